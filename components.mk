@@ -23,6 +23,12 @@ MQTT_TLS_DEFS += -DLWIP_ALTCP_TLS=1
 MQTT_TLS_DEFS += -DLWIP_ALTCP_TLS_MBEDTLS=1
 MQTT_TLS_DEFS += -DMEMP_NUM_ALTCP_PCB=4
 MQTT_TLS_DEFS += -DMBEDTLS_CONFIG_FILE='"user_mbedtls_config.h"'
+ifdef CFG_MQTT_TLS_IN_CONTENT_LEN
+MQTT_TLS_DEFS += -DOBK_TLS_IN_CONTENT_LEN=$(CFG_MQTT_TLS_IN_CONTENT_LEN)
+endif
+ifdef CFG_MQTT_TLS_OUT_CONTENT_LEN
+MQTT_TLS_DEFS += -DOBK_TLS_OUT_CONTENT_LEN=$(CFG_MQTT_TLS_OUT_CONTENT_LEN)
+endif
 CPPDEFINES += $(MQTT_TLS_DEFS) -Wno-misleading-indentation
 OSFLAGS += $(MQTT_TLS_DEFS)
 
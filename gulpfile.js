@@ -5,8 +5,12 @@ const through = require("through2");
 const path = require("path");
 const fs = require("fs");
 const readline = require("readline");
+const zlib = require("zlib");
+const crypto = require("crypto");
 
 const destination = "new_http.c";
+// gzipped files, included by new_http.c
+const destinationGz = "new_http_gz.h";
 
 function dumpFileSize() {
   return through.obj(function (file, enc, cb) {
@@ -17,6 +21,64 @@ function dumpFileSize() {
   });
 }
 
+/** Replaces (or appends) region of field_name in target file with output */
+function writeRegion(file, target, field_name, output, cb) {
+  const target_path = path.join(path.dirname(file.path), target);
+  //console.log(`Updated ${target_path}`);
+
+  const rl = readline.createInterface({
+    input: fs.createReadStream(target_path),
+    crlfDelay: Infinity,
+  });
+
+  const merged_contents = [];
+  const marker_start = `//region_start ${field_name}`;
+  const marker_end = `//region_end ${field_name}`;
+  let region_state = 0;
+
+  rl.on("line", (line) => {
+    if (line.trim() === marker_start) {
+      region_state = 1;
+      merged_contents.push(marker_start);
+      merged_contents.push(output);
+      merged_contents.push(marker_end);
+    } else {
+      //Skip all existing content lines till region ends
+      if (region_state === 1) {
+        if (line.trim() === marker_end) {
+          region_state = 2;
+        }
+      } else {
+        merged_contents.push(line);
+      }
+    }
+  });
+
+  rl.on("close", () => {
+    if (region_state === 0) {
+      //Starting marker was not found, append
+
+      merged_contents.push("");
+      merged_contents.push(marker_start);
+      merged_contents.push(output);
+      merged_contents.push(marker_end);
+    }
+
+    if (region_state === 1) {
+      cb(`Ending marker "${marker_end}" was not found.`, file);
+    } else {
+      fs.writeFile(
+        target_path,
+        merged_contents.join("\r\n"),
+        "utf8",
+        (err) => {
+          cb(err, file);
+        }
+      );
+    }
+  });
+}
+
 /** This function injects C for a const field in new_http.c */
 function generateCode(field_name, is_script) {
   return through.obj(function (file, enc, cb) {
@@ -33,61 +95,46 @@ function generateCode(field_name, is_script) {
       const suffix = is_script ? "</script>" : "</style>";
       output = `const char ${field_name}[] = "${prefix}${output}${suffix}";`;
 
-      const target_path = path.join(path.dirname(file.path), destination);
-      //console.log(`Updated ${target_path}`);
-
-      const rl = readline.createInterface({
-        input: fs.createReadStream(target_path),
-        crlfDelay: Infinity,
-      });
-
-      const merged_contents = [];
-      const marker_start = `//region_start ${field_name}`;
-      const marker_end = `//region_end ${field_name}`;
-      let region_state = 0;
-
-      rl.on("line", (line) => {
-        if (line.trim() === marker_start) {
-          region_state = 1;
-          merged_contents.push(marker_start);
-          merged_contents.push(output);
-          merged_contents.push(marker_end);
-        } else {
-          //Skip all existing content lines till region ends
-          if (region_state === 1) {
-            if (line.trim() === marker_end) {
-              region_state = 2;
-            }
-          } else {
-            merged_contents.push(line);
-          }
-        }
-      });
+      writeRegion(file, destination, field_name, output, cb);
+      return;
+    }
 
-      rl.on("close", () => {
-        if (region_state === 0) {
-          //Starting marker was not found, append
+    cb(null, file);
+  });
+}
 
-          merged_contents.push("");
-          merged_contents.push(marker_start);
-          merged_contents.push(output);
-          merged_contents.push(marker_end);
-        }
+/** Injects gzipped bytes of file and hash of its content into new_http_gz.h,
+ * served as a cacheable file (see http_fn_asset in new_http.c) */
+function generateGzCode(field_name, hash_name) {
+  return through.obj(function (file, enc, cb) {
+    if (file.isBuffer()) {
+      const contents = file.contents;
+      const gz = zlib.gzipSync(contents, { level: 9 });
+      const hash = crypto
+        .createHash("sha1")
+        .update(contents)
+        .digest("hex")
+        .substring(0, 8);
+      console.log(
+        `Processing ${file.basename}, gzipped length ${gz.length}, hash ${hash}`
+      );
 
-        if (region_state === 1) {
-          cb(`Ending marker "${marker_end}" was not found.`, file);
-        } else {
-          fs.writeFile(
-            target_path,
-            merged_contents.join("\r\n"),
-            "utf8",
-            (err) => {
-              cb(err, file);
-            }
-          );
+      const lines = [];
+      for (let i = 0; i < gz.length; i += 16) {
+        const row = [];
+        for (let j = i; j < i + 16 && j < gz.length; j++) {
+          row.push("0x" + gz[j].toString(16).padStart(2, "0"));
         }
-      });
-
+        lines.push("\t" + row.join(",") + ",");
+      }
+      const output = [
+        `#define ${hash_name} "${hash}"`,
+        `static const unsigned char ${field_name}[] = {`,
+        ...lines,
+        "};",
+      ].join("\r\n");
+
+      writeRegion(file, destinationGz, field_name, output, cb);
       return;
     }
 
@@ -100,7 +147,7 @@ function minifyJs() {
     .src("./src/httpserver/script.js")
     .pipe(dumpFileSize())
     .pipe(uglify())
-    .pipe(generateCode("pageScript", true));
+    .pipe(generateGzCode("pageScriptGz", "PAGESCRIPT_HASH"));
 }
 
 function minifyHassDiscoveryJs() {
@@ -116,7 +163,7 @@ function minifyCss() {
     .src("./src/httpserver/style.css")
     .pipe(dumpFileSize())
     .pipe(cssnano())
-    .pipe(generateCode("htmlHeadStyle", false));
+    .pipe(generateGzCode("htmlHeadStyleGz", "HTMLHEADSTYLE_HASH"));
 }
 
 exports.default = gulp.series(minifyJs, minifyHassDiscoveryJs, minifyCss);
@@ -236,22 +236,40 @@
 #endif
  // BK7231/RTL wraps malloc, free etc. to freertos ports. Some platforms don't do it.
 #if PLATFORM_W800 || PLATFORM_W600 || PLATFORM_LN882H
-#define BE_EXPLICIT_MALLOC pvPortMalloc
-#define BE_EXPLICIT_REALLOC pvPortRealloc
-#define BE_EXPLICIT_FREE vPortFree
+#define BE_SYS_MALLOC pvPortMalloc
+#define BE_SYS_REALLOC pvPortRealloc
+#define BE_SYS_FREE vPortFree
 #elif PLATFORM_TR6260 || PLATFORM_ECR6600
-#define BE_EXPLICIT_MALLOC os_malloc
-#define BE_EXPLICIT_FREE os_free
-#define BE_EXPLICIT_REALLOC os_realloc
+#define BE_SYS_MALLOC os_malloc
+#define BE_SYS_FREE os_free
+#define BE_SYS_REALLOC os_realloc
 #else
-#define BE_EXPLICIT_MALLOC malloc
-#define BE_EXPLICIT_FREE free
-#define BE_EXPLICIT_REALLOC realloc
+#define BE_SYS_MALLOC malloc
+#define BE_SYS_FREE free
+#define BE_SYS_REALLOC realloc
 #endif
 // normal realloc appears broken on OpenBK7231T: #1563, #298
 #if PLATFORM_BEKEN
-#undef BE_EXPLICIT_REALLOC
-#define BE_EXPLICIT_REALLOC os_realloc
+#undef BE_SYS_REALLOC
+#define BE_SYS_REALLOC os_realloc
+#endif
+
+/* With ENABLE_BERRY_ARENA the VM allocates from a dedicated arena,
+ * see src/berry/be_arena.c. The arena itself comes from BE_SYS_MALLOC.
+ **/
+#include "../src/obk_config.h"
+#if ENABLE_BERRY_ARENA
+#include <stddef.h>
+void *be_arena_malloc(size_t size);
+void *be_arena_realloc(void *ptr, size_t size);
+void be_arena_free(void *ptr);
+#define BE_EXPLICIT_MALLOC be_arena_malloc
+#define BE_EXPLICIT_REALLOC be_arena_realloc
+#define BE_EXPLICIT_FREE be_arena_free
+#else
+#define BE_EXPLICIT_MALLOC BE_SYS_MALLOC
+#define BE_EXPLICIT_REALLOC BE_SYS_REALLOC
+#define BE_EXPLICIT_FREE BE_SYS_FREE
 #endif
 
 /* Macro: be_assert
@@ -40,6 +40,8 @@ set(BERRY_SRC_C
 	${BERRY_SRCPATH}/be_vector.c
 	${BERRY_SRCPATH}/be_vm.c
 
+	${BERRY_MODULEPATH}/../be_arena.c
+	${BERRY_MODULEPATH}/../be_async.c
 	${BERRY_MODULEPATH}/../be_bindings.c
 	${BERRY_MODULEPATH}/../be_modtab.c
 	${BERRY_MODULEPATH}/../be_port.c
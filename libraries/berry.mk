@@ -47,6 +47,8 @@ BERRY_SRC_C += $(BERRY_SRCPATH)/be_vm.c
 ifeq ($(TARGET_PLATFORM),bk7231n)
 else ifeq ($(TARGET_PLATFORM),bk7231t)
 else
+BERRY_SRC_C += $(BERRY_MODULEPATH)/../be_arena.c
+BERRY_SRC_C += $(BERRY_MODULEPATH)/../be_async.c
 BERRY_SRC_C += $(BERRY_MODULEPATH)/../be_bindings.c
 BERRY_SRC_C += $(BERRY_MODULEPATH)/../be_modtab.c
 BERRY_SRC_C += $(BERRY_MODULEPATH)/../be_port.c
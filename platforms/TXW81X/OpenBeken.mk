@@ -12,6 +12,7 @@ SRC_C  += $(OBK_DIR)/src/hal/txw81x/hal_ota_txw81x.c
 SRC_C  += $(OBK_DIR)/src/hal/txw81x/hal_pins_txw81x.c
 SRC_C  += $(OBK_DIR)/src/hal/txw81x/hal_wifi_txw81x.c
 SRC_C  += $(OBK_DIR)/src/driver/drv_txw81x_camera.c
+SRC_C  += $(OBK_DIR)/src/driver/drv_txw81x_frames.c
 
 OBK_SRCS = $(OBK_DIR)/src/
 include $(OBK_DIR)/platforms/obk_main.mk
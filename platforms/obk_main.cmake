@@ -1,11 +1,13 @@
 set(OBKM_SRC
 	${OBK_SRCS}user_main.c
 
+	${OBK_SRCS}assets/obk_assets.c
 	${OBK_SRCS}base64/base64.c
 	${OBK_SRCS}bitmessage/bitmessage_read.c
 	${OBK_SRCS}bitmessage/bitmessage_write.c
 	${OBK_SRCS}cmnds/cmd_berry.c
 	${OBK_SRCS}cmnds/cmd_channels.c
+	${OBK_SRCS}cmnds/cmd_channelStats.c
 	${OBK_SRCS}cmnds/cmd_enums.c
 	${OBK_SRCS}cmnds/cmd_eventHandlers.c
 	${OBK_SRCS}cmnds/cmd_if.c
@@ -16,6 +18,8 @@ set(OBKM_SRC
 	${OBK_SRCS}cmnds/cmd_send.c
 	${OBK_SRCS}cmnds/cmd_script.c
 	${OBK_SRCS}cmnds/cmd_simulatorOnly.c
+	${OBK_SRCS}cmnds/cmd_stringPool.c
+	${OBK_SRCS}cmnds/cmd_timerHeap.c
 	${OBK_SRCS}cmnds/cmd_tasmota.c
 	${OBK_SRCS}cmnds/cmd_tcp.c
 	${OBK_SRCS}cmnds/cmd_test.c
@@ -24,6 +28,7 @@ set(OBKM_SRC
 	${OBK_SRCS}devicegroups/deviceGroups_util.c
 	${OBK_SRCS}devicegroups/deviceGroups_write.c
 	${OBK_SRCS}hal/generic/hal_adc_generic.c
+	${OBK_SRCS}hal/generic/hal_assets_generic.c
 	${OBK_SRCS}hal/generic/hal_flashConfig_generic.c
 	${OBK_SRCS}hal/generic/hal_flashVars_generic.c
 	${OBK_SRCS}hal/generic/hal_generic.c
@@ -35,6 +40,7 @@ set(OBKM_SRC
 	${OBK_SRCS}httpserver/hass.c
 	${OBK_SRCS}httpserver/http_basic_auth.c
 	${OBK_SRCS}httpserver/http_fns.c
+	${OBK_SRCS}httpserver/http_sse.c
 	${OBK_SRCS}httpserver/http_tcp_server.c
 	${OBK_SRCS}httpserver/new_tcp_server.c
 	${OBK_SRCS}httpserver/json_interface.c
@@ -43,10 +49,15 @@ set(OBKM_SRC
 	${OBK_SRCS}mqtt/new_mqtt_deduper.c
 	${OBK_SRCS}jsmn/jsmn.c
 	${OBK_SRCS}logging/logging.c
+	${OBK_SRCS}logging/cpuProfiler.c
+	${OBK_SRCS}logging/ioTrace.c
+	${OBK_SRCS}memory/heapTracker.c
+	${OBK_SRCS}memory/memPool.c
 	${OBK_SRCS}mqtt/new_mqtt.c
 	${OBK_SRCS}new_cfg.c
 	${OBK_SRCS}new_common.c
 	${OBK_SRCS}new_ping.c
+	${OBK_SRCS}new_pingStats.c
 	${OBK_SRCS}new_pins.c
 	${OBK_SRCS}rgb2hsv.c
 	${OBK_SRCS}tiny_crc8.c
@@ -54,16 +65,19 @@ set(OBKM_SRC
 	${OBK_SRCS}httpclient/utils_net.c
 	${OBK_SRCS}httpclient/utils_timer.c
 	${OBK_SRCS}littlefs/our_lfs.c
+	${OBK_SRCS}littlefs/lfs_records.c
 
 	${OBK_SRCS}driver/drv_main.c
 
 	${OBK_SRCS}driver/drv_adcButton.c
+	${OBK_SRCS}driver/drv_adcSampler.c
 	${OBK_SRCS}driver/drv_adcSmoother.c
 	${OBK_SRCS}driver/drv_aht2x.c
 	${OBK_SRCS}driver/drv_battery.c
 	${OBK_SRCS}driver/drv_bl0937.c
 	${OBK_SRCS}driver/drv_bl0942.c
 	${OBK_SRCS}driver/drv_bl_shared.c
+	${OBK_SRCS}driver/drv_bl_history.c
 	${OBK_SRCS}driver/drv_bmpi2c.c
 	${OBK_SRCS}driver/drv_bp1658cj.c
 	${OBK_SRCS}driver/drv_bp5758d.c
@@ -74,6 +88,10 @@ set(OBKM_SRC
 	${OBK_SRCS}driver/drv_cse7761.c
 	${OBK_SRCS}driver/drv_cse7766.c
 	${OBK_SRCS}driver/drv_ddp.c
+	${OBK_SRCS}driver/drv_e131.c
+	${OBK_SRCS}driver/drv_chSync.c
+	${OBK_SRCS}driver/drv_mdns.c
+	${OBK_SRCS}driver/drv_display_shared.c
 	${OBK_SRCS}driver/drv_dmx512.c
 	${OBK_SRCS}driver/drv_debouncer.c
 	${OBK_SRCS}driver/drv_dht_internal.c
@@ -84,6 +102,9 @@ set(OBKM_SRC
 	${OBK_SRCS}driver/drv_ds1820_simple.c
 	${OBK_SRCS}driver/drv_ds1820_full.c
 	${OBK_SRCS}driver/drv_freeze.c
+	${OBK_SRCS}driver/drv_powerGov.c
+	${OBK_SRCS}driver/drv_wifiRoam.c
+	${OBK_SRCS}driver/drv_modbus.c
 	${OBK_SRCS}driver/drv_gn6932.c
 	${OBK_SRCS}driver/drv_hd2015.c
 	${OBK_SRCS}driver/drv_hgs02.c
@@ -100,6 +121,7 @@ set(OBKM_SRC
 	${OBK_SRCS}driver/drv_mcp9808.c
 	${OBK_SRCS}driver/drv_multiPinI2CScanner.c
 	${OBK_SRCS}driver/drv_ntp.c
+	${OBK_SRCS}driver/drv_ntp_actions.c
 	${OBK_SRCS}driver/drv_deviceclock.c
 	${OBK_SRCS}driver/drv_ds3231.c
 	${OBK_SRCS}driver/drv_neo6m.c
@@ -112,6 +134,7 @@ set(OBKM_SRC
 	${OBK_SRCS}driver/drv_pwm_groups.c
 	${OBK_SRCS}driver/drv_pwmToggler.c
 	${OBK_SRCS}driver/drv_pwrCal.c
+	${OBK_SRCS}driver/drv_rc_edges.c
 	${OBK_SRCS}driver/drv_rn8209.c
 	${OBK_SRCS}driver/drv_sgp.c
 	${OBK_SRCS}driver/drv_shiftRegister.c
@@ -119,6 +142,8 @@ set(OBKM_SRC
 	${OBK_SRCS}driver/drv_sm2135.c
 	${OBK_SRCS}driver/drv_sm2235.c
 	${OBK_SRCS}driver/drv_soft_i2c.c
+	${OBK_SRCS}driver/drv_i2c_sched.c
+	${OBK_SRCS}driver/drv_sensor_acq.c
 	${OBK_SRCS}driver/drv_soft_spi.c
 	${OBK_SRCS}driver/drv_sm15155e.c
 	${OBK_SRCS}driver/drv_sm16703P.c
@@ -15,12 +15,14 @@ OBKM_SRC_CXX =
 
 OBKM_SRC  += $(OBK_SRCS)user_main.c
 
+OBKM_SRC  += $(OBK_SRCS)assets/obk_assets.c
 OBKM_SRC  += $(OBK_SRCS)base64/base64.c
 OBKM_SRC  += $(OBK_SRCS)bitmessage/bitmessage_read.c
 OBKM_SRC  += $(OBK_SRCS)bitmessage/bitmessage_write.c
 OBKM_SRC  += $(OBK_SRCS)cJSON/cJSON.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_berry.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_channels.c
+OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_channelStats.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_enums.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_eventHandlers.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_if.c
@@ -31,6 +33,8 @@ OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_repeatingEvents.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_send.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_script.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_simulatorOnly.c
+OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_stringPool.c
+OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_timerHeap.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_tasmota.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_tcp.c
 OBKM_SRC  += $(OBK_SRCS)cmnds/cmd_test.c
@@ -39,6 +43,7 @@ OBKM_SRC  += $(OBK_SRCS)devicegroups/deviceGroups_read.c
 OBKM_SRC  += $(OBK_SRCS)devicegroups/deviceGroups_util.c
 OBKM_SRC  += $(OBK_SRCS)devicegroups/deviceGroups_write.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_adc_generic.c
+OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_assets_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_flashConfig_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_flashVars_generic.c
 OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_generic.c
@@ -50,6 +55,7 @@ OBKM_SRC  += $(OBK_SRCS)hal/generic/hal_uart_generic.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/hass.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/http_basic_auth.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/http_fns.c
+OBKM_SRC  += $(OBK_SRCS)httpserver/http_sse.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/http_tcp_server.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/new_tcp_server.c
 OBKM_SRC  += $(OBK_SRCS)httpserver/json_interface.c
@@ -58,10 +64,15 @@ OBKM_SRC  += $(OBK_SRCS)httpserver/rest_interface.c
 OBKM_SRC  += $(OBK_SRCS)mqtt/new_mqtt_deduper.c
 OBKM_SRC  += $(OBK_SRCS)jsmn/jsmn.c
 OBKM_SRC  += $(OBK_SRCS)logging/logging.c
+OBKM_SRC  += $(OBK_SRCS)logging/cpuProfiler.c
+OBKM_SRC  += $(OBK_SRCS)logging/ioTrace.c
+OBKM_SRC  += $(OBK_SRCS)memory/heapTracker.c
+OBKM_SRC  += $(OBK_SRCS)memory/memPool.c
 OBKM_SRC  += $(OBK_SRCS)mqtt/new_mqtt.c
 OBKM_SRC  += $(OBK_SRCS)new_cfg.c
 OBKM_SRC  += $(OBK_SRCS)new_common.c
 OBKM_SRC  += $(OBK_SRCS)new_ping.c
+OBKM_SRC  += $(OBK_SRCS)new_pingStats.c
 OBKM_SRC  += $(OBK_SRCS)new_pins.c
 OBKM_SRC  += $(OBK_SRCS)rgb2hsv.c
 OBKM_SRC  += $(OBK_SRCS)tiny_crc8.c
@@ -71,16 +82,19 @@ OBKM_SRC  += $(OBK_SRCS)httpclient/utils_timer.c
 OBKM_SRC  += $(OBK_SRCS)littlefs/lfs_util.c
 OBKM_SRC  += $(OBK_SRCS)littlefs/lfs.c
 OBKM_SRC  += $(OBK_SRCS)littlefs/our_lfs.c
+OBKM_SRC  += $(OBK_SRCS)littlefs/lfs_records.c
 
 OBKM_SRC  += $(OBK_SRCS)driver/drv_main.c
 
 OBKM_SRC  += $(OBK_SRCS)driver/drv_adcButton.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_adcSampler.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_adcSmoother.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_aht2x.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_battery.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_bl0937.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_bl0942.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_bl_shared.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_bl_history.c
 #OBKM_SRC += $(OBK_SRCS)driver/drv_bmp280.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_bmpi2c.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_bkPartitions.c
@@ -93,9 +107,13 @@ OBKM_SRC  += $(OBK_SRCS)driver/drv_cht8305.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_cse7761.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_cse7766.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_ddp.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_e131.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_chSync.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_mdns.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_debouncer.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_dht_internal.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_dht.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_display_shared.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_dmx512.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_drawers.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_doorSensorWithDeepSleep.c
@@ -103,6 +121,9 @@ OBKM_SRC  += $(OBK_SRCS)driver/drv_ds1820_common.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_ds1820_simple.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_ds1820_full.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_freeze.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_powerGov.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_wifiRoam.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_modbus.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_gn6932.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_hd2015.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_hgs02.c
@@ -120,6 +141,7 @@ OBKM_SRC  += $(OBK_SRCS)driver/drv_max72xx_single.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_mcp9808.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_multiPinI2CScanner.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_ntp.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_ntp_actions.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_deviceclock.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_ds3231.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_neo6m.c
@@ -132,6 +154,7 @@ OBKM_SRC  += $(OBK_SRCS)driver/drv_pt6523.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_pwm_groups.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_pwmToggler.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_pwrCal.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_rc_edges.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_rn8209.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_sgp.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_shiftRegister.c
@@ -144,6 +167,8 @@ OBKM_SRC  += $(OBK_SRCS)driver/drv_ltr_als.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_sm2135.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_sm2235.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_soft_i2c.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_i2c_sched.c
+OBKM_SRC  += $(OBK_SRCS)driver/drv_sensor_acq.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_soft_spi.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_spi.c
 OBKM_SRC  += $(OBK_SRCS)driver/drv_spiLED.c
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+# Decodes OpenBeken log with binary records (see "logBinary 1" and addLogBin).
+# Record is 0x1E, length of the rest, kind ('F' format, 'H' hex), level,
+# feature, 32 bit address of format or title, then arguments or bytes.
+# Strings are read from firmware ELF the log was made with.
+#
+#   python3 decode_binlog.py OpenBK7231T_App.elf capture.bin
+#   python3 decode_binlog.py OpenBK7231T_App.elf 192.168.0.123:9000
+import re
+import socket
+import struct
+import sys
+
+LOG_BIN_MARKER = 0x1E
+
+
+class Elf:
+	def __init__(self, path):
+		with open(path, 'rb') as f:
+			self.data = f.read()
+		d = self.data
+		if d[:4] != b'\x7fELF' or d[4] != 1:
+			raise ValueError('only 32 bit ELF is supported')
+		self.e = '<' if d[5] == 1 else '>'
+		shoff, = struct.unpack_from(self.e + 'I', d, 0x20)
+		shentsize, shnum, shstrndx = struct.unpack_from(self.e + 'HHH', d, 0x2E)
+		self.sections = []
+		for i in range(shnum):
+			self.sections.append(struct.unpack_from(self.e + 'IIIIIIIIII', d, shoff + i * shentsize))
+		self.symbols = {}
+		for s in self.sections:
+			# SHT_SYMTAB, link is its string table
+			if s[1] == 2:
+				strtab = self.sections[s[6]]
+				for off in range(s[4], s[4] + s[5], 16):
+					name, value = struct.unpack_from(self.e + 'II', d, off)
+					self.symbols[self.cstr_at(strtab[4] + name)] = value
+
+	def cstr_at(self, off):
+		end = self.data.index(b'\0', off)
+		return self.data[off:end].decode('utf-8', 'replace')
+
+	def read(self, addr, size):
+		for s in self.sections:
+			# SHF_ALLOC, not NOBITS
+			if (s[2] & 2) and s[1] != 8 and s[3] <= addr < s[3] + s[5]:
+				off = s[4] + addr - s[3]
+				return self.data[off:off + size]
+		return None
+
+	def string(self, addr):
+		b = self.read(addr, 512)
+		if b is None:
+			return None
+		return b.split(b'\0')[0].decode('utf-8', 'replace')
+
+	def names(self, symbol, count):
+		base = self.symbols.get(symbol)
+		res = []
+		if base is None:
+			return res
+		for i in range(count):
+			b = self.read(base + i * 4, 4)
+			if b is None:
+				break
+			res.append(self.string(struct.unpack(self.e + 'I', b)[0]) or '?')
+		return res
+
+
+SPEC = re.compile(r'%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|q|j|z|t|L)?([diouxXcpfFeEgGaAs%])')
+
+
+def format_record(fmt, args):
+	out = []
+	pos = 0
+	last = 0
+	for m in SPEC.finditer(fmt):
+		out.append(fmt[last:m.start()])
+		last = m.end()
+		flags, width, prec, length, conv = m.groups()
+		if conv == '%':
+			out.append('%')
+			continue
+		if width == '*':
+			width = str(struct.unpack_from('<i', args, pos)[0])
+			pos += 4
+		if prec == '*':
+			prec = str(struct.unpack_from('<i', args, pos)[0])
+			pos += 4
+		spec = '%' + (flags or '') + (width or '') + ('.' + prec if prec is not None else '')
+		try:
+			if conv == 's':
+				n = args[pos]
+				out.append((spec + 's') % args[pos + 1:pos + 1 + n].decode('utf-8', 'replace'))
+				pos += 1 + n
+			elif conv in 'fFeEgGaA':
+				v, = struct.unpack_from('<d', args, pos)
+				pos += 8
+				out.append((spec + ('f' if conv in 'aA' else conv)) % v)
+			else:
+				big = length in ('ll', 'q', 'j')
+				size = 8 if big else 4
+				signed = conv in 'di'
+				v, = struct.unpack_from('<' + ({8: 'q', 4: 'i'} if signed else {8: 'Q', 4: 'I'})[size], args, pos)
+				pos += size
+				if conv == 'c':
+					out.append(chr(v & 0xFF))
+				elif conv == 'p':
+					out.append('0x%08x' % v)
+				else:
+					out.append((spec + ('d' if conv == 'i' else conv)) % v)
+		except (IndexError, struct.error):
+			out.append('<?>')
+			break
+	out.append(fmt[last:])
+	return ''.join(out)
+
+
+class Decoder:
+	def __init__(self, elf):
+		self.elf = elf
+		self.levels = elf.names('loglevelnames', 10)
+		self.features = elf.names('logfeaturenames', 64)
+		self.buf = bytearray()
+
+	def prefix(self, level, feature):
+		lv = self.levels[level] if level < len(self.levels) else '%i:' % level
+		ft = self.features[feature] if feature < len(self.features) else '%i:' % feature
+		return lv + ft
+
+	def record(self, rec):
+		kind, level, feature = rec[0], rec[1], rec[2]
+		addr, = struct.unpack_from('<I', rec, 3)
+		payload = bytes(rec[7:])
+		text = self.elf.string(addr)
+		if text is None:
+			text = '<unknown 0x%08x>' % addr
+		if kind == ord('H'):
+			line = text + ': ' + ''.join('%02X ' % b for b in payload)
+		else:
+			line = format_record(text, payload)
+		return self.prefix(level, feature) + line.rstrip('\r\n') + '\n'
+
+	def feed(self, data):
+		self.buf += data
+		out = []
+		while self.buf:
+			i = self.buf.find(bytes([LOG_BIN_MARKER]))
+			if i < 0:
+				out.append(self.buf.decode('utf-8', 'replace'))
+				self.buf.clear()
+				break
+			if i:
+				out.append(self.buf[:i].decode('utf-8', 'replace'))
+				del self.buf[:i]
+			if len(self.buf) < 2 or len(self.buf) < 2 + self.buf[1]:
+				break
+			n = self.buf[1]
+			if n >= 7:
+				out.append(self.record(self.buf[2:2 + n]))
+			del self.buf[:2 + n]
+		return ''.join(out)
+
+
+def main():
+	if len(sys.argv) != 3:
+		print(__doc__ or 'usage: decode_binlog.py firmware.elf capture|host:port')
+		sys.exit(1)
+	dec = Decoder(Elf(sys.argv[1]))
+	src = sys.argv[2]
+	m = re.match(r'^([\w.-]+):(\d+)$', src)
+	if m:
+		s = socket.create_connection((m.group(1), int(m.group(2))))
+		read = lambda: s.recv(1024)
+	else:
+		f = open(src, 'rb')
+		read = lambda: f.read(4096)
+	while True:
+		data = read()
+		if not data:
+			break
+		sys.stdout.write(dec.feed(data))
+		sys.stdout.flush()
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# Builds OpenBeken asset image from a directory, see obk_assets.c.
+# Files are served read-only from flash at /api/assets/<name>, name.gz is
+# sent gzipped for name, and Berry can import modules from there when they
+# are not in LittleFS. Web app can be put there and opened at
+# http://device/api/assets/index.html
+# ESP32 needs a partition for it in partitions.csv, for example:
+#   assets, data, spiffs, , 256K
+#
+#   python3 mkassets.py webapp/ assets.bin
+#   curl --data-binary @assets.bin http://device/api/assets
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = b'OBKA'
+VERSION = 1
+NAME_SIZE = 36
+HEADER_SIZE = 16
+ENTRY_SIZE = NAME_SIZE + 12
+
+
+def collect(root):
+	files = []
+	for d, dirs, names in os.walk(root):
+		dirs.sort()
+		for n in names:
+			path = os.path.join(d, n)
+			name = os.path.relpath(path, root).replace(os.sep, '/')
+			if len(name.encode()) >= NAME_SIZE:
+				raise ValueError('name too long (max %d): %s' % (NAME_SIZE - 1, name))
+			with open(path, 'rb') as f:
+				files.append((name.encode(), f.read()))
+	# firmware looks names up with binary search
+	files.sort(key=lambda x: x[0])
+	return files
+
+
+def build(files):
+	offset = HEADER_SIZE + len(files) * ENTRY_SIZE
+	index = bytearray()
+	data = bytearray()
+	for name, body in files:
+		pad = (-(offset + len(data))) % 4
+		data += b'\0' * pad
+		index += name.ljust(NAME_SIZE, b'\0')
+		index += struct.pack('<III', offset + len(data), len(body), zlib.crc32(body) & 0xFFFFFFFF)
+		data += body
+	size = offset + len(data)
+	header = MAGIC + struct.pack('<HHII', VERSION, len(files), size, zlib.crc32(bytes(index)) & 0xFFFFFFFF)
+	return header + bytes(index) + bytes(data)
+
+
+def main():
+	if len(sys.argv) != 3:
+		print('usage: mkassets.py directory out.bin')
+		sys.exit(1)
+	files = collect(sys.argv[1])
+	image = build(files)
+	with open(sys.argv[2], 'wb') as f:
+		f.write(image)
+	print('%d files, %d bytes' % (len(files), len(image)))
+
+
+if __name__ == '__main__':
+	main()
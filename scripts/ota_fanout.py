@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# Updates many OpenBeken devices, with devices feeding each other instead
+# of all pulling from one server. Seed devices pull image from url, then
+# every round each updated device serves its own image to one device still
+# waiting, so updated set doubles and fleet is done in log2(N) rounds.
+# Devices that serve must have "otaRelay 1" (see /api/otarelay), updated
+# devices come up with it when it is in autoexec. Only platforms with
+# ota_http pull (Beken) can be fed by peers, others can only serve.
+#
+#   python3 ota_fanout.py --url http://server/OpenBK7231N.rbl --build 1.17.500 10.0.0.11 10.0.0.12 ...
+#   python3 ota_fanout.py --url ... --seeds 2 --timeout 300 --user admin --password pass hosts...
+import argparse
+import base64
+import json
+import time
+import urllib.parse
+import urllib.request
+
+
+class Device:
+	def __init__(self, host, auth):
+		self.host = host
+		self.auth = auth
+
+	def get(self, path, timeout=5):
+		req = urllib.request.Request('http://%s/%s' % (self.host, path))
+		if self.auth:
+			req.add_header('Authorization', 'Basic ' + base64.b64encode(self.auth.encode()).decode())
+		with urllib.request.urlopen(req, timeout=timeout) as r:
+			return r.read()
+
+	def command(self, cmd):
+		return self.get('cm?cmnd=' + urllib.parse.quote(cmd))
+
+	def build(self):
+		try:
+			return json.loads(self.get('api/info')).get('build')
+		except (OSError, ValueError):
+			return None
+
+	def relay(self):
+		try:
+			return json.loads(self.get('api/otarelay'))
+		except (OSError, ValueError):
+			return {}
+
+	def pull(self, url):
+		self.command('ota_http ' + url)
+
+	def source_url(self):
+		return 'http://%s/api/otarelay/image' % self.host
+
+
+def wait_updated(devs, build, timeout):
+	# device reboots into new build, or stays on old one when OTA failed
+	done = []
+	end = time.time() + timeout
+	pending = list(devs)
+	while pending and time.time() < end:
+		time.sleep(5)
+		for d in list(pending):
+			b = d.build()
+			if b is not None and build in b:
+				done.append(d)
+				pending.remove(d)
+	return done, pending
+
+
+def main():
+	ap = argparse.ArgumentParser(description='fan out OTA from device to device')
+	ap.add_argument('--url', required=True, help='image for seed devices')
+	ap.add_argument('--build', required=True, help='text in /api/info build of new firmware')
+	ap.add_argument('--seeds', type=int, default=1, help='devices that pull from url')
+	ap.add_argument('--timeout', type=int, default=240, help='seconds one round may take')
+	ap.add_argument('--user', default='admin')
+	ap.add_argument('--password', default='')
+	ap.add_argument('hosts', nargs='+')
+	args = ap.parse_args()
+	auth = '%s:%s' % (args.user, args.password) if args.password else None
+
+	devs = [Device(h, auth) for h in args.hosts]
+	updated = [d for d in devs if args.build in (d.build() or '')]
+	waiting = [d for d in devs if d not in updated]
+	failed = []
+	print('%d devices, %d already on %s' % (len(devs), len(updated), args.build))
+
+	if not updated and waiting:
+		seeds = waiting[:args.seeds]
+		waiting = waiting[args.seeds:]
+		print('round 0: %d seeds pull %s' % (len(seeds), args.url))
+		for d in seeds:
+			d.pull(args.url)
+		done, lost = wait_updated(seeds, args.build, args.timeout)
+		updated += done
+		failed += lost
+
+	rnd = 1
+	while waiting:
+		sources = [d for d in updated if d.relay().get('image')]
+		if not sources:
+			print('no updated device serves its image, is otaRelay 1 in autoexec?')
+			break
+		pairs = list(zip(sources, waiting))
+		waiting = waiting[len(pairs):]
+		print('round %d: %d transfers, %d left' % (rnd, len(pairs), len(waiting)))
+		for src, dst in pairs:
+			dst.pull(src.source_url())
+		done, lost = wait_updated([dst for src, dst in pairs], args.build, args.timeout)
+		updated += done
+		failed += lost
+		rnd += 1
+
+	print('updated %d, failed %d, not reached %d' % (len(updated), len(failed), len(waiting)))
+	for d in failed + waiting:
+		print('  not updated: ' + d.host)
+
+
+if __name__ == '__main__':
+	main()
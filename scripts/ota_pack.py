@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# Packs OpenBeken OTA image, see OTA_Unpack_* in hal_ota_generic.c.
+# Image is compressed with copies from last 4 KB of output, and with
+# --base it is a delta against image running on device. Unpacked image
+# and base are checked with CRC32, so a delta is refused by firmware that
+# was not built from the same base.
+#
+#   python3 ota_pack.py new.bin new.obkp
+#   python3 ota_pack.py --base old.bin new.bin new.obkp
+import struct
+import sys
+import zlib
+
+MAGIC = b'OBKP'
+VERSION = 1
+FLAG_DELTA = 1
+WINDOW = 4096
+OP_BASE = 0xC0
+MIN_MATCH = 3
+MAX_MATCH = 66
+# base copy below that costs more than literals around it
+MIN_BASE_MATCH = 12
+BLOCK = 16
+
+
+def varint(v):
+	out = bytearray()
+	while True:
+		b = v & 0x7F
+		v >>= 7
+		if v:
+			out.append(b | 0x80)
+		else:
+			out.append(b)
+			return bytes(out)
+
+
+def zigzag(v):
+	return (v << 1) if v >= 0 else ((-v - 1) << 1) | 1
+
+
+def match_len(a, ai, b, bi, limit):
+	n = 0
+	while n < limit and ai + n < len(a) and bi + n < len(b) and a[ai + n] == b[bi + n]:
+		n += 1
+	return n
+
+
+class Packer:
+	def __init__(self, data, base):
+		self.data = data
+		self.base = base or b''
+		self.out = bytearray()
+		self.literals = bytearray()
+		self.chains = {}
+		self.blocks = {}
+		for i in range(0, len(self.base) - BLOCK + 1, BLOCK):
+			self.blocks.setdefault(self.base[i:i + BLOCK], i)
+
+	def flush_literals(self):
+		lit = self.literals
+		for i in range(0, len(lit), 128):
+			part = lit[i:i + 128]
+			self.out.append(len(part) - 1)
+			self.out += part
+		self.literals = bytearray()
+
+	def find_base(self, pos):
+		d = self.data
+		if pos + BLOCK > len(d):
+			return 0, 0
+		start = self.blocks.get(bytes(d[pos:pos + BLOCK]))
+		if start is None:
+			return 0, 0
+		return start, match_len(d, pos, self.base, start, len(d))
+
+	def find_window(self, pos):
+		d = self.data
+		best, dist = 0, 0
+		if pos + MIN_MATCH > len(d):
+			return 0, 0
+		for cand in reversed(self.chains.get(bytes(d[pos:pos + MIN_MATCH]), [])[-32:]):
+			if pos - cand > WINDOW:
+				break
+			n = match_len(d, pos, d, cand, MAX_MATCH)
+			if n > best:
+				best, dist = n, pos - cand
+				if n == MAX_MATCH:
+					break
+		return best, dist
+
+	def remember(self, pos, count):
+		d = self.data
+		for i in range(pos, min(pos + count, len(d) - MIN_MATCH + 1)):
+			self.chains.setdefault(bytes(d[i:i + MIN_MATCH]), []).append(i)
+
+	def pack(self):
+		d = self.data
+		pos = 0
+		while pos < len(d):
+			bstart, blen = self.find_base(pos)
+			if blen >= MIN_BASE_MATCH:
+				self.flush_literals()
+				self.out.append(OP_BASE)
+				self.out += varint(blen) + varint(zigzag(bstart - pos))
+				self.remember(pos, blen)
+				pos += blen
+				continue
+			wlen, dist = self.find_window(pos)
+			if wlen >= MIN_MATCH:
+				self.flush_literals()
+				self.out.append(0x80 | (wlen - MIN_MATCH))
+				self.out += struct.pack('<H', dist)
+				self.remember(pos, wlen)
+				pos += wlen
+				continue
+			self.literals.append(d[pos])
+			self.remember(pos, 1)
+			pos += 1
+		self.flush_literals()
+		flags = FLAG_DELTA if self.base else 0
+		header = MAGIC + struct.pack('<BBHIIII', VERSION, flags, 0, len(d), zlib.crc32(d) & 0xFFFFFFFF,
+			len(self.base), zlib.crc32(self.base) & 0xFFFFFFFF if self.base else 0)
+		return header + bytes(self.out)
+
+
+def main():
+	args = sys.argv[1:]
+	base = None
+	if len(args) == 4 and args[0] == '--base':
+		with open(args[1], 'rb') as f:
+			base = f.read()
+		args = args[2:]
+	if len(args) != 2:
+		print('usage: ota_pack.py [--base running.bin] new.bin out.obkp')
+		sys.exit(1)
+	with open(args[0], 'rb') as f:
+		data = f.read()
+	packed = Packer(data, base).pack()
+	with open(args[1], 'wb') as f:
+		f.write(packed)
+	print('%d -> %d bytes (%.1f%%)' % (len(data), len(packed), 100.0 * len(packed) / max(len(data), 1)))
+
+
+if __name__ == '__main__':
+	main()
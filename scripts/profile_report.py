@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# Names addresses of OpenBeken CPU profile (see profile_start and
+# /api/profile) from firmware ELF it was taken with, and prints share of
+# each task, function and address. Beken profile has tasks only.
+#
+#   python3 profile_report.py OpenBL602_App.elf 192.168.0.123
+#   python3 profile_report.py OpenBL602_App.elf profile.json [Count]
+import json
+import struct
+import sys
+import urllib.request
+
+
+class Elf:
+	def __init__(self, path):
+		with open(path, 'rb') as f:
+			d = f.read()
+		if d[:4] != b'\x7fELF' or d[4] != 1:
+			raise ValueError('only 32 bit ELF is supported')
+		e = '<' if d[5] == 1 else '>'
+		shoff, = struct.unpack_from(e + 'I', d, 0x20)
+		shentsize, shnum = struct.unpack_from(e + 'HH', d, 0x2E)
+		sections = [struct.unpack_from(e + 'IIIIIIIIII', d, shoff + i * shentsize) for i in range(shnum)]
+		funcs = []
+		for s in sections:
+			# SHT_SYMTAB, link is its string table
+			if s[1] != 2:
+				continue
+			strtab = sections[s[6]][4]
+			for off in range(s[4], s[4] + s[5], 16):
+				name, value, size, info = struct.unpack_from(e + 'IIIB', d, off)
+				# STT_FUNC
+				if info & 0xF == 2:
+					end = d.index(b'\0', strtab + name)
+					# thumb functions have bit 0 set
+					funcs.append((value & ~1, size, d[strtab + name:end].decode('utf-8', 'replace')))
+		funcs.sort()
+		self.starts = [f[0] for f in funcs]
+		self.funcs = funcs
+
+	def function(self, addr):
+		lo, hi = 0, len(self.starts)
+		while lo < hi:
+			mid = (lo + hi) // 2
+			if self.starts[mid] <= addr:
+				lo = mid + 1
+			else:
+				hi = mid
+		if lo == 0:
+			return None
+		start, size, name = self.funcs[lo - 1]
+		# symbols without size are taken up to next one
+		if size and addr >= start + size:
+			return None
+		return name, addr - start
+
+
+def load(src):
+	if src.endswith('.json'):
+		with open(src) as f:
+			return json.load(f)
+	if not src.startswith('http'):
+		src = 'http://' + src + '/api/profile'
+	with urllib.request.urlopen(src, timeout=10) as r:
+		return json.load(r)
+
+
+def table(title, counts, total, count):
+	print('%s:' % title)
+	for name, n in sorted(counts.items(), key=lambda x: -x[1])[:count]:
+		print('%7i %5.1f%%  %s' % (n, 100.0 * n / total, name))
+	print()
+
+
+def main():
+	if len(sys.argv) < 3:
+		print('usage: profile_report.py firmware.elf host|profile.json [Count]')
+		sys.exit(1)
+	elf = Elf(sys.argv[1])
+	prof = load(sys.argv[2])
+	count = int(sys.argv[3]) if len(sys.argv) > 3 else 30
+	tasks = [t['name'] for t in prof['tasks']]
+	total = prof['samples'] or 1
+	print('%i samples at %i Hz, %i dropped' % (prof['samples'], prof['hz'], prof['dropped']))
+	print()
+	table('tasks', dict((t['name'], t['samples']) for t in prof['tasks']), total, count)
+	funcs = {}
+	addrs = {}
+	for e in prof['pcs']:
+		pc = int(e['pc'], 16)
+		if pc == 0:
+			continue
+		task = tasks[e['task']] if e['task'] < len(tasks) else '?'
+		f = elf.function(pc)
+		fname = f[0] if f else '0x%08x' % pc
+		funcs[fname] = funcs.get(fname, 0) + e['n']
+		where = '%s+0x%x' % f if f else '?'
+		key = '0x%08x %-40s [%s]' % (pc, where, task)
+		addrs[key] = addrs.get(key, 0) + e['n']
+	if not funcs:
+		print('no addresses in profile, platform samples tasks only')
+		return
+	table('functions', funcs, total, count)
+	table('addresses', addrs, total, count)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,2 @@
+cd /d "%~dp0.."
+openBeken_win32.exe -runUnitTests 0 -fleet 50 -port 9000 -timeScale 1
\ No newline at end of file
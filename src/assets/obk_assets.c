@@ -0,0 +1,224 @@
+#include "obk_assets.h"
+#include "../logging/logging.h"
+#include "../hal/hal_assets.h"
+#include "../hal/hal_ota.h"
+
+#if ENABLE_ASSETS
+
+// Read-only asset image, made by scripts/mkassets.py and written as a
+// whole to asset partition (POST /api/assets). All numbers are little
+// endian:
+//   header  "OBKA", u16 version, u16 count, u32 image size, u32 CRC32 of index
+//   index   count entries sorted by name:
+//           char name[36] (zero padded), u32 offset, u32 size, u32 CRC32 of data
+//   data    files one after another, each at 4 byte aligned offset
+// There is no allocation and nothing is copied, when partition is memory
+// mapped lookups and serving walk flash directly.
+#define ASSETS_MAGIC		"OBKA"
+#define ASSETS_VERSION		1
+#define ASSETS_HEADER_SIZE	16
+#define ASSETS_ENTRY_SIZE	(ASSETS_NAME_SIZE + 12)
+
+// -1 when partition was not checked yet
+static int g_assetCount = -1;
+static const byte *g_assetBase = 0;
+// header of image being written, it goes to flash last, so image
+// is not valid until it is complete
+static bool g_assetWriting = false;
+static byte g_assetWriteHeader[ASSETS_HEADER_SIZE];
+static int g_assetWriteErased;
+static int g_assetWritePartSize;
+
+static unsigned int Assets_U32(const byte *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+static bool Assets_ReadRaw(int offset, byte *buffer, int len) {
+	if (g_assetBase) {
+		memcpy(buffer, g_assetBase + offset, len);
+		return true;
+	}
+	return HAL_Assets_Read(offset, buffer, len) == 0;
+}
+static int Assets_Load() {
+	byte hdr[ASSETS_HEADER_SIZE];
+	byte entry[ASSETS_ENTRY_SIZE];
+	int partSize, count, imageSize, i, offset, size;
+	unsigned int crc;
+
+	partSize = HAL_Assets_Open(&g_assetBase);
+	if (partSize < ASSETS_HEADER_SIZE || Assets_ReadRaw(0, hdr, sizeof(hdr)) == false) {
+		return 0;
+	}
+	if (memcmp(hdr, ASSETS_MAGIC, 4) || (hdr[4] | (hdr[5] << 8)) != ASSETS_VERSION) {
+		return 0;
+	}
+	count = hdr[6] | (hdr[7] << 8);
+	imageSize = Assets_U32(hdr + 8);
+	if (imageSize > partSize || ASSETS_HEADER_SIZE + count * ASSETS_ENTRY_SIZE > imageSize) {
+		ADDLOG_ERROR(LOG_FEATURE_GENERAL, "Assets: image of %i bytes does not fit partition of %i", imageSize, partSize);
+		return 0;
+	}
+	crc = 0;
+	for (i = 0; i < count; i++) {
+		if (Assets_ReadRaw(ASSETS_HEADER_SIZE + i * ASSETS_ENTRY_SIZE, entry, sizeof(entry)) == false) {
+			return 0;
+		}
+		crc = OTA_CRC32(crc, entry, sizeof(entry));
+		offset = Assets_U32(entry + ASSETS_NAME_SIZE);
+		size = Assets_U32(entry + ASSETS_NAME_SIZE + 4);
+		if (entry[ASSETS_NAME_SIZE - 1] != 0 || offset < 0 || size < 0 || offset + size > imageSize) {
+			ADDLOG_ERROR(LOG_FEATURE_GENERAL, "Assets: entry %i is broken", i);
+			return 0;
+		}
+	}
+	if (crc != Assets_U32(hdr + 12)) {
+		ADDLOG_ERROR(LOG_FEATURE_GENERAL, "Assets: index CRC mismatch");
+		return 0;
+	}
+	ADDLOG_INFO(LOG_FEATURE_GENERAL, "Assets: %i files, %i bytes%s", count, imageSize, g_assetBase ? ", mapped" : "");
+	return count;
+}
+static int Assets_Count() {
+	if (g_assetWriting) {
+		return 0;
+	}
+	if (g_assetCount < 0) {
+		g_assetCount = Assets_Load();
+	}
+	return g_assetCount;
+}
+void Assets_Reload() {
+	g_assetCount = -1;
+}
+int Assets_GetCount() {
+	return Assets_Count();
+}
+bool Assets_IsMapped() {
+	return Assets_Count() > 0 && g_assetBase != 0;
+}
+static bool Assets_ReadEntry(int index, byte *entry) {
+	return Assets_ReadRaw(ASSETS_HEADER_SIZE + index * ASSETS_ENTRY_SIZE, entry, ASSETS_ENTRY_SIZE);
+}
+static void Assets_FillEntry(const byte *entry, obkAsset_t *out) {
+	out->offset = Assets_U32(entry + ASSETS_NAME_SIZE);
+	out->size = Assets_U32(entry + ASSETS_NAME_SIZE + 4);
+	out->crc = Assets_U32(entry + ASSETS_NAME_SIZE + 8);
+	out->data = g_assetBase ? g_assetBase + out->offset : 0;
+}
+// name must have room for ASSETS_NAME_SIZE
+bool Assets_GetEntry(int index, char *name, obkAsset_t *out) {
+	byte entry[ASSETS_ENTRY_SIZE];
+
+	if (index < 0 || index >= Assets_Count() || Assets_ReadEntry(index, entry) == false) {
+		return false;
+	}
+	memcpy(name, entry, ASSETS_NAME_SIZE);
+	Assets_FillEntry(entry, out);
+	return true;
+}
+bool Assets_Find(const char *name, obkAsset_t *out) {
+	byte entry[ASSETS_ENTRY_SIZE];
+	int lo, hi, mid, cmp;
+
+	if (*name == '/') {
+		name++;
+	}
+	if (strlen(name) >= ASSETS_NAME_SIZE) {
+		return false;
+	}
+	lo = 0;
+	hi = Assets_Count() - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (Assets_ReadEntry(mid, entry) == false) {
+			return false;
+		}
+		cmp = strcmp(name, (const char*)entry);
+		if (cmp == 0) {
+			Assets_FillEntry(entry, out);
+			return true;
+		}
+		if (cmp < 0) {
+			hi = mid - 1;
+		}
+		else {
+			lo = mid + 1;
+		}
+	}
+	return false;
+}
+int Assets_Read(const obkAsset_t *a, int pos, byte *buffer, int maxLen) {
+	int len;
+
+	len = a->size - pos;
+	if (len > maxLen) {
+		len = maxLen;
+	}
+	if (len <= 0) {
+		return 0;
+	}
+	if (a->data) {
+		memcpy(buffer, a->data + pos, len);
+		return len;
+	}
+	if (HAL_Assets_Read(a->offset + pos, buffer, len)) {
+		return 0;
+	}
+	return len;
+}
+int Assets_WriteBegin() {
+	const byte *base;
+
+	g_assetWriting = true;
+	g_assetCount = -1;
+	g_assetBase = 0;
+	g_assetWriteErased = 0;
+	memset(g_assetWriteHeader, 0xFF, sizeof(g_assetWriteHeader));
+	g_assetWritePartSize = HAL_Assets_Open(&base);
+	return g_assetWritePartSize;
+}
+int Assets_WriteChunk(int offset, const byte *data, int len) {
+	int skip, part;
+
+	if (g_assetWriting == false || offset < 0 || len < 0 || offset + len > g_assetWritePartSize) {
+		return -1;
+	}
+	while (g_assetWriteErased < offset + len) {
+		part = g_assetWritePartSize - g_assetWriteErased;
+		if (part > HAL_ASSETS_SECTOR_SIZE) {
+			part = HAL_ASSETS_SECTOR_SIZE;
+		}
+		if (HAL_Assets_Erase(g_assetWriteErased, part)) {
+			return -1;
+		}
+		g_assetWriteErased += part;
+	}
+	if (offset < ASSETS_HEADER_SIZE) {
+		skip = ASSETS_HEADER_SIZE - offset;
+		if (skip > len) {
+			skip = len;
+		}
+		memcpy(g_assetWriteHeader + offset, data, skip);
+		offset += skip;
+		data += skip;
+		len -= skip;
+	}
+	if (len > 0 && HAL_Assets_Write(offset, data, len)) {
+		return -1;
+	}
+	return 0;
+}
+int Assets_WriteEnd(bool bComplete) {
+	if (g_assetWriting == false) {
+		return 0;
+	}
+	// erased header stays when upload broke
+	if (bComplete && g_assetWriteErased > 0) {
+		HAL_Assets_Write(0, g_assetWriteHeader, ASSETS_HEADER_SIZE);
+	}
+	g_assetWriting = false;
+	g_assetCount = -1;
+	return Assets_Count();
+}
+
+#endif // ENABLE_ASSETS
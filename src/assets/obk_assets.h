@@ -0,0 +1,37 @@
+#ifndef __OBK_ASSETS_H__
+#define __OBK_ASSETS_H__
+
+#include "../new_common.h"
+#include "../obk_config.h"
+
+#if ENABLE_ASSETS
+
+#define ASSETS_NAME_SIZE	36
+
+typedef struct obkAsset_s {
+	// file data when partition is memory mapped, else NULL
+	const byte *data;
+	// from start of partition
+	int offset;
+	int size;
+	unsigned int crc;
+} obkAsset_t;
+
+// checks partition again, call after new image was written
+void Assets_Reload();
+// count of files, 0 when there is no valid image
+int Assets_GetCount();
+bool Assets_IsMapped();
+bool Assets_GetEntry(int index, char *name, obkAsset_t *out);
+bool Assets_Find(const char *name, obkAsset_t *out);
+// returns bytes read, 0 after end of file
+int Assets_Read(const obkAsset_t *a, int pos, byte *buffer, int maxLen);
+// Image upload, parts come in order. Returns partition size, 0 when
+// there is none.
+int Assets_WriteBegin();
+int Assets_WriteChunk(int offset, const byte *data, int len);
+// returns count of files in new image
+int Assets_WriteEnd(bool bComplete);
+
+#endif
+#endif
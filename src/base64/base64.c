@@ -15,6 +15,40 @@ size_t b64_encoded_size(size_t inlen)
 
 const char b64chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
+// value of each char, -1 for ones that are not in alphabet (and '='),
+// so OR of few lookups is negative when any of them is invalid
+static const int8_t b64dec[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+// four chars to 24 bits, negative when any is invalid
+static int b64_group(const unsigned char *p)
+{
+	int a = b64dec[p[0]];
+	int b = b64dec[p[1]];
+	int c = b64dec[p[2]];
+	int d = b64dec[p[3]];
+
+	if ((a | b | c | d) < 0)
+		return -1;
+	return a << 18 | b << 12 | c << 6 | d;
+}
+
 char *b64_encode(const unsigned char *in, size_t len)
 {
 	char   *out;
@@ -28,25 +62,26 @@ char *b64_encode(const unsigned char *in, size_t len)
 
 	elen = b64_encoded_size(len);
 	out  = malloc(elen+1);
+	if (out == NULL)
+		return NULL;
 	out[elen] = '\0';
 
-	for (i=0, j=0; i<len; i+=3, j+=4) {
-		v = in[i];
-		v = i+1 < len ? v << 8 | in[i+1] : v << 8;
-		v = i+2 < len ? v << 8 | in[i+2] : v << 8;
-
+	// whole groups of 3 bytes, then padded tail
+	for (i=0, j=0; i+3<=len; i+=3, j+=4) {
+		v = (size_t)in[i] << 16 | (size_t)in[i+1] << 8 | in[i+2];
 		out[j]   = b64chars[(v >> 18) & 0x3F];
 		out[j+1] = b64chars[(v >> 12) & 0x3F];
-		if (i+1 < len) {
-			out[j+2] = b64chars[(v >> 6) & 0x3F];
-		} else {
-			out[j+2] = '=';
-		}
-		if (i+2 < len) {
-			out[j+3] = b64chars[v & 0x3F];
-		} else {
-			out[j+3] = '=';
-		}
+		out[j+2] = b64chars[(v >> 6) & 0x3F];
+		out[j+3] = b64chars[v & 0x3F];
+	}
+	if (i < len) {
+		v = (size_t)in[i] << 16;
+		if (i+1 < len)
+			v |= (size_t)in[i+1] << 8;
+		out[j]   = b64chars[(v >> 18) & 0x3F];
+		out[j+1] = b64chars[(v >> 12) & 0x3F];
+		out[j+2] = i+1 < len ? b64chars[(v >> 6) & 0x3F] : '=';
+		out[j+3] = '=';
 	}
 
 	return out;
@@ -75,43 +110,20 @@ size_t b64_decoded_size(const char *in)
 	return ret;
 }
 
-void b64_generate_decode_table()
-{
-	int    inv[80];
-	size_t i;
-
-	memset(inv, -1, sizeof(inv));
-	for (i=0; i<sizeof(b64chars)-1; i++) {
-		inv[b64chars[i]-43] = i;
-	}
-}
-
 int b64_isvalidchar(char c)
 {
-	if (c >= '0' && c <= '9')
-		return 1;
-	if (c >= 'A' && c <= 'Z')
-		return 1;
-	if (c >= 'a' && c <= 'z')
-		return 1;
-	if (c == '+' || c == '/' || c == '=')
-		return 1;
-	return 0;
+	return c == '=' || b64dec[(unsigned char)c] >= 0;
 }
 
-int b64invs[] = { 62, -1, -1, -1, 63, 52, 53, 54, 55, 56, 57, 58,
-	59, 60, 61, -1, -1, -1, -1, -1, -1, -1, 0, 1, 2, 3, 4, 5,
-	6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20,
-	21, 22, 23, 24, 25, -1, -1, -1, -1, -1, -1, 26, 27, 28,
-	29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42,
-	43, 44, 45, 46, 47, 48, 49, 50, 51 };
-
 int b64_decode(const char *in, unsigned char *out, size_t outlen)
 {
+	const unsigned char *p = (const unsigned char *)in;
+	unsigned char last[4];
 	size_t len;
 	size_t i;
 	size_t j;
 	int    v;
+	int    n;
 
 	if (in == NULL || out == NULL)
 		return 0;
@@ -119,25 +131,130 @@ int b64_decode(const char *in, unsigned char *out, size_t outlen)
 	len = strlen(in);
 	if (outlen < b64_decoded_size(in) || len % 4 != 0)
 		return 0;
+	if (len == 0)
+		return 1;
 
-	for (i=0; i<len; i++) {
-		if (!b64_isvalidchar(in[i])) {
+	// all groups but last can't have padding
+	for (i=0, j=0; i+4<len; i+=4, j+=3) {
+		v = b64_group(p + i);
+		if (v < 0)
 			return 0;
+		out[j]   = (v >> 16) & 0xFF;
+		out[j+1] = (v >> 8) & 0xFF;
+		out[j+2] = v & 0xFF;
+	}
+	// last one with '=' read as 'A', which adds zero bits
+	memcpy(last, p + i, 4);
+	n = 3;
+	if (last[3] == '=') {
+		last[3] = 'A';
+		n = 2;
+		if (last[2] == '=') {
+			last[2] = 'A';
+			n = 1;
 		}
 	}
+	v = b64_group(last);
+	if (v < 0)
+		return 0;
+	out[j] = (v >> 16) & 0xFF;
+	if (n > 1)
+		out[j+1] = (v >> 8) & 0xFF;
+	if (n > 2)
+		out[j+2] = v & 0xFF;
+
+	return 1;
+}
+
+void b64_decode_begin(b64_stream_t *s)
+{
+	memset(s, 0, sizeof(*s));
+}
 
-	for (i=0, j=0; i<len; i+=4, j+=3) {
-		v = b64invs[in[i]-43];
-		v = (v << 6) | b64invs[in[i+1]-43];
-		v = in[i+2]=='=' ? v << 6 : (v << 6) | b64invs[in[i+2]-43];
-		v = in[i+3]=='=' ? v << 6 : (v << 6) | b64invs[in[i+3]-43];
-
-		out[j] = (v >> 16) & 0xFF;
-		if (in[i+2] != '=')
-			out[j+1] = (v >> 8) & 0xFF;
-		if (in[i+3] != '=')
-			out[j+2] = v & 0xFF;
+int b64_decode_update(b64_stream_t *s, const char *in, size_t len, unsigned char *out)
+{
+	const unsigned char *p = (const unsigned char *)in;
+	const unsigned char *end = p + len;
+	unsigned char *o = out;
+	int v;
+
+	if (s->bad)
+		return -1;
+	while (p < end) {
+		// fast path, four chars of group at once
+		if (s->n == 0 && !s->pad) {
+			while (end - p >= 4) {
+				v = b64_group(p);
+				if (v < 0)
+					break;
+				o[0] = (v >> 16) & 0xFF;
+				o[1] = (v >> 8) & 0xFF;
+				o[2] = v & 0xFF;
+				o += 3;
+				p += 4;
+			}
+			if (p >= end)
+				break;
+		}
+		// line breaks, padding and group split between chunks
+		v = b64dec[*p];
+		if (v >= 0) {
+			if (s->pad) {
+				s->bad = 1;
+				return -1;
+			}
+			s->acc = s->acc << 6 | v;
+			if (++s->n == 4) {
+				o[0] = (s->acc >> 16) & 0xFF;
+				o[1] = (s->acc >> 8) & 0xFF;
+				o[2] = s->acc & 0xFF;
+				o += 3;
+				s->n = 0;
+				s->acc = 0;
+			}
+		} else if (*p == '=') {
+			if (!s->pad) {
+				if (s->n < 2) {
+					s->bad = 1;
+					return -1;
+				}
+				if (s->n == 2) {
+					o[0] = (s->acc >> 4) & 0xFF;
+					o += 1;
+				} else {
+					o[0] = (s->acc >> 10) & 0xFF;
+					o[1] = (s->acc >> 2) & 0xFF;
+					o += 2;
+				}
+				s->n = 0;
+				s->acc = 0;
+				s->pad = 1;
+			}
+		} else if (*p != '\r' && *p != '\n' && *p != ' ' && *p != '\t') {
+			s->bad = 1;
+			return -1;
+		}
+		p++;
 	}
+	return (int)(o - out);
+}
 
-	return 1;
+int b64_decode_finish(b64_stream_t *s, unsigned char *out)
+{
+	int n = s->n;
+
+	if (s->bad || n == 1)
+		return -1;
+	// input without padding
+	s->n = 0;
+	if (n == 2) {
+		out[0] = (s->acc >> 4) & 0xFF;
+		return 1;
+	}
+	if (n == 3) {
+		out[0] = (s->acc >> 10) & 0xFF;
+		out[1] = (s->acc >> 2) & 0xFF;
+		return 2;
+	}
+	return 0;
 }
@@ -10,8 +10,26 @@
 size_t b64_encoded_size(size_t inlen);
 char *b64_encode(const unsigned char *in, size_t len);
 size_t b64_decoded_size(const char *in);
-void b64_generate_decode_table();
 int b64_isvalidchar(char c);
 int b64_decode(const char *in, unsigned char *out, size_t outlen);
 
-#endif
\ No newline at end of file
+// Decoding of input that comes in parts, like POST body. Groups may be
+// split between parts, line breaks are skipped.
+typedef struct b64_stream_s {
+	unsigned int acc;
+	// chars of unfinished group in acc
+	int n;
+	// '=' seen, only more of it may follow
+	int pad;
+	int bad;
+} b64_stream_t;
+
+// out of update must hold (len + 3) / 4 * 3 bytes, returns bytes
+// written or -1 on invalid input
+#define B64_DECODE_MAX(len)		(((len) + 3) / 4 * 3)
+void b64_decode_begin(b64_stream_t *s);
+int b64_decode_update(b64_stream_t *s, const char *in, size_t len, unsigned char *out);
+// writes up to 2 bytes of unpadded last group, -1 when input was bad
+int b64_decode_finish(b64_stream_t *s, unsigned char *out);
+
+#endif
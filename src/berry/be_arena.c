@@ -0,0 +1,279 @@
+#include "be_arena.h"
+#include "berry_conf.h"
+#include "../logging/logging.h"
+
+// Dedicated arena for Berry VM allocations, so scripts can't use up the heap
+// needed by lwIP and MQTT and don't fragment it with small objects.
+// Blocks have a small header with own and previous block size, free blocks
+// are kept on a list and merged with free neighbours when released.
+// When arena is full, allocation fails and Berry runs GC and retries,
+// then raises memory error in script. Pointers that are not in arena
+// (arena not created yet) go to the system allocator.
+#if ENABLE_BERRY_ARENA
+
+#define ARENA_ALIGN			8
+#define ARENA_USED			1
+#define ARENA_ROUND(x)		(((x) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+typedef struct arenaHeader_s {
+	// whole block with header, low bit set when block is used
+	unsigned int size;
+	// size of block before, 0 for the first
+	unsigned int prevSize;
+} arenaHeader_t;
+
+typedef struct arenaFree_s {
+	arenaHeader_t h;
+	struct arenaFree_s *next;
+	struct arenaFree_s *prev;
+} arenaFree_t;
+
+#define ARENA_HEADER		ARENA_ROUND(sizeof(arenaHeader_t))
+#define ARENA_MIN_BLOCK		ARENA_ROUND(sizeof(arenaFree_t))
+
+static byte *g_arena;
+static byte *g_arenaEnd;
+static arenaFree_t *g_arenaFree;
+static berryArenaStats_t g_arenaStats;
+static int g_arenaUsedAfterGC;
+
+static unsigned int Arena_Size(arenaHeader_t *h) {
+	return h->size & ~ARENA_USED;
+}
+static arenaHeader_t *Arena_Next(arenaHeader_t *h) {
+	byte *n = (byte*)h + Arena_Size(h);
+	if (n >= g_arenaEnd) {
+		return 0;
+	}
+	return (arenaHeader_t*)n;
+}
+static arenaHeader_t *Arena_Prev(arenaHeader_t *h) {
+	if (h->prevSize == 0) {
+		return 0;
+	}
+	return (arenaHeader_t*)((byte*)h - h->prevSize);
+}
+static bool Arena_Contains(void *p) {
+	return (byte*)p >= g_arena && (byte*)p < g_arenaEnd;
+}
+static void Arena_Unlink(arenaFree_t *f) {
+	if (f->prev) {
+		f->prev->next = f->next;
+	}
+	else {
+		g_arenaFree = f->next;
+	}
+	if (f->next) {
+		f->next->prev = f->prev;
+	}
+}
+static void Arena_Link(arenaFree_t *f) {
+	f->prev = 0;
+	f->next = g_arenaFree;
+	if (g_arenaFree) {
+		g_arenaFree->prev = f;
+	}
+	g_arenaFree = f;
+}
+// sets block size and keeps prevSize of the following block in sync
+static void Arena_SetSize(arenaHeader_t *h, unsigned int size, int used) {
+	arenaHeader_t *n;
+
+	h->size = size | used;
+	n = Arena_Next(h);
+	if (n) {
+		n->prevSize = size;
+	}
+}
+// puts free block on the list, merging it with free neighbours
+static void Arena_Release(arenaHeader_t *h) {
+	arenaHeader_t *n, *p;
+	unsigned int size;
+
+	size = Arena_Size(h);
+	n = Arena_Next(h);
+	if (n && !(n->size & ARENA_USED)) {
+		Arena_Unlink((arenaFree_t*)n);
+		size += Arena_Size(n);
+	}
+	p = Arena_Prev(h);
+	if (p && !(p->size & ARENA_USED)) {
+		Arena_Unlink((arenaFree_t*)p);
+		size += Arena_Size(p);
+		h = p;
+	}
+	Arena_SetSize(h, size, 0);
+	Arena_Link((arenaFree_t*)h);
+}
+// cuts used block down to size, rest goes back to free list
+static void Arena_Split(arenaHeader_t *h, unsigned int size) {
+	arenaHeader_t *rest;
+	unsigned int total;
+
+	total = Arena_Size(h);
+	if (total - size < ARENA_MIN_BLOCK) {
+		return;
+	}
+	Arena_SetSize(h, size, ARENA_USED);
+	rest = (arenaHeader_t*)((byte*)h + size);
+	rest->prevSize = size;
+	Arena_SetSize(rest, total - size, 0);
+	Arena_Release(rest);
+}
+static unsigned int Arena_BlockSize(size_t size) {
+	unsigned int need = ARENA_ROUND(size + ARENA_HEADER);
+	if (need < ARENA_MIN_BLOCK) {
+		need = ARENA_MIN_BLOCK;
+	}
+	return need;
+}
+static void Arena_CountUsed(int delta) {
+	g_arenaStats.used += delta;
+	if (g_arenaStats.used > g_arenaStats.peak) {
+		g_arenaStats.peak = g_arenaStats.used;
+	}
+}
+
+void *be_arena_malloc(size_t size) {
+	arenaFree_t *f;
+	unsigned int need;
+
+	if (g_arena == 0) {
+		return BE_SYS_MALLOC(size);
+	}
+	need = Arena_BlockSize(size);
+	for (f = g_arenaFree; f; f = f->next) {
+		if (Arena_Size(&f->h) >= need) {
+			break;
+		}
+	}
+	if (f == 0) {
+		g_arenaStats.failed++;
+		return 0;
+	}
+	Arena_Unlink(f);
+	Arena_SetSize(&f->h, Arena_Size(&f->h), ARENA_USED);
+	Arena_Split(&f->h, need);
+	g_arenaStats.allocs++;
+	Arena_CountUsed(Arena_Size(&f->h));
+	return (byte*)f + ARENA_HEADER;
+}
+void be_arena_free(void *ptr) {
+	arenaHeader_t *h;
+
+	if (ptr == 0) {
+		return;
+	}
+	if (!Arena_Contains(ptr)) {
+		BE_SYS_FREE(ptr);
+		return;
+	}
+	h = (arenaHeader_t*)((byte*)ptr - ARENA_HEADER);
+	g_arenaStats.frees++;
+	Arena_CountUsed(-(int)Arena_Size(h));
+	Arena_Release(h);
+}
+void *be_arena_realloc(void *ptr, size_t size) {
+	arenaHeader_t *h, *n;
+	unsigned int need, cur;
+	void *r;
+
+	if (ptr == 0) {
+		return be_arena_malloc(size);
+	}
+	if (size == 0) {
+		be_arena_free(ptr);
+		return 0;
+	}
+	if (!Arena_Contains(ptr)) {
+		return BE_SYS_REALLOC(ptr, size);
+	}
+	h = (arenaHeader_t*)((byte*)ptr - ARENA_HEADER);
+	cur = Arena_Size(h);
+	need = Arena_BlockSize(size);
+	if (need <= cur) {
+		Arena_Split(h, need);
+		Arena_CountUsed((int)Arena_Size(h) - (int)cur);
+		return ptr;
+	}
+	// grow in place into free block after
+	n = Arena_Next(h);
+	if (n && !(n->size & ARENA_USED) && cur + Arena_Size(n) >= need) {
+		Arena_Unlink((arenaFree_t*)n);
+		Arena_SetSize(h, cur + Arena_Size(n), ARENA_USED);
+		Arena_Split(h, need);
+		Arena_CountUsed((int)Arena_Size(h) - (int)cur);
+		return ptr;
+	}
+	r = be_arena_malloc(size);
+	if (r == 0) {
+		return 0;
+	}
+	memcpy(r, ptr, cur - ARENA_HEADER);
+	be_arena_free(ptr);
+	return r;
+}
+
+bool Berry_ArenaInit(int size) {
+	if (g_arena) {
+		if (g_arenaStats.used) {
+			// still in use by a VM
+			return false;
+		}
+		BE_SYS_FREE(g_arena);
+		g_arena = 0;
+	}
+	size &= ~(ARENA_ALIGN - 1);
+	memset(&g_arenaStats, 0, sizeof(g_arenaStats));
+	g_arenaUsedAfterGC = 0;
+	g_arenaFree = 0;
+	if (size < 1024) {
+		return false;
+	}
+	g_arena = (byte*)BE_SYS_MALLOC(size);
+	if (g_arena == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_BERRY, "Failed to alloc %i bytes for Berry arena, using heap", size);
+		return false;
+	}
+	g_arenaEnd = g_arena + size;
+	g_arenaStats.size = size;
+	((arenaHeader_t*)g_arena)->prevSize = 0;
+	Arena_SetSize((arenaHeader_t*)g_arena, size, 0);
+	Arena_Link((arenaFree_t*)g_arena);
+	return true;
+}
+void Berry_ArenaRelease() {
+	if (g_arena == 0) {
+		return;
+	}
+	if (g_arenaStats.used) {
+		ADDLOG_ERROR(LOG_FEATURE_BERRY, "Berry arena still has %i bytes used, keeping it", g_arenaStats.used);
+		return;
+	}
+	BE_SYS_FREE(g_arena);
+	g_arena = 0;
+	g_arenaEnd = 0;
+	g_arenaFree = 0;
+}
+bool Berry_ArenaWantsGC(int gcPercent) {
+	int limit;
+
+	if (g_arena == 0) {
+		return false;
+	}
+	limit = g_arenaStats.size / 100 * gcPercent;
+	// don't collect over and over when live data alone is above the limit
+	if (limit < g_arenaUsedAfterGC + g_arenaStats.size / 8) {
+		limit = g_arenaUsedAfterGC + g_arenaStats.size / 8;
+	}
+	return g_arenaStats.used > limit;
+}
+void Berry_ArenaOnGC() {
+	g_arenaStats.collections++;
+	g_arenaUsedAfterGC = g_arenaStats.used;
+}
+void Berry_GetArenaStats(berryArenaStats_t *out) {
+	*out = g_arenaStats;
+}
+
+#endif // ENABLE_BERRY_ARENA
@@ -0,0 +1,27 @@
+#pragma once
+#include "../new_common.h"
+
+typedef struct berryArenaStats_s {
+	int size;
+	int used;
+	int peak;
+	int allocs;
+	int frees;
+	// allocations refused because arena was full
+	int failed;
+	// collections started because arena usage passed the threshold
+	int collections;
+} berryArenaStats_t;
+
+// allocates arena for the next VM, only possible while arena is empty
+bool Berry_ArenaInit(int size);
+// returns arena block to the heap after VM has been deleted
+void Berry_ArenaRelease();
+// true when usage passed gcPercent of arena since last collection
+bool Berry_ArenaWantsGC(int gcPercent);
+void Berry_ArenaOnGC();
+void Berry_GetArenaStats(berryArenaStats_t *out);
+
+void *be_arena_malloc(size_t size);
+void *be_arena_realloc(void *ptr, size_t size);
+void be_arena_free(void *ptr);
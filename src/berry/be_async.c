@@ -0,0 +1,569 @@
+#include "be_async.h"
+#include "be_run.h"
+#include "../logging/logging.h"
+#include "../quicktick.h"
+#include "../cmnds/cmd_public.h"
+#include "../mqtt/new_mqtt.h"
+#include "../httpclient/http_client.h"
+#include "lwip/sockets.h"
+#include "lwip/inet.h"
+
+// Scripts wait for sockets, HTTP replies and MQTT messages without blocking
+// the thread they run on. Each call suspends the given closure like
+// setTimeout does and Berry_RunThreads resumes it with the result, when
+// Berry_Async_Poll says op is complete or when its timeout passes.
+// Sockets are polled with zero timeout select, HTTP requests go to the
+// HTTP client task and MQTT messages come from MQTT_process_received.
+#if ENABLE_BERRY_ASYNC
+
+#define BERRY_ASYNC_RECV_CHUNK			512
+#define BERRY_ASYNC_HTTP_MAX_REPLY		4096
+#define BERRY_ASYNC_HTTP_TIMEOUT_MS		10000
+#define BERRY_ASYNC_MAX_SOCKETS			16
+#define BERRY_ASYNC_MQTT_TOPICS			8
+#define BERRY_ASYNC_MQTT_TOPIC_LEN		64
+// IDs of MQTT_RegisterCallback, one per subscribed topic
+#define BERRY_ASYNC_MQTT_CALLBACK_ID	200
+
+enum {
+	BERRY_ASYNC_TCP_CONNECT = 1,
+	BERRY_ASYNC_TCP_RECV,
+	BERRY_ASYNC_HTTP_GET,
+	BERRY_ASYNC_MQTT,
+};
+
+struct berryAsync_s {
+	byte kind;
+	// set last by whoever completes op, HTTP client task does not
+	// touch op after that
+	volatile byte done;
+	// socket in progress of connecting is owned by op until it is given to script
+	int sock;
+	// 0 on success, HTTP status code for http.get, negative on error
+	int status;
+	char *data;
+	int len;
+	// response_buf of HTTP request
+	char *chunk;
+	int topicSlot;
+	// on g_berryMqttWaiting or g_berryAsyncZombies
+	struct berryAsync_s *next;
+};
+
+static int g_berrySockets[BERRY_ASYNC_MAX_SOCKETS];
+static int g_berrySocketCount;
+// HTTP ops of cancelled threads, freed after HTTP client is done with them
+static berryAsync_t *g_berryAsyncZombies;
+static berryAsyncStats_t g_berryAsyncStats;
+#if ENABLE_MQTT
+static char g_berryMqttTopics[BERRY_ASYNC_MQTT_TOPICS][BERRY_ASYNC_MQTT_TOPIC_LEN];
+static berryAsync_t *g_berryMqttWaiting;
+#endif
+
+static void Berry_Async_Release(berryAsync_t *op) {
+	free(op->data);
+	free(op->chunk);
+	free(op);
+	g_berryAsyncStats.waiting--;
+}
+static void Berry_Async_FreeZombies() {
+	berryAsync_t **prev, *op;
+
+	prev = &g_berryAsyncZombies;
+	while (*prev) {
+		op = *prev;
+		if (op->done) {
+			*prev = op->next;
+			Berry_Async_Release(op);
+		}
+		else {
+			prev = &op->next;
+		}
+	}
+}
+static berryAsync_t *Berry_Async_Alloc(int kind) {
+	berryAsync_t *op;
+
+	Berry_Async_FreeZombies();
+	op = (berryAsync_t*)malloc(sizeof(berryAsync_t));
+	if (op == 0) {
+		return 0;
+	}
+	memset(op, 0, sizeof(berryAsync_t));
+	op->kind = kind;
+	op->sock = -1;
+	g_berryAsyncStats.waiting++;
+	return op;
+}
+void Berry_Async_Free(berryAsync_t *op) {
+#if ENABLE_MQTT
+	berryAsync_t **prev;
+#endif
+
+	if (op == 0) {
+		return;
+	}
+	if (op->kind == BERRY_ASYNC_HTTP_GET && !op->done) {
+		op->next = g_berryAsyncZombies;
+		g_berryAsyncZombies = op;
+		return;
+	}
+#if ENABLE_MQTT
+	if (op->kind == BERRY_ASYNC_MQTT) {
+		for (prev = &g_berryMqttWaiting; *prev; prev = &(*prev)->next) {
+			if (*prev == op) {
+				*prev = op->next;
+				break;
+			}
+		}
+	}
+#endif
+	if (op->kind == BERRY_ASYNC_TCP_CONNECT && op->sock >= 0) {
+		closesocket(op->sock);
+	}
+	Berry_Async_Release(op);
+}
+
+static bool Berry_Async_WouldBlock() {
+	int err;
+
+#if WINDOWS
+	err = GETSOCKETERRNO();
+	return err == WSAEWOULDBLOCK || err == EINPROGRESS || err == EAGAIN;
+#else
+	err = errno;
+	return err == EWOULDBLOCK || err == EINPROGRESS || err == EAGAIN;
+#endif
+}
+static int Berry_Async_FindSocket(int s) {
+	int i;
+
+	for (i = 0; i < g_berrySocketCount; i++) {
+		if (g_berrySockets[i] == s) {
+			return i;
+		}
+	}
+	return -1;
+}
+static void Berry_Async_CloseSocket(int i) {
+	closesocket(g_berrySockets[i]);
+	g_berrySocketCount--;
+	g_berrySockets[i] = g_berrySockets[g_berrySocketCount];
+}
+void Berry_Async_Shutdown() {
+	while (g_berrySocketCount > 0) {
+		Berry_Async_CloseSocket(g_berrySocketCount - 1);
+	}
+	Berry_Async_FreeZombies();
+}
+
+static bool Berry_Async_PollConnect(berryAsync_t *op) {
+	struct timeval tv;
+	fd_set wfds, efds;
+	socklen_t len;
+	int err;
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	FD_ZERO(&wfds);
+	FD_ZERO(&efds);
+	FD_SET(op->sock, &wfds);
+	FD_SET(op->sock, &efds);
+	if (select(op->sock + 1, NULL, &wfds, &efds, &tv) <= 0) {
+		return false;
+	}
+	err = 0;
+	len = sizeof(err);
+	if (FD_ISSET(op->sock, &efds)
+		|| getsockopt(op->sock, SOL_SOCKET, SO_ERROR, (char*)&err, &len) < 0 || err != 0) {
+		op->status = -1;
+	}
+	op->done = 1;
+	return true;
+}
+static bool Berry_Async_PollRecv(berryAsync_t *op) {
+	int n;
+
+	n = recv(op->sock, op->data, BERRY_ASYNC_RECV_CHUNK, 0);
+	if (n < 0) {
+		if (Berry_Async_WouldBlock()) {
+			return false;
+		}
+		op->status = -1;
+		n = 0;
+	}
+	// 0 means connection was closed by peer, script gets empty string
+	op->len = n;
+	op->done = 1;
+	return true;
+}
+bool Berry_Async_Poll(berryAsync_t *op) {
+	if (op->done) {
+		return true;
+	}
+	switch (op->kind) {
+	case BERRY_ASYNC_TCP_CONNECT:
+		return Berry_Async_PollConnect(op);
+	case BERRY_ASYNC_TCP_RECV:
+		return Berry_Async_PollRecv(op);
+	}
+	// HTTP and MQTT ops are completed by their callbacks
+	return false;
+}
+
+void Berry_Async_Resume(bvm *vm, int closureId, berryAsync_t *op) {
+	int argc;
+
+	if (op->done) {
+		g_berryAsyncStats.completed++;
+	}
+	else {
+		g_berryAsyncStats.timeouts++;
+	}
+	if (!be_getglobal(vm, "run_closure")) {
+		be_pop(vm, 1);
+		return;
+	}
+	be_pushint(vm, closureId);
+	argc = 1;
+	switch (op->kind) {
+	case BERRY_ASYNC_TCP_CONNECT:
+		if (op->done && op->status == 0 && g_berrySocketCount < BERRY_ASYNC_MAX_SOCKETS) {
+			g_berrySockets[g_berrySocketCount++] = op->sock;
+			be_pushint(vm, op->sock);
+			op->sock = -1;
+		}
+		else {
+			be_pushnil(vm);
+		}
+		break;
+	case BERRY_ASYNC_HTTP_GET:
+		argc = 2;
+		be_pushint(vm, op->status);
+		if (op->status > 0) {
+			be_pushnstring(vm, op->data ? op->data : "", op->len);
+		}
+		else {
+			be_pushnil(vm);
+		}
+		break;
+	default:
+		if (op->done && op->status == 0) {
+			be_pushnstring(vm, op->data ? op->data : "", op->len);
+		}
+		else {
+			be_pushnil(vm);
+		}
+		break;
+	}
+	be_call(vm, argc + 1);
+	be_pop(vm, argc + 2);
+}
+
+// tcp.connect(ip, port, timeoutMs, closure), closure gets socket or nil
+static int be_tcpConnect(bvm *vm) {
+	struct sockaddr_in address;
+	berryAsync_t *op;
+	const char *ip;
+	int s;
+
+	if (be_top(vm) != 4 || !be_isstring(vm, 1) || !be_isint(vm, 2) || !be_isint(vm, 3) || !be_isfunction(vm, 4)) {
+		be_return_nil(vm);
+	}
+	ip = be_tostring(vm, 1);
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = inet_addr(ip);
+	address.sin_port = htons(be_toint(vm, 2));
+	// DNS lookup would block, so only addresses are accepted
+	if (address.sin_addr.s_addr == INADDR_NONE) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "tcp.connect: %s is not an IP address", ip);
+		be_return_nil(vm);
+	}
+	if (g_berrySocketCount >= BERRY_ASYNC_MAX_SOCKETS) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "tcp.connect: too many sockets open");
+		be_return_nil(vm);
+	}
+	s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s < 0) {
+		be_return_nil(vm);
+	}
+	lwip_fcntl(s, F_SETFL, O_NONBLOCK);
+	if (connect(s, (struct sockaddr*)&address, sizeof(address)) < 0 && !Berry_Async_WouldBlock()) {
+		closesocket(s);
+		be_return_nil(vm);
+	}
+	op = Berry_Async_Alloc(BERRY_ASYNC_TCP_CONNECT);
+	if (op == 0) {
+		closesocket(s);
+		be_return_nil(vm);
+	}
+	op->sock = s;
+	return Berry_Await(vm, 4, op, be_toint(vm, 3));
+}
+// tcp.recv(sock, timeoutMs, closure), closure gets what has arrived,
+// empty string when peer closed connection, nil on timeout or error
+static int be_tcpRecv(bvm *vm) {
+	berryAsync_t *op;
+
+	if (be_top(vm) != 3 || !be_isint(vm, 1) || !be_isint(vm, 2) || !be_isfunction(vm, 3)
+		|| Berry_Async_FindSocket(be_toint(vm, 1)) < 0) {
+		be_return_nil(vm);
+	}
+	op = Berry_Async_Alloc(BERRY_ASYNC_TCP_RECV);
+	if (op == 0) {
+		be_return_nil(vm);
+	}
+	op->data = (char*)malloc(BERRY_ASYNC_RECV_CHUNK);
+	if (op->data == 0) {
+		Berry_Async_Free(op);
+		be_return_nil(vm);
+	}
+	op->sock = be_toint(vm, 1);
+	return Berry_Await(vm, 3, op, be_toint(vm, 2));
+}
+// tcp.send(sock, data), returns number of bytes taken by the stack
+// (may be less than given) or -1 on error
+static int be_tcpSend(bvm *vm) {
+	const char *data;
+	int n;
+
+	if (be_top(vm) != 2 || !be_isint(vm, 1) || !be_isstring(vm, 2)
+		|| Berry_Async_FindSocket(be_toint(vm, 1)) < 0) {
+		be_pushint(vm, -1);
+		be_return(vm);
+	}
+	data = be_tostring(vm, 2);
+	n = send(be_toint(vm, 1), data, strlen(data), 0);
+	if (n < 0) {
+		n = Berry_Async_WouldBlock() ? 0 : -1;
+	}
+	be_pushint(vm, n);
+	be_return(vm);
+}
+static int be_tcpClose(bvm *vm) {
+	int i;
+
+	if (be_top(vm) == 1 && be_isint(vm, 1)) {
+		i = Berry_Async_FindSocket(be_toint(vm, 1));
+		if (i >= 0) {
+			Berry_Async_CloseSocket(i);
+		}
+	}
+	be_return_nil(vm);
+}
+
+#if ENABLE_SEND_POSTANDGET
+// called from HTTP client task
+static int Berry_Async_OnHTTPData(httprequest_t *request) {
+	berryAsync_t *op = (berryAsync_t*)request->usercontext;
+	httpclient_data_t *data = &request->client_data;
+	char *grown;
+
+	if (request->state == 1 && op->status >= 0) {
+		op->status = request->client.response_code;
+		if (op->len + data->response_buf_filled > BERRY_ASYNC_HTTP_MAX_REPLY) {
+			op->status = -3;
+			return 1;
+		}
+		grown = (char*)realloc(op->data, op->len + data->response_buf_filled);
+		if (grown == 0) {
+			op->status = -3;
+			return 1;
+		}
+		op->data = grown;
+		memcpy(op->data + op->len, data->response_buf, data->response_buf_filled);
+		op->len += data->response_buf_filled;
+	}
+	else if (request->state < 0) {
+		op->status = request->state;
+	}
+	else if (request->state == 2) {
+		if (op->status == 0) {
+			// reply without body
+			op->status = request->client.response_code;
+		}
+		op->done = 1;
+	}
+	return 0;
+}
+// http.get(url, closure), closure gets HTTP status and body, or negative
+// status and nil on error
+static int be_httpGet(bvm *vm) {
+	httprequest_t *request;
+	berryAsync_t *op;
+
+	if (be_top(vm) != 2 || !be_isstring(vm, 1) || !be_isfunction(vm, 2)) {
+		be_return_nil(vm);
+	}
+	op = Berry_Async_Alloc(BERRY_ASYNC_HTTP_GET);
+	if (op == 0) {
+		be_return_nil(vm);
+	}
+	request = (httprequest_t*)malloc(sizeof(httprequest_t));
+	op->chunk = (char*)malloc(BERRY_ASYNC_RECV_CHUNK);
+	if (request == 0 || op->chunk == 0) {
+		free(request);
+		op->done = 1;
+		Berry_Async_Free(op);
+		be_return_nil(vm);
+	}
+	memset(request, 0, sizeof(httprequest_t));
+	request->url = strdup(be_tostring(vm, 1));
+	// request is freed by HTTP client, op is not
+	request->flags = HTTPREQUEST_FLAG_FREE_SELFONDONE | HTTPREQUEST_FLAG_FREE_URLONDONE;
+	request->port = HTTP_PORT;
+	request->method = HTTPCLIENT_GET;
+	request->timeout = BERRY_ASYNC_HTTP_TIMEOUT_MS;
+	request->data_callback = Berry_Async_OnHTTPData;
+	request->usercontext = op;
+	request->client_data.response_buf = op->chunk;
+	request->client_data.response_buf_len = BERRY_ASYNC_RECV_CHUNK;
+	if (request->url == 0 || HTTPClient_Async_SendGeneric(request) != 0) {
+		free((char*)request->url);
+		free(request);
+		op->done = 1;
+		Berry_Async_Free(op);
+		be_return_nil(vm);
+	}
+	// HTTP client always ends request with state 2, its timeout is used
+	return Berry_Await(vm, 2, op, -1);
+}
+#endif
+
+#if ENABLE_MQTT
+static int Berry_Async_OnMQTT(obk_mqtt_request_t *request) {
+	berryAsync_t *op;
+	bool woke = false;
+
+	for (op = g_berryMqttWaiting; op; op = op->next) {
+		if (op->done || strcmp(g_berryMqttTopics[op->topicSlot], request->topic)) {
+			continue;
+		}
+		op->data = (char*)malloc(request->receivedLen + 1);
+		if (op->data) {
+			memcpy(op->data, request->received, request->receivedLen);
+			op->len = request->receivedLen;
+		}
+		else {
+			op->status = -1;
+		}
+		op->done = 1;
+		woke = true;
+	}
+	if (woke) {
+		QuickTick_Wake();
+	}
+	// others subscribed to the same topic get it too
+	return 0;
+}
+static bool Berry_Async_IsTopicWaited(int slot) {
+	berryAsync_t *op;
+
+	for (op = g_berryMqttWaiting; op; op = op->next) {
+		if (op->topicSlot == slot) {
+			return true;
+		}
+	}
+	return false;
+}
+// subscriptions are kept after await is done, so waiting for the same
+// topic again does not make MQTT reconnect
+static int Berry_Async_GetTopicSlot(const char *topic) {
+	int i, freeSlot;
+
+	for (i = 0; i < BERRY_ASYNC_MQTT_TOPICS; i++) {
+		if (!strcmp(g_berryMqttTopics[i], topic)) {
+			return i;
+		}
+	}
+	// unused slot, or else one that nobody waits on now
+	freeSlot = -1;
+	for (i = 0; i < BERRY_ASYNC_MQTT_TOPICS; i++) {
+		if (g_berryMqttTopics[i][0] == 0) {
+			freeSlot = i;
+			break;
+		}
+		if (freeSlot < 0 && !Berry_Async_IsTopicWaited(i)) {
+			freeSlot = i;
+		}
+	}
+	if (freeSlot < 0) {
+		return -1;
+	}
+	// same ID replaces subscription of the old topic
+	if (MQTT_RegisterCallback(topic, topic, BERRY_ASYNC_MQTT_CALLBACK_ID + freeSlot, Berry_Async_OnMQTT) != 0) {
+		return -1;
+	}
+	strcpy(g_berryMqttTopics[freeSlot], topic);
+	return freeSlot;
+}
+// mqtt.await(topic, timeoutMs, closure), closure gets payload or nil on timeout
+static int be_mqttAwait(bvm *vm) {
+	berryAsync_t *op;
+	const char *topic;
+	int slot;
+
+	if (be_top(vm) != 3 || !be_isstring(vm, 1) || !be_isint(vm, 2) || !be_isfunction(vm, 3)) {
+		be_return_nil(vm);
+	}
+	topic = be_tostring(vm, 1);
+	if (topic[0] == 0 || strlen(topic) >= BERRY_ASYNC_MQTT_TOPIC_LEN || strchr(topic, '+') || strchr(topic, '#')) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "mqtt.await: topic '%s' is empty, too long or has wildcards", topic);
+		be_return_nil(vm);
+	}
+	slot = Berry_Async_GetTopicSlot(topic);
+	if (slot < 0) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "mqtt.await: no free topic for %s", topic);
+		be_return_nil(vm);
+	}
+	op = Berry_Async_Alloc(BERRY_ASYNC_MQTT);
+	if (op == 0) {
+		be_return_nil(vm);
+	}
+	op->topicSlot = slot;
+	op->next = g_berryMqttWaiting;
+	g_berryMqttWaiting = op;
+	return Berry_Await(vm, 3, op, be_toint(vm, 2));
+}
+#endif
+
+void Berry_Async_GetStats(berryAsyncStats_t *out) {
+	*out = g_berryAsyncStats;
+	out->sockets = g_berrySocketCount;
+}
+
+static const char berryAsyncPrelude[] =
+	"def sleep_ms(ms, closure)\n"
+	"  return setTimeout(closure, ms)\n"
+	"end\n"
+	"tcp = module(\"tcp\")\n"
+	"tcp.connect = _tcp_connect\n"
+	"tcp.recv = _tcp_recv\n"
+	"tcp.send = _tcp_send\n"
+	"tcp.close = _tcp_close\n"
+#if ENABLE_SEND_POSTANDGET
+	"http = module(\"http\")\n"
+	"http.get = _http_get\n"
+#endif
+#if ENABLE_MQTT
+	"mqtt = module(\"mqtt\")\n"
+	"mqtt.await = _mqtt_await\n"
+#endif
+	;
+
+void Berry_Async_Register(bvm *vm) {
+	be_regfunc(vm, "_tcp_connect", be_tcpConnect);
+	be_regfunc(vm, "_tcp_recv", be_tcpRecv);
+	be_regfunc(vm, "_tcp_send", be_tcpSend);
+	be_regfunc(vm, "_tcp_close", be_tcpClose);
+#if ENABLE_SEND_POSTANDGET
+	be_regfunc(vm, "_http_get", be_httpGet);
+#endif
+#if ENABLE_MQTT
+	be_regfunc(vm, "_mqtt_await", be_mqttAwait);
+#endif
+	berryRun(vm, berryAsyncPrelude);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#include "../new_common.h"
+#include "berry.h"
+
+// Non-blocking tcp, http and mqtt calls for Berry. Berry has no coroutines
+// that could be suspended inside a native call, so each call takes a closure
+// that is resumed from Berry_RunThreads with the result, like setTimeout.
+typedef struct berryAsync_s berryAsync_t;
+
+// suspends closure at closureIndex until op is complete or timeoutMs
+// passes (no timeout when negative), returns thread ID to Berry for cancel()
+int Berry_Await(bvm *vm, int closureIndex, berryAsync_t *op, int timeoutMs);
+
+// true once op has a result, called every tick for waiting ops
+bool Berry_Async_Poll(berryAsync_t *op);
+// calls closure with result of op, or with nil when it is not complete
+void Berry_Async_Resume(bvm *vm, int closureId, berryAsync_t *op);
+// op whose request is still running in another task is freed once it completes
+void Berry_Async_Free(berryAsync_t *op);
+// closes sockets opened by scripts, called when VM is deleted
+void Berry_Async_Shutdown();
+void Berry_Async_Register(bvm *vm);
+
+typedef struct berryAsyncStats_s {
+	int waiting;
+	int sockets;
+	unsigned int completed;
+	unsigned int timeouts;
+} berryAsyncStats_t;
+void Berry_Async_GetStats(berryAsyncStats_t *out);
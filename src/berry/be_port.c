@@ -30,8 +30,24 @@ BERRY_API char *be_readstring(char *buffer, size_t size) {
 	return buffer;
 }
 
+#include "../assets/obk_assets.h"
+
+#if ENABLE_LITTLEFS || ENABLE_ASSETS
+
+// Files opened for reading that are not in LittleFS come from asset image,
+// so modules can be imported from there, handle tells which one it is
+typedef struct beFile_s {
 #if ENABLE_LITTLEFS
+	lfs_file_t file;
+#endif
+#if ENABLE_ASSETS
+	obkAsset_t asset;
+	int pos;
+#endif
+	bool bAsset;
+} beFile_t;
 
+#if ENABLE_LITTLEFS
 // Mapping of fopen modes to lfs_file_open flags
 static int mode_to_flags(const char *mode) {
 	// accepted regex: ^(r|w|a)b?+?.*$
@@ -55,39 +71,71 @@ static int mode_to_flags(const char *mode) {
 	}
 	return -1;
 }
+#endif
 
 void *be_fopen(const char *filename, const char *modes) {
+	beFile_t *file = malloc(sizeof(beFile_t));
+	if (file == NULL)
+		return NULL;
+	memset(file, 0, sizeof(beFile_t));
+#if ENABLE_LITTLEFS
 	if (!lfs_present())
 		init_lfs(1);
 	if (lfs_present()) {
 		int flags = mode_to_flags(modes);
 		if (flags == -1) {
-			return NULL;
-		}
-		lfs_file_t *file = malloc(sizeof(lfs_file_t));
-		memset(file, 0, sizeof(lfs_file_t));
-		int err = lfs_file_open(&lfs, file, filename, flags);
-		if (err) {
 			free(file);
 			return NULL;
 		}
+		if (lfs_file_open(&lfs, &file->file, filename, flags) == 0) {
+			return file;
+		}
+	}
+#endif
+#if ENABLE_ASSETS
+	if (modes[0] == 'r' && strchr(modes, '+') == NULL && Assets_Find(filename, &file->asset)) {
+		file->bAsset = true;
 		return file;
 	}
+#endif
+	free(file);
 	return NULL;
 }
 
 int be_fclose(void *hfile) {
-	int ret = lfs_file_close(&lfs, (lfs_file_t *)hfile);
-	free(hfile);
+	beFile_t *file = hfile;
+	int ret = 0;
+#if ENABLE_LITTLEFS
+	if (!file->bAsset)
+		ret = lfs_file_close(&lfs, &file->file);
+#endif
+	free(file);
 	return ret;
 }
 
 size_t be_fwrite(void *hfile, const void *buffer, size_t length) {
-	return lfs_file_write(&lfs, hfile, buffer, length);
+	beFile_t *file = hfile;
+#if ENABLE_LITTLEFS
+	if (!file->bAsset)
+		return lfs_file_write(&lfs, &file->file, buffer, length);
+#endif
+	return 0;
 }
 
 size_t be_fread(void *hfile, void *buffer, size_t length) {
-	return lfs_file_read(&lfs, hfile, buffer, length);
+	beFile_t *file = hfile;
+#if ENABLE_ASSETS
+	if (file->bAsset) {
+		int len = Assets_Read(&file->asset, file->pos, buffer, length);
+		file->pos += len;
+		return len;
+	}
+#endif
+#if ENABLE_LITTLEFS
+	return lfs_file_read(&lfs, &file->file, buffer, length);
+#else
+	return 0;
+#endif
 }
 
 char *be_fgets(void *hfile, void *buffer, int size) {
@@ -98,7 +146,7 @@ char *be_fgets(void *hfile, void *buffer, int size) {
 	int count = 0;
 
 	while (count < size - 1) {
-		if (lfs_file_read(&lfs, hfile, dest, 1) != 1) {
+		if (be_fread(hfile, dest, 1) != 1) {
 			// EOF or error
 			if (count == 0)
 				return NULL;
@@ -122,22 +170,58 @@ char *be_fgets(void *hfile, void *buffer, int size) {
 }
 
 int be_fseek(void *hfile, long offset) {
-	return lfs_file_seek(&lfs, hfile, offset, LFS_SEEK_SET);
+	beFile_t *file = hfile;
+#if ENABLE_ASSETS
+	if (file->bAsset) {
+		if (offset < 0 || offset > file->asset.size)
+			return -1;
+		file->pos = offset;
+		return 0;
+	}
+#endif
+#if ENABLE_LITTLEFS
+	return lfs_file_seek(&lfs, &file->file, offset, LFS_SEEK_SET);
+#else
+	return -1;
+#endif
 }
 
 long int be_ftell(void *hfile) {
-	return lfs_file_tell(&lfs, hfile);
+	beFile_t *file = hfile;
+#if ENABLE_ASSETS
+	if (file->bAsset)
+		return file->pos;
+#endif
+#if ENABLE_LITTLEFS
+	return lfs_file_tell(&lfs, &file->file);
+#else
+	return 0;
+#endif
 }
 
 long int be_fflush(void *hfile) {
-	return lfs_file_sync(&lfs, hfile);
+	beFile_t *file = hfile;
+#if ENABLE_LITTLEFS
+	if (!file->bAsset)
+		return lfs_file_sync(&lfs, &file->file);
+#endif
+	return 0;
 }
 
 size_t be_fsize(void *hfile) {
-	return lfs_file_size(&lfs, hfile);
+	beFile_t *file = hfile;
+#if ENABLE_ASSETS
+	if (file->bAsset)
+		return file->asset.size;
+#endif
+#if ENABLE_LITTLEFS
+	return lfs_file_size(&lfs, &file->file);
+#else
+	return 0;
+#endif
 }
 
-#else // !ENABLE_LITTLEFS
+#else // !ENABLE_LITTLEFS && !ENABLE_ASSETS
 
 void *be_fopen(const char *filename, const char *modes) {
 	return NULL;
@@ -175,4 +259,4 @@ size_t be_fsize(void *hfile) {
 	return 0;
 }
 
-#endif // ENABLE_LITTLEFS
+#endif // ENABLE_LITTLEFS || ENABLE_ASSETS
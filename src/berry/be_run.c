@@ -1,6 +1,9 @@
 #include "be_run.h"
 #include "../logging/logging.h"
 #include "be_debug.h"
+#include "be_sys.h"
+#include "../cmnds/cmd_public.h"
+#include "../littlefs/our_lfs.h"
 
 const char berryPrelude[] =
 	"_suspended_closures = {}\n"
@@ -19,6 +22,16 @@ const char berryPrelude[] =
 	"\n"
 	"def remove_closure(idx)\n"
 	"  _suspended_closures.remove(idx)\n"
+	"end\n"
+	"\n"
+	"_file_cache = {}\n"
+	"\n"
+	"def _file_cache_get(slot)\n"
+	"  return _file_cache.find(slot)\n"
+	"end\n"
+	"\n"
+	"def _file_cache_set(slot, closure)\n"
+	"  _file_cache[slot] = closure\n"
 	"end\n";
 
 void be_error_pop_all(bvm *vm) {
@@ -40,6 +53,24 @@ void be_dumpstack(bvm *vm) {
 	}
 }
 
+// calls closure on top of the stack and clears the stack afterwards
+static bool berryCallTop(bvm *vm) {
+	int ret_code2 = be_pcall(vm, 0);
+	if (ret_code2 != 0) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "be_pcall fail, retcode %d", ret_code2);
+		be_dumpstack(vm);
+		be_error_pop_all(vm);
+		return false;
+	}
+
+	if (be_top(vm) > 1) {
+		be_error_pop_all(vm);
+	} else {
+		be_pop(vm, 1);
+	}
+	return true;
+}
+
 bool berryRun(bvm *vm, const char *prog) {
 	bool success = true;
 	ADDLOG_INFO(LOG_FEATURE_BERRY, "[berry start]");
@@ -52,24 +83,255 @@ bool berryRun(bvm *vm, const char *prog) {
 		goto err;
 	}
 
-	int ret_code2 = be_pcall(vm, 0);
-	if (ret_code2 != 0) {
-		ADDLOG_INFO(LOG_FEATURE_BERRY, "be_pcall fail, retcode %d", ret_code2);
-		be_dumpstack(vm);
-		be_error_pop_all(vm);
-		success = false;
-		goto err;
+	success = berryCallTop(vm);
+
+err:
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "[berry end]");
+	return success;
+}
+
+// Compiled scripts are cached in LittleFS next to their source,
+// test.be is cached as test.bec and other files (like pages with <?b ?> tags)
+// get .bec appended. Cache file is a regular Berry bytecode file followed by
+// a trailer with hash of the source, so editing the source invalidates it.
+#define BERRY_CACHE_MAGIC		0x4348424F
+
+typedef struct berryCacheTrailer_s {
+	unsigned int magic;
+	unsigned int hash;
+} berryCacheTrailer_t;
+
+static void berryGetCachePath(const char *fname, char *out, int outSize) {
+	int len = strlen(fname);
+
+	if (len > 3 && !strcmp(fname + len - 3, ".be")) {
+		snprintf(out, outSize, "%sc", fname);
+	} else {
+		snprintf(out, outSize, "%s.bec", fname);
 	}
+	out[outSize - 1] = 0;
+}
+// FNV-1a of the file, read in small chunks so the source doesn't have
+// to be loaded into memory when cache is valid
+static bool berryHashFile(const char *fname, unsigned int *outHash) {
+	unsigned char buf[64];
+	unsigned int hash = 2166136261u;
+	void *f;
+	int got, i;
 
-	if (be_top(vm) > 1) {
+	f = be_fopen(fname, "r");
+	if (f == 0) {
+		return false;
+	}
+	while ((got = (int)be_fread(f, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < got; i++) {
+			hash = (hash ^ buf[i]) * 16777619u;
+		}
+	}
+	be_fclose(f);
+	*outHash = hash;
+	return true;
+}
+static bool berryLoadCache(bvm *vm, const char *cache, unsigned int hash) {
+	berryCacheTrailer_t t;
+	void *f;
+	long size;
+	bool ok;
+
+	f = be_fopen(cache, "r");
+	if (f == 0) {
+		return false;
+	}
+	size = (long)be_fsize(f);
+	ok = size > (long)sizeof(t) && be_fseek(f, size - sizeof(t)) >= 0
+		&& be_fread(f, &t, sizeof(t)) == sizeof(t);
+	be_fclose(f);
+	if (!ok || t.magic != BERRY_CACHE_MAGIC || t.hash != hash) {
+		return false;
+	}
+	// loader stops after the main function, so trailer is not seen by it
+	if (be_loadfile(vm, cache) != 0) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "Cached bytecode %s is broken, recompiling", cache);
 		be_error_pop_all(vm);
-	} else {
+		return false;
+	}
+	return true;
+}
+static void berrySaveCache(bvm *vm, const char *cache, unsigned int hash) {
+	berryCacheTrailer_t t;
+	void *f;
+
+	// be_savecode raises an error when it can't open the file and there is
+	// no protected call around it, so check that file can be created first
+	f = be_fopen(cache, "w");
+	if (f == 0) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "Can't create bytecode cache %s", cache);
+		return;
+	}
+	be_fclose(f);
+	be_savecode(vm, cache);
+
+	t.magic = BERRY_CACHE_MAGIC;
+	t.hash = hash;
+	f = be_fopen(cache, "a");
+	if (f == 0) {
+		return;
+	}
+	be_fwrite(f, &t, sizeof(t));
+	be_fclose(f);
+}
+
+// Closures of last few files run are also kept in the VM (_file_cache),
+// so a page served again is only called, without reading the file.
+// LittleFS has no mtime, so slot stays valid while nothing was written
+// to LittleFS at all. After any write, source hash is checked again,
+// which still skips transpiling and compiling when file is the same.
+#define BERRY_RAM_CACHE_SLOTS	4
+
+typedef struct berryRamCache_s {
+	char fname[64];
+	unsigned int hash;
+	// berryWriteGeneration() when hash was last checked
+	unsigned int generation;
+	unsigned int lastUse;
+} berryRamCache_t;
+
+static berryRamCache_t g_berryRamCache[BERRY_RAM_CACHE_SLOTS];
+static unsigned int g_berryRamCacheUses;
+static berryCacheStats_t g_berryCacheStats;
+
+static unsigned int berryWriteGeneration() {
+#if ENABLE_LITTLEFS
+	return LFS_GetWriteGeneration();
+#else
+	// can't tell, so hash is checked on every run
+	static unsigned int calls;
+	return ++calls;
+#endif
+}
+
+// pushes cached closure of slot, false when there is none
+static bool berryRamCacheFetch(bvm *vm, int slot) {
+	if (!be_getglobal(vm, "_file_cache_get")) {
+		be_pop(vm, 1);
+		return false;
+	}
+	be_pushint(vm, slot);
+	be_call(vm, 1);
+	be_pop(vm, 1);
+	if (!be_isfunction(vm, -1)) {
+		be_pop(vm, 1);
+		return false;
+	}
+	return true;
+}
+// stores closure on top of the stack, it stays there
+static void berryRamCacheStore(bvm *vm, int slot) {
+	if (!be_getglobal(vm, "_file_cache_set")) {
 		be_pop(vm, 1);
+		return;
 	}
+	be_pushint(vm, slot);
+	be_pushvalue(vm, -3);
+	be_call(vm, 2);
+	be_pop(vm, 3);
+}
+static int berryRamCacheFind(const char *fname) {
+	int i;
 
-err:
-	ADDLOG_INFO(LOG_FEATURE_BERRY, "[berry end]");
-	return success;
+	for (i = 0; i < BERRY_RAM_CACHE_SLOTS; i++) {
+		if (g_berryRamCache[i].fname[0] && !strcmp(g_berryRamCache[i].fname, fname)) {
+			return i;
+		}
+	}
+	return -1;
+}
+// least recently used slot, or one that is not used yet
+static int berryRamCacheVictim() {
+	int i, best;
+
+	best = 0;
+	for (i = 0; i < BERRY_RAM_CACHE_SLOTS; i++) {
+		if (g_berryRamCache[i].fname[0] == 0) {
+			return i;
+		}
+		if (g_berryRamCache[i].lastUse < g_berryRamCache[best].lastUse) {
+			best = i;
+		}
+	}
+	return best;
+}
+void berryResetFileCache() {
+	memset(g_berryRamCache, 0, sizeof(g_berryRamCache));
+}
+void berryGetCacheStats(berryCacheStats_t *out) {
+	*out = g_berryCacheStats;
+}
+bool berryRunFile(bvm *vm, const char *fname, berrySourceLoader_t loadSource) {
+	char cache[64];
+	unsigned int hash, generation, startTick;
+	char *prog;
+	int ret, slot;
+
+	generation = berryWriteGeneration();
+	slot = berryRamCacheFind(fname);
+	if (slot >= 0 && g_berryRamCache[slot].generation == generation
+		&& berryRamCacheFetch(vm, slot)) {
+		g_berryCacheStats.hits++;
+		g_berryRamCache[slot].lastUse = ++g_berryRamCacheUses;
+		ADDLOG_EXTRADEBUG(LOG_FEATURE_BERRY, "[berry start %s, cached]", fname);
+		return berryCallTop(vm);
+	}
+	if (!berryHashFile(fname, &hash)) {
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "berryRunFile: can't open %s", fname);
+		return false;
+	}
+	if (slot >= 0 && g_berryRamCache[slot].hash == hash && berryRamCacheFetch(vm, slot)) {
+		// something else was written, this file is the same
+		g_berryCacheStats.rechecked++;
+		g_berryRamCache[slot].generation = generation;
+		g_berryRamCache[slot].lastUse = ++g_berryRamCacheUses;
+		return berryCallTop(vm);
+	}
+	berryGetCachePath(fname, cache, sizeof(cache));
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "[berry start %s]", fname);
+	if (berryLoadCache(vm, cache, hash)) {
+		g_berryCacheStats.bytecodeLoads++;
+	}
+	else {
+		startTick = xTaskGetTickCount();
+		prog = loadSource(fname);
+		if (prog == 0) {
+			return false;
+		}
+		ret = be_loadbuffer(vm, fname, prog, strlen(prog));
+		free(prog);
+		if (ret != 0) {
+			ADDLOG_INFO(LOG_FEATURE_BERRY, "be_loadbuffer fail, retcode %d: %s", ret, fname);
+			be_dumpstack(vm);
+			be_error_pop_all(vm);
+			return false;
+		}
+		g_berryCacheStats.compiles++;
+		g_berryCacheStats.lastCompileUs = SVM_GetElapsedUs(startTick);
+		g_berryCacheStats.totalCompileUs += g_berryCacheStats.lastCompileUs;
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "%s compiled in %u us", fname, g_berryCacheStats.lastCompileUs);
+		berrySaveCache(vm, cache, hash);
+	}
+	if (strlen(fname) < sizeof(g_berryRamCache[0].fname)) {
+		if (slot < 0) {
+			slot = berryRamCacheVictim();
+		}
+		berryRamCacheStore(vm, slot);
+		strcpy(g_berryRamCache[slot].fname, fname);
+		g_berryRamCache[slot].hash = hash;
+		// saving .bec above was a write too
+		g_berryRamCache[slot].generation = berryWriteGeneration();
+		g_berryRamCache[slot].lastUse = ++g_berryRamCacheUses;
+	}
+	ret = berryCallTop(vm);
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "[berry end %s]", fname);
+	return ret;
 }
 
 void berryRunClosure(bvm *vm, int closureId) {
@@ -6,6 +6,23 @@ extern const char berryPrelude[];
 void be_dumpstack(bvm *vm);
 
 bool berryRun(bvm *vm, const char *prog);
+// returns malloced source of given script, or NULL
+typedef char *(*berrySourceLoader_t)(const char *fname);
+// runs script from LittleFS, using cached bytecode if source has not changed
+bool berryRunFile(bvm *vm, const char *fname, berrySourceLoader_t loadSource);
+typedef struct berryCacheStats_s {
+	// closure kept in VM was called, file was not read
+	unsigned int hits;
+	// LittleFS was written, but source hash was still the same
+	unsigned int rechecked;
+	unsigned int bytecodeLoads;
+	unsigned int compiles;
+	unsigned int lastCompileUs;
+	unsigned int totalCompileUs;
+} berryCacheStats_t;
+void berryGetCacheStats(berryCacheStats_t *out);
+// forgets closures kept in VM, must be called when VM is deleted
+void berryResetFileCache();
 void berryRunClosure(bvm* vm, int closureId);
 void berryRunClosureBytes(bvm *vm, int closureId, byte *data, int len);
 void berryRunClosureIntBytes(bvm *vm, int closureId, int x, const byte *data, int len);
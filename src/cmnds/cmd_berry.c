@@ -2,6 +2,7 @@
 #include "../new_cfg.h"
 #include "../new_pins.h"
 #include "../obk_config.h"
+#include "../quicktick.h"
 
 #if ENABLE_OBK_BERRY
 
@@ -18,8 +19,11 @@
 
 #include "../berry/be_bindings.h"
 #include "../berry/be_run.h"
+#include "../berry/be_arena.h"
+#include "../berry/be_async.h"
 #include "be_repl.h"
 #include "be_vm.h"
+#include "be_gc.h"
 #include "berry.h"
 #include "../libraries/obktime/obktime.h"	// for time functions
 #include "../driver/drv_deviceclock.h"
@@ -34,11 +38,49 @@ typedef struct berryInstance_s
 	int closureId;
 	eventWait_t wait;
 	bool bFire;
+	// wake up time, only for timeouts and fired waiters
+	timerNode_t timer;
 
 	struct berryInstance_s* next;
+	// next handler closure registered for the same event
+	struct berryInstance_s* nextSameEvent;
+	threadStats_t stats;
+#if ENABLE_BERRY_ASYNC
+	// tcp/http/mqtt op the closure waits for, see be_async.c
+	berryAsync_t *async;
+	struct berryInstance_s *nextAwaiting;
+#endif
 } berryInstance_t;
 
 berryInstance_t *g_berryThreads = 0;
+static timerHeap_t g_berryTimers;
+#if ENABLE_BERRY_ASYNC
+// sockets and HTTP replies of waiting threads are checked this often
+#define BERRY_ASYNC_POLL_MS		20
+static berryInstance_t *g_berryAwaiting;
+#endif
+// handler closures by event code, so events nobody subscribed to
+// don't walk the threads and never reach the VM
+static berryInstance_t *g_berryHandlers[CMD_EVENT_MAX_TYPES];
+
+static void Berry_LinkHandler(berryInstance_t *t) {
+	t->nextSameEvent = g_berryHandlers[t->wait.waitingForEvent];
+	g_berryHandlers[t->wait.waitingForEvent] = t;
+}
+static void Berry_UnlinkHandler(berryInstance_t *t) {
+	berryInstance_t **prev;
+
+	prev = &g_berryHandlers[t->wait.waitingForEvent];
+	while (*prev) {
+		if (*prev == t) {
+			// nextSameEvent is kept, so a walk that is currently
+			// on this handler can still continue
+			*prev = t->nextSameEvent;
+			return;
+		}
+		prev = &(*prev)->nextSameEvent;
+	}
+}
 
 berryInstance_t *Berry_RegisterThread() {
 	berryInstance_t *r;
@@ -59,30 +101,113 @@ berryInstance_t *Berry_RegisterThread() {
 	}
 	r->uniqueID = 0;
 	r->currentDelayMS = 0;
+	r->timer.owner = r;
+	memset(&r->stats, 0, sizeof(r->stats));
 	return r;
 }
+int Berry_GetTimeToNextWakeMS() {
+	int next;
+
+	next = TimerHeap_GetTimeToNext(&g_berryTimers);
+#if ENABLE_BERRY_ASYNC
+	if (g_berryAwaiting && (next < 0 || next > BERRY_ASYNC_POLL_MS)) {
+		next = BERRY_ASYNC_POLL_MS;
+	}
+#endif
+	return next;
+}
+#if ENABLE_BERRY_ASYNC
+void berryThreadComplete(berryInstance_t *thread);
+
+static void Berry_UnlinkAwaiting(berryInstance_t *t) {
+	berryInstance_t **prev;
+
+	for (prev = &g_berryAwaiting; *prev; prev = &(*prev)->nextAwaiting) {
+		if (*prev == t) {
+			*prev = t->nextAwaiting;
+			return;
+		}
+	}
+}
+int Berry_Await(bvm *vm, int closureIndex, berryAsync_t *op, int timeoutMs) {
+	berryInstance_t *th;
+	int closure_id, thread_id;
+
+	if (!be_getglobal(vm, "suspend_closure")) {
+		be_pop(vm, 1);
+		Berry_Async_Free(op);
+		be_return_nil(vm);
+	}
+	be_pushvalue(vm, closureIndex);
+	be_call(vm, 1);
+	if (!be_isint(vm, -2)) {
+		be_pop(vm, 2);
+		Berry_Async_Free(op);
+		be_return_nil(vm);
+	}
+	closure_id = be_toint(vm, -2);
+	be_pop(vm, 2);
+	th = Berry_RegisterThread();
+	thread_id = 5000 + closure_id;
+	th->uniqueID = thread_id;
+	th->closureId = closure_id;
+	th->bFire = false;
+	th->async = op;
+	th->nextAwaiting = g_berryAwaiting;
+	g_berryAwaiting = th;
+	// without timeout, only completion of op puts it on the heap
+	if (timeoutMs >= 0) {
+		TimerHeap_Schedule(&g_berryTimers, &th->timer, timeoutMs);
+	}
+	QuickTick_Wake();
+	be_pushint(vm, thread_id);
+	be_return(vm);
+}
+// runs closure of thread with result of its op, or nil on timeout
+static void Berry_ResumeAwaiting(berryInstance_t *t) {
+	berryAsync_t *op;
+	int uniqueID, closureId;
+
+	op = t->async;
+	uniqueID = t->uniqueID;
+	closureId = t->closureId;
+	Berry_UnlinkAwaiting(t);
+	t->async = 0;
+	Berry_Async_Resume(g_vm, closureId, op);
+	Berry_Async_Free(op);
+	// closure may have cancelled itself and its slot may be in use again
+	if (t->uniqueID == uniqueID) {
+		berryRemoveClosure(g_vm, closureId);
+		berryThreadComplete(t);
+	}
+}
+#endif
 
 void CMD_Berry_ProcessWaitersForEvent(byte eventCode, int argument) {
 	berryInstance_t *t;
 
-
-	t = g_berryThreads;
+	// change handlers are on the handler list of their event
+	t = g_berryHandlers[eventCode];
 
 	while (t) {
 		if (CheckEventCondition(&t->wait, eventCode, argument)) {
 			t->bFire = true;
+			// closure is run from Berry_RunThreads
+			TimerHeap_Schedule(&g_berryTimers, &t->timer, 1);
+			QuickTick_Wake();
 		}
-		t = t->next;
+		t = t->nextSameEvent;
 	}
 	// TODO: better
 	CMD_Berry_RunEventHandlers_IntInt(eventCode, argument, 0);
 }
 void CMD_Berry_RunEventHandlers_IntInt(byte eventCode, int argument, int argument2) {
-	berryInstance_t *t;
+	berryInstance_t *t, *next;
 
-	t = g_berryThreads;
+	t = g_berryHandlers[eventCode];
 
 	while (t) {
+		next = t->nextSameEvent;
 		if (t->wait.waitingForEvent == eventCode
 			&& t->wait.waitingForRelation == 'a') {
 			berryRunClosureIntInt(g_vm, t->closureId, argument, argument2);
@@ -91,17 +216,18 @@ void CMD_Berry_RunEventHandlers_IntInt(byte eventCode, int argument, int argumen
 			&& t->wait.waitingForArgument == argument) {
 			berryRunClosureInt(g_vm, t->closureId, argument2);
 		}
-		t = t->next;
+		t = next;
 	}
 }
 
 int CMD_Berry_RunEventHandlers_StrPtr(byte eventCode, const char *argument, void* argument2) {
-	berryInstance_t *t;
+	berryInstance_t *t, *next;
 
-	t = g_berryThreads;
+	t = g_berryHandlers[eventCode];
 
 	int calls = 0;
 	while (t) {
+		next = t->nextSameEvent;
 		if (t->wait.waitingForEvent == eventCode
 			&& t->wait.waitingForRelation == 'a') {
 			berryRunClosureStr(g_vm, t->closureId, argument, argument2);
@@ -112,17 +238,18 @@ int CMD_Berry_RunEventHandlers_StrPtr(byte eventCode, const char *argument, void
 			berryRunClosurePtr(g_vm, t->closureId, argument2);
 			calls++;
 		}
-		t = t->next;
+		t = next;
 	}
 	return calls;
 }
 
 void CMD_Berry_RunEventHandlers_IntBytes(byte eventCode, int argument, const byte *data, int size) {
-	berryInstance_t *t;
+	berryInstance_t *t, *next;
 
-	t = g_berryThreads;
+	t = g_berryHandlers[eventCode];
 
 	while (t) {
+		next = t->nextSameEvent;
 		if (t->wait.waitingForEvent == eventCode
 			&& t->wait.waitingForRelation == 'a') {
 			berryRunClosureIntBytes(g_vm, t->closureId, argument, data, size);
@@ -132,16 +259,17 @@ void CMD_Berry_RunEventHandlers_IntBytes(byte eventCode, int argument, const byt
 			&& t->wait.waitingForArgument == argument) {
 			berryRunClosureBytes(g_vm, t->closureId, data, size);
 		}
-		t = t->next;
+		t = next;
 	}
 }
 int CMD_Berry_RunEventHandlers_Str(byte eventCode, const char *argument, const char *argument2) {
-	berryInstance_t *t;
+	berryInstance_t *t, *next;
 
-	t = g_berryThreads;
+	t = g_berryHandlers[eventCode];
 
 	int c_run = 0;
 	while (t) {
+		next = t->nextSameEvent;
 		if (t->wait.waitingForEvent == eventCode
 			&& t->wait.waitingForRelation == 'a') {
 			berryRunClosureStr(g_vm, t->closureId, argument, argument2);
@@ -153,10 +281,42 @@ int CMD_Berry_RunEventHandlers_Str(byte eventCode, const char *argument, const c
 			berryRunClosureStr(g_vm, t->closureId, argument2, "");
 			c_run++;
 		}
-		t = t->next;
+		t = next;
 	}
 	return c_run;
 }
+// OnCmd handler for a given name becomes a regular command, so it is found
+// by hash lookup and not through unknown command fallback
+static commandResult_t Berry_RunCommandHandler(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	static int g_guard = 0;
+	int c_run;
+
+	if (g_guard) {
+		return CMD_RES_UNKNOWN_COMMAND;
+	}
+	g_guard = 1;
+	c_run = CMD_Berry_RunEventHandlers_Str(CMD_EVENT_ON_CMD, cmd, args);
+	g_guard = 0;
+	// handler might have been cancelled, commands can't be removed
+	return c_run > 0 ? CMD_RES_OK : CMD_RES_UNKNOWN_COMMAND;
+}
+static void Berry_RegisterCommand(const char *name) {
+	command_t *cmd;
+	char *nameMem;
+
+	if (CMD_Find(name)) {
+		// already registered by earlier handler, or a native command
+		return;
+	}
+	nameMem = strdup(name);
+	cmd = CMD_RegisterCommand(nameMem, Berry_RunCommandHandler, NULL);
+	if (cmd) {
+		cmd->commandFlags |= CMD_FLAG_FREE_NAME;
+	}
+	else {
+		free(nameMem);
+	}
+}
 int be_addClosure(bvm *vm, const char *eventName, int relation, int reqArg, const char *reqArgStr, int argumentIndex) {
 	int eventCode = EVENT_ParseEventName(eventName);
 	if (eventCode == CMD_EVENT_NONE) {
@@ -195,6 +355,10 @@ int be_addClosure(bvm *vm, const char *eventName, int relation, int reqArg, cons
 		}
 		th->wait.waitingForRelation = relation;
 		th->closureId = closure_id;
+		Berry_LinkHandler(th);
+		if (eventCode == CMD_EVENT_ON_CMD && relation == 'm' && reqArgStr) {
+			Berry_RegisterCommand(reqArgStr);
+		}
 
 		// remove the 2 values we pushed on the stack
 		be_pop(vm, 2);
@@ -294,6 +458,9 @@ int be_setTimeoutInternal(bvm *vm, int repeats) {
 			th->totalDelayMS = delay_ms;
 			th->closureId = closure_id;
 			th->delayRepeats = repeats;
+			// zero delay runs on the next tick
+			TimerHeap_Schedule(&g_berryTimers, &th->timer, delay_ms > 0 ? delay_ms : 1);
+			QuickTick_Wake();
 
 			// remove the 2 values we pushed on the stack
 			be_pop(vm, 2);
@@ -414,10 +581,33 @@ int be_gmtime(bvm *vm) {
 
 
 
+#if ENABLE_BERRY_ARENA
+#ifndef BERRY_ARENA_DEFAULT_SIZE
+#if WINDOWS
+#define BERRY_ARENA_DEFAULT_SIZE		(1024 * 1024)
+#else
+#define BERRY_ARENA_DEFAULT_SIZE		(32 * 1024)
+#endif
+#endif
+// arena size for next VM start, 0 means general heap
+static int g_berryArenaSize = BERRY_ARENA_DEFAULT_SIZE;
+// collect garbage between ticks when arena is this percent full
+static int g_berryArenaGCPercent = 75;
+
+static void Berry_CheckArena() {
+	if (g_vm && Berry_ArenaWantsGC(g_berryArenaGCPercent)) {
+		be_gc_collect(g_vm);
+		Berry_ArenaOnGC();
+	}
+}
+#endif
 static int BasicInit() {
 	if (!g_vm) {
 		// Lazy init for now, to avoid resource consumption and boot loops
 		ADDLOG_INFO(LOG_FEATURE_BERRY, "[berry init]");
+#if ENABLE_BERRY_ARENA
+		Berry_ArenaInit(g_berryArenaSize);
+#endif
 		g_vm = be_vm_new(); /* create a virtual machine instance */
 		be_regfunc(g_vm, "setChannel", be_ChannelSet);
 		be_regfunc(g_vm, "setTimeout", be_setTimeout);
@@ -445,6 +635,9 @@ static int BasicInit() {
 		if (!berryRun(g_vm, berryPrelude)) {
 			return 0;
 		}
+#if ENABLE_BERRY_ASYNC
+		Berry_Async_Register(g_vm);
+#endif
 	}
 	return 1;
 }
@@ -460,6 +653,18 @@ void eval_berry_snippet(const char *s) {
 		berryRun(g_vm, s);
 	}
 }
+static char *Berry_ReadScriptFile(const char *fname) {
+	return (char*)LFS_ReadFile(fname);
+}
+bool Berry_RunFile(const char *fname, char *(*loadSource)(const char *fname)) {
+	if (!BasicInit()) {
+		return false;
+	}
+	if (loadSource == 0) {
+		loadSource = Berry_ReadScriptFile;
+	}
+	return berryRunFile(g_vm, fname, loadSource);
+}
 
 void berryThreadComplete(berryInstance_t *thread) {
 	// Free the associated closure if it exists
@@ -481,6 +686,17 @@ void berryThreadComplete(berryInstance_t *thread) {
 	}
 
 	// Reset all Berry-specific flags and data
+	TimerHeap_Remove(&g_berryTimers, &thread->timer);
+	if (thread->wait.waitingForEvent) {
+		Berry_UnlinkHandler(thread);
+	}
+#if ENABLE_BERRY_ASYNC
+	if (thread->async) {
+		Berry_UnlinkAwaiting(thread);
+		Berry_Async_Free(thread->async);
+		thread->async = 0;
+	}
+#endif
 	thread->closureId = -1;
 	thread->uniqueID = 0;
 	thread->currentDelayMS = 0;
@@ -506,8 +722,15 @@ void stopBerrySVM() {
 void CMD_StopBerry() {
 	if (g_vm) {
 		stopBerrySVM();
+#if ENABLE_BERRY_ASYNC
+		Berry_Async_Shutdown();
+#endif
 		be_vm_delete(g_vm);
 		g_vm = NULL;
+		berryResetFileCache();
+#if ENABLE_BERRY_ARENA
+		Berry_ArenaRelease();
+#endif
 	}
 }
 static commandResult_t CMD_StopBerryCommand(const void *context, const char *cmd, const char *args, int cmdFlags) {
@@ -544,6 +767,27 @@ void Berry_StopScripts(int id) {
 		t = t->next;
 	}
 }
+static bool Berry_IsAwaiting(berryInstance_t *t) {
+#if ENABLE_BERRY_ASYNC
+	return t->async != 0;
+#else
+	return false;
+#endif
+}
+void Berry_ListThreads() {
+	berryInstance_t *t;
+	int cnt;
+
+	cnt = 0;
+	for (t = g_berryThreads; t; t = t->next) {
+		if (t->uniqueID > 0) {
+			ADDLOG_INFO(LOG_FEATURE_CMD, "[%i] Berry thread UID %i - %s - runs %u, total %u us, max %u us, overruns %u",
+				cnt, t->uniqueID, t->wait.waitingForEvent ? "handler" : (Berry_IsAwaiting(t) ? "await" : "timer"),
+				t->stats.runs, t->stats.totalUs, t->stats.maxUs, t->stats.overruns);
+		}
+		cnt++;
+	}
+}
 int Berry_GetStackSizeTotal() {
 	if (g_vm) {
 		int size = g_vm->stacktop - g_vm->stack;    /* with debug enabled, stack increase may be negative */
@@ -560,54 +804,125 @@ int Berry_GetStackSizeCurrent() {
 }
 
 void Berry_RunThreads(int deltaMS) {
-	int c_sleep, c_run;
-
-	c_sleep = 0;
-	c_run = 0;
-
+	berryInstance_t *t;
+	timerNode_t *n;
+	int uniqueID;
+	unsigned int tickStart, start;
+
+	TimerHeap_Advance(&g_berryTimers, deltaMS);
+	tickStart = SYSPERF_GetTimeUs();
+#if ENABLE_BERRY_ASYNC
+	// completed waits go on the heap and are resumed below,
+	// within the same tick budget as timeouts
+	for (t = g_berryAwaiting; t; t = t->nextAwaiting) {
+		if (!t->bFire && Berry_Async_Poll(t->async)) {
+			t->bFire = true;
+			TimerHeap_Schedule(&g_berryTimers, &t->timer, 0);
+		}
+	}
+#endif
 
-	berryInstance_t *g_activeThread = g_berryThreads;
-	while (g_activeThread) {
-		if (g_activeThread->uniqueID > 0) {
-			if (g_activeThread->wait.waitingForEvent) {
-				if (g_activeThread->bFire) {
-					berryRunClosure(g_vm, g_activeThread->closureId);
-					g_activeThread->bFire = false;
-				}
-				// do nothing
-			}
-			else {
-				if (g_activeThread->currentDelayMS > 0) {
-					g_activeThread->currentDelayMS -= deltaMS;
-					// the following block is needed to handle with long freezes on simulator
-					if (g_activeThread->currentDelayMS <= 0) {
-						if (g_activeThread->delayRepeats == -1) {
-							berryRunClosure(g_vm, g_activeThread->closureId);
-							g_activeThread->currentDelayMS = g_activeThread->totalDelayMS;
-						}
-						else if (g_activeThread->delayRepeats > 0) {
-							g_activeThread->delayRepeats--;
-							berryRunClosure(g_vm, g_activeThread->closureId);
-							g_activeThread->currentDelayMS = g_activeThread->totalDelayMS;
-						}
-						else {
-							// finish totally
-							berryRunClosure(g_vm, g_activeThread->closureId);
-							berryRemoveClosure(g_vm, g_activeThread->closureId);
-							g_activeThread->closureId = 0;
-							g_activeThread->uniqueID = 0;//free
-						}
-					}
-				}
-				else {
-					Berry_RunThread(g_activeThread);
-				}
+	// only due timeouts and waiters with fired event are on the heap,
+	// closures can't be interrupted, but once the tick budget is used
+	// the remaining due ones wait on the heap for the next tick
+	while (!SVM_IsTickBudgetUsed(tickStart)) {
+		n = TimerHeap_PopDue(&g_berryTimers);
+		if (n == 0) {
+			break;
+		}
+		t = (berryInstance_t*)n->owner;
+		if (t->uniqueID <= 0) {
+			continue;
+		}
+		uniqueID = t->uniqueID;
+		start = SYSPERF_GetTimeUs();
+#if ENABLE_BERRY_ASYNC
+		if (t->async) {
+			Berry_ResumeAwaiting(t);
+			SVM_AccountRun(&t->stats, start, "Berry", uniqueID);
+			continue;
+		}
+#endif
+		if (t->wait.waitingForEvent) {
+			if (t->bFire) {
+				t->bFire = false;
+				berryRunClosure(g_vm, t->closureId);
+				SVM_AccountRun(&t->stats, start, "Berry", uniqueID);
 			}
+			continue;
+		}
+		if (t->currentDelayMS <= 0) {
+			Berry_RunThread(t);
+			SVM_AccountRun(&t->stats, start, "Berry", uniqueID);
+			continue;
+		}
+		if (t->delayRepeats == -1) {
+			berryRunClosure(g_vm, t->closureId);
+		}
+		else if (t->delayRepeats > 0) {
+			t->delayRepeats--;
+			berryRunClosure(g_vm, t->closureId);
+		}
+		else {
+			// finish totally
+			berryRunClosure(g_vm, t->closureId);
+			SVM_AccountRun(&t->stats, start, "Berry", uniqueID);
+			berryRemoveClosure(g_vm, t->closureId);
+			t->closureId = 0;
+			t->uniqueID = 0;//free
+			continue;
 		}
-		g_activeThread = g_activeThread->next;
+		SVM_AccountRun(&t->stats, start, "Berry", uniqueID);
+		// closure may have cancelled itself
+		if (t->uniqueID == uniqueID && t->timer.slot == 0) {
+			t->currentDelayMS = t->totalDelayMS;
+			TimerHeap_Schedule(&g_berryTimers, &t->timer, t->totalDelayMS > 0 ? t->totalDelayMS : 1);
+		}
+	}
+#if ENABLE_BERRY_ARENA
+	Berry_CheckArena();
+#endif
+}
+#if ENABLE_BERRY_ARENA
+static commandResult_t CMD_BerryArena(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	berryArenaStats_t st;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		g_berryArenaSize = Tokenizer_GetArgInteger(0);
+		g_berryArenaGCPercent = Tokenizer_GetArgIntegerDefault(1, g_berryArenaGCPercent);
+		ADDLOG_INFO(LOG_FEATURE_BERRY, "Berry arena will be %i bytes (GC at %i%%) on next VM start",
+			g_berryArenaSize, g_berryArenaGCPercent);
+		return CMD_RES_OK;
 	}
+	Berry_GetArenaStats(&st);
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "Berry arena: %i bytes, used %i, peak %i, allocs %i, frees %i, failed %i, collections %i",
+		st.size, st.used, st.peak, st.allocs, st.frees, st.failed, st.collections);
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "Berry stack: %i total, %i current",
+		Berry_GetStackSizeTotal(), Berry_GetStackSizeCurrent());
+	return CMD_RES_OK;
+}
+#endif
+static commandResult_t CMD_BerryCache(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	berryCacheStats_t st;
+
+	berryGetCacheStats(&st);
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "Berry file cache: %u hits, %u rechecked, %u bytecode loads, %u compiles",
+		st.hits, st.rechecked, st.bytecodeLoads, st.compiles);
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "Berry compile time: last %u us, total %u us",
+		st.lastCompileUs, st.totalCompileUs);
+	return CMD_RES_OK;
+}
+#if ENABLE_BERRY_ASYNC
+static commandResult_t CMD_BerryAsync(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	berryAsyncStats_t st;
 
+	Berry_Async_GetStats(&st);
+	ADDLOG_INFO(LOG_FEATURE_BERRY, "Berry async: %i waiting, %i sockets open, %u completed, %u timed out",
+		st.waiting, st.sockets, st.completed, st.timeouts);
+	return CMD_RES_OK;
 }
+#endif
 void CMD_InitBerry() {
 	//cmddetail:{"name":"berry","args":"[Berry code]",
 	//cmddetail:"descr":"Execute Berry code",
@@ -619,6 +934,25 @@ void CMD_InitBerry() {
 	//cmddetail:"fn":"CMD_StopBerryCommand","file":"cmnds/cmd_berry.c","requires":"",
 	//cmddetail:"examples":"stopBerry"}
 	CMD_RegisterCommand("stopBerry", CMD_StopBerryCommand, NULL);
+	//cmddetail:{"name":"berryCache","args":"",
+	//cmddetail:"descr":"Prints how often Berry files and pages were run from closure kept in VM, checked again after LittleFS write, loaded from bytecode or compiled, and time spent compiling",
+	//cmddetail:"fn":"CMD_BerryCache","file":"cmnds/cmd_berry.c","requires":"",
+	//cmddetail:"examples":"berryCache"}
+	CMD_RegisterCommand("berryCache", CMD_BerryCache, NULL);
+#if ENABLE_BERRY_ARENA
+	//cmddetail:{"name":"berryArena","args":"[SizeBytes][GCPercent]",
+	//cmddetail:"descr":"Without arguments, prints Berry arena usage, peak, allocation and GC counters. With arguments, sets arena size (0 means general heap) and GC threshold used on next Berry VM start, so put it in autoexec.bat or use stopBerry first.",
+	//cmddetail:"fn":"CMD_BerryArena","file":"cmnds/cmd_berry.c","requires":"",
+	//cmddetail:"examples":"berryArena 40000 70"}
+	CMD_RegisterCommand("berryArena", CMD_BerryArena, NULL);
+#endif
+#if ENABLE_BERRY_ASYNC
+	//cmddetail:{"name":"berryAsync","args":"",
+	//cmddetail:"descr":"Prints how many tcp, http and mqtt waits of Berry scripts are pending, sockets opened by scripts, and how many waits completed or timed out",
+	//cmddetail:"fn":"CMD_BerryAsync","file":"cmnds/cmd_berry.c","requires":"",
+	//cmddetail:"examples":"berryAsync"}
+	CMD_RegisterCommand("berryAsync", CMD_BerryAsync, NULL);
+#endif
 }
 
 #endif
@@ -0,0 +1,300 @@
+#include "../new_common.h"
+#include "../new_pins.h"
+#include "../logging/logging.h"
+#include "cmd_public.h"
+#include "cmd_local.h"
+#include "../quicktick.h"
+
+#if ENABLE_CHANNEL_STATS
+
+// Rolling statistics of channels, so rules can use "average power over
+// 5 min" without script polling CHANNEL_Get every second.
+// Channel value holds until next change, so all of them are weighted by
+// time. Window is split into CHSTAT_SLOTS slots, closed slot adds its sum
+// to running total and its min/max to monotonic queues, so update and read
+// are O(1) (amortized) and window is exact to one slot.
+// Only channels with tracker take memory, one tracker per channel/window.
+#define CHSTAT_SLOTS			16
+
+typedef struct chStatQueue_s {
+	// slot numbers, values are in slot arrays
+	unsigned short seq[CHSTAT_SLOTS];
+	byte head;
+	byte len;
+} chStatQueue_t;
+
+typedef struct chStat_s {
+	struct chStat_s *next;
+	byte ch;
+	int window;
+	uint32_t slotMS;
+	// start of open slot and time value was last added to it
+	uint32_t slotStart;
+	uint32_t lastTime;
+	float value;
+	float ema;
+	// open slot, sum is value * seconds
+	float slotSum;
+	float slotMin;
+	float slotMax;
+	float slotFirst;
+	// closed slots, ring indexed by slot number
+	unsigned short seq;
+	byte used;
+	float sums[CHSTAT_SLOTS];
+	float mins[CHSTAT_SLOTS];
+	float maxs[CHSTAT_SLOTS];
+	float firsts[CHSTAT_SLOTS];
+	float windowSum;
+	chStatQueue_t minQ;
+	chStatQueue_t maxQ;
+} chStat_t;
+
+unsigned int g_channelStatsMask[(CHANNEL_MAX + 31) / 32];
+static chStat_t *g_chStats = 0;
+
+static unsigned short ChStatQueue_Front(chStatQueue_t *q) {
+	return q->seq[q->head];
+}
+static unsigned short ChStatQueue_Back(chStatQueue_t *q) {
+	return q->seq[(q->head + q->len - 1) % CHSTAT_SLOTS];
+}
+// bMax keeps decreasing maxima, otherwise increasing minima
+static void ChStatQueue_Push(chStatQueue_t *q, const float *vals, unsigned short seq, bool bMax) {
+	float v = vals[seq % CHSTAT_SLOTS];
+	float b;
+
+	while (q->len) {
+		b = vals[ChStatQueue_Back(q) % CHSTAT_SLOTS];
+		if (bMax ? (b > v) : (b < v)) {
+			break;
+		}
+		q->len--;
+	}
+	// slot leaving window, pushed one overwrites it in ring
+	if (q->len && (unsigned short)(seq - ChStatQueue_Front(q)) >= CHSTAT_SLOTS) {
+		q->head = (q->head + 1) % CHSTAT_SLOTS;
+		q->len--;
+	}
+	q->seq[(q->head + q->len) % CHSTAT_SLOTS] = seq;
+	q->len++;
+}
+static void ChannelStats_CloseSlot(chStat_t *s) {
+	int i = s->seq % CHSTAT_SLOTS;
+
+	if (s->used == CHSTAT_SLOTS) {
+		s->windowSum -= s->sums[i];
+	}
+	else {
+		s->used++;
+	}
+	s->sums[i] = s->slotSum;
+	s->mins[i] = s->slotMin;
+	s->maxs[i] = s->slotMax;
+	s->firsts[i] = s->slotFirst;
+	s->windowSum += s->slotSum;
+	ChStatQueue_Push(&s->minQ, s->mins, s->seq, false);
+	ChStatQueue_Push(&s->maxQ, s->maxs, s->seq, true);
+	s->seq++;
+	s->slotSum = 0;
+	s->slotMin = s->slotMax = s->slotFirst = s->value;
+}
+// adds held value up to now and closes slots that have ended
+static void ChannelStats_Advance(chStat_t *s, uint32_t now) {
+	uint32_t end;
+	float dt;
+	int n = 0;
+
+	dt = (now - s->lastTime) * 0.001f;
+	s->ema += (s->value - s->ema) * (1.0f - expf(-dt / s->window));
+	while (now - s->slotStart >= s->slotMS) {
+		end = s->slotStart + s->slotMS;
+		s->slotSum += s->value * (end - s->lastTime) * 0.001f;
+		ChannelStats_CloseSlot(s);
+		s->slotStart = end;
+		s->lastTime = end;
+		// whole window went by, rest of slots would be the same
+		if (++n > CHSTAT_SLOTS) {
+			s->slotStart = now - (now - s->slotStart) % s->slotMS;
+			s->lastTime = s->slotStart;
+			break;
+		}
+	}
+	s->slotSum += s->value * (now - s->lastTime) * 0.001f;
+	s->lastTime = now;
+}
+void ChannelStats_Update(int ch, float value) {
+	uint32_t now = SYSPERF_GetTimeMs();
+	chStat_t *s;
+
+	for (s = g_chStats; s; s = s->next) {
+		if (s->ch != ch) {
+			continue;
+		}
+		ChannelStats_Advance(s, now);
+		s->value = value;
+		if (value < s->slotMin) {
+			s->slotMin = value;
+		}
+		if (value > s->slotMax) {
+			s->slotMax = value;
+		}
+	}
+}
+static chStat_t *ChannelStats_Find(int ch, int window) {
+	chStat_t *s;
+
+	for (s = g_chStats; s; s = s->next) {
+		if (s->ch == ch && s->window == window) {
+			return s;
+		}
+	}
+	return 0;
+}
+static float ChannelStats_Compute(chStat_t *s, int stat) {
+	float span, v;
+
+	ChannelStats_Advance(s, SYSPERF_GetTimeMs());
+	// seconds covered by closed slots and open one
+	span = (s->used * s->slotMS + (s->lastTime - s->slotStart)) * 0.001f;
+	switch (stat) {
+	case CHSTAT_AVG:
+		if (span <= 0) {
+			return s->value;
+		}
+		return (s->windowSum + s->slotSum) / span;
+	case CHSTAT_MIN:
+		v = s->slotMin;
+		if (s->minQ.len && s->mins[ChStatQueue_Front(&s->minQ) % CHSTAT_SLOTS] < v) {
+			v = s->mins[ChStatQueue_Front(&s->minQ) % CHSTAT_SLOTS];
+		}
+		return v;
+	case CHSTAT_MAX:
+		v = s->slotMax;
+		if (s->maxQ.len && s->maxs[ChStatQueue_Front(&s->maxQ) % CHSTAT_SLOTS] > v) {
+			v = s->maxs[ChStatQueue_Front(&s->maxQ) % CHSTAT_SLOTS];
+		}
+		return v;
+	case CHSTAT_SUM:
+		return s->windowSum + s->slotSum;
+	case CHSTAT_RATE:
+		if (span <= 0) {
+			return 0;
+		}
+		// from value at start of oldest slot
+		v = s->used ? s->firsts[(unsigned short)(s->seq - s->used) % CHSTAT_SLOTS] : s->slotFirst;
+		return (s->value - v) / span;
+	case CHSTAT_EMA:
+		return s->ema;
+	}
+	return 0;
+}
+bool ChannelStats_Get(int ch, int window, int stat, float *out) {
+	chStat_t *s = ChannelStats_Find(ch, window);
+
+	if (s == 0) {
+		*out = 0;
+		return false;
+	}
+	*out = ChannelStats_Compute(s, stat);
+	return true;
+}
+void ChannelStats_ForEach(void *userData, void (*callback)(int ch, int window, const float *stats, void *userData)) {
+	float stats[CHSTAT_COUNT];
+	chStat_t *s;
+	int i;
+
+	for (s = g_chStats; s; s = s->next) {
+		for (i = 0; i < CHSTAT_COUNT; i++) {
+			stats[i] = ChannelStats_Compute(s, i);
+		}
+		callback(s->ch, s->window, stats, userData);
+	}
+}
+static void ChannelStats_UpdateMask() {
+	chStat_t *s;
+
+	memset(g_channelStatsMask, 0, sizeof(g_channelStatsMask));
+	for (s = g_chStats; s; s = s->next) {
+		g_channelStatsMask[s->ch / 32] |= 1u << (s->ch % 32);
+	}
+}
+static int ChannelStats_Remove(int ch) {
+	chStat_t **p = &g_chStats;
+	chStat_t *s;
+	int removed = 0;
+
+	while (*p) {
+		s = *p;
+		if (ch < 0 || s->ch == ch) {
+			*p = s->next;
+			free(s);
+			removed++;
+		}
+		else {
+			p = &s->next;
+		}
+	}
+	ChannelStats_UpdateMask();
+	return removed;
+}
+// ChannelStats [Channel] [WindowSeconds]
+static commandResult_t CMD_ChannelStats(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	chStat_t *s;
+	int ch, window;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 2)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	ch = Tokenizer_GetArgInteger(0);
+	window = Tokenizer_GetArgInteger(1);
+	if (ch < 0 || ch >= CHANNEL_MAX || window <= 0) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	if (ChannelStats_Find(ch, window)) {
+		return CMD_RES_OK;
+	}
+	s = (chStat_t*)malloc(sizeof(chStat_t));
+	if (s == 0) {
+		return CMD_RES_ERROR;
+	}
+	memset(s, 0, sizeof(chStat_t));
+	s->ch = ch;
+	s->window = window;
+	s->slotMS = window * 1000 / CHSTAT_SLOTS;
+	if (s->slotMS == 0) {
+		s->slotMS = 1;
+	}
+	s->slotStart = s->lastTime = SYSPERF_GetTimeMs();
+	s->value = s->ema = CHANNEL_GetFloat(ch);
+	s->slotMin = s->slotMax = s->slotFirst = s->value;
+	s->next = g_chStats;
+	g_chStats = s;
+	ChannelStats_UpdateMask();
+	ADDLOG_INFO(LOG_FEATURE_CMD, "ChannelStats: channel %i over %i s", ch, window);
+	return CMD_RES_OK;
+}
+// ChannelStats_Clear [Channel]
+static commandResult_t CMD_ChannelStats_Clear(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int removed;
+
+	Tokenizer_TokenizeString(args, 0);
+	removed = ChannelStats_Remove(Tokenizer_GetArgIntegerDefault(0, -1));
+	ADDLOG_INFO(LOG_FEATURE_CMD, "ChannelStats: %i trackers removed", removed);
+	return CMD_RES_OK;
+}
+void ChannelStats_Init() {
+	//cmddetail:{"name":"ChannelStats","args":"[Channel] [WindowSeconds]",
+	//cmddetail:"descr":"Starts rolling statistics of channel over given window. Values are read as $CHavg1_300, $CHmin1_300, $CHmax1_300, $CHsum1_300 (value * seconds), $CHrate1_300 (change per second) and $CHema1_300, and listed in /api/channelstats.",
+	//cmddetail:"fn":"CMD_ChannelStats","file":"cmnds/cmd_channelStats.c","requires":"",
+	//cmddetail:"examples":"ChannelStats 1 300"}
+	CMD_RegisterCommand("ChannelStats", CMD_ChannelStats, NULL);
+	//cmddetail:{"name":"ChannelStats_Clear","args":"[Channel]",
+	//cmddetail:"descr":"Removes statistics of given channel, or all of them without argument.",
+	//cmddetail:"fn":"CMD_ChannelStats_Clear","file":"cmnds/cmd_channelStats.c","requires":"",
+	//cmddetail:"examples":"ChannelStats_Clear 1"}
+	CMD_RegisterCommand("ChannelStats_Clear", CMD_ChannelStats_Clear, NULL);
+}
+
+#endif
@@ -527,7 +527,33 @@ static commandResult_t CMD_PinDeepSleep(const void *context, const char *cmd, co
 	g_bWantPinDeepSleep = 1;
 	return CMD_RES_OK;
 }
+// ChannelSaveDelay - print write-behind stats of remembered channels
+// ChannelSaveDelay [DelaySeconds] [OptionalIntervalSeconds]
+// ChannelSaveDelay flush - write pending channels now
+static commandResult_t CMD_ChannelSaveDelay(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	channelSaveStats_t st;
+	int delay, interval, pending;
+
+	Tokenizer_TokenizeString(args, 0);
+
+	CHANNEL_GetSaveStats(&st, &delay, &interval, &pending);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		if (!stricmp(Tokenizer_GetArg(0), "flush")) {
+			CHANNEL_FlushSaves();
+			return CMD_RES_OK;
+		}
+		CHANNEL_SetSaveDelay(Tokenizer_GetArgInteger(0), Tokenizer_GetArgIntegerDefault(1, interval));
+		return CMD_RES_OK;
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Channel save delay %i s, interval %i s, pending %i", delay, interval, pending);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "%u changes, %u flash writes of %u values, %u unchanged, %u writes avoided",
+		st.requests, st.writes, st.values, st.unchanged, st.requests - st.writes);
+	return CMD_RES_OK;
+}
 void CMD_InitChannelCommands(){
+#if ENABLE_CHANNEL_STATS
+	ChannelStats_Init();
+#endif
 	//cmddetail:{"name":"SetChannel","args":"[ChannelIndex][ChannelValue]",
 	//cmddetail:"descr":"Sets a raw channel to given value. Relay channels are using 1 and 0 values. PWM channels are within [0,100] range. Do not use this for LED control, because there is a better and more advanced LED driver with dimming and configuration memory (remembers setting after on/off), LED driver commands has 'led_' prefix.",
 	//cmddetail:"fn":"CMD_SetChannel","file":"cmnds/cmd_channels.c","requires":"",
@@ -633,5 +659,10 @@ void CMD_InitChannelCommands(){
 	//cmddetail:"fn":"CMD_Ch","file":"cmnds/cmd_channels.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("Ch", CMD_Ch, NULL);
+	//cmddetail:{"name":"ChannelSaveDelay","args":"[DelaySeconds][OptionalIntervalSeconds]",
+	//cmddetail:"descr":"Remembered channels are saved to flash together, once they did not change for DelaySeconds (default 3), and at most once per IntervalSeconds (default 10). Delay 0 saves every change at once. Without arguments, prints count of changes, flash writes and writes avoided. 'ChannelSaveDelay flush' saves pending channels now.",
+	//cmddetail:"fn":"CMD_ChannelSaveDelay","file":"cmnds/cmd_channels.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("ChannelSaveDelay", CMD_ChannelSaveDelay, NULL);
 
 }
@@ -304,30 +304,61 @@ typedef struct eventHandler_s {
 	int requiredArgument;
 	int requiredArgument2;
 	int requiredArgument3;
-	// command to execute when it happens
-	char *command;
-	// for UART event handlers?
-	char *requiredArgumentText;
-
+	// command to execute when it happens, from string pool
+	const char *command;
+	// command resolved when handler was added
+	preparedCommand_t prepared;
+	// for UART event handlers?, from string pool
+	const char *requiredArgumentText;
+
+	// all handlers, newest first
 	struct eventHandler_s *next;
+	// handlers in the same eventCode bucket
+	struct eventHandler_s *nextSameCode;
+	// handlers in the same eventCode and requiredArgument bucket
+	struct eventHandler_s *nextSameArg;
 } eventHandler_t;
 
+// Handlers are also linked into buckets by event code, and by event code
+// with first argument, so firing an event only visits handlers that may match.
+// Bucket chains keep the newest first order of the main list.
+#define EVENT_CODE_BUCKETS		32
+#define EVENT_ARG_BUCKETS		32
+
 static eventHandler_t *g_eventHandlers = 0;
+static eventHandler_t *g_eventHandlersByCode[EVENT_CODE_BUCKETS];
+static eventHandler_t *g_eventHandlersByArg[EVENT_ARG_BUCKETS];
+
+static int EventHandlers_ArgBucket(byte eventCode, int argument) {
+	return (eventCode + (unsigned int)argument * 7) % EVENT_ARG_BUCKETS;
+}
+static void EventHandlers_Link(eventHandler_t *ev) {
+	int b;
+
+	ev->next = g_eventHandlers;
+	g_eventHandlers = ev;
+	b = ev->eventCode % EVENT_CODE_BUCKETS;
+	ev->nextSameCode = g_eventHandlersByCode[b];
+	g_eventHandlersByCode[b] = ev;
+	b = EventHandlers_ArgBucket(ev->eventCode, ev->requiredArgument);
+	ev->nextSameArg = g_eventHandlersByArg[b];
+	g_eventHandlersByArg[b] = ev;
+}
 
 
 void EventHandlers_ProcessVariableChange_Integer(byte eventCode, int oldValue, int newValue) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByCode[eventCode % EVENT_CODE_BUCKETS];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
 			if(EVENT_EvaluateChangeCondition(ev->eventType, ev->requiredArgument, oldValue, newValue)) {
 				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_ProcessVariableChange_Integer: executing command %s",ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+				CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextSameCode;
 	}
 
 #if ENABLE_OBK_SCRIPTING
@@ -337,50 +368,50 @@ void EventHandlers_ProcessVariableChange_Integer(byte eventCode, int oldValue, i
 
 void EventHandlers_AddEventHandler_Integer(byte eventCode, int type, int requiredArgument, int requiredArgument2, int requiredArgument3, const char *commandToRun)
 {
-	eventHandler_t *ev = malloc(sizeof(eventHandler_t));
+	eventHandler_t *ev = MemPool_Alloc(sizeof(eventHandler_t));
 	memset(ev,0,sizeof(eventHandler_t));
 
-	ev->next = g_eventHandlers;
-	g_eventHandlers = ev;
-
 	ev->requiredArgumentText = NULL;
 	ev->eventType = type;
-	ev->command = strdup(commandToRun);
+	ev->command = StringPool_Intern(commandToRun);
+	CMD_PrepareCommand(&ev->prepared, ev->command);
 	ev->eventCode = eventCode;
 	ev->requiredArgument = requiredArgument;
 	ev->requiredArgument2 = requiredArgument2;
 	ev->requiredArgument3 = requiredArgument3;
+
+	EventHandlers_Link(ev);
 }
 
 void EventHandlers_AddEventHandler_String(byte eventCode, int type, const char *requiredArgument, const char *commandToRun)
 {
-	eventHandler_t *ev = malloc(sizeof(eventHandler_t));
+	eventHandler_t *ev = MemPool_Alloc(sizeof(eventHandler_t));
 	memset(ev,0,sizeof(eventHandler_t));
 
-	ev->next = g_eventHandlers;
-	g_eventHandlers = ev;
-
-	ev->requiredArgumentText = strdup(requiredArgument);
+	ev->requiredArgumentText = StringPool_Intern(requiredArgument);
 	ev->eventType = type;
-	ev->command = strdup(commandToRun);
+	ev->command = StringPool_Intern(commandToRun);
+	CMD_PrepareCommand(&ev->prepared, ev->command);
 	ev->eventCode = eventCode;
 	ev->requiredArgument = 0;
 	ev->requiredArgument2 = 0;
+
+	EventHandlers_Link(ev);
 }
 int EventHandlers_FireEvent3(byte eventCode, int argument, int argument2, int argument3) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EventHandlers_ArgBucket(eventCode, argument)];
 	int ran = 0;
 	while (ev) {
 		if (eventCode == ev->eventCode) {
 			if (argument == ev->requiredArgument && argument2 == ev->requiredArgument2 && argument3 == ev->requiredArgument3) {
 				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent3: executing command %s", ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+				CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 				ran++;
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextSameArg;
 	}
 	return ran;
 }
@@ -388,17 +419,17 @@ int EventHandlers_FireEvent2(byte eventCode, int argument, int argument2) {
 	struct eventHandler_s *ev;
 	int ret = 0;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EventHandlers_ArgBucket(eventCode, argument)];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
 			if(argument == ev->requiredArgument && argument2 == ev->requiredArgument2) {
 				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent2: executing command %s",ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+				CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 				ret++;
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextSameArg;
 	}
 	return ret;
 }
@@ -407,7 +438,7 @@ const char *EventHandlers_GetHandlerCommand2(byte eventCode, int argument, int a
 
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EventHandlers_ArgBucket(eventCode, argument)];
 
 	while (ev) {
 		if (eventCode == ev->eventCode) {
@@ -415,7 +446,7 @@ const char *EventHandlers_GetHandlerCommand2(byte eventCode, int argument, int a
 				return ev->command;
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextSameArg;
 	}
 	return NULL;
 }
@@ -424,16 +455,16 @@ const char *EventHandlers_GetHandlerCommand2(byte eventCode, int argument, int a
 void EventHandlers_FireEvent(byte eventCode, int argument) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByArg[EventHandlers_ArgBucket(eventCode, argument)];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
 			if(argument == ev->requiredArgument) {
 				ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent: executing command %s",ev->command);
-				CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+				CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextSameArg;
 	}
 
 #if ENABLE_OBK_SCRIPTING
@@ -443,18 +474,18 @@ void EventHandlers_FireEvent(byte eventCode, int argument) {
 void EventHandlers_FireEvent_String(byte eventCode, const char *argument) {
 	struct eventHandler_s *ev;
 
-	ev = g_eventHandlers;
+	ev = g_eventHandlersByCode[eventCode % EVENT_CODE_BUCKETS];
 
 	while(ev) {
 		if(eventCode==ev->eventCode) {
 			if(ev->requiredArgumentText != 0) {
 				if(!stricmp(argument,ev->requiredArgumentText)) {
 					ADDLOG_INFO(LOG_FEATURE_EVENT, "EventHandlers_FireEvent_String: executing command %s",ev->command);
-					CMD_ExecuteCommand(ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+					CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
 				}
 			}
 		}
-		ev = ev->next;
+		ev = ev->nextSameCode;
 	}
 
 }
@@ -533,8 +564,9 @@ commandResult_t CMD_ClearAllHandlers(const void *context, const char *cmd, const
 	while(ev != 0) {
 		next = ev->next;
 
-		free(ev->command);
-		free(ev);
+		StringPool_Release(ev->command);
+		StringPool_Release(ev->requiredArgumentText);
+		MemPool_Free(ev);
 
 		ev = next;
 		c++;
@@ -542,6 +574,8 @@ commandResult_t CMD_ClearAllHandlers(const void *context, const char *cmd, const
 
 	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Fried %i handlers", c);
 	g_eventHandlers = 0;
+	memset(g_eventHandlersByCode, 0, sizeof(g_eventHandlersByCode));
+	memset(g_eventHandlersByArg, 0, sizeof(g_eventHandlersByArg));
 
 	return CMD_RES_OK;
 }
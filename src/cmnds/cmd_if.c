@@ -145,6 +145,17 @@ const char *strCompareBound(const char *s, const char *templ, const char *stoppe
 		{
 			return 0;
 		}
+		// '#' is whole number of any length
+		if (bAllowWildCard && *templ == '#') {
+			if (!isdigit((int)(*s))) {
+				return 0;
+			}
+			while (isdigit((int)(*s)) && s != stopper) {
+				s++;
+			}
+			templ++;
+			continue;
+		}
 		// are the chars the same?
 		if (bAllowWildCard && *templ == '*') {
 			if (isdigit((int)(*s))) {
@@ -189,6 +200,33 @@ float getFlagValue(const char *s) {
 	int idx = atoi(s + 5);
 	return CFG_HasFlag(idx);
 }
+#if ENABLE_CHANNEL_STATS
+// $CHavg1_300 is average of channel 1 over 300 seconds, see ChannelStats
+float getChannelStat(const char *s) {
+	static const char *names[CHSTAT_COUNT] = { "avg", "min", "max", "sum", "rate", "ema" };
+	const char *p;
+	float ret;
+	int i, ch;
+
+	s += 3;
+	for (i = 0; i < CHSTAT_COUNT; i++) {
+		if (!wal_strnicmp(s, names[i], strlen(names[i]))) {
+			break;
+		}
+	}
+	p = s;
+	while (*p && !isdigit((int)*p)) {
+		p++;
+	}
+	ch = atoi(p);
+	p = strchr(p, '_');
+	if (i == CHSTAT_COUNT || p == 0) {
+		return 0;
+	}
+	ChannelStats_Get(ch, atoi(p + 1), i, &ret);
+	return ret;
+}
+#endif
 
 #if ENABLE_LED_BASIC
 float getLedDimmer(const char *s) {
@@ -363,6 +401,38 @@ const constant_t g_constants[] = {
 	//cnstdetail:"descr":"Provides channel access, as above.",
 	//cnstdetail:"requires":""}
 	{"$CH*", &getChannelValue},
+#if ENABLE_CHANNEL_STATS
+	//cnstdetail:{"name":"$CHavg#_#",
+	//cnstdetail:"title":"$CHavg#_#",
+	//cnstdetail:"descr":"Time weighted average of channel over window, $CHavg1_300 is channel 1 over 300 seconds. Needs ChannelStats 1 300 first, otherwise 0.",
+	//cnstdetail:"requires":""}
+	{"$CHavg#_#", &getChannelStat},
+	//cnstdetail:{"name":"$CHmin#_#",
+	//cnstdetail:"title":"$CHmin#_#",
+	//cnstdetail:"descr":"Lowest value of channel over window, as above.",
+	//cnstdetail:"requires":""}
+	{"$CHmin#_#", &getChannelStat},
+	//cnstdetail:{"name":"$CHmax#_#",
+	//cnstdetail:"title":"$CHmax#_#",
+	//cnstdetail:"descr":"Highest value of channel over window, as above.",
+	//cnstdetail:"requires":""}
+	{"$CHmax#_#", &getChannelStat},
+	//cnstdetail:{"name":"$CHsum#_#",
+	//cnstdetail:"title":"$CHsum#_#",
+	//cnstdetail:"descr":"Channel value times seconds over window (W over window gives Ws), as above.",
+	//cnstdetail:"requires":""}
+	{"$CHsum#_#", &getChannelStat},
+	//cnstdetail:{"name":"$CHrate#_#",
+	//cnstdetail:"title":"$CHrate#_#",
+	//cnstdetail:"descr":"Change of channel per second over window, as above.",
+	//cnstdetail:"requires":""}
+	{"$CHrate#_#", &getChannelStat},
+	//cnstdetail:{"name":"$CHema#_#",
+	//cnstdetail:"title":"$CHema#_#",
+	//cnstdetail:"descr":"Exponential moving average of channel with window as time constant, as above.",
+	//cnstdetail:"requires":""}
+	{"$CHema#_#", &getChannelStat},
+#endif
 	//cnstdetail:{"name":"$FLAG**",
 	//cnstdetail:"title":"$FLAG**",
 	//cnstdetail:"descr":"Provides flag access, as above.",
@@ -573,27 +643,92 @@ const constant_t g_constants[] = {
 
 static int g_totalConstants = sizeof(g_constants) / sizeof(g_constants[0]);
 
+// Constants are indexed by the first significant character (the one after
+// the '$' prefix, as nearly all of them have it), so lookup only has to
+// compare a handful of names instead of the whole table. Chains keep
+// the table order, so first match still wins like before.
+#define CONSTANT_BUCKETS		64
+#define CONSTANT_CHAIN_END		-1
+
+static short g_constantBuckets[CONSTANT_BUCKETS];
+static short g_constantNext[sizeof(g_constants) / sizeof(g_constants[0])];
+static byte g_constantWildCard[sizeof(g_constants) / sizeof(g_constants[0])];
+static bool g_constantIndexReady = false;
+
+static int CMD_ConstantBucket(const char *s) {
+	int bucket;
+	int c;
+
+	bucket = 0;
+	if (*s == '$') {
+		bucket = CONSTANT_BUCKETS / 2;
+		s++;
+	}
+	c = (unsigned char)*s;
+	// wildcard '*' stands for a digit, so they must share a bucket
+	if (c == '*' || isdigit(c)) {
+		return bucket;
+	}
+	// case insensitive for letters
+	return bucket + (c & 0x1F);
+}
+static void CMD_BuildConstantIndex() {
+	int i, b;
+
+	for (i = 0; i < CONSTANT_BUCKETS; i++) {
+		g_constantBuckets[i] = CONSTANT_CHAIN_END;
+	}
+	// go backwards so that chains end up in table order
+	for (i = g_totalConstants - 1; i >= 0; i--) {
+		b = CMD_ConstantBucket(g_constants[i].constantName);
+		g_constantNext[i] = g_constantBuckets[b];
+		g_constantBuckets[b] = i;
+		g_constantWildCard[i] = strchr(g_constants[i].constantName, '*') != 0
+			|| strchr(g_constants[i].constantName, '#') != 0;
+	}
+	g_constantIndexReady = true;
+}
+
 // tries to expand a given string into a constant
 // So, for $CH1 it will set out to given channel value
 // For $led_dimmer it will set out to current led_dimmer value
 // Etc etc
 // Returns true if constant matches
 // Returns false if no constants found
-const char *CMD_ExpandConstantFloat(const char *s, const char *stop, float *out) {
+static const constant_t *CMD_FindConstantEx(const char *s, const char *stop, const char **after) {
 #if ENABLE_EXPAND_CONSTANT
-	const constant_t *var;
+	const char *ret;
 	int i;
-	var = g_constants;
-	for (i = 0; i < g_totalConstants; i++, var++) {
-		bool bAllowWildCard = strstr(var->constantName, "*") != 0;
-		const char *ret = strCompareBound(s, var->constantName, stop, bAllowWildCard);
+
+	if (g_constantIndexReady == false) {
+		CMD_BuildConstantIndex();
+	}
+	i = g_constantBuckets[CMD_ConstantBucket(s)];
+	while (i != CONSTANT_CHAIN_END) {
+		ret = strCompareBound(s, g_constants[i].constantName, stop, g_constantWildCard[i]);
 		if (ret) {
-			*out = var->getValue(s);
-			ADDLOG_IF_MATHEXP_DBG(LOG_FEATURE_EVENT, "CMD_ExpandConstantFloat: %s", var->name);
-			return ret;
+			*after = ret;
+			return &g_constants[i];
 		}
+		i = g_constantNext[i];
 	}
 #endif
+	return 0;
+}
+static const constant_t *CMD_FindConstant(const char *s, const char *stop) {
+	const char *after;
+	return CMD_FindConstantEx(s, stop, &after);
+}
+const char *CMD_ExpandConstantFloat(const char *s, const char *stop, float *out) {
+	const constant_t *var;
+	const char *ret;
+
+	var = CMD_FindConstantEx(s, stop, &ret);
+	if (var) {
+		*out = var->getValue(s);
+		ADDLOG_IF_MATHEXP_DBG(LOG_FEATURE_EVENT, "CMD_ExpandConstantFloat: %s", var->constantName);
+		return ret;
+	}
 	return false;
 }
 
@@ -668,7 +803,7 @@ const char *CMD_ExpandConstantString(const char *s, const char *stop, char *out,
 #if WINDOWS
 	ret = strCompareBound(s, "$autoexec.bat", stop, false);
 	if (ret) {
-		byte* data = LFS_ReadFile("autoexec.bat");
+		const byte* data = LFS_BorrowFile("autoexec.bat", 0);
 		if (data == 0) {
 #if 1
 			strcpy_safe(out, "No autoexec.bat for this sample", outLen);
@@ -677,8 +812,7 @@ const char *CMD_ExpandConstantString(const char *s, const char *stop, char *out,
 			return false;
 #endif
 		}
-		strcpy_safe(out, (char*)data, outLen);
-		free(data);
+		strcpy_safe(out, (const char*)data, outLen);
 		return ret;
 	}
 	ret = strCompareBound(s, "$readfile(", stop, false);
@@ -699,11 +833,10 @@ const char *CMD_ExpandConstantString(const char *s, const char *stop, char *out,
 			idx = sizeof(tmp) - 2;
 		strncpy(tmp, opening, idx);
 		tmp[idx] = 0;
-		byte* data = LFS_ReadFile(tmp);
+		const byte* data = LFS_BorrowFile(tmp, 0);
 		if (data == 0)
 			return false;
-		strcpy_safe(out, (char*)data, outLen);
-		free(data);
+		strcpy_safe(out, (const char*)data, outLen);
 		return ret;
 	}
 	ret = strCompareBound(s, "$pinstates", stop, false);
@@ -873,7 +1006,62 @@ const char *CMD_FindMatchingBrace(const char *s) {
 	return s;
 
 }
-float CMD_EvaluateExpression(const char *s, const char *stop) {
+static float CMD_ApplyOperator(byte opCode, float a, float b) {
+	float c;
+
+	switch (opCode)
+	{
+	case OP_EQUAL:
+		c = a == b;
+		break;
+	case OP_EQUAL_OR_GREATER:
+		c = a >= b;
+		break;
+	case OP_EQUAL_OR_LESS:
+		c = a <= b;
+		break;
+	case OP_NOT_EQUAL:
+		c = a != b;
+		break;
+	case OP_GREATER:
+		c = a > b;
+		break;
+	case OP_LESS:
+		c = a < b;
+		break;
+	case OP_AND:
+		c = ((int)a) && ((int)b);
+		break;
+	case OP_OR:
+		c = ((int)a) || ((int)b);
+		break;
+	case OP_ADD:
+		c = a + b;
+		break;
+	case OP_SUB:
+		c = a - b;
+		break;
+	case OP_MUL:
+		c = a * b;
+		break;
+	case OP_DIV:
+		c = a / b;
+		break;
+	case OP_MODULO:
+		if (b == 0) {
+			c = 0;
+		}
+		else {
+			c = ((int)a) % ((int)b);
+		}
+		break;
+	default:
+		c = 0;
+		break;
+	}
+	return c;
+}
+static float CMD_EvaluateExpression_Text(const char *s, const char *stop) {
 	byte opCode;
 	const char *op;
 	float a, b, c;
@@ -921,8 +1109,8 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 		// second token block begins at 'p2' and ends at NULL
 		p2 = op + g_operators[opCode].len;
 
-		a = CMD_EvaluateExpression(s, op);
-		b = CMD_EvaluateExpression(p2, stop);
+		a = CMD_EvaluateExpression_Text(s, op);
+		b = CMD_EvaluateExpression_Text(p2, stop);
 
 		// Why, again, %f crashes?
 		//ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_EvaluateExpression: a = %f, b = %f", a, b);
@@ -930,60 +1118,11 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 		//sprintf(g_expDebugBuffer,"CMD_EvaluateExpression: a = %f, b = %f", a, b);
 		//ADDLOG_INFO(LOG_FEATURE_EVENT, g_expDebugBuffer);
 
-		switch (opCode)
-		{
-		case OP_EQUAL:
-			c = a == b;
-			break;
-		case OP_EQUAL_OR_GREATER:
-			c = a >= b;
-			break;
-		case OP_EQUAL_OR_LESS:
-			c = a <= b;
-			break;
-		case OP_NOT_EQUAL:
-			c = a != b;
-			break;
-		case OP_GREATER:
-			c = a > b;
-			break;
-		case OP_LESS:
-			c = a < b;
-			break;
-		case OP_AND:
-			c = ((int)a) && ((int)b);
-			break;
-		case OP_OR:
-			c = ((int)a) || ((int)b);
-			break;
-		case OP_ADD:
-			c = a + b;
-			break;
-		case OP_SUB:
-			c = a - b;
-			break;
-		case OP_MUL:
-			c = a * b;
-			break;
-		case OP_DIV:
-			c = a / b;
-			break;
-		case OP_MODULO:
-			if (b == 0) {
-				c = 0;
-			}
-			else {
-				c = ((int)a) % ((int)b);
-			}
-			break;
-		default:
-			c = 0;
-			break;
-		}
+		c = CMD_ApplyOperator(opCode, a, b);
 		return c;
 	}
 	if (s[0] == '!') {
-		return !CMD_EvaluateExpression(s + 1, stop);
+		return !CMD_EvaluateExpression_Text(s + 1, stop);
 	}
 	if (CMD_ExpandConstantFloat(s, stop, &c)) {
 		return c;
@@ -998,6 +1137,303 @@ float CMD_EvaluateExpression(const char *s, const char *stop) {
 	return atof(g_expDebugBuffer);
 }
 
+
+// Expressions referencing constants (like "$CH1>5" in 'if' or
+// "$CH2*10" in setChannel) are usually evaluated over and over again
+// with the same text. They are compiled once into a postfix bytecode,
+// with constants resolved to getter functions, and kept in a small cache.
+#define EXPR_CACHE_SIZE		8
+#define EXPR_MAX_OPS		48
+#define EXPR_MAX_STACK		16
+#define EXPR_MAX_TEXT		EXPRESSION_DEBUG_BUFFER_SIZE
+
+typedef enum {
+	EXOP_VALUE,
+	EXOP_GETTER,
+	EXOP_NOT,
+	EXOP_OPERATOR,
+} exprOpType_t;
+
+typedef struct exprOp_s {
+	byte type;
+	// for EXOP_OPERATOR
+	byte opCode;
+	// for EXOP_VALUE
+	float value;
+	// for EXOP_GETTER, arg points into compiledExpr_t text
+	float(*getValue)(const char *s);
+	const char *arg;
+} exprOp_t;
+
+typedef struct compiledExpr_s {
+	// own copy of source text, getters are called with pointers into it
+	char *text;
+	unsigned int hash;
+	// evaluations running it right now, it is freed by last of them
+	// if it gets replaced in cache meanwhile
+	short users;
+	byte bEvicted;
+	short numOps;
+	exprOp_t ops[1];
+} compiledExpr_t;
+
+static compiledExpr_t *g_exprCache[EXPR_CACHE_SIZE];
+static int g_exprCacheNext = 0;
+// cache is shared by all threads running scripts and commands
+static SemaphoreHandle_t g_exprCacheMutex = 0;
+
+static unsigned int CMD_HashExpression(const char *s) {
+	unsigned int hash = 2166136261u;
+	while (*s) {
+		hash ^= (byte)*s;
+		hash *= 16777619u;
+		s++;
+	}
+	return hash;
+}
+static const constant_t *CMD_FindConstant(const char *s, const char *stop);
+
+// same parsing rules as CMD_EvaluateExpression_Text, but emits bytecode
+static bool CMD_CompileExpression_r(const char *s, const char *stop, exprOp_t *ops, int *numOps, int depth) {
+	byte opCode;
+	const char *op;
+	const constant_t *var;
+	char tmp[EXPR_MAX_TEXT];
+	int idx;
+
+	if (*numOps >= EXPR_MAX_OPS || depth >= EXPR_MAX_STACK)
+		return false;
+	if (*s == 0 || s >= stop) {
+		ops[*numOps].type = EXOP_VALUE;
+		ops[*numOps].value = 0;
+		(*numOps)++;
+		return true;
+	}
+	while (stop > s && isspace(((int)stop[-1]))) {
+		stop--;
+	}
+	while (isspace(((int)*s))) {
+		s++;
+		if (s >= stop) {
+			ops[*numOps].type = EXOP_VALUE;
+			ops[*numOps].value = 0;
+			(*numOps)++;
+			return true;
+		}
+	}
+	while (*s == '(' && stop[-1] == ')' && CMD_FindMatchingBrace(s) == (stop - 1)) {
+		s++;
+		stop--;
+	}
+	op = CMD_FindOperator(s, stop, &opCode);
+	if (op) {
+		if (!CMD_CompileExpression_r(s, op, ops, numOps, depth))
+			return false;
+		if (!CMD_CompileExpression_r(op + g_operators[opCode].len, stop, ops, numOps, depth + 1))
+			return false;
+		if (*numOps >= EXPR_MAX_OPS)
+			return false;
+		ops[*numOps].type = EXOP_OPERATOR;
+		ops[*numOps].opCode = opCode;
+		(*numOps)++;
+		return true;
+	}
+	if (s[0] == '!') {
+		if (!CMD_CompileExpression_r(s + 1, stop, ops, numOps, depth))
+			return false;
+		if (*numOps >= EXPR_MAX_OPS)
+			return false;
+		ops[*numOps].type = EXOP_NOT;
+		(*numOps)++;
+		return true;
+	}
+	var = CMD_FindConstant(s, stop);
+	if (var) {
+		ops[*numOps].type = EXOP_GETTER;
+		ops[*numOps].getValue = var->getValue;
+		ops[*numOps].arg = s;
+		(*numOps)++;
+		return true;
+	}
+	idx = stop - s;
+	if (idx >= sizeof(tmp))
+		idx = sizeof(tmp) - 1;
+	memcpy(tmp, s, idx);
+	tmp[idx] = 0;
+	ops[*numOps].type = EXOP_VALUE;
+	ops[*numOps].value = atof(tmp);
+	(*numOps)++;
+	return true;
+}
+static compiledExpr_t *CMD_CompileExpression(const char *s, unsigned int hash) {
+	exprOp_t ops[EXPR_MAX_OPS];
+	compiledExpr_t *ce;
+	char *text;
+	int numOps;
+	int len;
+
+	len = strlen(s);
+	if (len >= EXPR_MAX_TEXT)
+		return 0;
+	text = strdup(s);
+	if (text == 0)
+		return 0;
+	numOps = 0;
+	if (!CMD_CompileExpression_r(text, text + len, ops, &numOps, 0)) {
+		free(text);
+		return 0;
+	}
+	ce = (compiledExpr_t*)malloc(sizeof(compiledExpr_t) + sizeof(exprOp_t) * (numOps - 1));
+	if (ce == 0) {
+		free(text);
+		return 0;
+	}
+	ce->text = text;
+	ce->hash = hash;
+	ce->users = 0;
+	ce->bEvicted = 0;
+	ce->numOps = numOps;
+	memcpy(ce->ops, ops, sizeof(exprOp_t) * numOps);
+	return ce;
+}
+static float CMD_RunCompiledExpression(const compiledExpr_t *ce) {
+	float stack[EXPR_MAX_STACK + 1];
+	const exprOp_t *op;
+	int sp;
+	int i;
+
+	sp = 0;
+	for (i = 0; i < ce->numOps; i++) {
+		op = &ce->ops[i];
+		switch (op->type) {
+		case EXOP_VALUE:
+			stack[sp++] = op->value;
+			break;
+		case EXOP_GETTER:
+			stack[sp++] = op->getValue(op->arg);
+			break;
+		case EXOP_NOT:
+			stack[sp - 1] = !stack[sp - 1];
+			break;
+		case EXOP_OPERATOR:
+			sp--;
+			stack[sp - 1] = CMD_ApplyOperator(op->opCode, stack[sp - 1], stack[sp]);
+			break;
+		}
+	}
+	return stack[0];
+}
+static bool CMD_LockExpressionCache() {
+	if (g_exprCacheMutex == 0) {
+		// not created yet, only boot thread runs commands
+		return true;
+	}
+	return xSemaphoreTake(g_exprCacheMutex, 100) == pdTRUE;
+}
+static void CMD_UnlockExpressionCache() {
+	if (g_exprCacheMutex != 0) {
+		xSemaphoreGive(g_exprCacheMutex);
+	}
+}
+// must be called with cache locked
+static void CMD_EvictCompiledExpression(compiledExpr_t *ce) {
+	if (ce->users > 0) {
+		// still running in other thread (or in getter of outer
+		// expression), last user frees it
+		ce->bEvicted = 1;
+		return;
+	}
+	free(ce->text);
+	free(ce);
+}
+// returned expression is marked as used, so it can't be freed
+// until CMD_ReleaseCompiledExpression
+static compiledExpr_t *CMD_GetCompiledExpression(const char *s) {
+	compiledExpr_t *ce;
+	unsigned int hash;
+	int i;
+
+	hash = CMD_HashExpression(s);
+	if (!CMD_LockExpressionCache()) {
+		return 0;
+	}
+	for (i = 0; i < EXPR_CACHE_SIZE; i++) {
+		ce = g_exprCache[i];
+		if (ce && ce->hash == hash && !strcmp(ce->text, s)) {
+			ce->users++;
+			CMD_UnlockExpressionCache();
+			return ce;
+		}
+	}
+	ce = CMD_CompileExpression(s, hash);
+	if (ce == 0) {
+		CMD_UnlockExpressionCache();
+		return 0;
+	}
+	// simple round robin replacement
+	if (g_exprCache[g_exprCacheNext]) {
+		CMD_EvictCompiledExpression(g_exprCache[g_exprCacheNext]);
+	}
+	g_exprCache[g_exprCacheNext] = ce;
+	g_exprCacheNext = (g_exprCacheNext + 1) % EXPR_CACHE_SIZE;
+	ce->users++;
+	CMD_UnlockExpressionCache();
+	return ce;
+}
+static void CMD_ReleaseCompiledExpression(compiledExpr_t *ce) {
+	// users count must drop even if lock can't be taken quickly,
+	// otherwise entry would never be freed
+	while (!CMD_LockExpressionCache()) {
+		ADDLOG_WARN(LOG_FEATURE_EVENT, "Waiting for expression cache");
+	}
+	ce->users--;
+	if (ce->bEvicted && ce->users == 0) {
+		free(ce->text);
+		free(ce);
+	}
+	CMD_UnlockExpressionCache();
+}
+void CMD_InitExpressionCache() {
+	if (g_exprCacheMutex == 0) {
+		g_exprCacheMutex = xSemaphoreCreateMutex();
+	}
+}
+void CMD_FreeExpressionCache() {
+	int i;
+
+	while (!CMD_LockExpressionCache()) {
+		ADDLOG_WARN(LOG_FEATURE_EVENT, "Waiting for expression cache");
+	}
+	for (i = 0; i < EXPR_CACHE_SIZE; i++) {
+		if (g_exprCache[i]) {
+			CMD_EvictCompiledExpression(g_exprCache[i]);
+			g_exprCache[i] = 0;
+		}
+	}
+	g_exprCacheNext = 0;
+	CMD_UnlockExpressionCache();
+}
+float CMD_EvaluateExpression(const char *s, const char *stop) {
+	compiledExpr_t *ce;
+	float ret;
+
+	if (s == 0)
+		return 0;
+	// only whole strings with constants are worth compiling,
+	// plain numbers are quicker to parse directly
+	if (stop == 0 && strchr(s, '$')) {
+		// cache is not locked while it runs, getters may evaluate
+		// other expressions, entry is kept alive by its users count
+		ce = CMD_GetCompiledExpression(s);
+		if (ce) {
+			ret = CMD_RunCompiledExpression(ce);
+			CMD_ReleaseCompiledExpression(ce);
+			return ret;
+		}
+	}
+	return CMD_EvaluateExpression_Text(s, stop);
+}
+
 // if MQTTOnline then "qq" else "qq"
 commandResult_t CMD_If(const void *context, const char *cmd, const char *args, int cmdFlags) {
 	const char *cmdA;
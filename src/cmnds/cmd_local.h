@@ -5,26 +5,55 @@
 
 #define CMD_FLAG_FREE_NAME		1
 #define CMD_FLAG_FREE_CONTEXT	2
+// command_t itself was malloc'ed (aliases), otherwise it lives in a command block
+#define CMD_FLAG_FREE_STRUCT	4
+// command_t is the start of an alias record in alias arena
+#define CMD_FLAG_ALIAS_RECORD	8
 
 typedef struct command_s {
 	const char *name;
 	commandHandler_t handler;
 	const void *context;
 	struct command_s *next;
-	int commandFlags;
+	unsigned short commandFlags;
+	// full (unmasked) name hash, compared before doing stricmp
+	unsigned short hash;
+#if ENABLE_CMD_STATS
+	cmdStats_t stats;
+#endif
 } command_t;
 
 command_t *CMD_Find(const char *name);
+// bytes taken from alias arena, and bytes of them released by redefinitions
+void CMD_GetAliasArenaStats(int *used, int *freeBytes);
 // for autocompletion?
 void CMD_ListAllCommands(void *userData, void (*callback)(command_t *cmd, void *userData));
 int get_cmd(const char *s, char *dest, int maxlen, int stripnum);
 
 
 float CMD_EvaluateExpression(const char *s, const char *stop);
+void CMD_InitExpressionCache();
+void CMD_FreeExpressionCache();
 commandResult_t CMD_If(const void *context, const char *cmd, const char *args, int cmdFlags);
 void CMD_ExpandConstantsWithinString(const char *in, char *out, int outLen);
 void CMD_Script_ProcessWaitersForEvent(byte eventCode, int argument);
 bool CheckEventCondition(eventWait_t *w, byte eventCode, int argument);
+
+typedef struct timerHeap_s {
+	timerNode_t **nodes;
+	int count;
+	int capacity;
+	unsigned int now;
+	unsigned int order;
+} timerHeap_t;
+
+// adds node or moves it if already scheduled
+bool TimerHeap_Schedule(timerHeap_t *h, timerNode_t *n, int delayMS);
+void TimerHeap_Remove(timerHeap_t *h, timerNode_t *n);
+void TimerHeap_Advance(timerHeap_t *h, int deltaMS);
+// removes and returns earliest node that is due, or NULL
+timerNode_t *TimerHeap_PopDue(timerHeap_t *h);
+int TimerHeap_GetTimeToNext(timerHeap_t *h);
 void CMD_FreeLabels();
 
 
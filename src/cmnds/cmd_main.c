@@ -4,6 +4,8 @@
 #include "../obk_config.h"
 #include <ctype.h>
 #include "cmd_local.h"
+#include "../quicktick.h"
+#include "../driver/drv_freeze.h"
 #include "../driver/drv_ir.h"
 #include "../driver/drv_uart.h"
 #if ENABLE_DRIVER_BL0942
@@ -12,7 +14,10 @@
 #include "../driver/drv_public.h"
 #include "../hal/hal_adc.h"
 #include "../hal/hal_flashVars.h"
+#include "../hal/hal_ota.h"
 #include "../httpserver/http_tcp_server.h"
+#include "../httpserver/new_http.h"
+#include "../httpserver/hass.h"
 #include "../hal/hal_generic.h"
 
 int cmd_uartInitIndex = 0;
@@ -79,8 +84,11 @@ int g_sleepfactor = 1;
 #endif
 
 #define HASH_SIZE 128
+// builtin commands are never removed at runtime, so they are allocated
+// in blocks instead of a malloc per command. Only aliases go to heap.
+#define CMD_BLOCK_SIZE 32
 
-static int generateHashValue(const char* fname) {
+static unsigned short generateHashValue(const char* fname) {
 	int		i;
 	int		hash;
 	int		letter;
@@ -94,10 +102,19 @@ static int generateHashValue(const char* fname) {
 		i++;
 	}
 	hash = (hash ^ (hash >> 10) ^ (hash >> 20));
-	hash &= (HASH_SIZE - 1);
-	return hash;
+	return (unsigned short)hash;
 }
 
+typedef struct commandBlock_s {
+	command_t commands[CMD_BLOCK_SIZE];
+	int used;
+	struct commandBlock_s *next;
+} commandBlock_t;
+
+static commandBlock_t *g_commandBlocks = NULL;
+// incremented when all commands are freed, so prepared commands know to resolve again
+static byte g_commandsGeneration = 0;
+
 command_t* g_commands[HASH_SIZE] = { NULL };
 bool g_powersave;
 
@@ -124,20 +141,20 @@ void LN882H_ApplyPowerSave(int bOn) {
 }
 #endif
 
-static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const char* args, int cmdFlags) {
-	int bOn = 1;
-	Tokenizer_TokenizeString(args, 0);
+// g_powersave is bool and is used so by HALs, this keeps level for switching down from 2
+static int g_powerSaveLevel = 0;
 
-	if (Tokenizer_GetArgsCount() > 0) {
-		bOn = Tokenizer_GetArgInteger(0);
-	}
-#if PLATFORM_LN882H || PLATFORM_LN8825
-	ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_PowerSave: will set to %i%s", bOn, Main_IsConnectedToWiFi() == 0 ? " after WiFi is connected" : "");
-#else
-	ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_PowerSave: will set to %i", bOn);
+#if PLATFORM_ESPIDF
+void CMD_SetCpuFreqRange(int minMHz, int maxMHz) {
+	esp_pm_config_t pm_config = {
+			.max_freq_mhz = maxMHz,
+			.min_freq_mhz = minMHz,
+	};
+	esp_pm_configure(&pm_config);
+}
 #endif
-	
-
+// sets WiFi/CPU power save level, returns level that was set or -1 if it can't be set now
+int CMD_ApplyPowerSave(int bOn) {
 #if defined(PLATFORM_BEKEN)
 	extern int bk_wlan_power_save_set_level(BK_PS_LEVEL level);
 	if (bOn) {
@@ -185,40 +202,13 @@ static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const
 			esp_wifi_set_ps(WIFI_PS_NONE);
 			break;
 	}
-#if PLATFORM_ESPIDF
-	if(Tokenizer_GetArgsCount() > 1)
-	{
-		int tx = Tokenizer_GetArgInteger(1);
-		int8_t maxtx = 0;
-		esp_wifi_get_max_tx_power(&maxtx);
-		if(tx > maxtx / 4)
-		{
-			ADDLOG_ERROR(LOG_FEATURE_CMD, "TX power maximum is: %ddBm, entered: %idBm", maxtx / 4, tx);
-		}
-		else
-		{
-			esp_wifi_set_max_tx_power(tx * 4);
-			ADDLOG_INFO(LOG_FEATURE_CMD, "Setting TX power to: %idBm", tx);
-		}
-	}
-	if(Tokenizer_GetArgsCount() > 3)
-	{
-		int minfreq = Tokenizer_GetArgInteger(2);
-		int maxfreq = Tokenizer_GetArgInteger(3);
-		esp_pm_config_t pm_config = {
-				.max_freq_mhz = maxfreq,
-				.min_freq_mhz = minfreq,
-		};
-		esp_pm_configure(&pm_config);
-		ADDLOG_INFO(LOG_FEATURE_CMD, "PowerSave freq scaling, min: %iMhz, max: %iMhz", minfreq, maxfreq);
-	}
-#endif
 #elif PLATFORM_REALTEK
 	if(!wifi_is_up(RTW_STA_INTERFACE))
 	{
 		ADDLOG_ERROR(LOG_FEATURE_CMD, "Wifi is not on or in AP only mode, failed setting powersave!");
 		g_powersave = (bOn);
-		return CMD_RES_ERROR;
+		g_powerSaveLevel = bOn;
+		return -1;
 	}
 	if(bOn)
 	{
@@ -233,7 +223,7 @@ static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const
 			rtw_enable_wlan_low_pwr_mode(rtw_wlan_low_pw_mode);
 			g_sleepfactor = bOn >= 3 ? 2 : 1;
 		}
-		else if(g_powersave >= 2)
+		else if(g_powerSaveLevel >= 2)
 		{
 			rtw_wlan_low_pw_mode = PW_MODE_NONE;
 			rtw_wlan_low_pw_mode4_c1 = 0;
@@ -248,7 +238,7 @@ static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const
 			g_sleepfactor = 2;
 			SystemSetCpuClk(1);
 		}
-		else if(g_powersave >= 2)
+		else if(g_powerSaveLevel >= 2)
 		{
 			g_sleepfactor = 1;
 			SystemSetCpuClk(0);
@@ -259,7 +249,7 @@ static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const
 	else
 	{
 #if PLATFORM_RTL8710B
-		if(g_powersave >= 2)
+		if(g_powerSaveLevel >= 2)
 		{
 			rtw_wlan_low_pw_mode = PW_MODE_NONE;
 			rtw_wlan_low_pw_mode4_c1 = 0;
@@ -275,7 +265,7 @@ static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const
 		wifi_disable_powersave();
 	}
 #elif PLATFORM_XRADIO
-	if(g_powersave)
+	if(bOn)
 	{
 		wlan_set_ps_mode(g_wlan_netif, 1);
 		wlan_ext_ps_cfg_t ps_cfg;
@@ -284,12 +274,6 @@ static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const
 		ps_cfg.ps_idle_period = 40;
 		ps_cfg.ps_change_period = 10;
 		wlan_ext_request(g_wlan_netif, WLAN_EXT_CMD_SET_PS_CFG, (uint32_t)&ps_cfg);
-		if(Tokenizer_GetArgsCount() > 1)
-		{
-			int dtim = Tokenizer_GetArgInteger(1);
-			wlan_ext_request(g_wlan_netif, WLAN_EXT_CMD_SET_PM_DTIM, dtim);
-			wlan_ext_request(g_wlan_netif, WLAN_EXT_CMD_SET_LISTEN_INTERVAL, 0);
-		}
 	}
 	else
 	{
@@ -323,6 +307,59 @@ static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const
 	ADDLOG_INFO(LOG_FEATURE_CMD, "PowerSave is not implemented on this platform");
 #endif
 	g_powersave = (bOn);
+	g_powerSaveLevel = bOn;
+	return bOn;
+}
+int CMD_GetPowerSaveLevel() {
+	return g_powerSaveLevel;
+}
+static commandResult_t CMD_PowerSave(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	int bOn = 1;
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() > 0) {
+		bOn = Tokenizer_GetArgInteger(0);
+	}
+#if PLATFORM_LN882H || PLATFORM_LN8825
+	ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_PowerSave: will set to %i%s", bOn, Main_IsConnectedToWiFi() == 0 ? " after WiFi is connected" : "");
+#else
+	ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_PowerSave: will set to %i", bOn);
+#endif
+	if (CMD_ApplyPowerSave(bOn) < 0) {
+		return CMD_RES_ERROR;
+	}
+
+#if PLATFORM_ESPIDF
+	if(Tokenizer_GetArgsCount() > 1)
+	{
+		int tx = Tokenizer_GetArgInteger(1);
+		int8_t maxtx = 0;
+		esp_wifi_get_max_tx_power(&maxtx);
+		if(tx > maxtx / 4)
+		{
+			ADDLOG_ERROR(LOG_FEATURE_CMD, "TX power maximum is: %ddBm, entered: %idBm", maxtx / 4, tx);
+		}
+		else
+		{
+			esp_wifi_set_max_tx_power(tx * 4);
+			ADDLOG_INFO(LOG_FEATURE_CMD, "Setting TX power to: %idBm", tx);
+		}
+	}
+	if(Tokenizer_GetArgsCount() > 3)
+	{
+		int minfreq = Tokenizer_GetArgInteger(2);
+		int maxfreq = Tokenizer_GetArgInteger(3);
+		CMD_SetCpuFreqRange(minfreq, maxfreq);
+		ADDLOG_INFO(LOG_FEATURE_CMD, "PowerSave freq scaling, min: %iMhz, max: %iMhz", minfreq, maxfreq);
+	}
+#elif PLATFORM_XRADIO
+	if(bOn && Tokenizer_GetArgsCount() > 1)
+	{
+		int dtim = Tokenizer_GetArgInteger(1);
+		wlan_ext_request(g_wlan_netif, WLAN_EXT_CMD_SET_PM_DTIM, dtim);
+		wlan_ext_request(g_wlan_netif, WLAN_EXT_CMD_SET_LISTEN_INTERVAL, 0);
+	}
+#endif
 	return CMD_RES_OK;
 }
 static commandResult_t CMD_DeepSleep(const void* context, const char* cmd, const char* args, int cmdFlags) {
@@ -338,6 +375,7 @@ static commandResult_t CMD_DeepSleep(const void* context, const char* cmd, const
 	}
 
 	timeMS = Tokenizer_GetArgInteger(0);
+	CHANNEL_FlushSaves();
 #if defined(PLATFORM_BEKEN) && !defined(PLATFORM_BEKEN_NEW)
 	// It requires a define in SDK file:
 	// OpenBK7231T\platforms\bk7231t\bk7231t_os\beken378\func\include\manual_ps_pub.h
@@ -408,7 +446,8 @@ static commandResult_t CMD_ScheduleHADiscovery(const void* context, const char*
 	else {
 		delay = 5;
 	}
-
+	// explicit request republishes all entities, not only changed ones
+	hass_clear_discovery_cache();
 	Main_ScheduleHomeAssistantDiscovery(delay);
 
 	return CMD_RES_OK;
@@ -470,6 +509,17 @@ static commandResult_t CMD_HTTPOTA(const void* context, const char* cmd, const c
 
 	return CMD_RES_OK;
 }
+#if ENABLE_OTA_RELAY
+// otaRelay [0/1]
+static commandResult_t CMD_OTARelay(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		OTA_SetRelayEnabled(Tokenizer_GetArgInteger(0));
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "OTA relay is %s", OTA_IsRelayEnabled() ? "on" : "off");
+	return CMD_RES_OK;
+}
+#endif
 static commandResult_t CMD_Restart(const void* context, const char* cmd, const char* args, int cmdFlags) {
 	int delaySeconds;
 
@@ -711,6 +761,128 @@ void CMD_RunUartCmndIfRequired() {
 #endif
 }
 
+// Commands queued from other threads (TCP console etc), executed from QuickTick.
+// Producers only hold the mutex for a moment to link the item,
+// the whole list is taken at once and executed without the lock.
+typedef struct queuedCommand_s {
+	struct queuedCommand_s *next;
+	int cmdFlags;
+	cmdOutputCallback_t onOutput;
+	cmdQueueCallback_t onDone;
+	void *userData;
+	char command[1];
+} queuedCommand_t;
+
+#define CMD_QUEUE_MAX	16
+
+static SemaphoreHandle_t g_cmdQueueMutex = 0;
+static queuedCommand_t *g_cmdQueueHead = 0;
+static queuedCommand_t *g_cmdQueueTail = 0;
+static int g_cmdQueueCount = 0;
+
+static bool CMD_Queue_Mutex_Take(int del) {
+	int taken;
+
+	taken = xSemaphoreTake(g_cmdQueueMutex, del);
+	if (taken == pdTRUE) {
+		return true;
+	}
+	return false;
+}
+static void CMD_Queue_Mutex_Free() {
+	xSemaphoreGive(g_cmdQueueMutex);
+}
+// before any thread can queue, so producers don't race to create it
+static void CMD_Queue_Init() {
+	if (g_cmdQueueMutex == 0) {
+		g_cmdQueueMutex = xSemaphoreCreateMutex();
+	}
+}
+bool CMD_QueueCommandWithOutput(const char *s, int cmdFlags, cmdOutputCallback_t onOutput, cmdQueueCallback_t onDone, void *userData) {
+	queuedCommand_t *item;
+	int len;
+
+	len = strlen(s);
+	item = (queuedCommand_t*)malloc(sizeof(queuedCommand_t) + len);
+	if (item == 0) {
+		return false;
+	}
+	memcpy(item->command, s, len + 1);
+	item->cmdFlags = cmdFlags;
+	item->onOutput = onOutput;
+	item->onDone = onDone;
+	item->userData = userData;
+	item->next = 0;
+	if (CMD_Queue_Mutex_Take(100) == false) {
+		free(item);
+		return false;
+	}
+	if (g_cmdQueueCount >= CMD_QUEUE_MAX) {
+		CMD_Queue_Mutex_Free();
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "command queue full, dropping [%s]", s);
+		free(item);
+		return false;
+	}
+	if (g_cmdQueueTail) {
+		g_cmdQueueTail->next = item;
+	}
+	else {
+		g_cmdQueueHead = item;
+	}
+	g_cmdQueueTail = item;
+	g_cmdQueueCount++;
+	CMD_Queue_Mutex_Free();
+	QuickTick_Wake();
+	return true;
+}
+bool CMD_QueueCommand(const char *s, int cmdFlags, cmdQueueCallback_t onDone, void *userData) {
+	return CMD_QueueCommandWithOutput(s, cmdFlags, 0, onDone, userData);
+}
+int CMD_GetTimeToNextWakeMS() {
+	if (g_cmdQueueHead) {
+		return 0;
+	}
+#if PLATFORM_BEKEN
+	if (CFG_HasFlag(OBK_FLAG_CMD_ACCEPT_UART_COMMANDS)) {
+		return 0;
+	}
+#endif
+	return -1;
+}
+void CMD_RunQueuedCommands() {
+	queuedCommand_t *item, *next;
+	commandResult_t res;
+
+	// unlocked peek, item added right now will be taken on next tick
+	if (g_cmdQueueHead == 0) {
+		return;
+	}
+	if (CMD_Queue_Mutex_Take(100) == false) {
+		return;
+	}
+	item = g_cmdQueueHead;
+	g_cmdQueueHead = 0;
+	g_cmdQueueTail = 0;
+	g_cmdQueueCount = 0;
+	CMD_Queue_Mutex_Free();
+
+	while (item) {
+		next = item->next;
+		if (item->onOutput) {
+			LOG_SetOutputCapture(item->onOutput, item->userData);
+		}
+		res = CMD_ExecuteCommand(item->command, item->cmdFlags);
+		if (item->onOutput) {
+			LOG_SetOutputCapture(0, 0);
+		}
+		if (item->onDone) {
+			item->onDone(res, item->userData);
+		}
+		free(item);
+		item = next;
+	}
+}
+
 // run an aliased command
 static commandResult_t runcmd(const void* context, const char* cmd, const char* args, int cmdFlags) {
 	char* c = (char*)context;
@@ -726,33 +898,235 @@ static commandResult_t runcmd(const void* context, const char* cmd, const char*
 	return CMD_ExecuteCommand(c, cmdFlags);
 }
 
+static command_t *CMD_RegisterCommandInternal(const char* name, commandHandler_t handler, void* context, bool bHeap);
+static void CMD_LinkCommand(command_t *newCmd, const char* name, commandHandler_t handler, const void* context);
+
+// Aliases live in a single arena allocated with the first alias, so scripts
+// creating many of them don't fragment the heap. Each record keeps some
+// spare room, so redefining an alias with a similar command is done in place.
+// Text space left behind by a longer redefinition goes to a free list and is
+// reused by later redefinitions. Only when arena is full aliases fall back to
+// separate heap allocations.
+#ifndef CMD_ALIAS_ARENA_SIZE
+#define CMD_ALIAS_ARENA_SIZE	2048
+#endif
+#define CMD_ALIAS_TEXT_ROUND	16
+
+typedef struct aliasRecord_s {
+	// must be first, so command_t pointer is also a record pointer
+	command_t cmd;
+	// space available at cmd.context, which initially follows the name
+	unsigned short capacity;
+	char text[1];
+} aliasRecord_t;
+
+// written into released text space, which may be unaligned, so by memcpy
+typedef struct aliasFreeText_s {
+	// offset of next one in arena, -1 at end
+	int next;
+	int size;
+} aliasFreeText_t;
+
+typedef struct aliasArena_s {
+	int used;
+	int aliases;
+	int heapAliases;
+	int replaced;
+	// released text space, first one and bytes in all
+	int freeText;
+	int freeBytes;
+	byte data[CMD_ALIAS_ARENA_SIZE];
+} aliasArena_t;
+
+static aliasArena_t *g_aliasArena = 0;
+
+static void *CMD_AliasArenaAlloc(int size) {
+	void *ret;
+
+	if (g_aliasArena == 0) {
+		g_aliasArena = (aliasArena_t*)malloc(sizeof(aliasArena_t));
+		if (g_aliasArena == 0) {
+			return 0;
+		}
+		memset(g_aliasArena, 0, sizeof(aliasArena_t));
+		g_aliasArena->freeText = -1;
+	}
+	size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+	if (g_aliasArena->used + size > CMD_ALIAS_ARENA_SIZE) {
+		return 0;
+	}
+	ret = g_aliasArena->data + g_aliasArena->used;
+	g_aliasArena->used += size;
+	return ret;
+}
+static int CMD_AliasTextCapacity(int len) {
+	return (len + 1 + CMD_ALIAS_TEXT_ROUND - 1) & ~(CMD_ALIAS_TEXT_ROUND - 1);
+}
+static bool CMD_IsInAliasArena(const void *p) {
+	if (g_aliasArena == 0) {
+		return false;
+	}
+	return (const byte*)p >= g_aliasArena->data && (const byte*)p < g_aliasArena->data + CMD_ALIAS_ARENA_SIZE;
+}
+// text space for len chars, released space first, sets its size to *cap
+static char *CMD_AliasArenaAllocText(int len, int *cap) {
+	aliasFreeText_t node, prevNode;
+	int at, prev;
+
+	prev = -1;
+	for (at = g_aliasArena ? g_aliasArena->freeText : -1; at >= 0; at = node.next) {
+		memcpy(&node, g_aliasArena->data + at, sizeof(node));
+		if (node.size > len) {
+			if (prev < 0) {
+				g_aliasArena->freeText = node.next;
+			}
+			else {
+				memcpy(&prevNode, g_aliasArena->data + prev, sizeof(prevNode));
+				prevNode.next = node.next;
+				memcpy(g_aliasArena->data + prev, &prevNode, sizeof(prevNode));
+			}
+			g_aliasArena->freeBytes -= node.size;
+			*cap = node.size;
+			return (char*)g_aliasArena->data + at;
+		}
+		prev = at;
+	}
+	*cap = CMD_AliasTextCapacity(len);
+	return (char*)CMD_AliasArenaAlloc(*cap);
+}
+static void CMD_AliasArenaFreeText(char *p, int cap) {
+	aliasFreeText_t node;
+
+	if (cap < (int)sizeof(node)) {
+		return;
+	}
+	node.next = g_aliasArena->freeText;
+	node.size = cap;
+	memcpy(p, &node, sizeof(node));
+	g_aliasArena->freeText = (byte*)p - g_aliasArena->data;
+	g_aliasArena->freeBytes += cap;
+}
+static commandResult_t CMD_ReplaceAlias(command_t *existing, const char *ocmd) {
+	aliasRecord_t *rec;
+	char *cmdMem;
+	int len;
+	int cap;
+
+	rec = 0;
+	if (existing->commandFlags & CMD_FLAG_ALIAS_RECORD) {
+		rec = (aliasRecord_t*)existing;
+	}
+	len = strlen(ocmd);
+	if (rec && len < rec->capacity) {
+		// ocmd may point into current text, when alias redefines itself
+		memmove((char*)existing->context, ocmd, len + 1);
+		g_aliasArena->replaced++;
+		return CMD_RES_OK;
+	}
+	// alias on heap has no capacity to track arena space by
+	cmdMem = 0;
+	cap = 0;
+	if (rec) {
+		cmdMem = CMD_AliasArenaAllocText(len, &cap);
+	}
+	if (cmdMem == 0) {
+		cap = 0;
+		cmdMem = (char*)malloc(len + 1);
+		if (cmdMem == 0) {
+			return CMD_RES_ERROR;
+		}
+	}
+	memcpy(cmdMem, ocmd, len + 1);
+	if (existing->commandFlags & CMD_FLAG_FREE_CONTEXT) {
+		free((char*)existing->context);
+	}
+	else if (rec && CMD_IsInAliasArena(existing->context)) {
+		CMD_AliasArenaFreeText((char*)existing->context, rec->capacity);
+	}
+	existing->context = cmdMem;
+	if (CMD_IsInAliasArena(cmdMem)) {
+		existing->commandFlags &= ~CMD_FLAG_FREE_CONTEXT;
+	}
+	else {
+		existing->commandFlags |= CMD_FLAG_FREE_CONTEXT;
+	}
+	if (rec) {
+		rec->capacity = cap;
+	}
+	if (g_aliasArena) {
+		g_aliasArena->replaced++;
+	}
+	return CMD_RES_OK;
+}
 commandResult_t CMD_CreateAliasHelper(const char *alias, const char *ocmd) {
 	char* cmdMem;
 	char* aliasMem;
 	command_t* existing;
+	aliasRecord_t *rec;
+	int nameLen, cap;
 
 	existing = CMD_Find(alias);
 	if (existing != 0) {
-		ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_Alias: the alias you are trying to use is already in use (as an alias or as a command)");
+		if (existing->handler == runcmd) {
+			ADDLOG_INFO(LOG_FEATURE_CMD, "Alias %s has been redefined to run %s", alias, ocmd);
+			return CMD_ReplaceAlias(existing, ocmd);
+		}
+		ADDLOG_INFO(LOG_FEATURE_EVENT, "CMD_Alias: the alias you are trying to use is already in use (as a command)");
 		return CMD_RES_BAD_ARGUMENT;
 	}
 
+	ADDLOG_INFO(LOG_FEATURE_CMD, "New alias has been set: %s runs %s", alias, ocmd);
+
+	nameLen = strlen(alias);
+	cap = CMD_AliasTextCapacity(strlen(ocmd));
+	rec = (aliasRecord_t*)CMD_AliasArenaAlloc(sizeof(aliasRecord_t) + nameLen + 1 + cap);
+	if (rec) {
+		aliasMem = rec->text;
+		cmdMem = rec->text + nameLen + 1;
+		memcpy(aliasMem, alias, nameLen + 1);
+		strcpy(cmdMem, ocmd);
+		rec->capacity = cap;
+		rec->cmd.commandFlags = CMD_FLAG_ALIAS_RECORD;
+		//cmddetail:{"name":"aliasMem","args":"",
+		//cmddetail:"descr":"Internal usage only. See docs for 'alias' command.",
+		//cmddetail:"fn":"runcmd","file":"cmnds/cmd_main.c","requires":"",
+		//cmddetail:"examples":""}
+		CMD_LinkCommand(&rec->cmd, aliasMem, runcmd, cmdMem);
+		g_aliasArena->aliases++;
+		return CMD_RES_OK;
+	}
+
+	// arena is full, fall back to heap
 	cmdMem = strdup(ocmd);
 	aliasMem = strdup(alias);
 
-	ADDLOG_INFO(LOG_FEATURE_CMD, "New alias has been set: %s runs %s", alias, ocmd);
-
-	//cmddetail:{"name":"aliasMem","args":"",
-	//cmddetail:"descr":"Internal usage only. See docs for 'alias' command.",
-	//cmddetail:"fn":"runcmd","file":"cmnds/cmd_main.c","requires":"",
-	//cmddetail:"examples":""}
-	command_t *cmd = CMD_RegisterCommand(aliasMem, runcmd, cmdMem);
+	command_t *cmd = CMD_RegisterCommandInternal(aliasMem, runcmd, cmdMem, true);
 	if (cmd) {
 		cmd->commandFlags |= CMD_FLAG_FREE_NAME;
 		cmd->commandFlags |= CMD_FLAG_FREE_CONTEXT;
+		if (g_aliasArena) {
+			g_aliasArena->heapAliases++;
+		}
+	}
+	else {
+		free(cmdMem);
+		free(aliasMem);
+	}
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_AliasStats(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	if (g_aliasArena == 0) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "Alias arena: not allocated, %i bytes on first alias", CMD_ALIAS_ARENA_SIZE);
+		return CMD_RES_OK;
 	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Alias arena: used %i/%i bytes (%i free for redefinitions), %i aliases, %i on heap, %i redefinitions",
+		g_aliasArena->used, CMD_ALIAS_ARENA_SIZE, g_aliasArena->freeBytes, g_aliasArena->aliases, g_aliasArena->heapAliases, g_aliasArena->replaced);
 	return CMD_RES_OK;
 }
+void CMD_GetAliasArenaStats(int *used, int *freeBytes) {
+	*used = g_aliasArena ? g_aliasArena->used : 0;
+	*freeBytes = g_aliasArena ? g_aliasArena->freeBytes : 0;
+}
 // run an aliased command
 static commandResult_t CMD_CreateAliasForCommand(const void* context, const char* cmd, const char* args, int cmdFlags) {
 	const char* alias;
@@ -784,89 +1158,90 @@ static commandResult_t CMD_CreateAliasForCommand(const void* context, const char
 
 	return CMD_CreateAliasHelper(alias, ocmd);
 }
-/*
-int Flash_FindPattern(byte *data, int dataSize, int startOfs, int endOfs) {
-	int i;
-	float val;
-	const char *stop;
-	byte* buffer;
-	int at;
-	int res;
-	int matching;
-
-	matching = 0;
-
-	buffer = malloc(1024);
-
-	at = startOfs;
-	while (at < endOfs) {
-		int readlen = endOfs - at;
-		if (readlen > 1024) {
-			readlen = 1024;
+// Pattern is matched with KMP, which carries how much of it matched from
+// one chunk to next, so match across chunk boundary and overlapping
+// prefixes ("AAB" in "AAAB") are found without reading anything twice.
+// One flash page is read at a time into static buffer, and other tasks
+// get to run every FLASH_SEARCH_YIELD bytes.
+#define FLASH_SEARCH_CHUNK		256
+#define FLASH_SEARCH_YIELD		0x4000
+
+static byte g_flashSearchBuf[FLASH_SEARCH_CHUNK];
+
+int Flash_FindPattern(const byte *data, int dataSize, int startOfs, int endOfs) {
+	// longest proper prefix of pattern that is also suffix, per length - 1
+	byte fail[FLASH_SEARCH_MAX_PATTERN];
+	int i, k, at, readLen;
+	int matching = 0;
+
+	if (dataSize <= 0 || dataSize > FLASH_SEARCH_MAX_PATTERN) {
+		return -1;
+	}
+	fail[0] = 0;
+	for (i = 1, k = 0; i < dataSize; i++) {
+		while (k > 0 && data[i] != data[k]) {
+			k = fail[k - 1];
 		}
-
-		res = flash_read((byte*)buffer, readlen, at);
-
-
-		// Search for the pattern in the buffer
-		for (i = 0; i < readlen; i++) {
-			if (buffer[i] == data[matching]) {
+		if (data[i] == data[k]) {
+			k++;
+		}
+		fail[i] = k;
+	}
+	for (at = startOfs; at < endOfs; at += readLen) {
+		readLen = endOfs - at;
+		if (readLen > FLASH_SEARCH_CHUNK) {
+			readLen = FLASH_SEARCH_CHUNK;
+		}
+		HAL_FlashRead((char*)g_flashSearchBuf, readLen, at);
+		for (i = 0; i < readLen; i++) {
+			while (matching > 0 && g_flashSearchBuf[i] != data[matching]) {
+				matching = fail[matching - 1];
+			}
+			if (g_flashSearchBuf[i] == data[matching]) {
 				matching++;
 				if (matching == dataSize) {
-					free(buffer);
-					return at + i - dataSize + 1;  // Pattern found, return the offset
-				}
-			}
-			else {
-				matching = 0;  
-				if (buffer[i] == data[matching]) {
-					matching++;
+					return at + i - dataSize + 1;
 				}
 			}
 		}
-		at += readlen;
-
+#if !WINDOWS
+		if (((at - startOfs + readLen) % FLASH_SEARCH_YIELD) == 0) {
+			rtos_delay_milliseconds(1);
+		}
+#endif
 	}
-	free(buffer);
 	return -1;
 }
-*/
 // FindPattern 0x0 0x200000 46DCED0E672F3B70AE1276A3F8712E03
-/*
-commandResult_t CMD_FindPattern(const void *context, const char *cmd, const char *args, int cmdFlags) {
+static commandResult_t CMD_FindPattern(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	byte data[FLASH_SEARCH_MAX_PATTERN];
 	int startOfs, endOfs;
-	int maxData;
 	int realDataSize;
 	const char *hexStr;
-	byte b;
-	byte *data;
 	int result;
 
 	Tokenizer_TokenizeString(args, 0);
-
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 3)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
 	startOfs = Tokenizer_GetArgInteger(0);
 	endOfs = Tokenizer_GetArgInteger(1);
 	hexStr = Tokenizer_GetArg(2);
 
-	maxData = strlen(hexStr);
 	realDataSize = 0;
-
-	data = malloc(maxData);
-
-	while (hexStr[0] && hexStr[1]) {
-		b = hexbyte(hexStr);
-
-		data[realDataSize] = b;
-		realDataSize++;
-
+	while (hexStr[0] && hexStr[1] && realDataSize < FLASH_SEARCH_MAX_PATTERN) {
+		data[realDataSize++] = hexbyte(hexStr);
 		hexStr += 2;
 	}
+	if (realDataSize == 0 || hexStr[0]) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
 	result = Flash_FindPattern(data, realDataSize, startOfs, endOfs);
 
-	ADDLOG_INFO(LOG_FEATURE_CMD, "Pattern is at %i",result);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Pattern is at %i", result);
 
 	return CMD_RES_OK;
-}*/
+}
 
 #define PWM_FREQUENCY_DEFAULT 1000 //Default Frequency
 
@@ -959,6 +1334,9 @@ static commandResult_t CMD_WebServer(const void* context, const char* cmd, const
 	if (arg_count == 0)
 	{
 		ADDLOG_INFO(LOG_FEATURE_CMD, "WebServer:%d", !CFG_GetDisableWebServer());
+#if ENABLE_HTTP_REQUEST_STATS
+		HTTP_LogRequestStats();
+#endif
 		return CMD_RES_OK;
 	} 
 	if (arg_count == 1) {
@@ -972,7 +1350,7 @@ static commandResult_t CMD_WebServer(const void* context, const char* cmd, const
 		else if (strcmp(Tokenizer_GetArg(0), "1") == 0) {
 			ADDLOG_INFO(LOG_FEATURE_CMD, "Enable WebServer and restart");
 			CFG_SetDisableWebServer(false);
-			CFG_Save_IfThereArePendingChanges();
+			CFG_Save_Compact();
 			HAL_RebootModule();
 			return CMD_RES_OK;
 		}
@@ -982,12 +1360,228 @@ static commandResult_t CMD_WebServer(const void* context, const char* cmd, const
 }
 #endif
 
+#if ENABLE_CMD_STATS
+static commandResult_t CMD_CallHandler(command_t *cmd, const char *name, const char *args, int cmdFlags) {
+	commandResult_t res;
+	unsigned int start;
+	unsigned int took;
+
+	start = SYSPERF_GetTimeUs();
+	res = cmd->handler(cmd->context, name, args, cmdFlags);
+	took = SYSPERF_GetTimeUs() - start;
+	// nested commands (backlog, if, alias) are also counted in their caller
+	cmd->stats.calls++;
+	cmd->stats.totalUs += took;
+	if (took > cmd->stats.maxUs) {
+		cmd->stats.maxUs = took;
+	}
+	cmd->stats.sources |= cmdFlags;
+	return res;
+}
+void CMD_ForEachCommandStats(void *userData, void (*callback)(const char *name, const cmdStats_t *st, void *userData)) {
+	int i;
+	command_t *cmd;
+
+	for (i = 0; i < HASH_SIZE; i++) {
+		cmd = g_commands[i];
+		while (cmd) {
+			if (cmd->stats.calls) {
+				callback(cmd->name, &cmd->stats, userData);
+			}
+			cmd = cmd->next;
+		}
+	}
+}
+void CMD_ResetCommandStats() {
+	int i;
+	command_t *cmd;
+
+	for (i = 0; i < HASH_SIZE; i++) {
+		cmd = g_commands[i];
+		while (cmd) {
+			memset(&cmd->stats, 0, sizeof(cmd->stats));
+			cmd = cmd->next;
+		}
+	}
+}
+static void CMD_PrintCommandStats(const char *name, const cmdStats_t *st, void *userData) {
+	ADDLOG_INFO(LOG_FEATURE_CMD, "%s: calls %u, total %u us, max %u us, sources 0x%X",
+		name, st->calls, st->totalUs, st->maxUs, st->sources);
+}
+// cmdStats - print stats of all commands that were called at least once
+// cmdStats reset - clear stats
+static commandResult_t CMD_CmdStats(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() >= 1 && !stricmp(Tokenizer_GetArg(0), "reset")) {
+		CMD_ResetCommandStats();
+		return CMD_RES_OK;
+	}
+	CMD_ForEachCommandStats(0, CMD_PrintCommandStats);
+	return CMD_RES_OK;
+}
+#else
+#define CMD_CallHandler(cmd, name, args, cmdFlags) (cmd)->handler((cmd)->context, name, args, cmdFlags)
+#endif
+// each command gets own tokenizer context, so commands it runs (backlog,
+// if, alias, event handlers) don't overwrite args it has not read yet
+static commandResult_t CMD_RunHandler(command_t *cmd, const char *name, const char *args, int cmdFlags) {
+	commandResult_t res;
+	tokenizer_t *prev;
+
+	prev = Tokenizer_Enter();
+	res = CMD_CallHandler(cmd, name, args, cmdFlags);
+	Tokenizer_Leave(prev);
+	return res;
+}
+
+#if ENABLE_SYSPERF
+static void CMD_PrintPerfStat(const char* name, const perfStat_t* st, void* userData) {
+	ADDLOG_INFO(LOG_FEATURE_CMD, "%s%s: calls %u, avg %u us, max %u us", (const char*)userData, name,
+		st->calls, st->calls ? st->totalUs / st->calls : 0, st->maxUs);
+}
+#if ENABLE_DRIVER_INDEX_CACHE && !defined(OBK_DISABLE_ALL_DRIVERS)
+static void CMD_PrintIndexStat(const char* name, const perfStat_t* st, unsigned int hits, void* userData) {
+	ADDLOG_INFO(LOG_FEATURE_CMD, "index %s: renders %u, kept %u, avg %u us, max %u us", name,
+		st->calls, hits, st->calls ? st->totalUs / st->calls : 0, st->maxUs);
+}
+#endif
+// sysperf - print time of QuickTick parts and stack use of threads
+// sysperf reset - clear times
+static commandResult_t CMD_SysPerf(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	perfThread_t threads[SYSPERF_MAX_THREADS];
+	int i, count;
+
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() >= 1 && !stricmp(Tokenizer_GetArg(0), "reset")) {
+		QuickTick_ResetStats();
+		return CMD_RES_OK;
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "QuickTick every %i ms, overruns %u", QUICK_TMR_DURATION, QuickTick_GetOverruns());
+	for (i = 0; i < QT_STAGE_COUNT; i++) {
+		CMD_PrintPerfStat(QuickTick_GetStageName(i), QuickTick_GetStageStats(i), (void*)"");
+	}
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	DRV_ForEachQuickTickStats((void*)"driver ", CMD_PrintPerfStat);
+#if ENABLE_DRIVER_INDEX_CACHE
+	DRV_ForEachIndexStats(NULL, CMD_PrintIndexStat);
+#endif
+#endif
+	count = SYSPERF_GetThreads(threads, SYSPERF_MAX_THREADS);
+	for (i = 0; i < count; i++) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "thread %s%s: stack %i, min free %i", threads[i].name,
+			threads[i].bAlive ? "" : " (ended)", threads[i].stackBytes, threads[i].minFreeBytes);
+	}
+	return CMD_RES_OK;
+}
+// top [WindowSeconds] - print tasks of last window, busiest first,
+// window length is changed when given
+static commandResult_t CMD_Top(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	perfTask_t tasks[SYSPERF_MAX_TASKS], tmp;
+	int i, j, count;
+
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() >= 1) {
+		i = Tokenizer_GetArgInteger(0);
+		if (i < 1 || i > 3600) {
+			return CMD_RES_BAD_ARGUMENT;
+		}
+		SYSPERF_SetWindow(i);
+	}
+	count = SYSPERF_GetTasks(tasks, SYSPERF_MAX_TASKS);
+	for (i = 1; i < count; i++) {
+		tmp = tasks[i];
+		for (j = i; j > 0 && tasks[j - 1].cpuPermille < tmp.cpuPermille; j--) {
+			tasks[j] = tasks[j - 1];
+		}
+		tasks[j] = tmp;
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "tasks over %i s window:", SYSPERF_GetWindow());
+	for (i = 0; i < SYSPERF_MAX_CORES; i++) {
+		j = SYSPERF_GetCoreLoad(i);
+		if (j >= 0) {
+			ADDLOG_INFO(LOG_FEATURE_CMD, "core %i load %i.%i%%", i, j / 10, j % 10);
+		}
+	}
+	for (i = 0; i < count; i++) {
+		if (tasks[i].cpuPermille < 0) {
+			ADDLOG_INFO(LOG_FEATURE_CMD, "%-16s cpu ?, prio %i, min free stack %i", tasks[i].name,
+				tasks[i].priority, tasks[i].minFreeBytes);
+		}
+		else if (tasks[i].core >= 0) {
+			ADDLOG_INFO(LOG_FEATURE_CMD, "%-16s cpu %i.%i%% on core %i, prio %i, min free stack %i", tasks[i].name,
+				tasks[i].cpuPermille / 10, tasks[i].cpuPermille % 10, tasks[i].core, tasks[i].priority, tasks[i].minFreeBytes);
+		}
+		else {
+			ADDLOG_INFO(LOG_FEATURE_CMD, "%-16s cpu %i.%i%%, prio %i, min free stack %i", tasks[i].name,
+				tasks[i].cpuPermille / 10, tasks[i].cpuPermille % 10, tasks[i].priority, tasks[i].minFreeBytes);
+		}
+	}
+	return CMD_RES_OK;
+}
+#endif
+#if ENABLE_HEAP_TRACKER
+// heapstats [Count] - print totals and Count sites holding most memory
+// heapstats reset - peaks start again from what is allocated now
+static commandResult_t CMD_HeapStats(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	heapSiteStats_t sites[16];
+	heapStats_t st;
+	int i, count, max;
+
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() >= 1 && !stricmp(Tokenizer_GetArg(0), "reset")) {
+		HeapTrack_ResetPeak();
+		return CMD_RES_OK;
+	}
+	max = Tokenizer_GetArgIntegerDefault(0, 10);
+	if (max > 16) {
+		max = 16;
+	}
+	HeapTrack_GetStats(&st);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "heap: live %u bytes in %u blocks, peak %u, allocs %u, frees %u, failed %u, foreign %u, free %i, largest free %i",
+		st.liveBytes, st.liveCount, st.peakBytes, st.allocs, st.frees, st.failed, st.untracked, st.freeHeap, st.largestFree);
+	count = HeapTrack_GetSites(sites, max);
+	for (i = 0; i < count; i++) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "%s:%i: live %u bytes in %u, peak %u, allocs %u", sites[i].file ? sites[i].file : "other",
+			sites[i].line, sites[i].liveBytes, sites[i].liveCount, sites[i].peakBytes, sites[i].allocs);
+	}
+	return CMD_RES_OK;
+}
+#endif
+#if ENABLE_MEMPOOL
+static commandResult_t CMD_PoolStats(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	memPoolStats_t st[MEMPOOL_NUM_CLASSES];
+	unsigned int fallbacks;
+	int i, count;
+
+	count = MemPool_GetStats(st, &fallbacks);
+	for (i = 0; i < count; i++) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "pool %i: %u of %u blocks used in %i slabs, peak %u, allocs %u", st[i].blockSize,
+			st[i].used, st[i].capacity, st[i].slabs, st[i].peakUsed, st[i].allocs);
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "pool: %u allocations went to heap", fallbacks);
+	return CMD_RES_OK;
+}
+#endif
+
 void CMD_Init_Early() {
+	Tokenizer_Init();
+	CMD_Queue_Init();
+	CMD_InitExpressionCache();
+	StringPool_Init();
 	//cmddetail:{"name":"alias","args":"[Alias][Command with spaces]",
-	//cmddetail:"descr":"add an aliased command, so a command with spaces can be called with a short, nospaced alias",
+	//cmddetail:"descr":"add an aliased command, so a command with spaces can be called with a short, nospaced alias. Using an existing alias name replaces its command",
 	//cmddetail:"fn":"CMD_CreateAliasForCommand","file":"cmnds/cmd_main.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("alias", CMD_CreateAliasForCommand, NULL);
+	//cmddetail:{"name":"aliasStats","args":"",
+	//cmddetail:"descr":"Prints how much of the alias arena is used and how many aliases had to be put on heap",
+	//cmddetail:"fn":"CMD_AliasStats","file":"cmnds/cmd_main.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("aliasStats", CMD_AliasStats, NULL);
 	//cmddetail:{"name":"echo","args":"[Message]",
 	//cmddetail:"descr":"Sends given message back to console. This command expands variables, so writing $CH12 will print value of channel 12, etc. Remember that you can also use special channel indices to access persistant flash variables and to access LED variables like dimmer, etc.",
 	//cmddetail:"fn":"CMD_Echo","file":"cmnds/cmd_main.c","requires":"",
@@ -1043,6 +1637,13 @@ void CMD_Init_Early() {
 	//cmddetail:"fn":"CMD_HTTPOTA","file":"cmnds/cmd_main.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("ota_http", CMD_HTTPOTA, NULL);
+#if ENABLE_OTA_RELAY
+	//cmddetail:{"name":"otaRelay","args":"[0/1]",
+	//cmddetail:"descr":"Lets peers download firmware of this device from /api/otarelay/image, so fleet update can spread device to device (see scripts/ota_fanout.py). Not saved, put it in autoexec. /api/otarelay tells if verified image is there.",
+	//cmddetail:"fn":"CMD_OTARelay","file":"cmnds/cmd_main.c","requires":"",
+	//cmddetail:"examples":"otaRelay 1"}
+	CMD_RegisterCommand("otaRelay", CMD_OTARelay, NULL);
+#endif
 #if ENABLE_HA_DISCOVERY
 	//cmddetail:{"name":"scheduleHADiscovery","args":"[Seconds]",
 	//cmddetail:"descr":"This will schedule HA discovery, the discovery will happen with given number of seconds, but timer only counts when MQTT is connected. It will not work without MQTT online, so you must set MQTT credentials first.",
@@ -1118,6 +1719,44 @@ void CMD_Init_Early() {
 	//cmddetail:"fn":"CMD_IndexRefreshInterval","file":"cmnds/cmd_main.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("IndexRefreshInterval", CMD_IndexRefreshInterval, NULL);
+#if ENABLE_CMD_STATS
+	//cmddetail:{"name":"cmdStats","args":"[OptionalReset]",
+	//cmddetail:"descr":"Prints call count, total and max execution time and sources of every command called so far. Use 'cmdStats reset' to clear them. Also available at /api/cmdstats",
+	//cmddetail:"fn":"CMD_CmdStats","file":"cmnds/cmd_main.c","requires":"ENABLE_CMD_STATS",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("cmdStats", CMD_CmdStats, NULL);
+#endif
+#if ENABLE_SYSPERF
+	//cmddetail:{"name":"sysperf","args":"[OptionalReset]",
+	//cmddetail:"descr":"Prints average and max time of QuickTick parts, of every driver quick tick and of driver index page parts (with count of requests served from kept part), count of QuickTick runs longer than its period, and stack size and least free stack of threads. Use 'sysperf reset' to clear times. Also available at /api/sysperf",
+	//cmddetail:"fn":"CMD_SysPerf","file":"cmnds/cmd_main.c","requires":"ENABLE_SYSPERF",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("sysperf", CMD_SysPerf, NULL);
+	//cmddetail:{"name":"top","args":"[WindowSeconds]",
+	//cmddetail:"descr":"Prints tasks busiest first with CPU share, priority and least free stack, taken over window of seconds [default 10, changed when given]. All RTOS tasks and CPU share are there where SDK builds FreeRTOS run time stats, elsewhere registered threads without CPU share. Load of each core is taken from its idle task, on ESP-IDF also core of pinned tasks is shown. Also available at /api/top",
+	//cmddetail:"fn":"CMD_Top","file":"cmnds/cmd_main.c","requires":"ENABLE_SYSPERF",
+	//cmddetail:"examples":"top 30"}
+	CMD_RegisterCommand("top", CMD_Top, NULL);
+#endif
+#if ENABLE_HEAP_TRACKER
+	//cmddetail:{"name":"heapstats","args":"[Count or reset]",
+	//cmddetail:"descr":"Prints heap use seen by allocation tracker: live bytes and blocks, peak, allocation counts and largest free block where platform tells it, then Count [default 10] call sites (file:line) holding most memory. 'heapstats reset' starts peaks again. Also available at /api/heapstats",
+	//cmddetail:"fn":"CMD_HeapStats","file":"cmnds/cmd_main.c","requires":"ENABLE_HEAP_TRACKER",
+	//cmddetail:"examples":"heapstats 5"}
+	CMD_RegisterCommand("heapstats", CMD_HeapStats, NULL);
+#endif
+#if ENABLE_MEMPOOL
+	//cmddetail:{"name":"poolstats","args":"",
+	//cmddetail:"descr":"Prints use of small block pools that event handlers, repeating and clock events, MQTT callbacks and TuyaMCU mappings come from: blocks used of slab capacity per size class, peak, and how many allocations were too big and went to heap",
+	//cmddetail:"fn":"CMD_PoolStats","file":"cmnds/cmd_main.c","requires":"ENABLE_MEMPOOL",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("poolstats", CMD_PoolStats, NULL);
+#endif
+	//cmddetail:{"name":"FindPattern","args":"[StartOfs][EndOfs][HexBytes]",
+	//cmddetail:"descr":"Searches flash between offsets for up to 64 bytes given as hex and logs offset of first match, -1 if none",
+	//cmddetail:"fn":"CMD_FindPattern","file":"cmnds/cmd_main.c","requires":"",
+	//cmddetail:"examples":"FindPattern 0x0 0x200000 46DCED0E672F3B70AE1276A3F8712E03"}
+	CMD_RegisterCommand("FindPattern", CMD_FindPattern, NULL);
 
 #if MQTT_USE_TLS
 	//cmddetail:{"name":"WebServer","args":"[0 - Stop / 1 - Start]",
@@ -1176,6 +1815,7 @@ void CMD_ListAllCommands(void* userData, void (*callback)(command_t* cmd, void*
 void CMD_FreeAllCommands() {
 	int i;
 	command_t* cmd, * next;
+	commandBlock_t* block;
 
 	for (i = 0; i < HASH_SIZE; i++) {
 		cmd = g_commands[i];
@@ -1187,15 +1827,66 @@ void CMD_FreeAllCommands() {
 			if (cmd->commandFlags & CMD_FLAG_FREE_CONTEXT) {
 				free((char*)cmd->context);
 			}
-			free(cmd);
+			if (cmd->commandFlags & CMD_FLAG_FREE_STRUCT) {
+				MemPool_Free(cmd);
+			}
 			cmd = next;
 		}
 		g_commands[i] = 0;
 	}
+	while (g_commandBlocks) {
+		block = g_commandBlocks;
+		g_commandBlocks = block->next;
+		free(block);
+	}
+	if (g_aliasArena) {
+		free(g_aliasArena);
+		g_aliasArena = 0;
+	}
+	g_commandsGeneration++;
+	CMD_FreeExpressionCache();
+}
+static command_t *CMD_AllocCommand(bool bHeap) {
+	commandBlock_t* block;
+	command_t* newCmd;
+
+	if (bHeap) {
+		newCmd = (command_t*)MemPool_Alloc(sizeof(command_t));
+		if (newCmd) {
+			newCmd->commandFlags = CMD_FLAG_FREE_STRUCT;
+		}
+		return newCmd;
+	}
+	block = g_commandBlocks;
+	if (block == 0 || block->used >= CMD_BLOCK_SIZE) {
+		block = (commandBlock_t*)malloc(sizeof(commandBlock_t));
+		if (block == 0) {
+			return 0;
+		}
+		block->used = 0;
+		block->next = g_commandBlocks;
+		g_commandBlocks = block;
+	}
+	newCmd = &block->commands[block->used];
+	block->used++;
+	newCmd->commandFlags = 0;
+	return newCmd;
+}
+static void CMD_LinkCommand(command_t *newCmd, const char* name, commandHandler_t handler, const void* context) {
+	unsigned short hash;
 
+	hash = generateHashValue(name);
+	newCmd->handler = handler;
+	newCmd->name = name;
+	newCmd->hash = hash;
+	newCmd->next = g_commands[hash & (HASH_SIZE - 1)];
+	newCmd->context = context;
+#if ENABLE_CMD_STATS
+	memset(&newCmd->stats, 0, sizeof(newCmd->stats));
+#endif
+	g_commands[hash & (HASH_SIZE - 1)] = newCmd;
 }
-command_t *CMD_RegisterCommand(const char* name, commandHandler_t handler, void* context) {
-	int hash;
+static command_t *CMD_RegisterCommandInternal(const char* name, commandHandler_t handler, void* context, bool bHeap) {
 	command_t* newCmd;
 
 	// check
@@ -1209,26 +1900,27 @@ command_t *CMD_RegisterCommand(const char* name, commandHandler_t handler, void*
 	}
 	ADDLOG_DEBUG(LOG_FEATURE_CMD, "Adding command %s", name);
 
-	hash = generateHashValue(name);
-	newCmd = (command_t*)malloc(sizeof(command_t));
-	newCmd->commandFlags = 0;
-	newCmd->handler = handler;
-	newCmd->name = name;
-	newCmd->next = g_commands[hash];
-	newCmd->context = context;
-	g_commands[hash] = newCmd;
+	newCmd = CMD_AllocCommand(bHeap);
+	if (newCmd == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "failed to alloc command %s", name);
+		return 0;
+	}
+	CMD_LinkCommand(newCmd, name, handler, context);
 	return newCmd;
 }
+command_t *CMD_RegisterCommand(const char* name, commandHandler_t handler, void* context) {
+	return CMD_RegisterCommandInternal(name, handler, context, false);
+}
 
 command_t* CMD_Find(const char* name) {
-	int hash;
+	unsigned short hash;
 	command_t* newCmd;
 
 	hash = generateHashValue(name);
 
-	newCmd = g_commands[hash];
+	newCmd = g_commands[hash & (HASH_SIZE - 1)];
 	while (newCmd != 0) {
-		if (!stricmp(newCmd->name, name)) {
+		if (newCmd->hash == hash && !stricmp(newCmd->name, name)) {
 			return newCmd;
 		}
 		newCmd = newCmd->next;
@@ -1259,48 +1951,107 @@ int get_cmd(const char* s, char* dest, int maxlen, int stripnum) {
 }
 
 
-// execute a command from cmd and args - used below and in MQTT
-commandResult_t CMD_ExecuteCommandArgs(const char* cmd, const char* args, int cmdFlags) {
+// look for complete commmand, and if not found, for command name without trailing numbers
+static command_t *CMD_FindWithNumbersFallback(const char* cmd) {
 	command_t* newCmd;
-	//int len;
 
-	// look for complete commmand
 	newCmd = CMD_Find(cmd);
 	if (!newCmd) {
 		// not found, so...
 		char nonums[32];
 		// get the complete string up to numbers.
-		//len =
 		get_cmd(cmd, nonums, 32, 1);
 		newCmd = CMD_Find(nonums);
-		if (!newCmd) {
+	}
+	return newCmd;
+}
+// execute a command from cmd and args - used below and in MQTT
+commandResult_t CMD_ExecuteCommandArgs(const char* cmd, const char* args, int cmdFlags) {
+	command_t* newCmd;
+
+	newCmd = CMD_FindWithNumbersFallback(cmd);
+	if (!newCmd) {
 #if ENABLE_OBK_BERRY
-			static int g_guard = 0;
-			if (g_guard == 0) {
-				g_guard = 1;
-				int c_run = CMD_Berry_RunEventHandlers_Str(CMD_EVENT_ON_CMD, cmd, args);
-				g_guard = 0;
-				if (c_run > 0) {
-					return CMD_RES_OK;
-				}
+		static int g_guard = 0;
+		if (g_guard == 0) {
+			g_guard = 1;
+			int c_run = CMD_Berry_RunEventHandlers_Str(CMD_EVENT_ON_CMD, cmd, args);
+			g_guard = 0;
+			if (c_run > 0) {
+				return CMD_RES_OK;
 			}
-#endif
-			// if still not found, then error
-			ADDLOG_ERROR(LOG_FEATURE_CMD, "cmd %s NOT found (args %s)", cmd, args);
-			return CMD_RES_UNKNOWN_COMMAND;
 		}
-	}
-	else {
+#endif
+		// if still not found, then error
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "cmd %s NOT found (args %s)", cmd, args);
+		return CMD_RES_UNKNOWN_COMMAND;
 	}
 
 	if (newCmd->handler) {
 		commandResult_t res;
-		res = newCmd->handler(newCmd->context, cmd, args, cmdFlags);
+		// command may change anything driver shows on index
+		DRV_MarkIndexDirty(NULL);
+		res = CMD_RunHandler(newCmd, cmd, args, cmdFlags);
 		return res;
 	}
 	return CMD_RES_UNKNOWN_COMMAND;
 }
 
+void CMD_PrepareCommand(preparedCommand_t *pc, const char *s) {
+	const char *start;
+	const char *p;
+	char name[64];
+	int len;
+
+	pc->cmd = 0;
+	pc->generation = g_commandsGeneration;
+	if (s == 0) {
+		return;
+	}
+	start = s;
+	while (isWhiteSpace(*s)) {
+		s++;
+	}
+	len = get_cmd(s, name, sizeof(name), 0);
+	// empty, or too long to be cached - will go through CMD_ExecuteCommand
+	if (len == 0 || len >= (int)sizeof(name) - 1 || s - start > 255) {
+		return;
+	}
+	p = s + len;
+	while (*p && isWhiteSpace(*p)) {
+		p++;
+	}
+	if (p - start > 0xffff) {
+		return;
+	}
+	pc->nameOfs = s - start;
+	pc->nameLen = len;
+	pc->argsOfs = p - start;
+	// may be NULL if command is not registered yet, for example alias created later
+	pc->cmd = CMD_FindWithNumbersFallback(name);
+}
+commandResult_t CMD_ExecutePreparedCommand(preparedCommand_t *pc, const char *s, int cmdFlags) {
+	char name[64];
+
+	if (pc->cmd == 0 || pc->generation != g_commandsGeneration) {
+		CMD_PrepareCommand(pc, s);
+		if (pc->cmd == 0) {
+			// let the generic path handle the error or Berry fallback
+			return CMD_ExecuteCommand(s, cmdFlags);
+		}
+	}
+	if (pc->cmd->handler == 0) {
+		return CMD_RES_UNKNOWN_COMMAND;
+	}
+	memcpy(name, s + pc->nameOfs, pc->nameLen);
+	name[pc->nameLen] = 0;
+	if ((cmdFlags & COMMAND_FLAG_SOURCE_TCP) == 0) {
+		ADDLOG_DEBUG(LOG_FEATURE_CMD, "cmd [%s]", s + pc->nameOfs);
+	}
+	DRV_MarkIndexDirty(NULL);
+	return CMD_RunHandler(pc->cmd, name, s + pc->argsOfs, cmdFlags);
+}
+
 
 // execute a raw command - single string
 commandResult_t CMD_ExecuteCommand(const char* s, int cmdFlags) {
@@ -1324,6 +2075,7 @@ commandResult_t CMD_ExecuteCommand(const char* s, int cmdFlags) {
 	if ((cmdFlags & COMMAND_FLAG_SOURCE_TCP) == 0) {
 		ADDLOG_DEBUG(LOG_FEATURE_CMD, "cmd [%s]", s);
 	}
+	WDT_NoteCommand(s);
 	//org = s;
 
 	// get the complete string up to whitespace.
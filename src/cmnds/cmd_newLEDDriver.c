@@ -16,6 +16,7 @@
 #include <ctype.h>
 #include "cmd_local.h"
 #include "../mqtt/new_mqtt.h"
+#include "../quicktick.h"
 #include "../cJSON/cJSON.h"
 #include <string.h>
 #include <math.h>
@@ -109,6 +110,9 @@ void LED_ResetGlobalVariablesToDefaults() {
 	led_temperature_min = HASS_TEMPERATURE_MIN;
 	led_temperature_max = HASS_TEMPERATURE_MAX;
 	led_temperature_current = HASS_TEMPERATURE_MIN;
+#if ENABLE_LED_FIXED_POINT
+	LED_SetLerpTargets();
+#endif
 }
 
 // The color order is RGBCW.
@@ -143,12 +147,12 @@ bool LED_IsLedDriverChipRunning()
 	}
 #endif
 #ifndef OBK_DISABLE_ALL_DRIVERS
-	return DRV_IsRunning("SM2135") || DRV_IsRunning("BP5758D") 
-		|| DRV_IsRunning("TESTLED") || DRV_IsRunning("SM2235") || DRV_IsRunning("BP1658CJ")
-		|| DRV_IsRunning("KP18058")
-		|| DRV_IsRunning("SM16703P")
-		|| DRV_IsRunning("SM15155E")
-		|| DRV_IsRunning("DMX")
+	return DRV_IsRunning(DRV_ID_SM2135) || DRV_IsRunning(DRV_ID_BP5758D) 
+		|| DRV_IsRunning(DRV_ID_TESTLED) || DRV_IsRunning(DRV_ID_SM2235) || DRV_IsRunning(DRV_ID_BP1658CJ)
+		|| DRV_IsRunning(DRV_ID_KP18058)
+		|| DRV_IsRunning(DRV_ID_SM16703P)
+		|| DRV_IsRunning(DRV_ID_SM15155E)
+		|| DRV_IsRunning(DRV_ID_DMX)
 		; 
 #else
 	return false;
@@ -216,6 +220,8 @@ int shouldSendRGB() {
 
 
 float led_rawLerpCurrent[5] = { 0 };
+// false once lerp has reached its targets, apply_smart_light starts it again
+static bool led_lerpRunning = true;
 float Mathf_MoveTowards(float cur, float tg, float dt) {
 	float rem = tg - cur;
 	if(abs(rem) < dt) {
@@ -235,6 +241,67 @@ float led_lerpSpeedUnitsPerSecond = 200.f;
 float led_current_value_brightness = 0;
 float led_current_value_cold_or_warm = 0;
 
+#if ENABLE_LED_FIXED_POINT
+// Lerp state and targets in 1/65536 of colour unit, RGBCW and then
+// brightness and temperature. Floats above are only outputs of it.
+#define LED_LERP_BRIGHTNESS		5
+#define LED_LERP_TEMPERATURE	6
+static int led_lerpQ16[7];
+static int led_lerpTargetQ16[7];
+// RGB correction slows channel down with it
+static int led_lerpScaleQ16[7];
+// led_lerpSpeedUnitsPerSecond in 1/65536 per ms
+static int led_lerpSpeedQ16PerMS = 200.f * 65.536f;
+
+static int LED_MoveTowardsQ16(int cur, int tg, int step) {
+	if (cur < tg) {
+		return (tg - cur <= step) ? tg : cur + step;
+	}
+	return (cur - tg <= step) ? tg : cur - step;
+}
+// called when new targets are set, lerp itself does no float math
+void LED_SetLerpTargets() {
+	int i;
+
+	for (i = 0; i < 5; i++) {
+		led_lerpTargetQ16[i] = finalColors[i] * 65536.0f + 0.5f;
+		led_lerpScaleQ16[i] = (i < 3) ? (int)(rgb_used_corr[i] * 65536.0f) : 65536;
+	}
+	led_lerpTargetQ16[LED_LERP_TEMPERATURE] = (int)(LED_GetTemperature0to1Range() * 100.0f) << 16;
+	led_lerpTargetQ16[LED_LERP_BRIGHTNESS] = 0;
+	if (g_lightEnableAll && g_lightMode == Light_Temperature) {
+		led_lerpTargetQ16[LED_LERP_BRIGHTNESS] = (int)(g_brightness0to100 * g_brightnessScale) << 16;
+	}
+	led_lerpScaleQ16[LED_LERP_BRIGHTNESS] = 65536;
+	led_lerpScaleQ16[LED_LERP_TEMPERATURE] = 65536;
+}
+// false if nothing has moved
+static bool LED_RunLerpQ16(int deltaMS) {
+	int i, prev, step;
+	long long maxStep;
+	bool bMoved = false;
+
+	maxStep = (long long)deltaMS * led_lerpSpeedQ16PerMS;
+	for (i = 0; i < 7; i++) {
+		step = 256 << 16;
+		if (((maxStep * led_lerpScaleQ16[i]) >> 16) < step) {
+			step = (maxStep * led_lerpScaleQ16[i]) >> 16;
+		}
+		prev = led_lerpQ16[i];
+		led_lerpQ16[i] = LED_MoveTowardsQ16(prev, led_lerpTargetQ16[i], step);
+		if (prev != led_lerpQ16[i]) {
+			bMoved = true;
+		}
+	}
+	for (i = 0; i < 5; i++) {
+		led_rawLerpCurrent[i] = led_lerpQ16[i] * (1.0f / 65536.0f);
+	}
+	led_current_value_brightness = led_lerpQ16[LED_LERP_BRIGHTNESS] * (1.0f / 65536.0f);
+	led_current_value_cold_or_warm = led_lerpQ16[LED_LERP_TEMPERATURE] * (1.0f / 65536.0f);
+	return bMoved;
+}
+#endif
+
 
 void LED_CalculateEmulatedCool(float inCool, float *outRGB) {
 	outRGB[0] = inCool;
@@ -252,7 +319,7 @@ void LED_ApplyEmulatedCool(int firstChannelIndex, float chVal) {
 
 void LED_I2CDriver_WriteRGBCW(float* finalRGBCW) {
 #ifdef ENABLE_DRIVER_GOSUNDSW2
-	if (DRV_IsRunning("GosundSW2")) {
+	if (DRV_IsRunning(DRV_ID_GosundSW2)) {
 		DRV_GosundSW2_Write(finalRGBCW)
 	}
 #endif
@@ -267,24 +334,24 @@ void LED_I2CDriver_WriteRGBCW(float* finalRGBCW) {
 			// keep W unchanged
 		}
 	}
-	if (DRV_IsRunning("SM2135")) {
+	if (DRV_IsRunning(DRV_ID_SM2135)) {
 		SM2135_Write(finalRGBCW);
 	}
-	if (DRV_IsRunning("BP5758D")) {
+	if (DRV_IsRunning(DRV_ID_BP5758D)) {
 		BP5758D_Write(finalRGBCW);
 	}
-	if (DRV_IsRunning("BP1658CJ")) {
+	if (DRV_IsRunning(DRV_ID_BP1658CJ)) {
 		BP1658CJ_Write(finalRGBCW);
 	}
-	if (DRV_IsRunning("SM2235")) {
+	if (DRV_IsRunning(DRV_ID_SM2235)) {
 		SM2235_Write(finalRGBCW);
 	}
-	if (DRV_IsRunning("KP18058")) {
+	if (DRV_IsRunning(DRV_ID_KP18058)) {
 		KP18058_Write(finalRGBCW);
 	}
 #endif
 #ifdef ENABLE_DRIVER_SM15155E
-	if (DRV_IsRunning("SM15155E")) {
+	if (DRV_IsRunning(DRV_ID_SM15155E)) {
 		SM15155E_Write(finalRGBCW);
 	}
 #endif
@@ -311,15 +378,44 @@ void LED_RunOnEverySecond() {
 		led_timeUntilNextSavePossible++;
 	}
 }
+// RGBCW components that PWM hardware fades to target, bit per component,
+// lerp then only moves channel values of them
+static byte led_hwFadeMask = 0;
+// new targets from apply_smart_light, fades are started on next lerp step
+static bool led_hwFadeStart = false;
+
+static void LED_SetLerpOutput(int ch, int component, float chVal) {
+	int flags = CHANNEL_SET_FLAG_SKIP_MQTT | CHANNEL_SET_FLAG_SILENT;
+	float rate, dist;
+	int ms;
+
+	if (led_hwFadeStart) {
+		// same time that lerp needs for rest of the way
+		rate = led_lerpSpeedUnitsPerSecond * ((component < 3) ? rgb_used_corr[component] : 1.0f);
+		dist = fabsf(finalColors[component] - led_rawLerpCurrent[component]);
+		ms = (rate > 0) ? (int)(dist * 1000.0f / rate) : 0;
+		if (ms > 0 && CHANNEL_FadePWM(ch, finalColors[component] * g_cfg_colorScaleToChannel, ms)) {
+			led_hwFadeMask |= 1 << component;
+		}
+	}
+	if (led_hwFadeMask & (1 << component)) {
+		flags |= CHANNEL_SET_FLAG_SKIP_PWM;
+	}
+	CHANNEL_Set_FloatPWM(ch, chVal, flags);
+}
 void LED_RunQuickColorLerp(int deltaMS) {
 	int i;
 	int firstChannelIndex;
-	float deltaSeconds;
 	byte finalRGBCW[5];
 	int maxPossibleIndexToSet;
 	int emulatedCool = -1;
+#if !ENABLE_LED_FIXED_POINT
+	float deltaSeconds;
 	int target_value_brightness = 0;
 	int target_value_cold_or_warm = 0;
+	float prev;
+	bool bMoved = false;
+#endif
 
 	if (CFG_HasFlag(OBK_FLAG_LED_FORCE_MODE_RGB)) {
 		// only allow setting pwm 0, 1 and 2, force-skip 3 and 4
@@ -329,8 +425,10 @@ void LED_RunQuickColorLerp(int deltaMS) {
 		maxPossibleIndexToSet = 5;
 	}
 
-
-	deltaSeconds = deltaMS * 0.001f;
+	// QuickTick may have slept while lerp was idle, don't jump
+	if (led_lerpRunning == false && deltaMS > QUICK_TMR_DURATION) {
+		deltaMS = QUICK_TMR_DURATION;
+	}
 
 	firstChannelIndex = LED_GetFirstChannelIndex();
 
@@ -338,11 +436,20 @@ void LED_RunQuickColorLerp(int deltaMS) {
 		emulatedCool = firstChannelIndex + 3;
 	}
 
+#if ENABLE_LED_FIXED_POINT
+	// outputs are still written once after targets are reached
+	led_lerpRunning = LED_RunLerpQ16(deltaMS);
+#else
+	deltaSeconds = deltaMS * 0.001f;
 	for(i = 0; i < 5; i++) {
 		float ch_rgb_cal = (i < 3)? rgb_used_corr[i] : 1.0f; // adjust change rate with RGB correction in use
 		// This is the most silly and primitive approach, but it works
 		// In future we might implement better lerp algorithms, use HUE, etc
+		prev = led_rawLerpCurrent[i];
 		led_rawLerpCurrent[i] = Mathf_MoveTowards(led_rawLerpCurrent[i],finalColors[i], deltaSeconds * led_lerpSpeedUnitsPerSecond * ch_rgb_cal);
+		if (prev != led_rawLerpCurrent[i]) {
+			bMoved = true;
+		}
 	}
 
 	target_value_cold_or_warm = LED_GetTemperature0to1Range() * 100.0f;
@@ -352,9 +459,25 @@ void LED_RunQuickColorLerp(int deltaMS) {
 		}
 	}
 
+	prev = led_current_value_brightness;
 	led_current_value_brightness = Mathf_MoveTowards(led_current_value_brightness, target_value_brightness, deltaSeconds * led_lerpSpeedUnitsPerSecond);
+	if (prev != led_current_value_brightness) {
+		bMoved = true;
+	}
+	prev = led_current_value_cold_or_warm;
 	led_current_value_cold_or_warm = Mathf_MoveTowards(led_current_value_cold_or_warm, target_value_cold_or_warm, deltaSeconds * led_lerpSpeedUnitsPerSecond );
+	if (prev != led_current_value_cold_or_warm) {
+		bMoved = true;
+	}
+	// outputs are still written once after targets are reached
+	led_lerpRunning = bMoved;
+#endif
+	if (led_hwFadeStart) {
+		led_hwFadeMask = 0;
+	}
 
+	// all PWMs of light take new duty on same period
+	PIN_BeginPWMGroup();
 	// OBK_FLAG_LED_ALTERNATE_CW_MODE means we have a driver that takes one PWM for brightness and second for temperature
 	if(isCWMode() && CFG_HasFlag(OBK_FLAG_LED_ALTERNATE_CW_MODE)) {
 		CHANNEL_Set_FloatPWM(firstChannelIndex, led_current_value_cold_or_warm, CHANNEL_SET_FLAG_SKIP_MQTT | CHANNEL_SET_FLAG_SILENT);
@@ -364,8 +487,8 @@ void LED_RunQuickColorLerp(int deltaMS) {
 			// In CW mode, user sets just two PWMs. So we have: PWM0 and PWM1 (or maybe PWM1 and PWM2)
 			// But we still have RGBCW internally
 			// So, we need to map. Map component 3 of RGBCW to first channel, and component 4 to second.
-			CHANNEL_Set_FloatPWM(firstChannelIndex + 0, led_rawLerpCurrent[3] * g_cfg_colorScaleToChannel, CHANNEL_SET_FLAG_SKIP_MQTT | CHANNEL_SET_FLAG_SILENT);
-			CHANNEL_Set_FloatPWM(firstChannelIndex + 1, led_rawLerpCurrent[4] * g_cfg_colorScaleToChannel, CHANNEL_SET_FLAG_SKIP_MQTT | CHANNEL_SET_FLAG_SILENT);
+			LED_SetLerpOutput(firstChannelIndex + 0, 3, led_rawLerpCurrent[3] * g_cfg_colorScaleToChannel);
+			LED_SetLerpOutput(firstChannelIndex + 1, 4, led_rawLerpCurrent[4] * g_cfg_colorScaleToChannel);
 		} else {
 			// This should work for both RGB and RGBCW
 			// This also could work for a SINGLE COLOR strips
@@ -378,23 +501,36 @@ void LED_RunQuickColorLerp(int deltaMS) {
 				if (channelToUse == emulatedCool && g_lightMode == Light_Temperature) {
 					LED_ApplyEmulatedCool(firstChannelIndex, chVal);
 				}
-				else {
-					if (CFG_HasFlag(OBK_FLAG_LED_ALTERNATE_CW_MODE)) {
-						if (i == 3) {
-							chVal = led_current_value_cold_or_warm;
-						}
-						else if (i == 4) {
-							chVal = led_current_value_brightness;
-						}
+				else if (CFG_HasFlag(OBK_FLAG_LED_ALTERNATE_CW_MODE) && i >= 3) {
+					if (i == 3) {
+						chVal = led_current_value_cold_or_warm;
+					}
+					else if (i == 4) {
+						chVal = led_current_value_brightness;
 					}
 					CHANNEL_Set_FloatPWM(channelToUse, chVal, CHANNEL_SET_FLAG_SKIP_MQTT | CHANNEL_SET_FLAG_SILENT);
 				}
+				else {
+					LED_SetLerpOutput(channelToUse, i, chVal);
+				}
 			}
 		}
 	}
+	PIN_CommitPWMGroup();
+	led_hwFadeStart = false;
+	if (led_lerpRunning == false) {
+		led_hwFadeMask = 0;
+	}
 	
 	LED_I2CDriver_WriteRGBCW(led_rawLerpCurrent);
 }
+// 0 while smooth transition is in progress, else -1
+int LED_GetTimeToNextWakeMS() {
+	if (led_lerpRunning && CFG_HasFlag(OBK_FLAG_LED_SMOOTH_TRANSITIONS)) {
+		return 0;
+	}
+	return -1;
+}
 
 void LED_ResendCurrentColors() {
 	if (CFG_HasFlag(OBK_FLAG_LED_SMOOTH_TRANSITIONS)) {
@@ -408,6 +544,51 @@ void LED_ResendCurrentColors() {
 
 int led_gamma_enable_channel_messages = 0;
 
+#if ENABLE_LED_FIXED_POINT
+// 255 * (i / 255) ^ gamma in 1/256 of colour unit, rebuilt when led_corr
+// is not the one it was made from (led_gammaCtrl, config load)
+static unsigned short led_gammaTable[256];
+static int led_gammaCalQ16[3];
+static led_corr_t led_gammaTableCorr;
+static bool led_gammaTableValid = false;
+
+static void LED_BuildGammaTable() {
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		led_gammaTable[i] = powf(i / 255.0f, g_cfg.led_corr.led_gamma) * (255.0f * 256.0f) + 0.5f;
+	}
+	for (i = 0; i < 3; i++) {
+		led_gammaCalQ16[i] = g_cfg.led_corr.rgb_cal[i] * 65536.0f + 0.5f;
+	}
+	led_gammaTableCorr = g_cfg.led_corr;
+	led_gammaTableValid = true;
+}
+// in and out in 1/65536 of colour unit, out has RGB correction
+static int LED_GammaQ16(int color, int x) {
+	int idx, lo, out;
+
+	if (led_gammaTableValid == false || memcmp(&led_gammaTableCorr, &g_cfg.led_corr, sizeof(led_corr_t))) {
+		LED_BuildGammaTable();
+	}
+	idx = x >> 16;
+	if (idx < 0) {
+		return 0;
+	}
+	if (idx >= 255) {
+		out = led_gammaTable[255] << 8;
+	}
+	else {
+		lo = led_gammaTable[idx];
+		out = (lo << 8) + (led_gammaTable[idx + 1] - lo) * ((x >> 8) & 0xFF);
+	}
+	if (color < 3) {
+		out = ((long long)out * led_gammaCalQ16[color]) >> 16;
+	}
+	return out;
+}
+#endif
+
 float led_gamma_correction (int color, float iVal) { // apply LED gamma and RGB correction
 	if ((color < 0) || (color > 4)) {
 		return iVal;
@@ -426,6 +607,12 @@ float led_gamma_correction (int color, float iVal) { // apply LED gamma and RGB
 	// }
 	// float oVal = (powf (brightnessNormalized0to1, g_cfg.led_corr.led_gamma) * (1 - ch_bright_min) + ch_bright_min) * iVal;
 
+#if ENABLE_LED_FIXED_POINT
+	if (color < 3) {
+		rgb_used_corr[color] = g_cfg.led_corr.rgb_cal[color];
+	}
+	float oVal = LED_GammaQ16(color, (int)(iVal * brightnessNormalized0to1 * 65536.0f)) * (1.0f / 65536.0f);
+#else
 	// color value adjusted to float 0-1, modified by brightness
 	float brightnessCorrectedColor = iVal / 255.0f * brightnessNormalized0to1;
 
@@ -437,6 +624,7 @@ float led_gamma_correction (int color, float iVal) { // apply LED gamma and RGB
 		rgb_used_corr[color] = g_cfg.led_corr.rgb_cal[color];
 		oVal *= rgb_used_corr[color];
 	}
+#endif
 
 	if (led_gamma_enable_channel_messages &&
 			(((g_lightMode == Light_RGB) && (color < 3)) || ((g_lightMode != Light_RGB) && (color >= 3)))) {
@@ -541,6 +729,10 @@ void apply_smart_light() {
 	int value_brightness = 0;
 	int value_cold_or_warm = 0;
 
+	// new targets, smooth transition goes on from current values
+	led_lerpRunning = true;
+	led_hwFadeStart = true;
+	QuickTick_Wake();
 
 	firstChannelIndex = LED_GetFirstChannelIndex();
 
@@ -565,6 +757,7 @@ void apply_smart_light() {
 		}
 	}
 
+	PIN_BeginPWMGroup();
 	if(isCWMode() && CFG_HasFlag(OBK_FLAG_LED_ALTERNATE_CW_MODE)) {
 		for(i = 0; i < 5; i++) {
 			finalColors[i] = 0;
@@ -659,9 +852,13 @@ void apply_smart_light() {
 			}
 		}
 	}
+	PIN_CommitPWMGroup();
 	if(CFG_HasFlag(OBK_FLAG_LED_SMOOTH_TRANSITIONS) == false) {
 		LED_I2CDriver_WriteRGBCW(finalColors);
 	}
+#if ENABLE_LED_FIXED_POINT
+	LED_SetLerpTargets();
+#endif
 
 	if(CFG_HasFlag(OBK_FLAG_LED_REMEMBERLASTSTATE)) {
 		// something was changed, mark as dirty
@@ -1227,6 +1424,24 @@ static commandResult_t dimmer(const void *context, const char *cmd, const char *
 
 		return CMD_RES_OK;
 }
+static byte LED_BaseColorToByte(float f) {
+	if (f <= 0)
+		return 0;
+	if (f >= 255)
+		return 255;
+	return f + 0.5f;
+}
+// keep hsv in sync with RGB part of base colors, in fixed point as this
+// runs for each color set by scripts and animations
+static void LED_SyncHSVFromBaseColors() {
+	uint16_t h, s, v;
+
+	RGB_to_HSV_u16(LED_BaseColorToByte(led_baseColors[0]), LED_BaseColorToByte(led_baseColors[1]),
+		LED_BaseColorToByte(led_baseColors[2]), &h, &s, &v);
+	g_hsv_h = h * (1.0f / HSV_HUE_PER_DEGREE);
+	g_hsv_s = s * (1.0f / 65535);
+	g_hsv_v = v * (1.0f / 65535);
+}
 void LED_SetFinalRGBCW(byte *rgbcw) {
 	if(rgbcw[0] == 0 && rgbcw[1] == 0 && rgbcw[2] == 0 && rgbcw[3] == 0 && rgbcw[4] == 0) {
 
@@ -1296,7 +1511,7 @@ void LED_SetFinalRGBW(byte r, byte g, byte b, byte w) {
 	led_baseColors[3] = (255.0f) * w_half;
 	led_baseColors[4] = (255.0f) * w_half;
 
-	RGBtoHSV(led_baseColors[0] / 255.0f, led_baseColors[1] / 255.0f, led_baseColors[2] / 255.0f, &g_hsv_h, &g_hsv_s, &g_hsv_v);
+	LED_SyncHSVFromBaseColors();
 
 	if (CFG_HasFlag(OBK_FLAG_LED_AUTOENABLE_ON_ANY_ACTION)) {
 		LED_SetEnableAll(true);
@@ -1311,7 +1526,7 @@ void LED_SetFinalRGB(byte r, byte g, byte b) {
 	led_baseColors[1] = g;
 	led_baseColors[2] = b;
 
-	RGBtoHSV(led_baseColors[0]/255.0f, led_baseColors[1]/255.0f, led_baseColors[2]/255.0f, &g_hsv_h, &g_hsv_s, &g_hsv_v);
+	LED_SyncHSVFromBaseColors();
 
 	if (CFG_HasFlag(OBK_FLAG_LED_AUTOENABLE_ON_ANY_ACTION)) {
 		LED_SetEnableAll(true);
@@ -1332,14 +1547,30 @@ void LED_SetFinalRGB(byte r, byte g, byte b) {
 	}
 #endif
 }
+static uint16_t LED_FloatToU16(float f) {
+	if (f <= 0)
+		return 0;
+	if (f >= 1)
+		return 65535;
+	return f * 65535.0f + 0.5f;
+}
 static void onHSVChanged() {
-	float r, g, b;
-
-	HSVtoRGB(&r, &g, &b, g_hsv_h, g_hsv_s, g_hsv_v);
+	uint16_t h, s, v;
+	uint8_t r, g, b;
+	int hue;
+
+	hue = g_hsv_h * HSV_HUE_PER_DEGREE + 0.5f;
+	hue %= HSV_HUE_MAX;
+	if (hue < 0)
+		hue += HSV_HUE_MAX;
+	h = hue;
+	s = LED_FloatToU16(g_hsv_s);
+	v = LED_FloatToU16(g_hsv_v);
+	HSV_to_RGB_u8(h, s, v, &r, &g, &b);
 
-	led_baseColors[0] = r * 255.0f;
-	led_baseColors[1] = g * 255.0f;
-	led_baseColors[2] = b * 255.0f;
+	led_baseColors[0] = r;
+	led_baseColors[1] = g;
+	led_baseColors[2] = b;
 
 	if (CFG_HasFlag(OBK_FLAG_LED_AUTOENABLE_ON_ANY_ACTION)) {
 		LED_SetEnableAll(true);
@@ -1470,7 +1701,7 @@ commandResult_t LED_SetBaseColor(const void *context, const char *cmd, const cha
 				// keep hsv in sync
 			}
 
-			RGBtoHSV(led_baseColors[0]/255.0f, led_baseColors[1]/255.0f, led_baseColors[2]/255.0f, &g_hsv_h, &g_hsv_s, &g_hsv_v);
+			LED_SyncHSVFromBaseColors();
 
 			if (CFG_HasFlag(OBK_FLAG_LED_AUTOENABLE_ON_ANY_ACTION)) {
 				LED_SetEnableAll(true);
@@ -1555,6 +1786,9 @@ static commandResult_t lerpSpeed(const void *context, const char *cmd, const cha
 
 
 	led_lerpSpeedUnitsPerSecond = Tokenizer_GetArgFloat(0);
+#if ENABLE_LED_FIXED_POINT
+	led_lerpSpeedQ16PerMS = led_lerpSpeedUnitsPerSecond * 65.536f;
+#endif
 
 	return CMD_RES_OK;
 }
@@ -13,10 +13,21 @@ typedef enum commandResult_e {
 
 } commandResult_t;
 
+#define SVM_LABEL_BUCKETS		16
+
+// script files are split into lines once, when they are registered,
+// see cmd_script.c
 typedef struct scriptFile_s
 {
 	char* fname;
+	// file text, lines are NULL terminated in place
 	char* data;
+	// executable lines, terminated by an entry with NULL text
+	struct scriptLine_s* lines;
+	int numLines;
+	struct scriptLabel_s* labels;
+	// first label index in each bucket, -1 if none
+	short labelBuckets[SVM_LABEL_BUCKETS];
 
 	struct scriptFile_s* next;
 } scriptFile_t;
@@ -28,20 +39,48 @@ typedef struct eventWait_s {
 	char waitingForArgumentStr[16];
 } eventWait_t;
 
+// entry in a timerHeap_t, see cmd_timerHeap.c
+typedef struct timerNode_s {
+	unsigned int deadline;
+	unsigned int order;
+	// index within heap plus one, 0 when not scheduled
+	int slot;
+	void *owner;
+} timerNode_t;
+
+// CPU time used by a script or Berry thread, resolution is the RTOS tick
+typedef struct threadStats_s {
+	unsigned int runs;
+	unsigned int totalUs;
+	unsigned int maxUs;
+	// runs that took longer than the slice, see scriptBudget
+	unsigned int overruns;
+} threadStats_t;
+
 typedef struct scriptInstance_s
 {
 	scriptFile_t* curFile;
 	int uniqueID;
-	const char* curLine;
+	struct scriptLine_s* curLine;
 	int totalDelayMS;
 	int currentDelayMS;
 	eventWait_t wait;
 	int delayRepeats;
+	// wake up time, not scheduled while waiting for event or stopped
+	timerNode_t timer;
 
 	struct scriptInstance_s* next;
+	// next thread in waitFor for the same event
+	struct scriptInstance_s* nextWaiter;
+	threadStats_t stats;
 } scriptInstance_t;
 
 scriptInstance_t *SVM_RegisterThread();
+// time accounting shared by script and Berry threads,
+// start times are from SYSPERF_GetTimeUs
+unsigned int SVM_GetElapsedUs(unsigned int startUs);
+void SVM_AccountRun(threadStats_t *st, unsigned int startUs, const char *kind, int uniqueID);
+bool SVM_IsTickBudgetUsed(unsigned int tickStartUs);
 extern scriptInstance_t *g_scriptThreads;
 
 typedef commandResult_t(*commandHandler_t)(const void* context, const char* cmd, const char* args, int flags);
@@ -62,8 +101,44 @@ typedef commandResult_t(*commandHandler_t)(const void* context, const char* cmd,
 #define COMMAND_FLAG_SOURCE_TELESENDER	64
 
 extern bool g_powersave;
+// what PowerSave command does, without its extra arguments,
+// returns level that was set or -1 when WiFi is not ready for it
+int CMD_ApplyPowerSave(int level);
+int CMD_GetPowerSaveLevel();
+#if PLATFORM_ESPIDF
+void CMD_SetCpuFreqRange(int minMHz, int maxMHz);
+#endif
 typedef struct command_s command_t;
 
+// A command string resolved once when a repeating event, clock event
+// or event handler is added, so firing it later does not need to split
+// the name and look it up again. Text itself is still owned by caller.
+typedef struct preparedCommand_s {
+	command_t *cmd;
+	// offset of arguments within command text
+	unsigned short argsOfs;
+	// offset and length of command name within command text
+	byte nameOfs;
+	byte nameLen;
+	// commands generation at which cmd was resolved
+	byte generation;
+} preparedCommand_t;
+
+#if ENABLE_CMD_STATS
+// per-command execution statistics, see cmdStats command and /api/cmdstats
+typedef struct cmdStats_s {
+	unsigned int calls;
+	// resolution is the RTOS tick
+	unsigned int totalUs;
+	unsigned int maxUs;
+	// COMMAND_FLAG_SOURCE_* seen so far
+	unsigned short sources;
+} cmdStats_t;
+
+void CMD_ForEachCommandStats(void *userData, void (*callback)(const char *name, const cmdStats_t *st, void *userData));
+void CMD_ResetCommandStats();
+#endif
+
 //
 void CMD_Init_Early();
 void CMD_Init_Delayed();
@@ -72,10 +147,33 @@ void CMD_RunUartCmndIfRequired();
 command_t*CMD_RegisterCommand(const char* name, commandHandler_t handler, void* context);
 commandResult_t CMD_ExecuteCommand(const char* s, int cmdFlags);
 commandResult_t CMD_ExecuteCommandArgs(const char* cmd, const char* args, int cmdFlags);
+void CMD_PrepareCommand(preparedCommand_t *pc, const char *s);
+// s must be the same text that was given to CMD_PrepareCommand
+commandResult_t CMD_ExecutePreparedCommand(preparedCommand_t *pc, const char *s, int cmdFlags);
 // like a strdup, but will expand constants.
 // Please remember to free the returned string
 char* CMD_ExpandingStrdup(const char* in);
+// Shared, reference counted strings. Equal strings get the same pointer.
+// Every StringPool_Intern must be paired with StringPool_Release.
+void StringPool_Init();
+const char *StringPool_Intern(const char *s);
+void StringPool_Release(const char *s);
+void StringPool_GetStats(int *outStrings, int *outRefs, int *outBytes);
+// called in main thread after queued command was executed
+typedef void (*cmdQueueCallback_t)(commandResult_t res, void *userData);
+// safe to call from any thread, command is copied and executed later from QuickTick
+bool CMD_QueueCommand(const char *s, int cmdFlags, cmdQueueCallback_t onDone, void *userData);
+// called in main thread with each log line made while queued command runs
+typedef void (*cmdOutputCallback_t)(const char *text, int len, void *userData);
+// like CMD_QueueCommand, but output of command is given to onOutput
+bool CMD_QueueCommandWithOutput(const char *s, int cmdFlags, cmdOutputCallback_t onOutput, cmdQueueCallback_t onDone, void *userData);
+// 0 when queued commands or UART console need next QuickTick, else -1
+int CMD_GetTimeToNextWakeMS();
+void CMD_RunQueuedCommands();
 int CMD_CountVarsInString(const char *in);
+#define FLASH_SEARCH_MAX_PATTERN	64
+// offset of first match in flash between startOfs and endOfs, -1 if none
+int Flash_FindPattern(const byte *data, int dataSize, int startOfs, int endOfs);
 commandResult_t CMD_CreateAliasHelper(const char *alias, const char *ocmd);
 const char *CMD_ExpandConstantFloat(const char *s, const char *stop, float *out);
 byte CMD_ParseOrExpandHexByte(const char **p);
@@ -213,7 +311,48 @@ enum LightMode {
 #define TOKENIZER_ALLOW_ESCAPING_QUOTATIONS		16
 #define TOKENIZER_EXPAND_EARLY					32
 
+#define TOKENIZER_MAX_CMD_LEN					512
+#define TOKENIZER_MAX_ARGS						32
+#define TOKENIZER_EXPANDED_ARG_LEN				40
+
+// Tokenizer state. Classic Tokenizer_* functions use the current context
+// (global one by default), TokenizerCtx_* take an explicit one, so nested
+// or concurrent command paths don't clobber each other.
+typedef struct tokenizer_s {
+	// backing buffer, spaces on arg boundaries are replaced with null char
+	char buffer[TOKENIZER_MAX_CMD_LEN];
+	char *args[TOKENIZER_MAX_ARGS];
+	// allocated on first expansion, released when command is done
+	char (*argsExpanded)[TOKENIZER_EXPANDED_ARG_LEN];
+	// pointers into original, unmutated string
+	const char *argsFrom[TOKENIZER_MAX_ARGS];
+	int numArgs;
+	int flags;
+} tokenizer_t;
+
 // cmd_tokenizer.c
+tokenizer_t *Tokenizer_Alloc();
+void Tokenizer_Free(tokenizer_t *t);
+// redirects classic Tokenizer_* API to given context (NULL means global), returns previous one
+tokenizer_t *Tokenizer_SetCurrent(tokenizer_t *t);
+// creates mutex that serializes Tokenizer_Enter/Tokenizer_Leave between threads
+void Tokenizer_Init();
+// makes context of next nesting level current, returns previous one for Tokenizer_Leave.
+// Other threads wait in Tokenizer_Enter until matching Tokenizer_Leave
+tokenizer_t *Tokenizer_Enter();
+void Tokenizer_Leave(tokenizer_t *prev);
+int TokenizerCtx_GetArgsCount(tokenizer_t *t);
+bool TokenizerCtx_CheckArgsCountAndPrintWarning(tokenizer_t *t, const char* cmdStr, int reqCount);
+const char* TokenizerCtx_GetArg(tokenizer_t *t, int i);
+const char* TokenizerCtx_GetArgFrom(tokenizer_t *t, int i);
+int TokenizerCtx_GetArgInteger(tokenizer_t *t, int i);
+int TokenizerCtx_GetPin(tokenizer_t *t, int i, int def);
+int TokenizerCtx_GetArgIntegerDefault(tokenizer_t *t, int i, int def);
+float TokenizerCtx_GetArgFloatDefault(tokenizer_t *t, int i, float def);
+bool TokenizerCtx_IsArgInteger(tokenizer_t *t, int i);
+float TokenizerCtx_GetArgFloat(tokenizer_t *t, int i);
+int TokenizerCtx_GetArgIntegerRange(tokenizer_t *t, int i, int rangeMax, int rangeMin);
+void TokenizerCtx_TokenizeString(tokenizer_t *t, const char* s, int flags);
 int Tokenizer_GetArgsCount();
 bool Tokenizer_CheckArgsCountAndPrintWarning(const char* cmdStr, int reqCount);
 const char* Tokenizer_GetArg(int i);
@@ -228,7 +367,8 @@ int Tokenizer_GetArgIntegerRange(int i, int rangeMax, int rangeMin);
 void Tokenizer_TokenizeString(const char* s, int flags);
 // cmd_repeatingEvents.c
 void RepeatingEvents_Init();
-void RepeatingEvents_RunUpdate(float deltaTimeSeconds);
+void RepeatingEvents_RunUpdate(int deltaMS);
+void RepeatingEvents_GetStats(int *outFired, int *outMissed, int *outAvgLateMS, int *outMaxLateMS);
 void SIM_GenerateRepeatingEventsDesc(char *o, int outLen);
 void SIM_GeneratePowerStateDesc(char *o, int outLen);
 // cmd_eventHandlers.c
@@ -296,6 +436,9 @@ extern float led_baseColors[5];
 extern byte g_lightEnableAll;
 extern byte g_lightMode;
 void LED_RunQuickColorLerp(int deltaMS);
+// integer lerp takes targets from finalColors, see ENABLE_LED_FIXED_POINT
+void LED_SetLerpTargets();
+int LED_GetTimeToNextWakeMS();
 void LED_RunOnEverySecond();
 OBK_Publish_Result sendFinalColor();
 OBK_Publish_Result sendColorChange();
@@ -325,21 +468,39 @@ void CMD_Berry_RunEventHandlers_IntInt(byte eventCode, int argument, int argumen
 void CMD_Berry_RunEventHandlers_IntBytes(byte eventCode, int argument, const byte *data, int size);
 int CMD_Berry_RunEventHandlers_StrPtr(byte eventCode, const char *argument, void* argument2);
 int CMD_Berry_RunEventHandlers_Str(byte eventCode, const char *argument, const char *argument2);
+// runs script file through bytecode cache, loadSource builds the source
+// from file when cache is stale (NULL means file is plain Berry)
+bool Berry_RunFile(const char *fname, char *(*loadSource)(const char *fname));
+// logs Berry threads with their time stats, used by listScripts
+void Berry_ListThreads();
 
 const char* CMD_GetResultString(commandResult_t r);
 
 void SVM_StartBacklog(const char *command);
 void SVM_RunThreads(int deltaMS);
+// time in ms until any script thread wants to run, -1 if none is scheduled,
+// so platform idle can sleep longer
+int SVM_GetTimeToNextWakeMS();
 void CMD_InitScripting();
 void SVM_RunStartupCommandAsScript();
 byte* LFS_ReadFile(const char* fname);
+// reading file in chunks, so it does not have to fit in RAM
+typedef struct lfsStream_s lfsStream_t;
+lfsStream_t* LFS_OpenStream(const char* fname, int* outError);
+int LFS_GetStreamSize(lfsStream_t* s);
+int LFS_ReadChunk(lfsStream_t* s, byte* buffer, int maxLen);
+void LFS_CloseStream(lfsStream_t* s);
 byte* LFS_ReadFileExpanding(const char* fname);
+// cached read, pointer stays owned by cache until next call
+const byte* LFS_BorrowFile(const char* fname, int* outLen);
+int LFS_GetFileCacheHits(const char* fname);
 int LFS_WriteFile(const char *fname, const byte *data, int len, bool bAppend);
 
 commandResult_t CMD_ClearAllHandlers(const void* context, const char* cmd, const char* args, int cmdFlags);
 commandResult_t RepeatingEvents_Cmd_ClearRepeatingEvents(const void* context, const char* cmd, const char* args, int cmdFlags);
 commandResult_t CMD_resetSVM(const void* context, const char* cmd, const char* args, int cmdFlags);
 int RepeatingEvents_GetActiveCount();
+int RepeatingEvents_GetTimeToNextWakeMS();
 
 
 #endif // __CMD_PUBLIC_H__
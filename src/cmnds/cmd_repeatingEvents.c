@@ -5,6 +5,7 @@
 #include "../logging/logging.h"
 #include "../new_pins.h"
 #include "../new_cfg.h"
+#include "../quicktick.h"
 
 // addRepeatingEvent	interval_seconds	  repeats	command top run
 // addRepeatingEvent		1				 -1			led_basecolor_rgb rand
@@ -12,82 +13,202 @@
 // turn off TuyaMCU after 5 seconds
 // addRepeatingEvent 5 1 setChannel 1 0
 typedef struct repeatingEvent_s {
-	// command string to execute
-	char *command;
+	// command string to execute, from string pool
+	const char *command;
+	// command resolved when event was added
+	preparedCommand_t prepared;
 	//char *condition;
 	// how often event repeats
-	float intervalSeconds;
-	// current value until next repeat (decremented every second)
-	float currentInterval;
+	int intervalMS;
+	// wheel time of next run
+	unsigned int deadline;
 	// number of times to repeat.
 	// If set to -1, then it's infinite repeater
 	// If set to EVENT_CANCELED_TIMES, then event structure is ready to be reused
 	int times;
 	// user can set an ID and then cancel repeating event by ID
 	int userID;
+	// all allocated events, including free ones
 	struct repeatingEvent_s *next;
+	// wheel slot list, or free list
+	struct repeatingEvent_s *slotNext;
+	struct repeatingEvent_s **slotPrev;
+	// events with the same userID bucket
+	struct repeatingEvent_s *idNext;
+	struct repeatingEvent_s **idPrev;
 } repeatingEvent_t;
 
 #define EVENT_CANCELED_TIMES -999
 
+// Hierarchical timer wheel with 1 ms resolution. Level 0 has a slot for
+// every ms of the next 256 ms, every further level is 64 times coarser.
+// Events are moved down a level when lower level wraps around.
+#define WHEEL_LEVEL0_BITS		8
+#define WHEEL_LEVEL_BITS		6
+#define WHEEL_LEVELS			3
+#define WHEEL_LEVEL0_SIZE		(1 << WHEEL_LEVEL0_BITS)
+#define WHEEL_LEVEL_SIZE		(1 << WHEEL_LEVEL_BITS)
+#define WHEEL_LEVEL_SHIFT(l)	(WHEEL_LEVEL0_BITS + (l) * WHEEL_LEVEL_BITS)
+// longer delays are parked in the last slot and reinserted when cascaded
+#define WHEEL_MAX_DELAY			((1u << WHEEL_LEVEL_SHIFT(WHEEL_LEVELS)) - 1)
+
+#define EVENT_ID_BUCKETS		16
+
 static repeatingEvent_t *g_repeatingEvents = 0;
+static repeatingEvent_t *g_freeEvents = 0;
+static repeatingEvent_t *g_wheel0[WHEEL_LEVEL0_SIZE];
+static repeatingEvent_t *g_wheel[WHEEL_LEVELS][WHEEL_LEVEL_SIZE];
+static repeatingEvent_t *g_eventsById[EVENT_ID_BUCKETS];
+// events moved out of level 0 slot, being fired now
+static repeatingEvent_t *g_dueEvents = 0;
+// event which command is being executed, freed after it returns
+static repeatingEvent_t *g_firingEvent = 0;
+static unsigned int g_wheelNow = 0;
+static int g_activeEvents = 0;
+// timing statistics, see listRepeatingEvents
+static unsigned int g_firedEvents = 0;
+static unsigned int g_missedRuns = 0;
+static unsigned int g_totalLateMS = 0;
+static unsigned int g_maxLateMS = 0;
+
+static void RepeatingEvents_Link(repeatingEvent_t **head, repeatingEvent_t *ev) {
+	ev->slotNext = *head;
+	if (*head) {
+		(*head)->slotPrev = &ev->slotNext;
+	}
+	ev->slotPrev = head;
+	*head = ev;
+}
+static void RepeatingEvents_Unlink(repeatingEvent_t *ev) {
+	if (ev->slotPrev == 0) {
+		return;
+	}
+	*ev->slotPrev = ev->slotNext;
+	if (ev->slotNext) {
+		ev->slotNext->slotPrev = ev->slotPrev;
+	}
+	ev->slotNext = 0;
+	ev->slotPrev = 0;
+}
+static void RepeatingEvents_InsertIntoWheel(repeatingEvent_t *ev) {
+	unsigned int delay = ev->deadline - g_wheelNow;
+	unsigned int slotTime = ev->deadline;
+	int l;
+
+	if (delay < WHEEL_LEVEL0_SIZE) {
+		RepeatingEvents_Link(&g_wheel0[slotTime % WHEEL_LEVEL0_SIZE], ev);
+		return;
+	}
+	if (delay > WHEEL_MAX_DELAY) {
+		slotTime = g_wheelNow + WHEEL_MAX_DELAY;
+		delay = WHEEL_MAX_DELAY;
+	}
+	for (l = 0; l < WHEEL_LEVELS - 1; l++) {
+		if (delay < (1u << WHEEL_LEVEL_SHIFT(l + 1))) {
+			break;
+		}
+	}
+	RepeatingEvents_Link(&g_wheel[l][(slotTime >> WHEEL_LEVEL_SHIFT(l)) % WHEEL_LEVEL_SIZE], ev);
+}
+// moves events from given level slot to lower levels, returns slot index
+static int RepeatingEvents_Cascade(int level) {
+	repeatingEvent_t *ev;
+	int index;
+
+	index = (g_wheelNow >> WHEEL_LEVEL_SHIFT(level)) % WHEEL_LEVEL_SIZE;
+	while ((ev = g_wheel[level][index]) != 0) {
+		RepeatingEvents_Unlink(ev);
+		RepeatingEvents_InsertIntoWheel(ev);
+	}
+	return index;
+}
+static void RepeatingEvents_Free(repeatingEvent_t *ev) {
+	RepeatingEvents_Unlink(ev);
+	if (ev->idPrev) {
+		*ev->idPrev = ev->idNext;
+		if (ev->idNext) {
+			ev->idNext->idPrev = ev->idPrev;
+		}
+		ev->idNext = 0;
+		ev->idPrev = 0;
+	}
+	if (ev->times != EVENT_CANCELED_TIMES) {
+		ev->times = EVENT_CANCELED_TIMES;
+		g_activeEvents--;
+	}
+	if (ev == g_firingEvent) {
+		// still executing, will be freed after command returns
+		return;
+	}
+	StringPool_Release(ev->command);
+	ev->command = 0;
+	RepeatingEvents_Link(&g_freeEvents, ev);
+}
 
 void RepeatingEvents_CancelRepeatingEvents(int userID)
 {
-	repeatingEvent_t *ev;
+	repeatingEvent_t *ev, *n;
 
-	// reuse existing
-	for(ev = g_repeatingEvents; ev; ev = ev->next) {
+	for(ev = g_eventsById[(unsigned int)userID % EVENT_ID_BUCKETS]; ev; ev = n) {
+		n = ev->idNext;
 		if(ev->userID == userID) {
-			// mark as finished
-			ev->times = EVENT_CANCELED_TIMES;
 			addLogAdv(LOG_INFO, LOG_FEATURE_CMD,"Event with id %i and cmd %s has been canceled",ev->userID,ev->command);
+			// mark as finished
+			RepeatingEvents_Free(ev);
 		}
 	}
 
 }
-void RepeatingEvents_AddRepeatingEvent(const char *command, float secondsInterval, int times, int userID)
+void RepeatingEvents_AddRepeatingEvent(const char *command, int intervalMS, int times, int userID)
 {
-	repeatingEvent_t *ev;
-	char *cmd_copy;
+	repeatingEvent_t *ev, **idBucket;
+	const char *cmd_copy;
 
-	// reuse existing
-	for(ev = g_repeatingEvents; ev; ev = ev->next) {
-		// is this event canceled/empty?
-		if(ev->times == EVENT_CANCELED_TIMES) {
-			if(!strcmp(ev->command,command)) {
-				ev->intervalSeconds = secondsInterval;
-				// fire after delay
-				ev->currentInterval = secondsInterval;
-				ev->times = times;
-				return;
-			}
-		}
-	}
-	// create new
-	ev = malloc(sizeof(repeatingEvent_t));
-	if(ev == 0) {
-		addLogAdv(LOG_ERROR, LOG_FEATURE_CMD,"RepeatingEvents_OnEverySecond: failed to malloc new event");
+	if (times == 0 || (times < 0 && times != -1)) {
 		return;
 	}
-	cmd_copy = strdup(command);
+	if (intervalMS < 1) {
+		intervalMS = 1;
+	}
+	cmd_copy = StringPool_Intern(command);
 	if(cmd_copy == 0) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_CMD,"RepeatingEvents_OnEverySecond: failed to malloc command text copy");
-		free(ev);
 		return;
 	}
-
-	ev->next = g_repeatingEvents;
-	g_repeatingEvents = ev;
+	// reuse existing
+	ev = g_freeEvents;
+	if (ev) {
+		RepeatingEvents_Unlink(ev);
+	}
+	else {
+		// create new
+		ev = MemPool_Alloc(sizeof(repeatingEvent_t));
+		if(ev == 0) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_CMD,"RepeatingEvents_OnEverySecond: failed to malloc new event");
+			StringPool_Release(cmd_copy);
+			return;
+		}
+		memset(ev, 0, sizeof(repeatingEvent_t));
+		ev->next = g_repeatingEvents;
+		g_repeatingEvents = ev;
+	}
 	ev->command = cmd_copy;
-	ev->intervalSeconds = secondsInterval;
+	CMD_PrepareCommand(&ev->prepared, ev->command);
+	ev->intervalMS = intervalMS;
 	ev->times = times;
 	ev->userID = userID;
-	// fire next frame
-	// TODO: is this what we want? or do we want to fire after full interval?
-	//ev->currentInterval = 1;
+	idBucket = &g_eventsById[(unsigned int)userID % EVENT_ID_BUCKETS];
+	ev->idNext = *idBucket;
+	if (*idBucket) {
+		(*idBucket)->idPrev = &ev->idNext;
+	}
+	ev->idPrev = idBucket;
+	*idBucket = ev;
+	g_activeEvents++;
 	// fire after full interval
-	ev->currentInterval = secondsInterval;
+	ev->deadline = g_wheelNow + QuickTick_GetTimeSinceRunMS() + intervalMS;
+	RepeatingEvents_InsertIntoWheel(ev);
+	QuickTick_Wake();
 }
 void SIM_GenerateRepeatingEventsDesc(char *o, int outLen) {
 	repeatingEvent_t *cur;
@@ -100,8 +221,8 @@ void SIM_GenerateRepeatingEventsDesc(char *o, int outLen) {
 			//ci++;
 			snprintf(buffer, outLen,"ID %i, repeats %i",(int) cur->userID, (int)cur->times);
 			strcat_safe(o, buffer, outLen);
-			snprintf(buffer, outLen, ", interval %i", (int)cur->intervalSeconds);
-			snprintf(buffer, outLen, " (cur left %i), cmd: ", (int)cur->currentInterval);
+			snprintf(buffer, outLen, ", interval %i", cur->intervalMS / 1000);
+			snprintf(buffer, outLen, " (cur left %i), cmd: ", (int)(cur->deadline - g_wheelNow) / 1000);
 			strcat_safe(o, buffer, outLen);
 			strcat_safe(o, cur->command, outLen);
 		}
@@ -109,55 +230,101 @@ void SIM_GenerateRepeatingEventsDesc(char *o, int outLen) {
 	}
 }
 int RepeatingEvents_GetActiveCount() {
-	repeatingEvent_t *cur;
-	int c_active;
-	
-	c_active = 0;
-	cur = g_repeatingEvents;
-	while (cur) {
-		// -1 means 'forever'
-		if (cur->times > 0 || cur->times == -1) {
-			c_active++;
+	return g_activeEvents;
+}
+// ms to next level 0 slot with events, or to level 0 wrap, where
+// further events are cascaded down, -1 when there are no events
+int RepeatingEvents_GetTimeToNextWakeMS() {
+	unsigned int t;
+
+	if (g_activeEvents == 0) {
+		return -1;
+	}
+	for (t = g_wheelNow + 1; ; t++) {
+		if (g_wheel0[t % WHEEL_LEVEL0_SIZE] || t % WHEEL_LEVEL0_SIZE == 0) {
+			return t - g_wheelNow;
 		}
-		cur = cur->next;
 	}
-	return c_active;
 }
-void RepeatingEvents_RunUpdate(float deltaTimeSeconds) {
-	repeatingEvent_t *cur;
-	int c_checked = 0;
-	int c_ran = 0;
+void RepeatingEvents_GetStats(int *outFired, int *outMissed, int *outAvgLateMS, int *outMaxLateMS) {
+	*outFired = g_firedEvents;
+	*outMissed = g_missedRuns;
+	*outAvgLateMS = g_firedEvents ? g_totalLateMS / g_firedEvents : 0;
+	*outMaxLateMS = g_maxLateMS;
+}
+static void RepeatingEvents_Fire(repeatingEvent_t *ev, unsigned int tickEnd) {
+	unsigned int late, skip;
 
-	cur = g_repeatingEvents;
-	while(cur) {
-		c_checked++;
-		// debug only check
-		if(cur == cur->next) {
-			addLogAdv(LOG_ERROR, LOG_FEATURE_CMD,"RepeatingEvents_OnEverySecond: single linked list was broken?");
-			cur->next = 0;
-			return;
+	// events fire during the tick that covers their deadline,
+	// so tick end is when it actually happens
+	late = tickEnd - ev->deadline;
+	g_firedEvents++;
+	g_totalLateMS += late;
+	if (late > g_maxLateMS) {
+		g_maxLateMS = late;
+	}
+	g_firingEvent = ev;
+	// -1 means 'forever'
+	if(ev->times != -1) {
+		ev->times -= 1;
+	}
+	if (ev->times == 0) {
+		// if finished all calls, mark as empty so we can reuse later
+		RepeatingEvents_Free(ev);
+	}
+	else {
+		// keep the phase, but do not run more than once per tick
+		ev->deadline += ev->intervalMS;
+		if ((int)(tickEnd - ev->deadline) >= 0) {
+			skip = (tickEnd - ev->deadline) / ev->intervalMS + 1;
+			ev->deadline += skip * ev->intervalMS;
+			g_missedRuns += skip;
 		}
-		// -1 means 'forever'
-		if(cur->times > 0 || cur->times == -1) {
-			cur->currentInterval-= deltaTimeSeconds;
-			if(cur->currentInterval<=0){
-				c_ran++;
-				// -1 means 'forever'
-				if(cur->times != -1) {
-					cur->times -= 1;
-					if (cur->times <= 0) {
-						// if finished all calls, mark as empty so we can reuse later
-						cur->times = EVENT_CANCELED_TIMES;
-					}
+		RepeatingEvents_InsertIntoWheel(ev);
+	}
+	CMD_ExecutePreparedCommand(&ev->prepared, ev->command, COMMAND_FLAG_SOURCE_SCRIPT);
+	g_firingEvent = 0;
+	if (ev->times == EVENT_CANCELED_TIMES) {
+		// finished, or canceled by its own command
+		RepeatingEvents_Free(ev);
+	}
+}
+void RepeatingEvents_RunUpdate(int deltaMS) {
+	repeatingEvent_t *ev;
+	unsigned int tickEnd;
+	int l;
+
+	tickEnd = g_wheelNow + deltaMS;
+	if (g_activeEvents == 0) {
+		g_wheelNow = tickEnd;
+		return;
+	}
+	while (g_wheelNow != tickEnd) {
+		g_wheelNow++;
+		if (g_wheelNow % WHEEL_LEVEL0_SIZE == 0) {
+			for (l = 0; l < WHEEL_LEVELS; l++) {
+				if (RepeatingEvents_Cascade(l) != 0) {
+					break;
 				}
-				cur->currentInterval = cur->intervalSeconds;
-				CMD_ExecuteCommand(cur->command, COMMAND_FLAG_SOURCE_SCRIPT);
 			}
 		}
-		cur = cur->next;
+		ev = g_wheel0[g_wheelNow % WHEEL_LEVEL0_SIZE];
+		if (ev == 0) {
+			continue;
+		}
+		// move whole slot away, events fired now may add new ones
+		g_wheel0[g_wheelNow % WHEEL_LEVEL0_SIZE] = 0;
+		ev->slotPrev = &g_dueEvents;
+		g_dueEvents = ev;
+		while ((ev = g_dueEvents) != 0) {
+			RepeatingEvents_Unlink(ev);
+			RepeatingEvents_Fire(ev, tickEnd);
+		}
+		if (g_activeEvents == 0) {
+			g_wheelNow = tickEnd;
+			return;
+		}
 	}
-
-	//addLogAdv(LOG_INFO, LOG_FEATURE_CMD,"RepeatingEvents_OnEverySecond checked %i events, ran %i\n",c_checked,c_ran);
 }
 // addRepeatingEventID 1234 5 -1 DGR_SendPower "testgr" 1 1 
 // cancelRepeatingEvent 1234
@@ -196,7 +363,7 @@ commandResult_t RepeatingEvents_Cmd_AddRepeatingEvent(const void *context, const
 
 	addLogAdv(LOG_INFO, LOG_FEATURE_CMD,"addRepeatingEvent: interval %f, repeats %i, command [%s]",interval,times,cmdToRepeat);
 
-	RepeatingEvents_AddRepeatingEvent(cmdToRepeat,interval, times, userID);
+	RepeatingEvents_AddRepeatingEvent(cmdToRepeat, (int)(interval * 1000.0f + 0.5f), times, userID);
 
 	return CMD_RES_OK;
 }
@@ -206,15 +373,30 @@ commandResult_t RepeatingEvents_Cmd_ClearRepeatingEvents(const void *context, co
 	int c = 0;
 
 	cur = g_repeatingEvents;
+	g_repeatingEvents = 0;
 	while (cur) {
 		rem = cur;
 		cur = cur->next;
-		free(rem->command);
-		free(rem);
+		if (rem == g_firingEvent) {
+			// called from its own command, keep it until it returns
+			RepeatingEvents_Free(rem);
+			rem->slotNext = 0;
+			rem->slotPrev = 0;
+			rem->next = 0;
+			g_repeatingEvents = rem;
+			continue;
+		}
+		StringPool_Release(rem->command);
+		MemPool_Free(rem);
 		c++;
 	}
 	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Fried %i rep. events", c);
-	g_repeatingEvents = 0;
+	g_freeEvents = 0;
+	g_dueEvents = 0;
+	g_activeEvents = 0;
+	memset(g_wheel0, 0, sizeof(g_wheel0));
+	memset(g_wheel, 0, sizeof(g_wheel));
+	memset(g_eventsById, 0, sizeof(g_eventsById));
 	return CMD_RES_OK;
 }
 commandResult_t RepeatingEvents_Cmd_CancelRepeatingEvent(const void *context, const char *cmd, const char *args, int cmdFlags) {
@@ -244,11 +426,15 @@ static commandResult_t RepeatingEvents_Cmd_ListRepeatingEvents(const void *conte
 	c = 0;
 
 	while (ev) {
-		ADDLOG_INFO(LOG_FEATURE_EVENT, "Repeater %i has ID %i, interval %i, reps %i, and command %s",
-			c,  ev->userID, ev->intervalSeconds, ev->times, ev->command);
+		if (ev->times != EVENT_CANCELED_TIMES) {
+			ADDLOG_INFO(LOG_FEATURE_EVENT, "Repeater %i has ID %i, interval %i ms, reps %i, and command %s",
+				c, ev->userID, ev->intervalMS, ev->times, ev->command);
+			c++;
+		}
 		ev = ev->next;
-		c++;
 	}
+	ADDLOG_INFO(LOG_FEATURE_EVENT, "Fired %u times, skipped %u late runs, avg delay %u ms, max delay %u ms",
+		g_firedEvents, g_missedRuns, g_firedEvents ? g_totalLateMS / g_firedEvents : 0, g_maxLateMS);
 
 	return CMD_RES_OK;
 }
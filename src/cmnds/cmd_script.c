@@ -4,6 +4,8 @@
 #include "../new_cfg.h"
 #include "../obk_config.h"
 #include "../driver/drv_public.h"
+#include "../quicktick.h"
+#include "../driver/drv_freeze.h"
 #include <ctype.h>
 #include "cmd_local.h"
 
@@ -225,13 +227,141 @@ addEventHandler OnHold 20 backlog AddChannel 10 2 0 255; DGR_SendBrightness room
 
 */
 
-int g_scrBufferSize = 0;
-char *g_scrBuffer = NULL;
+typedef struct scriptLine_s {
+	const char *text;
+	preparedCommand_t prepared;
+} scriptLine_t;
+
+typedef struct scriptLabel_s {
+	const char *name;
+	// index of the first line after label
+	unsigned short line;
+	// next label index in the same bucket, -1 at the end
+	short next;
+} scriptLabel_t;
+
 int svm_deltaMS;
 scriptFile_t *g_scriptFiles = 0;
 scriptInstance_t *g_scriptThreads = 0;
 scriptInstance_t *g_activeThread = 0;
+// threads that want to run, keyed by wake up time
+static timerHeap_t g_scriptTimers;
+// time a single thread may run before it yields, 0 for no limit.
+// Times come from SYSPERF_GetTimeUs, which counts microseconds only on
+// ESP-IDF. Elsewhere it steps by whole RTOS ticks (1 to 10 ms), so slices
+// shorter than a tick are in effect limited by g_scriptMaxLines
+static int g_scriptSliceUs = 5000;
+// time all threads together may run in one tick, the rest run next tick
+static int g_scriptTickBudgetUs = 15000;
+// lines a thread may run before it yields, also when tick did not change
+static int g_scriptMaxLines = 20;
+
+static int SVM_HashLabel(const char *label) {
+	unsigned int hash = 0;
+	while (*label) {
+		hash = hash * 31 + (byte)*label;
+		label++;
+	}
+	return hash % SVM_LABEL_BUCKETS;
+}
+// finds next line that is not empty and is not a comment,
+// returns pointer after it or NULL at the end of text
+static char *SVM_NextLine(char *p, char **outStart, int *outLen) {
+	char *start, *end;
+
+	while (1) {
+		while (*p == ' ' || *p == '\r' || *p == '\t' || *p == '\n') {
+			p++;
+		}
+		if (*p == 0) {
+			return 0;
+		}
+		start = p;
+		while (*p && *p != '\n') {
+			p++;
+		}
+		end = p;
+		if (*p) {
+			p++;
+		}
+		if (start[0] == '/' && start[1] == '/') {
+			continue;
+		}
+		while (end > start && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\t')) {
+			end--;
+		}
+		*outStart = start;
+		*outLen = end - start;
+		return p;
+	}
+}
+// Splits file text into executable lines and labels, so running
+// a script does not have to scan text again and goto does not search.
+static bool SVM_LexFile(scriptFile_t *f) {
+	char *p, *start;
+	int len, lines, labels;
+	scriptLabel_t *lab;
+	int i, b;
+
+	lines = 0;
+	labels = 0;
+	p = f->data;
+	while ((p = SVM_NextLine(p, &start, &len)) != 0) {
+		if (start[len - 1] == ':') {
+			labels++;
+		} else {
+			lines++;
+		}
+	}
+	f->lines = malloc(sizeof(scriptLine_t) * (lines + 1) + sizeof(scriptLabel_t) * labels);
+	if (f->lines == 0) {
+		return false;
+	}
+	f->labels = (scriptLabel_t*)(f->lines + lines + 1);
+	f->numLines = 0;
+	labels = 0;
+	p = f->data;
+	while ((p = SVM_NextLine(p, &start, &len)) != 0) {
+		if (start[len - 1] == ':') {
+			start[len - 1] = 0;
+			f->labels[labels].name = start;
+			f->labels[labels].line = f->numLines;
+			labels++;
+		} else {
+			start[len] = 0;
+			f->lines[f->numLines].text = start;
+			CMD_PrepareCommand(&f->lines[f->numLines].prepared, start);
+			f->numLines++;
+		}
+	}
+	f->lines[f->numLines].text = 0;
+	for (i = 0; i < SVM_LABEL_BUCKETS; i++) {
+		f->labelBuckets[i] = -1;
+	}
+	// link backwards, so the first of duplicated labels is found first
+	for (i = labels - 1; i >= 0; i--) {
+		lab = &f->labels[i];
+		b = SVM_HashLabel(lab->name);
+		lab->next = f->labelBuckets[b];
+		f->labelBuckets[b] = i;
+	}
+	return true;
+}
+static scriptFile_t *SVM_AddFile(const char *fname, char *data) {
+	scriptFile_t *r;
 
+	r = malloc(sizeof(scriptFile_t));
+	memset(r,0,sizeof(scriptFile_t));
+	r->fname = strdup(fname);
+	r->data = data;
+	if (r->data && SVM_LexFile(r) == false) {
+		free(r->data);
+		r->data = 0;
+	}
+	r->next = g_scriptFiles;
+	g_scriptFiles = r;
+	return r;
+}
 
 scriptInstance_t *SVM_RegisterThread() {
 	scriptInstance_t *r;
@@ -254,10 +384,187 @@ scriptInstance_t *SVM_RegisterThread() {
 	r->curLine = 0;
 	r->curFile = 0;
 	r->currentDelayMS = 0;
+	r->timer.owner = r;
+	memset(&r->stats, 0, sizeof(r->stats));
 	return r;
 }
+unsigned int SVM_GetElapsedUs(unsigned int startUs) {
+	return SYSPERF_GetTimeUs() - startUs;
+}
+void SVM_AccountRun(threadStats_t *st, unsigned int startUs, const char *kind, int uniqueID) {
+	unsigned int took = SVM_GetElapsedUs(startUs);
+
+	st->runs++;
+	st->totalUs += took;
+	if (took > st->maxUs) {
+		st->maxUs = took;
+	}
+	if (g_scriptSliceUs > 0 && took > (unsigned int)g_scriptSliceUs) {
+		st->overruns++;
+		ADDLOG_WARN(LOG_FEATURE_CMD, "%s thread UID %i ran for %u us, slice is %i us",
+			kind, uniqueID, took, g_scriptSliceUs);
+	}
+}
+bool SVM_IsTickBudgetUsed(unsigned int tickStartUs) {
+	if (g_scriptTickBudgetUs <= 0) {
+		return false;
+	}
+	return SVM_GetElapsedUs(tickStartUs) >= (unsigned int)g_scriptTickBudgetUs;
+}
+// puts thread on timer heap according to its state, must be called
+// after it has run or after it was started, stopped or woken up
+static void SVM_ScheduleThread(scriptInstance_t *t) {
+	if (t->curLine == 0 || t->wait.waitingForEvent) {
+		TimerHeap_Remove(&g_scriptTimers, &t->timer);
+	}
+	else if (t->currentDelayMS > 0) {
+		TimerHeap_Schedule(&g_scriptTimers, &t->timer, t->currentDelayMS);
+		QuickTick_Wake();
+	}
+	else {
+		// next tick
+		TimerHeap_Schedule(&g_scriptTimers, &t->timer, 1);
+		QuickTick_Wake();
+	}
+}
+// threads blocked in waitFor, by event code, so fired events
+// only look at threads that wait for them
+static scriptInstance_t *g_scriptWaiters[CMD_EVENT_MAX_TYPES];
+
+static void SVM_AddWaiter(scriptInstance_t *t) {
+	t->nextWaiter = g_scriptWaiters[t->wait.waitingForEvent];
+	g_scriptWaiters[t->wait.waitingForEvent] = t;
+}
+static void SVM_RemoveWaiter(scriptInstance_t *t) {
+	scriptInstance_t **prev;
+
+	if (t->wait.waitingForEvent == 0) {
+		return;
+	}
+	prev = &g_scriptWaiters[t->wait.waitingForEvent];
+	while (*prev) {
+		if (*prev == t) {
+			*prev = t->nextWaiter;
+			break;
+		}
+		prev = &(*prev)->nextWaiter;
+	}
+	t->wait.waitingForArgument = 0;
+	t->wait.waitingForEvent = 0;
+}
+static void SVM_StopThread(scriptInstance_t *t) {
+	SVM_RemoveWaiter(t);
+	t->curLine = 0;
+	t->curFile = 0;
+	t->uniqueID = 0;
+	t->currentDelayMS = 0;
+	TimerHeap_Remove(&g_scriptTimers, &t->timer);
+}
+int SVM_GetTimeToNextWakeMS() {
+	int next = TimerHeap_GetTimeToNext(&g_scriptTimers);
+#if ENABLE_OBK_BERRY
+	extern int Berry_GetTimeToNextWakeMS();
+	int berry = Berry_GetTimeToNextWakeMS();
+	if (next < 0 || (berry >= 0 && berry < next)) {
+		next = berry;
+	}
+#endif
+	return next;
+}
+#define SVM_LOAD_CHUNK 128
+enum {
+	SVM_LOAD_START,
+	SVM_LOAD_SLASH,
+	SVM_LOAD_COMMENT,
+	SVM_LOAD_TEXT,
+};
+// Reads script file through small buffer and keeps only what SVM_NextLine
+// would return, so comments, indentation and blank lines never take RAM
+// next to the script for its whole lifetime.
+static char *SVM_LoadFileText(const char *fname) {
+	lfsStream_t *s;
+	byte chunk[SVM_LOAD_CHUNK];
+	char *out, *shrunk;
+	int len, i, o, lineEnd, state;
+	char c;
+
+	s = LFS_OpenStream(fname, 0);
+	if (s == 0) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "SVM_LoadFileText: failed to file %s", fname);
+		return 0;
+	}
+	// output is never longer than file
+	out = (char*)malloc(LFS_GetStreamSize(s) + 1);
+	if (out == 0) {
+		LFS_CloseStream(s);
+		return 0;
+	}
+	o = 0;
+	lineEnd = 0;
+	state = SVM_LOAD_START;
+	while ((len = LFS_ReadChunk(s, chunk, sizeof(chunk))) > 0) {
+		for (i = 0; i < len; i++) {
+			c = chunk[i];
+			switch (state) {
+			case SVM_LOAD_START:
+				if (c == '/') {
+					state = SVM_LOAD_SLASH;
+				}
+				else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+					out[o++] = c;
+					lineEnd = o;
+					state = SVM_LOAD_TEXT;
+				}
+				break;
+			case SVM_LOAD_SLASH:
+				if (c == '/') {
+					state = SVM_LOAD_COMMENT;
+					break;
+				}
+				out[o++] = '/';
+				lineEnd = o;
+				state = SVM_LOAD_TEXT;
+				// this char belongs to the line
+				// fall through
+			case SVM_LOAD_TEXT:
+				if (c == '\n') {
+					o = lineEnd;
+					out[o++] = '\n';
+					state = SVM_LOAD_START;
+				}
+				else {
+					out[o++] = c;
+					if (c != ' ' && c != '\t' && c != '\r') {
+						lineEnd = o;
+					}
+				}
+				break;
+			case SVM_LOAD_COMMENT:
+				if (c == '\n') {
+					state = SVM_LOAD_START;
+				}
+				break;
+			}
+		}
+	}
+	LFS_CloseStream(s);
+	if (state == SVM_LOAD_SLASH) {
+		out[o++] = '/';
+	}
+	else if (state == SVM_LOAD_TEXT) {
+		o = lineEnd;
+	}
+	out[o] = 0;
+	shrunk = (char*)realloc(out, o + 1);
+	if (shrunk) {
+		out = shrunk;
+	}
+	ADDLOG_DEBUG(LOG_FEATURE_CMD, "SVM_LoadFileText: %s keeps %i bytes", fname, o);
+	return out;
+}
 scriptFile_t *SVM_RegisterFile(const char *fname) {
 	scriptFile_t *r;
+	char *data;
 
 	if (!stricmp(fname, "this") || fname[0] == '*') {
 		if (g_activeThread != 0)
@@ -275,24 +582,21 @@ scriptFile_t *SVM_RegisterFile(const char *fname) {
 		}
 		r = r->next;
 	}
-	r = malloc(sizeof(scriptFile_t));
-	memset(r,0,sizeof(scriptFile_t));
-	r->fname = strdup(fname);
 	// cast from byte* to char*
 	if (!strcmp(fname, "@startup")) {
-		r->data = strdup(CFG_GetShortStartupCommand());
+		data = strdup(CFG_GetShortStartupCommand());
 	}
 	else {
-		r->data = (char*)LFS_ReadFile(fname);
+		data = SVM_LoadFileText(fname);
 	}
-	r->next = g_scriptFiles;
-	g_scriptFiles = r;
+	r = SVM_AddFile(fname, data);
 	if(r->data == 0)
 		return 0;
 	return r;
 }
 scriptFile_t *SVM_RegisterFileForText(const char *txt) {
 	scriptFile_t *r;
+	char *data, *p;
 
 	r = g_scriptFiles;
 
@@ -302,84 +606,42 @@ scriptFile_t *SVM_RegisterFileForText(const char *txt) {
 		}
 		r = r->next;
 	}
-	r = malloc(sizeof(scriptFile_t));
-	memset(r, 0, sizeof(scriptFile_t));
-	r->fname = strdup(txt);
-	r->data = strdup(txt);
+	data = strdup(txt);
 	// convert backlog to script
-	char *p = r->data;
-	while (*p) {
+	p = data;
+	while (p && *p) {
 		if (*p == ';') {
 			*p = '\n';
 		}
 		p++;
 	}
-	r->next = g_scriptFiles;
-	g_scriptFiles = r;
+	r = SVM_AddFile(txt, data);
 	if (r->data == 0)
 		return 0;
 	return r;
 }
-const char *SVM_SkipWS(const char *p) {
-	if(p==0)
-		return 0;
-	// skip also whitespaces
-	while(*p == ' ' || *p == '\r' || *p == '\t') {
-		p++;
-	}
-	return p;
-}
-const char *SVM_SkipLine(const char *p) {
-	if(p==0)
-		return 0;
-	while(*p) {
-		if(*p == '\n') {
-			p++;
-			return p;
-		}
-		p++;
-	}
-	return p;
-}
 
-const char *SVM_FindLabel(const char *text, const char *label, const char *fname) {
-	int labLen;
+scriptLine_t *SVM_FindLabel(scriptFile_t *f, const char *label) {
+	int i;
 
 	if(label == 0)
-		return text;
+		return f->lines;
 	if (!strcmp(label, "*"))
-		return text;
+		return f->lines;
 	if (*label == 0)
-		return text;
+		return f->lines;
 
-	labLen = strlen(label);
-
-	while(*text) {
-		text = SVM_SkipWS(text); 
-		if(strncmp(text,label,labLen) == 0 && text[labLen] == ':') {
-			return text;
-		}
-		if(text[0] == '/' && text[1] == '/') {
-			text = SVM_SkipLine(text); 
-			text = SVM_SkipWS(text); 
-		} else {
-			text = SVM_SkipLine(text); 
-			text = SVM_SkipWS(text); 
+	for (i = f->labelBuckets[SVM_HashLabel(label)]; i >= 0; i = f->labels[i].next) {
+		if (!strcmp(f->labels[i].name, label)) {
+			return &f->lines[f->labels[i].line];
 		}
 	}
-	ADDLOG_INFO(LOG_FEATURE_CMD, "Label %s not found in %s - will go to the start of file",label,fname);
-	return text;
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Label %s not found in %s - will go to the start of file",label,f->fname);
+	return &f->lines[f->numLines];
 }
-void SVM_RunThread(scriptInstance_t *t, int maxLoops) {
+static void SVM_RunSlice(scriptInstance_t *t, int maxLoops, unsigned int startUs) {
 	int loop = 0;
-	const char *start, *end;
-	int len, p;
-	
-	if(g_scrBuffer == NULL) {
-		g_scrBufferSize = 256;
-		g_scrBuffer = malloc(g_scrBufferSize + 1);
-	}
-
+	scriptLine_t *line;
 
 	while(1) {
 		loop++;
@@ -395,84 +657,58 @@ void SVM_RunThread(scriptInstance_t *t, int maxLoops) {
 		if (loop > maxLoops) {
 			return;
 		}
-		t->curLine = SVM_SkipWS(t->curLine); 
-		if(t->curLine[0] == 0) {
+		if (loop > 1 && g_scriptSliceUs > 0 && SVM_GetElapsedUs(startUs) >= (unsigned int)g_scriptSliceUs) {
+			return;
+		}
+		line = t->curLine;
+		if(line->text == 0) {
 			t->curLine = 0;
 			t->curFile = 0;
 			return;
 		}
-		if(t->curLine[0] == '/' && t->curLine[1] == '/') {
-			t->curLine = SVM_SkipLine(t->curLine); 
-			t->curLine = SVM_SkipWS(t->curLine); 
-		} else {
-			start = t->curLine;
-			end = SVM_SkipLine(start);
-			t->curLine = SVM_SkipWS(end); 
+		// advance first, so goto and return can change it
+		t->curLine = line + 1;
+		CMD_ExecutePreparedCommand(&line->prepared, line->text, 0);
 
-			while(end > start && (end[-1]==' '||end[-1]=='\r'||end[-1]=='\n'||end[-1]=='\t')) {
-				end--;
-			}
-			len = (end - start);
-			//ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "Script len: %i",len);
-
-			// skip empty lines and skip labels
-			if(len > 0 && start[len-1] != ':') {
-				if(len >= g_scrBufferSize) {
-					g_scrBufferSize = len + 256;
-					g_scrBuffer = (char*)realloc(g_scrBuffer, g_scrBufferSize+1);
-				}
-				if (g_scrBuffer == NULL) {
-					return;
-				}
-				memcpy(g_scrBuffer,start,len);
-				g_scrBuffer[len] = 0;
-
-				p = start-t->curFile->data;
-				///ADDLOG_EXTRADEBUG(LOG_FEATURE_CMD, "[Loop %i] Script line: %s, char index %i",loop,g_scrBuffer,p);
-				CMD_ExecuteCommand(g_scrBuffer,0);
-
-				// did we get a sleep?
-				if(t->currentDelayMS > 0) {
-					return;
-				}	
-			}
+		// did we get a sleep?
+		if(t->currentDelayMS > 0) {
+			return;
 		}
 	}
 }
+void SVM_RunThread(scriptInstance_t *t, int maxLoops) {
+	unsigned int startUs = SYSPERF_GetTimeUs();
+	// thread may be stopped and reused while it runs
+	int uniqueID = t->uniqueID;
+
+	SVM_RunSlice(t, maxLoops, startUs);
+	SVM_AccountRun(&t->stats, startUs, "Script", uniqueID);
+}
 
 void SVM_RunThreads(int deltaMS) {
-	int c_sleep, c_run;
+	timerNode_t *n;
+	unsigned int tickStart;
 
-	c_sleep = 0;
-	c_run = 0;
+	WDT_Heartbeat(WDT_TASK_SCRIPT);
 	svm_deltaMS = deltaMS;
-
-
-	g_activeThread = g_scriptThreads;
-	while(g_activeThread) {
-		if (g_activeThread->wait.waitingForEvent) {
-			// do nothing
-			c_sleep++;
-		}
-		else {
-			if (g_activeThread->currentDelayMS > 0) {
-				g_activeThread->currentDelayMS -= deltaMS;
-				// the following block is needed to handle with long freezes on simulator
-				if (g_activeThread->currentDelayMS <= 0) {
-					g_activeThread->currentDelayMS = 0;
-					SVM_RunThread(g_activeThread, 20);
-				}
-				c_sleep++;
-			}
-			else {
-				SVM_RunThread(g_activeThread, 20);
-				c_run++;
-			}
+	TimerHeap_Advance(&g_scriptTimers, deltaMS);
+	tickStart = SYSPERF_GetTimeUs();
+
+	// threads sleeping or waiting for event are not on the heap at all,
+	// and a thread that runs is put back at least one ms later, so it
+	// will not run twice within a single call
+	while (!SVM_IsTickBudgetUsed(tickStart)) {
+		// threads that are still due stay on the heap for the next tick
+		n = TimerHeap_PopDue(&g_scriptTimers);
+		if (n == 0) {
+			break;
 		}
-		g_activeThread = g_activeThread->next;
+		g_activeThread = (scriptInstance_t*)n->owner;
+		g_activeThread->currentDelayMS = 0;
+		SVM_RunThread(g_activeThread, g_scriptMaxLines);
+		SVM_ScheduleThread(g_activeThread);
 	}
-
-	//ADDLOG_INFO(LOG_FEATURE_CMD, "SCR sleep %i, ran %i",c_sleep,c_run);
+	g_activeThread = 0;
 }
 bool CheckEventCondition(eventWait_t *w, byte eventCode, int argument) {
 	if (w->waitingForEvent != eventCode) {
@@ -512,21 +748,26 @@ bool CheckEventCondition(eventWait_t *w, byte eventCode, int argument) {
 	return bMatch;
 }
 void CMD_Script_ProcessWaitersForEvent(byte eventCode, int argument) {
-	scriptInstance_t *t;
+	scriptInstance_t *t, **prev;
 
+	if (eventCode >= CMD_EVENT_MAX_TYPES) {
+		return;
+	}
 #if ENABLE_OBK_BERRY
 	extern void CMD_Berry_ProcessWaitersForEvent(byte eventCode, int argument);
 	CMD_Berry_ProcessWaitersForEvent(eventCode, argument);
 #endif
-	t = g_scriptThreads;
-
-	while (t) {
+	prev = &g_scriptWaiters[eventCode];
+	while ((t = *prev) != 0) {
 		if(CheckEventCondition(&t->wait,eventCode,argument)) {
 			// unlock!
+			*prev = t->nextWaiter;
 			t->wait.waitingForArgument = 0;
 			t->wait.waitingForEvent = 0;
+			SVM_ScheduleThread(t);
+		} else {
+			prev = &t->nextWaiter;
 		}
-		t = t->next;
 	}
 }
 void SVM_GoTo(scriptInstance_t *th, const char *fname, const char *label) {
@@ -546,7 +787,7 @@ void SVM_GoTo(scriptInstance_t *th, const char *fname, const char *label) {
 		return;
 	}
 	th->curFile = f;
-	th->curLine = SVM_FindLabel(f->data,label,f->fname);
+	th->curLine = SVM_FindLabel(f,label);
 
 	return;
 }
@@ -560,6 +801,7 @@ void SVM_FreeAllFiles() {
 		n = f->next;
 
 		free(f->data);
+		free(f->lines);
 		free(f->fname);
 		free(f);
 
@@ -572,10 +814,7 @@ void SVM_StopAllScripts() {
 
 	t = g_scriptThreads;
 	while(t) {
-		t->curLine = 0;
-		t->curFile = 0;
-		t->uniqueID = 0;
-		t->currentDelayMS = 0;
+		SVM_StopThread(t);
 		t = t->next;
 	}
 }
@@ -589,10 +828,7 @@ void SVM_StopScripts(int id, int bExcludeSelf) {
 			// excluded
 		} else {
 			if(t->uniqueID == id) {
-				t->curLine = 0;
-				t->curFile = 0;
-				t->uniqueID = 0;
-				t->currentDelayMS = 0;
+				SVM_StopThread(t);
 			} 
 		}
 		t = t->next;
@@ -604,7 +840,7 @@ void SVM_GoToLocal(scriptInstance_t *th, const char *label) {
 
 		return;
 	}
-	th->curLine = SVM_FindLabel(th->curFile->data,label,th->curFile->fname);
+	th->curLine = SVM_FindLabel(th->curFile,label);
 
 	return;
 }
@@ -633,7 +869,8 @@ void SVM_StartBacklog(const char *command) {
 	}
 	th->uniqueID = 0;
 	th->curFile = f;
-	th->curLine = f->data;
+	th->curLine = f->lines;
+	SVM_ScheduleThread(th);
 	//return th;
 }
 scriptInstance_t *SVM_StartScript(const char *fname, const char *label, int uniqueID) {
@@ -641,20 +878,15 @@ scriptInstance_t *SVM_StartScript(const char *fname, const char *label, int uniq
 	scriptInstance_t *th;
 
 #if 1
-	// allow "startScript test.be" as a shorthand for "berry import test"
+	// allow "startScript test.be" to run Berry script, from cached bytecode if possible
 #if ENABLE_OBK_BERRY
 	if (hasExtension(fname, ".be")) {
 		// berry does not like slash?
 		if (*fname == '/' || *fname == '\\') {
 			fname++;
 		}
-		char tmp[64];
-		snprintf(tmp, sizeof(tmp), "berry import %s",fname);
-		tmp[sizeof(tmp) - 1] = 0;
-		// strip .be
-		tmp[strlen(tmp) - 3] = 0;
-		ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_StartScript: will run %s", tmp);
-		CMD_ExecuteCommand(tmp,0);
+		ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_StartScript: will run Berry %s", fname);
+		Berry_RunFile(fname, 0);
 		return NULL;
 	}
 #endif
@@ -678,7 +910,8 @@ scriptInstance_t *SVM_StartScript(const char *fname, const char *label, int uniq
 	}
 	th->uniqueID = uniqueID;
 	th->curFile = f;
-	th->curLine = SVM_FindLabel(f->data,label,f->fname);
+	th->curLine = SVM_FindLabel(f,label);
+	SVM_ScheduleThread(th);
 
 	if(label==0) {
 		ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_StartScript: started %s at the beginning",fname);
@@ -695,6 +928,7 @@ void SVM_RunStartupCommandAsScript() {
 		// Hacky as hell?
 		g_activeThread = th;
 		SVM_RunThread(g_activeThread, 200);
+		SVM_ScheduleThread(g_activeThread);
 		g_activeThread = 0;
 	}
 	else {
@@ -864,7 +1098,8 @@ static commandResult_t CMD_ListScripts(const void *context, const char *cmd, con
 	t = g_scriptThreads;
 	while(t) {
 		if(t->curFile) {
-			ADDLOG_INFO(LOG_FEATURE_CMD, "[%i] Thread UID %i - at file %s",cnt,t->uniqueID,t->curFile->fname);
+			ADDLOG_INFO(LOG_FEATURE_CMD, "[%i] Thread UID %i - at file %s - runs %u, total %u us, max %u us, overruns %u",
+				cnt,t->uniqueID,t->curFile->fname,t->stats.runs,t->stats.totalUs,t->stats.maxUs,t->stats.overruns);
 		} else {
 			ADDLOG_INFO(LOG_FEATURE_CMD, "[%i] Empty thread.",cnt);
 		}
@@ -872,9 +1107,26 @@ static commandResult_t CMD_ListScripts(const void *context, const char *cmd, con
 		cnt++;
 		t = t->next;
 	}
+#if ENABLE_OBK_BERRY
+	Berry_ListThreads();
+#endif
 
 	return CMD_RES_OK;
 }
+static commandResult_t CMD_ScriptBudget(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		g_scriptSliceUs = Tokenizer_GetArgInteger(0);
+		g_scriptTickBudgetUs = Tokenizer_GetArgIntegerDefault(1, g_scriptTickBudgetUs);
+		g_scriptMaxLines = Tokenizer_GetArgIntegerDefault(2, g_scriptMaxLines);
+		if (g_scriptMaxLines < 1) {
+			g_scriptMaxLines = 1;
+		}
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Script slice %i us, tick budget %i us, max %i lines per slice",
+		g_scriptSliceUs, g_scriptTickBudgetUs, g_scriptMaxLines);
+	return CMD_RES_OK;
+}
 static commandResult_t CMD_StopAllScripts(const void *context, const char *cmd, const char *args, int cmdFlags){
 
 
@@ -939,9 +1191,11 @@ commandResult_t CMD_waitFor(const void *context, const char *cmd, const char *ar
 	}
 	reqArg = atoi(s);
 	
+	SVM_RemoveWaiter(g_activeThread);
 	g_activeThread->wait.waitingForEvent = eventCode;
 	g_activeThread->wait.waitingForArgument = reqArg;
 	g_activeThread->wait.waitingForRelation = relation;
+	SVM_AddWaiter(g_activeThread);
 
 	return CMD_RES_OK;
 }
@@ -967,6 +1221,11 @@ void CMD_InitScripting(){
 	//cmddetail:"fn":"CMD_ListScripts","file":"cmnds/cmd_script.c","requires":"",
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("listScripts", CMD_ListScripts, NULL);
+	//cmddetail:{"name":"scriptBudget","args":"[SliceUs][TickBudgetUs][MaxLines]",
+	//cmddetail:"descr":"Sets how long a single script or Berry thread may run before it yields, how long all threads together may run in one tick (the rest continue next tick) and how many script lines a thread runs at most before it yields. 0 disables a time limit. Times have microsecond resolution only on ESP-IDF, elsewhere they step by RTOS tick (1 to 10 ms), so shorter slices are limited by MaxLines. Threads that run over the slice are logged and counted in listScripts. Without arguments prints current values.",
+	//cmddetail:"fn":"CMD_ScriptBudget","file":"cmnds/cmd_script.c","requires":"",
+	//cmddetail:"examples":"scriptBudget 5000 15000 20"}
+	CMD_RegisterCommand("scriptBudget", CMD_ScriptBudget, NULL);
 	//cmddetail:{"name":"goto","args":"[LabelStr]",
 	//cmddetail:"descr":"Script-only command. IF single argument is given, then goes to given label from within current script file. If two arguments are given, then jumps to any other script file by label - first argument is file, second label",
 	//cmddetail:"fn":"CMD_GoTo","file":"cmnds/cmd_script.c","requires":"",
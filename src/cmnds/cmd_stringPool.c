@@ -0,0 +1,135 @@
+#include "../new_common.h"
+#include "../logging/logging.h"
+#include "cmd_local.h"
+#include <stddef.h>
+
+// Shared, reference counted copies of strings that are often repeated,
+// like event handler commands or MQTT topic prefixes. Identical strings
+// are stored once, so interned strings can also be compared by pointer.
+#define STRINGPOOL_BUCKETS		32
+// string with that many references is never freed, its count is not
+// tracked anymore and it stays shared by all later users
+#define STRINGPOOL_PINNED		0xFFFF
+
+typedef struct pooledString_s {
+	struct pooledString_s *next;
+	unsigned short refs;
+	unsigned short hash;
+	char str[1];
+} pooledString_t;
+
+static pooledString_t *g_stringPool[STRINGPOOL_BUCKETS];
+// pool is used by handlers and MQTT callbacks registered from any thread
+static SemaphoreHandle_t g_stringPoolMutex = 0;
+
+static void StringPool_Lock() {
+	if (g_stringPoolMutex == 0) {
+		// not created yet, only boot thread runs
+		return;
+	}
+	while (xSemaphoreTake(g_stringPoolMutex, 1000) != pdTRUE) {
+		ADDLOG_WARN(LOG_FEATURE_CMD, "Waiting for string pool");
+	}
+}
+static void StringPool_Unlock() {
+	if (g_stringPoolMutex != 0) {
+		xSemaphoreGive(g_stringPoolMutex);
+	}
+}
+void StringPool_Init() {
+	if (g_stringPoolMutex == 0) {
+		g_stringPoolMutex = xSemaphoreCreateMutex();
+	}
+}
+
+static unsigned short StringPool_Hash(const char *s) {
+	unsigned short hash = 5381;
+	while (*s) {
+		hash = ((hash << 5) + hash) + (byte)*s;
+		s++;
+	}
+	return hash;
+}
+static pooledString_t *StringPool_EntryFor(const char *s) {
+	return (pooledString_t*)(s - offsetof(pooledString_t, str));
+}
+const char *StringPool_Intern(const char *s) {
+	pooledString_t *e;
+	unsigned short hash;
+	int len;
+
+	if (s == 0) {
+		return 0;
+	}
+	hash = StringPool_Hash(s);
+	StringPool_Lock();
+	for (e = g_stringPool[hash % STRINGPOOL_BUCKETS]; e; e = e->next) {
+		if (e->hash == hash && !strcmp(e->str, s)) {
+			if (e->refs < STRINGPOOL_PINNED) {
+				e->refs++;
+			}
+			StringPool_Unlock();
+			return e->str;
+		}
+	}
+	len = strlen(s);
+	e = (pooledString_t*)malloc(sizeof(pooledString_t) + len);
+	if (e == 0) {
+		StringPool_Unlock();
+		return 0;
+	}
+	memcpy(e->str, s, len + 1);
+	e->refs = 1;
+	e->hash = hash;
+	e->next = g_stringPool[hash % STRINGPOOL_BUCKETS];
+	g_stringPool[hash % STRINGPOOL_BUCKETS] = e;
+	StringPool_Unlock();
+	return e->str;
+}
+void StringPool_Release(const char *s) {
+	pooledString_t *e, **prev;
+
+	if (s == 0) {
+		return;
+	}
+	e = StringPool_EntryFor(s);
+	StringPool_Lock();
+	if (e->refs == STRINGPOOL_PINNED) {
+		StringPool_Unlock();
+		return;
+	}
+	if (e->refs > 1) {
+		e->refs--;
+		StringPool_Unlock();
+		return;
+	}
+	prev = &g_stringPool[e->hash % STRINGPOOL_BUCKETS];
+	while (*prev) {
+		if (*prev == e) {
+			*prev = e->next;
+			StringPool_Unlock();
+			free(e);
+			return;
+		}
+		prev = &(*prev)->next;
+	}
+	StringPool_Unlock();
+	ADDLOG_ERROR(LOG_FEATURE_CMD, "StringPool_Release: %s is not pooled", s);
+}
+void StringPool_GetStats(int *outStrings, int *outRefs, int *outBytes) {
+	pooledString_t *e;
+	int i;
+
+	*outStrings = 0;
+	*outRefs = 0;
+	*outBytes = 0;
+	StringPool_Lock();
+	for (i = 0; i < STRINGPOOL_BUCKETS; i++) {
+		for (e = g_stringPool[i]; e; e = e->next) {
+			(*outStrings)++;
+			*outRefs += e->refs;
+			*outBytes += sizeof(pooledString_t) + strlen(e->str);
+		}
+	}
+	StringPool_Unlock();
+}
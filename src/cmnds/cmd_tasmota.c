@@ -136,39 +136,68 @@ static commandResult_t powerAll(const void *context, const char *cmd, const char
 }
 
 
-static commandResult_t cmnd_backlog_old(const void * context, const char *cmd, const char *args, int cmdFlags) {
-
-	const char *subcmd;
+// Backlog text is copied once into a single buffer that holds both the
+// prepared commands and the text itself, with ';' replaced by terminators.
+// So there is no per-command copy (and no length limit for a single command)
+// and every command name is resolved only once, before anything is run.
+static commandResult_t cmnd_backlog_batch(const void * context, const char *cmd, const char *args, int cmdFlags) {
+	preparedCommand_t *prepared;
 	const char *p;
-	int count = 0;
-	char copy[128];
-	char *c;
+	char *text, *c, *start;
+	int count, len, i;
 	int localRes;
 	int res = CMD_RES_OK;
+	bool bReported = false;
+
 	ADDLOG_DEBUG(LOG_FEATURE_CMD, "backlog [%s]", args);
 
-	subcmd = args;
-	p = args;
-	while (*subcmd) {
-		c = copy;
-		while (*p) {
-			if (*p == ';') {
-				p++;
-				break;
-			}
-			*(c) = *(p++);
-			if (c - copy < (sizeof(copy) - 1)) {
-				c++;
-			}
+	count = 1;
+	for (p = args; *p; p++) {
+		if (*p == ';') {
+			count++;
+		}
+	}
+	len = p - args;
+	prepared = (preparedCommand_t*)malloc(sizeof(preparedCommand_t) * count + len + 1);
+	if (prepared == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "backlog: failed to alloc %i commands", count);
+		return CMD_RES_ERROR;
+	}
+	text = (char*)(prepared + count);
+	memcpy(text, args, len + 1);
+	c = text;
+	for (i = 0; i < count; i++) {
+		// piece ends at its ';' before name and args are looked up in it
+		start = c;
+		while (*c && *c != ';') {
+			c++;
 		}
-		*c = 0;
-		count++;
-		localRes = CMD_ExecuteCommand(copy, cmdFlags);
+		*(c++) = 0;
+		CMD_PrepareCommand(&prepared[i], start);
+	}
+	// Unresolved commands still go through the generic path later,
+	// because an earlier command may define them (alias) or Berry may handle them
+	c = text;
+	for (i = 0; i < count; i++) {
+		p = c;
+		while (isspace((unsigned char)*p)) {
+			p++;
+		}
+		if (prepared[i].cmd == 0 && *p && bReported == false) {
+			ADDLOG_WARN(LOG_FEATURE_CMD, "backlog: command %i [%s] is not known yet", i, p);
+			bReported = true;
+		}
+		c += strlen(c) + 1;
+	}
+	c = text;
+	for (i = 0; i < count; i++) {
+		localRes = CMD_ExecutePreparedCommand(&prepared[i], c, cmdFlags);
 		if (localRes != CMD_RES_OK && localRes != CMD_RES_EMPTY_STRING) {
 			res = localRes;
 		}
-		subcmd = p;
+		c += strlen(c) + 1;
 	}
+	free(prepared);
 	ADDLOG_DEBUG(LOG_FEATURE_CMD, "backlog executed %d", count);
 	return res;
 }
@@ -183,92 +212,231 @@ static commandResult_t cmnd_backlog(const void * context, const char *cmd, const
 	else 
 #endif
 	{
-		// old backlog - in place
-		res = cmnd_backlog_old(context, cmd, args, cmdFlags);
+		// backlog without delays - run in place
+		res = cmnd_backlog_batch(context, cmd, args, cmdFlags);
 	}
 	return res;
 }
 
-// Our wrapper for LFS.
-// Returns a buffer created with malloc.
-// You must free it later.
-byte *LFS_ReadFile(const char *fname) {
 #if ENABLE_LITTLEFS
-	if (lfs_present()){
-		lfs_file_t file;
-		int lfsres;
-		int len;
-		int cnt;
-		byte *res, *at;
-
-		cnt = 0;
-
-		memset(&file, 0, sizeof(lfs_file_t));
-		lfsres = lfs_file_open(&lfs, &file, fname, LFS_O_RDONLY);
-
-		if (lfsres >= 0) {
-			ADDLOG_DEBUG(LOG_FEATURE_CMD, "LFS_ReadFile: opened file %s", fname);
-			//lfs_file_seek(&lfs,&file,0,LFS_SEEK_END);
-			//len = lfs_file_tell(&lfs,&file);
-			//lfs_file_seek(&lfs,&file,0,LFS_SEEK_SET);
-
-			len = lfs_file_size(&lfs,&file);
-
-			lfs_file_seek(&lfs,&file,0,LFS_SEEK_SET);
+struct lfsStream_s {
+	lfs_file_t file;
+	int size;
+};
+#endif
 
-			res = malloc(len+1);
-			at = res;
+// Opens file for reading in chunks, so it does not have to fit in RAM.
+// Returns NULL when there is no such file, outError gets LFS result then.
+lfsStream_t *LFS_OpenStream(const char *fname, int *outError) {
+#if ENABLE_LITTLEFS
+	lfsStream_t *s;
+	int lfsres;
 
-			if(res == 0) {
-				ADDLOG_INFO(LOG_FEATURE_CMD, "LFS_ReadFile: opened file %s but malloc failed for %i", fname, len);
-			} else {
-#if 0
-				char buffer[32];
-				while(at - res < len) {
-					lfsres = lfs_file_read(&lfs, &file, buffer, sizeof(buffer));
-					if(lfsres <= 0)
-						break;
-					memcpy(at,buffer,lfsres);
+	if (outError) {
+		*outError = LFS_ERR_NOENT;
+	}
+	if (!lfs_present()) {
+#if WINDOWS
+		// sstop sim spam
+#else
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "LFS_OpenStream: lfs is absent");
+#endif
+		return 0;
+	}
+	s = (lfsStream_t*)malloc(sizeof(lfsStream_t));
+	if (s == 0) {
+		if (outError) {
+			*outError = LFS_ERR_NOMEM;
+		}
+		return 0;
+	}
+	memset(s, 0, sizeof(lfsStream_t));
+	lfsres = lfs_file_open(&lfs, &s->file, fname, LFS_O_RDONLY);
+	if (lfsres < 0) {
+		if (outError) {
+			*outError = lfsres;
+		}
+		free(s);
+		return 0;
+	}
+	s->size = lfs_file_size(&lfs, &s->file);
+	ADDLOG_DEBUG(LOG_FEATURE_CMD, "LFS_OpenStream: opened file %s, %i bytes", fname, s->size);
+	return s;
+#else
+	return 0;
+#endif
+}
+int LFS_GetStreamSize(lfsStream_t *s) {
+#if ENABLE_LITTLEFS
+	return s->size;
+#else
+	return 0;
+#endif
+}
+// returns count of bytes read, 0 at end of file or negative LFS error
+int LFS_ReadChunk(lfsStream_t *s, byte *buffer, int maxLen) {
+#if ENABLE_LITTLEFS
+	return lfs_file_read(&lfs, &s->file, buffer, maxLen);
+#else
+	return 0;
+#endif
+}
+void LFS_CloseStream(lfsStream_t *s) {
+#if ENABLE_LITTLEFS
+	if (s == 0) {
+		return;
+	}
+	lfs_file_close(&lfs, &s->file);
+	free(s);
+#endif
+}
 
-					at += lfsres;
-				}
-#elif 1
-				lfsres = lfs_file_read(&lfs, &file, res, len);
-#elif 0
-				int ofs;
-				for(ofs = 0; ofs < len; ofs++) {
-					lfsres = lfs_file_read(&lfs, &file, &res[ofs], 1);
-					if(lfsres <= 0)
-						break;
+// Our wrapper for LFS.
+// Returns a buffer created with malloc.
+// You must free it later.
+byte *LFS_ReadFile(const char *fname) {
+	lfsStream_t *s;
+	byte *res;
+	int len, got, total;
 
-				}
-#else
-				while(at - res < len) {
-					lfsres = lfs_file_read(&lfs, &file, at, 1);
-					if(lfsres <= 0)
-						break;
-					at++;
-				}
+	s = LFS_OpenStream(fname, 0);
+	if (s == 0) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "LFS_ReadFile: failed to file %s", fname);
+		return 0;
+	}
+	len = LFS_GetStreamSize(s);
+	res = malloc(len + 1);
+	if (res == 0) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "LFS_ReadFile: opened file %s but malloc failed for %i", fname, len);
+	}
+	else {
+		total = 0;
+		while (total < len && (got = LFS_ReadChunk(s, res + total, len - total)) > 0) {
+			total += got;
+		}
+		res[total] = 0;
+		ADDLOG_DEBUG(LOG_FEATURE_CMD, "LFS_ReadFile: Loaded %i bytes\n", total);
+	}
+	LFS_CloseStream(s);
+	return res;
+}
+#if ENABLE_LITTLEFS
+// Small LRU of whole files for scripts that expand $readfile on every tick.
+// Any LittleFS write drops everything, there are no modification times.
+#define LFS_FILECACHE_SLOTS			4
+#define LFS_FILECACHE_MAX_FILE		1024
+#define LFS_FILECACHE_MAX_TOTAL		2048
+
+typedef struct lfsCachedFile_s {
+	char fname[32];
+	byte *data;
+	int len;
+	unsigned int lastUse;
+	unsigned int hits;
+} lfsCachedFile_t;
+
+static lfsCachedFile_t g_fileCache[LFS_FILECACHE_SLOTS];
+static unsigned int g_fileCacheGeneration;
+static unsigned int g_fileCacheClock;
+static int g_fileCacheTotal;
+// file too big for cache, kept only until next borrow
+static byte *g_fileCacheOversize;
+
+static void LFS_FileCache_Drop(lfsCachedFile_t *e) {
+	g_fileCacheTotal -= e->len;
+	free(e->data);
+	memset(e, 0, sizeof(*e));
+}
+// free slot if there is one, otherwise least recently used
+static lfsCachedFile_t *LFS_FileCache_Oldest(bool bUsedOnly) {
+	lfsCachedFile_t *best = 0;
+	int i;
+
+	for (i = 0; i < LFS_FILECACHE_SLOTS; i++) {
+		if (g_fileCache[i].data == 0) {
+			if (bUsedOnly) {
+				continue;
+			}
+			return &g_fileCache[i];
+		}
+		if (best == 0 || g_fileCache[i].lastUse < best->lastUse) {
+			best = &g_fileCache[i];
+		}
+	}
+	return best;
+}
 #endif
-				res[len] = 0;
-				ADDLOG_DEBUG(LOG_FEATURE_CMD, "LFS_ReadFile: Loaded %i bytes\n",len);
-				//ADDLOG_INFO(LOG_FEATURE_CMD, "LFS_ReadFile: Loaded %s\n",res);
+// Returns file contents owned by cache, zero terminated.
+// Pointer is valid until next LFS_BorrowFile call, do not free it.
+const byte *LFS_BorrowFile(const char *fname, int *outLen) {
+#if ENABLE_LITTLEFS
+	lfsCachedFile_t *e;
+	byte *data;
+	int i, len;
+
+	free(g_fileCacheOversize);
+	g_fileCacheOversize = 0;
+	if (g_fileCacheGeneration != LFS_GetWriteGeneration()) {
+		g_fileCacheGeneration = LFS_GetWriteGeneration();
+		for (i = 0; i < LFS_FILECACHE_SLOTS; i++) {
+			if (g_fileCache[i].data) {
+				LFS_FileCache_Drop(&g_fileCache[i]);
 			}
-			lfs_file_close(&lfs, &file);
-			ADDLOG_DEBUG(LOG_FEATURE_CMD, "LFS_ReadFile: closed file %s", fname);
-			return res;
-		} else {
-			ADDLOG_INFO(LOG_FEATURE_CMD, "LFS_ReadFile: failed to file %s", fname);
 		}
-	} else {
-#if WINDOWS
-		// sstop sim spam
+	}
+	g_fileCacheClock++;
+	for (i = 0; i < LFS_FILECACHE_SLOTS; i++) {
+		e = &g_fileCache[i];
+		if (e->data && !strcmp(e->fname, fname)) {
+			e->hits++;
+			e->lastUse = g_fileCacheClock;
+			if (outLen) {
+				*outLen = e->len;
+			}
+			return e->data;
+		}
+	}
+	data = LFS_ReadFile(fname);
+	if (data == 0) {
+		return 0;
+	}
+	len = strlen((const char*)data);
+	if (outLen) {
+		*outLen = len;
+	}
+	if (len > LFS_FILECACHE_MAX_FILE || strlen(fname) >= sizeof(e->fname)) {
+		g_fileCacheOversize = data;
+		return data;
+	}
+	while (g_fileCacheTotal + len > LFS_FILECACHE_MAX_TOTAL) {
+		LFS_FileCache_Drop(LFS_FileCache_Oldest(true));
+	}
+	e = LFS_FileCache_Oldest(false);
+	if (e->data) {
+		LFS_FileCache_Drop(e);
+	}
+	strcpy(e->fname, fname);
+	e->data = data;
+	e->len = len;
+	e->lastUse = g_fileCacheClock;
+	g_fileCacheTotal += len;
+	return data;
 #else
-		ADDLOG_ERROR(LOG_FEATURE_CMD, "LFS_ReadFile: lfs is absent");
+	return 0;
 #endif
+}
+// -1 if file is not in cache
+int LFS_GetFileCacheHits(const char *fname) {
+#if ENABLE_LITTLEFS
+	int i;
+
+	for (i = 0; i < LFS_FILECACHE_SLOTS; i++) {
+		if (g_fileCache[i].data && !strcmp(g_fileCache[i].fname, fname)) {
+			return g_fileCache[i].hits;
+		}
 	}
 #endif
-	return 0;
+	return -1;
 }
 byte* LFS_ReadFileExpanding(const char* fname) {
 	byte *d = LFS_ReadFile(fname);
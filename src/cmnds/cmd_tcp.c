@@ -2,115 +2,284 @@
 #include "../new_cfg.h"
 #include "../logging/logging.h"
 #include "../obk_config.h"
+#include "../quicktick.h"
 #include <ctype.h>
 #include "cmd_local.h"
 
 #if ENABLE_TCP_COMMANDLINE
 
-#define CMD_CLIENT_SLEEP_TIME_MS 50
+// TCP console on port 100. One thread serves all sessions with select.
+// Each session collects bytes into lines (backspace and Ctrl-U edit it,
+// telnet option bytes are skipped) and queues every complete line. The
+// command runs from main thread and log lines it makes go to ring of its
+// own session, which this thread sends when socket takes them, so output
+// of sessions does not mix and one slow client does not stall the rest.
+// Lines logged by other threads while a command runs go with its output.
+
 #define CMD_CLIENT_DISCONNECT_AFTER_IDLE_MS (60 * 1000)
+// main thread adds output without waking select, so it does not wait long
+#define CMD_SELECT_TIMEOUT_MS	20
 
 #define CMD_SERVER_PORT		100
-#define MAX_COMMAND_LEN		64
+#define MAX_COMMAND_LEN		128
+#define CMD_MAX_SESSIONS	3
+// must be power of two
+#define CMD_OUT_SIZE		512
+#define CMD_OUT_MASK		(CMD_OUT_SIZE - 1)
+
+#define TELNET_IAC			0xFF
+
+typedef struct cmdSession_s {
+	// -1 when socket is closed
+	int fd;
+	// slot is not reused while its queued commands may still write to it
+	bool inUse;
+	// queued counts in this thread, done in main thread
+	volatile unsigned int queued;
+	volatile unsigned int done;
+	char line[MAX_COMMAND_LEN];
+	int lineLen;
+	// rest of too long line is skipped
+	bool overlong;
+	// telnet option bytes still to skip
+	int iacSkip;
+	unsigned int lastActive;
+	// output of commands, main thread moves in, this thread moves out
+	char out[CMD_OUT_SIZE];
+	volatile unsigned int outIn;
+	volatile unsigned int outOut;
+	// lines that did not fit while client was slow
+	unsigned int outDropped;
+} cmdSession_t;
 
 static xTaskHandle g_cmd_thread = NULL;
 static int g_bStarted = 0;
+static cmdSession_t g_cmdSessions[CMD_MAX_SESSIONS];
 
-static void CMD_ClientThread(int fd)
-{
-	char buf[MAX_COMMAND_LEN];
-	int len;
-	int sleepTime;
+// called from main thread with each log line of running command
+static void CMD_TCPCommandOutput(const char *text, int len, void *userData) {
+	cmdSession_t *s = (cmdSession_t*)userData;
+	unsigned int at;
+	int first;
+
+	// whole line or nothing, so client never gets half of one
+	if (s->fd < 0 || len > CMD_OUT_SIZE - (int)(s->outIn - s->outOut)) {
+		s->outDropped++;
+		return;
+	}
+	at = s->outIn & CMD_OUT_MASK;
+	first = CMD_OUT_SIZE - at;
+	if (first > len) {
+		first = len;
+	}
+	memcpy(s->out + at, text, first);
+	memcpy(s->out, text + first, len - first);
+	s->outIn += len;
+}
+// called from main thread when queued command is done
+static void CMD_TCPCommandDone(commandResult_t res, void *userData) {
+	cmdSession_t *s = (cmdSession_t*)userData;
 
-	sleepTime = 0;
-	//send(fd,"CMD:",5,0);
+	s->done++;
+}
 
-	while(1) {
-		if(sleepTime >= CMD_CLIENT_DISCONNECT_AFTER_IDLE_MS) {
-			ADDLOG_ERROR(LOG_FEATURE_CMD, "TCP Console dropping because of inactivity" );
-			break;
+static void CMD_TCPSessionClose(cmdSession_t *s) {
+	if (s->fd < 0) {
+		return;
+	}
+	if (s->outDropped) {
+		ADDLOG_DEBUG(LOG_FEATURE_CMD, "TCP Console client lost %u output lines", s->outDropped);
+	}
+	lwip_close(s->fd);
+	s->fd = -1;
+}
+static void CMD_TCPSessionLine(cmdSession_t *s) {
+	s->line[s->lineLen] = 0;
+	if (s->overlong) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "TCP Console line longer than %i dropped", MAX_COMMAND_LEN - 1);
+	}
+	else if (s->lineLen > 0) {
+		s->queued++;
+		if (CMD_QueueCommandWithOutput(s->line, COMMAND_FLAG_SOURCE_TCP, CMD_TCPCommandOutput, CMD_TCPCommandDone, s) == false) {
+			s->queued--;
 		}
-		rtos_delay_milliseconds(CMD_CLIENT_SLEEP_TIME_MS);
-		sleepTime += CMD_CLIENT_SLEEP_TIME_MS;
-		len = recv( fd, buf, sizeof(buf)-1, 0 );
-		if(len < 0) {
-			if(errno == EAGAIN) {
-				continue;
+	}
+	s->lineLen = 0;
+	s->overlong = false;
+}
+static void CMD_TCPSessionInput(cmdSession_t *s, const byte *data, int len) {
+	int i;
+	byte c;
+
+	for (i = 0; i < len; i++) {
+		c = data[i];
+		if (s->iacSkip) {
+			// IAC IAC is data byte 0xFF, which is not wanted in a command anyway
+			s->iacSkip--;
+			continue;
+		}
+		if (c == TELNET_IAC) {
+			// option negotiation, command and option
+			s->iacSkip = 2;
+		}
+		else if (c == '\r' || c == '\n') {
+			CMD_TCPSessionLine(s);
+		}
+		else if (c == 0x08 || c == 0x7F) {
+			if (s->lineLen > 0) {
+				s->lineLen--;
 			}
-			break;
 		}
-		if(len == 0) {
-			break;
+		else if (c == 0x15) {
+			s->lineLen = 0;
+		}
+		else if (c < 0x20 && c != '\t') {
+			// other control characters are ignored
 		}
-		if(len > 0) {
-			sleepTime = 0;
-			buf[len] = 0;
-			ADDLOG_ERROR(LOG_FEATURE_CMD, "TCP Console command: %s (raw len %i, strlen %i)", buf, len, strlen(buf) );
-			LOG_SetRawSocketCallback(fd);
-			CMD_ExecuteCommand(buf,COMMAND_FLAG_SOURCE_TCP);
-			LOG_SetRawSocketCallback(0);
-			//send(fd,"OK",3,0);
+		else if (s->lineLen < MAX_COMMAND_LEN - 1) {
+			s->line[s->lineLen++] = c;
+		}
+		else {
+			s->overlong = true;
 		}
 	}
+}
+// sends what socket takes now, rest stays for next time
+static void CMD_TCPSessionFlush(cmdSession_t *s) {
+	unsigned int at;
+	int len, first, sent;
 
-	ADDLOG_ERROR(LOG_FEATURE_CMD, "TCP client endd" );
-	rtos_delay_milliseconds(10);
-
+	while (s->fd >= 0 && (len = s->outIn - s->outOut) > 0) {
+		at = s->outOut & CMD_OUT_MASK;
+		first = CMD_OUT_SIZE - at;
+		if (first > len) {
+			first = len;
+		}
+		sent = send(s->fd, s->out + at, first, 0);
+		if (sent <= 0) {
+			if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				CMD_TCPSessionClose(s);
+			}
+			return;
+		}
+		s->outOut += sent;
+	}
+}
+static void CMD_TCPAccept(int tcp_listen_fd) {
+	struct sockaddr_in client_addr;
+	socklen_t sockaddr_t_size = sizeof(client_addr);
+	cmdSession_t *s;
+	int client_fd, i;
 
+	client_fd = accept(tcp_listen_fd, (struct sockaddr *) &client_addr, &sockaddr_t_size);
+	if (client_fd < 0) {
+		return;
+	}
+	for (i = 0; i < CMD_MAX_SESSIONS; i++) {
+		if (!g_cmdSessions[i].inUse) {
+			break;
+		}
+	}
+	if (i == CMD_MAX_SESSIONS) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "TCP Console has no free session");
+		lwip_close(client_fd);
+		return;
+	}
+	// Put the socket in non-blocking mode:
+	if (fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0) {
+		ADDLOG_DEBUG(LOG_FEATURE_CMD, "CMD Client failed to made non-blocking");
+	}
+	s = &g_cmdSessions[i];
+	memset(s, 0, sizeof(*s));
+	s->inUse = true;
+	s->lastActive = g_timeMs;
+	s->fd = client_fd;
 }
 
-/* TCP server listener thread */
-static void CMD_ServerThread( beken_thread_arg_t arg )
+/* TCP server thread, listens and serves all sessions */
+static void CMD_ServerThread(beken_thread_arg_t arg)
 {
-    (void)( arg );
-    OSStatus err = kNoErr;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t sockaddr_t_size = sizeof(client_addr);
-    int tcp_listen_fd = -1, client_fd = -1;
-    fd_set readfds;
+	(void)(arg);
+	OSStatus err = kNoErr;
+	struct sockaddr_in server_addr;
+	struct timeval tv;
+	int tcp_listen_fd = -1;
+	fd_set readfds, writefds;
+	cmdSession_t *s;
+	byte buf[64];
+	int i, len, maxfd;
 
-    tcp_listen_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	for (i = 0; i < CMD_MAX_SESSIONS; i++) {
+		g_cmdSessions[i].fd = -1;
+	}
+	tcp_listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;/* Accept conenction request on all network interface */
-    server_addr.sin_port = htons( CMD_SERVER_PORT );/* Server listen on port: 20000 */
-    err = bind( tcp_listen_fd, (struct sockaddr *) &server_addr, sizeof(server_addr) );
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = INADDR_ANY;/* Accept conenction request on all network interface */
+	server_addr.sin_port = htons(CMD_SERVER_PORT);
+	err = bind(tcp_listen_fd, (struct sockaddr *) &server_addr, sizeof(server_addr));
 
-    err = listen( tcp_listen_fd, 0 );
+	err = listen(tcp_listen_fd, CMD_MAX_SESSIONS);
 
-    while ( 1 )
-    {
-        FD_ZERO( &readfds );
-        FD_SET( tcp_listen_fd, &readfds );
-
-        select( tcp_listen_fd + 1, &readfds, NULL, NULL, NULL);
-
-        if ( FD_ISSET( tcp_listen_fd, &readfds ) )
-        {
-            client_fd = accept( tcp_listen_fd, (struct sockaddr *) &client_addr, &sockaddr_t_size );
-            if ( client_fd >= 0 )
-            {
-#if 1
-				// Put the socket in non-blocking mode:
-				if(fcntl(client_fd, F_SETFL, O_NONBLOCK) < 0) {
-				    ADDLOG_DEBUG(LOG_FEATURE_CMD,  "CMD Client failed to made non-blocking" );
-				}
-#endif
-             //   strcpy( client_ip_str, inet_ntoa( client_addr.sin_addr ) );
-           ///     ADDLOG_DEBUG(LOG_FEATURE_CMD,  "CMD Client %s:%d connected, fd: %d", client_ip_str, client_addr.sin_port, client_fd );
-				CMD_ClientThread(client_fd);
-				lwip_close( client_fd );;
-            }
-        }
-    }
+	while (1)
+	{
+		FD_ZERO(&readfds);
+		FD_ZERO(&writefds);
+		FD_SET(tcp_listen_fd, &readfds);
+		maxfd = tcp_listen_fd;
+		for (i = 0; i < CMD_MAX_SESSIONS; i++) {
+			s = &g_cmdSessions[i];
+			if (s->fd < 0) {
+				continue;
+			}
+			FD_SET(s->fd, &readfds);
+			if (s->outIn != s->outOut) {
+				FD_SET(s->fd, &writefds);
+			}
+			if (s->fd > maxfd) {
+				maxfd = s->fd;
+			}
+		}
+		tv.tv_sec = 0;
+		tv.tv_usec = CMD_SELECT_TIMEOUT_MS * 1000;
+		if (select(maxfd + 1, &readfds, &writefds, NULL, &tv) < 0) {
+			rtos_delay_milliseconds(CMD_SELECT_TIMEOUT_MS);
+			continue;
+		}
 
-    if ( err != kNoErr )
-		  ADDLOG_ERROR(LOG_FEATURE_CMD,  "Server listener thread exit with err: %d", err );
+		if (FD_ISSET(tcp_listen_fd, &readfds)) {
+			CMD_TCPAccept(tcp_listen_fd);
+		}
+		for (i = 0; i < CMD_MAX_SESSIONS; i++) {
+			s = &g_cmdSessions[i];
+			if (s->fd >= 0 && FD_ISSET(s->fd, &readfds)) {
+				len = recv(s->fd, buf, sizeof(buf), 0);
+				if (len > 0) {
+					s->lastActive = g_timeMs;
+					CMD_TCPSessionInput(s, buf, len);
+				}
+				else if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+					// what client sent last still runs, its output is lost
+					CMD_TCPSessionClose(s);
+				}
+			}
+			CMD_TCPSessionFlush(s);
+			if (s->fd >= 0 && s->queued == s->done && g_timeMs - s->lastActive >= CMD_CLIENT_DISCONNECT_AFTER_IDLE_MS) {
+				ADDLOG_ERROR(LOG_FEATURE_CMD, "TCP Console dropping because of inactivity");
+				CMD_TCPSessionClose(s);
+			}
+			if (s->fd < 0 && s->inUse && s->queued == s->done) {
+				s->inUse = false;
+			}
+		}
+	}
 
-    lwip_close( tcp_listen_fd );
+	if (err != kNoErr)
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "Server listener thread exit with err: %d", err);
 
-    rtos_delete_thread( NULL );
+	lwip_close(tcp_listen_fd);
 
+	rtos_delete_thread(NULL);
 }
 
 
@@ -0,0 +1,123 @@
+#include "../new_common.h"
+#include "cmd_local.h"
+
+// Min-heap of timer nodes ordered by absolute wake time.
+// Used by script threads, so sleeping threads are not visited every tick.
+// Time is kept by heap itself and advanced with QuickTick delta time.
+#define TIMERHEAP_GROW		8
+
+static bool TimerHeap_Before(const timerNode_t *a, const timerNode_t *b) {
+	int d = (int)(a->deadline - b->deadline);
+	if (d != 0) {
+		return d < 0;
+	}
+	// keep scheduling order for equal deadlines
+	return (int)(a->order - b->order) < 0;
+}
+static void TimerHeap_Place(timerHeap_t *h, int i, timerNode_t *n) {
+	h->nodes[i] = n;
+	n->slot = i + 1;
+}
+static void TimerHeap_Up(timerHeap_t *h, int i) {
+	timerNode_t *n = h->nodes[i];
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!TimerHeap_Before(n, h->nodes[parent])) {
+			break;
+		}
+		TimerHeap_Place(h, i, h->nodes[parent]);
+		i = parent;
+	}
+	TimerHeap_Place(h, i, n);
+}
+static void TimerHeap_Down(timerHeap_t *h, int i) {
+	timerNode_t *n = h->nodes[i];
+	int child;
+
+	while (1) {
+		child = i * 2 + 1;
+		if (child >= h->count) {
+			break;
+		}
+		if (child + 1 < h->count && TimerHeap_Before(h->nodes[child + 1], h->nodes[child])) {
+			child++;
+		}
+		if (!TimerHeap_Before(h->nodes[child], n)) {
+			break;
+		}
+		TimerHeap_Place(h, i, h->nodes[child]);
+		i = child;
+	}
+	TimerHeap_Place(h, i, n);
+}
+bool TimerHeap_Schedule(timerHeap_t *h, timerNode_t *n, int delayMS) {
+	timerNode_t **nodes;
+
+	n->deadline = h->now + delayMS;
+	n->order = h->order++;
+	if (n->slot) {
+		TimerHeap_Up(h, n->slot - 1);
+		TimerHeap_Down(h, n->slot - 1);
+		return true;
+	}
+	if (h->count >= h->capacity) {
+		nodes = (timerNode_t**)realloc(h->nodes, sizeof(timerNode_t*) * (h->capacity + TIMERHEAP_GROW));
+		if (nodes == 0) {
+			return false;
+		}
+		h->nodes = nodes;
+		h->capacity += TIMERHEAP_GROW;
+	}
+	TimerHeap_Place(h, h->count, n);
+	h->count++;
+	TimerHeap_Up(h, h->count - 1);
+	return true;
+}
+void TimerHeap_Remove(timerHeap_t *h, timerNode_t *n) {
+	timerNode_t *last;
+	int i;
+
+	if (n->slot == 0) {
+		return;
+	}
+	i = n->slot - 1;
+	n->slot = 0;
+	h->count--;
+	if (i == h->count) {
+		return;
+	}
+	last = h->nodes[h->count];
+	TimerHeap_Place(h, i, last);
+	TimerHeap_Up(h, i);
+	TimerHeap_Down(h, last->slot - 1);
+}
+void TimerHeap_Advance(timerHeap_t *h, int deltaMS) {
+	h->now += deltaMS;
+}
+timerNode_t *TimerHeap_PopDue(timerHeap_t *h) {
+	timerNode_t *n;
+
+	if (h->count == 0) {
+		return 0;
+	}
+	n = h->nodes[0];
+	if ((int)(n->deadline - h->now) > 0) {
+		return 0;
+	}
+	TimerHeap_Remove(h, n);
+	return n;
+}
+int TimerHeap_GetTimeToNext(timerHeap_t *h) {
+	int d;
+
+	if (h->count == 0) {
+		return -1;
+	}
+	d = (int)(h->nodes[0]->deadline - h->now);
+	if (d < 0) {
+		return 0;
+	}
+	return d;
+}
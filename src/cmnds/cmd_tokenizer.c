@@ -8,18 +8,25 @@
 #include "../logging/logging.h"
 #include "../hal/hal_pins.h"
 
-#define MAX_CMD_LEN 512
-#define MAX_ARGS 32
-
-static char g_buffer[MAX_CMD_LEN];
-static char *g_args[MAX_ARGS];
-static char g_argsExpanded[MAX_ARGS][40];
-static const char *g_argsFrom[MAX_ARGS];
-static int g_numArgs = 0;
-static int tok_flags = 0;
-
-#define g_bAllowQuotes (tok_flags&TOKENIZER_ALLOW_QUOTES)
-#define g_bAllowExpand (!(tok_flags&TOKENIZER_DONT_EXPAND))
+#define MAX_CMD_LEN TOKENIZER_MAX_CMD_LEN
+#define MAX_ARGS TOKENIZER_MAX_ARGS
+
+// context used by the classic Tokenizer_* API
+static tokenizer_t g_defaultTokenizer;
+static tokenizer_t *g_tok = &g_defaultTokenizer;
+// contexts of nested command calls, see Tokenizer_Enter. Allocated on
+// first use of given depth and kept, deeper levels are allocated per call
+#define TOKENIZER_POOL_SIZE		4
+static tokenizer_t *g_tokenizerPool[TOKENIZER_POOL_SIZE];
+static int g_tokenizerDepth;
+// contexts above are shared, so command execution is serialized. Thread
+// that holds the mutex can enter again for nested commands.
+static SemaphoreHandle_t g_tokenizerMutex = 0;
+static void *g_tokenizerOwner;
+static int g_tokenizerLocks;
+
+#define g_bAllowQuotes (t->flags&TOKENIZER_ALLOW_QUOTES)
+#define g_bAllowExpand (!(t->flags&TOKENIZER_DONT_EXPAND))
 
 int str_to_ip(const char *s, byte *ip) {
 #if PLATFORM_W600 || PLATFORM_LN882H || PLATFORM_REALTEK || PLATFORM_ECR6600 || PLATFORM_TR6260 \
@@ -54,33 +61,51 @@ bool isWhiteSpace(char ch) {
 		return true;
 	return false;
 }
-bool Tokenizer_CheckArgsCountAndPrintWarning(const char *cmdString, int reqCount) {
-	if (g_numArgs >= reqCount)
+bool TokenizerCtx_CheckArgsCountAndPrintWarning(tokenizer_t *t, const char *cmdString, int reqCount) {
+	if (t->numArgs >= reqCount)
 		return false;
-	ADDLOG_ERROR(LOG_FEATURE_CMD, "Cant run '%s', expected at least %i args (given %i)", cmdString, reqCount, g_numArgs);
+	ADDLOG_ERROR(LOG_FEATURE_CMD, "Cant run '%s', expected at least %i args (given %i)", cmdString, reqCount, t->numArgs);
 	return true;
 }
-int Tokenizer_GetArgsCount() {
-	return g_numArgs;
+int TokenizerCtx_GetArgsCount(tokenizer_t *t) {
+	return t->numArgs;
 }
-bool Tokenizer_IsArgInteger(int i) {
-	if(i >= g_numArgs)
+bool TokenizerCtx_IsArgInteger(tokenizer_t *t, int i) {
+	if(i >= t->numArgs)
 		return false;
-	if (*g_args[i] == '$') {
+	if (*t->args[i] == '$') {
 		return true;
 	}
-	return strIsInteger(g_args[i]);
+	return strIsInteger(t->args[i]);
 }
-const char *Tokenizer_GetArgExpanding(int i) {
+// buffer for expanded arg i, NULL if it can't be allocated
+static char *TokenizerCtx_GetExpandBuffer(tokenizer_t *t, int i) {
+	if (t->argsExpanded == 0) {
+		t->argsExpanded = calloc(MAX_ARGS, TOKENIZER_EXPANDED_ARG_LEN);
+		if (t->argsExpanded == 0) {
+			return 0;
+		}
+	}
+	return t->argsExpanded[i];
+}
+static void TokenizerCtx_ReleaseExpandBuffer(tokenizer_t *t) {
+	free(t->argsExpanded);
+	t->argsExpanded = 0;
+}
+const char *TokenizerCtx_GetArgExpanding(tokenizer_t *t, int i) {
 	const char *s;
-	char tokLine[sizeof(g_argsExpanded[i])];
-	char Templine[sizeof(g_argsExpanded[i])];
+	char tokLine[TOKENIZER_EXPANDED_ARG_LEN];
+	char Templine[TOKENIZER_EXPANDED_ARG_LEN];
 	char convert[10];
+	char *out;
 
-	if (i >= g_numArgs)
+	if (i >= t->numArgs)
 		return 0;
+	out = TokenizerCtx_GetExpandBuffer(t, i);
+	if (out == 0)
+		return t->args[i];
 
-	s = g_args[i];
+	s = t->args[i];
 
 	//séparators for strtok to detect constants
 	const char * separators = "${}";
@@ -88,7 +113,7 @@ const char *Tokenizer_GetArgExpanding(int i) {
 	char *ptrConst;
 
 	//copy input string before manipulations
-	strcpy_safe(g_argsExpanded[i], s, sizeof(g_argsExpanded[i]));
+	strcpy_safe(out, s, TOKENIZER_EXPANDED_ARG_LEN);
 	strcpy_safe(tokLine, s, sizeof(tokLine));
 
 	//start strtok
@@ -98,18 +123,18 @@ const char *Tokenizer_GetArgExpanding(int i) {
 		char tconst[20] = "${";
 		strcat(tconst, strToken);
 		strcat(tconst, "}");
-		ptrConst = strstr(g_argsExpanded[i], tconst);
+		ptrConst = strstr(out, tconst);
 		if (ptrConst == NULL) {
 			// we didn't find ${<token>} so we try with $<token>
 			strcpy(tconst, "$");
 			strcat(tconst, strToken);
-			ptrConst = strstr(g_argsExpanded[i], tconst);
+			ptrConst = strstr(out, tconst);
 		}
 		// if we found ${<token>} or $<token> it means we found a constant
 		if (ptrConst != NULL) {
 			//put 0 on the start of the constant to copy the left part of the input string
 			ptrConst[0] = 0;
-			strcpy_safe(Templine, g_argsExpanded[i], sizeof(Templine));
+			strcpy_safe(Templine, out, sizeof(Templine));
 			//analyse the constant found to replace it with it's value/string and concat it with the left part of the input string
 			if (!strcmp(tconst, "${IP}") || !strcmp(tconst, "$IP")) {
 				strcat_safe(Templine, HAL_GetMyIPString(), sizeof(Templine));
@@ -131,27 +156,35 @@ const char *Tokenizer_GetArgExpanding(int i) {
 			//concat with the right part, after the constant
 			strcat_safe(Templine, ptrConst + strlen(tconst), sizeof(Templine));
 			//update the input string with the replaced constant
-			strcpy_safe(g_argsExpanded[i], Templine, sizeof(g_argsExpanded[i]));
+			strcpy_safe(out, Templine, TOKENIZER_EXPANDED_ARG_LEN);
 		}
 		//look for next token
 		strToken = strtok(NULL, separators);
 
 	}
 
-	return g_argsExpanded[i];
+	return out;
 
 }
-const char *Tokenizer_GetArg(int i) {
+const char *TokenizerCtx_GetArg(tokenizer_t *t, int i) {
 	const char *s;
+	char *out;
 
-	if (i >= g_numArgs)
+	if (i >= t->numArgs)
 		return 0;
 
-	if (g_argsExpanded[i][0] != 0) {
-		return g_argsExpanded[i];
+	if (t->argsExpanded && t->argsExpanded[i][0] != 0) {
+		return t->argsExpanded[i];
 	}
 
-	s = g_args[i];
+	s = t->args[i];
+	if (!g_bAllowExpand || ((t->flags & TOKENIZER_ALTERNATE_EXPAND_AT_START) == 0 && s[0] != '$')) {
+		return s;
+	}
+	out = TokenizerCtx_GetExpandBuffer(t, i);
+	if (out == 0) {
+		return s;
+	}
 
 #if 0
 	if (g_bAllowExpand && s[0] == '$' && s[1] == 'C' && s[2] == 'H') {
@@ -161,45 +194,45 @@ const char *Tokenizer_GetArg(int i) {
 		channelIndex = atoi(s + 3);
 		value = CHANNEL_Get(channelIndex);
 
-		sprintf(g_argsExpanded[i], "%i", value);
+		sprintf(t->argsExpanded[i], "%i", value);
 
-		return g_argsExpanded[i];
+		return t->argsExpanded[i];
 	}
 #else
-	if (g_bAllowExpand && (tok_flags & TOKENIZER_ALTERNATE_EXPAND_AT_START)) {
-		CMD_ExpandConstantsWithinString(s, g_argsExpanded[i], sizeof(g_argsExpanded[i]));
-		return g_argsExpanded[i];
+	if (g_bAllowExpand && (t->flags & TOKENIZER_ALTERNATE_EXPAND_AT_START)) {
+		CMD_ExpandConstantsWithinString(s, out, TOKENIZER_EXPANDED_ARG_LEN);
+		return out;
 	}
 	else if (g_bAllowExpand && s[0] == '$') {
 		// quick hack for str expansion here, may do it in a better way later
 		if (!strcmp(s + 1, "IP")) {
-			strcpy_safe(g_argsExpanded[i], HAL_GetMyIPString(), sizeof(g_argsExpanded[i]));
+			strcpy_safe(out, HAL_GetMyIPString(), TOKENIZER_EXPANDED_ARG_LEN);
 		}
 		else if (!strcmp(s + 1, "ShortName")) {
-			strcpy_safe(g_argsExpanded[i], CFG_GetShortDeviceName(), sizeof(g_argsExpanded[i]));
+			strcpy_safe(out, CFG_GetShortDeviceName(), TOKENIZER_EXPANDED_ARG_LEN);
 		}
 		else if (!strcmp(s + 1, "Name")) {
-			strcpy_safe(g_argsExpanded[i], CFG_GetDeviceName(), sizeof(g_argsExpanded[i]));
+			strcpy_safe(out, CFG_GetDeviceName(), TOKENIZER_EXPANDED_ARG_LEN);
 		}
 		else {
 			float f;
 			int iValue;
 			CMD_ExpandConstantFloat(s, 0, &f);
 			iValue = f;
-			sprintf(g_argsExpanded[i], "%i", iValue);
+			sprintf(out, "%i", iValue);
 		}
-		return g_argsExpanded[i];
+		return out;
 	}
 
 #endif
 
-	return g_args[i];
+	return t->args[i];
 }
-const char *Tokenizer_GetArgFrom(int i) {
-	return g_argsFrom[i];
+const char *TokenizerCtx_GetArgFrom(tokenizer_t *t, int i) {
+	return t->argsFrom[i];
 }
-int Tokenizer_GetArgIntegerRange(int i, int rangeMin, int rangeMax) {
-	int ret = Tokenizer_GetArgInteger(i);
+int TokenizerCtx_GetArgIntegerRange(tokenizer_t *t, int i, int rangeMin, int rangeMax) {
+	int ret = TokenizerCtx_GetArgInteger(t, i);
 	if(ret < rangeMin) {
 		ret = rangeMin;
 		ADDLOG_ERROR(LOG_FEATURE_CMD, "Argument %i (val=%i) was out of range [%i,%i], clamped",i,ret,rangeMax,rangeMin);
@@ -211,44 +244,44 @@ int Tokenizer_GetArgIntegerRange(int i, int rangeMin, int rangeMax) {
 	return ret;
 }
 
-int Tokenizer_GetPin(int i, int def) {
+int TokenizerCtx_GetPin(tokenizer_t *t, int i, int def) {
 	int r;
 
-	if (g_numArgs <= i) {
+	if (t->numArgs <= i) {
 //		ADDLOG_DEBUG(LOG_FEATURE_CMD, "Tokenizer_GetPin: Argument %i not present - Returning default index %i",i,def);
 		return def;
 	}
-	return Tokenizer_IsArgInteger(i) ? Tokenizer_GetArgInteger(i) : PIN_FindIndexFromString(g_args[i]);
-//	r = Tokenizer_IsArgInteger(i) ? Tokenizer_GetArgInteger(i) : PIN_FindIndexFromString(g_args[i]);
-//	ADDLOG_DEBUG(LOG_FEATURE_CMD, "Tokenizer_GetPin: Argument %i (%s) - Returning index %i",i,g_args[i],r);
+	return TokenizerCtx_IsArgInteger(t, i) ? TokenizerCtx_GetArgInteger(t, i) : PIN_FindIndexFromString(t->args[i]);
+//	r = Tokenizer_IsArgInteger(i) ? Tokenizer_GetArgInteger(i) : PIN_FindIndexFromString(t->args[i]);
+//	ADDLOG_DEBUG(LOG_FEATURE_CMD, "Tokenizer_GetPin: Argument %i (%s) - Returning index %i",i,t->args[i],r);
 	return r;
 }
 
-int Tokenizer_GetArgIntegerDefault(int i, int def) {
+int TokenizerCtx_GetArgIntegerDefault(tokenizer_t *t, int i, int def) {
 	int r;
 
-	if (g_numArgs <= i) {
+	if (t->numArgs <= i) {
 		return def;
 	}
-	r = Tokenizer_GetArgInteger(i);
+	r = TokenizerCtx_GetArgInteger(t, i);
 
 	return r;
 }
-float Tokenizer_GetArgFloatDefault(int i, float def) {
+float TokenizerCtx_GetArgFloatDefault(tokenizer_t *t, int i, float def) {
 	float r;
 
-	if (g_numArgs <= i) {
+	if (t->numArgs <= i) {
 		return def;
 	}
-	r = Tokenizer_GetArgFloat(i);
+	r = TokenizerCtx_GetArgFloat(t, i);
 
 	return r;
 }
-int Tokenizer_GetArgInteger(int i) {
+int TokenizerCtx_GetArgInteger(tokenizer_t *t, int i) {
 	const char *s;
 	int ret;
 
-	s = g_args[i];
+	s = t->args[i];
 	if (s == 0)
 		return 0;
 	if(s[0] == '0' && s[1] == 'x') {
@@ -277,12 +310,12 @@ int Tokenizer_GetArgInteger(int i) {
 #endif
 	return atoi(s);
 }
-float Tokenizer_GetArgFloat(int i) {
+float TokenizerCtx_GetArgFloat(tokenizer_t *t, int i) {
 #if !ENABLE_EXPAND_CONSTANT
 	int channelIndex;
 #endif
 	const char *s;
-	s = g_args[i];
+	s = t->args[i];
 #if !ENABLE_EXPAND_CONSTANT
 	if(g_bAllowExpand && s[0] == '$') {
 		// constant
@@ -323,11 +356,11 @@ void expandQuotes(char* str) {
 	str[writeIndex] = 0;
 }
 
-void Tokenizer_TokenizeString(const char *s, int flags) {
+void TokenizerCtx_TokenizeString(tokenizer_t *t, const char *s, int flags) {
 	char *p;
 
-	tok_flags = flags;
-	g_numArgs = 0;
+	t->flags = flags;
+	t->numArgs = 0;
 
 	if(s == 0) {
 		return;
@@ -342,34 +375,38 @@ void Tokenizer_TokenizeString(const char *s, int flags) {
 	}
 
 	// not really needed, but nice for testing
-	memset(g_args, 0, sizeof(g_args)); // backing buffer is g_buffer, which is mutated where spaces on arg boundaries are set to null char
-	memset(g_argsFrom, 0, sizeof(g_argsFrom)); // backing buffer is s, original unmutated string
-	memset(g_argsExpanded, 0, sizeof(g_argsExpanded));
+	memset(t->args, 0, sizeof(t->args)); // backing buffer is t->buffer, which is mutated where spaces on arg boundaries are set to null char
+	memset(t->argsFrom, 0, sizeof(t->argsFrom)); // backing buffer is s, original unmutated string
+	if (t->argsExpanded) {
+		memset(t->argsExpanded, 0, MAX_ARGS * TOKENIZER_EXPANDED_ARG_LEN);
+	}
 
 	if (flags & TOKENIZER_EXPAND_EARLY) {
-		CMD_ExpandConstantsWithinString(s, g_buffer, sizeof(g_buffer) - 1);
+		CMD_ExpandConstantsWithinString(s, t->buffer, sizeof(t->buffer) - 1);
 	}
 	else {
-		strcpy_safe(g_buffer, s, sizeof(g_buffer));
+		strcpy_safe(t->buffer, s, sizeof(t->buffer));
 	}
 
 	if (flags & TOKENIZER_FORCE_SINGLE_ARGUMENT_MODE) {
-		g_args[g_numArgs] = g_buffer;
-		g_argsFrom[g_numArgs] = g_buffer;
+		t->args[t->numArgs] = t->buffer;
+		t->argsFrom[t->numArgs] = t->buffer;
+		t->numArgs = 1;
 		// some hack, but we fored to have only have one arg, so we can extend the string over array bondaries.
-		// probably better: introducing an union containing g_argsExpanded[][] and one sole string in the same memory area ...
-		CMD_ExpandConstantsWithinString(g_buffer,(char*)g_argsExpanded,sizeof(g_argsExpanded)-1);
-		g_numArgs = 1;
+		// probably better: introducing an union containing t->argsExpanded[][] and one sole string in the same memory area ...
+		if (TokenizerCtx_GetExpandBuffer(t, 0)) {
+			CMD_ExpandConstantsWithinString(t->buffer, (char*)t->argsExpanded, MAX_ARGS * TOKENIZER_EXPANDED_ARG_LEN - 1);
+		}
 		return;
 	}
-	p = g_buffer;
+	p = t->buffer;
 	// we need to rewrite this function and check it well with unit tests
 	if (*p == '"') {
 		goto quote;
 	}
-	g_args[g_numArgs] = p;
-	g_argsFrom[g_numArgs] = (s+(p-g_buffer));
-	g_numArgs++;
+	t->args[t->numArgs] = p;
+	t->argsFrom[t->numArgs] = (s+(p-t->buffer));
+	t->numArgs++;
 	while(*p != 0) {
 		if(isWhiteSpace(*p)) {
 			*p = 0;
@@ -379,24 +416,24 @@ void Tokenizer_TokenizeString(const char *s, int flags) {
 					p++;
 					goto quote;
 				}
-				g_args[g_numArgs] = p+1;
-				g_argsFrom[g_numArgs] = (s+((p+1)-g_buffer));
-				g_numArgs++;
+				t->args[t->numArgs] = p+1;
+				t->argsFrom[t->numArgs] = (s+((p+1)-t->buffer));
+				t->numArgs++;
 			}
 		}
 		//if(*p == ',') {
 		//	*p = 0;
-		//	g_args[g_numArgs] = p+1;
-		//	g_argsFrom[g_numArgs] = (s+((p+1)-g_buffer));
-		//	g_numArgs++;
+		//	t->args[t->numArgs] = p+1;
+		//	t->argsFrom[t->numArgs] = (s+((p+1)-t->buffer));
+		//	t->numArgs++;
 		//}
-		if(g_bAllowQuotes && *p == '"' && ((p <= g_buffer) || isWhiteSpace(p[-1]))) {
+		if(g_bAllowQuotes && *p == '"' && ((p <= t->buffer) || isWhiteSpace(p[-1]))) {
 quote:
 			*p = 0;
-			g_argsFrom[g_numArgs] = (s+((p+1)-g_buffer));
+			t->argsFrom[t->numArgs] = (s+((p+1)-t->buffer));
 			p++;
-			g_args[g_numArgs] = p;
-			g_numArgs++;
+			t->args[t->numArgs] = p;
+			t->numArgs++;
 			while(*p != 0) {
 				if (flags & TOKENIZER_ALLOW_ESCAPING_QUOTATIONS) {
 					if (*p == '"' && p[-1] != '\\') {
@@ -413,10 +450,10 @@ quote:
 				p++;
 			}
 			if (flags & TOKENIZER_ALLOW_ESCAPING_QUOTATIONS) {
-				expandQuotes(g_args[g_numArgs - 1]);
+				expandQuotes(t->args[t->numArgs - 1]);
 			}
 		}
-		if(g_numArgs>=MAX_ARGS) {
+		if(t->numArgs>=MAX_ARGS) {
 			ADDLOG_ERROR(LOG_FEATURE_CMD, "Too many args, skipped all after 32nd.");
 			break;
 		}
@@ -425,3 +462,160 @@ quote:
 
 
 }
+
+tokenizer_t *Tokenizer_SetCurrent(tokenizer_t *t) {
+	tokenizer_t *prev;
+
+	prev = g_tok;
+	if (t == 0) {
+		t = &g_defaultTokenizer;
+	}
+	g_tok = t;
+	return prev;
+}
+tokenizer_t *Tokenizer_Alloc() {
+	tokenizer_t *t;
+
+	t = (tokenizer_t*)malloc(sizeof(tokenizer_t));
+	if (t) {
+		t->numArgs = 0;
+		t->flags = 0;
+		t->argsExpanded = 0;
+	}
+	return t;
+}
+void Tokenizer_Free(tokenizer_t *t) {
+	if (t == 0) {
+		return;
+	}
+	if (t == g_tok) {
+		g_tok = &g_defaultTokenizer;
+	}
+	TokenizerCtx_ReleaseExpandBuffer(t);
+	free(t);
+}
+static void *Tokenizer_CurrentThread() {
+#if WINDOWS
+	// simulator runs commands from single thread
+	return 0;
+#elif PLATFORM_TXW81X
+	return csi_kernel_task_get_cur();
+#elif PLATFORM_RDA5981
+	return osThreadGetId();
+#else
+	return xTaskGetCurrentTaskHandle();
+#endif
+}
+static void Tokenizer_Lock() {
+	void *self;
+
+	if (g_tokenizerMutex == 0) {
+		// not created yet, only boot thread runs commands
+		g_tokenizerLocks++;
+		return;
+	}
+	self = Tokenizer_CurrentThread();
+	if (g_tokenizerLocks == 0 || g_tokenizerOwner != self) {
+		while (xSemaphoreTake(g_tokenizerMutex, 1000) != pdTRUE) {
+			ADDLOG_WARN(LOG_FEATURE_CMD, "Waiting for command running in other thread");
+		}
+		g_tokenizerOwner = self;
+	}
+	g_tokenizerLocks++;
+}
+static void Tokenizer_Unlock() {
+	g_tokenizerLocks--;
+	if (g_tokenizerLocks == 0 && g_tokenizerMutex != 0) {
+		g_tokenizerOwner = 0;
+		xSemaphoreGive(g_tokenizerMutex);
+	}
+}
+void Tokenizer_Init() {
+	if (g_tokenizerMutex == 0) {
+		g_tokenizerMutex = xSemaphoreCreateMutex();
+	}
+}
+tokenizer_t *Tokenizer_Enter() {
+	tokenizer_t *prev, *t;
+
+	Tokenizer_Lock();
+	prev = g_tok;
+	if (g_tokenizerDepth < TOKENIZER_POOL_SIZE) {
+		if (g_tokenizerPool[g_tokenizerDepth] == 0) {
+			g_tokenizerPool[g_tokenizerDepth] = Tokenizer_Alloc();
+		}
+		t = g_tokenizerPool[g_tokenizerDepth];
+	}
+	else {
+		t = Tokenizer_Alloc();
+	}
+	if (t == 0) {
+		// out of memory, command shares context of its caller like before
+		return prev;
+	}
+	t->numArgs = 0;
+	g_tokenizerDepth++;
+	g_tok = t;
+	return prev;
+}
+void Tokenizer_Leave(tokenizer_t *prev) {
+	tokenizer_t *t;
+
+	t = g_tok;
+	g_tok = prev;
+	if (t != prev) {
+		g_tokenizerDepth--;
+		if (g_tokenizerDepth >= TOKENIZER_POOL_SIZE) {
+			Tokenizer_Free(t);
+		}
+		else {
+			TokenizerCtx_ReleaseExpandBuffer(t);
+		}
+		if (g_tokenizerDepth == 0) {
+			// used by code that tokenizes outside of commands
+			TokenizerCtx_ReleaseExpandBuffer(&g_defaultTokenizer);
+		}
+	}
+	Tokenizer_Unlock();
+}
+
+// classic API, operates on current context
+bool Tokenizer_CheckArgsCountAndPrintWarning(const char *cmdString, int reqCount) {
+	return TokenizerCtx_CheckArgsCountAndPrintWarning(g_tok, cmdString, reqCount);
+}
+int Tokenizer_GetArgsCount() {
+	return TokenizerCtx_GetArgsCount(g_tok);
+}
+bool Tokenizer_IsArgInteger(int i) {
+	return TokenizerCtx_IsArgInteger(g_tok, i);
+}
+const char *Tokenizer_GetArgExpanding(int i) {
+	return TokenizerCtx_GetArgExpanding(g_tok, i);
+}
+const char *Tokenizer_GetArg(int i) {
+	return TokenizerCtx_GetArg(g_tok, i);
+}
+const char *Tokenizer_GetArgFrom(int i) {
+	return TokenizerCtx_GetArgFrom(g_tok, i);
+}
+int Tokenizer_GetArgIntegerRange(int i, int rangeMin, int rangeMax) {
+	return TokenizerCtx_GetArgIntegerRange(g_tok, i, rangeMin, rangeMax);
+}
+int Tokenizer_GetPin(int i, int def) {
+	return TokenizerCtx_GetPin(g_tok, i, def);
+}
+int Tokenizer_GetArgIntegerDefault(int i, int def) {
+	return TokenizerCtx_GetArgIntegerDefault(g_tok, i, def);
+}
+float Tokenizer_GetArgFloatDefault(int i, float def) {
+	return TokenizerCtx_GetArgFloatDefault(g_tok, i, def);
+}
+int Tokenizer_GetArgInteger(int i) {
+	return TokenizerCtx_GetArgInteger(g_tok, i);
+}
+float Tokenizer_GetArgFloat(int i) {
+	return TokenizerCtx_GetArgFloat(g_tok, i);
+}
+void Tokenizer_TokenizeString(const char *s, int flags) {
+	TokenizerCtx_TokenizeString(g_tok, s, flags);
+}
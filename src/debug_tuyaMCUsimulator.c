@@ -1,6 +1,7 @@
 #ifdef WINDOWS
 
 #include "new_common.h"
+#include "driver/drv_public.h"
 
 const char *dataToSimulate[] =
 {
@@ -121,19 +122,19 @@ void NewTuyaMCUSimulator_RunQuickTick(int deltaMS) {
 	}
 #if 0
 #elif 1
-	if (DRV_IsRunning("TuyaMCU") == 0) {
+	if (DRV_IsRunning(DRV_ID_TuyaMCU) == 0) {
 		CMD_ExecuteCommand("startDriver TuyaMCU", 0);
 		CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 6 RAW_TAC2121C_VCP", 0);
 	}
 #elif 0
-	if (DRV_IsRunning("TuyaMCU") == 0) {
+	if (DRV_IsRunning(DRV_ID_TuyaMCU) == 0) {
 		CMD_ExecuteCommand("startDriver TuyaMCU", 0);
 		CMD_ExecuteCommand("startDriver tmSensor ", 0);
 		CMD_ExecuteCommand("setChannelType 1 readonly", 0);
 		CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 1 val 1", 0);
 	}
 #else
-	if (DRV_IsRunning("TuyaMCU") == 0) {
+	if (DRV_IsRunning(DRV_ID_TuyaMCU) == 0) {
 		CMD_ExecuteCommand("startDriver TuyaMCU", 0);
 		CMD_ExecuteCommand("startDriver NTP", 0);
 		CMD_ExecuteCommand("setChannelType 1 toggle", 0);
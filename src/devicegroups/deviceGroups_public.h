@@ -11,6 +11,9 @@
 #define DGR_SHARE_DIMMER_SETTINGS	32
 #define DGR_SHARE_EVENT				64
 
+// message flags
+#define DGR_FLAG_ACK				8
+
 typedef struct dgrCallbacks_s {
 	void (*processPower)(int relayStates, byte relaysCount);
 	// they are both sent together by Tasmota devices
@@ -19,6 +22,11 @@ typedef struct dgrCallbacks_s {
 	void (*processLightFixedColor)(byte colorCode);
 	void (*processRGBCW)(byte *rgbcw);
 	int (*checkSequence)(uint16_t seq);
+	// ack of our message came, and message came that wants our ack
+	void (*processAck)(uint16_t seq);
+	void (*sendAck)(uint16_t seq);
+	// DGR_ITEM_COMMAND text, terminated
+	void (*processCommand)(const char *command);
 } dgrCallbacks_t;
 
 typedef struct dgrGroupDef_s {
@@ -38,6 +46,8 @@ int DGR_Quick_FormatPowerState(byte *buffer, int maxSize, const char *groupName,
 int DGR_Quick_FormatBrightness(byte *buffer, int maxSize, const char *groupName, uint16_t sequence, int flags, byte brightness);
 int DGR_Quick_FormatRGBCW(byte *buffer, int maxSize, const char *groupName, uint16_t sequence, int flags, byte r, byte g, byte b, byte c, byte w);
 int DGR_Quick_FormatFixedColor(byte *buffer, int maxSize, const char *groupName, uint16_t sequence, int flags, int color);
+int DGR_Quick_FormatCommand(byte *buffer, int maxSize, const char *groupName, uint16_t sequence, int flags, const char *command);
+int DGR_Quick_FormatAck(byte *buffer, int maxSize, const char *groupName, uint16_t sequence);
 
 
 
@@ -39,10 +39,16 @@ int DGR_Parse(const byte *data, int len, dgrDevice_t *dev, struct sockaddr *addr
 	sequence = MSG_ReadU16(&msg);
 	flags = MSG_ReadU16(&msg);
 
-	// ack, not supported yet
-	if(flags == 8) {
+	if(flags == DGR_FLAG_ACK) {
+		if(dev->cbs.processAck) {
+			dev->cbs.processAck(sequence);
+		}
 		return 1;
 	}
+	// also for duplicate, our ack of it could be lost
+	if(dev->cbs.sendAck) {
+		dev->cbs.sendAck(sequence);
+	}
 
 	if(dev->cbs.checkSequence(sequence)) {
 		addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_DGR,"DGR ignoring message from duplicate or older sequence %i",sequence);
@@ -120,7 +126,20 @@ int DGR_Parse(const byte *data, int len, dgrDevice_t *dev, struct sockaddr *addr
 			// Gives sLen 4
 			if(type == DGR_ITEM_COMMAND) {
 				const char *cmd = MSG_GetStringPointerAtCurrentPosition(&msg);
-				addLogAdv(LOG_DEBUG, LOG_FEATURE_DGR,"DGR_ITEM_COMMAND: %s",cmd);
+				char tmp[128];
+				// copied, terminator of sender is not trusted
+				i = sLen < sizeof(tmp) ? sLen : sizeof(tmp) - 1;
+				if(i > msg.totalSize - msg.position) {
+					i = msg.totalSize - msg.position;
+				}
+				memcpy(tmp, cmd, i);
+				tmp[i] = 0;
+				addLogAdv(LOG_DEBUG, LOG_FEATURE_DGR,"DGR_ITEM_COMMAND: %s",tmp);
+				if(dev && dev->cbs.processCommand) {
+					if(DGR_IsItemInMask(type, dev->gr.devGroupShare_In)) {
+						dev->cbs.processCommand(tmp);
+					}
+				}
 			}
 			MSG_SkipBytes(&msg,sLen);
 		} else if(type == DGR_ITEM_LIGHT_CHANNELS) {
@@ -15,7 +15,7 @@ unsigned int DGR_GetMaskForItem(byte item)
 		mask = DGR_SHARE_LIGHT_FADE;
 	else  if (item == DGR_ITEM_BRI_PRESET_LOW || item == DGR_ITEM_BRI_PRESET_HIGH)
 		mask = DGR_SHARE_DIMMER_SETTINGS;
-	else if (item == DGR_ITEM_EVENT)
+	else if (item == DGR_ITEM_EVENT || item == DGR_ITEM_COMMAND)
 		mask = DGR_SHARE_EVENT;
 	return mask;
 }
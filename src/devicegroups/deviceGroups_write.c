@@ -61,6 +61,12 @@ void DGR_AppendDimmer(bitMessage_t *msg, byte dimmValue) {
 	MSG_WriteByte(msg,DGR_ITEM_LIGHT_BRI);
 	MSG_WriteByte(msg,dimmValue);
 }
+// string with its terminator, as Tasmota sends it
+void DGR_AppendCommand(bitMessage_t *msg, const char *command) {
+	MSG_WriteByte(msg, DGR_ITEM_COMMAND);
+	MSG_WriteByte(msg, strlen(command) + 1);
+	MSG_WriteString(msg, command);
+}
 void DGR_Finish(bitMessage_t *msg) {
 	MSG_WriteByte(msg,DGR_ITEM_EOL);
 
@@ -102,8 +108,23 @@ int DGR_Quick_FormatFixedColor(byte *buffer, int maxSize, const char *groupName,
 	DGR_Finish(&msg);
 	return msg.position;
 }
+int DGR_Quick_FormatCommand(byte *buffer, int maxSize, const char *groupName, uint16_t sequence, int flags, const char *command) {
+	bitMessage_t msg;
+	MSG_BeginWriting(&msg, buffer, maxSize);
+	DGR_BeginWriting(&msg, groupName, sequence, flags);
+	DGR_AppendCommand(&msg, command);
+	DGR_Finish(&msg);
+	return msg.position;
+}
 
 
 
 
 
+// Tasmota ack is just header with sequence of acked message, no items
+int DGR_Quick_FormatAck(byte *buffer, int maxSize, const char *groupName, uint16_t sequence) {
+	bitMessage_t msg;
+	MSG_BeginWriting(&msg, buffer, maxSize);
+	DGR_BeginWriting(&msg, groupName, sequence, DGR_FLAG_ACK);
+	return msg.position;
+}
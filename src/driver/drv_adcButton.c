@@ -68,7 +68,7 @@ void DRV_ADCButtonDoMeasurement() {
 	if (adcPin == -1) {
 		return;
 	}
-	adcValue = HAL_ADC_Read(adcPin);
+	adcValue = ADCSampler_Read(adcPin);
 
 	newButton = chooseButton(adcValue);
 
@@ -0,0 +1,49 @@
+#include "../new_common.h"
+#include "../hal/hal_adc.h"
+#include "drv_public.h"
+
+// One ADC reading made of a short burst, so a single noisy conversion
+// (WiFi TX, relay switching) does not end up in a channel. Burst goes
+// through median of 3, which drops lone spikes, and medians are averaged,
+// which lowers noise before value is used or decimated by ADCSmoother.
+// Beken takes the burst from one saradc run, other platforms loop reads.
+
+#define ADCSAMPLER_BURST	8
+
+// rounded mean of sliding medians of 3, plain mean for short bursts
+int ADCSampler_Filter(const unsigned short *s, int n) {
+	int i, a, b, c, med, sum = 0;
+
+	if (n <= 0) {
+		return 0;
+	}
+	if (n < 3) {
+		for (i = 0; i < n; i++) {
+			sum += s[i];
+		}
+		return (sum + n / 2) / n;
+	}
+	for (i = 1; i < n - 1; i++) {
+		a = s[i - 1];
+		b = s[i];
+		c = s[i + 1];
+		if (a > b) {
+			med = a; a = b; b = med;
+		}
+		// a <= b, median is b clamped to a..c
+		med = c < a ? a : (c > b ? b : c);
+		sum += med;
+	}
+	return (sum + (n - 2) / 2) / (n - 2);
+}
+// filtered reading of pin, -1 when ADC gave nothing
+int ADCSampler_Read(int pinNumber) {
+	unsigned short burst[ADCSAMPLER_BURST];
+	int n;
+
+	n = HAL_ADC_ReadBurst(pinNumber, burst, ADCSAMPLER_BURST);
+	if (n <= 0) {
+		return -1;
+	}
+	return ADCSampler_Filter(burst, n);
+}
@@ -85,7 +85,7 @@ void DRV_ADCSmoother_Init() {
 	CMD_RegisterCommand("ADCSmoother", Cmd_SetupADCSmoother, NULL);
 }
 void DRV_ADCSmootherDoSmooth() {
-	int raw = HAL_ADC_Read(g_adcPin);
+	int raw = ADCSampler_Read(g_adcPin);
 	ADCSmoother_AppendSample(raw);
 	int smoothed = ADCSmoother_Sample();
 	int lowHigh = smoothed > g_margin;
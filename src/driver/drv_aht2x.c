@@ -5,11 +5,14 @@
 
 #define AHT2X_I2C_ADDR (0x38 << 1)
 
-static byte g_aht_secondsUntilNextMeasurement = 1, g_aht_secondsBetweenMeasurements = 10,
+static byte g_aht_secondsBetweenMeasurements = 10,
 	max_retries = 20, channel_temp = 0, channel_humid = 0;
 static float g_temp = 0.0, g_humid = 0.0, g_calTemp = 0.0, g_calHum = 0.0;
 static softI2C_t g_softI2C;
 static bool isWorking = false;
+// reads of busy sensor since measurement was triggered
+static byte g_aht_polls = 0;
+static int g_ahtSensor = -1;
 
 void AHT2X_SoftReset()
 {
@@ -61,43 +64,30 @@ void AHT2X_Initialization()
 
 void AHT2X_StopDriver()
 {
+	SensorAcq_Unregister(g_ahtSensor);
+	g_ahtSensor = -1;
+	I2CSched_Cancel(&g_softI2C);
 	AHT2X_SoftReset();
 }
 
-void AHT2X_Measure()
+// result of measurement triggered by AHT2X_Measure, polled while busy
+static void AHT2X_ReadMeasurement(softI2C_t *bus)
 {
 	uint8_t data[6] = { 0, };
 
-	Soft_I2C_Start(&g_softI2C, AHT2X_I2C_ADDR);
-	Soft_I2C_WriteByte(&g_softI2C, AHT2X_CMD_TMS);
-	Soft_I2C_WriteByte(&g_softI2C, AHT2X_DAT_TMS1);
-	Soft_I2C_WriteByte(&g_softI2C, AHT2X_DAT_TMS2);
+	Soft_I2C_Start(&g_softI2C, AHT2X_I2C_ADDR | 1);
+	Soft_I2C_ReadBytes(&g_softI2C, data, 6);
 	Soft_I2C_Stop(&g_softI2C);
-
-	bool ready = false;
-
-	rtos_delay_milliseconds(80);
-
-	for(uint8_t i = 0; i < 10; i++)
+	if((data[0] & AHT2X_DAT_BUSY) == AHT2X_DAT_BUSY)
 	{
-		Soft_I2C_Start(&g_softI2C, AHT2X_I2C_ADDR | 1);
-		Soft_I2C_ReadBytes(&g_softI2C, data, 6);
-		Soft_I2C_Stop(&g_softI2C);
-		if((data[0] & AHT2X_DAT_BUSY) != AHT2X_DAT_BUSY)
+		if(g_aht_polls >= 10)
 		{
-			ready = true;
-			break;
-		}
-		else
-		{
-			ADDLOG_DEBUG(LOG_FEATURE_SENSOR, "AHT2X_Measure: Sensor is busy, waiting... (%ims)", i * 20);
-			rtos_delay_milliseconds(20);
+			ADDLOG_INFO(LOG_FEATURE_SENSOR, "AHT2X_Measure: Measurements reading timed out.");
+			return;
 		}
-	}
-
-	if(!ready)
-	{
-		ADDLOG_INFO(LOG_FEATURE_SENSOR, "AHT2X_Measure: Measurements reading timed out.");
+		ADDLOG_DEBUG(LOG_FEATURE_SENSOR, "AHT2X_Measure: Sensor is busy, waiting... (%ims)", g_aht_polls * 20);
+		g_aht_polls++;
+		I2CSched_Add(&g_softI2C, 20, AHT2X_ReadMeasurement);
 		return;
 	}
 
@@ -115,16 +105,33 @@ void AHT2X_Measure()
 
 	if(channel_temp > -1)
 	{
-		CHANNEL_Set(channel_temp, (int)(g_temp * 10), 0);
+		SensorAcq_Push(g_ahtSensor, channel_temp, (int)(g_temp * 10));
 	}
 	if(channel_humid > -1)
 	{
-		CHANNEL_Set(channel_humid, (int)(g_humid), 0);
+		SensorAcq_Push(g_ahtSensor, channel_humid, (int)(g_humid));
 	}
 
 	ADDLOG_INFO(LOG_FEATURE_SENSOR, "AHT2X_Measure: Temperature:%fC Humidity:%f%%", g_temp, g_humid);
 }
 
+void AHT2X_Measure()
+{
+	Soft_I2C_Start(&g_softI2C, AHT2X_I2C_ADDR);
+	Soft_I2C_WriteByte(&g_softI2C, AHT2X_CMD_TMS);
+	Soft_I2C_WriteByte(&g_softI2C, AHT2X_DAT_TMS1);
+	Soft_I2C_WriteByte(&g_softI2C, AHT2X_DAT_TMS2);
+	Soft_I2C_Stop(&g_softI2C);
+
+	g_aht_polls = 0;
+	I2CSched_Add(&g_softI2C, 80, AHT2X_ReadMeasurement);
+}
+
+static void AHT2X_Poll()
+{
+	if(isWorking) AHT2X_Measure();
+}
+
 commandResult_t AHT2X_Calibrate(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
 	Tokenizer_TokenizeString(args, TOKENIZER_ALLOW_QUOTES | TOKENIZER_DONT_EXPAND);
@@ -158,6 +165,7 @@ commandResult_t AHT2X_Cycle(const void* context, const char* cmd, const char* ar
 	else
 	{
 		g_aht_secondsBetweenMeasurements = seconds;
+		SensorAcq_SetInterval(g_ahtSensor, seconds * 1000);
 	}
 
 	ADDLOG_INFO(LOG_FEATURE_CMD, "AHT2X_Cycle: Measurement will run every %i seconds.", g_aht_secondsBetweenMeasurements);
@@ -167,17 +175,13 @@ commandResult_t AHT2X_Cycle(const void* context, const char* cmd, const char* ar
 
 commandResult_t AHT2X_Force(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
-	g_aht_secondsUntilNextMeasurement = g_aht_secondsBetweenMeasurements;
-
-	AHT2X_Measure();
+	SensorAcq_PollNow(g_ahtSensor);
 
 	return CMD_RES_OK;
 }
 
 commandResult_t AHT2X_Reinit(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
-	g_aht_secondsUntilNextMeasurement = g_aht_secondsBetweenMeasurements;
-
 	AHT2X_Initialization();
 
 	return CMD_RES_OK;
@@ -195,6 +199,7 @@ void AHT2X_Init()
 	rtos_delay_milliseconds(100);
 
 	AHT2X_Initialization();
+	g_ahtSensor = SensorAcq_Register("AHT2X", g_aht_secondsBetweenMeasurements * 1000, AHT2X_Poll);
 
 	//cmddetail:{"name":"AHT2X_Calibrate","args":"[DeltaTemp][DeltaHumidity]",
 	//cmddetail:"descr":"Calibrate the AHT2X Sensor as Tolerance is +/-2 degrees C.",
@@ -218,19 +223,6 @@ void AHT2X_Init()
 	CMD_RegisterCommand("AHT2X_Reinit", AHT2X_Reinit, NULL);
 }
 
-void AHT2X_OnEverySecond()
-{
-	if(g_aht_secondsUntilNextMeasurement <= 0)
-	{
-		if(isWorking) AHT2X_Measure();
-		g_aht_secondsUntilNextMeasurement = g_aht_secondsBetweenMeasurements;
-	}
-	if(g_aht_secondsUntilNextMeasurement > 0)
-	{
-		g_aht_secondsUntilNextMeasurement--;
-	}
-}
-
 void AHT2X_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState)
 {
 	if (bPreState)
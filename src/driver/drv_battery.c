@@ -11,6 +11,7 @@
 #include "../hal/hal_pins.h"
 #include "../hal/hal_adc.h"
 #include "drv_battery.h"
+#include "../quicktick.h"
 
 static int g_pin_adc = 0, channel_adc = 0, g_pin_rel = 0, g_battcycle = 1, g_battcycleref = 10;
 //static int channel_rel = 0;
@@ -18,44 +19,35 @@ static float g_battvoltage = 0.0, g_battlevel = 0.0;
 static int g_lastbattvoltage = 0, g_lastbattlevel = 0;
 static float g_vref = 2400, g_vdivider = 2.29, g_maxbatt = 3000, g_minbatt = 2000, g_adcbits = 4096;
 
-static void Batt_Measure() {
-	//this command has only been tested on CBU
+// divider relay is switched on and reading is taken on a later quick
+// tick, so nothing blocks while it settles
+#define BATT_SETTLE_MS		10
+// bursts averaged into one reading, gives resolution below one ADC step
+#define BATT_OVERSAMPLE		4
+
+static int g_battWriteVal = 1;
+static bool g_battSettling = false;
+static unsigned int g_battSettleAt;
+
+static void Batt_Finish() {
 	float batt_ref, batt_res, vref;
-	int writeVal = 1;
-	ADDLOG_INFO(LOG_FEATURE_DRV, "DRV_BATTERY : Measure Battery volt en perc");
-	g_pin_adc = PIN_FindPinIndexForRole(IOR_BAT_ADC, g_pin_adc);
-	if (PIN_FindPinIndexForRole(IOR_BAT_Relay, -1) == -1 && PIN_FindPinIndexForRole(IOR_BAT_Relay_n, -1) == -1) {
-		g_vdivider = 1;
-	}
-	// if divider equal to 1 then no need for relay activation
-	if (g_vdivider > 1) {
-		g_pin_rel = PIN_FindPinIndexForRole(IOR_BAT_Relay, -1);
-		if (g_pin_rel == -1) {
-			g_pin_rel = PIN_FindPinIndexForRole(IOR_BAT_Relay_n, -1);
-			writeVal = 0;
+	int i, v, n = 0;
+
+	g_battvoltage = 0;
+	for (i = 0; i < BATT_OVERSAMPLE; i++) {
+		v = ADCSampler_Read(g_pin_adc);
+		if (v >= 0) {
+			g_battvoltage += v;
+			n++;
 		}
-		//if(g_pin_rel>0) {
-		//channel_rel = g_cfg.pins.channels[g_pin_rel];
-		//}
 	}
-	// should be already initialized in pins
-	//HAL_ADC_Init(g_pin_adc);
-	g_battlevel = HAL_ADC_Read(g_pin_adc);
-	if (g_battlevel < 1024) {
-		ADDLOG_INFO(LOG_FEATURE_DRV, "DRV_BATTERY : ADC Value low device not on battery");
-	}
-	if (g_vdivider > 1) {
-		//CHANNEL_Set(channel_rel, 1, 0);
-		if (g_pin_rel > 0) {
-			HAL_PIN_SetOutputValue(g_pin_rel, writeVal);
-		}
-		rtos_delay_milliseconds(10);
+	if (n) {
+		g_battvoltage /= n;
 	}
-	g_battvoltage = HAL_ADC_Read(g_pin_adc);
 	ADDLOG_DEBUG(LOG_FEATURE_DRV, "DRV_BATTERY : ADC binary Measurement : %f and channel %i", g_battvoltage, channel_adc);
 	if (g_vdivider > 1) {
 		if (g_pin_rel > 0) {
-			HAL_PIN_SetOutputValue(g_pin_rel, !writeVal);
+			HAL_PIN_SetOutputValue(g_pin_rel, !g_battWriteVal);
 		}
 		//CHANNEL_Set(channel_rel, 0, 0);
 	}
@@ -75,15 +67,76 @@ static void Batt_Measure() {
 		g_battlevel = 100;
 
 #if ENABLE_MQTT
-	MQTT_PublishMain_StringInt("voltage", (int)g_battvoltage, 0);
-	MQTT_PublishMain_StringInt("battery", (int)g_battlevel, 0);
+	MQTT_PublishMain_StringInt("voltage", (int)g_battvoltage, OBK_PUBLISH_FLAG_DEDUP);
+	MQTT_PublishMain_StringInt("battery", (int)g_battlevel, OBK_PUBLISH_FLAG_DEDUP);
 #endif
 	g_lastbattlevel = (int)g_battlevel;
 	g_lastbattvoltage = (int)g_battvoltage;
 	ADDLOG_INFO(LOG_FEATURE_DRV, "DRV_BATTERY : battery voltage : %f and percentage %f%%", g_battvoltage, g_battlevel);
+	DRV_MarkIndexDirty(Batt_AppendInformationToHTTPIndexPage);
+}
+
+static void Batt_Measure() {
+	//this command has only been tested on CBU
+	if (g_battSettling) {
+		return;
+	}
+	g_battWriteVal = 1;
+	ADDLOG_INFO(LOG_FEATURE_DRV, "DRV_BATTERY : Measure Battery volt en perc");
+	g_pin_adc = PIN_FindPinIndexForRole(IOR_BAT_ADC, g_pin_adc);
+	if (PIN_FindPinIndexForRole(IOR_BAT_Relay, -1) == -1 && PIN_FindPinIndexForRole(IOR_BAT_Relay_n, -1) == -1) {
+		g_vdivider = 1;
+	}
+	// if divider equal to 1 then no need for relay activation
+	if (g_vdivider > 1) {
+		g_pin_rel = PIN_FindPinIndexForRole(IOR_BAT_Relay, -1);
+		if (g_pin_rel == -1) {
+			g_pin_rel = PIN_FindPinIndexForRole(IOR_BAT_Relay_n, -1);
+			g_battWriteVal = 0;
+		}
+		//if(g_pin_rel>0) {
+		//channel_rel = g_cfg.pins.channels[g_pin_rel];
+		//}
+	}
+	// should be already initialized in pins
+	//HAL_ADC_Init(g_pin_adc);
+	g_battlevel = ADCSampler_Read(g_pin_adc);
+	DRV_MarkIndexDirty(Batt_AppendInformationToHTTPIndexPage);
+	if (g_battlevel < 1024) {
+		ADDLOG_INFO(LOG_FEATURE_DRV, "DRV_BATTERY : ADC Value low device not on battery");
+	}
+	if (g_vdivider > 1) {
+		//CHANNEL_Set(channel_rel, 1, 0);
+		if (g_pin_rel > 0) {
+			HAL_PIN_SetOutputValue(g_pin_rel, g_battWriteVal);
+		}
+		g_battSettleAt = g_timeMs + BATT_SETTLE_MS;
+		g_battSettling = true;
+		return;
+	}
+	Batt_Finish();
+}
+void Batt_RunQuickTick() {
+	if (g_battSettling && (int)(g_timeMs - g_battSettleAt) >= 0) {
+		g_battSettling = false;
+		Batt_Finish();
+	}
+}
+int Batt_GetTimeToNextWakeMS() {
+	int left;
+
+	if (!g_battSettling) {
+		return -1;
+	}
+	left = (int)(g_battSettleAt - g_timeMs);
+	return left > 0 ? left : 0;
 }
 void Simulator_Force_Batt_Measure() {
 	Batt_Measure();
+	if (g_battSettling) {
+		g_battSettling = false;
+		Batt_Finish();
+	}
 }
 
 int Battery_lastreading(int type)
@@ -160,6 +213,7 @@ void Batt_Init() {
 	//cmddetail:"examples":"Battery_cycle 60"}
 	CMD_RegisterCommand("Battery_cycle", Battery_cycle, NULL);
 
+	DRV_MarkIndexDirty(Batt_AppendInformationToHTTPIndexPage);
 }
 
 void Batt_OnEverySecond() {
@@ -178,7 +232,12 @@ void Batt_OnEverySecond() {
 
 
 void Batt_StopDriver() {
-
+	if (g_battSettling) {
+		g_battSettling = false;
+		if (g_pin_rel > 0) {
+			HAL_PIN_SetOutputValue(g_pin_rel, !g_battWriteVal);
+		}
+	}
 }
 void Batt_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState)
 {
@@ -10,26 +10,60 @@
 #include "../hal/hal_adc.h"
 #include "../mqtt/new_mqtt.h"
 
+// Beken partition table is kept in flash as records of "01PE" magic,
+// names, offset and length. Flash is read in 34 byte records, 32 bytes
+// of data and CRC16, and data of them is scanned as one stream, few
+// sections per QuickTick within time budget. Last BKPART_TAIL bytes of
+// each section are kept in front of next one, so magic or record split
+// between two reads is still parsed whole. Found records are cached for
+// /api/partitions and scan stops after one pass over flash.
+
+// data bytes kept from previous section, longest record (fal64) less one
+#define BKPART_TAIL				63
+#define BKPART_MAX_FOUND		16
+#define BKPART_BUDGET_US		1000
+// bound for frame when clock is too coarse to see budget pass
+#define BKPART_MAX_SECTIONS		4
+
 static const char *search_magic = "01PE";
 static int cur_adr = 0x0; 
 static int start_adr = 0x0; 
 static int max_adr = 0x200000; 
-static int read_len = 0x1000;
 static int record_size = 34;
 static int data_size = 32;
-static int records_per_chunk = 64;
-static int raw_chunk = 34 * 64; // 2176
+static int records_per_chunk = 16;
+static int raw_chunk = 34 * 16; // 544
 static byte *g_buf;
 static int magic_len = 0;
 static int crc_ok = 0;
 static int crc_error = 0;
+// collapsed data in g_buf, stream offset of its first byte and next
+// position to look for magic at
+static int g_len = 0;
+static int g_base = 0;
+static int g_scanPos = 0;
+static bool g_bDone = false;
+static PartitionRecord g_found[BKPART_MAX_FOUND];
+static int g_numFound = 0;
 
 void BKPartitions_Init() {
 	magic_len = (int)strlen(search_magic);
-	g_buf = (byte*)malloc(raw_chunk);
+	if (g_buf == 0) {
+		g_buf = (byte*)malloc(BKPART_TAIL + raw_chunk);
+	}
 	cur_adr = start_adr;
+	g_len = 0;
+	g_base = 0;
+	g_scanPos = 0;
+	g_bDone = false;
+	g_numFound = 0;
+	crc_ok = 0;
+	crc_error = 0;
+}
+void BKPartitions_Stop() {
+	free(g_buf);
+	g_buf = 0;
 }
-
 
 static int is_position_in_data_zone(int abs_offset) {
 	int mod = abs_offset % 34;
@@ -61,13 +95,13 @@ int block_crc_check(const uint8_t *data, size_t len, const uint8_t *crc_bytes)
 	uint16_t calc = crc16(data, 0, len, 0xffff);
 	return (stored == calc);
 }
-int ReadSection(int ofs) {
+int ReadSection(byte *dst, int ofs) {
 	int to_read = raw_chunk;
 	if (ofs + to_read > max_adr)
 		to_read = max_adr - ofs;
 	if (to_read <= 0) return 0;
 
-	int r = HAL_FlashRead((char*)g_buf, to_read, ofs);
+	int r = HAL_FlashRead((char*)dst, to_read, ofs);
 	r = to_read;
 	if (r <= 0) {
 		return 0;
@@ -80,11 +114,11 @@ int ReadSection(int ofs) {
 			break;
 
 		// Compute CRC of the 32 bytes of data
-		uint16_t crc = crc16(g_buf, base, base + data_size, 0xffff);
+		uint16_t crc = crc16(dst, base, base + data_size, 0xffff);
 
 		// Read stored CRC (little-endian)
-		uint16_t stored = g_buf[base + data_size + 1] |
-			(g_buf[base + data_size ] << 8);
+		uint16_t stored = dst[base + data_size + 1] |
+			(dst[base + data_size ] << 8);
 
 		if (crc != stored) {
 			//addLogAdv(LOG_INFO, LOG_FEATURE_CMD,"Invalid CRC at %i",base);
@@ -95,20 +129,11 @@ int ReadSection(int ofs) {
 			crc_ok++;
 		}
 		// CRC OK → copy 32 bytes to the output position
-		memmove(&g_buf[realSize], &g_buf[base], data_size);
+		memmove(&dst[realSize], &dst[base], data_size);
 		realSize += data_size;
 	}
 	return realSize;
 }
-typedef struct {
-	char name[25];
-	char flash[17];
-	uint32_t offset;
-	uint32_t length;
-	uint32_t extra;
-	char layout[8]; // "fal64" or "fal48"
-} PartitionRecord;
-
 static int is_printable_str(const char *s) {
 	if (!s || !*s) return 0;
 	for (int i = 0; s[i]; i++) {
@@ -160,48 +185,122 @@ static int parse_fal48(byte *buf, int pos, PartitionRecord *out) {
 	return is_valid_pr(out);
 }
 
-void ReadPartition(int ofs) {
-	int realSize = ReadSection(ofs);
-	int scan_len = realSize - magic_len;
-
-	for (int pos = 0; pos <= scan_len; pos++) {
-		if (memcmp(&g_buf[pos], search_magic, magic_len) != 0) continue;
+static unsigned int BKPartitions_TimeUs() {
+#if ENABLE_SYSPERF
+	return SYSPERF_GetTimeUs();
+#else
+	return (unsigned int)xTaskGetTickCount() * portTICK_PERIOD_MS * 1000;
+#endif
+}
+static void BKPartitions_Parse(int pos) {
+	PartitionRecord rec;
+	int q, ok;
 
-		PartitionRecord rec;
-		if (
-			parse_fal64(g_buf, pos, &rec) || 
-			parse_fal48(g_buf, pos, &rec)) {
-			unsigned int abs_off = ofs + pos;
-			addLogAdv(LOG_INFO, LOG_FEATURE_CMD,
-				"Partition found at 0x%X: %s flash=%s offset=0x%X size=%u extra=%u layout=%s\n",
-				abs_off, rec.name, rec.flash, rec.offset, rec.length, rec.extra, rec.layout);
-		}
+	memset(&rec, 0, sizeof(rec));
+	// near end of flash record may be shorter than layout
+	ok = (pos + 64 <= g_len && parse_fal64(g_buf, pos, &rec))
+		|| (pos + 48 <= g_len && parse_fal48(g_buf, pos, &rec));
+	if (!ok) {
+		return;
+	}
+	// back from data stream to flash address
+	q = g_base + pos;
+	rec.at = start_adr + (q / data_size) * record_size + q % data_size;
+	addLogAdv(LOG_INFO, LOG_FEATURE_CMD,
+		"Partition found at 0x%X: %s flash=%s offset=0x%X size=%u extra=%u layout=%s\n",
+		rec.at, rec.name, rec.flash, rec.offset, rec.length, rec.extra, rec.layout);
+	if (g_numFound < BKPART_MAX_FOUND) {
+		g_found[g_numFound++] = rec;
 	}
 }
+// reads next section after unscanned tail of previous one
+static void BKPartitions_NextSection() {
+	int keep = g_len - g_scanPos;
 
+	memmove(g_buf, g_buf + g_scanPos, keep);
+	g_base += g_scanPos;
+	g_scanPos = 0;
+	g_len = keep + ReadSection(g_buf + keep, cur_adr);
+	cur_adr += raw_chunk;
+}
+static void BKPartitions_ScanSection() {
+	byte *p;
+	int last;
 
-void BKPartitions_QuickFrame() {
-	if (!g_buf) return;
+	// magic near end is looked at with next section, unless there is none
 	if (cur_adr >= max_adr) {
-		cur_adr = start_adr;
+		last = g_len - magic_len;
 	}
-
-	int realSize = ReadSection(cur_adr);
-	int scan_len = realSize - magic_len;
-	for (int pos = 0; pos <= scan_len; pos++) {
-		if (memcmp(&g_buf[pos], search_magic, magic_len) == 0) {
-			unsigned int abs_off = (unsigned int)(cur_adr + pos);
-			addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "AS: found magic at 0x%X\n", abs_off);
-			// find nearest first record 
-			int nearest = (abs_off/ 34) * 34;
-			addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "AS: nearest at 0x%X\n", nearest);
-			ReadPartition(nearest);
+	else {
+		last = g_len - BKPART_TAIL - 1;
+	}
+	while (g_scanPos <= last) {
+		p = (byte*)memchr(g_buf + g_scanPos, search_magic[0], last + 1 - g_scanPos);
+		if (p == 0) {
+			g_scanPos = last + 1;
+			break;
+		}
+		g_scanPos = (int)(p - g_buf);
+		if (memcmp(p, search_magic, magic_len) == 0) {
+			BKPartitions_Parse(g_scanPos);
 		}
+		g_scanPos++;
 	}
+}
+void BKPartitions_QuickFrame() {
+	unsigned int start;
+	int i;
 
-	//printf("At %i\n", cur_adr);
-
-	// move by one record less
-	cur_adr += record_size * (records_per_chunk - 1);
+	if (!g_buf || g_bDone) return;
+	start = BKPartitions_TimeUs();
+	for (i = 0; i < BKPART_MAX_SECTIONS; i++) {
+		if (cur_adr >= max_adr) {
+			g_bDone = true;
+			addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Partition scan done, %i found, CRC ok %i, bad %i",
+				g_numFound, crc_ok, crc_error);
+			return;
+		}
+		BKPartitions_NextSection();
+		BKPartitions_ScanSection();
+		if (BKPartitions_TimeUs() - start >= BKPART_BUDGET_US) {
+			break;
+		}
+	}
+}
+int BKPartitions_GetFound(const PartitionRecord **out) {
+	*out = g_found;
+	return g_numFound;
 }
+bool BKPartitions_IsDone() {
+	return g_bDone;
+}
+// cached result of scan, it is not repeated for request
+int BKPartitions_HTTPQuery(http_request_t *request) {
+	jsonWriter_t w;
+	int i;
 
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Bool(&w, "done", g_bDone);
+	JSONW_Int(&w, "scanned", cur_adr - start_adr);
+	JSONW_Int(&w, "size", max_adr - start_adr);
+	JSONW_Int(&w, "crcOk", crc_ok);
+	JSONW_Int(&w, "crcBad", crc_error);
+	JSONW_StartArray(&w, "partitions");
+	for (i = 0; i < g_numFound; i++) {
+		JSONW_StartObject(&w, NULL);
+		JSONW_Int(&w, "at", g_found[i].at);
+		JSONW_String(&w, "name", g_found[i].name);
+		JSONW_String(&w, "flash", g_found[i].flash);
+		JSONW_Int(&w, "offset", g_found[i].offset);
+		JSONW_Int(&w, "length", g_found[i].length);
+		JSONW_Int(&w, "extra", g_found[i].extra);
+		JSONW_String(&w, "layout", g_found[i].layout);
+		JSONW_EndObject(&w);
+	}
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
@@ -6,12 +6,14 @@
 #if ENABLE_DRIVER_BL0942 
 
 #include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "../logging/logging.h"
 #include "../new_cfg.h"
 #include "../new_pins.h"
 #include "../cmnds/cmd_public.h"
+#include "../quicktick.h"
 #include "drv_bl_shared.h"
 #include "drv_pwrCal.h"
 #include "drv_spi.h"
@@ -27,10 +29,9 @@ static unsigned short bl0942_opts= 0;
 #define BL0942_OPTBIT1_UART2 2
 #endif
 #define BL0942_DEVICE_INDEX_0 0
-#define BL0942_DEVICE_INDEX_1 1
 
 #define BL0942_UART_RECEIVE_BUFFER_SIZE 256
-#define BL0942_UART_ADDR 0 // 0 - 3
+#define BL0942_UART_ADDR 0 // 0 - 3, used when no address mask is given
 #define BL0942_UART_CMD_READ(addr) (0x58 | addr)
 #define BL0942_UART_CMD_WRITE(addr) (0xA8 | addr)
 #define BL0942_UART_REG_PACKET 0xAA
@@ -62,6 +63,20 @@ static unsigned short bl0942_opts= 0;
 
 #define CF_CNT_INVALID (1 << 31)
 
+// Devices sharing one UART, polled one after another. Each sets its
+// address with A1/A2 pins, reply checksum is seeded with that address.
+#define BL0942_MAX_DEVICES 4
+#if ENABLE_BL_TWIN
+#define BL0942_MAX_BUSES 2
+#else
+#define BL0942_MAX_BUSES 1
+#endif
+#define BL0942_DEFAULT_POLL_MS 1000
+#define BL0942_MIN_POLL_MS 50
+#define BL0942_RECV_POLL_MS 10
+// held reading of silent device is dropped after that many polls
+#define BL0942_MAX_MISSED 3
+
 typedef struct {
     uint32_t i_rms;
     uint32_t v_rms;
@@ -70,116 +85,107 @@ typedef struct {
     uint32_t freq;
 } bl0942_data_t;
 
-#if ENABLE_BL_TWIN
-static uint32_t PrevCfCnt[2] = {CF_CNT_INVALID, CF_CNT_INVALID};
-#else
-static uint32_t PrevCfCnt[1] = {CF_CNT_INVALID};
-#endif
+typedef struct {
+    float voltage;
+    float current;
+    float power;
+    float frequency;
+    float energyWh;
+} bl0942_reading_t;
+
+typedef struct {
+    byte port;
+    byte addr;
+    // sensor dataset of drv_bl_shared, devices past the last one are
+    // merged into it
+    byte dataset;
+    uint32_t prevCfCnt;
+    // readings since last update of shared module, polls can be faster
+    float sumVoltage;
+    float sumCurrent;
+    float sumPower;
+    float frequency;
+    float energyWh;
+    int samples;
+    // last mean, kept for sum of merged devices while others report
+    bl0942_reading_t held;
+    bool bHeld;
+    byte missed;
+    unsigned int timeouts;
+    unsigned int badPackets;
+} bl0942_dev_t;
+
+typedef struct {
+    byte port;
+    byte firstDev;
+    byte numDevs;
+    byte cur;
+    bool bWaiting;
+    int initCounter;
+    unsigned int sentAt;
+    int replyTimeoutMs;
+    unsigned int nextRoundAt;
+} bl0942_bus_t;
+
+static bl0942_dev_t bl0942_devs[BL0942_MAX_DEVICES];
+static int bl0942_numDevs;
+static bl0942_bus_t bl0942_buses[BL0942_MAX_BUSES];
+static int bl0942_numBuses;
+static int bl0942_pollMs = BL0942_DEFAULT_POLL_MS;
+static uint32_t bl0942_spiPrevCfCnt = CF_CNT_INVALID;
 
 static int32_t Int24ToInt32(int32_t val) {
     return (val & (1 << 23) ? val | (0xFF << 24) : val);
 }
 
-#if ENABLE_BL_TWIN
-static void ScaleAndUpdate(int adeviceindex, bl0942_data_t *data) {
-#else
-static void ScaleAndUpdate(bl0942_data_t * data) {
-  int adeviceindex = BL0942_DEVICE_INDEX_0;
-#endif
-  float voltage, current, power;
-    PwrCal_Scale(data->v_rms, data->i_rms, data->watt, &voltage, &current,
-                 &power);
-
-    float frequency = 2 * 500000.0f / data->freq;
-
-    float energyWh = 0;
-    if (PrevCfCnt[adeviceindex] != CF_CNT_INVALID) {
-      int diff = (data->cf_cnt < PrevCfCnt[adeviceindex]
-        ? data->cf_cnt + (0xFFFFFF - PrevCfCnt[adeviceindex]) + 1
-        : data->cf_cnt - PrevCfCnt[adeviceindex]);
-      energyWh =
+static void Scale(uint32_t *prevCfCnt, bl0942_data_t *data, bl0942_reading_t *out) {
+    PwrCal_Scale(data->v_rms, data->i_rms, data->watt, &out->voltage, &out->current,
+                 &out->power);
+
+    out->frequency = 2 * 500000.0f / data->freq;
+
+    out->energyWh = 0;
+    if (*prevCfCnt != CF_CNT_INVALID) {
+      int diff = (data->cf_cnt < *prevCfCnt
+        ? data->cf_cnt + (0xFFFFFF - *prevCfCnt) + 1
+        : data->cf_cnt - *prevCfCnt);
+      out->energyWh =
         fabsf(PwrCal_ScalePowerOnly(diff)) * 1638.4f * 256.0f / 3600.0f;
     }
-    PrevCfCnt[adeviceindex] = data->cf_cnt;
+    *prevCfCnt = data->cf_cnt;
+}
+
+static void ProcessUpdate(int asensdatasetix, bl0942_reading_t *r) {
 #if ENABLE_BL_TWIN
-    //I assume that adeviceindex BL0942_DEVICE_INDEX_0/1 is equal to BL_SENSORS_IX_0/1 [to save flash memory]
-    BL_ProcessUpdateEx(adeviceindex, voltage, current, power, frequency, energyWh);
+    BL_ProcessUpdateEx(asensdatasetix, r->voltage, r->current, r->power, r->frequency, r->energyWh);
 #else
-    BL_ProcessUpdate(voltage, current, power, frequency, energyWh);
+    BL_ProcessUpdate(r->voltage, r->current, r->power, r->frequency, r->energyWh);
 #endif
     //addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Sensors ix %i v=%.f c=%.f p=%.f e=%.f",
-    //    adeviceindex, voltage, current, power, frequency, energyWh);
+    //    asensdatasetix, r->voltage, r->current, r->power, r->frequency, r->energyWh);
 }
 
-#if !ENABLE_BL_TWIN
-static int BL0942_UART_TryToGetNextPacket() {
-  int cs;
-  int i;
-  int c_garbage_consumed = 0;
-  byte checksum;
-
-  cs = UART_GetDataSize();
-
-  if(cs < BL0942_UART_PACKET_LEN) {
-    return 0;
-  }
-  // skip garbage data (should not happen)
-  while(cs > 0) {
-    if (UART_GetByte(0) != BL0942_UART_PACKET_HEAD) {
-      UART_ConsumeBytes(1);
-      c_garbage_consumed++;
-      cs--;
-    } else {
-      break;
-    }
-  }
-  if(c_garbage_consumed > 0){
-    ADDLOG_WARN(LOG_FEATURE_ENERGYMETER,
-      "Consumed %i unwanted non-header byte in BL0942 buffer\n",
-      c_garbage_consumed);
-  }
-  if(cs < BL0942_UART_PACKET_LEN) {
-    return 0;
-  }
-  if (UART_GetByte(0) != 0x55)
-    return 0;
-  checksum = BL0942_UART_CMD_READ(BL0942_UART_ADDR);
-
-  for(i = 0; i < BL0942_UART_PACKET_LEN-1; i++) {
-    checksum += UART_GetByte(i);
-  }
-  checksum ^= 0xFF;
-
-  if (checksum != UART_GetByte(BL0942_UART_PACKET_LEN - 1)) {
-    ADDLOG_WARN(LOG_FEATURE_ENERGYMETER,
-      "Skipping packet with bad checksum %02X wanted %02X\n",
-      UART_GetByte(BL0942_UART_PACKET_LEN - 1), checksum);
-    UART_ConsumeBytes(BL0942_UART_PACKET_LEN);
-    return 1;
-  }
-
-  bl0942_data_t data;
-  data.i_rms =
-    (UART_GetByte(3) << 16) | (UART_GetByte(2) << 8) | UART_GetByte(1);
-  data.v_rms =
-    (UART_GetByte(6) << 16) | (UART_GetByte(5) << 8) | UART_GetByte(4);
-  data.watt = Int24ToInt32((UART_GetByte(12) << 16) |
-    (UART_GetByte(11) << 8) | UART_GetByte(10));
-  data.cf_cnt =
-    (UART_GetByte(15) << 16) | (UART_GetByte(14) << 8) | UART_GetByte(13);
-  data.freq = (UART_GetByte(17) << 8) | UART_GetByte(16);
-  ScaleAndUpdate(&data);
-
-  UART_ConsumeBytes(BL0942_UART_PACKET_LEN);
-  return BL0942_UART_PACKET_LEN;
+static void AddSample(bl0942_dev_t *dev, bl0942_data_t *data) {
+    bl0942_reading_t r;
+
+    Scale(&dev->prevCfCnt, data, &r);
+    dev->sumVoltage += r.voltage;
+    dev->sumCurrent += r.current;
+    dev->sumPower += r.power;
+    dev->frequency = r.frequency;
+    dev->energyWh += r.energyWh;
+    dev->samples++;
+    dev->missed = 0;
 }
 
-#else
-static int BL0942_UART_TryToGetNextPacket(int adeviceindex, int auartindex) {
+// Returns 0 while packet is incomplete, 1 for bad one, packet length
+// when reading of dev was taken.
+static int BL0942_UART_TryToGetNextPacket(bl0942_dev_t *dev) {
 	int cs;
 	int i;
 	int c_garbage_consumed = 0;
 	byte checksum;
+	int auartindex = dev->port;
 
 	cs = UART_GetDataSizeEx(auartindex);
 
@@ -197,7 +203,7 @@ static int BL0942_UART_TryToGetNextPacket(int adeviceindex, int auartindex) {
 		}
 	}
 	if(c_garbage_consumed > 0){
-        ADDLOG_WARN(LOG_FEATURE_ENERGYMETER,
+        ADDLOGBIN_WARN(LOG_FEATURE_ENERGYMETER,
                     "Consumed %i unwanted non-header byte in BL0942 buffer\n",
                     c_garbage_consumed);
 	}
@@ -206,64 +212,123 @@ static int BL0942_UART_TryToGetNextPacket(int adeviceindex, int auartindex) {
 	}
     if (UART_GetByteEx(auartindex, 0) != 0x55)
 		return 0;
-    checksum = BL0942_UART_CMD_READ(BL0942_UART_ADDR);
+    // whole packet at once, parsed from copy
+    byte p[BL0942_UART_PACKET_LEN];
+    UART_PeekIntoEx(auartindex, p, BL0942_UART_PACKET_LEN);
+    checksum = BL0942_UART_CMD_READ(dev->addr);
 
     for(i = 0; i < BL0942_UART_PACKET_LEN-1; i++) {
-        checksum += UART_GetByteEx(auartindex, i);
+        checksum += p[i];
 	}
 	checksum ^= 0xFF;
 
-    if (checksum != UART_GetByteEx(auartindex, BL0942_UART_PACKET_LEN - 1)) {
-        ADDLOG_WARN(LOG_FEATURE_ENERGYMETER,
-                    "Skipping packet with bad checksum %02X wanted %02X\n",
-                    UART_GetByteEx(auartindex, BL0942_UART_PACKET_LEN - 1), checksum);
+    if (checksum != p[BL0942_UART_PACKET_LEN - 1]) {
+        ADDLOGBIN_WARN(LOG_FEATURE_ENERGYMETER,
+                    "Skipping packet of addr %i with bad checksum %02X wanted %02X\n",
+                    dev->addr, p[BL0942_UART_PACKET_LEN - 1], checksum);
         UART_ConsumeBytesEx(auartindex, BL0942_UART_PACKET_LEN);
+        dev->badPackets++;
 		return 1;
 	}
 
     bl0942_data_t data;
     data.i_rms =
-        (UART_GetByteEx(auartindex, 3) << 16) | (UART_GetByteEx(auartindex, 2) << 8) | UART_GetByteEx(auartindex, 1);
+        (p[3] << 16) | (p[2] << 8) | p[1];
     data.v_rms =
-        (UART_GetByteEx(auartindex, 6) << 16) | (UART_GetByteEx(auartindex, 5) << 8) | UART_GetByteEx(auartindex, 4);
-    data.watt = Int24ToInt32((UART_GetByteEx(auartindex, 12) << 16) |
-                             (UART_GetByteEx(auartindex, 11) << 8) | UART_GetByteEx(auartindex, 10));
+        (p[6] << 16) | (p[5] << 8) | p[4];
+    data.watt = Int24ToInt32((p[12] << 16) |
+                             (p[11] << 8) | p[10]);
     data.cf_cnt =
-        (UART_GetByteEx(auartindex, 15) << 16) | (UART_GetByteEx(auartindex, 14) << 8) | UART_GetByteEx(auartindex, 13);
-    data.freq = (UART_GetByteEx(auartindex, 17) << 8) | UART_GetByteEx(auartindex, 16);
-    ScaleAndUpdate(adeviceindex, &data);
+        (p[15] << 16) | (p[14] << 8) | p[13];
+    data.freq = (p[17] << 8) | p[16];
+    AddSample(dev, &data);
     UART_ConsumeBytesEx(auartindex, BL0942_UART_PACKET_LEN);
 	return BL0942_UART_PACKET_LEN;
 }
-#endif
 
-#if ENABLE_BL_TWIN
-static void UART_WriteReg(int auartindex, uint8_t reg, uint32_t val) {
-#else  
-static void UART_WriteReg(uint8_t reg, uint32_t val) {
-#endif
-    uint8_t send[5];
-    send[0] = BL0942_UART_CMD_WRITE(BL0942_UART_ADDR);
+static void UART_WriteReg(int auartindex, uint8_t addr, uint8_t reg, uint32_t val) {
+    uint8_t send[6];
+    send[0] = BL0942_UART_CMD_WRITE(addr);
     send[1] = reg;
     send[2] = (val & 0xFF);
     send[3] = ((val >> 8) & 0xFF);
     send[4] = ((val >> 16) & 0xFF);
     uint8_t crc = 0;
 
-    for (int i = 0; i < sizeof(send); i++) {
-#if ENABLE_BL_TWIN
-      UART_SendByteEx(auartindex, send[i]);
-#else
-      UART_SendByte(send[i]);
-#endif
+    for (int i = 0; i < 5; i++) {
         crc += send[i];
     }
+    send[5] = crc ^ 0xFF;
+    UART_SendBytesEx(auartindex, send, sizeof(send));
+}
 
-#if ENABLE_BL_TWIN
-    UART_SendByteEx(auartindex, crc ^ 0xFF);
-#else
-    UART_SendByte(crc ^ 0xFF);
-#endif
+static void BL0942_UART_SetupBus(bl0942_bus_t *bus) {
+    int i;
+    bl0942_dev_t *dev;
+
+    UART_InitUARTEx(bus->port, bl0942_baudRate, 0, false);
+    UART_InitReceiveRingBufferEx(bus->port, BL0942_UART_RECEIVE_BUFFER_SIZE);
+    // kept until some other user takes over port, then set up again
+    bus->initCounter = UART_GetInitCounterEx(bus->port);
+    bus->bWaiting = false;
+
+    for (i = 0; i < bus->numDevs; i++) {
+        dev = &bl0942_devs[bus->firstDev + i];
+        UART_WriteReg(bus->port, dev->addr, BL0942_REG_USR_WRPROT, BL0942_USR_WRPROT_DISABLE);
+        UART_WriteReg(bus->port, dev->addr, BL0942_REG_MODE,
+                      BL0942_MODE_DEFAULT | BL0942_MODE_RMS_UPDATE_SEL_800_MS);
+    }
+}
+
+// One step of request/response cycle. Next device is asked as soon as
+// previous one replied or timed out, round starts again after poll time.
+static void BL0942_UART_RunBus(bl0942_bus_t *bus) {
+    bl0942_dev_t *dev;
+    byte req[2];
+
+    if (UART_GetInitCounterEx(bus->port) != bus->initCounter) {
+        BL0942_UART_SetupBus(bus);
+    }
+    dev = &bl0942_devs[bus->firstDev + bus->cur];
+    // idle bus still takes packets, e.g. from simulator, as current device
+    if (BL0942_UART_TryToGetNextPacket(dev) == 0 && bus->bWaiting) {
+        if ((int)(g_timeMs - bus->sentAt) < bus->replyTimeoutMs) {
+            return;
+        }
+        dev->timeouts++;
+        if (++dev->missed >= BL0942_MAX_MISSED) {
+            dev->bHeld = false;
+        }
+        ADDLOG_DEBUG(LOG_FEATURE_ENERGYMETER, "BL0942 addr %i reply timeout, %i bytes",
+                     dev->addr, UART_GetDataSizeEx(bus->port));
+        UART_ConsumeBytesEx(bus->port, UART_GetDataSizeEx(bus->port));
+    }
+    else if (bus->bWaiting == false) {
+        if (bus->cur == 0 && (int)(g_timeMs - bus->nextRoundAt) < 0) {
+            return;
+        }
+    }
+    if (bus->bWaiting) {
+        bus->bWaiting = false;
+        bus->cur++;
+        if (bus->cur >= bus->numDevs) {
+            bus->cur = 0;
+            return;
+        }
+        dev = &bl0942_devs[bus->firstDev + bus->cur];
+    }
+    if (bus->cur == 0) {
+        bus->nextRoundAt += bl0942_pollMs;
+        // don't catch up after stall
+        if ((int)(g_timeMs - bus->nextRoundAt) >= 0) {
+            bus->nextRoundAt = g_timeMs + bl0942_pollMs;
+        }
+    }
+    req[0] = BL0942_UART_CMD_READ(dev->addr);
+    req[1] = BL0942_UART_REG_PACKET;
+    UART_SendBytesEx(bus->port, req, sizeof(req));
+    bus->sentAt = g_timeMs;
+    bus->bWaiting = true;
 }
 
 static int SPI_ReadReg(uint8_t reg, uint32_t *val) {
@@ -316,10 +381,7 @@ static int SPI_WriteReg(uint8_t reg, uint32_t val) {
 }
 
 static void BL0942_Init(void) {
-  PrevCfCnt[BL0942_DEVICE_INDEX_0] = CF_CNT_INVALID;
-#if ENABLE_BL_TWIN
-  PrevCfCnt[BL0942_DEVICE_INDEX_1] = CF_CNT_INVALID;
-#endif
+    bl0942_spiPrevCfCnt = CF_CNT_INVALID;
 
     BL_Shared_Init();
 
@@ -327,90 +389,156 @@ static void BL0942_Init(void) {
                 DEFAULT_POWER_CAL);
 }
 
-// THIS IS called by 'startDriver BL0942' command
-// You can set alternate baud with 'startDriver BL0942 9600' syntax
-#if !ENABLE_BL_TWIN
-void BL0942_UART_Init(void) {
-  BL0942_Init();
-
-  bl0942_baudRate = Tokenizer_GetArgIntegerDefault(1, 4800);
+static void BL0942_UART_AddBus(int auartindex, int addrMask) {
+    bl0942_bus_t *bus;
+    bl0942_dev_t *dev;
+    int addr;
 
-  UART_InitUART(bl0942_baudRate, 0, false);
-  UART_InitReceiveRingBuffer(BL0942_UART_RECEIVE_BUFFER_SIZE);
-
-  UART_WriteReg(BL0942_REG_USR_WRPROT, BL0942_USR_WRPROT_DISABLE);
-  UART_WriteReg(BL0942_REG_MODE,
-    BL0942_MODE_DEFAULT | BL0942_MODE_RMS_UPDATE_SEL_800_MS);
+    if (bl0942_numBuses >= BL0942_MAX_BUSES) {
+        return;
+    }
+    bus = &bl0942_buses[bl0942_numBuses];
+    memset(bus, 0, sizeof(*bus));
+    bus->port = auartindex;
+    bus->firstDev = bl0942_numDevs;
+    for (addr = 0; addr < 4; addr++) {
+        if (!(addrMask & (1 << addr)) || bl0942_numDevs >= BL0942_MAX_DEVICES) {
+            continue;
+        }
+        dev = &bl0942_devs[bl0942_numDevs];
+        memset(dev, 0, sizeof(*dev));
+        dev->port = auartindex;
+        dev->addr = addr;
+        dev->dataset = bl0942_numDevs < BL_SENSDATASETS_COUNT ? bl0942_numDevs : BL_SENSDATASETS_COUNT - 1;
+        dev->prevCfCnt = CF_CNT_INVALID;
+        bl0942_numDevs++;
+        bus->numDevs++;
+    }
+    if (bus->numDevs == 0) {
+        return;
+    }
+    // request and 23 byte reply, 10 bits each, twice that for chip delay
+    bus->replyTimeoutMs = 2 * (2 + BL0942_UART_PACKET_LEN) * 10 * 1000 / bl0942_baudRate + 20;
+    bus->nextRoundAt = g_timeMs;
+    bl0942_numBuses++;
+    BL0942_UART_SetupBus(bus);
 }
-#else
-void BL0942_UART_InitEx(int auartindex) {
-	BL0942_Init();
 
-	bl0942_baudRate = Tokenizer_GetArgIntegerDefault(1, 4800);
+// THIS IS called by 'startDriver BL0942' command
+// You can set alternate baud with 'startDriver BL0942 9600' syntax
+// Several chips on one port are given as mask of addresses, and
+// poll period can be shorter than a second, readings are averaged:
+// 'startDriver BL0942 9600 3 250' polls addresses 0 and 1 four times a second
+void BL0942_UART_Init(void) {
+    int addrMask;
 
-	UART_InitUARTEx(auartindex, bl0942_baudRate, 0, false);
-	UART_InitReceiveRingBufferEx(auartindex, BL0942_UART_RECEIVE_BUFFER_SIZE);
+    BL0942_Init();
 
-    UART_WriteReg(auartindex, BL0942_REG_USR_WRPROT, BL0942_USR_WRPROT_DISABLE);
-    UART_WriteReg(auartindex, BL0942_REG_MODE,
-                  BL0942_MODE_DEFAULT | BL0942_MODE_RMS_UPDATE_SEL_800_MS);
-}
+    bl0942_baudRate = Tokenizer_GetArgIntegerDefault(1, 4800);
+    addrMask = Tokenizer_GetArgIntegerDefault(2, 1 << BL0942_UART_ADDR) & 0xF;
+    bl0942_pollMs = Tokenizer_GetArgIntegerDefault(3, BL0942_DEFAULT_POLL_MS);
+    if (bl0942_pollMs < BL0942_MIN_POLL_MS) {
+        bl0942_pollMs = BL0942_MIN_POLL_MS;
+    }
 
-void BL0942_UART_Init(void) {
-  if (!bl0942_opts) {
-    int fuartindex = UART_GetSelectedPortIndex();
-    BL0942_UART_InitEx(fuartindex);
-  }
-  else {
+    bl0942_numDevs = 0;
+    bl0942_numBuses = 0;
+#if ENABLE_BL_TWIN
     if (bl0942_opts & BL0942_OPTBIT0_UART1) {
-      BL0942_UART_InitEx(UART_PORT_INDEX_0);
+        BL0942_UART_AddBus(UART_PORT_INDEX_0, addrMask);
     }
     if (bl0942_opts & BL0942_OPTBIT1_UART2) {
-      BL0942_UART_InitEx(UART_PORT_INDEX_1);
+        BL0942_UART_AddBus(UART_PORT_INDEX_1, addrMask);
     }
-  }
-}
+    if (!bl0942_opts)
 #endif
+    BL0942_UART_AddBus(UART_GetSelectedPortIndex(), addrMask);
+    if (bl0942_numDevs > BL_SENSDATASETS_COUNT) {
+        ADDLOG_INFO(LOG_FEATURE_ENERGYMETER, "BL0942: %i devices, last %i summed",
+                    bl0942_numDevs, bl0942_numDevs - BL_SENSDATASETS_COUNT + 1);
+    }
+}
 
-#if ENABLE_BL_TWIN
-void BL0942_UART_RunEverySecondEx(int adeviceindex, int auartindex) {
-  BL0942_UART_TryToGetNextPacket(adeviceindex, auartindex);
+void BL0942_UART_RunQuickTick(void) {
+    int i;
 
-  UART_InitUARTEx(auartindex, bl0942_baudRate, 0, false);
-  UART_SendByteEx(auartindex, BL0942_UART_CMD_READ(BL0942_UART_ADDR));
-  UART_SendByteEx(auartindex, BL0942_UART_REG_PACKET);
+    for (i = 0; i < bl0942_numBuses; i++) {
+        BL0942_UART_RunBus(&bl0942_buses[i]);
+    }
 }
 
-void BL0942_UART_RunEverySecond(void) {
-  if (!bl0942_opts) {
-    int fuartindex = UART_GetSelectedPortIndex();
-    BL0942_UART_RunEverySecondEx(BL0942_DEVICE_INDEX_0, fuartindex);
-  }
-  else {
-    if (bl0942_opts & BL0942_OPTBIT0_UART1) {
-      BL0942_UART_RunEverySecondEx(BL0942_DEVICE_INDEX_0, UART_PORT_INDEX_0);
+int BL0942_UART_GetTimeToNextWakeMS(void) {
+    int i;
+    int left;
+    int wake = -1;
+
+    for (i = 0; i < bl0942_numBuses; i++) {
+        if (bl0942_buses[i].bWaiting || bl0942_buses[i].cur != 0) {
+            return BL0942_RECV_POLL_MS;
+        }
+        left = (int)(bl0942_buses[i].nextRoundAt - g_timeMs);
+        if (left < 0) {
+            left = 0;
+        }
+        if (wake < 0 || left < wake) {
+            wake = left;
+        }
     }
-    if (bl0942_opts & BL0942_OPTBIT1_UART2) {
-      BL0942_UART_RunEverySecondEx(BL0942_DEVICE_INDEX_1, UART_PORT_INDEX_1);
-    }
-  }
+    return wake;
 }
-#else
+
+void BL0942_UART_Stop(void) {
+    bl0942_numBuses = 0;
+    bl0942_numDevs = 0;
+}
+
+// Shared module expects one update per second, so readings taken since
+// last one are averaged, energy is summed. Devices merged into a dataset
+// add up current and power, voltage is their mean, and each one counts
+// with its last reading until it misses a few polls.
 void BL0942_UART_RunEverySecond(void) {
-#if ENABLE_BL_TWIN
-  int fuartindex = UART_GetSelectedPortIndex();
-  BL0942_UART_TryToGetNextPacket(BL0942_DEVICE_INDEX_0, fuartindex);
-  UART_InitUARTEx(fuartindex, bl0942_baudRate, 0, false);
-  UART_SendByteEx(fuartindex, BL0942_UART_CMD_READ(BL0942_UART_ADDR));
-  UART_SendByteEx(fuartindex, BL0942_UART_REG_PACKET);
-#else
-  BL0942_UART_TryToGetNextPacket();
-  UART_InitUART(bl0942_baudRate, 0, false);
-  UART_SendByte(BL0942_UART_CMD_READ(BL0942_UART_ADDR));
-  UART_SendByte(BL0942_UART_REG_PACKET);
-#endif
+    bl0942_reading_t r;
+    bl0942_dev_t *dev;
+    int set, i, n;
+    bool bNew;
+
+    for (set = 0; set < BL_SENSDATASETS_COUNT; set++) {
+        memset(&r, 0, sizeof(r));
+        n = 0;
+        bNew = false;
+        for (i = 0; i < bl0942_numDevs; i++) {
+            dev = &bl0942_devs[i];
+            if (dev->dataset != set) {
+                continue;
+            }
+            if (dev->samples) {
+                dev->held.voltage = dev->sumVoltage / dev->samples;
+                dev->held.current = dev->sumCurrent / dev->samples;
+                dev->held.power = dev->sumPower / dev->samples;
+                dev->held.frequency = dev->frequency;
+                dev->bHeld = true;
+                r.energyWh += dev->energyWh;
+                dev->sumVoltage = dev->sumCurrent = dev->sumPower = dev->energyWh = 0;
+                dev->samples = 0;
+                bNew = true;
+            }
+            if (!dev->bHeld) {
+                continue;
+            }
+            r.voltage += dev->held.voltage;
+            r.current += dev->held.current;
+            r.power += dev->held.power;
+            if (n == 0) {
+                r.frequency = dev->held.frequency;
+            }
+            n++;
+        }
+        if (bNew && n) {
+            r.voltage /= n;
+            ProcessUpdate(set, &r);
+        }
+    }
 }
-#endif
 
 void BL0942_SPI_Init(void) {
 	BL0942_Init();
@@ -431,19 +559,32 @@ void BL0942_SPI_Init(void) {
                  BL0942_MODE_DEFAULT | BL0942_MODE_RMS_UPDATE_SEL_800_MS);
 }
 
+// Registers of one update, declared once. Full packet (0xAA) is UART only,
+// SPI reads them one by one, and update is skipped if any is bad.
+static const struct {
+    uint8_t reg;
+    uint8_t offset;
+} bl0942_spiScan[] = {
+    { BL0942_REG_I_RMS, offsetof(bl0942_data_t, i_rms) },
+    { BL0942_REG_V_RMS, offsetof(bl0942_data_t, v_rms) },
+    { BL0942_REG_WATT, offsetof(bl0942_data_t, watt) },
+    { BL0942_REG_CF_CNT, offsetof(bl0942_data_t, cf_cnt) },
+    { BL0942_REG_FREQ, offsetof(bl0942_data_t, freq) },
+};
+
 void BL0942_SPI_RunEverySecond(void) {
     bl0942_data_t data;
-    SPI_ReadReg(BL0942_REG_I_RMS, &data.i_rms);
-    SPI_ReadReg(BL0942_REG_V_RMS, &data.v_rms);
-    SPI_ReadReg(BL0942_REG_WATT, (uint32_t *)&data.watt);
+    bl0942_reading_t r;
+    int i;
+
+    for (i = 0; i < sizeof(bl0942_spiScan) / sizeof(bl0942_spiScan[0]); i++) {
+        if (SPI_ReadReg(bl0942_spiScan[i].reg, (uint32_t *)((uint8_t *)&data + bl0942_spiScan[i].offset)) < 0) {
+            return;
+        }
+    }
     data.watt = Int24ToInt32(data.watt);
-    SPI_ReadReg(BL0942_REG_CF_CNT, &data.cf_cnt);
-    SPI_ReadReg(BL0942_REG_FREQ, &data.freq);
-#if ENABLE_BL_TWIN
-    ScaleAndUpdate(BL0942_DEVICE_INDEX_0,&data);
-#else
-    ScaleAndUpdate(&data);
-#endif
+    Scale(&bl0942_spiPrevCfCnt, &data, &r);
+    ProcessUpdate(BL0942_DEVICE_INDEX_0, &r);
 }
 
 #if ENABLE_BL_TWIN
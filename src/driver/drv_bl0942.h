@@ -4,6 +4,9 @@
 
 void BL0942_UART_Init(void);
 void BL0942_UART_RunEverySecond(void);
+void BL0942_UART_RunQuickTick(void);
+int BL0942_UART_GetTimeToNextWakeMS(void);
+void BL0942_UART_Stop(void);
 void BL0942_SPI_Init(void);
 void BL0942_SPI_RunEverySecond(void);
 #if ENABLE_BL_TWIN
@@ -0,0 +1,294 @@
+#include "../new_common.h"
+#include "../obk_config.h"
+#include "../logging/logging.h"
+#include "../cmnds/cmd_public.h"
+#include "../httpserver/new_http.h"
+#include "../littlefs/our_lfs.h"
+#include "../libraries/obktime/obktime.h"
+#include "drv_bl_shared.h"
+#include "drv_deviceclock.h"
+#include "drv_public.h"
+
+#if ENABLE_BL_HISTORY
+
+// Energy history kept on device, so it survives reboots of whatever
+// collects it. Total consumption is recorded once per interval, aligned to
+// UTC, as energy of that interval, into one append-only file per month:
+// energy_YYYYMM.bin. Oldest month is removed when a new one starts.
+//
+// File is made of EH_BLOCK_SIZE blocks, each starts with a header:
+//   'E', version, interval in minutes (u16 LE), base time (u32 LE, UTC)
+// and a list of records, two unsigned LEB128 varints each:
+//   seconds since previous record (or base time), never 0
+//   energy of interval in mWh
+// Zero byte where a record would start means rest of block is unused.
+// Record that does not fit starts a new block, and so does a reboot,
+// so blocks are independent and can be read in any order.
+//
+// EnergyHistory [IntervalSeconds] [KeepMonths]
+// GET api/energyhistory?from=<utc>&to=<utc>
+
+#define EH_BLOCK_SIZE			128
+#define EH_HEADER_SIZE			8
+#define EH_VERSION				1
+#define EH_RECORD_MAX			10
+#define EH_MAX_QUERY_MONTHS		24
+
+static int eh_interval = 0;
+static int eh_keepMonths = 3;
+// slot of UTC time that is being accumulated, -1 before clock is known
+static int eh_slot = -1;
+static double eh_lastTotal;
+// bytes used in last block of current file, 0 if block is not known
+static int eh_blockUsed = 0;
+static int eh_blockMonth = 0;
+static unsigned int eh_lastTime;
+
+static int EnergyHistory_GetMonth(unsigned int utc) {
+	TimeComponents tc = calculateComponents(utc);
+
+	return tc.year * 100 + tc.month;
+}
+static int EnergyHistory_AddMonths(int month, int add) {
+	int m = (month / 100) * 12 + (month % 100) - 1 + add;
+
+	return (m / 12) * 100 + (m % 12) + 1;
+}
+static void EnergyHistory_GetFileName(char *out, int outSize, int month) {
+	snprintf(out, outSize, "energy_%06i.bin", month);
+}
+static int EnergyHistory_PutVarint(byte *p, unsigned int v) {
+	int n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+// returns bytes used, 0 if varint does not end before end
+static int EnergyHistory_GetVarint(const byte *p, const byte *end, unsigned int *v) {
+	int n = 0, shift = 0;
+
+	*v = 0;
+	while (p + n < end && shift < 32) {
+		*v |= (p[n] & 0x7F) << shift;
+		if ((p[n++] & 0x80) == 0) {
+			return n;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+static void EnergyHistory_Append(unsigned int t, unsigned int mWh) {
+	byte buf[EH_BLOCK_SIZE + EH_HEADER_SIZE + EH_RECORD_MAX];
+	byte rec[EH_RECORD_MAX];
+	char fname[32];
+	lfs_file_t *file;
+	int month, recLen, len, pad;
+	unsigned int base;
+
+	if (!lfs_present()) {
+		return;
+	}
+	// record closes interval, so it belongs to month of its last second
+	month = EnergyHistory_GetMonth(t - 1);
+	EnergyHistory_GetFileName(fname, sizeof(fname), month);
+	file = (lfs_file_t*)os_malloc(sizeof(lfs_file_t));
+	if (file == 0) {
+		return;
+	}
+	memset(file, 0, sizeof(lfs_file_t));
+	if (lfs_file_open(&lfs, file, fname, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND) < 0) {
+		os_free(file);
+		return;
+	}
+	if (month != eh_blockMonth) {
+		if (lfs_file_size(&lfs, file) == 0 && eh_keepMonths > 0) {
+			EnergyHistory_GetFileName(fname, sizeof(fname), EnergyHistory_AddMonths(month, -eh_keepMonths));
+			lfs_remove(&lfs, fname);
+		}
+		eh_blockMonth = month;
+		eh_blockUsed = 0;
+	}
+	len = 0;
+	// clock went back, times are counted again from new base
+	if (t <= eh_lastTime) {
+		eh_blockUsed = 0;
+	}
+	if (eh_blockUsed == 0) {
+		eh_lastTime = t - eh_interval;
+	}
+	recLen = EnergyHistory_PutVarint(rec, t - eh_lastTime);
+	recLen += EnergyHistory_PutVarint(rec + recLen, mWh);
+	if (eh_blockUsed == 0 || eh_blockUsed + recLen > EH_BLOCK_SIZE) {
+		// finish block that is there, also one left by a reboot
+		pad = EH_BLOCK_SIZE - lfs_file_size(&lfs, file) % EH_BLOCK_SIZE;
+		if (pad != EH_BLOCK_SIZE) {
+			memset(buf, 0, pad);
+			len = pad;
+		}
+		base = eh_lastTime;
+		buf[len++] = 'E';
+		buf[len++] = EH_VERSION;
+		buf[len++] = eh_interval / 60;
+		buf[len++] = (eh_interval / 60) >> 8;
+		buf[len++] = base;
+		buf[len++] = base >> 8;
+		buf[len++] = base >> 16;
+		buf[len++] = base >> 24;
+		eh_blockUsed = EH_HEADER_SIZE;
+	}
+	memcpy(buf + len, rec, recLen);
+	len += recLen;
+	if (lfs_file_write(&lfs, file, buf, len) == len) {
+		eh_blockUsed += recLen;
+		eh_lastTime = t;
+	} else {
+		eh_blockUsed = 0;
+	}
+	lfs_file_close(&lfs, file);
+	os_free(file);
+}
+
+// called from BL_Shared_RunEverySecond
+void EnergyHistory_RunEverySecond(void) {
+	double total, diff;
+	unsigned int now;
+	int slot;
+
+	if (eh_interval == 0 || !TIME_IsTimeSynced()) {
+		return;
+	}
+	now = TIME_GetCurrentTimeWithoutOffset();
+	slot = now / eh_interval;
+	if (slot == eh_slot) {
+		return;
+	}
+	total = DRV_GetReading(OBK_CONSUMPTION_TOTAL);
+	if (eh_slot != -1) {
+		diff = total - eh_lastTotal;
+		// counter was reset
+		if (diff < 0) {
+			diff = 0;
+		}
+		EnergyHistory_Append(slot * eh_interval, (unsigned int)(diff * 1000.0 + 0.5));
+	}
+	eh_slot = slot;
+	eh_lastTotal = total;
+}
+
+static commandResult_t EnergyHistory_Setup(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int interval;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	interval = Tokenizer_GetArgInteger(0);
+	if (interval != 0 && interval < 60) {
+		interval = 60;
+	}
+	if (interval > 86400) {
+		interval = 86400;
+	}
+	interval -= interval % 60;
+	eh_keepMonths = Tokenizer_GetArgIntegerDefault(1, 3);
+	if (eh_keepMonths < 0) {
+		eh_keepMonths = 0;
+	}
+	eh_interval = interval;
+	eh_slot = -1;
+	eh_blockUsed = 0;
+	eh_blockMonth = 0;
+	if (interval) {
+		init_lfs(1);
+		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Energy history every %i s, %i months", interval, eh_keepMonths);
+	}
+	return CMD_RES_OK;
+}
+
+// one [time, mWh] row per record from from..to, streamed as files are read
+int EnergyHistory_HTTPQuery(http_request_t *request) {
+	byte block[EH_BLOCK_SIZE];
+	char tmp[16];
+	char fname[32];
+	lfs_file_t *file;
+	jsonWriter_t w;
+	unsigned int from, to, t, v, dt;
+	int month, last, i, n, at, count;
+
+	from = http_getArg(request->url, "from", tmp, sizeof(tmp)) ? strtoul(tmp, 0, 10) : 0;
+	to = TIME_IsTimeSynced() ? TIME_GetCurrentTimeWithoutOffset() : 0xFFFFFFFF;
+	if (http_getArg(request->url, "to", tmp, sizeof(tmp))) {
+		to = strtoul(tmp, 0, 10);
+	}
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "interval", eh_interval);
+	JSONW_String(&w, "unit", "mWh");
+	JSONW_StartArray(&w, "data");
+	count = 0;
+	file = lfs_present() ? (lfs_file_t*)os_malloc(sizeof(lfs_file_t)) : 0;
+	if (file) {
+		// long ranges are cut to newest EH_MAX_QUERY_MONTHS files
+		month = EnergyHistory_GetMonth(from ? from - 1 : 0);
+		last = EnergyHistory_GetMonth(to == 0xFFFFFFFF ? to : to - 1);
+		if (EnergyHistory_AddMonths(month, EH_MAX_QUERY_MONTHS) < last) {
+			month = EnergyHistory_AddMonths(last, -EH_MAX_QUERY_MONTHS);
+		}
+		for (; month <= last; month = EnergyHistory_AddMonths(month, 1)) {
+			EnergyHistory_GetFileName(fname, sizeof(fname), month);
+			memset(file, 0, sizeof(lfs_file_t));
+			if (lfs_file_open(&lfs, file, fname, LFS_O_RDONLY) < 0) {
+				continue;
+			}
+			while ((n = lfs_file_read(&lfs, file, block, sizeof(block))) > EH_HEADER_SIZE) {
+				if (block[0] != 'E' || block[1] != EH_VERSION) {
+					continue;
+				}
+				t = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+				for (at = EH_HEADER_SIZE; at < n && block[at]; ) {
+					i = EnergyHistory_GetVarint(block + at, block + n, &dt);
+					if (i == 0) {
+						break;
+					}
+					at += i;
+					i = EnergyHistory_GetVarint(block + at, block + n, &v);
+					if (i == 0) {
+						break;
+					}
+					at += i;
+					t += dt;
+					if (t > from && t <= to) {
+						JSONW_StartArray(&w, NULL);
+						JSONW_Int(&w, NULL, t);
+						JSONW_Int(&w, NULL, v);
+						JSONW_EndArray(&w);
+						count++;
+					}
+				}
+			}
+			lfs_file_close(&lfs, file);
+		}
+		os_free(file);
+	}
+	JSONW_EndArray(&w);
+	JSONW_Int(&w, "count", count);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+
+void EnergyHistory_Init(void) {
+	//cmddetail:{"name":"EnergyHistory","args":"[IntervalSeconds][KeepMonths]",
+	//cmddetail:"descr":"Records energy of each interval [60..86400 s, aligned to UTC, 0 turns it off] into LittleFS, one compact append-only file per month (energy_YYYYMM.bin), and keeps KeepMonths [default 3] of them. Needs time from NTP or device clock. Read back with GET api/energyhistory?from=<utc>&to=<utc>, which gives [time, mWh] rows where time is interval end.",
+	//cmddetail:"fn":"EnergyHistory_Setup","file":"driver/drv_bl_history.c","requires":"",
+	//cmddetail:"examples":"`EnergyHistory 3600 12`"}
+	CMD_RegisterCommand("EnergyHistory", EnergyHistory_Setup, NULL);
+}
+
+#endif
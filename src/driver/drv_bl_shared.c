@@ -5,7 +5,6 @@
 
 #include "../new_cfg.h"
 #include "../new_pins.h"
-#include "../cJSON/cJSON.h"
 #include "../hal/hal_flashVars.h"
 #include "../logging/logging.h"
 #include "../mqtt/new_mqtt.h"
@@ -16,16 +15,12 @@
 #include "drv_public.h"
 #include "drv_uart.h"
 #include "../cmnds/cmd_public.h" //for enum EventCode
+#include "../quicktick.h"
 #include <math.h>
 //#include <time.h>
 #include "../libraries/obktime/obktime.h"	// for time functions
 
 
-#if ENABLE_BL_TWIN
-#define BL_SENSDATASETS_COUNT 2
-#else
-#define BL_SENSDATASETS_COUNT 1
-#endif
 #if ENABLE_BL_TWIN
 const int OBK_CONSUMPTION_STORED_LAST[2] = { OBK_CONSUMPTION_YESTERDAY,OBK_CONSUMPTION_TODAY };
 #else
@@ -118,7 +113,8 @@ bool energyCounterStatsEnable = false;
 int energyCounterSampleCount = 60;
 int energyCounterSampleInterval = 60;
 float *energyCounterMinutes = NULL;
-portTickType energyCounterMinutesStamp;
+// seconds since statistics period started, counted by BL_Shared_RunEverySecond
+int energyCounterPeriodSeconds;
 long energyCounterMinutesIndex;
 bool energyCounterStatsJSONEnable = false;
 
@@ -127,6 +123,48 @@ long ConsumptionSaveCounter = 0;
 portTickType lastConsumptionSaveStamp;
 time_t ConsumptionResetTime = 0;
 
+// total of IX0 changed since it was given to flash vars, which can write
+// flash for it, so it is saved write-behind like channels, see BL_Shared_RunEverySecond
+static bool bl_totalSavePending = false;
+static int bl_totalSaveAge = 0;
+static bool bl_sharedStarted = false;
+// grows with each BL_ProcessUpdate, see DRV_GetReadingsVersion
+static int bl_readingsVersion = 0;
+
+// High rate trace, see SetupEnergyWindows. Every IX0 reading goes to a ring
+// and to running sums of a few windows, only window summaries are published
+// and ring is sent on demand by EnergyTraceDump.
+#define BL_TRACE_WINDOWS 3
+#define BL_TRACE_DUMP_PART 64
+
+typedef struct blTraceSample_s {
+  unsigned int timeMs;
+  float power;
+  unsigned short voltage_dV;
+  unsigned short current_mA;
+} blTraceSample_t;
+
+typedef struct blTraceWindow_s {
+  // 0 if slot is not used
+  int seconds;
+  int elapsed;
+  int count;
+  float powerMin;
+  float powerMax;
+  double powerSum;
+  double powerSqSum;
+  double currentSqSum;
+  double voltageSqSum;
+  double energyWh;
+} blTraceWindow_t;
+
+static bool bl_traceEnable = false;
+static blTraceSample_t *bl_traceRing = NULL;
+static int bl_traceRingSize = 0;
+static int bl_traceRingCount = 0;
+static int bl_traceRingNext = 0;
+static blTraceWindow_t bl_traceWindows[BL_TRACE_WINDOWS];
+
 int changeSendAlwaysFrames = 60;
 int changeDoNotSendMinFrames = 5;
 
@@ -151,15 +189,15 @@ void BL09XX_AppendInformationToHTTPIndexPage(http_request_t * request, int bPreS
     const char *mode;
 //    struct tm *ltm;
 
-    if(DRV_IsRunning("BL0937")) {
+    if(DRV_IsRunning(DRV_ID_BL0937)) {
         mode = "BL0937";
-    } else if(DRV_IsRunning("BL0942")) {
+    } else if(DRV_IsRunning(DRV_ID_BL0942)) {
         mode = "BL0942";
-    } else if (DRV_IsRunning("BL0942SPI")) {
+    } else if (DRV_IsRunning(DRV_ID_BL0942SPI)) {
         mode = "BL0942SPI";
-    } else if(DRV_IsRunning("CSE7766")) {
+    } else if(DRV_IsRunning(DRV_ID_CSE7766)) {
         mode = "CSE7766";
-    } else if(DRV_IsRunning("RN8209")) {
+    } else if(DRV_IsRunning(DRV_ID_RN8209)) {
         mode = "RN8209";
     } else {
         mode = "PWR";
@@ -316,7 +354,7 @@ commandResult_t BL09XX_ResetEnergyCounterEx(int asensdatasetix, float* pvalue)
                     energyCounterMinutes[i] = 0.0;
                 }
             }
-            energyCounterMinutesStamp = xTaskGetTickCount();
+            energyCounterPeriodSeconds = 0;
             energyCounterMinutesIndex = 0;
         }
         for(i = OBK_CONSUMPTION__DAILY_FIRST; i <= OBK_CONSUMPTION__DAILY_LAST; i++)
@@ -426,7 +464,7 @@ commandResult_t BL09XX_SetupEnergyStatistic(const void *context, const char *cmd
         }
         addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Sample Interval: %d", energyCounterSampleInterval);
 
-        energyCounterMinutesStamp = xTaskGetTickCount();
+        energyCounterPeriodSeconds = 0;
         energyCounterMinutesIndex = 0;
     } else {
         /* Disable Consimption Nistory */
@@ -617,6 +655,404 @@ float BL_ChangeEnergyUnitIfNeeded(float Wh) {
 	return Wh;
 }
 
+#if ENABLE_MQTT
+// consumption_stats, written straight into one buffer by JSON writer
+static void BL_PublishConsumptionStats() {
+  energysensdataset_t* sensdataset = &datasetlist[BL_SENSORS_IX_0];
+  int energyDecimals = CFG_HasFlag(OBK_FLAG_MQTT_ENERGY_IN_KWH) ? 6 : 3;
+  http_request_t out;
+  jsonWriter_t w;
+  char datetime[64];
+  char *msg;
+  int i, size;
+
+  // fixed fields are under 512 bytes, numbers under 16 each
+  size = 512 + (energyCounterSampleCount + OBK_CONSUMPTION__DAILY_LAST - OBK_CONSUMPTION__DAILY_FIRST + 1) * 16;
+  msg = (char*)os_malloc(size);
+  if (msg == NULL) {
+    return;
+  }
+  memset(&out, 0, sizeof(out));
+  out.fd = -1;
+  out.reply = msg;
+  out.replymaxlen = size;
+
+  JSONW_Init(&w, &out);
+  JSONW_StartObject(&w, 0);
+  JSONW_Int(&w, "uptime", g_secondsElapsed);
+  JSONW_Float(&w, "consumption_total", BL_ChangeEnergyUnitIfNeeded(DRV_GetReading(OBK_CONSUMPTION_TOTAL)), energyDecimals);
+  JSONW_Float(&w, "consumption_last_hour", BL_ChangeEnergyUnitIfNeeded(DRV_GetReading(OBK_CONSUMPTION_LAST_HOUR)), energyDecimals);
+  JSONW_Int(&w, "consumption_stat_index", energyCounterMinutesIndex);
+  JSONW_Int(&w, "consumption_sample_count", energyCounterSampleCount);
+  JSONW_Int(&w, "consumption_sampling_period", energyCounterSampleInterval);
+  if (TIME_IsTimeSynced() == true)
+  {
+    JSONW_Float(&w, "consumption_today", BL_ChangeEnergyUnitIfNeeded(DRV_GetReading(OBK_CONSUMPTION_TODAY)), energyDecimals);
+    JSONW_Float(&w, "consumption_yesterday", BL_ChangeEnergyUnitIfNeeded(DRV_GetReading(OBK_CONSUMPTION_YESTERDAY)), energyDecimals);
+    // since we can be sure, a negative offset is minumum 1 hour,
+    // the sign for the hour will be "-" for "negative" timezones
+    snprintf(datetime, sizeof(datetime), "%.16s%+03i:%02i",TS2STR(ConsumptionResetTime, TIME_FORMAT_ISO_8601),
+        TIME_GetTimesZoneOfsSeconds()/3600, (abs(TIME_GetTimesZoneOfsSeconds())/60) % 60);
+    JSONW_String(&w, "consumption_clear_date", datetime);
+  }
+  if (energyCounterMinutes != NULL)
+  {
+    // WARNING - it causes HA problems?
+    // See: https://github.com/openshwprojects/OpenBK7231T_App/issues/870
+    // Basically HA has 256 chars state limit?
+    JSONW_StartArray(&w, "consumption_samples");
+    for (i = 0; i < energyCounterSampleCount; i++)
+    {
+      JSONW_Float(&w, 0, energyCounterMinutes[i], 3);
+    }
+    JSONW_EndArray(&w);
+  }
+  if (NTP_IsTimeSynced() == true)
+  {
+    JSONW_StartArray(&w, "consumption_daily");
+    for (i = OBK_CONSUMPTION__DAILY_FIRST; i <= OBK_CONSUMPTION__DAILY_LAST; i++)
+    {
+      JSONW_Float(&w, 0, sensdataset->sensors[i].lastReading, 3);
+    }
+    JSONW_EndArray(&w);
+  }
+  JSONW_EndObject(&w);
+  msg[out.replylen] = 0;
+
+  MQTT_PublishMain_StringString("consumption_stats", msg, OBK_PUBLISH_FLAG_TELE);
+  stat_updatesSent[BL_SENSORS_IX_0]++;
+  os_free(msg);
+}
+#endif
+
+static unsigned short BL_Trace_ToU16(float v) {
+  if (v <= 0) {
+    return 0;
+  }
+  if (v >= 65535.0f) {
+    return 65535;
+  }
+  return (unsigned short)(v + 0.5f);
+}
+
+static void BL_Trace_ResetWindow(blTraceWindow_t *win) {
+  win->elapsed = 0;
+  win->count = 0;
+  win->powerMin = 0;
+  win->powerMax = 0;
+  win->powerSum = 0;
+  win->powerSqSum = 0;
+  win->currentSqSum = 0;
+  win->voltageSqSum = 0;
+  win->energyWh = 0;
+}
+
+// called for each reading, so only a ring store and a few sums
+void BL_Trace_AddSample(float voltage, float current, float power, float energyWh) {
+  blTraceSample_t *s;
+  blTraceWindow_t *win;
+  int i;
+
+  if (bl_traceRing != NULL) {
+    s = &bl_traceRing[bl_traceRingNext];
+    s->timeMs = g_timeMs;
+    s->power = power;
+    s->voltage_dV = BL_Trace_ToU16(voltage * 10.0f);
+    s->current_mA = BL_Trace_ToU16(current * 1000.0f);
+    bl_traceRingNext++;
+    if (bl_traceRingNext >= bl_traceRingSize) {
+      bl_traceRingNext = 0;
+    }
+    if (bl_traceRingCount < bl_traceRingSize) {
+      bl_traceRingCount++;
+    }
+  }
+  for (i = 0; i < BL_TRACE_WINDOWS; i++) {
+    win = &bl_traceWindows[i];
+    if (win->seconds == 0) {
+      continue;
+    }
+    if (win->count == 0 || power < win->powerMin) {
+      win->powerMin = power;
+    }
+    if (win->count == 0 || power > win->powerMax) {
+      win->powerMax = power;
+    }
+    win->count++;
+    win->powerSum += power;
+    win->powerSqSum += power * power;
+    win->currentSqSum += current * current;
+    win->voltageSqSum += voltage * voltage;
+    win->energyWh += energyWh;
+  }
+}
+
+#if ENABLE_MQTT
+static char *BL_Trace_BeginJSON(http_request_t *out, jsonWriter_t *w, int size) {
+  char *msg;
+
+  msg = (char*)os_malloc(size);
+  if (msg == NULL) {
+    return NULL;
+  }
+  memset(out, 0, sizeof(*out));
+  out->fd = -1;
+  out->reply = msg;
+  out->replymaxlen = size;
+  JSONW_Init(w, out);
+  JSONW_StartObject(w, 0);
+  return msg;
+}
+
+// energy_window_<seconds>, means of window without readings are null
+static void BL_Trace_PublishWindow(blTraceWindow_t *win) {
+  int energyDecimals = CFG_HasFlag(OBK_FLAG_MQTT_ENERGY_IN_KWH) ? 6 : 3;
+  float n = win->count ? (float)win->count : NAN;
+  http_request_t out;
+  jsonWriter_t w;
+  char topic[32];
+  char *msg;
+
+  msg = BL_Trace_BeginJSON(&out, &w, 320);
+  if (msg == NULL) {
+    return;
+  }
+  JSONW_Int(&w, "window", win->seconds);
+  JSONW_Int(&w, "count", win->count);
+  JSONW_Float(&w, "power_min", win->count ? win->powerMin : NAN, 2);
+  JSONW_Float(&w, "power_max", win->count ? win->powerMax : NAN, 2);
+  JSONW_Float(&w, "power_mean", (float)(win->powerSum / n), 2);
+  JSONW_Float(&w, "power_rms", sqrtf((float)(win->powerSqSum / n)), 2);
+  JSONW_Float(&w, "current_rms", sqrtf((float)(win->currentSqSum / n)), 3);
+  JSONW_Float(&w, "voltage_rms", sqrtf((float)(win->voltageSqSum / n)), 1);
+  JSONW_Float(&w, "energy", BL_ChangeEnergyUnitIfNeeded((float)win->energyWh), energyDecimals);
+  JSONW_EndObject(&w);
+  msg[out.replylen] = 0;
+
+  snprintf(topic, sizeof(topic), "energy_window_%i", win->seconds);
+  MQTT_PublishMain_StringString(topic, msg, OBK_PUBLISH_FLAG_QOS_ZERO | OBK_PUBLISH_FLAG_TELE);
+  stat_updatesSent[BL_SENSORS_IX_0]++;
+  os_free(msg);
+}
+
+// energy_trace, ring from oldest reading in parts of BL_TRACE_DUMP_PART.
+// Delta coded: first value of each array is absolute, then differences,
+// time in ms, power in 0.1W, current in mA, voltage in 0.1V.
+static void BL_Trace_PublishDump(int maxSamples) {
+  http_request_t out;
+  jsonWriter_t w;
+  blTraceSample_t *s;
+  char *msg;
+  int count, first, part, parts, at, n, i, field;
+  int prev, cur;
+
+  count = bl_traceRingCount;
+  if (maxSamples > 0 && maxSamples < count) {
+    count = maxSamples;
+  }
+  first = bl_traceRingNext - count;
+  if (first < 0) {
+    first += bl_traceRingSize;
+  }
+  parts = (count + BL_TRACE_DUMP_PART - 1) / BL_TRACE_DUMP_PART;
+  if (parts == 0) {
+    parts = 1;
+  }
+  for (part = 0; part < parts; part++) {
+    n = count - part * BL_TRACE_DUMP_PART;
+    if (n > BL_TRACE_DUMP_PART) {
+      n = BL_TRACE_DUMP_PART;
+    }
+    // deltas are short, absolute values and keys fit in the rest
+    msg = BL_Trace_BeginJSON(&out, &w, 192 + n * 4 * 8);
+    if (msg == NULL) {
+      return;
+    }
+    JSONW_Int(&w, "part", part);
+    JSONW_Int(&w, "parts", parts);
+    JSONW_Int(&w, "count", n);
+    for (field = 0; field < 4; field++) {
+      JSONW_StartArray(&w, field == 0 ? "time" : field == 1 ? "power" : field == 2 ? "current" : "voltage");
+      prev = 0;
+      for (i = 0; i < n; i++) {
+        at = (first + part * BL_TRACE_DUMP_PART + i) % bl_traceRingSize;
+        s = &bl_traceRing[at];
+        switch (field) {
+        case 0: cur = (int)s->timeMs; break;
+        case 1: cur = (int)floorf(s->power * 10.0f + 0.5f); break;
+        case 2: cur = s->current_mA; break;
+        default: cur = s->voltage_dV; break;
+        }
+        JSONW_Int(&w, 0, i == 0 ? cur : cur - prev);
+        prev = cur;
+      }
+      JSONW_EndArray(&w);
+    }
+    JSONW_EndObject(&w);
+    msg[out.replylen] = 0;
+    MQTT_PublishMain_StringString("energy_trace", msg, OBK_PUBLISH_FLAG_QOS_ZERO | OBK_PUBLISH_FLAG_TELE);
+    os_free(msg);
+  }
+}
+#endif
+
+static void BL_Trace_RunEverySecond(void) {
+  blTraceWindow_t *win;
+  int i;
+
+  for (i = 0; i < BL_TRACE_WINDOWS; i++) {
+    win = &bl_traceWindows[i];
+    if (win->seconds == 0) {
+      continue;
+    }
+    win->elapsed++;
+    if (win->elapsed < win->seconds) {
+      continue;
+    }
+#if ENABLE_MQTT
+    if (MQTT_IsReady() == true) {
+      BL_Trace_PublishWindow(win);
+    }
+#endif
+    BL_Trace_ResetWindow(win);
+  }
+}
+
+commandResult_t BL09XX_SetupEnergyWindows(const void *context, const char *cmd, const char *args, int cmdFlags)
+{
+  // SetupEnergyWindows enable [ring_size] [window1] [window2] [window3]
+  static const int defaultWindows[BL_TRACE_WINDOWS] = { 1, 10, 60 };
+  int ringSize;
+  int i, sec;
+
+  Tokenizer_TokenizeString(args, 0);
+  if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+    return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+  }
+  if (bl_traceRing != NULL) {
+    os_free(bl_traceRing);
+    bl_traceRing = NULL;
+  }
+  bl_traceRingSize = 0;
+  bl_traceRingCount = 0;
+  bl_traceRingNext = 0;
+  if (Tokenizer_GetArgInteger(0) == 0) {
+    bl_traceEnable = false;
+    for (i = 0; i < BL_TRACE_WINDOWS; i++) {
+      bl_traceWindows[i].seconds = 0;
+    }
+    addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Energy windows disabled");
+    return CMD_RES_OK;
+  }
+  ringSize = Tokenizer_GetArgIntegerDefault(1, 128);
+  /* Security limits for ring size, 0 means summaries only */
+  if (ringSize < 0)
+    ringSize = 0;
+  if (ringSize > 1024)
+    ringSize = 1024;
+  if (ringSize > 0) {
+    bl_traceRing = (blTraceSample_t*)os_malloc(ringSize * sizeof(blTraceSample_t));
+    if (bl_traceRing == NULL) {
+      addLogAdv(LOG_ERROR, LOG_FEATURE_ENERGYMETER, "Energy trace ring alloc failed");
+      return CMD_RES_ERROR;
+    }
+    bl_traceRingSize = ringSize;
+  }
+  for (i = 0; i < BL_TRACE_WINDOWS; i++) {
+    sec = Tokenizer_GetArgIntegerDefault(2 + i, defaultWindows[i]);
+    if (sec < 0)
+      sec = 0;
+    if (sec > 3600)
+      sec = 3600;
+    bl_traceWindows[i].seconds = sec;
+    BL_Trace_ResetWindow(&bl_traceWindows[i]);
+  }
+  bl_traceEnable = true;
+  addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "Energy windows %i/%i/%i s, ring %i",
+    bl_traceWindows[0].seconds, bl_traceWindows[1].seconds, bl_traceWindows[2].seconds, bl_traceRingSize);
+  return CMD_RES_OK;
+}
+
+commandResult_t BL09XX_EnergyTraceDump(const void *context, const char *cmd, const char *args, int cmdFlags)
+{
+  Tokenizer_TokenizeString(args, 0);
+  if (bl_traceRing == NULL) {
+    addLogAdv(LOG_ERROR, LOG_FEATURE_ENERGYMETER, "Energy trace ring is not enabled, see SetupEnergyWindows");
+    return CMD_RES_BAD_ARGUMENT;
+  }
+#if ENABLE_MQTT
+  if (MQTT_IsReady() == false) {
+    return CMD_RES_ERROR;
+  }
+  BL_Trace_PublishDump(Tokenizer_GetArgIntegerDefault(0, 0));
+#endif
+  return CMD_RES_OK;
+}
+
+// Work that does not have to follow every reading, so fast metering UARTs
+// only accumulate: end of statistics period with its MQTT JSON, and
+// write-behind of total consumption to flash vars.
+void BL_Shared_RunEverySecond(void) {
+  energysensdataset_t* sensdataset = &datasetlist[BL_SENSORS_IX_0];
+  channelSaveStats_t saveStats;
+  int saveDelay, saveInterval, savePending;
+  int i;
+
+  if (bl_sharedStarted == false) {
+    return;
+  }
+  if (energyCounterStatsEnable == true)
+  {
+    energyCounterPeriodSeconds++;
+    if (energyCounterPeriodSeconds >= energyCounterSampleInterval)
+    {
+      if (energyCounterMinutes != NULL) {
+        sensdataset->sensors[OBK_CONSUMPTION_LAST_HOUR].lastReading = 0;
+        for (i = 0; i < energyCounterSampleCount; i++) {
+          sensdataset->sensors[OBK_CONSUMPTION_LAST_HOUR].lastReading += energyCounterMinutes[i];
+        }
+      }
+#if ENABLE_MQTT
+      if ((energyCounterStatsJSONEnable == true) && (MQTT_IsReady() == true))
+      {
+        BL_PublishConsumptionStats();
+      }
+#endif
+      if (energyCounterMinutes != NULL)
+      {
+        for (i=energyCounterSampleCount-1;i>0;i--)
+        {
+          if (energyCounterMinutes[i-1]>0.0)
+          {
+            energyCounterMinutes[i] = energyCounterMinutes[i-1];
+          } else {
+            energyCounterMinutes[i] = 0.0;
+          }
+        }
+        energyCounterMinutes[0] = 0.0;
+      }
+      energyCounterPeriodSeconds = 0;
+      energyCounterMinutesIndex++;
+    }
+  }
+  if (bl_traceEnable == true) {
+    BL_Trace_RunEverySecond();
+  }
+#if ENABLE_BL_HISTORY
+  EnergyHistory_RunEverySecond();
+#endif
+  // same interval as remembered channels, see CHANNEL_SetSaveDelay
+  if (bl_totalSavePending) {
+    CHANNEL_GetSaveStats(&saveStats, &saveDelay, &saveInterval, &savePending);
+    bl_totalSaveAge++;
+    if (bl_totalSaveAge >= saveInterval) {
+      HAL_FlashVars_SaveTotalConsumption((float)sensdataset->sensors[OBK_CONSUMPTION_TOTAL].lastReading);
+      bl_totalSavePending = false;
+      bl_totalSaveAge = 0;
+    }
+  }
+}
+
 #if ENABLE_BL_TWIN
 void BL_ProcessUpdateEx(int asensdatasetix, float voltage, float current, float power,
   float frequency, float energyWh) {
@@ -630,14 +1066,11 @@ void BL_ProcessUpdate(float voltage, float current, float power,
 
   int i;
   int xPassedTicks;
-  cJSON* root;
-  cJSON* stats;
-  char *msg;
-  portTickType interval;
   time_t deviceTime;
 //  struct tm *ltm;
   char datetime[64];
   float diff;
+  float apparent;
 
   // I had reports that BL0942 sometimes gives 
   // a large, negative peak of current/power
@@ -663,17 +1096,17 @@ void BL_ProcessUpdate(float voltage, float current, float power,
   current = XJ_MovingAverage_float((float)sensdataset->sensors[OBK_CURRENT].lastReading, current);
 #endif
 
+  bl_readingsVersion++;
   sensdataset->sensors[OBK_VOLTAGE].lastReading = voltage;
   sensdataset->sensors[OBK_CURRENT].lastReading = current;
   sensdataset->sensors[OBK_POWER].lastReading = power;
   sensdataset->sensors[OBK_FREQUENCY].lastReading = frequency;
-  sensdataset->sensors[OBK_POWER_APPARENT].lastReading = sensdataset->sensors[OBK_VOLTAGE].lastReading * sensdataset->sensors[OBK_CURRENT].lastReading;
-  sensdataset->sensors[OBK_POWER_REACTIVE].lastReading = (sensdataset->sensors[OBK_POWER_APPARENT].lastReading <= fabsf((float)sensdataset->sensors[OBK_POWER].lastReading)
+  apparent = voltage * current;
+  sensdataset->sensors[OBK_POWER_APPARENT].lastReading = apparent;
+  sensdataset->sensors[OBK_POWER_REACTIVE].lastReading = (apparent <= fabsf(power)
     ? 0
-    : sqrtf(powf((float)sensdataset->sensors[OBK_POWER_APPARENT].lastReading, 2) -
-      powf((float)sensdataset->sensors[OBK_POWER].lastReading, 2)));
-  sensdataset->sensors[OBK_POWER_FACTOR].lastReading =
-    (sensdataset->sensors[OBK_POWER_APPARENT].lastReading == 0 ? 1 : sensdataset->sensors[OBK_POWER].lastReading / sensdataset->sensors[OBK_POWER_APPARENT].lastReading);
+    : sqrtf(apparent * apparent - power * power));
+  sensdataset->sensors[OBK_POWER_FACTOR].lastReading = (apparent == 0 ? 1 : power / apparent);
 
 
   sensors_reciveddata[asensdatasetix] = 1;
@@ -693,14 +1126,10 @@ void BL_ProcessUpdate(float voltage, float current, float power,
 
     sensdataset->sensors[OBK_CONSUMPTION_TOTAL].lastReading += (double)energy;
     energyCounterStamp[asensdatasetix] = xTaskGetTickCount();
-    #if ENABLE_BL_TWIN
+    // only IX0 goes to flash vars, IX1 is saved in BL09XX_SaveEmeteringStatistics()
     if (asensdatasetix == BL_SENSORS_IX_0) {
-      //update only IX0, IX1 will be saved later in BL09XX_SaveEmeteringStatistics()
-      HAL_FlashVars_SaveTotalConsumption((float)sensdataset->sensors[OBK_CONSUMPTION_TOTAL].lastReading);
+      bl_totalSavePending = true;
     }
-    #else
-    HAL_FlashVars_SaveTotalConsumption((float)sensdataset->sensors[OBK_CONSUMPTION_TOTAL].lastReading);
-    #endif
     sensdataset->sensors[OBK_CONSUMPTION_TODAY].lastReading += energy;
 
     if (TIME_IsTimeSynced()) {
@@ -739,113 +1168,13 @@ void BL_ProcessUpdate(float voltage, float current, float power,
 
     if ((energyCounterStatsEnable == true) && (asensdatasetix==BL_SENSORS_IX_0))
     {
-      interval = energyCounterSampleInterval;
-      interval *= (1000 / portTICK_PERIOD_MS);
-      if ((xTaskGetTickCount() - energyCounterMinutesStamp) >= interval)
-      {
-        if (energyCounterMinutes != NULL) {
-          sensdataset->sensors[OBK_CONSUMPTION_LAST_HOUR].lastReading = 0;
-          for (int i = 0; i < energyCounterSampleCount; i++) {
-            sensdataset->sensors[OBK_CONSUMPTION_LAST_HOUR].lastReading += energyCounterMinutes[i];
-          }
-        }
-#if ENABLE_MQTT
-        if ((energyCounterStatsJSONEnable == true) && (MQTT_IsReady() == true))
-        {
-          root = cJSON_CreateObject();
-          cJSON_AddNumberToObject(root, "uptime", g_secondsElapsed);
-          cJSON_AddNumberToObject(root, "consumption_total", BL_ChangeEnergyUnitIfNeeded(DRV_GetReading(OBK_CONSUMPTION_TOTAL)));
-          cJSON_AddNumberToObject(root, "consumption_last_hour", BL_ChangeEnergyUnitIfNeeded(DRV_GetReading(OBK_CONSUMPTION_LAST_HOUR)));
-          cJSON_AddNumberToObject(root, "consumption_stat_index", energyCounterMinutesIndex);
-          cJSON_AddNumberToObject(root, "consumption_sample_count", energyCounterSampleCount);
-          cJSON_AddNumberToObject(root, "consumption_sampling_period", energyCounterSampleInterval);
-          if(TIME_IsTimeSynced() == true)
-          {
-            cJSON_AddNumberToObject(root, "consumption_today", BL_ChangeEnergyUnitIfNeeded(DRV_GetReading(OBK_CONSUMPTION_TODAY)));
-            cJSON_AddNumberToObject(root, "consumption_yesterday", BL_ChangeEnergyUnitIfNeeded(DRV_GetReading(OBK_CONSUMPTION_YESTERDAY)));
-//            ltm = gmtime(&ConsumptionResetTime);
-/*
-            if (TIME_GetTimesZoneOfsSeconds()>0)
-            {
-              snprintf(datetime,sizeof(datetime), "%04i-%02i-%02iT%02i:%02i+%02i:%02i",
-                ltm->tm_year+1900, ltm->tm_mon+1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
-                TIME_GetTimesZoneOfsSeconds()/3600, (TIME_GetTimesZoneOfsSeconds()/60) % 60);
-            } else {
-              snprintf(datetime, sizeof(datetime), "%04i-%02i-%02iT%02i:%02i-%02i:%02i",
-                ltm->tm_year+1900, ltm->tm_mon+1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
-                abs(TIME_GetTimesZoneOfsSeconds()/3600), (abs(TIME_GetTimesZoneOfsSeconds())/60) % 60);
-            }
-*/
-            // optimized output: since we can be sure, a negative offset is minumum 1 hour, 
-            // the sign for the hour will be "-" for "negative" timezones 
-            //    this wouldn't work if a negative offset less than one hour would be possible
-/*
-            snprintf(datetime, sizeof(datetime), "%04i-%02i-%02iT%02i:%02i%+03i:%02i",
-                ltm->tm_year+1900, ltm->tm_mon+1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min,
-                TIME_GetTimesZoneOfsSeconds()/3600, (abs(TIME_GetTimesZoneOfsSeconds())/60) % 60);
-*/            
-            snprintf(datetime, sizeof(datetime), "%.16s%+03i:%02i",TS2STR(ConsumptionResetTime, TIME_FORMAT_ISO_8601),
-                TIME_GetTimesZoneOfsSeconds()/3600, (abs(TIME_GetTimesZoneOfsSeconds())/60) % 60);
-
-            cJSON_AddStringToObject(root, "consumption_clear_date", datetime);
-          }
-
-          if (energyCounterMinutes != NULL)
-          {
-            stats = cJSON_CreateArray();
-            // WARNING - it causes HA problems?
-            // See: https://github.com/openshwprojects/OpenBK7231T_App/issues/870
-            // Basically HA has 256 chars state limit?
-            // Wait, no, it's over 256 even without samples?
-            for(i = 0; i < energyCounterSampleCount; i++)
-            {
-              cJSON_AddItemToArray(stats, cJSON_CreateNumber(energyCounterMinutes[i]));
-            }
-            cJSON_AddItemToObject(root, "consumption_samples", stats);
-          }
-
-          if(NTP_IsTimeSynced() == true)
-          {
-            stats = cJSON_CreateArray();
-            for(i = OBK_CONSUMPTION__DAILY_FIRST; i <= OBK_CONSUMPTION__DAILY_LAST; i++)
-            {
-              cJSON_AddItemToArray(stats, cJSON_CreateNumber(DRV_GetReading(i)));
-            }
-            cJSON_AddItemToObject(root, "consumption_daily", stats);
-          }
-
-          msg = cJSON_PrintUnformatted(root);
-          cJSON_Delete(root);
-
-          // addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER, "JSON Printed: %d bytes", strlen(msg));
-
-          MQTT_PublishMain_StringString("consumption_stats", msg, 0);
-          stat_updatesSent[asensdatasetix]++;
-          os_free(msg);
-        }
-#endif
-
-        if (energyCounterMinutes != NULL)
-        {
-          for (i=energyCounterSampleCount-1;i>0;i--)
-          {
-            if (energyCounterMinutes[i-1]>0.0)
-            {
-              energyCounterMinutes[i] = energyCounterMinutes[i-1];
-            } else {
-              energyCounterMinutes[i] = 0.0;
-            }
-          }
-          energyCounterMinutes[0] = 0.0;
-        }
-        energyCounterMinutesStamp = xTaskGetTickCount();
-        energyCounterMinutesIndex++;
-
-      }
-
       if (energyCounterMinutes != NULL)
         energyCounterMinutes[0] += energy;
     }
+    if ((bl_traceEnable == true) && (asensdatasetix == BL_SENSORS_IX_0))
+    {
+      BL_Trace_AddSample(voltage, current, power, energy);
+    }
   }
   for (i = OBK__FIRST; i <= OBK__LAST; i++)
   {
@@ -932,7 +1261,7 @@ void BL_ProcessUpdate(float voltage, float current, float power,
         } else { //all other sensors
           float val = (float)sensdataset->sensors[i].lastReading;
           if (sensdataset->sensors[i].names.units == UNIT_WH) val = BL_ChangeEnergyUnitIfNeeded(val);
-          MQTT_PublishMain_StringFloat(sensdataset->sensors[i].names.name_mqtt, val, sensdataset->sensors[i].rounding_decimals, OBK_PUBLISH_FLAG_QOS_ZERO);
+          MQTT_PublishMain_StringFloat(sensdataset->sensors[i].names.name_mqtt, val, sensdataset->sensors[i].rounding_decimals, OBK_PUBLISH_FLAG_QOS_ZERO | OBK_PUBLISH_FLAG_TELE);
         }
         stat_updatesSent[asensdatasetix]++;
       }
@@ -974,6 +1303,8 @@ void BL_Shared_Init(void) {
   int i;
     ENERGY_METERING_DATA data;
 
+    bl_sharedStarted = true;
+
     for(i = OBK__FIRST; i <= OBK__LAST; i++)
     {
       sensdataset->sensors[i].noChangeFrame = 0;
@@ -994,7 +1325,7 @@ void BL_Shared_Init(void) {
             energyCounterMinutes[i] = 0.0;
           }
         }
-        energyCounterMinutesStamp = xTaskGetTickCount();
+        energyCounterPeriodSeconds = 0;
         energyCounterMinutesIndex = 0;
       }
 
@@ -1036,6 +1367,16 @@ void BL_Shared_Init(void) {
 	//cmddetail:"fn":"BL09XX_SetupEnergyStatistic","file":"driver/drv_bl_shared.c","requires":"",
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("SetupEnergyStats", BL09XX_SetupEnergyStatistic, NULL);
+	//cmddetail:{"name":"SetupEnergyWindows","args":"[Enable1or0][RingSize][Window1][Window2][Window3]",
+	//cmddetail:"descr":"High rate energy trace. Every reading is kept in a ring of RingSize [0..1024, default 128] and reduced into up to three windows in seconds [default 1, 10, 60, 0 turns a window off]. At end of each window min/max/mean/RMS power, RMS current and voltage and energy are published as JSON to energy_window_<seconds>. Ring is sent with EnergyTraceDump.",
+	//cmddetail:"fn":"BL09XX_SetupEnergyWindows","file":"driver/drv_bl_shared.c","requires":"",
+	//cmddetail:"examples":"`SetupEnergyWindows 1 256 1 10 60`"}
+    CMD_RegisterCommand("SetupEnergyWindows", BL09XX_SetupEnergyWindows, NULL);
+	//cmddetail:{"name":"EnergyTraceDump","args":"[MaxSamples]",
+	//cmddetail:"descr":"Publishes the energy trace ring of SetupEnergyWindows to energy_trace, oldest reading first, in parts of 64 readings. Arrays time (ms), power (0.1W), current (mA) and voltage (0.1V) are delta coded, first value is absolute and others are differences to previous one. MaxSamples limits dump to newest readings.",
+	//cmddetail:"fn":"BL09XX_EnergyTraceDump","file":"driver/drv_bl_shared.c","requires":"",
+	//cmddetail:"examples":"`EnergyTraceDump 100`"}
+    CMD_RegisterCommand("EnergyTraceDump", BL09XX_EnergyTraceDump, NULL);
 	//cmddetail:{"name":"ConsumptionThreshold","args":"[FloatValue]",
 	//cmddetail:"descr":"Setup value for automatic save of consumption data [1..100]",
 	//cmddetail:"fn":"BL09XX_SetupConsumptionThreshold","file":"driver/drv_bl_shared.c","requires":"",
@@ -1056,6 +1397,9 @@ void BL_Shared_Init(void) {
 	//cmddetail:"fn":"BL09XX_VCPPublishIntervals","file":"driver/drv_bl_shared.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("VCPPublishIntervals", BL09XX_VCPPublishIntervals, NULL);
+#if ENABLE_BL_HISTORY
+	EnergyHistory_Init();
+#endif
 }
 
 // OBK_POWER etc
@@ -1063,6 +1407,10 @@ float DRV_GetReading(energySensor_t type)
 {
 	return (float)datasetlist[BL_SENSORS_IX_0].sensors[type].lastReading;
 }
+int DRV_GetReadingsVersion()
+{
+	return bl_readingsVersion;
+}
 
 #if ENABLE_BL_TWIN
 int BL_IsMeteringDeviceIndexActive(int asensdatasetix){
@@ -10,10 +10,26 @@ void BL_ProcessUpdate(float voltage, float current, float power,
                       float frequency, float energyWh);
 void BL09XX_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
 void BL09XX_SaveEmeteringStatistics();
+// called from DRV_OnEverySecond
+void BL_Shared_RunEverySecond(void);
+// one reading for SetupEnergyWindows, BL_ProcessUpdate calls it for meters it serves
+void BL_Trace_AddSample(float voltage, float current, float power, float energyWh);
+
+#if ENABLE_BL_HISTORY
+// drv_bl_history.c
+void EnergyHistory_Init(void);
+void EnergyHistory_RunEverySecond(void);
+int EnergyHistory_HTTPQuery(http_request_t *request);
+#endif
 
 #define BL_SENSORS_IX_0 0
 #if ENABLE_BL_TWIN
 #define BL_SENSORS_IX_1 1
+#define BL_SENSDATASETS_COUNT 2
+#else
+#define BL_SENSDATASETS_COUNT 1
+#endif
+#if ENABLE_BL_TWIN
 
 void BL_ProcessUpdateEx(int asensdatasetix, float voltage, float current, float power,
   float frequency, float energyWh);
@@ -69,30 +69,8 @@ commandResult_t BMPI2C_Calibrate(const void* context, const char* cmd, const cha
 	return CMD_RES_OK;
 }
 
-void BMPI2C_Measure()
+static void BMPI2C_Publish()
 {
-	if(IsBMX280)
-	{
-		BMX280_Update();
-		delay_ms(125);
-		g_temperature = BMX280_ReadTemperature();
-		g_pressure = BMX280_ReadPressure();
-		if(IsBME280)
-		{
-			g_humidity = BME280_ReadHumidity();
-		}
-	}
-	else if(IsBMP180)
-	{
-		g_pressure = BMP180_ReadData(&g_temperature);
-	}
-	else if(IsBME68X)
-	{
-		BME68X_Update();
-		g_temperature = BME68X_ReadTemperature();
-		g_pressure = BME68X_ReadPressure();
-		g_humidity = BME68X_ReadHumidity();
-	}
 	g_temperature += g_calTemp;
 	g_pressure += g_calPres;
 	if(g_targetChannelTemperature != -1)
@@ -118,6 +96,45 @@ void BMPI2C_Measure()
 	}
 }
 
+// BMX280 conversion started by BMPI2C_Measure is done
+static void BMPI2C_ReadBMX280(softI2C_t *bus)
+{
+	g_temperature = BMX280_ReadTemperature();
+	g_pressure = BMX280_ReadPressure();
+	if(IsBME280)
+	{
+		g_humidity = BME280_ReadHumidity();
+	}
+	BMPI2C_Publish();
+}
+
+void BMPI2C_Measure()
+{
+	if(IsBMX280)
+	{
+		BMX280_Update();
+		I2CSched_Add(&g_softI2C, 125, BMPI2C_ReadBMX280);
+		return;
+	}
+	else if(IsBMP180)
+	{
+		g_pressure = BMP180_ReadData(&g_temperature);
+	}
+	else if(IsBME68X)
+	{
+		BME68X_Update();
+		g_temperature = BME68X_ReadTemperature();
+		g_pressure = BME68X_ReadPressure();
+		g_humidity = BME68X_ReadHumidity();
+	}
+	BMPI2C_Publish();
+}
+
+void BMPI2C_StopDriver()
+{
+	I2CSched_Cancel(&g_softI2C);
+}
+
 // startDriver BMPI2C 8 14 1 2 3 0
 // startDriver BMPI2C [CLK] [DATA] [ChannelForTemp] [ChannelForPressure] [ChannelForHumidity] [Addr]
 // Adr8bit 0 for 0x77, 1 for 0x76
@@ -0,0 +1,447 @@
+#include "../new_common.h"
+#include "../new_pins.h"
+#include "../new_cfg.h"
+// Commands register, execution API and cmd tokenizer
+#include "../cmnds/cmd_public.h"
+#include "../logging/logging.h"
+#include "../bitmessage/bitmessage_public.h"
+#include "../quicktick.h"
+#include "lwip/sockets.h"
+#include "lwip/ip_addr.h"
+#include "lwip/inet.h"
+#include "../httpserver/new_http.h"
+#include "drv_local.h"
+
+#if ENABLE_DRIVER_CHSYNC
+
+// Mirrors channels between OBK devices without MQTT broker. Device sends
+// its published channels that changed on next QuickTick, to multicast
+// group or to listed peers, and all of them again every CHSYNC_REFRESH_S
+// so device that rebooted catches up. Receiver maps channel of named
+// sender onto its own channel. Values that came are not sent again, so
+// two devices that mirror each other do not loop.
+//
+// Packet, made with bitmessage like device groups are:
+//   "OBKC", flags, zero terminated sender name, sequence (u16 LE)
+//   items up to end: byte with channel (low 6 bits) and value size - 1
+//   (high 2 bits), then signed value of 1-4 bytes LE
+// Sequence is per sender and older ones are ignored, but full refresh is
+// always taken, so sender that starts again from 0 is not ignored.
+//
+// startDriver ChSync [Name]
+// ChSync_Publish [Channel] [Channel2] ...
+// ChSync_Subscribe [Name] [RemoteChannel] [LocalChannel]
+// ChSync_Peer [IP]
+
+#define CHSYNC_HEADER			"OBKC"
+#define CHSYNC_FLAG_REFRESH		1
+#define CHSYNC_PORT				4449
+#define CHSYNC_MAX_PACKET		128
+#define CHSYNC_MAX_NAME			24
+#define CHSYNC_MAX_SUBS			16
+#define CHSYNC_MAX_SENDERS		8
+#define CHSYNC_MAX_PEERS		4
+#define CHSYNC_REFRESH_S		30
+#define CHSYNC_MAX_RECV_PER_TICK	16
+
+typedef struct chSyncSub_s {
+	char name[CHSYNC_MAX_NAME];
+	byte remoteChannel;
+	byte localChannel;
+} chSyncSub_t;
+
+typedef struct chSyncSender_s {
+	char name[CHSYNC_MAX_NAME];
+	uint16_t lastSeq;
+	// first packet is taken whatever its sequence is
+	bool bKnown;
+} chSyncSender_t;
+
+static const char *chsync_group = "239.255.250.250";
+static int g_chsync_socket = -1;
+static int g_chsync_retry = 5;
+static char g_chsync_name[CHSYNC_MAX_NAME];
+static uint16_t g_chsync_seq = 0;
+// bit per channel
+static unsigned int g_chsync_published[2];
+static unsigned int g_chsync_dirty[2];
+static bool g_chsync_refresh = false;
+static int g_chsync_refreshLeft = CHSYNC_REFRESH_S;
+static int g_chsync_lastSent[CHANNEL_MAX];
+// set while values that came are applied
+static bool g_chsync_applying = false;
+static chSyncSub_t g_chsync_subs[CHSYNC_MAX_SUBS];
+static int g_chsync_numSubs = 0;
+static chSyncSender_t g_chsync_senders[CHSYNC_MAX_SENDERS];
+static int g_chsync_numSenders = 0;
+static unsigned int g_chsync_peers[CHSYNC_MAX_PEERS];
+static int g_chsync_numPeers = 0;
+// statistics
+static unsigned int stat_chsyncSent = 0;
+static unsigned int stat_chsyncValuesSent = 0;
+static unsigned int stat_chsyncReceived = 0;
+static unsigned int stat_chsyncApplied = 0;
+static unsigned int stat_chsyncOld = 0;
+
+static bool ChSync_IsBitSet(const unsigned int *mask, int ch) {
+	return (mask[ch / 32] >> (ch % 32)) & 1;
+}
+
+static void ChSync_BeginPacket(bitMessage_t *msg, byte *buffer, int maxSize, const char *name, int flags, uint16_t seq) {
+	MSG_BeginWriting(msg, buffer, maxSize);
+	MSG_WriteBytes(msg, CHSYNC_HEADER, strlen(CHSYNC_HEADER));
+	MSG_WriteByte(msg, flags);
+	MSG_WriteString(msg, name);
+	MSG_WriteU16(msg, seq);
+}
+// false when item does not fit
+static bool ChSync_WriteItem(bitMessage_t *msg, int ch, int v) {
+	int size;
+
+	if (v >= -128 && v < 128) {
+		size = 1;
+	}
+	else if (v >= -32768 && v < 32768) {
+		size = 2;
+	}
+	else if (v >= -8388608 && v < 8388608) {
+		size = 3;
+	}
+	else {
+		size = 4;
+	}
+	if (msg->position + 1 + size >= msg->totalSize) {
+		return false;
+	}
+	MSG_WriteByte(msg, ch | ((size - 1) << 6));
+	MSG_WriteBytes(msg, &v, size);
+	return true;
+}
+int ChSync_Format(byte *buffer, int maxSize, const char *name, int flags, uint16_t seq, const int *chs, const int *vals, int count) {
+	bitMessage_t msg;
+	int i;
+
+	ChSync_BeginPacket(&msg, buffer, maxSize, name, flags, seq);
+	for (i = 0; i < count && ChSync_WriteItem(&msg, chs[i], vals[i]); i++) {
+	}
+	return msg.position;
+}
+
+static chSyncSender_t *ChSync_FindSender(const char *name) {
+	chSyncSender_t *s;
+	int i;
+
+	for (i = 0; i < g_chsync_numSenders; i++) {
+		if (!strcmp(g_chsync_senders[i].name, name)) {
+			return &g_chsync_senders[i];
+		}
+	}
+	if (g_chsync_numSenders >= CHSYNC_MAX_SENDERS) {
+		return 0;
+	}
+	s = &g_chsync_senders[g_chsync_numSenders++];
+	strcpy_safe(s->name, name, sizeof(s->name));
+	s->bKnown = false;
+	return s;
+}
+void ChSync_ProcessPacket(const byte *data, int len) {
+	char name[CHSYNC_MAX_NAME];
+	chSyncSender_t *sender;
+	bitMessage_t msg;
+	int flags, item, size, v, i;
+	uint16_t seq;
+
+	MSG_BeginReading(&msg, data, len);
+	if (MSG_CheckAndSkip(&msg, CHSYNC_HEADER, strlen(CHSYNC_HEADER)) == 0) {
+		return;
+	}
+	flags = MSG_ReadByte(&msg);
+	if (MSG_ReadString(&msg, name, sizeof(name)) <= 0) {
+		return;
+	}
+	// our own, back from multicast
+	if (!strcmp(name, g_chsync_name)) {
+		return;
+	}
+	stat_chsyncReceived++;
+	seq = MSG_ReadU16(&msg);
+	sender = ChSync_FindSender(name);
+	if (sender == 0) {
+		return;
+	}
+	if ((flags & CHSYNC_FLAG_REFRESH) == 0 && sender->bKnown && (short)(seq - sender->lastSeq) <= 0) {
+		stat_chsyncOld++;
+		return;
+	}
+	sender->lastSeq = seq;
+	sender->bKnown = true;
+	while (!MSG_EOF(&msg)) {
+		item = MSG_ReadByte(&msg);
+		size = (item >> 6) + 1;
+		if (msg.position + size > msg.totalSize) {
+			break;
+		}
+		v = 0;
+		memcpy(&v, msg.data + msg.position, size);
+		MSG_SkipBytes(&msg, size);
+		// sign extend
+		if (size < 4) {
+			v = (v << (32 - size * 8)) >> (32 - size * 8);
+		}
+		for (i = 0; i < g_chsync_numSubs; i++) {
+			if (g_chsync_subs[i].remoteChannel == (item & 0x3F) && !strcmp(g_chsync_subs[i].name, name)) {
+				g_chsync_applying = true;
+				CHANNEL_Set(g_chsync_subs[i].localChannel, v, 0);
+				g_chsync_applying = false;
+				stat_chsyncApplied++;
+			}
+		}
+	}
+}
+
+void DRV_ChSync_OnChannelsChanged(const int *chs, const int *vals, int count) {
+	int i;
+
+	if (g_chsync_applying) {
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		if (chs[i] < 0 || chs[i] >= CHANNEL_MAX || !ChSync_IsBitSet(g_chsync_published, chs[i])) {
+			continue;
+		}
+		if (vals[i] != g_chsync_lastSent[chs[i]]) {
+			g_chsync_dirty[chs[i] / 32] |= 1u << (chs[i] % 32);
+			QuickTick_Wake();
+		}
+	}
+}
+
+static void ChSync_CreateSocket() {
+	struct sockaddr_in addr;
+	struct ip_mreq mreq;
+	int flag = 1;
+
+	g_chsync_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (g_chsync_socket < 0) {
+		g_chsync_socket = -1;
+		addLogAdv(LOG_INFO, LOG_FEATURE_DRV, "ChSync failed to do socket\n");
+		return;
+	}
+	setsockopt(g_chsync_socket, SOL_SOCKET, SO_REUSEADDR, (char*)&flag, sizeof(flag));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(CHSYNC_PORT);
+	if (bind(g_chsync_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_DRV, "ChSync failed to do bind\n");
+		close(g_chsync_socket);
+		g_chsync_socket = -1;
+		return;
+	}
+	mreq.imr_multiaddr.s_addr = inet_addr(chsync_group);
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (setsockopt(g_chsync_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*)&mreq, sizeof(mreq)) < 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_DRV, "ChSync failed to join multicast, only peers will work\n");
+	}
+	lwip_fcntl(g_chsync_socket, F_SETFL, O_NONBLOCK);
+}
+static void ChSync_Send(const byte *data, int len) {
+	struct sockaddr_in addr;
+	int i;
+
+	stat_chsyncSent++;
+	if (g_chsync_socket < 0) {
+		return;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(CHSYNC_PORT);
+	if (g_chsync_numPeers == 0) {
+		addr.sin_addr.s_addr = inet_addr(chsync_group);
+		sendto(g_chsync_socket, (const char*)data, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+		return;
+	}
+	for (i = 0; i < g_chsync_numPeers; i++) {
+		addr.sin_addr.s_addr = g_chsync_peers[i];
+		sendto(g_chsync_socket, (const char*)data, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+	}
+}
+// all changed channels, in as few packets as they fit in
+static void ChSync_SendPending() {
+	byte buffer[CHSYNC_MAX_PACKET];
+	bitMessage_t msg;
+	int ch, n;
+
+	ch = 0;
+	while (ch < CHANNEL_MAX) {
+		ChSync_BeginPacket(&msg, buffer, sizeof(buffer), g_chsync_name,
+			g_chsync_refresh ? CHSYNC_FLAG_REFRESH : 0, ++g_chsync_seq);
+		for (n = 0; ch < CHANNEL_MAX; ch++) {
+			if (!ChSync_IsBitSet(g_chsync_dirty, ch)) {
+				continue;
+			}
+			g_chsync_lastSent[ch] = CHANNEL_Get(ch);
+			if (!ChSync_WriteItem(&msg, ch, g_chsync_lastSent[ch])) {
+				break;
+			}
+			n++;
+		}
+		if (n == 0) {
+			g_chsync_seq--;
+			break;
+		}
+		ChSync_Send(buffer, msg.position);
+		stat_chsyncValuesSent += n;
+	}
+	g_chsync_dirty[0] = g_chsync_dirty[1] = 0;
+	g_chsync_refresh = false;
+}
+void DRV_ChSync_RunQuickTick() {
+	byte buffer[CHSYNC_MAX_PACKET];
+	struct sockaddr_in addr;
+	socklen_t addrlen;
+	int nbytes, i;
+
+	if (g_chsync_dirty[0] || g_chsync_dirty[1]) {
+		ChSync_SendPending();
+	}
+	if (g_chsync_socket < 0) {
+		return;
+	}
+	CHANNEL_BeginBatch();
+	for (i = 0; i < CHSYNC_MAX_RECV_PER_TICK; i++) {
+		addrlen = sizeof(addr);
+		nbytes = recvfrom(g_chsync_socket, (char*)buffer, sizeof(buffer), 0, (struct sockaddr*)&addr, &addrlen);
+		if (nbytes <= 0) {
+			break;
+		}
+		ChSync_ProcessPacket(buffer, nbytes);
+	}
+	CHANNEL_CommitBatch();
+}
+static void ChSync_MarkAllDirty() {
+	g_chsync_dirty[0] = g_chsync_published[0];
+	g_chsync_dirty[1] = g_chsync_published[1];
+	g_chsync_refresh = true;
+	g_chsync_refreshLeft = CHSYNC_REFRESH_S;
+	QuickTick_Wake();
+}
+void DRV_ChSync_RunEverySecond() {
+	if (g_chsync_socket < 0) {
+		g_chsync_retry--;
+		if (g_chsync_retry <= 0) {
+			g_chsync_retry = 5;
+			ChSync_CreateSocket();
+		}
+	}
+	g_chsync_refreshLeft--;
+	if (g_chsync_refreshLeft <= 0) {
+		ChSync_MarkAllDirty();
+	}
+}
+void DRV_ChSync_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
+	if (bPreState) {
+		return;
+	}
+	hprintf255(request, "<h5>ChSync %s: sent %u packets (%u values), received %u (%u values applied, %u old)</h5>",
+		g_chsync_name, stat_chsyncSent, stat_chsyncValuesSent, stat_chsyncReceived, stat_chsyncApplied, stat_chsyncOld);
+}
+
+static commandResult_t CMD_ChSync_Publish(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int i, ch;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	for (i = 0; i < Tokenizer_GetArgsCount(); i++) {
+		ch = Tokenizer_GetArgInteger(i);
+		if (ch < 0 || ch >= CHANNEL_MAX) {
+			return CMD_RES_BAD_ARGUMENT;
+		}
+		g_chsync_published[ch / 32] |= 1u << (ch % 32);
+	}
+	// peers get new channels right away
+	ChSync_MarkAllDirty();
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_ChSync_Subscribe(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	chSyncSub_t *s;
+	int remote, local;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 3)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	remote = Tokenizer_GetArgInteger(1);
+	local = Tokenizer_GetArgInteger(2);
+	if (remote < 0 || remote >= CHANNEL_MAX || local < 0 || local >= CHANNEL_MAX) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	if (g_chsync_numSubs >= CHSYNC_MAX_SUBS) {
+		ADDLOG_ERROR(LOG_FEATURE_DRV, "ChSync_Subscribe: at most %i subscriptions", CHSYNC_MAX_SUBS);
+		return CMD_RES_ERROR;
+	}
+	s = &g_chsync_subs[g_chsync_numSubs++];
+	strcpy_safe(s->name, Tokenizer_GetArg(0), sizeof(s->name));
+	s->remoteChannel = remote;
+	s->localChannel = local;
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_ChSync_Peer(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	if (g_chsync_numPeers >= CHSYNC_MAX_PEERS) {
+		ADDLOG_ERROR(LOG_FEATURE_DRV, "ChSync_Peer: at most %i peers", CHSYNC_MAX_PEERS);
+		return CMD_RES_ERROR;
+	}
+	g_chsync_peers[g_chsync_numPeers++] = inet_addr(Tokenizer_GetArg(0));
+	return CMD_RES_OK;
+}
+
+void DRV_ChSync_Init() {
+	strcpy_safe(g_chsync_name, Tokenizer_GetArgsCount() > 1 ? Tokenizer_GetArg(1) : CFG_GetShortDeviceName(), sizeof(g_chsync_name));
+	g_chsync_published[0] = g_chsync_published[1] = 0;
+	g_chsync_dirty[0] = g_chsync_dirty[1] = 0;
+	g_chsync_refresh = false;
+	g_chsync_refreshLeft = CHSYNC_REFRESH_S;
+	g_chsync_seq = 0;
+	g_chsync_numSubs = 0;
+	g_chsync_numSenders = 0;
+	g_chsync_numPeers = 0;
+	stat_chsyncSent = 0;
+	stat_chsyncValuesSent = 0;
+	stat_chsyncReceived = 0;
+	stat_chsyncApplied = 0;
+	stat_chsyncOld = 0;
+	ChSync_CreateSocket();
+
+	//cmddetail:{"name":"ChSync_Publish","args":"[Channel][Channel2]...",
+	//cmddetail:"descr":"Sends given channels to other devices running ChSync whenever they change, and all of them every 30 seconds. Packets go to multicast group, or to peers added with ChSync_Peer.",
+	//cmddetail:"fn":"CMD_ChSync_Publish","file":"driver/drv_chSync.c","requires":"",
+	//cmddetail:"examples":"ChSync_Publish 1 5"}
+	CMD_RegisterCommand("ChSync_Publish", CMD_ChSync_Publish, NULL);
+	//cmddetail:{"name":"ChSync_Subscribe","args":"[Name][RemoteChannel][LocalChannel]",
+	//cmddetail:"descr":"Sets LocalChannel to RemoteChannel of device that runs ChSync with given Name (its short name by default, or one given to startDriver ChSync).",
+	//cmddetail:"fn":"CMD_ChSync_Subscribe","file":"driver/drv_chSync.c","requires":"",
+	//cmddetail:"examples":"ChSync_Subscribe kitchenSensor 5 10"}
+	CMD_RegisterCommand("ChSync_Subscribe", CMD_ChSync_Subscribe, NULL);
+	//cmddetail:{"name":"ChSync_Peer","args":"[IP]",
+	//cmddetail:"descr":"Sends published channels by unicast to given device instead of multicast, for networks where multicast does not get through. Can be used up to 4 times.",
+	//cmddetail:"fn":"CMD_ChSync_Peer","file":"driver/drv_chSync.c","requires":"",
+	//cmddetail:"examples":"ChSync_Peer 192.168.0.20"}
+	CMD_RegisterCommand("ChSync_Peer", CMD_ChSync_Peer, NULL);
+}
+void DRV_ChSync_Shutdown() {
+	if (g_chsync_socket >= 0) {
+		close(g_chsync_socket);
+		g_chsync_socket = -1;
+	}
+	g_chsync_published[0] = g_chsync_published[1] = 0;
+	g_chsync_dirty[0] = g_chsync_dirty[1] = 0;
+	g_chsync_numSubs = 0;
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include "../httpserver/new_http.h"
 #include "drv_ntp.h"
 #include "drv_deviceclock.h"
+#include "../littlefs/our_lfs.h"
 
 /*
 // Sample 1
@@ -204,12 +205,40 @@ goto again
 
 
 
+*/
+/*
+// Sample 10
+// Like Sample 8, but chart is kept in LittleFS, so a day of data is still
+// there after reboot or OTA. Samples are written every 15 minutes.
+startDriver charts
+startDriver NTP
+waitFor NTPState 1
+chart_create 288 2 2
+chart_setVar 0 "Temperature" "axtemp"
+chart_setVar 1 "Humidity" "axhum"
+chart_setAxis 0 "axtemp" 0 "Temperature (C)"
+chart_setAxis 1 "axhum" 1 "Humidity (%)"
+chart_persist dht_chart.bin 900
+// every 5 minutes
+addRepeatingEvent 300 -1 chart_addNow $CH1*0.1 $CH2
+
 */
 #define AX_RIGHT 1
+// Samples are kept as int16 columns, value is sample * 10^exp10 of its var.
+// Resolution starts at 0.01 and drops by 10 each time a value does not fit,
+// so a 48 sample chart of 3 vars takes 300 bytes of RAM instead of 600+.
+#define CHART_MIN_EXP10		-2
+#define CHART_MAX_EXP10		30
+#define CHART_SAMPLE_MAX	32767
+// no value, shown as gap
+#define CHART_SAMPLE_NONE	-32768
+#define CHART_BIN_VERSION	1
+
 typedef struct var_s {
 	char *title;
 	char *axis;
-	float *samples;
+	short *samples;
+	int exp10;
 } var_t;
 
 typedef struct axis_s {
@@ -222,11 +251,19 @@ typedef struct chart_s {
 	int maxSamples;
 	int nextSample;
 	int lastSample;
-	time_t *times;
+	uint32_t *times;
 	int numVars;
 	var_t *vars;
 	int numAxes;
 	axis_t *axes;
+	// LittleFS backing, see Chart_Flush
+	char *persistFile;
+	int flushInterval;
+	int flushCountdown;
+	// first slot that is not in file yet
+	int flushedSample;
+	// whole file must be written
+	bool persistAll;
 } chart_t;
 
 chart_t *g_chart = 0;
@@ -252,6 +289,9 @@ void Chart_Free(chart_t **ptr) {
 			if (s->vars[i].title) {
 				free(s->vars[i].title);
 			}
+			if (s->vars[i].axis) {
+				free(s->vars[i].axis);
+			}
 			if (s->vars[i].samples) {
 				free(s->vars[i].samples);
 			}
@@ -261,6 +301,7 @@ void Chart_Free(chart_t **ptr) {
 	if (s->times) {
 		free(s->times);
 	}
+	free(s->persistFile);
 	free(s);
 	*ptr = 0;
 }
@@ -272,6 +313,9 @@ byte *ZeroMalloc(unsigned int size) {
 	return r;
 }
 chart_t *Chart_Create(int maxSamples, int numVars, int numAxes) {
+	if (maxSamples < 2 || numVars < 1 || numVars > 255 || numAxes < 0) {
+		return NULL;
+	}
 	chart_t *s = (chart_t *)ZeroMalloc(sizeof(chart_t));
 	if (!s) {
 		return NULL;
@@ -281,13 +325,13 @@ chart_t *Chart_Create(int maxSamples, int numVars, int numAxes) {
 		free(s);
 		return NULL; 
 	}
-	s->axes = (axis_t *)ZeroMalloc(sizeof(axis_t) * numAxes);
+	s->axes = (axis_t *)ZeroMalloc(sizeof(axis_t) * (numAxes ? numAxes : 1));
 	if (!s->axes) {
 		free(s->vars);
 		free(s);
 		return NULL;
 	}
-	s->times = (time_t *)ZeroMalloc(sizeof(time_t) * maxSamples);
+	s->times = (uint32_t *)ZeroMalloc(sizeof(uint32_t) * maxSamples);
 	if (!s->times) {
 		free(s->axes);
 		free(s->vars);
@@ -296,7 +340,7 @@ chart_t *Chart_Create(int maxSamples, int numVars, int numAxes) {
 	}
 
 	for (int i = 0; i < numVars; i++) {
-		s->vars[i].samples = (float*)ZeroMalloc(sizeof(float) * maxSamples);
+		s->vars[i].samples = (short*)ZeroMalloc(sizeof(short) * maxSamples);
 		if (s->vars[i].samples == 0) {
 			for (int j = 0; j < i; j++) {
 				free(s->vars[j].samples);
@@ -307,6 +351,7 @@ chart_t *Chart_Create(int maxSamples, int numVars, int numAxes) {
 			free(s);
 			return NULL;
 		}
+		s->vars[i].exp10 = CHART_MIN_EXP10;
 	}
 	s->numAxes = numAxes;
 	s->numVars = numVars;
@@ -316,29 +361,86 @@ chart_t *Chart_Create(int maxSamples, int numVars, int numAxes) {
 	return s;
 }
 void Chart_SetAxis(chart_t *s, int idx, const char *name, int flags, const char *label) {
-	if (!s || idx >= s->numAxes) {
+	if (!s || idx < 0 || idx >= s->numAxes) {
 		return;
 	}
+	free(s->axes[idx].name);
+	free(s->axes[idx].label);
 	s->axes[idx].name = strdup(name);
 	s->axes[idx].label = strdup(label);
 	s->axes[idx].flags = flags;
 }
 void Chart_SetVar(chart_t *s, int idx, const char *title, const char *axis) {
-	if (!s || idx >= s->numVars) {
+	if (!s || idx < 0 || idx >= s->numVars) {
 		return;
 	}
+	free(s->vars[idx].title);
+	free(s->vars[idx].axis);
 	s->vars[idx].title = strdup(title);
 	s->vars[idx].axis = strdup(axis);
 }
+static float Chart_Pow10(int exp10) {
+	float r = 1.0f;
+
+	for (; exp10 > 0; exp10--) {
+		r *= 10.0f;
+	}
+	for (; exp10 < 0; exp10++) {
+		r *= 0.1f;
+	}
+	return r;
+}
+float Chart_GetScale(chart_t *s, int idx) {
+	return Chart_Pow10(s->vars[idx].exp10);
+}
+// value of idx-th sample in time order, NAN if there is none
+float Chart_GetSample(chart_t *s, int idx, int sample) {
+	short q = s->vars[idx].samples[(s->lastSample + sample) % s->maxSamples];
+
+	if (q == CHART_SAMPLE_NONE) {
+		return NAN;
+	}
+	return q * Chart_GetScale(s, idx);
+}
+int Chart_GetCount(chart_t *s) {
+	if (!s) {
+		return 0;
+	}
+	return (s->nextSample - s->lastSample + s->maxSamples) % s->maxSamples;
+}
 void Chart_SetSample(chart_t *s, int idx, float value) {
-	if (!s || idx >= s->numVars) {
-	bk_printf("DEBUG CHARTS: ERROR - Chart_SetSample ixd=%i /  s->numVars=%i / value=%f\n",idx, s->numVars,value); 
+	var_t *v;
+	float q;
+	int i;
+
+	if (!s || idx < 0 || idx >= s->numVars) {
 		return;
 	}
-	bk_printf("DEBUG CHARTS: OK - Chart_SetSample ixd=%i /  s->numVars=%i  / value=%f\n",idx, s->numVars,value); 
-	s->vars[idx].samples[s->nextSample] = value;
+	v = &s->vars[idx];
+	if (isnan(value) || isinf(value)) {
+		v->samples[s->nextSample] = CHART_SAMPLE_NONE;
+		return;
+	}
+	q = value / Chart_Pow10(v->exp10);
+	// coarser resolution for whole column, rare, only until it fits
+	while ((q > CHART_SAMPLE_MAX || q < -CHART_SAMPLE_MAX) && v->exp10 < CHART_MAX_EXP10) {
+		v->exp10++;
+		q *= 0.1f;
+		s->persistAll = true;
+		for (i = 0; i < s->maxSamples; i++) {
+			if (v->samples[i] != CHART_SAMPLE_NONE) {
+				v->samples[i] = (short)(v->samples[i] >= 0 ? (v->samples[i] + 5) / 10 : (v->samples[i] - 5) / 10);
+			}
+		}
+	}
+	if (q > CHART_SAMPLE_MAX) {
+		q = CHART_SAMPLE_MAX;
+	} else if (q < -CHART_SAMPLE_MAX) {
+		q = -CHART_SAMPLE_MAX;
+	}
+	v->samples[s->nextSample] = (short)(q >= 0 ? q + 0.5f : q - 0.5f);
 }
-void Chart_AddTime(chart_t *s, time_t time) {
+void Chart_AddTime(chart_t *s, uint32_t time) {
 	if (!s) {
 		return;
 	}
@@ -347,50 +449,336 @@ void Chart_AddTime(chart_t *s, time_t time) {
 	if (s->lastSample == s->nextSample) {
 		s->lastSample = (s->lastSample + 1) % s->maxSamples;
 	}
+	// went around since last flush, every slot is new
+	if (s->flushedSample == s->nextSample) {
+		s->persistAll = true;
+	}
 }
-void Chart_Iterate(chart_t *s, int index, void (*callback)(float *val, time_t *time, void *userData), void *userData) {
-	if (!s) {
-		return;
+// Largest-Triangle-Three-Buckets over all vars at once, so every var keeps
+// the same time axis. First and last samples are always kept, from every
+// bucket the one making largest triangle with previous pick and next bucket
+// average, which keeps peaks and dips that plain decimation would drop.
+// Vars are normalized to their range so one with big values does not decide.
+// Fills out with indexes in time order and returns their count.
+int Chart_Downsample(chart_t *s, int points, int *out) {
+	float *avg, *range, *minv;
+	float ax, cx, area, best, ay, by, cy;
+	int count, i, v, j, k, a, pick, from, to, nextFrom, nextTo;
+	float every;
+
+	count = Chart_GetCount(s);
+	if (points >= count || points < 3) {
+		for (i = 0; i < count; i++) {
+			out[i] = i;
+		}
+		return count;
+	}
+	avg = (float*)malloc(sizeof(float) * s->numVars * 3);
+	if (avg == 0) {
+		return 0;
+	}
+	range = avg + s->numVars;
+	minv = range + s->numVars;
+	for (v = 0; v < s->numVars; v++) {
+		minv[v] = INFINITY;
+		range[v] = -INFINITY;
+		for (i = 0; i < count; i++) {
+			by = Chart_GetSample(s, v, i);
+			if (isnan(by)) {
+				continue;
+			}
+			if (by < minv[v]) {
+				minv[v] = by;
+			}
+			if (by > range[v]) {
+				range[v] = by;
+			}
+		}
+		range[v] -= minv[v];
+		if (!(range[v] > 0)) {
+			range[v] = 1;
+			minv[v] = 0;
+		}
+	}
+	every = (float)(count - 2) / (points - 2);
+	a = 0;
+	k = 0;
+	out[k++] = 0;
+	for (j = 0; j < points - 2; j++) {
+		from = (int)(j * every) + 1;
+		to = (int)((j + 1) * every) + 1;
+		nextFrom = to;
+		nextTo = (int)((j + 2) * every) + 1;
+		if (nextTo > count) {
+			nextTo = count;
+		}
+		cx = (nextFrom + nextTo - 1) * 0.5f;
+		for (v = 0; v < s->numVars; v++) {
+			avg[v] = 0;
+			for (i = nextFrom; i < nextTo; i++) {
+				by = Chart_GetSample(s, v, i);
+				avg[v] += isnan(by) ? 0 : (by - minv[v]) / range[v];
+			}
+			avg[v] /= (nextTo - nextFrom);
+		}
+		ax = (float)a;
+		best = -1;
+		pick = from;
+		for (i = from; i < to; i++) {
+			area = 0;
+			for (v = 0; v < s->numVars; v++) {
+				ay = Chart_GetSample(s, v, a);
+				by = Chart_GetSample(s, v, i);
+				cy = avg[v];
+				ay = isnan(ay) ? 0 : (ay - minv[v]) / range[v];
+				by = isnan(by) ? 0 : (by - minv[v]) / range[v];
+				area += fabsf((ax - cx) * (by - ay) - (ax - i) * (cy - ay));
+			}
+			if (area > best) {
+				best = area;
+				pick = i;
+			}
+		}
+		out[k++] = pick;
+		a = pick;
 	}
-	int start = s->lastSample;
-	int end = s->nextSample;
+	out[k++] = count - 1;
+	free(avg);
+	return k;
+}
+static void Chart_PutU16(byte *p, int v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+static void Chart_PutU32(byte *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+#if ENABLE_LITTLEFS
+// Chart can be backed by LittleFS file, so it survives reboot and OTA.
+// File has same ring layout as RAM, so only records added since last flush
+// are written, once per flush interval, never for every sample:
+//   "OBKR", version, vars (u8), max samples (u16), next (u16), last (u16),
+//   scale exponent of every var (s8)
+//   max samples records of time (u32) and sample of every var (s16)
+// All little-endian. Whole file is written only when it is new or when
+// scale of a var changed, which also changed all its samples.
+#define CHART_FILE_VERSION	1
+#define CHART_FILE_HEADER	12
 
-	if (start <= end) {
-		for (int i = start; i < end; i++) {
-			callback(&s->vars[index].samples[i], &s->times[i], userData);
+static int Chart_RecordSize(chart_t *s) {
+	return 4 + s->numVars * 2;
+}
+static void Chart_PutRecord(chart_t *s, int slot, byte *out) {
+	Chart_PutU32(out, s->times[slot]);
+	for (int v = 0; v < s->numVars; v++) {
+		Chart_PutU16(out + 4 + v * 2, s->vars[v].samples[slot]);
+	}
+}
+static int Chart_PutHeader(chart_t *s, byte *out) {
+	memcpy(out, "OBKR", 4);
+	out[4] = CHART_FILE_VERSION;
+	out[5] = s->numVars;
+	Chart_PutU16(out + 6, s->maxSamples);
+	Chart_PutU16(out + 8, s->nextSample);
+	Chart_PutU16(out + 10, s->lastSample);
+	for (int v = 0; v < s->numVars; v++) {
+		out[CHART_FILE_HEADER + v] = (signed char)s->vars[v].exp10;
+	}
+	return CHART_FILE_HEADER + s->numVars;
+}
+// writes what changed since last flush, returns false on error
+bool Chart_Flush(chart_t *s) {
+	lfs_file_t *file;
+	byte *buf;
+	int recSize, len, slot, ok;
+
+	if (!s || !s->persistFile || !lfs_present()) {
+		return false;
+	}
+	if (!s->persistAll && s->flushedSample == s->nextSample) {
+		return true;
+	}
+	recSize = Chart_RecordSize(s);
+	buf = (byte*)malloc(CHART_FILE_HEADER + 255 > recSize ? CHART_FILE_HEADER + 255 : recSize);
+	file = (lfs_file_t*)os_malloc(sizeof(lfs_file_t));
+	if (buf == 0 || file == 0) {
+		free(buf);
+		os_free(file);
+		return false;
+	}
+	memset(file, 0, sizeof(lfs_file_t));
+	ok = lfs_file_open(&lfs, file, s->persistFile, LFS_O_RDWR | LFS_O_CREAT) >= 0;
+	if (ok) {
+		len = Chart_PutHeader(s, buf);
+		ok = lfs_file_write(&lfs, file, buf, len) == len;
+		if (s->persistAll) {
+			lfs_file_truncate(&lfs, file, len);
+			for (slot = 0; ok && slot < s->maxSamples; slot++) {
+				Chart_PutRecord(s, slot, buf);
+				ok = lfs_file_write(&lfs, file, buf, recSize) == recSize;
+			}
+		} else {
+			for (slot = s->flushedSample; ok && slot != s->nextSample; slot = (slot + 1) % s->maxSamples) {
+				Chart_PutRecord(s, slot, buf);
+				ok = lfs_file_seek(&lfs, file, len + slot * recSize, LFS_SEEK_SET) >= 0
+					&& lfs_file_write(&lfs, file, buf, recSize) == recSize;
+			}
+		}
+		if (lfs_file_close(&lfs, file) < 0) {
+			ok = 0;
+		}
+	}
+	if (ok) {
+		s->persistAll = false;
+		s->flushedSample = s->nextSample;
+	}
+	free(buf);
+	os_free(file);
+	return ok;
+}
+// loads samples from file if it was written for chart of same size
+static bool Chart_Restore(chart_t *s) {
+	lfs_file_t *file;
+	byte *buf;
+	int recSize, len, slot, v, ok, found;
+
+	recSize = Chart_RecordSize(s);
+	len = CHART_FILE_HEADER + s->numVars;
+	buf = (byte*)malloc(len > recSize ? len : recSize);
+	file = (lfs_file_t*)os_malloc(sizeof(lfs_file_t));
+	if (buf == 0 || file == 0) {
+		free(buf);
+		os_free(file);
+		return false;
+	}
+	memset(file, 0, sizeof(lfs_file_t));
+	found = lfs_file_open(&lfs, file, s->persistFile, LFS_O_RDONLY) >= 0;
+	ok = found;
+	if (found) {
+		ok = lfs_file_read(&lfs, file, buf, len) == len
+			&& !memcmp(buf, "OBKR", 4) && buf[4] == CHART_FILE_VERSION && buf[5] == s->numVars
+			&& (buf[6] | (buf[7] << 8)) == s->maxSamples
+			&& (buf[8] | (buf[9] << 8)) < s->maxSamples
+			&& (buf[10] | (buf[11] << 8)) < s->maxSamples;
+		if (ok) {
+			s->nextSample = buf[8] | (buf[9] << 8);
+			s->lastSample = buf[10] | (buf[11] << 8);
+			for (v = 0; v < s->numVars; v++) {
+				s->vars[v].exp10 = (signed char)buf[CHART_FILE_HEADER + v];
+			}
 		}
-	} else {
-		for (int i = start; i < s->maxSamples; i++) {
-			callback(&s->vars[index].samples[i], &s->times[i], userData);
+		for (slot = 0; ok && slot < s->maxSamples; slot++) {
+			ok = lfs_file_read(&lfs, file, buf, recSize) == recSize;
+			if (ok) {
+				s->times[slot] = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+				for (v = 0; v < s->numVars; v++) {
+					s->vars[v].samples[slot] = (short)(buf[4 + v * 2] | (buf[5 + v * 2] << 8));
+				}
+			}
 		}
-		for (int i = 0; i < end; i++) {
-			callback(&s->vars[index].samples[i], &s->times[i], userData);
+		lfs_file_close(&lfs, file);
+	}
+	if (found && !ok) {
+		// broken or foreign file, start again with empty chart
+		for (v = 0; v < s->numVars; v++) {
+			memset(s->vars[v].samples, 0, sizeof(short) * s->maxSamples);
+			s->vars[v].exp10 = CHART_MIN_EXP10;
 		}
+		s->nextSample = s->lastSample = 0;
 	}
+	s->flushedSample = s->nextSample;
+	s->persistAll = !ok;
+	free(buf);
+	os_free(file);
+	return ok;
 }
-void Chart_DisplayLabel(float *val, time_t *time, void *userData) {
-	char buffer[64];
-	http_request_t *request = (http_request_t *)userData;
-	if (request->userCounter != 0) {
-		poststr(request, ",");
+bool Chart_SetPersist(chart_t *s, const char *fileName, int flushSeconds) {
+	if (!s) {
+		return false;
+	}
+	free(s->persistFile);
+	s->persistFile = strdup(fileName);
+	s->flushInterval = flushSeconds;
+	s->flushCountdown = flushSeconds;
+	init_lfs(1);
+	if (!lfs_present()) {
+		return false;
 	}
-	request->userCounter++;
-	snprintf(buffer, sizeof(buffer), "%ld", (long)(*time));					// don't transmit too much data, use only the timestamps here and handle conversion later  ....
-	poststr(request, buffer);
+	return Chart_Restore(s);
 }
-void Chart_DisplayData(float *val, time_t *time, void *userData) {
-	char buffer[32];
-	http_request_t *request = (http_request_t *)userData;
-	if (request->userCounter != 0) {
-		poststr(request, ",");
+#endif
+// GET api/chart/<id>[?points=<N>], only chart 0 exists for now.
+// Little-endian binary, so page does not have to parse text:
+//   "OBKC", version (u8), vars (u8), count (u16)
+//   scale of every var (f32), value = sample * scale
+//   count sample times (u32, UTC)
+//   count samples (s16, -32768 is gap) of var 0, then of var 1, ...
+// With points, chart is downsampled to that many samples when it has more.
+int Chart_HTTPQuery(http_request_t *request) {
+	chart_t *s = g_chart;
+	byte buf[64];
+	char tmp[16];
+	int *idx;
+	int count, points, v, i, len;
+	uint32_t bits;
+	float scale;
+
+	if (strcmp(request->url + strlen("api/chart/"), "0") && strncmp(request->url + strlen("api/chart/"), "0?", 2)) {
+		s = 0;
+	}
+	count = Chart_GetCount(s);
+	if (s == 0 || count == 0) {
+		return http_rest_error(request, 404, "no chart");
+	}
+	points = count;
+	if (http_getArg(request->url, "points", tmp, sizeof(tmp))) {
+		points = atoi(tmp);
+	}
+	idx = (int*)malloc(sizeof(int) * count);
+	if (idx == 0) {
+		return http_rest_error(request, 500, "no memory");
+	}
+	count = Chart_Downsample(s, points, idx);
+	http_setup(request, httpMimeTypeBinary);
+	memcpy(buf, "OBKC", 4);
+	buf[4] = CHART_BIN_VERSION;
+	buf[5] = s->numVars;
+	Chart_PutU16(buf + 6, count);
+	postany(request, (const char*)buf, 8);
+	for (v = 0; v < s->numVars; v++) {
+		scale = Chart_GetScale(s, v);
+		memcpy(&bits, &scale, 4);
+		Chart_PutU32(buf, bits);
+		postany(request, (const char*)buf, 4);
+	}
+	// in small pieces, so nothing of chart size is on stack
+	len = 0;
+	for (i = 0; i < count; i++) {
+		Chart_PutU32(buf + len, s->times[(s->lastSample + idx[i]) % s->maxSamples]);
+		len += 4;
+		if (len == sizeof(buf) || i == count - 1) {
+			postany(request, (const char*)buf, len);
+			len = 0;
+		}
+	}
+	for (v = 0; v < s->numVars; v++) {
+		for (i = 0; i < count; i++) {
+			Chart_PutU16(buf + len, s->vars[v].samples[(s->lastSample + idx[i]) % s->maxSamples]);
+			len += 2;
+			if (len == sizeof(buf) || i == count - 1) {
+				postany(request, (const char*)buf, len);
+				len = 0;
+			}
+		}
 	}
-	request->userCounter++;
-	snprintf(buffer, sizeof(buffer), "%.2f", *val);
-	poststr(request, buffer);
+	poststr(request, NULL);
+	free(idx);
+	return 0;
 }
 void Chart_Display(http_request_t *request, chart_t *s) {
-	char buffer[64];
-
 	if (s == 0) {
 		poststr(request, "<h4>Chart is NULL</h4>");
 		return;
@@ -418,22 +806,20 @@ void Chart_Display(http_request_t *request, chart_t *s) {
 	poststr(request, "<canvas id=\"obkChart\" width=\"400\" height=\"200\"></canvas>");
 	poststr(request, "<script src=\"https://cdn.jsdelivr.net/npm/chart.js\"></script>");
 */
-	poststr(request, "<input type='hidden' id='chartlabels' value='");
-	request->userCounter = 0;
-	Chart_Iterate(s, 0, Chart_DisplayLabel, request);
-	poststr(request, "'>");
-	for (int i = 0; i < s->numVars; i++) {
-		hprintf255(request, "<input type='hidden' id='chartdata%i' value='",i);
-		request->userCounter = 0;
-		Chart_Iterate(s, i,  Chart_DisplayData, request);
-		poststr(request, "'>");
-	}
+	// only chart setup is in page, samples are fetched from api/chart/0,
+	// downsampled to canvas width (see Chart_HTTPQuery for format)
 	poststr(request, "<script>");
 	poststr(request, "function cha() {");
-	poststr(request, "var labels =document.getElementById('chartlabels').value.split(/\s*,\s*/).map(Number).map((x)=>new Date(x * 1000).toLocaleTimeString());"); // we transmitted only timestamps, let Javascript do the work to convert them ;-)
-	for (int i = 0; i < s->numVars; i++) {
-		hprintf255(request, "var data%i = document.getElementById('chartdata%i').value.split(/\s*,\s*/).map(Number);",i,i);	
-	}
+	poststr(request, "var c=document.getElementById('obkChart');");
+	poststr(request, "fetch('/api/chart/0?points='+(c.clientWidth||c.width)).then(r=>r.arrayBuffer()).then(b=>{");
+	poststr(request, "var d=new DataView(b),nv=d.getUint8(5),n=d.getUint16(6,1),o=8+nv*4,labels=[],data=[];");
+	poststr(request, "for(var i=0;i<n;i++)labels.push(new Date(d.getUint32(o+i*4,1)*1000).toLocaleTimeString());");
+	poststr(request, "o+=n*4;");
+	poststr(request, "for(var v=0;v<nv;v++){var s=d.getFloat32(8+v*4,1);data[v]=[];");
+	poststr(request, "for(var i=0;i<n;i++,o+=2){var q=d.getInt16(o,1);data[v].push(q==-32768?null:+(q*s).toPrecision(6));}}");
+	poststr(request, "chd(labels,data);});");
+	poststr(request, "}\n");
+	poststr(request, "function chd(labels,data) {");
 	poststr(request, "if (! window.obkChartInstance) {");
 	poststr(request, "console.log('Initializing chart');");
 	poststr(request, "var ctx = document.getElementById('obkChart');");
@@ -450,7 +836,7 @@ void Chart_Display(http_request_t *request, chart_t *s) {
 		}
 		poststr(request, "{");
 		hprintf255(request, "            label: '%s',", s->vars[i].title);
-		hprintf255(request, "            data: data%i,",i);
+		hprintf255(request, "            data: data[%i],",i);
 		if (i == 2) {
 			poststr(request, "                borderColor: 'rgba(155, 33, 55, 1)',");
 		}
@@ -502,9 +888,7 @@ void Chart_Display(http_request_t *request, chart_t *s) {
 	poststr(request, "else {\n");
 	poststr(request, "console.log('Updating chart');\n");
 	poststr(request, "	window.obkChartInstance.data.labels=labels;\n");
-	for (int i = 0; i < s->numVars; i++) {
-		hprintf255(request, "	window.obkChartInstance.data.datasets[%i].data=data%i;\n",i,i);	
-	}
+	poststr(request, "	data.forEach((x,i)=>window.obkChartInstance.data.datasets[i].data=x);\n");
 	poststr(request, "	window.obkChartInstance.update();\n");
 	poststr(request, "}\n}");
 	poststr(request, "</script>");
@@ -517,7 +901,12 @@ void DRV_Charts_AddToHtmlPage_Test(http_request_t *request, int bPreState) {
 	}
 	// chart_create [NumSamples] [NumVariables] [NumAxes]
 	// chart_create 16 3 2
-	chart_t *s = Chart_Create(16, 3, 2);
+	// page fetches samples of chart 0, so sample chart becomes chart 0
+	if (g_chart) {
+		Chart_Display(request, g_chart);
+		return;
+	}
+	chart_t *s = g_chart = Chart_Create(16, 3, 2);
 	// chart_setVar [VarIndex] [DisplayName] [AxisCode]
 	// chart_setVar 0 "Room t" "axtemp"
 	// chart_setVar 1 "Outside T" "axtemp"
@@ -558,7 +947,6 @@ void DRV_Charts_AddToHtmlPage_Test(http_request_t *request, int bPreState) {
 	Chart_SetSample(s, 2, 91);
 	Chart_AddTime(s, 1725656094);
 	Chart_Display(request, s);
-	Chart_Free(&s);
 }
 // startDriver Charts
 void DRV_Charts_AddToHtmlPage(http_request_t *request, int bPreState) {
@@ -651,13 +1039,14 @@ static commandResult_t CMD_Chart_Add(const void *context, const char *cmd, const
 	if (cnt < 2) {
 		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
-	int time = Tokenizer_GetArgInteger(0);
+	// plain number is taken as it is, expression goes through float and loses seconds
+	const char *timeArg = Tokenizer_GetArg(0);
+	uint32_t time = timeArg[strspn(timeArg, "0123456789")] ? Tokenizer_GetArgInteger(0) : strtoul(timeArg, 0, 10);
 	for (int i = 1; i < cnt; i++) {
 		float f = Tokenizer_GetArgFloat(i);
 		if (i > g_chart->numVars){
 //			ADDLOG_ERROR(LOG_FEATURE_CMD, "Can't set value %f for var %i, only %i vars defined (starting with 0)!",f, i-1, g_chart->numVars);
 			ADDLOG_ERROR(LOG_FEATURE_CMD, "Can't set value %f for var %i, only var %s%i defined!",f, i-1,  g_chart->numVars>1? "0-":"",g_chart->numVars-1);
-			bk_printf("CHARTS: Can't set value %f for var %i, only var %s%i defined!\n",f, i-1,  g_chart->numVars>1? "0-":"",g_chart->numVars-1);
 		return CMD_RES_BAD_ARGUMENT;
 		}
 		Chart_SetSample(g_chart, i - 1, f);
@@ -667,6 +1056,42 @@ static commandResult_t CMD_Chart_Add(const void *context, const char *cmd, const
 	return CMD_RES_OK;
 }
 
+#if ENABLE_LITTLEFS
+static commandResult_t CMD_Chart_Persist(const void *context, const char *cmd, const char *args, int flags) {
+	Tokenizer_TokenizeString(args, TOKENIZER_ALLOW_QUOTES);
+
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	if (g_chart == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "No chart, use chart_create first!");
+		return CMD_RES_ERROR;
+	}
+	int flushSeconds = Tokenizer_GetArgIntegerDefault(1, 600);
+	if (flushSeconds < 1) {
+		flushSeconds = 1;
+	}
+	if (Chart_SetPersist(g_chart, Tokenizer_GetArg(0), flushSeconds)) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "Chart restored from %s, %i samples", Tokenizer_GetArg(0), Chart_GetCount(g_chart));
+	}
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_Chart_Flush(const void *context, const char *cmd, const char *args, int flags) {
+	if (!Chart_Flush(g_chart)) {
+		return CMD_RES_ERROR;
+	}
+	return CMD_RES_OK;
+}
+#endif
+void DRV_Charts_RunEverySecond() {
+#if ENABLE_LITTLEFS
+	if (g_chart && g_chart->persistFile && --g_chart->flushCountdown <= 0) {
+		g_chart->flushCountdown = g_chart->flushInterval;
+		Chart_Flush(g_chart);
+	}
+#endif
+}
+
 void DRV_Charts_Init() {
 
 
@@ -696,6 +1121,18 @@ void DRV_Charts_Init() {
 	//cmddetail:"fn":"CMD_Chart_Add","file":"driver/drv_charts.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("chart_add", CMD_Chart_Add, NULL);
+#if ENABLE_LITTLEFS
+	//cmddetail:{"name":"chart_persist","args":"[file_name][flush_seconds]",
+	//cmddetail:"descr":"Backs chart by a LittleFS file, so samples survive reboot and OTA. Use after chart_create and its setup. Samples of file are loaded if it was written by chart of same size. New samples are written every flush_seconds [default 600], only those added since last write.",
+	//cmddetail:"fn":"CMD_Chart_Persist","file":"driver/drv_charts.c","requires":"",
+	//cmddetail:"examples":"`chart_persist chart0.bin 900`"}
+	CMD_RegisterCommand("chart_persist", CMD_Chart_Persist, NULL);
+	//cmddetail:{"name":"chart_flush","args":"",
+	//cmddetail:"descr":"Writes samples of persistent chart to its file now, for example before planned restart.",
+	//cmddetail:"fn":"CMD_Chart_Flush","file":"driver/drv_charts.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("chart_flush", CMD_Chart_Flush, NULL);
+#endif
 
 }
 
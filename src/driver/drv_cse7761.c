@@ -56,12 +56,7 @@ bool Cse7761ReadOnce(uint32_t log_level, uint32_t reg, uint32_t size, uint32_t*
 	//uint32_t timeout = millis() + 6;
 
 	rtos_delay_milliseconds(6);
-	for (int i = 0; i < UART_GetDataSize(); i++) {
-		if (i < sizeof(buffer)) {
-			buffer[i] = UART_GetByte(i);
-			rcvd++;
-		}
-	}
+	rcvd = UART_ReadInto(buffer, sizeof(buffer));
 	UART_ConsumeBytes(UART_GetDataSize());
 	//while (!TimeReached(timeout) && (rcvd <= size)) {
 	//	//  while (!TimeReached(timeout)) {
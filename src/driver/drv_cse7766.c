@@ -56,10 +56,13 @@ int CSE7766_TryToGetNextCSE7766Packet() {
     if(UART_GetByte(0) != 0x55 || UART_GetByte(1) != 0x5A) {
 		return 0;
 	}
+	// whole packet at once, parsed from copy
+	byte p[24];
+	UART_PeekInto(p, CSE7766_PACKET_LEN);
 	checksum = 0;
 
 	for(i = 2; i < CSE7766_PACKET_LEN-1; i++) {
-        checksum += UART_GetByte(i);
+        checksum += p[i];
     }
 
 #if 1
@@ -68,16 +71,16 @@ int CSE7766_TryToGetNextCSE7766Packet() {
 		char buffer2[32];
 		buffer_for_log[0] = 0;
 		for(i = 0; i < CSE7766_PACKET_LEN; i++) {
-            snprintf(buffer2, sizeof(buffer2), "%02X ", UART_GetByte(i));
+            snprintf(buffer2, sizeof(buffer2), "%02X ", p[i]);
             strcat_safe(buffer_for_log,buffer2,sizeof(buffer_for_log));
 		}
 		addLogAdv(LOG_INFO, LOG_FEATURE_ENERGYMETER,"CSE7766 received: %s\n", buffer_for_log);
 	}
 #endif
-	if(checksum != UART_GetByte(CSE7766_PACKET_LEN-1)) {
+	if(checksum != p[CSE7766_PACKET_LEN-1]) {
         ADDLOG_INFO(LOG_FEATURE_ENERGYMETER,
                     "Skipping packet with bad checksum %02X wanted %02X\n",
-                    checksum, UART_GetByte(CSE7766_PACKET_LEN - 1));
+                    checksum, p[CSE7766_PACKET_LEN - 1]);
         UART_ConsumeBytes(CSE7766_PACKET_LEN);
 		return 1;
 	}
@@ -137,9 +140,9 @@ int CSE7766_TryToGetNextCSE7766Packet() {
 		backlog startDriver CSE7766; uartFakeHex 555A02FCD800062F00413200D7F2537B18023E9F7171FEEC
 		*/
 
-#define CSC_GetByte(x) ((unsigned long)UART_GetByte(x))
+#define CSC_GetByte(x) ((unsigned long)p[x])
 
-        adjustement = UART_GetByte(20);
+        adjustement = p[20];
         int vol_par =
 			CSC_GetByte(2) << 16 | CSC_GetByte(3) << 8 | CSC_GetByte(4);
         int cur_par =
@@ -147,7 +150,7 @@ int CSE7766_TryToGetNextCSE7766Packet() {
         int pow_par =
 			CSC_GetByte(14) << 16 | CSC_GetByte(15) << 8 | CSC_GetByte(16);
         float raw_unscaled_voltage =
-			CSC_GetByte(5) << 16 | CSC_GetByte(6) << 8 | UART_GetByte(7);
+			CSC_GetByte(5) << 16 | CSC_GetByte(6) << 8 | p[7];
         float raw_unscaled_current =
 			CSC_GetByte(11) << 16 | CSC_GetByte(12) << 8 | CSC_GetByte(13);
         float raw_unscaled_power =
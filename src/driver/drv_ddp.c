@@ -13,16 +13,15 @@
 #include "../httpserver/new_http.h"
 #include "drv_local.h"
 
-#if ENABLE_DRIVER_SM16703P
-#include "drv_spiLED.h"
-#endif
-
 static const char* group = "239.255.250.250";
 static int port = 4048;
 static int g_ddp_socket_receive = -1;
 static int g_retry_delay = 5;
 int stat_ddpPacketsReceived = 0;
 static int stat_ddpBytesReceived = 0;
+static int stat_ddpFramesPushed = 0;
+// senders that never set PUSH get every packet shown at once
+static bool g_ddpPushSeen = false;
 static char *g_ddp_buffer = 0;
 static int g_ddp_bufferSize = 512;
 
@@ -120,35 +119,57 @@ void DRV_DDP_CreateSocket_Receive() {
 
 	addLogAdv(LOG_INFO, LOG_FEATURE_DDP,"Waiting for packets\n");
 }
+#define DDP_FLAGS_PUSH			0x01
+#define DDP_FLAGS_TIMECODE		0x10
+#define DDP_HEADER_SIZE			10
+// time DRV_DDP_RunFrame may spend on queued packets before giving QuickTick back
+#define DDP_RUNFRAME_BUDGET_MS	10
+
 void DDP_Parse(byte *data, int len) {
-	if(len > 12) {
+	int hdr = DDP_HEADER_SIZE;
+
+	if (data[0] & DDP_FLAGS_TIMECODE) {
+		hdr += 4;
+	}
+	if(len > hdr + 2) {
 		byte r, g, b;
 
 		// This is done by WLED, but not checked in Tasmota
 		// data type 0x1B (formerly 0x1A) is RGBW (type 3, 8 bit/channel)
 		byte bytesPerPixel = ((data[2] & 0b00111000) >> 3 == 0b011) ? 4 : 3;
 
-#if ENABLE_DRIVER_SM16703P
 		if (Strip_IsActive()) {
-			// Note that this is limited by DDP msgbuf size
-			uint32_t numPixels = (len - 10) / 3;
+			// offset and length are in bytes, big endian
+			uint32_t offset = (data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
+			int dataLen = (data[8] << 8) | data[9];
+			bool bPush = (data[0] & DDP_FLAGS_PUSH) != 0;
+
+			if (dataLen > len - hdr) {
+				dataLen = len - hdr;
+			}
 			// debug
-			//addLogAdv(LOG_INFO, LOG_FEATURE_DDP, "DDP_Parse: STRIP path: %i pixels", numPixels);
-			// This immediately activates the pixels, maybe we should read the PUSH flag
-			Strip_setMultiplePixel(numPixels, &data[10], true);
+			//addLogAdv(LOG_INFO, LOG_FEATURE_DDP, "DDP_Parse: STRIP path: %i bytes at %i", dataLen, offset);
+			Strip_BlitPixels(offset / bytesPerPixel, &data[hdr], dataLen / bytesPerPixel, bytesPerPixel);
+			if (bPush) {
+				g_ddpPushSeen = true;
+			}
+			// frame can span many packets, last one has PUSH
+			if (bPush || g_ddpPushSeen == false) {
+				stat_ddpFramesPushed++;
+				Strip_Apply();
+			}
 		} else
-#endif
 		{
-			r = data[10];
-			g = data[11];
-			b = data[12];
+			r = data[hdr];
+			g = data[hdr + 1];
+			b = data[hdr + 2];
 
 			//addLogAdv(LOG_INFO, LOG_FEATURE_DDP, "DDP_Parse: bulb path");
 
 #if ENABLE_LED_BASIC
 			LED_SetDimmerIfChanged(100);
 			if (data[9] == 4) {
-				LED_SetFinalRGBW(r, g, b, data[13]);
+				LED_SetFinalRGBW(r, g, b, data[hdr + 3]);
 			}
 			else {
 				LED_SetFinalRGB(r, g, b);
@@ -160,6 +181,7 @@ void DDP_Parse(byte *data, int len) {
 void DRV_DDP_RunFrame() {
 	struct sockaddr_in addr;
 	int nbytes;
+	portTickType start;
 
 	if(g_ddp_socket_receive<0) {
 		g_retry_delay--;
@@ -172,6 +194,7 @@ void DRV_DDP_RunFrame() {
         }
     // now just enter a read-print loop
     //
+	start = xTaskGetTickCount();
 	while (1) {
 		socklen_t addrlen = sizeof(addr);
 		nbytes = recvfrom(
@@ -193,8 +216,9 @@ void DRV_DDP_RunFrame() {
 
 		DDP_Parse((byte*)g_ddp_buffer, nbytes);
 
-		if (stat_ddpPacketsReceived % 10 == 0) {
-			rtos_delay_milliseconds(5);
+		// rest waits in socket for next QuickTick
+		if ((xTaskGetTickCount() - start) * portTICK_PERIOD_MS >= DDP_RUNFRAME_BUDGET_MS) {
+			return;
 		}
 	}
 }
@@ -210,7 +234,7 @@ void DRV_DDP_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreS
 	if (bPreState){
 		return;
 	}
-	hprintf255(request, "<h2>DDP received: %i packets, %i bytes</h2>", stat_ddpPacketsReceived, stat_ddpBytesReceived);
+	hprintf255(request, "<h2>DDP received: %i packets, %i bytes, %i frames</h2>", stat_ddpPacketsReceived, stat_ddpBytesReceived, stat_ddpFramesPushed);
 }
 void DRV_DDP_Init()
 {
@@ -3,15 +3,296 @@
 #include "../new_cfg.h"
 // Commands register, execution API and cmd tokenizer
 #include "../cmnds/cmd_public.h"
-#include "../mqtt/new_mqtt.h"
 #include "../logging/logging.h"
 #include "../hal/hal_pins.h"
-#include "../hal/hal_wifi.h"
+#include "../quicktick.h"
 #include "drv_public.h"
 #include "drv_local.h"
-#include "drv_ssdp.h"
 #include "../httpserver/new_http.h"
 
-int sourceChannel;
-int currentValue;
-int margin;
+#if ENABLE_DRIVER_DEBOUNCER
+
+// Debounced inputs for reed switches, flow meters and similar.
+// ISR only stamps edge into queue, QuickTick replays edges with their own
+// times, so resolution does not depend on how often QuickTick runs and an
+// idle input costs nothing.
+//
+// Glitch window - level must stay that long to be taken, shorter pulses
+// are dropped.
+// Debounce window - after taken change, edges are only counted as bounces
+// until window passes, then current level is taken.
+// Adaptive - when change had bounces, window is doubled up to max, after
+// quiet changes it goes back down to base.
+
+#define DEBOUNCER_MAX				8
+#define DEBOUNCER_QUEUE_SIZE		64
+// bounces after change that count as chatter
+#define DEBOUNCER_CHATTER			2
+// changes without chatter before window goes down
+#define DEBOUNCER_QUIET				8
+
+typedef struct debouncer_s {
+	byte pin;
+	// level taken and raw level after last replayed edge
+	byte level;
+	byte raw;
+	byte quiet;
+	short channel;
+	short countChannel;
+	unsigned short window;
+	unsigned short baseWindow;
+	unsigned short maxWindow;
+	unsigned short glitch;
+	unsigned short bounces;
+	uint32_t rawSince;
+	uint32_t changedAt;
+	unsigned int changes;
+	unsigned int glitches;
+	unsigned int totalBounces;
+} debouncer_t;
+
+typedef struct debouncerEdge_s {
+	uint32_t time;
+	byte slot;
+	byte level;
+} debouncerEdge_t;
+
+static debouncer_t g_debouncers[DEBOUNCER_MAX];
+static int g_debouncerCount = 0;
+// slot + 1 for pin, 0 if pin is not debounced
+static byte g_debouncerPinSlot[PLATFORM_GPIO_MAX];
+static debouncerEdge_t g_debouncerEdges[DEBOUNCER_QUEUE_SIZE];
+// head is moved only by ISR, tail only by QuickTick
+static volatile unsigned int g_debouncerHead = 0;
+static volatile unsigned int g_debouncerTail = 0;
+static volatile unsigned int g_debouncerLost = 0;
+
+// NOTE: ISR
+static void Debouncer_Interrupt(int gpio) {
+	unsigned int head = g_debouncerHead;
+	debouncerEdge_t *e;
+
+	if (g_debouncerPinSlot[gpio] == 0) {
+		return;
+	}
+	if (head - g_debouncerTail >= DEBOUNCER_QUEUE_SIZE) {
+		g_debouncerLost++;
+		return;
+	}
+	e = &g_debouncerEdges[head % DEBOUNCER_QUEUE_SIZE];
+	e->time = SYSPERF_GetTimeMs();
+	e->slot = g_debouncerPinSlot[gpio] - 1;
+	e->level = HAL_PIN_ReadDigitalInput(gpio);
+	OBK_SMP_BARRIER();
+	g_debouncerHead = head + 1;
+	QuickTick_WakeFromISR();
+}
+
+static void Debouncer_Take(debouncer_t *d) {
+	if (d->maxWindow > d->baseWindow) {
+		if (d->bounces >= DEBOUNCER_CHATTER) {
+			d->window = d->window * 2 < d->maxWindow ? d->window * 2 : d->maxWindow;
+			d->quiet = 0;
+		}
+		else if (++d->quiet >= DEBOUNCER_QUIET) {
+			d->quiet = 0;
+			d->window -= d->window / 4;
+			if (d->window / 4 == 0 || d->window < d->baseWindow) {
+				d->window = d->baseWindow;
+			}
+		}
+	}
+	d->level = d->raw;
+	// window is counted from real edge, not from when it was taken
+	d->changedAt = d->rawSince;
+	d->bounces = 0;
+	d->changes++;
+	CHANNEL_Set(d->channel, d->level, 0);
+	if (d->level && d->countChannel >= 0) {
+		CHANNEL_Add(d->countChannel, 1);
+	}
+}
+// raw level did not change until given time
+static void Debouncer_Advance(debouncer_t *d, uint32_t time) {
+	if (d->raw == d->level) {
+		return;
+	}
+	if ((int)(time - d->rawSince) < d->glitch || (int)(time - d->changedAt) < d->window) {
+		return;
+	}
+	Debouncer_Take(d);
+}
+static void Debouncer_Edge(debouncer_t *d, uint32_t time, byte level) {
+	if (level == d->raw) {
+		return;
+	}
+	if ((int)(time - d->changedAt) < d->window) {
+		d->bounces++;
+		d->totalBounces++;
+	}
+	else if (level == d->level) {
+		// pulse ended before glitch window
+		d->glitches++;
+	}
+	d->raw = level;
+	d->rawSince = time;
+}
+void Debouncer_RunQuickTick() {
+	unsigned int tail;
+	debouncerEdge_t *e;
+	debouncer_t *d;
+	uint32_t now;
+	int i;
+
+	if (g_debouncerCount == 0) {
+		return;
+	}
+	now = SYSPERF_GetTimeMs();
+	tail = g_debouncerTail;
+	while (tail != g_debouncerHead) {
+		OBK_SMP_BARRIER();
+		e = &g_debouncerEdges[tail % DEBOUNCER_QUEUE_SIZE];
+		d = &g_debouncers[e->slot];
+		Debouncer_Advance(d, e->time);
+		Debouncer_Edge(d, e->time, e->level);
+		tail++;
+		OBK_SMP_BARRIER();
+		g_debouncerTail = tail;
+	}
+	for (i = 0; i < g_debouncerCount; i++) {
+		Debouncer_Advance(&g_debouncers[i], now);
+	}
+}
+// -1 when no input waits for its window
+int Debouncer_GetTimeToNextWakeMS() {
+	debouncer_t *d;
+	uint32_t now;
+	int i, due, next = -1;
+
+	if (g_debouncerCount == 0) {
+		return -1;
+	}
+	now = SYSPERF_GetTimeMs();
+	for (i = 0; i < g_debouncerCount; i++) {
+		d = &g_debouncers[i];
+		if (d->raw == d->level) {
+			continue;
+		}
+		due = d->glitch - (int)(now - d->rawSince);
+		if (d->window - (int)(now - d->changedAt) > due) {
+			due = d->window - (int)(now - d->changedAt);
+		}
+		if (due < 0) {
+			due = 0;
+		}
+		if (next == -1 || due < next) {
+			next = due;
+		}
+	}
+	return next;
+}
+
+static void Debouncer_DetachAll() {
+	int i;
+
+	for (i = 0; i < g_debouncerCount; i++) {
+		HAL_DetachInterrupt(g_debouncers[i].pin);
+		g_debouncerPinSlot[g_debouncers[i].pin] = 0;
+	}
+	g_debouncerCount = 0;
+	g_debouncerTail = g_debouncerHead;
+}
+// Debouncer_Add [Pin] [Channel] [WindowMS] [GlitchMS] [MaxWindowMS] [CountChannel]
+static commandResult_t CMD_Debouncer_Add(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	debouncer_t *d;
+	int pin, slot;
+	uint32_t now;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 3)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	pin = Tokenizer_GetPin(0, -1);
+	if (pin < 0 || pin >= PLATFORM_GPIO_MAX) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	slot = g_debouncerPinSlot[pin] - 1;
+	if (slot < 0) {
+		if (g_debouncerCount >= DEBOUNCER_MAX) {
+			ADDLOG_ERROR(LOG_FEATURE_DRV, "Debouncer: at most %i inputs", DEBOUNCER_MAX);
+			return CMD_RES_ERROR;
+		}
+		slot = g_debouncerCount;
+	}
+	d = &g_debouncers[slot];
+	memset(d, 0, sizeof(*d));
+	d->pin = pin;
+	d->channel = Tokenizer_GetArgInteger(1);
+	d->baseWindow = Tokenizer_GetArgIntegerRange(2, 0, 60000);
+	d->glitch = Tokenizer_GetArgIntegerRange(3, 0, 60000);
+	d->maxWindow = Tokenizer_GetArgIntegerRange(4, 0, 60000);
+	d->countChannel = Tokenizer_GetArgIntegerDefault(5, -1);
+	if (d->maxWindow < d->baseWindow) {
+		d->maxWindow = d->baseWindow;
+	}
+	d->window = d->baseWindow;
+
+	HAL_PIN_Setup_Input_Pullup(pin);
+	now = SYSPERF_GetTimeMs();
+	d->level = d->raw = HAL_PIN_ReadDigitalInput(pin);
+	d->rawSince = now;
+	// first edge does not wait for window
+	d->changedAt = now - d->window;
+	CHANNEL_Set(d->channel, d->level, 0);
+	if (slot == g_debouncerCount) {
+		g_debouncerPinSlot[pin] = slot + 1;
+		g_debouncerCount++;
+	}
+	HAL_AttachInterrupt(pin, INTERRUPT_CHANGE, Debouncer_Interrupt);
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_Debouncer_Clear(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Debouncer_DetachAll();
+	return CMD_RES_OK;
+}
+
+void Debouncer_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
+	debouncer_t *d;
+	int i;
+
+	if (bPreState) {
+		return;
+	}
+	for (i = 0; i < g_debouncerCount; i++) {
+		d = &g_debouncers[i];
+		hprintf255(request, "<h5>Debouncer P%i: %i, window %i ms, changes %u, bounces %u, glitches %u</h5>",
+			d->pin, d->level, d->window, d->changes, d->totalBounces, d->glitches);
+	}
+	if (g_debouncerLost) {
+		hprintf255(request, "<h5>Debouncer: %u edges lost</h5>", g_debouncerLost);
+	}
+}
+void Debouncer_Stop() {
+	Debouncer_DetachAll();
+}
+// startDriver Debouncer
+// Debouncer_Add 7 1 20
+void Debouncer_Init() {
+	g_debouncerCount = 0;
+	memset(g_debouncerPinSlot, 0, sizeof(g_debouncerPinSlot));
+	g_debouncerTail = g_debouncerHead;
+	g_debouncerLost = 0;
+
+	//cmddetail:{"name":"Debouncer_Add","args":"[Pin] [Channel] [WindowMS] [GlitchMS] [MaxWindowMS] [CountChannel]",
+	//cmddetail:"descr":"Debounces pin on its edge interrupts and sets its level to channel. After a change, edges within WindowMS are taken as bounces. Pulses shorter than GlitchMS are dropped. With MaxWindowMS over WindowMS, window doubles when bounces are seen, up to MaxWindowMS, and goes back down after quiet changes. Optional CountChannel is increased on each rising change, for flow meters. Adding the same pin again changes its settings.",
+	//cmddetail:"fn":"CMD_Debouncer_Add","file":"driver/drv_debouncer.c","requires":"",
+	//cmddetail:"examples":"Debouncer_Add 7 1 20 2 200"}
+	CMD_RegisterCommand("Debouncer_Add", CMD_Debouncer_Add, NULL);
+	//cmddetail:{"name":"Debouncer_Clear","args":"",
+	//cmddetail:"descr":"Removes all debounced inputs.",
+	//cmddetail:"fn":"CMD_Debouncer_Clear","file":"driver/drv_debouncer.c","requires":"",
+	//cmddetail:"examples":"Debouncer_Clear"}
+	CMD_RegisterCommand("Debouncer_Clear", CMD_Debouncer_Clear, NULL);
+}
+
+#endif
@@ -40,7 +40,7 @@ void DHT_OnPinsConfigChanged() {
 		if (g_dhts) {
 			for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
 				if (g_dhts[i]) {
-					free(g_dhts[i]);
+					DHT_Free(g_dhts[i]);
 					g_dhts[i] = 0;
 				}
 			}
@@ -62,7 +62,7 @@ void DHT_OnPinsConfigChanged() {
 		}
 		else {
 			if (g_dhts[i] != 0) {
-				free(g_dhts[i]);
+				DHT_Free(g_dhts[i]);
 				g_dhts[i] = 0;
 			}
 		}
@@ -92,7 +92,7 @@ void DHT_OnEverySecond() {
 		}
 		else {
 			if (g_dhts[i] != 0) {
-				free(g_dhts[i]);
+				DHT_Free(g_dhts[i]);
 				g_dhts[i] = 0;
 			}
 		}
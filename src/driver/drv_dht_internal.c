@@ -84,6 +84,77 @@ dht_t *DHT_Create(byte pin, byte type) {
 
 	return ret;
 }
+
+#if DHT_USE_CAPTURE
+// sensor whose frame is being captured, one at a time
+static dht_t *volatile g_dhtCapture = 0;
+
+static void DHT_EdgeInterrupt(int gpio) {
+	dht_t *dht = g_dhtCapture;
+
+	if (dht == 0 || dht->numEdges >= DHT_MAX_EDGES) {
+		return;
+	}
+	dht->edges[dht->numEdges++] = (uint32_t)esp_timer_get_time();
+}
+// called when start signal was sent, releasing line arms interrupt
+static void DHT_StartCapture(dht_t *dht) {
+	dht->numEdges = 0;
+	g_dhtCapture = dht;
+	HAL_AttachInterrupt(dht->_pin, INTERRUPT_FALLING, DHT_EdgeInterrupt);
+}
+static void DHT_StopCapture(dht_t *dht) {
+	if (g_dhtCapture != dht) {
+		return;
+	}
+	HAL_DetachInterrupt(dht->_pin);
+	g_dhtCapture = 0;
+}
+// frame took few ms and is long over at next call
+static bool DHT_FinishCapture(dht_t *dht) {
+	byte data[5];
+
+	DHT_StopCapture(dht);
+	if (DHT_DecodeEdges(dht->edges, dht->numEdges, data) == false) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "DHT capture failed, %i edges", (int)dht->numEdges);
+		dht->_lastresult = false;
+		return dht->_lastresult;
+	}
+	memcpy(dht->data, data, sizeof(data));
+	dht->_lastresult = true;
+	return dht->_lastresult;
+}
+#endif
+void DHT_Free(dht_t *dht) {
+#if DHT_USE_CAPTURE
+	DHT_StopCapture(dht);
+#endif
+	free(dht);
+}
+// Falling edges in microseconds, last DHT_FRAME_EDGES of them are start
+// of every bit and end of frame, so edges before (response) are skipped.
+// Bit is 50 us low and 26-28 us (0) or 70 us (1) high.
+bool DHT_DecodeEdges(const uint32_t *edges, int count, byte *data) {
+	uint32_t len;
+	int i, first;
+
+	if (count < DHT_FRAME_EDGES) {
+		return false;
+	}
+	first = count - DHT_FRAME_EDGES;
+	memset(data, 0, 5);
+	for (i = 0; i < 40; i++) {
+		len = edges[first + i + 1] - edges[first + i];
+		if (len < 50 || len > 200) {
+			return false;
+		}
+		data[i / 8] <<= 1;
+		if (len > 100) {
+			data[i / 8] |= 1;
+		}
+	}
+	return data[4] == ((data[0] + data[1] + data[2] + data[3]) & 0xFF);
+}
 /*!
  *  @brief  Read temperature
  *  @param  S
@@ -249,9 +320,20 @@ bool DHT_read(dht_t *dht, bool force) {
 	// Check if sensor was read less than two seconds ago and return early
 	// to use last reading.
 	uint32_t currenttime = g_secondsElapsed;
+#if DHT_USE_CAPTURE
+	if (g_dhtCapture == dht && currenttime != dht->_lastreadtime) {
+		return DHT_FinishCapture(dht);
+	}
+#endif
 	if (!force && ((currenttime - dht->_lastreadtime) < 3)) {
 		return dht->_lastresult; // return last correct measurement
 	}
+#if DHT_USE_CAPTURE
+	// other sensor is being captured, this one waits for next call
+	if (g_dhtCapture != 0) {
+		return dht->_lastresult;
+	}
+#endif
 	dht->_lastreadtime = currenttime;
 
 #if WINDOWS
@@ -261,10 +343,6 @@ bool DHT_read(dht_t *dht, bool force) {
 
 	return SIM_ReadDHT11(dht->_pin, data);
 #endif
-	// Reset 40 bits of received data to zero.
-	data[0] = data[1] = data[2] = data[3] = data[4] = 0;
-
-
 	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "DHT start, pin is %i",(int)dht->_pin);
   // Send start signal.  See DHT datasheet for full signal diagram:
   //   http://www.adafruit.com/datasheets/Digital%20humidity%20and%20temperature%20sensor%20AM2302.pdf
@@ -287,6 +365,13 @@ bool DHT_read(dht_t *dht, bool force) {
 		delay(20); // data sheet says at least 18ms, 20ms just to be safe
 		break;
 	}
+#if DHT_USE_CAPTURE
+	// until it is decoded on next call, last reading stays
+	DHT_StartCapture(dht);
+	return dht->_lastresult;
+#endif
+	// Reset 40 bits of received data to zero.
+	data[0] = data[1] = data[2] = data[3] = data[4] = 0;
 
 	uint32_t cycles[80];
 #ifdef PLATFORM_BEKEN
@@ -5,16 +5,32 @@
 #define DHT22 22
 #define AM2301 21
 
+// ESP-IDF has microsecond time that edge interrupt can stamp, so there
+// frame is captured in background instead of polled with interrupts off.
+// Every bit starts with falling edge, so falling edges are enough: start
+// of each of 40 bits and end of frame.
+#if PLATFORM_ESPIDF
+#define DHT_USE_CAPTURE 1
+#endif
+#define DHT_FRAME_EDGES 41
+#define DHT_MAX_EDGES 44
+
 typedef struct dht_s { 
 	byte data[5];
 	byte _pin, _type;
 	uint32_t _lastreadtime, _maxcycles;
 	bool _lastresult;
 	uint8_t pullTime; // Time (in usec) to pull up data line before reading
+#if DHT_USE_CAPTURE
+	volatile byte numEdges;
+	uint32_t edges[DHT_MAX_EDGES];
+#endif
 
 } dht_t;
 
 dht_t *DHT_Create(byte pin, byte type);
+void DHT_Free(dht_t *dht);
+bool DHT_DecodeEdges(const uint32_t *edges, int count, byte *data);
 float DHT_readHumidity(dht_t *dht, bool force);
 float DHT_readTemperature(dht_t *dht, bool S, bool force);
 
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../new_common.h"
+
+// Framebuffer of a display, drawn by its driver in whatever layout it has.
+// It is split into bands that display can take alone, like a row of LED
+// matrix or a digit of segment display, and DispFB_Flush sends only bands
+// that changed since they were sent. Band b is bandItems bytes at
+// b * bandStep + i * itemStep, so rows spread over chained devices fit too.
+typedef struct dispFB_s dispFB_t;
+typedef void (*dispSendBandFn_t)(dispFB_t *fb, int band);
+
+struct dispFB_s {
+	byte *pixels;
+	// what display shows, from last send
+	byte *sent;
+	short numBands;
+	short bandStep;
+	short bandItems;
+	short itemStep;
+	bool sentValid;
+	dispSendBandFn_t sendBand;
+	void *user;
+	unsigned int bandsSent;
+};
+
+bool DispFB_Init(dispFB_t *fb, byte *pixels, int numBands, int bandStep, int bandItems, int itemStep,
+	dispSendBandFn_t sendBand, void *user);
+void DispFB_Free(dispFB_t *fb);
+void DispFB_Invalidate(dispFB_t *fb);
+void DispFB_SendBand(dispFB_t *fb, int band);
+int DispFB_Flush(dispFB_t *fb);
+
+// columns of a glyph, 0 if font has none for code
+const byte *Disp_GetGlyph(byte code, int *width);
+int Disp_TextToColumns(const char *s, byte *out, int maxCols);
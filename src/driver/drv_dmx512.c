@@ -37,19 +37,32 @@ startDriver PixelAnim
 
 #define DMX_CHANNELS_SIZE 512
 #define DMX_BUFFER_SIZE (DMX_CHANNELS_SIZE+1)
-
+// full universe takes 22.7 ms at 250 kbaud, so frames go out at ~44 Hz
+#define DMX_FRAME_MS 23
+#define DMX_BREAK_US 120 // >= 88
+#define DMX_MAB_US 12 // >= 8
+
+// Strip writes back buffer, apply copies it to front buffer. Where UART
+// HAL can send break and queue bytes for interrupt, own thread sends
+// front buffer every DMX_FRAME_MS, no matter what main loop does, so
+// universe from E1.31/Art-Net gets refreshed like on wired DMX node.
+// Elsewhere front buffer is sent from apply as before.
 static byte *g_dmxBuffer;
+static byte *g_dmxFront;
 static int dmx_pixelCount = 0;
 static int dmx_pixelSize = 3;
+static volatile bool g_dmxRunning = false;
+#if !WINDOWS
+static SemaphoreHandle_t g_dmxMutex = 0;
+static beken_thread_t g_dmxThread = 0;
+static volatile bool g_dmxThreadDone = true;
+#endif
 
 int dmx_pin = 22;
 
 void HAL_UART_Flush(void);
 void HAL_SetBaud(uint32_t baud);
-void DMX_Show() {
-	if (g_dmxBuffer == 0) {
-		return;
-	}
+static void DMX_SendBlocking() {
 #if !WINDOWS
 	for (int i = 0; i < 2; i++)
 #endif
@@ -73,24 +86,108 @@ void DMX_Show() {
 
 		// restore UART and send DMX data
 		for (int i = 0; i < DMX_BUFFER_SIZE; i++) {
-			HAL_UART_SendByte(g_dmxBuffer[i]);
+			HAL_UART_SendByte(g_dmxFront[i]);
 		}
 		//Serial485.begin(250000, SERIAL_8N2, RS485_RX_PIN, RS485_TX_PIN);
 		////Serial485.write(dmxBuffer, sizeof(dmxBuffer));
 		//Serial485.flush();
 	}
 }
+#if !WINDOWS
+static void DMX_Thread(beken_thread_arg_t arg) {
+	while (g_dmxRunning) {
+		// previous frame is still on the line
+		if (HAL_UART_IsTxDone() == false) {
+			rtos_delay_milliseconds(1);
+			continue;
+		}
+		if (xSemaphoreTake(g_dmxMutex, 10) == pdTRUE) {
+			HAL_UART_SendBreak(DMX_BREAK_US, DMX_MAB_US);
+			HAL_UART_SendBytesAsync(g_dmxFront, DMX_BUFFER_SIZE);
+			xSemaphoreGive(g_dmxMutex);
+		}
+		rtos_delay_milliseconds(DMX_FRAME_MS);
+	}
+	g_dmxThreadDone = true;
+	rtos_delete_thread(NULL);
+}
+static void DMX_StartThread() {
+	OSStatus err;
+
+	// probe, platform without support says so before anything is sent
+	if (HAL_UART_IsTxDone() == false || HAL_UART_SendBreak(DMX_BREAK_US, DMX_MAB_US) == false) {
+		return;
+	}
+	if (g_dmxMutex == 0) {
+		g_dmxMutex = xSemaphoreCreateMutex();
+	}
+	g_dmxRunning = true;
+	g_dmxThreadDone = false;
+	err = rtos_create_thread(&g_dmxThread, BEKEN_APPLICATION_PRIORITY + 1,
+		"DMX",
+		(beken_thread_function_t)DMX_Thread,
+		0x400,
+		(beken_thread_arg_t)0);
+	if (err != kNoErr) {
+		ADDLOG_ERROR(LOG_FEATURE_DRV, "create \"DMX\" thread failed with %i!", err);
+		g_dmxRunning = false;
+		g_dmxThreadDone = true;
+	}
+}
+static void DMX_StopThread() {
+	int i;
+
+	if (g_dmxRunning == false) {
+		return;
+	}
+	g_dmxRunning = false;
+	for (i = 0; i < 100 && g_dmxThreadDone == false; i++) {
+		rtos_delay_milliseconds(5);
+	}
+	g_dmxThread = 0;
+}
+#else
+// simulator sends each frame from apply
+static void DMX_StartThread() {
+}
+static void DMX_StopThread() {
+}
+#endif
+void DMX_Show() {
+	if (g_dmxBuffer == 0) {
+		return;
+	}
+#if !WINDOWS
+	if (g_dmxRunning) {
+		// thread sends it with next frame
+		if (xSemaphoreTake(g_dmxMutex, 100) == pdTRUE) {
+			memcpy(g_dmxFront, g_dmxBuffer, DMX_BUFFER_SIZE);
+			xSemaphoreGive(g_dmxMutex);
+		}
+		return;
+	}
+#endif
+	memcpy(g_dmxFront, g_dmxBuffer, DMX_BUFFER_SIZE);
+	DMX_SendBlocking();
+}
 
 byte DMX_GetByte(uint32_t idx) {
 	if (idx >= DMX_CHANNELS_SIZE)
 		return 0;
 	return g_dmxBuffer[1 + idx];
 }
-void DMX_setByte(int idx, byte color) {
+void DMX_setByte(uint32_t idx, byte color) {
 	if (idx >= DMX_CHANNELS_SIZE)
 		return;
 	g_dmxBuffer[1 + idx] = color;
 }
+void DMX_setBytes(uint32_t idx, const byte *data, int len) {
+	if (idx >= DMX_CHANNELS_SIZE)
+		return;
+	if (len > (int)(DMX_CHANNELS_SIZE - idx))
+		len = DMX_CHANNELS_SIZE - idx;
+	memcpy(g_dmxBuffer + 1 + idx, data, len);
+}
 
 void DMX_SetLEDCount(int pixel_count, int pixel_size) {
 	dmx_pixelCount = pixel_count;
@@ -103,25 +200,34 @@ void DMX_Init() {
 
 	g_dmxBuffer = (byte*)malloc(DMX_BUFFER_SIZE);
 	memset(g_dmxBuffer, 0, DMX_BUFFER_SIZE);
+	g_dmxFront = (byte*)malloc(DMX_BUFFER_SIZE);
+	memset(g_dmxFront, 0, DMX_BUFFER_SIZE);
 	ledStrip_t ws_export;
 	ws_export.apply = DMX_Show;
 	ws_export.getByte = DMX_GetByte;
 	ws_export.setByte = DMX_setByte;
+	ws_export.setBytes = DMX_setBytes;
 	ws_export.setLEDCount = DMX_SetLEDCount;
 
 	LEDS_InitShared(&ws_export);
 
 	HAL_UART_Init(250000, 2, false, dmx_pin, -1);
+	DMX_StartThread();
 }
 void DMX_OnEverySecond() {
 }
 
 
 void DMX_Shutdown() {
+	DMX_StopThread();
 	if (g_dmxBuffer) {
 		free(g_dmxBuffer);
 		g_dmxBuffer = 0;
 	}
+	if (g_dmxFront) {
+		free(g_dmxFront);
+		g_dmxFront = 0;
+	}
 	LEDS_ShutdownShared();
 }
 #endif
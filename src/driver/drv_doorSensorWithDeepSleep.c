@@ -3,6 +3,11 @@
 // After a certain amount of time with MQTT connection, to make sure that door state is 
 // already reported, and with no futher door state changes, device goes to deep sleep 
 // and waits for wakeup from door sensor input state change.
+//
+// With DSBatch and automatic wake up time (DSTime), timer wakes only record
+// door state and battery voltage into LittleFS, with WiFi kept off. Every
+// N-th wake, a door change or low battery connects and publishes all
+// recorded samples as one JSON message on "batch" topic.
 
 #include "../new_common.h"
 #include "../new_pins.h"
@@ -17,6 +22,10 @@
 #include "../hal/hal_pins.h"
 #include "../hal/hal_adc.h"
 #include "../hal/hal_ota.h"
+#include "../littlefs/our_lfs.h"
+#include "drv_battery.h"
+#include "drv_deviceclock.h"
+#include "drv_public.h"
 
 static int g_noChangeTimePassed = 0; // time without change. Every event in any of the doorsensor channels resets it.
 static int g_emergencyTimeWithNoConnection = 0; // time without connection to MQTT. Extends the interval till Deep Sleep until connection is established or EMERGENCY_TIME_TO_SLEEP_WITHOUT_MQTT
@@ -26,6 +35,44 @@ static int setting_timeRequiredUntilDeepSleep = 60;
 
 #define EMERGENCY_TIME_TO_SLEEP_WITHOUT_MQTT 60 * 5
 
+#if ENABLE_LITTLEFS
+#define DSBATCH_FILE			"dsbatch.bin"
+#define DSBATCH_MAGIC			0xDB
+#define DSBATCH_MAX_SAMPLES		32
+// sensor-only wake waits that long for battery reading
+#define DSBATCH_BATT_WAIT		5
+// publish without clock when NTP does not answer
+#define DSBATCH_TIME_WAIT		10
+
+typedef struct dsSample_s {
+	// seconds on batch clock
+	unsigned int clock;
+	unsigned short battMv;
+	short door;
+} dsSample_t;
+
+// kept in file over deep sleep, written on every sleep
+typedef struct dsBatch_s {
+	byte magic;
+	byte count;
+	unsigned short wakesPerConnect;
+	unsigned short lowBattMv;
+	// sensor-only wakes since last connect
+	unsigned short wakes;
+	short lastDoor;
+	// seconds since last publish, up to last sleep, and length of that sleep
+	unsigned int clock;
+	unsigned int sleepSeconds;
+	dsSample_t samples[DSBATCH_MAX_SAMPLES];
+} dsBatch_t;
+
+static dsBatch_t g_batch;
+// this wake only records a sample, WiFi is held off
+static bool g_bSensorOnly = false;
+static bool g_bBatchPublished = false;
+static int g_awakeSeconds = 0;
+#endif
+
 int Simulator_GetNoChangeTimePassed() {
 	return g_noChangeTimePassed;
 }
@@ -61,6 +108,152 @@ commandResult_t DoorDeepSleep_SetTime(const void* context, const char* cmd, cons
 	return CMD_RES_OK;
 }
 
+#if ENABLE_LITTLEFS
+static void DSBatch_Save() {
+	lfs_file_t file;
+
+	if (!lfs_present()) {
+		return;
+	}
+	if (lfs_file_open(&lfs, &file, DSBATCH_FILE, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) < 0) {
+		return;
+	}
+	lfs_file_write(&lfs, &file, &g_batch, sizeof(g_batch));
+	lfs_file_close(&lfs, &file);
+}
+
+static void DSBatch_Load() {
+	lfs_file_t file;
+	int read = 0;
+
+	if (lfs_present() && lfs_file_open(&lfs, &file, DSBATCH_FILE, LFS_O_RDONLY) >= 0) {
+		read = lfs_file_read(&lfs, &file, &g_batch, sizeof(g_batch));
+		lfs_file_close(&lfs, &file);
+	}
+	if (read != sizeof(g_batch) || g_batch.magic != DSBATCH_MAGIC || g_batch.count > DSBATCH_MAX_SAMPLES) {
+		memset(&g_batch, 0, sizeof(g_batch));
+		g_batch.magic = DSBATCH_MAGIC;
+		g_batch.lastDoor = -1;
+	}
+}
+
+static int DSBatch_GetDoor() {
+	int i;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep ||
+			g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep_NoPup ||
+			g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep_pd) {
+			return CHANNEL_Get(g_cfg.pins.channels[i]);
+		}
+	}
+	return -1;
+}
+
+static void DSBatch_Sleep() {
+	g_batch.lastDoor = DSBatch_GetDoor();
+	g_batch.clock += g_awakeSeconds;
+	g_batch.sleepSeconds = setting_automaticWakeUpAfterSleepTime;
+	DSBatch_Save();
+	g_bWantPinDeepSleep = true;
+	g_pinDeepSleepWakeUp = setting_automaticWakeUpAfterSleepTime;
+}
+
+static void DSBatch_Publish() {
+	char *json;
+	char *p;
+	int i, len;
+	unsigned int now, age;
+	bool bTime;
+	dsSample_t *smp;
+
+	bTime = TIME_IsTimeSynced();
+	if (!bTime && g_awakeSeconds < DSBATCH_TIME_WAIT) {
+		return;
+	}
+	g_bBatchPublished = true;
+	if (g_batch.count == 0) {
+		return;
+	}
+	len = 16 + g_batch.count * 48;
+	json = malloc(len);
+	if (json == 0) {
+		return;
+	}
+	now = g_batch.clock + g_awakeSeconds;
+	p = json + sprintf(json, "{\"samples\":[");
+	for (i = 0; i < g_batch.count; i++) {
+		smp = &g_batch.samples[i];
+		age = now - smp->clock;
+		p += sprintf(p, "%s{\"%s\":%u,\"door\":%i,\"mV\":%i}", i ? "," : "",
+			bTime ? "t" : "age", bTime ? TIME_GetCurrentTime() - age : age,
+			smp->door, smp->battMv);
+	}
+	strcpy(p, "]}");
+#if ENABLE_MQTT
+	MQTT_PublishMain_StringString("batch", json, 0);
+#endif
+	free(json);
+	g_batch.count = 0;
+	g_batch.wakes = 0;
+	// clock starts now, DSBatch_Sleep adds whole time awake
+	g_batch.clock = 0 - g_awakeSeconds;
+	DSBatch_Save();
+}
+
+// Wake without WiFi: wait a bit for battery driver, then record and sleep,
+// unless door has changed or battery is low, which connects at once.
+static void DSBatch_RunSensorOnly() {
+	dsSample_t *smp;
+	int door, mv;
+
+	door = DSBatch_GetDoor();
+	if (door != g_batch.lastDoor) {
+		ADDLOG_INFO(LOG_FEATURE_DRV, "DSBatch: door changed, connecting");
+		g_bSensorOnly = false;
+		Main_HoldWiFi(false);
+		return;
+	}
+	mv = 0;
+#if ENABLE_DRIVER_BATTERY
+	mv = Battery_lastreading(OBK_BATT_VOLTAGE);
+	if (mv == 0 && DRV_IsRunning(DRV_ID_Battery) && g_awakeSeconds < DSBATCH_BATT_WAIT) {
+		return;
+	}
+#endif
+	smp = &g_batch.samples[g_batch.count++];
+	smp->clock = g_batch.clock + g_awakeSeconds;
+	smp->door = door;
+	smp->battMv = mv;
+	g_batch.wakes++;
+	if (g_batch.lowBattMv && mv && mv < g_batch.lowBattMv) {
+		ADDLOG_INFO(LOG_FEATURE_DRV, "DSBatch: battery %i mV low, connecting", mv);
+		g_bSensorOnly = false;
+		Main_HoldWiFi(false);
+		DSBatch_Save();
+		return;
+	}
+	DSBatch_Sleep();
+}
+
+// DSBatch [WakesPerConnect] [LowBatteryMv]
+static commandResult_t DoorDeepSleep_Batch(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		g_batch.wakesPerConnect = Tokenizer_GetArgInteger(0);
+		g_batch.lowBattMv = Tokenizer_GetArgIntegerDefault(1, 0);
+		DSBatch_Save();
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "DSBatch: connect every %i wakes, low battery %i mV, %i samples kept",
+		g_batch.wakesPerConnect, g_batch.lowBattMv, g_batch.count);
+	return CMD_RES_OK;
+}
+
+int Simulator_GetDoorSensorBatchCount() {
+	return g_batch.count;
+}
+#endif
+
 void DoorDeepSleep_Init() {
 	// 0 seconds since last change
 	g_noChangeTimePassed = 0;
@@ -70,6 +263,26 @@ void DoorDeepSleep_Init() {
 	//cmddetail:"fn":"DoorDeepSleep_SetTime","file":"driver/drv_doorSensorWithDeepSleep.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("DSTime", DoorDeepSleep_SetTime, NULL);
+#if ENABLE_LITTLEFS
+	//cmddetail:{"name":"DSBatch","args":"[WakesPerConnect][LowBatteryMv]",
+	//cmddetail:"descr":"DoorSensor driver batching, used with automatic wake up time of DSTime. Timer wakes only record door state and battery voltage with WiFi off, every N-th wake connects and publishes them as one JSON on batch topic. Door change, or battery below optional mV, connects at once. Setting is kept in LittleFS, 0 disables.",
+	//cmddetail:"fn":"DoorDeepSleep_Batch","file":"driver/drv_doorSensorWithDeepSleep.c","requires":"",
+	//cmddetail:"examples":"DSBatch 6 2400"}
+	CMD_RegisterCommand("DSBatch", DoorDeepSleep_Batch, NULL);
+
+	// started before WiFi, so radio can stay off for sensor-only wake
+	// last sleep without wake up timer means this wake is door change
+	DSBatch_Load();
+	g_awakeSeconds = 0;
+	g_bBatchPublished = false;
+	g_bSensorOnly = g_batch.wakesPerConnect > 1 && g_batch.sleepSeconds > 0
+		&& g_batch.wakes + 1 < g_batch.wakesPerConnect && g_batch.count < DSBATCH_MAX_SAMPLES;
+	g_batch.clock += g_batch.sleepSeconds;
+	g_batch.sleepSeconds = 0;
+	if (g_bSensorOnly) {
+		Main_HoldWiFi(true);
+	}
+#endif
 }
 
 void DoorDeepSleep_QueueNewEvents() {
@@ -108,7 +321,27 @@ void DoorDeepSleep_QueueNewEvents() {
 	}
 }
 
+static void DoorDeepSleep_Sleep() {
+#if ENABLE_LITTLEFS
+	if (g_batch.wakesPerConnect > 1) {
+		DSBatch_Sleep();
+		return;
+	}
+#endif
+	g_bWantPinDeepSleep = true;
+	g_pinDeepSleepWakeUp = setting_automaticWakeUpAfterSleepTime;
+}
+
 void DoorDeepSleep_OnEverySecond() {
+#if ENABLE_LITTLEFS
+	g_awakeSeconds++;
+	if (g_bSensorOnly) {
+		DSBatch_RunSensorOnly();
+		if (g_bSensorOnly) {
+			return;
+		}
+	}
+#endif
 
 	if (OTA_GetProgress() >= 0) {
 		// update active
@@ -120,6 +353,11 @@ void DoorDeepSleep_OnEverySecond() {
 #if ENABLE_MQTT
 			PublishQueuedItems(); // publish those items that were queued when device was offline
 #endif
+#if ENABLE_LITTLEFS
+			if (!g_bBatchPublished) {
+				DSBatch_Publish();
+			}
+#endif
 			
 			g_noChangeTimePassed++;
 			if (g_noChangeTimePassed >= setting_timeRequiredUntilDeepSleep) {
@@ -128,8 +366,7 @@ void DoorDeepSleep_OnEverySecond() {
 				// and for those pins, it will wake up on the pin change to opposite state
 				// (so if door sensor is low, it will wake up on rising edge,
 				// if door sensor is high, it will wake up on falling)
-				g_bWantPinDeepSleep = true;
-				g_pinDeepSleepWakeUp = setting_automaticWakeUpAfterSleepTime;
+				DoorDeepSleep_Sleep();
 			}
 	}
 	else { // executes every second while the device is woken up, but offline
@@ -137,14 +374,18 @@ void DoorDeepSleep_OnEverySecond() {
 		
 		g_emergencyTimeWithNoConnection++;
 		if (g_emergencyTimeWithNoConnection >= EMERGENCY_TIME_TO_SLEEP_WITHOUT_MQTT) {
-			g_bWantPinDeepSleep = true;
-			g_pinDeepSleepWakeUp = setting_automaticWakeUpAfterSleepTime;
+			DoorDeepSleep_Sleep();
 		}
 	}
 }
 
 void DoorDeepSleep_StopDriver() {
-
+#if ENABLE_LITTLEFS
+	if (g_bSensorOnly) {
+		g_bSensorOnly = false;
+		Main_HoldWiFi(false);
+	}
+#endif
 }
 
 void DoorDeepSleep_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState)
@@ -42,6 +42,9 @@ typedef struct {
   unsigned short last_read[DS18B20MAX];
   short channel[DS18B20MAX];
   short GPIO[DS18B20MAX];
+  // scratchpad reads tried and how many of them had bad CRC
+  unsigned int reads[DS18B20MAX];
+  unsigned int crcErrors[DS18B20MAX];
 
 } DS1820devices;
 
@@ -53,6 +56,11 @@ DeviceAddress ROM_NO;
 
 static DS1820devices ds18b20devices;
 uint8_t DS18B20GPIOS[DS18B20MAX_GPIOS];
+static int ds18_numGPIOs = 0;	// used entries of DS18B20GPIOS, set by scan_sensors()
+// index in DS18B20GPIOS searched for next device, -1 when not scanning
+static int ds18_scanGPIO = -1;
+// attempts left to read each sensor after conversion, 0 when it was read
+static uint8_t ds18_tries[DS18B20MAX];
 uint8_t devices = 0;
 
 
@@ -167,12 +175,55 @@ static commandResult_t Cmd_DS18B20_SetResolution(const void* context, const char
 	return CMD_RES_OK;
 }
 
-void ds18b20_requestConvertT(int GPIO) {
-	OWReset(GPIO);
+// all sensors on GPIO convert at once, returns false if none answered reset
+bool ds18b20_requestConvertT(int GPIO) {
+#if WINDOWS
+	// fake sensors are always there
+	return true;
+#else
+	if (!OWReset(GPIO)) {
+		return false;
+	}
 	OWWriteByte(GPIO,SKIP_ROM);
 	OWWriteByte(GPIO,CONVERT_T);
+	return true;
+#endif
 }
 
+#if WINDOWS
+// reads of fake sensor left that give bad CRC
+static int sim_badReads[DS18B20MAX];
+
+void SIM_DS18B20_SetBadReads(int index, int count) {
+	sim_badReads[index] = count;
+}
+void SIM_DS18B20_GetReadCounts(int index, int *reads, int *crcErrors) {
+	*reads = ds18b20devices.reads[index];
+	*crcErrors = ds18b20devices.crcErrors[index];
+}
+
+// fake sensor has 12 bit resolution, temperature rises with index and time
+static void SIM_DS18B20_ReadScratchPad(const uint8_t *deviceAddress, uint8_t* scratchPad) {
+	int i, raw;
+
+	for (i = 0; i < ds18_count; i++) {
+		if (!memcmp(deviceAddress, ds18b20devices.array[i], 8)) {
+			break;
+		}
+	}
+	raw = (int)((20.0f + i / 10.0f + (float)(g_secondsElapsed % 100) / 100.0f) * 16);
+	memset(scratchPad, 0, 9);
+	scratchPad[0] = raw;
+	scratchPad[1] = raw >> 8;
+	scratchPad[4] = 0x7F;
+	scratchPad[8] = Crc8CQuick(scratchPad, 8);
+	if (i < ds18_count && sim_badReads[i] > 0) {
+		sim_badReads[i]--;
+		scratchPad[8] ^= 0x01;
+	}
+}
+#endif
+
 
 
 
@@ -186,6 +237,9 @@ bool ds18b20_readScratchPad(const uint8_t *deviceAddress, uint8_t* scratchPad) {
 		return false;
 	}
 	DS1820_LOG(DEBUG, "GPIO found for device - DS18B20_GPIO=%i", DS18B20_GPIO);
+#if WINDOWS
+	SIM_DS18B20_ReadScratchPad(deviceAddress, scratchPad);
+#else
 	// send the reset command and fail fast
 	int b = OWReset(DS18B20_GPIO);
 	if (b == 0) {
@@ -207,9 +261,15 @@ bool ds18b20_readScratchPad(const uint8_t *deviceAddress, uint8_t* scratchPad) {
 	for (uint8_t i = 0; i < 9; i++) {
 		scratchPad[i] = OWReadByte(DS18B20_GPIO);
 	}
+#endif
 	uint8_t crc = Crc8CQuick(scratchPad, 8);
 	if(crc != scratchPad[8])
 	{
+		for (int i = 0; i < ds18_count; i++) {
+			if (!memcmp(deviceAddress, ds18b20devices.array[i], 8)) {
+				ds18b20devices.crcErrors[i]++;
+			}
+		}
 		DS1820_LOG(ERROR, "Read CRC=%x != calculated:%x (errcount=%i)", scratchPad[8], crc, errcount);
 		DS1820_LOG(ERROR, "Scratchpad Data Read: " SPSTR,
 			SP2STR(scratchPad));
@@ -217,7 +277,11 @@ bool ds18b20_readScratchPad(const uint8_t *deviceAddress, uint8_t* scratchPad) {
 		return false;
 	}
 
+#if WINDOWS
+	return true;
+#else
 	return OWReset(DS18B20_GPIO);
+#endif
 }
 
 
@@ -503,6 +567,9 @@ void insertArray(DS1820devices *a, DeviceAddress devaddr) {
 	a->last_read[ds18_count] = 0;
 	a->channel[ds18_count] = -1;
 	a->GPIO[ds18_count]=DS18B20_GPIO;
+	a->reads[ds18_count] = 0;
+	a->crcErrors[ds18_count] = 0;
+	ds18_tries[ds18_count] = 0;
 	ds18_count++;
 }
 
@@ -682,6 +749,27 @@ commandResult_t CMD_DS18B20_setsensor(const void *context, const char *cmd, cons
 }
 
 
+// Search finds one device per second, so scan of a bus with many sensors
+// does not block one second for all of them. Conversions wait until it is done.
+static void DS18B20_ScanStep() {
+	DeviceAddress devaddr = {0};
+	int pin = DS18B20GPIOS[ds18_scanGPIO];
+
+	DS18B20_GPIO = pin;
+	if (ds18_count < DS18B20MAX && search(devaddr, 1, pin)) {
+		bk_printf("found device " DEVSTR " ", DEV2STR(devaddr));
+		insertArray(&ds18b20devices, devaddr);
+		if (!LastDeviceFlag) {
+			return;
+		}
+	}
+	reset_search();
+	if (++ds18_scanGPIO >= ds18_numGPIOs) {
+		ds18_scanGPIO = -1;
+		DS1820_LOG(INFO, "Scan done, %i sensor(s)", ds18_count);
+	}
+}
+
 void scan_sensors(){
 	ds18_count=0;
 	reset_search();
@@ -689,12 +777,18 @@ void scan_sensors(){
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
 		if ((g_cfg.pins.roles[i] == IOR_DS1820_IO) && ( j < DS18B20MAX_GPIOS)){
 			DS18B20GPIOS[j++]=i;
+#if WINDOWS
 			DS18B20_GPIO = i ;	// set DS18B20_GPIO to i
 			DS18B20_fill_devicelist(i);
+#endif
 		}
 	}
+	ds18_numGPIOs = j;
 	// fill unused "pins" with 99 as sign for unused
 	for (;j<DS18B20MAX_GPIOS;j++) DS18B20GPIOS[j]=99;
+#if !WINDOWS
+	ds18_scanGPIO = ds18_numGPIOs ? 0 : -1;
+#endif
 }
 
 commandResult_t CMD_DS18B20_scansensors(const void *context, const char *cmd, const char *args, int cmdFlags) {
@@ -824,13 +918,13 @@ char *DS1820_full_jsonSensors(){
 void DS1820_full_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState)
 {
 	if (bPreState){
-		hprintf255(request, "<h5>DS18B20 devices detected/configured: %i</h5>",ds18_count);
+		hprintf255(request, "<h5>DS18B20 devices detected/configured: %i%s</h5>",ds18_count,ds18_scanGPIO >= 0 ? " (scanning)" : "");
 		return;
 	}
 		
 	if (ds18_count > 0 ){
 		hprintf255(request, "DS18B20 devices<table><th width='25'>Name</th>"
-			"<th width='38'> &nbsp; Address </th><th width='8'> Pin </th><th width='6'> CH </th><th width='10'> Temp </th><th width='10'> read </th>",ds18_count);
+			"<th width='38'> &nbsp; Address </th><th width='8'> Pin </th><th width='6'> CH </th><th width='10'> Temp </th><th width='10'> read </th><th width='10'> CRC err </th>");
 		for (int i=0; i < ds18_count; i++) {
 			const char * pinalias=NULL; 
 			char gpioname[10];
@@ -851,9 +945,9 @@ void DS1820_full_AppendInformationToHTTPIndexPage(http_request_t* request, int b
 			if (ch >=0) sprintf(chan,"%i",(uint8_t)ch);
 			hprintf255(request, "<tr><td>%s</td>"
 			"<td> &nbsp; %02X %02X %02X %02X %02X %02X %02X %02X</td>"
-			"<td>%s</td><td>%s</td><td>%s</td></tr>",ds18b20devices.name[i],
+			"<td>%s</td><td>%s</td><td>%s</td><td>%u/%u</td></tr>",ds18b20devices.name[i],
 			DEV2STR(ds18b20devices.array[i]),
-			pinalias, chan, tmp);
+			pinalias, chan, tmp, ds18b20devices.crcErrors[i], ds18b20devices.reads[i]);
 		}
 		hprintf255(request, "</table>");
 	}
@@ -920,12 +1014,16 @@ int http_fn_cfg_ds18b20(http_request_t* request)
 
 void DS1820_full_OnEverySecond()
 {
-	// for now just find the pin used
-	Pin = PIN_FindPinIndexForRole(IOR_DS1820_IO, -1);
-
-	// only if (at least one) pin is set
-	if(Pin < 0) {
-		DS1820_LOG(INFO, "No Pin found\r\n");
+	// pins are found by scan_sensors(), on start and by DS1820_FULL_scansensors
+	if(ds18_numGPIOs == 0) {
+		return;
+	}
+	Pin = DS18B20GPIOS[0];
+	if (ds18_scanGPIO >= 0) {
+		for (int i=0; i < ds18_count; i++) {
+			ds18b20devices.last_read[i] += 1 ;
+		}
+		DS18B20_ScanStep();
 		return;
 	}
 	//Temperature measurement is done in two repeatable steps. 
@@ -933,60 +1031,60 @@ void DS1820_full_OnEverySecond()
 	//          That requires some time - 15-100-750ms, depending on sensor family/vendor.
 	//          However, time between steps is always one second.
 	// Step 2 - dsread = 1. Sensor finished conversion, requesting conversion result.
+	//          Up to DS18B20_READS_PER_SECOND sensors are read each second, and
+	//          ones that failed are tried again next second, up to 5 times.
+	//          Scratchpad keeps the result until next conversion.
 
 	// request temp if conversion was requested two seconds after request
 	// if (dsread == 1 && g_secondsElapsed % 5 == 2) {
 	// better if we don't use parasitic power, we can check if conversion is ready
 		DS1820_LOG(DEBUG, ".. Pin %i found! dsread=%i \r\n",Pin,dsread);
 		if(dsread == 1){ 
-#if WINDOWS
-			bk_printf("Reading temperature from fake DS18B20 sensor(s)\r\n");
-			for (int i=0; i < ds18_count; i++) {
-				ds18b20devices.last_read[i] += 1 ;
-				errcount = 0;
-				float t_float = 20.0 + i/10.0 + (float)(g_secondsElapsed%100)/100.0;
-					ds18b20devices.lasttemp[i] = t_float;
-					ds18b20devices.last_read[i] = 0;
-					if (ds18b20devices.channel[i]>=0) CHANNEL_Set(ds18b20devices.channel[i], (int)(t_float*100), CHANNEL_SET_FLAG_SILENT);
-					lastconv = g_secondsElapsed;
-			}
-#else	// to #if WINDOWS
 			float t_float = -127;
 			const char * pinalias; 
 			char gpioname[10];
+			int reads = 0, pending = 0;
 			DS1820_LOG(INFO, "Reading temperature from %i DS18B20 sensor(s)\r\n",ds18_count);
 			for (int i=0; i < ds18_count; i++) {
+				ds18b20devices.last_read[i] += 1 ;
+				if (ds18_tries[i] == 0) {
+					continue;
+				}
+				if (reads >= DS18B20_READS_PER_SECOND) {
+					pending++;
+					continue;
+				}
 				pinalias = HAL_PIN_GetPinNameAlias(ds18b20devices.GPIO[i]);
 				if (! pinalias ) {
 					sprintf(gpioname,"GPIO %u",ds18b20devices.GPIO[i]);
 					pinalias = gpioname;
 				}
-				ds18b20devices.last_read[i] += 1 ;
-				errcount = 0;
-				t_float = -127;
-				while ( t_float == -127 && errcount++ < 5){
-					t_float = ds18b20_getTempC((const uint8_t*)ds18b20devices.array[i]);
-					DS1820_LOG(DEBUG, "Device %i (" DEVSTR ") reported %0.2f\r\n",i,
-						DEV2STR(ds18b20devices.array[i]),t_float);
-				}
+				reads++;
+				ds18b20devices.reads[i]++;
+				t_float = ds18b20_getTempC((const uint8_t*)ds18b20devices.array[i]);
+				DS1820_LOG(DEBUG, "Device %i (" DEVSTR ") reported %0.2f\r\n",i,
+					DEV2STR(ds18b20devices.array[i]),t_float);
 				if (t_float != -127){
+					ds18_tries[i] = 0;
 					ds18b20devices.lasttemp[i] = t_float;
 					ds18b20devices.last_read[i] = 0;
 					if (ds18b20devices.channel[i]>=0) CHANNEL_Set(ds18b20devices.channel[i], (int)(t_float*100), CHANNEL_SET_FLAG_SILENT);
 					lastconv = g_secondsElapsed;
 					DS1820_LOG(INFO, "Sensor " DEVSTR " on %s reported %0.2f\r\n",DEV2STR(ds18b20devices.array[i]),pinalias,t_float);
 				} else{
+					if (--ds18_tries[i] > 0) {
+						pending++;
+					}
 					if (ds18b20devices.last_read[i] > 60) {
 						DS1820_LOG(ERROR, "No temperature read for over 60 seconds for"
 							" device %i (" DEVSTR " on %s)! Setting to -127°C!\r\n",i,
 							DEV2STR(ds18b20devices.array[i]),pinalias);
 						ds18b20devices.lasttemp[i] = -127;
-						dsread=0;
 					}
 				}
 			}
-#endif	// to #if WINDOWS		
-			dsread=0;
+			if (pending == 0)
+				dsread=0;
 		}
 		else{
 //			bk_printf("No tepms read! dsread=%i  -- isConversionComplete()=%i\r\n",dsread,isConversionComplete());
@@ -997,8 +1095,14 @@ void DS1820_full_OnEverySecond()
 			if(dsread == 0 && (g_secondsElapsed % ds18_conversionPeriod == 0 || lastconv == 0))
 			{
 				DS1820_LOG(INFO, "Starting conversion");
-				for (int i=0; i<DS18B20MAX_GPIOS; i++){
-					ds18b20_requestConvertT(DS18B20GPIOS[i]);
+				// broadcast on each GPIO, sensors on all of them convert in parallel
+				for (int i=0; i<ds18_numGPIOs; i++){
+					bool ok = ds18b20_requestConvertT(DS18B20GPIOS[i]);
+					for (int j=0; j < ds18_count; j++) {
+						if (ds18b20devices.GPIO[j] == DS18B20GPIOS[i]) {
+							ds18_tries[j] = ok ? 5 : 0;
+						}
+					}
 				}
 				dsread = 1;
 				errcount = 0;
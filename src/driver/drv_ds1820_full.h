@@ -11,6 +11,7 @@ void DS1820_full_AppendInformationToHTTPIndexPage(http_request_t *request, int b
 #define DS18B20MAX	10			// max numbe of sensors
 #define DS18B20namel	20			// length of description
 #define DS18B20MAX_GPIOS 2			// max GPIOs with sensors
+#define DS18B20_READS_PER_SECOND 4	// max sensors read in one second
 
 
 // prototypes
@@ -0,0 +1,483 @@
+#include "../new_common.h"
+#include "../new_pins.h"
+#include "../new_cfg.h"
+// Commands register, execution API and cmd tokenizer
+#include "../cmnds/cmd_public.h"
+#include "../driver/drv_public.h"
+#include "../logging/logging.h"
+#include "lwip/sockets.h"
+#include "lwip/ip_addr.h"
+#include "lwip/inet.h"
+#include "../httpserver/new_http.h"
+#include "drv_local.h"
+
+#if ENABLE_DRIVER_E131
+
+// E1.31 (sACN) and Art-Net receiver for LED strips.
+// Universes are mapped onto strip pixel ranges, data is written into
+// strip frame as it comes and strip is sent once per frame: on sync
+// packet (E1.31 sync or ArtSync) when sender uses them, otherwise when
+// all mapped universes came, or when one comes again before that.
+//
+// startDriver E131 [FirstUniverse]
+// E131_Map [Universe] [FirstPixel] [PixelCount] [StartChannel] [ChannelsPerPixel]
+
+#define E131_PORT				5568
+#define ARTNET_PORT				6454
+#define E131_MAX_UNIVERSES		8
+// sACN is 638 bytes with 512 channels, Art-Net 530
+#define E131_BUFFER_SIZE		640
+#define E131_PIXELS_PER_UNIVERSE	170
+// time E131_RunFrame may spend on queued packets before giving QuickTick back
+#define E131_RUNFRAME_BUDGET_MS	10
+// without sync packets for that long, frames are shown as they come again
+#define E131_SYNC_TIMEOUT_MS	4000
+
+#define E131_ROOT_VECTOR_DATA		0x00000004
+#define E131_ROOT_VECTOR_EXTENDED	0x00000008
+#define E131_FRAME_VECTOR_DATA		0x00000002
+#define E131_FRAME_VECTOR_SYNC		0x00000001
+#define E131_OPT_PREVIEW			0x80
+#define E131_OPT_TERMINATED			0x40
+#define ARTNET_OP_DMX				0x5000
+#define ARTNET_OP_SYNC				0x5200
+
+typedef struct e131Universe_s {
+	unsigned short universe;
+	// 1 based, as on consoles
+	unsigned short startChannel;
+	unsigned short firstPixel;
+	unsigned short pixelCount;
+	byte channelsPerPixel;
+	byte lastSeq;
+	bool bSeqValid;
+	bool bInFrame;
+	unsigned int arrivedMs;
+	unsigned int packets;
+	unsigned int lost;
+	unsigned int lastLatencyMs;
+	unsigned int maxLatencyMs;
+} e131Universe_t;
+
+static e131Universe_t g_universes[E131_MAX_UNIVERSES];
+static int g_numUniverses = 0;
+// maps made from first universe to cover whole strip, until E131_Map is used
+static bool g_bAutoMap = true;
+static int g_firstUniverse = 1;
+static int g_autoMapPixels = -1;
+// sender marks frames with sync, they are sent only on sync packet
+static bool g_bWaitForSync = false;
+static unsigned int g_lastSyncMs = 0;
+static int g_socket_e131 = -1;
+static int g_socket_artnet = -1;
+static int g_retry_delay = 0;
+static byte *g_e131_buffer = 0;
+static unsigned int stat_e131Frames = 0;
+static unsigned int stat_e131Packets = 0;
+static unsigned int stat_e131Ignored = 0;
+
+static unsigned int E131_GetMS() {
+	return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+static void E131_ShowFrame();
+
+static void E131_SetWaitForSync(bool bWait) {
+	if (bWait && g_bWaitForSync == false) {
+		g_lastSyncMs = E131_GetMS();
+	}
+	g_bWaitForSync = bWait;
+}
+static void E131_OnSync() {
+	E131_SetWaitForSync(true);
+	g_lastSyncMs = E131_GetMS();
+	E131_ShowFrame();
+}
+static unsigned int E131_U16(const byte *p) {
+	return (p[0] << 8) | p[1];
+}
+static unsigned int E131_U32(const byte *p) {
+	return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+static void E131_JoinUniverse(int universe) {
+	struct ip_mreq mreq;
+
+	if (g_socket_e131 < 0) {
+		return;
+	}
+	// 239.255.<universe hi>.<universe lo>
+	mreq.imr_multiaddr.s_addr = htonl(0xEFFF0000 | (universe & 0xFFFF));
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (setsockopt(g_socket_e131, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*)&mreq, sizeof(mreq)) < 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_DDP, "E131 failed to join universe %i\n", universe);
+	}
+}
+static e131Universe_t *E131_FindUniverse(int universe) {
+	int i;
+
+	for (i = 0; i < g_numUniverses; i++) {
+		if (g_universes[i].universe == universe) {
+			return &g_universes[i];
+		}
+	}
+	return 0;
+}
+static e131Universe_t *E131_AddUniverse(int universe, int firstPixel, int pixelCount, int startChannel, int channelsPerPixel) {
+	e131Universe_t *u;
+
+	u = E131_FindUniverse(universe);
+	if (u == 0) {
+		if (g_numUniverses >= E131_MAX_UNIVERSES) {
+			return 0;
+		}
+		u = &g_universes[g_numUniverses++];
+		E131_JoinUniverse(universe);
+	}
+	memset(u, 0, sizeof(*u));
+	u->universe = universe;
+	u->firstPixel = firstPixel;
+	u->pixelCount = pixelCount;
+	u->startChannel = startChannel;
+	u->channelsPerPixel = channelsPerPixel;
+	return u;
+}
+// consecutive universes of 170 RGB pixels from first one
+static void E131_UpdateAutoMap() {
+	int pixel;
+
+	if (g_bAutoMap == false || g_autoMapPixels == (int)pixel_count) {
+		return;
+	}
+	g_autoMapPixels = pixel_count;
+	g_numUniverses = 0;
+	for (pixel = 0; pixel < (int)pixel_count; pixel += E131_PIXELS_PER_UNIVERSE) {
+		int count = pixel_count - pixel;
+		if (count > E131_PIXELS_PER_UNIVERSE) {
+			count = E131_PIXELS_PER_UNIVERSE;
+		}
+		if (E131_AddUniverse(g_firstUniverse + pixel / E131_PIXELS_PER_UNIVERSE, pixel, count, 1, 3) == 0) {
+			break;
+		}
+	}
+}
+static void E131_ShowFrame() {
+	unsigned int now = E131_GetMS();
+	bool bAny = false;
+	int i;
+
+	for (i = 0; i < g_numUniverses; i++) {
+		e131Universe_t *u = &g_universes[i];
+		if (u->bInFrame == false) {
+			continue;
+		}
+		u->lastLatencyMs = now - u->arrivedMs;
+		if (u->lastLatencyMs > u->maxLatencyMs) {
+			u->maxLatencyMs = u->lastLatencyMs;
+		}
+		u->bInFrame = false;
+		bAny = true;
+	}
+	if (bAny) {
+		stat_e131Frames++;
+		Strip_Apply();
+	}
+}
+static bool E131_IsFrameComplete() {
+	int i;
+
+	for (i = 0; i < g_numUniverses; i++) {
+		if (g_universes[i].bInFrame == false) {
+			return false;
+		}
+	}
+	return true;
+}
+// seq 0 in Art-Net means sender does not count
+static void E131_CountSequence(e131Universe_t *u, int seq, bool bArtNet) {
+	byte diff;
+
+	if (bArtNet && seq == 0) {
+		return;
+	}
+	if (u->bSeqValid) {
+		diff = (byte)(seq - u->lastSeq);
+		// big jump back is restart or reordering, not loss
+		if (diff > 1 && diff < 128) {
+			u->lost += diff - 1;
+		}
+	}
+	u->lastSeq = seq;
+	u->bSeqValid = true;
+}
+static void E131_OnUniverseData(int universe, int seq, bool bArtNet, const byte *dmx, int channels) {
+	e131Universe_t *u;
+	int skip, count;
+
+	E131_UpdateAutoMap();
+	u = E131_FindUniverse(universe);
+	if (u == 0) {
+		stat_e131Ignored++;
+		return;
+	}
+	u->packets++;
+	E131_CountSequence(u, seq, bArtNet);
+	if (g_bWaitForSync && E131_GetMS() - g_lastSyncMs > E131_SYNC_TIMEOUT_MS) {
+		g_bWaitForSync = false;
+	}
+	// next frame started before this one was complete
+	if (u->bInFrame && g_bWaitForSync == false) {
+		E131_ShowFrame();
+	}
+	skip = u->startChannel - 1;
+	count = 0;
+	if (channels > skip) {
+		count = (channels - skip) / u->channelsPerPixel;
+	}
+	if (count > u->pixelCount) {
+		count = u->pixelCount;
+	}
+	Strip_BlitPixels(u->firstPixel, dmx + skip, count, u->channelsPerPixel);
+	if (u->bInFrame == false) {
+		u->bInFrame = true;
+		u->arrivedMs = E131_GetMS();
+	}
+	if (g_bWaitForSync == false && E131_IsFrameComplete()) {
+		E131_ShowFrame();
+	}
+}
+static void E131_ParseSACN(const byte *data, int len) {
+	static const byte acnId[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+	unsigned int rootVector;
+	int channels;
+
+	if (len < 49 || memcmp(data + 4, acnId, sizeof(acnId))) {
+		return;
+	}
+	rootVector = E131_U32(data + 18);
+	if (rootVector == E131_ROOT_VECTOR_EXTENDED) {
+		if (E131_U32(data + 40) == E131_FRAME_VECTOR_SYNC) {
+			E131_OnSync();
+		}
+		return;
+	}
+	if (rootVector != E131_ROOT_VECTOR_DATA || len < 126 || E131_U32(data + 40) != E131_FRAME_VECTOR_DATA) {
+		return;
+	}
+	// preview data is for visualisers, terminated stream carries no levels
+	if (data[112] & (E131_OPT_PREVIEW | E131_OPT_TERMINATED)) {
+		return;
+	}
+	// only DMX null start code carries levels
+	if (data[117] != 0x02 || data[125] != 0) {
+		return;
+	}
+	E131_SetWaitForSync(E131_U16(data + 109) != 0);
+	channels = E131_U16(data + 123) - 1;
+	if (channels > len - 126) {
+		channels = len - 126;
+	}
+	E131_OnUniverseData(E131_U16(data + 113), data[111], false, data + 126, channels);
+}
+static void E131_ParseArtNet(const byte *data, int len) {
+	int opcode, channels;
+
+	opcode = data[8] | (data[9] << 8);
+	if (opcode == ARTNET_OP_SYNC) {
+		E131_OnSync();
+		return;
+	}
+	if (opcode != ARTNET_OP_DMX || len < 18) {
+		return;
+	}
+	channels = E131_U16(data + 16);
+	if (channels > len - 18) {
+		channels = len - 18;
+	}
+	// SubUni and Net make 15 bit Port-Address
+	E131_OnUniverseData(data[14] | ((data[15] & 0x7F) << 8), data[12], true, data + 18, channels);
+}
+void E131_ProcessPacket(const byte *data, int len) {
+	if (Strip_IsActive() == false) {
+		stat_e131Ignored++;
+		return;
+	}
+	stat_e131Packets++;
+	if (len >= 12 && !memcmp(data, "Art-Net", 8)) {
+		E131_ParseArtNet(data, len);
+	}
+	else {
+		E131_ParseSACN(data, len);
+	}
+}
+bool E131_GetUniverseStats(int universe, unsigned int *packets, unsigned int *lost, unsigned int *latencyMs) {
+	e131Universe_t *u;
+
+	E131_UpdateAutoMap();
+	u = E131_FindUniverse(universe);
+	if (u == 0) {
+		return false;
+	}
+	*packets = u->packets;
+	*lost = u->lost;
+	*latencyMs = u->lastLatencyMs;
+	return true;
+}
+unsigned int E131_GetFramesShown() {
+	return stat_e131Frames;
+}
+static int E131_CreateSocket(int port) {
+	struct sockaddr_in addr;
+	int flag = 1;
+	int s;
+
+	s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s < 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_DDP, "E131 failed to do socket\n");
+		return -1;
+	}
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char*)&flag, sizeof(flag));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_DDP, "E131 failed to bind port %i\n", port);
+		close(s);
+		return -1;
+	}
+	lwip_fcntl(s, F_SETFL, O_NONBLOCK);
+	return s;
+}
+static void E131_CreateSockets() {
+	int i;
+
+	if (g_socket_e131 < 0) {
+		g_socket_e131 = E131_CreateSocket(E131_PORT);
+		for (i = 0; i < g_numUniverses; i++) {
+			E131_JoinUniverse(g_universes[i].universe);
+		}
+	}
+	if (g_socket_artnet < 0) {
+		g_socket_artnet = E131_CreateSocket(ARTNET_PORT);
+	}
+}
+// returns false when time budget is used up
+static bool E131_ReadSocket(int s, unsigned int start) {
+	struct sockaddr_in addr;
+	int nbytes;
+
+	while (s >= 0) {
+		socklen_t addrlen = sizeof(addr);
+		nbytes = recvfrom(s, g_e131_buffer, E131_BUFFER_SIZE, 0, (struct sockaddr *)&addr, &addrlen);
+		if (nbytes <= 0) {
+			return true;
+		}
+		E131_ProcessPacket(g_e131_buffer, nbytes);
+		if (E131_GetMS() - start >= E131_RUNFRAME_BUDGET_MS) {
+			return false;
+		}
+	}
+	return true;
+}
+void E131_RunFrame() {
+	unsigned int start;
+
+	if (g_socket_e131 < 0 || g_socket_artnet < 0) {
+		g_retry_delay--;
+		if (g_retry_delay <= 0) {
+			g_retry_delay = 15;
+			E131_CreateSockets();
+		}
+	}
+	if (g_e131_buffer == 0) {
+		return;
+	}
+	// new universes to join when strip got longer
+	E131_UpdateAutoMap();
+	start = E131_GetMS();
+	if (E131_ReadSocket(g_socket_e131, start)) {
+		E131_ReadSocket(g_socket_artnet, start);
+	}
+}
+// E131_Map 1 0 170
+// E131_Map 2 170 100 1 3
+// E131_Map 3 0 128 1 4
+static commandResult_t CMD_E131_Map(const void *context, const char *cmd, const char *args, int flags) {
+	int universe, firstPixel, pixelCount, startChannel, channelsPerPixel;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 3)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	universe = Tokenizer_GetArgIntegerRange(0, 0, 63999);
+	firstPixel = Tokenizer_GetArgIntegerRange(1, 0, 65535);
+	pixelCount = Tokenizer_GetArgIntegerRange(2, 0, 170);
+	startChannel = Tokenizer_GetArgIntegerDefault(3, 1);
+	channelsPerPixel = Tokenizer_GetArgIntegerDefault(4, 3);
+	if (startChannel < 1 || startChannel > 512 || (channelsPerPixel != 3 && channelsPerPixel != 4)) {
+		ADDLOG_ERROR(LOG_FEATURE_DDP, "E131_Map: start channel is 1-512, channels per pixel 3 or 4");
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	if (g_bAutoMap) {
+		g_bAutoMap = false;
+		g_numUniverses = 0;
+	}
+	// sender may change too
+	g_bWaitForSync = false;
+	if (E131_AddUniverse(universe, firstPixel, pixelCount, startChannel, channelsPerPixel) == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_DDP, "E131_Map: at most %i universes", E131_MAX_UNIVERSES);
+		return CMD_RES_ERROR;
+	}
+	return CMD_RES_OK;
+}
+void E131_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState) {
+	int i;
+
+	if (bPreState) {
+		return;
+	}
+	hprintf255(request, "<h2>E1.31/Art-Net: %u packets, %u frames, %u ignored</h2>",
+		stat_e131Packets, stat_e131Frames, stat_e131Ignored);
+	for (i = 0; i < g_numUniverses; i++) {
+		e131Universe_t *u = &g_universes[i];
+		hprintf255(request, "<h5>Universe %i (pixels %i-%i): %u packets, %u lost, latency %u ms (max %u)</h5>",
+			u->universe, u->firstPixel, u->firstPixel + u->pixelCount - 1,
+			u->packets, u->lost, u->lastLatencyMs, u->maxLatencyMs);
+	}
+}
+void E131_Init() {
+	g_firstUniverse = Tokenizer_GetArgIntegerDefault(1, 1);
+	g_bAutoMap = true;
+	g_autoMapPixels = -1;
+	g_numUniverses = 0;
+	g_bWaitForSync = false;
+	stat_e131Frames = 0;
+	stat_e131Packets = 0;
+	stat_e131Ignored = 0;
+	if (g_e131_buffer == 0) {
+		g_e131_buffer = malloc(E131_BUFFER_SIZE);
+	}
+	E131_CreateSockets();
+
+	//cmddetail:{"name":"E131_Map","args":"[Universe] [FirstPixel] [PixelCount] [StartChannel] [ChannelsPerPixel]",
+	//cmddetail:"descr":"Maps E1.31/Art-Net universe onto strip pixels, PixelCount up to 170, StartChannel is 1 based (default 1), ChannelsPerPixel is 3 (RGB, default) or 4 (RGBW). First use replaces default map of consecutive universes from the one given to startDriver.",
+	//cmddetail:"fn":"CMD_E131_Map","file":"driver/drv_e131.c","requires":"",
+	//cmddetail:"examples":"E131_Map 1 0 170"}
+	CMD_RegisterCommand("E131_Map", CMD_E131_Map, NULL);
+}
+void E131_Shutdown() {
+	if (g_socket_e131 >= 0) {
+		close(g_socket_e131);
+		g_socket_e131 = -1;
+	}
+	if (g_socket_artnet >= 0) {
+		close(g_socket_artnet);
+		g_socket_artnet = -1;
+	}
+	if (g_e131_buffer) {
+		free(g_e131_buffer);
+		g_e131_buffer = 0;
+	}
+	g_numUniverses = 0;
+}
+
+#endif
@@ -1,14 +1,347 @@
 // freeze
+#include "../new_common.h"
+#include "../logging/logging.h"
+#include "../cmnds/cmd_public.h"
+#include "../httpserver/new_http.h"
 #include "drv_local.h"
+#include "drv_freeze.h"
+#include "../quicktick.h"
+#if ENABLE_MQTT
+#include "../mqtt/new_mqtt.h"
+#endif
 
-void Freeze_OnEverySecond() {
+#if ENABLE_DRIVER_FREEZE
+
+#if PLATFORM_BEKEN
+#include "include.h"
+#include "arm_arch.h"
+#include "bk_timer_pub.h"
+#include "drv_model_pub.h"
+#elif PLATFORM_BL602
+#include <hal_hwtimer.h>
+#endif
+
+// Software watchdog. Supervised tasks call WDT_Heartbeat from their loops,
+// timer checks their deadlines, which are below hardware watchdog time
+// (10 s on Beken), so stuck task is written to crash log before reset.
+// Line has task, how long it is stuck, task and PC that timer interrupted
+// where platform gives them, and last executed command.
+// Task with restart hook is restarted alone when WDT_Restart is on, other
+// stuck tasks stop feeding of hardware watchdog, so device resets.
+//
+// Checked from hardware timer on Beken (BKTIMER3, IR2 has BKTIMER0,
+// PinMutex BKTIMER1, profiler BKTIMER2) and BL602, from highest priority
+// task on ESP-IDF, elsewhere once a second from main loop, which then
+// cannot see main loop itself stuck.
+
+#define WDT_CHECK_MS		250
+#define WDT_CMD_LEN			40
+
+typedef struct wdtTaskState_s {
+	const char *name;
+	int deadlineMs;
+	void(*restart)();
+	volatile uint32_t last;
+	volatile byte bSeen;
+	// set by check, cleared by next heartbeat
+	volatile byte bStuck;
+	volatile byte bRestartPending;
+	int maxGapMs;
+	unsigned int stuckCount;
+	unsigned int restarts;
+} wdtTaskState_t;
+
+#if ENABLE_MQTT
+static void WDT_RestartMQTT() {
+	// disconnect and connect again on next MQTT second
+	mqtt_reconnect = 1;
+}
+#else
+#define WDT_RestartMQTT		NULL
+#endif
+
+static wdtTaskState_t g_wdtTasks[WDT_TASK_COUNT] = {
+	{ .name = "Main", .deadlineMs = 5000, .restart = NULL, .last = 0 },
+	{ .name = "QuickTick", .deadlineMs = 3000, .restart = NULL, .last = 0 },
+	{ .name = "MQTT", .deadlineMs = 5000, .restart = WDT_RestartMQTT, .last = 0 },
+	{ .name = "HTTP", .deadlineMs = 5000, .restart = NULL, .last = 0 },
+	{ .name = "Script", .deadlineMs = 3000, .restart = NULL, .last = 0 },
+};
+static char g_wdtLastCmd[WDT_CMD_LEN];
+static bool g_wdtRunning = false;
+static bool g_wdtRestart = false;
+
+#if PLATFORM_BEKEN
+static uint32_t g_wdtChan = BKTIMER3;
+#elif PLATFORM_BL602
+static hw_timer_t *g_wdtTimer = 0;
+#elif PLATFORM_ESPIDF
+static TaskHandle_t g_wdtThread = 0;
+#endif
+
+void WDT_Heartbeat(int task) {
+	wdtTaskState_t *t = &g_wdtTasks[task];
+	uint32_t now = SYSPERF_GetTimeMs();
+	int gap;
+
+	if (t->bSeen) {
+		gap = now - t->last;
+		if (gap > t->maxGapMs) {
+			t->maxGapMs = gap;
+		}
+	}
+	t->last = now;
+	t->bSeen = 1;
+	t->bStuck = 0;
+}
+void WDT_NoteCommand(const char *cmd) {
+	strncpy(g_wdtLastCmd, cmd, WDT_CMD_LEN - 1);
+}
+// may run in ISR, takes no mutex and does not allocate
+static void WDT_CheckAt(uint32_t now, unsigned int pc, const char *curTask) {
+	wdtTaskState_t *t;
+	char line[96];
+	int i, since;
+
+	if (g_wdtRunning == false) {
+		return;
+	}
+	for (i = 0; i < WDT_TASK_COUNT; i++) {
+		t = &g_wdtTasks[i];
+		if (t->bSeen == 0 || t->bStuck || t->deadlineMs <= 0) {
+			continue;
+		}
+		since = now - t->last;
+		if (since < t->deadlineMs) {
+			continue;
+		}
+		t->bStuck = 1;
+		t->stuckCount++;
+		if (g_wdtRestart && t->restart) {
+			t->bRestartPending = 1;
+		}
+		// last byte of command copy is never written, so it stays terminated
+		snprintf(line, sizeof(line), "WDT %s stuck %i ms in %s pc %x cmd %s",
+			t->name, since, curTask ? curTask : "-", pc, g_wdtLastCmd);
+#if ENABLE_CRASH_LOG
+		LOG_CrashLogNote(line);
+#endif
+	}
+}
+void WDT_Check() {
+	WDT_CheckAt(SYSPERF_GetTimeMs(), 0, 0);
+}
+bool WDT_IsHealthy() {
+	int i;
+
+	if (g_wdtRunning == false) {
+		return true;
+	}
+	for (i = 0; i < WDT_TASK_COUNT; i++) {
+		if (g_wdtTasks[i].bStuck && (g_wdtRestart == false || g_wdtTasks[i].restart == 0)) {
+			return false;
+		}
+	}
+	return true;
+}
+void WDT_GetStats(int task, wdtStats_t *out) {
+	wdtTaskState_t *t = &g_wdtTasks[task];
+
+	out->name = t->name;
+	out->sinceMs = t->bSeen ? (int)(SYSPERF_GetTimeMs() - t->last) : -1;
+	out->deadlineMs = t->deadlineMs;
+	out->maxGapMs = t->maxGapMs;
+	out->stuckCount = t->stuckCount;
+	out->restarts = t->restarts;
+}
+
+#if PLATFORM_BEKEN
+// NOTE: ISR
+static void WDT_ISR(UINT8 t) {
+	WDT_CheckAt(SYSPERF_GetTimeMs(), 0, pcTaskGetName(NULL));
+}
+#elif PLATFORM_BL602
+// NOTE: ISR
+static void WDT_ISR(void) {
+	unsigned int pc;
+
+	__asm__ volatile ("csrr %0, mepc" : "=r"(pc));
+	WDT_CheckAt(SYSPERF_GetTimeMs(), pc, pcTaskGetName(NULL));
+}
+#elif PLATFORM_ESPIDF
+static void WDT_Thread(void *param) {
+	while (1) {
+		vTaskDelay(pdMS_TO_TICKS(WDT_CHECK_MS));
+		WDT_Check();
+	}
+}
+#endif
+
+static void WDT_StartTimer() {
+#if PLATFORM_BEKEN
+	timer_param_t params = {
+		(unsigned char)g_wdtChan,
+		1, // div
+		WDT_CHECK_MS * 1000, // us
+		WDT_ISR
+	};
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_INIT_PARAM_US, &params);
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_ENABLE, &g_wdtChan);
+#elif PLATFORM_BL602
+	hal_hwtimer_init();
+	g_wdtTimer = hal_hwtimer_create(WDT_CHECK_MS, WDT_ISR, 1);
+#elif PLATFORM_ESPIDF
+	xTaskCreate(WDT_Thread, "wdt", 2048, NULL, configMAX_PRIORITIES - 1, &g_wdtThread);
+#endif
+}
+static void WDT_StopTimer() {
+#if PLATFORM_BEKEN
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_DISABLE, &g_wdtChan);
+#elif PLATFORM_BL602
+	if (g_wdtTimer) {
+		hal_hwtimer_delete(g_wdtTimer);
+		g_wdtTimer = 0;
+	}
+#elif PLATFORM_ESPIDF
+	if (g_wdtThread) {
+		vTaskDelete(g_wdtThread);
+		g_wdtThread = 0;
+	}
+#endif
+}
+
+static int WDT_FindTask(const char *name) {
+	int i;
+
+	for (i = 0; i < WDT_TASK_COUNT; i++) {
+		if (!stricmp(g_wdtTasks[i].name, name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+// WDT_Deadline [Task] [DeadlineMS]
+static commandResult_t CMD_WDT_Deadline(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int task;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 2)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	task = WDT_FindTask(Tokenizer_GetArg(0));
+	if (task < 0) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	g_wdtTasks[task].deadlineMs = Tokenizer_GetArgIntegerRange(1, 0, 60000);
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_WDT_Restart(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	g_wdtRestart = Tokenizer_GetArgInteger(0) != 0;
+	return CMD_RES_OK;
+}
+// WDT_Stats [reset]
+static commandResult_t CMD_WDT_Stats(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	wdtTaskState_t *t;
+	int i;
+
+	for (i = 0; i < WDT_TASK_COUNT; i++) {
+		t = &g_wdtTasks[i];
+		ADDLOG_INFO(LOG_FEATURE_CMD, "WDT %s: max gap %i ms, deadline %i ms, stuck %u, restarts %u",
+			t->name, t->maxGapMs, t->deadlineMs, t->stuckCount, t->restarts);
+		if (!stricmp(args, "reset")) {
+			t->maxGapMs = 0;
+		}
+	}
+	return CMD_RES_OK;
+}
+// main loop busy forever, to test watchdog
+static commandResult_t CMD_WDT_Freeze(const void *context, const char *cmd, const char *args, int cmdFlags) {
+#if WINDOWS
+	return CMD_RES_ERROR;
+#else
 	while (1) {
 		// freeze
 	}
+#endif
 }
-void Freeze_RunFrame() {
-	//don't freeze, seems this does not allow watchdog reset to work on BL602
+
+void Freeze_OnEverySecond() {
+	wdtTaskState_t *t;
+	int i;
+
+#if !(PLATFORM_BEKEN || PLATFORM_BL602 || PLATFORM_ESPIDF)
+	WDT_Check();
+#endif
+	// restart hooks run here, not in timer
+	for (i = 0; i < WDT_TASK_COUNT; i++) {
+		t = &g_wdtTasks[i];
+		if (t->bRestartPending) {
+			t->bRestartPending = 0;
+			t->restarts++;
+			ADDLOG_ERROR(LOG_FEATURE_CMD, "WDT: restarting %s", t->name);
+			t->restart();
+		}
+	}
 }
+void Freeze_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
+	wdtTaskState_t *t;
+	int i;
+
+	if (bPreState) {
+		return;
+	}
+	hprintf255(request, "<h5>WDT max gap:");
+	for (i = 0; i < WDT_TASK_COUNT; i++) {
+		t = &g_wdtTasks[i];
+		if (t->bSeen) {
+			hprintf255(request, " %s %i%s", t->name, t->maxGapMs, t->bStuck ? " (stuck)" : "");
+		}
+	}
+	hprintf255(request, " ms</h5>");
+}
+void Freeze_Stop() {
+	WDT_StopTimer();
+	g_wdtRunning = false;
+}
+// startDriver Freeze
+// WDT_Deadline MQTT 8000
 void Freeze_Init() {
-	// don't freeze
+	int i;
+
+	for (i = 0; i < WDT_TASK_COUNT; i++) {
+		g_wdtTasks[i].bStuck = 0;
+		g_wdtTasks[i].bRestartPending = 0;
+		g_wdtTasks[i].maxGapMs = 0;
+		g_wdtTasks[i].stuckCount = 0;
+		g_wdtTasks[i].restarts = 0;
+	}
+	g_wdtRunning = true;
+	WDT_StartTimer();
+
+	//cmddetail:{"name":"WDT_Deadline","args":"[Task] [DeadlineMS]",
+	//cmddetail:"descr":"Sets how long Main, QuickTick, MQTT, HTTP or Script task may go without heartbeat before it is taken as stuck. 0 stops supervising it.",
+	//cmddetail:"fn":"CMD_WDT_Deadline","file":"driver/drv_freeze.c","requires":"",
+	//cmddetail:"examples":"WDT_Deadline MQTT 8000"}
+	CMD_RegisterCommand("WDT_Deadline", CMD_WDT_Deadline, NULL);
+	//cmddetail:{"name":"WDT_Restart","args":"[0or1]",
+	//cmddetail:"descr":"With 1, stuck task that can be restarted alone (MQTT) is restarted. Otherwise stuck task stops feeding of hardware watchdog, so device resets.",
+	//cmddetail:"fn":"CMD_WDT_Restart","file":"driver/drv_freeze.c","requires":"",
+	//cmddetail:"examples":"WDT_Restart 1"}
+	CMD_RegisterCommand("WDT_Restart", CMD_WDT_Restart, NULL);
+	//cmddetail:{"name":"WDT_Stats","args":"[reset]",
+	//cmddetail:"descr":"Logs longest time between heartbeats of each task, its deadline and how often it was stuck. With reset, longest times start again.",
+	//cmddetail:"fn":"CMD_WDT_Stats","file":"driver/drv_freeze.c","requires":"",
+	//cmddetail:"examples":"WDT_Stats reset"}
+	CMD_RegisterCommand("WDT_Stats", CMD_WDT_Stats, NULL);
+	//cmddetail:{"name":"WDT_Freeze","args":"",
+	//cmddetail:"descr":"Freezes main loop forever, to test watchdog.",
+	//cmddetail:"fn":"CMD_WDT_Freeze","file":"driver/drv_freeze.c","requires":"",
+	//cmddetail:"examples":"WDT_Freeze"}
+	CMD_RegisterCommand("WDT_Freeze", CMD_WDT_Freeze, NULL);
 }
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../obk_config.h"
+
+// tasks supervised by Freeze driver, each calls WDT_Heartbeat from its loop
+typedef enum {
+	WDT_TASK_MAIN,
+	WDT_TASK_QUICKTICK,
+	WDT_TASK_MQTT,
+	WDT_TASK_HTTP,
+	WDT_TASK_SCRIPT,
+	WDT_TASK_COUNT
+} wdtTask_t;
+
+typedef struct wdtStats_s {
+	const char *name;
+	// -1 until task has beaten once
+	int sinceMs;
+	int deadlineMs;
+	int maxGapMs;
+	unsigned int stuckCount;
+	unsigned int restarts;
+} wdtStats_t;
+
+#if ENABLE_DRIVER_FREEZE
+
+void WDT_Heartbeat(int task);
+// copies command, so last one is known when a task hangs in it
+void WDT_NoteCommand(const char *cmd);
+// false while supervisor sees stuck task that was not restarted,
+// then hardware watchdog is no longer fed and resets device
+bool WDT_IsHealthy();
+// runs deadline check, normally from timer
+void WDT_Check();
+void WDT_GetStats(int task, wdtStats_t *out);
+
+#else
+
+#define WDT_Heartbeat(task)
+#define WDT_NoteCommand(cmd)
+#define WDT_IsHealthy()		true
+
+#endif
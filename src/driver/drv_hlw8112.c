@@ -10,6 +10,7 @@
 #if ENABLE_DRIVER_HLW8112SPI
 
 #include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <inttypes.h>
 
@@ -54,6 +55,7 @@ static HLW8112_UpdateData_t last_update_data = {
 };	// last scaled values for ext systems 
 
 static int stat_save_count_down = HLW8112_SAVE_COUNTER;
+static int config_read_count_down = 0;
 int GPIO_HLW_SCSN = 9;
 
 #pragma region HLW8112 utils
@@ -121,12 +123,13 @@ int HLW8112_ReadRegister(uint8_t reg, uint8_t size, uint32_t *valueResult) {
   	uint8_t rx[5] = {0};
   	tx[0] = reg & 0x7F;
   	
-	int result = HLW8112_SPI_Transact(tx, 1, rx, 5);
+	// clock only bytes of register
+	int result = HLW8112_SPI_Transact(tx, 1, rx, size);
   	if (result < 0) {
     	ADDLOG_ERROR(LOG_FEATURE_ENERGYMETER, "HLW8112_ReadRegister non zero result %d", result);
     	return result;
   	}
-  	HLW8112_Print_Array(rx, 5);
+  	HLW8112_Print_Array(rx, size);
   
 	uint32_t value = 0x0;
   	if (size == 4) {
@@ -170,6 +173,55 @@ int HLW8112_ReadRegister32(uint8_t reg, uint32_t *valueResult) {
   	ADDLOG_DEBUG(LOG_FEATURE_ENERGYMETER, "HLW8112_ReadRegister32 reg= %02X  :  v = %08X", reg, *valueResult);
   	return result;
 }
+
+// Registers of one update, declared once. Chip has no burst read, so each
+// is own transaction, but both channels come in one pass and one update.
+typedef struct {
+	uint8_t reg;
+	uint8_t size;
+	uint8_t offset;
+} HLW8112_ScanReg_t;
+
+#define HLW8112_SCAN(REG, SIZE, FIELD) { HLW8112_REG_##REG, SIZE, offsetof(HLW8112_Data_t, FIELD) }
+
+static const HLW8112_ScanReg_t g_hlw8112Scan[] = {
+	HLW8112_SCAN(RMSU, 3, v_rms),
+	HLW8112_SCAN(UFREQ, 2, freq),
+	HLW8112_SCAN(RMSIA, 3, ia_rms),
+	HLW8112_SCAN(POWER_PA, 4, pa),
+	HLW8112_SCAN(ENERGY_PA, 3, ea),
+	HLW8112_SCAN(RMSIB, 3, ib_rms),
+	HLW8112_SCAN(POWER_PB, 4, pb),
+	HLW8112_SCAN(ENERGY_PB, 3, eb),
+	HLW8112_SCAN(POWER_FACTOR, 3, pf),
+	HLW8112_SCAN(POWER_S, 4, ap),
+	HLW8112_SCAN(SYSSTATUS, 1, sysstat),
+	HLW8112_SCAN(EMUSTATUS, 3, emustat),
+	HLW8112_SCAN(IF, 2, int_f),
+};
+
+// returns 0 if whole list was read, field width follows register size
+int HLW8112_ReadScanList(const HLW8112_ScanReg_t *list, int count, void *out) {
+	uint32_t value;
+	uint8_t *field;
+	int i, result;
+
+	for (i = 0; i < count; i++) {
+		result = HLW8112_ReadRegister(list[i].reg, list[i].size, &value);
+		if (result < 0) {
+			return result;
+		}
+		field = (uint8_t*)out + list[i].offset;
+		if (list[i].size == 1) {
+			*field = (uint8_t)value;
+		} else if (list[i].size == 2) {
+			*(uint16_t*)field = (uint16_t)value;
+		} else {
+			*(uint32_t*)field = value;
+		}
+	}
+	return 0;
+}
 #pragma endregion
 
 #pragma region write
@@ -403,6 +455,7 @@ static commandResult_t HLW8112_write_reg(const void *context, const char *cmd, c
     	return CMD_RES_BAD_ARGUMENT;
   	}
   	int result = HLW8112_WriteRegister16((uint8_t)reg, (uint16_t)val);
+  	config_read_count_down = 0;
   	ADDLOG_INFO(LOG_FEATURE_CMD, "HLW8112_write_reg result %d", result);
 
   	int cr = HLW8112_CheckCoeffs();
@@ -1001,30 +1054,8 @@ static void HLW8112_ScaleAndUpdate(HLW8112_Data_t* data) {
 #pragma endregion
 
 
-void HLW8112_RunEverySecond(void) {
-	HLW8112_Data_t data;
-
-	HLW8112_ReadRegister24(HLW8112_REG_RMSU, &data.v_rms);
-	HLW8112_ReadRegister16(HLW8112_REG_UFREQ, &data.freq);
-
-	HLW8112_ReadRegister24(HLW8112_REG_RMSIA, &data.ia_rms);
-	HLW8112_ReadRegister32(HLW8112_REG_POWER_PA, &data.pa);
-	HLW8112_ReadRegister24(HLW8112_REG_ENERGY_PA, &data.ea);
-
-	HLW8112_ReadRegister24(HLW8112_REG_RMSIB, &data.ib_rms);
-
-	HLW8112_ReadRegister32(HLW8112_REG_POWER_PB, &data.pb);
-	HLW8112_ReadRegister24(HLW8112_REG_ENERGY_PB, &data.eb);
-
-	HLW8112_ReadRegister24(HLW8112_REG_POWER_FACTOR, &data.pf);
-	HLW8112_ReadRegister32(HLW8112_REG_POWER_S, &data.ap);
-	
-	HLW8112_ReadRegister8(HLW8112_REG_SYSSTATUS, &data.sysstat);
-	HLW8112_ReadRegister24(HLW8112_REG_EMUSTATUS, &data.emustat);
-	HLW8112_ReadRegister16(HLW8112_REG_IF, &data.int_f);
-
-
-
+// settings shown on HTTP page, they change only by own writes
+void HLW8112_ReadConfigRegisters(void) {
 	READ_REG(SYSCON,16);
 	READ_REG(EMUCON,16);
 	READ_REG(HFCONST,16);
@@ -1042,7 +1073,19 @@ void HLW8112_RunEverySecond(void) {
 	READ_REG(PSGAIN,16);
 	READ_REG(PSOS,16);
 	READ_REG(EMUCON2,16);
-	
+}
+
+void HLW8112_RunEverySecond(void) {
+	HLW8112_Data_t data;
+
+	memset(&data, 0, sizeof(data));
+	if (HLW8112_ReadScanList(g_hlw8112Scan, sizeof(g_hlw8112Scan) / sizeof(g_hlw8112Scan[0]), &data) < 0) {
+		return;
+	}
+	if (--config_read_count_down <= 0) {
+		HLW8112_ReadConfigRegisters();
+		config_read_count_down = HLW8112_CONFIG_READ_INTERVAL;
+	}
 	last_data = data;
 
     HLW8112_ScaleAndUpdate(&data);
@@ -1112,6 +1155,7 @@ void HLW8112_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreS
 					break;
 				}
 			}
+			config_read_count_down = 0;
 		}
 		//?action=reg_edit&reg_value=&reg=100&reg_width=24&compliment=1
 		return;
@@ -1233,14 +1277,14 @@ void HLW8112_OnHassDiscovery(const char *topic) {
     ADDLOG_ERROR(LOG_FEATURE_ENERGYMETER, "HLW8112_OnHassDiscovery");
 	HassDeviceInfo* dev_info = NULL;
 	dev_info = hass_init_button_device_info("Clear Energy A", "clear_energy", "channel_a", HASS_CATEGORY_DIAGNOSTIC);
-	MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+	hass_publish_discovery(topic, dev_info);
 	dev_info = hass_init_button_device_info("Clear Energy B", "clear_energy", "channel_b", HASS_CATEGORY_DIAGNOSTIC);
-	MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+	hass_publish_discovery(topic, dev_info);
 	hass_free_device_info(dev_info);
 }
 
 void HLW8112_Save_Statistics() {
-	if (DRV_IsRunning("HLW8112SPI")){
+	if (DRV_IsRunning(DRV_ID_HLW8112SPI)){
 		HLW8112_save_stats(HLW8112_SAVE_FORCE);
 	}
 }
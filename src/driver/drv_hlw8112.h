@@ -39,6 +39,7 @@ void HLW8112_Save_Statistics();
 #define DEFAULT_INTERNAL_CLK 			3579545UL
 #define HLW8112_INVALID_REGVALUE  		1 << 23
 #define HLW8112_SAVE_COUNTER 			3600 // 1 * 60 * 60;	// maybe once in a hour
+#define HLW8112_CONFIG_READ_INTERVAL 	60 // seconds, settings registers are not in the fast scan
 
 #define DEFAULT_RES_KU 					1.0f
 #define DEFAULT_RES_KIA 				0.2f
@@ -11,6 +11,7 @@
 #include "drv_local.h"
 #include "drv_ssdp.h"
 #include "../httpserver/new_http.h"
+#include "drv_deviceclock.h"
 
 // Hue driver for Alexa, requiring btsimonh's SSDP to work
 // Based on Tasmota approach
@@ -111,56 +112,224 @@ void HUE_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState
 
 }
 
-const char *g_hue_setup_1 = "<?xml version=\"1.0\"?>"
+// ARGUMENTS: IP, IP, serial, uuid
+static const char *g_hue_setup =
+"<?xml version=\"1.0\"?>"
 "<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
 "<specVersion>"
 "<major>1</major>"
 "<minor>0</minor>"
 "</specVersion>"
-"<URLBase>http://";
-// IP ADDR HERE
-const char *g_hue_setup_2 = ":80/</URLBase>"
+"<URLBase>http://%s:80/</URLBase>"
 "<device>"
 "<deviceType>urn:schemas-upnp-org:device:Basic:1</deviceType>"
-"<friendlyName>Amazon-Echo-HA-Bridge (";
-// IP ADDR HERE
-const char *g_hue_setup_3 = ")</friendlyName>"
+"<friendlyName>Amazon-Echo-HA-Bridge (%s)</friendlyName>"
 "<manufacturer>Royal Philips Electronics</manufacturer>"
 "<manufacturerURL>http://www.philips.com</manufacturerURL>"
 "<modelDescription>Philips hue Personal Wireless Lighting</modelDescription>"
 "<modelName>Philips hue bridge 2012</modelName>"
 "<modelNumber>929000226503</modelNumber>"
-"<serialNumber>";
-// SERIAL here
-const char *g_hue_setup_4 = "</serialNumber>"
-"<UDN>uuid:";
-// UID HERE
-const char *g_hue_setup_5 = "</UDN>"
-   "</device>"
-   "</root>\r\n"
-   "\r\n";
+"<serialNumber>%s</serialNumber>"
+"<UDN>uuid:%s</UDN>"
+"</device>"
+"</root>\r\n"
+"\r\n";
+
+// ARGUMENTS: mac, IP, mask, gateway, bridgeID, UTC, user, last use date, create date
+static const char *g_hue_config =
+"{\"name\":\"Philips hue\",\"mac\":\"%s\",\"dhcp\":true,\"ipaddress\":\"%s\","
+"\"netmask\":\"%s\",\"gateway\":\"%s\",\"proxyaddress\":\"none\",\"proxyport\":0,"
+"\"bridgeid\":\"%s\",\"UTC\":\"%s\",\"whitelist\":{\"%s\":{\"last use date\":\"%s\","
+"\"create date\":\"%s\",\"name\":\"Remote\"}},\"swversion\":\"01041302\",\"apiversion\":\"1.17.0\","
+"\"swupdate\":{\"updatestate\":0,\"url\":\"\",\"text\":\"\",\"notify\": false},"
+"\"linkbutton\":false,\"portalservices\":false}";
+
+static const char *g_hue_global_1 = "{\"lights\":{\"1\":";
+static const char *g_hue_global_2 = "},\"groups\":{},\"schedules\":{},\"config\":";
+static const char *g_hue_global_3 = "}";
+
+// device is exposed as single dimmable light with id 1
+static const char *g_hue_light =
+"{\"state\":{\"on\":%s,\"bri\":%i,\"alert\":\"none\",\"reachable\":true},"
+"\"type\":\"Dimmable light\",\"name\":\"%s\",\"modelid\":\"LWB010\","
+"\"manufacturername\":\"Philips\",\"uniqueid\":\"%s-01\",\"swversion\":\"1.46.13_r26312\"}";
+
+// placeholder for dates, same length as real ones
+#define HUE_DATE_EMPTY	"1970-01-01T00:00:00"
+#define HUE_DATE_LEN	19
+
+// Replies are built for IP device has, then requests only copy them.
+// Only dates of config are written again each time.
+static char g_hueBuiltForIP[32];
+static char *g_hueSetupReply = 0;
+static int g_hueSetupReplyLen = 0;
+static char *g_hueConfigReply = 0;
+static int g_hueConfigReplyLen = 0;
+static int g_hueConfigUTCAt = 0;
+static int g_hueConfigLastUseAt = 0;
+
+// both replies fit, checked by length after printing
+#define HUE_REPLY_MAX	1024
+
+static char *HUE_Printf(int *outLen, const char *fmt, ...) {
+	va_list argList;
+	char *r;
+
+	r = (char*)malloc(HUE_REPLY_MAX);
+	if (r == 0) {
+		return 0;
+	}
+	va_start(argList, fmt);
+	vsnprintf(r, HUE_REPLY_MAX, fmt, argList);
+	va_end(argList);
+	*outLen = strlen(r);
+	if (*outLen >= HUE_REPLY_MAX - 1) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_HTTP, "HUE reply too long");
+	}
+	return r;
+}
+static void HUE_FormatNow(char *out) {
+	if (TIME_IsTimeSynced() == false) {
+		strcpy(out, HUE_DATE_EMPTY);
+		return;
+	}
+	snprintf(out, HUE_DATE_LEN + 1, "%04i-%02i-%02iT%02i:%02i:%02i", TIME_GetYear(), TIME_GetMonth(),
+		TIME_GetMDay(), TIME_GetHour(), TIME_GetMinute(), TIME_GetSecond());
+}
+static bool HUE_BuildReplies() {
+	const char *ip = HAL_GetMyIPString();
+	unsigned char mac[8];
+	char macStr[24];
+	char now[HUE_DATE_LEN + 1];
+	char *p;
+
+	if (g_hueSetupReply && g_hueConfigReply && !strcmp(ip, g_hueBuiltForIP)) {
+		return true;
+	}
+	free(g_hueSetupReply);
+	free(g_hueConfigReply);
+	g_hueConfigReply = 0;
+	strcpy_safe(g_hueBuiltForIP, ip, sizeof(g_hueBuiltForIP));
+	g_hueSetupReply = HUE_Printf(&g_hueSetupReplyLen, g_hue_setup, ip, ip, g_serial, g_uid);
+	if (g_hueSetupReply == 0) {
+		return false;
+	}
+
+	WiFI_GetMacAddress((char*)mac);
+	snprintf(macStr, sizeof(macStr), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	HUE_FormatNow(now);
+	g_hueConfigReply = HUE_Printf(&g_hueConfigReplyLen, g_hue_config, macStr, ip, HAL_GetMyMaskString(),
+		HAL_GetMyGatewayString(), g_bridgeID, HUE_DATE_EMPTY, g_userID, HUE_DATE_EMPTY, now);
+	if (g_hueConfigReply == 0) {
+		return false;
+	}
+	p = strstr(g_hueConfigReply, "\"UTC\":\"");
+	g_hueConfigUTCAt = p ? p - g_hueConfigReply + 7 : -1;
+	p = strstr(g_hueConfigReply, "\"last use date\":\"");
+	g_hueConfigLastUseAt = p ? p - g_hueConfigReply + 17 : -1;
+	return true;
+}
+static void HUE_UpdateConfigDates() {
+	char now[HUE_DATE_LEN + 1];
+
+	HUE_FormatNow(now);
+	if (g_hueConfigUTCAt >= 0) {
+		memcpy(g_hueConfigReply + g_hueConfigUTCAt, now, HUE_DATE_LEN);
+	}
+	if (g_hueConfigLastUseAt >= 0) {
+		memcpy(g_hueConfigReply + g_hueConfigLastUseAt, now, HUE_DATE_LEN);
+	}
+}
 
 static int HUE_Setup(http_request_t* request) {
-	http_setup(request, httpMimeTypeXML);
-	poststr(request, g_hue_setup_1);
-	poststr(request, HAL_GetMyIPString());
-	poststr(request, g_hue_setup_2);
-	poststr(request, HAL_GetMyIPString());
-	poststr(request, g_hue_setup_3);
-	poststr(request, g_serial);
-	poststr(request, g_hue_setup_4);
-	poststr(request, g_uid);
-	poststr(request, g_hue_setup_5);
+	if (HUE_BuildReplies() == false) {
+		return 0;
+	}
+	http_setup_len(request, httpMimeTypeXML, g_hueSetupReplyLen);
+	postany(request, g_hueSetupReply, g_hueSetupReplyLen);
 	poststr(request, NULL);
 
 	stat_setupXMLVisits++;
 
 	return 0;
 }
-static int HUE_NotImplemented(http_request_t* request) {
+// Hue brightness is 1..254
+static int HUE_GetBrightness() {
+#if ENABLE_LED_BASIC
+	if (LED_IsLEDRunning()) {
+		return 1 + (int)(LED_GetDimmer() * 253 / 100 + 0.5f);
+	}
+#endif
+	return 254;
+}
+static int HUE_PrintLight(char *out, int outSize) {
+	return snprintf(out, outSize, g_hue_light, Main_GetFirstPowerState() ? "true" : "false",
+		HUE_GetBrightness(), CFG_GetShortDeviceName(), g_serial);
+}
+static int HUE_Light(http_request_t* request, bool bInList) {
+	char light[384];
+	int len;
+
+	len = HUE_PrintLight(light, sizeof(light));
+	http_setup_len(request, httpMimeTypeJson, len + (bInList ? 6 : 0));
+	if (bInList) {
+		postany(request, "{\"1\":", 5);
+	}
+	postany(request, light, len);
+	if (bInList) {
+		postany(request, "}", 1);
+	}
+	poststr(request, NULL);
+
+	return 0;
+}
+// value of "key": in JSON body, 0 if there is none
+static const char *HUE_FindValue(const char *body, const char *key) {
+	const char *p;
 
+	p = strstr(body, key);
+	if (p == 0) {
+		return 0;
+	}
+	p += strlen(key);
+	while (*p == ' ' || *p == ':') {
+		p++;
+	}
+	return p;
+}
+static int HUE_SetLightState(http_request_t* request) {
+	const char *body = request->bodystart ? request->bodystart : "";
+	const char *on, *bri;
+	char tmp[32];
+	int dimmer;
+
+	on = HUE_FindValue(body, "\"on\"");
+	bri = HUE_FindValue(body, "\"bri\"");
+	if (on) {
+		CMD_ExecuteCommand(strncmp(on, "true", 4) ? "POWER OFF" : "POWER ON", 0);
+	}
+	if (bri) {
+		dimmer = ((atoi(bri) - 1) * 100 + 126) / 253;
+		snprintf(tmp, sizeof(tmp), "Dimmer %i", dimmer < 0 ? 0 : dimmer);
+		CMD_ExecuteCommand(tmp, 0);
+	}
 	http_setup(request, httpMimeTypeJson);
-	poststr(request, "{}");
+	poststr(request, "[");
+	if (on) {
+		hprintf255(request, "{\"success\":{\"/lights/1/state/on\":%s}}", Main_GetFirstPowerState() ? "true" : "false");
+	}
+	if (bri) {
+		hprintf255(request, "%s{\"success\":{\"/lights/1/state/bri\":%i}}", on ? "," : "", HUE_GetBrightness());
+	}
+	poststr(request, "]");
+	poststr(request, NULL);
+
+	return 0;
+}
+static int HUE_NotAvailable(http_request_t* request, const char *resource) {
+	http_setup(request, httpMimeTypeJson);
+	hprintf255(request, "[{\"error\":{\"type\":3,\"address\":\"%s\",\"description\":\"resource, %s, not available\"}}]",
+		resource, resource);
 	poststr(request, NULL);
 
 	return 0;
@@ -173,60 +342,92 @@ static int HUE_Authentication(http_request_t* request) {
 
 	return 0;
 }
-static int HUE_Config_Internal(http_request_t* request) {
-
-	poststr(request, "{\"name\":\"Philips hue\",\"mac\":\"");
-	// TODO: mac
-	poststr(request, "\",\"dhcp\":true,\"ipaddress\":\"");
-	// TODO: ip
-	poststr(request, "\",\"netmask\":\"");
-	// TODO: mask
-	poststr(request, "\",\"gateway\":\"");
-	// TODO: gw
-	poststr(request, "\",\"proxyaddress\":\"none\",\"proxyport\":0,\"bridgeid\":\"");
-	// TODO: bridgeid
-	poststr(request, "\",\"UTC\":\"{dt\",\"whitelist\":{\"");
-	// TODO: id
-	poststr(request, "\":{\"last use date\":\"");
-	// TODO: date
-	poststr(request, "\",\"create date\":\"");
-	// TODO: date
-	poststr(request, "\",\"name\":\"Remote\"}},\"swversion\":\"01041302\",\"apiversion\":\"1.17.0\",\"swupdate\":{\"updatestate\":0,\"url\":\"\",\"text\":\"\",\"notify\": false},\"linkbutton\":false,\"portalservices\":false}");
+static int HUE_Config(http_request_t* request) {
+	if (HUE_BuildReplies() == false) {
+		return 0;
+	}
+	HUE_UpdateConfigDates();
+	http_setup_len(request, httpMimeTypeJson, g_hueConfigReplyLen);
+	postany(request, g_hueConfigReply, g_hueConfigReplyLen);
 	poststr(request, NULL);
 
 	return 0;
 }
-
-
-
-
 static int HUE_GlobalConfig(http_request_t* request) {
+	char light[384];
+	int len1, len2, len3, lightLen;
 
-	http_setup(request, httpMimeTypeJson);
-	poststr(request, "{\"lights\":{");
-	// TODO: lights
-	poststr(request, "},\"groups\":{},\"schedules\":{},\"config\":");
-	HUE_Config_Internal(request);
-	poststr(request, "}");
+	if (HUE_BuildReplies() == false) {
+		return 0;
+	}
+	HUE_UpdateConfigDates();
+	len1 = strlen(g_hue_global_1);
+	len2 = strlen(g_hue_global_2);
+	len3 = strlen(g_hue_global_3);
+	lightLen = HUE_PrintLight(light, sizeof(light));
+	http_setup_len(request, httpMimeTypeJson, len1 + lightLen + len2 + g_hueConfigReplyLen + len3);
+	postany(request, g_hue_global_1, len1);
+	postany(request, light, lightLen);
+	postany(request, g_hue_global_2, len2);
+	postany(request, g_hueConfigReply, g_hueConfigReplyLen);
+	postany(request, g_hue_global_3, len3);
 	poststr(request, NULL);
 
 	return 0;
 }
 
 
-// http://192.168.0.213/api/username/lights/1/state
+// http://192.168.0.213/api/username/lights/1/state (PUT {"on":true,"bri":254})
 // http://192.168.0.213/description.xml
+// Returns 1 when request was for Hue API, others go to OBK REST API.
 int HUE_APICall(http_request_t* request) {
+	const char *api;
+	int userLen;
+
 	if (g_uid == 0) {
 		// not running
 		return 0;
 	}
-	// skip "api/"
-	//const char *api = request->url + 4;
-	//int urlLen = strlen(request->url);
-	// TODO
-
-	return 0;
+	if (strncmp(request->url, "api", 3)) {
+		return 0;
+	}
+	api = request->url + 3;
+	// pairing, app posts its devicetype to /api
+	if (*api == 0 && request->method == HTTP_POST) {
+		HUE_Authentication(request);
+		return 1;
+	}
+	if (*api != '/') {
+		return 0;
+	}
+	api++;
+	userLen = strlen(g_userID);
+	if (strncmp(api, g_userID, userLen)) {
+		return 0;
+	}
+	api += userLen;
+	if (*api == 0 || !strcmp(api, "/")) {
+		HUE_GlobalConfig(request);
+	}
+	else if (!strcmp(api, "/config")) {
+		HUE_Config(request);
+	}
+	else if (!strcmp(api, "/lights")) {
+		HUE_Light(request, true);
+	}
+	else if (!strcmp(api, "/lights/1")) {
+		HUE_Light(request, false);
+	}
+	else if (!strcmp(api, "/lights/1/state") && request->method != HTTP_GET) {
+		HUE_SetLightState(request);
+	}
+	else if (*api == '/') {
+		HUE_NotAvailable(request, api);
+	}
+	else {
+		return 0;
+	}
+	return 1;
 }
 // backlog startDriver SSDP; startDriver HUE
 // 
@@ -0,0 +1,188 @@
+#include "../new_common.h"
+#include "../logging/logging.h"
+#include "../cmnds/cmd_public.h"
+#include "../quicktick.h"
+#include "drv_local.h"
+
+// I2C sensors need time between start of conversion and its result.
+// Instead of waiting it out inline, driver gives a step that reads the
+// result after that time, and steps run from QuickTick in due order.
+// Conversions of all sensors on all buses then go on at once and every
+// second tick does not block for them. Step is one short transfer, and
+// it may add next step, like poll again while sensor is busy.
+//
+// SoftI2C_Stats prints per bus use since last call.
+
+#define I2CSCHED_MAX_STEPS		16
+#define I2CSCHED_MAX_BUSES		4
+
+typedef struct i2cStep_s {
+	softI2C_t *bus;
+	i2cStepFn_t fn;
+	unsigned int due;
+} i2cStep_t;
+
+typedef struct i2cBusStats_s {
+	short pin_clk;
+	short pin_data;
+	unsigned int steps;
+	unsigned int bytes;
+	// time in steps, RTOS tick resolution except on ESP-IDF
+	unsigned int busyUs;
+	unsigned int maxUs;
+	// most a step ran after its due time
+	unsigned int maxLateMs;
+} i2cBusStats_t;
+
+static i2cStep_t g_i2cSteps[I2CSCHED_MAX_STEPS];
+static int g_i2cNumSteps = 0;
+static i2cBusStats_t g_i2cBuses[I2CSCHED_MAX_BUSES];
+static int g_i2cNumBuses = 0;
+static unsigned int g_i2cStatsStart = 0;
+static unsigned int g_i2cInline = 0;
+// g_timeMs of last QuickTick that ran, due times are counted from it
+static unsigned int g_i2cLastRun = 0;
+
+static i2cBusStats_t *I2CSched_GetBusStats(softI2C_t *bus) {
+	i2cBusStats_t *s;
+	int i;
+
+	for (i = 0; i < g_i2cNumBuses; i++) {
+		s = &g_i2cBuses[i];
+		if (s->pin_clk == bus->pin_clk && s->pin_data == bus->pin_data) {
+			return s;
+		}
+	}
+	if (g_i2cNumBuses >= I2CSCHED_MAX_BUSES) {
+		return 0;
+	}
+	s = &g_i2cBuses[g_i2cNumBuses++];
+	memset(s, 0, sizeof(*s));
+	s->pin_clk = bus->pin_clk;
+	s->pin_data = bus->pin_data;
+	return s;
+}
+static void I2CSched_RunStep(softI2C_t *bus, i2cStepFn_t fn, unsigned int lateMs) {
+	i2cBusStats_t *s = I2CSched_GetBusStats(bus);
+	unsigned int bytes = g_softI2C_bytes;
+#if ENABLE_SYSPERF
+	unsigned int start = SYSPERF_GetTimeUs();
+	unsigned int took;
+#endif
+
+	fn(bus);
+	if (s == 0) {
+		return;
+	}
+	s->steps++;
+	s->bytes += g_softI2C_bytes - bytes;
+	if (lateMs > s->maxLateMs) {
+		s->maxLateMs = lateMs;
+	}
+#if ENABLE_SYSPERF
+	took = SYSPERF_GetTimeUs() - start;
+	s->busyUs += took;
+	if (took > s->maxUs) {
+		s->maxUs = took;
+	}
+#endif
+}
+
+// runs fn after ms, or waits and runs it now when there is no free slot
+void I2CSched_Add(softI2C_t *bus, int ms, i2cStepFn_t fn) {
+	i2cStep_t *st;
+
+	if (g_i2cNumSteps >= I2CSCHED_MAX_STEPS) {
+		g_i2cInline++;
+		rtos_delay_milliseconds(ms);
+		I2CSched_RunStep(bus, fn, 0);
+		return;
+	}
+	st = &g_i2cSteps[g_i2cNumSteps++];
+	st->bus = bus;
+	st->fn = fn;
+	st->due = g_i2cLastRun + QuickTick_GetTimeSinceRunMS() + ms;
+	QuickTick_Wake();
+}
+// driver that stops drops its steps
+void I2CSched_Cancel(softI2C_t *bus) {
+	int i;
+
+	for (i = 0; i < g_i2cNumSteps; ) {
+		if (g_i2cSteps[i].bus == bus) {
+			g_i2cSteps[i] = g_i2cSteps[--g_i2cNumSteps];
+		}
+		else {
+			i++;
+		}
+	}
+}
+// index of earliest step, -1 if there are none
+static int I2CSched_FindFirst() {
+	int i, first = -1;
+
+	for (i = 0; i < g_i2cNumSteps; i++) {
+		if (first == -1 || (int)(g_i2cSteps[i].due - g_i2cSteps[first].due) < 0) {
+			first = i;
+		}
+	}
+	return first;
+}
+void I2CSched_RunQuickTick() {
+	i2cStep_t st;
+	int i, runs;
+
+	g_i2cLastRun = g_timeMs;
+	// step added by step with 0 ms runs on next tick at latest
+	for (runs = 0; runs < I2CSCHED_MAX_STEPS; runs++) {
+		i = I2CSched_FindFirst();
+		if (i == -1 || (int)(g_timeMs - g_i2cSteps[i].due) < 0) {
+			break;
+		}
+		st = g_i2cSteps[i];
+		g_i2cSteps[i] = g_i2cSteps[--g_i2cNumSteps];
+		I2CSched_RunStep(st.bus, st.fn, g_timeMs - st.due);
+	}
+}
+int I2CSched_GetTimeToNextWakeMS() {
+	int i = I2CSched_FindFirst();
+	int left;
+
+	if (i == -1) {
+		return -1;
+	}
+	left = g_i2cSteps[i].due - g_timeMs;
+	return left > 0 ? left : 0;
+}
+int I2CSched_GetPendingCount() {
+	return g_i2cNumSteps;
+}
+
+static commandResult_t CMD_SoftI2C_Stats(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	i2cBusStats_t *s;
+	unsigned int window = g_timeMs - g_i2cStatsStart;
+	int i;
+
+	if (window == 0) {
+		window = 1;
+	}
+	for (i = 0; i < g_i2cNumBuses; i++) {
+		s = &g_i2cBuses[i];
+		addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "I2C bus %i/%i: %u steps, %u bytes, busy %u.%u%% (max %u us), late max %u ms",
+			s->pin_clk, s->pin_data, s->steps, s->bytes, s->busyUs / (window * 10), (s->busyUs / window) % 10,
+			s->maxUs, s->maxLateMs);
+		s->steps = s->bytes = s->busyUs = s->maxUs = s->maxLateMs = 0;
+	}
+	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "I2C steps pending %i, run inline %u, over %u ms", g_i2cNumSteps, g_i2cInline, window);
+	g_i2cInline = 0;
+	g_i2cStatsStart = g_timeMs;
+	return CMD_RES_OK;
+}
+
+void I2CSched_Init() {
+	//cmddetail:{"name":"SoftI2C_Stats","args":"",
+	//cmddetail:"descr":"Prints use of each soft I2C bus by scheduled sensor reads since last call: steps, bytes, busy time (ESP-IDF measures microseconds, others RTOS tick) and how late steps ran.",
+	//cmddetail:"fn":"CMD_SoftI2C_Stats","file":"driver/drv_i2c_sched.c","requires":"",
+	//cmddetail:"examples":"SoftI2C_Stats"}
+	CMD_RegisterCommand("SoftI2C_Stats", CMD_SoftI2C_Stats, NULL);
+}
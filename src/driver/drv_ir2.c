@@ -8,6 +8,7 @@
 #include "../logging/logging.h"
 #include "../obk_config.h"
 #include "../cmnds/cmd_public.h"
+#include "../littlefs/our_lfs.h"
 
 #if PLATFORM_BEKEN
 
@@ -153,23 +154,45 @@ static uint32_t ir_chan
 ;
 
 static uint32_t ir_div = 1;
-static uint32_t ir_periodus = 50;
 static uint32_t duty_on, duty_off;
 static uint32_t reg_duty;
 
-
-
-int txpin = 26;
-
-int times[512];
-int maxTimes = 512;
-int *cur;
-int *stop;
-int myPeriodUs = 50;
-int curTime = 0;
-int state = 0;
-int pwmIndex = -1;
-unsigned int period;
+// Stored codes are a table of up to IR2_MAX_LEVELS distinct durations and
+// a nibble per edge pointing into it, so NEC frame takes under 50 bytes and long
+// AC frame of some hundred edges a bit over half of that in bytes. Durations
+// within IR2_TOLERANCE_PCT of each other are one level, its value is their
+// mean. One LittleFS file per code, ir2_<name>.bin:
+//   'I', version, levels count, levels (u16 LE, us), edges count (u16 LE),
+//   edges, two per byte, low nibble first, first edge is a mark
+//
+// IR2_Store [Name] [Times...]
+// IR2_Send [Name|GapMs]...
+// IR2_Delete [Name]
+
+#define IR2_MAX_TIMES			512
+#define IR2_MAX_LEVELS			15
+#define IR2_TOLERANCE_PCT		20
+#define IR2_CODE_VERSION		1
+#define IR2_CODE_MAX			(5 + IR2_MAX_LEVELS * 2 + IR2_MAX_TIMES / 2)
+#define IR2_MAX_NAME			24
+// between two codes sent one after other without gap given
+#define IR2_DEFAULT_GAP_MS		50
+
+static int txpin = 26;
+
+// durations in us, alternating space and mark, first is space
+static int times[IR2_MAX_TIMES];
+static int maxTimes = IR2_MAX_TIMES;
+static int *volatile cur;
+static int *stop;
+static int myPeriodUs = 50;
+static int curTime = 0;
+static int state = 0;
+static int pwmIndex = -1;
+#if PLATFORM_BEKEN
+// PWM period of carrier
+static unsigned int period;
+#endif
 
 static uint8_t group, channel;
 
@@ -178,6 +201,13 @@ static uint8_t group, channel;
 #define DEBUG_WAVE_WITH_GPIO 1
 #endif
 
+// timer only runs while there is something to send
+static void IR2_SetTimer(bool on) {
+#if PLATFORM_BEKEN && !DEBUG_WAVE_WITH_GPIO
+	sddev_control((char *)TIMER_DEV_NAME, on ? CMD_TIMER_UNIT_ENABLE : CMD_TIMER_UNIT_DISABLE, &ir_chan);
+#endif
+}
+
 void SendIR2_ISR(uint8_t t) {
 #if DEBUG_WAVE_WITH_GPIO
 	static int dbg_state = 0;
@@ -204,52 +234,49 @@ void SendIR2_ISR(uint8_t t) {
 			cur = 0;
 
 			MY_SET_DUTY(duty_off);
+			IR2_SetTimer(false);
 		}
 	}
 }
-/*
-// start the driver
-startDriver IR2
-// start timer 50us
-// arguments: duty_on_fraction, duty_off_fraction, pin for sending (optional)
-SetupIR2 50 0.5 0 8
-// send data
-SendIR2 3200 1300 950 500 900 1300 900 550 900 650 900
-//
 
-backlog startDriver IR2; SetupIR2 50 0.5 0 9
-*/
-static commandResult_t CMD_IR2_SendIR2(const void* context, const char* cmd, const char* args, int cmdFlags) {
-	float frequency = 38000;
-	float duty_cycle = 0.330000f;
+static void IR2_QueueStart() {
 	stop = times;
+	*stop++ = 500; // prepend 500us zero
+}
+static bool IR2_QueuePush(int us) {
+	if (stop - times >= maxTimes) {
+		return false;
+	}
+	*stop++ = us;
+	return true;
+}
+// space after last mark, or longer one if queue ends with space
+static bool IR2_QueueGap(int us) {
+	if ((stop - times) % 2) {
+		stop[-1] += us;
+		return true;
+	}
+	return IR2_QueuePush(us);
+}
+// code starts with mark
+static bool IR2_QueueCode(const int *t, int n) {
+	int i;
 
-	ADDLOG_INFO(LOG_FEATURE_IR, "SendIR2 args len: %i", strlen(args));
-
-	// parse string like 10 12 432 432 432 432 432
-	*stop = 500; // prepend 500us zero
-	stop++;
-	while (*args) {
-		while (*args && isWhiteSpace(*args)) {
-			args++;
-		}
-		if (stop - times < maxTimes) {
-			int x = atoi(args);
-			*stop = x;
-			ADDLOG_INFO(LOG_FEATURE_IR, "Value: %i", x);
-			stop++;
-		}
-		else {
-			break;
-		}
-		while (*args && !isWhiteSpace(*args)) {
-			args++;
+	if ((stop - times) % 2 == 0 && !IR2_QueueGap(IR2_DEFAULT_GAP_MS * 1000)) {
+		return false;
+	}
+	for (i = 0; i < n; i++) {
+		if (!IR2_QueuePush(t[i])) {
+			return false;
 		}
 	}
+	return true;
+}
+static void IR2_QueueRun() {
+	curTime = 0;
 	state = 0;
 	ADDLOG_INFO(LOG_FEATURE_IR, "Queue size %i", (stop - times));
 
-
 #if PLATFORM_BK7231N && !PLATFORM_BEKEN_NEW
 	bk_pwm_update_param((bk_pwm_t)pwmIndex, period, duty_off, 0, 0);
 #elif PLATFORM_BEKEN
@@ -257,11 +284,271 @@ static commandResult_t CMD_IR2_SendIR2(const void* context, const char* cmd, con
 #endif
 
 	cur = times;
+	IR2_SetTimer(true);
 #if WINDOWS
 	while (cur) {
 		SendIR2_ISR(0);
 	}
 #endif
+}
+// durations queued by last send, for selftest
+int IR2_GetQueue(const int **out) {
+	*out = times;
+	return stop ? stop - times : 0;
+}
+// parse string like 10 12 432 432 432 432 432
+static int IR2_ParseTimes(const char *args, int *out, int max) {
+	int n = 0;
+
+	while (*args) {
+		while (*args && isWhiteSpace(*args)) {
+			args++;
+		}
+		if (*args == 0 || n >= max) {
+			break;
+		}
+		out[n++] = atoi(args);
+		while (*args && !isWhiteSpace(*args)) {
+			args++;
+		}
+	}
+	return n;
+}
+
+// returns bytes used, 0 if there are too many distinct durations
+int IR2_EncodeCode(const int *t, int n, byte *out, int outSize) {
+	int sum[IR2_MAX_LEVELS], cnt[IR2_MAX_LEVELS];
+	int levels = 0, i, j, lv, len;
+
+	if (n <= 0 || n > IR2_MAX_TIMES || outSize < 5 + IR2_MAX_LEVELS * 2 + (n + 1) / 2) {
+		return 0;
+	}
+	len = 5 + IR2_MAX_LEVELS * 2;
+	memset(out + len, 0, (n + 1) / 2);
+	for (i = 0; i < n; i++) {
+		if (t[i] <= 0 || t[i] > 0xFFFF) {
+			return 0;
+		}
+		for (j = 0; j < levels; j++) {
+			lv = sum[j] / cnt[j];
+			if (abs(t[i] - lv) * 100 <= lv * IR2_TOLERANCE_PCT) {
+				break;
+			}
+		}
+		if (j == levels) {
+			if (levels == IR2_MAX_LEVELS) {
+				return 0;
+			}
+			sum[j] = cnt[j] = 0;
+			levels++;
+		}
+		sum[j] += t[i];
+		cnt[j]++;
+		out[len + i / 2] |= j << ((i & 1) * 4);
+	}
+	// edges go right after levels that are used
+	memmove(out + 5 + levels * 2, out + len, (n + 1) / 2);
+	out[0] = 'I';
+	out[1] = IR2_CODE_VERSION;
+	out[2] = levels;
+	for (j = 0; j < levels; j++) {
+		lv = (sum[j] + cnt[j] / 2) / cnt[j];
+		out[3 + j * 2] = lv;
+		out[4 + j * 2] = lv >> 8;
+	}
+	out[3 + levels * 2] = n;
+	out[4 + levels * 2] = n >> 8;
+	return 5 + levels * 2 + (n + 1) / 2;
+}
+// returns count of durations, -1 if code is broken
+int IR2_DecodeCode(const byte *in, int len, int *t, int max) {
+	int levels, n, i, lv, at;
+
+	if (len < 5 || in[0] != 'I' || in[1] != IR2_CODE_VERSION) {
+		return -1;
+	}
+	levels = in[2];
+	at = 3 + levels * 2;
+	if (levels > IR2_MAX_LEVELS || at + 2 > len) {
+		return -1;
+	}
+	n = in[at] | (in[at + 1] << 8);
+	at += 2;
+	if (n > max || at + (n + 1) / 2 > len) {
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		lv = (in[at + i / 2] >> ((i & 1) * 4)) & 0xF;
+		if (lv >= levels) {
+			return -1;
+		}
+		t[i] = in[3 + lv * 2] | (in[4 + lv * 2] << 8);
+	}
+	return n;
+}
+
+#if ENABLE_LITTLEFS
+static bool IR2_GetFileName(char *out, int outSize, const char *name) {
+	if (strlen(name) > IR2_MAX_NAME || strchr(name, '/')) {
+		return false;
+	}
+	snprintf(out, outSize, "ir2_%s.bin", name);
+	return true;
+}
+// returns count of durations, -1 if there is no such code
+static int IR2_LoadCode(const char *name, int *t, int max) {
+	byte buf[IR2_CODE_MAX];
+	char fname[40];
+	lfs_file_t *file;
+	int len;
+
+	if (!lfs_present() || !IR2_GetFileName(fname, sizeof(fname), name)) {
+		return -1;
+	}
+	file = (lfs_file_t*)os_malloc(sizeof(lfs_file_t));
+	if (file == 0) {
+		return -1;
+	}
+	memset(file, 0, sizeof(lfs_file_t));
+	if (lfs_file_open(&lfs, file, fname, LFS_O_RDONLY) < 0) {
+		os_free(file);
+		return -1;
+	}
+	len = lfs_file_read(&lfs, file, buf, sizeof(buf));
+	lfs_file_close(&lfs, file);
+	os_free(file);
+	return IR2_DecodeCode(buf, len, t, max);
+}
+static commandResult_t CMD_IR2_Store(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	int t[IR2_MAX_TIMES];
+	byte buf[IR2_CODE_MAX];
+	char name[IR2_MAX_NAME + 1];
+	char fname[40];
+	lfs_file_t *file;
+	int n, len, i;
+
+	while (*args && isWhiteSpace(*args)) {
+		args++;
+	}
+	for (i = 0; *args && !isWhiteSpace(*args); args++) {
+		if (i < IR2_MAX_NAME) {
+			name[i++] = *args;
+		}
+	}
+	name[i] = 0;
+	n = IR2_ParseTimes(args, t, IR2_MAX_TIMES);
+	if (i == 0 || n == 0) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	len = IR2_EncodeCode(t, n, buf, sizeof(buf));
+	if (len == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_IR, "IR2_Store: %s has more than %i distinct durations", name, IR2_MAX_LEVELS);
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	if (!lfs_present()) {
+		init_lfs(1);
+	}
+	if (!lfs_present() || !IR2_GetFileName(fname, sizeof(fname), name)) {
+		return CMD_RES_ERROR;
+	}
+	file = (lfs_file_t*)os_malloc(sizeof(lfs_file_t));
+	if (file == 0) {
+		return CMD_RES_ERROR;
+	}
+	memset(file, 0, sizeof(lfs_file_t));
+	if (lfs_file_open(&lfs, file, fname, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) < 0) {
+		os_free(file);
+		return CMD_RES_ERROR;
+	}
+	i = lfs_file_write(&lfs, file, buf, len);
+	lfs_file_close(&lfs, file);
+	os_free(file);
+	if (i != len) {
+		return CMD_RES_ERROR;
+	}
+	ADDLOG_INFO(LOG_FEATURE_IR, "IR2_Store: %s, %i edges in %i levels, %i bytes", name, n, buf[2], len);
+	return CMD_RES_OK;
+}
+// codes and gaps go into one queue, so timer sends them all without task
+static commandResult_t CMD_IR2_Send(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	int t[IR2_MAX_TIMES];
+	int i, n;
+
+	if (cur) {
+		ADDLOG_ERROR(LOG_FEATURE_IR, "IR2_Send: still sending");
+		return CMD_RES_ERROR;
+	}
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	IR2_QueueStart();
+	for (i = 0; i < Tokenizer_GetArgsCount(); i++) {
+		if (Tokenizer_IsArgInteger(i)) {
+			if (!IR2_QueueGap(Tokenizer_GetArgInteger(i) * 1000)) {
+				break;
+			}
+			continue;
+		}
+		n = IR2_LoadCode(Tokenizer_GetArg(i), t, IR2_MAX_TIMES);
+		if (n < 0) {
+			ADDLOG_ERROR(LOG_FEATURE_IR, "IR2_Send: no code %s", Tokenizer_GetArg(i));
+			return CMD_RES_BAD_ARGUMENT;
+		}
+		if (!IR2_QueueCode(t, n)) {
+			break;
+		}
+	}
+	if (i < Tokenizer_GetArgsCount()) {
+		ADDLOG_ERROR(LOG_FEATURE_IR, "IR2_Send: more than %i durations", IR2_MAX_TIMES);
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	IR2_QueueRun();
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_IR2_Delete(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	char fname[40];
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	if (!lfs_present() || !IR2_GetFileName(fname, sizeof(fname), Tokenizer_GetArg(0))) {
+		return CMD_RES_ERROR;
+	}
+	return lfs_remove(&lfs, fname) < 0 ? CMD_RES_BAD_ARGUMENT : CMD_RES_OK;
+}
+#endif
+
+/*
+// start the driver
+startDriver IR2
+// start timer 50us
+// arguments: duty_on_fraction, duty_off_fraction, pin for sending (optional)
+SetupIR2 50 0.5 0 8
+// send data
+SendIR2 3200 1300 950 500 900 1300 900 550 900 650 900
+// or keep it and send it twice, 100 ms apart
+IR2_Store tv 3200 1300 950 500 900 1300 900 550 900 650 900
+IR2_Send tv 100 tv
+//
+
+backlog startDriver IR2; SetupIR2 50 0.5 0 9
+*/
+static commandResult_t CMD_IR2_SendIR2(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	int t[IR2_MAX_TIMES];
+	int n;
+
+	if (cur) {
+		ADDLOG_ERROR(LOG_FEATURE_IR, "SendIR2: still sending");
+		return CMD_RES_ERROR;
+	}
+	ADDLOG_INFO(LOG_FEATURE_IR, "SendIR2 args len: %i", strlen(args));
+
+	n = IR2_ParseTimes(args, t, IR2_MAX_TIMES - 1);
+	IR2_QueueStart();
+	IR2_QueueCode(t, n);
+	IR2_QueueRun();
 	return CMD_RES_OK;
 }
 // SetupIR2 [myPeriodUs] [dutyOnFrac] [dutyOffFrac] [txPin]
@@ -330,9 +617,9 @@ static commandResult_t CMD_IR2_SetupIR2(const void* context, const char* cmd, co
 		ADDLOG_ERROR(LOG_FEATURE_IR, (char *)"bk_timer driver not initialised?");
 		if ((int)res == -5) {
 			ADDLOG_INFO(LOG_FEATURE_IR, (char *)"bk_timer sddev not found - not initialised?");
-			return;
+			return CMD_RES_ERROR;
 		}
-		return;
+		return CMD_RES_ERROR;
 	}
 
 
@@ -343,8 +630,8 @@ static commandResult_t CMD_IR2_SetupIR2(const void* context, const char* cmd, co
 	ADDLOG_INFO(LOG_FEATURE_IR, (char *)"will ir timer setup %u", res);
 	res = sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_INIT_PARAM_US, &params);
 	ADDLOG_INFO(LOG_FEATURE_IR, (char *)"ir timer setup %u", res);
-	res = sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_ENABLE, &ir_chan);
-	ADDLOG_INFO(LOG_FEATURE_IR, (char *)"ir timer enabled %u", res);
+	// init starts it, it is started again by send
+	IR2_SetTimer(false);
 #endif
 
 	//ADDLOG_INFO(LOG_FEATURE_IR, "Time: %i", curTime);
@@ -363,7 +650,23 @@ void DRV_IR2_Init() {
 	//cmddetail:"fn":"CMD_IR2_SendIR2","file":"driver/drv_ir2.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("SendIR2", CMD_IR2_SendIR2, NULL);
-
+#if ENABLE_LITTLEFS
+	//cmddetail:{"name":"IR2_Store","args":"[Name] [Times...]",
+	//cmddetail:"descr":"Stores raw IR code (mark and space durations in us, like for SendIR2) in LittleFS under Name. Code is kept as table of up to 15 distinct durations and a nibble per edge, durations within 20% of each other become their mean.",
+	//cmddetail:"fn":"CMD_IR2_Store","file":"driver/drv_ir2.c","requires":"",
+	//cmddetail:"examples":"IR2_Store tv_power 9000 4500 560 560 560 1690 560"}
+	CMD_RegisterCommand("IR2_Store", CMD_IR2_Store, NULL);
+	//cmddetail:{"name":"IR2_Send","args":"[Name|GapMs]...",
+	//cmddetail:"descr":"Sends stored codes and gaps (numbers, in ms) as one sequence, timer sends it all without task running in between. Codes without gap between them are 50 ms apart.",
+	//cmddetail:"fn":"CMD_IR2_Send","file":"driver/drv_ir2.c","requires":"",
+	//cmddetail:"examples":"IR2_Send tv_power 500 tv_volup tv_volup"}
+	CMD_RegisterCommand("IR2_Send", CMD_IR2_Send, NULL);
+	//cmddetail:{"name":"IR2_Delete","args":"[Name]",
+	//cmddetail:"descr":"Removes code stored by IR2_Store.",
+	//cmddetail:"fn":"CMD_IR2_Delete","file":"driver/drv_ir2.c","requires":"",
+	//cmddetail:"examples":"IR2_Delete tv_power"}
+	CMD_RegisterCommand("IR2_Delete", CMD_IR2_Delete, NULL);
+#endif
 }
 
 #endif
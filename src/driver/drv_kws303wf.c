@@ -78,7 +78,8 @@
  * -- New console commands ---------------------------------------------------
  *   kws_detect_w [W]        - get/set auto-detect power threshold (default 500W)
  *   kws_history_dump        - print session history CSV to UART log
- *   kws_history_clear       - truncate kws_history.csv
+ *   kws_history_clear       - empty the session history ring
+ *   GET /api/kws/history    - session history as CSV (faults: /api/kws/faults)
  *   kws_lifetime [Wh]       - get/set lifetime energy odometer
  *   kws_session_stat        - shows elapsed time, detect_w, lifetime_now
  *   [-] button (P20)        - cycles vehicle profile (2W<->4W) at any time
@@ -93,6 +94,9 @@
 #include "../new_pins.h"
 #include "../hal/hal_pins.h"
 #include "../cmnds/cmd_public.h"
+#include "../httpserver/new_http.h"
+#include "../littlefs/our_lfs.h"
+#include "../littlefs/lfs_records.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -127,21 +131,6 @@ static int kws_localtime(struct tm *out) {
 #define LOG_FEATURE_ENERGY LOG_FEATURE_MAIN
 #endif
 
-/* -- LittleFS fopen("w") quirk on BK7231N ------------------------------------
- * fopen(path,"w") returns NULL when the file does not yet exist.
- * fopen(path,"a") creates it.  robust_fopen_w() tries "w" first; on failure
- * it touches the file with "a" then retries "w".  See drv_ht7017.c for the
- * full root-cause note (confirmed 2026-03-06).
- * ---------------------------------------------------------------------------- */
-static FILE *robust_fopen_w(const char *path)
-{
-    FILE *f = fopen(path, "w");
-    if (f) return f;
-    f = fopen(path, "a");
-    if (f) fclose(f);
-    return fopen(path, "w");
-}
-
 /* ============================================================================
  * SECTION A - CONFIGURATION
  * ============================================================================ */
@@ -250,11 +239,11 @@ static FILE *robust_fopen_w(const char *path)
  * "/filename" -> fopen returns NULL silently. "filename" works correctly.
  * Same fix already applied in drv_ht7017.c (FIX-CAL-1). */
 #define KWS_SESSION_FILE     "kws_session.cfg"
-#define KWS_HISTORY_FILE     "kws_history.csv"   /* append-only session log   */
+#define KWS_HISTORY_FILE     "kws_history.csv"   /* v1.x session log          */
 #define KWS_LIFETIME_FILE    "kws_lifetime.cfg"  /* persists cumulative Wh    */
 #define KWS_MQTT_TOPIC       "home/ev/session"
-/* IMP-B: maximum rows retained in kws_history.csv.
- * Each row ~= 80 bytes.  200 rows = ~16 kB - well within the 512 kB LittleFS
+/* IMP-B: maximum rows retained in the history ring.
+ * Each row is 36 bytes.  200 rows = ~7 kB - well within the 512 kB LittleFS
  * partition.  At 10 sessions/day this retains ~20 days of history while
  * preventing unbounded flash growth.  Adjustable here at compile time.     */
 #define KWS_HISTORY_MAX_ROWS  200u
@@ -275,6 +264,12 @@ static FILE *robust_fopen_w(const char *path)
  * Wraps midnight correctly (e.g. 22:00 -> 06:00).                          */
 #define KWS_SCHEDULE_FILE    "kws_schedule.cfg"    /* IMP-Q: off-peak window config        */
 
+/* -- v1.3.0: binary store, replaces all files above ---------------------
+ * The .cfg/.csv/.log files above are only read once to import them.       */
+#define KWS_STATE_FILE        "kws_state.bin"    /* journaled KwsStore_t     */
+#define KWS_HISTORY_RING_FILE "kws_history.bin"  /* ring of KwsHistRow_t     */
+#define KWS_FAULTS_RING_FILE  "kws_faults.bin"   /* ring of KwsFaultRow_t    */
+
 /* -- IMP-Q: off-peak scheduling defaults ---------------------------------
  * KWS_SCHED_DEFAULT_START   Default window start hour (10 PM)
  * KWS_SCHED_DEFAULT_END     Default window end hour   (6 AM)
@@ -333,10 +328,9 @@ static FILE *robust_fopen_w(const char *path)
 #define KWS_HEARTBEAT_TOPIC  "home/ev/status"
 
 /* -- IMP-M: fault log -----------------------------------------------------
- * KWS_FAULT_MAX_ROWS  Maximum fault entries retained in kws_faults.log.
- * Each row <= 80 bytes.  20 rows = ~1.6 kB.  On overflow oldest row is NOT
- * dropped (no LittleFS seek/shift on BK7231N); the log is capped in place.
- * The user clears with kws_faults_clear.                                  */
+ * KWS_FAULT_MAX_ROWS  Maximum fault entries retained in the fault ring.
+ * Each row is 12 bytes.  On overflow the oldest row is overwritten, so the
+ * ring always holds the newest faults.  Cleared with kws_faults_clear.    */
 #define KWS_FAULT_MAX_ROWS   20u
 
 
@@ -449,6 +443,10 @@ static uint8_t  g_sess_locked   = 0u;  /* 0=unlocked, 1=locked               */
 static uint16_t g_lock_hold_tk  = 0u;  /* SESSION pin hold counter            */
 static uint8_t  g_lock_prev_pin = 1u;  /* previous SESSION pin level          */
 
+/* -- v1.x text file loaders ----------------------------------------------
+ * Used only by legacy_import() on the first boot after upgrade; all saves
+ * go to kws_store_save().                                                 */
+
 /*
  * lifetime_load() - v1.1.0
  * IMP-K: also reads reboots= field from kws_lifetime.cfg.
@@ -482,18 +480,6 @@ static void lifetime_load(void)
               g_lifetime_wh, g_lifetime_wh / 1000.0f, (unsigned)g_reboot_count);
 }
 
-static void lifetime_save(void)
-{
-    FILE *f = robust_fopen_w(KWS_LIFETIME_FILE);
-    if (!f) return;
-    /* IMP-K: persist reboot_count alongside Wh so a single file covers both.
-     * Format: "wh=XXXX.XXXX\nreboots=N\n"
-     * Backwards-compatible: old firmware ignores the reboots line.        */
-    fprintf(f, "wh=%.4f\nreboots=%u\n", g_lifetime_wh, (unsigned)g_reboot_count);
-    fclose(f);
-    g_lifetime_dirty = 0u;
-}
-
 /* -- IMP-G: rate persistence ---------------------------------------------
  * IMP-G: rate_load() - restore saved electricity tariff from flash.
  * Called at Init() before the first RunEverySecond.                       */
@@ -515,21 +501,6 @@ static void rate_load(void)
               "KWS303WF: rate loaded %.4f Rs/kWh", g_rate_rs);
 }
 
-/* IMP-G: rate_save() - persist current tariff to flash. */
-static void rate_save(void)
-{
-    FILE *f = robust_fopen_w(KWS_RATE_FILE);
-    if (!f) {
-        addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-                  "KWS303WF: rate_save failed - %s", KWS_RATE_FILE);
-        return;
-    }
-    fprintf(f, "rate=%.4f\n", g_rate_rs);
-    fclose(f);
-    addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-              "KWS303WF: rate saved %.4f Rs/kWh", g_rate_rs);
-}
-
 /* -- IMP-H: protection threshold persistence ----------------------------
  * IMP-H: protect_load() - restore OV/UV/OC thresholds from flash.        */
 static void protect_load(void)
@@ -553,23 +524,6 @@ static void protect_load(void)
               g_ov_thr, g_uv_thr, g_oc_thr);
 }
 
-/* IMP-H: protect_save() - persist current thresholds to flash.
- * Called when any threshold is changed via kws_protect command.           */
-static void protect_save(void)
-{
-    FILE *f = robust_fopen_w(KWS_PROTECT_FILE);
-    if (!f) {
-        addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-                  "KWS303WF: protect_save failed - %s", KWS_PROTECT_FILE);
-        return;
-    }
-    fprintf(f, "ov=%.2f\nuv=%.2f\noc=%.2f\n", g_ov_thr, g_uv_thr, g_oc_thr);
-    fclose(f);
-    addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-              "KWS303WF: protection saved OV=%.1fV UV=%.1fV OC=%.1fA",
-              g_ov_thr, g_uv_thr, g_oc_thr);
-}
-
 /* -- IMP-J: daily kWh persistence ---------------------------------------
  * IMP-J: daily_load() - restore today's accumulated kWh from flash.
  * Format: "kwh=XXXX.XXX\nstart=%u\n"
@@ -597,16 +551,6 @@ static void daily_load(void)
               g_daily_kwh, (unsigned)g_daily_start_uptime);
 }
 
-/* IMP-J: daily_save() - persist daily accumulator to flash. */
-static void daily_save(void)
-{
-    FILE *f = robust_fopen_w(KWS_DAILY_FILE);
-    if (!f) return;
-    fprintf(f, "kwh=%.3f\nstart=%u\n",
-            g_daily_kwh, (unsigned)g_daily_start_uptime);
-    fclose(f);
-}
-
 /* -- IMP-P: per-vehicle efficiency persistence ---------------------------
  * IMP-P: vehicles_load() - restore per-vehicle km/kWh factors from flash.
  * Falls back silently to compile-time defaults if file is missing/corrupt. */
@@ -633,23 +577,6 @@ static void vehicles_load(void)
               g_veh2_km_pkwh, g_veh2_old_kmpl, g_veh4_km_pkwh, g_veh4_old_kmpl);
 }
 
-/* IMP-P: vehicles_save() - persist current efficiency factors. */
-static void vehicles_save(void)
-{
-    FILE *f = robust_fopen_w(KWS_VEHICLES_FILE);
-    if (!f) {
-        addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-                  "KWS303WF: vehicles_save failed - %s", KWS_VEHICLES_FILE);
-        return;
-    }
-    fprintf(f, "veh2_km=%.2f\nveh4_km=%.2f\nveh2_kmpl=%.2f\nveh4_kmpl=%.2f\n",
-            g_veh2_km_pkwh, g_veh4_km_pkwh, g_veh2_old_kmpl, g_veh4_old_kmpl);
-    fclose(f);
-    addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-              "KWS303WF: vehicles saved 2W=%.1fkm/kWh 4W=%.1fkm/kWh",
-              g_veh2_km_pkwh, g_veh4_km_pkwh);
-}
-
 /* -- IMP-Q: off-peak schedule persistence --------------------------------
  * IMP-Q: schedule_load() - restore scheduling config from flash.          */
 static void schedule_load(void)
@@ -672,20 +599,6 @@ static void schedule_load(void)
               (unsigned)g_sched_enabled, (unsigned)g_sched_start, (unsigned)g_sched_end);
 }
 
-/* IMP-Q: schedule_save() - persist scheduling config. */
-static void schedule_save(void)
-{
-    FILE *f = robust_fopen_w(KWS_SCHEDULE_FILE);
-    if (!f) {
-        addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-                  "KWS303WF: schedule_save failed - %s", KWS_SCHEDULE_FILE);
-        return;
-    }
-    fprintf(f, "enabled=%u\nstart=%u\nend=%u\n",
-            (unsigned)g_sched_enabled, (unsigned)g_sched_start, (unsigned)g_sched_end);
-    fclose(f);
-}
-
 /* IMP-Q: sched_window_active() - returns 1 if current NTP hour is inside the
  * configured charge window.  Handles midnight-wrap (e.g. 22->06).
  * Returns 1 (allow) when NTP is not synced - fail-safe, don't block charging
@@ -751,24 +664,6 @@ static void tou_load(void)
     }
 }
 
-/* IMP-R: tou_save() - append tier lines to kws_rate.cfg after the base rate.
- * Rewrites the whole file so previous tier lines are replaced, not appended. */
-static void tou_save(void)
-{
-    FILE *f = robust_fopen_w(KWS_RATE_FILE);
-    if (!f) return;
-    fprintf(f, "rate=%.4f\n", g_rate_rs);
-    fprintf(f, "tiers=%u\n", (unsigned)g_rate_tiers_n);
-    for (uint8_t i = 0u; i < g_rate_tiers_n; i++) {
-        fprintf(f, "tier%u=%u,%u,%.4f\n",
-                (unsigned)i,
-                (unsigned)g_rate_tiers[i].start_h,
-                (unsigned)g_rate_tiers[i].end_h,
-                g_rate_tiers[i].rate_rs);
-    }
-    fclose(f);
-}
-
 /* IMP-R: rate_for_hour() - returns the applicable Rs/kWh for the given hour.
  * Iterates active TOU tiers; returns g_rate_rs if none matches or tiers=0.
  * Handles midnight-crossing windows identically to sched_window_active().  */
@@ -807,49 +702,6 @@ static float current_rate(void)
 }
 
 
-/* IMP-M: fault_log() - append one fault event to kws_faults.log.
- * Capped at KWS_FAULT_MAX_ROWS to prevent unbounded flash growth.
- * alarm_code: 1=OV, 2=UV, 3=OC, 4=OP (power), 5=THM (NTC)
- * uptime_s: caller provides g_uptime_s for the timestamp.               */
-static void fault_log(uint8_t alarm_code, uint32_t uptime_s, float value)
-{
-    /* Count existing rows - same approach as history_append(). */
-    {
-        FILE *fc = fopen(KWS_FAULTS_FILE, "r");
-        if (fc) {
-            uint32_t rows = 0u;
-            char tmp[96];   /* PERF-1: was [4] - fault rows are "uptime,code,value\n" ~30 chars */
-            while (fgets(tmp, sizeof(tmp), fc)) {
-                if (tmp[0] != '\0' && strchr(tmp, '\n')) rows++;
-            }
-            fclose(fc);
-            if (rows >= KWS_FAULT_MAX_ROWS) {
-                addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-                          "KWS303WF: fault log full (%u rows) - use kws_faults_clear",
-                          (unsigned)rows);
-                return;
-            }
-        }
-    }
-    FILE *f = fopen(KWS_FAULTS_FILE, "a");
-    if (!f) return;
-    /* Columns: uptime_s, alarm_code, value (V or A or C depending on code) */
-    const char *code_str = "UNKN";
-    switch (alarm_code) {
-        case 1: code_str = "OV";  break;
-        case 2: code_str = "UV";  break;
-        case 3: code_str = "OC";  break;
-        case 4: code_str = "OP";  break;
-        case 5: code_str = "THM"; break;
-        default: break;
-    }
-    fprintf(f, "%u,%s,%.2f\n", (unsigned)uptime_s, code_str, value);
-    fclose(f);
-    addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-              "KWS303WF: fault logged [%s] %.2f @ uptime=%u s",
-              code_str, value, (unsigned)uptime_s);
-}
-
 /* ============================================================================
  * EV SESSION TYPES AND STATE - hoisted before SECTION C so that relay_close()
  * and relay_open() (FIX-UX1) can reference g_ev and g_preferred_veh without
@@ -879,6 +731,153 @@ static EvSess_t  g_ev;
  * Set by [-] button when idle. KWS_VEH_NONE(0) = use watt-threshold logic. */
 static uint8_t   g_preferred_veh = KWS_VEH_NONE;
 
+/* ============================================================================
+ * PERSISTENCE - one journaled state record + two record rings
+ * ----------------------------------------------------------------------------
+ * All settings, counters and the running session are one binary KwsStore_t
+ * written through LFS_Record_Save (littlefs/lfs_records.h): every save is
+ * appended to kws_state.bin with a CRC, load takes the newest good entry, so
+ * a power cut mid-write falls back to the previous one.  Replaces the eight
+ * text files that were each rewritten on their own.
+ *
+ * Session history and the fault log are fixed-size rings.  Row count is in
+ * the ring header, so an append writes one slot + header and never reads
+ * the file back; when full, the oldest row is overwritten.  CSV is made on
+ * demand by kws_history_dump and GET /api/kws/history (faults likewise).
+ *
+ * Old text files of v1.x are imported once on first boot, then removed.
+ * Bump KWS_STORE_VERSION when KwsStore_t layout changes.
+ * ============================================================================ */
+#define KWS_STORE_VERSION    1u
+#define KWS_STORE_MAX_BYTES  4096   /* journal is compacted to one entry above this */
+#define KWS_HISTORY_CSV_HEADER "id,veh,kwh,cost_rs,km,duration_s,segs,peak_w,peak_a"
+
+typedef struct {
+    float      lifetime_wh;        /* incl. energy of running session        */
+    uint32_t   reboot_count;
+    float      rate_rs;
+    RateTier_t rate_tiers[KWS_RATE_TIER_MAX];
+    uint8_t    rate_tiers_n;
+    uint8_t    sched_enabled;
+    uint8_t    sched_start;
+    uint8_t    sched_end;
+    float      ov_thr, uv_thr, oc_thr;
+    float      daily_kwh;
+    uint32_t   daily_start_uptime;
+    float      veh2_km_pkwh, veh4_km_pkwh;
+    float      veh2_old_kmpl, veh4_old_kmpl;
+    EvSess_t   ev;
+} KwsStore_t;
+
+typedef struct {
+    uint32_t session_id;
+    uint32_t duration_s;
+    uint32_t seg_count;
+    float    kwh;
+    float    cost_rs;
+    float    km;
+    float    peak_w;
+    float    peak_a;
+    uint8_t  vehicle;
+    uint8_t  pad[3];
+} KwsHistRow_t;
+
+typedef struct {
+    uint32_t uptime_s;
+    float    value;
+    uint8_t  code;                 /* 1=OV 2=UV 3=OC 4=OP 5=THM              */
+    uint8_t  pad[3];
+} KwsFaultRow_t;
+
+static lfsRecord_t g_store = {
+    KWS_STATE_FILE, KWS_STORE_VERSION, sizeof(KwsStore_t), KWS_STORE_MAX_BYTES, -1
+};
+static lfsRing_t g_hist_ring = {
+    KWS_HISTORY_RING_FILE, 1u, sizeof(KwsHistRow_t), KWS_HISTORY_MAX_ROWS, 0, 0
+};
+static lfsRing_t g_fault_ring = {
+    KWS_FAULTS_RING_FILE, 1u, sizeof(KwsFaultRow_t), KWS_FAULT_MAX_ROWS, 0, 0
+};
+
+/* kws_store_save() - write all persistent state as one journal entry.
+ * Lifetime includes the running session, so a reboot mid-charge keeps the
+ * energy so far (same as the former 60 s lifetime snapshot).               */
+static void kws_store_save(void)
+{
+    KwsStore_t s;
+    memset(&s, 0, sizeof(s));
+    s.lifetime_wh        = g_lifetime_wh + (g_ev.active ? g_ev.wh_session : 0.0f);
+    s.reboot_count       = g_reboot_count;
+    s.rate_rs            = g_rate_rs;
+    memcpy(s.rate_tiers, g_rate_tiers, sizeof(s.rate_tiers));
+    s.rate_tiers_n       = g_rate_tiers_n;
+    s.sched_enabled      = g_sched_enabled;
+    s.sched_start        = g_sched_start;
+    s.sched_end          = g_sched_end;
+    s.ov_thr             = g_ov_thr;
+    s.uv_thr             = g_uv_thr;
+    s.oc_thr             = g_oc_thr;
+    s.daily_kwh          = g_daily_kwh;
+    s.daily_start_uptime = g_daily_start_uptime;
+    s.veh2_km_pkwh       = g_veh2_km_pkwh;
+    s.veh4_km_pkwh       = g_veh4_km_pkwh;
+    s.veh2_old_kmpl      = g_veh2_old_kmpl;
+    s.veh4_old_kmpl      = g_veh4_old_kmpl;
+    s.ev                 = g_ev;
+    if (!LFS_Record_Save(&g_store, &s)) {
+        addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
+                  "KWS303WF: state save failed - %s", KWS_STATE_FILE);
+        return;
+    }
+    g_lifetime_dirty = 0u;
+}
+
+static const char *fault_code_str(uint8_t code)
+{
+    switch (code) {
+        case 1: return "OV";
+        case 2: return "UV";
+        case 3: return "OC";
+        case 4: return "OP";
+        case 5: return "THM";
+        default: return "UNKN";
+    }
+}
+
+/* IMP-M: fault_log() - add one fault event to the fault ring.
+ * Ring keeps the newest KWS_FAULT_MAX_ROWS events.
+ * alarm_code: 1=OV, 2=UV, 3=OC, 4=OP (power), 5=THM (NTC)
+ * uptime_s: caller provides g_uptime_s for the timestamp.               */
+static void fault_log(uint8_t alarm_code, uint32_t uptime_s, float value)
+{
+    KwsFaultRow_t row;
+    memset(&row, 0, sizeof(row));
+    row.uptime_s = uptime_s;
+    row.value    = value;
+    row.code     = alarm_code;
+    if (!LFS_Ring_Append(&g_fault_ring, &row)) return;
+    addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
+              "KWS303WF: fault logged [%s] %.2f @ uptime=%u s",
+              fault_code_str(alarm_code), value, (unsigned)uptime_s);
+}
+
+/* CSV of one row, same columns as the former text files. */
+static void hist_row_csv(const KwsHistRow_t *r, char *out, size_t len)
+{
+    snprintf(out, len, "%u,%s,%.3f,%.2f,%.1f,%u,%u,%.1f,%.3f",
+             (unsigned)r->session_id,
+             (r->vehicle==KWS_VEH_2W) ? KWS_VEH2_NAME : KWS_VEH4_NAME,
+             r->kwh, r->cost_rs, r->km,
+             (unsigned)r->duration_s, (unsigned)r->seg_count,
+             r->peak_w, r->peak_a);
+}
+
+static void fault_row_csv(const KwsFaultRow_t *r, char *out, size_t len)
+{
+    snprintf(out, len, "%u,%s,%.2f",
+             (unsigned)r->uptime_s, fault_code_str(r->code), r->value);
+}
+
 /* ============================================================================
  * SECTION C - RELAY
  * ============================================================================ */
@@ -1291,20 +1290,6 @@ static void btn_tick(void)
  * start.  Promoted to file scope and reset in sess_start() so the 60-second
  * save period always begins fresh with each new session.                     */
 
-static void sess_save(void)
-{
-    FILE *f = robust_fopen_w(KWS_SESSION_FILE);
-    if (!f) return;
-    fprintf(f, "active=%u\nvehicle=%u\nid=%u\nwh_off=%.4f\nwh_sess=%.4f\n"
-               "segs=%u\npeak_w=%.2f\npeak_a=%.4f\nrate=%.4f\n"
-               "start_up=%u\n",                        /* improvement #2 */
-            (unsigned)g_ev.active, (unsigned)g_ev.vehicle, g_ev.session_id,
-            g_ev.wh_offset, g_ev.wh_session, g_ev.seg_count,
-            g_ev.peak_w, g_ev.peak_a, g_ev.rate_rs,
-            (unsigned)g_ev.start_uptime_s);
-    fclose(f);
-}
-
 static bool sess_load(void)
 {
     unsigned int ua = 0, uv = 0, ustart = 0;
@@ -1339,6 +1324,127 @@ static bool sess_load(void)
     return (bool)g_ev.active;
 }
 
+/* -- v1.x text files: read once into the state record, then removed ------ */
+static void legacy_rows_import(void)
+{
+    char line[128];
+    FILE *f;
+
+    f = fopen(KWS_HISTORY_FILE, "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            KwsHistRow_t row;
+            char veh[40];
+            unsigned int id = 0u, dur = 0u, segs = 0u;
+            memset(&row, 0, sizeof(row));
+            if (sscanf(line, "%u,%39[^,],%f,%f,%f,%u,%u,%f,%f",
+                       &id, veh, &row.kwh, &row.cost_rs, &row.km,
+                       &dur, &segs, &row.peak_w, &row.peak_a) != 9) continue;
+            row.session_id = id;
+            row.duration_s = dur;
+            row.seg_count  = segs;
+            row.vehicle    = strcmp(veh, KWS_VEH2_NAME) ? KWS_VEH_4W : KWS_VEH_2W;
+            LFS_Ring_Append(&g_hist_ring, &row);
+        }
+        fclose(f);
+    }
+    f = fopen(KWS_FAULTS_FILE, "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            KwsFaultRow_t row;
+            char code[8];
+            unsigned int up = 0u;
+            uint8_t c;
+            memset(&row, 0, sizeof(row));
+            if (sscanf(line, "%u,%7[^,],%f", &up, code, &row.value) != 3) continue;
+            for (c = 1u; c <= 5u && strcmp(code, fault_code_str(c)); c++) { }
+            row.uptime_s = up;
+            row.code     = (c <= 5u) ? c : 0u;
+            LFS_Ring_Append(&g_fault_ring, &row);
+        }
+        fclose(f);
+    }
+}
+
+static void legacy_import(void)
+{
+    static const char *const files[] = {
+        KWS_LIFETIME_FILE, KWS_RATE_FILE, KWS_PROTECT_FILE, KWS_DAILY_FILE,
+        KWS_VEHICLES_FILE, KWS_SCHEDULE_FILE, KWS_SESSION_FILE,
+        KWS_HISTORY_FILE, KWS_FAULTS_FILE
+    };
+    unsigned int i;
+
+    lifetime_load();   /* improvement #8: odometer + IMP-K: reboot_count */
+    rate_load();       /* IMP-G */
+    tou_load();        /* IMP-R: extra lines of kws_rate.cfg */
+    protect_load();    /* IMP-H */
+    daily_load();      /* IMP-J */
+    vehicles_load();   /* IMP-P */
+    schedule_load();   /* IMP-Q */
+    /* running session: its energy so far is in the lifetime snapshot */
+    if (sess_load()) g_ev.wh_session = 0.0f;
+    if (g_hist_ring.count == 0u && g_fault_ring.count == 0u) legacy_rows_import();
+
+    kws_store_save();
+    if (g_store.fileSize <= 0) return;   /* keep old files until saved */
+    for (i = 0u; i < sizeof(files) / sizeof(files[0]); i++) {
+        lfs_remove(&lfs, files[i]);
+    }
+    addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
+              "KWS303WF: v1 text files imported into %s", KWS_STATE_FILE);
+}
+
+/* kws_store_load() - restore all persistent state, rings and session. */
+static void kws_store_load(void)
+{
+    KwsStore_t s;
+
+    init_lfs(1);
+    LFS_Ring_Open(&g_hist_ring);
+    LFS_Ring_Open(&g_fault_ring);
+    if (!LFS_Record_Load(&g_store, &s)) {
+        legacy_import();
+        return;
+    }
+    g_lifetime_wh        = (s.lifetime_wh >= 0.0f) ? s.lifetime_wh : 0.0f;
+    g_reboot_count       = s.reboot_count;
+    if (s.rate_rs > 0.0f) g_rate_rs = s.rate_rs;
+    memcpy(g_rate_tiers, s.rate_tiers, sizeof(g_rate_tiers));
+    g_rate_tiers_n       = (s.rate_tiers_n <= KWS_RATE_TIER_MAX) ? s.rate_tiers_n : 0u;
+    g_sched_enabled      = s.sched_enabled ? 1u : 0u;
+    if (s.sched_start <= 23u && s.sched_end <= 23u) {
+        g_sched_start    = s.sched_start;
+        g_sched_end      = s.sched_end;
+    }
+    if (s.ov_thr > 0.0f && s.uv_thr > 0.0f && s.oc_thr > 0.0f) {
+        g_ov_thr         = s.ov_thr;
+        g_uv_thr         = s.uv_thr;
+        g_oc_thr         = s.oc_thr;
+    }
+    g_daily_kwh          = (s.daily_kwh >= 0.0f) ? s.daily_kwh : 0.0f;
+    g_daily_start_uptime = s.daily_start_uptime;
+    if (s.veh2_km_pkwh > 0.0f && s.veh4_km_pkwh > 0.0f
+        && s.veh2_old_kmpl > 0.0f && s.veh4_old_kmpl > 0.0f) {
+        g_veh2_km_pkwh   = s.veh2_km_pkwh;
+        g_veh4_km_pkwh   = s.veh4_km_pkwh;
+        g_veh2_old_kmpl  = s.veh2_old_kmpl;
+        g_veh4_old_kmpl  = s.veh4_old_kmpl;
+    }
+    g_ev = s.ev;
+    if (g_ev.active) {
+        /* energy so far is already in lifetime_wh */
+        g_ev.wh_session = 0.0f;
+        if (g_ev.vehicle < KWS_VEH_2W || g_ev.vehicle > KWS_VEH_4W)
+            g_ev.vehicle = KWS_VEH_2W;
+    }
+    addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
+              "KWS303WF: state loaded lifetime=%.2f Wh reboots=%u rate=%.4f "
+              "history=%u faults=%u",
+              g_lifetime_wh, (unsigned)g_reboot_count, g_rate_rs,
+              (unsigned)g_hist_ring.count, (unsigned)g_fault_ring.count);
+}
+
 static void sess_start(uint8_t veh)
 {
     g_ev.active          = 1;
@@ -1355,7 +1461,7 @@ static void sess_start(uint8_t veh)
     g_sess_sv            = 0;            /* BUG-14 FIX: reset 60s save timer  */
     PubCh(KWS_CH_SESS_ACTIVE,  1);       /* improvement #10: tell display      */
     PubCh(KWS_CH_SESS_ELAPSED, 0);
-    sess_save();
+    kws_store_save();
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
               "KWS303WF: Session START id=%u veh=%s",
               g_ev.session_id,
@@ -1474,47 +1580,29 @@ static void sess_summary(void)
               g_lifetime_wh / 1000.0f);
 }
 
-/* improvement #4: append one CSV row to history file
- * IMP-B: bounded at KWS_HISTORY_MAX_ROWS (200).  Before appending, count
- * existing newlines in one pass.  If at limit, log a warning and skip.
- * A single fgets loop on 200x80B = 16kB takes ~1ms - well within WDT budget.
- * The user can reclaim space with kws_history_clear if needed.            */
+/* improvement #4: add one row to the history ring
+ * IMP-B: bounded at KWS_HISTORY_MAX_ROWS (200).  Row count is kept in the
+ * ring header, so this writes one slot + header and never reads the rows;
+ * when full, the oldest session is overwritten.                          */
 static void history_append(void)
 {
-    /* -- IMP-B: count existing rows ---------------------------------- */
-    {
-        FILE *fc = fopen(KWS_HISTORY_FILE, "r");
-        if (fc) {
-            uint32_t rows = 0;
-            char tmp[128];                 /* PERF-1: was [4], enlarged to hold a full CSV row */
-            while (fgets(tmp, sizeof(tmp), fc)) {
-                /* fgets returns the partial last line too; only count
-                 * lines that end in '\n' = complete rows.               */
-                if (tmp[0] != '\0' && strchr(tmp, '\n')) rows++;
-            }
-            fclose(fc);
-            if (rows >= KWS_HISTORY_MAX_ROWS) {
-                addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-                          "KWS303WF: history full (%u rows) - "
-                          "use kws_history_clear to reset",
-                          (unsigned)rows);
-                return;
-            }
-        }
-    }
-    FILE *f = fopen(KWS_HISTORY_FILE, "a");
-    if (!f) return;
-    float kwh  = g_ev.wh_session / 1000.0f;
-    float cost = kwh * g_ev.rate_rs;
+    KwsHistRow_t row;
+    float kwh = g_ev.wh_session / 1000.0f;
+    memset(&row, 0, sizeof(row));
+    row.session_id = g_ev.session_id;
+    row.duration_s = g_ev.duration_s;
+    row.seg_count  = g_ev.seg_count;
+    row.kwh        = kwh;
+    row.cost_rs    = kwh * g_ev.rate_rs;
     /* IMP-P: use runtime per-vehicle efficiency factors */
-    float km   = kwh * ((g_ev.vehicle==KWS_VEH_2W) ? g_veh2_km_pkwh : g_veh4_km_pkwh);
-    fprintf(f, "%u,%s,%.3f,%.2f,%.1f,%u,%u,%.1f,%.3f\n",
-            g_ev.session_id,
-            (g_ev.vehicle==KWS_VEH_2W) ? KWS_VEH2_NAME : KWS_VEH4_NAME,
-            kwh, cost, km,
-            (unsigned)g_ev.duration_s, (unsigned)g_ev.seg_count,
-            g_ev.peak_w, g_ev.peak_a);
-    fclose(f);
+    row.km         = kwh * ((g_ev.vehicle==KWS_VEH_2W) ? g_veh2_km_pkwh : g_veh4_km_pkwh);
+    row.peak_w     = g_ev.peak_w;
+    row.peak_a     = g_ev.peak_a;
+    row.vehicle    = g_ev.vehicle;
+    if (!LFS_Ring_Append(&g_hist_ring, &row)) {
+        addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
+                  "KWS303WF: history append failed - %s", KWS_HISTORY_RING_FILE);
+    }
 }
 
 static void sess_end(void)
@@ -1528,19 +1616,17 @@ static void sess_end(void)
     /* improvement #8: credit this session's energy to lifetime total */
     g_lifetime_wh += g_ev.wh_session;
     if (g_lifetime_wh < 0.0f) g_lifetime_wh = 0.0f;
-    lifetime_save();
 
     /* IMP-J: accumulate session kWh into today's daily total. */
     g_daily_kwh += g_ev.wh_session / 1000.0f;
     if (g_daily_kwh < 0.0f) g_daily_kwh = 0.0f;
-    daily_save();
 
     sess_summary();
-    history_append();    /* improvement #4: write CSV row */
+    history_append();    /* improvement #4: add history row */
     sess_mqtt();
 
-    FILE *f = robust_fopen_w(KWS_SESSION_FILE);
-    if (f) { fprintf(f,"active=0\n"); fclose(f); }
+    /* lifetime, daily total and inactive session in one write */
+    kws_store_save();
 
     PubCh(KWS_CH_SESS_ACTIVE,  0);   /* improvement #10: clear session flag  */
     PubCh(KWS_CH_SESS_ELAPSED, 0);
@@ -1575,11 +1661,8 @@ static void sess_tick(void)
          * of static local - see comment at declaration above.               */
         if (++g_sess_sv >= 60) {
             g_sess_sv = 0;
-            sess_save();
-            /* improvement #8: persist lifetime Wh snapshot every 60 s */
-            float snap = g_lifetime_wh + g_ev.wh_session;
-            FILE *lf = robust_fopen_w(KWS_LIFETIME_FILE);
-            if (lf) { fprintf(lf, "wh=%.4f\n", snap); fclose(lf); }
+            /* improvement #8: session + lifetime Wh snapshot every 60 s */
+            kws_store_save();
         }
     } else {
         PubCh(KWS_CH_EVCOST, 0);
@@ -1713,7 +1796,7 @@ static commandResult_t CMD_Ch8Set(const void*x,const char*c,const char*a,int f)
 
 /*
  * CMD_Rate() - v1.1.0
- * IMP-G: now calls rate_save() after setting so the tariff persists across reboots.
+ * IMP-G: saves the store after setting so the tariff persists across reboots.
  */
 static commandResult_t CMD_Rate(const void*x,const char*c,const char*a,int f)
 {
@@ -1724,7 +1807,7 @@ static commandResult_t CMD_Rate(const void*x,const char*c,const char*a,int f)
         return CMD_RES_BAD_ARGUMENT;
     }
     g_rate_rs = v;
-    rate_save();   /* IMP-G: persist to kws_rate.cfg */
+    kws_store_save();   /* IMP-G: persist tariff */
     addLogAdv(LOG_INFO,LOG_FEATURE_ENERGY,"kws_rate set %.4f Rs/kWh (saved)", g_rate_rs);
     return CMD_RES_OK;
 }
@@ -1749,53 +1832,41 @@ static commandResult_t CMD_DetectW(const void*x,const char*c,const char*a,int f)
 /* improvement #4: dump history CSV over log
  * IMP-F: capped at KWS_HISTORY_DUMP_ROWS recent rows.  On a large file,
  * unlimited addLogAdv() calls can stall the UART FIFO long enough to trigger
- * the ~5 s WDT.  50 rows x ~80 chars each ~= 4 kB output - safe.          */
+ * the ~5 s WDT.  50 rows x ~80 chars each ~= 4 kB output - safe.
+ * Rows are read from the ring in small chunks, oldest shown first.        */
 #define KWS_HISTORY_DUMP_ROWS  50u
+#define KWS_ROWS_PER_READ       8
 static commandResult_t CMD_HistoryDump(const void*x,const char*c,const char*a,int f)
 {
-    FILE *fh = fopen(KWS_HISTORY_FILE, "r");
-    if (!fh) {
-        addLogAdv(LOG_INFO,LOG_FEATURE_ENERGY,"kws_history: no history file yet");
-        return CMD_RES_OK;
-    }
-
-    /* Count total rows first so we can skip to the last N. */
-    uint32_t total = 0;
+    KwsHistRow_t rows[KWS_ROWS_PER_READ];
     char line[128];
-    while (fgets(line, sizeof(line), fh)) {
-        size_t l = strlen(line);
-        if (l > 0 && line[l-1] == '\n') total++;
-    }
-    rewind(fh);
-
-    uint32_t skip = (total > KWS_HISTORY_DUMP_ROWS)
-                    ? (total - KWS_HISTORY_DUMP_ROWS) : 0u;
+    int total = g_hist_ring.count;
+    int i, j, n;
 
+    if (total == 0) {
+        addLogAdv(LOG_INFO,LOG_FEATURE_ENERGY,"kws_history: no history yet");
+        return CMD_RES_OK;
+    }
+    i = (total > (int)KWS_HISTORY_DUMP_ROWS) ? total - (int)KWS_HISTORY_DUMP_ROWS : 0;
     addLogAdv(LOG_INFO,LOG_FEATURE_ENERGY,
               "kws_history: %u rows total, showing last %u",
-              (unsigned)total,
-              (unsigned)(total > KWS_HISTORY_DUMP_ROWS ? KWS_HISTORY_DUMP_ROWS : total));
-    addLogAdv(LOG_INFO,LOG_FEATURE_ENERGY,
-              "id,veh,kwh,cost_rs,km,duration_s,segs,peak_w,peak_a");
-
-    uint32_t row = 0;
-    while (fgets(line, sizeof(line), fh)) {
-        size_t l = strlen(line);
-        if (l > 0 && line[l-1] == '\n') {
-            if (row++ < skip) continue;
-            line[l-1] = '\0';
+              (unsigned)total, (unsigned)(total - i));
+    addLogAdv(LOG_INFO,LOG_FEATURE_ENERGY, "%s", KWS_HISTORY_CSV_HEADER);
+    for (; i < total; i += n) {
+        n = LFS_Ring_Read(&g_hist_ring, i, rows, KWS_ROWS_PER_READ);
+        if (n <= 0) break;
+        for (j = 0; j < n; j++) {
+            hist_row_csv(&rows[j], line, sizeof(line));
             addLogAdv(LOG_INFO,LOG_FEATURE_ENERGY,"%s", line);
         }
     }
-    fclose(fh);
     return CMD_RES_OK;
 }
 
-/* improvement #4: clear history file */
+/* improvement #4: clear history ring */
 static commandResult_t CMD_HistoryClear(const void*x,const char*c,const char*a,int f)
 {
-    FILE *fh = robust_fopen_w(KWS_HISTORY_FILE);
-    if (fh) { fclose(fh); }
+    LFS_Ring_Clear(&g_hist_ring);
     addLogAdv(LOG_INFO,LOG_FEATURE_ENERGY,"kws_history: cleared");
     return CMD_RES_OK;
 }
@@ -1855,7 +1926,7 @@ static commandResult_t CMD_Lifetime(const void*x,const char*c,const char*a,int f
         float v = (float)atof(a);
         if (v < 0.0f) return CMD_RES_BAD_ARGUMENT;
         g_lifetime_wh = v;
-        lifetime_save();
+        kws_store_save();
         addLogAdv(LOG_INFO,LOG_FEATURE_ENERGY,
                   "kws_lifetime set %.2f Wh (%.4f kWh)", v, v/1000.0f);
     } else {
@@ -1898,10 +1969,10 @@ static commandResult_t CMD_HaDevname(const void *ctx, const char *cmd,
  *        kws_protect ov <V>       -> set over-voltage trip
  *        kws_protect uv <V>       -> set under-voltage trip
  *        kws_protect oc <A>       -> set over-current trip
- * All changes are saved to kws_protection.cfg immediately.
+ * All changes are saved immediately.
  * NOTE: Thresholds are logged here and written to file.  Applying them to
  * the HT7017 registers requires a restart (HT7017_Init re-reads them via
- * the protect_load() -> g_ov/uv/oc_thr -> passed to HT7017 at Init).      */
+ * the kws_store_load() -> g_ov/uv/oc_thr -> passed to HT7017 at Init).   */
 static commandResult_t CMD_Protect(const void *ctx, const char *cmd,
                                    const char *args, int flags)
 {
@@ -1927,7 +1998,7 @@ static commandResult_t CMD_Protect(const void *ctx, const char *cmd,
                   "kws_protect: unknown key '%s' (use ov/uv/oc)", key);
         return CMD_RES_BAD_ARGUMENT;
     }
-    protect_save();
+    kws_store_save();
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
               "kws_protect: %s set to %.2f (saved). Restart to apply to HT7017.",
               key, val);
@@ -1944,7 +2015,7 @@ static commandResult_t CMD_DailyReset(const void *ctx, const char *cmd,
     g_daily_kwh          = 0.0f;
     g_daily_start_uptime = g_uptime_s;
     g_daily_mqtt_sent    = 0u;
-    daily_save();
+    kws_store_save();
     return CMD_RES_OK;
 }
 
@@ -1970,49 +2041,93 @@ static commandResult_t CMD_Heartbeat(const void *ctx, const char *cmd,
 }
 
 /* -- IMP-M: kws_faults_dump - print fault log to UART console ------------
- * Reads kws_faults.log and prints each row, capped at KWS_FAULT_MAX_ROWS.
+ * Prints the fault ring oldest first, at most KWS_FAULT_MAX_ROWS rows.
  * Format per row: uptime_s, code, value.                                  */
 static commandResult_t CMD_FaultsDump(const void *ctx, const char *cmd,
                                       const char *args, int flags)
 {
-    FILE *f = fopen(KWS_FAULTS_FILE, "r");
-    if (!f) {
+    KwsFaultRow_t rows[KWS_ROWS_PER_READ];
+    char buf[48];
+    int i, j, n;
+
+    if (g_fault_ring.count == 0u) {
         addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
                   "kws_faults_dump: no fault log found");
         return CMD_RES_OK;
     }
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY, "=== Fault Log ===");
-    char buf[96];
-    uint32_t rows = 0u;
-    while (fgets(buf, sizeof(buf), f) && rows < KWS_FAULT_MAX_ROWS) {
-        /* Strip trailing newline for clean log output */
-        size_t len = strlen(buf);
-        if (len > 0 && buf[len-1] == '\n') buf[len-1] = '\0';
-        addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY, "  %s", buf);
-        rows++;
+    for (i = 0; i < g_fault_ring.count; i += n) {
+        n = LFS_Ring_Read(&g_fault_ring, i, rows, KWS_ROWS_PER_READ);
+        if (n <= 0) break;
+        for (j = 0; j < n; j++) {
+            fault_row_csv(&rows[j], buf, sizeof(buf));
+            addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY, "  %s", buf);
+        }
     }
-    fclose(f);
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
-              "=== %u fault(s) total ===", (unsigned)rows);
+              "=== %u fault(s) total ===", (unsigned)g_fault_ring.count);
     return CMD_RES_OK;
 }
 
-/* IMP-M: kws_faults_clear - truncate fault log (zero it out). */
+/* IMP-M: kws_faults_clear - empty the fault ring. */
 static commandResult_t CMD_FaultsClear(const void *ctx, const char *cmd,
                                        const char *args, int flags)
 {
-    FILE *f = robust_fopen_w(KWS_FAULTS_FILE);
-    if (f) { fclose(f); }
+    LFS_Ring_Clear(&g_fault_ring);
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY, "KWS303WF: fault log cleared");
     return CMD_RES_OK;
 }
 
+/* GET /api/kws/history and /api/kws/faults - whole ring as CSV, oldest
+ * row first.  Built row by row from the binary ring, nothing is buffered. */
+int KWS303WF_HistoryHTTPQuery(http_request_t *request)
+{
+    KwsHistRow_t rows[KWS_ROWS_PER_READ];
+    char line[128];
+    int i, j, n;
+
+    http_setup(request, httpMimeTypeText);
+    poststr(request, KWS_HISTORY_CSV_HEADER "\n");
+    for (i = 0; i < g_hist_ring.count; i += n) {
+        n = LFS_Ring_Read(&g_hist_ring, i, rows, KWS_ROWS_PER_READ);
+        if (n <= 0) break;
+        for (j = 0; j < n; j++) {
+            hist_row_csv(&rows[j], line, sizeof(line));
+            poststr(request, line);
+            poststr(request, "\n");
+        }
+    }
+    poststr(request, NULL);
+    return 0;
+}
+
+int KWS303WF_FaultsHTTPQuery(http_request_t *request)
+{
+    KwsFaultRow_t rows[KWS_ROWS_PER_READ];
+    char line[48];
+    int i, j, n;
+
+    http_setup(request, httpMimeTypeText);
+    poststr(request, "uptime_s,code,value\n");
+    for (i = 0; i < g_fault_ring.count; i += n) {
+        n = LFS_Ring_Read(&g_fault_ring, i, rows, KWS_ROWS_PER_READ);
+        if (n <= 0) break;
+        for (j = 0; j < n; j++) {
+            fault_row_csv(&rows[j], line, sizeof(line));
+            poststr(request, line);
+            poststr(request, "\n");
+        }
+    }
+    poststr(request, NULL);
+    return 0;
+}
+
 
 /* -- IMP-P: kws_veh_config - get/set per-vehicle runtime efficiency -------
  * Usage: kws_veh_config                           -> print current values
  *        kws_veh_config 2w <km/kWh> <oldkmpl>    -> set 2-wheeler factors
  *        kws_veh_config 4w <km/kWh> <oldkmpl>    -> set 4-wheeler factors
- * All changes are persisted to kws_vehicles.cfg immediately.
+ * All changes are persisted immediately.
  * Example: kws_veh_config 2w 28.5 38.0
  *          -> Ather 450X, 28.5 km/kWh; old Activa at 38 km/L petrol        */
 static commandResult_t CMD_VehConfig(const void *ctx, const char *cmd,
@@ -2048,7 +2163,7 @@ static commandResult_t CMD_VehConfig(const void *ctx, const char *cmd,
                   "kws_veh_config: unknown type '%s' (use 2w or 4w)", key);
         return CMD_RES_BAD_ARGUMENT;
     }
-    vehicles_save();
+    kws_store_save();
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
               "kws_veh_config: %s set to %.2fkm/kWh old=%.1fkmpl (saved)",
               key, km_pkwh, old_kmpl);
@@ -2092,7 +2207,7 @@ static commandResult_t CMD_Schedule(const void *ctx, const char *cmd,
     if (strcmp(args, "enable") == 0) {
         g_sched_enabled = 1u;
         g_sched_blocked = 0u;
-        schedule_save();
+        kws_store_save();
         addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
                   "KWS303WF: schedule ENABLED window=%02u:00-%02u:00",
                   (unsigned)g_sched_start, (unsigned)g_sched_end);
@@ -2101,7 +2216,7 @@ static commandResult_t CMD_Schedule(const void *ctx, const char *cmd,
     if (strcmp(args, "disable") == 0) {
         g_sched_enabled = 0u;
         g_sched_blocked = 0u;
-        schedule_save();
+        kws_store_save();
         addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
                   "KWS303WF: schedule DISABLED");
         return CMD_RES_OK;
@@ -2117,7 +2232,7 @@ static commandResult_t CMD_Schedule(const void *ctx, const char *cmd,
     g_sched_end     = (uint8_t)eh;
     g_sched_enabled = 1u;   /* setting a window implicitly enables scheduling */
     g_sched_blocked = 0u;
-    schedule_save();
+    kws_store_save();
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
               "KWS303WF: schedule window set %02u:00-%02u:00 (enabled, saved)",
               (unsigned)g_sched_start, (unsigned)g_sched_end);
@@ -2168,7 +2283,7 @@ static commandResult_t CMD_Tou(const void *ctx, const char *cmd,
     }
     if (strcmp(args, "clear") == 0) {
         g_rate_tiers_n = 0u;
-        tou_save();
+        kws_store_save();
         addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
                   "KWS303WF: TOU cleared - single rate Rs%.4f/kWh active", g_rate_rs);
         return CMD_RES_OK;
@@ -2195,7 +2310,7 @@ static commandResult_t CMD_Tou(const void *ctx, const char *cmd,
     g_rate_tiers[i].end_h   = (uint8_t)eh;
     g_rate_tiers[i].rate_rs = rate;
     g_rate_tiers_n++;
-    tou_save();
+    kws_store_save();
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
               "KWS303WF: TOU tier%u added %02u:00-%02u:00 Rs%.4f/kWh (saved, %u tier(s) total)",
               (unsigned)i, (unsigned)sh, (unsigned)eh, rate,
@@ -2204,13 +2319,11 @@ static commandResult_t CMD_Tou(const void *ctx, const char *cmd,
 }
 
 /*
- * KWS303WF_Init() - v1.2.0
- * IMP-G: rate_load() restores persisted tariff.
- * IMP-H: protect_load() restores OV/UV/OC thresholds.
- * IMP-J: daily_load() restores today's accumulated kWh.
- * IMP-K: increments g_reboot_count and persists immediately after lifetime_load().
+ * KWS303WF_Init() - v1.3.0
+ * kws_store_load() restores tariff, thresholds, daily kWh, vehicle factors,
+ * schedule, TOU tiers, lifetime and the running session in one read.
+ * IMP-K: increments g_reboot_count and persists immediately after load.
  * IMP-L: g_hb_tick initialised to 0 - first heartbeat fires after KWS_HEARTBEAT_S s.
- * IMP-P: vehicles_load() restores per-vehicle efficiency factors.
  */
 
 /* IMP-V: kws_lock - get/set session relay lock state.
@@ -2245,34 +2358,17 @@ void KWS303WF_Init(void)
     HAL_PIN_SetOutputValue(KWS_RELAY_PIN_OFF, 0);
     relay_open();
 
-    lifetime_load();   /* improvement #8: restore odometer + IMP-K: reboot_count */
+    /* All persistent state (and v1.x text files on first boot). */
+    kws_store_load();
 
     /* IMP-K: increment reboot counter and persist immediately. */
     g_reboot_count++;
-    lifetime_save();
+    kws_store_save();
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
               "KWS303WF: reboot #%u (lifetime %.2f Wh)",
               (unsigned)g_reboot_count, g_lifetime_wh);
-
-    /* IMP-G: restore persisted electricity rate. */
-    rate_load();
-
-    /* IMP-H: restore persisted protection thresholds. */
-    protect_load();
-
-    /* IMP-J: restore today's daily accumulator. */
-    daily_load();
     g_daily_mqtt_sent    = 0u;   /* never sent this boot */
 
-    /* IMP-P: restore per-vehicle efficiency factors. */
-    vehicles_load();
-
-    /* IMP-Q: restore off-peak scheduling config. */
-    schedule_load();
-
-    /* IMP-R: restore TOU tariff tiers (reads extra lines from kws_rate.cfg). */
-    tou_load();
-
     /* IMP-L: heartbeat counter starts at 0 - first publish fires after
      * KWS_HEARTBEAT_S seconds; no publish on cold boot to avoid flood. */
     g_hb_tick = 0u;
@@ -2294,7 +2390,7 @@ void KWS303WF_Init(void)
     btn_register(KWS_BTN_SESSION,  on_session);
     btn_register(KWS_BTN_RESERVED, on_reserved);
 
-    if (sess_load() && g_ev.active) {
+    if (g_ev.active) {
         g_ev.seg_count++;
         g_ev.wh_offset = 0.0f;
         g_ev.wh_resume = 1;
@@ -2304,7 +2400,10 @@ void KWS303WF_Init(void)
                   "KWS303WF: Session RESUMED id=%u segs=%u (offset deferred)",
                   g_ev.session_id, g_ev.seg_count);
     } else {
+        /* keep session ids counting up across reboots */
+        uint32_t id = g_ev.session_id;
         memset(&g_ev, 0, sizeof(g_ev));
+        g_ev.session_id = id;
         g_ev.rate_rs = g_rate_rs;
     }
 
@@ -2447,7 +2546,7 @@ static void daily_tick(void)
 
     g_daily_kwh          = 0.0f;
     g_daily_start_uptime = g_uptime_s;
-    daily_save();
+    kws_store_save();
 }
 
 /* -- IMP-L: MQTT heartbeat/keepalive tick --------------------------------
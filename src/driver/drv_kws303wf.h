@@ -1,7 +1,7 @@
 /*
  * drv_kws303wf.h — Public API for KWS-303WF Device Application Driver
  *
- * Only two functions are public — the OBK lifecycle functions.
+ * Public: the OBK lifecycle functions and the REST CSV handlers.
  * Everything else (relay, buttons, NTC, session) is internal to drv_kws303wf.c
  */
 
@@ -9,12 +9,16 @@
 #define DRV_KWS303WF_H
 
 #include "../obk_config.h"
+#include "../httpserver/new_http.h"
 #if ENABLE_DRIVER_KWS303WF
 
 void KWS303WF_Init(void);
 void KWS303WF_RunEverySecond(void);
 void KWS303WF_RunQuickTick(void);
 void KWS303WF_OnHassDiscovery(const char *topic);
+// CSV of history and fault rings for REST api/kws/history, api/kws/faults
+int KWS303WF_HistoryHTTPQuery(http_request_t *request);
+int KWS303WF_FaultsHTTPQuery(http_request_t *request);
 
 #endif /* ENABLE_DRIVER_KWS303WF */
 #endif /* DRV_KWS303WF_H */
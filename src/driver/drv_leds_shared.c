@@ -7,6 +7,7 @@
 #include "../httpserver/new_http.h"
 #include "../logging/logging.h"
 #include "../mqtt/new_mqtt.h"
+#include "../quicktick.h"
 
 #include "drv_local.h"
 #include "drv_leds_shared.h"
@@ -24,6 +25,110 @@ enum ColorChannel *color_channel_order = default_color_channel_order;
 int pixel_size = DEFAULT_PIXEL_SIZE; // default is RGB -> 3 bytes per pixel
 // Number of pixels that can be addressed
 uint32_t pixel_count;
+// SPI buffer takes 4 bytes per colour, 1024 RGB pixels need 12KB
+#define STRIP_MAX_PIXELS 1024
+// Pixels in strip channel order, pushed to backend in one go by Strip_Apply
+static byte *g_pixels;
+static bool g_pixelsDirty;
+
+// Frame pacing, with target FPS set Strip_Apply sends at most one frame
+// per interval and newer frame replaces one still waiting (dropped).
+// Backend DMA buffer is written only by Strip_Flush right before sending.
+static int g_stripFPS;
+static bool g_framePending;
+static unsigned int g_nextFrameMs;
+static unsigned int g_framesSent;
+static unsigned int g_framesDropped;
+static unsigned int g_fpsWindowStart;
+static unsigned int g_fpsWindowFrames;
+static int g_achievedFPS;
+
+typedef void (*stripBlit_t)(byte *dst, const byte *rgbcw);
+static stripBlit_t g_blit;
+
+// rgbcw is indexed by ColorChannel_t
+static void Strip_Blit_RGB(byte *dst, const byte *rgbcw) {
+	dst[0] = rgbcw[COLOR_CHANNEL_RED];
+	dst[1] = rgbcw[COLOR_CHANNEL_GREEN];
+	dst[2] = rgbcw[COLOR_CHANNEL_BLUE];
+}
+static void Strip_Blit_GRB(byte *dst, const byte *rgbcw) {
+	dst[0] = rgbcw[COLOR_CHANNEL_GREEN];
+	dst[1] = rgbcw[COLOR_CHANNEL_RED];
+	dst[2] = rgbcw[COLOR_CHANNEL_BLUE];
+}
+static void Strip_Blit_RGBW(byte *dst, const byte *rgbcw) {
+	dst[0] = rgbcw[COLOR_CHANNEL_RED];
+	dst[1] = rgbcw[COLOR_CHANNEL_GREEN];
+	dst[2] = rgbcw[COLOR_CHANNEL_BLUE];
+	dst[3] = rgbcw[COLOR_CHANNEL_WARM_WHITE];
+}
+static void Strip_Blit_GRBW(byte *dst, const byte *rgbcw) {
+	dst[0] = rgbcw[COLOR_CHANNEL_GREEN];
+	dst[1] = rgbcw[COLOR_CHANNEL_RED];
+	dst[2] = rgbcw[COLOR_CHANNEL_BLUE];
+	dst[3] = rgbcw[COLOR_CHANNEL_WARM_WHITE];
+}
+static void Strip_Blit_Any3(byte *dst, const byte *rgbcw) {
+	dst[0] = rgbcw[color_channel_order[0]];
+	dst[1] = rgbcw[color_channel_order[1]];
+	dst[2] = rgbcw[color_channel_order[2]];
+}
+static void Strip_Blit_Any4(byte *dst, const byte *rgbcw) {
+	dst[0] = rgbcw[color_channel_order[0]];
+	dst[1] = rgbcw[color_channel_order[1]];
+	dst[2] = rgbcw[color_channel_order[2]];
+	dst[3] = rgbcw[color_channel_order[3]];
+}
+static void Strip_Blit_Any(byte *dst, const byte *rgbcw) {
+	int i;
+
+	for (i = 0; i < pixel_size; i++) {
+		dst[i] = rgbcw[color_channel_order[i]];
+	}
+}
+static bool Strip_OrderIs(const char *order) {
+	int i;
+
+	for (i = 0; i < pixel_size; i++) {
+		if (order[i] == 0 || "RGBCW"[color_channel_order[i]] != order[i]) {
+			return false;
+		}
+	}
+	return order[i] == 0;
+}
+static stripBlit_t Strip_SelectBlit() {
+	if (Strip_OrderIs("RGB"))
+		return Strip_Blit_RGB;
+	if (Strip_OrderIs("GRB"))
+		return Strip_Blit_GRB;
+	if (Strip_OrderIs("RGBW"))
+		return Strip_Blit_RGBW;
+	if (Strip_OrderIs("GRBW"))
+		return Strip_Blit_GRBW;
+	if (pixel_size == 3)
+		return Strip_Blit_Any3;
+	if (pixel_size == 4)
+		return Strip_Blit_Any4;
+	return Strip_Blit_Any;
+}
+static void Strip_Flush() {
+	uint32_t i, len;
+
+	if (g_pixels == 0 || g_pixelsDirty == false) {
+		return;
+	}
+	len = pixel_count * pixel_size;
+	if (led_backend.setBytes) {
+		led_backend.setBytes(0, g_pixels, len);
+	}
+	else {
+		for (i = 0; i < len; i++) {
+			led_backend.setByte(i, g_pixels[i]);
+		}
+	}
+	g_pixelsDirty = false;
+}
 
 bool Strip_HasChannel(ColorChannel_t ch) {
 	for (int i = 0; i < pixel_size; i++) {
@@ -35,11 +140,11 @@ bool Strip_HasChannel(ColorChannel_t ch) {
 }
 
 void Strip_GetPixel(uint32_t pixel, byte *dst) {
-	int i;
-
-	for (i = 0; i < pixel_size; i++) {
-		dst[i] = led_backend.getByte(pixel * pixel_size + i);
+	if (g_pixels == 0 || pixel >= pixel_count) {
+		memset(dst, 0, pixel_size);
+		return;
 	}
+	memcpy(dst, g_pixels + pixel * pixel_size, pixel_size);
 }
 
 bool Strip_VerifyPixel(uint32_t pixel, byte r, byte g, byte b) {
@@ -84,52 +189,50 @@ bool Strip_VerifyPixel4(uint32_t pixel, byte r, byte g, byte b, byte w) {
 
 
 void Strip_setPixel(int pixel, int r, int g, int b, int c, int w) {
-	if (pixel < 0 || pixel >= pixel_count) {
+	byte rgbcw[5];
+
+	if (pixel < 0 || pixel >= (int)pixel_count || g_pixels == 0) {
 		return; // out of range - would crash
 	}
+	rgbcw[COLOR_CHANNEL_RED] = r;
+	rgbcw[COLOR_CHANNEL_GREEN] = g;
+	rgbcw[COLOR_CHANNEL_BLUE] = b;
+	rgbcw[COLOR_CHANNEL_COLD_WHITE] = c;
+	rgbcw[COLOR_CHANNEL_WARM_WHITE] = w;
+	g_blit(g_pixels + pixel * pixel_size, rgbcw);
+	g_pixelsDirty = true;
+}
+// data is RGB (srcSize 3) or RGBW (srcSize 4) pixels, written from pixel first on
+void Strip_BlitPixels(uint32_t first, const byte *data, int count, int srcSize) {
+	byte rgbcw[5] = { 0 };
+	byte *dst;
 	int i;
-	for (i = 0; i < pixel_size; i++)
-	{
-		byte pcolor;
-		switch (color_channel_order[i])
-		{
-		case COLOR_CHANNEL_RED:
-			pcolor = r;
-			break;
-		case COLOR_CHANNEL_GREEN:
-			pcolor = g;
-			break;
-		case COLOR_CHANNEL_BLUE:
-			pcolor = b;
-			break;
-		case COLOR_CHANNEL_COLD_WHITE:
-			pcolor = c;
-			break;
-		case COLOR_CHANNEL_WARM_WHITE:
-			pcolor = w;
-			break;
-		default:
-			ADDLOG_ERROR(LOG_FEATURE_CMD, "Unknown color channel %d at index %d", color_channel_order[i], i);
-			return;
-		}
-		led_backend.setByte(i + (pixel * pixel_size), pcolor);
 
+	if (g_pixels == 0 || first >= pixel_count)
+		return;
+	if (count > (int)(pixel_count - first))
+		count = pixel_count - first;
+	dst = g_pixels + first * pixel_size;
+	g_pixelsDirty = true;
+	// strip has same order as data
+	if ((srcSize == 3 && g_blit == Strip_Blit_RGB) || (srcSize == 4 && g_blit == Strip_Blit_RGBW)) {
+		memcpy(dst, data, count * srcSize);
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		rgbcw[COLOR_CHANNEL_RED] = data[0];
+		rgbcw[COLOR_CHANNEL_GREEN] = data[1];
+		rgbcw[COLOR_CHANNEL_BLUE] = data[2];
+		if (srcSize == 4) {
+			rgbcw[COLOR_CHANNEL_WARM_WHITE] = data[3];
+		}
+		g_blit(dst, rgbcw);
+		data += srcSize;
+		dst += pixel_size;
 	}
 }
 void Strip_setMultiplePixel(uint32_t pixel, uint8_t *data, bool push) {
-	// Check max pixel
-	if (pixel > pixel_count)
-		pixel = pixel_count;
-
-	// Iterate over pixel
-	for (uint32_t i = 0; i < pixel; i++) {
-		uint8_t r, g, b;
-		r = *data++;
-		g = *data++;
-		b = *data++;
-		// TODO: Not sure how this works. Should we add Cold and Warm white here as well?
-		Strip_setPixel((int)i, (int)r, (int)g, (int)b, 0, 0);
-	}
+	Strip_BlitPixels(0, data, pixel, 3);
 	if (push) {
 		Strip_Apply();
 	}
@@ -149,19 +252,15 @@ void Strip_setPixelWithBrig(int pixel, int r, int g, int b, int c, int w) {
 #define SCALE8_PIXEL(x, scale) (uint8_t)(((uint32_t)x * (uint32_t)scale) / 256)
 
 void Strip_scaleAllPixels(int scale) {
-	int pixel;
-	byte b;
-	int ofs;
-	byte *data, *input;
+	uint32_t i, len;
 
-	for (pixel = 0; pixel < pixel_count; pixel++) {
-		for (ofs = 0; ofs < pixel_size; ofs++) {
-			int byteIndex = pixel * pixel_size + ofs;
-			byte b = led_backend.getByte(byteIndex);
-			b = SCALE8_PIXEL(b, scale);
-			led_backend.setByte(byteIndex, b);
-		}
+	if (g_pixels == 0)
+		return;
+	len = pixel_count * pixel_size;
+	for (i = 0; i < len; i++) {
+		g_pixels[i] = SCALE8_PIXEL(g_pixels[i], scale);
 	}
+	g_pixelsDirty = true;
 }
 void Strip_setAllPixels(int r, int g, int b, int c, int w) {
 	int pixel;
@@ -183,12 +282,19 @@ commandResult_t Strip_CMD_setRaw(const void *context, const char *cmd, const cha
 	int i = 0;
 	// parse hex string like FFAABB0011 byte by byte
 	while (s[0] && s[1]) {
-		led_backend.setByte(i, hexbyte(s));
+		// pixel bytes must be in frame, or next Strip_Apply would overwrite them
+		if (g_pixels && i < (int)(pixel_count * pixel_size)) {
+			g_pixels[i] = hexbyte(s);
+			g_pixelsDirty = true;
+		}
+		else {
+			led_backend.setByte(i, hexbyte(s));
+		}
 		i++;
 		s += 2;
 	}
 	if (bPush) {
-		led_backend.apply();
+		Strip_Apply();
 	}
 	return CMD_RES_OK;
 }
@@ -259,7 +365,7 @@ commandResult_t Strip_CMD_InitForLEDCount(const void *context, const char *cmd,
 	//SM16703P_Shutdown();
 
 	// First arg: number of pixel to address
-	pixel_count = Tokenizer_GetArgIntegerRange(0, 0, 255);
+	pixel_count = Tokenizer_GetArgIntegerRange(0, 0, STRIP_MAX_PIXELS);
 	// Second arg (optional, default "RGB"): pixel format of "RGB" or "GRB"
 	if (Tokenizer_GetArgsCount() > 1) {
 		const char *format = Tokenizer_GetArg(1);
@@ -299,6 +405,18 @@ commandResult_t Strip_CMD_InitForLEDCount(const void *context, const char *cmd,
 		}
 		color_channel_order = new_channel_order;
 	}
+	if (g_pixels) {
+		os_free(g_pixels);
+	}
+	g_pixels = os_malloc(pixel_count * pixel_size + 1);
+	if (!g_pixels) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "Failed to allocate memory for %i pixels", pixel_count);
+		pixel_count = 0;
+		return CMD_RES_ERROR;
+	}
+	memset(g_pixels, 0, pixel_count * pixel_size);
+	g_pixelsDirty = false;
+	g_blit = Strip_SelectBlit();
 	led_backend.setLEDCount(pixel_count, pixel_size);
 
 	ADDLOG_INFO(LOG_FEATURE_CMD, "Register driver with %i LEDs", pixel_count);
@@ -313,8 +431,98 @@ bool Strip_IsActive() {
 	}
 	return false;
 }
-void Strip_Apply() {
+static void Strip_Send() {
+	unsigned int elapsed;
+
+	Strip_Flush();
 	led_backend.apply();
+	g_framePending = false;
+	g_framesSent++;
+	g_fpsWindowFrames++;
+	elapsed = g_timeMs - g_fpsWindowStart;
+	if (elapsed >= 1000) {
+		g_achievedFPS = g_fpsWindowFrames * 1000 / elapsed;
+		g_fpsWindowStart = g_timeMs;
+		g_fpsWindowFrames = 0;
+	}
+}
+static bool Strip_IsFrameDue() {
+	return (int)(g_timeMs - g_nextFrameMs) >= 0;
+}
+static void Strip_SendPaced() {
+	unsigned int interval = 1000 / g_stripFPS;
+
+	Strip_Send();
+	g_nextFrameMs += interval;
+	// late by more than a frame, don't try to catch up with a burst
+	if (Strip_IsFrameDue()) {
+		g_nextFrameMs = g_timeMs + interval;
+	}
+}
+void Strip_Apply() {
+	if (g_stripFPS <= 0) {
+		Strip_Send();
+		return;
+	}
+	if (g_framePending) {
+		g_framesDropped++;
+	}
+	g_framePending = true;
+	if (Strip_IsFrameDue()) {
+		Strip_SendPaced();
+	}
+	else {
+		QuickTick_Wake();
+	}
+}
+// true when frame made now would be sent right away, renderers can skip frames otherwise
+bool Strip_WantsFrame() {
+	if (g_stripFPS <= 0) {
+		return true;
+	}
+	return g_framePending == false && Strip_IsFrameDue();
+}
+void Strip_RunQuickTick() {
+	if (g_framePending && Strip_IsFrameDue()) {
+		Strip_SendPaced();
+	}
+}
+int Strip_GetTimeToNextWakeMS() {
+	if (g_framePending == false) {
+		return -1;
+	}
+	if (Strip_IsFrameDue()) {
+		return 0;
+	}
+	return g_nextFrameMs - g_timeMs;
+}
+int Strip_GetAchievedFPS() {
+	// nothing sent for a while
+	if (g_timeMs - g_fpsWindowStart >= 2000) {
+		return 0;
+	}
+	return g_achievedFPS;
+}
+unsigned int Strip_GetDroppedFrames() {
+	return g_framesDropped;
+}
+// Strip_FPS 50
+// Strip_FPS
+static commandResult_t Strip_CMD_FPS(const void *context, const char *cmd, const char *args, int flags) {
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() > 0) {
+		g_stripFPS = Tokenizer_GetArgIntegerRange(0, 0, 200);
+		g_nextFrameMs = g_timeMs;
+		g_framesDropped = 0;
+		// frame waiting for slot goes out now
+		if (g_framePending && g_stripFPS <= 0) {
+			Strip_Send();
+		}
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Strip target %i FPS, sent %i FPS, %u frames, %u dropped",
+		g_stripFPS, Strip_GetAchievedFPS(), g_framesSent, g_framesDropped);
+	return CMD_RES_OK;
 }
 static commandResult_t Strip_CMD_StartTX(const void *context, const char *cmd, const char *args, int flags) {
 	Strip_Apply();
@@ -328,7 +536,7 @@ void LEDS_InitShared(ledStrip_t *api) {
 	led_backend = *api;
 
 	//cmddetail:{"name":"SM16703P_Init","args":"[NumberOfLEDs][ColorOrder]",
-	//cmddetail:"descr":"This will setup LED driver for a strip with given number of LEDs. Please note that it also works for WS2812B and similiar LEDs. You can optionally set the color order with can be any combination of R, G, B, C and W (e.g. RGBW or GRBWC, default is RGB). See [tutorial](https://www.elektroda.com/rtvforum/topic4036716.html).",
+	//cmddetail:"descr":"This will setup LED driver for a strip with given number of LEDs (up to 1024). Please note that it also works for WS2812B and similiar LEDs. You can optionally set the color order with can be any combination of R, G, B, C and W (e.g. RGBW or GRBWC, default is RGB). See [tutorial](https://www.elektroda.com/rtvforum/topic4036716.html).",
 	//cmddetail:"fn":"Strip_CMD_InitForLEDCount","file":"driver/drv_leds_shared.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("SM16703P_Init", Strip_CMD_InitForLEDCount, NULL);
@@ -351,11 +559,26 @@ void LEDS_InitShared(ledStrip_t *api) {
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("SM16703P_SetRaw", Strip_CMD_setRaw, NULL);
 	CMD_CreateAliasHelper("Strip_SetRaw", "SM16703P_SetRaw");
+	//cmddetail:{"name":"Strip_FPS","args":"[TargetFPS]",
+	//cmddetail:"descr":"Paces strip output to given frames per second, 0 (default) sends every frame right away. With pacing, frame made before its time waits and newer frame replaces it, that is counted as dropped. PixelAnim renders only when frame can be sent. Without argument, prints target and achieved FPS and dropped frames count.",
+	//cmddetail:"fn":"Strip_CMD_FPS","file":"driver/drv_leds_shared.c","requires":"",
+	//cmddetail:"examples":"Strip_FPS 50"}
+	CMD_RegisterCommand("Strip_FPS", Strip_CMD_FPS, NULL);
 
 	//CMD_RegisterCommand("SM16703P_SendBytes", SM16703P_CMD_sendBytes, NULL);
 }
 
 void LEDS_ShutdownShared() {
+	if (g_pixels) {
+		os_free(g_pixels);
+		g_pixels = 0;
+	}
+	g_pixelsDirty = false;
+	g_stripFPS = 0;
+	g_framePending = false;
+	g_framesSent = 0;
+	g_framesDropped = 0;
+	g_achievedFPS = 0;
 	if (color_channel_order != default_color_channel_order) {
 		os_free(color_channel_order);
 		color_channel_order = default_color_channel_order;
@@ -8,6 +8,8 @@
 typedef struct ledStrip_s {
 	byte (*getByte)(uint32_t pixel);
 	void (*setByte)(uint32_t idx, byte val);
+	// optional, copies many bytes at once, used by Strip_Apply to flush pixels
+	void (*setBytes)(uint32_t idx, const byte *data, int len);
 	void (*apply)();
 	void (*setLEDCount)(int pixel_count, int pixel_size);
 } ledStrip_t;
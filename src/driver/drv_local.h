@@ -2,19 +2,45 @@
 
 #include "../httpserver/new_http.h"
 #include "../cmnds/cmd_public.h"
+#include "drv_public.h"
 
 void DRV_DGR_Init();
 void DRV_DGR_RunQuickTick();
 void DRV_DGR_RunEverySecond();
 void DRV_DGR_Shutdown();
 void DRV_DGR_OnChannelChanged(int ch, int value);
+void DRV_DGR_OnChannelsChanged(const int* chs, const int* vals, int count);
 void DRV_DGR_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
 
+void DRV_ChSync_Init();
+void DRV_ChSync_RunQuickTick();
+void DRV_ChSync_RunEverySecond();
+void DRV_ChSync_Shutdown();
+void DRV_ChSync_OnChannelsChanged(const int *chs, const int *vals, int count);
+void DRV_ChSync_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+void ChSync_ProcessPacket(const byte *data, int len);
+int ChSync_Format(byte *buffer, int maxSize, const char *name, int flags, uint16_t seq, const int *chs, const int *vals, int count);
+
+void DRV_MDNS_Init();
+void DRV_MDNS_RunQuickTick();
+void DRV_MDNS_RunEverySecond();
+void DRV_MDNS_Shutdown();
+void DRV_MDNS_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+int MDNS_AnswerQuery(const byte *pkt, int len, int fromPort, byte *out, int outSize, bool *bUnicast);
+
 void DRV_DDP_Init();
 void DRV_DDP_RunFrame();
 void DRV_DDP_Shutdown();
 void DRV_DDP_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
 
+void E131_Init();
+void E131_RunFrame();
+void E131_Shutdown();
+void E131_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+void E131_ProcessPacket(const byte *data, int len);
+bool E131_GetUniverseStats(int universe, unsigned int *packets, unsigned int *lost, unsigned int *latencyMs);
+unsigned int E131_GetFramesShown();
+
 void BMP280_Init();
 void BMP280_OnEverySecond();
 void BMP280_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
@@ -62,7 +88,11 @@ void DRV_GosundSW2_RunFrame();
 
 
 void DRV_PinMutex_Init();
-void DRV_PinMutex_RunFrame();
+void DRV_PinMutex_Stop();
+void DRV_PinMutex_OnChannelChanged(int ch, int value);
+void DRV_PinMutex_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+void PinMutex_RunQuickTick();
+int PinMutex_GetTimeToNextWakeMS();
 
 void MultiPinI2CScanner_Init();
 void MultiPinI2CScanner_RunFrame();
@@ -78,11 +108,18 @@ void Strip_setPixelWithBrig(int pixel, int r, int g, int b, int c, int w);
 void Strip_setAllPixels(int r, int g, int b, int c, int w);
 void Strip_scaleAllPixels(int scale);
 void Strip_setMultiplePixel(uint32_t pixel, uint8_t* data, bool push);
+void Strip_BlitPixels(uint32_t first, const byte *data, int count, int srcSize);
 void SM16703P_Show();
 void SM15155E_Init();
 void SM15155E_Write(float *rgbcw);
 void Strip_Apply();
 bool Strip_IsActive();
+// frame pacing, see Strip_FPS
+bool Strip_WantsFrame();
+void Strip_RunQuickTick();
+int Strip_GetTimeToNextWakeMS();
+int Strip_GetAchievedFPS();
+unsigned int Strip_GetDroppedFrames();
 extern uint32_t pixel_count;
 
 void TM1637_Init();
@@ -100,11 +137,15 @@ void DRV_IR2_Init();
 void DRV_ADCSmoother_Init();
 void DRV_ADCSmoother_RunFrame();
 
-bool DRV_IsRunning(const char *name);
 
 // this is exposed here only for debug tool with automatic testing
 void DGR_ProcessIncomingPacket(char *msgbuf, int nbytes);
 void DGR_SpoofNextDGRPacketSource(const char *ipStrs);
+void SSDP_ProcessPacketFrom(char *msg, const char *ip);
+int DGR_GetSendQueueCount();
+void DGR_FlushSendQueue();
+void DGR_RunRetransmits();
+int DGR_GetPendingAckCount();
 
 void TuyaMCU_Sensor_RunEverySecond();
 void TuyaMCU_Sensor_Init();
@@ -113,6 +154,8 @@ void DRV_Test_Charts_AddToHtmlPage(http_request_t *request, int bPreState);
 
 void DRV_Charts_AddToHtmlPage(http_request_t *request, int bPreState);
 void DRV_Charts_Init();
+void DRV_Charts_RunEverySecond();
+int Chart_HTTPQuery(http_request_t *request);
 
 void DRV_Toggler_ProcessChanges(http_request_t *request);
 void DRV_Toggler_AddToHtmlPage(http_request_t *request);
@@ -122,6 +165,7 @@ void DRV_InitPWMToggler();
 
 void DRV_Widget_AddToHtmlPage(http_request_t *request, int bPreState);
 void DRV_Widget_Init();
+int Widget_GetCacheHits(const char *fname);
 
 void DRV_OpenWeatherMap_Init();
 void OWM_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
@@ -141,29 +185,50 @@ void SHT3X_StopDriver();
 
 void AHT2X_Init();
 void AHT2X_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
-void AHT2X_OnEverySecond();
 void AHT2X_StopDriver();
 
 void BMPI2C_Init();
 void BMPI2C_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
 void BMPI2C_OnEverySecond();
+void BMPI2C_StopDriver();
 
 void SGP_Init();
 void SGP_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
-void SGP_OnEverySecond();
+void SGP_Readmeasure();
 void SGP_StopDriver();
 
 void Batt_Init();
 void Batt_OnEverySecond();
 void Batt_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
 void Batt_StopDriver();
+// finish reading after divider relay has settled, from DRV_RunQuickTick
+void Batt_RunQuickTick();
+int Batt_GetTimeToNextWakeMS();
+
+typedef struct {
+	char name[25];
+	char flash[17];
+	uint32_t offset;
+	uint32_t length;
+	uint32_t extra;
+	char layout[8]; // "fal64" or "fal48"
+	// flash address of record magic
+	uint32_t at;
+} PartitionRecord;
 
 void BKPartitions_Init();
 void BKPartitions_QuickFrame();
+void BKPartitions_Stop();
+int BKPartitions_GetFound(const PartitionRecord **out);
+bool BKPartitions_IsDone();
+int BKPartitions_HTTPQuery(http_request_t *request);
  
 void Shift_Init();
 void Shift_OnEverySecond();
 void Shift_OnChannelChanged(int ch, int value);
+void Shift_OnChannelsChanged(const int* chs, const int* vals, int count);
+void Shift_RunQuickTick();
+void Shift_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState);
 
 void PIR_Init();
 void PIR_OnEverySecond();
@@ -176,6 +241,9 @@ void DRV_MAX72XX_Init();
 void DRV_MAX72XX_Shutdown();
 int MAX72XXSingle_CountPixels(bool bOn);
 int MAX72XXSingle_GetScrollCount();
+void MAX72XXSingle_PrintText(const char *s, int ofs);
+int MAX72XXSingle_GetWidth();
+unsigned int MAX72XXSingle_GetRowsSent();
 
 void EEPROM_Init();
 void EEPROM_OnEverySecond();
@@ -185,6 +253,8 @@ void apply_smart_light();
 
 void WEMO_Init();
 void WEMO_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+// LED enable state if LED driver runs, otherwise first relay
+bool Main_GetFirstPowerState();
 
 void HUE_Init();
 void HUE_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
@@ -209,6 +279,7 @@ void MAX31855_RunEverySecond();
 void TCA9554_Init();
 void TCA9554_OnEverySecond();
 void TCA9554_OnChannelChanged(int ch, int value);
+void TCA9554_OnChannelsChanged(const int* chs, const int* vals, int count);
 
 void DMX_Init();
 void DMX_OnEverySecond();
@@ -218,9 +289,33 @@ void PWMG_Init();
 
 void Freeze_Init();
 void Freeze_OnEverySecond();
-void Freeze_RunFrame();
+void Freeze_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+void Freeze_Stop();
+
+void PowerGov_Init();
+void PowerGov_OnEverySecond();
+void PowerGov_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+void PowerGov_Stop();
+// applies wake by command from QuickTick thread, from DRV_RunQuickTick
+void PowerGov_RunQuickTick();
+int PowerGov_GetTimeToNextWakeMS();
+
+void WiFiRoam_Init();
+void WiFiRoam_OnEverySecond();
+void WiFiRoam_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+void WiFiRoam_Stop();
+
+void Modbus_Init();
+void Modbus_RunQuickTick();
+int Modbus_GetTimeToNextWakeMS();
+void Modbus_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+void Modbus_Stop();
 
 void DRV_InitFlashMemoryTestFunctions();
+void LFS_SPI_Flash_Read(int adr, int cnt, byte *data);
+void LFS_SPI_Flash_Write(int adr, const byte *data, int cnt);
+void LFS_SPI_Flash_EraseSector(int addr);
+void LFS_SPI_Flash_Sync();
 
 void PixelAnim_Init();
 void PixelAnim_SetAnimQuickTick();
@@ -260,6 +355,7 @@ void DRV_DDPSend_AppendInformationToHTTPIndexPage(http_request_t* request, int b
 
 void TXW_Cam_Init(void);
 void TXW_Cam_RunEverySecond(void);
+void TXW_Cam_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState);
 
 #define SM2135_DELAY 4
 
@@ -284,6 +380,45 @@ void Soft_I2C_Start_Internal(softI2C_t *i2c);
 void Soft_I2C_Stop(softI2C_t *i2c);
 uint8_t Soft_I2C_ReadByte(softI2C_t *i2c, bool nack);
 void Soft_I2C_ReadBytes(softI2C_t *i2c, uint8_t *buf, int numOfBytes);
+// bytes moved by soft I2C, for bus use stats
+extern unsigned int g_softI2C_bytes;
+
+// I2C step run later from QuickTick, when sensor conversion is done
+typedef void (*i2cStepFn_t)(softI2C_t *bus);
+void I2CSched_Init();
+void I2CSched_Add(softI2C_t *bus, int ms, i2cStepFn_t fn);
+void I2CSched_Cancel(softI2C_t *bus);
+void I2CSched_RunQuickTick();
+int I2CSched_GetTimeToNextWakeMS();
+int I2CSched_GetPendingCount();
+
+// drv_sensor_acq.c, polls sensors at their interval and keeps their samples
+typedef void (*sensorPollFn_t)(void);
+typedef struct sensorSample_s {
+	// g_timeMs of poll that started measurement
+	unsigned int timeMs;
+	int value;
+	byte sensor;
+	byte channel;
+} sensorSample_t;
+int SensorAcq_Register(const char *name, int intervalMs, sensorPollFn_t poll);
+void SensorAcq_Unregister(int id);
+void SensorAcq_SetInterval(int id, int intervalMs);
+void SensorAcq_PollNow(int id);
+void SensorAcq_Push(int id, int channel, int value);
+bool SensorAcq_Next(unsigned int *seq, sensorSample_t *out);
+int SensorAcq_Find(const char *name);
+const char *SensorAcq_GetName(int id);
+unsigned int SensorAcq_GetPollCount(int id);
+void SensorAcq_RunQuickTick();
+int SensorAcq_GetTimeToNextWakeMS();
+
+// drv_debouncer.c, inputs debounced from edges stamped in ISR
+void Debouncer_Init();
+void Debouncer_Stop();
+void Debouncer_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+void Debouncer_RunQuickTick();
+int Debouncer_GetTimeToNextWakeMS();
 
 // Shared LED driver
 commandResult_t CMD_LEDDriver_Map(const void *context, const char *cmd, const char *args, int flags);
@@ -13,6 +13,7 @@
 #include "drv_ntp.h"
 #include "drv_deviceclock.h"
 #include "drv_public.h"
+#include "../quicktick.h"
 #include "drv_ssdp.h"
 #include "drv_test_drivers.h"
 #include "drv_tuyaMCU.h"
@@ -35,6 +36,9 @@ typedef struct driver_s {
 	void(*onChannelChanged)(int ch, int val);
 	void(*onHassDiscovery)(const char *topic);
 	bool bLoaded;
+	// optional, called once for channels changed in channel batch instead
+	// of onChannelChanged for each, so driver can write its outputs once
+	void(*onChannelsChanged)(const int* chs, const int* vals, int count);
 } driver_t;
 
 
@@ -59,6 +63,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 	//drvdetail:{"name":"tmSensor",
 	//drvdetail:"title":"TODO",
@@ -73,6 +78,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #ifdef ENABLE_DRIVER_GIRIERMCU
@@ -89,6 +95,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_TCA9554
@@ -105,6 +112,7 @@ static driver_t g_drivers[] = {
 	TCA9554_OnChannelChanged,                // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	TCA9554_OnChannelsChanged,               // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_DMX
@@ -121,22 +129,75 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_FREEZE
 	//drvdetail:{"name":"Freeze",
 	//drvdetail:"title":"TODO",
-	//drvdetail:"descr":"Freeze is a test driver for watchdog. Enabling this will freeze device main loop.",
+	//drvdetail:"descr":"Freeze is software watchdog. Main loop, QuickTick, MQTT, HTTP and script runner report heartbeats, timer checks their deadlines and writes stuck task, with last command, to crash log before hardware watchdog resets device. Longest gaps between heartbeats are shown on main page, see WDT_Stats. WDT_Freeze freezes main loop to test it.",
 	//drvdetail:"requires":""}
 	{ "Freeze",                              // Driver Name
 	Freeze_Init,                             // Init
 	Freeze_OnEverySecond,                    // onEverySecond
-	NULL,                                    // appendInformationToHTTPIndexPage
-	Freeze_RunFrame,                         // runQuickTick
-	NULL,                                    // stopFunction
+	Freeze_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
+	NULL,                                    // runQuickTick
+	Freeze_Stop,                             // stopFunction
+	NULL,                                    // onChannelChanged
+	NULL,                                    // onHassDiscovery
+	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
+	},
+#endif
+#if ENABLE_DRIVER_POWERGOV
+	//drvdetail:{"name":"PowerGov",
+	//drvdetail:"title":"TODO",
+	//drvdetail:"descr":"PowerGov sets PowerSave level by load. MQTT and HTTP traffic, LED transitions, drivers and scripts that run often keep device at full performance, idle device goes to light and later deep power save, command or page request wakes it at once. Time spent in each level is shown on main page, see PowerGov and PowerGov_Stats.",
+	//drvdetail:"requires":""}
+	{ "PowerGov",                            // Driver Name
+	PowerGov_Init,                           // Init
+	PowerGov_OnEverySecond,                  // onEverySecond
+	PowerGov_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
+	NULL,                                    // runQuickTick
+	PowerGov_Stop,                           // stopFunction
+	NULL,                                    // onChannelChanged
+	NULL,                                    // onHassDiscovery
+	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
+	},
+#endif
+#if ENABLE_DRIVER_WIFIROAM
+	//drvdetail:{"name":"WiFiRoam",
+	//drvdetail:"title":"TODO",
+	//drvdetail:"descr":"WiFiRoam scans for APs in background while device is idle and keeps their BSSID, channel and signal in cache, shown in /api/wifiscan. When link stays weak, device joins better AP of same SSID, see WiFiRoam_Policy. Optional argument is seconds between scans, default 300.",
+	//drvdetail:"requires":""}
+	{ "WiFiRoam",                            // Driver Name
+	WiFiRoam_Init,                           // Init
+	WiFiRoam_OnEverySecond,                  // onEverySecond
+	WiFiRoam_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
+	NULL,                                    // runQuickTick
+	WiFiRoam_Stop,                           // stopFunction
+	NULL,                                    // onChannelChanged
+	NULL,                                    // onHassDiscovery
+	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
+	},
+#endif
+#if ENABLE_DRIVER_MODBUS
+	//drvdetail:{"name":"Modbus",
+	//drvdetail:"title":"TODO",
+	//drvdetail:"descr":"Modbus RTU on UART. As master it polls register ranges of slaves into channels by deadline, see Modbus_Map, and writes registers with Modbus_Write. Modbus_Slave makes device a slave with channels as holding registers. Optional arguments are baud (default 9600), parity (0 none, 1 odd, 2 even) and reply timeout in ms (default 100). Per slave counters and latency are shown by Modbus_Stats.",
+	//drvdetail:"requires":""}
+	{ "Modbus",                              // Driver Name
+	Modbus_Init,                             // Init
+	NULL,                                    // onEverySecond
+	Modbus_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
+	NULL,                                    // runQuickTick
+	Modbus_Stop,                             // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_TESTSPIFLASH
@@ -153,6 +214,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_PIR
@@ -169,6 +231,7 @@ static driver_t g_drivers[] = {
 	PIR_OnChannelChanged,                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_PIXELANIM
@@ -185,6 +248,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_DRAWERS
@@ -201,6 +265,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_HGS02
@@ -217,22 +282,24 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_PINMUTEX
 	//drvdetail:{"name":"PinMutex",
 	//drvdetail:"title":"TODO",
-	//drvdetail:"descr":"PinMutex.",
+	//drvdetail:"descr":"PinMutex drives two pins from one channel, for shutters and H-bridges, with guaranteed dead time between them, see setMutex.",
 	//drvdetail:"requires":""}
 	{ "PinMutex",                            // Driver Name
 	DRV_PinMutex_Init,                       // Init
 	NULL,                                    // onEverySecond
-	NULL,                                    // appendInformationToHTTPIndexPage
-	DRV_PinMutex_RunFrame,                   // runQuickTick
-	NULL,                                    // stopFunction
-	NULL,                                    // onChannelChanged
+	DRV_PinMutex_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
+	NULL,                                    // runQuickTick
+	DRV_PinMutex_Stop,                       // stopFunction
+	DRV_PinMutex_OnChannelChanged,           // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_GOSUNDSW2
@@ -249,6 +316,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_TCL
@@ -265,6 +333,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	TCL_DoDiscovery,                         // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_OPENWEATHERMAP
@@ -281,6 +350,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_WIDGET
@@ -297,6 +367,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if WINDOWS
@@ -313,6 +384,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_CHARTS
@@ -322,13 +394,14 @@ static driver_t g_drivers[] = {
 	//drvdetail:"requires":""}
 	{ "Charts",                              // Driver Name
 	DRV_Charts_Init,                         // Init
-	NULL,                                    // onEverySecond
+	DRV_Charts_RunEverySecond,               // onEverySecond
 	DRV_Charts_AddToHtmlPage,                // appendInformationToHTTPIndexPage
 	NULL,                                    // runQuickTick
 	NULL,                                    // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_NTP
@@ -345,6 +418,7 @@ static driver_t g_drivers[] = {
    	NULL,                                    // onChannelChanged
    	NULL,                                    // onHassDiscovery
    	false,                                   // loaded
+   	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_DS3231
@@ -361,6 +435,7 @@ static driver_t g_drivers[] = {
    	NULL,                                    // onChannelChanged
    	NULL,                                    // onHassDiscovery
    	false,                                   // loaded
+   	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_HTTPBUTTONS
@@ -377,6 +452,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_TESTPOWER
@@ -393,6 +469,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_TESTLED
@@ -409,6 +486,7 @@ static driver_t g_drivers[] = {
 	Test_LED_Driver_OnChannelChanged,        // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_TESTUART
@@ -425,6 +503,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_TEST_COMMANDS
@@ -441,6 +520,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_SIMPLEEEPROM
@@ -457,6 +537,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_MULTIPINI2CSCANNER
@@ -473,6 +554,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_I2C
@@ -489,6 +571,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_RN8209
@@ -505,22 +588,24 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_BL0942
 	//drvdetail:{"name":"BL0942",
 	//drvdetail:"title":"TODO",
-	//drvdetail:"descr":"BL0942 is a power-metering chip which uses UART protocol for communication. It's usually connected to TX1/RX1 port of BK. You need to calibrate power metering once, just like in Tasmota. See [LSPA9 teardown example](https://www.elektroda.com/rtvforum/topic3887748.html). By default, it uses 4800 baud, but you can also enable it with baud 9600 by using 'startDriver BL0942 9600', see [related topic](https://www.elektroda.com/rtvforum/viewtopic.php?p=20957896#20957896)",
+	//drvdetail:"descr":"BL0942 is a power-metering chip which uses UART protocol for communication. It's usually connected to TX1/RX1 port of BK. You need to calibrate power metering once, just like in Tasmota. See [LSPA9 teardown example](https://www.elektroda.com/rtvforum/topic3887748.html). By default, it uses 4800 baud, but you can also enable it with baud 9600 by using 'startDriver BL0942 9600', see [related topic](https://www.elektroda.com/rtvforum/viewtopic.php?p=20957896#20957896). Up to 4 chips on one UART are polled in turn, third argument is mask of their addresses and fourth is poll period in ms, readings of faster polls are averaged, e.g. 'startDriver BL0942 9600 3 250'",
 	//drvdetail:"requires":""}
 	{ "BL0942",                              // Driver Name
 	BL0942_UART_Init,                        // Init
 	BL0942_UART_RunEverySecond,              // onEverySecond
 	BL09XX_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
 	NULL,                                    // runQuickTick
-	NULL,                                    // stopFunction
+	BL0942_UART_Stop,                        // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_HT7017
@@ -546,6 +631,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	KWS303WF_OnHassDiscovery,               // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif                             
 #if ENABLE_DRIVER_PWM_GROUP
@@ -562,6 +648,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_BL0942SPI
@@ -578,6 +665,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_HLW8112SPI
@@ -594,6 +682,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	HLW8112_OnHassDiscovery,                 // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_CHARGINGLIMIT
@@ -610,6 +699,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_BL0937
@@ -626,6 +716,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_CSE7761
@@ -642,6 +733,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_CSE7766
@@ -658,6 +750,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_MAX6675
@@ -674,6 +767,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_MAX31855
@@ -690,6 +784,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_PT6523
@@ -706,6 +801,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_TEXTSCROLLER
@@ -722,6 +818,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_SM16703P
@@ -738,6 +835,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_SM15155E
@@ -754,6 +852,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_IRREMOTEESP
@@ -770,6 +869,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_IR
@@ -786,6 +886,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_RC
@@ -802,6 +903,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_IR2
@@ -818,6 +920,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_DDPSEND
@@ -834,6 +937,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_DDP
@@ -850,6 +954,24 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
+	},
+#endif
+#if ENABLE_DRIVER_E131
+	//drvdetail:{"name":"E131",
+	//drvdetail:"title":"TODO",
+	//drvdetail:"descr":"E1.31 (sACN) and Art-Net receiver for LED strips, for lighting consoles and xLights. Universes are mapped to strip pixels (by default consecutive universes of 170 RGB pixels from the one given, 1 if none), see E131_Map. Strip is sent once per frame, on sync packet when sender uses them. Packet loss and latency of each universe is shown on main page.",
+	//drvdetail:"requires":""}
+	{ "E131",                                // Driver Name
+	E131_Init,                               // Init
+	NULL,                                    // onEverySecond
+	E131_AppendInformationToHTTPIndexPage,   // appendInformationToHTTPIndexPage
+	E131_RunFrame,                           // runQuickTick
+	E131_Shutdown,                           // stopFunction
+	NULL,                                    // onChannelChanged
+	NULL,                                    // onHassDiscovery
+	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_SSDP
@@ -866,6 +988,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_TASMOTADEVICEGROUPS
@@ -882,6 +1005,41 @@ static driver_t g_drivers[] = {
 	DRV_DGR_OnChannelChanged,                // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	DRV_DGR_OnChannelsChanged,               // onChannelsChanged
+	},
+#endif
+#if ENABLE_DRIVER_CHSYNC
+	//drvdetail:{"name":"ChSync",
+	//drvdetail:"title":"TODO",
+	//drvdetail:"descr":"Mirrors channels between OBK devices over UDP without MQTT broker, see ChSync_Publish and ChSync_Subscribe. Changed channels are sent on next quick tick, to multicast group or to peers, and all of them every 30 seconds. Argument is name under which device publishes, short device name by default.",
+	//drvdetail:"requires":""}
+	{ "ChSync",                              // Driver Name
+	DRV_ChSync_Init,                         // Init
+	DRV_ChSync_RunEverySecond,               // onEverySecond
+	DRV_ChSync_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
+	DRV_ChSync_RunQuickTick,                 // runQuickTick
+	DRV_ChSync_Shutdown,                     // stopFunction
+	NULL,                                    // onChannelChanged
+	NULL,                                    // onHassDiscovery
+	false,                                   // loaded
+	DRV_ChSync_OnChannelsChanged,            // onChannelsChanged
+	},
+#endif
+#if ENABLE_DRIVER_MDNS
+	//drvdetail:{"name":"MDNS",
+	//drvdetail:"title":"TODO",
+	//drvdetail:"descr":"mDNS responder, answers for short device name with .local and advertises _http._tcp and _obk._tcp services (TXT with version, chip and MAC) for DNS-SD browsers. Records are prepared once, so answers are sent as soon as query comes.",
+	//drvdetail:"requires":""}
+	{ "MDNS",                                // Driver Name
+	DRV_MDNS_Init,                           // Init
+	DRV_MDNS_RunEverySecond,                 // onEverySecond
+	DRV_MDNS_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
+	DRV_MDNS_RunQuickTick,                   // runQuickTick
+	DRV_MDNS_Shutdown,                       // stopFunction
+	NULL,                                    // onChannelChanged
+	NULL,                                    // onHassDiscovery
+	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_WEMO
@@ -898,6 +1056,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_HUE
@@ -914,6 +1073,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
@@ -930,6 +1090,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 	//drvdetail:{"name":"DoorSensor",
 	//drvdetail:"title":"TODO",
@@ -940,10 +1101,11 @@ static driver_t g_drivers[] = {
 	DoorDeepSleep_OnEverySecond,             // onEverySecond
 	DoorDeepSleep_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
 	NULL,                                    // runQuickTick
-	NULL,                                    // stopFunction
+	DoorDeepSleep_StopDriver,                // stopFunction
 	DoorDeepSleep_OnChannelChanged,          // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_ADCBUTTON
@@ -960,6 +1122,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_MAX72XX
@@ -976,6 +1139,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_LED
@@ -992,6 +1156,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 	//drvdetail:{"name":"BP5758D",
 	//drvdetail:"title":"TODO",	
@@ -1006,6 +1171,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 	//drvdetail:{"name":"BP1658CJ",
 	//drvdetail:"title":"TODO",
@@ -1020,6 +1186,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 	//drvdetail:{"name":"SM2235",
 	//drvdetail:"title":"TODO",
@@ -1034,6 +1201,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_SSD1306
@@ -1050,6 +1218,7 @@ static driver_t g_drivers[] = {
 		NULL,                                    // onChannelChanged
 		NULL,                                    // onHassDiscovery
 		false,                                   // loaded
+		NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_ST7735
@@ -1066,6 +1235,7 @@ static driver_t g_drivers[] = {
 		NULL,                                // onChannelChanged
 		NULL,                                // onHassDiscovery
 		false,                               // loaded
+		NULL,                                // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_BMP280
@@ -1082,6 +1252,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_MAX72XX
@@ -1098,6 +1269,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_BMPI2C
@@ -1110,10 +1282,11 @@ static driver_t g_drivers[] = {
 	BMPI2C_OnEverySecond,                    // onEverySecond
 	BMPI2C_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
 	NULL,                                    // runQuickTick
-	NULL,                                    // stopFunction
+	BMPI2C_StopDriver,                       // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_CHT83XX
@@ -1130,6 +1303,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_MCP9808
@@ -1146,6 +1320,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_KP18058
@@ -1162,6 +1337,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_ADCSMOOTHER
@@ -1178,6 +1354,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_SHT3X
@@ -1194,6 +1371,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_SGP
@@ -1203,29 +1381,31 @@ static driver_t g_drivers[] = {
 	//drvdetail:"requires":""}
 	{ "SGP",                                 // Driver Name
 	SGP_Init,                                // Init
-	SGP_OnEverySecond,                       // onEverySecond
+	NULL,                                    // onEverySecond
 	SGP_AppendInformationToHTTPIndexPage,    // appendInformationToHTTPIndexPage
 	NULL,                                    // runQuickTick
 	SGP_StopDriver,                          // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_SHIFTREGISTER
 	//drvdetail:{"name":"ShiftRegister",
 	//drvdetail:"title":"TODO",
-	//drvdetail:"descr":"Simple Shift Register driver that allows you to map channels to shift register output. See [related topic](https://www.elektroda.com/rtvforum/viewtopic.php?p=20533505#20533505)",
+	//drvdetail:"descr":"Simple Shift Register driver that allows you to map channels to shift register output. Changes within a tick are shifted and latched once, optionally through hardware SPI. See [related topic](https://www.elektroda.com/rtvforum/viewtopic.php?p=20533505#20533505)",
 	//drvdetail:"requires":""}
 	{ "ShiftRegister",                       // Driver Name
 	Shift_Init,                              // Init
 	Shift_OnEverySecond,                     // onEverySecond
-	NULL,                                    // appendInformationToHTTPIndexPage
-	NULL,                                    // runQuickTick
+	Shift_AppendInformationToHTTPIndexPage,  // appendInformationToHTTPIndexPage
+	Shift_RunQuickTick,                      // runQuickTick
 	NULL,                                    // stopFunction
 	Shift_OnChannelChanged,                  // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	Shift_OnChannelsChanged,                 // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_AHT2X
@@ -1235,13 +1415,14 @@ static driver_t g_drivers[] = {
 	//drvdetail:"requires":""}
 	{ "AHT2X",                               // Driver Name
 	AHT2X_Init,                              // Init
-	AHT2X_OnEverySecond,                     // onEverySecond
+	NULL,                                    // onEverySecond
 	AHT2X_AppendInformationToHTTPIndexPage,  // appendInformationToHTTPIndexPage
 	NULL,                                    // runQuickTick
 	AHT2X_StopDriver,                        // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_DS1820
@@ -1258,6 +1439,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_DS1820_FULL
@@ -1274,6 +1456,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_HT16K33
@@ -1290,6 +1473,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 	// Shared driver for TM1637, GN6932, TM1638 - TM_GN_Display_SharedInit
@@ -1307,6 +1491,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 	//drvdetail:{"name":"GN6932",
 	//drvdetail:"title":"TODO",
@@ -1321,6 +1506,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 	//drvdetail:{"name":"TM1638",
 	//drvdetail:"title":"TODO",
@@ -1335,6 +1521,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 	//drvdetail:{"name":"HD2015",
 	//drvdetail:"title":"TODO",
@@ -1349,6 +1536,7 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_BATTERY
@@ -1365,22 +1553,24 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_BKPARTITIONS
 	//drvdetail:{"name":"BKPartitions",
 	//drvdetail:"title":"TODO",
-	//drvdetail:"descr":"o.",
+	//drvdetail:"descr":"Scans flash for Beken partition table records, few sections per QuickTick, and logs them. Result is kept for /api/partitions.",
 	//drvdetail:"requires":""}
 	{ "BKPartitions",                        // Driver Name
 	BKPartitions_Init,                       // Init
 	NULL,                                    // onEverySecond
 	NULL,                                    // appendInformationToHTTPIndexPage
 	BKPartitions_QuickFrame,                 // runQuickTick
-	NULL,                                    // stopFunction
+	BKPartitions_Stop,                       // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_BRIDGE
@@ -1397,6 +1587,7 @@ static driver_t g_drivers[] = {
 	Bridge_driver_OnChannelChanged,          // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_UART_TCP
@@ -1413,38 +1604,41 @@ static driver_t g_drivers[] = {
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if PLATFORM_TXW81X
 	//drvdetail:{"name":"TXWCAM",
 	//drvdetail:"title":"TODO",
-	//drvdetail:"descr":"TXW81X Camera.",
+	//drvdetail:"descr":"TXW81X Camera. Besides vendor RTSP, serves MJPEG stream at /cam/stream.mjpg and newest frame at /cam/snap.jpg.",
 	//drvdetail:"requires":""}
 	{ "TXWCAM",                              // Driver Name
 	TXW_Cam_Init,                            // Init
 	TXW_Cam_RunEverySecond,                  // onEverySecond
-	NULL,                                    // appendInformationToHTTPIndexPage
+	TXW_Cam_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
 	NULL,                                    // runQuickTick
 	NULL,                                    // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_NEO6M
 	//drvdetail:{"name":"NEO6M",
 	//drvdetail:"title":"TODO",
-	//drvdetail:"descr":"NEO6M is a GPS chip which uses UART protocol for communication. By default, it uses 9600 baud, but you can also enable it with other baud rates by using 'startDriver NEO6M <rate>'.",
+	//drvdetail:"descr":"NEO6M is a GPS chip which uses UART protocol for communication. By default, it uses 9600 baud, but you can also enable it with other baud rates by using 'startDriver NEO6M <rate>'. NMEA RMC is read, with 'allnmea' also GGA, GSA and VTG, and UBX NAV-PVT of newer u-blox modules. See NEO6M_Rate and NEO6M_MinDistance.",
 	//drvdetail:"requires":""}
 	{ "NEO6M",                               // Driver Name
 	NEO6M_UART_Init,                         // Init
 	NEO6M_UART_RunEverySecond,               // onEverySecond
 	NEO6M_AppendInformationToHTTPIndexPage,  // appendInformationToHTTPIndexPage
-	NULL,                                    // runQuickTick
+	NEO6M_RunQuickTick,                      // runQuickTick
 	NULL,                                    // stopFunction
 	NULL,                                    // onChannelChanged
 	NULL,                                    // onHassDiscovery
 	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 #if ENABLE_DRIVER_LTR_ALS
@@ -1461,22 +1655,210 @@ static driver_t g_drivers[] = {
 	NULL,                                 // onChannelChanged
 	NULL,                                 // onHassDiscovery
 	false,                                // loaded
+	NULL,                                 // onChannelsChanged
+	},
+#endif
+#if ENABLE_DRIVER_DEBOUNCER
+	//drvdetail:{"name":"Debouncer",
+	//drvdetail:"title":"TODO",
+	//drvdetail:"descr":"Debounced inputs on edge interrupts, for reed switches and flow meters. Each input has its own debounce and glitch windows, optionally adaptive, see Debouncer_Add. Edges are stamped in interrupt, so they are timed to a millisecond whatever main loop does.",
+	//drvdetail:"requires":""}
+	{ "Debouncer",                           // Driver Name
+	Debouncer_Init,                          // Init
+	NULL,                                    // onEverySecond
+	Debouncer_AppendInformationToHTTPIndexPage, // appendInformationToHTTPIndexPage
+	NULL,                                    // runQuickTick
+	Debouncer_Stop,                          // stopFunction
+	NULL,                                    // onChannelChanged
+	NULL,                                    // onHassDiscovery
+	false,                                   // loaded
+	NULL,                                    // onChannelsChanged
 	},
 #endif
 	//{ "", NULL, NULL, NULL, NULL, NULL, NULL, NULL, false },
 };
 
 
-static const int g_numDrivers = sizeof(g_drivers) / sizeof(g_drivers[0]);
+#define DRV_TABLE_SIZE (sizeof(g_drivers) / sizeof(g_drivers[0]))
+
+static const int g_numDrivers = DRV_TABLE_SIZE;
+
+// names for driverId_t, table entries are matched to them by name
+static const char* g_driverIdNames[DRV_ID_COUNT] = {
+	"TuyaMCU",
+	"tmSensor",
+	"GirierMCU",
+	"TCA9554",
+	"DMX",
+	"Freeze",
+	"PowerGov",
+	"TESTSPIFLASH",
+	"PIR",
+	"PixelAnim",
+	"Drawers",
+	"HGS02",
+	"PinMutex",
+	"GosundSW2",
+	"TCL",
+	"OpenWeatherMap",
+	"Widget",
+	"TestCharts",
+	"Charts",
+	"NTP",
+	"DS3231",
+	"HTTPButtons",
+	"TESTPOWER",
+	"TESTLED",
+	"TESTUART",
+	"Test",
+	"SimpleEEPROM",
+	"MultiPinI2CScanner",
+	"I2C",
+	"RN8209",
+	"BL0942",
+	"HT7017",
+	"KWS303WF",
+	"PWMG",
+	"BL0942SPI",
+	"HLW8112SPI",
+	"ChargingLimit",
+	"BL0937",
+	"CSE7761",
+	"CSE7766",
+	"MAX6675",
+	"MAX31855",
+	"PT6523",
+	"TextScroller",
+	"SM16703P",
+	"SM15155E",
+	"IR",
+	"RC",
+	"IR2",
+	"DDPSend",
+	"DDP",
+	"E131",
+	"SSDP",
+	"DGR",
+	"ChSync",
+	"MDNS",
+	"Wemo",
+	"Hue",
+	"PWMToggler",
+	"DoorSensor",
+	"ADCButton",
+	"MAX72XX_Clock",
+	"SM2135",
+	"BP5758D",
+	"BP1658CJ",
+	"SM2235",
+	"SSD1306",
+	"ST7735",
+	"BMP280",
+	"MAX72XX",
+	"BMPI2C",
+	"CHT83XX",
+	"MCP9808",
+	"KP18058",
+	"ADCSmoother",
+	"SHT3X",
+	"SGP",
+	"ShiftRegister",
+	"AHT2X",
+	"DS1820",
+	"DS1820_FULL",
+	"HT16K33",
+	"TM1637",
+	"GN6932",
+	"TM1638",
+	"HD2015",
+	"Battery",
+	"BKPartitions",
+	"Bridge",
+	"UartTCP",
+	"TXWCAM",
+	"NEO6M",
+	"LTR_ALS",
+};
+
+// Loaded drivers in table order, as whole and separately for each
+// callback, so callbacks do not scan whole table and check for NULL.
+// Rebuilt by DRV_StartDriver and DRV_StopDriver.
+typedef struct driverList_s {
+	int count;
+	byte items[DRV_TABLE_SIZE];
+} driverList_t;
+
+static driverList_t g_loadedDrivers;
+static driverList_t g_everySecondDrivers;
+static driverList_t g_quickTickDrivers;
+static driverList_t g_channelChangedDrivers;
+static driverList_t g_httpIndexDrivers;
+static driverList_t g_hassDiscoveryDrivers;
+// bit per driverId_t
+static uint32_t g_runningDriverIds[(DRV_ID_COUNT + 31) / 32];
 
-bool DRV_IsRunning(const char* name) {
+static int DRV_FindIdByName(const char* name) {
 	int i;
 
+	for (i = 0; i < DRV_ID_COUNT; i++) {
+		if (!stricmp(name, g_driverIdNames[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+static void DRV_ListAdd(driverList_t* list, int* count, int index, bool bHasCallback) {
+	if (bHasCallback) {
+		list->items[*count] = index;
+		(*count)++;
+	}
+}
+static void DRV_RebuildLists() {
+	int i, id;
+	int loaded = 0, everySecond = 0, quickTick = 0;
+	int channelChanged = 0, httpIndex = 0, hassDiscovery = 0;
+	driver_t* d;
+
+	// DRV_OnChannelChanged does not take mutex, so counts are set
+	// last and it never sees index past the filled items
+	memset(g_runningDriverIds, 0, sizeof(g_runningDriverIds));
 	for (i = 0; i < g_numDrivers; i++) {
-		if (g_drivers[i].bLoaded) {
-			if (!stricmp(name, g_drivers[i].name)) {
-				return true;
-			}
+		d = &g_drivers[i];
+		if (d->bLoaded == false) {
+			continue;
+		}
+		id = DRV_FindIdByName(d->name);
+		if (id >= 0) {
+			g_runningDriverIds[id / 32] |= 1u << (id % 32);
+		}
+		DRV_ListAdd(&g_loadedDrivers, &loaded, i, true);
+		DRV_ListAdd(&g_everySecondDrivers, &everySecond, i, d->onEverySecond != 0);
+		DRV_ListAdd(&g_quickTickDrivers, &quickTick, i, d->runQuickTick != 0);
+		DRV_ListAdd(&g_channelChangedDrivers, &channelChanged, i, d->onChannelChanged != 0 || d->onChannelsChanged != 0);
+		DRV_ListAdd(&g_httpIndexDrivers, &httpIndex, i, d->appendInformationToHTTPIndexPage != 0);
+		DRV_ListAdd(&g_hassDiscoveryDrivers, &hassDiscovery, i, d->onHassDiscovery != 0);
+	}
+	g_loadedDrivers.count = loaded;
+	g_everySecondDrivers.count = everySecond;
+	g_quickTickDrivers.count = quickTick;
+	g_channelChangedDrivers.count = channelChanged;
+	g_httpIndexDrivers.count = httpIndex;
+	g_hassDiscoveryDrivers.count = hassDiscovery;
+	QuickTick_Wake();
+}
+
+bool DRV_IsRunning(int driverId) {
+	if (driverId < 0 || driverId >= DRV_ID_COUNT) {
+		return false;
+	}
+	return (g_runningDriverIds[driverId / 32] >> (driverId % 32)) & 1;
+}
+bool DRV_IsRunningByName(const char* name) {
+	int i;
+
+	for (i = 0; i < g_loadedDrivers.count; i++) {
+		if (!stricmp(name, g_drivers[g_loadedDrivers.items[i]].name)) {
+			return true;
 		}
 	}
 	return false;
@@ -1506,49 +1888,173 @@ void DRV_OnEverySecond() {
 	if (DRV_Mutex_Take(100) == false) {
 		return;
 	}
-	for (i = 0; i < g_numDrivers; i++) {
-		if (g_drivers[i].bLoaded) {
-			if (g_drivers[i].onEverySecond != 0) {
-				g_drivers[i].onEverySecond();
-			}
-		}
+	for (i = 0; i < g_everySecondDrivers.count; i++) {
+		g_drivers[g_everySecondDrivers.items[i]].onEverySecond();
 	}
+#if ENABLE_BL_SHARED
+	BL_Shared_RunEverySecond();
+#endif
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	// unconditionally run TIME
 	TIME_OnEverySecond();
 #endif
 	DRV_Mutex_Free();
 }
+#if ENABLE_SYSPERF
+// by index in g_drivers
+static perfStat_t g_quickTickStats[DRV_TABLE_SIZE];
+#if ENABLE_DRIVER_INDEX_CACHE
+// index part renders and requests served from kept part
+static perfStat_t g_indexStats[DRV_TABLE_SIZE];
+static unsigned int g_indexHits[DRV_TABLE_SIZE];
+#endif
+
+void DRV_ForEachQuickTickStats(void* userData, void (*callback)(const char* name, const perfStat_t* st, void* userData)) {
+	int i;
+
+	for (i = 0; i < g_numDrivers; i++) {
+		if (g_quickTickStats[i].calls) {
+			callback(g_drivers[i].name, &g_quickTickStats[i], userData);
+		}
+	}
+}
+void DRV_ResetQuickTickStats() {
+	memset(g_quickTickStats, 0, sizeof(g_quickTickStats));
+#if ENABLE_DRIVER_INDEX_CACHE
+	memset(g_indexStats, 0, sizeof(g_indexStats));
+	memset(g_indexHits, 0, sizeof(g_indexHits));
+#endif
+}
+#endif
 void DRV_RunQuickTick() {
 	int i;
+#if ENABLE_SYSPERF
+	unsigned int start, now;
+#endif
 
 	if (DRV_Mutex_Take(0) == false) {
 		return;
 	}
-	for (i = 0; i < g_numDrivers; i++) {
-		if (g_drivers[i].bLoaded) {
-			if (g_drivers[i].runQuickTick != 0) {
-				g_drivers[i].runQuickTick();
-			}
-		}
+#if ENABLE_SYSPERF
+	start = SYSPERF_GetTimeUs();
+	for (i = 0; i < g_quickTickDrivers.count; i++) {
+		g_drivers[g_quickTickDrivers.items[i]].runQuickTick();
+		now = SYSPERF_GetTimeUs();
+		PerfStat_Add(&g_quickTickStats[g_quickTickDrivers.items[i]], now - start);
+		start = now;
+	}
+#else
+	for (i = 0; i < g_quickTickDrivers.count; i++) {
+		g_drivers[g_quickTickDrivers.items[i]].runQuickTick();
 	}
+#endif
+	// paced LED strip frame waiting for its time
+	Strip_RunQuickTick();
+	I2CSched_RunQuickTick();
+	SensorAcq_RunQuickTick();
+#if ENABLE_DRIVER_DEBOUNCER
+	// edges are queued by ISR, which wakes QuickTick
+	Debouncer_RunQuickTick();
+#endif
+#if ENABLE_NTP
+	// reply time is taken here, to a tick
+	NTP_RunQuickTick();
+#endif
+#if ENABLE_DRIVER_PINMUTEX && !PLATFORM_BEKEN
+	// dead time timer, Beken has it in hardware
+	PinMutex_RunQuickTick();
+#endif
+#if ENABLE_DRIVER_BL0942
+	// request/response cycle of UART bus, wakes only while it waits
+	BL0942_UART_RunQuickTick();
+#endif
+#if ENABLE_DRIVER_BATTERY
+	Batt_RunQuickTick();
+#endif
+#if ENABLE_DRIVER_POWERGOV
+	PowerGov_RunQuickTick();
+#endif
+#if ENABLE_DRIVER_MODBUS
+	// reply is in as soon as UART receive wakes QuickTick
+	Modbus_RunQuickTick();
+#endif
 	DRV_Mutex_Free();
 }
+// drivers don't report their deadlines, so any quick tick driver needs every tick
+static int DRV_EarlierWake(int a, int b) {
+	if (a == -1 || (b != -1 && b < a)) {
+		return b;
+	}
+	return a;
+}
+int DRV_GetTimeToNextWakeMS() {
+	int wake;
+
+	if (g_quickTickDrivers.count) {
+		return 0;
+	}
+	wake = Strip_GetTimeToNextWakeMS();
+	wake = DRV_EarlierWake(wake, I2CSched_GetTimeToNextWakeMS());
+#if ENABLE_NTP
+	wake = DRV_EarlierWake(wake, NTP_GetTimeToNextWakeMS());
+#endif
+#if ENABLE_DRIVER_DEBOUNCER
+	wake = DRV_EarlierWake(wake, Debouncer_GetTimeToNextWakeMS());
+#endif
+#if ENABLE_DRIVER_PINMUTEX && !PLATFORM_BEKEN
+	wake = DRV_EarlierWake(wake, PinMutex_GetTimeToNextWakeMS());
+#endif
+#if ENABLE_DRIVER_BL0942
+	wake = DRV_EarlierWake(wake, BL0942_UART_GetTimeToNextWakeMS());
+#endif
+#if ENABLE_DRIVER_BATTERY
+	wake = DRV_EarlierWake(wake, Batt_GetTimeToNextWakeMS());
+#endif
+#if ENABLE_DRIVER_POWERGOV
+	wake = DRV_EarlierWake(wake, PowerGov_GetTimeToNextWakeMS());
+#endif
+#if ENABLE_DRIVER_MODBUS
+	wake = DRV_EarlierWake(wake, Modbus_GetTimeToNextWakeMS());
+#endif
+	return DRV_EarlierWake(wake, SensorAcq_GetTimeToNextWakeMS());
+}
 void DRV_OnChannelChanged(int channel, int iVal) {
 	int i;
+	driver_t* d;
 
 	//if(DRV_Mutex_Take(100)==false) {
 	//	return;
 	//}
-	for (i = 0; i < g_numDrivers; i++) {
-		if (g_drivers[i].bLoaded) {
-			if (g_drivers[i].onChannelChanged != 0) {
-				g_drivers[i].onChannelChanged(channel, iVal);
-			}
+	for (i = 0; i < g_channelChangedDrivers.count; i++) {
+		d = &g_drivers[g_channelChangedDrivers.items[i]];
+		if (d->onChannelChanged) {
+			d->onChannelChanged(channel, iVal);
+		}
+		else {
+			d->onChannelsChanged(&channel, &iVal, 1);
 		}
 	}
 	//DRV_Mutex_Free();
 }
+void DRV_OnChannelsChanged(const int* chs, const int* vals, int count) {
+	int i, j;
+	driver_t* d;
+
+	for (i = 0; i < g_channelChangedDrivers.count; i++) {
+		d = &g_drivers[g_channelChangedDrivers.items[i]];
+		if (d->onChannelsChanged) {
+			d->onChannelsChanged(chs, vals, count);
+		}
+		else {
+			for (j = 0; j < count; j++) {
+				d->onChannelChanged(chs[j], vals[j]);
+			}
+		}
+	}
+}
+#if ENABLE_DRIVER_INDEX_CACHE
+static void DRV_FreeIndexFragment(int i);
+#endif
 // right now only used by simulator
 void DRV_ShutdownAllDrivers() {
 	int i;
@@ -1571,6 +2077,10 @@ void DRV_StopDriver(const char* name) {
 					g_drivers[i].stopFunc();
 				}
 				g_drivers[i].bLoaded = false;
+#if ENABLE_DRIVER_INDEX_CACHE
+				DRV_FreeIndexFragment(i);
+#endif
+				DRV_RebuildLists();
 				addLogAdv(LOG_INFO, LOG_FEATURE_MAIN, "Drv %s stopped.", g_drivers[i].name);
 			}
 			else {
@@ -1597,12 +2107,12 @@ void DRV_StartDriver(const char* name) {
 		if (!stricmp(g_drivers[i].name, name)) {
 #if (ENABLE_DRIVER_DS1820) && (ENABLE_DRIVER_DS1820_FULL)
 			twinrunning=false;
-			if (!stricmp("DS1820", name) && DRV_IsRunning("DS1820_FULL")){
+			if (!stricmp("DS1820", name) && DRV_IsRunning(DRV_ID_DS1820_FULL)){
 				addLogAdv(LOG_ERROR, LOG_FEATURE_MAIN, "Drv DS1820_FULL is already loaded - can't start DS1820, too.\n", name);
 				twinrunning=true;
 				break;
 			}
-			if (!stricmp("DS1820_FULL", name) && DRV_IsRunning("DS1820")){
+			if (!stricmp("DS1820_FULL", name) && DRV_IsRunning(DRV_ID_DS1820)){
 				addLogAdv(LOG_ERROR, LOG_FEATURE_MAIN, "Drv DS1820 is already loaded - can't start DS1820_FULL, too.\n", name);
 				twinrunning=true;
 				break;
@@ -1619,6 +2129,7 @@ void DRV_StartDriver(const char* name) {
 					g_drivers[i].initFunc();
 				}
 				g_drivers[i].bLoaded = true;
+				DRV_RebuildLists();
 				addLogAdv(LOG_INFO, LOG_FEATURE_MAIN, "Started %s.\n", name);
 				bStarted = 1;
 				break;
@@ -1694,16 +2205,128 @@ void DRV_OnHassDiscovery(const char *topic) {
 	if (DRV_Mutex_Take(100) == false) {
 		return;
 	}
+	for (i = 0; i < g_hassDiscoveryDrivers.count; i++) {
+		g_drivers[g_hassDiscoveryDrivers.items[i]].onHassDiscovery(topic);
+	}
+	DRV_Mutex_Free();
+
+}
+#if ENABLE_DRIVER_INDEX_CACHE
+// Index page part of driver that tells when what it shows has changed,
+// by DRV_MarkIndexDirty, is kept and copied to next requests, so browsers
+// refreshing index and state polls don't format it again. Only after
+// state part is kept, before state one handles form arguments of request.
+// Any command or channel change drops all kept parts, they may show it.
+#define DRV_INDEX_FRAGMENT_MAX		1536
+
+typedef struct drvIndexFragment_s {
+	char* text;
+	int len;
+	int size;
+	// generations and channel state version it was rendered at
+	unsigned int gen;
+	unsigned int globalGen;
+	int stateVersion;
+	// doesn't fit in scratch buffer, rendered each time
+	bool bTooBig;
+} drvIndexFragment_t;
+
+// by index in g_drivers, 0 for drivers that don't mark changes
+static volatile unsigned int g_indexGen[DRV_TABLE_SIZE];
+static volatile unsigned int g_indexGlobalGen = 1;
+static drvIndexFragment_t g_indexFragments[DRV_TABLE_SIZE];
+static char g_indexScratch[DRV_INDEX_FRAGMENT_MAX];
+
+void DRV_MarkIndexDirty(void (*appendFunc)(http_request_t* request, int bPreState)) {
+	int i;
+
+	if (appendFunc == 0) {
+		g_indexGlobalGen++;
+		return;
+	}
+	// one function may serve many drivers, like energy meters
 	for (i = 0; i < g_numDrivers; i++) {
-		if (g_drivers[i].bLoaded) {
-			if (g_drivers[i].onHassDiscovery) {
-				g_drivers[i].onHassDiscovery(topic);
+		if (g_drivers[i].appendInformationToHTTPIndexPage == appendFunc) {
+			if (++g_indexGen[i] == 0) {
+				g_indexGen[i] = 1;
 			}
 		}
 	}
-	DRV_Mutex_Free();
+}
+static void DRV_FreeIndexFragment(int i) {
+	free(g_indexFragments[i].text);
+	memset(&g_indexFragments[i], 0, sizeof(g_indexFragments[i]));
+	g_indexGen[i] = 0;
+}
+static void DRV_RenderIndex(int i, http_request_t* request, int bPreState) {
+#if ENABLE_SYSPERF
+	unsigned int start = SYSPERF_GetTimeUs();
+#endif
+
+	g_drivers[i].appendInformationToHTTPIndexPage(request, bPreState);
+#if ENABLE_SYSPERF
+	PerfStat_Add(&g_indexStats[i], SYSPERF_GetTimeUs() - start);
+#endif
+}
+static void DRV_AppendDriverIndex(int i, http_request_t* request, int bPreState) {
+	drvIndexFragment_t* f = &g_indexFragments[i];
+	unsigned int gen = g_indexGen[i];
+	unsigned int globalGen = g_indexGlobalGen;
+	int stateVersion = CHANNEL_GetStateVersion();
+	http_request_t capture;
+	char* text;
 
+	if (bPreState || gen == 0 || f->bTooBig) {
+		DRV_RenderIndex(i, request, bPreState);
+		return;
+	}
+	if (f->gen == gen && f->globalGen == globalGen && f->stateVersion == stateVersion) {
+		postany(request, f->text, f->len);
+#if ENABLE_SYSPERF
+		g_indexHits[i]++;
+#endif
+		return;
+	}
+	// same as http_captureDriverInfo, fd -1 keeps it in buffer
+	capture = *request;
+	capture.fd = -1;
+	capture.reply = g_indexScratch;
+	capture.replylen = 0;
+	capture.replymaxlen = sizeof(g_indexScratch);
+	DRV_RenderIndex(i, &capture, bPreState);
+	if (capture.replylen >= (int)sizeof(g_indexScratch) - 1) {
+		f->bTooBig = true;
+		DRV_RenderIndex(i, request, bPreState);
+		return;
+	}
+	if (capture.replylen > f->size) {
+		text = (char*)realloc(f->text, capture.replylen);
+		if (text == 0) {
+			postany(request, g_indexScratch, capture.replylen);
+			return;
+		}
+		f->text = text;
+		f->size = capture.replylen;
+	}
+	memcpy(f->text, g_indexScratch, capture.replylen);
+	f->len = capture.replylen;
+	f->gen = gen;
+	f->globalGen = globalGen;
+	f->stateVersion = stateVersion;
+	postany(request, f->text, f->len);
 }
+#if ENABLE_SYSPERF
+void DRV_ForEachIndexStats(void* userData, void (*callback)(const char* name, const perfStat_t* st, unsigned int hits, void* userData)) {
+	int i;
+
+	for (i = 0; i < g_numDrivers; i++) {
+		if (g_indexStats[i].calls || g_indexHits[i]) {
+			callback(g_drivers[i].name, &g_indexStats[i], g_indexHits[i], userData);
+		}
+	}
+}
+#endif
+#endif
 void DRV_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState) {
 	int i, j;
 	int c_active = 0;
@@ -1714,14 +2337,14 @@ void DRV_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	TIME_AppendInformationToHTTPIndexPage(request, bPreState);
 #endif
-	for (i = 0; i < g_numDrivers; i++) {
-		if (g_drivers[i].bLoaded) {
-			c_active++;
-			if (g_drivers[i].appendInformationToHTTPIndexPage) {
-				g_drivers[i].appendInformationToHTTPIndexPage(request, bPreState);
-			}
-		}
+	for (i = 0; i < g_httpIndexDrivers.count; i++) {
+#if ENABLE_DRIVER_INDEX_CACHE
+		DRV_AppendDriverIndex(g_httpIndexDrivers.items[i], request, bPreState);
+#else
+		g_drivers[g_httpIndexDrivers.items[i]].appendInformationToHTTPIndexPage(request, bPreState);
+#endif
 	}
+	c_active = g_loadedDrivers.count;
 	DRV_Mutex_Free();
 
 	if (bPreState == false) {
@@ -1730,16 +2353,14 @@ void DRV_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState
 			j = 0;// printed 0 names so far
 			// generate active drivers list in (  )
 			hprintf255(request, " (");
-			for (i = 0; i < g_numDrivers; i++) {
-				if (g_drivers[i].bLoaded) {
-					// if at least one name printed, add separator
-					if (j != 0) {
-						hprintf255(request, ", ");
-					}
-					hprintf255(request, g_drivers[i].name);
-					// one more name printed
-					j++;
+			for (i = 0; i < g_loadedDrivers.count; i++) {
+				// if at least one name printed, add separator
+				if (j != 0) {
+					hprintf255(request, ", ");
 				}
+				hprintf255(request, g_drivers[g_loadedDrivers.items[i]].name);
+				// one more name printed
+				j++;
 			}
 			hprintf255(request, ")");
 		}
@@ -1748,17 +2369,17 @@ void DRV_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState
 }
 bool DRV_IsMeasuringPower() {
 #ifndef OBK_DISABLE_ALL_DRIVERS
-	return DRV_IsRunning("BL0937") || DRV_IsRunning("BL0942")
-		|| DRV_IsRunning("CSE7766") || DRV_IsRunning("TESTPOWER")
-		|| DRV_IsRunning("BL0942SPI") || DRV_IsRunning("RN8209");
-		// || DRV_IsRunning("HLW8112SPI"); TODO messup ha config if enabled
+	return DRV_IsRunning(DRV_ID_BL0937) || DRV_IsRunning(DRV_ID_BL0942)
+		|| DRV_IsRunning(DRV_ID_CSE7766) || DRV_IsRunning(DRV_ID_TESTPOWER)
+		|| DRV_IsRunning(DRV_ID_BL0942SPI) || DRV_IsRunning(DRV_ID_RN8209);
+		// || DRV_IsRunning(DRV_ID_HLW8112SPI); TODO messup ha config if enabled
 #else
 	return false;
 #endif
 }
 bool DRV_IsMeasuringBattery() {
 #ifndef OBK_DISABLE_ALL_DRIVERS
-	return DRV_IsRunning("Battery");
+	return DRV_IsRunning(DRV_ID_Battery);
 #else
 	return false;
 #endif
@@ -1766,7 +2387,7 @@ bool DRV_IsMeasuringBattery() {
 
 bool DRV_IsSensor() {
 #ifndef OBK_DISABLE_ALL_DRIVERS
-	return DRV_IsRunning("SHT3X") || DRV_IsRunning("CHT83XX") || DRV_IsRunning("SGP") || DRV_IsRunning("AHT2X") || DRV_IsRunning("DS1820") || DRV_IsRunning("DS1820_full");
+	return DRV_IsRunning(DRV_ID_SHT3X) || DRV_IsRunning(DRV_ID_CHT83XX) || DRV_IsRunning(DRV_ID_SGP) || DRV_IsRunning(DRV_ID_AHT2X) || DRV_IsRunning(DRV_ID_DS1820) || DRV_IsRunning(DRV_ID_DS1820_FULL);
 #else
 	return false;
 #endif
@@ -7,6 +7,7 @@
 #include "../logging/logging.h"
 #include "../hal/hal_pins.h"
 #include "drv_max72xx_internal.h"
+#include "drv_spi.h"
 
 #define LSBFIRST 0
 #define MSBFIRST 1
@@ -31,6 +32,7 @@
 
 #define MAX72XX_DELAY
 // #define MAX72XX_DELAY usleep(123);
+#define MAX72XX_SPI_BAUD 5000000
 
 byte *max_buffer = 0;
 int max_buffer_size = 0;
@@ -61,6 +63,28 @@ void PORT_shiftOut(int dataPin, int clockPin, int bitOrder, int val, int totalBy
 }
 
 void SIM_SetMAX7219Pixels(byte *data, int size);
+// spidata is in send order, opcode and data of every device,
+// first device is sent last so it is at the end
+static void MAX72XX_sendFrame(max72XX_t *led) {
+	int i, maxbytes;
+
+	maxbytes = led->maxDevices * 2;
+	MAX72XX_DELAY
+	HAL_PIN_SetOutputValue(led->port_cs, LOW);
+	MAX72XX_DELAY
+	if (led->bUseSPI) {
+		SPI_WriteBytes(led->spidata, maxbytes);
+	}
+	else {
+		for (i = 0; i < maxbytes; i++)
+			PORT_shiftOut(led->port_mosi, led->port_clk, MSBFIRST, led->spidata[i], 1);
+	}
+#if WINDOWS && !LINUX
+	SIM_SetMAX7219Pixels(led->led_status, led->maxDevices);
+#endif
+	MAX72XX_DELAY
+	HAL_PIN_SetOutputValue(led->port_cs, HIGH);
+}
 void MAX72XX_spiTransfer(max72XX_t *led, int adddr, unsigned char opcode, byte datta) {
 	if (led == 0) {
 		return;
@@ -68,23 +92,27 @@ void MAX72XX_spiTransfer(max72XX_t *led, int adddr, unsigned char opcode, byte d
 	int offset, maxbytes;
 	int i;
 
-	offset = adddr * 2;
+	offset = (led->maxDevices - 1 - adddr) * 2;
 	maxbytes = led->maxDevices * 2;
 
 	for (i = 0; i < maxbytes; i++)
 		led->spidata[i] = (byte)0;
-	led->spidata[offset + 1] = opcode;
-	led->spidata[offset] = datta;
-	MAX72XX_DELAY
-	HAL_PIN_SetOutputValue(led->port_cs, LOW);
-	MAX72XX_DELAY
-	for (i = maxbytes; i > 0; i--)
-		PORT_shiftOut(led->port_mosi, led->port_clk, MSBFIRST, led->spidata[i - 1], 1);
-#if WINDOWS && !LINUX
-	SIM_SetMAX7219Pixels(led->led_status, led->maxDevices);
-#endif
-	MAX72XX_DELAY
-	HAL_PIN_SetOutputValue(led->port_cs, HIGH);
+	led->spidata[offset] = opcode;
+	led->spidata[offset + 1] = datta;
+	MAX72XX_sendFrame(led);
+}
+// same row of all devices in one frame
+static void MAX72XX_sendRow(dispFB_t *fb, int row) {
+	max72XX_t *led = (max72XX_t*)fb->user;
+	byte *p;
+	int i;
+
+	p = led->spidata;
+	for (i = led->maxDevices - 1; i >= 0; i--) {
+		*p++ = row + 1;
+		*p++ = led->led_status[i * 8 + row];
+	}
+	MAX72XX_sendFrame(led);
 }
 void MAX72XX_shutdown(max72XX_t *led, int addr, bool b) {
 	if (led == 0) {
@@ -132,6 +160,7 @@ void MAX72XX_clearDisplayAndSend(max72XX_t *led, int addr) {
 		led->led_status[offset + i] = 0;
 		MAX72XX_spiTransfer(led, addr, i + 1, led->led_status[offset + i]);
 	}
+	DispFB_Invalidate(&led->fb);
 }
 
 void MAX72XX_setIntensity(max72XX_t *led, int addr, int intensity) {
@@ -147,6 +176,7 @@ void MAX72XX_free(max72XX_t *led) {
 	if (led == 0) {
 		return;
 	}
+	DispFB_Free(&led->fb);
 	free(led->spidata);
 	free(led->led_status);
 	free(led);
@@ -178,19 +208,7 @@ void MAX72XX_refresh(max72XX_t *led) {
 	if (led == 0) {
 		return;
 	}
-	int i;
-	//int mx;
-	//byte tmp;
-	int offset;
-	int row;
-	for (i = 0; i < led->maxDevices; i++)
-	{
-		for (row = 0; row < 8; row++)
-		{
-			offset = i * 8;
-			MAX72XX_spiTransfer(led, i, row + 1, led->led_status[offset + row]);
-		}
-	}
+	DispFB_Flush(&led->fb);
 }
 byte Byte_ReverseBits(byte num)
 {
@@ -219,8 +237,6 @@ void MAX72XX_setPixel(max72XX_t* led, int x, int y, int b)
 		led->led_status[offset + y] |= mask;
 	else
 		led->led_status[offset + y] &= (byte)(~mask);
-
-	MAX72XX_spiTransfer(led, addr, y + 1, led->led_status[offset + y]);
 }
 void MAX72XX_displayArray(max72XX_t* led, byte *p, int devs, int ofs)
 {
@@ -321,8 +337,6 @@ void MAX72XX_shift(max72XX_t *led, int d) {
 	//        led->led_status[i] =  0xff;
 	//  }
 	  //led->led_status[mx] = tmp;
-	MAX72XX_refresh(led);
-
 }
 void MAX72XX_setLed(max72XX_t *led, int addr, int row, int column, bool state) {
 	if (led == 0) {
@@ -343,7 +357,6 @@ void MAX72XX_setLed(max72XX_t *led, int addr, int row, int column, bool state) {
 		val = ~val;
 		led->led_status[offset + row] = led->led_status[offset + row] & val;
 	}
-	MAX72XX_spiTransfer(led, addr, row + 1, led->led_status[offset + row]);
 }
 void MAX72XX_rotate90CW(max72XX_t *led) {
 	int i;
@@ -396,6 +409,7 @@ void MAX72XX_setupPins(max72XX_t *led, int csi, int clki, int mosii, int maxDevi
 	led->maxDevices = maxDevices;
 	led->spidata = (byte*)malloc(maxDevices * 2);
 	led->led_status = (byte*)malloc(maxDevices * 8);
+	DispFB_Init(&led->fb, led->led_status, 8, 1, maxDevices, 8, MAX72XX_sendRow, led);
 	led->port_cs = csi;
 	led->port_clk = clki;
 	led->port_mosi = mosii;
@@ -406,6 +420,28 @@ void MAX72XX_setupPins(max72XX_t *led, int csi, int clki, int mosii, int maxDevi
 	HAL_PIN_Setup_Output(mosii);
 	HAL_PIN_SetOutputValue(mosii, 0);
 }
+// CS stays on GPIO, clock and data go to hardware SPI pins
+bool MAX72XX_setupSPI(max72XX_t *led) {
+	spi_config_t cfg;
+
+	if (led == 0) {
+		return false;
+	}
+	cfg.role = SPI_ROLE_MASTER;
+	cfg.bit_width = SPI_BIT_WIDTH_8BITS;
+	cfg.polarity = SPI_POLARITY_LOW;
+	cfg.phase = SPI_PHASE_1ST_EDGE;
+	cfg.wire_mode = SPI_3WIRE_MODE;
+	cfg.baud_rate = MAX72XX_SPI_BAUD;
+	cfg.bit_order = SPI_MSB_FIRST;
+	if (SPI_DriverInit() < 0 || OBK_SPI_Init(&cfg) < 0) {
+		addLogAdv(LOG_WARN, LOG_FEATURE_MAIN, "MAX72XX: no hardware SPI, using GPIO");
+		led->bUseSPI = 0;
+		return false;
+	}
+	led->bUseSPI = 1;
+	return true;
+}
 max72XX_t *MAX72XX_alloc() {
 	max72XX_t *ret = (max72XX_t*)malloc(sizeof(max72XX_t));
 	if (ret == 0)
@@ -2,12 +2,18 @@
 // My MAX72XX old library
 // See: https://www.elektroda.pl/rtvforum/viewtopic.php?p=18040628#18040628
 
+#include "drv_display_shared.h"
+
 typedef struct max72XX_s {
 	byte port_clk, port_cs, port_mosi;
 	byte maxDevices;
+	// frames go out through hardware SPI, see MAX72XX_setupSPI
+	byte bUseSPI;
 	unsigned char *spidata;
 	byte *led_status;
 	int scrollCount;
+	// bands are rows, each sent to all chained devices at once
+	dispFB_t fb;
 } max72XX_t;
 
 int MAX72XX_countPixels(max72XX_t *led, bool bOn);
@@ -25,5 +31,6 @@ void MAX72XX_shift(max72XX_t *led,int d);
 void MAX72XX_setLed(max72XX_t *led,int addr, int row, int column, bool state) ;
 void MAX72XX_init(max72XX_t *led);
 void MAX72XX_setupPins(max72XX_t *led, int csi, int clki, int mosii, int maxD);
+bool MAX72XX_setupSPI(max72XX_t *led);
 max72XX_t *MAX72XX_alloc();
 void MAX_FreeBuffer();
@@ -0,0 +1,475 @@
+#include "../new_common.h"
+#include "../new_pins.h"
+#include "../new_cfg.h"
+// Commands register, execution API and cmd tokenizer
+#include "../cmnds/cmd_public.h"
+#include "../logging/logging.h"
+#include "../hal/hal_wifi.h"
+#include "lwip/sockets.h"
+#include "lwip/ip_addr.h"
+#include "lwip/inet.h"
+#include "../httpserver/new_http.h"
+#include "drv_local.h"
+
+#if ENABLE_DRIVER_MDNS
+
+// mDNS responder (RFC 6762) with DNS-SD (RFC 6763), so device is found
+// as soon as something asks, without waiting for periodic announcements.
+// It answers for <host>.local (A) and advertises _http._tcp and _obk._tcp
+// services, the latter with TXT of version, chip and MAC. Records are
+// serialized once, when driver starts or IP changes, and replies are
+// made by copying the ones that match the question, with SRV, TXT and A
+// of PTR answers as additional records. Records are announced twice on
+// start and withdrawn with TTL 0 on stop. There is no probing for name
+// conflicts; short device name should be unique anyway.
+//
+// Queries from port other than 5353 are one-shot (legacy) queries and get
+// unicast reply with their ID, question and TTL of 10 s, others and those
+// asking for unicast reply (QU bit) are answered as multicast and unicast.
+//
+// startDriver MDNS
+
+#define MDNS_PORT				5353
+#define MDNS_MAX_PACKET			768
+#define MDNS_MAX_RECORDS		10
+#define MDNS_RECORDS_SIZE		640
+#define MDNS_MAX_NAME			64
+#define MDNS_TTL_HOST			120
+#define MDNS_TTL_SERVICE		4500
+#define MDNS_TTL_LEGACY			10
+#define MDNS_MAX_RECV_PER_TICK	4
+
+#define MDNS_TYPE_A				1
+#define MDNS_TYPE_PTR			12
+#define MDNS_TYPE_TXT			16
+#define MDNS_TYPE_SRV			33
+#define MDNS_TYPE_ANY			255
+#define MDNS_CLASS_IN			1
+// in question: unicast reply wanted, in record: cache flush
+#define MDNS_CLASS_TOP			0x8000
+
+typedef struct mdnsRecord_s {
+	char name[MDNS_MAX_NAME];
+	unsigned short type;
+	// place in g_mdns_records, TTL is at offset + nameLen + 4
+	unsigned short offset;
+	unsigned short len;
+	unsigned short nameLen;
+	// records that go as additional after this one
+	unsigned short related;
+} mdnsRecord_t;
+
+static const char *mdns_group = "224.0.0.251";
+
+static int g_mdns_socket = -1;
+static int g_mdns_retry = 0;
+static int g_mdns_announce = 0;
+static char g_mdns_ip[20];
+// instance name of services, host is it with .local
+static char g_mdns_label[MDNS_MAX_NAME - 8];
+static char g_mdns_host[MDNS_MAX_NAME];
+static mdnsRecord_t g_mdns_recs[MDNS_MAX_RECORDS];
+static int g_mdns_numRecs = 0;
+static byte g_mdns_records[MDNS_RECORDS_SIZE];
+static int g_mdns_recordsLen = 0;
+static byte g_mdns_packet[MDNS_MAX_PACKET];
+static unsigned int g_mdns_queries = 0;
+static unsigned int g_mdns_replies = 0;
+
+static void MDNS_Put16(byte *p, int v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+static int MDNS_Get16(const byte *p) {
+	return (p[0] << 8) | p[1];
+}
+// dotted name as labels, returns length, 0 if it does not fit
+static int MDNS_PutName(byte *p, int maxLen, const char *name) {
+	const char *dot;
+	int n = 0, l;
+
+	while (*name) {
+		dot = strchr(name, '.');
+		l = dot ? (int)(dot - name) : (int)strlen(name);
+		if (l == 0 || l > 63 || n + l + 2 > maxLen) {
+			return 0;
+		}
+		p[n++] = l;
+		memcpy(p + n, name, l);
+		n += l;
+		name += l;
+		if (*name == '.') {
+			name++;
+		}
+	}
+	p[n++] = 0;
+	return n;
+}
+// name at off into dotted out, follows compression pointers,
+// returns offset after name, -1 if packet is bad
+static int MDNS_ReadName(const byte *pkt, int len, int off, char *out, int outSize) {
+	int end = -1, jumps = 0, n = 0, l;
+
+	while (1) {
+		if (off >= len) {
+			return -1;
+		}
+		l = pkt[off];
+		if (l == 0) {
+			off++;
+			break;
+		}
+		if ((l & 0xC0) == 0xC0) {
+			if (off + 1 >= len || ++jumps > 8) {
+				return -1;
+			}
+			if (end == -1) {
+				end = off + 2;
+			}
+			off = ((l & 0x3F) << 8) | pkt[off + 1];
+			continue;
+		}
+		off++;
+		if (off + l > len || n + l + 1 >= outSize) {
+			return -1;
+		}
+		if (n) {
+			out[n++] = '.';
+		}
+		memcpy(out + n, pkt + off, l);
+		n += l;
+		off += l;
+	}
+	out[n] = 0;
+	return end == -1 ? off : end;
+}
+// returns index of record, -1 if there is no room
+static int MDNS_AddRecord(const char *name, int type, bool bUnique, int ttl, const byte *rdata, int rdlen) {
+	mdnsRecord_t *r;
+	byte *p;
+	int nameLen;
+
+	if (g_mdns_numRecs >= MDNS_MAX_RECORDS) {
+		return -1;
+	}
+	p = g_mdns_records + g_mdns_recordsLen;
+	nameLen = MDNS_PutName(p, MDNS_RECORDS_SIZE - g_mdns_recordsLen, name);
+	if (nameLen == 0 || g_mdns_recordsLen + nameLen + 10 + rdlen > MDNS_RECORDS_SIZE) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_DRV, "MDNS no room for %s", name);
+		return -1;
+	}
+	MDNS_Put16(p + nameLen, type);
+	MDNS_Put16(p + nameLen + 2, MDNS_CLASS_IN | (bUnique ? MDNS_CLASS_TOP : 0));
+	MDNS_Put16(p + nameLen + 4, ttl >> 16);
+	MDNS_Put16(p + nameLen + 6, ttl);
+	MDNS_Put16(p + nameLen + 8, rdlen);
+	memcpy(p + nameLen + 10, rdata, rdlen);
+	r = &g_mdns_recs[g_mdns_numRecs];
+	strcpy_safe(r->name, name, sizeof(r->name));
+	r->type = type;
+	r->offset = g_mdns_recordsLen;
+	r->len = nameLen + 10 + rdlen;
+	r->nameLen = nameLen;
+	r->related = 0;
+	g_mdns_recordsLen += r->len;
+	return g_mdns_numRecs++;
+}
+static int MDNS_AddPTR(const char *name, const char *target) {
+	byte rdata[MDNS_MAX_NAME + 2];
+
+	return MDNS_AddRecord(name, MDNS_TYPE_PTR, false, MDNS_TTL_SERVICE, rdata,
+		MDNS_PutName(rdata, sizeof(rdata), target));
+}
+// PTR, SRV and TXT of one service, txt is list of zero terminated strings
+static void MDNS_AddService(const char *service, const char *instance, const char *txt, int txtCount, int hostRec) {
+	char name[MDNS_MAX_NAME];
+	byte rdata[128];
+	int n, i, l, ptr, srv, rtxt;
+
+	snprintf(name, sizeof(name), "%s.%s", instance, service);
+	ptr = MDNS_AddPTR(service, name);
+	// priority, weight, port, target
+	MDNS_Put16(rdata, 0);
+	MDNS_Put16(rdata + 2, 0);
+	MDNS_Put16(rdata + 4, 80);
+	n = MDNS_PutName(rdata + 6, sizeof(rdata) - 6, g_mdns_host);
+	srv = MDNS_AddRecord(name, MDNS_TYPE_SRV, true, MDNS_TTL_HOST, rdata, n + 6);
+	n = 0;
+	for (i = 0; i < txtCount; i++) {
+		l = strlen(txt);
+		if (n + l + 1 > (int)sizeof(rdata)) {
+			break;
+		}
+		rdata[n++] = l;
+		memcpy(rdata + n, txt, l);
+		n += l;
+		txt += l + 1;
+	}
+	rtxt = MDNS_AddRecord(name, MDNS_TYPE_TXT, true, MDNS_TTL_SERVICE, rdata, n);
+	if (ptr < 0 || srv < 0 || rtxt < 0) {
+		return;
+	}
+	g_mdns_recs[ptr].related = (1 << srv) | (1 << rtxt) | (1 << hostRec);
+	g_mdns_recs[srv].related = 1 << hostRec;
+}
+static void MDNS_BuildRecords() {
+	const char *name = CFG_GetShortDeviceName();
+	char txt[96];
+	char mac[24];
+	uint32_t ip;
+	int i, n, host;
+
+	// host label is letters, digits and hyphens
+	for (i = 0; name[i] && i < (int)sizeof(g_mdns_label) - 1; i++) {
+		g_mdns_label[i] = isalnum((unsigned char)name[i]) ? name[i] : '-';
+	}
+	g_mdns_label[i] = 0;
+	snprintf(g_mdns_host, sizeof(g_mdns_host), "%s.local", g_mdns_label);
+	strcpy_safe(g_mdns_ip, HAL_GetMyIPString(), sizeof(g_mdns_ip));
+	ip = inet_addr(g_mdns_ip);
+
+	g_mdns_numRecs = 0;
+	g_mdns_recordsLen = 0;
+	host = MDNS_AddRecord(g_mdns_host, MDNS_TYPE_A, true, MDNS_TTL_HOST, (const byte*)&ip, 4);
+	if (host < 0) {
+		return;
+	}
+	MDNS_AddService("_http._tcp.local", g_mdns_label, "path=/", 1, host);
+	HAL_GetMACStr(mac);
+	n = snprintf(txt, sizeof(txt), "ver=%s", USER_SW_VER) + 1;
+	n += snprintf(txt + n, sizeof(txt) - n, "chip=%s", PLATFORM_MCU_NAME) + 1;
+	snprintf(txt + n, sizeof(txt) - n, "mac=%s", mac);
+	MDNS_AddService("_obk._tcp.local", g_mdns_label, txt, 3, host);
+	MDNS_AddPTR("_services._dns-sd._udp.local", "_http._tcp.local");
+	MDNS_AddPTR("_services._dns-sd._udp.local", "_obk._tcp.local");
+}
+
+// packet with given answers and additional records (masks of records),
+// question is repeated and TTL lowered when legacy is given
+static int MDNS_BuildPacket(byte *out, int outSize, int answers, int additional, const byte *legacyQuestion, int legacyQuestionLen, int legacyId, int ttl) {
+	mdnsRecord_t *r;
+	int n = 12, counts[2] = { 0, 0 };
+	int pass, i, mask;
+
+	memset(out, 0, 12);
+	if (legacyQuestion) {
+		MDNS_Put16(out, legacyId);
+		if (n + legacyQuestionLen > outSize) {
+			return 0;
+		}
+		memcpy(out + n, legacyQuestion, legacyQuestionLen);
+		n += legacyQuestionLen;
+		MDNS_Put16(out + 4, 1);
+	}
+	// response, authoritative
+	out[2] = 0x84;
+	for (pass = 0; pass < 2; pass++) {
+		mask = pass == 0 ? answers : additional;
+		for (i = 0; i < g_mdns_numRecs; i++) {
+			r = &g_mdns_recs[i];
+			if ((mask & (1 << i)) == 0 || n + r->len > outSize) {
+				continue;
+			}
+			memcpy(out + n, g_mdns_records + r->offset, r->len);
+			if (ttl >= 0) {
+				MDNS_Put16(out + n + r->nameLen + 4, ttl >> 16);
+				MDNS_Put16(out + n + r->nameLen + 6, ttl);
+			}
+			if (legacyQuestion) {
+				// cache flush bit is not for legacy resolvers
+				out[n + r->nameLen + 2] &= 0x7F;
+			}
+			n += r->len;
+			counts[pass]++;
+		}
+	}
+	MDNS_Put16(out + 6, counts[0]);
+	MDNS_Put16(out + 10, counts[1]);
+	return counts[0] ? n : 0;
+}
+
+// reply to query from given port into out, returns its length, 0 when
+// there is nothing to say; *bUnicast is set when reply goes to sender only
+int MDNS_AnswerQuery(const byte *pkt, int len, int fromPort, byte *out, int outSize, bool *bUnicast) {
+	char qname[MDNS_MAX_NAME];
+	int qdcount, q, off, next, qtype, qclass, i;
+	int answers = 0, additional = 0;
+	int firstQuestion = 0, firstQuestionLen = 0;
+	bool bLegacy = fromPort != MDNS_PORT;
+
+	*bUnicast = bLegacy;
+	// queries only, responses of others are not checked for conflicts
+	if (len < 12 || (pkt[2] & 0x80) || (pkt[2] & 0x78)) {
+		return 0;
+	}
+	qdcount = MDNS_Get16(pkt + 4);
+	off = 12;
+	for (q = 0; q < qdcount; q++) {
+		next = MDNS_ReadName(pkt, len, off, qname, sizeof(qname));
+		if (next < 0 || next + 4 > len) {
+			// name too long for any of ours, or bad packet
+			return 0;
+		}
+		qtype = MDNS_Get16(pkt + next);
+		qclass = MDNS_Get16(pkt + next + 2);
+		if (q == 0) {
+			firstQuestion = off;
+			firstQuestionLen = next + 4 - off;
+			*bUnicast = bLegacy || (qclass & MDNS_CLASS_TOP);
+		}
+		off = next + 4;
+		if ((qclass & 0x7FFF) != MDNS_CLASS_IN && (qclass & 0x7FFF) != MDNS_TYPE_ANY) {
+			continue;
+		}
+		for (i = 0; i < g_mdns_numRecs; i++) {
+			if ((qtype == g_mdns_recs[i].type || qtype == MDNS_TYPE_ANY) && !stricmp(g_mdns_recs[i].name, qname)) {
+				answers |= 1 << i;
+			}
+		}
+	}
+	for (i = 0; i < g_mdns_numRecs; i++) {
+		if (answers & (1 << i)) {
+			additional |= g_mdns_recs[i].related;
+		}
+	}
+	additional &= ~answers;
+	if (bLegacy) {
+		// question is copied as it is, so it must not point back into packet
+		for (i = firstQuestion; i < firstQuestion + firstQuestionLen - 4; i += pkt[i] + 1) {
+			if ((pkt[i] & 0xC0) == 0xC0) {
+				return 0;
+			}
+		}
+		return MDNS_BuildPacket(out, outSize, answers, additional, pkt + firstQuestion, firstQuestionLen,
+			MDNS_Get16(pkt), MDNS_TTL_LEGACY);
+	}
+	return MDNS_BuildPacket(out, outSize, answers, additional, 0, 0, 0, -1);
+}
+
+static void MDNS_SendTo(const byte *data, int len, struct sockaddr_in *to) {
+	struct sockaddr_in addr;
+
+	if (g_mdns_socket < 0 || len <= 0) {
+		return;
+	}
+	if (to == 0) {
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = inet_addr(mdns_group);
+		addr.sin_port = htons(MDNS_PORT);
+		to = &addr;
+	}
+	sendto(g_mdns_socket, (const char*)data, len, 0, (struct sockaddr*)to, sizeof(*to));
+}
+// all records, ttl -1 keeps theirs, 0 withdraws them
+static void MDNS_Announce(int ttl) {
+	int len;
+
+	len = MDNS_BuildPacket(g_mdns_packet, sizeof(g_mdns_packet), (1 << g_mdns_numRecs) - 1, 0, 0, 0, 0, ttl);
+	MDNS_SendTo(g_mdns_packet, len, 0);
+}
+static void MDNS_CreateSocket() {
+	struct sockaddr_in addr;
+	struct ip_mreq mreq;
+	int flag = 1;
+
+	g_mdns_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (g_mdns_socket < 0) {
+		g_mdns_socket = -1;
+		addLogAdv(LOG_INFO, LOG_FEATURE_DRV, "MDNS failed to do socket\n");
+		return;
+	}
+	setsockopt(g_mdns_socket, SOL_SOCKET, SO_REUSEADDR, (char*)&flag, sizeof(flag));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(MDNS_PORT);
+	if (bind(g_mdns_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_DRV, "MDNS failed to do bind\n");
+		close(g_mdns_socket);
+		g_mdns_socket = -1;
+		return;
+	}
+	mreq.imr_multiaddr.s_addr = inet_addr(mdns_group);
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (setsockopt(g_mdns_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*)&mreq, sizeof(mreq)) < 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_DRV, "MDNS failed to join multicast\n");
+		close(g_mdns_socket);
+		g_mdns_socket = -1;
+		return;
+	}
+	lwip_fcntl(g_mdns_socket, F_SETFL, O_NONBLOCK);
+	g_mdns_announce = 2;
+}
+
+void DRV_MDNS_RunQuickTick() {
+	struct sockaddr_in addr;
+	socklen_t addrlen;
+	byte query[512];
+	int nbytes, len, i;
+	bool bUnicast;
+
+	if (g_mdns_socket < 0) {
+		return;
+	}
+	for (i = 0; i < MDNS_MAX_RECV_PER_TICK; i++) {
+		addrlen = sizeof(addr);
+		nbytes = recvfrom(g_mdns_socket, (char*)query, sizeof(query), 0, (struct sockaddr*)&addr, &addrlen);
+		if (nbytes <= 0) {
+			break;
+		}
+		g_mdns_queries++;
+		len = MDNS_AnswerQuery(query, nbytes, ntohs(addr.sin_port), g_mdns_packet, sizeof(g_mdns_packet), &bUnicast);
+		if (len == 0) {
+			continue;
+		}
+		g_mdns_replies++;
+		MDNS_SendTo(g_mdns_packet, len, bUnicast ? &addr : 0);
+		// QU question from 5353 also refreshes caches of others
+		if (bUnicast && ntohs(addr.sin_port) == MDNS_PORT) {
+			MDNS_SendTo(g_mdns_packet, len, 0);
+		}
+	}
+}
+void DRV_MDNS_RunEverySecond() {
+	if (!Main_IsConnectedToWiFi()) {
+		return;
+	}
+	if (strcmp(g_mdns_ip, HAL_GetMyIPString())) {
+		MDNS_BuildRecords();
+		g_mdns_announce = 2;
+	}
+	if (g_mdns_socket < 0) {
+		g_mdns_retry--;
+		if (g_mdns_retry <= 0) {
+			g_mdns_retry = 5;
+			MDNS_CreateSocket();
+		}
+		return;
+	}
+	if (g_mdns_announce > 0) {
+		g_mdns_announce--;
+		MDNS_Announce(-1);
+	}
+}
+void DRV_MDNS_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
+	if (bPreState) {
+		return;
+	}
+	hprintf255(request, "<h5>mDNS: %s, %u queries, %u answered</h5>", g_mdns_host, g_mdns_queries, g_mdns_replies);
+}
+void DRV_MDNS_Init() {
+	g_mdns_queries = g_mdns_replies = 0;
+	g_mdns_retry = 0;
+	MDNS_BuildRecords();
+}
+void DRV_MDNS_Shutdown() {
+	if (g_mdns_socket >= 0) {
+		MDNS_Announce(0);
+		close(g_mdns_socket);
+		g_mdns_socket = -1;
+	}
+	g_mdns_ip[0] = 0;
+}
+
+#endif
@@ -0,0 +1,821 @@
+#include "../new_common.h"
+#include "../new_pins.h"
+#include "../logging/logging.h"
+#include "../cmnds/cmd_public.h"
+#include "../httpserver/new_http.h"
+#include "../quicktick.h"
+#include "drv_local.h"
+#include "drv_uart.h"
+#include "drv_modbus.h"
+
+#if ENABLE_DRIVER_MODBUS
+
+// Modbus RTU on UART. As master, driver polls a table of register ranges
+// of slaves into channels. Each entry has own interval and polls are run
+// by deadline from QuickTick; when entry is due, entries of same slave and
+// function that are next to it and due within half of their interval are
+// read with it in one request. Next request goes out as soon as reply is
+// in (UART receive wakes QuickTick) and bus was quiet for 3.5 characters,
+// so busy bus is not left idle waiting for tick.
+// As slave, channels are holding registers, register n is channel n.
+//
+// Modbus_Stats prints per slave counters since last call.
+
+#define MB_MAX_MAPS				24
+#define MB_MAX_SLAVES			16
+#define MB_MAX_WRITES			8
+#define MB_FRAME_MAX			256
+#define MB_RECEIVE_BUFFER_SIZE	512
+#define MB_MAX_READ_REGS		125
+#define MB_MAX_READ_BITS		2000
+#define MB_MAX_WRITE_REGS		123
+// registers nobody asked for that may be read to join two entries
+#define MB_MERGE_GAP			4
+// RTU character with start, parity (or second stop) and stop bits
+#define MB_CHAR_BITS			11
+#define MB_DEFAULT_TIMEOUT_MS	100
+
+enum {
+	MB_TYPE_U16,
+	MB_TYPE_S16,
+	MB_TYPE_U32,
+	MB_TYPE_S32,
+};
+
+typedef struct mbMap_s {
+	byte slave;
+	byte func;
+	byte type;
+	byte count;
+	unsigned short reg;
+	short channel;
+	float scale;
+	int intervalMs;
+	unsigned int due;
+} mbMap_t;
+
+typedef struct mbWrite_s {
+	byte slave;
+	unsigned short reg;
+	unsigned short value;
+} mbWrite_t;
+
+// request on bus, count is registers or bits
+typedef struct mbPoll_s {
+	byte slave;
+	byte func;
+	unsigned short reg;
+	unsigned short count;
+	unsigned int mapMask;
+} mbPoll_t;
+
+static const unsigned short g_mbCrcTable[256] = {
+	0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+	0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+	0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+	0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+	0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+	0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+	0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+	0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+	0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+	0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+	0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+	0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+	0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+	0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+	0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+	0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+	0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+	0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+	0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+	0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+	0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+	0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+	0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+	0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+	0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+	0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+	0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+	0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+	0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+	0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+	0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+	0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+static mbMap_t g_mbMaps[MB_MAX_MAPS];
+static int g_mbNumMaps = 0;
+static mbWrite_t g_mbWrites[MB_MAX_WRITES];
+static int g_mbNumWrites = 0;
+static modbusSlaveStats_t g_mbSlaves[MB_MAX_SLAVES];
+static int g_mbNumSlaves = 0;
+static byte g_mbFrame[MB_FRAME_MAX];
+
+static struct {
+	bool bRunning;
+	int port;
+	int baud;
+	int parity;
+	int initCounter;
+	// 3.5 characters of silence between frames
+	int gapMs;
+	int timeoutMs;
+	// 0 for master
+	byte slaveId;
+	bool bWaiting;
+	mbPoll_t cur;
+	int replyLen;
+	int replyTimeoutMs;
+	unsigned int sentAt;
+	// next request not before that
+	unsigned int idleAt;
+	// slave mode, received bytes and when their count last changed
+	int lastSize;
+	unsigned int lastSizeAt;
+	unsigned int busBytes;
+	unsigned int statsStart;
+} g_mb;
+
+unsigned short Modbus_CRC16(const byte *data, int len) {
+	unsigned short crc = 0xFFFF;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		crc = (crc >> 8) ^ g_mbCrcTable[(crc ^ data[i]) & 0xFF];
+	}
+	return crc;
+}
+static int Modbus_TxMs(int bytes) {
+	return (bytes * MB_CHAR_BITS * 1000 + g_mb.baud - 1) / g_mb.baud;
+}
+static modbusSlaveStats_t *Modbus_FindSlave(int addr, bool bCreate) {
+	modbusSlaveStats_t *s;
+	int i;
+
+	for (i = 0; i < g_mbNumSlaves; i++) {
+		if (g_mbSlaves[i].addr == addr) {
+			return &g_mbSlaves[i];
+		}
+	}
+	if (bCreate == false || g_mbNumSlaves >= MB_MAX_SLAVES) {
+		return 0;
+	}
+	s = &g_mbSlaves[g_mbNumSlaves++];
+	memset(s, 0, sizeof(*s));
+	s->addr = addr;
+	return s;
+}
+const modbusSlaveStats_t *Modbus_GetSlaveStats(int addr) {
+	return Modbus_FindSlave(addr, false);
+}
+int Modbus_GetBusLoad() {
+	unsigned int window = g_timeMs - g_mb.statsStart;
+
+	if (window == 0 || g_mb.baud == 0) {
+		return 0;
+	}
+	return (int)((float)g_mb.busBytes * MB_CHAR_BITS * 1000000.0f / g_mb.baud / window);
+}
+static void Modbus_Flush() {
+	int n = UART_GetDataSizeEx(g_mb.port);
+
+	g_mb.busBytes += n;
+	UART_ConsumeBytesEx(g_mb.port, n);
+}
+static void Modbus_OnUartReceive() {
+	QuickTick_WakeFromISR();
+}
+static void Modbus_SetupPort() {
+	UART_InitUARTEx(g_mb.port, g_mb.baud, g_mb.parity, false);
+	UART_InitReceiveRingBufferEx(g_mb.port, MB_RECEIVE_BUFFER_SIZE);
+	// kept until some other user takes over port, then set up again
+	g_mb.initCounter = UART_GetInitCounterEx(g_mb.port);
+	g_mb.bWaiting = false;
+	UART_SetReceiveNotify(Modbus_OnUartReceive);
+}
+static int Modbus_GetMapRegs(const mbMap_t *m) {
+	if (m->type == MB_TYPE_U32 || m->type == MB_TYPE_S32) {
+		return m->count * 2;
+	}
+	return m->count;
+}
+static bool Modbus_IsBitFunc(int func) {
+	return func == 1 || func == 2;
+}
+
+// adds CRC and sends, reply of replyLen bytes is waited for
+static void Modbus_Send(int len, int replyLen) {
+	unsigned short crc = Modbus_CRC16(g_mbFrame, len);
+	modbusSlaveStats_t *s = Modbus_FindSlave(g_mb.cur.slave, true);
+
+	g_mbFrame[len++] = crc & 0xFF;
+	g_mbFrame[len++] = crc >> 8;
+	UART_SendBytesEx(g_mb.port, g_mbFrame, len);
+	g_mb.busBytes += len;
+	g_mb.sentAt = g_timeMs;
+	g_mb.bWaiting = true;
+	g_mb.replyLen = replyLen;
+	g_mb.replyTimeoutMs = Modbus_TxMs(len) + Modbus_TxMs(replyLen) + g_mb.timeoutMs;
+	if (s) {
+		s->requests++;
+	}
+}
+static void Modbus_ApplyReply(const byte *data) {
+	const mbMap_t *m;
+	unsigned int raw;
+	double val;
+	int i, v, ofs, width;
+
+	for (i = 0; i < g_mbNumMaps; i++) {
+		if ((g_mb.cur.mapMask & (1u << i)) == 0) {
+			continue;
+		}
+		m = &g_mbMaps[i];
+		width = Modbus_GetMapRegs(m) / m->count;
+		for (v = 0; v < m->count; v++) {
+			ofs = m->reg - g_mb.cur.reg + v * width;
+			if (Modbus_IsBitFunc(m->func)) {
+				val = (data[ofs >> 3] >> (ofs & 7)) & 1;
+			}
+			else {
+				raw = (data[ofs * 2] << 8) | data[ofs * 2 + 1];
+				if (width == 2) {
+					raw = (raw << 16) | (data[ofs * 2 + 2] << 8) | data[ofs * 2 + 3];
+				}
+				if (m->type == MB_TYPE_S16) {
+					val = (short)raw;
+				}
+				else if (m->type == MB_TYPE_S32) {
+					val = (int)raw;
+				}
+				else {
+					val = raw;
+				}
+			}
+			val *= m->scale;
+			CHANNEL_Set(m->channel + v, (int)(val >= 0 ? val + 0.5 : val - 0.5), 0);
+		}
+	}
+}
+// 0 while reply is not complete, 1 when request is done with
+static int Modbus_TryReply() {
+	modbusSlaveStats_t *s = Modbus_FindSlave(g_mb.cur.slave, true);
+	int n = UART_GetDataSizeEx(g_mb.port);
+	int len, latency;
+	unsigned short crc = 0;
+
+	// noise or echo before reply
+	while (n > 0 && UART_GetByteEx(g_mb.port, 0) != g_mb.cur.slave) {
+		UART_ConsumeBytesEx(g_mb.port, 1);
+		g_mb.busBytes++;
+		n--;
+	}
+	if (n < 5) {
+		return 0;
+	}
+	UART_PeekIntoEx(g_mb.port, g_mbFrame, 3);
+	if (g_mbFrame[1] == (g_mb.cur.func | 0x80)) {
+		len = 5;
+	}
+	else if (g_mbFrame[1] == g_mb.cur.func && (g_mb.cur.func > 4 || g_mbFrame[2] == g_mb.replyLen - 5)) {
+		len = g_mb.replyLen;
+	}
+	else {
+		len = 0;
+	}
+	if (len && n < len) {
+		return 0;
+	}
+	if (len) {
+		UART_PeekIntoEx(g_mb.port, g_mbFrame, len);
+		crc = Modbus_CRC16(g_mbFrame, len - 2);
+	}
+	if (len == 0 || g_mbFrame[len - 2] != (crc & 0xFF) || g_mbFrame[len - 1] != (crc >> 8)) {
+		ADDLOG_DEBUG(LOG_FEATURE_DRV, "Modbus: bad reply of slave %i, %i bytes", g_mb.cur.slave, n);
+		if (s) {
+			s->crcErrors++;
+		}
+		Modbus_Flush();
+		return 1;
+	}
+	UART_ConsumeBytesEx(g_mb.port, len);
+	g_mb.busBytes += len;
+	if (s == 0) {
+		return 1;
+	}
+	latency = g_timeMs - g_mb.sentAt;
+	s->latencySumMs += latency;
+	if (latency > s->maxLatencyMs) {
+		s->maxLatencyMs = latency;
+	}
+	if (len == 5) {
+		ADDLOG_INFO(LOG_FEATURE_DRV, "Modbus: slave %i function %i register %i exception %i",
+			g_mb.cur.slave, g_mb.cur.func, g_mb.cur.reg, g_mbFrame[2]);
+		s->exceptions++;
+		return 1;
+	}
+	s->replies++;
+	if (g_mb.cur.func <= 4) {
+		Modbus_ApplyReply(g_mbFrame + 3);
+	}
+	return 1;
+}
+static bool Modbus_NextWrite() {
+	mbWrite_t w;
+
+	if (g_mbNumWrites == 0) {
+		return false;
+	}
+	w = g_mbWrites[0];
+	g_mbNumWrites--;
+	memmove(g_mbWrites, g_mbWrites + 1, g_mbNumWrites * sizeof(g_mbWrites[0]));
+	memset(&g_mb.cur, 0, sizeof(g_mb.cur));
+	g_mb.cur.slave = w.slave;
+	g_mb.cur.func = 6;
+	g_mb.cur.reg = w.reg;
+	g_mbFrame[0] = w.slave;
+	g_mbFrame[1] = 6;
+	g_mbFrame[2] = w.reg >> 8;
+	g_mbFrame[3] = w.reg & 0xFF;
+	g_mbFrame[4] = w.value >> 8;
+	g_mbFrame[5] = w.value & 0xFF;
+	Modbus_Send(6, 8);
+	return true;
+}
+// index of entry with earliest deadline, -1 if there are none
+static int Modbus_FindFirstMap() {
+	int i, first = -1;
+
+	for (i = 0; i < g_mbNumMaps; i++) {
+		if (first == -1 || (int)(g_mbMaps[i].due - g_mbMaps[first].due) < 0) {
+			first = i;
+		}
+	}
+	return first;
+}
+static bool Modbus_NextPoll() {
+	mbPoll_t *p = &g_mb.cur;
+	mbMap_t *m;
+	int i, first, start, end, max;
+	bool bAdded;
+
+	first = Modbus_FindFirstMap();
+	if (first == -1 || (int)(g_timeMs - g_mbMaps[first].due) < 0) {
+		return false;
+	}
+	m = &g_mbMaps[first];
+	p->slave = m->slave;
+	p->func = m->func;
+	p->reg = m->reg;
+	p->count = Modbus_GetMapRegs(m);
+	p->mapMask = 1u << first;
+	max = Modbus_IsBitFunc(p->func) ? MB_MAX_READ_BITS : MB_MAX_READ_REGS;
+	// joining one entry may bring next one within gap
+	do {
+		bAdded = false;
+		for (i = 0; i < g_mbNumMaps; i++) {
+			m = &g_mbMaps[i];
+			if ((p->mapMask & (1u << i)) || m->slave != p->slave || m->func != p->func) {
+				continue;
+			}
+			if ((int)(m->due - g_timeMs) > m->intervalMs / 2) {
+				continue;
+			}
+			if (m->reg > p->reg + p->count + MB_MERGE_GAP || p->reg > m->reg + Modbus_GetMapRegs(m) + MB_MERGE_GAP) {
+				continue;
+			}
+			start = m->reg < p->reg ? m->reg : p->reg;
+			end = m->reg + Modbus_GetMapRegs(m);
+			if (end < p->reg + p->count) {
+				end = p->reg + p->count;
+			}
+			if (end - start > max) {
+				continue;
+			}
+			p->reg = start;
+			p->count = end - start;
+			p->mapMask |= 1u << i;
+			bAdded = true;
+		}
+	} while (bAdded);
+	for (i = 0; i < g_mbNumMaps; i++) {
+		if (p->mapMask & (1u << i)) {
+			m = &g_mbMaps[i];
+			m->due += m->intervalMs;
+			// don't catch up after stall
+			if ((int)(g_timeMs - m->due) >= 0) {
+				m->due = g_timeMs + m->intervalMs;
+			}
+		}
+	}
+	g_mbFrame[0] = p->slave;
+	g_mbFrame[1] = p->func;
+	g_mbFrame[2] = p->reg >> 8;
+	g_mbFrame[3] = p->reg & 0xFF;
+	g_mbFrame[4] = p->count >> 8;
+	g_mbFrame[5] = p->count & 0xFF;
+	if (Modbus_IsBitFunc(p->func)) {
+		Modbus_Send(6, 5 + (p->count + 7) / 8);
+	}
+	else {
+		Modbus_Send(6, 5 + p->count * 2);
+	}
+	return true;
+}
+static void Modbus_RunMaster() {
+	modbusSlaveStats_t *s;
+
+	if (g_mb.bWaiting) {
+		if (Modbus_TryReply() == 0) {
+			if ((int)(g_timeMs - g_mb.sentAt) < g_mb.replyTimeoutMs) {
+				return;
+			}
+			ADDLOG_DEBUG(LOG_FEATURE_DRV, "Modbus: slave %i reply timeout, %i bytes",
+				g_mb.cur.slave, UART_GetDataSizeEx(g_mb.port));
+			s = Modbus_FindSlave(g_mb.cur.slave, true);
+			if (s) {
+				s->timeouts++;
+			}
+			Modbus_Flush();
+		}
+		g_mb.bWaiting = false;
+		g_mb.idleAt = g_timeMs + g_mb.gapMs;
+	}
+	if ((int)(g_timeMs - g_mb.idleAt) < 0) {
+		return;
+	}
+	// bytes nobody asked for
+	Modbus_Flush();
+	if (Modbus_NextWrite() == false) {
+		Modbus_NextPoll();
+	}
+}
+
+static int Modbus_SlaveException(int func, int code) {
+	g_mbFrame[1] = func | 0x80;
+	g_mbFrame[2] = code;
+	return 3;
+}
+// request of len bytes in g_mbFrame is replaced by reply, returns its
+// length without CRC
+static int Modbus_SlaveHandle(int len) {
+	int func = g_mbFrame[1];
+	int reg = (g_mbFrame[2] << 8) | g_mbFrame[3];
+	int count = (g_mbFrame[4] << 8) | g_mbFrame[5];
+	int i;
+
+	if (func == 3 || func == 4) {
+		if (count < 1 || count > MB_MAX_READ_REGS) {
+			return Modbus_SlaveException(func, 3);
+		}
+		if (reg + count > CHANNEL_MAX) {
+			return Modbus_SlaveException(func, 2);
+		}
+		g_mbFrame[2] = count * 2;
+		for (i = 0; i < count; i++) {
+			int v = CHANNEL_Get(reg + i);
+			g_mbFrame[3 + i * 2] = (v >> 8) & 0xFF;
+			g_mbFrame[4 + i * 2] = v & 0xFF;
+		}
+		return 3 + count * 2;
+	}
+	if (func == 6) {
+		if (reg >= CHANNEL_MAX) {
+			return Modbus_SlaveException(func, 2);
+		}
+		CHANNEL_Set(reg, (short)count, 0);
+		// reply is echo of request
+		return 6;
+	}
+	if (func == 16) {
+		if (count < 1 || count > MB_MAX_WRITE_REGS || g_mbFrame[6] != count * 2) {
+			return Modbus_SlaveException(func, 3);
+		}
+		if (reg + count > CHANNEL_MAX) {
+			return Modbus_SlaveException(func, 2);
+		}
+		for (i = 0; i < count; i++) {
+			CHANNEL_Set(reg + i, (short)((g_mbFrame[7 + i * 2] << 8) | g_mbFrame[8 + i * 2]), 0);
+		}
+		return 6;
+	}
+	return Modbus_SlaveException(func, 1);
+}
+static void Modbus_RunSlave() {
+	modbusSlaveStats_t *s = Modbus_FindSlave(g_mb.slaveId, true);
+	int n = UART_GetDataSizeEx(g_mb.port);
+	int len, replyLen;
+	bool bQuiet;
+	unsigned short crc;
+
+	if (n != g_mb.lastSize) {
+		g_mb.lastSize = n;
+		g_mb.lastSizeAt = g_timeMs;
+	}
+	bQuiet = (int)(g_timeMs - g_mb.lastSizeAt) >= g_mb.gapMs;
+	while (n >= 8) {
+		UART_PeekIntoEx(g_mb.port, g_mbFrame, 7);
+		if (g_mbFrame[1] == 15 || g_mbFrame[1] == 16) {
+			len = 9 + g_mbFrame[6];
+		}
+		else {
+			len = 8;
+		}
+		if (n < len) {
+			break;
+		}
+		UART_PeekIntoEx(g_mb.port, g_mbFrame, len);
+		crc = Modbus_CRC16(g_mbFrame, len - 2);
+		// reply of other slave or noise, look for frame at next byte
+		if (g_mbFrame[len - 2] != (crc & 0xFF) || g_mbFrame[len - 1] != (crc >> 8)) {
+			UART_ConsumeBytesEx(g_mb.port, 1);
+			g_mb.busBytes++;
+			n--;
+			continue;
+		}
+		UART_ConsumeBytesEx(g_mb.port, len);
+		g_mb.busBytes += len;
+		n -= len;
+		if (g_mbFrame[0] != g_mb.slaveId && g_mbFrame[0] != 0) {
+			continue;
+		}
+		if (s) {
+			s->requests++;
+		}
+		replyLen = Modbus_SlaveHandle(len);
+		// broadcast is not answered
+		if (g_mbFrame[0] == 0) {
+			continue;
+		}
+		if (s) {
+			if (g_mbFrame[1] & 0x80) {
+				s->exceptions++;
+			}
+			else {
+				s->replies++;
+			}
+		}
+		crc = Modbus_CRC16(g_mbFrame, replyLen);
+		g_mbFrame[replyLen++] = crc & 0xFF;
+		g_mbFrame[replyLen++] = crc >> 8;
+		UART_SendBytesEx(g_mb.port, g_mbFrame, replyLen);
+		g_mb.busBytes += replyLen;
+	}
+	// rest of frame that never came
+	if (n > 0 && bQuiet) {
+		if (s) {
+			s->crcErrors++;
+		}
+		Modbus_Flush();
+		n = 0;
+	}
+	g_mb.lastSize = n;
+}
+void Modbus_RunQuickTick() {
+	if (g_mb.bRunning == false) {
+		return;
+	}
+	if (UART_GetInitCounterEx(g_mb.port) != g_mb.initCounter) {
+		Modbus_SetupPort();
+	}
+	if (g_mb.slaveId) {
+		Modbus_RunSlave();
+	}
+	else {
+		Modbus_RunMaster();
+	}
+}
+int Modbus_GetTimeToNextWakeMS() {
+	int first, left, idle;
+
+	if (g_mb.bRunning == false) {
+		return -1;
+	}
+	// receive wakes QuickTick, only end of frame is waited for
+	if (g_mb.slaveId) {
+		return UART_GetDataSizeEx(g_mb.port) ? g_mb.gapMs : -1;
+	}
+	if (g_mb.bWaiting) {
+		left = (int)(g_mb.sentAt + g_mb.replyTimeoutMs - g_timeMs);
+		return left > 0 ? left : 0;
+	}
+	if (g_mbNumWrites) {
+		left = 0;
+	}
+	else {
+		first = Modbus_FindFirstMap();
+		if (first == -1) {
+			return -1;
+		}
+		left = (int)(g_mbMaps[first].due - g_timeMs);
+	}
+	idle = (int)(g_mb.idleAt - g_timeMs);
+	if (idle > left) {
+		left = idle;
+	}
+	return left > 0 ? left : 0;
+}
+
+void Modbus_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
+	const modbusSlaveStats_t *s;
+	int i, load;
+
+	if (bPreState) {
+		return;
+	}
+	load = Modbus_GetBusLoad();
+	if (g_mb.slaveId) {
+		hprintf255(request, "<h5>Modbus slave %i, %i baud, bus load %i.%i%%</h5>",
+			g_mb.slaveId, g_mb.baud, load / 10, load % 10);
+	}
+	else {
+		hprintf255(request, "<h5>Modbus master, %i baud, %i maps, bus load %i.%i%%</h5>",
+			g_mb.baud, g_mbNumMaps, load / 10, load % 10);
+	}
+	for (i = 0; i < g_mbNumSlaves; i++) {
+		s = &g_mbSlaves[i];
+		hprintf255(request, "<h6>Slave %i: %u/%u replies, %u timeouts, %u CRC errors, %u exceptions, latency avg %u ms, max %u ms</h6>",
+			s->addr, s->replies, s->requests, s->timeouts, s->crcErrors, s->exceptions,
+			s->replies ? s->latencySumMs / s->replies : 0, s->maxLatencyMs);
+	}
+}
+void Modbus_Stop() {
+	if (g_mb.bRunning) {
+		UART_SetReceiveNotify(0);
+	}
+	g_mb.bRunning = false;
+	g_mbNumMaps = 0;
+	g_mbNumWrites = 0;
+}
+static int Modbus_ParseType(const char *s) {
+	if (!stricmp(s, "s16")) {
+		return MB_TYPE_S16;
+	}
+	if (!stricmp(s, "u32")) {
+		return MB_TYPE_U32;
+	}
+	if (!stricmp(s, "s32")) {
+		return MB_TYPE_S32;
+	}
+	if (!stricmp(s, "u16")) {
+		return MB_TYPE_U16;
+	}
+	return -1;
+}
+// Modbus_Map [Slave] [Function] [Register] [Count] [FirstChannel] [IntervalMs] [Scale] [Type]
+static commandResult_t CMD_Modbus_Map(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	mbMap_t *m;
+	int max;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 5)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	if (g_mbNumMaps >= MB_MAX_MAPS) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "Modbus: no room for more than %i maps", MB_MAX_MAPS);
+		return CMD_RES_ERROR;
+	}
+	m = &g_mbMaps[g_mbNumMaps];
+	memset(m, 0, sizeof(*m));
+	m->slave = Tokenizer_GetArgInteger(0);
+	m->func = Tokenizer_GetArgInteger(1);
+	m->reg = Tokenizer_GetArgInteger(2);
+	m->count = Tokenizer_GetArgInteger(3);
+	m->channel = Tokenizer_GetArgInteger(4);
+	m->intervalMs = Tokenizer_GetArgIntegerDefault(5, 1000);
+	m->scale = Tokenizer_GetArgFloatDefault(6, 1.0f);
+	m->type = MB_TYPE_U16;
+	if (Tokenizer_GetArgsCount() > 7) {
+		max = Modbus_ParseType(Tokenizer_GetArg(7));
+		if (max < 0) {
+			ADDLOG_ERROR(LOG_FEATURE_CMD, "Modbus: type %s is not u16, s16, u32 or s32", Tokenizer_GetArg(7));
+			return CMD_RES_BAD_ARGUMENT;
+		}
+		m->type = max;
+	}
+	if (Modbus_IsBitFunc(m->func)) {
+		m->type = MB_TYPE_U16;
+		max = MB_MAX_READ_BITS;
+	}
+	else {
+		max = MB_MAX_READ_REGS;
+	}
+	if (m->slave < 1 || m->slave > 247 || m->func < 1 || m->func > 4 || m->count < 1
+		|| Modbus_GetMapRegs(m) > max || m->channel < 0 || m->channel + m->count > CHANNEL_MAX) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	if (m->intervalMs < 1) {
+		m->intervalMs = 1;
+	}
+	m->due = g_timeMs;
+	g_mbNumMaps++;
+	QuickTick_Wake();
+	return CMD_RES_OK;
+}
+// Modbus_Write [Slave] [Register] [Value]
+static commandResult_t CMD_Modbus_Write(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	mbWrite_t *w;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 3)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	if (g_mbNumWrites >= MB_MAX_WRITES) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "Modbus: %i writes already waiting", MB_MAX_WRITES);
+		return CMD_RES_ERROR;
+	}
+	w = &g_mbWrites[g_mbNumWrites];
+	w->slave = Tokenizer_GetArgInteger(0);
+	w->reg = Tokenizer_GetArgInteger(1);
+	w->value = Tokenizer_GetArgInteger(2);
+	if (w->slave < 1 || w->slave > 247) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	g_mbNumWrites++;
+	QuickTick_Wake();
+	return CMD_RES_OK;
+}
+// Modbus_Slave [Id]
+static commandResult_t CMD_Modbus_Slave(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int id;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	id = Tokenizer_GetArgInteger(0);
+	if (id < 0 || id > 247) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	g_mb.slaveId = id;
+	g_mb.bWaiting = false;
+	g_mb.lastSize = 0;
+	g_mbNumSlaves = 0;
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_Modbus_Stats(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	modbusSlaveStats_t *s;
+	int i, load = Modbus_GetBusLoad();
+
+	for (i = 0; i < g_mbNumSlaves; i++) {
+		s = &g_mbSlaves[i];
+		ADDLOG_INFO(LOG_FEATURE_DRV, "Modbus slave %i: %u requests, %u replies, %u timeouts, %u CRC errors, %u exceptions, latency avg %u ms, max %u ms",
+			s->addr, s->requests, s->replies, s->timeouts, s->crcErrors, s->exceptions,
+			s->replies ? s->latencySumMs / s->replies : 0, s->maxLatencyMs);
+	}
+	ADDLOG_INFO(LOG_FEATURE_DRV, "Modbus bus load %i.%i%% over %u ms", load / 10, load % 10, g_timeMs - g_mb.statsStart);
+	g_mbNumSlaves = 0;
+	g_mb.busBytes = 0;
+	g_mb.statsStart = g_timeMs;
+	return CMD_RES_OK;
+}
+// startDriver Modbus [Baud] [Parity] [TimeoutMs]
+// Modbus_Map 1 3 0 10 1 500
+void Modbus_Init() {
+	memset(&g_mb, 0, sizeof(g_mb));
+	g_mb.baud = Tokenizer_GetArgIntegerDefault(1, 9600);
+	g_mb.parity = Tokenizer_GetArgIntegerDefault(2, 0);
+	g_mb.timeoutMs = Tokenizer_GetArgIntegerDefault(3, MB_DEFAULT_TIMEOUT_MS);
+	if (g_mb.baud < 300) {
+		g_mb.baud = 300;
+	}
+	// fixed 1750 us above 19200 baud
+	if (g_mb.baud > 19200) {
+		g_mb.gapMs = 2;
+	}
+	else {
+		g_mb.gapMs = (35 * MB_CHAR_BITS * 100 + g_mb.baud - 1) / g_mb.baud;
+	}
+	g_mb.port = UART_GetSelectedPortIndex();
+	g_mb.statsStart = g_timeMs;
+	g_mb.idleAt = g_timeMs;
+	g_mbNumMaps = 0;
+	g_mbNumWrites = 0;
+	g_mbNumSlaves = 0;
+	g_mb.bRunning = true;
+	Modbus_SetupPort();
+
+	//cmddetail:{"name":"Modbus_Map","args":"[Slave] [Function] [Register] [Count] [FirstChannel] [IntervalMs] [Scale] [Type]",
+	//cmddetail:"descr":"Adds Modbus master poll of Count values from Register of Slave with read Function 1-4 into channels from FirstChannel, every IntervalMs (default 1000). Value is multiplied by Scale (default 1). Type of register values is u16 (default), s16, u32 or s32, 32 bit values take two registers, high word first. Entries of same slave next to each other are read in one request.",
+	//cmddetail:"fn":"CMD_Modbus_Map","file":"driver/drv_modbus.c","requires":"",
+	//cmddetail:"examples":"Modbus_Map 1 4 0 3 1 1000 0.1"}
+	CMD_RegisterCommand("Modbus_Map", CMD_Modbus_Map, NULL);
+	//cmddetail:{"name":"Modbus_Write","args":"[Slave] [Register] [Value]",
+	//cmddetail:"descr":"Writes holding register of Slave with function 6, ahead of waiting polls",
+	//cmddetail:"fn":"CMD_Modbus_Write","file":"driver/drv_modbus.c","requires":"",
+	//cmddetail:"examples":"Modbus_Write 2 100 1"}
+	CMD_RegisterCommand("Modbus_Write", CMD_Modbus_Write, NULL);
+	//cmddetail:{"name":"Modbus_Slave","args":"[Id]",
+	//cmddetail:"descr":"Makes device Modbus slave of given Id, where holding (and input) register n is channel n, read by function 3 or 4, written by 6 or 16. Id 0 goes back to master.",
+	//cmddetail:"fn":"CMD_Modbus_Slave","file":"driver/drv_modbus.c","requires":"",
+	//cmddetail:"examples":"Modbus_Slave 5"}
+	CMD_RegisterCommand("Modbus_Slave", CMD_Modbus_Slave, NULL);
+	//cmddetail:{"name":"Modbus_Stats","args":"",
+	//cmddetail:"descr":"Prints requests, replies, timeouts, CRC errors, exceptions and reply latency of each Modbus slave and bus load since last call.",
+	//cmddetail:"fn":"CMD_Modbus_Stats","file":"driver/drv_modbus.c","requires":"",
+	//cmddetail:"examples":"Modbus_Stats"}
+	CMD_RegisterCommand("Modbus_Stats", CMD_Modbus_Stats, NULL);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../obk_config.h"
+#include "../new_common.h"
+
+#if ENABLE_DRIVER_MODBUS
+
+// CRC of RTU frame, low byte goes first on the wire
+unsigned short Modbus_CRC16(const byte *data, int len);
+
+// counters of one slave since last Modbus_Stats, in slave mode the
+// device itself is the only entry
+typedef struct modbusSlaveStats_s {
+	byte addr;
+	unsigned int requests;
+	unsigned int replies;
+	unsigned int timeouts;
+	unsigned int crcErrors;
+	unsigned int exceptions;
+	// from start of request to whole reply, ms
+	unsigned int latencySumMs;
+	unsigned int maxLatencyMs;
+} modbusSlaveStats_t;
+
+// NULL for slave not seen since last Modbus_Stats
+const modbusSlaveStats_t *Modbus_GetSlaveStats(int addr);
+// time bus was sending since last Modbus_Stats, per mille
+int Modbus_GetBusLoad();
+
+#endif
@@ -7,18 +7,21 @@
 #include "../logging/logging.h"
 #include "../new_pins.h"
 #include "../cmnds/cmd_public.h"
+#include "../mqtt/new_mqtt.h"
 #include "drv_uart.h"
 
 #include "../httpserver/new_http.h"
+#include "drv_neo6m.h"
 
 static unsigned short NEO6M_baudRate = 9600;
 
+// drained every quick tick, so it only has to hold what comes between them
 #define NEO6M_UART_RECEIVE_BUFFER_SIZE 512
 
 
 static char fakelat[12]={0};
 static char fakelong[12]={0};
-static char tempstr[50]; 
+static char tempstr[50];
 
 #include "drv_deviceclock.h"
 static bool setclock2gps=false;
@@ -26,34 +29,80 @@ static bool setclock2gps=false;
 static bool setlatlong2gps=false;
 #endif
 
-
-
-static int H,M,S,SS,DD,MM,YY;
-static float Lat_f,Long_f;
-static char NS,EW;
-static bool gpslocked=false;
 static uint8_t failedTries = 0;
 
+// last fix, taken from sentences with good checksum only
+static neo6mFix_t g_fix;
+// fix being filled by sentence that is still coming
+static neo6mFix_t g_next;
+static neo6mStats_t g_stats;
+// epochs counted at last 5 second check, for update rate
+static unsigned int g_lastEpochs;
+static unsigned int g_lastEpochTime;
+static int g_rate;
+// position is published when it moved that far (m) from last one, 0 is off
+static int g_minDistance = 0;
+static bool g_published;
+static int g_publishedLat, g_publishedLon;
+
+// Receive state. Bytes are fed one by one as they come from UART ring,
+// NMEA fields are decoded to fixed point while read, nothing of sentence
+// is kept but the field that is being read.
+enum {
+	NEO6M_IDLE,
+	// after '$', up to '*'
+	NEO6M_NMEA,
+	// two hex digits after '*'
+	NEO6M_NMEA_CS,
+	// after 0xB5
+	NEO6M_UBX_SYNC,
+	// class, id, length
+	NEO6M_UBX_HEAD,
+	// payload and two checksum bytes
+	NEO6M_UBX_BODY,
+};
 
 enum {
-NMEA_TIME,
-NMEA_LOCK,
-NMEA_LAT,
-NMEA_LAT_DIR,
-NMEA_LONG,
-NMEA_LONG_DIR,
-NMEA_SPEED,
-NMEA_COURSE,
-NMEA_DATE,
-NMEA_MAGVAR,
-NMEA_MAGVAR_DIR,
-NMEA_MODE,
-// parse will stop at *, so not needed during parsing
-//NMEA_STAR,
-//NMEA_CHECKSUM,
-NMEA_WORDS
+	NMEA_SENT_NONE,
+	NMEA_SENT_RMC,
+	NMEA_SENT_GGA,
+	NMEA_SENT_VTG,
+	NMEA_SENT_GSA,
 };
 
+// NMEA 0183 sentence is at most 82 chars
+#define NMEA_MAX_LEN		90
+#define NMEA_FRAC_DIGITS	6
+#define UBX_MAX_LEN			1024
+#define UBX_NAV_PVT_LEN		92
+
+typedef struct nmeaField_s {
+	// digits before and after '.'
+	unsigned int ip;
+	unsigned int fp;
+	byte fd;
+	byte len;
+	bool dot;
+	bool neg;
+	// first char, for one letter fields
+	char c0;
+} nmeaField_t;
+
+static byte g_state;
+static byte g_sentence;
+static byte g_fieldIndex;
+static byte g_nmeaSum;
+static byte g_nmeaLen;
+static byte g_csHave;
+static byte g_csRead;
+static char g_sentenceId[6];
+static nmeaField_t g_field;
+static byte g_ubxHead[4];
+static unsigned short g_ubxLen;
+static unsigned short g_ubxHave;
+static byte g_ubxCkA, g_ubxCkB;
+static byte g_ubxPvt[UBX_NAV_PVT_LEN];
+
 #define LEAP_YEAR(Y)  ((!(Y%4) && (Y%100)) || !(Y%400))
 static const uint8_t DaysMonth[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
 const uint32_t SECS_PER_MIN = 60UL;
@@ -62,7 +111,7 @@ const uint32_t SECS_PER_DAY = 3600UL * 24UL;
 const uint32_t MINS_PER_HOUR = 60UL;
 
 //simple "mktime" replacement to calculate epoch from a date
-// note: as mktime, month are 0-11 (not 1 - 12) 
+// note: as mktime, month are 0-11 (not 1 - 12)
 uint32_t obkmktime(int yr, uint8_t month, uint8_t day, uint8_t hr, uint8_t min, uint8_t sec) {
   // to avoid mktime - this enlarges the image especially for BL602!
   // so calculate seconds from epoch locally
@@ -86,219 +135,536 @@ uint32_t obkmktime(int yr, uint8_t month, uint8_t day, uint8_t hr, uint8_t min,
  return t;
 }
 
+// field value with given count of decimal digits, like 1.01 -> 101 for 2
+static int NMEA_Fixed(const nmeaField_t *f, int digits) {
+	unsigned int fp = f->fp;
+	int fd = f->fd;
+	int i, v;
+
+	for (; fd < digits; fd++) {
+		fp *= 10;
+	}
+	for (; fd > digits; fd--) {
+		fp /= 10;
+	}
+	v = f->ip;
+	for (i = 0; i < digits; i++) {
+		v *= 10;
+	}
+	v += fp;
+	return f->neg ? -v : v;
+}
+// NMEA ddmm.mmmm or dddmm.mmmm to degrees * 10^7
+static int NMEA_Degrees(const nmeaField_t *f) {
+	int minutes = (f->ip % 100) * 100000 + NMEA_Fixed(f, 5) % 100000;
+
+	return (f->ip / 100) * 10000000 + minutes * 100 / 60;
+}
+// fake coordinates replace first chars of real ones, see NEO6M_UART_Init
+static char NMEA_FakeChar(char c) {
+	const char *fake = 0;
 
+	if ((g_sentence == NMEA_SENT_RMC && g_fieldIndex == 3) || (g_sentence == NMEA_SENT_GGA && g_fieldIndex == 2)) {
+		fake = fakelat;
+	}
+	else if ((g_sentence == NMEA_SENT_RMC && g_fieldIndex == 5) || (g_sentence == NMEA_SENT_GGA && g_fieldIndex == 4)) {
+		fake = fakelong;
+	}
+	if (fake && g_field.len < strlen(fake)) {
+		return fake[g_field.len];
+	}
+	return c;
+}
+static void NMEA_AddChar(char c) {
+	nmeaField_t *f = &g_field;
 
-void parseGPS(char *data){
-	if (! data) {
-		ADDLOG_INFO(LOG_FEATURE_DRV, "parseGPS -- no data ! ");
+	if (g_fieldIndex == 0) {
+		if (f->len < sizeof(g_sentenceId) - 1) {
+			g_sentenceId[f->len] = c;
+		}
+		f->len++;
+		return;
+	}
+	c = NMEA_FakeChar(c);
+	if (f->len == 0) {
+		f->c0 = c;
+	}
+	if (f->len < 255) {
+		f->len++;
+	}
+	if (c >= '0' && c <= '9') {
+		if (f->dot) {
+			if (f->fd < NMEA_FRAC_DIGITS) {
+				f->fp = f->fp * 10 + c - '0';
+				f->fd++;
+			}
+		}
+		else if (f->ip < 100000000) {
+			f->ip = f->ip * 10 + c - '0';
+		}
+	}
+	else if (c == '.') {
+		f->dot = true;
+	}
+	else if (c == '-') {
+		f->neg = true;
+	}
+}
+static void NMEA_Time(const nmeaField_t *f) {
+	if (f->len < 6) {
 		return;
 	}
-	char *p = strstr(data, "$GPRMC,");
-	if (p){
-//ADDLOG_INFO(LOG_FEATURE_DRV, "parseGPS  p is not NULL -- data=%s  ## p=%s  .... ",data,p);
-
-	// Data is like "$GPRMC,142953.00,A,5213.00212,N,02101.98018,E,0.105,,200724,,,A*71"
-	// $GPRMC,HHMMSS[.SSS],A,BBBB.BBBB,b,LLLLL.LLLL,l,GG.G,RR.R,DDMMYY,M.M,m,F*PP
-	//
-		// calculate NMEA checksum
-		int NMEACS=103;		// Start with checksum value for "GPRMC," - we don't need to parse it later and strsts makes sure, we have it in string
-		int word=0,letter=0;
-		char Nvalue[NMEA_WORDS][12]={0};
-		gpslocked=0;
-		p+=7 ; // so we are after the "," of $GPRMC, and can start calculation and assignment
-		//ADDLOG_INFO(LOG_FEATURE_DRV, "calculating CS with p=%s \n",p);
-		while (p && p[0] != '*') { 
-			NMEACS ^= p[0];
-			if (p[0] != ','){
-				if (letter < 11 && word < NMEA_WORDS) Nvalue[word][letter++]=p[0];
-				else  {
-					ADDLOG_INFO(LOG_FEATURE_DRV, "parseGPS: OOps, word/letter error!! letter=%i # word=%i  (data=%s)!!!",letter,word,data);
-					return;
-				}	
+	g_next.hour = f->ip / 10000;
+	g_next.minute = (f->ip / 100) % 100;
+	g_next.second = f->ip % 100;
+	g_next.ms = NMEA_Fixed(f, 3) % 1000;
+	g_next.timeValid = true;
+}
+static void NMEA_EndField() {
+	const nmeaField_t *f = &g_field;
+	const char *id = g_sentenceId;
+
+	if (g_fieldIndex == 0) {
+		// talker (GP, GN, GL...) is not checked
+		g_sentence = NMEA_SENT_NONE;
+		if (f->len == 5) {
+			if (!strcmp(id + 2, "RMC")) {
+				g_sentence = NMEA_SENT_RMC;
 			}
-			else {
-				Nvalue[word][letter]=0;
-				word++;
-				letter=0;
+			else if (!strcmp(id + 2, "GGA")) {
+				g_sentence = NMEA_SENT_GGA;
+			}
+			else if (!strcmp(id + 2, "VTG")) {
+				g_sentence = NMEA_SENT_VTG;
+			}
+			else if (!strcmp(id + 2, "GSA")) {
+				g_sentence = NMEA_SENT_GSA;
 			}
-			p++;
 		}
-		// checksum in parsed data
-		int readcs=0; 
-		if (++p) {
-			readcs=(int)strtol(p, NULL, 16);
-		} else  ADDLOG_INFO(LOG_FEATURE_DRV, "parseGPS: OOps, no checksum in data!!");
-
-		if (NMEACS != readcs) {        
-			ADDLOG_WARN(LOG_FEATURE_DRV, "parseGPS:  calculated CS (%2X) !=  read CS (%2X) ! Data might be invalid!\r\n",NMEACS,readcs); 		
-		};
-
-		bool timeread =0, dateread=0;
-		timeread = (sscanf (Nvalue[NMEA_TIME],"%2d%2d%2d.%d",&H,&M,&S,&SS) >=3);
-		dateread = (sscanf (Nvalue[NMEA_DATE],"%2d%2d%2d",&DD,&MM,&YY) ==3);
-		YY+=2000;
-
-		gpslocked=(Nvalue[NMEA_LOCK][0]=='A');
-		if (!gpslocked) {        
-			ADDLOG_WARN(LOG_FEATURE_DRV, "parseGPS: no GPS lock! %s\r\n", timeread && dateread ? "Date/time might be valid." :""); 
-			
-		};
-
-		NS='?';	// otherwise the string will be cut here 
-		if (Nvalue[NMEA_LAT_DIR][0]) NS=Nvalue[NMEA_LAT_DIR][0];
-
-		// NMEA returns degrees as degree and "minutes" of latitude/longitude 
-		// we want it as a decimal representation 
-		// e.g. from input value
-		// 5213.00212 	= 52.216702
-		// ddmm.mmmmm
-		// we would need the minutes 13.00212 to be converted
-		// the result is value / 60
-		// here: 1.03272 / 60 = 0.216702
-
-		float frac;
-		int whole=0;						// need to get tw digits as %2d, using "%2f" will take the whole value as float?!?
-
-		ADDLOG_DEBUG(LOG_FEATURE_DRV,"NEO6M: fakelat=%s  Nvalue[NMEA_LAT]=%s ",fakelat,Nvalue[NMEA_LAT]);		
-		if (*fakelat && strlen(fakelat) <= strlen(Nvalue[NMEA_LAT])) memcpy(Nvalue[NMEA_LAT],fakelat,strlen(fakelat));
-		Lat_f=atof(Nvalue[NMEA_LAT]);
-		whole=(int)(Lat_f/100);
-		Lat_f=(float)whole + (Lat_f - 100*whole)/60;
-
-
-
-		EW='?';	// otherwise the string will be cut here
-		if (Nvalue[NMEA_LONG_DIR][0]) EW=Nvalue[NMEA_LONG_DIR][0];
-
-
-		ADDLOG_DEBUG(LOG_FEATURE_DRV,"NEO6M: fakelong=%s  Nvalue[NMEA_LONG]=%s ",fakelong,Nvalue[NMEA_LONG]);		
-
-		if (*fakelong && strlen(fakelong) <= strlen(Nvalue[NMEA_LONG])) { 
-			memcpy(Nvalue[NMEA_LONG],fakelong,strlen(fakelong));		// note: we will not copy "\0" but ony overwrite (some) numbers...		 
+		return;
+	}
+	switch (g_sentence) {
+	case NMEA_SENT_RMC:
+		// time, status, lat, N/S, long, E/W, knots, course, date
+		switch (g_fieldIndex) {
+		case 1: NMEA_Time(f); break;
+		case 2: g_next.valid = f->c0 == 'A'; break;
+		case 3: if (f->len) g_next.lat = NMEA_Degrees(f); break;
+		case 4: if (f->c0 == 'S') g_next.lat = -g_next.lat; break;
+		case 5: if (f->len) g_next.lon = NMEA_Degrees(f); break;
+		case 6: if (f->c0 == 'W') g_next.lon = -g_next.lon; break;
+		case 7: if (f->len) g_next.speed = NMEA_Fixed(f, 3) * 1852 / 3600; break;
+		case 8: if (f->len) g_next.course = NMEA_Fixed(f, 2); break;
+		case 9:
+			if (f->len == 6) {
+				g_next.day = f->ip / 10000;
+				g_next.month = (f->ip / 100) % 100;
+				g_next.year = 2000 + f->ip % 100;
+				g_next.dateValid = true;
+			}
+			break;
 		}
-		Long_f = atof(Nvalue[NMEA_LONG]);
-		whole = (int)(Long_f/100);
-		Long_f=(float)whole + (Long_f - 100*whole)/60;
-		uint32_t epoch_time=obkmktime(YY,MM-1,DD,H,M,S);
-		tempstr[0]='\0';
-		if (setclock2gps && gpslocked && timeread && dateread){
-			TIME_setDeviceTime(epoch_time);
-//			ADDLOG_INFO(LOG_FEATURE_DRV,"local clock set to UTC time read");
-			strcat(tempstr, "(clock ");
+		break;
+	case NMEA_SENT_GGA:
+		// time, lat, N/S, long, E/W, quality, satellites, HDOP, altitude
+		switch (g_fieldIndex) {
+		case 1: NMEA_Time(f); break;
+		case 2: if (f->len) g_next.lat = NMEA_Degrees(f); break;
+		case 3: if (f->c0 == 'S') g_next.lat = -g_next.lat; break;
+		case 4: if (f->len) g_next.lon = NMEA_Degrees(f); break;
+		case 5: if (f->c0 == 'W') g_next.lon = -g_next.lon; break;
+		case 6: g_next.valid = f->ip > 0; break;
+		case 7: g_next.sats = f->ip; break;
+		case 8: if (f->len) g_next.hdop = NMEA_Fixed(f, 2); break;
+		case 9: if (f->len) g_next.alt = NMEA_Fixed(f, 3); break;
 		}
-#if ENABLE_TIME_SUNRISE_SUNSET
-		if( setlatlong2gps && gpslocked){
-			TIME_setLatitude(Lat_f);
-			TIME_setLongitude(Long_f);
-//			ADDLOG_INFO(LOG_FEATURE_DRV,"latitude set to %f, longitude set to %f",Lat_f, Long_f);
-			strcat(tempstr,tempstr[0]? "and lat/long " : "(lat/log ");
+		break;
+	case NMEA_SENT_VTG:
+		// course, T, magnetic course, M, knots, N, km/h
+		switch (g_fieldIndex) {
+		case 1: if (f->len) g_next.course = NMEA_Fixed(f, 2); break;
+		case 7: if (f->len) g_next.speed = NMEA_Fixed(f, 3) * 10 / 36; break;
 		}
-#endif
-		if (tempstr[0]) strcat(tempstr,"set to GPS data)");
-		ADDLOG_INFO(LOG_FEATURE_DRV, 
-			    "Read GPS DATA:%02i.%02i.%i - %02i:%02i:%02i.%02i (epoch=%u) LAT=%f%c - LONG=%f%c  %s\r\n", DD,MM,YY,H,M,S,SS,epoch_time,Lat_f,NS,Long_f,EW,tempstr);
-
-	p = strstr(++p, "$GPRMC,");
-
-	} else{
-		ADDLOG_INFO(LOG_FEATURE_DRV, "parseGPS:  p is  NULL -- data=%s  .... ",data);
-		failedTries++;
+		break;
+	case NMEA_SENT_GSA:
+		// mode, fix type, 12 satellites, PDOP, HDOP, VDOP
+		switch (g_fieldIndex) {
+		case 2: g_next.fixType = f->ip == 2 || f->ip == 3 ? f->ip : 0; break;
+		case 15: if (f->len) g_next.pdop = NMEA_Fixed(f, 2); break;
+		case 16: if (f->len) g_next.hdop = NMEA_Fixed(f, 2); break;
+		case 17: if (f->len) g_next.vdop = NMEA_Fixed(f, 2); break;
+		}
+		break;
 	}
-//ADDLOG_INFO(LOG_FEATURE_DRV, "... end of parseGPS ");
-
+}
+static void NMEA_StartField() {
+	memset(&g_field, 0, sizeof(g_field));
 }
 
+static int UBX_I32(const byte *p) {
+	return (int)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+// UBX-NAV-PVT, u-blox 8 and newer, has all of it in one message
+static void UBX_NavPvt(const byte *p) {
+	int nano;
+
+	g_next = g_fix;
+	g_next.year = p[4] | (p[5] << 8);
+	g_next.month = p[6];
+	g_next.day = p[7];
+	g_next.hour = p[8];
+	g_next.minute = p[9];
+	g_next.second = p[10];
+	g_next.dateValid = (p[11] & 1) != 0;
+	g_next.timeValid = (p[11] & 2) != 0;
+	nano = UBX_I32(p + 16);
+	g_next.ms = nano > 0 ? nano / 1000000 : 0;
+	// 4 is GNSS with dead reckoning, 5 time only
+	g_next.fixType = p[20] == 2 ? 2 : (p[20] == 3 || p[20] == 4) ? 3 : 0;
+	g_next.valid = (p[21] & 1) != 0;
+	g_next.sats = p[23];
+	g_next.lon = UBX_I32(p + 24);
+	g_next.lat = UBX_I32(p + 28);
+	g_next.alt = UBX_I32(p + 36);
+	g_next.speed = UBX_I32(p + 60);
+	g_next.course = UBX_I32(p + 64) / 1000;
+	g_next.pdop = p[76] | (p[77] << 8);
+}
 
-static int UART_GetNextPacket(void) {
-//ADDLOG_INFO(LOG_FEATURE_DRV, "UART_GetNextPacket - start \r\n");
-	int cs;
-	char data[NEO6M_UART_RECEIVE_BUFFER_SIZE+5]={0};
-	cs = UART_GetDataSize();
-//ADDLOG_INFO(LOG_FEATURE_DRV, "UART_GetNextPacket - cs=%i \r\n",cs);
+// distance in m, flat approximation is enough for distances compared here
+static float NEO6M_Distance(int lat1, int lon1, int lat2, int lon2) {
+	const float degToRad = (float)M_PI / 180.0f;
+	float x, y;
 
-	int i=0;
-	for (i=0; i< cs; i++){
-		data[i]=UART_GetByte(i);
+	x = (float)((long long)lon2 - lon1) * 1e-7f * cosf((lat1 * 0.5e-7f + lat2 * 0.5e-7f) * degToRad);
+	y = (float)(lat2 - lat1) * 1e-7f;
+	return sqrtf(x * x + y * y) * degToRad * 6371000.0f;
+}
+// degrees * 10^7 as decimal, without sign
+static void NEO6M_FormatDegrees(char *out, int size, int v) {
+	if (v < 0) {
+		v = -v;
+	}
+	snprintf(out, size, "%i.%07i", v / 10000000, v % 10000000);
+}
+static void NEO6M_PublishPosition() {
+#if ENABLE_MQTT
+	char lat[16], lon[16];
+	char msg[160];
+
+	NEO6M_FormatDegrees(lat, sizeof(lat), g_fix.lat);
+	NEO6M_FormatDegrees(lon, sizeof(lon), g_fix.lon);
+	snprintf(msg, sizeof(msg), "{\"lat\":%s%s,\"lon\":%s%s,\"alt\":%i,\"speed\":%i,\"course\":%i,\"sats\":%i}",
+		g_fix.lat < 0 ? "-" : "", lat, g_fix.lon < 0 ? "-" : "", lon,
+		g_fix.alt / 1000, g_fix.speed, g_fix.course / 100, g_fix.sats);
+	MQTT_PublishMain_StringString("gps", msg, OBK_PUBLISH_FLAG_QOS_ZERO);
+#endif
+	g_published = true;
+	g_publishedLat = g_fix.lat;
+	g_publishedLon = g_fix.lon;
+}
+static void NEO6M_OnFix() {
+	unsigned int t;
+
+	// RMC and GGA of one epoch have same time
+	t = ((g_fix.hour * 60 + g_fix.minute) * 60 + g_fix.second) * 1000 + g_fix.ms;
+	if (g_fix.timeValid && t != g_lastEpochTime) {
+		g_lastEpochTime = t;
+		g_stats.epochs++;
+	}
+	if (g_fix.valid == false || g_minDistance <= 0) {
+		return;
+	}
+	if (g_published == false
+		|| NEO6M_Distance(g_publishedLat, g_publishedLon, g_fix.lat, g_fix.lon) >= g_minDistance) {
+		NEO6M_PublishPosition();
 	}
-	data[i]=0;
-//ADDLOG_INFO(LOG_FEATURE_DRV, "UART_GetNextPacket  i=%i  - data=%s\r\n",i,data);
-	UART_ConsumeBytes(cs-1);
-	parseGPS(data);
-	return 0;
 }
 
+static void NEO6M_FeedIdle(byte b) {
+	if (b == '$') {
+		g_state = NEO6M_NMEA;
+		g_sentence = NMEA_SENT_NONE;
+		g_fieldIndex = 0;
+		g_nmeaSum = 0;
+		g_nmeaLen = 0;
+		memset(g_sentenceId, 0, sizeof(g_sentenceId));
+		NMEA_StartField();
+		g_next = g_fix;
+	}
+	else if (b == 0xB5) {
+		g_state = NEO6M_UBX_SYNC;
+	}
+}
+static int NEO6M_HexDigit(byte b) {
+	if (b >= '0' && b <= '9') {
+		return b - '0';
+	}
+	if (b >= 'A' && b <= 'F') {
+		return b - 'A' + 10;
+	}
+	if (b >= 'a' && b <= 'f') {
+		return b - 'a' + 10;
+	}
+	return -1;
+}
+static void NEO6M_FeedByte(byte b) {
+	int d;
+
+	switch (g_state) {
+	case NEO6M_IDLE:
+		NEO6M_FeedIdle(b);
+		break;
+	case NEO6M_NMEA:
+		if (b == '*') {
+			NMEA_EndField();
+			g_state = NEO6M_NMEA_CS;
+			g_csHave = 0;
+			g_csRead = 0;
+		}
+		else if (b < 0x20 || b > 0x7E || b == '$' || ++g_nmeaLen > NMEA_MAX_LEN) {
+			// cut sentence, it's dropped and next may start here
+			g_stats.bad++;
+			g_state = NEO6M_IDLE;
+			NEO6M_FeedIdle(b);
+		}
+		else {
+			g_nmeaSum ^= b;
+			if (b == ',') {
+				NMEA_EndField();
+				NMEA_StartField();
+				g_fieldIndex++;
+			}
+			else {
+				NMEA_AddChar(b);
+			}
+		}
+		break;
+	case NEO6M_NMEA_CS:
+		d = NEO6M_HexDigit(b);
+		if (d < 0) {
+			g_stats.bad++;
+			g_state = NEO6M_IDLE;
+			NEO6M_FeedIdle(b);
+			break;
+		}
+		g_csRead = (g_csRead << 4) | d;
+		if (++g_csHave < 2) {
+			break;
+		}
+		g_state = NEO6M_IDLE;
+		if (g_csRead != g_nmeaSum) {
+			g_stats.bad++;
+			break;
+		}
+		g_stats.good++;
+		if (g_sentence != NMEA_SENT_NONE) {
+			g_fix = g_next;
+			NEO6M_OnFix();
+		}
+		break;
+	case NEO6M_UBX_SYNC:
+		if (b == 0x62) {
+			g_state = NEO6M_UBX_HEAD;
+			g_ubxHave = 0;
+			g_ubxCkA = 0;
+			g_ubxCkB = 0;
+		}
+		else {
+			g_state = NEO6M_IDLE;
+			NEO6M_FeedIdle(b);
+		}
+		break;
+	case NEO6M_UBX_HEAD:
+		g_ubxHead[g_ubxHave++] = b;
+		g_ubxCkA += b;
+		g_ubxCkB += g_ubxCkA;
+		if (g_ubxHave < 4) {
+			break;
+		}
+		g_ubxLen = g_ubxHead[2] | (g_ubxHead[3] << 8);
+		g_ubxHave = 0;
+		g_state = g_ubxLen > UBX_MAX_LEN ? NEO6M_IDLE : NEO6M_UBX_BODY;
+		break;
+	case NEO6M_UBX_BODY:
+		if (g_ubxHave < g_ubxLen) {
+			// only NAV-PVT is kept, rest is just checked
+			if (g_ubxHead[0] == 0x01 && g_ubxHead[1] == 0x07 && g_ubxLen == UBX_NAV_PVT_LEN) {
+				g_ubxPvt[g_ubxHave] = b;
+			}
+			g_ubxCkA += b;
+			g_ubxCkB += g_ubxCkA;
+		}
+		else if (g_ubxHave == g_ubxLen) {
+			if (b != g_ubxCkA) {
+				g_stats.bad++;
+				g_state = NEO6M_IDLE;
+			}
+		}
+		else {
+			g_state = NEO6M_IDLE;
+			if (b != g_ubxCkB) {
+				g_stats.bad++;
+				break;
+			}
+			g_stats.ubx++;
+			if (g_ubxHead[0] == 0x01 && g_ubxHead[1] == 0x07 && g_ubxLen == UBX_NAV_PVT_LEN) {
+				UBX_NavPvt(g_ubxPvt);
+				g_fix = g_next;
+				NEO6M_OnFix();
+			}
+		}
+		g_ubxHave++;
+		break;
+	}
+}
 
+// takes all that came, in place from ring memory
+void NEO6M_RunQuickTick() {
+	const byte *p;
+	int i, n;
 
-// send "$EIGPQ,RMC*3A\r\n" to request/poll DATA
-static void UART_WritePollReq(void) {
-    uint8_t send[]="$EIGPQ,RMC*3A\r\n$EIGPQ,RMC*3A\r\n";
-
-    for (int i = 0; i < sizeof(send); i++) {
-        UART_SendByte(send[i]);
-    }
+	while ((n = UART_PeekContiguous(&p)) > 0) {
+		for (i = 0; i < n; i++) {
+			NEO6M_FeedByte(p[i]);
+		}
+		UART_ConsumeBytes(n);
+	}
 }
 
+void NEO6M_GetFix(neo6mFix_t *out) {
+	*out = g_fix;
+}
+void NEO6M_GetStats(neo6mStats_t *out) {
+	*out = g_stats;
+}
 
-/*
- # Disabling all NMEA sentences
-$PUBX,40,GGA,0,0,0,0*5A   // Disable GGA
-$PUBX,40,GLL,0,0,0,0*5C   // Disable GLL
-$PUBX,40,GSA,0,0,0,0*4E   // Disable GSA
-$PUBX,40,GSV,0,0,0,0*59   // Disable GSV
-$PUBX,40,RMC,0,0,0,0*47   // Disable RMC
-$PUBX,40,VTG,0,0,0,0*5E   // Disable VTG
-$PUBX,40,ZDA,0,0,0,0*44   // Disable ZDA
-*/
-static void UART_WriteDisableNMEA(void) {
-    char send[][26]={
-    	"$PUBX,40,GGA,0,0,0,0*5A\r\n",
-    	"$PUBX,40,GGA,0,0,0,0*5A\r\n",
-//    	"$PUBX,40,GGA,0,1,0,0*5B\r\n",   // Enable GGA
-    	"$PUBX,40,GLL,0,0,0,0*5C\r\n",
-    	"$PUBX,40,GSA,0,0,0,0*4E\r\n",
-    	"$PUBX,40,GSV,0,0,0,0*59\r\n",
-//    	"$PUBX,40,RMC,0,0,0,0*47\r\n",   // Disable RMC
-    	"$PUBX,40,RMC,0,1,0,0*46\r\n",   // Enable RMC
-    	"$PUBX,40,VTG,0,0,0,0*5E\r\n",
-    	"$PUBX,40,ZDA,0,0,0,0*44\r\n"
-    	};
-    byte b;
-    for (int i = 0; i < 7; i++) {
-	    for (int j = 0; j < sizeof(send[i]); j++) {
-	    	b = (byte)send[i][j];
-        	UART_SendByte(b);
-            }
-    }
+static void NEO6M_SendBytes(const byte *data, int len) {
+	for (int i = 0; i < len; i++) {
+		UART_SendByte(data[i]);
+	}
+}
+// UBX message with its sync chars and Fletcher checksum
+static void NEO6M_SendUBX(byte cls, byte id, const byte *payload, int len) {
+	byte head[6];
+	byte ck[2] = { 0, 0 };
+	int i;
+
+	head[0] = 0xB5;
+	head[1] = 0x62;
+	head[2] = cls;
+	head[3] = id;
+	head[4] = len;
+	head[5] = len >> 8;
+	for (i = 2; i < 6; i++) {
+		ck[0] += head[i];
+		ck[1] += ck[0];
+	}
+	for (i = 0; i < len; i++) {
+		ck[0] += payload[i];
+		ck[1] += ck[0];
+	}
+	NEO6M_SendBytes(head, 6);
+	NEO6M_SendBytes(payload, len);
+	NEO6M_SendBytes(ck, 2);
+}
+// u-blox PUBX,40 sets how often NMEA sentence is sent on UART, 0 is never
+static void NEO6M_SendPUBX40(const char *msg, int rate) {
+	char send[32];
+	byte sum = 0;
+	int i;
+
+	snprintf(send, sizeof(send), "PUBX,40,%s,0,%i,0,0", msg, rate);
+	for (i = 0; send[i]; i++) {
+		sum ^= send[i];
+	}
+	UART_SendByte('$');
+	NEO6M_SendBytes((const byte*)send, i);
+	snprintf(send, sizeof(send), "*%02X\r\n", sum);
+	NEO6M_SendBytes((const byte*)send, strlen(send));
+}
+// RMC only, or RMC with GGA, GSA and VTG for altitude, satellites and DOP
+static void UART_WriteDisableNMEA(bool bAll) {
+	NEO6M_SendPUBX40("GLL", 0);
+	NEO6M_SendPUBX40("GSV", 0);
+	NEO6M_SendPUBX40("ZDA", 0);
+	NEO6M_SendPUBX40("GGA", bAll);
+	NEO6M_SendPUBX40("GSA", bAll);
+	NEO6M_SendPUBX40("VTG", bAll);
+	NEO6M_SendPUBX40("RMC", 1);
 }
 
 static void UART_Write_SAVE(void) {
-uint8_t cfg_cfg_save_all[] ={ 0xB5,0x62,0x06,0x09,0x0D,0x00,0x00,0x00,0x00,0x00,0xFF,0xFF,0x00,0x00,0x00,0x00,0x00,0x00,0x03,0x1D,0xAB };
-    byte b;
-    for (int j = 0; j < sizeof(cfg_cfg_save_all); j++) {
-    	b = (byte)cfg_cfg_save_all[j];
-       	UART_SendByte(b);
-    }
+	// UBX-CFG-CFG, save all to battery backed RAM and flash
+	static const byte cfg_cfg_save_all[] = { 0x00,0x00,0x00,0x00,0xFF,0xFF,0x00,0x00,0x00,0x00,0x00,0x00,0x03 };
+
+	NEO6M_SendUBX(0x06, 0x09, cfg_cfg_save_all, sizeof(cfg_cfg_save_all));
 }
 
+static void UART_WriteEnableRMC(void) {
+	NEO6M_SendPUBX40("RMC", 1);
+}
 
+// UBX-CFG-RATE, measurement every 1000/hz ms, one solution per measurement, GPS time
+static void NEO6M_SetRate(int hz) {
+	byte payload[6];
+	int ms = 1000 / hz;
+
+	payload[0] = ms;
+	payload[1] = ms >> 8;
+	payload[2] = 1;
+	payload[3] = 0;
+	payload[4] = 1;
+	payload[5] = 0;
+	NEO6M_SendUBX(0x06, 0x08, payload, sizeof(payload));
+}
 
+static commandResult_t CMD_NEO6M_Rate(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int hz;
 
-static void UART_WriteEnableRMC(void) {
-    char send[][26]={
-    	"$PUBX,40,RMC,0,1,0,0*46\r\n",   // Enable RMC
-    	"$PUBX,40,RMC,0,1,0,0*46\r\n"   // Enable RMC
-    	};
-    byte b;
-    for (int i = 0; i < 7; i++) {
-	    for (int j = 0; j < sizeof(send[i]); j++) {
-	    	b = (byte)send[i][j];
-        	UART_SendByte(b);
-            }
-    }
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	hz = Tokenizer_GetArgInteger(0);
+	if (hz < 1 || hz > 10) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	NEO6M_SetRate(hz);
+	if (hz > 1 && NEO6M_baudRate < 38400) {
+		ADDLOG_WARN(LOG_FEATURE_DRV, "NEO6M: %i Hz may not fit in %i baud", hz, NEO6M_baudRate);
+	}
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_NEO6M_MinDistance(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		g_minDistance = Tokenizer_GetArgInteger(0);
+		g_published = false;
+	}
+	ADDLOG_INFO(LOG_FEATURE_DRV, "NEO6M: position published on move of %i m (0 is off)", g_minDistance);
+	return CMD_RES_OK;
 }
 
 static void Init(void) {
-
+	memset(&g_fix, 0, sizeof(g_fix));
+	memset(&g_stats, 0, sizeof(g_stats));
+	g_state = NEO6M_IDLE;
+	g_lastEpochs = 0;
+	g_lastEpochTime = 0xFFFFFFFF;
+	g_rate = 0;
+	g_published = false;
+
+	//cmddetail:{"name":"NEO6M_Rate","args":"[Hz]",
+	//cmddetail:"descr":"Sets how many fixes per second GPS module sends, 1 to 10 (UBX-CFG-RATE). Over 1 Hz needs faster baud than 9600, see startDriver NEO6M <rate>.",
+	//cmddetail:"fn":"CMD_NEO6M_Rate","file":"driver/drv_neo6m.c","requires":"",
+	//cmddetail:"examples":"NEO6M_Rate 5"}
+	CMD_RegisterCommand("NEO6M_Rate", CMD_NEO6M_Rate, NULL);
+	//cmddetail:{"name":"NEO6M_MinDistance","args":"[Meters]",
+	//cmddetail:"descr":"Position is published to MQTT topic gps when it moved that many meters from last published one. 0 (default) turns it off.",
+	//cmddetail:"fn":"CMD_NEO6M_MinDistance","file":"driver/drv_neo6m.c","requires":"",
+	//cmddetail:"examples":"NEO6M_MinDistance 25"}
+	CMD_RegisterCommand("NEO6M_MinDistance", CMD_NEO6M_MinDistance, NULL);
 }
 
 // THIS IS called by 'startDriver NEO6M' command
@@ -307,7 +673,7 @@ void NEO6M_UART_Init(void) {
 	Init();
 	uint8_t temp=Tokenizer_GetArgsCount()-1;
 	const char* arg;
-	const char* fake=NULL;	
+	const char* fake=NULL;
 	NEO6M_baudRate = 9600;	// default value
 #if ENABLE_TIME_SUNRISE_SUNSET
 	setlatlong2gps = false;
@@ -316,15 +682,16 @@ void NEO6M_UART_Init(void) {
 	fakelat[0]='\0';
 	fakelong[0]='\0';
 	bool savecfg=0;
+	bool allnmea=0;
 	for (int i=1; i<=temp; i++) {
 		arg = Tokenizer_GetArg(i);
-		
-		ADDLOG_INFO(LOG_FEATURE_DRV,"NEO6M: argument %i/%i is %s",i,temp,arg);		
+
+		ADDLOG_INFO(LOG_FEATURE_DRV,"NEO6M: argument %i/%i is %s",i,temp,arg);
 
 		if ( arg && !stricmp(arg,"setclock")) {
 		setclock2gps=true;
 		ADDLOG_INFO(LOG_FEATURE_DRV,"NEO6M: setting local clock to UTC time read if GPS is synched");
-		} 
+		}
 		if ( arg && !stricmp(arg,"setlatlong")) {
 #if ENABLE_TIME_SUNRISE_SUNSET
 		setlatlong2gps=true;
@@ -338,88 +705,115 @@ void NEO6M_UART_Init(void) {
 			int i=0;
 			fake += 8;
 //			ADDLOG_INFO(LOG_FEATURE_DRV,"fake=%s fakelat=%s",fake,fakelat);
-			while(fake[i]){
+			while(fake[i] && i < sizeof(fakelat) - 1){
 				fakelat[i]=fake[i];
 				i++;
 			};
 			fakelat[i]='\0';
 			ADDLOG_INFO(LOG_FEATURE_DRV,"NEO6M: fakelat=%s",fakelat);
-		} 
+		}
 		fake=NULL;
 		fake=strstr(arg, "fakelong=");
 		if ( arg && (fake=strstr(arg, "fakelong=")) ) {
 			int i=0;
 			fake +=9;
 //			ADDLOG_INFO(LOG_FEATURE_DRV,"fake=%s fakelong=%s",fake,fakelong);
-			while(fake[i]){
+			while(fake[i] && i < sizeof(fakelong) - 1){
 				fakelong[i]=fake[i];
 				i++;
 			};
 			fakelong[i]='\0';
 			ADDLOG_INFO(LOG_FEATURE_DRV,"NEO6M: fakelong=%s",fakelong);
-		} 
-		
+		}
+
 		fake=NULL;
 		fake=strstr(arg, "savecfg");
 		if ( arg && fake ) {
 			savecfg=1;
-		} 
+		}
+		if ( arg && !stricmp(arg,"allnmea")) {
+			allnmea=1;
+		}
 
 		if (Tokenizer_IsArgInteger(i)){
 			NEO6M_baudRate = Tokenizer_GetArgInteger(i);
 			ADDLOG_INFO(LOG_FEATURE_DRV,"NEO6M: baudrate set to %i",NEO6M_baudRate);
 		}
-	}			
+	}
 	UART_InitUART(NEO6M_baudRate, 0, 0);
 	UART_InitReceiveRingBuffer(NEO6M_UART_RECEIVE_BUFFER_SIZE);
-	UART_WriteDisableNMEA();
+	UART_WriteDisableNMEA(allnmea);
 	if (savecfg) UART_Write_SAVE();
 }
 
 
+// fix is applied to clock and logged every 5 seconds, whatever the rate
+static void NEO6M_ApplyFix(void) {
+	char lat[16], lon[16];
+	uint32_t epoch_time;
 
-
-
-void NEO6M_requestData(void) {
-//ADDLOG_INFO(LOG_FEATURE_DRV, "NEO6M_requestData \r\n");
-    UART_GetNextPacket();
+	if (g_fix.valid == false) {
+		ADDLOG_WARN(LOG_FEATURE_DRV, "NEO6M: no GPS lock! %s\r\n", g_fix.timeValid && g_fix.dateValid ? "Date/time might be valid." : "");
+		return;
+	}
+	epoch_time = obkmktime(g_fix.year, g_fix.month - 1, g_fix.day, g_fix.hour, g_fix.minute, g_fix.second);
+	tempstr[0] = '\0';
+	if (setclock2gps && g_fix.timeValid && g_fix.dateValid) {
+		TIME_setDeviceTime(epoch_time);
+		strcat(tempstr, "(clock ");
+	}
+#if ENABLE_TIME_SUNRISE_SUNSET
+	if (setlatlong2gps) {
+		TIME_setLatitude(g_fix.lat * 1e-7f);
+		TIME_setLongitude(g_fix.lon * 1e-7f);
+		strcat(tempstr, tempstr[0] ? "and lat/long " : "(lat/log ");
+	}
+#endif
+	if (tempstr[0]) strcat(tempstr, "set to GPS data)");
+	NEO6M_FormatDegrees(lat, sizeof(lat), g_fix.lat);
+	NEO6M_FormatDegrees(lon, sizeof(lon), g_fix.lon);
+	ADDLOG_INFO(LOG_FEATURE_DRV,
+		"Read GPS DATA:%02i.%02i.%i - %02i:%02i:%02i.%03i (epoch=%u) LAT=%s%c - LONG=%s%c  %s\r\n",
+		g_fix.day, g_fix.month, g_fix.year, g_fix.hour, g_fix.minute, g_fix.second, g_fix.ms, epoch_time,
+		lat, g_fix.lat < 0 ? 'S' : 'N', lon, g_fix.lon < 0 ? 'W' : 'E', tempstr);
 }
 
-
-
 void NEO6M_UART_RunEverySecond(void) {
-
-	int cs= UART_GetDataSize();
-
-//ADDLOG_INFO(LOG_FEATURE_DRV,"NEO6M_UART_RunEverySecond: UART_GetDataSize() = %i  \r\n",cs);
-
 	if (g_secondsElapsed % 5 == 0) {	// every 5 seconds
-			NEO6M_requestData();
-	}
-	else { 
-		if (cs > 1){
-//ADDLOG_INFO(LOG_FEATURE_DRV, "EO6M_UART_RunEverySecond: UART_ConsumeBytes(%i); \r\n",cs -1);
-			UART_ConsumeBytes(cs -1);	// empty buffer so the old values are not read
+		if (g_stats.epochs == g_lastEpochs) {
+			ADDLOG_INFO(LOG_FEATURE_DRV, "NEO6M: no data (%u bad sentences)", g_stats.bad);
+			failedTries++;
 		}
+		else {
+			NEO6M_ApplyFix();
+			failedTries = 0;
+		}
+		g_rate = (g_stats.epochs - g_lastEpochs + 2) / 5;
+		g_lastEpochs = g_stats.epochs;
 	}
-	if (g_secondsElapsed % 5 == 4) {	// every 5 seconds, one second before requesting data
+	if (g_secondsElapsed % 5 == 4) {	// every 5 seconds, one second before checking data
 		if (failedTries >=5){
 			UART_WriteEnableRMC();	// try to enable NMEA RMC messages, just in case
 			failedTries = 0;
 		}
-// we could also disable all NMEA outpot and only poll the data
-// this will be less serial "traffic", but time is available only on next cycle, so one additional second later
-//ADDLOG_INFO(LOG_FEATURE_DRV, "EO6M_UART_RunEverySecond: calling UART_WritePollReq \r\n");
-//		UART_WritePollReq();
 	}
-
 }
 
 
 void NEO6M_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState)
 {
+	char lat[16], lon[16];
+
 	if (bPreState)
 		return;
-	if (gpslocked) hprintf255(request, "<h5>GPS: %i-%02i-%02iT%02i:%02i:%02i Lat: %f%c Long: %f%c </h5>", YY,MM,DD,H,M,S,Lat_f,NS,Long_f,EW);
+	if (g_fix.valid == false)
+		return;
+	NEO6M_FormatDegrees(lat, sizeof(lat), g_fix.lat);
+	NEO6M_FormatDegrees(lon, sizeof(lon), g_fix.lon);
+	hprintf255(request, "<h5>GPS: %i-%02i-%02iT%02i:%02i:%02i Lat: %s%c Long: %s%c </h5>",
+		g_fix.year, g_fix.month, g_fix.day, g_fix.hour, g_fix.minute, g_fix.second,
+		lat, g_fix.lat < 0 ? 'S' : 'N', lon, g_fix.lon < 0 ? 'W' : 'E');
+	hprintf255(request, "<h5>Alt: %i m, sats: %i, speed: %i.%02i km/h, %i fixes/s</h5>\n",
+		g_fix.alt / 1000, g_fix.sats, g_fix.speed * 36 / 10000, (g_fix.speed * 36 / 100) % 100, g_rate);
 }
 #endif // ENABLE_DRIVER_NEO6M
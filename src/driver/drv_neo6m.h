@@ -1,5 +1,47 @@
 #pragma once
 
+// position in fixed point, from NMEA RMC/GGA/VTG/GSA or UBX NAV-PVT
+typedef struct neo6mFix_s {
+	// degrees * 10^7, south and west negative
+	int lat;
+	int lon;
+	// above mean sea level, mm
+	int alt;
+	// mm/s and degrees * 100
+	int speed;
+	int course;
+	// dilution of precision * 100
+	unsigned short pdop;
+	unsigned short hdop;
+	unsigned short vdop;
+	byte sats;
+	// 0 unknown or none, 2 for 2D, 3 for 3D
+	byte fixType;
+	// RMC status A, GGA quality above 0 or NAV-PVT gnssFixOK
+	bool valid;
+	bool timeValid;
+	bool dateValid;
+	byte hour;
+	byte minute;
+	byte second;
+	unsigned short ms;
+	byte day;
+	byte month;
+	unsigned short year;
+} neo6mFix_t;
+
+typedef struct neo6mStats_s {
+	// NMEA sentences with good and bad checksum, UBX messages
+	unsigned int good;
+	unsigned int bad;
+	unsigned int ubx;
+	// fixes with different time
+	unsigned int epochs;
+} neo6mStats_t;
+
 void NEO6M_UART_Init(void);
 void NEO6M_UART_RunEverySecond(void);
-void NEO6M_AppendInformationToHTTPIndexPage(http_request_t *request);
+void NEO6M_RunQuickTick();
+void NEO6M_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState);
+void NEO6M_GetFix(neo6mFix_t *out);
+void NEO6M_GetStats(neo6mStats_t *out);
@@ -12,9 +12,13 @@
 #include "../httpserver/new_http.h"
 #include "../logging/logging.h"
 #include "../hal/hal_ota.h"
+#include "../quicktick.h"
+#include "lwip/sockets.h"
+#include "lwip/inet.h"
 #include "drv_deviceclock.h"	// for TIME_Init()
 #include "../libraries/obktime/obktime.h"	// for time functions
 #include "drv_ntp.h"
+#include "../logging/ioTrace.h"
 
 #define LOG_FEATURE LOG_FEATURE_NTP
 
@@ -48,17 +52,40 @@ typedef struct
 
 } ntp_packet;              // Total: 384 bits or 48 bytes.
 
-#define MAKE_WORD(hi, lo) hi << 8 | lo
-
 // NTP time since 1900 to unix time (since 1970)
 // Number of seconds to ad
 #define NTP_OFFSET 2208988800L
 
+// SNTP client (RFC 4330). Request goes to configured server, or to next
+// of fallback servers when it does not answer. Reply is checked against
+// request and time of its arrival is taken in QuickTick, so round trip is
+// known to a tick and half of it, less time server held the packet, is
+// added to server time. Result is kept as UTC milliseconds at g_timeMs,
+// NTP_GetCurrentTimeMs counts on from it. Poll interval doubles with each
+// good reply from minimum up to maximum, and goes back to minimum when
+// clock was found off by more than NTP_STEP_MS. Requests that get no
+// reply back off from NTP_RETRY_MIN_S, so lost network is not flooded.
+// Offset found by reply that did not step the clock is error of tick
+// counter rate over time since last one, half of it goes to drift
+// estimate that NTP_GetCurrentTimeMs applies between replies, so clock
+// that is read for timed actions doesn't walk away with long polls.
+//
+// startDriver NTP [MinPollSeconds] [MaxPollSeconds]
+// ntp_servers [ServerIP] [ServerIP] [ServerIP]
+
+#define NTP_PORT				123
+#define NTP_MAX_FALLBACKS		3
+#define NTP_REPLY_TIMEOUT_MS	2000
+// reply is looked for this often while it is awaited
+#define NTP_RECV_POLL_MS		10
+#define NTP_RETRY_MIN_S			8
+#define NTP_STEP_MS				128
+// offsets over shorter time are mostly round trip noise
+#define NTP_DRIFT_MIN_MS		16000
+#define NTP_DRIFT_MAX_PPM		500
+#define NTP_MODE_SERVER			4
+
 static int g_ntp_socket = 0;
-static struct sockaddr_in g_address;
-static int adrLen;
-// in seconds, before next retry
-static int g_ntp_delay = 0;
 static bool g_synced = false;
 // time offset (time zone?) in seconds
 //#define CFG_DEFAULT_TIMEOFFSETSECONDS (-8 * 60 * 60)
@@ -67,6 +94,34 @@ static int g_timeOffsetSeconds = 0;
 // don't use as global variable, use functions to access and manipulate "clock" in "drv_deviceclock.c"
 time_t g_ntpTime;
 static unsigned int g_ntp_syncinterval=60;
+static unsigned int g_ntp_maxPoll = 1024;
+// set by driver, QuickTick does all socket work so it owns the socket
+static bool g_ntp_running = false;
+// set every second, network is up and OTA is not running
+static volatile bool g_ntp_canSend = false;
+static char g_ntp_fallbacks[NTP_MAX_FALLBACKS][32];
+// 0 is server from config, then fallbacks
+static int g_ntp_server = 0;
+// servers that answered with kiss-o'-death DENY or RSTR
+static int g_ntp_denied = 0;
+// seconds between requests, now and after next good reply
+static unsigned int g_ntp_poll;
+// g_timeMs when next request goes, or when awaited reply times out
+static unsigned int g_ntp_due;
+// g_timeMs when request was sent and its transmit stamp, reply echoes it
+static unsigned int g_ntp_sentMs;
+static uint32_t g_ntp_origin_s;
+static uint32_t g_ntp_origin_f;
+// requests without reply since last good one
+static int g_ntp_failures = 0;
+// UTC at g_timeMs of g_ntp_refTick
+static uint32_t g_ntp_refSec;
+static int g_ntp_refMs;
+static unsigned int g_ntp_refTick;
+static int g_ntp_lastOffsetMs = 0;
+static int g_ntp_lastDelayMs = 0;
+// rate error of tick counter, positive when it runs slow
+static int g_ntp_driftPpm = 0;
 
 int NTP_GetTimesZoneOfsSeconds()
 {
@@ -102,9 +157,24 @@ commandResult_t NTP_SetServer(const void *context, const char *cmd, const char *
     return CMD_RES_OK;
 }
 
+//Set fallback NTP servers, tried in order when previous one does not answer
+commandResult_t NTP_SetServers(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int i;
+
+	Tokenizer_TokenizeString(args, 0);
+	for (i = 0; i < NTP_MAX_FALLBACKS; i++) {
+		strcpy_safe(g_ntp_fallbacks[i], i < Tokenizer_GetArgsCount() ? Tokenizer_GetArg(i) : "", sizeof(g_ntp_fallbacks[i]));
+	}
+	g_ntp_denied = 0;
+	addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP fallback servers: %s %s %s", g_ntp_fallbacks[0], g_ntp_fallbacks[1], g_ntp_fallbacks[2]);
+	return CMD_RES_OK;
+}
+
 //Display settings used by the NTP driver
 commandResult_t NTP_Info(const void *context, const char *cmd, const char *args, int cmdFlags) {
     addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "Server=%s, Time offset=%d", CFG_GetNTPServer(), TIME_GetTimesZoneOfsSeconds());
+	addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "Poll %u s (%u..%u), failures %i, last offset %i ms, delay %i ms, drift %i ppm",
+		g_ntp_poll, g_ntp_syncinterval, g_ntp_maxPoll, g_ntp_failures, g_ntp_lastOffsetMs, g_ntp_lastDelayMs, g_ntp_driftPpm);
     return CMD_RES_OK;
 }
 
@@ -116,6 +186,9 @@ void NTP_SetSimulatedTime(unsigned int timeNow) {
 	g_ntpTime += g_timeOffsetSeconds;
 */
 	TIME_setDeviceTime(timeNow);
+	g_ntp_refSec = timeNow;
+	g_ntp_refMs = 0;
+	g_ntp_refTick = g_timeMs;
 #if ENABLE_TIME_DST
 //	g_ntpTime += setDST(0)*60;
 	setDST(0);
@@ -139,22 +212,47 @@ void NTP_Init() {
 	//cmddetail:"fn":"NTP_SetServer","file":"driver/drv_ntp.c","requires":"",
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("ntp_setServer", NTP_SetServer, NULL);
+	//cmddetail:{"name":"ntp_servers","args":"[ServerIP][ServerIP][ServerIP]",
+	//cmddetail:"descr":"Sets up to 3 fallback NTP servers, asked in turn when server set by ntp_setServer does not answer. Without arguments clears them.",
+	//cmddetail:"fn":"NTP_SetServers","file":"driver/drv_ntp.c","requires":"",
+	//cmddetail:"examples":"ntp_servers 162.159.200.1 129.6.15.28"}
+    CMD_RegisterCommand("ntp_servers", NTP_SetServers, NULL);
 	//cmddetail:{"name":"ntp_info","args":"",
-	//cmddetail:"descr":"Display NTP related settings",
+	//cmddetail:"descr":"Display NTP related settings, poll interval and offset and round trip of last reply",
 	//cmddetail:"fn":"NTP_Info","file":"driver/drv_ntp.c","requires":"",
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("ntp_info", NTP_Info, NULL);
+	NTP_Actions_Init();
     
     g_ntp_syncinterval = Tokenizer_GetArgIntegerDefault(1, 60);
+	if (g_ntp_syncinterval < 16) {
+		g_ntp_syncinterval = 16;
+	}
+	g_ntp_maxPoll = Tokenizer_GetArgIntegerDefault(2, 1024);
+	if (g_ntp_maxPoll < g_ntp_syncinterval) {
+		g_ntp_maxPoll = g_ntp_syncinterval;
+	}
 
-    addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP driver initialized with server=%s, offset=%d, syncing every %i seconds", CFG_GetNTPServer(), g_timeOffsetSeconds, g_ntp_syncinterval);
+    addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP driver initialized with server=%s, offset=%d, polling every %i..%i seconds", CFG_GetNTPServer(), g_timeOffsetSeconds, g_ntp_syncinterval, g_ntp_maxPoll);
     g_synced = false;
+	g_ntp_poll = g_ntp_syncinterval;
+	g_ntp_failures = 0;
+	g_ntp_server = 0;
+	g_ntp_denied = 0;
+	g_ntp_driftPpm = 0;
+	g_ntp_due = g_timeMs;
+	g_ntp_running = true;
+	QuickTick_Wake();
 }
 
 // if driver is stopped, we need to make sure, we don't keep NTP in state "synched"
+// socket is closed by next QuickTick
 void NTP_Stop() {
     addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP driver stopped");
+	g_ntp_running = false;
     g_synced = false;
+	NTP_Actions_Clear();
+	QuickTick_Wake();
 }
 
 // just for compatibility 
@@ -164,10 +262,21 @@ unsigned int NTP_GetCurrentTime() {
 unsigned int NTP_GetCurrentTimeWithoutOffset() {
 	return TIME_GetCurrentTimeWithoutOffset();
 }
+uint64_t NTP_GetCurrentTimeMs() {
+	unsigned int passed;
 
+	if (g_synced == false) {
+		return (uint64_t)TIME_GetCurrentTimeWithoutOffset() * 1000;
+	}
+	passed = g_timeMs - g_ntp_refTick;
+	return (uint64_t)g_ntp_refSec * 1000 + g_ntp_refMs + passed
+		+ (int64_t)passed * g_ntp_driftPpm / 1000000;
+}
+int NTP_GetDriftPpm() {
+	return g_ntp_driftPpm;
+}
 
-
-void NTP_Shutdown() {
+static void NTP_Shutdown() {
     if(g_ntp_socket != 0) {
 #if WINDOWS
         closesocket(g_ntp_socket);
@@ -176,187 +285,312 @@ void NTP_Shutdown() {
 #endif
     }
     g_ntp_socket = 0;
-    // can attempt in next 10 seconds
-    g_ntp_delay = g_ntp_syncinterval-1;
 }
-void NTP_SendRequest(bool bBlocking) {
-    byte *ptr;
+static const char *NTP_GetServer(int index) {
 	const char *adrString;
-    //int i, recv_len;
-    //char buf[64];
-    ntp_packet packet = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-
-    adrLen = sizeof(g_address);
-    memset( &packet, 0, sizeof( ntp_packet ) );
-    ptr = (byte*)&packet;
-    // Initialize values needed to form NTP request
-    // (see URL above for details on the packets)
-    ptr[0] = 0xE3;   // LI, Version, Mode
-    ptr[1] = 0;     // Stratum, or type of clock
-    ptr[2] = 6;     // Polling Interval
-    ptr[3] = 0xEC;  // Peer Clock Precision
-    // 8 bytes of zero for Root Delay & Root Dispersion
-    ptr[12]  = 49;
-    ptr[13]  = 0x4E;
-    ptr[14]  = 49;
-    ptr[15]  = 52;
-
-
-    //create a UDP socket
-    if ((g_ntp_socket=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP )) == -1)
-    {
-        g_ntp_socket = 0;
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"NTP_SendRequest: failed to create socket");
-        return;
-    }
-
-    memset((char *) &g_address, 0, sizeof(g_address));
 
+	if (index > 0) {
+		return g_ntp_fallbacks[index - 1];
+	}
 	adrString = CFG_GetNTPServer();
 	if (adrString == 0 || adrString[0] == 0) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_SendRequest: somehow ntp server in config was empty, setting non-empty");
 		CFG_SetNTPServer(DEFAULT_NTP_SERVER);
 		adrString = CFG_GetNTPServer();
 	}
-
-    g_address.sin_family = AF_INET;
-    g_address.sin_addr.s_addr = inet_addr(adrString);
-    g_address.sin_port = htons(123);
-
-
-    // Send the message to server:
-    if(sendto(g_ntp_socket, &packet, sizeof(packet), 0,
-         (struct sockaddr*)&g_address, adrLen) < 0) {
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"NTP_SendRequest: Unable to send message");
-        NTP_Shutdown();
-		// quick next frame attempt
-		if (g_secondsElapsed < 60) {
-			g_ntp_delay = 0;
+	return adrString;
+}
+// next server that is set and did not deny us, config server if none is
+static void NTP_NextServer() {
+	int i, s;
+
+	for (i = 1; i <= NTP_MAX_FALLBACKS + 1; i++) {
+		s = (g_ntp_server + i) % (NTP_MAX_FALLBACKS + 1);
+		if ((g_ntp_denied & (1 << s)) == 0 && NTP_GetServer(s)[0]) {
+			g_ntp_server = s;
+			return;
 		}
-        return;
-    }
+	}
+	g_ntp_server = 0;
+}
+static void NTP_ScheduleIn(unsigned int seconds) {
+	g_ntp_due = g_timeMs + seconds * 1000;
+}
+static bool NTP_SendRequest() {
+	struct sockaddr_in address;
+	byte packet[sizeof(ntp_packet)];
+	const char *adrString;
 
-    // https://github.com/tuya/tuya-iotos-embeded-sdk-wifi-ble-bk7231t/blob/5e28e1f9a1a9d88425f3fd4b658e895a8ee7b83b/platforms/bk7231t/tuya_os_adapter/src/system/tuya_hal_network.c
-    //
-    if(bBlocking == false) {
-#if WINDOWS
-#else
-        if(fcntl(g_ntp_socket, F_SETFL, O_NONBLOCK)) {
-            addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"NTP_SendRequest: failed to make socket non-blocking!");
-        }
-#endif
-    }
+	memset(packet, 0, sizeof(packet));
+	// Initialize values needed to form NTP request
+	// (see URL above for details on the packets)
+	packet[0] = 0xE3;   // LI, Version, Mode
+	packet[1] = 0;     // Stratum, or type of clock
+	packet[2] = 6;     // Polling Interval
+	packet[3] = 0xEC;  // Peer Clock Precision
+	// 8 bytes of zero for Root Delay & Root Dispersion
+	packet[12] = 49;
+	packet[13] = 0x4E;
+	packet[14] = 49;
+	packet[15] = 52;
+	// transmit stamp is only a nonce, server gives it back as originate
+	g_ntp_origin_s = rand() ^ (g_timeMs << 8);
+	g_ntp_origin_f = rand() ^ g_secondsElapsed;
+	packet[40] = g_ntp_origin_s >> 24;
+	packet[41] = g_ntp_origin_s >> 16;
+	packet[42] = g_ntp_origin_s >> 8;
+	packet[43] = g_ntp_origin_s;
+	packet[44] = g_ntp_origin_f >> 24;
+	packet[45] = g_ntp_origin_f >> 16;
+	packet[46] = g_ntp_origin_f >> 8;
+	packet[47] = g_ntp_origin_f;
+
+	adrString = NTP_GetServer(g_ntp_server);
+	memset((char *)&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = inet_addr(adrString);
+	address.sin_port = htons(NTP_PORT);
+	if (address.sin_addr.s_addr == INADDR_NONE) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_SendRequest: %s is not an IP address", adrString);
+		return false;
+	}
 
-    // can attempt in next 10 seconds
-    g_ntp_delay = 10;
+	//create a UDP socket
+	if ((g_ntp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+	{
+		g_ntp_socket = 0;
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_SendRequest: failed to create socket");
+		return false;
+	}
+	lwip_fcntl(g_ntp_socket, F_SETFL, O_NONBLOCK);
+	// connected, so replies from other addresses are not seen
+	if (connect(g_ntp_socket, (struct sockaddr*)&address, sizeof(address)) < 0
+		|| send(g_ntp_socket, (const char*)packet, sizeof(packet), 0) < 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP_SendRequest: Unable to send message");
+		NTP_Shutdown();
+		return false;
+	}
+	g_ntp_sentMs = g_timeMs;
+	g_ntp_due = g_timeMs + NTP_REPLY_TIMEOUT_MS;
+	return true;
 }
-void NTP_CheckForReceive() {
-    byte *ptr;
-    int i, recv_len;
-    //struct tm * ptm;
-    unsigned short highWord;
-    unsigned short lowWord;
-    unsigned int secsSince1900;
-    struct tm *ltm;
-    ntp_packet packet = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
-    ptr = (byte*)&packet;
-
-    // Receive the server's response:
-    i = sizeof(packet);
-#if 0
-    recv_len = recvfrom(g_ntp_socket, ptr, i, 0,
-         (struct sockaddr*)&g_address, &adrLen);
-#else
-    recv_len = recv(g_ntp_socket, ptr, i, 0);
+static uint32_t NTP_Read32(const byte *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+// NTP fraction of a second to milliseconds
+static int NTP_FracToMs(uint32_t f) {
+	return (int)(((uint64_t)f * 1000) >> 32);
+}
+// request got no reply or reply was useless
+static void NTP_OnFailure() {
+	unsigned int retry;
+
+	g_ntp_failures++;
+	NTP_NextServer();
+	// each server in turn quickly, then back off
+	retry = NTP_RETRY_MIN_S;
+	if (g_ntp_failures > NTP_MAX_FALLBACKS + 1) {
+		retry <<= (g_ntp_failures - NTP_MAX_FALLBACKS - 1) < 8 ? (g_ntp_failures - NTP_MAX_FALLBACKS - 1) : 8;
+	}
+	if (retry > g_ntp_maxPoll) {
+		retry = g_ntp_maxPoll;
+	}
+	NTP_ScheduleIn(retry);
+}
+// reply arrived at g_timeMs, returns false if it does not answer our request
+static bool NTP_ProcessReply(const byte *p, int len) {
+	uint32_t rx_s, tx_s;
+	int rx_ms, tx_ms, held, delay, offset;
+	unsigned int rtt, elapsed;
+	uint64_t before, now;
+
+	if (len < (int)sizeof(ntp_packet) || (p[0] & 7) != NTP_MODE_SERVER
+		|| NTP_Read32(p + 24) != g_ntp_origin_s || NTP_Read32(p + 28) != g_ntp_origin_f) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP reply does not match request");
+		return false;
+	}
+	// kiss-o'-death, code is in reference id
+	if (p[1] == 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP server %s says %c%c%c%c", NTP_GetServer(g_ntp_server), p[12], p[13], p[14], p[15]);
+		if (!memcmp(p + 12, "RATE", 4)) {
+			g_ntp_poll = g_ntp_poll * 2 < g_ntp_maxPoll ? g_ntp_poll * 2 : g_ntp_maxPoll;
+		}
+		else if (!memcmp(p + 12, "DENY", 4) || !memcmp(p + 12, "RSTR", 4)) {
+			g_ntp_denied |= 1 << g_ntp_server;
+		}
+		NTP_OnFailure();
+		return true;
+	}
+	rx_s = NTP_Read32(p + 32);
+	rx_ms = NTP_FracToMs(NTP_Read32(p + 36));
+	tx_s = NTP_Read32(p + 40);
+	tx_ms = NTP_FracToMs(NTP_Read32(p + 44));
+	if (tx_s == 0 || (p[0] >> 6) == 3) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP server %s is not synchronized", NTP_GetServer(g_ntp_server));
+		NTP_OnFailure();
+		return true;
+	}
+	// round trip less time packet spent in server
+	rtt = g_timeMs - g_ntp_sentMs;
+	held = (int)(tx_s - rx_s) * 1000 + tx_ms - rx_ms;
+	delay = (int)rtt - held;
+	if (delay < 0) {
+		delay = 0;
+	}
+	before = NTP_GetCurrentTimeMs();
+	elapsed = g_timeMs - g_ntp_refTick;
+	g_ntp_refTick = g_timeMs;
+	g_ntp_refSec = tx_s - NTP_OFFSET;
+	g_ntp_refMs = tx_ms + delay / 2;
+	g_ntp_refSec += g_ntp_refMs / 1000;
+	g_ntp_refMs %= 1000;
+	now = NTP_GetCurrentTimeMs();
+	offset = (int)(now - before);
+	g_ntp_lastDelayMs = delay;
+
+	TIME_setDeviceTime(g_ntp_refSec);
+#if ENABLE_IO_TRACE
+	if (g_ioTraceMode) {
+		IOTrace_Ntp(g_ntp_refSec);
+	}
 #endif
-
-    if(recv_len < 0){
-			addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"NTP_CheckForReceive: Error while receiving server's msg");
-        return;
-    }
-    highWord = MAKE_WORD(ptr[40], ptr[41]);
-    lowWord = MAKE_WORD(ptr[42], ptr[43]);
-    // combine the four bytes (two words) into a long integer
-    // this is NTP time (seconds since Jan 1 1900):
-    secsSince1900 = highWord << 16 | lowWord;
-    addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"Seconds since Jan 1 1900 = %u",secsSince1900);
-
-/*
-    g_ntpTime = secsSince1900 - NTP_OFFSET;
-    g_ntpTime += g_timeOffsetSeconds;
-*/
-   TIME_setDeviceTime((uint32_t) (secsSince1900 - NTP_OFFSET) );
-//    g_ntpTime=(time_t)TIME_GetCurrentTime();
-    addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"Unix time  : %u - local Time %s",(uint32_t) (secsSince1900 - NTP_OFFSET),TS2STR(TIME_GetCurrentTime(),TIME_FORMAT_LONG));
-//    ltm = gmtime(&g_ntpTime);
-//    addLogAdv(LOG_INFO, LOG_FEATURE_NTP, LTSTR, LTM2TIME(ltm));
+	addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "Unix time  : %u.%03i (delay %i ms) - local Time %s",
+		g_ntp_refSec, g_ntp_refMs, delay, TS2STR(TIME_GetCurrentTime(), TIME_FORMAT_LONG));
 
 	if (g_synced == false) {
+		g_ntp_lastOffsetMs = 0;
+		g_synced = true;
 		EventHandlers_FireEvent(CMD_EVENT_NTP_STATE, 1);
 		// so now clock is synced. If it wasn't set before, start "TIME_Init()" for timed events
 		// done in CMD_Init_Delayed()  in cmd_main.c
-//		if (! TIME_IsTimeSynced() ) TIME_Init();
-	}
-    g_synced = true;
-#if 0
-    //ptm = gmtime (&g_ntpTime);
-    ptm = gmtime(&g_ntpTime);
-    if(ptm == 0) {
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime somehow returned 0\n");
-    } else {
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime => tm_year: %i\n",ptm->tm_year);
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime => tm_mon: %i\n",ptm->tm_mon);
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime => tm_mday: %i\n",ptm->tm_mday);
-        addLogAdv(LOG_INFO, LOG_FEATURE_NTP,"gmtime => tm_hour: %i\n",ptm->tm_hour  );
-    }
-#endif
-    NTP_Shutdown();
-
+		g_ntp_poll = g_ntp_syncinterval;
+	}
+	else {
+		g_ntp_lastOffsetMs = offset;
+		if (offset > NTP_STEP_MS || offset < -NTP_STEP_MS) {
+			g_ntp_poll = g_ntp_syncinterval;
+		}
+		else {
+			if (elapsed >= NTP_DRIFT_MIN_MS) {
+				g_ntp_driftPpm += (int)((int64_t)offset * 1000000 / (int64_t)elapsed / 2);
+				if (g_ntp_driftPpm > NTP_DRIFT_MAX_PPM) {
+					g_ntp_driftPpm = NTP_DRIFT_MAX_PPM;
+				}
+				if (g_ntp_driftPpm < -NTP_DRIFT_MAX_PPM) {
+					g_ntp_driftPpm = -NTP_DRIFT_MAX_PPM;
+				}
+			}
+			g_ntp_poll = g_ntp_poll * 2 <= g_ntp_maxPoll ? g_ntp_poll * 2 : g_ntp_maxPoll;
+		}
+	}
+	g_ntp_failures = 0;
+	NTP_ScheduleIn(g_ntp_poll);
+	return true;
 }
-
-void NTP_SendRequest_BlockingMode() {
-    NTP_Shutdown();
-    NTP_SendRequest(true);
-    NTP_CheckForReceive();
-
+static void NTP_CheckForReceive() {
+	byte packet[sizeof(ntp_packet) + 16];
+	int recv_len;
+
+	// Receive the server's response:
+	recv_len = recv(g_ntp_socket, (char*)packet, sizeof(packet), 0);
+	if (recv_len < 0) {
+		// nothing yet, or error; both wait for timeout
+		return;
+	}
+	if (NTP_ProcessReply(packet, recv_len)) {
+		NTP_Shutdown();
+	}
 }
 
 void NTP_OnEverySecond()
 {
-
-    if(Main_IsConnectedToWiFi()==0)
-    {
-        return;
-    }
+	g_ntp_canSend = Main_IsConnectedToWiFi() && OTA_GetProgress() == -1;
 #if WINDOWS
 	if (b_ntp_simulatedTime) {
-		return;
+		g_ntp_canSend = false;
 	}
 #endif
-    if (OTA_GetProgress() != -1)
-    {
-        return;
-    }
-    if(g_ntp_socket == 0) {
-        // if no socket, this is a reconnect delay
-        if(g_ntp_delay > 0) {
-            g_ntp_delay--;
-            return;
-        }
-        NTP_SendRequest(false);
-    } else {
-        NTP_CheckForReceive();
-        // if socket exists, this is a disconnect timeout
-        if(g_ntp_delay > 0) {
-            g_ntp_delay--;
-            if(g_ntp_delay<=0) {
-                // disconnect and force reconnect
-                NTP_Shutdown();
-            }
-        }
-    }
 }
 
+// called from DRV_RunQuickTick, whether driver runs or not
+void NTP_RunQuickTick() {
+	NTP_Actions_RunQuickTick();
+	if (g_ntp_running == false) {
+		NTP_Shutdown();
+		return;
+	}
+	if (g_ntp_socket != 0) {
+		NTP_CheckForReceive();
+		if (g_ntp_socket != 0 && (int)(g_timeMs - g_ntp_due) >= 0) {
+			addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "NTP server %s did not answer", NTP_GetServer(g_ntp_server));
+			NTP_Shutdown();
+			NTP_OnFailure();
+		}
+		return;
+	}
+	if ((int)(g_timeMs - g_ntp_due) < 0) {
+		return;
+	}
+	if (g_ntp_canSend == false) {
+		NTP_ScheduleIn(1);
+		return;
+	}
+	if (NTP_SendRequest() == false) {
+		NTP_OnFailure();
+	}
+	// clock is counted from reference, move it before g_timeMs distance wraps
+	if (g_synced && g_timeMs - g_ntp_refTick > 24 * 60 * 60 * 1000) {
+		uint64_t now = NTP_GetCurrentTimeMs();
+		g_ntp_refTick = g_timeMs;
+		g_ntp_refSec = (uint32_t)(now / 1000);
+		g_ntp_refMs = (int)(now % 1000);
+	}
+}
+int NTP_GetTimeToNextWakeMS() {
+	int left, action;
+
+	action = NTP_Actions_GetTimeToNextWakeMS();
+	if (g_ntp_socket != 0) {
+		left = NTP_RECV_POLL_MS;
+	}
+	else if (g_ntp_running == false) {
+		return action;
+	}
+	else {
+		left = g_ntp_due - g_timeMs;
+		if (left < 0) {
+			left = 0;
+		}
+	}
+	return (action != -1 && action < left) ? action : left;
+}
+
+#if WINDOWS
+// for unit testing, reply to request sent rttMs ago, server held it heldMs
+void NTP_SimulateReply(uint32_t unixTime, int ms, int rttMs, int heldMs) {
+	byte p[sizeof(ntp_packet)];
+	uint32_t t = unixTime + NTP_OFFSET;
+	uint32_t f = (uint32_t)(((uint64_t)ms << 32) / 1000) + 1;
+	uint32_t rx_f = (uint32_t)((((uint64_t)(ms - heldMs)) << 32) / 1000) + 1;
+
+	memset(p, 0, sizeof(p));
+	p[0] = 0x24;
+	p[1] = 2;
+	memcpy(p + 12, "TEST", 4);
+	p[24] = g_ntp_origin_s >> 24; p[25] = g_ntp_origin_s >> 16; p[26] = g_ntp_origin_s >> 8; p[27] = g_ntp_origin_s;
+	p[28] = g_ntp_origin_f >> 24; p[29] = g_ntp_origin_f >> 16; p[30] = g_ntp_origin_f >> 8; p[31] = g_ntp_origin_f;
+	p[32] = t >> 24; p[33] = t >> 16; p[34] = t >> 8; p[35] = t;
+	p[36] = rx_f >> 24; p[37] = rx_f >> 16; p[38] = rx_f >> 8; p[39] = rx_f;
+	p[40] = t >> 24; p[41] = t >> 16; p[42] = t >> 8; p[43] = t;
+	p[44] = f >> 24; p[45] = f >> 16; p[46] = f >> 8; p[47] = f;
+	g_ntp_sentMs = g_timeMs - rttMs;
+	NTP_ProcessReply(p, sizeof(p));
+}
+unsigned int NTP_GetPollInterval() {
+	return g_ntp_poll;
+}
+#endif
+
 void NTP_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState)
 {
 	if (bPreState)
@@ -374,7 +608,7 @@ void NTP_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState
 */
     //  if NTP is synced, we'll print time with deviceclocks HTTP information
     if (g_synced != true)
-        hprintf255(request, "<h5>NTP: Syncing with %s....</h5>",CFG_GetNTPServer());
+        hprintf255(request, "<h5>NTP: Syncing with %s....</h5>",NTP_GetServer(g_ntp_server));
 }
 
 bool NTP_IsTimeSynced()
@@ -12,12 +12,28 @@ void NTP_OnEverySecond();
 // returns number of seconds passed after 1900
 unsigned int NTP_GetCurrentTime();
 unsigned int NTP_GetCurrentTimeWithoutOffset();
+// UTC in milliseconds since 1970, whole seconds of device clock until synced
+uint64_t NTP_GetCurrentTimeMs();
+// drv_main.c calls these for QuickTick even when driver is not started
+void NTP_RunQuickTick();
+int NTP_GetTimeToNextWakeMS();
 void NTP_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState);
 bool NTP_IsTimeSynced();
 int NTP_GetTimesZoneOfsSeconds();
 void NTP_SetTimesZoneOfsSeconds(int o);
 // for Simulator only, on Windows, for unit testing
 void NTP_SetSimulatedTime(unsigned int timeNow);
+void NTP_SimulateReply(uint32_t unixTime, int ms, int rttMs, int heldMs);
+unsigned int NTP_GetPollInterval();
+// estimated rate error of local clock, corrected by NTP_GetCurrentTimeMs
+int NTP_GetDriftPpm();
+// drv_ntp_actions.c, commands run at given UTC ms, see ntp_at
+void NTP_Actions_Init();
+void NTP_Actions_Clear();
+void NTP_Actions_RunQuickTick();
+int NTP_Actions_GetTimeToNextWakeMS();
+int NTP_Actions_GetPendingCount();
+int NTP_Actions_GetLastSkew();
 // drv_ntp_events.c
 extern time_t g_ntpTime;
 
@@ -0,0 +1,277 @@
+// commands run at given NTP time, so devices of a group switch together
+#include "../obk_config.h"
+#if ENABLE_NTP
+
+#include "../new_common.h"
+#include "../new_cfg.h"
+#include "../cmnds/cmd_public.h"
+#include "../logging/logging.h"
+#include "../quicktick.h"
+#include "drv_ntp.h"
+#include "drv_public.h"
+#if ENABLE_MQTT
+#include "../mqtt/new_mqtt.h"
+#endif
+
+// Command is queued with UTC milliseconds it should run at and is run by
+// QuickTick of first tick at or after it, wake time is asked for exact
+// deadline so the tick is not late by sleep. Clock is the one of
+// NTP_GetCurrentTimeMs with drift correction, so devices that synced with
+// same server run it within their NTP error and one tick of each other.
+// Group sends "ntp_at <Time> <Command>" over DGR and to MQTT group topic,
+// every member (and sender itself) queues it; same action that comes by
+// both paths is queued once. ntp_atOffset delays all actions of this
+// device, e.g. to stagger relays of a group so their inrush doesn't add.
+// Skew is how late the command ran against its time, min/avg/max are kept.
+//
+// ntp_at 1700000000000 POWER ON
+// ntp_at +500 POWER TOGGLE
+// ntp_atGroup 2000 POWER ON
+
+#define NTP_MAX_ACTIONS			8
+#define NTP_ACTION_CMD			80
+// actions found this late (power loss, bad sync) are dropped
+#define NTP_ACTION_LATE_MS		2000
+// time before first sync is device clock in whole seconds
+#define NTP_ACTION_UNSYNCED_MAX	60000
+
+typedef struct ntpAction_s {
+	uint64_t at;
+	char cmd[NTP_ACTION_CMD];
+} ntpAction_t;
+
+static ntpAction_t g_ntpActions[NTP_MAX_ACTIONS];
+static int g_ntpActionsCount = 0;
+static int g_ntpActionOffsetMs = 0;
+static int g_ntpActionsRun = 0;
+static int g_ntpActionsMissed = 0;
+static int g_ntpSkewMin = 0;
+static int g_ntpSkewMax = 0;
+static int g_ntpSkewLast = 0;
+static int64_t g_ntpSkewSum = 0;
+
+static bool NTP_QueueAction(uint64_t at, const char *cmd) {
+	int i;
+
+	if (strlen(cmd) >= NTP_ACTION_CMD) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_NTP, "ntp_at: command too long");
+		return false;
+	}
+	for (i = 0; i < g_ntpActionsCount; i++) {
+		if (g_ntpActions[i].at == at && !strcmp(g_ntpActions[i].cmd, cmd)) {
+			return true;
+		}
+	}
+	if (g_ntpActionsCount >= NTP_MAX_ACTIONS) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_NTP, "ntp_at: queue full");
+		return false;
+	}
+	// kept sorted, first one is next to run
+	for (i = g_ntpActionsCount; i > 0 && g_ntpActions[i - 1].at > at; i--) {
+		g_ntpActions[i] = g_ntpActions[i - 1];
+	}
+	g_ntpActions[i].at = at;
+	strcpy(g_ntpActions[i].cmd, cmd);
+	g_ntpActionsCount++;
+	QuickTick_Wake();
+	return true;
+}
+static void NTP_RecordSkew(int skew) {
+	if (g_ntpActionsRun == 0 || skew < g_ntpSkewMin) {
+		g_ntpSkewMin = skew;
+	}
+	if (g_ntpActionsRun == 0 || skew > g_ntpSkewMax) {
+		g_ntpSkewMax = skew;
+	}
+	g_ntpSkewLast = skew;
+	g_ntpSkewSum += skew;
+	g_ntpActionsRun++;
+}
+// called from NTP_RunQuickTick
+void NTP_Actions_RunQuickTick() {
+	char cmd[NTP_ACTION_CMD];
+	uint64_t now;
+	int skew;
+
+	while (g_ntpActionsCount) {
+		now = NTP_GetCurrentTimeMs();
+		if (now < g_ntpActions[0].at) {
+			return;
+		}
+		skew = (int)(now - g_ntpActions[0].at);
+		strcpy(cmd, g_ntpActions[0].cmd);
+		g_ntpActionsCount--;
+		memmove(&g_ntpActions[0], &g_ntpActions[1], g_ntpActionsCount * sizeof(ntpAction_t));
+		if (skew > NTP_ACTION_LATE_MS) {
+			addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "ntp_at: %s missed by %i ms", cmd, skew);
+			g_ntpActionsMissed++;
+			continue;
+		}
+		NTP_RecordSkew(skew);
+		// command may queue another action
+		CMD_ExecuteCommand(cmd, COMMAND_FLAG_SOURCE_SCRIPT);
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_NTP, "ntp_at: %s, skew %i ms", cmd, skew);
+	}
+}
+int NTP_Actions_GetTimeToNextWakeMS() {
+	uint64_t now;
+
+	if (g_ntpActionsCount == 0) {
+		return -1;
+	}
+	now = NTP_GetCurrentTimeMs();
+	if (now >= g_ntpActions[0].at) {
+		return 0;
+	}
+	if (g_ntpActions[0].at - now > 0x7fffffff) {
+		return 0x7fffffff;
+	}
+	return (int)(g_ntpActions[0].at - now);
+}
+int NTP_Actions_GetPendingCount() {
+	return g_ntpActionsCount;
+}
+int NTP_Actions_GetLastSkew() {
+	return g_ntpSkewLast;
+}
+void NTP_Actions_Clear() {
+	g_ntpActionsCount = 0;
+}
+// "+500" is relative to now, otherwise UTC milliseconds since 1970
+static bool NTP_ParseActionTime(const char *s, uint64_t *at) {
+	uint64_t v = 0;
+	bool bRelative = false;
+
+	if (*s == '+') {
+		bRelative = true;
+		s++;
+	}
+	if (*s < '0' || *s > '9') {
+		return false;
+	}
+	while (*s >= '0' && *s <= '9') {
+		v = v * 10 + (*s - '0');
+		s++;
+	}
+	if (bRelative) {
+		v += NTP_GetCurrentTimeMs();
+	}
+	else if (NTP_IsTimeSynced() == false) {
+		// group time means nothing without sync, unless it's very close
+		if (v > NTP_GetCurrentTimeMs() + NTP_ACTION_UNSYNCED_MAX) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_NTP, "ntp_at: clock not synced");
+			return false;
+		}
+	}
+	*at = v + g_ntpActionOffsetMs;
+	return true;
+}
+// ntp_at [TimeMs or +DelayMs] [Command]
+static commandResult_t NTP_At(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	uint64_t at;
+	const char *rest;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 2)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	if (NTP_ParseActionTime(Tokenizer_GetArg(0), &at) == false) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	rest = Tokenizer_GetArgFrom(1);
+	if (NTP_QueueAction(at, rest) == false) {
+		return CMD_RES_ERROR;
+	}
+	return CMD_RES_OK;
+}
+// ntp_atGroup [DelayMs] [Command]
+static commandResult_t NTP_AtGroup(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	char msg[NTP_ACTION_CMD + 32];
+	char dgr[NTP_ACTION_CMD + 40];
+	uint64_t at;
+	int delay;
+	const char *rest;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 2)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	if (NTP_IsTimeSynced() == false) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_NTP, "ntp_atGroup: clock not synced");
+		return CMD_RES_ERROR;
+	}
+	delay = Tokenizer_GetArgInteger(0);
+	rest = Tokenizer_GetArgFrom(1);
+	at = NTP_GetCurrentTimeMs() + delay;
+	snprintf(msg, sizeof(msg), "%llu %s", (unsigned long long)at, rest);
+#if ENABLE_TASMOTADEVICEGROUPS
+	if (DRV_IsRunning(DRV_ID_DGR)) {
+		snprintf(dgr, sizeof(dgr), "ntp_at %s", msg);
+		DRV_DGR_Send_Command(CFG_DeviceGroups_GetName(), dgr);
+	}
+#endif
+#if ENABLE_MQTT
+	if (*CFG_GetMQTTGroupTopic()) {
+		char topic[64];
+		snprintf(topic, sizeof(topic), "cmnd/%s", CFG_GetMQTTGroupTopic());
+		MQTT_Publish(topic, "ntp_at", msg, 0);
+	}
+#endif
+	// group topic comes back to us too, queue drops it then
+	if (NTP_QueueAction(at + g_ntpActionOffsetMs, rest) == false) {
+		return CMD_RES_ERROR;
+	}
+	return CMD_RES_OK;
+}
+// ntp_atOffset [Ms]
+static commandResult_t NTP_AtOffset(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	g_ntpActionOffsetMs = Tokenizer_GetArgInteger(0);
+	return CMD_RES_OK;
+}
+static commandResult_t NTP_AtStats(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	addLogAdv(LOG_INFO, LOG_FEATURE_NTP, "ntp_at: %i queued, %i run, %i missed, skew last %i min %i avg %i max %i ms, drift %i ppm",
+		g_ntpActionsCount, g_ntpActionsRun, g_ntpActionsMissed, g_ntpSkewLast, g_ntpSkewMin,
+		g_ntpActionsRun ? (int)(g_ntpSkewSum / g_ntpActionsRun) : 0, g_ntpSkewMax, NTP_GetDriftPpm());
+	if (!stricmp(args, "reset")) {
+		g_ntpActionsRun = 0;
+		g_ntpActionsMissed = 0;
+		g_ntpSkewSum = 0;
+		g_ntpSkewLast = g_ntpSkewMin = g_ntpSkewMax = 0;
+	}
+	return CMD_RES_OK;
+}
+void NTP_Actions_Init() {
+	g_ntpActionsCount = 0;
+	g_ntpActionOffsetMs = 0;
+	g_ntpActionsRun = 0;
+	g_ntpActionsMissed = 0;
+	g_ntpSkewSum = 0;
+	g_ntpSkewLast = g_ntpSkewMin = g_ntpSkewMax = 0;
+
+	//cmddetail:{"name":"ntp_at","args":"[TimeMs or +DelayMs] [Command]",
+	//cmddetail:"descr":"Runs command at given UTC time in milliseconds since 1970, or given milliseconds from now. Devices synced by NTP run it together within a few ms. Also accepted from DGR and MQTT group topic.",
+	//cmddetail:"fn":"NTP_At","file":"driver/drv_ntp_actions.c","requires":"",
+	//cmddetail:"examples":"ntp_at 1700000000000 POWER ON"}
+	CMD_RegisterCommand("ntp_at", NTP_At, NULL);
+	//cmddetail:{"name":"ntp_atGroup","args":"[DelayMs] [Command]",
+	//cmddetail:"descr":"Sends ntp_at with time DelayMs from now to device group over DGR and to MQTT group topic, and queues it here, so whole group runs command at once.",
+	//cmddetail:"fn":"NTP_AtGroup","file":"driver/drv_ntp_actions.c","requires":"",
+	//cmddetail:"examples":"ntp_atGroup 2000 POWER ON"}
+	CMD_RegisterCommand("ntp_atGroup", NTP_AtGroup, NULL);
+	//cmddetail:{"name":"ntp_atOffset","args":"[Ms]",
+	//cmddetail:"descr":"Delays all ntp_at actions of this device by given ms, so relays of a group can be staggered on purpose.",
+	//cmddetail:"fn":"NTP_AtOffset","file":"driver/drv_ntp_actions.c","requires":"",
+	//cmddetail:"examples":"ntp_atOffset 40"}
+	CMD_RegisterCommand("ntp_atOffset", NTP_AtOffset, NULL);
+	//cmddetail:{"name":"ntp_atStats","args":"[reset]",
+	//cmddetail:"descr":"Logs queued and run ntp_at actions, how late they ran (skew) and clock drift estimate.",
+	//cmddetail:"fn":"NTP_AtStats","file":"driver/drv_ntp_actions.c","requires":"",
+	//cmddetail:"examples":"ntp_atStats"}
+	CMD_RegisterCommand("ntp_atStats", NTP_AtStats, NULL);
+}
+
+#endif
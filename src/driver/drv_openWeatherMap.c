@@ -7,30 +7,26 @@
 #include "../logging/logging.h"
 #include "../hal/hal_pins.h"
 #include "../httpserver/new_http.h"
-#include "../httpclient/utils_net.h"
+#include "../httpclient/http_client.h"
+#include "../jsmn/jsmn_h.h"
 #include "drv_ntp.h"
-#include "lwip/sockets.h"
-#include "lwip/ip_addr.h"
-#include "lwip/inet.h"
-#include "../cJSON/cJSON.h"
+#include "drv_local.h"
 #include "../libraries/obktime/obktime.h"	// for time functions
 
 #if ENABLE_DRIVER_OPENWEATHERMAP
 
-#ifndef WINDOWS
-#include <lwip/err.h>
-#include <lwip/dns.h>
-#include "lwip/netdb.h"
-#endif
-
-#ifdef WINDOWS
-typedef int xTaskHandle;
-#endif
+// Query goes through async HTTP client, so it needs no thread of its own
+// and polls reuse connection kept by the client. Reply body is collected
+// as it comes and values are read from jsmn tokens, without a JSON tree.
+#define OWM_MAX_TOKENS		128
 
-xTaskHandle g_weather_thread = NULL;
-
-static char g_request[512];
+static char g_url[256];
 static char g_reply[1024];
+static int g_replyLen;
+static httprequest_t g_owmRequest;
+static char g_owmChunk[256];
+static bool g_owmBusy = false;
+static bool g_owmFailed;
 
 #include "drv_openWeatherMap.h"
 
@@ -40,81 +36,44 @@ weatherChannels_t g_channels;
 weatherData_t *Weather_GetData() {
 	return &g_weather;
 }
-static double json_get_double(cJSON *parent, const char *name, double def) {
-	cJSON *n = cJSON_GetObjectItem(parent, name);
-	if (n && cJSON_IsNumber(n)) {
-		return n->valuedouble;
-	}
-	return def;
-}
-
-static int json_get_int(cJSON *parent, const char *name, int def) {
-	cJSON *n = cJSON_GetObjectItem(parent, name);
-	if (n && cJSON_IsNumber(n)) {
-		return n->valueint;
-	}
-	return def;
-}
-
-static void json_get_string(cJSON *parent, const char *name, char *dst, int dstSize, const char *def) {
-	cJSON *n = cJSON_GetObjectItem(parent, name);
-	const char *src = (n && cJSON_IsString(n)) ? n->valuestring : def;
-	strncpy(dst, src, dstSize - 1);
-	dst[dstSize - 1] = '\0';
-}
 const char *Weather_GetReply() {
 	return g_reply;
 }
-void Weather_SetReply(const char *s) {
-	const char *json_start = strstr(s, "\r\n\r\n");
-	if (json_start) {
-		json_start += 4;
-		strcpy_safe(g_reply, json_start, sizeof(g_reply));
-
-		cJSON *json = cJSON_Parse(json_start);
-		if (json) {
+static void Weather_ParseReply() {
+	jsmn_parser p;
+	jsmntok_t *t;
+	int n;
 
-			cJSON *coord = cJSON_GetObjectItem(json, "coord");
-			if (coord) {
-				g_weather.lon = json_get_double(coord, "lon", 0.0);
-				g_weather.lat = json_get_double(coord, "lat", 0.0);
-			}
-
-			cJSON *weather_array = cJSON_GetObjectItem(json, "weather");
-			if (weather_array && cJSON_IsArray(weather_array)) {
-				cJSON *weather = cJSON_GetArrayItem(weather_array, 0);
-				if (weather) {
-					json_get_string(weather, "main", g_weather.main_weather, sizeof(g_weather.main_weather), "Unknown");
-					json_get_string(weather, "description", g_weather.description, sizeof(g_weather.description), "Unknown");
-				}
-			}
-
-			cJSON *main = cJSON_GetObjectItem(json, "main");
-			if (main) {
-				g_weather.temp = json_get_double(main, "temp", 0.0);
-				g_weather.pressure = json_get_int(main, "pressure", 0);
-				g_weather.humidity = json_get_int(main, "humidity", 0);
-			}
-
-			g_weather.timezone = json_get_int(json, "timezone", 0);
-
-			cJSON *sys = cJSON_GetObjectItem(json, "sys");
-			if (sys) {
-				g_weather.sunrise = json_get_int(sys, "sunrise", 0);
-				g_weather.sunset = json_get_int(sys, "sunset", 0);
-			}
-
-			cJSON_Delete(json);
+	t = (jsmntok_t*)malloc(sizeof(jsmntok_t) * OWM_MAX_TOKENS);
+	if (t == 0) {
+		return;
+	}
+	jsmn_init(&p);
+	n = jsmn_parse(&p, g_reply, strlen(g_reply), t, OWM_MAX_TOKENS);
+	if (n > 0 && t[0].type == JSMN_OBJECT) {
+		g_weather.lon = jsmn_getDouble(g_reply, t, n, "coord.lon", 0.0);
+		g_weather.lat = jsmn_getDouble(g_reply, t, n, "coord.lat", 0.0);
+		if (jsmn_find(g_reply, t, n, "weather.0") >= 0) {
+			jsmn_getString(g_reply, t, n, "weather.0.main", g_weather.main_weather, sizeof(g_weather.main_weather), "Unknown");
+			jsmn_getString(g_reply, t, n, "weather.0.description", g_weather.description, sizeof(g_weather.description), "Unknown");
 		}
-		else {
-			ADDLOG_ERROR(LOG_FEATURE_HTTP, "Failed to parse JSON");
+		if (jsmn_find(g_reply, t, n, "main") >= 0) {
+			g_weather.temp = jsmn_getDouble(g_reply, t, n, "main.temp", 0.0);
+			g_weather.pressure = jsmn_getInt(g_reply, t, n, "main.pressure", 0);
+			g_weather.humidity = jsmn_getInt(g_reply, t, n, "main.humidity", 0);
+		}
+		g_weather.timezone = jsmn_getInt(g_reply, t, n, "timezone", 0);
+		if (jsmn_find(g_reply, t, n, "sys") >= 0) {
+			g_weather.sunrise = jsmn_getInt(g_reply, t, n, "sys.sunrise", 0);
+			g_weather.sunset = jsmn_getInt(g_reply, t, n, "sys.sunset", 0);
 		}
 	}
 	else {
-		g_reply[0] = '\0';
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "No JSON found in reply");
+		ADDLOG_ERROR(LOG_FEATURE_HTTP, "Failed to parse JSON (%i)", n);
 	}
-
+	free(t);
+}
+static void Weather_SetChannels() {
 	if (g_channels.bInitialized) {
 		if (g_channels.temperature != -1) {
 			CHANNEL_SetSmart(g_channels.temperature, g_weather.temp, 0);
@@ -127,104 +86,76 @@ void Weather_SetReply(const char *s) {
 		}
 	}
 }
-
-#if 0
-
-static void sendQueryThreadInternal() {
-	int s = HAL_TCP_Establish("api.openweathermap.org", 80);
-	if (s == 0) {
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "Connect fail.");
-		return;
-	}
-	int len = strlen(g_request);
-	if (HAL_TCP_Write(s, g_request, len, 1000) != len) {
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "Send failed");
-		rtos_delay_milliseconds(250);
-		closesocket(s);
-		return;
+// whole reply with HTTP header
+void Weather_SetReply(const char *s) {
+	const char *json_start = strstr(s, "\r\n\r\n");
+	if (json_start) {
+		json_start += 4;
+		strcpy_safe(g_reply, json_start, sizeof(g_reply));
+		Weather_ParseReply();
 	}
-	char buffer[1024];
-	int recv_size = HAL_TCP_Read(s, buffer, sizeof(buffer) - 1, 1000);
-	ADDLOG_ERROR(LOG_FEATURE_HTTP, "Rec %i", recv_size);
-	if (recv_size > 0) {
-		buffer[recv_size] = '\0';
-		Weather_SetReply(buffer);
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, buffer);
+	else {
+		g_reply[0] = '\0';
+		ADDLOG_ERROR(LOG_FEATURE_HTTP, "No JSON found in reply");
 	}
-
-	HAL_TCP_Destroy(s);
+	Weather_SetChannels();
+	DRV_MarkIndexDirty(OWM_AppendInformationToHTTPIndexPage);
 }
-#else
-
-static void sendQueryThreadInternal() {
-	struct hostent *he;
-	char hostname[] = "api.openweathermap.org";
-	struct in_addr **addr_list;
-	int s;
-
-	he = gethostbyname(hostname);
-	if (he == NULL) {
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "Failed to resolve hostname.");
-		return;
-	}
-	addr_list = (struct in_addr **)he->h_addr_list;
-	ADDLOG_ERROR(LOG_FEATURE_HTTP, "Resolved IP address: %s\n", inet_ntoa(*addr_list[0]));
-
-	if ((s = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "Could not create socket.");
-		return;
-	}
-
-	struct sockaddr_in server;
-	server.sin_addr = *addr_list[0];
-	server.sin_family = AF_INET;
-	server.sin_port = htons(80);
 
-	if (connect(s, (struct sockaddr *)&server, sizeof(server)) < 0) {
-		closesocket(s);
-		return;
-	}
-	if (send(s, g_request, strlen(g_request), 0) < 0) {
-		closesocket(s);
-		return;
+// called from HTTP client task with pieces of reply body
+static int Weather_OnData(httprequest_t *request) {
+	httpclient_data_t *data = &request->client_data;
+	int len;
+
+	if (request->state == 1) {
+		len = data->response_buf_filled;
+		if (len > (int)sizeof(g_reply) - 1 - g_replyLen) {
+			ADDLOG_ERROR(LOG_FEATURE_HTTP, "OWM reply too long");
+			g_owmFailed = true;
+			return 1;
+		}
+		memcpy(g_reply + g_replyLen, data->response_buf, len);
+		g_replyLen += len;
+		g_reply[g_replyLen] = 0;
 	}
-	char buffer[1024];
-	int recv_size = recv(s, buffer, sizeof(buffer) - 1, 0);
-	ADDLOG_ERROR(LOG_FEATURE_HTTP, "Rec %i", recv_size);
-	if (recv_size > 0) {
-		buffer[recv_size] = '\0';
-		Weather_SetReply(buffer);
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, buffer);
+	else if (request->state < 0) {
+		g_owmFailed = true;
 	}
-
-	//HAL_TCP_Destroy(s);
-	//lwip_close_force(s);
-	closesocket(s);
-
-}
-#endif
-static void weather_thread(beken_thread_arg_t arg) {
-	sendQueryThreadInternal();
-	rtos_delete_thread(NULL);
-}
-void startWeatherThread() {
-	OSStatus err = kNoErr;
-
-	err = rtos_create_thread(&g_weather_thread, BEKEN_APPLICATION_PRIORITY,
-		"OWM",
-		(beken_thread_function_t)weather_thread,
-		4096,
-		(beken_thread_arg_t)0);
-	if (err != kNoErr)
-	{
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "create \"OWM\" thread failed with %i!\r\n", err);
+	else if (request->state == 2) {
+		if (!g_owmFailed && g_replyLen > 0) {
+			Weather_ParseReply();
+			Weather_SetChannels();
+		}
+		g_owmBusy = false;
+		DRV_MarkIndexDirty(OWM_AppendInformationToHTTPIndexPage);
 	}
+	return 0;
 }
 static commandResult_t CMD_OWM_Request(const void *context, const char *cmd, const char *args, int flags) {
-	Tokenizer_TokenizeString(args, TOKENIZER_ALLOW_QUOTES);
-
-	startWeatherThread();
-
+	if (g_url[0] == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_HTTP, "Use owm_setup first");
+		return CMD_RES_ERROR;
+	}
+	if (g_owmBusy) {
+		ADDLOG_INFO(LOG_FEATURE_HTTP, "OWM request is still running");
+		return CMD_RES_OK;
+	}
+	g_owmBusy = true;
+	g_owmFailed = false;
+	g_replyLen = 0;
+	g_reply[0] = 0;
+	memset(&g_owmRequest, 0, sizeof(g_owmRequest));
+	g_owmRequest.url = g_url;
+	g_owmRequest.port = HTTP_PORT;
+	g_owmRequest.method = HTTPCLIENT_GET;
+	g_owmRequest.timeout = 10000;
+	g_owmRequest.data_callback = Weather_OnData;
+	g_owmRequest.client_data.response_buf = g_owmChunk;
+	g_owmRequest.client_data.response_buf_len = sizeof(g_owmChunk);
+	if (HTTPClient_Async_SendGeneric(&g_owmRequest) != 0) {
+		g_owmBusy = false;
+		return CMD_RES_ERROR;
+	}
 	return CMD_RES_OK;
 }
 static commandResult_t CMD_OWM_Channels(const void *context, const char *cmd, const char *args, int flags) {
@@ -245,14 +176,10 @@ static commandResult_t CMD_OWM_Setup(const void *context, const char *cmd, const
 	const char *lng = Tokenizer_GetArg(1);
 	const char *key = Tokenizer_GetArg(2);
 
-	snprintf(g_request, sizeof(g_request),
-		"GET /data/2.5/weather?lat=%s&lon=%s&appid=%s&units=metric HTTP/1.1\r\n"
-		"Host: api.openweathermap.org\r\n"
-		"Connection: close\r\n\r\n",
+	snprintf(g_url, sizeof(g_url),
+		"http://api.openweathermap.org/data/2.5/weather?lat=%s&lon=%s&appid=%s&units=metric",
 		lat, lng, key);
 
-	ADDLOG_ERROR(LOG_FEATURE_HTTP, g_request);
-
 	return CMD_RES_OK;
 }
 void OWM_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
@@ -318,7 +245,7 @@ void DRV_OpenWeatherMap_Init() {
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("owm_channels", CMD_OWM_Channels, NULL);
 
-
+	DRV_MarkIndexDirty(OWM_AppendInformationToHTTPIndexPage);
 }
 
 #endif
@@ -11,16 +11,32 @@
 #include "../new_pins.h"
 #include "../quicktick.h"
 #include "../cmnds/cmd_public.h"
+#include "../httpserver/new_http.h"
+
+#if PLATFORM_BEKEN
+#include "include.h"
+#include "arm_arch.h"
+#include "bk_timer_pub.h"
+#include "drv_model_pub.h"
+#endif
 
 /*
 startDriver PinMutex
-// setMutex MutexIndex ChannelIndex PinUp PinDown DelayMs
-setMutex 0 1 10 11 50
+// setMutex MutexIndex ChannelIndex DelayMs PinDown PinUp
+setMutex 0 1 50 10 11
 // now, if you set channel 1 to 0, both pins are low.
-// If you set to 1, Up goes 1, if you set to 2, down goes 1
+// If you set to 1, Down goes 1, if you set to 2, Up goes 1
 // but there is guaranted 50ms dead time
 */
 
+// Nothing is polled. Channel change turns old pin off at once and either
+// turns new pin on, when other pin has been off long enough, or arms
+// one shot timer for the rest of dead time.
+// Beken uses hardware timer BKTIMER1 (IR2 has BKTIMER0, profiler BKTIMER2),
+// elsewhere due time is handed to QuickTick as its next wake.
+// Dead time is counted from when old pin really went off and one clock
+// step is added, so it can only come out longer, never shorter.
+
 // desired pin state: off, up, or down
 typedef enum {
 	PM_DESIRED_OFF = 0,
@@ -30,69 +46,211 @@ typedef enum {
 
 // pinMutex structure
 typedef struct pinMutex_s {
-	int           channel;       // which CHANNEL_Get index to watch
-	int           pinUp;         // gpio pin number for "up"
-	int           pinDown;       // gpio pin number for "down"
+	bool          bUsed;
+	int           channel;       // which channel index to watch
+	int           pins[2];       // gpio pin for PM_DESIRED_DOWN and PM_DESIRED_UP
 	int           deadTimeMs;    // minimum off-time when switching
-	pmDesired_t   lastDesired;   // previous desired state
-	int           timerMs;       // remaining dead-time countdown
+	pmDesired_t   on;            // which pin is on now
+	pmDesired_t   lastOn;        // which pin was on before offAt
+	pmDesired_t   pending;       // waiting for dead time
+	uint32_t      offAt;
+	uint32_t      due;
+	int           lastDeadMs;    // measured, -1 until first switch
+	int           minDeadMs;
+	unsigned int  switches;
 } pinMutex_t;
 
-#define MAX_PINMUTEX 4
-static pinMutex_t pms[MAX_PINMUTEX];
-
-// this must be called from the main loop at ~1 kHz (once per millisecond)
-void DRV_PinMutex_RunFrame() {
-	for (int i = 0; i < MAX_PINMUTEX; i++) {
-		pinMutex_t *pm = &pms[i];
-
-		// skip unused slots (both pins zero)
-		if (pm->pinUp == 0 && pm->pinDown == 0) continue;
-
-		// read desired state: 0=off, 1=up, 2=down
-		int desired = CHANNEL_Get(pm->channel);
-
-		// state changed? start dead-time
-		if ((pmDesired_t)desired != pm->lastDesired) {
-			// immediately turn both pins off
-			HAL_PIN_SetOutputValue(pm->pinUp, 0);
-			HAL_PIN_SetOutputValue(pm->pinDown, 0);
-			// start delay before new direction
-			if (pm->lastDesired != 0) {
-				pm->timerMs = pm->deadTimeMs;
-			}
-			else {
-				pm->timerMs = 0;
-			}
-			pm->lastDesired = (pmDesired_t)desired;
+// table grows with highest setMutex index
+#define MAX_PINMUTEX 32
+static pinMutex_t *pms = 0;
+static int g_numPinMutex = 0;
+
+// off time may be stamped up to one clock step late
+#if WINDOWS
+#define PINMUTEX_TIME_STEP		1
+#else
+#define PINMUTEX_TIME_STEP		portTICK_PERIOD_MS
+#endif
+
+#if PLATFORM_BEKEN
+static uint32_t g_pinMutexChan = BKTIMER1;
+#define PINMUTEX_DECLARE()		GLOBAL_INT_DECLARATION()
+#define PINMUTEX_LOCK()			GLOBAL_INT_DISABLE()
+#define PINMUTEX_UNLOCK()		GLOBAL_INT_RESTORE()
+#else
+#define PINMUTEX_DECLARE()
+#define PINMUTEX_LOCK()
+#define PINMUTEX_UNLOCK()
+#endif
+static bool g_pinMutexArmed = false;
+
+static void PinMutex_Energize(pinMutex_t *pm, pmDesired_t desired, uint32_t now) {
+	HAL_PIN_SetOutputValue(pm->pins[desired - 1], 1);
+	pm->on = desired;
+	pm->pending = PM_DESIRED_OFF;
+	if (pm->lastOn != PM_DESIRED_OFF && pm->lastOn != desired) {
+		pm->lastDeadMs = now - pm->offAt;
+		if (pm->minDeadMs < 0 || pm->lastDeadMs < pm->minDeadMs) {
+			pm->minDeadMs = pm->lastDeadMs;
+		}
+		pm->switches++;
+	}
+}
+// turns on pending pins that are due, returns ms to next due or -1
+static int PinMutex_RunDue(uint32_t now) {
+	pinMutex_t *pm;
+	int i, left, next = -1;
+
+	for (i = 0; i < g_numPinMutex; i++) {
+		pm = &pms[i];
+		if (pm->pending == PM_DESIRED_OFF) {
+			continue;
+		}
+		left = (int)(pm->due - now);
+		if (left <= 0) {
+			PinMutex_Energize(pm, pm->pending, now);
+		}
+		else if (next == -1 || left < next) {
+			next = left;
+		}
+	}
+	return next;
+}
+
+#if PLATFORM_BEKEN
+static void PinMutex_ArmTimer(int ms);
+// NOTE: ISR
+static void PinMutex_ISR(UINT8 t) {
+	int next;
+
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_DISABLE, &g_pinMutexChan);
+	g_pinMutexArmed = false;
+	next = PinMutex_RunDue(SYSPERF_GetTimeMs());
+	if (next >= 0) {
+		PinMutex_ArmTimer(next);
+	}
+}
+static void PinMutex_ArmTimer(int ms) {
+	timer_param_t params = {
+		(unsigned char)g_pinMutexChan,
+		1, // div
+		(ms > 0 ? ms : 1) * 1000, // us
+		PinMutex_ISR
+	};
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_DISABLE, &g_pinMutexChan);
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_INIT_PARAM_US, &params);
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_ENABLE, &g_pinMutexChan);
+	g_pinMutexArmed = true;
+}
+static void PinMutex_DisarmTimer() {
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_DISABLE, &g_pinMutexChan);
+	g_pinMutexArmed = false;
+}
+#else
+static void PinMutex_ArmTimer(int ms) {
+	g_pinMutexArmed = true;
+	// so QuickTick takes new due time for its sleep
+	QuickTick_Wake();
+}
+static void PinMutex_DisarmTimer() {
+	g_pinMutexArmed = false;
+}
+// timer in software, QuickTick wakes for it through PinMutex_GetTimeToNextWakeMS
+void PinMutex_RunQuickTick() {
+	if (g_pinMutexArmed == false) {
+		return;
+	}
+	if (PinMutex_RunDue(SYSPERF_GetTimeMs()) < 0) {
+		g_pinMutexArmed = false;
+	}
+}
+int PinMutex_GetTimeToNextWakeMS() {
+	uint32_t now;
+	int i, left, next = -1;
+
+	if (g_pinMutexArmed == false) {
+		return -1;
+	}
+	now = SYSPERF_GetTimeMs();
+	for (i = 0; i < g_numPinMutex; i++) {
+		if (pms[i].pending == PM_DESIRED_OFF) {
+			continue;
 		}
-		else if (pm->timerMs > 0) {
-			// still in dead-time: count down
-			pm->timerMs -= g_deltaTimeMS;
-			// keep both outputs off
+		left = (int)(pms[i].due - now);
+		if (left < 0) {
+			left = 0;
 		}
-		else {
-			// dead-time expired → apply new state
-			switch (pm->lastDesired) {
-			case PM_DESIRED_OFF:
-				HAL_PIN_SetOutputValue(pm->pinUp, 0);
-				HAL_PIN_SetOutputValue(pm->pinDown, 0);
-				break;
-			case PM_DESIRED_UP:
-				HAL_PIN_SetOutputValue(pm->pinUp, 1);
-				HAL_PIN_SetOutputValue(pm->pinDown, 0);
-				break;
-			case PM_DESIRED_DOWN:
-				HAL_PIN_SetOutputValue(pm->pinUp, 0);
-				HAL_PIN_SetOutputValue(pm->pinDown, 1);
-				break;
-			}
+		if (next == -1 || left < next) {
+			next = left;
 		}
 	}
+	return next;
+}
+#endif
+
+// re-arms timer for earliest pending pin
+static void PinMutex_Rearm(uint32_t now) {
+	int next = PinMutex_RunDue(now);
+
+	if (next >= 0) {
+		PinMutex_ArmTimer(next);
+	}
+	else if (g_pinMutexArmed) {
+		PinMutex_DisarmTimer();
+	}
 }
+static void PinMutex_Apply(pinMutex_t *pm, int value, uint32_t now) {
+	pmDesired_t desired = PM_DESIRED_OFF;
 
-// setMutex <index> <channel> <delayMs> <pinUp> <pinDown>
+	if (value == PM_DESIRED_DOWN || value == PM_DESIRED_UP) {
+		desired = (pmDesired_t)value;
+	}
+	pm->pending = PM_DESIRED_OFF;
+	if (pm->on != PM_DESIRED_OFF && pm->on != desired) {
+		HAL_PIN_SetOutputValue(pm->pins[pm->on - 1], 0);
+		pm->lastOn = pm->on;
+		pm->offAt = now;
+		pm->on = PM_DESIRED_OFF;
+	}
+	if (desired == PM_DESIRED_OFF || pm->on == desired) {
+		return;
+	}
+	// other pin was on before, so also 1 -> 0 -> 2 keeps dead time
+	if (pm->lastOn != PM_DESIRED_OFF && pm->lastOn != desired
+		&& (int)(now - pm->offAt) < pm->deadTimeMs + PINMUTEX_TIME_STEP) {
+		pm->pending = desired;
+		pm->due = pm->offAt + pm->deadTimeMs + PINMUTEX_TIME_STEP;
+		return;
+	}
+	PinMutex_Energize(pm, desired, now);
+}
+
+void DRV_PinMutex_OnChannelChanged(int ch, int value) {
+	uint32_t now;
+	bool bChanged = false;
+	int i;
+	PINMUTEX_DECLARE();
+
+	PINMUTEX_LOCK();
+	now = SYSPERF_GetTimeMs();
+	for (i = 0; i < g_numPinMutex; i++) {
+		if (pms[i].bUsed && pms[i].channel == ch) {
+			PinMutex_Apply(&pms[i], value, now);
+			bChanged = true;
+		}
+	}
+	if (bChanged) {
+		PinMutex_Rearm(now);
+	}
+	PINMUTEX_UNLOCK();
+}
+
+// setMutex <index> <channel> <delayMs> <pinDown> <pinUp>
 static commandResult_t CMD_setMutex(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	pinMutex_t *pm, *table, *old = 0;
+	uint32_t now;
+	PINMUTEX_DECLARE();
+
 	Tokenizer_TokenizeString(args, 0);
 
 	// expect 5 arguments
@@ -103,8 +261,6 @@ static commandResult_t CMD_setMutex(const void *context, const char *cmd, const
 	int idx = Tokenizer_GetArgInteger(0);
 	int channel = Tokenizer_GetArgInteger(1);
 	int delayMs = Tokenizer_GetArgInteger(2);
-//	int pinDown = Tokenizer_GetArgInteger(3);
-//	int pinUp = Tokenizer_GetArgInteger(4);
 	int pinDown = Tokenizer_GetPin(3,-1);
 	int pinUp = Tokenizer_GetPin(4,-1);
 	if (pinDown == -1 || pinUp == -1) return CMD_RES_BAD_ARGUMENT;
@@ -117,36 +273,103 @@ static commandResult_t CMD_setMutex(const void *context, const char *cmd, const
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "setMutex: delay must be >= 0");
 		return CMD_RES_BAD_ARGUMENT;
 	}
+	if (idx >= g_numPinMutex) {
+		// timer ISR may walk table, so it is swapped, not reallocated
+		table = (pinMutex_t*)malloc(sizeof(pinMutex_t) * (idx + 1));
+		if (table == 0) {
+			return CMD_RES_ERROR;
+		}
+		memset(table, 0, sizeof(pinMutex_t) * (idx + 1));
+		PINMUTEX_LOCK();
+		if (g_numPinMutex) {
+			memcpy(table, pms, sizeof(pinMutex_t) * g_numPinMutex);
+		}
+		old = pms;
+		pms = table;
+		g_numPinMutex = idx + 1;
+		PINMUTEX_UNLOCK();
+		free(old);
+	}
 
-	// initialize slot
-	pms[idx].channel = channel;
-	pms[idx].pinUp = pinUp;
-	pms[idx].pinDown = pinDown;
-	pms[idx].deadTimeMs = delayMs;
-	pms[idx].lastDesired = PM_DESIRED_OFF;
-	pms[idx].timerMs = 0;
+	PINMUTEX_LOCK();
+	now = SYSPERF_GetTimeMs();
+	pm = &pms[idx];
+	// slot in use turns off its pin first, so dead time holds across reconfiguration
+	if (pm->bUsed) {
+		PinMutex_Apply(pm, PM_DESIRED_OFF, now);
+	}
+	else {
+		pm->lastOn = PM_DESIRED_OFF;
+		pm->lastDeadMs = -1;
+		pm->minDeadMs = -1;
+		pm->switches = 0;
+	}
+	pm->bUsed = true;
+	pm->channel = channel;
+	pm->pins[PM_DESIRED_DOWN - 1] = pinDown;
+	pm->pins[PM_DESIRED_UP - 1] = pinUp;
+	pm->deadTimeMs = delayMs;
 
 	// configure gpio as outputs, start low
 	HAL_PIN_Setup_Output(pinUp);
 	HAL_PIN_Setup_Output(pinDown);
 	HAL_PIN_SetOutputValue(pinUp, 0);
 	HAL_PIN_SetOutputValue(pinDown, 0);
+	PinMutex_Apply(pm, CHANNEL_Get(channel), now);
+	PinMutex_Rearm(now);
+	PINMUTEX_UNLOCK();
 
-	addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "PinMutex[%d] = ch=%d, up=%d, down=%d, t=%dms",
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "PinMutex[%d] = ch=%d, up=%d, down=%d, t=%dms",
 		idx, channel, pinUp, pinDown, delayMs);
 	return CMD_RES_OK;
 }
 
-void DRV_PinMutex_Init() {
-	// mark all slots unused (both pins zero)
-	for (int i = 0; i < MAX_PINMUTEX; i++) {
-		pms[i].pinUp = 0;
-		pms[i].pinDown = 0;
+void DRV_PinMutex_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
+	pinMutex_t *pm;
+	int i;
+
+	if (bPreState) {
+		return;
 	}
-	//cmddetail:{"name":"setMutex","args":"CMD_setMutex",
-	//cmddetail:"descr":"pinmutex driver (potentially for shutters)",
+	for (i = 0; i < g_numPinMutex; i++) {
+		pm = &pms[i];
+		if (pm->bUsed == false) {
+			continue;
+		}
+		hprintf255(request, "<h5>PinMutex %i: ch %i, dead time %i ms, last %i ms, min %i ms, switches %u</h5>",
+			i, pm->channel, pm->deadTimeMs, pm->lastDeadMs, pm->minDeadMs, pm->switches);
+	}
+}
+
+void DRV_PinMutex_Stop() {
+	pinMutex_t *old;
+	int i;
+	PINMUTEX_DECLARE();
+
+	PINMUTEX_LOCK();
+	if (g_pinMutexArmed) {
+		PinMutex_DisarmTimer();
+	}
+	for (i = 0; i < g_numPinMutex; i++) {
+		if (pms[i].bUsed && pms[i].on != PM_DESIRED_OFF) {
+			HAL_PIN_SetOutputValue(pms[i].pins[pms[i].on - 1], 0);
+		}
+	}
+	old = pms;
+	pms = 0;
+	g_numPinMutex = 0;
+	PINMUTEX_UNLOCK();
+	free(old);
+}
+
+void DRV_PinMutex_Init() {
+	pms = 0;
+	g_numPinMutex = 0;
+	g_pinMutexArmed = false;
+	//cmddetail:{"name":"setMutex","args":"[Index] [Channel] [DeadTimeMS] [PinDown] [PinUp]",
+	//cmddetail:"descr":"Drives two pins from channel, value 1 turns PinDown on, 2 turns PinUp on, anything else turns both off. When switching between them, both stay off for at least DeadTimeMS, timed from channel change without polling. Measured dead time is shown on main page.",
 	//cmddetail:"fn":"CMD_setMutex","file":"driver/drv_pinMutex.c","requires":"",
-	//cmddetail:"examples":""}
+	//cmddetail:"examples":"setMutex 0 1 50 10 11"}
 	CMD_RegisterCommand("setMutex", CMD_setMutex, NULL);
 }
 
@@ -56,9 +56,13 @@ void PIR_Init() {
 		}
 	}
 	ch_sens = CHANNEL_FindIndexForPinType2(IOR_PWM_ScriptOnly, IOR_PWM_ScriptOnly_n);
+	DRV_MarkIndexDirty(PIR_AppendInformationToHTTPIndexPage);
 }
 
 void PIR_OnEverySecond() {
+	int prevTimeLeft = g_timeLeft;
+	int prevIsDark = g_isDark;
+
 	if (ch_sens != -1) {
 		CHANNEL_Set(ch_sens,g_sensitivity, 0);
 	}
@@ -85,7 +89,9 @@ void PIR_OnEverySecond() {
 	else {
 		g_timeLeft = 0;
 	}
-
+	if (g_timeLeft != prevTimeLeft || g_isDark != prevIsDark) {
+		DRV_MarkIndexDirty(PIR_AppendInformationToHTTPIndexPage);
+	}
 }
 
 void PIR_OnChannelChanged(int ch, int value) {
@@ -96,21 +102,29 @@ void PIR_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState
 	if (bPreState)
 	{
 		char tmpA[32];
+		bool bChanged = false;
 		if (http_getArg(request->url, "pirTime", tmpA, sizeof(tmpA))) {
 			g_onTime = atoi(tmpA);
 			HAL_FlashVars_SaveChannel(VAR_TIME, g_onTime);
+			bChanged = true;
 		}
 		if (http_getArg(request->url, "pirSensitivity", tmpA, sizeof(tmpA))) {
 			g_sensitivity = atoi(tmpA);
 			HAL_FlashVars_SaveChannel(VAR_SENS, g_sensitivity);
+			bChanged = true;
 		}
 		if (http_getArg(request->url, "pirMode", tmpA, sizeof(tmpA))) {
 			g_mode = atoi(tmpA);
 			HAL_FlashVars_SaveChannel(VAR_MODE, g_mode);
+			bChanged = true;
 		}
 		if (http_getArg(request->url, "light", tmpA, sizeof(tmpA))) {
 			g_lightLevelMargin = atoi(tmpA);
 			HAL_FlashVars_SaveChannel(VAR_LIGHTLEVEL, g_lightLevelMargin);
+			bChanged = true;
+		}
+		if (bChanged) {
+			DRV_MarkIndexDirty(PIR_AppendInformationToHTTPIndexPage);
 		}
 
 		hprintf255(request, "<h3>PIR Sensor Settings</h3>");
@@ -13,6 +13,7 @@
 #include "drv_local.h"
 #include "../hal/hal_pins.h"
 #include <math.h>
+#include <ctype.h>
 
 /*
 // Usage:
@@ -23,9 +24,7 @@ startDriver PixelAnim
 */
 
 // Credit: https://github.com/Electriangle/RainbowCycle_Main
-byte *RainbowWheel_Wheel(byte WheelPosition) {
-	static byte c[3];
-
+void RainbowWheel_Wheel(byte WheelPosition, byte *c) {
 	if (WheelPosition < 85) {
 		c[0] = WheelPosition * 3;
 		c[1] = 255 - WheelPosition * 3;
@@ -43,8 +42,6 @@ byte *RainbowWheel_Wheel(byte WheelPosition) {
 		c[1] = WheelPosition * 3;
 		c[2] = 255 - WheelPosition * 3;
 	}
-
-	return c;
 }
 uint16_t j = 0;
 uint16_t count = 0;
@@ -76,12 +73,12 @@ void ShootingStar_Run() {
 	Strip_Apply();
 }
 void RainbowCycle_Run() {
-	byte *c;
+	byte c[3];
 	uint16_t i;
 
 	for (i = 0; i < pixel_count; i++) {
-		c = RainbowWheel_Wheel(((i * 256 / pixel_count) + j) & 255);
-		Strip_setPixelWithBrig(pixel_count - 1 - i, *c, *(c + 1), *(c + 2), 0, 0);
+		RainbowWheel_Wheel(((i * 256 / pixel_count) + j) & 255, c);
+		Strip_setPixelWithBrig(pixel_count - 1 - i, c[0], c[1], c[2], 0, 0);
 	}
 	Strip_Apply();
 	j++;
@@ -230,8 +227,9 @@ static int chase_rainbow_pos = 0;
 void TheaterChaseRainbow_Run() {
 	for (int i = 0; i < pixel_count; i++) {
 		if ((i + chase_rainbow_pos) % 3 == 0) {
-			byte *c = RainbowWheel_Wheel((i + chase_rainbow_pos * 8) & 255);
-			Strip_setPixelWithBrig(i, *c, *(c + 1), *(c + 2), 0, 0);
+			byte c[3];
+			RainbowWheel_Wheel((i + chase_rainbow_pos * 8) & 255, c);
+			Strip_setPixelWithBrig(i, c[0], c[1], c[2], 0, 0);
 		}
 		else {
 			Strip_setPixelWithBrig(i, 0, 0, 0, 0, 0);
@@ -242,6 +240,509 @@ void TheaterChaseRainbow_Run() {
 	chase_rainbow_pos++;
 	if (chase_rainbow_pos >= 3) chase_rainbow_pos = 0;
 }
+
+// Segment engine, strip ranges have own effects. Frame is made in stages
+// that work on whole segment at once with integer math: generator makes
+// palette index and level of each pixel, palette map turns index into RGB,
+// level and brightness scale it and blend puts it into RGB frame, which
+// goes to strip in one Strip_BlitPixels. Function pointers of stages are
+// picked when segment is set, not per pixel.
+//
+// PixelSeg 0 0 30 Rainbow
+// PixelSeg 1 30 30 Fire
+// PixelSegSet 1 speed 512
+#define PA_MAX_SEGMENTS		8
+// 16 colours and one more, so interpolation does not need to wrap
+#define PA_PALETTE_SIZE		17
+
+typedef struct paSegment_s paSegment_t;
+// idx, lvl and state are count bytes from first pixel of segment
+typedef void (*paGenerator_t)(paSegment_t *s, byte *idx, byte *lvl, byte *state);
+typedef void (*paBlend_t)(byte *dst, const byte *src, int len);
+
+struct paSegment_s {
+	int first;
+	// 0 if segment is not used
+	int count;
+	byte effect;
+	byte palette;
+	byte blend;
+	byte brightness;
+	byte intensity;
+	byte color[3];
+	// phase step per frame, 256 is one palette index
+	int speed;
+	unsigned short phase;
+	// set by PA_CompileSegment
+	paGenerator_t gen;
+	// 0 means plain segment colour
+	const byte *pal;
+	paBlend_t blendFn;
+};
+
+typedef struct paEffect_s {
+	const char *name;
+	paGenerator_t gen;
+	byte defaultPalette;
+} paEffect_t;
+
+typedef struct paPalette_s {
+	const char *name;
+	byte colors[PA_PALETTE_SIZE][3];
+} paPalette_t;
+
+typedef struct paBlendMode_s {
+	const char *name;
+	paBlend_t fn;
+} paBlendMode_t;
+
+extern float g_brightness0to100;
+
+static paSegment_t pa_segments[PA_MAX_SEGMENTS];
+static bool pa_segmentsActive = false;
+// per pixel: RGB frame, RGB of segment, index, level and state
+static byte *pa_buffer = 0;
+static int pa_bufferPixels = 0;
+
+// sine with 0-255 range for 0-255 angle, parabola is close enough
+static byte PA_Sin8(byte x) {
+	int t = x & 127;
+	int y = (t * (128 - t)) >> 5;
+
+	if (y > 127) {
+		y = 127;
+	}
+	return (x < 128) ? 128 + y : 128 - y;
+}
+
+static void PA_Gen_Solid(paSegment_t *s, byte *idx, byte *lvl, byte *state) {
+	memset(idx, s->phase >> 8, s->count);
+	memset(lvl, 255, s->count);
+}
+static void PA_Gen_Rainbow(paSegment_t *s, byte *idx, byte *lvl, byte *state) {
+	int i, at, step;
+
+	// index in 1/256, so short segments still get whole palette
+	step = (256 << 8) / s->count;
+	at = s->phase;
+	for (i = 0; i < s->count; i++) {
+		idx[i] = at >> 8;
+		at += step;
+	}
+	memset(lvl, 255, s->count);
+}
+static void PA_Gen_Wave(paSegment_t *s, byte *idx, byte *lvl, byte *state) {
+	int i;
+
+	PA_Gen_Rainbow(s, idx, lvl, state);
+	for (i = 0; i < s->count; i++) {
+		// more intensity, shorter waves
+		idx[i] -= s->phase >> 8;
+		lvl[i] = PA_Sin8(((i * (s->intensity + 1)) >> 3) - (s->phase >> 8));
+	}
+}
+static void PA_Gen_Chase(paSegment_t *s, byte *idx, byte *lvl, byte *state) {
+	int i, at;
+
+	PA_Gen_Rainbow(s, idx, lvl, state);
+	at = s->phase >> 8;
+	for (i = 0; i < s->count; i++) {
+		idx[i] -= at;
+		lvl[i] = ((i + at) % 3 == 0) ? 255 : 0;
+	}
+}
+static void PA_Gen_Comet(paSegment_t *s, byte *idx, byte *lvl, byte *state) {
+	int i, head, fade, span;
+
+	// head goes there and back, more intensity, longer tail
+	span = s->count > 1 ? s->count * 2 - 2 : 1;
+	head = (s->phase >> 8) % span;
+	if (head >= s->count) {
+		head = span - head;
+	}
+	fade = 192 + (s->intensity >> 2);
+	for (i = 0; i < s->count; i++) {
+		state[i] = (state[i] * fade) >> 8;
+	}
+	state[head] = 255;
+	memcpy(idx, state, s->count);
+	memcpy(lvl, state, s->count);
+}
+static void PA_Gen_Twinkle(paSegment_t *s, byte *idx, byte *lvl, byte *state) {
+	int i, fade;
+
+	PA_Gen_Rainbow(s, idx, lvl, state);
+	fade = (s->intensity >> 4) + 4;
+	for (i = 0; i < s->count; i++) {
+		state[i] = state[i] > fade ? state[i] - fade : 0;
+	}
+	if ((rand() & 255) < (s->intensity >> 2) + 8) {
+		state[rand() % s->count] = 255;
+	}
+	memcpy(lvl, state, s->count);
+}
+static void PA_Gen_Fire(paSegment_t *s, byte *idx, byte *lvl, byte *state) {
+	int i, cooldown, y, v;
+
+	// like Fire_Run, state is heat, intensity is how often sparks come
+	for (i = 0; i < s->count; i++) {
+		cooldown = rand() % (((FlameHeight * 10) / s->count) + 2);
+		state[i] = cooldown > state[i] ? 0 : state[i] - cooldown;
+	}
+	for (i = s->count - 1; i >= 2; i--) {
+		state[i] = (state[i - 1] + state[i - 2] + state[i - 2]) / 3;
+	}
+	if ((rand() & 255) < s->intensity) {
+		y = rand() % (s->count < 7 ? s->count : 7);
+		v = state[y] + 160 + rand() % 96;
+		state[y] = v > 255 ? 255 : v;
+	}
+	for (i = 0; i < s->count; i++) {
+		// 0-240, so hottest does not go past last palette colour
+		idx[i] = (state[i] * 15) >> 4;
+	}
+	memset(lvl, 255, s->count);
+}
+
+static const paEffect_t pa_effects[] = {
+	{ "Solid", PA_Gen_Solid, 0 },
+	{ "Rainbow", PA_Gen_Rainbow, 1 },
+	{ "Wave", PA_Gen_Wave, 0 },
+	{ "Chase", PA_Gen_Chase, 0 },
+	{ "Comet", PA_Gen_Comet, 0 },
+	{ "Twinkle", PA_Gen_Twinkle, 5 },
+	{ "Fire", PA_Gen_Fire, 2 },
+};
+#define PA_NUM_EFFECTS (sizeof(pa_effects) / sizeof(pa_effects[0]))
+
+static const paPalette_t pa_palettes[] = {
+	// segment colour, has no table
+	{ "Color", { { 0 } } },
+	{ "Rainbow", {
+		{ 255, 0, 0 }, { 213, 42, 0 }, { 171, 85, 0 }, { 171, 127, 0 },
+		{ 171, 171, 0 }, { 86, 213, 0 }, { 0, 255, 0 }, { 0, 213, 42 },
+		{ 0, 171, 85 }, { 0, 86, 170 }, { 0, 0, 255 }, { 42, 0, 213 },
+		{ 85, 0, 171 }, { 127, 0, 129 }, { 171, 0, 85 }, { 213, 0, 43 },
+		{ 255, 0, 0 } } },
+	{ "Fire", {
+		{ 0, 0, 0 }, { 32, 0, 0 }, { 64, 0, 0 }, { 96, 0, 0 },
+		{ 128, 0, 0 }, { 160, 0, 0 }, { 192, 0, 0 }, { 224, 16, 0 },
+		{ 255, 32, 0 }, { 255, 64, 0 }, { 255, 96, 0 }, { 255, 128, 0 },
+		{ 255, 160, 0 }, { 255, 192, 0 }, { 255, 224, 64 }, { 255, 255, 160 },
+		{ 255, 255, 255 } } },
+	{ "Ocean", {
+		{ 0, 0, 32 }, { 0, 0, 64 }, { 0, 0, 96 }, { 0, 16, 128 },
+		{ 0, 32, 160 }, { 0, 64, 192 }, { 0, 96, 224 }, { 0, 128, 255 },
+		{ 0, 160, 255 }, { 32, 192, 255 }, { 64, 224, 255 }, { 32, 192, 224 },
+		{ 0, 160, 192 }, { 0, 128, 160 }, { 0, 64, 128 }, { 0, 32, 64 },
+		{ 0, 0, 32 } } },
+	{ "Forest", {
+		{ 0, 32, 0 }, { 0, 64, 0 }, { 16, 96, 0 }, { 32, 128, 0 },
+		{ 64, 160, 0 }, { 96, 192, 32 }, { 64, 160, 32 }, { 32, 128, 16 },
+		{ 0, 96, 0 }, { 48, 80, 0 }, { 96, 64, 0 }, { 128, 96, 16 },
+		{ 96, 128, 0 }, { 64, 160, 0 }, { 32, 96, 0 }, { 0, 64, 0 },
+		{ 0, 32, 0 } } },
+	{ "Party", {
+		{ 85, 0, 171 }, { 132, 0, 124 }, { 181, 0, 75 }, { 229, 0, 27 },
+		{ 232, 23, 0 }, { 184, 71, 0 }, { 171, 119, 0 }, { 171, 171, 0 },
+		{ 171, 85, 0 }, { 221, 34, 0 }, { 242, 0, 14 }, { 194, 0, 62 },
+		{ 143, 0, 113 }, { 95, 0, 161 }, { 47, 0, 208 }, { 0, 7, 249 },
+		{ 85, 0, 171 } } },
+};
+#define PA_NUM_PALETTES (sizeof(pa_palettes) / sizeof(pa_palettes[0]))
+
+static void PA_Blend_Replace(byte *dst, const byte *src, int len) {
+	memcpy(dst, src, len);
+}
+static void PA_Blend_Add(byte *dst, const byte *src, int len) {
+	int i, v;
+
+	for (i = 0; i < len; i++) {
+		v = dst[i] + src[i];
+		dst[i] = v > 255 ? 255 : v;
+	}
+}
+static void PA_Blend_Max(byte *dst, const byte *src, int len) {
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (src[i] > dst[i]) {
+			dst[i] = src[i];
+		}
+	}
+}
+static void PA_Blend_Average(byte *dst, const byte *src, int len) {
+	int i;
+
+	for (i = 0; i < len; i++) {
+		dst[i] = (dst[i] + src[i] + 1) >> 1;
+	}
+}
+
+static const paBlendMode_t pa_blends[] = {
+	{ "Replace", PA_Blend_Replace },
+	{ "Add", PA_Blend_Add },
+	{ "Max", PA_Blend_Max },
+	{ "Average", PA_Blend_Average },
+};
+#define PA_NUM_BLENDS (sizeof(pa_blends) / sizeof(pa_blends[0]))
+
+static void PA_MapPalette(const paSegment_t *s, const byte *idx, byte *rgb) {
+	const byte *a, *b;
+	int i, k, frac;
+
+	if (s->pal == 0) {
+		for (i = 0; i < s->count; i++, rgb += 3) {
+			memcpy(rgb, s->color, 3);
+		}
+		return;
+	}
+	for (i = 0; i < s->count; i++, rgb += 3) {
+		a = s->pal + (idx[i] >> 4) * 3;
+		b = a + 3;
+		frac = idx[i] & 15;
+		for (k = 0; k < 3; k++) {
+			rgb[k] = a[k] + (((b[k] - a[k]) * frac) >> 4);
+		}
+	}
+}
+// level of pixel, brightness of segment and dimmer together
+static void PA_ApplyBrightness(const paSegment_t *s, const byte *lvl, byte *rgb, int dimmer) {
+	int i, scale, bright;
+
+	bright = ((s->brightness + 1) * dimmer) >> 8;
+	for (i = 0; i < s->count; i++, rgb += 3) {
+		scale = ((lvl[i] * bright) >> 8) + 1;
+		rgb[0] = (rgb[0] * scale) >> 8;
+		rgb[1] = (rgb[1] * scale) >> 8;
+		rgb[2] = (rgb[2] * scale) >> 8;
+	}
+}
+static void PA_CompileSegment(paSegment_t *s) {
+	s->gen = pa_effects[s->effect].gen;
+	s->pal = s->palette ? &pa_palettes[s->palette].colors[0][0] : 0;
+	s->blendFn = pa_blends[s->blend].fn;
+}
+static bool PA_EnsureBuffer() {
+	if (pa_bufferPixels >= (int)pixel_count && pa_buffer) {
+		return true;
+	}
+	free(pa_buffer);
+	pa_buffer = (byte*)calloc(pixel_count, 9);
+	pa_bufferPixels = pa_buffer ? pixel_count : 0;
+	return pa_buffer != 0;
+}
+static void PA_RenderSegments() {
+	paSegment_t *s;
+	byte *frame, *rgb, *idx, *lvl, *state;
+	int i, dimmer, full;
+
+	if (pixel_count == 0 || PA_EnsureBuffer() == false) {
+		return;
+	}
+	frame = pa_buffer;
+	rgb = frame + pa_bufferPixels * 3;
+	idx = rgb + pa_bufferPixels * 3;
+	lvl = idx + pa_bufferPixels;
+	state = lvl + pa_bufferPixels;
+	dimmer = 256;
+#if ENABLE_LED_BASIC
+	dimmer = (int)(g_brightness0to100 * 2.56f);
+#endif
+	memset(frame, 0, pixel_count * 3);
+	for (i = 0; i < PA_MAX_SEGMENTS; i++) {
+		s = &pa_segments[i];
+		if (s->count <= 0 || s->first >= (int)pixel_count) {
+			continue;
+		}
+		// strip may have been made shorter since
+		full = s->count;
+		if (s->first + s->count > (int)pixel_count) {
+			s->count = pixel_count - s->first;
+		}
+		s->gen(s, idx + s->first, lvl + s->first, state + s->first);
+		PA_MapPalette(s, idx + s->first, rgb);
+		PA_ApplyBrightness(s, lvl + s->first, rgb, dimmer);
+		s->blendFn(frame + s->first * 3, rgb, s->count * 3);
+		s->count = full;
+		s->phase += s->speed;
+	}
+	Strip_BlitPixels(0, frame, pixel_count, 3);
+	Strip_Apply();
+}
+// name or index
+static int PA_FindName(const char *arg, const char *first, int stride, int count) {
+	int i;
+
+	if (arg == 0 || *arg == 0) {
+		return -1;
+	}
+	if (isdigit((unsigned char)*arg)) {
+		i = atoi(arg);
+		return i < count ? i : -1;
+	}
+	for (i = 0; i < count; i++) {
+		if (!stricmp(arg, *(const char**)(first + i * stride))) {
+			return i;
+		}
+	}
+	return -1;
+}
+#define PA_FindEffect(arg) PA_FindName(arg, (const char*)&pa_effects[0].name, sizeof(paEffect_t), PA_NUM_EFFECTS)
+#define PA_FindPalette(arg) PA_FindName(arg, (const char*)&pa_palettes[0].name, sizeof(paPalette_t), PA_NUM_PALETTES)
+#define PA_FindBlend(arg) PA_FindName(arg, (const char*)&pa_blends[0].name, sizeof(paBlendMode_t), PA_NUM_BLENDS)
+
+static void PA_EnterSegmentMode() {
+	activeAnim = -1;
+	pa_segmentsActive = true;
+	g_lightMode = Light_Anim;
+	if (CFG_HasFlag(OBK_FLAG_LED_AUTOENABLE_ON_ANY_ACTION)) {
+		LED_SetEnableAll(true);
+	}
+	apply_smart_light();
+	MQTT_PublishMain_StringString_DeDuped(DEDUP_CURRENT_ANIM, DEDUP_EXPIRE_TIME, "currentAnim", "Segments", 0);
+}
+static void PA_PrintSegments() {
+	paSegment_t *s;
+	int i;
+
+	for (i = 0; i < PA_MAX_SEGMENTS; i++) {
+		s = &pa_segments[i];
+		if (s->count <= 0) {
+			continue;
+		}
+		ADDLOG_INFO(LOG_FEATURE_CMD, "Segment %i: pixels %i-%i, %s, palette %s, speed %i, intensity %i, brightness %i, %s",
+			i, s->first, s->first + s->count - 1, pa_effects[s->effect].name, pa_palettes[s->palette].name,
+			s->speed, s->intensity, s->brightness, pa_blends[s->blend].name);
+	}
+}
+// PixelSeg Index FirstPixel PixelCount [Effect] [Palette] [Speed] [Brightness]
+commandResult_t PA_Cmd_Segment(const void *context, const char *cmd, const char *args, int flags) {
+	paSegment_t *s;
+	int i, effect, palette;
+
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() == 0) {
+		PA_PrintSegments();
+		return CMD_RES_OK;
+	}
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 3)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	i = Tokenizer_GetArgInteger(0);
+	if (i < 0 || i >= PA_MAX_SEGMENTS) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	s = &pa_segments[i];
+	effect = 1;
+	if (Tokenizer_GetArgsCount() > 3) {
+		effect = PA_FindEffect(Tokenizer_GetArg(3));
+		if (effect < 0) {
+			return CMD_RES_BAD_ARGUMENT;
+		}
+	}
+	palette = pa_effects[effect].defaultPalette;
+	if (Tokenizer_GetArgsCount() > 4) {
+		palette = PA_FindPalette(Tokenizer_GetArg(4));
+		if (palette < 0) {
+			return CMD_RES_BAD_ARGUMENT;
+		}
+	}
+	memset(s, 0, sizeof(*s));
+	s->first = Tokenizer_GetArgIntegerRange(1, 0, 0xFFFF);
+	s->count = Tokenizer_GetArgIntegerRange(2, 0, 0xFFFF);
+	s->effect = effect;
+	s->palette = palette;
+	s->speed = Tokenizer_GetArgIntegerDefault(5, 256);
+	s->brightness = Tokenizer_GetArgIntegerRange(6, 0, 255);
+	if (Tokenizer_GetArgsCount() <= 6) {
+		s->brightness = 255;
+	}
+	s->intensity = 128;
+	for (i = 0; i < 3; i++) {
+		s->color[i] = led_baseColors[i];
+	}
+	PA_CompileSegment(s);
+	PA_EnterSegmentMode();
+
+	return CMD_RES_OK;
+}
+// PixelSegSet Index Param Value
+commandResult_t PA_Cmd_SegmentSet(const void *context, const char *cmd, const char *args, int flags) {
+	paSegment_t *s;
+	const char *param, *val;
+	int i, v;
+
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 3)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	i = Tokenizer_GetArgInteger(0);
+	if (i < 0 || i >= PA_MAX_SEGMENTS) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	s = &pa_segments[i];
+	param = Tokenizer_GetArg(1);
+	val = Tokenizer_GetArg(2);
+	v = Tokenizer_GetArgInteger(2);
+	if (!stricmp(param, "effect")) {
+		v = PA_FindEffect(val);
+		if (v < 0) {
+			return CMD_RES_BAD_ARGUMENT;
+		}
+		s->effect = v;
+	}
+	else if (!stricmp(param, "palette")) {
+		v = PA_FindPalette(val);
+		if (v < 0) {
+			return CMD_RES_BAD_ARGUMENT;
+		}
+		s->palette = v;
+	}
+	else if (!stricmp(param, "blend")) {
+		v = PA_FindBlend(val);
+		if (v < 0) {
+			return CMD_RES_BAD_ARGUMENT;
+		}
+		s->blend = v;
+	}
+	else if (!stricmp(param, "color")) {
+		if (*val == '#') {
+			val++;
+		}
+		if (strlen(val) < 6) {
+			return CMD_RES_BAD_ARGUMENT;
+		}
+		for (i = 0; i < 3; i++) {
+			s->color[i] = hexbyte(val + i * 2);
+		}
+	}
+	else if (!stricmp(param, "speed")) {
+		s->speed = v;
+	}
+	else if (!stricmp(param, "intensity")) {
+		s->intensity = v < 0 ? 0 : (v > 255 ? 255 : v);
+	}
+	else if (!stricmp(param, "brightness")) {
+		s->brightness = v < 0 ? 0 : (v > 255 ? 255 : v);
+	}
+	else if (!stricmp(param, "first")) {
+		s->first = v < 0 ? 0 : v;
+	}
+	else if (!stricmp(param, "count")) {
+		s->count = v < 0 ? 0 : v;
+	}
+	else {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "PixelSegSet: unknown %s", param);
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	PA_CompileSegment(s);
+	PA_EnterSegmentMode();
+
+	return CMD_RES_OK;
+}
 // startDriver PixelAnim
 
 int activeAnim = -1;
@@ -259,6 +760,7 @@ int g_speed = 0;
 void PixelAnim_SetAnim(int j)
 {
 	activeAnim = j;
+	pa_segmentsActive = false;
 	if(j >= 0)
 	{
 		g_lightMode = Light_Anim;
@@ -310,6 +812,16 @@ void PixelAnim_Init() {
 	//cmddetail:"fn":"PA_Cmd_AnimSpeed","file":"driver/drv_pixelAnim.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("AnimSpeed", PA_Cmd_AnimSpeed, NULL);
+	//cmddetail:{"name":"PixelSeg","args":"[Index] [FirstPixel] [PixelCount] [Effect] [Palette] [Speed] [Brightness]",
+	//cmddetail:"descr":"Sets strip segment with its own effect, up to 8 segments. Effect is name or index: Solid, Rainbow, Wave, Chase, Comet, Twinkle, Fire. Palette: Color (segment colour, default is base colour), Rainbow, Fire, Ocean, Forest, Party. Speed is phase step per frame, 256 (default) is one palette step. PixelCount 0 removes segment. Without arguments, prints segments. Setting segment starts segment mode, Anim goes back to single animation.",
+	//cmddetail:"fn":"PA_Cmd_Segment","file":"driver/drv_pixelAnim.c","requires":"",
+	//cmddetail:"examples":"PixelSeg 0 0 30 Rainbow<br>PixelSeg 1 30 30 Fire Fire 512"}
+	CMD_RegisterCommand("PixelSeg", PA_Cmd_Segment, NULL);
+	//cmddetail:{"name":"PixelSegSet","args":"[Index] [Param] [Value]",
+	//cmddetail:"descr":"Sets one parameter of strip segment: effect, palette, speed, intensity (0-255, wave length, tail, sparks), brightness (0-255), blend (Replace, Add, Max, Average, how segment goes over lower ones), color (RRGGBB), first, count.",
+	//cmddetail:"fn":"PA_Cmd_SegmentSet","file":"driver/drv_pixelAnim.c","requires":"",
+	//cmddetail:"examples":"PixelSegSet 1 color FF8000"}
+	CMD_RegisterCommand("PixelSegSet", PA_Cmd_SegmentSet, NULL);
 }
 
 void PixelAnim_CreatePanel(http_request_t *request) {
@@ -356,6 +868,16 @@ void PixelAnim_CreatePanel(http_request_t *request) {
 			c, g_anims[i].name);
 	}
 	poststr(request, "</td></tr>");
+
+	for (i = 0; i < PA_MAX_SEGMENTS; i++) {
+		paSegment_t *s = &pa_segments[i];
+		if (s->count <= 0) {
+			continue;
+		}
+		hprintf255(request, "<tr><td>Segment %i%s: pixels %i-%i, %s, palette %s</td></tr>",
+			i, pa_segmentsActive ? " [ACTIVE]" : "", s->first, s->first + s->count - 1,
+			pa_effects[s->effect].name, pa_palettes[s->palette].name);
+	}
 }
 int g_ticks = 0;
 void PixelAnim_SetAnimQuickTick() {
@@ -364,14 +886,23 @@ void PixelAnim_SetAnimQuickTick() {
 		return;
 	}
 	if (g_lightMode != Light_Anim) {
-		if(activeAnim != -1) PixelAnim_SetAnim(-1);
+		if(activeAnim != -1 || pa_segmentsActive) PixelAnim_SetAnim(-1);
 		// disabled
 		return;
 	}
-	if (activeAnim != -1) {
+	if (activeAnim != -1 || pa_segmentsActive) {
+		// paced strip would only replace frame still waiting
+		if (Strip_WantsFrame() == false) {
+			return;
+		}
 		g_ticks++;
 		if (g_ticks >= g_speed) {
-			g_anims[activeAnim].runFunc();
+			if (pa_segmentsActive) {
+				PA_RenderSegments();
+			}
+			else {
+				g_anims[activeAnim].runFunc();
+			}
 			g_ticks = 0;
 		}
 	}
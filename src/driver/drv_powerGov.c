@@ -0,0 +1,263 @@
+// power save governor
+#include "../new_common.h"
+#include "../logging/logging.h"
+#include "../quicktick.h"
+#include "../cmnds/cmd_public.h"
+#include "../httpserver/new_http.h"
+#include "drv_local.h"
+#include "drv_powerGov.h"
+#if ENABLE_MQTT
+#include "../mqtt/new_mqtt.h"
+#endif
+
+#if ENABLE_DRIVER_POWERGOV
+
+// Switches PowerSave level by itself. Any sign of work (received MQTT
+// command, HTTP request, burst of MQTT publishes, LED transition, driver
+// or script that wants to run again within PG_BUSY_WAKE_MS) goes to level
+// 0 at once, idle device goes down to level 1 and later to MaxLevel.
+// Going down needs whole idle delay, so short pauses in traffic don't
+// make it flip between levels.
+// On ESP-IDF it can also keep CPU at full clock in level 0 and let PM
+// scale it between given limits in others.
+
+#define PG_BUSY_WAKE_MS			100
+#define PG_BUSY_PUBLISHES		4
+
+typedef struct powerGov_s {
+	bool bRunning;
+	int level;
+	// PowerSave level from before start, set again on stop
+	int prevLevel;
+	int maxLevel;
+	int lightDelay;
+	int deepDelay;
+	int minMHz;
+	int maxMHz;
+	int idleSeconds;
+	int lastPublishes;
+	int lastReceived;
+	int seconds[PG_MAX_LEVEL + 1];
+	int switches;
+	int kicks;
+} powerGov_t;
+
+static powerGov_t g_pg;
+static volatile byte g_pgKick = 0;
+
+static void PowerGov_SetLevel(int level) {
+	if (level == g_pg.level) {
+		return;
+	}
+	// WiFi not ready, tried again on next second
+	if (CMD_ApplyPowerSave(level) < 0) {
+		return;
+	}
+#if PLATFORM_ESPIDF
+	if (g_pg.maxMHz) {
+		CMD_SetCpuFreqRange(level ? g_pg.minMHz : g_pg.maxMHz, g_pg.maxMHz);
+	}
+#endif
+	ADDLOG_DEBUG(LOG_FEATURE_CMD, "PowerGov: level %i -> %i", g_pg.level, level);
+	g_pg.level = level;
+	g_pg.switches++;
+}
+static bool PowerGov_IsBusy() {
+	bool bBusy = false;
+	int wake;
+
+	if (g_pgKick) {
+		g_pgKick = 0;
+		bBusy = true;
+	}
+#if ENABLE_MQTT
+	{
+		int pub = MQTT_GetPublishEventCounter();
+		int rcv = MQTT_GetReceivedEventCounter();
+		if (rcv != g_pg.lastReceived || pub - g_pg.lastPublishes > PG_BUSY_PUBLISHES) {
+			bBusy = true;
+		}
+		g_pg.lastPublishes = pub;
+		g_pg.lastReceived = rcv;
+	}
+#endif
+#if ENABLE_LED_BASIC
+	if (LED_GetTimeToNextWakeMS() != -1) {
+		bBusy = true;
+	}
+#endif
+	// drivers polled on every tick and short script delays
+	wake = DRV_GetTimeToNextWakeMS();
+	if (wake != -1 && wake < PG_BUSY_WAKE_MS) {
+		bBusy = true;
+	}
+#if ENABLE_OBK_SCRIPTING
+	wake = SVM_GetTimeToNextWakeMS();
+	if (wake != -1 && wake < PG_BUSY_WAKE_MS) {
+		bBusy = true;
+	}
+#endif
+	return bBusy;
+}
+void PowerGov_Kick() {
+	if (g_pg.bRunning == false) {
+		return;
+	}
+	g_pgKick = 1;
+	QuickTick_Wake();
+}
+void PowerGov_RunQuickTick() {
+	if (g_pg.bRunning == false || g_pgKick == 0) {
+		return;
+	}
+	// flag stays for next second, so it also restarts idle time
+	g_pg.kicks++;
+	PowerGov_SetLevel(0);
+}
+int PowerGov_GetTimeToNextWakeMS() {
+	if (g_pg.bRunning && g_pgKick && g_pg.level) {
+		return 0;
+	}
+	return -1;
+}
+int PowerGov_GetLevel() {
+	return g_pg.level;
+}
+int PowerGov_GetResidency(int level) {
+	if (level < 0 || level > PG_MAX_LEVEL) {
+		return 0;
+	}
+	return g_pg.seconds[level];
+}
+int PowerGov_GetSwitches() {
+	return g_pg.switches;
+}
+void PowerGov_OnEverySecond() {
+	int target;
+
+	g_pg.seconds[g_pg.level]++;
+	if (PowerGov_IsBusy()) {
+		g_pg.idleSeconds = 0;
+	}
+	else {
+		g_pg.idleSeconds++;
+	}
+	if (g_pg.idleSeconds >= g_pg.deepDelay) {
+		target = g_pg.maxLevel;
+	}
+	else if (g_pg.idleSeconds >= g_pg.lightDelay) {
+		target = 1;
+	}
+	else {
+		target = 0;
+	}
+	PowerGov_SetLevel(target);
+}
+void PowerGov_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
+	int i, total = 0;
+
+	if (bPreState) {
+		return;
+	}
+	for (i = 0; i <= PG_MAX_LEVEL; i++) {
+		total += g_pg.seconds[i];
+	}
+	if (total == 0) {
+		total = 1;
+	}
+	hprintf255(request, "<h5>PowerGov level %i, time in levels", g_pg.level);
+	for (i = 0; i <= g_pg.maxLevel; i++) {
+		hprintf255(request, " %i: %i%%", i, g_pg.seconds[i] * 100 / total);
+	}
+	hprintf255(request, ", %i switches</h5>", g_pg.switches);
+}
+void PowerGov_Stop() {
+	g_pg.bRunning = false;
+	g_pgKick = 0;
+	CMD_ApplyPowerSave(g_pg.prevLevel);
+#if PLATFORM_ESPIDF
+	if (g_pg.maxMHz) {
+		CMD_SetCpuFreqRange(g_pg.minMHz, g_pg.maxMHz);
+	}
+#endif
+}
+// PowerGov [MaxLevel] [LightDelaySec] [DeepDelaySec] [MinMHz] [MaxMHz]
+static commandResult_t CMD_PowerGov(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() > 0) {
+		g_pg.maxLevel = Tokenizer_GetArgInteger(0);
+		if (g_pg.maxLevel < 1) {
+			g_pg.maxLevel = 1;
+		}
+		if (g_pg.maxLevel > PG_MAX_LEVEL) {
+			g_pg.maxLevel = PG_MAX_LEVEL;
+		}
+	}
+	if (Tokenizer_GetArgsCount() > 1) {
+		g_pg.lightDelay = Tokenizer_GetArgInteger(1);
+	}
+	if (Tokenizer_GetArgsCount() > 2) {
+		g_pg.deepDelay = Tokenizer_GetArgInteger(2);
+	}
+	if (g_pg.deepDelay < g_pg.lightDelay) {
+		g_pg.deepDelay = g_pg.lightDelay;
+	}
+	if (Tokenizer_GetArgsCount() > 4) {
+		g_pg.minMHz = Tokenizer_GetArgInteger(3);
+		g_pg.maxMHz = Tokenizer_GetArgInteger(4);
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "PowerGov: max level %i, light after %i s, deep after %i s",
+		g_pg.maxLevel, g_pg.lightDelay, g_pg.deepDelay);
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_PowerGov_Stats(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int i;
+
+	for (i = 0; i <= g_pg.maxLevel; i++) {
+		ADDLOG_INFO(LOG_FEATURE_CMD, "PowerGov level %i: %i s", i, g_pg.seconds[i]);
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "PowerGov: now %i, idle %i s, %i switches, %i wakes by requests",
+		g_pg.level, g_pg.idleSeconds, g_pg.switches, g_pg.kicks);
+	if (!stricmp(args, "reset")) {
+		memset(g_pg.seconds, 0, sizeof(g_pg.seconds));
+		g_pg.switches = 0;
+		g_pg.kicks = 0;
+	}
+	return CMD_RES_OK;
+}
+// startDriver PowerGov
+// PowerGov 2 10 60
+void PowerGov_Init() {
+	memset(&g_pg, 0, sizeof(g_pg));
+	g_pg.prevLevel = CMD_GetPowerSaveLevel();
+	g_pg.maxLevel = 2;
+	g_pg.lightDelay = 10;
+	g_pg.deepDelay = 60;
+	// start from full performance, idle time brings it down
+	g_pg.level = -1;
+	PowerGov_SetLevel(0);
+	if (g_pg.level < 0) {
+		g_pg.level = 0;
+	}
+	g_pg.switches = 0;
+#if ENABLE_MQTT
+	g_pg.lastPublishes = MQTT_GetPublishEventCounter();
+	g_pg.lastReceived = MQTT_GetReceivedEventCounter();
+#endif
+	g_pgKick = 0;
+	g_pg.bRunning = true;
+
+	//cmddetail:{"name":"PowerGov","args":"[MaxLevel] [LightDelaySec] [DeepDelaySec] [MinMHz] [MaxMHz]",
+	//cmddetail:"descr":"Sets PowerGov driver. Device goes to PowerSave 1 after LightDelaySec without work and to MaxLevel after DeepDelaySec, any command or page request brings it back to 0. MinMHz and MaxMHz set CPU clock scaling on ESP-IDF.",
+	//cmddetail:"fn":"CMD_PowerGov","file":"driver/drv_powerGov.c","requires":"",
+	//cmddetail:"examples":"PowerGov 2 10 60"}
+	CMD_RegisterCommand("PowerGov", CMD_PowerGov, NULL);
+	//cmddetail:{"name":"PowerGov_Stats","args":"[reset]",
+	//cmddetail:"descr":"Logs how many seconds PowerGov spent in each PowerSave level and how often it switched. With reset, counting starts again.",
+	//cmddetail:"fn":"CMD_PowerGov_Stats","file":"driver/drv_powerGov.c","requires":"",
+	//cmddetail:"examples":"PowerGov_Stats reset"}
+	CMD_RegisterCommand("PowerGov_Stats", CMD_PowerGov_Stats, NULL);
+}
+
+#endif
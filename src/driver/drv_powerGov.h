@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../obk_config.h"
+
+#define PG_MAX_LEVEL		3
+
+#if ENABLE_DRIVER_POWERGOV
+
+// command or page request arrived, governor goes to full performance
+// on next QuickTick, safe from network threads
+void PowerGov_Kick();
+int PowerGov_GetLevel();
+// seconds spent in given PowerSave level since start or reset
+int PowerGov_GetResidency(int level);
+int PowerGov_GetSwitches();
+
+#else
+
+#define PowerGov_Kick()
+
+#endif
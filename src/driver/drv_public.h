@@ -2,6 +2,7 @@
 #define __DRV_PUBLIC_H__
 
 #include "../httpserver/new_http.h"
+#include "../quicktick.h"
 
 typedef enum energySensor_e {
 	OBK__FIRST = 0,
@@ -47,21 +48,143 @@ typedef struct energySensorNames_s {
 	const char* const hass_uniq_id_suffix; //keep identifiers persistent in case OBK_ENERG_SENSOR changes
 } energySensorNames_t;
 
+// IDs of all drivers known to any build, for quick DRV_IsRunning checks.
+// Must match order of g_driverIdNames in drv_main.c
+typedef enum driverId_e {
+	DRV_ID_TuyaMCU,
+	DRV_ID_tmSensor,
+	DRV_ID_GirierMCU,
+	DRV_ID_TCA9554,
+	DRV_ID_DMX,
+	DRV_ID_Freeze,
+	DRV_ID_PowerGov,
+	DRV_ID_TESTSPIFLASH,
+	DRV_ID_PIR,
+	DRV_ID_PixelAnim,
+	DRV_ID_Drawers,
+	DRV_ID_HGS02,
+	DRV_ID_PinMutex,
+	DRV_ID_GosundSW2,
+	DRV_ID_TCL,
+	DRV_ID_OpenWeatherMap,
+	DRV_ID_Widget,
+	DRV_ID_TestCharts,
+	DRV_ID_Charts,
+	DRV_ID_NTP,
+	DRV_ID_DS3231,
+	DRV_ID_HTTPButtons,
+	DRV_ID_TESTPOWER,
+	DRV_ID_TESTLED,
+	DRV_ID_TESTUART,
+	DRV_ID_Test,
+	DRV_ID_SimpleEEPROM,
+	DRV_ID_MultiPinI2CScanner,
+	DRV_ID_I2C,
+	DRV_ID_RN8209,
+	DRV_ID_BL0942,
+	DRV_ID_HT7017,
+	DRV_ID_KWS303WF,
+	DRV_ID_PWMG,
+	DRV_ID_BL0942SPI,
+	DRV_ID_HLW8112SPI,
+	DRV_ID_ChargingLimit,
+	DRV_ID_BL0937,
+	DRV_ID_CSE7761,
+	DRV_ID_CSE7766,
+	DRV_ID_MAX6675,
+	DRV_ID_MAX31855,
+	DRV_ID_PT6523,
+	DRV_ID_TextScroller,
+	DRV_ID_SM16703P,
+	DRV_ID_SM15155E,
+	DRV_ID_IR,
+	DRV_ID_RC,
+	DRV_ID_IR2,
+	DRV_ID_DDPSend,
+	DRV_ID_DDP,
+	DRV_ID_E131,
+	DRV_ID_SSDP,
+	DRV_ID_DGR,
+	DRV_ID_ChSync,
+	DRV_ID_MDNS,
+	DRV_ID_Wemo,
+	DRV_ID_Hue,
+	DRV_ID_PWMToggler,
+	DRV_ID_DoorSensor,
+	DRV_ID_ADCButton,
+	DRV_ID_MAX72XX_Clock,
+	DRV_ID_SM2135,
+	DRV_ID_BP5758D,
+	DRV_ID_BP1658CJ,
+	DRV_ID_SM2235,
+	DRV_ID_SSD1306,
+	DRV_ID_ST7735,
+	DRV_ID_BMP280,
+	DRV_ID_MAX72XX,
+	DRV_ID_BMPI2C,
+	DRV_ID_CHT83XX,
+	DRV_ID_MCP9808,
+	DRV_ID_KP18058,
+	DRV_ID_ADCSmoother,
+	DRV_ID_SHT3X,
+	DRV_ID_SGP,
+	DRV_ID_ShiftRegister,
+	DRV_ID_AHT2X,
+	DRV_ID_DS1820,
+	DRV_ID_DS1820_FULL,
+	DRV_ID_HT16K33,
+	DRV_ID_TM1637,
+	DRV_ID_GN6932,
+	DRV_ID_TM1638,
+	DRV_ID_HD2015,
+	DRV_ID_Battery,
+	DRV_ID_BKPartitions,
+	DRV_ID_Bridge,
+	DRV_ID_UartTCP,
+	DRV_ID_TXWCAM,
+	DRV_ID_NEO6M,
+	DRV_ID_LTR_ALS,
+	DRV_ID_COUNT,
+} driverId_t;
+
 extern int g_dhtsCount;
 
 void DRV_Generic_Init();
 void DRV_OnHassDiscovery(const char *topic);
 void DRV_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState);
+#if ENABLE_DRIVER_INDEX_CACHE
+// Driver calls it with its append function whenever what it shows on index
+// changes, from then on its part is kept between requests. With NULL all
+// kept parts are dropped.
+void DRV_MarkIndexDirty(void (*appendFunc)(http_request_t* request, int bPreState));
+#else
+#define DRV_MarkIndexDirty(appendFunc)
+#endif
 void DRV_OnEverySecond();
 void DHT_OnEverySecond();
 void DHT_OnPinsConfigChanged();
 void DRV_RunQuickTick();
+int DRV_GetTimeToNextWakeMS();
+#if ENABLE_SYSPERF
+// runQuickTick time of drivers that ran since last reset
+void DRV_ForEachQuickTickStats(void* userData, void (*callback)(const char* name, const perfStat_t* st, void* userData));
+void DRV_ResetQuickTickStats();
+#if ENABLE_DRIVER_INDEX_CACHE
+// index part render time and count of requests served from kept part
+void DRV_ForEachIndexStats(void* userData, void (*callback)(const char* name, const perfStat_t* st, unsigned int hits, void* userData));
+#endif
+#endif
 void DRV_StartDriver(const char* name);
 void DRV_StopDriver(const char* name);
 // right now only used by simulator
 void DRV_ShutdownAllDrivers();
-bool DRV_IsRunning(const char* name);
+// O(1) check by driverId_t
+bool DRV_IsRunning(int driverId);
+// for names given by user, like in startDriver
+bool DRV_IsRunningByName(const char* name);
 void DRV_OnChannelChanged(int channel, int iVal);
+// used by CHANNEL_CommitBatch
+void DRV_OnChannelsChanged(const int* chs, const int* vals, int count);
 #if PLATFORM_BK7231N
 void Strip_setMultiplePixel(uint32_t pixel, uint8_t *data, bool push);
 #endif
@@ -74,9 +197,13 @@ void KP18058_Write(float *rgbcw);
 void DRV_DGR_OnLedDimmerChange(int iVal);
 void DRV_DGR_OnLedEnableAllChange(int iVal);
 void DRV_DGR_OnLedFinalColorsChange(byte rgbcw[5]);
+// DGR_ITEM_COMMAND, run by members that receive events
+void DRV_DGR_Send_Command(const char *groupName, const char *command);
 
 // OBK_POWER etc
 float DRV_GetReading(energySensor_t type);
+// changes when new measurement is taken into readings above
+int DRV_GetReadingsVersion();
 energySensorNames_t* DRV_GetEnergySensorNames(energySensor_t type);
 energySensorNames_t* DRV_GetEnergySensorNamesEx(int asensdatasetix, energySensor_t type);
 bool DRV_IsMeasuringPower();
@@ -87,6 +214,25 @@ bool DRV_IsSensor();
 void TuyaMCU_OnRGBCWChange(const float *rgbcw, int bLightEnableAll, int iLightMode, float brightnessRange01, float temperatureRange01);
 bool TuyaMCU_IsLEDRunning();
 
+// drv_adcSampler.c, ADC burst with spike filter
+// OpenBeken devices heard by SSDP driver
+typedef struct obkPeer_s {
+	uint32_t ip;
+	char name[32];
+	char version[32];
+	// g_secondsElapsed when last heard from
+	int lastSeen;
+} obkPeer_t;
+
+const obkPeer_t *SSDP_FindPeerByIP(uint32_t ip);
+const obkPeer_t *SSDP_FindPeerByName(const char *name);
+const obkPeer_t *SSDP_GetPeer(int index);
+int SSDP_GetPeerSlots();
+int SSDP_GetPeerCount();
+
+int ADCSampler_Filter(const unsigned short *s, int n);
+int ADCSampler_Read(int pinNumber);
+
 
 #endif /* __DRV_PUBLIC_H__ */
 
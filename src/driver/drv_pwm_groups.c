@@ -20,6 +20,17 @@
 
 int PIN_GetPWMIndexForPinIndex(int pin);
 
+#if !PLATFORM_BK7231N
+static unsigned short PWMG_PercentToDuty(int percent) {
+	if (percent <= 0) {
+		return 0;
+	}
+	if (percent >= 100) {
+		return 65535;
+	}
+	return percent * 65535 / 100;
+}
+#endif
 
 // PWMG_Set 10 10 10 1000
 // PWMG_Set Duty1Percent Duty2Percent DeadTimePercent Frequency PinA PinB
@@ -55,6 +66,22 @@ static commandResult_t CMD_PWMG_Set(const void* context, const char* cmd, const
 	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "bk_pwm_group_initialize %i", err);
 	err = bk_pwm_group_mode_enable(pwm1);
 	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "bk_pwm_group_mode_enable %i", err);
+#else
+	// no group mode here, both duties are latched together instead and
+	// dead time is not applied
+	int duty1 = (Tokenizer_GetArgIntegerDefault(0, 20));
+	int duty2 = (Tokenizer_GetArgIntegerDefault(1, 20));
+	int freq = (Tokenizer_GetArgIntegerDefault(3, 1000));
+	int pins[2];
+	unsigned short duties[2];
+
+	pins[0] = Tokenizer_GetArgIntegerDefault(4, 6);
+	pins[1] = Tokenizer_GetArgIntegerDefault(5, 7);
+	duties[0] = PWMG_PercentToDuty(duty1);
+	duties[1] = PWMG_PercentToDuty(duty2);
+	HAL_PIN_PWM_Start(pins[0], freq);
+	HAL_PIN_PWM_Start(pins[1], freq);
+	HAL_PIN_PWM_UpdateGroup(pins, duties, 2);
 #endif
 
 	return CMD_RES_OK;
@@ -11,10 +11,12 @@ extern "C" {
 #include "../new_pins.h"
 #include "../new_cfg.h"
 #include "../cmnds/cmd_public.h"
+#include "../quicktick.h"
 
 }
 
 #include "drv_rc.h"
+#include "drv_rc_edges.h"
 #include "../libraries/rc-switch/src/RCSwitch.h"
 
 RCSwitch mySwitch = RCSwitch();
@@ -39,13 +41,22 @@ void DRV_RC_Init() {
 //extern int rc_singleRepeats;
 //extern int rc_repeats;
 static int rc_totalDecoded = 0;
+#define RC_MAX_PROTOCOLS 64
+static unsigned int rc_protocolHits[RC_MAX_PROTOCOLS];
+static unsigned int rc_duplicates = 0;
 
 void RC_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
 
 	if (bPreState) {
 	}
 	else {
-		hprintf255(request, "<h3>RC signals decoded: %i</h3>", rc_totalDecoded);
+		hprintf255(request, "<h3>RC signals decoded: %i (%u repeats dropped, %u edges lost)</h3>",
+			rc_totalDecoded, rc_duplicates, RC_GetEdgeOverflows());
+		for (int i = 0; i < RC_MAX_PROTOCOLS; i++) {
+			if (rc_protocolHits[i]) {
+				hprintf255(request, "<h5>Protocol %i: %u</h5>", i, rc_protocolHits[i]);
+			}
+		}
 		//hprintf255(request, "<h3>Triggers: %i</h3>", (int)rc_triggers);
 		//hprintf255(request, "<h3>Micros: %i</h3>", (int)g_micros);
 		//hprintf255(request, "<h3>g_rcpin: %i</h3>", (int)g_rcpin);
@@ -64,8 +75,13 @@ void DRV_RC_RunFrame() {
 			ADDLOG_INFO(LOG_FEATURE_IR, "Clearing hold timer\n");
 		}
 	}
-	if (mySwitch.available()) {
+	// edges are decoded here, out of timer ISR
+	while (mySwitch.processEdges()) {
 		rc_totalDecoded++;
+		unsigned int protocol = mySwitch.getReceivedProtocol();
+		if (protocol < RC_MAX_PROTOCOLS) {
+			rc_protocolHits[protocol]++;
+		}
 
 		unsigned long rc_now = mySwitch.getReceivedValue();
 		int bHold = 0;
@@ -76,6 +92,11 @@ void DRV_RC_RunFrame() {
 			bHold = 1;
 		}
 		loopsUntilClear = 15;
+		if (RC_IsEarlyRepeat(bHold, g_timeMs)) {
+			rc_duplicates++;
+			mySwitch.resetAvailable();
+			continue;
+		}
 		// TODO 64 bit
 		// generic
 		// addEventHandler RC 1234 toggleChannel 5 123
@@ -86,7 +107,7 @@ void DRV_RC_RunFrame() {
 		ADDLOG_INFO(LOG_FEATURE_IR, "Received %lu / %u bit protocol %u, hold %i\n",
 			rc_now,
 			mySwitch.getReceivedBitlength(),
-			mySwitch.getReceivedProtocol(),
+			protocol,
 			bHold);
 		EventHandlers_FireEvent2(CMD_EVENT_RC, mySwitch.getReceivedValue(), bHold);
 
@@ -0,0 +1,53 @@
+// Edges of RC receiver. Timer ISR only samples pin and queues time of
+// each change, levels alternate so they are not kept. Frames are put
+// together and matched against protocol table from driver task, so noisy
+// receiver does not keep ISR long.
+#include "../new_common.h"
+#include "drv_rc_edges.h"
+
+#if ENABLE_DRIVER_RC || WINDOWS
+
+// One writer (ISR) and one reader (task), so head and tail need no
+// lock, each side only writes its own index.
+static volatile uint32_t rc_edgeTime[RC_EDGE_RING];
+static volatile unsigned int rc_edgeHead = 0;
+static volatile unsigned int rc_edgeTail = 0;
+// edges lost because task did not keep up
+static volatile unsigned int rc_edgeOverflows = 0;
+static unsigned int rc_lastFired = 0;
+
+void RC_PushEdge(uint32_t time) {
+	unsigned int head = rc_edgeHead;
+
+	if (head - rc_edgeTail >= RC_EDGE_RING) {
+		rc_edgeOverflows++;
+		return;
+	}
+	rc_edgeTime[head % RC_EDGE_RING] = time;
+	rc_edgeHead = head + 1;
+}
+
+bool RC_PopEdge(uint32_t *time) {
+	unsigned int tail = rc_edgeTail;
+
+	if (tail == rc_edgeHead) {
+		return false;
+	}
+	*time = rc_edgeTime[tail % RC_EDGE_RING];
+	rc_edgeTail = tail + 1;
+	return true;
+}
+
+unsigned int RC_GetEdgeOverflows() {
+	return rc_edgeOverflows;
+}
+
+bool RC_IsEarlyRepeat(int bHold, unsigned int nowMs) {
+	if (bHold && nowMs - rc_lastFired < RC_DUPLICATE_MS) {
+		return true;
+	}
+	rc_lastFired = nowMs;
+	return false;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __DRV_RC_EDGES_H__
+#define __DRV_RC_EDGES_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// edges queued by timer ISR, decoded from driver task
+#define RC_EDGE_RING 256
+// remote repeats its code many times per press, same code again sooner
+// than this is dropped, so long press still gives hold events at this rate
+#define RC_DUPLICATE_MS 150
+
+void RC_PushEdge(uint32_t time);
+bool RC_PopEdge(uint32_t *time);
+unsigned int RC_GetEdgeOverflows();
+// true if hold repeat came too soon after last event, else it is the last
+bool RC_IsEarlyRepeat(int bHold, unsigned int nowMs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
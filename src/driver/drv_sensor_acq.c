@@ -0,0 +1,236 @@
+#include "../new_common.h"
+#include "../new_pins.h"
+#include "../logging/logging.h"
+#include "../cmnds/cmd_public.h"
+#include "../quicktick.h"
+#include "drv_local.h"
+
+// Sensor drivers register their poll with interval in ms instead of
+// counting seconds in onEverySecond. Polls run from QuickTick on a fixed
+// cadence, so slow sensors can poll every 30 s and fast ones more often
+// than 1 Hz. Poll starts measurement, and driver pushes its values with
+// SensorAcq_Push: they are set to channels and kept in a ring of samples,
+// all stamped with g_timeMs of the poll that took them, so readings of
+// different sensors can be put side by side.
+//
+// SensorInterval [Name] [Ms]
+// SensorSamples [Count]
+
+#define SENSORACQ_MAX_SENSORS	8
+#define SENSORACQ_RING		32
+
+typedef struct acqSensor_s {
+	const char *name;
+	sensorPollFn_t poll;
+	unsigned int intervalMs;
+	unsigned int due;
+	// time of last poll, samples pushed after it carry it
+	unsigned int pollTime;
+	unsigned int polls;
+} acqSensor_t;
+
+static acqSensor_t g_acqSensors[SENSORACQ_MAX_SENSORS];
+static sensorSample_t g_acqRing[SENSORACQ_RING];
+// samples pushed so far, ring holds last SENSORACQ_RING of them
+static unsigned int g_acqHead = 0;
+
+static void SensorAcq_RegisterCommands();
+
+// returns id, driver that starts again gets its old one; -1 if all are used
+int SensorAcq_Register(const char *name, int intervalMs, sensorPollFn_t poll) {
+	acqSensor_t *s;
+	int i, id = -1;
+
+	SensorAcq_RegisterCommands();
+	for (i = 0; i < SENSORACQ_MAX_SENSORS; i++) {
+		s = &g_acqSensors[i];
+		if (s->name && !strcmp(s->name, name)) {
+			id = i;
+			break;
+		}
+		if (s->name == 0 && id == -1) {
+			id = i;
+		}
+	}
+	if (id == -1) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_SENSOR, "SensorAcq: no slot for %s", name);
+		return -1;
+	}
+	s = &g_acqSensors[id];
+	memset(s, 0, sizeof(*s));
+	s->name = name;
+	s->poll = poll;
+	s->intervalMs = intervalMs > 0 ? intervalMs : 1000;
+	// first measurement right away
+	s->due = g_timeMs;
+	QuickTick_Wake();
+	return id;
+}
+void SensorAcq_Unregister(int id) {
+	if (id < 0 || id >= SENSORACQ_MAX_SENSORS) {
+		return;
+	}
+	g_acqSensors[id].name = 0;
+	g_acqSensors[id].poll = 0;
+}
+void SensorAcq_SetInterval(int id, int intervalMs) {
+	acqSensor_t *s;
+
+	if (id < 0 || id >= SENSORACQ_MAX_SENSORS || intervalMs <= 0) {
+		return;
+	}
+	s = &g_acqSensors[id];
+	// counts from last poll, not from the one already planned
+	if (s->polls) {
+		s->due = s->pollTime + intervalMs;
+	}
+	s->intervalMs = intervalMs;
+	QuickTick_Wake();
+}
+static void SensorAcq_Poll(acqSensor_t *s) {
+	s->pollTime = g_timeMs;
+	s->polls++;
+	s->poll();
+}
+// measurement asked by user, cadence stays
+void SensorAcq_PollNow(int id) {
+	if (id < 0 || id >= SENSORACQ_MAX_SENSORS || g_acqSensors[id].poll == 0) {
+		return;
+	}
+	SensorAcq_Poll(&g_acqSensors[id]);
+}
+void SensorAcq_Push(int id, int channel, int value) {
+	sensorSample_t *smp;
+
+	if (id < 0 || id >= SENSORACQ_MAX_SENSORS) {
+		return;
+	}
+	smp = &g_acqRing[g_acqHead % SENSORACQ_RING];
+	smp->timeMs = g_acqSensors[id].pollTime;
+	smp->value = value;
+	smp->sensor = id;
+	smp->channel = channel;
+	g_acqHead++;
+	CHANNEL_Set(channel, value, 0);
+}
+// next sample after *seq, start with 0; samples ring dropped are skipped
+bool SensorAcq_Next(unsigned int *seq, sensorSample_t *out) {
+	if (g_acqHead - *seq > SENSORACQ_RING) {
+		*seq = g_acqHead - SENSORACQ_RING;
+	}
+	if (*seq == g_acqHead) {
+		return false;
+	}
+	*out = g_acqRing[*seq % SENSORACQ_RING];
+	(*seq)++;
+	return true;
+}
+int SensorAcq_Find(const char *name) {
+	int i;
+
+	for (i = 0; i < SENSORACQ_MAX_SENSORS; i++) {
+		if (g_acqSensors[i].poll && !stricmp(g_acqSensors[i].name, name)) {
+			return i;
+		}
+	}
+	return -1;
+}
+const char *SensorAcq_GetName(int id) {
+	if (id < 0 || id >= SENSORACQ_MAX_SENSORS || g_acqSensors[id].name == 0) {
+		return "";
+	}
+	return g_acqSensors[id].name;
+}
+unsigned int SensorAcq_GetPollCount(int id) {
+	if (id < 0 || id >= SENSORACQ_MAX_SENSORS) {
+		return 0;
+	}
+	return g_acqSensors[id].polls;
+}
+
+void SensorAcq_RunQuickTick() {
+	acqSensor_t *s;
+	int i;
+
+	for (i = 0; i < SENSORACQ_MAX_SENSORS; i++) {
+		s = &g_acqSensors[i];
+		if (s->poll == 0 || (int)(g_timeMs - s->due) < 0) {
+			continue;
+		}
+		SensorAcq_Poll(s);
+		s->due += s->intervalMs;
+		// long stall, start cadence again instead of catching up
+		if ((int)(g_timeMs - s->due) >= 0) {
+			s->due = g_timeMs + s->intervalMs;
+		}
+	}
+}
+int SensorAcq_GetTimeToNextWakeMS() {
+	int i, left, best = -1;
+
+	for (i = 0; i < SENSORACQ_MAX_SENSORS; i++) {
+		if (g_acqSensors[i].poll == 0) {
+			continue;
+		}
+		left = g_acqSensors[i].due - g_timeMs;
+		if (left < 0) {
+			left = 0;
+		}
+		if (best == -1 || left < best) {
+			best = left;
+		}
+	}
+	return best;
+}
+
+static commandResult_t CMD_SensorInterval(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	acqSensor_t *s;
+	const char *name;
+	int i;
+
+	Tokenizer_TokenizeString(args, 0);
+	name = Tokenizer_GetArgsCount() >= 1 ? Tokenizer_GetArg(0) : 0;
+	for (i = 0; i < SENSORACQ_MAX_SENSORS; i++) {
+		s = &g_acqSensors[i];
+		if (s->poll == 0 || (name && stricmp(s->name, name))) {
+			continue;
+		}
+		if (name && Tokenizer_GetArgsCount() >= 2) {
+			SensorAcq_SetInterval(i, Tokenizer_GetArgInteger(1));
+		}
+		addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "Sensor %s: every %u ms, %u polls, last %u ms ago",
+			s->name, s->intervalMs, s->polls, g_timeMs - s->pollTime);
+		if (name) {
+			return CMD_RES_OK;
+		}
+	}
+	return name ? CMD_RES_BAD_ARGUMENT : CMD_RES_OK;
+}
+static commandResult_t CMD_SensorSamples(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	sensorSample_t smp;
+	unsigned int seq;
+	int count;
+
+	Tokenizer_TokenizeString(args, 0);
+	count = Tokenizer_GetArgIntegerDefault(0, 8);
+	seq = g_acqHead - (count < SENSORACQ_RING ? count : SENSORACQ_RING);
+	while (SensorAcq_Next(&seq, &smp)) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "%u ms: %s channel %i = %i",
+			smp.timeMs, SensorAcq_GetName(smp.sensor), smp.channel, smp.value);
+	}
+	return CMD_RES_OK;
+}
+
+// again with every sensor, simulator frees commands between tests
+static void SensorAcq_RegisterCommands() {
+	//cmddetail:{"name":"SensorInterval","args":"[Name][Ms]",
+	//cmddetail:"descr":"Sets how often sensor that registered with acquisition layer (AHT2X, SGP) is polled, in ms. Without Ms prints its interval and polls, without arguments prints all sensors.",
+	//cmddetail:"fn":"CMD_SensorInterval","file":"driver/drv_sensor_acq.c","requires":"",
+	//cmddetail:"examples":"SensorInterval AHT2X 30000"}
+	CMD_RegisterCommand("SensorInterval", CMD_SensorInterval, NULL);
+	//cmddetail:{"name":"SensorSamples","args":"[Count]",
+	//cmddetail:"descr":"Prints last Count [default 8] samples pushed by sensors, with time of the poll that took them.",
+	//cmddetail:"fn":"CMD_SensorSamples","file":"driver/drv_sensor_acq.c","requires":"",
+	//cmddetail:"examples":"SensorSamples 16"}
+	CMD_RegisterCommand("SensorSamples", CMD_SensorSamples, NULL);
+}
@@ -15,12 +15,19 @@
 
 #define SGP_I2C_ADDRESS (0x58 << 1)
 
-static byte channel_co2 = 0, channel_tvoc = 0, g_sgpcycle = 1, g_sgpcycleref = 10, g_sgpstate = 0;
+static byte channel_co2 = 0, channel_tvoc = 0, g_sgpcycleref = 10, g_sgpstate = 0;
 static float g_co2 = 0.0, g_tvoc = 0.0;
 static softI2C_t g_sgpI2C;
+static int g_sgpSensor = -1;
 
+// every second while baseline is found, then every g_sgpcycleref seconds
+static void SGP_UpdateInterval() {
+	SensorAcq_SetInterval(g_sgpSensor, g_sgpstate ? g_sgpcycleref * 1000 : 1000);
+}
 
-void SGP_Readmeasure() {
+
+// result of measurement launched by SGP_Readmeasure
+static void SGP_ReadResult(softI2C_t *bus) {
 #if WINDOWS
 	// TODO: values for simulator so I can test SGP
 	// on my Windows machine
@@ -30,14 +37,6 @@ void SGP_Readmeasure() {
 	uint8_t buff[6];
 	unsigned int th, tl, hh, hl;
 
-	// launch measurement on sensor. 
-	Soft_I2C_Start(&g_sgpI2C, SGP_I2C_ADDRESS);
-	Soft_I2C_WriteByte(&g_sgpI2C, 0x20);
-	Soft_I2C_WriteByte(&g_sgpI2C, 0x08);
-	Soft_I2C_Stop(&g_sgpI2C);
-
-	rtos_delay_milliseconds(12);
-
 	Soft_I2C_Start(&g_sgpI2C, SGP_I2C_ADDRESS | 1);
 	Soft_I2C_ReadBytes(&g_sgpI2C, buff, 6);
 	Soft_I2C_Stop(&g_sgpI2C);
@@ -53,6 +52,8 @@ void SGP_Readmeasure() {
 	g_tvoc = ((hh * 256 + hl));
 #endif
 
+	bool wasReady = g_sgpstate;
+
 	channel_co2 = g_cfg.pins.channels[g_sgpI2C.pin_data];
 	channel_tvoc = g_cfg.pins.channels2[g_sgpI2C.pin_data];
 	if (g_co2 == 400.00 && g_tvoc == 0.00)
@@ -62,15 +63,32 @@ void SGP_Readmeasure() {
 	}
 	else {
 		g_sgpstate = 1;
-		CHANNEL_Set(channel_co2, (int)(g_co2), 0);
-		CHANNEL_Set(channel_tvoc, (int)(g_tvoc), 0);
+		SensorAcq_Push(g_sgpSensor, channel_co2, (int)(g_co2));
+		SensorAcq_Push(g_sgpSensor, channel_tvoc, (int)(g_tvoc));
+	}
+	if (g_sgpstate != wasReady) {
+		SGP_UpdateInterval();
 	}
 	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SGP_Measure: CO2 :%.1f ppm tvoc:%.0f ppb", g_co2, g_tvoc);
 }
+void SGP_Readmeasure() {
+#if !WINDOWS
+	// launch measurement on sensor. 
+	Soft_I2C_Start(&g_sgpI2C, SGP_I2C_ADDRESS);
+	Soft_I2C_WriteByte(&g_sgpI2C, 0x20);
+	Soft_I2C_WriteByte(&g_sgpI2C, 0x08);
+	Soft_I2C_Stop(&g_sgpI2C);
+#endif
+
+	I2CSched_Add(&g_sgpI2C, 12, SGP_ReadResult);
+}
 
 // StopDriver SGP
 void SGP_StopDriver() {
 	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SGP : Stopping Driver and reset sensor");
+	SensorAcq_Unregister(g_sgpSensor);
+	g_sgpSensor = -1;
+	I2CSched_Cancel(&g_sgpI2C);
 }
 
 
@@ -197,6 +215,16 @@ commandResult_t SGP_cycle(const void* context, const char* cmd, const char* args
 		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
 	g_sgpcycleref = Tokenizer_GetArgFloat(0);
+	if (g_sgpcycleref == 0) {
+		SensorAcq_Unregister(g_sgpSensor);
+		g_sgpSensor = -1;
+		ADDLOG_INFO(LOG_FEATURE_CMD, "SGP Cycle : Measurement is off");
+		return CMD_RES_OK;
+	}
+	if (g_sgpSensor == -1) {
+		g_sgpSensor = SensorAcq_Register("SGP", g_sgpcycleref * 1000, SGP_Readmeasure);
+	}
+	SGP_UpdateInterval();
 
 	ADDLOG_INFO(LOG_FEATURE_CMD, "SGP Cycle : Measurement will run every %i seconds", g_sgpcycleref);
 
@@ -219,6 +247,9 @@ void SGP_Init() {
 
 	rtos_delay_milliseconds(10);
 
+	g_sgpstate = 0;
+	g_sgpSensor = SensorAcq_Register("SGP", 1000, SGP_Readmeasure);
+
 	//cmddetail:{"name":"SGP_cycle","args":"[int]",
 	//cmddetail:"descr":"change cycle of measurement by default every 10 seconds 0 to deactivate",
 	//cmddetail:"fn":"SGP_cycle","file":"driver/drv_sgp.c","requires":"",
@@ -240,19 +271,6 @@ void SGP_Init() {
 	//cmddetail:"examples":"SGP_SoftReset"}
 	CMD_RegisterCommand("SGP_SoftReset", SGP_SoftResetcmd, NULL);
 }
-void SGP_OnEverySecond()
-{
-
-	if (g_sgpcycle == 1 || g_sgpstate == 0) {
-		SGP_Readmeasure();
-		g_sgpcycle = g_sgpcycleref;
-	}
-	if (g_sgpcycle > 0) {
-		--g_sgpcycle;
-	}
-	ADDLOG_DEBUG(LOG_FEATURE_DRV, "DRV_SGP : Measurement will run in %i cycle", g_sgpcycle);
-}
-
 void SGP_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState)
 {
 	if(bPreState)
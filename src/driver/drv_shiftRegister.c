@@ -1,13 +1,20 @@
 #include "../new_common.h"
 #include "../new_pins.h"
 #include "../new_cfg.h"
+#include "../quicktick.h"
 // Commands register, execution API and cmd tokenizer
 #include "../cmnds/cmd_public.h"
 #include "../mqtt/new_mqtt.h"
 #include "../logging/logging.h"
+#include "../httpserver/new_http.h"
 #include "drv_local.h"
+#include "drv_spi.h"
 #include "../hal/hal_pins.h"
 
+// up to 64 outputs
+#define SHIFT_MAX_REGISTERS 8
+#define SHIFT_SPI_BAUD 1000000
+
 // GPIO index of Data
 static byte g_data;
 // GPIO index of Latch
@@ -16,24 +23,37 @@ static byte g_latch;
 static byte g_clk;
 // First index of channel that is mapped to shift register.
 static byte g_firstChannel;
-// Current value on shift register
-// This is a 32-bit integer, so up to 4 shift registers (32 bits) are supported 
-static int g_currentValue;
+// Current value on shift register, bit of first channel is bit 0 of byte 0
+static byte g_currentValue[SHIFT_MAX_REGISTERS];
 // MSBFirst or LSBFirst
 static byte g_order;
 // how many 8 bit registers you have chained together
 static byte g_totalRegisters;
 // invert or not
 static byte g_invert;
+// data and clock go through hardware SPI, only latch is GPIO
+static byte g_useSPI;
+// channels changed since last send, sent once from QuickTick
+static bool g_dirty;
+// timing of sends
+static int g_updates;
+static unsigned int g_lastUpdateUs;
+static unsigned int g_maxUpdateUs;
+
+#define LSBFIRST 0
+#define MSBFIRST 1
 
 /*
 
-// startDriver ShiftRegister [DataPin] [LatchPin] [ClkPin] [FirstChannel] [Order] [TotalRegisters] [Invert]
+// startDriver ShiftRegister [DataPin] [LatchPin] [ClkPin] [FirstChannel] [Order] [TotalRegisters] [Invert] [UseSPI]
 startDriver ShiftRegister 24 6 7 10 1 1 0
 // If given argument is not present, default value is used
 // First channel is a first channel that is mapped to first output of shift register.
 // The total number of channels mapped is equal to TotalRegisters * 8, because every register has 8 pins.
+// Up to 8 registers (64 channels) are supported.
 // Order can be 0 or 1, MSBFirst or LSBFirst
+// UseSPI 1 sends data through hardware SPI (where supported) on its fixed
+// MOSI and SCK pins, DataPin and ClkPin are then not used
 
 // To make channel appear with Toggle on HTTP panel, please also set the type:
 setChannelType 10 Toggle
@@ -47,6 +67,22 @@ setChannelType 17 Toggle
 
 
 */
+static void Shift_InitSPI() {
+	spi_config_t cfg;
+
+	cfg.role = SPI_ROLE_MASTER;
+	cfg.bit_width = SPI_BIT_WIDTH_8BITS;
+	cfg.polarity = SPI_POLARITY_LOW;
+	cfg.phase = SPI_PHASE_1ST_EDGE;
+	// latch is driven by hand
+	cfg.wire_mode = SPI_3WIRE_MODE;
+	cfg.baud_rate = SHIFT_SPI_BAUD;
+	cfg.bit_order = g_order == LSBFIRST ? SPI_LSB_FIRST : SPI_MSB_FIRST;
+	if (SPI_DriverInit() < 0 || OBK_SPI_Init(&cfg) < 0) {
+		addLogAdv(LOG_WARN, LOG_FEATURE_MAIN, "ShiftRegister: no hardware SPI, using GPIO");
+		g_useSPI = 0;
+	}
+}
 void Shift_Init() {
 	// NOTE: this is called by "startDriver ShiftRegister" command,
 	// which means that Tokenizer has already tokenized the command,
@@ -58,53 +94,130 @@ void Shift_Init() {
 	g_order = Tokenizer_GetArgIntegerDefault(5, 1);
 	g_totalRegisters = Tokenizer_GetArgIntegerDefault(6, 1);
 	g_invert = Tokenizer_GetArgIntegerDefault(7, 0);
+	g_useSPI = Tokenizer_GetArgIntegerDefault(8, 0);
+	if (g_totalRegisters > SHIFT_MAX_REGISTERS) {
+		g_totalRegisters = SHIFT_MAX_REGISTERS;
+	}
+	g_dirty = false;
+	g_updates = 0;
+	g_lastUpdateUs = 0;
+	g_maxUpdateUs = 0;
 
 	HAL_PIN_Setup_Output(g_latch);
-	HAL_PIN_Setup_Output(g_data);
-	HAL_PIN_Setup_Output(g_clk);
+	if (g_useSPI) {
+		Shift_InitSPI();
+	}
+	if (g_useSPI == 0) {
+		HAL_PIN_Setup_Output(g_data);
+		HAL_PIN_Setup_Output(g_clk);
+	}
 }
 
-void PORT_shiftOut(int dataPin, int clockPin, int bitOrder, int val, int totalRegisters);
+// bit by bit, in order of PORT_shiftOut for one long value
+static void Shift_OutGPIO() {
+	int i, bit, totalBits;
 
-void PORT_shiftOutLatch(int dataPin, int clockPin, int latchPin, int bitOrder, int val, int totalRegisters) {
-	HAL_PIN_SetOutputValue(latchPin, 0);
-	PORT_shiftOut(dataPin, clockPin, bitOrder, val, totalRegisters);
-	HAL_PIN_SetOutputValue(latchPin, 1);
+	totalBits = g_totalRegisters * 8;
+	for (i = 0; i < totalBits; i++) {
+		bit = g_order == LSBFIRST ? i : totalBits - 1 - i;
+		HAL_PIN_SetOutputValue(g_data, (g_currentValue[bit >> 3] >> (bit & 7)) & 1);
+		HAL_PIN_SetOutputValue(g_clk, 1);
+		HAL_PIN_SetOutputValue(g_clk, 0);
+	}
 }
+// SPI shifts each byte in configured bit order, so only bytes are reordered
+static void Shift_OutSPI() {
+	byte buf[SHIFT_MAX_REGISTERS];
+	int i;
 
-void Shift_OnEverySecond() {
-#if 0
-	static int testVal = 0;
-	if (testVal) {
-		testVal = 0;
+	for (i = 0; i < g_totalRegisters; i++) {
+		buf[i] = g_currentValue[g_order == LSBFIRST ? i : g_totalRegisters - 1 - i];
 	}
-	else {
-		testVal = 0xff;
-	}
-	PORT_shiftOutLatch(g_data, g_clk, g_latch, 0, testVal, 1);
-#endif
+	SPI_WriteBytes(buf, g_totalRegisters);
 }
-void Shift_OnChannelChanged(int ch, int value) {
+
+void Shift_OnEverySecond() {
+}
+// returns false if channel is not mapped to registers
+static bool Shift_SetBit(int ch, int value) {
 	int totalChannelsMapped = g_totalRegisters * 8;
 
 	ch -= g_firstChannel;
 	if (ch < 0) {
-		return;
+		return false;
 	}
 	if (ch >= totalChannelsMapped) {
-		return;
+		return false;
 	}
 	if (g_invert) {
 		value = !value;
 	}
 	if (value) {
-		BIT_SET(g_currentValue, ch);
+		BIT_SET(g_currentValue[ch >> 3], (ch & 7));
 	}
 	else {
-		BIT_CLEAR(g_currentValue, ch);
+		BIT_CLEAR(g_currentValue[ch >> 3], (ch & 7));
+	}
+	return true;
+}
+static unsigned int Shift_TimeUs() {
+#if ENABLE_SYSPERF
+	return SYSPERF_GetTimeUs();
+#else
+	return (unsigned int)xTaskGetTickCount() * portTICK_PERIOD_MS * 1000;
+#endif
+}
+static void Shift_Send() {
+	unsigned int start, took;
+
+	start = Shift_TimeUs();
+	HAL_PIN_SetOutputValue(g_latch, 0);
+	if (g_useSPI) {
+		Shift_OutSPI();
+	}
+	else {
+		Shift_OutGPIO();
+	}
+	HAL_PIN_SetOutputValue(g_latch, 1);
+	took = Shift_TimeUs() - start;
+	g_dirty = false;
+	g_updates++;
+	g_lastUpdateUs = took;
+	if (took > g_maxUpdateUs) {
+		g_maxUpdateUs = took;
+	}
+	addLogAdv(LOG_DEBUG, LOG_FEATURE_MAIN, "ShiftRegister: sent %i bytes in %u us", g_totalRegisters, took);
+}
+// single changes, like each line of backlog, are only marked here,
+// so whole chain is shifted and latched once per tick
+void Shift_OnChannelChanged(int ch, int value) {
+	if (Shift_SetBit(ch, value)) {
+		g_dirty = true;
+	}
+}
+void Shift_RunQuickTick() {
+	if (g_dirty) {
+		Shift_Send();
+	}
+}
+void Shift_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState) {
+	if (bPreState)
+		return;
+	hprintf255(request, "<h2>Shift register (%s): %i updates, last %u us, max %u us</h2>",
+		g_useSPI ? "SPI" : "GPIO", g_updates, g_lastUpdateUs, g_maxUpdateUs);
+}
+void Shift_OnChannelsChanged(const int* chs, const int* vals, int count) {
+	int i;
+	bool bAny = false;
+
+	for (i = 0; i < count; i++) {
+		if (Shift_SetBit(chs[i], vals[i])) {
+			bAny = true;
+		}
+	}
+	if (bAny) {
+		Shift_Send();
 	}
-	addLogAdv(LOG_INFO, LOG_FEATURE_MAIN, "Will send value %i", g_currentValue);
-	PORT_shiftOutLatch(g_data, g_clk, g_latch, g_order, g_currentValue, g_totalRegisters);
 }
 
 
@@ -156,7 +156,8 @@ commandResult_t SHT3X_MeasurePer(const void* context, const char* cmd, const cha
 	SHT3X_MeasurePercmd();
 	return CMD_RES_OK;
 }
-void SHT3X_Measurecmd() {
+// result of conversion started by SHT3X_Measurecmd
+static void SHT3X_ReadMeasurement(softI2C_t *bus) {
 #if WINDOWS
 	// TODO: values for simulator so I can test SHT30 
 	// on my Windows machine
@@ -166,15 +167,6 @@ void SHT3X_Measurecmd() {
 	uint8_t buff[6];
 	unsigned int th, tl, hh, hl;
 
-	Soft_I2C_Start(&g_softI2C, SHT3X_I2C_ADDR);
-	// no clock stretching
-	Soft_I2C_WriteByte(&g_softI2C, 0x24);
-	// medium repeteability
-	Soft_I2C_WriteByte(&g_softI2C, 0x16);
-	Soft_I2C_Stop(&g_softI2C);
-
-	rtos_delay_milliseconds(20);	//give the sensor time to do the conversion
-
 	Soft_I2C_Start(&g_softI2C, SHT3X_I2C_ADDR | 1);
 	Soft_I2C_ReadBytes(&g_softI2C, buff, 6);
 	Soft_I2C_Stop(&g_softI2C);
@@ -199,6 +191,19 @@ void SHT3X_Measurecmd() {
 	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SHT3X_Measure: Temperature:%.1fC Humidity:%.0f%%", g_temp, g_humid);
 
 }
+void SHT3X_Measurecmd() {
+#if !WINDOWS
+	Soft_I2C_Start(&g_softI2C, SHT3X_I2C_ADDR);
+	// no clock stretching
+	Soft_I2C_WriteByte(&g_softI2C, 0x24);
+	// medium repeteability
+	Soft_I2C_WriteByte(&g_softI2C, 0x16);
+	Soft_I2C_Stop(&g_softI2C);
+#endif
+
+	//give the sensor time to do the conversion
+	I2CSched_Add(&g_softI2C, 20, SHT3X_ReadMeasurement);
+}
 
 commandResult_t SHT3X_Measure(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
@@ -208,6 +213,7 @@ commandResult_t SHT3X_Measure(const void* context, const char* cmd, const char*
 // StopDriver SHT3X
 void SHT3X_StopDriver() {
 	addLogAdv(LOG_INFO, LOG_FEATURE_SENSOR, "SHT3X : Stopping Driver and reset sensor");
+	I2CSched_Cancel(&g_softI2C);
 	SHT3X_StopPer();
 	// Reset the sensor
 	Soft_I2C_Start(&g_softI2C, SHT3X_I2C_ADDR);
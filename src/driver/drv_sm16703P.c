@@ -36,6 +36,13 @@ void SM16703P_setByte(int index, byte color) {
 		return;
 	translate_byte(color, spiLED.buf + (spiLED.ofs + index * 4));
 }
+void SM16703P_setBytes(uint32_t index, const byte *data, int len) {
+	if (spiLED.buf == 0)
+		return;
+	if (spiLED.ready == 0)
+		return;
+	SPILED_EncodeBytes(spiLED.buf + spiLED.ofs + index * 4, data, len);
+}
 
 void SM16703P_SetLEDCount(int pixel_count, int pixel_size) {
 	// Third arg (optional, default "0"): spiLED.ofs to prepend to each transmission
@@ -62,6 +69,7 @@ void SM16703P_Init() {
 	ws_export.apply = SM16703P_Show;
 	ws_export.getByte = SM16703P_GetByte;
 	ws_export.setByte = SM16703P_setByte;
+	ws_export.setBytes = SM16703P_setBytes;
 	ws_export.setLEDCount = SM16703P_SetLEDCount;
 
 	LEDS_InitShared(&ws_export);
@@ -11,6 +11,17 @@
 #include "../hal/hal_pins.h"
 
 static int g_clk_period = SM2135_DELAY;
+unsigned int g_softI2C_bytes = 0;
+// usleep units in one ms, measured when bus speed is first set
+static int g_usleepPerMs = 0;
+// Level each bus pin was left at, so repeated level does not set pin up
+// again. Known only from Start to Stop of one transfer, other drivers
+// may use same pins between. Open drain pins only change output level.
+static uint64_t g_softI2C_low = 0;
+static uint64_t g_softI2C_high = 0;
+static uint64_t g_softI2C_openDrain = 0;
+
+#define SOFT_I2C_PIN_BIT(pin) ((pin) < 64 ? (1ULL << (pin)) : 0)
 
 #if !PLATFORM_ESPIDF && !PLATFORM_XR806 && !PLATFORM_XR872 && !PLATFORM_ESP8266 && !PLATFORM_REALTEK_NEW && !PLATFORM_TXW81X
 void usleep(int r) //delay function do 10*r nops, because rtos_delay_milliseconds is too much
@@ -25,12 +36,75 @@ void usleep(int r) //delay function do 10*r nops, because rtos_delay_millisecond
 #endif
 
 void Soft_I2C_SetLow(uint8_t pin) {
-	HAL_PIN_Setup_Output(pin);
+	uint64_t bit = SOFT_I2C_PIN_BIT(pin);
+
+	if (g_softI2C_low & bit) {
+		return;
+	}
+	if ((g_softI2C_openDrain & bit) == 0) {
+		HAL_PIN_Setup_Output(pin);
+	}
 	HAL_PIN_SetOutputValue(pin, 0);
+	g_softI2C_low |= bit;
+	g_softI2C_high &= ~bit;
 }
 
 void Soft_I2C_SetHigh(uint8_t pin) {
-	HAL_PIN_Setup_Input_Pullup(pin);
+	uint64_t bit = SOFT_I2C_PIN_BIT(pin);
+
+	if (g_softI2C_high & bit) {
+		return;
+	}
+	if (g_softI2C_openDrain & bit) {
+		HAL_PIN_SetOutputValue(pin, 1);
+	}
+	else {
+		HAL_PIN_Setup_Input_Pullup(pin);
+	}
+	g_softI2C_high |= bit;
+	g_softI2C_low &= ~bit;
+}
+
+// pins are set up once per transfer, open drain where platform has it
+static void Soft_I2C_Claim(softI2C_t *i2c) {
+	uint64_t bits = SOFT_I2C_PIN_BIT(i2c->pin_data) | SOFT_I2C_PIN_BIT(i2c->pin_clk);
+
+	g_softI2C_low &= ~bits;
+	g_softI2C_high &= ~bits;
+	g_softI2C_openDrain &= ~bits;
+	if (bits == 0) {
+		return;
+	}
+	if (HAL_PIN_Setup_OpenDrain(i2c->pin_data) && HAL_PIN_Setup_OpenDrain(i2c->pin_clk)) {
+		g_softI2C_openDrain |= bits;
+		g_softI2C_high |= bits;
+	}
+}
+static void Soft_I2C_Release(softI2C_t *i2c) {
+	uint64_t bits = SOFT_I2C_PIN_BIT(i2c->pin_data) | SOFT_I2C_PIN_BIT(i2c->pin_clk);
+
+	g_softI2C_low &= ~bits;
+	g_softI2C_high &= ~bits;
+	g_softI2C_openDrain &= ~bits;
+}
+
+// usleep units in one ms, against RTOS tick. Loop runs until enough
+// ticks passed that tick length does not matter.
+static int Soft_I2C_CalibrateDelay() {
+	portTickType start;
+	int units = 1000;
+	int took;
+
+	while (1) {
+		start = xTaskGetTickCount();
+		usleep(units);
+		took = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+		if (took >= 20 || units >= (1 << 26)) {
+			break;
+		}
+		units *= 2;
+	}
+	return took > 0 ? units / took : units;
 }
 
 static commandResult_t CMD_SoftI2C_SetClkPeriod(const void* context, const char* cmd, const char* args, int cmdFlags) {
@@ -47,17 +121,45 @@ static commandResult_t CMD_SoftI2C_SetClkPeriod(const void* context, const char*
 	return CMD_RES_OK;
 }
 
+static commandResult_t CMD_SoftI2C_SetSpeed(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	int kHz;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	kHz = Tokenizer_GetArgInteger(0);
+	if (kHz <= 0) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	if (g_usleepPerMs == 0) {
+		g_usleepPerMs = Soft_I2C_CalibrateDelay();
+	}
+	// one delay per bit, pin access adds to it, so bus is not faster
+	g_clk_period = g_usleepPerMs / kHz;
+	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Soft I2C %i kHz, clk period %i (%i per ms)", kHz, g_clk_period, g_usleepPerMs);
+	return CMD_RES_OK;
+}
+
 bool Soft_I2C_PreInit(softI2C_t *i2c) {
 	//cmddetail:{"name":"SoftI2C_SetClkPeriod","args":"[period]",
 	//cmddetail:"descr":"Sets the clock period in number of nop delay cycles (times 10)",
 	//cmddetail:"fn":"CMD_SoftI2C_SetClkPeriod","file":"driver/drv_soft_i2c.c","requires":"",
 	//cmddetail:"examples":"SoftI2C_SetClkPeriod 50"}
 	CMD_RegisterCommand("SoftI2C_SetClkPeriod", CMD_SoftI2C_SetClkPeriod, NULL);
+	//cmddetail:{"name":"SoftI2C_SetSpeed","args":"[kHz]",
+	//cmddetail:"descr":"Sets soft I2C clock period for given bus speed, like 100 or 400. Delay loop is measured against system tick the first time, pin access time makes real speed bit lower.",
+	//cmddetail:"fn":"CMD_SoftI2C_SetSpeed","file":"driver/drv_soft_i2c.c","requires":"",
+	//cmddetail:"examples":"SoftI2C_SetSpeed 400"}
+	CMD_RegisterCommand("SoftI2C_SetSpeed", CMD_SoftI2C_SetSpeed, NULL);
+	I2CSched_Init();
 
+	Soft_I2C_Release(i2c);
 	HAL_PIN_SetOutputValue(i2c->pin_data, 0);
 	HAL_PIN_SetOutputValue(i2c->pin_clk, 0);
 	Soft_I2C_SetHigh(i2c->pin_data);
 	Soft_I2C_SetHigh(i2c->pin_clk);
+	Soft_I2C_Release(i2c);
 	return (!((HAL_PIN_ReadDigitalInput(i2c->pin_data) == 0 || HAL_PIN_ReadDigitalInput(i2c->pin_clk) == 0)));
 }
 
@@ -65,6 +167,7 @@ bool Soft_I2C_WriteByte(softI2C_t *i2c, uint8_t value) {
 	uint8_t curr;
 	uint8_t ack;
 
+	g_softI2C_bytes++;
 	for (curr = 0x80; curr != 0; curr >>= 1) {
 		if (curr & value) {
 			Soft_I2C_SetHigh(i2c->pin_data);
@@ -88,11 +191,13 @@ bool Soft_I2C_WriteByte(softI2C_t *i2c, uint8_t value) {
 }
 
 void Soft_I2C_Start_Internal(softI2C_t *i2c) {
+	Soft_I2C_Claim(i2c);
 	Soft_I2C_SetLow(i2c->pin_data);
 	usleep(g_clk_period);
 	Soft_I2C_SetLow(i2c->pin_clk);
 }
 bool Soft_I2C_Start(softI2C_t *i2c, uint8_t addr) {
+	Soft_I2C_Claim(i2c);
 	Soft_I2C_SetLow(i2c->pin_data);
 	usleep(g_clk_period);
 	Soft_I2C_SetLow(i2c->pin_clk);
@@ -106,6 +211,7 @@ void Soft_I2C_Stop(softI2C_t *i2c) {
 	usleep(g_clk_period);
 	Soft_I2C_SetHigh(i2c->pin_data);
 	usleep(g_clk_period);
+	Soft_I2C_Release(i2c);
 }
 
 
@@ -125,6 +231,7 @@ uint8_t Soft_I2C_ReadByte(softI2C_t *i2c, bool nack)
 {
 	uint8_t val = 0;
 
+	g_softI2C_bytes++;
 	Soft_I2C_SetHigh(i2c->pin_data);
 	for (int i = 0; i < 8; i++)
 	{
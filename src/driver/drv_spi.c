@@ -29,6 +29,15 @@ uint32_t mode = SPI_MASTER;
 #define bk_spi_master_xfer(x) bk_spi_master_dma_xfer(x, 0)
 #define bk_spi_slave_xfer bk_spi_slave_dma_xfer
 #endif
+
+#if WINDOWS
+// simulator has no SPI, selftest can put a fake chip on the bus
+static SIM_SPIDevice_t g_simSPIDevice = 0;
+
+void SIM_SPI_SetDevice(SIM_SPIDevice_t dev) {
+	g_simSPIDevice = dev;
+}
+#endif
 int SPI_DriverInit(void) {
 #if PLATFORM_BK7231N && !PLATFORM_BEKEN_NEW
     return bk_spi_driver_init();
@@ -198,6 +207,12 @@ int SPI_WriteBytes(const void *data, uint32_t size) {
 	else
 		return bk_spi_slave_xfer(&msg);
 #else
+#if WINDOWS
+	if (g_simSPIDevice) {
+		g_simSPIDevice(data, size, 0, 0);
+		return 0;
+	}
+#endif
     ADDLOG_ERROR(LOG_FEATURE_DRV, "SPI_WriteBytes not supported");
     return -1;
 #endif
@@ -269,6 +284,12 @@ int SPI_Transmit(const void *txData, uint32_t txSize, void *rxData,
 	else
 		return bk_spi_slave_xfer(&msg);
 #else
+#if WINDOWS
+	if (g_simSPIDevice) {
+		g_simSPIDevice(txData, txSize, rxData, rxSize);
+		return 0;
+	}
+#endif
     ADDLOG_ERROR(LOG_FEATURE_DRV, "SPI_Transmit not supported");
     return -1;
 #endif
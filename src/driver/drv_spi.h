@@ -55,3 +55,9 @@ int SPI_WriteBytes(const void *data, uint32_t size);
 int SPI_ReadBytes(void *data, uint32_t size);
 int SPI_Transmit(const void *txData, uint32_t txSize, void *rxData,
 		uint32_t rxSize);
+
+#if WINDOWS
+// called for every transfer, tx bytes are clocked out before rx is filled
+typedef void (*SIM_SPIDevice_t)(const void *tx, uint32_t txSize, void *rx, uint32_t rxSize);
+void SIM_SPI_SetDevice(SIM_SPIDevice_t dev);
+#endif
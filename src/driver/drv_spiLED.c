@@ -31,6 +31,15 @@ void SPIDMA_Deinit(void) {
 #endif
 static uint8_t data_translate[4] = { 0b10001000, 0b10001110, 0b11101000, 0b11101110 };
 
+// every pixel byte goes out as 4 SPI bytes of 2 bits each, these are all 256 of them
+#define SPILED_2BIT(v) (((v) & 3) == 0 ? 0b10001000 : ((v) & 3) == 1 ? 0b10001110 : ((v) & 3) == 2 ? 0b11101000 : 0b11101110)
+#define SPILED_ENC1(b) { SPILED_2BIT((b) >> 6), SPILED_2BIT((b) >> 4), SPILED_2BIT((b) >> 2), SPILED_2BIT(b) }
+#define SPILED_ENC4(b) SPILED_ENC1(b), SPILED_ENC1((b) + 1), SPILED_ENC1((b) + 2), SPILED_ENC1((b) + 3)
+#define SPILED_ENC16(b) SPILED_ENC4(b), SPILED_ENC4((b) + 4), SPILED_ENC4((b) + 8), SPILED_ENC4((b) + 12)
+#define SPILED_ENC64(b) SPILED_ENC16(b), SPILED_ENC16((b) + 16), SPILED_ENC16((b) + 32), SPILED_ENC16((b) + 48)
+static const uint8_t g_spiLEDTable[256][4] = {
+	SPILED_ENC64(0), SPILED_ENC64(64), SPILED_ENC64(128), SPILED_ENC64(192)
+};
 
 uint8_t translate_2bit(uint8_t input) {
 	//ADDLOG_INFO(LOG_FEATURE_CMD, "Translate 0x%02x to 0x%02x", (input & 0b00000011), data_translate[(input & 0b00000011)]);
@@ -38,13 +47,8 @@ uint8_t translate_2bit(uint8_t input) {
 }
 
 uint8_t reverse_translate_2bit(uint8_t input) {
-	uint8_t i;
-	for (i = 0; i < 4; ++i) {
-		if (data_translate[i] == input) {
-			return i;
-		}
-	}
-	return 0;
+	// high bit is in 0b01000000, low bit in 0b00000010
+	return ((input >> 5) & 2) | ((input >> 1) & 1);
 }
 
 byte reverse_translate_byte(uint8_t *input) {
@@ -56,22 +60,16 @@ byte reverse_translate_byte(uint8_t *input) {
 	return dst;
 }
 void translate_byte(uint8_t input, uint8_t *dst) {
-	// return 0x00000000 |
-	// 	   translate_2bit((input >> 6)) |
-	// 	   translate_2bit((input >> 4)) |
-	// 	   translate_2bit((input >> 2)) |
-	// 	   translate_2bit(input);
-	*dst++ = translate_2bit((input >> 6));
-	*dst++ = translate_2bit((input >> 4));
-	*dst++ = translate_2bit((input >> 2));
-	*dst++ = translate_2bit(input);
-
-#if WINDOWS
-	byte test = reverse_translate_byte(dst - 4);
-	if (input != test) {
-		printf("reverse_translate_byte is brken");
+	memcpy(dst, g_spiLEDTable[input], 4);
+}
+// dst must have room for numBytes * 4
+void SPILED_EncodeBytes(uint8_t *dst, const byte *src, int numBytes) {
+	int i;
+
+	for (i = 0; i < numBytes; i++) {
+		memcpy(dst, g_spiLEDTable[src[i]], 4);
+		dst += 4;
 	}
-#endif
 }
 
 spiLED_t spiLED;
@@ -135,14 +133,7 @@ void SPILED_SetRawBytes(int start_offset, byte *bytes, int numBytes, int push) {
 	// start offset is in bytes, and we do 2 bits per dst byte, so *4
 	uint8_t *dst = spiLED.buf + spiLED.ofs + start_offset * 4;
 
-	// parse hex string like FFAABB0011 byte by byte
-	for (int i = 0; i < numBytes; i++) {
-		byte b = bytes[i];
-		*dst++ = translate_2bit((b >> 6));
-		*dst++ = translate_2bit((b >> 4));
-		*dst++ = translate_2bit((b >> 2));
-		*dst++ = translate_2bit(b);
-	}
+	SPILED_EncodeBytes(dst, bytes, numBytes);
 	if (push) {
 		SPIDMA_StartTX(spiLED.msg);
 	}
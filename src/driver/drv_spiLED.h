@@ -18,6 +18,7 @@ uint8_t translate_2bit(uint8_t input);
 uint8_t reverse_translate_2bit(uint8_t input);
 byte reverse_translate_byte(uint8_t *input);
 void translate_byte(uint8_t input, uint8_t *dst);
+void SPILED_EncodeBytes(uint8_t *dst, const byte *src, int numBytes);
 
 void SPILED_InitDMA(int numBytes);
 
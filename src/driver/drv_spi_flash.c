@@ -16,6 +16,7 @@
 
 #define READ_ID_FLASH_CMD 0x9F
 #define READ_FLASH_CMD 0x03 // Read Flash command opcode
+#define FAST_READ_FLASH_CMD 0x0B // like READ_FLASH_CMD, but one dummy byte after address
 #define WRITEENABLE_FLASH_CMD 0x06
 #define ERASE_WHOLE_FLASH_CMD 0xC7
 #define WRITE_FLASH_CMD 0x02
@@ -144,26 +145,191 @@ byte FastSPI_Read(softSPI_t *spi) {
 
 #endif
 
-void spi_flash_read_id(softSPI_t* spi, byte* jedec_id) {
+#define SPIFLASH_PAGE_SIZE 256
+#define SPIFLASH_SECTOR_SIZE 4096
+// pages that may wait for the chip, so the caller does not block on every page program
+#define SPIFLASH_QUEUE_PAGES 4
+// same as LFS cache_size for SPI, metadata walks read small pieces of one line
+#define SPIFLASH_CACHE_LINE 128
+
+typedef struct spiFlashPage_s {
+	int adr;
+	int len;
+	byte data[SPIFLASH_PAGE_SIZE];
+} spiFlashPage_t;
+
+static spiFlashPage_t g_flashQueue[SPIFLASH_QUEUE_PAGES];
+static int g_flashQueueFirst = 0;
+static int g_flashQueueCount = 0;
+// program or erase was started and the chip was not seen idle since
+static bool g_flashBusy = false;
+static byte g_flashCache[SPIFLASH_CACHE_LINE];
+static int g_flashCacheAdr = -1;
+static unsigned int g_flashPagePrograms = 0;
+static unsigned int g_flashCacheHits = 0;
+static unsigned int g_flashCacheMisses = 0;
+static unsigned int g_flashStatusPolls = 0;
+
+#if ENABLE_LFS_SPI_HW
+#include "drv_spi.h"
+
+// Beken hardware SPI has fixed pins, chip select is driven by hand
+#define HW_SCK_PIN 14
+#define HW_SS_PIN 15
+#define HW_MOSI_PIN 16
+#define HW_MISO_PIN 17
+#define SPIFLASH_HW_BAUD 10000000
+
+static int g_flashHW = 0;
+// command, address and dummy byte must go in the same transfer as page data
+static byte g_flashHWBuffer[5 + SPIFLASH_PAGE_SIZE];
+#endif
+
+#if WINDOWS
+// simulator has no flash on the GPIO pins, so a W25Q16 is emulated in RAM
+#define SIM_SPIFLASH_SIZE 0x200000
+
+static byte *g_simFlash = 0;
+static int g_simFlashWEL = 0;
+// status reads left until program or erase is done
+static int g_simFlashBusy = 0;
+
+static void SIM_SPIFlash_Xfer(const byte *hdr, int hdrLen, const byte *tx, int txLen, byte *rx, int rxLen) {
+	int adr, i;
+
+	if (g_simFlash == 0) {
+		g_simFlash = malloc(SIM_SPIFLASH_SIZE);
+		memset(g_simFlash, 0xFF, SIM_SPIFLASH_SIZE);
+	}
+	adr = 0;
+	if (hdrLen >= 4) {
+		adr = ((hdr[1] << 16) | (hdr[2] << 8) | hdr[3]) % SIM_SPIFLASH_SIZE;
+	}
+	// real chip ignores everything but status while busy
+	if (g_simFlashBusy > 0 && hdr[0] != READ_STATUS_REG_CMD) {
+		memset(rx, 0xFF, rxLen);
+		return;
+	}
+	switch (hdr[0]) {
+	case READ_ID_FLASH_CMD:
+		for (i = 0; i < rxLen; i++) {
+			rx[i] = i == 0 ? 0xEF : (i == 1 ? 0x40 : 0x15);
+		}
+		break;
+	case READ_STATUS_REG_CMD:
+		for (i = 0; i < rxLen; i++) {
+			rx[i] = (g_simFlashBusy > 0 ? STATUS_BUSY_MASK : 0) | (g_simFlashWEL ? STATUS_WEL_MASK : 0);
+		}
+		if (g_simFlashBusy > 0) {
+			g_simFlashBusy--;
+		}
+		break;
+	case WRITEENABLE_FLASH_CMD:
+		g_simFlashWEL = 1;
+		break;
+	case WRITE_FLASH_CMD:
+		if (g_simFlashWEL) {
+			// program can only clear bits and wraps inside the page
+			for (i = 0; i < txLen && i < SPIFLASH_PAGE_SIZE; i++) {
+				g_simFlash[(adr & ~(SPIFLASH_PAGE_SIZE - 1)) | ((adr + i) & (SPIFLASH_PAGE_SIZE - 1))] &= tx[i];
+			}
+			g_simFlashBusy = 2;
+		}
+		g_simFlashWEL = 0;
+		break;
+	case READ_FLASH_CMD:
+	case FAST_READ_FLASH_CMD:
+		for (i = 0; i < rxLen; i++) {
+			rx[i] = g_simFlash[(adr + i) % SIM_SPIFLASH_SIZE];
+		}
+		break;
+	case ERASE_SECTOR_CMD:
+		if (g_simFlashWEL) {
+			memset(g_simFlash + (adr & ~(SPIFLASH_SECTOR_SIZE - 1)), 0xFF, SPIFLASH_SECTOR_SIZE);
+			g_simFlashBusy = 4;
+		}
+		g_simFlashWEL = 0;
+		break;
+	case ERASE_WHOLE_FLASH_CMD:
+		if (g_simFlashWEL) {
+			memset(g_simFlash, 0xFF, SIM_SPIFLASH_SIZE);
+			g_simFlashBusy = 8;
+		}
+		g_simFlashWEL = 0;
+		break;
+	}
+}
+#endif
+
+// One chip select frame: header (command, address, dummy) and tx bytes
+// are clocked out, then rx bytes are clocked in.
+static void SPIFlash_Xfer(softSPI_t *spi, const byte *hdr, int hdrLen, const byte *tx, int txLen, byte *rx, int rxLen) {
+#if WINDOWS
+	SIM_SPIFlash_Xfer(hdr, hdrLen, tx, txLen, rx, rxLen);
+#else
+	int i;
+
+#if ENABLE_LFS_SPI_HW
+	if (g_flashHW) {
+		HAL_PIN_SetOutputValue(spi->ss, 0);
+		if (txLen > 0) {
+			memcpy(g_flashHWBuffer, hdr, hdrLen);
+			memcpy(g_flashHWBuffer + hdrLen, tx, txLen);
+			SPI_Transmit(g_flashHWBuffer, hdrLen + txLen, rx, rxLen);
+		}
+		else {
+			// large reads go straight to caller buffer, DMA on new Beken SDK
+			SPI_Transmit(hdr, hdrLen, rx, rxLen);
+		}
+		HAL_PIN_SetOutputValue(spi->ss, 1);
+		return;
+	}
+#endif
+	OBK_DISABLE_INTERRUPTS;
 	SPI_Begin(spi);
-	SPI_Send(spi, READ_ID_FLASH_CMD);
-	jedec_id[0] = SPI_Read(spi);
-	jedec_id[1] = SPI_Read(spi);
-	jedec_id[2] = SPI_Read(spi);
+	for (i = 0; i < hdrLen; i++) {
+		SPI_Send(spi, hdr[i]);
+	}
+	for (i = 0; i < txLen; i++) {
+		SPI_Send(spi, tx[i]);
+	}
+	for (i = 0; i < rxLen; i++) {
+		rx[i] = SPI_Read(spi);
+	}
 	SPI_End(spi);
+	OBK_ENABLE_INTERRUPTS;
+#endif
 }
 
+static void SPIFlash_Command(softSPI_t *spi, byte cmd, int adr, int hdrLen) {
+	byte hdr[4];
 
+	hdr[0] = cmd;
+	hdr[1] = (adr >> 16) & 0xFF;
+	hdr[2] = (adr >> 8) & 0xFF;
+	hdr[3] = adr & 0xFF;
+	SPIFlash_Xfer(spi, hdr, hdrLen, 0, 0, 0, 0);
+}
 
-static void flash_wait_for(softSPI_t* spi, byte mask) {
+void spi_flash_read_id(softSPI_t* spi, byte* jedec_id) {
+	byte cmd = READ_ID_FLASH_CMD;
+
+	SPIFlash_Xfer(spi, &cmd, 1, 0, 0, jedec_id, 3);
+}
+
+static byte flash_read_status(softSPI_t* spi) {
+	byte cmd = READ_STATUS_REG_CMD;
 	byte status;
+
+	SPIFlash_Xfer(spi, &cmd, 1, 0, 0, &status, 1);
+	g_flashStatusPolls++;
+	return status;
+}
+
+static void flash_wait_for(softSPI_t* spi, byte mask) {
 	int loops = 0;
 	while (1) {
-		SPI_Begin(spi);
-		SPI_Send(spi, READ_STATUS_REG_CMD);
-		status = SPI_Read(spi);
-		SPI_End(spi);
-		if (!(status & mask)) {
+		if (!(flash_read_status(spi) & mask)) {
 			break;
 		}
 		loops++;
@@ -177,125 +343,264 @@ static void flash_wait_for(softSPI_t* spi, byte mask) {
 static void flash_wait_while_busy(softSPI_t* spi) {
 	flash_wait_for(spi, STATUS_BUSY_MASK);
 }
-void softspi_flash_read(softSPI_t* spi, int adr, byte* out, int cnt) {
-	int i;
 
-	OBK_DISABLE_INTERRUPTS;
+//static void flash_wait_for_wel(softSPI_t* spi) {
+//	flash_wait_for(spi, STATUS_WEL_MASK);
+//}
 
-	SPI_Begin(spi);
-	SPI_Send(spi, READ_FLASH_CMD);
-	SPI_Send(spi, (adr >> 16) & 0xFF);
-	SPI_Send(spi, (adr >> 8) & 0xFF);
-	SPI_Send(spi, adr & 0xFF);
-	for (i = 0; i < cnt; i++) {
-		out[i] = SPI_Read(spi);
+// single status poll, does not wait
+static bool SPIFlash_IsBusy(softSPI_t* spi) {
+	if (g_flashBusy && !(flash_read_status(spi) & STATUS_BUSY_MASK)) {
+		g_flashBusy = false;
+	}
+	return g_flashBusy;
+}
+static void SPIFlash_WaitIdle(softSPI_t* spi) {
+	if (g_flashBusy) {
+		flash_wait_while_busy(spi);
+		g_flashBusy = false;
+	}
+}
+static void SPIFlash_StartProgram(softSPI_t* spi, spiFlashPage_t *page) {
+	byte hdr[4];
+
+	SPIFlash_Command(spi, WRITEENABLE_FLASH_CMD, 0, 1);
+	hdr[0] = WRITE_FLASH_CMD;
+	hdr[1] = (page->adr >> 16) & 0xFF;
+	hdr[2] = (page->adr >> 8) & 0xFF;
+	hdr[3] = page->adr & 0xFF;
+	SPIFlash_Xfer(spi, hdr, 4, page->data, page->len, 0, 0);
+	g_flashBusy = true;
+	g_flashPagePrograms++;
+}
+// Starts queued page programs while the chip is idle.
+// With bWait, returns only when queue is empty and the last program is done.
+static void SPIFlash_Pump(softSPI_t* spi, bool bWait) {
+	while (g_flashQueueCount > 0) {
+		if (SPIFlash_IsBusy(spi)) {
+			if (!bWait) {
+				return;
+			}
+			SPIFlash_WaitIdle(spi);
+		}
+		SPIFlash_StartProgram(spi, &g_flashQueue[g_flashQueueFirst]);
+		g_flashQueueFirst = (g_flashQueueFirst + 1) % SPIFLASH_QUEUE_PAGES;
+		g_flashQueueCount--;
+	}
+	if (bWait) {
+		SPIFlash_WaitIdle(spi);
 	}
-	SPI_End(spi);
-
-	OBK_ENABLE_INTERRUPTS;
 }
+static bool SPIFlash_IsQueued(int adr, int cnt) {
+	int i;
+	spiFlashPage_t *page;
 
-//static void flash_wait_for_wel(softSPI_t* spi) {
-//	flash_wait_for(spi, STATUS_WEL_MASK);
-//}
+	for (i = 0; i < g_flashQueueCount; i++) {
+		page = &g_flashQueue[(g_flashQueueFirst + i) % SPIFLASH_QUEUE_PAGES];
+		if (page->adr < adr + cnt && adr < page->adr + page->len) {
+			return true;
+		}
+	}
+	return false;
+}
+static void SPIFlash_InvalidateCache(int adr, int cnt) {
+	if (g_flashCacheAdr >= 0 && g_flashCacheAdr < adr + cnt && adr < g_flashCacheAdr + SPIFLASH_CACHE_LINE) {
+		g_flashCacheAdr = -1;
+	}
+}
 
-void spi_flash_erase(softSPI_t* spi) {
-	OBK_DISABLE_INTERRUPTS;
+void softspi_flash_read(softSPI_t* spi, int adr, byte* out, int cnt) {
+	byte hdr[5];
 
-	SPI_Begin(spi);
-	SPI_Send(spi, WRITEENABLE_FLASH_CMD);
-	SPI_End(spi);
+	// pages for other addresses may stay queued, the chip only has to be idle
+	if (SPIFlash_IsQueued(adr, cnt)) {
+		SPIFlash_Pump(spi, true);
+	}
+	else {
+		SPIFlash_WaitIdle(spi);
+	}
+	hdr[0] = FAST_READ_FLASH_CMD;
+	hdr[1] = (adr >> 16) & 0xFF;
+	hdr[2] = (adr >> 8) & 0xFF;
+	hdr[3] = adr & 0xFF;
+	// dummy byte
+	hdr[4] = 0;
+	SPIFlash_Xfer(spi, hdr, 5, 0, 0, out, cnt);
+	SPIFlash_Pump(spi, false);
+}
 
-	SPI_Begin(spi);
-	SPI_Send(spi, ERASE_WHOLE_FLASH_CMD);
-	SPI_End(spi);
+void spi_flash_erase(softSPI_t* spi) {
+	SPIFlash_Pump(spi, true);
+	g_flashCacheAdr = -1;
 
-	flash_wait_while_busy(spi);
+	SPIFlash_Command(spi, WRITEENABLE_FLASH_CMD, 0, 1);
+	SPIFlash_Command(spi, ERASE_WHOLE_FLASH_CMD, 0, 1);
+	g_flashBusy = true;
 
-	OBK_ENABLE_INTERRUPTS;
+	SPIFlash_WaitIdle(spi);
 }
 
+// Splits data into page programs and queues them, only waits
+// when the queue is full.
 void spi_flash_write2(softSPI_t* spi, int adr, const byte* data, int cnt) {
 	int remaining = cnt;
 	int offset = 0;
-
-	OBK_DISABLE_INTERRUPTS;
+	spiFlashPage_t *page;
 
 	//ADDLOG_INFO(LOG_FEATURE_CMD, "spi_flash_write2 %i at %i\n", cnt, adr);
 
 	while (remaining > 0) {
-		int page_offset = adr % 256;
-		int write_len = 256 - page_offset;
+		int page_offset = adr % SPIFLASH_PAGE_SIZE;
+		int write_len = SPIFLASH_PAGE_SIZE - page_offset;
 		if (write_len > remaining)
 			write_len = remaining;
 
-
-		SPI_Begin(spi);
-		SPI_Send(spi, WRITEENABLE_FLASH_CMD);
-		SPI_End(spi);
-
-		//ADDLOG_INFO(LOG_FEATURE_CMD, "Write fragmnent %i at %i\n", write_len, adr);
-		SPI_Begin(spi);
-		SPI_Send(spi, WRITE_FLASH_CMD);
-		SPI_Send(spi, (adr >> 16) & 0xFF);
-		SPI_Send(spi, (adr >> 8) & 0xFF);
-		SPI_Send(spi, adr & 0xFF);
-		for (int i = 0; i < write_len; i++) {
-			SPI_Send(spi, data[offset + i]);
+		if (g_flashQueueCount == SPIFLASH_QUEUE_PAGES) {
+			// chip has to take the oldest page first
+			SPIFlash_WaitIdle(spi);
+			SPIFlash_Pump(spi, false);
 		}
-		SPI_End(spi);
-
-		flash_wait_while_busy(spi);
+		//ADDLOG_INFO(LOG_FEATURE_CMD, "Write fragmnent %i at %i\n", write_len, adr);
+		page = &g_flashQueue[(g_flashQueueFirst + g_flashQueueCount) % SPIFLASH_QUEUE_PAGES];
+		page->adr = adr;
+		page->len = write_len;
+		memcpy(page->data, data + offset, write_len);
+		g_flashQueueCount++;
+		SPIFlash_InvalidateCache(adr, write_len);
 
 		adr += write_len;
 		offset += write_len;
 		remaining -= write_len;
 	}
-
-	OBK_ENABLE_INTERRUPTS;
+	SPIFlash_Pump(spi, false);
 }
 
+// Queued pages go first, then erase is started and left running,
+// next access waits for it.
 void softspi_flash_erase_sector(softSPI_t* spi, int addr) {
-	OBK_DISABLE_INTERRUPTS;
+	SPIFlash_Pump(spi, true);
+	SPIFlash_InvalidateCache(addr & ~(SPIFLASH_SECTOR_SIZE - 1), SPIFLASH_SECTOR_SIZE);
 
-	SPI_Begin(spi);
-	SPI_Send(spi, WRITEENABLE_FLASH_CMD);
-	SPI_End(spi);
+	SPIFlash_Command(spi, WRITEENABLE_FLASH_CMD, 0, 1);
+	SPIFlash_Command(spi, ERASE_SECTOR_CMD, addr, 4);
+	g_flashBusy = true;
+}
 
-	SPI_Begin(spi);
-	SPI_Send(spi, ERASE_SECTOR_CMD);
-	SPI_Send(spi, (addr >> 16) & 0xFF);
-	SPI_Send(spi, (addr >> 8) & 0xFF);
-	SPI_Send(spi, addr & 0xFF);
-	SPI_End(spi);
+softSPI_t g_lfs_spi;
+int g_lfs_spi_ready = 0;
+void LFS_SPI_Init() {
+	g_lfs_spi.miso = MISO_PIN;
+	g_lfs_spi.mosi = MOSI_PIN;
+	g_lfs_spi.ss = SS_PIN;
+	g_lfs_spi.sck = SCK_PIN;
+
+#if ENABLE_LFS_SPI_HW
+	spi_config_t cfg;
+
+	cfg.role = SPI_ROLE_MASTER;
+	cfg.bit_width = SPI_BIT_WIDTH_8BITS;
+	cfg.polarity = SPI_POLARITY_LOW;
+	cfg.phase = SPI_PHASE_1ST_EDGE;
+	// chip select is driven by hand, it has to stay low for whole command
+	cfg.wire_mode = SPI_3WIRE_MODE;
+	cfg.baud_rate = SPIFLASH_HW_BAUD;
+	cfg.bit_order = SPI_MSB_FIRST;
+	if (SPI_DriverInit() >= 0 && OBK_SPI_Init(&cfg) >= 0) {
+		g_lfs_spi.miso = HW_MISO_PIN;
+		g_lfs_spi.mosi = HW_MOSI_PIN;
+		g_lfs_spi.ss = HW_SS_PIN;
+		g_lfs_spi.sck = HW_SCK_PIN;
+		HAL_PIN_Setup_Output(g_lfs_spi.ss);
+		HAL_PIN_SetOutputValue(g_lfs_spi.ss, 1);
+		g_flashHW = 1;
+		g_lfs_spi_ready = 1;
+		ADDLOG_INFO(LOG_FEATURE_CMD, "SPI flash on hardware SPI");
+		return;
+	}
+	ADDLOG_WARN(LOG_FEATURE_CMD, "SPI flash: no hardware SPI, using GPIO");
+#endif
+	SPI_Setup(&g_lfs_spi);
+	g_lfs_spi_ready = 1;
+}
+void LFS_SPI_Flash_EraseSector(int addr) {
+	if (g_lfs_spi_ready == 0) {
+		LFS_SPI_Init();
+	}
+	softspi_flash_erase_sector(&g_lfs_spi, addr);
+}
+void spi_test() {
+	byte jedec_id[3];
 
-	flash_wait_while_busy(spi);
+	if (g_lfs_spi_ready == 0) {
+		LFS_SPI_Init();
+	}
+	SPIFlash_Pump(&g_lfs_spi, true);
+	spi_flash_read_id(&g_lfs_spi, jedec_id);
 
-	OBK_ENABLE_INTERRUPTS;
+	ADDLOG_INFO(LOG_FEATURE_CMD, "ID %02X %02X %02X", jedec_id[0], jedec_id[1], jedec_id[2]);
 }
+void LFS_SPI_Flash_Read(int adr, int cnt, byte *data) {
+	int lineAdr;
 
-void flash_test_pages(softSPI_t* spi, int baseAddr, int length, byte pattern) {
+	if (g_lfs_spi_ready == 0) {
+		LFS_SPI_Init();
+	}
+	lineAdr = adr & ~(SPIFLASH_CACHE_LINE - 1);
+	if (cnt > SPIFLASH_CACHE_LINE || ((adr + cnt - 1) & ~(SPIFLASH_CACHE_LINE - 1)) != lineAdr) {
+		softspi_flash_read(&g_lfs_spi, adr, data, cnt);
+		return;
+	}
+	if (g_flashCacheAdr == lineAdr) {
+		g_flashCacheHits++;
+	}
+	else {
+		softspi_flash_read(&g_lfs_spi, lineAdr, g_flashCache, SPIFLASH_CACHE_LINE);
+		g_flashCacheAdr = lineAdr;
+		g_flashCacheMisses++;
+	}
+	memcpy(data, g_flashCache + (adr - lineAdr), cnt);
+}
+void LFS_SPI_Flash_Write(int adr, const byte *data, int cnt) {
+	if (g_lfs_spi_ready == 0) {
+		LFS_SPI_Init();
+	}
+	spi_flash_write2(&g_lfs_spi, adr, data, cnt);
+}
+// called by LFS sync, queued pages must be on the chip after it
+void LFS_SPI_Flash_Sync() {
+	if (g_lfs_spi_ready == 0) {
+		return;
+	}
+	SPIFlash_Pump(&g_lfs_spi, true);
+}
+void flash_test_pages(int baseAddr, int length, byte pattern) {
 	int i, err = 0;
+	int start, eraseMs, writeMs, readMs;
+	unsigned int programs, polls, hits, misses;
 	byte *writeBuf = malloc(length);
 	byte *readBuf = malloc(length);
 
 	for (i = 0; i < length; i++)
 		writeBuf[i] = pattern;
 
-	if (0) {
-		spi_flash_erase(spi);
-	}
-	else {
+	programs = g_flashPagePrograms;
+	polls = g_flashStatusPolls;
+	hits = g_flashCacheHits;
+	misses = g_flashCacheMisses;
+	start = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	{
 		int startAddr = baseAddr & ~(0xFFF); // align down to 4KB
 		int endAddr = (baseAddr + length - 1) & ~(0xFFF); // align down last used address
 
 		for (int addr = startAddr; addr <= endAddr; addr += 4096) {
-			softspi_flash_erase_sector(spi, addr);
+			LFS_SPI_Flash_EraseSector(addr);
 		}
+		LFS_SPI_Flash_Sync();
 	}
+	eraseMs = xTaskGetTickCount() * portTICK_PERIOD_MS - start;
 	ADDLOG_INFO(LOG_FEATURE_CMD, "Erased flash.");
 
-	softspi_flash_read(spi, baseAddr, readBuf, length);
+	LFS_SPI_Flash_Read(baseAddr, length, readBuf);
 	for (i = 0; i < length; i++) {
 		if (readBuf[i] != 0xFF)
 			err++;
@@ -303,65 +608,31 @@ void flash_test_pages(softSPI_t* spi, int baseAddr, int length, byte pattern) {
 	ADDLOG_INFO(LOG_FEATURE_CMD, "Flash erased test: errors = %d/%d", err, length);
 
 	err = 0;
-	spi_flash_write2(spi, baseAddr, writeBuf, length);
+	start = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	LFS_SPI_Flash_Write(baseAddr, writeBuf, length);
+	LFS_SPI_Flash_Sync();
+	writeMs = xTaskGetTickCount() * portTICK_PERIOD_MS - start;
 	ADDLOG_INFO(LOG_FEATURE_CMD, "Wrote pattern %02X to flash.", pattern);
 
-	softspi_flash_read(spi, baseAddr, readBuf, length);
+	start = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	LFS_SPI_Flash_Read(baseAddr, length, readBuf);
+	readMs = xTaskGetTickCount() * portTICK_PERIOD_MS - start;
 	for (i = 0; i < length; i++) {
 		if (readBuf[i] != pattern)
 			err++;
 	}
 
 	ADDLOG_INFO(LOG_FEATURE_CMD, "Flash write-read test: errors = %d/%d", err, length);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Flash erase %i ms, write %i ms (%i KB/s), read %i ms (%i KB/s)",
+		eraseMs, writeMs, length / (writeMs > 0 ? writeMs : 1) * 1000 / 1024,
+		readMs, length / (readMs > 0 ? readMs : 1) * 1000 / 1024);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "Flash page programs %u, status polls %u, cache hits %u, misses %u",
+		g_flashPagePrograms - programs, g_flashStatusPolls - polls,
+		g_flashCacheHits - hits, g_flashCacheMisses - misses);
 
 	free(writeBuf);
 	free(readBuf);
 }
-
-softSPI_t g_lfs_spi;
-int g_lfs_spi_ready = 0;
-void LFS_SPI_Init() {
-	g_lfs_spi.miso = MISO_PIN;
-	g_lfs_spi.mosi = MOSI_PIN;
-	g_lfs_spi.ss = SS_PIN;
-	g_lfs_spi.sck = SCK_PIN;
-
-	SPI_Setup(&g_lfs_spi);
-	g_lfs_spi_ready = 1;
-}
-void LFS_SPI_Flash_EraseSector(int addr) {
-	if (g_lfs_spi_ready == 0) {
-		LFS_SPI_Init();
-	}
-	softspi_flash_erase_sector(&g_lfs_spi, addr);
-}
-void spi_test() {
-	softSPI_t spi;
-
-	spi.miso = MISO_PIN;
-	spi.mosi = MOSI_PIN;
-	spi.ss = SS_PIN;
-	spi.sck = SCK_PIN;
-	byte jedec_id[3];
-
-	SPI_Setup(&spi);
-
-	spi_flash_read_id(&spi, jedec_id);
-
-	ADDLOG_INFO(LOG_FEATURE_CMD, "ID %02X %02X %02X", jedec_id[0], jedec_id[1], jedec_id[2]);
-}
-void LFS_SPI_Flash_Read(int adr, int cnt, byte *data) {
-	if (g_lfs_spi_ready == 0) {
-		LFS_SPI_Init();
-	}
-	softspi_flash_read(&g_lfs_spi, adr, data, cnt);
-}
-void LFS_SPI_Flash_Write(int adr, const byte *data, int cnt) {
-	if (g_lfs_spi_ready == 0) {
-		LFS_SPI_Init();
-	}
-	spi_flash_write2(&g_lfs_spi, adr, data, cnt);
-}
 void spi_test_read_and_print(int adr, int cnt) {
 	byte *data;
 	int i;
@@ -386,16 +657,10 @@ void spi_test_read_and_print(int adr, int cnt) {
 }
 
 void spi_test_erase() {
-	softSPI_t spi;
-
-	spi.miso = MISO_PIN;
-	spi.mosi = MOSI_PIN;
-	spi.ss = SS_PIN;
-	spi.sck = SCK_PIN;
-
-	SPI_Setup(&spi);
-
-	spi_flash_erase(&spi);
+	if (g_lfs_spi_ready == 0) {
+		LFS_SPI_Init();
+	}
+	spi_flash_erase(&g_lfs_spi);
 }
 
 
@@ -474,16 +739,9 @@ static commandResult_t CMD_SPITestFlash_TestPages(const void* context, const cha
 		}
 	}
 
-	softSPI_t spi;
-	spi.miso = MISO_PIN;
-	spi.mosi = MOSI_PIN;
-	spi.ss = SS_PIN;
-	spi.sck = SCK_PIN;
-
-	SPI_Setup(&spi);
-	unsigned int st = g_timeMs;
-	flash_test_pages(&spi, addr, len, (byte)pattern);
-	int ela = g_timeMs - st;
+	unsigned int st = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	flash_test_pages(addr, len, (byte)pattern);
+	int ela = xTaskGetTickCount() * portTICK_PERIOD_MS - st;
 	ADDLOG_INFO(LOG_FEATURE_CMD, "CMD_SPITestFlash_TestPages %i ms",ela);
 
 	return CMD_RES_OK;
@@ -39,6 +39,8 @@ static char g_ssdp_uuid[40] = "e427ce1a-3e80-43d0-ad6f-89ec42e46363";
 
 static void DRV_SSDP_Send_Notify();
 static int ssdp_timercount = 0;
+// seconds between NOTIFY, 0 when they are off and only searches find us
+static int ssdp_notifyInterval = 30;
 
 extern const char *HAL_GetMyIPString();
 extern int Main_IsConnectedToWiFi();
@@ -56,65 +58,158 @@ int http_message_len = 0;
 
 
 #define MAX_OBK_DEVICES 40
-#define OBK_DEVICE_TIMEOUT 60
-
-typedef struct OBK_DEVICE_tag{
-    uint32_t ip;
-    int timeout; // seconds
-} OBK_DEVICE;
-
-static OBK_DEVICE obkDevices[MAX_OBK_DEVICES];
+// three notifies, so one lost packet does not drop device
+#define OBK_DEVICE_TIMEOUT 90
+#define OBK_DEVICE_HASH 64
+
+// Peers that announce themselves as OpenBk, from their NOTIFY and replies
+// to our M-SEARCH, so other drivers and fleet tools can ask one device
+// instead of scanning network. Found by IP through chained hash, chains
+// are indices into obkDevices plus one, so zeroed table is empty.
+static obkPeer_t obkDevices[MAX_OBK_DEVICES];
+static byte obkDeviceNext[MAX_OBK_DEVICES];
+static byte obkDeviceHash[OBK_DEVICE_HASH];
+static int obkDeviceCount = 0;
+
+static int obkDeviceBucket(uint32_t ip){
+    return (ip * 2654435761u) >> 26;
+}
+static void obkDeviceClear(){
+    memset(obkDevices, 0, sizeof(obkDevices));
+    memset(obkDeviceHash, 0, sizeof(obkDeviceHash));
+    obkDeviceCount = 0;
+}
+const obkPeer_t *SSDP_FindPeerByIP(uint32_t ip){
+    int i;
 
-static void obkDeviceTick(uint32_t ip){
+    for (i = obkDeviceHash[obkDeviceBucket(ip)]; i != 0; i = obkDeviceNext[i - 1]){
+        if (obkDevices[i - 1].ip == ip){
+            return &obkDevices[i - 1];
+        }
+    }
+    return 0;
+}
+const obkPeer_t *SSDP_FindPeerByName(const char *name){
     int i;
+
     for (i = 0; i < MAX_OBK_DEVICES; i++){
-        if (obkDevices[i].ip == ip){
-            obkDevices[i].timeout = OBK_DEVICE_TIMEOUT;
-            addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"SSDP obk device still present 0x%08x",ip);
-            break;
+        if (obkDevices[i].ip != 0 && !stricmp(obkDevices[i].name, name)){
+            return &obkDevices[i];
         }
     }
+    return 0;
+}
+// slots 0..SSDP_GetPeerSlots()-1, 0 for empty one
+const obkPeer_t *SSDP_GetPeer(int index){
+    if (index < 0 || index >= MAX_OBK_DEVICES || obkDevices[index].ip == 0){
+        return 0;
+    }
+    return &obkDevices[index];
+}
+int SSDP_GetPeerSlots(){
+    return MAX_OBK_DEVICES;
+}
+int SSDP_GetPeerCount(){
+    return obkDeviceCount;
+}
+static void obkDeviceRemove(int i){
+    byte *link = &obkDeviceHash[obkDeviceBucket(obkDevices[i].ip)];
 
-    if (i == MAX_OBK_DEVICES){
-        for (i = 0; i < MAX_OBK_DEVICES; i++){
-            if (obkDevices[i].ip == 0){
-                obkDevices[i].ip = ip;
-                obkDevices[i].timeout = OBK_DEVICE_TIMEOUT;
-                addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"SSDP new obk device 0x%08x",ip);
-                break;
-            }
+    while (*link != i + 1){
+        link = &obkDeviceNext[*link - 1];
+    }
+    *link = obkDeviceNext[i];
+    addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"SSDP obk device gone 0x%08x",obkDevices[i].ip);
+    memset(&obkDevices[i], 0, sizeof(obkDevices[i]));
+    obkDeviceCount--;
+}
+// name and version are kept when packet does not have them
+static void obkDeviceTick(uint32_t ip, const char *name, const char *version){
+    obkPeer_t *d = (obkPeer_t*)SSDP_FindPeerByIP(ip);
+    int i, b;
+
+    if (d == 0){
+        for (i = 0; i < MAX_OBK_DEVICES && obkDevices[i].ip != 0; i++){
         }
+        if (i == MAX_OBK_DEVICES){
+            addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"SSDP no room for obk device 0x%08x",ip);
+            return;
+        }
+        d = &obkDevices[i];
+        d->ip = ip;
+        b = obkDeviceBucket(ip);
+        obkDeviceNext[i] = obkDeviceHash[b];
+        obkDeviceHash[b] = i + 1;
+        obkDeviceCount++;
+        addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"SSDP new obk device 0x%08x",ip);
+    }
+    if (name && *name){
+        strcpy_safe(d->name, name, sizeof(d->name));
     }
+    if (version && *version){
+        strcpy_safe(d->version, version, sizeof(d->version));
+    }
+    d->lastSeen = g_secondsElapsed;
+}
+static void obkDeviceFormatIP(char *out, int outSize, uint32_t ip){
+    snprintf(out, outSize, "%d.%d.%d.%d",
+        ip & 0xff,
+        (ip & 0xff00)>>8,
+        (ip & 0xff0000) >> 16,
+        (ip & 0xff000000) >> 24
+        );
 }
 
 static void obkDeviceList(){
+    char ip[16];
+
     for (int i = 0; i < MAX_OBK_DEVICES; i++){
         if (obkDevices[i].ip != 0){
-            addLogAdv(LOG_INFO, LOG_FEATURE_HTTP,"obk device 0x%08x", obkDevices[i].ip);
+            obkDeviceFormatIP(ip, sizeof(ip), obkDevices[i].ip);
+            addLogAdv(LOG_INFO, LOG_FEATURE_HTTP,"obk device %s %s %s, seen %i s ago", ip,
+                obkDevices[i].name, obkDevices[i].version, g_secondsElapsed - obkDevices[i].lastSeen);
         }
     }
 }
 
-
+// GET /obkdevicelist?page=0&size=20
 static int http_rest_get_devicelist(http_request_t* request) {
-	http_setup(request, httpMimeTypeJson);
-	hprintf255(request, "[");
-    int count = 0;
-    for (int i = 0; i < MAX_OBK_DEVICES; i++){
-        if (obkDevices[i].ip != 0){
-            if (count) hprintf255(request,",");
-            hprintf255(request,"{\"ip\":\"%d.%d.%d.%d\"}", 
-                obkDevices[i].ip & 0xff,
-                (obkDevices[i].ip & 0xff00)>>8,
-                (obkDevices[i].ip & 0xff0000) >> 16,
-                (obkDevices[i].ip & 0xff000000) >> 24
-                );
-            count++;
+    jsonWriter_t w;
+    char tmp[16];
+    int page, size, at, i;
+
+    page = http_getArg(request->url, "page", tmp, sizeof(tmp)) ? atoi(tmp) : 0;
+    size = http_getArg(request->url, "size", tmp, sizeof(tmp)) ? atoi(tmp) : 20;
+    if (size <= 0 || size > MAX_OBK_DEVICES){
+        size = MAX_OBK_DEVICES;
+    }
+    http_setup(request, httpMimeTypeJson);
+    JSONW_Init(&w, request);
+    JSONW_StartObject(&w, NULL);
+    JSONW_Int(&w, "count", obkDeviceCount);
+    JSONW_Int(&w, "page", page);
+    JSONW_Int(&w, "pages", (obkDeviceCount + size - 1) / size);
+    JSONW_StartArray(&w, "devices");
+    at = 0;
+    for (i = 0; i < MAX_OBK_DEVICES; i++){
+        if (obkDevices[i].ip == 0){
+            continue;
         }
+        if (at >= page * size && at < (page + 1) * size){
+            obkDeviceFormatIP(tmp, sizeof(tmp), obkDevices[i].ip);
+            JSONW_StartObject(&w, NULL);
+            JSONW_String(&w, "ip", tmp);
+            JSONW_String(&w, "name", obkDevices[i].name);
+            JSONW_String(&w, "version", obkDevices[i].version);
+            JSONW_Int(&w, "seen", g_secondsElapsed - obkDevices[i].lastSeen);
+            JSONW_EndObject(&w);
+        }
+        at++;
     }
-	hprintf255(request, "]\n");
-	poststr(request, NULL);
-	return 0;
+    JSONW_EndArray(&w);
+    JSONW_EndObject(&w);
+    poststr(request, NULL);
+    return 0;
 }
 
 ///////////////////////////////
@@ -222,6 +317,8 @@ static const char message_template[] =
 "01-NLS: %s\r\n" \
 "ST: upnp:rootdevice\r\n" \
 "SERVER: OpenBk\r\n" \
+"X-OBK-NAME: %s\r\n" \
+"X-OBK-VERSION: %s\r\n" \
 "USN: %s::upnp:rootdevice\r\n" \
 "BOOTID.UPNP.ORG: 0\r\n" \
 "CONFIGID.UPNP.ORG: 1\r\n" \
@@ -257,13 +354,15 @@ static void DRV_SSDP_Send_Advert_To(struct sockaddr_in *addr) {
 
 
     if (!advert_message){
-        advert_maxlen = strlen(message_template) +  100;
+        advert_maxlen = strlen(message_template) +  200;
         advert_message = (char *)malloc(advert_maxlen+1);
     }
 
     snprintf(advert_message, advert_maxlen, message_template, 
         myip, 
         g_ssdp_uuid, 
+        CFG_GetShortDeviceName(),
+        USER_SW_VER,
         g_ssdp_uuid);
 
 	DRV_SSDP_SendReply(addr,advert_message);
@@ -284,6 +383,8 @@ static const char notify_template[] =
 "LOCATION: http://%s:80/ssdp.xml\r\n" \
 "NTS: ssdp:alive\r\n" \
 "NT: upnp:rootdevice\r\n" \
+"X-OBK-NAME: %s\r\n" \
+"X-OBK-VERSION: %s\r\n" \
 "USN: uuid:%s::upnp:rootdevice\r\n" \
 "\r\n\r\n" \
 ;
@@ -309,15 +410,15 @@ static void DRV_SSDP_Send_Notify() {
     const char *myip = HAL_GetMyIPString();
 
     if (!notify_message){
-        notify_maxlen = strlen(notify_template) +  100;
+        notify_maxlen = strlen(notify_template) +  200;
         notify_message = (char *)malloc(notify_maxlen+1);
     }
 
-    snprintf(notify_message, notify_maxlen, notify_template, myip, g_ssdp_uuid);
+    snprintf(notify_message, notify_maxlen, notify_template, myip, CFG_GetShortDeviceName(), USER_SW_VER, g_ssdp_uuid);
 
     int len = strlen(notify_message);
 
-	addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"DRV_SSDP_Send_Notify: space: %d msg:%d", strlen(notify_template) +  100, len);
+	addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"DRV_SSDP_Send_Notify: space: %d msg:%d", notify_maxlen, len);
 	addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"DRV_SSDP_Send_Notify: \r\n%s\r\n", notify_message);
 
     // set up destination address
@@ -339,6 +440,27 @@ static void DRV_SSDP_Send_Notify() {
 }
 
 
+static const char search_message[] = 
+"M-SEARCH * HTTP/1.1\r\n" \
+"HOST: 239.255.255.250:1900\r\n" \
+"MAN: \"ssdp:discover\"\r\n" \
+"MX: 2\r\n" \
+"ST: upnp:rootdevice\r\n" \
+"\r\n" \
+;
+
+// peers reply with their advert, so list is full without waiting for notifies
+static void DRV_SSDP_Send_Search() {
+    struct sockaddr_in multicastaddr;
+
+    memset(&multicastaddr, 0, sizeof(multicastaddr));
+    multicastaddr.sin_family = AF_INET;
+    multicastaddr.sin_addr.s_addr = inet_addr(ssdp_group);
+    multicastaddr.sin_port = htons(ssdp_port);
+    DRV_SSDP_SendReply(&multicastaddr, search_message);
+}
+
+
 static const char *http_reply = 
 "<root>\r\n" \
 "    <specVersion>\r\n" \
@@ -406,6 +528,17 @@ static int DRV_SSDP_Service_Http(http_request_t* request){
 
 static commandResult_t Cmd_obkDeviceList(const void *context, const char *cmd, const char *args, int cmdFlags){
     obkDeviceList();
+    // for next call
+    DRV_SSDP_Send_Search();
+    return CMD_RES_OK;
+}
+static commandResult_t Cmd_ssdp_notify(const void *context, const char *cmd, const char *args, int cmdFlags){
+    Tokenizer_TokenizeString(args, 0);
+    if (Tokenizer_GetArgsCount() >= 1){
+        ssdp_notifyInterval = Tokenizer_GetArgInteger(0);
+        ssdp_timercount = 0;
+    }
+    addLogAdv(LOG_INFO, LOG_FEATURE_HTTP,"SSDP NOTIFY every %i s (0 is off)", ssdp_notifyInterval);
     return CMD_RES_OK;
 }
 
@@ -421,7 +554,7 @@ void DRV_SSDP_Init()
         return;
     }
 
-    memset(obkDevices, 0, sizeof(obkDevices));
+    obkDeviceClear();
 
     addLogAdv(LOG_INFO, LOG_FEATURE_HTTP,"DRV_SSDP_Init");
     // like "e427ce1a-3e80-43d0-ad6f-89ec42e46363";
@@ -435,12 +568,18 @@ void DRV_SSDP_Init()
     );
 
 	DRV_SSDP_CreateSocket_Receive();
+    DRV_SSDP_Send_Search();
     HTTP_RegisterCallback("/ssdp.xml", HTTP_GET, DRV_SSDP_Service_Http, 0);
 	//cmddetail:{"name":"obkDeviceList","args":"",
-	//cmddetail:"descr":"Generate the SSDP list of OpenBeken devices found on the network.",
+	//cmddetail:"descr":"Prints OpenBeken devices found on the network by SSDP, with name, version and when they were last seen, and sends search so the list is fresh. Same list is in JSON at /obkdevicelist?page=0&size=20.",
 	//cmddetail:"fn":"Cmd_obkDeviceList","file":"driver/drv_ssdp.c","requires":"",
 	//cmddetail:"examples":""}
     CMD_RegisterCommand("obkDeviceList", Cmd_obkDeviceList, NULL);
+	//cmddetail:{"name":"ssdp_notify","args":"[Seconds]",
+	//cmddetail:"descr":"Sets how often SSDP NOTIFY is multicast, 30 seconds by default. 0 stops them, when MDNS driver announces device instead; other OpenBeken devices then see it only after their search, as they drop it 90 seconds after last NOTIFY.",
+	//cmddetail:"fn":"Cmd_ssdp_notify","file":"driver/drv_ssdp.c","requires":"",
+	//cmddetail:"examples":"ssdp_notify 0"}
+    CMD_RegisterCommand("ssdp_notify", Cmd_ssdp_notify, NULL);
 
     HTTP_RegisterCallback("/obkdevicelist", HTTP_GET, http_rest_get_devicelist, 0);
 
@@ -454,21 +593,121 @@ void DRV_SSDP_RunEverySecond() {
 	}
 
     ssdp_timercount++;
-    if (ssdp_timercount >= 30){
+    if (ssdp_notifyInterval > 0 && ssdp_timercount >= ssdp_notifyInterval){
         // multicast a notify
         DRV_SSDP_Send_Notify();
         ssdp_timercount = 0;
     }
 
     for (int i = 0; i < MAX_OBK_DEVICES; i++){
-        if (obkDevices[i].timeout){
-            obkDevices[i].timeout --;
-            if (!obkDevices[i].timeout){
-                obkDevices[i].ip = 0;
+        if (obkDevices[i].ip != 0 && g_secondsElapsed - obkDevices[i].lastSeen > OBK_DEVICE_TIMEOUT){
+            obkDeviceRemove(i);
+        }
+    }
+}
+
+// value of header line "Key: value", empty if there is none
+static void SSDP_GetHeader(const char *msg, const char *key, char *out, int outSize){
+    int keyLen = strlen(key);
+    const char *p = msg;
+    int n;
+
+    *out = 0;
+    while (*p){
+        if (!wal_strnicmp(p, key, keyLen) && p[keyLen] == ':'){
+            p += keyLen + 1;
+            while (*p == ' '){
+                p++;
+            }
+            for (n = 0; n < outSize - 1 && p[n] && p[n] != '\r' && p[n] != '\n'; n++){
+                out[n] = p[n];
             }
+            out[n] = 0;
+            return;
+        }
+        while (*p && *p != '\n'){
+            p++;
+        }
+        if (*p){
+            p++;
         }
     }
 }
+// msg is zero terminated, addr is sender
+static void SSDP_ProcessPacket(char *msg, struct sockaddr_in *addr) {
+    /* we may get:
+    M-SEARCH * HTTP/1.1
+    HOST:239.255.255.250:1900
+    ST:upnp:rootdevice
+    MX:2
+    MAN:"ssdp:discover"
+    */
+
+    // if search, then respond
+    // we SHOULD be a little more specific!!!
+    if (!strncmp(msg, "M-SEARCH", 8)){
+        // reply with our advert to the sender
+        addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"Is MSEARCH - responding");
+#if ENABLE_DRIVER_WEMO
+		if (DRV_IsRunning(DRV_ID_Wemo)) {
+			if (strcasestr(msg, "urn:belkin:device:**")) {
+				DRV_WEMO_Send_Advert_To(1, addr);
+				return;
+			}
+			else if (strcasestr(msg, "upnp:rootdevice")
+				|| strcasestr(msg, "ssdpsearch:all")
+				|| strcasestr(msg, "ssdp:all")) {
+				DRV_WEMO_Send_Advert_To(2, addr);
+				return;
+			}
+		}
+#endif
+#if ENABLE_DRIVER_HUE
+		if (DRV_IsRunning(DRV_ID_Hue)) {
+			if (strcasestr(msg, ":device:basic:1")
+				|| strcasestr(msg, "upnp:rootdevice")
+				|| strcasestr(msg, "ssdpsearch:all")
+				|| strcasestr(msg, "ssdp:all")) {
+				addLogAdv(LOG_ALL, LOG_FEATURE_HTTP, "SSDP has received HUE PACKET");
+				addLogAdv(LOG_ALL, LOG_FEATURE_HTTP, msg);
+				DRV_HUE_Send_Advert_To(addr);
+				return;
+			}
+		}
+#endif
+		DRV_SSDP_Send_Advert_To(addr);
+    }
+
+    // our NOTIFY, and reply to our M-SEARCH, both have SERVER: OpenBk
+    if (!strncmp(msg, "NOTIFY", 6) || !strncmp(msg, "HTTP/1.1 200", 12)){
+        char value[32];
+        char version[32];
+
+        SSDP_GetHeader(msg, "SERVER", value, sizeof(value));
+        if (strcmp(value, "OpenBk")){
+            return;
+        }
+        // ours, back from multicast
+        if (strstr(msg, g_ssdp_uuid)){
+            return;
+        }
+        addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"NOTIFY from a peer device");
+        SSDP_GetHeader(msg, "X-OBK-NAME", value, sizeof(value));
+        SSDP_GetHeader(msg, "X-OBK-VERSION", version, sizeof(version));
+        obkDeviceTick(addr->sin_addr.s_addr, value, version);
+    }
+}
+
+// for selftests, packet that came from given IP
+void SSDP_ProcessPacketFrom(char *msg, const char *ip) {
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(ip);
+    addr.sin_port = htons(ssdp_port);
+    SSDP_ProcessPacket(msg, &addr);
+}
 
 void DRV_SSDP_RunQuickTick() {
 
@@ -507,70 +746,9 @@ void DRV_SSDP_RunQuickTick() {
     addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"data: %s",udp_msgbuf);
     udp_msgbuf[nbytes] = '\0';
 
-    /* we may get:
-    M-SEARCH * HTTP/1.1
-    HOST:239.255.255.250:1900
-    ST:upnp:rootdevice
-    MX:2
-    MAN:"ssdp:discover"
-    */
-
-    // if search, then respond
-    // we SHOULD be a little more specific!!!
-    if (!strncmp(udp_msgbuf, "M-SEARCH", 8)){
-        // reply with our advert to the sender
-        addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"Is MSEARCH - responding");
-#if ENABLE_DRIVER_WEMO
-		if (DRV_IsRunning("WEMO")) {
-			if (strcasestr(udp_msgbuf, "urn:belkin:device:**")) {
-				DRV_WEMO_Send_Advert_To(1, &addr);
-				return;
-			}
-			else if (strcasestr(udp_msgbuf, "upnp:rootdevice")
-				|| strcasestr(udp_msgbuf, "ssdpsearch:all")
-				|| strcasestr(udp_msgbuf, "ssdp:all")) {
-				DRV_WEMO_Send_Advert_To(2, &addr);
-				return;
-			}
-		}
-#endif
-#if ENABLE_DRIVER_HUE
-		if (DRV_IsRunning("HUE")) {
-			if (strcasestr(udp_msgbuf, ":device:basic:1")
-				|| strcasestr(udp_msgbuf, "upnp:rootdevice")
-				|| strcasestr(udp_msgbuf, "ssdpsearch:all")
-				|| strcasestr(udp_msgbuf, "ssdp:all")) {
-				addLogAdv(LOG_ALL, LOG_FEATURE_HTTP, "SSDP has received HUE PACKET");
-				addLogAdv(LOG_ALL, LOG_FEATURE_HTTP, udp_msgbuf);
-				DRV_HUE_Send_Advert_To(&addr);
-				return;
-			}
-		}
-#endif
-		DRV_SSDP_Send_Advert_To(&addr);
-    }
-
-    // our NOTIFTY like:
-    //"NOTIFY * HTTP/1.1\r\n" 
-    //"SERVER: OpenBk\r\n" 
-    if (!strncmp(udp_msgbuf, "NOTIFY", 6)){
-        const char *p = udp_msgbuf;
-        while (*p && *p != '\n'){
-            p++;
-        }
-        if (*p == '\n'){
-            p++;
-            if (!strncmp(p, "SERVER: OpenBk", 14)){
-                addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_HTTP,"NOTIFY from a peer device");
-                // add the device to the device list, or set timeout to 0
-                obkDeviceTick(*(uint32_t *)(&((struct sockaddr_in *)&addr)->sin_addr));
-            }
-        }
-    }
-
+    SSDP_ProcessPacket(udp_msgbuf, &addr);
 }
 
-
 void DRV_SSDP_Shutdown(){
     addLogAdv(LOG_INFO, LOG_FEATURE_HTTP,"DRV_SSDP_Shutdown");
     DRV_SSDP_Active = 0;
@@ -6,8 +6,10 @@
  * SINGLE RESPONSIBILITY: Read OBK channels → draw pixels on screen.
  * NO relay GPIO.  NO buttons.  NO NTC.  NO session math.  NO MQTT.
  *
- * startDriver ST7735 <SCK> <SDA> <RES> <DC> <CS> [BLK]
- * Example:   startDriver ST7735 14 16 9 17 15 24
+ * startDriver ST7735 <SCK> <SDA> <RES> <DC> <CS> [BLK] [HwSPI]
+ * Example:   startDriver ST7735 14 16 9 17 15 24 1
+ *   HwSPI=1 sends through hardware SPI + DMA where drv_spidma.c has it
+ *   (BK7231N / new Beken SDK, SCK=P14 SDA=P16), else bit-bang is kept.
  *
  * ── CHANNEL INPUT MAP ────────────────────────────────────────────────────
  *   Ch 1  = Voltage      (V  × 100)    e.g. 22150 = 221.50 V
@@ -114,6 +116,15 @@
  *       the backlight if autoexec ran after Init() completed.
  *   The CMD_Brightness command (st7735_brightness 0|1) still works
  *   correctly for runtime use.
+ *
+ * ── LINE BUFFER RENDERING ────────────────────────────────────────────────
+ *   Zones, rects and strings are rendered row by row as RGB565 into a
+ *   small line buffer and sent in bursts inside one TFT_SetWindow().
+ *   A zone used to cost a black FillRect plus one window per glyph and
+ *   two SPI_WriteByte() calls per pixel, so every value change wrote each
+ *   pixel twice.  Now it is written once, and with HwSPI each burst is a
+ *   single DMA transfer.  The zone string caches stay the dirty tracking;
+ *   a full 25 KB framebuffer would not pay off for this fixed layout.
  */
 
 #include "../obk_config.h"
@@ -124,6 +135,7 @@
 #include "../new_cfg.h"
 #include "../new_pins.h"
 #include "../cmnds/cmd_public.h"
+#include "../hal/hal_generic.h"
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
@@ -214,28 +226,84 @@ static uint8_t  g_txt_scale = 1;
 #define SPI_BLK_ON()  SPI_BLK_L()   /* intent-safe: enable  backlight */
 #define SPI_BLK_OFF() SPI_BLK_H()   /* intent-safe: disable backlight */
 
-static inline void spi_delay(void) { volatile int i = 4; while (i--) {} }
-
+/* NOTE: spi_delay() busy loop per half-clock removed — one
+ * HAL_PIN_SetOutputValue() call already takes longer than the ST7735S
+ * minimum SCK high/low time (15 ns), the loop only doubled bit time.     */
 static void SPI_WriteByte(uint8_t b)
 {
     uint8_t i;
     for (i = 0; i < 8; i++) {
         if (b & 0x80) { SPI_SDA_H(); } else { SPI_SDA_L(); }
-        spi_delay(); SPI_SCK_H(); spi_delay(); SPI_SCK_L();
+        SPI_SCK_H(); SPI_SCK_L();
         b <<= 1;
     }
 }
 
+/* ── Optional hardware SPI + DMA ─────────────────────────────────────────
+ * Reuses drv_spidma.c (3 MHz, mode 0).  On Beken its SCK is fixed to P14
+ * and MOSI to P16; SPIDMA_Init() also turns P17 into MISO, so DC (P17 on
+ * KWS-303WF) is set back to GPIO output right after it.  CS and DC stay
+ * GPIOs.  DMA source is read by 32-bit words, so buffers are aligned.
+ * DMA done does not mean the SPI FIFO is empty — CS/DC wait for drain.   */
+#if PLATFORM_BK7231N || PLATFORM_BEKEN_NEW
+#include "drv_spidma.h"
+#define ST7735_HAS_SPIDMA     1
+#define ST7735_HW_SCK        14
+#define ST7735_HW_SDA        16
+#define ST7735_DMA_DRAIN_US  50   /* > 16-byte FIFO at 3 MHz */
+static struct spi_message g_spi_msg;
+#elif WINDOWS
+/* simulator sends each burst to drv_spi.c, where a selftest can watch it */
+#include "drv_spi.h"
+#endif
+static uint8_t  g_use_dma = 0;
+static uint32_t g_cmd_word;       /* aligned single byte for commands */
+
+/* Sends len bytes with current DC; caller holds CS low. */
+static void TFT_WriteBurst(const uint8_t *buf, uint32_t len)
+{
+#if ST7735_HAS_SPIDMA
+    if (g_use_dma) {
+        g_spi_msg.send_buf = (byte *)buf;
+        g_spi_msg.send_len = len;
+        SPIDMA_StartTX(&g_spi_msg);
+        return;
+    }
+#elif WINDOWS
+    if (g_use_dma) {
+        SPI_WriteBytes(buf, len);
+        return;
+    }
+#endif
+    while (len--) SPI_WriteByte(*buf++);
+}
+
+static void TFT_Deselect(void)
+{
+#if ST7735_HAS_SPIDMA
+    if (g_use_dma) HAL_Delay_us(ST7735_DMA_DRAIN_US);
+#endif
+    SPI_CS_H();
+}
+
 static void TFT_WriteCmd(uint8_t cmd)
-    { SPI_CS_L(); SPI_DC_L(); SPI_WriteByte(cmd); SPI_CS_H(); }
+{
+    *(uint8_t *)&g_cmd_word = cmd;
+    SPI_CS_L(); SPI_DC_L(); TFT_WriteBurst((uint8_t *)&g_cmd_word, 1); TFT_Deselect();
+}
 
 static void TFT_WriteData8(uint8_t d)
-    { SPI_CS_L(); SPI_DC_H(); SPI_WriteByte(d);   SPI_CS_H(); }
+{
+    *(uint8_t *)&g_cmd_word = d;
+    SPI_CS_L(); SPI_DC_H(); TFT_WriteBurst((uint8_t *)&g_cmd_word, 1); TFT_Deselect();
+}
 
 /* ══════════════════════════════════════════════════════════════════════════
  * SECTION D — DELAY
  * ══════════════════════════════════════════════════════════════════════════ */
+#if !WINDOWS
 extern int rtos_delay_milliseconds(uint32_t num_ms);
+#endif
 static void ST7735_Delay(uint32_t ms) { (void)rtos_delay_milliseconds(ms); }
 
 /* ══════════════════════════════════════════════════════════════════════════
@@ -309,29 +377,55 @@ static void TFT_InitController(void)
 /* ══════════════════════════════════════════════════════════════════════════
  * SECTION F — DRAWING PRIMITIVES
  * ══════════════════════════════════════════════════════════════════════════ */
+/* Each address pair goes out as one 4-byte burst. */
+static void TFT_WriteData4(uint8_t a, uint8_t b)
+{
+    uint8_t *p = (uint8_t *)&g_cmd_word;
+    p[0] = 0x00; p[1] = a; p[2] = 0x00; p[3] = b;
+    SPI_CS_L(); SPI_DC_H(); TFT_WriteBurst(p, 4); TFT_Deselect();
+}
+
 static void TFT_SetWindow(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
 {
     TFT_WriteCmd(ST77_CASET);
-    TFT_WriteData8(0x00); TFT_WriteData8(x0 + ST7735_COL_OFFSET);
-    TFT_WriteData8(0x00); TFT_WriteData8(x1 + ST7735_COL_OFFSET);
+    TFT_WriteData4(x0 + ST7735_COL_OFFSET, x1 + ST7735_COL_OFFSET);
     TFT_WriteCmd(ST77_RASET);
-    TFT_WriteData8(0x00); TFT_WriteData8(y0 + ST7735_ROW_OFFSET);
-    TFT_WriteData8(0x00); TFT_WriteData8(y1 + ST7735_ROW_OFFSET);
+    TFT_WriteData4(y0 + ST7735_ROW_OFFSET, y1 + ST7735_ROW_OFFSET);
     TFT_WriteCmd(ST77_RAMWR);
 }
 
+/* ── Line buffer ─────────────────────────────────────────────────────────
+ * RGB565 big-endian pixels of up to ST7735_LINEBUF_ROWS full panel rows;
+ * one burst each.  Word array keeps it aligned for DMA.                  */
+#define ST7735_LINEBUF_ROWS    8
+#define ST7735_LINEBUF_PIXELS  (ST7735_WIDTH * ST7735_LINEBUF_ROWS)
+static uint32_t g_line_words[ST7735_LINEBUF_PIXELS / 2];
+#define g_line_buf ((uint8_t *)g_line_words)
+
+static void TFT_FillPixels(uint8_t *p, uint32_t n, uint16_t colour)
+{
+    uint8_t hi = colour >> 8, lo = colour & 0xFF;
+    while (n--) { *p++ = hi; *p++ = lo; }
+}
+
 void ST7735_FillRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint16_t colour)
 {
     if (!g_initialized) return;
     if (x >= ST7735_WIDTH  || y >= ST7735_HEIGHT) return;
     if (x + w > ST7735_WIDTH)  w = (uint8_t)(ST7735_WIDTH  - x);
     if (y + h > ST7735_HEIGHT) h = (uint8_t)(ST7735_HEIGHT - y);
+    if (w == 0 || h == 0) return;
     TFT_SetWindow(x, y, (uint8_t)(x+w-1), (uint8_t)(y+h-1));
-    uint8_t hi = colour >> 8, lo = colour & 0xFF;
     uint32_t n = (uint32_t)w * h;
+    uint32_t chunk = n < ST7735_LINEBUF_PIXELS ? n : ST7735_LINEBUF_PIXELS;
+    TFT_FillPixels(g_line_buf, chunk, colour);
     SPI_CS_L(); SPI_DC_H();
-    while (n--) { SPI_WriteByte(hi); SPI_WriteByte(lo); }
-    SPI_CS_H();
+    while (n) {
+        uint32_t k = n < chunk ? n : chunk;
+        TFT_WriteBurst(g_line_buf, k * 2);
+        n -= k;
+    }
+    TFT_Deselect();
 }
 
 void ST7735_FillScreen(uint16_t colour)
@@ -512,51 +606,93 @@ static const uint8_t g_font5x7[][5] = {
  *
  *  CPU cost of new branch: 1 compare + 1 jump, fires only for cost-row redraws.
  * ──────────────────────────────────────────────────────────────────────── */
-void ST7735_DrawChar(uint8_t x, uint8_t y, char c,
-                     uint16_t fg, uint16_t bg, uint8_t scale)
+static const uint8_t *TFT_Glyph(char c)
 {
     uint8_t glyph_idx;
-    if (!g_initialized) return;
-
     if ((uint8_t)c == (uint8_t)RUPEE_CHAR) {
         glyph_idx = 95u;                      /* ₹ custom glyph at index 95  */
     } else {
         if (c < 0x20 || c > 0x7E) c = '?';   /* clamp unknown chars         */
         glyph_idx = (uint8_t)(c - 0x20);      /* standard ASCII 0x20-0x7E   */
     }
+    return g_font5x7[glyph_idx];
+}
 
-    if (x + FONT_W * scale > ST7735_WIDTH)  return;
-    if (y + FONT_H * scale > ST7735_HEIGHT) return;
+#define TFT_MAX_CHARS  (ST7735_WIDTH / FONT_ADV + 1)
+
+/* ── TFT_RenderText: one window, rows rendered into line buffer ─────────
+ *
+ *  Window x,y zw×zh is painted bg, with str from its left edge and text
+ *  row ty.  Glyphs that do not fit in zw are dropped, as DrawString()
+ *  drops them at panel edge.  Gaps between glyphs are painted bg too.
+ * ──────────────────────────────────────────────────────────────────────── */
+static void TFT_RenderText(uint8_t x, uint8_t y, uint8_t zw, uint8_t zh,
+                           uint8_t ty, const char *str,
+                           uint16_t fg, uint16_t bg, uint8_t sc)
+{
+    const uint8_t *gl[TFT_MAX_CHARS];
+    uint8_t nch = 0, r, k, i, col, s, grow;
+    uint8_t hi = fg >> 8, lo = fg & 0xFF;
+    uint8_t rows_per_burst;
+    uint8_t *p;
+
+    if (!g_initialized) return;
+    if (x >= ST7735_WIDTH || y >= ST7735_HEIGHT) return;
+    if (x + zw > ST7735_WIDTH)  zw = (uint8_t)(ST7735_WIDTH  - x);
+    if (y + zh > ST7735_HEIGHT) zh = (uint8_t)(ST7735_HEIGHT - y);
+    if (zw == 0 || zh == 0) return;
+    while (str && str[nch] && nch < TFT_MAX_CHARS &&
+           (nch * FONT_ADV + FONT_W) * sc <= zw) {
+        gl[nch] = TFT_Glyph(str[nch]);
+        nch++;
+    }
 
-    const uint8_t *gl = g_font5x7[glyph_idx];
-    TFT_SetWindow(x, y,
-                  (uint8_t)(x + FONT_W * scale - 1),
-                  (uint8_t)(y + FONT_H * scale - 1));
+    TFT_SetWindow(x, y, (uint8_t)(x + zw - 1), (uint8_t)(y + zh - 1));
+    rows_per_burst = (uint8_t)(ST7735_LINEBUF_PIXELS / zw);
     SPI_CS_L(); SPI_DC_H();
-    uint8_t row, s, col, t;
-    for (row = 0; row < FONT_H; row++) {
-        for (s = 0; s < scale; s++) {
-            for (col = 0; col < FONT_W; col++) {
-                uint16_t colour = ((gl[col] >> row) & 1) ? fg : bg;
-                uint8_t hi = colour >> 8, lo = colour & 0xFF;
-                for (t = 0; t < scale; t++) {
-                    SPI_WriteByte(hi); SPI_WriteByte(lo);
+    for (r = 0; r < zh; ) {
+        p = g_line_buf;
+        for (k = 0; k < rows_per_burst && r < zh; k++, r++) {
+            TFT_FillPixels(p, zw, bg);
+            if (r >= ty && r < ty + FONT_H * sc) {
+                grow = (uint8_t)((r - ty) / sc);
+                for (i = 0; i < nch; i++) {
+                    uint8_t *cp = p + 2 * (i * FONT_ADV * sc);
+                    for (col = 0; col < FONT_W; col++) {
+                        if (!((gl[i][col] >> grow) & 1)) continue;
+                        for (s = 0; s < sc; s++) {
+                            cp[2 * (col * sc + s)]     = hi;
+                            cp[2 * (col * sc + s) + 1] = lo;
+                        }
+                    }
                 }
             }
+            p += 2 * zw;
         }
+        TFT_WriteBurst(g_line_buf, (uint32_t)(p - g_line_buf));
     }
-    SPI_CS_H();
+    TFT_Deselect();
+}
+
+void ST7735_DrawChar(uint8_t x, uint8_t y, char c,
+                     uint16_t fg, uint16_t bg, uint8_t scale)
+{
+    char s[2] = { c, 0 };
+    if (x + FONT_W * scale > ST7735_WIDTH)  return;
+    if (y + FONT_H * scale > ST7735_HEIGHT) return;
+    TFT_RenderText(x, y, FONT_W * scale, FONT_H * scale, 0, s, fg, bg, scale);
 }
 
 void ST7735_DrawString(uint8_t x, uint8_t y, const char *str,
                        uint16_t fg, uint16_t bg, uint8_t scale)
 {
+    uint8_t n = 0;
     if (!g_initialized || !str) return;
-    while (*str) {
-        if (x + FONT_W * scale > ST7735_WIDTH) break;
-        ST7735_DrawChar(x, y, *str++, fg, bg, scale);
-        x = (uint8_t)(x + FONT_ADV * scale);
-    }
+    if (y + FONT_H * scale > ST7735_HEIGHT) return;
+    while (str[n] && x + (n * FONT_ADV + FONT_W) * scale <= ST7735_WIDTH) n++;
+    if (n == 0) return;
+    TFT_RenderText(x, y, (uint8_t)(((n - 1) * FONT_ADV + FONT_W) * scale),
+                   FONT_H * scale, 0, str, fg, bg, scale);
 }
 
 /* ══════════════════════════════════════════════════════════════════════════
@@ -631,9 +767,9 @@ static void zone_update(uint8_t x, uint8_t y, uint8_t zw, uint8_t zh,
     if (strcmp(str, cache) == 0) return;
     strncpy(cache, str, cache_sz - 1);
     cache[cache_sz - 1] = '\0';
-    ST7735_FillRect(x, y, zw, zh, ST7735_BLACK);
-    uint8_t ty = y + (uint8_t)((zh - FONT_H * sc) / 2);
-    ST7735_DrawString(x, ty, str, fg, ST7735_BLACK, (uint8_t)sc);
+    /* one window: black and text in a single pass, no double write */
+    TFT_RenderText(x, y, zw, zh, (uint8_t)((zh - FONT_H * sc) / 2),
+                   str, fg, ST7735_BLACK, sc);
 }
 
 static void draw_static_labels(void)
@@ -708,8 +844,8 @@ static void display_tick(void)
         }
         if (strncmp(rs, p_rly, sizeof(p_rly)) != 0) {
             strncpy(p_rly, rs, sizeof(p_rly) - 1);
-            ST7735_FillRect(STA_RLY_X, ROW_STA_Y, STA_RLY_W, ROW_STA_H, ST7735_BLACK);
-            ST7735_DrawString(STA_RLY_X, ROW_STA_Y + 1, rs, rc, ST7735_BLACK, S1);
+            TFT_RenderText(STA_RLY_X, ROW_STA_Y, STA_RLY_W, ROW_STA_H, 1,
+                           rs, rc, ST7735_BLACK, S1);
         }
     }
 
@@ -732,8 +868,8 @@ static void display_tick(void)
         uint16_t    wc = wif ? ST7735_BLUE : ST7735_GREY;
         if (strncmp(ws, p_wif, sizeof(p_wif)) != 0) {
             strncpy(p_wif, ws, sizeof(p_wif) - 1);
-            ST7735_FillRect(STA_WIF_X, ROW_STA_Y, STA_WIF_W, ROW_STA_H, ST7735_BLACK);
-            ST7735_DrawString(STA_WIF_X, ROW_STA_Y + 1, ws, wc, ST7735_BLACK, S1);
+            TFT_RenderText(STA_WIF_X, ROW_STA_Y, STA_WIF_W, ROW_STA_H, 1,
+                           ws, wc, ST7735_BLACK, S1);
         }
     }
 
@@ -753,8 +889,8 @@ static void display_tick(void)
         if (strncmp(w_lbl, p_w_lbl, sizeof(p_w_lbl)) != 0) {
             strncpy(p_w_lbl, w_lbl, sizeof(p_w_lbl) - 1);
             uint8_t wy = (uint8_t)(ROW_W_Y + (ROW_W_H - FONT_H * S2) / 2);
-            ST7735_FillRect((uint8_t)LBL_X, wy, (uint8_t)LBL_W, FONT_H * S2, ST7735_BLACK);
-            ST7735_DrawString((uint8_t)LBL_X, wy, w_lbl, ST7735_YELLOW, ST7735_BLACK, S2);
+            TFT_RenderText((uint8_t)LBL_X, wy, (uint8_t)LBL_W, FONT_H * S2, 0,
+                           w_lbl, ST7735_YELLOW, ST7735_BLACK, S2);
             memset(p_w, '\0', sizeof(p_w));  /* force value redraw with new unit */
         }
         if (sess_active)
@@ -1008,6 +1144,7 @@ void ST7735_Init(void)
     if (argc >= 5) g_pin_dc  = Tokenizer_GetArgIntegerDefault(4, ST7735_DEFAULT_DC);
     if (argc >= 6) g_pin_cs  = Tokenizer_GetArgIntegerDefault(5, ST7735_DEFAULT_CS);
     if (argc >= 7) g_pin_blk = Tokenizer_GetArgIntegerDefault(6, ST7735_DEFAULT_BLK);
+    int hwspi = Tokenizer_GetArgIntegerDefault(7, 0);
 
     addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY,
               "ST7735: SCK=%d SDA=%d RES=%d DC=%d CS=%d BLK=%d",
@@ -1019,6 +1156,25 @@ void ST7735_Init(void)
 
     SPI_CS_H(); SPI_SCK_L(); SPI_SDA_L(); SPI_DC_H(); SPI_RES_H();
 
+    g_use_dma = 0;
+    if (hwspi) {
+#if ST7735_HAS_SPIDMA
+        if (g_pin_sck == ST7735_HW_SCK && g_pin_sda == ST7735_HW_SDA) {
+            g_spi_msg.send_buf = g_line_buf;
+            g_spi_msg.send_len = sizeof(g_line_words);
+            SPIDMA_Init(&g_spi_msg);
+            HAL_PIN_Setup_Output(g_pin_dc);   /* P17 back from MISO */
+            SPI_DC_H();
+            g_use_dma = 1;
+        }
+#elif WINDOWS
+        g_use_dma = 1;
+#endif
+        addLogAdv(LOG_INFO, LOG_FEATURE_ENERGY, "ST7735: %s",
+                  g_use_dma ? "hardware SPI + DMA" :
+                  "hardware SPI needs SCK=14 SDA=16 on BK7231N, using bit-bang");
+    }
+
     /* BUG-20 FIX — keep backlight OFF during hardware init and frame fill.
      * P24 is active-LOW: BLK_OFF() = HAL HIGH = backlight dark.
      * Previous code called SPI_BLK_L() here which immediately illuminated
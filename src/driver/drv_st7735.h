@@ -7,7 +7,8 @@
  * ║  ST7735S — 0.96" 80×160 Color TFT Driver for OpenBK7231T / BK7231N        ║
  * ║  Target device : KWS-303WF  (FPC-JL096B005-01V0 display module)           ║
  * ╠══════════════════════════════════════════════════════════════════════════════╣
- * ║  INTERFACE: 4-wire Software SPI (bit-bang)                                 ║
+ * ║  INTERFACE: 4-wire Software SPI (bit-bang), or hardware SPI + DMA          ║
+ * ║             (BK7231N, SCK=P14 SDA=P16) with optional HwSPI arg = 1        ║
  * ║                                                                            ║
  * ║  WIRING (CBU module GPIO numbers):                                         ║
  * ║    TFT       CBU GPIO   Function                                           ║
@@ -22,8 +23,8 @@
  * ║    GND         GND                                                         ║
  * ║                                                                            ║
  * ╠══════════════════════════════════════════════════════════════════════════════╣
- * ║  startDriver ST7735 14 16 9 17 15 24                                       ║
- * ║               SCK  SDA RES DC CS BLK                                       ║
+ * ║  startDriver ST7735 14 16 9 17 15 24 [1]                                   ║
+ * ║               SCK  SDA RES DC CS BLK HwSPI                                 ║
  * ║                                                                            ║
  * ║  CONSOLE COMMANDS:                                                         ║
  * ║  st7735_clear [colour]          fill screen (default black)               ║
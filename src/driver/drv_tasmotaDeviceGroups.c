@@ -11,6 +11,7 @@
 #include "lwip/ip_addr.h"
 #include "lwip/inet.h"
 #include "../httpserver/new_http.h"
+#include "../quicktick.h"
 
 static const char* dgr_group = "239.255.250.250";
 static int dgr_port = 4447;
@@ -34,30 +35,44 @@ void DRV_DGR_Dump(byte *message, int len);
 // Used to send all DGR on quick tick 
 // (instead of doing it in-place, from MQTT callback etc)
 //
-// TODO: MUTEX !!!!!
+// Queue is a fixed ring. Packet that sets power, brightness or color of a
+// group replaces queued one of same kind for same group, so dragging a
+// slider sends its newest value at the place of the first one instead of
+// queuing every step.
 //
 // Maximum number of bytes in pendings DGR packet
 #define MAX_DGR_PACKET 128
-// limits the total number of dgrPacket_t we can alloc
+// slots in send ring
 #define MAX_DGR_QUEUE_SIZE 8
 
+// what queued packet sets, DGR_KIND_OTHER is never replaced
+#define DGR_KIND_OTHER			0
+#define DGR_KIND_POWER			1
+#define DGR_KIND_BRIGHTNESS		2
+#define DGR_KIND_RGBCW			3
+#define DGR_KIND_FIXEDCOLOR		4
+
 typedef struct dgrPacket_s {
-	struct dgrPacket_s *next;
 	byte buffer[MAX_DGR_PACKET];
 	byte length;
+	byte kind;
 } dgrPacket_t;
 
-// the list is not allocated before first use
-dgrPacket_t *dgr_pending = 0;
-int dgr_total_alloced_queue_size = 0;
+static dgrPacket_t dgr_queue[MAX_DGR_QUEUE_SIZE];
+static int dgr_queueFirst = 0;
+static int dgr_queueCount = 0;
+static int g_dgr_stat_coalesced = 0;
+static int g_dgr_stat_dropped = 0;
 
 static SemaphoreHandle_t g_mutex = 0;
 
 // Adds a packet to DGR send queue. Can be called from anywhere, MQTT callback, etc.
 // We don't send UDP DGR packets directly from MQTT callback, because it would crash device in some cases....
-void DGR_AddToSendQueue(byte *data, int len) {
-	dgrPacket_t *p;
+void DGR_AddToSendQueue(byte *data, int len, int kind) {
+	dgrPacket_t *p = 0;
 	bool taken;
+	int i;
+
 	if(len > MAX_DGR_PACKET) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_DGR, "DGR_AddToSendQueue: DGR packet too long - %i\n",len);
 		return;
@@ -70,76 +85,76 @@ void DGR_AddToSendQueue(byte *data, int len) {
 	if (taken == false) {
 		return;
 	}
-	p = dgr_pending;
-	while(p) {
-		if(p->length == 0) {
-			// this packet can be reused
-			break;
+	if (kind != DGR_KIND_OTHER) {
+		for (i = 0; i < dgr_queueCount; i++) {
+			p = &dgr_queue[(dgr_queueFirst + i) % MAX_DGR_QUEUE_SIZE];
+			// packet starts with header and group name, zero terminated
+			if (p->kind == kind && !strncmp((const char*)p->buffer, (const char*)data, len)) {
+				g_dgr_stat_coalesced++;
+				break;
+			}
+			p = 0;
 		}
-		p = p->next;
 	}
-	if(p == 0) {
-		if (dgr_total_alloced_queue_size >= MAX_DGR_QUEUE_SIZE) {
-			addLogAdv(LOG_INFO, LOG_FEATURE_DGR, "DGR_AddToSendQueue: DGR queue grew to big, will drop packet\n");
+	if (p == 0) {
+		if (dgr_queueCount >= MAX_DGR_QUEUE_SIZE) {
+			g_dgr_stat_dropped++;
+			xSemaphoreGive(g_mutex);
+			addLogAdv(LOG_INFO, LOG_FEATURE_DGR, "DGR_AddToSendQueue: DGR queue is full, will drop packet\n");
 			return;
 		}
-		dgr_total_alloced_queue_size++;
-		p = malloc(sizeof(dgrPacket_t));
-		p->next = dgr_pending;
-		dgr_pending = p;
+		p = &dgr_queue[(dgr_queueFirst + dgr_queueCount) % MAX_DGR_QUEUE_SIZE];
+		dgr_queueCount++;
 	}
 	p->length = len;
+	p->kind = kind;
 	memcpy(p->buffer,data,len);
 	xSemaphoreGive(g_mutex);
 }
-void DGR_FlushSendQueue() {
-	dgrPacket_t *p;
+int DGR_GetSendQueueCount() {
+	return dgr_queueCount;
+}
+static void DGR_SendMulticast(const byte *data, int len) {
     struct sockaddr_in addr;
-	int nbytes;
-	bool taken;
 
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = inet_addr(dgr_group);
     addr.sin_port = htons(dgr_port);
 
+	g_dgr_stat_sent++;
+	sendto(
+		g_dgr_socket_send,
+	   (const char*) data,
+		len,
+		0,
+		(struct sockaddr*) &addr,
+		sizeof(addr)
+	);
+}
+static void DGR_TrackForAck(const dgrPacket_t *p);
+void DGR_FlushSendQueue() {
+	dgrPacket_t p;
+	bool taken;
+
 	if (g_mutex == 0)
 	{
 		g_mutex = xSemaphoreCreateMutex();
 	}
-	taken = xSemaphoreTake(g_mutex, 1);
-	if (taken == false) {
-		return;
-	}
-	p = dgr_pending;
-	while(p) {
-		if(p->length != 0) {
-			g_dgr_stat_sent++;
-			nbytes = sendto(
-				g_dgr_socket_send,
-			   (const char*) p->buffer,
-				p->length,
-				0,
-				(struct sockaddr*) &addr,
-				sizeof(addr)
-			);
-#if 0
-			rtos_delay_milliseconds(1);
-			nbytes = sendto(
-				g_dgr_socket_send,
-			   (const char*) p->buffer,
-				p->length,
-				0,
-				(struct sockaddr*) &addr,
-				sizeof(addr)
-			);
-#endif
-			p->length = 0;
+	while (dgr_queueCount) {
+		// packet is taken out, so queue is not held while sending
+		taken = xSemaphoreTake(g_mutex, 1);
+		if (taken == false) {
+			return;
 		}
-		p = p->next;
-	}
-	xSemaphoreGive(g_mutex);
+		p = dgr_queue[dgr_queueFirst];
+		dgr_queueFirst = (dgr_queueFirst + 1) % MAX_DGR_QUEUE_SIZE;
+		dgr_queueCount--;
+		xSemaphoreGive(g_mutex);
 
+		DGR_SendMulticast(p.buffer, p.length);
+		DGR_TrackForAck(&p);
+	}
 }
 byte Val255ToVal100(byte v){ 
 	float fr;
@@ -163,7 +178,7 @@ void DRV_DGR_CreateSocket_Send() {
     }
 	addLogAdv(LOG_INFO, LOG_FEATURE_DGR,"DRV_DGR_CreateSocket_Send: socket created\n");
 }
-void DRV_DGR_Send_Generic(byte *message, int len) {
+void DRV_DGR_Send_Generic(byte *message, int len, int kind) {
 	// if this send is as a result of use RXing something, 
 	// don't send it....
 	if (g_inCmdProcessing){
@@ -174,7 +189,7 @@ void DRV_DGR_Send_Generic(byte *message, int len) {
 
 	// This is here only because sending UDP from MQTT callback crashes BK for me
 	// So instead, we are making a queue which is sent in quick tick
-	DGR_AddToSendQueue(message, len);
+	DGR_AddToSendQueue(message, len, kind);
 	addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE_DGR, "DGR adds to queue %i",len);
 }
 
@@ -200,7 +215,7 @@ void DRV_DGR_Send_Power(const char *groupName, int channelValues, int numChannel
 
 	len = DGR_Quick_FormatPowerState(message,sizeof(message),groupName,g_dgr_send_seq, 0,channelValues, numChannels);
 
-	DRV_DGR_Send_Generic(message,len);
+	DRV_DGR_Send_Generic(message,len, DGR_KIND_POWER);
 }
 void DRV_DGR_Send_Brightness(const char *groupName, byte brightness){
 	int len;
@@ -213,7 +228,7 @@ void DRV_DGR_Send_Brightness(const char *groupName, byte brightness){
 
 	len = DGR_Quick_FormatBrightness(message,sizeof(message),groupName,g_dgr_send_seq, 0, brightness);
 
-	DRV_DGR_Send_Generic(message,len);
+	DRV_DGR_Send_Generic(message,len, DGR_KIND_BRIGHTNESS);
 }
 void DRV_DGR_Send_RGBCW(const char *groupName, byte *rgbcw){
 	int len;
@@ -226,7 +241,7 @@ void DRV_DGR_Send_RGBCW(const char *groupName, byte *rgbcw){
 
 	len = DGR_Quick_FormatRGBCW(message,sizeof(message),groupName,g_dgr_send_seq, 0, rgbcw[0],rgbcw[1],rgbcw[2],rgbcw[3],rgbcw[4]);
 
-	DRV_DGR_Send_Generic(message,len);
+	DRV_DGR_Send_Generic(message,len, DGR_KIND_RGBCW);
 }
 void DRV_DGR_Send_FixedColor(const char *groupName, int colorIndex) {
 	int len;
@@ -239,7 +254,25 @@ void DRV_DGR_Send_FixedColor(const char *groupName, int colorIndex) {
 
 	len = DGR_Quick_FormatFixedColor(message, sizeof(message), groupName, g_dgr_send_seq, 0, colorIndex);
 
-	DRV_DGR_Send_Generic(message, len);
+	DRV_DGR_Send_Generic(message, len, DGR_KIND_FIXEDCOLOR);
+}
+void DRV_DGR_Send_Command(const char *groupName, const char *command) {
+	int len;
+	byte message[MAX_DGR_PACKET];
+	// if this send is as a result of use RXing something, 
+	// don't send it....
+	if (g_inCmdProcessing) {
+		return;
+	}
+
+	// "TASMOTA_DGR" header, group, sequence, flags, item, length and EOL
+	if (strlen(groupName) + strlen(command) + 20 > sizeof(message)) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_DGR, "DGR command too long for packet");
+		return;
+	}
+	len = DGR_Quick_FormatCommand(message, sizeof(message), groupName, g_dgr_send_seq, 0, command);
+
+	DRV_DGR_Send_Generic(message, len, DGR_KIND_OTHER);
 }
 void DRV_DGR_CreateSocket_Receive() {
 
@@ -384,25 +417,41 @@ void DRV_DGR_processLightBrightness(byte brightness) {
 	LED_SetDimmer(Val255ToVal100(brightness));
 }
 #endif
+void DRV_DGR_processCommand(const char *command) {
+	addLogAdv(LOG_DEBUG, LOG_FEATURE_DGR, "DRV_DGR_processCommand: %s\n", command);
+
+	CMD_ExecuteCommand(command, 0);
+}
 typedef struct dgrMmember_s {
 	int ip;
 	uint16_t lastSeq;
 } dgrMember_t;
 
 #define MAX_DGR_MEMBERS 32
+// open addressing on IP, twice the members so probes stay short
+#define DGR_MEMBER_HASH 64
 static dgrMember_t g_dgrMembers[MAX_DGR_MEMBERS];
+static signed char g_dgrMemberHash[DGR_MEMBER_HASH];
 static int g_curDGRMembers = 0;
 static struct sockaddr_in addr;
 
+static void DGR_ClearMembers() {
+	memset(&g_dgrMembers[0], 0, sizeof(g_dgrMembers));
+	memset(g_dgrMemberHash, -1, sizeof(g_dgrMemberHash));
+	g_curDGRMembers = 0;
+}
+// member that sent packet in 'addr', added if new; 0 if table is full
 dgrMember_t *findMember() {
+	unsigned int h;
 	int i, ip;
 
-	ip = addr.sin_addr.s_addr;;
-
-	for(i = 0; i < g_curDGRMembers; i++) {
-		if(g_dgrMembers[i].ip == ip) {
-			return &g_dgrMembers[i];
+	ip = addr.sin_addr.s_addr;
+	h = ((unsigned int)ip * 2654435761u) >> 26;
+	while (g_dgrMemberHash[h] != -1) {
+		if (g_dgrMembers[(int)g_dgrMemberHash[h]].ip == ip) {
+			return &g_dgrMembers[(int)g_dgrMemberHash[h]];
 		}
+		h = (h + 1) % DGR_MEMBER_HASH;
 	}
 	i = g_curDGRMembers;
 	if(i>=MAX_DGR_MEMBERS)
@@ -410,6 +459,7 @@ dgrMember_t *findMember() {
 	g_curDGRMembers ++;
 	g_dgrMembers[i].ip = ip;
 	g_dgrMembers[i].lastSeq = 0;
+	g_dgrMemberHash[h] = i;
 	return &g_dgrMembers[i];
 }
 
@@ -443,6 +493,131 @@ int DGR_CheckSequence(uint16_t seq) {
 	return 1;
 }
 
+// Tasmota acks every message with unicast of its sequence. Sent message
+// waits here for acks of all known members and is sent again after
+// 200, 400, 800... ms while some are missing. Newer message of same kind
+// for same group takes its slot, older value does not need to get there.
+#define DGR_MAX_RETRANSMIT		4
+#define DGR_MAX_RETRIES			5
+#define DGR_RETRANSMIT_MS		200
+
+typedef struct dgrRetransmit_s {
+	// length 0 is free slot
+	dgrPacket_t p;
+	uint16_t seq;
+	byte tries;
+	unsigned int nextMs;
+	// bit per index in g_dgrMembers
+	unsigned int ackedMask;
+} dgrRetransmit_t;
+
+static dgrRetransmit_t g_dgrRetransmit[DGR_MAX_RETRANSMIT];
+static int g_dgr_stat_acksSent = 0;
+static int g_dgr_stat_acksReceived = 0;
+static int g_dgr_stat_retransmits = 0;
+static int g_dgr_stat_unacked = 0;
+
+// sequence follows header and zero terminated group name
+static uint16_t DGR_GetPacketSequence(const dgrPacket_t *p) {
+	int at = strnlen((const char*)p->buffer, p->length) + 1;
+	uint16_t seq = 0;
+
+	if (at + 2 <= p->length) {
+		memcpy(&seq, p->buffer + at, 2);
+	}
+	return seq;
+}
+static void DGR_TrackForAck(const dgrPacket_t *p) {
+	dgrRetransmit_t *r, *slot = 0;
+	int i;
+
+	for (i = 0; i < DGR_MAX_RETRANSMIT; i++) {
+		r = &g_dgrRetransmit[i];
+		if (r->p.length && p->kind != DGR_KIND_OTHER && r->p.kind == p->kind
+			&& !strncmp((const char*)r->p.buffer, (const char*)p->buffer, p->length)) {
+			slot = r;
+			break;
+		}
+		// free slot, or the one that waited longest
+		if (slot == 0 || (slot->p.length && (r->p.length == 0 || r->tries > slot->tries))) {
+			slot = r;
+		}
+	}
+	if (slot->p.length && slot->p.kind != p->kind) {
+		g_dgr_stat_unacked++;
+	}
+	slot->p = *p;
+	slot->seq = DGR_GetPacketSequence(p);
+	slot->tries = 0;
+	slot->nextMs = g_timeMs + DGR_RETRANSMIT_MS;
+	slot->ackedMask = 0;
+}
+// every known member acked, and at least one did
+static bool DGR_IsAckedByAll(const dgrRetransmit_t *r) {
+	unsigned int known = g_curDGRMembers >= 32 ? 0xFFFFFFFF : (1u << g_curDGRMembers) - 1;
+
+	return r->ackedMask && (r->ackedMask & known) == known;
+}
+void DGR_ProcessAck(uint16_t seq) {
+	dgrMember_t *m = findMember();
+	dgrRetransmit_t *r;
+	int i;
+
+	g_dgr_stat_acksReceived++;
+	if (m == 0) {
+		return;
+	}
+	for (i = 0; i < DGR_MAX_RETRANSMIT; i++) {
+		r = &g_dgrRetransmit[i];
+		if (r->p.length && r->seq == seq) {
+			r->ackedMask |= 1u << (m - g_dgrMembers);
+			if (DGR_IsAckedByAll(r)) {
+				r->p.length = 0;
+			}
+		}
+	}
+}
+// unicast back to sender of the message in 'addr'
+void DGR_SendAck(uint16_t seq) {
+	byte ack[64];
+	int len;
+
+	len = DGR_Quick_FormatAck(ack, sizeof(ack), CFG_DeviceGroups_GetName(), seq);
+	g_dgr_stat_acksSent++;
+	sendto(g_dgr_socket_send, (const char*)ack, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+}
+void DGR_RunRetransmits() {
+	dgrRetransmit_t *r;
+	int i;
+
+	for (i = 0; i < DGR_MAX_RETRANSMIT; i++) {
+		r = &g_dgrRetransmit[i];
+		if (r->p.length == 0 || (int)(g_timeMs - r->nextMs) < 0) {
+			continue;
+		}
+		if (r->tries >= DGR_MAX_RETRIES) {
+			g_dgr_stat_unacked++;
+			r->p.length = 0;
+			continue;
+		}
+		r->tries++;
+		g_dgr_stat_retransmits++;
+		DGR_SendMulticast(r->p.buffer, r->p.length);
+		r->nextMs = g_timeMs + (DGR_RETRANSMIT_MS << r->tries);
+	}
+}
+// sent messages that still wait for some ack
+int DGR_GetPendingAckCount() {
+	int i, n = 0;
+
+	for (i = 0; i < DGR_MAX_RETRANSMIT; i++) {
+		if (g_dgrRetransmit[i].p.length) {
+			n++;
+		}
+	}
+	return n;
+}
+
 void DRV_DGR_RunEverySecond() {
 	const char *myip;
 
@@ -473,9 +648,12 @@ void DGR_SpoofNextDGRPacketSource(const char *ipStrs) {
 }
 void DGR_ProcessIncomingPacket(char *msgbuf, int nbytes) {
 	dgrDevice_t def;
+	int wasProcessing = g_inCmdProcessing;
 
 	msgbuf[nbytes] = '\0';
 
+	memset(&def, 0, sizeof(def));
+
 	strcpy(def.gr.groupName, CFG_DeviceGroups_GetName());
 	def.gr.devGroupShare_In = CFG_DeviceGroups_GetRecvFlags();
 	def.gr.devGroupShare_Out = CFG_DeviceGroups_GetSendFlags();
@@ -487,6 +665,9 @@ void DGR_ProcessIncomingPacket(char *msgbuf, int nbytes) {
 #endif
 	def.cbs.processPower = DRV_DGR_processPower;
 	def.cbs.checkSequence = DGR_CheckSequence;
+	def.cbs.processAck = DGR_ProcessAck;
+	def.cbs.sendAck = DGR_SendAck;
+	def.cbs.processCommand = DRV_DGR_processCommand;
 
 	// don't send things that result from something we rxed...
 	g_inCmdProcessing = 1;
@@ -494,12 +675,16 @@ void DGR_ProcessIncomingPacket(char *msgbuf, int nbytes) {
 	DRV_DGR_Dump((byte*)msgbuf, nbytes);
 #endif
 	DGR_Parse((byte*)msgbuf, nbytes, &def, (struct sockaddr *)&addr);
-	g_inCmdProcessing = 0;
+	g_inCmdProcessing = wasProcessing;
 
 }
 
+// whole burst of packets is applied as one channel change
+#define DGR_MAX_RECV_PER_TICK	32
+
 void DRV_DGR_RunQuickTick() {
-    char msgbuf[64];
+	// room for terminating zero
+	char msgbuf[MAX_DGR_PACKET + 1];
 	socklen_t addrlen;
 	int nbytes;
 	int i;
@@ -509,20 +694,24 @@ void DRV_DGR_RunQuickTick() {
 	}
     // send pending
 	DGR_FlushSendQueue();
-	
+	DGR_RunRetransmits();
+
+	// don't send things that result from something we rxed...
+	g_inCmdProcessing = 1;
+	CHANNEL_BeginBatch();
 	// NOTE: 'addr' is global, and used in callbacks to determine the member.
-	for (i = 0; i < 10; i++) {
+	for (i = 0; i < DGR_MAX_RECV_PER_TICK; i++) {
 		addrlen = sizeof(addr);
 		nbytes = recvfrom(
 			g_dgr_socket_receive,
 			msgbuf,
-			sizeof(msgbuf),
+			sizeof(msgbuf) - 1,
 			0,
 			(struct sockaddr *) &addr,
 			&addrlen
 		);
 		if (nbytes <= 0) {
-			return;
+			break;
 		}
 
 		if (g_mySockAddr.sin_addr.s_addr == addr.sin_addr.s_addr) {
@@ -538,6 +727,8 @@ void DRV_DGR_RunQuickTick() {
 
 		DGR_ProcessIncomingPacket(msgbuf, nbytes);
 	}
+	CHANNEL_CommitBatch();
+	g_inCmdProcessing = 0;
 }
 void DRV_DGR_Shutdown()
 {
@@ -566,7 +757,10 @@ void DRV_DGR_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreS
 	if (bPreState){
 		return;
 	}
-	hprintf255(request, "<h4>DGR received: %i, send: %i</h4>", g_dgr_stat_received, g_dgr_stat_sent);
+	hprintf255(request, "<h4>DGR received: %i, send: %i (%i replaced in queue, %i dropped)</h4>", g_dgr_stat_received, g_dgr_stat_sent,
+		g_dgr_stat_coalesced, g_dgr_stat_dropped);
+	hprintf255(request, "<h5>DGR acks sent: %i, received: %i, retransmits: %i, unacked: %i, members: %i</h5>", g_dgr_stat_acksSent,
+		g_dgr_stat_acksReceived, g_dgr_stat_retransmits, g_dgr_stat_unacked, g_curDGRMembers);
 }
 // DGR_SendPower testSocket 1 1
 // DGR_SendPower stringGroupName integerChannelValues integerChannelsCount
@@ -693,6 +887,12 @@ void DRV_DGR_OnChannelChanged(int ch, int value) {
 		DRV_DGR_Send_Power(groupName,channelValues,channelsCount);
 	}
 }
+// power message has all channels, so one is sent for whole batch
+void DRV_DGR_OnChannelsChanged(const int* chs, const int* vals, int count) {
+	if (count > 0) {
+		DRV_DGR_OnChannelChanged(chs[0], vals[0]);
+	}
+}
 // DGR_SendBrightness roomLEDstrips 128
 // DGR_SendBrightness stringGroupName integerBrightness
 commandResult_t CMD_DGR_SendBrightness(const void *context, const char *cmd, const char *args, int flags) {
@@ -784,10 +984,32 @@ commandResult_t CMD_DGR_SendFixedColor(const void *context, const char *cmd, con
 
 	return CMD_RES_OK;
 }
+// DGR_SendCommand stringGroupName command
+commandResult_t CMD_DGR_SendCommand(const void *context, const char *cmd, const char *args, int flags) {
+	const char *groupName;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 2)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	groupName = Tokenizer_GetArg(0);
+
+	DRV_DGR_Send_Command(groupName, Tokenizer_GetArgFrom(1));
+	addLogAdv(LOG_INFO, LOG_FEATURE_DGR, "CMD_DGR_SendCommand: sent message to group %s\n", groupName);
+
+	return CMD_RES_OK;
+}
 void DRV_DGR_Init()
 {
-	memset(&g_dgrMembers[0],0,sizeof(g_dgrMembers));
-	g_curDGRMembers = 0;
+	dgr_queueCount = 0;
+	g_dgr_stat_coalesced = 0;
+	g_dgr_stat_dropped = 0;
+	DGR_ClearMembers();
+	memset(g_dgrRetransmit, 0, sizeof(g_dgrRetransmit));
+	g_dgr_stat_acksSent = 0;
+	g_dgr_stat_acksReceived = 0;
+	g_dgr_stat_retransmits = 0;
+	g_dgr_stat_unacked = 0;
 
 	DRV_DGR_CreateSocket_Receive();
 	DRV_DGR_CreateSocket_Send();
@@ -812,6 +1034,11 @@ void DRV_DGR_Init()
 	//cmddetail:"fn":"CMD_DGR_SendFixedColor","file":"driver/drv_tasmotaDeviceGroups.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("DGR_SendFixedColor", CMD_DGR_SendFixedColor, NULL);
+	//cmddetail:{"name":"DGR_SendCommand","args":"[GroupName][Command]",
+	//cmddetail:"descr":"Sends a command to given Tasmota Device Group, members that receive events run it. With ntp_at, whole group runs it at same time.",
+	//cmddetail:"fn":"CMD_DGR_SendCommand","file":"driver/drv_tasmotaDeviceGroups.c","requires":"",
+	//cmddetail:"examples":"DGR_SendCommand myGroup ntp_at +1000 POWER ON"}
+	CMD_RegisterCommand("DGR_SendCommand", CMD_DGR_SendCommand, NULL);
 }
 
 
@@ -56,7 +56,7 @@ void TCA9954_ApplyChanges() {
 	Soft_I2C_WriteByte(&tcI2C, tca_values);
 	Soft_I2C_Stop(&tcI2C);
 }
-void TCA9554_OnChannelChanged(int ch, int value) {
+static bool TCA9554_SetBit(int ch, int value) {
 	if (ch >= tca_firstChannel && ch < (tca_firstChannel + TCA_CHANNELS)) {
 		int local = ch - tca_firstChannel;
 		if (value) {
@@ -65,9 +65,28 @@ void TCA9554_OnChannelChanged(int ch, int value) {
 		else {
 			tca_values &= ~(1 << local); // clear bit
 		}
+		return true;
+	}
+	return false;
+}
+void TCA9554_OnChannelChanged(int ch, int value) {
+	if (TCA9554_SetBit(ch, value)) {
 		TCA9954_ApplyChanges(); // write changes to TCA9554
 	}
 }
+void TCA9554_OnChannelsChanged(const int* chs, const int* vals, int count) {
+	int i;
+	bool bAny = false;
+
+	for (i = 0; i < count; i++) {
+		if (TCA9554_SetBit(chs[i], vals[i])) {
+			bAny = true;
+		}
+	}
+	if (bAny) {
+		TCA9954_ApplyChanges(); // one write for all
+	}
+}
 
 void TCA9554_OnEverySecond()
 {
@@ -10,6 +10,7 @@
 #include "../mqtt/new_mqtt.h"
 #include "../httpserver/new_http.h"
 #include "drv_uart.h"
+#include "drv_local.h"
 
 #define TCL_UART_PACKET_LEN 1
 #define TCL_UART_PACKET_HEAD 0xff
@@ -602,6 +603,7 @@ void TCL_UART_TryToGetNextPacket() {
 				if (is_changed)
 				{
 					//publish_state();
+					DRV_MarkIndexDirty(TCL_AppendInformationToHTTPIndexPage);
 				}
 			}
 			//publish_state(buffer);
@@ -796,6 +798,8 @@ void TCL_Init(void) {
 	//cmddetail:"fn":"CMD_Display","file":"driver/drv_tclAC.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("Display", CMD_Display, NULL);
+
+	DRV_MarkIndexDirty(TCL_AppendInformationToHTTPIndexPage);
 }
 
 // backlog startDriver TCL; Gen 3
@@ -831,7 +835,7 @@ void TCL_DoDiscovery(const char *topic) {
 		vertical_swing_options,sizeof(vertical_swing_options) / sizeof(vertical_swing_options[0]),
 		horizontal_swing_options, sizeof(horizontal_swing_options) / sizeof(horizontal_swing_options[0])
 		);
-	MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+	hass_publish_discovery(topic, dev_info);
 	hass_free_device_info(dev_info);
 
 	//dev_info = hass_createFanWithModes("Fan Speed", "~/FANMode/get", "FANMode", fanOptions, 4);
@@ -839,11 +843,11 @@ void TCL_DoDiscovery(const char *topic) {
 	//hass_free_device_info(dev_info);
 
 	dev_info = hass_createToggle("Buzzer","~/Buzzer/get","Buzzer");
-	MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+	hass_publish_discovery(topic, dev_info);
 	hass_free_device_info(dev_info);
 
 	dev_info = hass_createToggle("Display", "~/Display/get", "Display");
-	MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+	hass_publish_discovery(topic, dev_info);
 	hass_free_device_info(dev_info);
 
 
@@ -23,7 +23,7 @@ void TS_RunQuickTick() {
 
 		int screenSize = 8;
 #ifdef ENABLE_DRIVER_PT6523
-		if (DRV_IsRunning("PT6523")) {
+		if (DRV_IsRunning(DRV_ID_PT6523)) {
 			screenSize = 8;
 			PT6523_ClearString();
 			if (g_curOfs < 0) {
@@ -36,13 +36,19 @@ void TS_RunQuickTick() {
 		}
 #endif
 #ifdef ENABLE_DRIVER_MAX72XX
-		if (DRV_IsRunning("MAX72XX")) {
-			// TODO 
-			// TODO screenSize = qqq;
+		if (DRV_IsRunning(DRV_ID_MAX72XX)) {
+			// glyphs are mostly 5 columns and a gap
+			screenSize = MAX72XXSingle_GetWidth() / 6;
+			if (g_curOfs < 0) {
+				MAX72XXSingle_PrintText(g_buffer, -g_curOfs * 6);
+			}
+			else {
+				MAX72XXSingle_PrintText(g_buffer + g_curOfs, 0);
+			}
 		}
 #endif
 #ifdef ENABLE_DRIVER_HT16K33
-		if (DRV_IsRunning("HT16K33")) {
+		if (DRV_IsRunning(DRV_ID_HT16K33)) {
 			// TODO 
 			// TODO screenSize = qqq;
 		}
@@ -25,17 +25,24 @@ typedef struct clockEvent_s {
 	byte second;
 	byte weekDayFlags;
 #if ENABLE_TIME_SUNRISE_SUNSET
-	byte lastDay;  /* used so we don't repeat sunrise sunset events the same day */
 	byte sunflags;  /* flags for sunrise/sunset as follows: */
 #define SUNRISE_FLAG (1 << 0)
 #define SUNSET_FLAG (1 << 1)
 #endif
 	int id;
-	char *command;
+	// from string pool
+	const char *command;
+	// command resolved when event was added
+	preparedCommand_t prepared;
+	// next local time to run, 0 if not known yet
+	time_t nextTime;
 	struct clockEvent_s *next;
+	// scheduled events, sorted by nextTime
+	struct clockEvent_s *nextSorted;
 } clockEvent_t;
 
 clockEvent_t *clock_events = 0;
+static clockEvent_t *clock_eventsByTime = 0;
 
 #if ENABLE_TIME_SUNRISE_SUNSET
 /* Sunrise/sunset algorithm, somewhat based on https://edwilliams.org/sunrise_sunset_algorithm.htm and tasmota code */
@@ -168,59 +175,81 @@ void TIME_CalculateSunset(byte *outHour, byte *outMinute) {
 }
 #endif
 
-void TIME_RunEventsForSecond(time_t runTime) {
-	clockEvent_t *e;
-	
-/*
-	struct tm *ltm;
-
-	// NOTE: on windows, you need _USE_32BIT_TIME_T 
-	ltm = gmtime(&runTime);
-	
-	if (ltm == 0) {
+static void TIME_UnscheduleEvent(clockEvent_t *e) {
+	clockEvent_t **p;
+
+	for (p = &clock_eventsByTime; *p; p = &(*p)->nextSorted) {
+		if (*p == e) {
+			*p = e->nextSorted;
+			break;
+		}
+	}
+	e->nextSorted = 0;
+	e->nextTime = 0;
+}
+static void TIME_InsertSorted(clockEvent_t *e) {
+	clockEvent_t **p;
+
+	// new event goes before the ones with the same time
+	for (p = &clock_eventsByTime; *p; p = &(*p)->nextSorted) {
+		if ((*p)->nextTime >= e->nextTime) {
+			break;
+		}
+	}
+	e->nextSorted = *p;
+	*p = e;
+}
+// sets nextTime to the first matching second not earlier than 'from'
+static void TIME_ScheduleEvent(clockEvent_t *e, time_t from) {
+	TimeComponents tc;
+	time_t dayStart, t;
+	int d;
+
+	TIME_UnscheduleEvent(e);
+	if (from == 0 || e->command == 0) {
 		return;
 	}
-*/
-	TimeComponents tc=calculateComponents(runTime);
-	e = clock_events;
+	tc = calculateComponents(from);
+	dayStart = from - (tc.hour * SECS_PER_HOUR + tc.minute * SECS_PER_MIN + tc.second);
+	for (d = 0; d <= 7; d++) {
+		t = dayStart + d * SECS_PER_DAY + e->hour * SECS_PER_HOUR + e->minute * SECS_PER_MIN + e->second;
+		if (t >= from && BIT_CHECK(e->weekDayFlags, (tc.wday + d) % 7)) {
+			e->nextTime = t;
+			TIME_InsertSorted(e);
+			return;
+		}
+	}
+	// no week day is set
+}
+static void TIME_RescheduleAllEvents(time_t from) {
+	clockEvent_t *e;
+
+	clock_eventsByTime = 0;
+	for (e = clock_events; e; e = e->next) {
+		e->nextSorted = 0;
+		e->nextTime = 0;
+		TIME_ScheduleEvent(e, from);
+	}
+}
+static void TIME_RunEvent(clockEvent_t *e) {
+	time_t runTime = e->nextTime;
+	const char *command;
 
-	while (e) {
-		if (e->command) {
-			// base check
-//			if (e->hour == ltm->tm_hour && e->second == ltm->tm_sec && e->minute == ltm->tm_min) {
-			if (e->hour == tc.hour && e->second == tc.second && e->minute == tc.minute) {
-				// weekday check
-//				if (BIT_CHECK(e->weekDayFlags, ltm->tm_wday)) {
-				if (BIT_CHECK(e->weekDayFlags, tc.wday)) {
 #if ENABLE_TIME_SUNRISE_SUNSET
-					if (e->sunflags) {	// no need to check for sunrise/sunset here. If sunflags != 0, it's either of them!!
-/*
-						if (e->lastDay != ltm->tm_wday) {
-							e->lastDay = ltm->tm_wday;  // stop any further sun events today 
-							dusk2Dawn(&sun_data, e->sunflags, &e->hour, &e->minute,
-								calc_day_offset(ltm->tm_wday + 1, e->weekDayFlags));  // setup for tomorrow
-							CMD_ExecuteCommand(e->command, 0);
-							}
-*/
-						if (e->lastDay != tc.wday) {
-							e->lastDay = tc.wday;  /* stop any further sun events today */
-							dusk2Dawn(&sun_data, e->sunflags, &e->hour, &e->minute,
-								calc_day_offset(tc.wday + 1, e->weekDayFlags));  /* setup for tomorrow */
-							CMD_ExecuteCommand(e->command, 0);
-							}
-
-						else {
-							e->lastDay = -1;  /* mark with anything but a valid day of week */
-							}
-						}
-					else
-#endif
-					CMD_ExecuteCommand(e->command, 0);
-				}
-			}
-		}
-		e = e->next;
+	if (e->sunflags) {
+		TimeComponents tc = calculateComponents(runTime);
+		dusk2Dawn(&sun_data, e->sunflags, &e->hour, &e->minute,
+			calc_day_offset(tc.wday + 1, e->weekDayFlags));  /* setup for tomorrow */
+		/* no further sun events today */
+		TIME_ScheduleEvent(e, runTime - (tc.hour * SECS_PER_HOUR + tc.minute * SECS_PER_MIN + tc.second) + SECS_PER_DAY);
 	}
+	else
+#endif
+	TIME_ScheduleEvent(e, runTime + 1);
+	// command may remove this event, keep the text alive until it returns
+	command = StringPool_Intern(e->command);
+	CMD_ExecutePreparedCommand(&e->prepared, command, 0);
+	StringPool_Release(command);
 }
 #if ENABLE_TIME_SUNRISE_SUNSET && ENABLE_TIME_DST
 // in case a DST switch happens, we should change future events of sunset/sunrise, since this will be different after a switch
@@ -236,6 +265,13 @@ void fix_DSTforEvents(int minutes){
 			int m = minutes % 60;
 			e->hour += h;
 			e->minute += m;
+			if (e->nextTime) {
+				// stay on the same day, it may be already done for today
+				time_t from = e->nextTime - e->nextTime % SECS_PER_DAY;
+				if (from < clock_eventsTime)
+					from = clock_eventsTime;
+				TIME_ScheduleEvent(e, from);
+			}
 		}
 		e = e->next;
 	}
@@ -243,7 +279,7 @@ void fix_DSTforEvents(int minutes){
 #endif
 void TIME_RunEvents(unsigned int newTime, bool bTimeValid) {
 	unsigned int delta;
-	unsigned int i;
+	time_t limit;
 
 	// new time invalid?
 	if (bTimeValid == false) {
@@ -253,24 +289,30 @@ void TIME_RunEvents(unsigned int newTime, bool bTimeValid) {
 	// old time invalid, but new one ok?
 	if (clock_eventsTime == 0) {
 		clock_eventsTime = (time_t)newTime;
+		TIME_RescheduleAllEvents(clock_eventsTime);
 		return;
 	}
 	// time went backwards
 	if (newTime < clock_eventsTime) {
 		clock_eventsTime = (time_t)newTime;
+		TIME_RescheduleAllEvents(clock_eventsTime);
 		return;
 	}
-	if (clock_events) {
-		// NTP resynchronization could cause us to skip some seconds in some rare cases?
-		delta = (unsigned int)((time_t)newTime - clock_eventsTime);
-		// a large shift in time is not expected, so limit to a constant number of seconds
-		if (delta > 100)
-			delta = 100;
-		for (i = 0; i < delta; i++) {
-			TIME_RunEventsForSecond(clock_eventsTime + i);
-		}
+	// NTP resynchronization could cause us to skip some seconds in some rare cases?
+	delta = (unsigned int)((time_t)newTime - clock_eventsTime);
+	// a large shift in time is not expected, so limit to a constant number of seconds
+	if (delta > 100)
+		delta = 100;
+	limit = clock_eventsTime + delta;
+	// every event due within [clock_eventsTime, limit) runs once
+	while (clock_eventsByTime && clock_eventsByTime->nextTime < limit) {
+		TIME_RunEvent(clock_eventsByTime);
 	}
 	clock_eventsTime = (time_t)newTime;
+	// the ones skipped by a large jump are moved after it
+	while (clock_eventsByTime && clock_eventsByTime->nextTime < clock_eventsTime) {
+		TIME_ScheduleEvent(clock_eventsByTime, clock_eventsTime);
+	}
 }
 
 #if ENABLE_TIME_SUNRISE_SUNSET
@@ -278,7 +320,7 @@ void TIME_AddEvent(int hour, int minute, int second, int weekDayFlags, int id, i
 #else
 void TIME_AddEvent(int hour, int minute, int second, int weekDayFlags, int id, const char* command) {
 #endif
-	clockEvent_t* newEvent = (clockEvent_t*)malloc(sizeof(clockEvent_t));
+	clockEvent_t* newEvent = (clockEvent_t*)MemPool_Alloc(sizeof(clockEvent_t));
 	if (newEvent == NULL) {
 		// handle error
 		return;
@@ -289,14 +331,17 @@ void TIME_AddEvent(int hour, int minute, int second, int weekDayFlags, int id, c
 	newEvent->second = second;
 	newEvent->weekDayFlags = weekDayFlags;
 #if ENABLE_TIME_SUNRISE_SUNSET
-	newEvent->lastDay = -1;  /* mark with anything but a valid day of week */
 	newEvent->sunflags = sunflags;
 #endif
 	newEvent->id = id;
-	newEvent->command = strdup(command);
+	newEvent->command = StringPool_Intern(command);
+	CMD_PrepareCommand(&newEvent->prepared, newEvent->command);
+	newEvent->nextTime = 0;
+	newEvent->nextSorted = 0;
 	newEvent->next = clock_events;
 
 	clock_events = newEvent;
+	TIME_ScheduleEvent(newEvent, clock_eventsTime);
 }
 int TIME_RemoveEvent(int id) {
 	int ret = 0;
@@ -311,8 +356,9 @@ int TIME_RemoveEvent(int id) {
 			else {
 				prev->next = curr->next;
 			}
-			free(curr->command);
-			free(curr);
+			TIME_UnscheduleEvent(curr);
+			StringPool_Release(curr->command);
+			MemPool_Free(curr);
 			ret++;
 			if (prev == NULL) {
 				curr = clock_events;
@@ -516,10 +562,11 @@ int TIME_ClearEvents() {
 		t++;
 		e = e->next;
 
-		free(p->command);
-		free(p);
+		StringPool_Release(p->command);
+		MemPool_Free(p);
 	}
 	clock_events = 0;
+	clock_eventsByTime = 0;
 	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "Removed %i events", t);
 	return t;
 }
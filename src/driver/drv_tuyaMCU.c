@@ -185,6 +185,17 @@ typedef struct tuyaMCUMapping_s {
 } tuyaMCUMapping_t;
 
 tuyaMCUMapping_t* g_tuyaMappings = 0;
+// Lookup tables over g_tuyaMappings, made again whenever a mapping is
+// added or changed, so finding mapping per received DP and per channel
+// change does not walk the list. Bit per channel rejects channels that
+// are not mapped at all without touching tables.
+typedef struct tuyaMCUMappingIndex_s {
+	tuyaMCUMapping_t* byDpId[256];
+	tuyaMCUMapping_t* byChannel[CHANNEL_MAX];
+} tuyaMCUMappingIndex_t;
+
+static tuyaMCUMappingIndex_t* g_tuyaMappingIndex = 0;
+static uint32_t g_tuyaMappedChannels[(CHANNEL_MAX + 31) / 32];
 
 /**
  * Dimmer range
@@ -252,83 +263,140 @@ static byte g_hello[] = { 0x55, 0xAA, 0x00, 0x01, 0x00, 0x00, 0x00 };
 //static byte g_request_state[] = { 0x55, 0xAA, 0x00, 0x02, 0x00, 0x01, 0x04, 0x06 };
 static bool g_tuyaMCU_batteryPoweredMode = false;
 
-typedef struct tuyaMCUPacket_s {
-	byte *data;
-	int size;
-	int allocated;
-	struct tuyaMCUPacket_s *next;
-} tuyaMCUPacket_t;
-
-tuyaMCUPacket_t *tm_emptyPackets = 0;
-tuyaMCUPacket_t *tm_sendPackets = 0;
+// Queued packets are whole frames, one after another in one ring that is
+// allocated once, each behind its length (u16 LE). Adding is O(1) and
+// nothing is allocated per packet. Frame that does not fit before end of
+// ring goes to its start, zero length marks the skipped end. When ring is
+// full, oldest frames are dropped, newer state is what MCU should get.
+#define TUYAMCU_QUEUE_SIZE 1024
+
+static byte *tm_queue = 0;
+// oldest frame, where next frame goes, bytes taken with skipped ends
+static int tm_queueHead = 0;
+static int tm_queueTail = 0;
+static int tm_queueUsed = 0;
+
+// length of oldest frame, 0 if there is none
+static int TUYAMCU_QueuePeek(byte **frame) {
+	if (tm_queueUsed == 0) {
+		return 0;
+	}
+	if (TUYAMCU_QUEUE_SIZE - tm_queueHead < 2 || (tm_queue[tm_queueHead] | tm_queue[tm_queueHead + 1]) == 0) {
+		tm_queueUsed -= TUYAMCU_QUEUE_SIZE - tm_queueHead;
+		tm_queueHead = 0;
+		if (tm_queueUsed == 0) {
+			return 0;
+		}
+	}
+	*frame = tm_queue + tm_queueHead + 2;
+	return tm_queue[tm_queueHead] | (tm_queue[tm_queueHead + 1] << 8);
+}
+static void TUYAMCU_QueuePop() {
+	byte *frame;
+	int len = TUYAMCU_QueuePeek(&frame);
 
-tuyaMCUPacket_t *TUYAMCU_AddToQueue(int len) {
-	tuyaMCUPacket_t *toUse;
-	if (tm_emptyPackets) {
-		toUse = tm_emptyPackets;
-		tm_emptyPackets = toUse->next;
+	tm_queueHead += 2 + len;
+	tm_queueUsed -= 2 + len;
+	if (tm_queueHead == TUYAMCU_QUEUE_SIZE) {
+		tm_queueHead = 0;
+	}
+	if (tm_queueUsed == 0) {
+		tm_queueHead = tm_queueTail = 0;
+	}
+}
+// room for frame of len bytes at queue end, 0 if it can never fit
+static byte *TUYAMCU_AddToQueue(int len) {
+	int need = 2 + len;
+	int skip;
+	byte *frame;
 
-		if (len > toUse->allocated) {
-			toUse->data = realloc(toUse->data, len);
-			toUse->allocated = len;
-		}
+	if (need > TUYAMCU_QUEUE_SIZE) {
+		return 0;
 	}
-	else {
-		toUse = malloc(sizeof(tuyaMCUPacket_t));
-		int toAlloc = 128;
-		if (len > toAlloc)
-			toAlloc = len;
-		toUse->allocated = toAlloc;
-		toUse->data = malloc(toUse->allocated);
+	if (tm_queue == 0) {
+		tm_queue = malloc(TUYAMCU_QUEUE_SIZE);
+		if (tm_queue == 0) {
+			return 0;
+		}
+		tm_queueHead = tm_queueTail = tm_queueUsed = 0;
 	}
-	toUse->size = len;
-	if (tm_sendPackets == 0) {
-		tm_sendPackets = toUse;
+	while (1) {
+		if (tm_queueUsed == 0) {
+			tm_queueHead = tm_queueTail = 0;
+		}
+		skip = tm_queueTail + need > TUYAMCU_QUEUE_SIZE ? TUYAMCU_QUEUE_SIZE - tm_queueTail : 0;
+		if (tm_queueUsed + skip + need <= TUYAMCU_QUEUE_SIZE) {
+			break;
+		}
+		addLogAdv(LOG_WARN, LOG_FEATURE_TUYAMCU, "Send queue full, oldest packet dropped\n");
+		TUYAMCU_QueuePop();
 	}
-	else {
-		tuyaMCUPacket_t *p = tm_sendPackets;
-		while (p->next) {
-			p = p->next;
+	if (skip) {
+		if (skip >= 2) {
+			tm_queue[tm_queueTail] = tm_queue[tm_queueTail + 1] = 0;
 		}
-		p->next = toUse;
+		tm_queueUsed += skip;
+		tm_queueTail = 0;
 	}
-	toUse->next = 0;
-	return toUse;
+	tm_queue[tm_queueTail] = len;
+	tm_queue[tm_queueTail + 1] = len >> 8;
+	frame = tm_queue + tm_queueTail + 2;
+	tm_queueTail += need;
+	if (tm_queueTail == TUYAMCU_QUEUE_SIZE) {
+		tm_queueTail = 0;
+	}
+	tm_queueUsed += need;
+	return frame;
 }
 bool TUYAMCU_SendFromQueue() {
-	tuyaMCUPacket_t *toUse;
-	if (tm_sendPackets == 0)
-		return false;
-	toUse = tm_sendPackets;
-	tm_sendPackets = toUse->next;
+	byte *frame;
+	int len = TUYAMCU_QueuePeek(&frame);
 
-	UART_SendByte(0x55);
-	UART_SendByte(0xAA);
-	UART_SendByte(0x00);
-	for (int i = 0; i < toUse->size; i++) {
-		UART_SendByte(toUse->data[i]);
-	}
-
-	toUse->next = tm_emptyPackets;
-	tm_emptyPackets = toUse;
+	if (len == 0)
+		return false;
+	UART_SendBytes(frame, len);
+	TUYAMCU_QueuePop();
 	return true;
 }
 
-tuyaMCUMapping_t* TuyaMCU_FindDefForID(int dpId) {
+static void TuyaMCU_RebuildMappingIndex() {
 	tuyaMCUMapping_t* cur;
 
-	cur = g_tuyaMappings;
-	while (cur) {
-		if (cur->dpId == dpId)
-			return cur;
-		cur = cur->next;
+	memset(g_tuyaMappedChannels, 0, sizeof(g_tuyaMappedChannels));
+	if (g_tuyaMappingIndex == 0) {
+		g_tuyaMappingIndex = (tuyaMCUMappingIndex_t*)malloc(sizeof(tuyaMCUMappingIndex_t));
+		if (g_tuyaMappingIndex == 0) {
+			return;
+		}
+	}
+	memset(g_tuyaMappingIndex, 0, sizeof(tuyaMCUMappingIndex_t));
+	for (cur = g_tuyaMappings; cur; cur = cur->next) {
+		g_tuyaMappingIndex->byDpId[cur->dpId] = cur;
+		// first on list wins, as list walk did
+		if (cur->channel >= 0 && cur->channel < CHANNEL_MAX && g_tuyaMappingIndex->byChannel[cur->channel] == 0) {
+			g_tuyaMappingIndex->byChannel[cur->channel] = cur;
+			g_tuyaMappedChannels[cur->channel >> 5] |= 1u << (cur->channel & 31);
+		}
 	}
-	return 0;
+}
+
+tuyaMCUMapping_t* TuyaMCU_FindDefForID(int dpId) {
+	if (g_tuyaMappingIndex == 0 || dpId < 0 || dpId > 255) {
+		return 0;
+	}
+	return g_tuyaMappingIndex->byDpId[dpId];
 }
 
 tuyaMCUMapping_t* TuyaMCU_FindDefForChannel(int channel) {
 	tuyaMCUMapping_t* cur;
 
+	if (channel >= 0 && channel < CHANNEL_MAX) {
+		if ((g_tuyaMappedChannels[channel >> 5] & (1u << (channel & 31))) == 0) {
+			return 0;
+		}
+		return g_tuyaMappingIndex->byChannel[channel];
+	}
+	// not a real channel, only list has it
 	cur = g_tuyaMappings;
 	while (cur) {
 		if (cur->channel == channel)
@@ -344,7 +412,7 @@ tuyaMCUMapping_t* TuyaMCU_MapIDToChannel(int dpId, int dpType, int channel, int
 	cur = TuyaMCU_FindDefForID(dpId);
 
 	if (cur == 0) {
-		cur = (tuyaMCUMapping_t*)malloc(sizeof(tuyaMCUMapping_t));
+		cur = (tuyaMCUMapping_t*)MemPool_Alloc(sizeof(tuyaMCUMapping_t));
 		cur->next = g_tuyaMappings;
 		cur->rawData = 0;
 		cur->rawDataLen = 0;
@@ -361,6 +429,7 @@ tuyaMCUMapping_t* TuyaMCU_MapIDToChannel(int dpId, int dpType, int channel, int
 	cur->inv = inv;
 	cur->prevValue = 0;
 	cur->channel = channel;
+	TuyaMCU_RebuildMappingIndex();
 	return cur;
 }
 
@@ -375,75 +444,113 @@ void TuyaMCU_SetHeartbeatCounter(int v) {
 // 55AA     00      00      0000   xx   00
 
 #define MIN_TUYAMCU_PACKET_SIZE (2+1+1+2+1)
+#define TUYAMCU_RX_FRAME_MAX 192
+
+// Frame being received. Bytes are taken from UART ring as they come, in
+// contiguous blocks, and checksum is summed on the way, so nothing is
+// scanned twice when frame comes in pieces over many calls.
+static byte tm_rxFrame[TUYAMCU_RX_FRAME_MAX];
+// bytes of frame taken, 0 while looking for header
+static int tm_rxHave = 0;
+// whole frame with checksum, 0 until length is in
+static int tm_rxLen = 0;
+static byte tm_rxSum = 0;
+
+static void TuyaMCU_ResetReceive() {
+	tm_rxHave = 0;
+	tm_rxLen = 0;
+	tm_rxSum = 0;
+}
+// hex of skipped bytes is only made when it is going to be printed
+static void TuyaMCU_AddSkipped(char *dbg, int dbgSize, const byte *p, int n) {
+	int at;
+
+	if (g_loglevel < LOG_INFO) {
+		return;
+	}
+	at = strlen(dbg);
+	while (n > 0 && at + 4 < dbgSize) {
+		snprintf(dbg + at, dbgSize - at, "%02X ", *p);
+		at += 3;
+		p++;
+		n--;
+	}
+}
 int UART_TryToGetNextTuyaPacket(byte* out, int maxSize) {
-	int cs;
-	int len, i;
+	const byte *p, *q;
+	int n, take, i;
 	int c_garbage_consumed = 0;
-	byte a, b, version, command, lena, lenb;
+	int ret = 0;
 	char printfSkipDebug[256];
-	char buffer2[8];
 
 	printfSkipDebug[0] = 0;
-
-	cs = UART_GetDataSize();
-
-	if (cs < MIN_TUYAMCU_PACKET_SIZE) {
-		return 0;
-	}
-	// skip garbage data (should not happen)
-	while (cs > 0) {
-		a = UART_GetByte(0);
-		b = UART_GetByte(1);
-		if (a != 0x55 || b != 0xAA) {
-			UART_ConsumeBytes(1);
-			if (c_garbage_consumed + 2 < sizeof(printfSkipDebug)) {
-				snprintf(buffer2, sizeof(buffer2), "%02X ", a);
-				strcat_safe(printfSkipDebug, buffer2, sizeof(printfSkipDebug));
+	while (ret == 0 && (n = UART_PeekContiguous(&p)) > 0) {
+		if (tm_rxHave == 0) {
+			// skip garbage data (should not happen)
+			q = (const byte*)memchr(p, 0x55, n);
+			take = q ? q - p : n;
+			if (take == 0) {
+				tm_rxFrame[0] = 0x55;
+				tm_rxSum = 0x55;
+				tm_rxHave = take = 1;
+			}
+			else {
+				TuyaMCU_AddSkipped(printfSkipDebug, sizeof(printfSkipDebug), p, take);
+				c_garbage_consumed += take;
 			}
+			UART_ConsumeBytes(take);
+			continue;
+		}
+		if (tm_rxHave == 1 && p[0] != 0xAA) {
+			// lone 0x55, next byte may start header, so it is left
+			TuyaMCU_AddSkipped(printfSkipDebug, sizeof(printfSkipDebug), tm_rxFrame, 1);
 			c_garbage_consumed++;
-			cs--;
+			TuyaMCU_ResetReceive();
+			continue;
 		}
-		else {
-			break;
+		take = (tm_rxLen ? tm_rxLen : MIN_TUYAMCU_PACKET_SIZE - 1) - tm_rxHave;
+		if (take > n) {
+			take = n;
+		}
+		for (i = 0; i < take; i++, tm_rxHave++) {
+			if (tm_rxHave < TUYAMCU_RX_FRAME_MAX) {
+				tm_rxFrame[tm_rxHave] = p[i];
+			}
+			if (tm_rxHave != tm_rxLen - 1) {
+				tm_rxSum += p[i];
+			}
 		}
+		UART_ConsumeBytes(take);
+		if (tm_rxLen == 0) {
+			if (tm_rxHave == MIN_TUYAMCU_PACKET_SIZE - 1) {
+				// header 2 bytes, version, command, lenght, chekcusm
+				tm_rxLen = ((tm_rxFrame[4] << 8) | tm_rxFrame[5]) + MIN_TUYAMCU_PACKET_SIZE;
+				if (tm_rxLen > maxSize || tm_rxLen > TUYAMCU_RX_FRAME_MAX) {
+					addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TuyaMCU packet too large, %i > %i\n", tm_rxLen, maxSize);
+				}
+			}
+			continue;
+		}
+		if (tm_rxHave < tm_rxLen) {
+			continue;
+		}
+		// whole packet is in, too large one was only skipped
+		if (tm_rxLen <= maxSize && tm_rxLen <= TUYAMCU_RX_FRAME_MAX) {
+			if (tm_rxSum == tm_rxFrame[tm_rxLen - 1]) {
+				memcpy(out, tm_rxFrame, tm_rxLen);
+				ret = tm_rxLen;
+			}
+			else {
+				addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TuyaMCU packet with bad checksum, expected %i and got %i\n", (int)tm_rxFrame[tm_rxLen - 1], (int)tm_rxSum);
+			}
+		}
+		TuyaMCU_ResetReceive();
 	}
 	if (c_garbage_consumed > 0) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "Consumed %i unwanted non-header byte in Tuya MCU buffer\n", c_garbage_consumed);
 		addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "Skipped data (part) %s\n", printfSkipDebug);
 	}
-	if (cs < MIN_TUYAMCU_PACKET_SIZE) {
-		return 0;
-	}
-	a = UART_GetByte(0);
-	b = UART_GetByte(1);
-	if (a != 0x55 || b != 0xAA) {
-		return 0;
-	}
-	version = UART_GetByte(2);
-	command = UART_GetByte(3);
-	lena = UART_GetByte(4); // hi
-	lenb = UART_GetByte(5); // lo
-	len = lenb | lena >> 8;
-	// now check if we have received whole packet
-	len += 2 + 1 + 1 + 2 + 1; // header 2 bytes, version, command, lenght, chekcusm
-	if (cs >= len) {
-		int ret;
-		// can packet fit into the buffer?
-		if (len <= maxSize) {
-			for (i = 0; i < len; i++) {
-				out[i] = UART_GetByte(i);
-			}
-			ret = len;
-		}
-		else {
-			addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "TuyaMCU packet too large, %i > %i\n", len, maxSize);
-			ret = 0;
-		}
-		// consume whole packet (but don't touch next one, if any)
-		UART_ConsumeBytes(len);
-		return ret;
-	}
-	return 0;
+	return ret;
 }
 
 
@@ -451,34 +558,33 @@ int UART_TryToGetNextTuyaPacket(byte* out, int maxSize) {
 // append header, len, everything, checksum
 void TuyaMCU_SendCommandWithData(byte cmdType, byte* data, int payload_len) {
 	int i;
+	byte *frame = 0;
+	byte header[6];
 	
 	byte check_sum = (0xFF + cmdType + (payload_len >> 8) + (payload_len & 0xFF));
 
+	for (i = 0; i < payload_len; i++) {
+		check_sum += data[i];
+	}
+	header[0] = 0x55;
+	header[1] = 0xAA;
+	header[2] = 0x00;         // version 00
+	header[3] = cmdType;
+	header[4] = payload_len >> 8;      // following data length (Hi)
+	header[5] = payload_len & 0xFF;    // following data length (Lo)
 	//UART_InitUART(g_baudRate, 0, false);
 	if (CFG_HasFlag(OBK_FLAG_TUYAMCU_USE_QUEUE)) {
-		tuyaMCUPacket_t *p = TUYAMCU_AddToQueue(payload_len + 4);
-		p->data[0] = cmdType;
-		p->data[1] = payload_len >> 8;
-		p->data[2] = payload_len & 0xFF;
-		memcpy(p->data + 3, data, payload_len);
-		for (i = 0; i < payload_len; i++) {
-			byte b = data[i];
-			check_sum += b;
-		}
-		p->data[3+payload_len] = check_sum;
+		// built in place, too big one is sent at once
+		frame = TUYAMCU_AddToQueue(sizeof(header) + payload_len + 1);
+	}
+	if (frame) {
+		memcpy(frame, header, sizeof(header));
+		memcpy(frame + sizeof(header), data, payload_len);
+		frame[sizeof(header) + payload_len] = check_sum;
 	}
 	else {
-		UART_SendByte(0x55);
-		UART_SendByte(0xAA);
-		UART_SendByte(0x00);         // version 00
-		UART_SendByte(cmdType);         // version 00
-		UART_SendByte(payload_len >> 8);      // following data length (Hi)
-		UART_SendByte(payload_len & 0xFF);    // following data length (Lo)
-		for (i = 0; i < payload_len; i++) {
-			byte b = data[i];
-			check_sum += b;
-			UART_SendByte(b);
-		}
+		UART_SendBytes(header, sizeof(header));
+		UART_SendBytes(data, payload_len);
 		UART_SendByte(check_sum);
 	}
 }
@@ -794,11 +900,7 @@ struct tm* TuyaMCU_Get_NTP_Time() {
 	return ptm;
 }
 void TuyaMCU_Send_RawBuffer(byte* data, int len) {
-	int i;
-
-	for (i = 0; i < len; i++) {
-		UART_SendByte(data[i]);
-	}
+	UART_SendBytes(data, len);
 }
 //battery-powered water sensor with TyuaMCU request to get somo response
 // uartSendHex 55AA0001000000 - this will get reply:
@@ -1614,6 +1716,8 @@ void TuyaMCU_ParseStateMessage(const byte* data, int len) {
 
 	ofs = 0;
 
+	// state dump after reboot or query can set many channels
+	CHANNEL_BeginBatch();
 	while (ofs + 4 < len) {
 		sectorLen = data[ofs + 2] << 8 | data[ofs + 3];
 		dpId = data[ofs];
@@ -1841,7 +1945,7 @@ void TuyaMCU_ParseStateMessage(const byte* data, int len) {
 		// size of header (type, datatype, len 2 bytes) + data sector size
 		ofs += (4 + sectorLen);
 	}
-
+	CHANNEL_CommitBatch();
 }
 
 int TuyaMCU_WiFiInReset() {
@@ -1975,7 +2079,7 @@ void TuyaMCU_ProcessIncoming(const byte* data, int len) {
 		return;
 	}
 	version = data[2];
-	checkLen = data[5] | data[4] >> 8;
+	checkLen = data[5] | data[4] << 8;
 	checkLen = checkLen + 2 + 1 + 1 + 2 + 1;
 	if (checkLen != len) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "ProcessIncoming: discarding packet bad expected len, expected %i and got len %i\n", checkLen, len);
@@ -2323,12 +2427,7 @@ void TuyaMCU_PrintPacket(byte *data, int len) {
 	char buffer_for_log[256];
 	char buffer2[4];
 	
-			buffer_for_log[0] = 0;
-			for (i = 0; i < len; i++) {
-				snprintf(buffer2, sizeof(buffer2), "%02X ", data[i]);
-				strcat_safe(buffer_for_log, buffer2, sizeof(buffer_for_log));
-			}
-			addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "Received: %s\n", buffer_for_log);
+			addLogHex(LOG_INFO, LOG_FEATURE_TUYAMCU, "Received", data, len);
 #if 1
 			// redo sprintf without spaces
 			buffer_for_log[0] = 0;
@@ -2343,7 +2442,7 @@ void TuyaMCU_PrintPacket(byte *data, int len) {
 #endif
 }
 void TuyaMCU_RunReceive() {
-	byte data[192];
+	byte data[TUYAMCU_RX_FRAME_MAX];
 	int len;
 	while (1)
 	{
@@ -2550,7 +2649,7 @@ void TuyaMCU_RunFrame() {
 	}
 }
 void TuyaMCU_RunEverySecond() {
-	g_sensorMode = DRV_IsRunning("tmSensor");
+	g_sensorMode = DRV_IsRunning(DRV_ID_tmSensor);
 	if (g_sensorMode) {
 		TuyaMCU_RunStateMachine_BatteryPowered();
 	}
@@ -2651,7 +2750,6 @@ bool TuyaMCU_IsLEDRunning() {
 }
 void TuyaMCU_Shutdown() {
 	tuyaMCUMapping_t *tmp, *nxt;
-	tuyaMCUPacket_t *packet, *next_packet;
 
 	// free the tuyaMCUMapping_t linked list
 	tmp = g_tuyaMappings;
@@ -2664,10 +2762,13 @@ void TuyaMCU_Shutdown() {
 			tmp->rawBufferSize = 0;
 			tmp->rawDataLen = 0;
 		}
-		free(tmp);
+		MemPool_Free(tmp);
 		tmp = nxt;
 	}
 	g_tuyaMappings = NULL;
+	free(g_tuyaMappingIndex);
+	g_tuyaMappingIndex = NULL;
+	memset(g_tuyaMappedChannels, 0, sizeof(g_tuyaMappedChannels));
 
 	// free the tuyaMCUpayloadBuffer
 	if (g_tuyaMCUpayloadBuffer) {
@@ -2676,35 +2777,11 @@ void TuyaMCU_Shutdown() {
 		g_tuyaMCUpayloadBufferSize = 0;
 	}
 
-	// free the tm_emptyPackets queue
-	packet = tm_emptyPackets;
-	while (packet) {
-		next_packet = packet->next;
-		if (packet->data) {
-			free(packet->data);
-			packet->data = NULL;
-			packet->allocated = 0;
-			packet->size = 0;
-		}
-		free(packet);
-		packet = next_packet;
-	}
-	tm_emptyPackets = NULL;
-
-	// free the tm_sendPackets queue
-	packet = tm_sendPackets;
-	while (packet) {
-		next_packet = packet->next;
-		if (packet->data) {
-			free(packet->data);
-			packet->data = NULL;
-			packet->allocated = 0;
-			packet->size = 0;
-		}
-		free(packet);
-		packet = next_packet;
-	}
-	tm_sendPackets = NULL;
+	// free the send queue
+	free(tm_queue);
+	tm_queue = NULL;
+	tm_queueHead = tm_queueTail = tm_queueUsed = 0;
+	TuyaMCU_ResetReceive();
 
 	// free the mutex
 	if (g_mutex) {
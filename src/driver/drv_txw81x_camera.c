@@ -18,6 +18,9 @@
 #include "lib/video/dvp/jpeg/jpg.h"
 #include "project_config.h"
 #include "../libraries/obktime/obktime.h"	// for time functions
+#include "../httpserver/new_http.h"
+#include "stream_frame.h"
+#include "drv_txw81x_frames.h"
 
 extern struct vpp_device* vpp_test;
 bool isStarted = false;
@@ -27,6 +30,29 @@ extern void set_time_watermark(uint16 year, uint16 month, uint16 day, uint16 hou
 int dvp_scl = PC_2;
 int dvp_sda = PC_3;
 
+// MJPEG over HTTP next to vendor RTSP. Encoder frames are taken from
+// stream of JPEG source by a small thread, newest one is kept for
+// snapshots and every streaming client sends newest frame it hasn't sent
+// yet straight from encoder buffers, see drv_txw81x_frames.c.
+#ifndef TXWCAM_STREAM_NAME
+// destination JPEG source binds to for SD recording, unused here
+#define TXWCAM_STREAM_NAME		R_RECORD_JPEG
+#endif
+#define TXWCAM_POLL_MS			5
+// stream is ended when camera gives nothing for this long
+#define TXWCAM_IDLE_MS			5000
+#define TXWCAM_BOUNDARY			"obkframe"
+
+static stream* g_camStream = 0;
+static beken_thread_t g_camThread = 0;
+static SemaphoreHandle_t g_camMutex = 0;
+static int g_camClients = 0;
+// counters, fps is frames of last second
+static uint32_t g_camFramesIn = 0, g_camLastFramesIn = 0;
+static uint32_t g_camDropped = 0;
+static uint32_t g_camBytesSent = 0;
+static int g_camFps = 0;
+
 uint8 vcam_en()
 {
 	uint8 ret = TRUE;
@@ -71,6 +97,226 @@ void CMD_ShowTimestamp(const void* context, const char* cmd, const char* args, i
 	vpp_set_watermark0_enable(vpp_test, showTimestamp);
 }
 
+static int TXW_Cam_Opcode(stream* s, void* priv, int opcode)
+{
+	switch(opcode)
+	{
+		case STREAM_OPEN_EXIT:
+			enable_stream(s, 1);
+			break;
+		default:
+			break;
+	}
+	return 0;
+}
+
+static void TXW_Cam_Release(void* data)
+{
+	free_data((struct data_structure*)data);
+}
+
+static void TXW_Cam_Thread(beken_thread_arg_t arg)
+{
+	struct data_structure* d;
+
+	while(1)
+	{
+		d = recv_real_data(g_camStream);
+		if(d == 0)
+		{
+			rtos_delay_milliseconds(TXWCAM_POLL_MS);
+			continue;
+		}
+		xSemaphoreTake(g_camMutex, 100);
+		if(!TXW_CamFrames_Publish(d, get_stream_real_data_len(d)))
+		{
+			free_data(d);
+			g_camDropped++;
+		}
+		g_camFramesIn++;
+		xSemaphoreGive(g_camMutex);
+	}
+}
+
+static camFrame_t* TXW_Cam_GetFrame(uint32_t afterSeq)
+{
+	camFrame_t* f;
+
+	xSemaphoreTake(g_camMutex, 100);
+	f = TXW_CamFrames_Get(afterSeq);
+	xSemaphoreGive(g_camMutex);
+	return f;
+}
+
+static void TXW_Cam_PutFrame(camFrame_t* f)
+{
+	xSemaphoreTake(g_camMutex, 100);
+	TXW_CamFrames_Put(f);
+	xSemaphoreGive(g_camMutex);
+}
+
+// encoder writes frame into ring of fixed size buffers, each one goes
+// to socket as it is
+static int TXW_Cam_SendFrame(int fd, camFrame_t* f)
+{
+	struct data_structure* d = (struct data_structure*)f->data;
+	struct stream_jpeg_data_s* first;
+	struct stream_jpeg_data_s* node;
+	uint32_t nodeLen, left, len;
+	uint8_t* buf;
+
+	first = (struct stream_jpeg_data_s*)get_stream_real_data(d);
+	nodeLen = GET_NODE_LEN(d);
+	node = first;
+	left = f->len;
+	while(left > 0)
+	{
+		buf = (uint8_t*)GET_JPG_SELF_BUF(d, node->data);
+		len = left < nodeLen ? left : nodeLen;
+		if(send(fd, buf, len, 0) != (int)len)
+		{
+			return -1;
+		}
+		g_camBytesSent += len;
+		left -= len;
+		node = node->next;
+		if(node == first)
+		{
+			break;
+		}
+	}
+	return 0;
+}
+
+static int TXW_Cam_Unavailable(http_request_t* request)
+{
+	request->responseCode = 503;
+	http_setup(request, httpMimeTypeText);
+	poststr(request, "Camera stream not available");
+	poststr(request, NULL);
+	return 0;
+}
+
+static bool TXW_Cam_OpenClient()
+{
+	bool ret = false;
+
+	xSemaphoreTake(g_camMutex, 100);
+	if(g_camClients < TXWCAM_MAX_CLIENTS)
+	{
+		g_camClients++;
+		ret = true;
+	}
+	xSemaphoreGive(g_camMutex);
+	return ret;
+}
+
+static void TXW_Cam_CloseClient()
+{
+	xSemaphoreTake(g_camMutex, 100);
+	g_camClients--;
+	xSemaphoreGive(g_camMutex);
+}
+
+// both hold serving thread, so server must have one per client
+static int TXW_Cam_HTTP_Stream(http_request_t* request)
+{
+	char hdr[96];
+	camFrame_t* f;
+	uint32_t lastSeq = 0;
+	int len, ok, idleMs = 0;
+
+	if(g_camStream == 0 || !request->allowStream || !TXW_Cam_OpenClient())
+	{
+		return TXW_Cam_Unavailable(request);
+	}
+	request->keepAlive = 0;
+	poststr(request, "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=" TXWCAM_BOUNDARY "\r\nCache-Control: no-cache\r\n");
+	poststr(request, httpCorsHeaders);
+	poststr(request, "\r\nConnection: close\r\n\r\n");
+	poststr(request, NULL);
+	while(1)
+	{
+		f = TXW_Cam_GetFrame(lastSeq);
+		if(f == 0)
+		{
+			rtos_delay_milliseconds(TXWCAM_POLL_MS);
+			idleMs += TXWCAM_POLL_MS;
+			if(idleMs >= TXWCAM_IDLE_MS)
+			{
+				break;
+			}
+			continue;
+		}
+		idleMs = 0;
+		// frames that came while previous one was sent are skipped
+		g_camDropped += TXW_CamFrames_Skipped(lastSeq, f->seq);
+		lastSeq = f->seq;
+		len = snprintf(hdr, sizeof(hdr), "--" TXWCAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", (unsigned int)f->len);
+		ok = send(request->fd, hdr, len, 0) == len
+			&& TXW_Cam_SendFrame(request->fd, f) == 0
+			&& send(request->fd, "\r\n", 2, 0) == 2;
+		TXW_Cam_PutFrame(f);
+		if(!ok)
+		{
+			break;
+		}
+	}
+	TXW_Cam_CloseClient();
+	return 0;
+}
+
+static int TXW_Cam_HTTP_Snapshot(http_request_t* request)
+{
+	camFrame_t* f;
+
+	if(g_camStream == 0 || !request->allowStream)
+	{
+		return TXW_Cam_Unavailable(request);
+	}
+	f = TXW_Cam_GetFrame(0);
+	if(f == 0)
+	{
+		return TXW_Cam_Unavailable(request);
+	}
+	request->keepAlive = 0;
+	poststr(request, "HTTP/1.1 200 OK\r\nContent-Type: image/jpeg\r\nCache-Control: no-cache\r\n");
+	poststr(request, httpCorsHeaders);
+	hprintf255(request, "\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", (unsigned int)f->len);
+	poststr(request, NULL);
+	TXW_Cam_SendFrame(request->fd, f);
+	TXW_Cam_PutFrame(f);
+	return 0;
+}
+
+static void TXW_Cam_StartHTTP()
+{
+	OSStatus err;
+
+	g_camMutex = xSemaphoreCreateMutex();
+	TXW_CamFrames_Init(TXW_Cam_Release);
+	g_camStream = open_stream_available(TXWCAM_STREAM_NAME, 0, TXWCAM_FRAME_SLOTS, TXW_Cam_Opcode, NULL);
+	if(g_camStream == 0)
+	{
+		ADDLOG_ERROR(LOG_FEATURE_DRV, "TXWCAM: no JPEG stream for HTTP");
+		return;
+	}
+	err = rtos_create_thread(&g_camThread, BEKEN_APPLICATION_PRIORITY,
+		"TXWCAM",
+		(beken_thread_function_t)TXW_Cam_Thread,
+		0x400,
+		(beken_thread_arg_t)0);
+	if(err != kNoErr)
+	{
+		ADDLOG_ERROR(LOG_FEATURE_DRV, "TXWCAM: create thread failed with %i", err);
+		close_stream(g_camStream);
+		g_camStream = 0;
+		return;
+	}
+	HTTP_RegisterCallback("/cam/stream.mjpg", HTTP_GET, TXW_Cam_HTTP_Stream, 1);
+	HTTP_RegisterCallback("/cam/snap.jpg", HTTP_GET, TXW_Cam_HTTP_Snapshot, 1);
+}
+
 void TXW_Cam_Init(void)
 {
 	if(!isStarted)
@@ -93,6 +339,7 @@ void TXW_Cam_Init(void)
 			csi_open();
 		audio_adc_init();
 		spook_init();
+		TXW_Cam_StartHTTP();
 	}
 	isStarted = true;
 
@@ -105,6 +352,13 @@ void TXW_Cam_Init(void)
 
 void TXW_Cam_RunEverySecond(void)
 {
+	g_camFps = g_camFramesIn - g_camLastFramesIn;
+	g_camLastFramesIn = g_camFramesIn;
+	if(g_camClients > 0)
+	{
+		ADDLOG_DEBUG(LOG_FEATURE_DRV, "TXWCAM: %i fps, %i clients, %u dropped, %u bytes sent",
+			g_camFps, g_camClients, g_camDropped, g_camBytesSent);
+	}
 	if(showTimestamp)
 	{
 /*
@@ -118,4 +372,12 @@ void TXW_Cam_RunEverySecond(void)
 	}
 }
 
+void TXW_Cam_AppendInformationToHTTPIndexPage(http_request_t* request, int bPreState)
+{
+	if(bPreState)
+		return;
+	hprintf255(request, "<h2>Camera: %i fps, %i stream clients, %u frames dropped, %u bytes sent</h2>",
+		g_camFps, g_camClients, g_camDropped, g_camBytesSent);
+}
+
 #endif
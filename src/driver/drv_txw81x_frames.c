@@ -0,0 +1,89 @@
+// Frames of TXW81x camera shared by HTTP clients. Only newest frame is
+// kept, reference counted in fixed slots, so encoder never waits for a
+// slow client and nothing queues behind it.
+#include "../new_common.h"
+#include "drv_txw81x_frames.h"
+
+#if PLATFORM_TXW81X || WINDOWS
+
+static camFrame_t g_camFrames[TXWCAM_FRAME_SLOTS];
+static camFrame_t* g_camLatest = 0;
+static uint32_t g_camSeq = 0;
+static camFrameRelease_t g_camRelease = 0;
+
+static void TXW_CamFrames_Release(camFrame_t* f)
+{
+	g_camRelease(f->data);
+	f->data = 0;
+}
+
+void TXW_CamFrames_Init(camFrameRelease_t release)
+{
+	memset(g_camFrames, 0, sizeof(g_camFrames));
+	g_camLatest = 0;
+	g_camSeq = 0;
+	g_camRelease = release;
+}
+
+bool TXW_CamFrames_Publish(void* data, uint32_t len)
+{
+	camFrame_t* f = 0;
+	camFrame_t* old;
+	int i;
+
+	for(i = 0; i < TXWCAM_FRAME_SLOTS; i++)
+	{
+		if(g_camFrames[i].data == 0)
+		{
+			f = &g_camFrames[i];
+			break;
+		}
+	}
+	if(f == 0)
+	{
+		return false;
+	}
+	f->data = data;
+	f->len = len;
+	f->seq = ++g_camSeq;
+	f->refs = 0;
+	old = g_camLatest;
+	g_camLatest = f;
+	if(old && old->refs == 0)
+	{
+		TXW_CamFrames_Release(old);
+	}
+	return true;
+}
+
+camFrame_t* TXW_CamFrames_Get(uint32_t afterSeq)
+{
+	camFrame_t* f = g_camLatest;
+
+	if(f && f->seq != afterSeq)
+	{
+		f->refs++;
+		return f;
+	}
+	return 0;
+}
+
+void TXW_CamFrames_Put(camFrame_t* f)
+{
+	f->refs--;
+	if(f->refs == 0 && f != g_camLatest)
+	{
+		TXW_CamFrames_Release(f);
+	}
+}
+
+uint32_t TXW_CamFrames_Skipped(uint32_t lastSeq, uint32_t seq)
+{
+	if(lastSeq && seq - lastSeq > 1)
+	{
+		return seq - lastSeq - 1;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __DRV_TXW81X_FRAMES_H__
+#define __DRV_TXW81X_FRAMES_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TXWCAM_MAX_CLIENTS		2
+// newest, one per client and one just received
+#define TXWCAM_FRAME_SLOTS		(TXWCAM_MAX_CLIENTS + 2)
+
+typedef void (*camFrameRelease_t)(void* data);
+
+typedef struct camFrame_s {
+	// NULL when slot is free
+	void* data;
+	uint32_t len;
+	uint32_t seq;
+	// clients sending it
+	int refs;
+} camFrame_t;
+
+// caller holds camera lock for all of these
+void TXW_CamFrames_Init(camFrameRelease_t release);
+// false if all slots are in use, then frame is not taken
+bool TXW_CamFrames_Publish(void* data, uint32_t len);
+// newest frame if it is other than one with afterSeq, caller must put it back
+camFrame_t* TXW_CamFrames_Get(uint32_t afterSeq);
+void TXW_CamFrames_Put(camFrame_t* f);
+// frames client skipped between two it has sent
+uint32_t TXW_CamFrames_Skipped(uint32_t lastSeq, uint32_t seq);
+
+#endif
@@ -6,6 +6,8 @@
 #include "../cmnds/cmd_local.h"
 #include "../logging/logging.h"
 #include "../hal/hal_uart.h"
+#include "drv_uart.h"
+#include "../logging/ioTrace.h"
 
 //#define UART_ALWAYSFIRSTBYTES 
 #define UART_DEFAULT_BUFIZE 512
@@ -34,20 +36,29 @@ int UART_GetBufIndexFromPort(int aport) {
 #endif
 }
 
+// Ring storage is rounded up to power of two, so indexes are masked instead
+// of divided. In and out are free running and wrap as unsigned, data size is
+// just in - out. Usable size stays what was asked minus one, as before.
 typedef struct {
   byte* g_recvBuf;
   int g_recvBufSize;
-  int g_recvBufIn;
-  int g_recvBufOut;
+  unsigned int g_recvBufMask;
+  unsigned int g_recvBufIn;
+  unsigned int g_recvBufOut;
+// bytes lost because ring was full
+  unsigned int g_overruns;
 // used to detect uart reinit
   int g_uart_init_counter;
 // used to detect uart manual mode
   int g_uart_manualInitCounter;
 } uartbuf_t;
 
-static uartbuf_t uartbuf[UART_BUF_CNT] = { {0,0,0,0,0,-1}
+// called after bytes were added to any ring, often from UART interrupt
+static uartReceiveNotify_t g_uartReceiveNotify = 0;
+
+static uartbuf_t uartbuf[UART_BUF_CNT] = { {0,0,0,0,0,0,0,-1}
   #if UART_BUF_CNT == 2
-    , { 0,0,0,0,0,-1 } 
+    , { 0,0,0,0,0,0,0,-1 } 
   #endif
   };
 
@@ -55,22 +66,32 @@ uartbuf_t * UART_GetBufFromPort(int aport) {
   return &uartbuf[UART_GetBufIndexFromPort(aport)];
 }
 
-int get_g_uart_init_counter() {
-  uartbuf_t* fuartbuf = UART_GetBufFromPort(UART_GetSelectedPortIndex());
+int UART_GetInitCounterEx(int auartindex) {
+  uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
   return fuartbuf->g_uart_init_counter;
 }
 
+int get_g_uart_init_counter() {
+  return UART_GetInitCounterEx(UART_GetSelectedPortIndex());
+}
+
 void UART_InitReceiveRingBufferEx(int auartindex, int size){
   uartbuf_t* fuartbuf=UART_GetBufFromPort(auartindex);
+  unsigned int alloc = 2;
   //XJIKKA 20241122 - Note that the actual usable buffer size must be g_recvBufSize-1, 
     //otherwise there would be no difference between an empty and a full buffer.
+    while (alloc < (unsigned int)size) {
+      alloc <<= 1;
+    }
 	  if(fuartbuf->g_recvBuf!=0)
         free(fuartbuf->g_recvBuf);
-	  fuartbuf->g_recvBuf = (byte*)malloc(size);
-	  memset(fuartbuf->g_recvBuf,0,size);
+	  fuartbuf->g_recvBuf = (byte*)malloc(alloc);
+	  memset(fuartbuf->g_recvBuf,0,alloc);
     fuartbuf->g_recvBufSize = size;
+    fuartbuf->g_recvBufMask = alloc - 1;
     fuartbuf->g_recvBufIn = 0;
     fuartbuf->g_recvBufOut = 0;
+    fuartbuf->g_overruns = 0;
 }
 
 void UART_InitReceiveRingBuffer(int size) {
@@ -90,9 +111,7 @@ int UART_GetReceiveRingBufferSize() {
 
 int UART_GetDataSizeEx(int auartindex) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
-  return (fuartbuf->g_recvBufIn >= fuartbuf->g_recvBufOut
-                ? fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut
-                : fuartbuf->g_recvBufIn + (fuartbuf->g_recvBufSize - fuartbuf->g_recvBufOut)); //XJIKKA 20241122 fixed buffer size calculation on ring bufferroverflow
+  return fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut;
 }
 
 int UART_GetDataSize() {
@@ -102,7 +121,7 @@ int UART_GetDataSize() {
 
 byte UART_GetByteEx(int auartindex, int idx) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
-  return fuartbuf->g_recvBuf[(fuartbuf->g_recvBufOut + idx) % fuartbuf->g_recvBufSize];
+  return fuartbuf->g_recvBuf[(fuartbuf->g_recvBufOut + idx) & fuartbuf->g_recvBufMask];
 }
 
 byte UART_GetByte(int idx) {
@@ -112,8 +131,25 @@ byte UART_GetByte(int idx) {
 
 void UART_ConsumeBytesEx(int auartindex, int idx) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  int size = fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut;
+  if (idx > size) {
+    idx = size;
+  }
+#if ENABLE_IO_TRACE
+  // taken here and not in receive ISR, what driver took is what replay gives
+  if (g_ioTraceMode == IOTRACE_RECORD) {
+    byte tmp[64];
+    int i, n;
+    for (i = 0; i < idx; i += n) {
+      n = idx - i < (int)sizeof(tmp) ? idx - i : (int)sizeof(tmp);
+      for (int j = 0; j < n; j++) {
+        tmp[j] = UART_GetByteEx(auartindex, i + j);
+      }
+      IOTrace_UartRx(auartindex, tmp, n);
+    }
+  }
+#endif
   fuartbuf->g_recvBufOut += idx;
-  fuartbuf->g_recvBufOut %= fuartbuf->g_recvBufSize;
 }
 
 void UART_ConsumeBytes(int idx) {
@@ -121,32 +157,92 @@ void UART_ConsumeBytes(int idx) {
   UART_ConsumeBytesEx(fuartindex, idx);
 }
 
-void UART_AppendByteToReceiveRingBufferEx(int auartindex, int rc) {
+// Returns how many received bytes follow each other in ring memory from
+// first unread one, and sets *data to it. Parser can use them in place
+// and UART_ConsumeBytesEx what it took, rest is after wrap.
+int UART_PeekContiguousEx(int auartindex, const byte **data) {
+  uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  unsigned int at = fuartbuf->g_recvBufOut & fuartbuf->g_recvBufMask;
+  int size = fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut;
+  int tillEnd = fuartbuf->g_recvBufMask + 1 - at;
+
+  *data = fuartbuf->g_recvBuf + at;
+  return size < tillEnd ? size : tillEnd;
+}
+
+int UART_PeekContiguous(const byte **data) {
+  return UART_PeekContiguousEx(UART_GetSelectedPortIndex(), data);
+}
+
+// Copies up to maxLen first unread bytes, without consuming them.
+// Returns how many were copied.
+int UART_PeekIntoEx(int auartindex, byte *out, int maxLen) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  unsigned int at = fuartbuf->g_recvBufOut & fuartbuf->g_recvBufMask;
+  int len = fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut;
+  int first = fuartbuf->g_recvBufMask + 1 - at;
+
+  if (len > maxLen) {
+    len = maxLen;
+  }
+  if (first > len) {
+    first = len;
+  }
+  memcpy(out, fuartbuf->g_recvBuf + at, first);
+  memcpy(out + first, fuartbuf->g_recvBuf, len - first);
+  return len;
+}
+
+int UART_PeekInto(byte *out, int maxLen) {
+  return UART_PeekIntoEx(UART_GetSelectedPortIndex(), out, maxLen);
+}
+
+// Like UART_PeekIntoEx, but copied bytes are consumed.
+int UART_ReadIntoEx(int auartindex, byte *out, int maxLen) {
+  int len = UART_PeekIntoEx(auartindex, out, maxLen);
+
+  UART_GetBufFromPort(auartindex)->g_recvBufOut += len;
+  return len;
+}
+
+int UART_ReadInto(byte *out, int maxLen) {
+  return UART_ReadIntoEx(UART_GetSelectedPortIndex(), out, maxLen);
+}
+
+unsigned int UART_GetOverrunsEx(int auartindex) {
+  return UART_GetBufFromPort(auartindex)->g_overruns;
+}
+
+static void UART_CheckReceiveRingBuffer(int auartindex, uartbuf_t* fuartbuf) {
   if (fuartbuf->g_recvBufSize <= 0) {
       //if someone (uartFakeHex) send data without init, and if flag 26 changes(UART)
       addLogAdv(LOG_ERROR, LOG_FEATURE_DRV, "UART %i not initialized\n",auartindex);
       //return;
       UART_InitReceiveRingBufferEx(auartindex,UART_DEFAULT_BUFIZE);
     }
+}
+
+void UART_AppendByteToReceiveRingBufferEx(int auartindex, int rc) {
+  uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  if (fuartbuf->g_recvBufSize <= 0) {
+    UART_CheckReceiveRingBuffer(auartindex, fuartbuf);
+  }
 #ifdef UART_ALWAYSFIRSTBYTES
     //20250119 old style, if g_recvBufSize-1 is reached, received byte was ignored
-    if (UART_GetDataSizeEx(auartindex) < (fuartbuf->g_recvBufSize - 1)) {
-#else
-    //20250119 new style, we have always last g_recvBufSize-1 bytes
-    //if g_recvBufSize-1 is reached, first byte is overwritten
-#endif
-        fuartbuf->g_recvBuf[fuartbuf->g_recvBufIn++] = rc;
-        fuartbuf->g_recvBufIn %= fuartbuf->g_recvBufSize;
-#ifdef UART_ALWAYSFIRSTBYTES
+    if (fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut >= fuartbuf->g_recvBufSize - 1) {
+      fuartbuf->g_overruns++;
+      return;
     }
 #endif
-    //XJIKKA 20241122 if the same pointer is reached (in and out), we must also advance 
-    //the outbuffer pointer, otherwise UART_GetDataSize will return g_recvBufSize.
-    //This way now we always have the last (g_recvBufSize - 1) bytes
-    if (fuartbuf->g_recvBufIn == fuartbuf->g_recvBufOut) {
+    //20250119 new style, we have always last g_recvBufSize-1 bytes
+    //if g_recvBufSize-1 is reached, first byte is overwritten
+    fuartbuf->g_recvBuf[fuartbuf->g_recvBufIn++ & fuartbuf->g_recvBufMask] = rc;
+    if (fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut > fuartbuf->g_recvBufSize - 1) {
       fuartbuf->g_recvBufOut++;
-      fuartbuf->g_recvBufOut %= fuartbuf->g_recvBufSize;
+      fuartbuf->g_overruns++;
+    }
+    if (g_uartReceiveNotify) {
+      g_uartReceiveNotify();
     }
 }
 
@@ -155,7 +251,69 @@ void UART_AppendByteToReceiveRingBuffer(int rc) {
   UART_AppendByteToReceiveRingBufferEx(fuartindex, rc);
 }
 
+// For HALs that get a burst from FIFO or driver buffer, at most two copies
+// instead of a call per byte.
+void UART_AppendBytesToReceiveRingBufferEx(int auartindex, const byte *data, int len) {
+  uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
+  unsigned int at;
+  int cap, first, lost;
+
+  if (fuartbuf->g_recvBufSize <= 0) {
+    UART_CheckReceiveRingBuffer(auartindex, fuartbuf);
+  }
+  cap = fuartbuf->g_recvBufSize - 1;
+#ifdef UART_ALWAYSFIRSTBYTES
+  lost = len - (cap - (int)(fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut));
+  if (lost > 0) {
+    if (lost > len) {
+      lost = len;
+    }
+    fuartbuf->g_overruns += lost;
+    len -= lost;
+  }
+#else
+  // only last cap bytes can stay
+  if (len > cap) {
+    fuartbuf->g_overruns += len - cap;
+    data += len - cap;
+    len = cap;
+  }
+#endif
+  at = fuartbuf->g_recvBufIn & fuartbuf->g_recvBufMask;
+  first = fuartbuf->g_recvBufMask + 1 - at;
+  if (first > len) {
+    first = len;
+  }
+  memcpy(fuartbuf->g_recvBuf + at, data, first);
+  memcpy(fuartbuf->g_recvBuf, data + first, len - first);
+  fuartbuf->g_recvBufIn += len;
+  lost = (int)(fuartbuf->g_recvBufIn - fuartbuf->g_recvBufOut) - cap;
+  if (lost > 0) {
+    fuartbuf->g_recvBufOut += lost;
+    fuartbuf->g_overruns += lost;
+  }
+  if (g_uartReceiveNotify && len > 0) {
+    g_uartReceiveNotify();
+  }
+}
+
+void UART_AppendBytesToReceiveRingBuffer(const byte *data, int len) {
+  UART_AppendBytesToReceiveRingBufferEx(UART_GetSelectedPortIndex(), data, len);
+}
+
+// For a driver thread that sleeps until data comes instead of polling
+// data size. Notify runs in receive path, which is interrupt on most HALs,
+// so it may only signal, 0 removes it.
+void UART_SetReceiveNotify(uartReceiveNotify_t notify) {
+  g_uartReceiveNotify = notify;
+}
+
 void UART_SendByteEx(int auartindex, byte b) {
+#if ENABLE_IO_TRACE
+  if (g_ioTraceMode) {
+    IOTrace_UartTx(auartindex, b);
+  }
+#endif
 #ifdef UART_2_UARTS_CONCURRENT
   HAL_UART_SendByteEx(auartindex, b);
 #else
@@ -168,6 +326,18 @@ void UART_SendByte(byte b) {
   UART_SendByteEx(fuartindex, b);
 }
 
+// Whole buffer, port is looked up once. HALs only have byte send for now,
+// this is the place for their block write when they get one.
+void UART_SendBytesEx(int auartindex, const byte *data, int len) {
+  for (int i = 0; i < len; i++) {
+    UART_SendByteEx(auartindex, data[i]);
+  }
+}
+
+void UART_SendBytes(const byte *data, int len) {
+  UART_SendBytesEx(UART_GetSelectedPortIndex(), data, len);
+}
+
 commandResult_t CMD_UART_Send_Hex(const void *context, const char *cmd, const char *args, int cmdFlags) {
     if (!(*args)) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_TUYAMCU, "CMD_UART_Send_Hex: requires 1 argument (hex string, like FFAABB00CCDD\n");
@@ -267,8 +437,9 @@ int UART_InitUART(int baud, int parity, bool hwflowc) {
 void UART_LogBufState(int auartindex) {
   uartbuf_t* fuartbuf = UART_GetBufFromPort(auartindex);
   ADDLOG_WARN(LOG_INFO,
-    "Uart ix %d inbuf %i inptr %i outptr %i \n",
-    auartindex, UART_GetDataSizeEx(auartindex), fuartbuf->g_recvBufIn, fuartbuf->g_recvBufOut
+    "Uart ix %d inbuf %i inptr %i outptr %i overruns %u \n",
+    auartindex, UART_GetDataSizeEx(auartindex), fuartbuf->g_recvBufIn & fuartbuf->g_recvBufMask,
+    fuartbuf->g_recvBufOut & fuartbuf->g_recvBufMask, fuartbuf->g_overruns
   );
 }
 void UART_DebugTool_Run(int auartindex) {
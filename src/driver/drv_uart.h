@@ -11,7 +11,14 @@ int UART_GetDataSize();
 byte UART_GetByte(int idx);
 void UART_ConsumeBytes(int idx);
 void UART_AppendByteToReceiveRingBuffer(int rc);
+void UART_AppendBytesToReceiveRingBuffer(const byte *data, int len);
+int UART_PeekContiguous(const byte **data);
+int UART_PeekInto(byte *out, int maxLen);
+int UART_ReadInto(byte *out, int maxLen);
+typedef void (*uartReceiveNotify_t)(void);
+void UART_SetReceiveNotify(uartReceiveNotify_t notify);
 void UART_SendByte(byte b);
+void UART_SendBytes(const byte *data, int len);
 int UART_InitUART(int baud, int parity, bool hwflowc);
 void UART_AddCommands();
 void UART_RunEverySecond();
@@ -35,11 +42,19 @@ int UART_GetSelectedPortIndex();
 int UART_GetBufIndexFromPort(int aport);
 void UART_InitReceiveRingBufferEx(int auartindex, int size);
 void UART_AppendByteToReceiveRingBufferEx(int auartindex, int rc);
+void UART_AppendBytesToReceiveRingBufferEx(int auartindex, const byte *data, int len);
+int UART_PeekContiguousEx(int auartindex, const byte **data);
+int UART_PeekIntoEx(int auartindex, byte *out, int maxLen);
+int UART_ReadIntoEx(int auartindex, byte *out, int maxLen);
+unsigned int UART_GetOverrunsEx(int auartindex);
 int UART_GetReceiveRingBufferSizeEx(int auartindex);
 int UART_GetDataSizeEx(int auartindex);
 byte UART_GetByteEx(int auartindex, int idx);
 void UART_ConsumeBytesEx(int auartindex, int idx);
 void UART_SendByteEx(int auartindex, byte b);
+void UART_SendBytesEx(int auartindex, const byte *data, int len);
 int UART_InitUARTEx(int auartindex, int baud, int parity, bool hwflowc);
+// changes on every init of port, drivers keeping port set up compare it
+int UART_GetInitCounterEx(int auartindex);
 void UART_LogBufState(int auartindex);
 
@@ -13,6 +13,7 @@
 #define DEFAULT_BUF_SIZE		512
 #define DEFAULT_UART_TCP_PORT	8888
 #define INVALID_SOCK			-1
+#define UTCP_IDLE_WAIT_MS		100
 #ifndef UTCP_DEBUG
 #define UTCP_DEBUG				0
 #endif
@@ -32,62 +33,73 @@ static xTaskHandle g_trx_thread = NULL;
 static xTaskHandle g_rx_thread = NULL;
 static xTaskHandle g_tx_thread = NULL;
 static bool rx_closed, tx_closed;
-static byte* g_utcpBuf = 0;
+static SemaphoreHandle_t g_rxSem = 0;
+// Nagle off, each send goes out at once
+static int g_noDelay = 1;
+// longest wait for rest of a burst before it is sent
+static int g_coalesceMs = 2;
 
 void Start_UART_TCP(void* arg);
 void UART_TCP_Deinit();
 
+// UART receive path gives g_rxSem, so TX thread sleeps until bytes come
+// instead of polling data size. Once awake it waits up to g_coalesceMs for
+// more while line keeps sending and buffer is not full, so a Modbus frame
+// goes out as one segment, then sends straight from UART ring.
 static void UTCP_TX_Thd(void* param)
 {
 	int client_fd = *(int*)param;
 
 	while(1)
 	{
+		const byte* data;
 		int ret = 0;
 		int delay = 0;
-		memset(g_utcpBuf, 0, buf_size);
 		int len = UART_GetDataSize();
+		int prev;
 
 		if(client_fd == INVALID_SOCK) goto exit;
-		while(len < buf_size && delay < 10)
+		if(len == 0)
 		{
+			if(rx_closed)
+			{
+				goto exit;
+			}
+			xSemaphoreTake(g_rxSem, UTCP_IDLE_WAIT_MS / portTICK_PERIOD_MS);
+			continue;
+		}
+		do
+		{
+			prev = len;
+			if(len >= buf_size || delay >= g_coalesceMs)
+				break;
 			rtos_delay_milliseconds(1);
 			len = UART_GetDataSize();
 			delay++;
-		}
+		} while(len != prev);
 
-		if(len > 0)
+		// at most two spans, second one after ring wraps
+		while(len > 0)
 		{
-			for(int i = 0; i < len; i++)
-			{
-				g_utcpBuf[i] = UART_GetByte(i);
-			}
-			UART_ConsumeBytes(len);
+			ret = UART_PeekContiguous(&data);
+			if(ret > len)
+				ret = len;
 #if UTCP_DEBUG
-			char data[len * 2];
-			char* p = data;
-			for(int i = 0; i < len; i++)
+			char hex[ret * 2 + 1];
+			char* p = hex;
+			for(int i = 0; i < ret; i++)
 			{
-				sprintf(p, "%02X", g_utcpBuf[i]);
+				sprintf(p, "%02X", data[i]);
 				p += 2;
 			}
-			ADDLOG_EXTRADEBUG(LOG_FEATURE_DRV, "%d bytes UART RX->TCP TX: %s", len, data);
+			ADDLOG_EXTRADEBUG(LOG_FEATURE_DRV, "%d bytes UART RX->TCP TX: %s", ret, hex);
 #endif
-			ret = send(client_fd, g_utcpBuf, len, 0);
-		}
-		else
-		{
-			if(rx_closed)
-			{
+			ret = send(client_fd, data, ret, 0);
+			if(ret <= 0)
 				goto exit;
-			}
-			continue;
+			UART_ConsumeBytes(ret);
+			len -= ret;
 		}
-
-		if(ret <= 0)
-			goto exit;
-
-		rtos_delay_milliseconds(5);
 	}
 
 exit:
@@ -119,10 +131,7 @@ static void UTCP_RX_Thd(void* param)
 			}
 			ADDLOG_EXTRADEBUG(LOG_FEATURE_DRV, "%d bytes TCP RX->UART TX: %s", ret, data);
 #endif
-			for(int i = 0; i < ret; i++)
-			{
-				UART_SendByte(buffer[i]);
-			}
+			UART_SendBytes(buffer, ret);
 		}
 		else if(tx_closed)
 		{
@@ -137,8 +146,6 @@ static void UTCP_RX_Thd(void* param)
 			ADDLOG_DEBUG(LOG_FEATURE_DRV, "ret: %i, errno: %i", ret, errno);
 			goto exit;
 		}
-
-		rtos_delay_milliseconds(5);
 	}
 
 exit:
@@ -200,6 +207,7 @@ void UART_TCP_TRX_Thread()
 		if(client_sock != INVALID_SOCK)
 		{
 			if(g_conn_channel >= 0) CHANNEL_Set(g_conn_channel, 1, CHANNEL_SET_FLAG_SKIP_MQTT | CHANNEL_SET_FLAG_SILENT);
+			setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&g_noDelay, sizeof(g_noDelay));
 			rx_closed = true;
 			tx_closed = true;
 
@@ -272,11 +280,15 @@ error:
 	}
 }
 
+static void UTCP_OnUartReceive()
+{
+	xSemaphoreGiveFromISR(g_rxSem, NULL);
+}
+
 void Start_UART_TCP(void* arg)
 {
 	UART_TCP_Deinit();
-
-	g_utcpBuf = (byte*)os_malloc(buf_size);
+	UART_SetReceiveNotify(UTCP_OnUartReceive);
 
 	OSStatus err = rtos_create_thread(&g_trx_thread, BEKEN_APPLICATION_PRIORITY,
 		"UART_TCP_TRX",
@@ -290,6 +302,19 @@ void Start_UART_TCP(void* arg)
 	rtos_suspend_thread(NULL);
 }
 
+static commandResult_t CMD_UartTCPLatency(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	Tokenizer_TokenizeString(args, 0);
+	g_noDelay = Tokenizer_GetArgIntegerDefault(0, g_noDelay) ? 1 : 0;
+	g_coalesceMs = Tokenizer_GetArgIntegerDefault(1, g_coalesceMs);
+	if(g_coalesceMs < 0)
+		g_coalesceMs = 0;
+	if(client_sock != INVALID_SOCK)
+		setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&g_noDelay, sizeof(g_noDelay));
+	ADDLOG_INFO(LOG_FEATURE_DRV, "UART TCP: no delay %i, coalesce %i ms", g_noDelay, g_coalesceMs);
+	return CMD_RES_OK;
+}
+
 // startDriver UartTCP [baudrate] [buffer size] [connection channel] [hw flow control]
 // connection is for led, -1 if not used.
 // Sample:
@@ -307,6 +332,16 @@ void UART_TCP_Init()
 
 	UART_InitUART(g_baudRate, 0, flowcontrol > 0 ? true : false);
 	UART_InitReceiveRingBuffer(buf_size * 2);
+	if(g_rxSem == 0)
+	{
+		g_rxSem = xSemaphoreCreateBinary();
+	}
+
+	//cmddetail:{"name":"UartTCPLatency","args":"[NoDelay][CoalesceMs]",
+	//cmddetail:"descr":"Tunes UART to TCP relay. NoDelay 1 [default] turns Nagle off. CoalesceMs [default 2] is longest wait for rest of a UART burst before it is sent, 0 sends at first byte.",
+	//cmddetail:"fn":"CMD_UartTCPLatency","file":"driver/drv_uart_tcp.c","requires":"",
+	//cmddetail:"examples":"UartTCPLatency 1 5"}
+	CMD_RegisterCommand("UartTCPLatency", CMD_UartTCPLatency, NULL);
 
 	if(g_start_thread != NULL)
 	{
@@ -342,7 +377,7 @@ void UART_TCP_Deinit()
 		rtos_delete_thread(&g_tx_thread);
 		g_tx_thread = NULL;
 	}
-	if(g_utcpBuf) free(g_utcpBuf);
+	UART_SetReceiveNotify(0);
 
 	if(listen_sock != INVALID_SOCK) close(listen_sock);
 	if(client_sock != INVALID_SOCK) close(client_sock);
@@ -20,27 +20,20 @@
 // 3. then alexa accesses our XML pages here with GET
 // 4. and can change the binary state (0 or 1) with POST
 
+// ARGUMENTS: friendly name, uuid, serial, IP
 static const char *g_wemo_setup_1 =
 "<?xml version=\"1.0\"?>"
 "<root xmlns=\"urn:Belkin:device-1-0\">"
 "<device>"
 "<deviceType>urn:Belkin:device:controllee:1</deviceType>"
-"<friendlyName>";
-static const char *g_wemo_setup_2 =
-"</friendlyName>"
+"<friendlyName>%s</friendlyName>"
 "<manufacturer>Belkin International Inc.</manufacturer>"
 "<modelName>Socket</modelName>"
 "<modelNumber>3.1415</modelNumber>"
-"<UDN>uuid:";
-static const char *g_wemo_setup_3 =
-"</UDN>"
-"<serialNumber>";
-static const char *g_wemo_setup_4 =
-"</serialNumber>"
-"<presentationURL>http://";
-static const char *g_wemo_setup_5 =
-":80/</presentationURL>"
-"<binaryState>0</binaryState>";
+"<UDN>uuid:%s</UDN>"
+"<serialNumber>%s</serialNumber>"
+"<presentationURL>http://%s:80/</presentationURL>"
+"<binaryState>0</binaryState>%s";
 static const char *g_wemo_setup_6 =
 	"<serviceList>"
 		"<service>"
@@ -154,6 +147,20 @@ const char *g_wemo_response_2_fmt =
 
 static char *g_serial = 0;
 static char *g_uid = 0;
+// setup.xml is built for IP and name device has, binaryState digit
+// is written again for each request
+static char g_wemoBuiltForIP[32];
+static char g_wemoBuiltForName[64];
+static char *g_wemoSetupReply = 0;
+static int g_wemoSetupReplyLen = 0;
+static int g_wemoSetupStateAt = 0;
+// BasicEvent1 reply, only Set/Get letters and state differ
+static char *g_wemoEventReply = 0;
+static int g_wemoEventReplyLen = 0;
+static int g_wemoEventLetterAt[2];
+static int g_wemoEventStateAt = 0;
+static int g_wemoEventServiceLen = 0;
+static int g_wemoMetaServiceLen = 0;
 static int outBufferLen = 0;
 static char *buffer_out = 0;
 static int stat_searchesReceived = 0;
@@ -248,10 +255,12 @@ static int WEMO_BasicEvent1(http_request_t* request) {
 
 	// We must send a SetBinaryState or GetBinaryState response depending on what 
 	// was sent to us	
-	http_setup(request, httpMimeTypeXML);
-	poststr(request, g_wemo_response_1);
 	// letter is twice because we have two SetBinaryStateResponse tokens (opening and closing tag)
-	hprintf255(request, g_wemo_response_2_fmt, letter, bMainPower, letter);
+	g_wemoEventReply[g_wemoEventLetterAt[0]] = letter;
+	g_wemoEventReply[g_wemoEventLetterAt[1]] = letter;
+	g_wemoEventReply[g_wemoEventStateAt] = bMainPower ? '1' : '0';
+	http_setup_len(request, httpMimeTypeXML, g_wemoEventReplyLen);
+	postany(request, g_wemoEventReply, g_wemoEventReplyLen);
 	poststr(request, NULL);
 
 
@@ -261,8 +270,8 @@ static int WEMO_BasicEvent1(http_request_t* request) {
 }
 static int WEMO_EventService(http_request_t* request) {
 
-	http_setup(request, httpMimeTypeXML);
-	poststr(request, g_wemo_eventService);
+	http_setup_len(request, httpMimeTypeXML, g_wemoEventServiceLen);
+	postany(request, g_wemo_eventService, g_wemoEventServiceLen);
 	poststr(request, NULL);
 
 	stat_eventServiceXMLVisits++;
@@ -271,36 +280,67 @@ static int WEMO_EventService(http_request_t* request) {
 }
 static int WEMO_MetaInfoService(http_request_t* request) {
 
-	http_setup(request, httpMimeTypeXML);
-	poststr(request, g_wemo_metaService);
+	http_setup_len(request, httpMimeTypeXML, g_wemoMetaServiceLen);
+	postany(request, g_wemo_metaService, g_wemoMetaServiceLen);
 	poststr(request, NULL);
 
 	stat_metaServiceXMLVisits++;
 
 	return 0;
 }
+static bool WEMO_BuildSetup() {
+	const char *ip = HAL_GetMyIPString();
+	const char *name = CFG_GetDeviceName();
+	char *p;
+	int len;
+
+	if (g_wemoSetupReply && !strcmp(ip, g_wemoBuiltForIP) && !strcmp(name, g_wemoBuiltForName)) {
+		return true;
+	}
+	free(g_wemoSetupReply);
+	strcpy_safe(g_wemoBuiltForIP, ip, sizeof(g_wemoBuiltForIP));
+	strcpy_safe(g_wemoBuiltForName, name, sizeof(g_wemoBuiltForName));
+	len = strlen(g_wemo_setup_1) + strlen(g_wemo_setup_6) + strlen(name) + strlen(g_uid)
+		+ strlen(g_serial) + strlen(ip) + 1;
+	g_wemoSetupReply = (char*)malloc(len);
+	if (g_wemoSetupReply == 0) {
+		return false;
+	}
+	snprintf(g_wemoSetupReply, len, g_wemo_setup_1, name, g_uid, g_serial, ip, g_wemo_setup_6);
+	g_wemoSetupReplyLen = strlen(g_wemoSetupReply);
+	p = strstr(g_wemoSetupReply, "<binaryState>");
+	g_wemoSetupStateAt = p - g_wemoSetupReply + 13;
+	return true;
+}
 static int WEMO_Setup(http_request_t* request) {
-	http_setup(request, httpMimeTypeXML);
-	poststr(request, g_wemo_setup_1);
-	// friendly name
-	poststr(request, CFG_GetDeviceName());
-	poststr(request, g_wemo_setup_2);
-	// uuid
-	poststr(request, g_uid);
-	poststr(request, g_wemo_setup_3);
-	// IP str
-	poststr(request, HAL_GetMyIPString());
-	poststr(request, g_wemo_setup_4);
-	// serial str
-	poststr(request, g_serial);
-	poststr(request, g_wemo_setup_5);
-	poststr(request, g_wemo_setup_6);
+	if (WEMO_BuildSetup() == false) {
+		return 0;
+	}
+	g_wemoSetupReply[g_wemoSetupStateAt] = Main_GetFirstPowerState() ? '1' : '0';
+	http_setup_len(request, httpMimeTypeXML, g_wemoSetupReplyLen);
+	postany(request, g_wemoSetupReply, g_wemoSetupReplyLen);
 	poststr(request, NULL);
 
 	stat_setupXMLVisits++;
 
 	return 0;
 }
+static void WEMO_BuildEventReply() {
+	int len;
+	char *p;
+
+	len = strlen(g_wemo_response_1) + strlen(g_wemo_response_2_fmt) + 1;
+	free(g_wemoEventReply);
+	g_wemoEventReply = (char*)malloc(len);
+	strcpy(g_wemoEventReply, g_wemo_response_1);
+	p = g_wemoEventReply + strlen(g_wemoEventReply);
+	snprintf(p, len - (p - g_wemoEventReply), g_wemo_response_2_fmt, 'G', 0, 'G');
+	g_wemoEventReplyLen = strlen(g_wemoEventReply);
+	// "<u:" and "</u:" are followed by letter
+	g_wemoEventLetterAt[0] = strstr(g_wemoEventReply, "<u:") - g_wemoEventReply + 3;
+	g_wemoEventLetterAt[1] = strstr(g_wemoEventReply, "</u:") - g_wemoEventReply + 4;
+	g_wemoEventStateAt = strstr(g_wemoEventReply, "<BinaryState>") - g_wemoEventReply + 13;
+}
 void WEMO_Init() {
 	char uid[64];
 	char serial[32];
@@ -313,12 +353,16 @@ void WEMO_Init() {
 	g_serial = strdup(serial);
 	g_uid = strdup(uid);
 
+	WEMO_BuildEventReply();
+	g_wemoEventServiceLen = strlen(g_wemo_eventService);
+	g_wemoMetaServiceLen = strlen(g_wemo_metaService);
+
 	HTTP_RegisterCallback("/upnp/control/basicevent1", HTTP_POST, WEMO_BasicEvent1, 0);
 	HTTP_RegisterCallback("/eventservice.xml", HTTP_GET, WEMO_EventService, 0);
 	HTTP_RegisterCallback("/metainfoservice.xml", HTTP_GET, WEMO_MetaInfoService, 0);
 	HTTP_RegisterCallback("/setup.xml", HTTP_GET, WEMO_Setup, 0);
 
-	//if (DRV_IsRunning("SSDP") == false) {
+	//if (DRV_IsRunning(DRV_ID_SSDP) == false) {
 //	ScheduleDriverStart("SSDP", 5);
 //	}
 }
@@ -8,11 +8,16 @@
 #include "../hal/hal_pins.h"
 #include "../httpserver/new_http.h"
 #include "drv_ntp.h"
+#if ENABLE_LITTLEFS
+#include "../littlefs/our_lfs.h"
+#endif
 
 /*
 startDriver widget
-// widget_create [LocationIndex][bAllowCache][FileName]
+// widget_create [LocationIndex][bAllowCache][FileName][RefreshSeconds]
 widget_create 0 0 demo1.html
+// static widget, sent only with whole page, never with state refresh
+widget_create 1 1 clock.html 0
 
 */
 const char *demo =
@@ -26,6 +31,11 @@ const char *demo =
 "}"
 "</script>";
 
+// every open tab renders state widgets each second, so content is kept in RAM
+#define WIDGET_CACHE_MAX_FILE		2048
+#define WIDGET_CACHE_MAX_TOTAL		4096
+#define WIDGET_STREAM_CHUNK			128
+
 typedef enum {
 	WIDGET_STATIC,
 	WIDGET_STATE,
@@ -35,34 +45,95 @@ typedef struct widget_s {
 	char *fname;
 	WidgetLocation location;
 	char *cached;
+	int cachedLen;
+	// LFS write generation and time when cached was read
+	unsigned int cachedGeneration;
+	int cachedAt;
+	unsigned int hits;
+	// with bAllowCache, content is kept until LFS is written,
+	// otherwise only for refreshSeconds
 	byte bAllowCache;
+	// 0 means static, widget is not sent with state refresh
+	int refreshSeconds;
 	struct widget_s *next;
 } widget_t;
 
 widget_t *g_widgets = 0;
+static int g_widgetCacheTotal = 0;
+
+static void Widget_DropCache(widget_t *w) {
+	if (w->cached) {
+		g_widgetCacheTotal -= w->cachedLen;
+		free(w->cached);
+		w->cached = 0;
+		w->cachedLen = 0;
+	}
+}
+static unsigned int Widget_GetGeneration() {
+#if ENABLE_LITTLEFS
+	return LFS_GetWriteGeneration();
+#else
+	return 0;
+#endif
+}
+// file too big for cache is sent in chunks, so it is never whole in RAM
+static void Widget_Stream(http_request_t *request, lfsStream_t *s) {
+	char buffer[WIDGET_STREAM_CHUNK + 1];
+	int len;
 
+	while ((len = LFS_ReadChunk(s, (byte*)buffer, WIDGET_STREAM_CHUNK)) > 0) {
+		buffer[len] = 0;
+		poststr(request, buffer);
+	}
+}
 void DRV_Widget_Display(http_request_t *request, widget_t *w) {
+	lfsStream_t *s;
+	int size, len, got;
+
+	if (w->cached && (w->cachedGeneration != Widget_GetGeneration()
+		|| (!w->bAllowCache && g_secondsElapsed - w->cachedAt >= w->refreshSeconds))) {
+		Widget_DropCache(w);
+	}
 	// fast path - cached
 	if (w->cached) {
+		w->hits++;
 		poststr(request, w->cached);
 		return;
 	}
-	char *data = (char*)LFS_ReadFile(w->fname);
-	if (data == 0) {
+	s = LFS_OpenStream(w->fname, 0);
+	if (s == 0) {
 		return;
 	}
-	poststr(request, data);
-
-	if (w->bAllowCache) {
-		w->cached = data;
+	size = LFS_GetStreamSize(s);
+	if ((w->bAllowCache == 0 && w->refreshSeconds <= 0) || size > WIDGET_CACHE_MAX_FILE
+		|| g_widgetCacheTotal + size > WIDGET_CACHE_MAX_TOTAL
+		|| (w->cached = malloc(size + 1)) == 0) {
+		Widget_Stream(request, s);
+		LFS_CloseStream(s);
 		return;
 	}
-	free(data);
+	for (len = 0; len < size; len += got) {
+		got = LFS_ReadChunk(s, (byte*)w->cached + len, size - len);
+		if (got <= 0) {
+			break;
+		}
+	}
+	LFS_CloseStream(s);
+	w->cached[len] = 0;
+	w->cachedLen = len;
+	w->cachedGeneration = Widget_GetGeneration();
+	w->cachedAt = g_secondsElapsed;
+	w->hits = 0;
+	g_widgetCacheTotal += len;
+	poststr(request, w->cached);
 }
-void DRV_Widget_DisplayList(http_request_t* request, WidgetLocation loc) {
+void DRV_Widget_DisplayList(http_request_t* request, int bPreState) {
 	widget_t *w = g_widgets;
 	while (w) {
-		if (w->location == loc) {
+		// state section is replaced by every refresh, so static
+		// widgets go before it, on whole page only
+		if (bPreState ? (w->location == WIDGET_STATIC || w->refreshSeconds <= 0)
+			: (w->location == WIDGET_STATE && w->refreshSeconds > 0)) {
 			DRV_Widget_Display(request, w);
 		}
 		w = w->next;
@@ -70,12 +141,18 @@ void DRV_Widget_DisplayList(http_request_t* request, WidgetLocation loc) {
 }
 
 void DRV_Widget_AddToHtmlPage(http_request_t *request, int bPreState) {
-	if (bPreState) {
-		DRV_Widget_DisplayList(request, WIDGET_STATIC);
-	}
-	else {
-		DRV_Widget_DisplayList(request, WIDGET_STATE);
+	DRV_Widget_DisplayList(request, bPreState);
+}
+// -1 if widget content is not in RAM
+int Widget_GetCacheHits(const char *fname) {
+	widget_t *w;
+
+	for (w = g_widgets; w; w = w->next) {
+		if (w->cached && !strcmp(w->fname, fname)) {
+			return w->hits;
+		}
 	}
+	return -1;
 }
 void Widget_Add(widget_t **first, widget_t *n) {
 	if (*first == 0) {
@@ -101,6 +178,7 @@ static commandResult_t CMD_Widget_Create(const void *context, const char *cmd, c
 	n->bAllowCache = Tokenizer_GetArgInteger(1);
 	const char *fname = Tokenizer_GetArg(2);
 	n->fname = strdup(fname);
+	n->refreshSeconds = Tokenizer_GetArgIntegerDefault(3, 1);
 	Widget_Add(&g_widgets, n);
 	return CMD_RES_OK;
 }
@@ -109,9 +187,7 @@ static commandResult_t CMD_Widget_ClearAll(const void *context, const char *cmd,
 	while (current) {
 		widget_t *next = current->next;
 		free(current->fname);
-		if (current->cached) {
-			free(current->cached);
-		}
+		Widget_DropCache(current);
 		free(current);
 		current = next;
 	}
@@ -127,8 +203,8 @@ void DRV_Widget_Init() {
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("widget_clearAll", CMD_Widget_ClearAll, NULL);
 
-	//cmddetail:{"name":"widget_create","args":"[LocationIndex][bAllowCache][FileName]",
-	//cmddetail:"descr":"",
+	//cmddetail:{"name":"widget_create","args":"[LocationIndex][bAllowCache][FileName][RefreshSeconds]",
+	//cmddetail:"descr":"Adds widget from LittleFS file. Content is kept in RAM until LFS is written, or only for RefreshSeconds without bAllowCache. RefreshSeconds 0 makes widget static, it is sent with whole page and skipped by state refresh. Default is 1.",
 	//cmddetail:"fn":"CMD_Widget_Create","file":"driver/drv_widget.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("widget_create", CMD_Widget_Create, NULL);
@@ -0,0 +1,346 @@
+// background WiFi scan and roaming between APs of one SSID
+#include "../new_common.h"
+#include "../new_cfg.h"
+#include "../new_pins.h"
+#include "../logging/logging.h"
+#include "../cmnds/cmd_public.h"
+#include "../httpserver/new_http.h"
+#include "../hal/hal_wifi.h"
+#include "drv_local.h"
+#include "drv_wifiRoam.h"
+#if ENABLE_MQTT
+#include "../mqtt/new_mqtt.h"
+#endif
+
+#if ENABLE_DRIVER_WIFIROAM
+
+// Device stays on AP it joined first, even when user walks to other end
+// of house and other AP of same network would give much better link.
+// Driver scans now and then while device is idle (scan takes station off
+// its channel for a moment) and keeps BSSID, channel and signal of APs in
+// cache. When link stays below MinRssi for HoldSec, it joins strongest
+// cached AP of same SSID, if that one is at least GainDb better.
+// Weak link is scanned more often, so candidates are fresh by then.
+// After roam there is cooldown, so two APs of similar signal don't make
+// it jump back and forth.
+
+#define WR_MAX_APS				16
+#define WR_BUSY_PUBLISHES		4
+// interval of scans while link is weak, seconds
+#define WR_WEAK_SCAN_INTERVAL	10
+// scan results not back in that time are given up
+#define WR_SCAN_TIMEOUT			10
+#define WR_ROAM_TIMEOUT			20
+#define WR_COOLDOWN				120
+
+typedef struct wifiRoamAP_s {
+	obkWiFiScanEntry_t e;
+	int age;
+} wifiRoamAP_t;
+
+typedef struct wifiRoam_s {
+	bool bRunning;
+	// seconds between scans of idle device
+	int scanInterval;
+	int minRssi;
+	int holdSec;
+	int gainDb;
+	int sinceScan;
+	// seconds since scan was started, 0 when none runs
+	int scanWait;
+	int weakSeconds;
+	int cooldown;
+	// seconds since roam request, 0 when none
+	int roaming;
+	unsigned char roamBSSID[6];
+	int lastPublishes;
+	int lastReceived;
+	int scans;
+	int roams;
+	int count;
+	wifiRoamAP_t aps[WR_MAX_APS];
+} wifiRoam_t;
+
+static wifiRoam_t g_wr;
+static obkWiFiScanEntry_t g_wrResults[WR_MAX_APS];
+static bool g_wrScanNow = false;
+
+static int WiFiRoam_FindAP(const unsigned char *bssid) {
+	int i;
+
+	for (i = 0; i < g_wr.count; i++) {
+		if (!memcmp(g_wr.aps[i].e.bssid, bssid, 6)) {
+			return i;
+		}
+	}
+	return -1;
+}
+static void WiFiRoam_AddAP(const obkWiFiScanEntry_t *e) {
+	int i, j;
+
+	i = WiFiRoam_FindAP(e->bssid);
+	if (i < 0) {
+		if (g_wr.count < WR_MAX_APS) {
+			i = g_wr.count++;
+		}
+		else {
+			// full, weakest one gives place to stronger
+			i = 0;
+			for (j = 1; j < g_wr.count; j++) {
+				if (g_wr.aps[j].e.rssi < g_wr.aps[i].e.rssi) {
+					i = j;
+				}
+			}
+			if (g_wr.aps[i].e.rssi >= e->rssi) {
+				return;
+			}
+		}
+	}
+	g_wr.aps[i].e = *e;
+	g_wr.aps[i].age = 0;
+}
+// APs not seen in three scans are gone
+static void WiFiRoam_AgeAPs() {
+	int i = 0;
+
+	while (i < g_wr.count) {
+		g_wr.aps[i].age++;
+		if (g_wr.aps[i].age > g_wr.scanInterval * 3) {
+			g_wr.aps[i] = g_wr.aps[--g_wr.count];
+			DRV_MarkIndexDirty(WiFiRoam_AppendInformationToHTTPIndexPage);
+		}
+		else {
+			i++;
+		}
+	}
+}
+static void WiFiRoam_PollScan() {
+	int i, n;
+
+	if (g_wr.scanWait == 0) {
+		return;
+	}
+	n = HAL_WiFi_GetScanResults(g_wrResults, WR_MAX_APS);
+	if (n < 0) {
+		if (++g_wr.scanWait > WR_SCAN_TIMEOUT) {
+			ADDLOG_DEBUG(LOG_FEATURE_GENERAL, "WiFiRoam: scan gave no results");
+			g_wr.scanWait = 0;
+		}
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		WiFiRoam_AddAP(&g_wrResults[i]);
+	}
+	g_wr.scanWait = 0;
+	DRV_MarkIndexDirty(WiFiRoam_AppendInformationToHTTPIndexPage);
+	ADDLOG_DEBUG(LOG_FEATURE_GENERAL, "WiFiRoam: scan found %i APs, %i cached", n, g_wr.count);
+}
+static bool WiFiRoam_IsBusy() {
+	bool bBusy = false;
+
+#if ENABLE_MQTT
+	{
+		int pub = MQTT_GetPublishEventCounter();
+		int rcv = MQTT_GetReceivedEventCounter();
+		if (rcv != g_wr.lastReceived || pub - g_wr.lastPublishes > WR_BUSY_PUBLISHES) {
+			bBusy = true;
+		}
+		g_wr.lastPublishes = pub;
+		g_wr.lastReceived = rcv;
+	}
+#endif
+	return bBusy;
+}
+static void WiFiRoam_StartScan() {
+	if (HAL_WiFi_StartScan() != 0) {
+		return;
+	}
+	g_wr.scanWait = 1;
+	g_wr.sinceScan = 0;
+	g_wr.scans++;
+	DRV_MarkIndexDirty(WiFiRoam_AppendInformationToHTTPIndexPage);
+}
+static bool WiFiRoam_GetLinkBSSID(unsigned char *bssid) {
+	char str[32];
+	unsigned int b[6];
+	int i;
+
+	if (sscanf(HAL_GetWiFiBSSID(str), "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+		return false;
+	}
+	for (i = 0; i < 6; i++) {
+		bssid[i] = b[i];
+	}
+	return true;
+}
+static void WiFiRoam_TryRoam(int rssi) {
+	const char *ssid = CFG_GetWiFiSSID();
+	unsigned char cur[6];
+	int i, best = -1;
+
+	if (WiFiRoam_GetLinkBSSID(cur) == false) {
+		return;
+	}
+	for (i = 0; i < g_wr.count; i++) {
+		if (strcmp(g_wr.aps[i].e.ssid, ssid) || !memcmp(g_wr.aps[i].e.bssid, cur, 6)) {
+			continue;
+		}
+		if (g_wr.aps[i].e.rssi < rssi + g_wr.gainDb) {
+			continue;
+		}
+		if (best < 0 || g_wr.aps[i].e.rssi > g_wr.aps[best].e.rssi) {
+			best = i;
+		}
+	}
+	if (best < 0) {
+		return;
+	}
+	ADDLOG_INFO(LOG_FEATURE_GENERAL, "WiFiRoam: link %i dBm, roaming to " MACSTR " ch %i, %i dBm",
+		rssi, MAC2STR(g_wr.aps[best].e.bssid), g_wr.aps[best].e.channel, g_wr.aps[best].e.rssi);
+	memcpy(g_wr.roamBSSID, g_wr.aps[best].e.bssid, 6);
+	g_wr.roaming = 1;
+	g_wr.roams++;
+	DRV_MarkIndexDirty(WiFiRoam_AppendInformationToHTTPIndexPage);
+	g_wr.cooldown = WR_COOLDOWN;
+	g_wr.weakSeconds = 0;
+	HAL_WiFi_ConnectToBSSID(ssid, CFG_GetWiFiPass(), &g_wr.aps[best].e, &g_cfg.staticIP);
+}
+// roam is over when station is on new AP, otherwise main loop
+// reconnects after timeout as for any lost link
+static void WiFiRoam_CheckRoam() {
+	unsigned char cur[6];
+
+	if (Main_HasWiFiConnected() && WiFiRoam_GetLinkBSSID(cur) && !memcmp(cur, g_wr.roamBSSID, 6)) {
+		ADDLOG_INFO(LOG_FEATURE_GENERAL, "WiFiRoam: joined " MACSTR " after %i s", MAC2STR(cur), g_wr.roaming);
+		g_wr.roaming = 0;
+		return;
+	}
+	if (++g_wr.roaming > WR_ROAM_TIMEOUT) {
+		ADDLOG_WARN(LOG_FEATURE_GENERAL, "WiFiRoam: roam to " MACSTR " timed out", MAC2STR(g_wr.roamBSSID));
+		g_wr.roaming = 0;
+	}
+}
+bool WiFiRoam_IsRoaming() {
+	return g_wr.bRunning && g_wr.roaming;
+}
+int WiFiRoam_GetRoamCount() {
+	return g_wr.roams;
+}
+int WiFiRoam_GetScanCount() {
+	return g_wr.scans;
+}
+void WiFiRoam_ForEachAP(void *userData, void (*callback)(const obkWiFiScanEntry_t *ap, int age, void *userData)) {
+	int i;
+
+	for (i = 0; i < g_wr.count; i++) {
+		callback(&g_wr.aps[i].e, g_wr.aps[i].age, userData);
+	}
+}
+void WiFiRoam_OnEverySecond() {
+	bool bBusy;
+	int rssi, interval;
+
+	WiFiRoam_AgeAPs();
+	WiFiRoam_PollScan();
+	bBusy = WiFiRoam_IsBusy();
+	g_wr.sinceScan++;
+	if (g_wr.cooldown) {
+		g_wr.cooldown--;
+	}
+	if (g_wr.roaming) {
+		WiFiRoam_CheckRoam();
+		return;
+	}
+	if (Main_HasWiFiConnected() == 0) {
+		g_wr.weakSeconds = 0;
+		return;
+	}
+	rssi = HAL_GetWifiStrength();
+	if (rssi < g_wr.minRssi) {
+		g_wr.weakSeconds++;
+	}
+	else {
+		g_wr.weakSeconds = 0;
+	}
+	// weak link needs candidates even if device is busy
+	if (g_wr.weakSeconds) {
+		interval = g_wr.scanInterval < WR_WEAK_SCAN_INTERVAL ? g_wr.scanInterval : WR_WEAK_SCAN_INTERVAL;
+	}
+	else {
+		interval = bBusy ? -1 : g_wr.scanInterval;
+	}
+	if (g_wr.scanWait == 0 && (g_wrScanNow || (interval >= 0 && g_wr.sinceScan >= interval))) {
+		g_wrScanNow = false;
+		WiFiRoam_StartScan();
+	}
+	if (g_wr.weakSeconds >= g_wr.holdSec && g_wr.cooldown == 0) {
+		WiFiRoam_TryRoam(rssi);
+	}
+}
+void WiFiRoam_AppendInformationToHTTPIndexPage(http_request_t *request, int bPreState) {
+	if (bPreState) {
+		return;
+	}
+	hprintf255(request, "<h5>WiFiRoam: %i APs cached, %i scans, %i roams</h5>",
+		g_wr.count, g_wr.scans, g_wr.roams);
+}
+void WiFiRoam_Stop() {
+	g_wr.bRunning = false;
+	g_wr.roaming = 0;
+}
+// WiFiRoam_Policy [MinRssi] [HoldSec] [GainDb]
+static commandResult_t CMD_WiFiRoam_Policy(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	g_wr.minRssi = Tokenizer_GetArgInteger(0);
+	if (Tokenizer_GetArgsCount() > 1) {
+		g_wr.holdSec = Tokenizer_GetArgInteger(1);
+	}
+	if (Tokenizer_GetArgsCount() > 2) {
+		g_wr.gainDb = Tokenizer_GetArgInteger(2);
+	}
+	if (g_wr.gainDb < 1) {
+		g_wr.gainDb = 1;
+	}
+	ADDLOG_INFO(LOG_FEATURE_CMD, "WiFiRoam: roam below %i dBm held %i s to AP %i dB better",
+		g_wr.minRssi, g_wr.holdSec, g_wr.gainDb);
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_WiFiRoam_Scan(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	g_wrScanNow = true;
+	return CMD_RES_OK;
+}
+// startDriver WiFiRoam [ScanIntervalSec]
+// WiFiRoam_Policy -75 30 8
+void WiFiRoam_Init() {
+	memset(&g_wr, 0, sizeof(g_wr));
+	g_wr.scanInterval = Tokenizer_GetArgIntegerDefault(1, 300);
+	if (g_wr.scanInterval < 1) {
+		g_wr.scanInterval = 1;
+	}
+	g_wr.minRssi = -75;
+	g_wr.holdSec = 30;
+	g_wr.gainDb = 8;
+#if ENABLE_MQTT
+	g_wr.lastPublishes = MQTT_GetPublishEventCounter();
+	g_wr.lastReceived = MQTT_GetReceivedEventCounter();
+#endif
+	g_wrScanNow = false;
+	g_wr.bRunning = true;
+	DRV_MarkIndexDirty(WiFiRoam_AppendInformationToHTTPIndexPage);
+
+	//cmddetail:{"name":"WiFiRoam_Policy","args":"[MinRssi] [HoldSec] [GainDb]",
+	//cmddetail:"descr":"Sets when WiFiRoam driver roams. When link is below MinRssi for HoldSec, device joins strongest AP of same SSID seen by scans, if it is at least GainDb better. Defaults are -75 30 8.",
+	//cmddetail:"fn":"CMD_WiFiRoam_Policy","file":"driver/drv_wifiRoam.c","requires":"",
+	//cmddetail:"examples":"WiFiRoam_Policy -75 30 8"}
+	CMD_RegisterCommand("WiFiRoam_Policy", CMD_WiFiRoam_Policy, NULL);
+	//cmddetail:{"name":"WiFiRoam_Scan","args":"",
+	//cmddetail:"descr":"Starts WiFiRoam scan on next second, without waiting for idle time. Results are in /api/wifiscan.",
+	//cmddetail:"fn":"CMD_WiFiRoam_Scan","file":"driver/drv_wifiRoam.c","requires":"",
+	//cmddetail:"examples":"WiFiRoam_Scan"}
+	CMD_RegisterCommand("WiFiRoam_Scan", CMD_WiFiRoam_Scan, NULL);
+}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../obk_config.h"
+#include "../hal/hal_wifi.h"
+
+#if ENABLE_DRIVER_WIFIROAM
+
+// true from roam request until station is on new AP or roam timed out,
+// lost link in that time is not reconnected by main loop
+bool WiFiRoam_IsRoaming();
+int WiFiRoam_GetRoamCount();
+int WiFiRoam_GetScanCount();
+// cached APs of last scans, age is seconds since AP was last seen
+void WiFiRoam_ForEachAP(void *userData, void (*callback)(const obkWiFiScanEntry_t *ap, int age, void *userData));
+
+#else
+
+#define WiFiRoam_IsRoaming()		false
+
+#endif
@@ -154,7 +154,8 @@ static UINT32 temp_single_get_enable(int ch)
     return SARADC_SUCCESS;
 }
 
-int HAL_ADC_Read(int pinNumber)
+// one saradc run, fills ADC_TEMP_BUFFER_SIZE samples into tmp_single_buff
+static int BK_ADC_Run(int pinNumber)
 {
     UINT32 ret;
     int result;
@@ -179,8 +180,32 @@ int HAL_ADC_Read(int pinNumber)
     ret = 1000; // 1s
     result = rtos_get_semaphore(&tmp_single_semaphore, ret);
     if(result == kNoErr) {
-        return tmp_single_desc.pData[0];
+        return 0;
     } 
     return -3;
 }
+int HAL_ADC_Read(int pinNumber)
+{
+	int result = BK_ADC_Run(pinNumber);
+
+	if (result != 0) {
+		return result;
+	}
+	return tmp_single_desc.pData[0];
+}
+// run collects several samples anyway, all of them are used here
+int HAL_ADC_ReadBurst(int pinNumber, unsigned short *out, int count)
+{
+	int n = 0, i;
+
+	while (n < count) {
+		if (BK_ADC_Run(pinNumber) != 0) {
+			break;
+		}
+		for (i = 0; i < ADC_TEMP_BUFFER_SIZE && n < count; i++) {
+			out[n++] = tmp_single_buff[i];
+		}
+	}
+	return n;
+}
 
@@ -107,5 +107,41 @@ int HAL_Configuration_SaveConfigMemory(void *src, int dataLen){
     return dataLen;
 }
 
+// journal is rest of config sector, it is erased with config
+static int journalStart = 0;
 
+int HAL_Configuration_GetJournalSize(int dataLen){
+	bk_logic_partition_t *pt = bk_flash_get_info(BK_PARTITION_NET_PARAM);
+
+	journalStart = dataLen;
+	if (pt == 0 || dataLen >= pt->partition_length){
+		return 0;
+	}
+	// only the sector config ends in is erased by save
+	return ((dataLen + 0xFFF) & ~0xFFF) - dataLen;
+}
+
+int HAL_Configuration_ReadJournal(void *target, int offset, int len){
+	bk_logic_partition_t *pt = bk_flash_get_info(BK_PARTITION_NET_PARAM);
+
+	return beken_hal_flash_read(pt->partition_start_addr + journalStart + offset, target, len);
+}
 
+int HAL_Configuration_WriteJournal(const void *src, int offset, int len){
+	BaseType_t taken;
+	int res;
+
+	if (!config_mutex) {
+		config_mutex = xSemaphoreCreateMutex( );
+	}
+	taken = xSemaphoreTake( config_mutex, 100 );
+	// no erase, bytes after last record are still FF
+	hal_flash_lock();
+	bk_flash_enable_security(FLASH_PROTECT_NONE);
+	res = bk_flash_write(BK_PARTITION_NET_PARAM, journalStart + offset, (uint8_t *)src, len);
+	bk_flash_enable_security(FLASH_PROTECT_ALL);
+	hal_flash_unlock();
+	if (taken == pdTRUE)
+		xSemaphoreGive( config_mutex );
+	return res == 0 ? 0 : -1;
+}
@@ -2,26 +2,38 @@
 	This module saves variable data to a flash region in an erase effient way.
 
 	Design:
-	variables to be small - we want as many writes between erases as possible.
-	sector will be all FF (erased), and data added into it.
-	reading consists of searching the first non FF byte from the end, then
-	reading the preceding bytes as the variables.
-	last byte of data is len (!== 0xFF!)
-
+	two sectors, one of them is active. Active sector starts with header
+	(magic, generation) followed by records. Record updates a byte range of
+	FLASH_VARS_STRUCTURE: offset, len, checksum and then len bytes of data.
+	Erased flash is FF, so offset FF ends the log. Reading starts with zeroed
+	structure and applies records in order, so last write wins.
+	Save appends a record of changed fields only. When active sector is full,
+	other one is erased, whole structure is written there as first record and
+	its header is written last with higher generation, so power loss during
+	compaction leaves old sector in use.
+	Area in old format (whole structures, len as last byte) is read once and
+	converted. Log goes to sector 1, old magic in sector 0 is first marked
+	as converting and sector 0 is erased only once new header is written.
+	Simulator builds only the log, on RAM area, for selftests.
 */
 
 #ifndef PLATFORM_XR809
 #ifdef PLATFORM_BEKEN_NEW
 #endif
+#if WINDOWS
+#include <stddef.h>
+#include "../../new_common.h"
+#else
 #include "include.h"
 #include "mem_pub.h"
 #include "drv_model_pub.h"
 #include "net_param_pub.h"
 #include "flash_pub.h"
-#include "../hal_flashVars.h"
 
 #include "BkDriverFlash.h"
 #include "BkDriverUart.h"
+#endif
+#include "../hal_flashVars.h"
 
 #include "../../logging/logging.h"
 
@@ -31,31 +43,37 @@ extern FLASH_VARS_STRUCTURE flash_vars;
 int flash_vars_init();
 int flash_vars_write();
 
-// for testing only...  only done once at startup...
-extern int flash_vars_offset;
-int flash_vars_read(FLASH_VARS_STRUCTURE* data);
-
 
 
 //#define TEST_MODE
 //#define debug_delay(x) rtos_delay_milliseconds(x)
 #define debug_delay(x)
 
+// magic of old format area
 #define FLASH_VARS_MAGIC 0xfefefefe
+// old magic with bits cleared before conversion erases sector 1, only
+// structures in sector 0 are valid then
+#define FLASH_VARS_MAGIC_CONVERTING 0x00fefefe
+#define FLASH_VARS_LOG_MAGIC 0x4b424f4c
+#define FLASH_VARS_HEADER_SIZE 8
+#define FLASH_VARS_RECORD_HEADER 3
+// records never cover len byte, it is always sizeof
+#define FLASH_VARS_DATA_LEN ((int)offsetof(FLASH_VARS_STRUCTURE, len))
 // NOTE: Changed below according to partitions in SDK!!!!
 static unsigned int flash_vars_start = 0x1e3000; //0x1e1000 + 0x1000 + 0x1000; // after netconfig and mystery SSID
 static unsigned int flash_vars_len = 0x2000; // two blocks in BK7231
 static unsigned int flash_vars_sector_len = 0x1000; // erase size in BK7231
 
 FLASH_VARS_STRUCTURE flash_vars;
-int flash_vars_offset = 0; // offset to first FF in our area
-static int flash_vars_initialised = 0; // offset to first FF in our area
+int flash_vars_offset = 0; // offset to first FF in active sector
+static int flash_vars_active = 0; // sector the log is in
+static unsigned int flash_vars_generation = 0; // bumped by each compaction
+static int flash_vars_initialised = 0;
 
-static int flash_vars_valid();
-static int flash_vars_write_magic();
+static int flash_vars_raw_read(void* data, unsigned int off_set, unsigned int size);
 static int _flash_vars_write(void* data, unsigned int off_set, unsigned int size);
 static int flash_vars_erase(unsigned int off_set, unsigned int size);
-int flash_vars_read(FLASH_VARS_STRUCTURE* data);
+static int flash_vars_save(int offset, int len);
 
 #if WINDOWS
 #define TEST_MODE
@@ -68,18 +86,194 @@ int flash_vars_read(FLASH_VARS_STRUCTURE* data);
 #ifdef TEST_MODE
 
 static char test_flash_area[0x2000];
+// writes and erases left before simulated power loss, -1 for no limit
+static int test_flash_opsLeft = -1;
+
+static int test_flash_powerLost() {
+	if (test_flash_opsLeft == 0) {
+		return 1;
+	}
+	if (test_flash_opsLeft > 0) {
+		test_flash_opsLeft--;
+	}
+	return 0;
+}
 
 #endif
 
+static unsigned char flash_vars_checksum(const unsigned char* rec, int len) {
+	unsigned char sum = 0x5A;
+	int i;
+
+	// offset and len, then data after checksum byte
+	sum ^= rec[0];
+	sum = (sum << 1) | (sum >> 7);
+	sum ^= rec[1];
+	for (i = 0; i < len; i++) {
+		sum = (sum << 1) | (sum >> 7);
+		sum ^= rec[FLASH_VARS_RECORD_HEADER + i];
+	}
+	return sum;
+}
+
+static int flash_vars_header(int sector, unsigned int* generation) {
+	unsigned int hdr[2];
+
+	flash_vars_raw_read(hdr, sector * flash_vars_sector_len, sizeof(hdr));
+	if (hdr[0] != FLASH_VARS_LOG_MAGIC) {
+		return 0;
+	}
+	*generation = hdr[1];
+	return 1;
+}
+
+// applies records of sector, returns offset of first free byte
+static int flash_vars_replay(int sector, FLASH_VARS_STRUCTURE* data) {
+	unsigned char rec[FLASH_VARS_RECORD_HEADER + sizeof(FLASH_VARS_STRUCTURE)];
+	unsigned int base = sector * flash_vars_sector_len;
+	unsigned int pos = FLASH_VARS_HEADER_SIZE;
+	int records = 0;
+
+	while (pos + FLASH_VARS_RECORD_HEADER <= flash_vars_sector_len) {
+		flash_vars_raw_read(rec, base + pos, FLASH_VARS_RECORD_HEADER);
+		if (rec[0] == 0xFF) {
+			break;
+		}
+		if (rec[1] == 0 || rec[0] + rec[1] > FLASH_VARS_DATA_LEN
+			|| pos + FLASH_VARS_RECORD_HEADER + rec[1] > flash_vars_sector_len) {
+			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars bad record at %d", pos);
+			// sector is treated as full, next save compacts
+			return flash_vars_sector_len;
+		}
+		flash_vars_raw_read(rec + FLASH_VARS_RECORD_HEADER, base + pos + FLASH_VARS_RECORD_HEADER, rec[1]);
+		if (flash_vars_checksum(rec, rec[1]) != rec[2]) {
+			// torn write from power loss, it was last one
+			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash vars torn record at %d", pos);
+			return flash_vars_sector_len;
+		}
+		memcpy(((unsigned char*)data) + rec[0], rec + FLASH_VARS_RECORD_HEADER, rec[1]);
+		pos += FLASH_VARS_RECORD_HEADER + rec[1];
+		records++;
+	}
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars sector %d gen %u, %d records, offset %d",
+		sector, flash_vars_generation, records, pos);
+	return pos;
+}
+
+// old format: magic, then whole structures with len as last byte.
+// Returns 1 and end of latest structure, or 0 when there is none.
+static int flash_vars_read_legacy(FLASH_VARS_STRUCTURE* data, int* end) {
+	unsigned int start_addr;
+	unsigned int tmp = 0xffffffff;
+	int shifts = 0;
+	unsigned int len = 0;
+
+	flash_vars_raw_read(&tmp, 0, sizeof(tmp));
+	if (tmp == FLASH_VARS_MAGIC) {
+		start_addr = flash_vars_len;
+	}
+	else if (tmp == FLASH_VARS_MAGIC_CONVERTING) {
+		// sector 1 may hold part of the new log
+		start_addr = flash_vars_sector_len;
+	}
+	else {
+		return 0;
+	}
+	do {
+		start_addr -= sizeof(tmp);
+		flash_vars_raw_read(&tmp, start_addr, sizeof(tmp));
+	} while ((tmp == 0xFFFFFFFF) && (start_addr > 4));
+	if (tmp == 0xffffffff) {
+		return 0;
+	}
+	start_addr += sizeof(tmp);
+	while ((tmp & 0xFF000000) == 0xFF000000) {
+		tmp <<= 8;
+		shifts++;
+	}
+	len = (tmp >> 24) & 0xff;
+	start_addr -= shifts;
+	if (len == 0 || len > sizeof(*data) || len > start_addr - 4) {
+		ADDLOG_ERROR(LOG_FEATURE_CFG, "len (%d) in flash_var greater than current structure len (%d)", len, sizeof(*data));
+		return 0;
+	}
+	*end = start_addr;
+	start_addr -= len;
+	flash_vars_raw_read(data, start_addr, len - 1);
+	data->len = sizeof(*data);
+	return 1;
+}
+
+static int flash_vars_put(int sector, int pos, int offset, int len) {
+	unsigned char rec[FLASH_VARS_RECORD_HEADER + sizeof(FLASH_VARS_STRUCTURE)];
 
-static void alignOffset(int* offs) {
-	// do nothing - should work with any offsets
-	/*
-	if ((*offs) % 32){
-		(*offs) += (32- ((*offs)%32));
-	}*/
+	rec[0] = offset;
+	rec[1] = len;
+	memcpy(rec + FLASH_VARS_RECORD_HEADER, ((unsigned char*)&flash_vars) + offset, len);
+	rec[2] = flash_vars_checksum(rec, len);
+	return _flash_vars_write(rec, sector * flash_vars_sector_len + pos, FLASH_VARS_RECORD_HEADER + len);
 }
 
+// writes whole structure into other sector and makes it active
+static int flash_vars_compact() {
+	unsigned int hdr[2];
+	int sector = flash_vars_active ^ 1;
+
+	if (flash_vars_erase(sector * flash_vars_sector_len, flash_vars_sector_len) < 0) {
+		return -1;
+	}
+	if (flash_vars_put(sector, FLASH_VARS_HEADER_SIZE, 0, FLASH_VARS_DATA_LEN) < 0) {
+		return -1;
+	}
+	hdr[0] = FLASH_VARS_LOG_MAGIC;
+	hdr[1] = flash_vars_generation + 1;
+	if (_flash_vars_write(hdr, sector * flash_vars_sector_len, sizeof(hdr)) < 0) {
+		return -1;
+	}
+	flash_vars_active = sector;
+	flash_vars_generation = hdr[1];
+	flash_vars_offset = FLASH_VARS_HEADER_SIZE + FLASH_VARS_RECORD_HEADER + FLASH_VARS_DATA_LEN;
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars compacted to sector %d gen %u", sector, flash_vars_generation);
+	return 0;
+}
+
+static void flash_vars_load() {
+	unsigned int g0 = 0, g1 = 0;
+	unsigned int magic;
+	int v0, v1, end;
+
+	v0 = flash_vars_header(0, &g0);
+	v1 = flash_vars_header(1, &g1);
+	if (v0 || v1) {
+		if (v0 && v1) {
+			flash_vars_active = ((int)(g1 - g0)) > 0;
+		}
+		else {
+			flash_vars_active = v1;
+		}
+		flash_vars_generation = flash_vars_active ? g1 : g0;
+		flash_vars_offset = flash_vars_replay(flash_vars_active, &flash_vars);
+		return;
+	}
+	if (flash_vars_read_legacy(&flash_vars, &end)) {
+		ADDLOG_INFO(LOG_FEATURE_CFG, "converting flash vars, boot_count %d", flash_vars.boot_count);
+		// mark before sector 1 is erased. Structure crossing into it is
+		// lost if conversion is interrupted, so old area is dropped then
+		magic = end <= (int)flash_vars_sector_len ? FLASH_VARS_MAGIC_CONVERTING : 0;
+		_flash_vars_write(&magic, 0, sizeof(magic));
+		// log goes to sector 1, old area is kept until its header is written
+		flash_vars_active = 0;
+		flash_vars_generation = 0;
+		if (flash_vars_compact() == 0) {
+			flash_vars_erase(0, flash_vars_sector_len);
+		}
+		return;
+	}
+	ADDLOG_INFO(LOG_FEATURE_CFG, "new flash vars");
+	flash_vars_active = 1;
+	flash_vars_generation = 0;
+	flash_vars_compact();
+}
 
 // initialise and read variables from flash
 int flash_vars_init() {
@@ -88,12 +282,9 @@ int flash_vars_init() {
 #else
 	bk_logic_partition_t* pt;
 #endif
-	//direct_serial_log = 1;
 
 	if (!flash_vars_initialised) {
 		ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars not initialised - reading");
-		debug_delay(200);
-
 
 #if WINDOWS
 #elif PLATFORM_XR809
@@ -105,285 +296,62 @@ int flash_vars_init() {
 		flash_vars_len = 0x2000; // two blocks in BK7231
 		flash_vars_sector_len = 0x1000; // erase size in BK7231
 #endif
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "got part info");
-		debug_delay(200);
 
 		memset(&flash_vars, 0, sizeof(flash_vars));
 		flash_vars.len = sizeof(flash_vars);
-
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "cleared structure");
-		debug_delay(200);
-		// read any existing
-		flash_vars_read(&flash_vars);
+		// set first, compaction saves through here
 		flash_vars_initialised = 1;
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "read structure");
-		debug_delay(200);
-	}
-	else {
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars already initialised");
-
+		flash_vars_load();
+		flash_vars.len = sizeof(flash_vars);
 	}
 	return 0;
 }
 
-static int flash_vars_valid() {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
-#ifndef TEST_MODE
-	DD_HANDLE flash_hdl;
-#endif
-	uint32_t start_addr;
-	unsigned int tmp = 0xffffffff;
-	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_valid()");
-	debug_delay(200);
-
-#ifndef TEST_MODE
-	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
-	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-#endif
-	start_addr = flash_vars_start;
-
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_valid() flash open");
-	debug_delay(200);
-
-#ifdef TEST_MODE
-	memcpy(&tmp, &test_flash_area[start_addr - flash_vars_start], sizeof(tmp));
-#else
-	GLOBAL_INT_DISABLE();
-	ddev_read(flash_hdl, (char*)&tmp, sizeof(tmp), start_addr);
-	GLOBAL_INT_RESTORE();
-	ddev_close(flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_valid() copied header 0x%x", tmp);
-	debug_delay(200);
-
-	// if not our magic, then erase and write magic
-	if (tmp != FLASH_VARS_MAGIC) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash_vars_valid - not our magic, erase");
-		debug_delay(200);
-		if (flash_vars_write_magic() >= 0) {
-			ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash initialised");
-		}
-		else {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash initialise failed");
-			return -1;
-		}
-		return 0;
+// appends byte range of flash_vars as one record, no read back
+static int flash_vars_save(int offset, int len) {
+	flash_vars_init();
+	if (offset + len > FLASH_VARS_DATA_LEN) {
+		len = FLASH_VARS_DATA_LEN - offset;
+	}
+	if (flash_vars_offset + FLASH_VARS_RECORD_HEADER + len > (int)flash_vars_sector_len) {
+		// whole structure is written, change included
+		return flash_vars_compact();
+	}
+	if (flash_vars_put(flash_vars_active, flash_vars_offset, offset, len) < 0) {
+		return -1;
 	}
+	flash_vars_offset += FLASH_VARS_RECORD_HEADER + len;
 	return 1;
 }
 
-static int flash_vars_write_magic() {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
+int flash_vars_write() {
+	return flash_vars_save(0, FLASH_VARS_DATA_LEN);
+}
+
+static int flash_vars_raw_read(void* data, unsigned int off_set, unsigned int size) {
 #ifndef TEST_MODE
+	UINT32 status;
 	DD_HANDLE flash_hdl;
 #endif
-	uint32_t start_addr;
-	unsigned int tmp = FLASH_VARS_MAGIC;
 	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_magic write");
-	debug_delay(200);
 
-	start_addr = flash_vars_start;
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash open");
-	debug_delay(200);
-
-	if (flash_vars_erase(0, flash_vars_len) >= 0) {
-		ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash erased");
-		debug_delay(200);
-	}
-	else {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash erase failed");
-		debug_delay(200);
+	if (off_set + size > flash_vars_len) {
+		memset(data, 0xFF, size);
 		return -1;
 	}
 #ifdef TEST_MODE
-	memcpy(&test_flash_area[start_addr - flash_vars_start], &tmp, sizeof(tmp));
+	memcpy(data, &test_flash_area[off_set], size);
 #else
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-
 	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
 	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
 	GLOBAL_INT_DISABLE();
-	ddev_write(flash_hdl, (char*)&tmp, sizeof(tmp), start_addr);
+	ddev_read(flash_hdl, (char*)data, size, flash_vars_start + off_set);
 	GLOBAL_INT_RESTORE();
 	ddev_close(flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_ALL);
 #endif
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "header written");
-	// next write point
-	flash_vars_offset = sizeof(tmp);
-	alignOffset(&flash_vars_offset);
-
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "header written %d", flash_vars_offset);
-	debug_delay(200);
-
-	// write a new structure
-	flash_vars_write();
-
 	return 0;
 }
 
-
-// read data from flash vars area.
-// design:
-// search from end of flash until we find a non-zero byte.
-// this is length of existing data.
-// clear structure to 00
-// read existing data (excluding len) into structure.
-// set len to current structure defn len.
-// remember first FF byte offset
-int flash_vars_read(FLASH_VARS_STRUCTURE* data) {
-	//uint32_t i;
-	//uint32_t param;
-	UINT32 status;
-#ifndef TEST_MODE
-	DD_HANDLE flash_hdl;
-#endif
-	uint32_t start_addr;
-	int loops = 0x2100 / 4;
-	unsigned int tmp = 0xffffffff;
-	GLOBAL_INT_DECLARATION();
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash_vars_read len %d", sizeof(*data));
-
-	// check for magic, and reset sector(s) if not.
-	if (flash_vars_valid() >= 0) {
-		//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars valid or initialised");
-	}
-	else {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "flash_vars_validity error");
-		memset(data, 0, sizeof(*data));
-		data->len = sizeof(*data);
-		debug_delay(200);
-		return -1;
-	}
-	debug_delay(200);
-
-#ifndef TEST_MODE
-	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
-	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-#endif
-	start_addr = flash_vars_start + flash_vars_len;
-
-	do {
-		start_addr -= sizeof(tmp);
-#ifdef TEST_MODE
-		memcpy(&tmp, &test_flash_area[start_addr - flash_vars_start], sizeof(tmp));
-#else
-		GLOBAL_INT_DISABLE();
-		ddev_read(flash_hdl, (char*)&tmp, sizeof(tmp), start_addr);
-		GLOBAL_INT_RESTORE();
-#endif
-	} while ((tmp == 0xFFFFFFFF) && (start_addr > flash_vars_start + 4) && (loops--));
-	if (!loops) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "loops over addr 0x%X", start_addr);
-	}
-
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "found at %u 0x%X", start_addr, tmp);
-	start_addr += sizeof(tmp);
-	debug_delay(200);
-
-	if (tmp == 0xffffffff) {
-		// no data found, all erased
-		// clear result.
-		memset(data, 0, sizeof(*data));
-		// set the len to the latest revision's len
-		data->len = sizeof(*data);
-#ifndef TEST_MODE
-		ddev_close(flash_hdl);
-		bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-		ADDLOG_INFO(LOG_FEATURE_CFG, "new flash vars");
-		return 0;
-	}
-	else {
-		int shifts = 0;
-		int len = 0;
-		while ((tmp & 0xFF000000) == 0xFF000000) {
-			tmp <<= 8;
-			shifts++;
-		}
-		len = (tmp >> 24) & 0xff;
-		start_addr -= shifts;
-		start_addr -= len;
-
-		if (len > sizeof(*data)) {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "len (%d) in flash_var greater than current structure len (%d)", len, sizeof(*data));
-#ifndef TEST_MODE
-			ddev_close(flash_hdl);
-			bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-			// erase it all and write a new one
-			flash_vars_write_magic();
-
-		}
-		else {
-			// clear result.
-			memset(data, 0, sizeof(*data));
-			// read the DATA portion into the structure
-#ifdef TEST_MODE
-			memcpy(data, &test_flash_area[start_addr - flash_vars_start], len - 1);
-#else
-			GLOBAL_INT_DISABLE();
-			ddev_read(flash_hdl, (char*)data, len - 1, start_addr);
-			GLOBAL_INT_RESTORE();
-			ddev_close(flash_hdl);
-			bk_flash_enable_security(FLASH_PROTECT_ALL);
-#endif
-			// set the len to the latest revision's len
-			data->len = sizeof(*data);
-			flash_vars_offset = (start_addr - flash_vars_start) + len;
-			alignOffset(&flash_vars_offset);
-
-			ADDLOG_DEBUG(LOG_FEATURE_CFG, "new offset after read %d, boot_count %d, success count %d",
-				flash_vars_offset,
-				data->boot_count,
-				data->boot_success_count
-			);
-
-		}
-		return 1;
-	}
-}
-
-
-int flash_vars_write() {
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars write");
-	flash_vars_init();
-	alignOffset(&flash_vars_offset);
-
-	FLASH_VARS_STRUCTURE* data = &flash_vars;
-	if (flash_vars_offset + data->len > flash_vars_len) {
-		if (flash_vars_write_magic() >= 0) {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash reinitialised");
-		}
-		else {
-			ADDLOG_ERROR(LOG_FEATURE_CFG, "flash reinitialise failed");
-			return -1;
-		}
-	}
-
-	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars write at offset %d len %d", flash_vars_offset, data->len);
-	_flash_vars_write(data, flash_vars_offset, data->len);
-	flash_vars_offset += data->len;
-	alignOffset(&flash_vars_offset);
-
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "new offset %d, boot_count %d, success count %d",
-		flash_vars_offset,
-		data->boot_count,
-		data->boot_success_count
-	);
-	return 1;
-}
-
-
 // write updated data to flash vars area.
 // off_set is zero based.  size in bytes
 // TODO - test we CAN write at a byte boundary?
@@ -392,37 +360,30 @@ int flash_vars_write() {
 int _flash_vars_write(void* data, unsigned int off_set, unsigned int size) {
 	//uint32_t i;
 	//uint32_t param;
-	UINT32 status;
 #ifndef TEST_MODE
+	UINT32 status;
 	DD_HANDLE flash_hdl;
 #endif
 	uint32_t start_addr;
 	GLOBAL_INT_DECLARATION();
 	//ADDLOG_DEBUG(LOG_FEATURE_CFG, "_flash vars write offset %d, size %d", off_set, size);
 
-#ifndef TEST_MODE
-	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
-	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
-	bk_flash_enable_security(FLASH_PROTECT_NONE);
-#endif
 	start_addr = flash_vars_start + off_set;
 
-	if (start_addr <= flash_vars_start) {
-		ADDLOG_ERROR(LOG_FEATURE_CFG, "_flash vars write invalid addr 0x%X", start_addr);
-		ddev_close(flash_hdl);
-		bk_flash_enable_security(FLASH_PROTECT_ALL);
-		return -1;
-	}
 	if (start_addr + size > flash_vars_start + flash_vars_len) {
 		ADDLOG_ERROR(LOG_FEATURE_CFG, "_flash vars write invalid addr 0x%X len 0x%X", start_addr, size);
-		ddev_close(flash_hdl);
-		bk_flash_enable_security(FLASH_PROTECT_ALL);
 		return -1;
 	}
 
 #ifdef TEST_MODE
+	if (test_flash_powerLost()) {
+		return -1;
+	}
 	memcpy(&test_flash_area[start_addr - flash_vars_start], data, size);
 #else
+	flash_hdl = ddev_open(FLASH_DEV_NAME, &status, 0);
+	ASSERT(DD_HANDLE_UNVALID != flash_hdl);
+	bk_flash_enable_security(FLASH_PROTECT_NONE);
 	GLOBAL_INT_DISABLE();
 	ddev_write(flash_hdl, data, size, start_addr);
 	GLOBAL_INT_RESTORE();
@@ -441,8 +402,8 @@ int _flash_vars_write(void* data, unsigned int off_set, unsigned int size) {
 int flash_vars_erase(unsigned int off_set, unsigned int size) {
 	uint32_t i;
 	uint32_t param;
-	UINT32 status;
 #ifndef TEST_MODE
+	UINT32 status;
 	DD_HANDLE flash_hdl;
 #endif
 	uint32_t start_sector, end_sector;
@@ -478,6 +439,9 @@ int flash_vars_erase(unsigned int off_set, unsigned int size) {
 		}
 		ADDLOG_DEBUG(LOG_FEATURE_CFG, "flash vars erase block at addr 0x%X", param);
 #ifdef TEST_MODE
+		if (test_flash_powerLost()) {
+			return -1;
+		}
 		memset(&test_flash_area[param - flash_vars_start], 0xff, 0x1000);
 #else
 		GLOBAL_INT_DISABLE();
@@ -495,33 +459,48 @@ int flash_vars_erase(unsigned int off_set, unsigned int size) {
 }
 
 
+#if WINDOWS
+// selftest access to the log, simulator HAL_FlashVars_* are in hal_flashVars_win32.c
+void SIM_FlashVarsLog_SetArea(const void *image, int len) {
+	memset(test_flash_area, 0xFF, sizeof(test_flash_area));
+	memcpy(test_flash_area, image, len);
+	test_flash_opsLeft = -1;
+}
+const byte *SIM_FlashVarsLog_GetArea() {
+	return (const byte*)test_flash_area;
+}
+// power is lost after given count of flash writes and erases, -1 for never
+void SIM_FlashVarsLog_PowerLossAfter(int ops) {
+	test_flash_opsLeft = ops;
+}
+// reads vars again like after reboot
+const FLASH_VARS_STRUCTURE *SIM_FlashVarsLog_Boot() {
+	flash_vars_initialised = 0;
+	flash_vars_init();
+	return &flash_vars;
+}
+int SIM_FlashVarsLog_SaveBootCount(int bootCount) {
+	flash_vars.boot_count = bootCount;
+	return flash_vars_save(offsetof(FLASH_VARS_STRUCTURE, boot_count), sizeof(flash_vars.boot_count));
+}
+#else
 
 //#define DISABLE_FLASH_VARS_VARS
 
 
+#define FLASH_VARS_SAVED_VALUE(i) ((int)offsetof(FLASH_VARS_STRUCTURE, savedValues) + (i) * (int)sizeof(short))
+
 // call at startup
 void HAL_FlashVars_IncreaseBootCount() {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
 	flash_vars_init();
 	flash_vars.boot_count++;
 	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Boot Count %d #######", flash_vars.boot_count);
-	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
+	flash_vars_save(offsetof(FLASH_VARS_STRUCTURE, boot_count), sizeof(flash_vars.boot_count));
 #endif
 }
 void HAL_FlashVars_SaveChannel(int index, int value) {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
-
 	if (index < 0 || index >= MAX_RETAIN_CHANNELS) {
 		ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Can't Save Channel %d as %d (not enough space in array) #######", index, value);
 		return;
@@ -530,14 +509,35 @@ void HAL_FlashVars_SaveChannel(int index, int value) {
 	flash_vars_init();
 	flash_vars.savedValues[index] = value;
 	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Channel %d as %d #######", index, value);
-	flash_vars_write();
+	flash_vars_save(FLASH_VARS_SAVED_VALUE(index), sizeof(short));
+#endif
+}
+void HAL_FlashVars_SaveChannels(const int* indices, const int* values, int count) {
+#ifndef DISABLE_FLASH_VARS_VARS
+	int i, first, last;
 
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
+	flash_vars_init();
+	first = MAX_RETAIN_CHANNELS;
+	last = -1;
+	for (i = 0; i < count; i++) {
+		if (indices[i] < 0 || indices[i] >= MAX_RETAIN_CHANNELS) {
+			ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Can't Save Channel %d as %d (not enough space in array) #######", indices[i], values[i]);
+			continue;
+		}
+		flash_vars.savedValues[indices[i]] = values[i];
+		if (indices[i] < first) {
+			first = indices[i];
+		}
+		if (indices[i] > last) {
+			last = indices[i];
+		}
+	}
+	if (last < 0) {
+		return;
+	}
+	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save %d Channels #######", count);
+	// one record spanning all of them
+	flash_vars_save(FLASH_VARS_SAVED_VALUE(first), (last - first + 1) * sizeof(short));
 #endif
 }
 void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, byte* rgb, byte* bEnableAll) {
@@ -559,8 +559,8 @@ void HAL_FlashVars_ReadLED(byte* mode, short* brightness, short* temperature, by
 
 void HAL_FlashVars_SaveLED(byte mode, short brightness, short temperature, byte r, byte g, byte b, byte bEnableAll) {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
 	int iChangesCount = 0;
+	int iColorChanges = 0;
 
 
 	flash_vars_init();
@@ -568,20 +568,18 @@ void HAL_FlashVars_SaveLED(byte mode, short brightness, short temperature, byte
 	SAVE_CHANGE_IF_REQUIRED_AND_COUNT(flash_vars.savedValues[MAX_RETAIN_CHANNELS - 2], temperature, iChangesCount);
 	SAVE_CHANGE_IF_REQUIRED_AND_COUNT(flash_vars.savedValues[MAX_RETAIN_CHANNELS - 3], mode, iChangesCount);
 	SAVE_CHANGE_IF_REQUIRED_AND_COUNT(flash_vars.savedValues[MAX_RETAIN_CHANNELS - 4], bEnableAll, iChangesCount);
-	SAVE_CHANGE_IF_REQUIRED_AND_COUNT(flash_vars.rgb[0], r, iChangesCount);
-	SAVE_CHANGE_IF_REQUIRED_AND_COUNT(flash_vars.rgb[1], g, iChangesCount);
-	SAVE_CHANGE_IF_REQUIRED_AND_COUNT(flash_vars.rgb[2], b, iChangesCount);
+	SAVE_CHANGE_IF_REQUIRED_AND_COUNT(flash_vars.rgb[0], r, iColorChanges);
+	SAVE_CHANGE_IF_REQUIRED_AND_COUNT(flash_vars.rgb[1], g, iColorChanges);
+	SAVE_CHANGE_IF_REQUIRED_AND_COUNT(flash_vars.rgb[2], b, iColorChanges);
 
-	if (iChangesCount > 0) {
+	if (iChangesCount > 0 || iColorChanges > 0) {
 		ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save LED #######");
-		flash_vars_write();
-
-		flash_vars_read(&data);
-		ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-			flash_vars_offset,
-			data.boot_count,
-			data.boot_success_count,
-			data.boot_count - data.boot_success_count);
+	}
+	if (iChangesCount > 0) {
+		flash_vars_save(FLASH_VARS_SAVED_VALUE(MAX_RETAIN_CHANNELS - 4), 4 * sizeof(short));
+	}
+	if (iColorChanges > 0) {
+		flash_vars_save(offsetof(FLASH_VARS_STRUCTURE, rgb), sizeof(flash_vars.rgb));
 	}
 #endif
 }
@@ -593,38 +591,21 @@ short HAL_FlashVars_ReadUsage() {
 }
 void HAL_FlashVars_SaveTotalUsage(short usage) {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
-
-
 	flash_vars_init();
 	flash_vars.savedValues[MAX_RETAIN_CHANNELS - 1] = usage;
 	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Flash Save Usage #######");
-	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
+	flash_vars_save(FLASH_VARS_SAVED_VALUE(MAX_RETAIN_CHANNELS - 1), sizeof(short));
 #endif
 }
 // call once started (>30s?)
 void HAL_FlashVars_SaveBootComplete() {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE data;
 	// mark that we have completed a boot.
 	ADDLOG_INFO(LOG_FEATURE_CFG, "####### Set Boot Complete #######");
 
+	flash_vars_init();
 	flash_vars.boot_success_count = flash_vars.boot_count;
-	flash_vars_write();
-
-	flash_vars_read(&data);
-	ADDLOG_DEBUG(LOG_FEATURE_CFG, "re-read - offset %d, boot count %d, boot success %d, bootfailures %d",
-		flash_vars_offset,
-		data.boot_count,
-		data.boot_success_count,
-		data.boot_count - data.boot_success_count);
+	flash_vars_save(offsetof(FLASH_VARS_STRUCTURE, boot_success_count), sizeof(flash_vars.boot_success_count));
 #endif
 }
 
@@ -666,13 +647,11 @@ int HAL_GetEnergyMeterStatus(ENERGY_METERING_DATA* data)
 int HAL_SetEnergyMeterStatus(ENERGY_METERING_DATA* data)
 {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE tmp;
-	// mark that we have completed a boot.
 	if (data != NULL)
 	{
+		flash_vars_init();
 		memcpy(&flash_vars.emetering, data, sizeof(ENERGY_METERING_DATA));
-		flash_vars_write();
-		flash_vars_read(&tmp);
+		flash_vars_save(offsetof(FLASH_VARS_STRUCTURE, emetering), sizeof(ENERGY_METERING_DATA));
 	}
 #endif
 	return 0;
@@ -701,17 +680,16 @@ float HAL_FlashVars_GetEnergyExport()
 void HAL_FlashVars_SaveEnergy(ENERGY_DATA** data, int channel_count)
 {
 #ifndef DISABLE_FLASH_VARS_VARS
-	FLASH_VARS_STRUCTURE tmp;
 	if (data != NULL)
 	{
+		flash_vars_init();
 		uintptr_t base =  (uintptr_t) &flash_vars.emetering;
 		for(int i =0 ; i < channel_count; i++){
 			int offset =( i * sizeof(ENERGY_DATA));
 			uintptr_t flash_addr = base + offset ;
 			memcpy((void *)flash_addr, data[i], sizeof(ENERGY_DATA));
 		}
-		flash_vars_write();
-		flash_vars_read(&tmp);
+		flash_vars_save(offsetof(FLASH_VARS_STRUCTURE, emetering), channel_count * sizeof(ENERGY_DATA));
 	}
 #endif
 }
@@ -735,3 +713,4 @@ void HAL_FlashVars_GetEnergy(ENERGY_DATA* data, ENERGY_CHANNEL channel)
 
 #endif
 
+#endif
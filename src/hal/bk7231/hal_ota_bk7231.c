@@ -1,22 +1,81 @@
 #include "../hal_ota.h"
 
 #include "../../new_common.h"
+#include "../../logging/logging.h"
+#if WINDOWS
+// Simulator builds only the OTA writer, on RAM area, for selftests.
+// Area starts at START_ADR_OF_BK_PARTITION_OTA.
+#define TEST_OTA_AREA_SIZE 0x10000
+static byte test_ota_area[TEST_OTA_AREA_SIZE];
+static int test_ota_erases = 0;
+static int test_ota_yields = 0;
+
+#define CMD_FLASH_WRITE_ENABLE 0
+#define CMD_FLASH_ERASE_SECTOR 1
+#define flash_init()
+#define flash_protection_op(mode, type)
+#undef rtos_delay_milliseconds
+#define rtos_delay_milliseconds(ms) test_ota_yields++
+
+static unsigned int test_ota_offset(unsigned int address, unsigned int count) {
+	unsigned int ofs = address - START_ADR_OF_BK_PARTITION_OTA;
+
+	if (address < START_ADR_OF_BK_PARTITION_OTA || ofs + count > TEST_OTA_AREA_SIZE) {
+		return TEST_OTA_AREA_SIZE;
+	}
+	return ofs;
+}
+static unsigned int flash_write(char *user_buf, unsigned int count, unsigned int address) {
+	unsigned int i, ofs = test_ota_offset(address, count);
+
+	if (ofs == TEST_OTA_AREA_SIZE)
+		return 1;
+	// like flash, write only clears bits
+	for (i = 0; i < count; i++) {
+		test_ota_area[ofs + i] &= user_buf[i];
+	}
+	return 0;
+}
+static unsigned int flash_ctrl(unsigned int cmd, void *parm) {
+	unsigned int ofs;
+
+	if (cmd == CMD_FLASH_ERASE_SECTOR) {
+		ofs = test_ota_offset(*(unsigned int *)parm, 0x1000);
+		if (ofs == TEST_OTA_AREA_SIZE)
+			return 1;
+		memset(test_ota_area + ofs, 0xFF, 0x1000);
+		test_ota_erases++;
+	}
+	return 0;
+}
+#else
 #include "../../new_cfg.h"
 #include "typedef.h"
 #include "flash_pub.h"
 //#include "flash.h"
-#include "../../logging/logging.h"
 #include "../../httpclient/http_client.h"
 #include "../../httpserver/new_http.h"
 #include "../../driver/drv_public.h"
 #include "../../driver/drv_bl_shared.h"
 #include "../../driver/drv_hlw8112.h"
+#endif
 
 static unsigned char *sector = (void *)0;
-int sectorlen = 0;
-unsigned int addr = 0xff000;
+static int sectorlen = 0;
+static unsigned int addr = 0xff000;
 #define SECTOR_SIZE 0x1000
+// Socket reads and sector erase block anyway, so OTA does not sleep per
+// chunk. It only yields once every few sectors, so idle task can free
+// memory of ended tasks.
+#define OTA_SECTORS_PER_YIELD 4
+static int sectorsSinceYield = 0;
+// packed images are unpacked on the way to flash. Running image is not
+// in the RBL form the OTA partition takes, so there is no delta base here
+static otaUnpack_t *unpack = (void *)0;
+static unsigned int otaStartAddr = 0;
 static void store_sector(unsigned int addr, unsigned char *data);
+static int store_otadata(void *ctx, const unsigned char *data, int len);
+#if !WINDOWS
 extern void flash_protection_op(UINT8 mode,PROTECT_TYPE type);
 
 // from wlan_ui.c
@@ -33,6 +92,64 @@ int HAL_FlashRead(char*buffer, int readlen, int startaddr) {
 	return res;
 }
 
+#if ENABLE_OTA_RELAY
+// rt-ota header the OTA partition starts with. Bootloader copies image out
+// of partition, but leaves it there, so it is what this device booted
+typedef struct rblHeader_s {
+	char magic[4];
+	unsigned short algo;
+	unsigned short algo2;
+	unsigned int timestamp;
+	char name[16];
+	char version[24];
+	char sn[24];
+	unsigned int crc32;
+	unsigned int hash;
+	unsigned int size_raw;
+	unsigned int size_package;
+	unsigned int info_crc32;
+} rblHeader_t;
+#define RBL_MAX_PACKAGE 0x100000
+
+int HAL_OTA_GetRelayImage(unsigned int *outAddr, int *outLen, unsigned int *outCrc){
+	rblHeader_t hdr;
+	unsigned char buf[256];
+	unsigned int crc, pos, part, total;
+
+	if (sector){
+		// OTA is writing partition just now
+		return -1;
+	}
+	HAL_FlashRead((char *)&hdr, sizeof(hdr), START_ADR_OF_BK_PARTITION_OTA);
+	if (memcmp(hdr.magic, "RBL", 4) || hdr.size_package == 0 || hdr.size_package > RBL_MAX_PACKAGE){
+		return -1;
+	}
+	if (OTA_CRC32(0, (const unsigned char *)&hdr, sizeof(hdr) - 4) != hdr.info_crc32){
+		return -1;
+	}
+	// whole body is checked, partition may be half written by failed OTA
+	crc = 0;
+	pos = START_ADR_OF_BK_PARTITION_OTA + sizeof(hdr);
+	for (total = 0; total < hdr.size_package; total += part){
+		part = hdr.size_package - total;
+		if (part > sizeof(buf)){
+			part = sizeof(buf);
+		}
+		HAL_FlashRead((char *)buf, part, pos + total);
+		crc = OTA_CRC32(crc, buf, part);
+	}
+	if (crc != hdr.crc32){
+		addLogAdv(LOG_INFO, LOG_FEATURE_OTA, "OTA partition image fails CRC, not serving it\n");
+		return -1;
+	}
+	*outAddr = START_ADR_OF_BK_PARTITION_OTA;
+	*outLen = sizeof(hdr) + hdr.size_package;
+	*outCrc = crc;
+	return 0;
+}
+#endif
+#endif
+
 int init_ota(unsigned int startaddr){
     flash_init();
 	  flash_protection_op(FLASH_XTX_16M_SR_WRITE_ENABLE, FLASH_PROTECT_NONE);
@@ -43,7 +160,18 @@ int init_ota(unsigned int startaddr){
         }
         sector = os_malloc(SECTOR_SIZE);
         sectorlen = 0;
+        sectorsSinceYield = 0;
         addr = startaddr;
+        otaStartAddr = startaddr;
+        unpack = OTA_Unpack_Create(store_otadata, (void *)0, (void *)0);
+        if (!sector || !unpack){
+            addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"aborting OTA, no memory\n");
+            if (sector) os_free(sector);
+            sector = (void *)0;
+            OTA_Unpack_Free(unpack);
+            unpack = (void *)0;
+            return 0;
+        }
         addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"init OTA, startaddr 0x%x\n", startaddr);
         return 1;
     }
@@ -51,32 +179,50 @@ int init_ota(unsigned int startaddr){
     return 0;
 }
 
-void close_ota(){
+// returns 0 when image is complete
+int close_ota(){
+    int res = -1;
+
+    if (!sector) return -1;
     addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"\r\n");
+    if (unpack){
+        res = OTA_Unpack_Finish(unpack);
+        OTA_Unpack_Free(unpack);
+        unpack = (void *)0;
+    }
     if (sectorlen){
         addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"close OTA, additional 0x%x FF added \n", SECTOR_SIZE - sectorlen);
         memset(sector+sectorlen, 0xff, SECTOR_SIZE - sectorlen);
         sectorlen = SECTOR_SIZE;
         store_sector(addr, sector);
-        addr += 1024;
+        addr += SECTOR_SIZE;
         sectorlen = 0;
     }
     addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"close OTA, addr 0x%x\n", addr);
+    if (res != 0 && otaStartAddr){
+        // bad packed image, RBL header is erased so bootloader ignores it
+        addLogAdv(LOG_ERROR, LOG_FEATURE_OTA,"OTA image is broken, discarded\n");
+        flash_ctrl(CMD_FLASH_WRITE_ENABLE, (void *)0);
+        flash_ctrl(CMD_FLASH_ERASE_SECTOR, &otaStartAddr);
+    }
 
     os_free(sector);
     sector = (void *)0;
 	  flash_protection_op(FLASH_XTX_16M_SR_WRITE_ENABLE, FLASH_UNPROTECT_LAST_BLOCK);
+    return res;
 }
 
 void add_otadata(unsigned char *data, int len)
 {
-    if (!sector) return;
+    if (!sector || !unpack) return;
+    OTA_Unpack_Feed(unpack, data, len);
+}
+
+static int store_otadata(void *ctx, const unsigned char *data, int len)
+{
     //addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"OTA DataRxed start: %02.2x %02.2x len %d\r\n", data[0], data[1], len);
     while (len > 0)
     {
-        // force it to sleep...  we MUST have some idle task processing
-	    // else task memory doesn't get freed
-
         if (sectorlen < SECTOR_SIZE)
         {
             int lenstore = SECTOR_SIZE - sectorlen;
@@ -93,15 +239,19 @@ void add_otadata(unsigned char *data, int len)
             store_sector(addr, sector);
             addr += SECTOR_SIZE;
             sectorlen = 0;
-        } else {
-            //addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"OTA sectorlen 0x%x not yet 0x%x\n", sectorlen, SECTOR_SIZE);
-            rtos_delay_milliseconds(10);
+            // we MUST have some idle task processing
+            // else task memory doesn't get freed
+            if (++sectorsSinceYield >= OTA_SECTORS_PER_YIELD) {
+                sectorsSinceYield = 0;
+                rtos_delay_milliseconds(1);
+            }
         }
     }
+    return 0;
 }
 
 static void store_sector(unsigned int addr, unsigned char *data){
-    //if (!(addr % 0x4000))
+    if (!(addr % 0x10000))
     {
       addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"%x", addr);
     }
@@ -114,6 +264,7 @@ static void store_sector(unsigned int addr, unsigned char *data){
 }
 
 
+#if !WINDOWS
 httprequest_t httprequest;
 
 int myhttpclientcallback(httprequest_t* request){
@@ -140,7 +291,11 @@ int myhttpclientcallback(httprequest_t* request){
       }
       break;
     case 2: // ended, write any remaining bytes to the sector
-      close_ota();
+      if (close_ota() != 0){
+        OTA_ResetProgress();
+        addLogAdv(LOG_ERROR, LOG_FEATURE_OTA,"OTA failed, not rebooting");
+        break;
+      }
       OTA_ResetProgress();
       addLogAdv(LOG_INFO, LOG_FEATURE_OTA,"\r\nmyhttpclientcallback state %d total %d/%d\r\n", request->state, OTA_GetTotalBytes(), request->client_data.response_content_len);
 
@@ -149,7 +304,7 @@ int myhttpclientcallback(httprequest_t* request){
       // record this OTA
       CFG_IncrementOTACount();
       // make sure it's saved before reboot
-	  CFG_Save_IfThereArePendingChanges();
+	  CFG_Save_Compact();
 #if ENABLE_BL_SHARED
       if (DRV_IsMeasuringPower())
       {
@@ -194,6 +349,8 @@ void otarequest(const char *urlin){
   }
 
   strncpy(url, urlin, sizeof(url));
+  // new firmware may not read config journal
+  CFG_Save_Compact();
 
   OTA_SetTotalBytes(0);
   memset(request, 0, sizeof(*request));
@@ -229,8 +386,8 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 {
 	int total = 0;
 	int towrite = request->bodylen;
-	char* writebuf = request->bodystart;
-	int writelen = request->bodylen;
+	char* writebuf = NULL;
+	int writelen;
 
 	ADDLOG_DEBUG(LOG_FEATURE_OTA, "OTA post len %d", request->contentLength);
 
@@ -241,6 +398,8 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		towrite = request->contentLength;
 	}
 
+	// first part came with headers
+	writelen = http_readBody(request, &writebuf);
 	if (writelen < 0 || (startaddr + writelen > maxaddr))
 	{
 		ADDLOG_DEBUG(LOG_FEATURE_OTA, "ABORTED: %d bytes to write", writelen);
@@ -256,15 +415,17 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		towrite -= writelen;
 		if (towrite > 0)
 		{
-			writebuf = request->received;
-			writelen = recv(request->fd, writebuf, request->receivedLenmax, 0);
+			writelen = http_readBody(request, &writebuf);
 			if (writelen < 0)
 			{
 				ADDLOG_DEBUG(LOG_FEATURE_OTA, "recv returned %d - end of data - remaining %d", writelen, towrite);
 			}
 		}
-	} while ((towrite > 0) && (writelen >= 0));
-	close_ota();
+	} while ((towrite > 0) && (writelen > 0));
+	if (close_ota() != 0)
+	{
+		return http_rest_error(request, -21, "OTA image is broken or packed for other firmware");
+	}
 	ADDLOG_DEBUG(LOG_FEATURE_OTA, "%d total bytes written", total);
 	http_setup(request, httpMimeTypeJson);
 	hprintf255(request, "{\"size\":%d}", total);
@@ -272,5 +433,20 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 	CFG_IncrementOTACount();
 	return 0;
 }
-
-
+#else
+// selftest access to the writer
+void SIM_OTA_ClearArea() {
+	memset(test_ota_area, 0xFF, sizeof(test_ota_area));
+	test_ota_erases = 0;
+	test_ota_yields = 0;
+}
+const byte *SIM_OTA_GetArea() {
+	return test_ota_area;
+}
+int SIM_OTA_GetErases() {
+	return test_ota_erases;
+}
+int SIM_OTA_GetYields() {
+	return test_ota_yields;
+}
+#endif
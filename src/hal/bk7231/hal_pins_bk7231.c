@@ -6,6 +6,7 @@
 #include "../hal_pins.h"
 //#include "../../new_pins.h"
 #include <gpio_pub.h>
+#include "include.h"
 
 #include "../../beken378/func/include/net_param_pub.h"
 #include "../../beken378/func/user_driver/BkDriverPwm.h"
@@ -163,6 +164,55 @@ void HAL_PIN_PWM_Update(int index, float value) {
 #endif
 }
 
+void HAL_PIN_PWM_UpdateDuty(int index, unsigned short duty) {
+	int pwmIndex;
+
+	pwmIndex = PIN_GetPWMIndexForPinIndex(index);
+
+	// is this pin capable of PWM?
+	if(pwmIndex == -1) {
+		return;
+	}
+	// period is in 26MHz clocks, much finer than 0-100 percent
+	uint32_t period = g_periods[pwmIndex];
+	uint32_t dutyClocks = ((unsigned long long)period * duty + 32767) / 65535;
+#if defined(PLATFORM_BK7231N) && !defined(PLATFORM_BEKEN_NEW)
+	bk_pwm_update_param(pwmIndex, period, dutyClocks,0,0);
+#else
+	bk_pwm_update_param(pwmIndex, period, dutyClocks);
+#endif
+}
+
+void HAL_PIN_PWM_UpdateGroup(const int *pins, const unsigned short *duties, int count) {
+	uint8_t pwms[6];
+	uint32_t dutyClocks[6];
+	int i, n, pwmIndex;
+	GLOBAL_INT_DECLARATION();
+
+	// clocks of all first, so only register writes are left below
+	n = 0;
+	for(i = 0; i < count && n < 6; i++) {
+		pwmIndex = PIN_GetPWMIndexForPinIndex(pins[i]);
+		if(pwmIndex == -1) {
+			continue;
+		}
+		pwms[n] = pwmIndex;
+		dutyClocks[n] = ((unsigned long long)g_periods[pwmIndex] * duties[i] + 32767) / 65535;
+		n++;
+	}
+	// new duty is taken at end of period, without interrupts between
+	// writes all channels take it at the same end
+	GLOBAL_INT_DISABLE();
+	for(i = 0; i < n; i++) {
+#if defined(PLATFORM_BK7231N) && !defined(PLATFORM_BEKEN_NEW)
+		bk_pwm_update_param(pwms[i], g_periods[pwms[i]], dutyClocks[i], 0, 0);
+#else
+		bk_pwm_update_param(pwms[i], g_periods[pwms[i]], dutyClocks[i]);
+#endif
+	}
+	GLOBAL_INT_RESTORE();
+}
+
 unsigned int HAL_GetGPIOPin(int index) {
 	return index;
 }
@@ -13,9 +13,20 @@ void test_ty_read_uart_data_to_buffer(int port, void* param)
 {
 	int rc = 0;
   int fbufindex = UART_GetBufIndexFromPort(port);
-
-	while((rc = uart_read_byte(port)) != -1)
-		UART_AppendByteToReceiveRingBufferEx(fbufindex,rc);
+  // drain FIFO into burst, ring is touched once per burst, not per byte
+  byte burst[32];
+  int len = 0;
+
+	while((rc = uart_read_byte(port)) != -1) {
+		burst[len++] = rc;
+		if (len == sizeof(burst)) {
+			UART_AppendBytesToReceiveRingBufferEx(fbufindex, burst, len);
+			len = 0;
+		}
+	}
+	if (len) {
+		UART_AppendBytesToReceiveRingBufferEx(fbufindex, burst, len);
+	}
 }
 
 int bk_port_from_portindex(int auartindex) {
@@ -457,6 +457,109 @@ void HAL_DisconnectFromWifi()
     bk_wlan_stop(STATION);
 }
 
+#ifndef PLATFORM_BEKEN_NEW
+
+// from rw_pub.h, no header
+void mhdr_scanu_reg_cb(FUNC_2PARAM_PTR ind_cb, void* ctxt);
+
+// background scan for drv_wifiRoam.c, station stays connected
+static volatile bool g_scanRunning = false;
+static volatile bool g_scanDone = false;
+
+static void HAL_WiFi_ScanDone(void* ctxt, uint8_t param)
+{
+	g_scanRunning = false;
+	g_scanDone = true;
+}
+
+int HAL_WiFi_StartScan()
+{
+	if(g_scanRunning || g_bOpenAccessPointMode)
+	{
+		return -1;
+	}
+	g_scanRunning = true;
+	g_scanDone = false;
+	mhdr_scanu_reg_cb(HAL_WiFi_ScanDone, 0);
+	bk_wlan_start_scan();
+	return 0;
+}
+
+int HAL_WiFi_GetScanResults(obkWiFiScanEntry_t* out, int max)
+{
+	ScanResult_adv apList;
+	int i, n;
+
+	if(g_scanRunning || !g_scanDone)
+	{
+		return -1;
+	}
+	g_scanDone = false;
+	memset(&apList, 0, sizeof(apList));
+	if(wlan_sta_scan_result(&apList) != 0)
+	{
+		return 0;
+	}
+	n = apList.ApNum < max ? apList.ApNum : max;
+	for(i = 0; i < n; i++)
+	{
+		memset(&out[i], 0, sizeof(obkWiFiScanEntry_t));
+		strncpy(out[i].ssid, apList.ApList[i].ssid, sizeof(out[i].ssid) - 1);
+		memcpy(out[i].bssid, apList.ApList[i].bssid, 6);
+		out[i].channel = apList.ApList[i].channel;
+		out[i].rssi = apList.ApList[i].ApPower;
+		out[i].security = apList.ApList[i].security;
+	}
+	if(apList.ApList)
+	{
+		os_free(apList.ApList);
+	}
+	return n;
+}
+
+// same way as fast connect, PMK of current link is valid for every AP of SSID
+void HAL_WiFi_ConnectToBSSID(const char* ssid, const char* key, const obkWiFiScanEntry_t* ap, obkStaticIP_t* ip)
+{
+	network_InitTypeDef_adv_st network_cfg;
+	uint8_t* psk = wpas_get_sta_psk();
+	char psks[65];
+	int i;
+
+	if(psk == 0 || ap->security <= SECURITY_TYPE_WEP)
+	{
+		HAL_ConnectToWiFi(ssid, key, ip);
+		return;
+	}
+	memset(&network_cfg, 0, sizeof(network_InitTypeDef_adv_st));
+	strcpy(network_cfg.ap_info.ssid, ssid);
+	for(i = 0; i < 32; i++)
+	{
+		sprintf(psks + i * 2, "%02x", psk[i]);
+	}
+	memcpy(network_cfg.key, psks, 64);
+	network_cfg.key_len = 64;
+	memcpy(network_cfg.ap_info.bssid, ap->bssid, 6);
+	if(ip->localIPAddr[0] == 0)
+	{
+		network_cfg.dhcp_mode = DHCP_CLIENT;
+	}
+	else
+	{
+		network_cfg.dhcp_mode = DHCP_DISABLE;
+		convert_IP_to_string(network_cfg.local_ip_addr, ip->localIPAddr);
+		convert_IP_to_string(network_cfg.net_mask, ip->netMask);
+		convert_IP_to_string(network_cfg.gateway_ip_addr, ip->gatewayIPAddr);
+		convert_IP_to_string(network_cfg.dns_server_ip_addr, ip->dnsServerIpAddr);
+	}
+	network_cfg.ap_info.channel = ap->channel;
+	network_cfg.ap_info.security = ap->security;
+	network_cfg.wifi_retry_interval = 100;
+
+	bk_wlan_start_sta_adv(&network_cfg);
+}
+
+#endif
+
 int HAL_SetupWiFiOpenAccessPoint(const char* ssid)
 {
 #define APP_DRONE_DEF_NET_IP        "192.168.4.1"
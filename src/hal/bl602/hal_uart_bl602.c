@@ -38,7 +38,6 @@ static void console_cb_read(int fd, void* param)
 {
 	char buffer[64];  /* adapt to usb cdc since usb fifo is 64 bytes */
 	int ret;
-	int i;
 
 	ret = aos_read(fd, buffer, sizeof(buffer));
 	if(ret > 0)
@@ -48,10 +47,7 @@ static void console_cb_read(int fd, void* param)
 			fd_console = fd;
 			buffer[ret] = 0;
 			addLogAdv(LOG_DEBUG, LOG_FEATURE_ENERGYMETER, "BL602 received: %s\n", buffer);
-			for(i = 0; i < ret; i++)
-			{
-				UART_AppendByteToReceiveRingBuffer(buffer[i]);
-			}
+			UART_AppendBytesToReceiveRingBuffer((const byte*)buffer, ret);
 		}
 		else
 		{
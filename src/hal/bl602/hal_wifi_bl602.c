@@ -367,4 +367,93 @@ void HAL_DisableEnhancedFastConnect()
     ef_del_env("fcdata");
 }
 
+// background scan for drv_wifiRoam.c, wifi manager keeps station connected
+static volatile bool g_scanRunning = false;
+static volatile bool g_scanDone = false;
+static obkWiFiScanEntry_t* g_scanOut;
+static int g_scanMax, g_scanCount;
+
+static void HAL_WiFi_ScanDone(void* data, void* param)
+{
+    g_scanRunning = false;
+    g_scanDone = true;
+}
+
+int HAL_WiFi_StartScan()
+{
+    if(g_scanRunning || g_bAccessPointMode)
+    {
+        return -1;
+    }
+    g_scanRunning = true;
+    g_scanDone = false;
+    if(wifi_mgmr_scan(NULL, HAL_WiFi_ScanDone) != 0)
+    {
+        g_scanRunning = false;
+        return -1;
+    }
+    return 0;
+}
+
+static void HAL_WiFi_ScanItem(wifi_mgmr_ap_item_t* env, uint32_t* param1, wifi_mgmr_ap_item_t* item)
+{
+    obkWiFiScanEntry_t* e;
+
+    if(g_scanCount >= g_scanMax)
+    {
+        return;
+    }
+    e = &g_scanOut[g_scanCount++];
+    memset(e, 0, sizeof(obkWiFiScanEntry_t));
+    strncpy(e->ssid, item->ssid, sizeof(e->ssid) - 1);
+    memcpy(e->bssid, item->bssid, 6);
+    e->channel = item->channel;
+    e->rssi = item->rssi;
+    e->security = item->auth;
+}
+
+int HAL_WiFi_GetScanResults(obkWiFiScanEntry_t* out, int max)
+{
+    wifi_mgmr_ap_item_t env;
+    uint32_t num = 0;
+
+    if(g_scanRunning || !g_scanDone)
+    {
+        return -1;
+    }
+    g_scanDone = false;
+    g_scanOut = out;
+    g_scanMax = max;
+    g_scanCount = 0;
+    wifi_mgmr_scan_ap_all(&env, &num, HAL_WiFi_ScanItem);
+    return g_scanCount;
+}
+
+void HAL_WiFi_ConnectToBSSID(const char* ssid, const char* key, const obkWiFiScanEntry_t* ap, obkStaticIP_t* ip)
+{
+    struct ap_connect_adv ext_param = { 0 };
+    wifi_interface_t wifi_interface;
+
+    if(ip->localIPAddr[0] == 0)
+    {
+        wifi_mgmr_sta_ip_unset();
+    }
+    else
+    {
+        wifi_mgmr_sta_ip_set(*(int*)ip->localIPAddr, *(int*)ip->netMask, *(int*)ip->gatewayIPAddr, *(int*)ip->dnsServerIpAddr, 0);
+    }
+    ext_param.ap_info.type = AP_INFO_TYPE_SUGGEST;
+    ext_param.ap_info.time_to_live = 30;
+    ext_param.ap_info.bssid = (uint8_t*)ap->bssid;
+    ext_param.ap_info.band = 0;
+    ext_param.ap_info.freq = phy_channel_to_freq(0, ap->channel);
+    ext_param.ap_info.use_dhcp = ip->localIPAddr[0] == 0 ? 1 : 0;
+    ext_param.flags = WIFI_CONNECT_PMF_CAPABLE | WIFI_CONNECT_STOP_SCAN_CURRENT_CHANNEL_IF_TARGET_AP_FOUND;
+
+    if(g_powersave) wifi_mgmr_sta_ps_exit();
+    wifi_mgmr_sta_disconnect();
+    wifi_interface = wifi_mgmr_sta_enable();
+    wifi_mgmr_sta_connect_ext(wifi_interface, (char*)ssid, (char*)key, &ext_param);
+}
+
 #endif // PLATFORM_BL602
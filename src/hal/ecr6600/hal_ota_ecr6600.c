@@ -23,8 +23,8 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 {
 	int total = 0;
 	int towrite = request->bodylen;
-	char* writebuf = request->bodystart;
-	int writelen = request->bodylen;
+	char* writebuf = NULL;
+	int writelen;
 
 	ADDLOG_DEBUG(LOG_FEATURE_OTA, "OTA post len %d", request->contentLength);
 
@@ -48,6 +48,9 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		goto update_ota_exit;
 	}
 
+	// first part came with headers
+	writelen = http_readBody(request, &writebuf);
+
 	do
 	{
 		if (ota_write((unsigned char*)writebuf, writelen) != 0)
@@ -62,15 +65,14 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		towrite -= writelen;
 		if (towrite > 0)
 		{
-			writebuf = request->received;
-			writelen = recv(request->fd, writebuf, request->receivedLenmax, 0);
+			writelen = http_readBody(request, &writebuf);
 			if (writelen < 0)
 			{
 				ADDLOG_DEBUG(LOG_FEATURE_OTA, "recv returned %d - end of data - remaining %d", writelen, towrite);
 				ret = -1;
 			}
 		}
-	} while ((towrite > 0) && (writelen >= 0));
+	} while ((towrite > 0) && (writelen > 0));
 
 update_ota_exit:
 	if (ret != -1)
@@ -0,0 +1,81 @@
+#if PLATFORM_ESPIDF || PLATFORM_ESP8266
+
+#include "../../obk_config.h"
+#include "../../new_common.h"
+#include "../../logging/logging.h"
+#include "../hal_assets.h"
+
+#include "esp_partition.h"
+
+// Partition table entry like "assets, data, 0x40, , 0x40000," enables it,
+// default tables have none.
+#define ASSETS_PARTITION_LABEL "assets"
+
+static const esp_partition_t* g_assetsPart = NULL;
+#if PLATFORM_ESPIDF
+static const void* g_assetsMap = NULL;
+static esp_partition_mmap_handle_t g_assetsMapHandle;
+#endif
+
+static const esp_partition_t* HAL_Assets_Partition() {
+	if (g_assetsPart == NULL) {
+		g_assetsPart = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ASSETS_PARTITION_LABEL);
+	}
+	return g_assetsPart;
+}
+
+int HAL_Assets_Open(const unsigned char** base) {
+	const esp_partition_t* part = HAL_Assets_Partition();
+
+	*base = 0;
+	if (part == NULL) {
+		return 0;
+	}
+#if PLATFORM_ESPIDF
+	// data is read through flash cache, so serving it is a pointer walk
+	if (g_assetsMap == NULL) {
+		if (esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &g_assetsMap, &g_assetsMapHandle) != ESP_OK) {
+			ADDLOG_ERROR(LOG_FEATURE_GENERAL, "Assets partition can't be mapped");
+			g_assetsMap = NULL;
+		}
+	}
+	*base = (const unsigned char*)g_assetsMap;
+#endif
+	return part->size;
+}
+
+int HAL_Assets_Read(int offset, unsigned char* buffer, int len) {
+	const esp_partition_t* part = HAL_Assets_Partition();
+
+	if (part == NULL || offset < 0 || len < 0 || offset + len > part->size) {
+		return -1;
+	}
+	return esp_partition_read(part, offset, buffer, len) == ESP_OK ? 0 : -1;
+}
+
+int HAL_Assets_Erase(int offset, int len) {
+	const esp_partition_t* part = HAL_Assets_Partition();
+
+	if (part == NULL || offset < 0 || len < 0 || offset + len > part->size) {
+		return -1;
+	}
+#if PLATFORM_ESPIDF
+	// mapping is made again once image is complete
+	if (g_assetsMap != NULL) {
+		esp_partition_munmap(g_assetsMapHandle);
+		g_assetsMap = NULL;
+	}
+#endif
+	return esp_partition_erase_range(part, offset, len) == ESP_OK ? 0 : -1;
+}
+
+int HAL_Assets_Write(int offset, const unsigned char* data, int len) {
+	const esp_partition_t* part = HAL_Assets_Partition();
+
+	if (part == NULL || offset < 0 || len < 0 || offset + len > part->size) {
+		return -1;
+	}
+	return esp_partition_write(part, offset, data, len) == ESP_OK ? 0 : -1;
+}
+
+#endif
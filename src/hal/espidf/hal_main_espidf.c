@@ -36,6 +36,41 @@ void temp_func(void* pvParameters)
 
 #endif
 
+#if PLATFORM_ESPIDF
+// Threads are matched by start of name. WiFi and lwIP tasks run on core 0,
+// MQTT runs in lwIP thread, so servers stay there too. QuickTick (pins,
+// LED refresh and transitions), UART events of metering and sensor
+// drivers and DMX frames go to other core, so network load doesn't delay them.
+static const char* const g_timingThreads[] = {
+	"quick", "uart_event_task", "DMX",
+};
+static const char* const g_netThreads[] = {
+	"HTTP", "httprequest", "TCP", "CMD_server", "Log_server", "UART_TCP", "UART TCP", "UTCP_",
+};
+
+static bool HAL_ThreadIsIn(const char* name, const char* const* list, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!strncmp(name, list[i], strlen(list[i]))) {
+			return true;
+		}
+	}
+	return false;
+}
+int HAL_GetThreadCore(const char* name) {
+#if !CONFIG_FREERTOS_UNICORE
+	if (OBK_TIMING_CORE >= 0 && HAL_ThreadIsIn(name, g_timingThreads, sizeof(g_timingThreads) / sizeof(g_timingThreads[0]))) {
+		return OBK_TIMING_CORE;
+	}
+	if (OBK_NET_CORE >= 0 && HAL_ThreadIsIn(name, g_netThreads, sizeof(g_netThreads) / sizeof(g_netThreads[0]))) {
+		return OBK_NET_CORE;
+	}
+#endif
+	return tskNO_AFFINITY;
+}
+#endif
+
 void app_main(void)
 {
     esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
@@ -44,7 +79,7 @@ void app_main(void)
 #if !CONFIG_IDF_TARGET_ESP32 && !PLATFORM_ESP8266
     temperature_sensor_config_t temp_sensor_config = TEMPERATURE_SENSOR_CONFIG_DEFAULT(-10, 80);
     temperature_sensor_install(&temp_sensor_config, &temp_handle);
-    xTaskCreate(temp_func, "IntTemp", TEMP_STACK_SIZE, NULL, 16, NULL);
+    rtos_create_thread(NULL, 16, "IntTemp", temp_func, TEMP_STACK_SIZE, NULL);
 #endif
 
 #if PLATFORM_ESP8266
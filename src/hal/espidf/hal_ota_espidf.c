@@ -5,6 +5,7 @@
 #include "../../new_cfg.h"
 #include "../../httpserver/new_http.h"
 #include "../../logging/logging.h"
+#include "../hal_ota.h"
 
 #include "esp_system.h"
 #include "esp_ota_ops.h"
@@ -14,11 +15,11 @@
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "esp_wifi.h"
+#include "esp_image_format.h"
 #if PLATFORM_ESPIDF
 #include "esp_flash.h"
 #include "esp_pm.h"
 #else
-#include "esp_image_format.h"
 #include "spi_flash.h"
 #define esp_flash_read(a,b,c,d) spi_flash_read(c,b,d)
 #define OTA_WITH_SEQUENTIAL_WRITES OTA_SIZE_UNKNOWN
@@ -26,67 +27,91 @@
 #endif
 
 
+// unpacked image goes here, update is begun on its first bytes
+typedef struct espOta_s {
+	const esp_partition_t* running;
+	const esp_partition_t* update;
+	esp_ota_handle_t handle;
+	bool bBegun;
+} espOta_t;
+
+static int ESP_OTA_Write(void* ctx, const unsigned char* data, int len)
+{
+	espOta_t* ota = (espOta_t*)ctx;
+	esp_err_t err;
+
+	if (ota->bBegun == false)
+	{
+		esp_app_desc_t new_app_info;
+		if (len > sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t))
+		{
+			memcpy(&new_app_info, &data[sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t)], sizeof(esp_app_desc_t));
+			ADDLOG_DEBUG(LOG_FEATURE_OTA, "New firmware version: %s", new_app_info.version);
+
+			esp_app_desc_t running_app_info;
+			if (esp_ota_get_partition_description(ota->running, &running_app_info) == ESP_OK)
+			{
+				ADDLOG_DEBUG(LOG_FEATURE_OTA, "Running firmware version: %s", running_app_info.version);
+			}
+		}
+		err = esp_ota_begin(ota->update, OTA_WITH_SEQUENTIAL_WRITES, &ota->handle);
+		if (err != ESP_OK)
+		{
+			ADDLOG_ERROR(LOG_FEATURE_OTA, "esp_ota_begin failed (%s)", esp_err_to_name(err));
+			return -1;
+		}
+		ota->bBegun = true;
+		ADDLOG_DEBUG(LOG_FEATURE_OTA, "esp_ota_begin succeeded");
+	}
+	err = esp_ota_write(ota->handle, (const void*)data, len);
+	return err == ESP_OK ? 0 : -1;
+}
+
+// delta images are made against running image
+static int ESP_OTA_ReadBase(void* ctx, unsigned char* out, int len, unsigned int offset)
+{
+	espOta_t* ota = (espOta_t*)ctx;
+
+	if (offset + len > ota->running->size)
+	{
+		return -1;
+	}
+	return esp_partition_read(ota->running, offset, out, len) == ESP_OK ? 0 : -1;
+}
+
 int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 {
 	int total = 0;
 	int towrite = request->bodylen;
 	char* writebuf = request->bodystart;
 	int writelen = request->bodylen;
+	espOta_t ota;
+	otaUnpack_t* unpack;
 
 	ADDLOG_DEBUG(LOG_FEATURE_OTA, "OTA post len %d", request->contentLength);
 
 	ADDLOG_DEBUG(LOG_FEATURE_OTA, "Ota start!\r\n");
 	esp_err_t err;
-	esp_ota_handle_t update_handle = 0;
-	const esp_partition_t* update_partition = NULL;
-	const esp_partition_t* running = esp_ota_get_running_partition();
-	update_partition = esp_ota_get_next_update_partition(NULL);
+	memset(&ota, 0, sizeof(ota));
+	ota.running = esp_ota_get_running_partition();
+	ota.update = esp_ota_get_next_update_partition(NULL);
 	if (request->contentLength >= 0)
 	{
 		towrite = request->contentLength;
 	}
+	unpack = OTA_Unpack_Create(ESP_OTA_Write, ESP_OTA_ReadBase, &ota);
+	if (unpack == NULL)
+	{
+		return http_rest_error(request, -1, "no memory");
+	}
 
 	esp_wifi_set_ps(WIFI_PS_NONE);
-	bool image_header_was_checked = false;
 	do
 	{
-		if (image_header_was_checked == false)
+		if (OTA_Unpack_Feed(unpack, (const unsigned char*)writebuf, writelen) != 0)
 		{
-			esp_app_desc_t new_app_info;
-			if (towrite > sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t))
-			{
-				memcpy(&new_app_info, &writebuf[sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t)], sizeof(esp_app_desc_t));
-				ADDLOG_DEBUG(LOG_FEATURE_OTA, "New firmware version: %s", new_app_info.version);
-
-				esp_app_desc_t running_app_info;
-				if (esp_ota_get_partition_description(running, &running_app_info) == ESP_OK)
-				{
-					ADDLOG_DEBUG(LOG_FEATURE_OTA, "Running firmware version: %s", running_app_info.version);
-				}
-
-				image_header_was_checked = true;
-
-				err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
-				if (err != ESP_OK)
-				{
-					ADDLOG_ERROR(LOG_FEATURE_OTA, "esp_ota_begin failed (%s)", esp_err_to_name(err));
-					esp_ota_abort(update_handle);
-					return -1;
-				}
-				ADDLOG_DEBUG(LOG_FEATURE_OTA, "esp_ota_begin succeeded");
-			}
-			else
-			{
-				ADDLOG_ERROR(LOG_FEATURE_OTA, "received package is not fit len");
-				esp_ota_abort(update_handle);
-				return -1;
-			}
-		}
-		err = esp_ota_write(update_handle, (const void*)writebuf, writelen);
-		if (err != ESP_OK)
-		{
-			esp_ota_abort(update_handle);
-			return -1;
+			ADDLOG_ERROR(LOG_FEATURE_OTA, "OTA write failed at %i", total);
+			break;
 		}
 
 		ADDLOG_DEBUG(LOG_FEATURE_OTA, "Writelen %i at %i", writelen, total);
@@ -105,9 +130,21 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		}
 	} while ((towrite > 0) && (writelen >= 0));
 
+	// length and CRC of packed image are checked before update is ended
+	if (OTA_Unpack_Finish(unpack) != 0 || ota.bBegun == false)
+	{
+		OTA_Unpack_Free(unpack);
+		if (ota.bBegun)
+		{
+			esp_ota_abort(ota.handle);
+		}
+		return -1;
+	}
+	OTA_Unpack_Free(unpack);
+
 	ADDLOG_INFO(LOG_FEATURE_OTA, "OTA in progress: 100%%, total Write binary data length: %d", total);
 
-	err = esp_ota_end(update_handle);
+	err = esp_ota_end(ota.handle);
 	if (err != ESP_OK)
 	{
 		if (err == ESP_ERR_OTA_VALIDATE_FAILED)
@@ -120,7 +157,7 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		}
 		return -1;
 	}
-	err = esp_ota_set_boot_partition(update_partition);
+	err = esp_ota_set_boot_partition(ota.update);
 	if (err != ESP_OK)
 	{
 		ADDLOG_ERROR(LOG_FEATURE_OTA, "esp_ota_set_boot_partition failed (%s)!", esp_err_to_name(err));
@@ -142,5 +179,47 @@ int HAL_FlashRead(char*buffer, int readlen, int startaddr) {
 	return res;
 }
 
+#if ENABLE_OTA_RELAY
+// running app is served, it is a plain image esp_ota_write takes
+int HAL_OTA_GetRelayImage(unsigned int* addr, int* len, unsigned int* crc)
+{
+	const esp_partition_t* running = esp_ota_get_running_partition();
+	esp_partition_pos_t pos;
+	esp_image_metadata_t data;
+	unsigned char buf[256];
+	unsigned int c, total, part;
+
+	if (running == NULL)
+	{
+		return -1;
+	}
+	pos.offset = running->address;
+	pos.size = running->size;
+	memset(&data, 0, sizeof(data));
+	if (esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &pos, &data) != ESP_OK || data.image_len == 0)
+	{
+		return -1;
+	}
+	c = 0;
+	for (total = 0; total < data.image_len; total += part)
+	{
+		part = data.image_len - total;
+		if (part > sizeof(buf))
+		{
+			part = sizeof(buf);
+		}
+		if (esp_partition_read(running, total, buf, part) != ESP_OK)
+		{
+			return -1;
+		}
+		c = OTA_CRC32(c, buf, part);
+	}
+	*addr = running->address;
+	*len = data.image_len;
+	*crc = c;
+	return 0;
+}
+#endif
+
 #endif
 
@@ -372,6 +372,55 @@ int HAL_PIN_ReadDigitalInput(int index)
 	return gpio_get_level(pin->pin);
 }
 
+#if PLATFORM_ESPIDF
+#include "soc/gpio_reg.h"
+
+// GPIO_IN/OUT registers hold whole bank, second bank is there on chips
+// with more than 32 GPIOs
+uint64_t HAL_PIN_ReadAll()
+{
+	uint64_t levels, res = 0;
+	int i;
+
+	levels = REG_READ(GPIO_IN_REG);
+#ifdef GPIO_IN1_REG
+	levels |= (uint64_t)REG_READ(GPIO_IN1_REG) << 32;
+#endif
+	for(i = 0; i < g_numPins && i < 64; i++)
+	{
+		if(g_pins[i].pin != GPIO_NUM_NC && (levels >> g_pins[i].pin) & 1)
+		{
+			res |= 1ULL << i;
+		}
+	}
+	return res;
+}
+
+void HAL_PIN_WriteMasked(uint64_t mask, uint64_t values)
+{
+	uint64_t set = 0, clear = 0, bit;
+	int i;
+
+	for(i = 0; i < g_numPins && i < 64; i++)
+	{
+		if((mask & (1ULL << i)) == 0 || g_pins[i].pin == GPIO_NUM_NC)
+			continue;
+		bit = 1ULL << g_pins[i].pin;
+		if(values & (1ULL << i))
+			set |= bit;
+		else
+			clear |= bit;
+	}
+	// set and clear registers leave other pins alone
+	REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t)set);
+	REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)clear);
+#ifdef GPIO_OUT1_W1TS_REG
+	REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t)(set >> 32));
+	REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(clear >> 32));
+#endif
+}
+#endif
+
 void ESP_ConfigurePin(gpio_num_t pin, gpio_mode_t mode, bool pup, bool pdown, gpio_int_type_t intr)
 {
 	gpio_config_t conf = {};
@@ -448,11 +497,59 @@ void HAL_PIN_Setup_Output(int index)
 	gpio_set_level(pin->pin, 0);
 }
 
+#if PLATFORM_ESP8266
+#define GPIO_MODE_OPEN_DRAIN GPIO_MODE_OUTPUT_OD
+#else
+#define GPIO_MODE_OPEN_DRAIN GPIO_MODE_INPUT_OUTPUT_OD
+#endif
+
+int HAL_PIN_Setup_OpenDrain(int index)
+{
+	if(index >= g_numPins)
+		return 0;
+	espPinMapping_t* pin = g_pins + index;
+	if(pin->pin == GPIO_NUM_NC) return 0;
+	// released first, so line is not pulled low by old output level
+	gpio_set_level(pin->pin, 1);
+	if(!pin->isConfigured)
+	{
+		pin->isConfigured = true;
+		ESP_ConfigurePin(pin->pin, GPIO_MODE_OPEN_DRAIN, true, false, GPIO_INTR_DISABLE);
+		return 1;
+	}
+	gpio_set_direction(pin->pin, GPIO_MODE_OPEN_DRAIN);
+	gpio_set_pull_mode(pin->pin, GPIO_PULLUP_ONLY);
+	return 1;
+}
+
 #if PLATFORM_ESPIDF || PLATFORM_ESP8266
 
 static ledc_channel_config_t ledc_channel[LEDC_MAX_CH];
 static float obk_ch_value[LEDC_MAX_CH];
 static bool g_ledc_init = false;
+#if PLATFORM_ESPIDF
+static bool g_ledc_fadeInstalled = false;
+// time when hardware fade of channel ends
+static unsigned int g_ledc_fadeEnd[LEDC_MAX_CH];
+
+// true if fade of channel still runs, it is stopped where chip can
+static bool LEDC_EndFade(int ch)
+{
+	unsigned int now = (unsigned int)(esp_timer_get_time() / 1000);
+
+	if((int)(g_ledc_fadeEnd[ch] - now) <= 0)
+	{
+		return false;
+	}
+#if SOC_LEDC_SUPPORT_FADE_STOP
+	ledc_fade_stop(LEDC_LOW_SPEED_MODE, ch);
+	g_ledc_fadeEnd[ch] = now;
+	return false;
+#else
+	return true;
+#endif
+}
+#endif
 
 void InitLEDC()
 {
@@ -588,6 +685,9 @@ void HAL_PIN_PWM_Update(int index, float value)
 #endif
 		if(value != obk_ch_value[ch]) 
 		{ 
+#if PLATFORM_ESPIDF
+			LEDC_EndFade(ch);
+#endif
 			obk_ch_value[ch] = value;
 			ledc_set_duty(LEDC_LOW_SPEED_MODE, ch, propduty);
 			ledc_update_duty(LEDC_LOW_SPEED_MODE, ch);
@@ -603,6 +703,85 @@ void HAL_PIN_PWM_Update(int index, float value)
 	}
 }
 
+// all duties are set first, then updated back to back, so channels of
+// shared timer take them on same period
+void HAL_PIN_PWM_UpdateGroup(const int *pins, const unsigned short *duties, int count)
+{
+	int chs[LEDC_MAX_CH];
+	float values[LEDC_MAX_CH];
+	int i, n, ch;
+
+	n = 0;
+	for(i = 0; i < count && n < LEDC_MAX_CH; i++)
+	{
+		if(pins[i] >= g_numPins)
+			continue;
+		ch = GetLedcChannelForPin(g_pins[pins[i]].pin);
+		if(ch < 0)
+			continue;
+		values[n] = duties[i] * (100.0f / 65535.0f);
+		if(values[n] == obk_ch_value[ch])
+			continue;
+#if PLATFORM_ESPIDF
+		LEDC_EndFade(ch);
+#endif
+		obk_ch_value[ch] = values[n];
+#if PLATFORM_ESPIDF
+		ledc_set_duty(LEDC_LOW_SPEED_MODE, ch, values[n] * 81.91);
+#else
+		ledc_set_duty(LEDC_LOW_SPEED_MODE, ch, values[n] * 81.96);
+#endif
+		chs[n++] = ch;
+	}
+	for(i = 0; i < n; i++)
+	{
+		ledc_update_duty(LEDC_LOW_SPEED_MODE, chs[i]);
+	}
+	for(i = 0; i < n; i++)
+	{
+		if(values[i] == 100.0f)
+		{
+			ledc_stop(LEDC_LOW_SPEED_MODE, chs[i], 1);
+		}
+		else if(values[i] <= 0.01f)
+		{
+			ledc_stop(LEDC_LOW_SPEED_MODE, chs[i], 0);
+		}
+	}
+}
+
+#if PLATFORM_ESPIDF
+int HAL_PIN_PWM_FadeTo(int index, float value, int ms)
+{
+	if(index >= g_numPins)
+		return 0;
+	espPinMapping_t* pin = g_pins + index;
+	int ch = GetLedcChannelForPin(pin->pin);
+	if(ch < 0)
+		return 0;
+	if(!g_ledc_fadeInstalled)
+	{
+		if(ledc_fade_func_install(0) != ESP_OK)
+			return 0;
+		g_ledc_fadeInstalled = true;
+	}
+	// new fade would wait for old one to end
+	if(LEDC_EndFade(ch))
+		return 0;
+	if(value < 0)
+		value = 0;
+	if(value > 100)
+		value = 100;
+	if(ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, ch, value * 81.91, ms) != ESP_OK)
+		return 0;
+	if(ledc_fade_start(LEDC_LOW_SPEED_MODE, ch, LEDC_FADE_NO_WAIT) != ESP_OK)
+		return 0;
+	obk_ch_value[ch] = value;
+	g_ledc_fadeEnd[ch] = (unsigned int)(esp_timer_get_time() / 1000) + ms;
+	return 1;
+}
+#endif
+
 #endif
 
 unsigned int HAL_GetGPIOPin(int index)
@@ -631,13 +810,19 @@ void HAL_AttachInterrupt(int pinIndex, OBKInterruptType mode, OBKInterruptHandle
 	}
 	espPinMapping_t* esp_cf = g_pins + pinIndex;
 	int esp_mode;
-	if (mode == INTERRUPT_RISING) {
-		esp_mode = GPIO_INTR_POSEDGE;
+	if (mode == INTERRUPT_CHANGE) {
+		// pin is already set up by its role, keep its pull resistors
+		gpio_set_intr_type(esp_cf->pin, GPIO_INTR_ANYEDGE);
 	}
 	else {
-		esp_mode = GPIO_INTR_NEGEDGE;
+		if (mode == INTERRUPT_RISING) {
+			esp_mode = GPIO_INTR_POSEDGE;
+		}
+		else {
+			esp_mode = GPIO_INTR_NEGEDGE;
+		}
+		ESP_ConfigurePin(esp_cf->pin, GPIO_MODE_INPUT, true, false, esp_mode);
 	}
-	ESP_ConfigurePin(esp_cf->pin, GPIO_MODE_INPUT, true, false, esp_mode);
 	gpio_isr_handler_add(esp_cf->pin, ESP_Interrupt, (void*)pinIndex);
 }
 void HAL_DetachInterrupt(int pinIndex) {
@@ -652,4 +837,76 @@ void HAL_DetachInterrupt(int pinIndex) {
 	g_handlers[pinIndex] = 0;
 }
 
+#if PLATFORM_ESPIDF
+#include "soc/soc_caps.h"
+#endif
+#if PLATFORM_ESPIDF && SOC_PCNT_SUPPORTED
+#include "driver/pulse_cnt.h"
+
+// PCNT units are few, pins beyond them fall back to interrupt
+#define PCNT_HIGH_LIMIT		30000
+
+static pcnt_unit_handle_t g_pcntUnits[PLATFORM_GPIO_MAX];
+static pcnt_channel_handle_t g_pcntChannels[PLATFORM_GPIO_MAX];
+
+int HAL_PIN_Counter_Start(int pinIndex, OBKInterruptType mode) {
+	pcnt_unit_config_t unitCfg = {
+		.low_limit = -1,
+		.high_limit = PCNT_HIGH_LIMIT,
+		// overflows at watch point are added up by driver
+		.flags.accum_count = 1,
+	};
+	pcnt_chan_config_t chanCfg = {
+		.edge_gpio_num = g_pins[pinIndex].pin,
+		.level_gpio_num = -1,
+	};
+	pcnt_unit_handle_t unit = 0;
+	pcnt_channel_handle_t chan = 0;
+	pcnt_channel_edge_action_t rising, falling;
+
+	if (g_pcntUnits[pinIndex]) {
+		HAL_PIN_Counter_Stop(pinIndex);
+	}
+	if (pcnt_new_unit(&unitCfg, &unit) != ESP_OK) {
+		return 0;
+	}
+	if (pcnt_new_channel(unit, &chanCfg, &chan) != ESP_OK) {
+		pcnt_del_unit(unit);
+		return 0;
+	}
+	rising = mode == INTERRUPT_FALLING ? PCNT_CHANNEL_EDGE_ACTION_HOLD : PCNT_CHANNEL_EDGE_ACTION_INCREASE;
+	falling = mode == INTERRUPT_RISING ? PCNT_CHANNEL_EDGE_ACTION_HOLD : PCNT_CHANNEL_EDGE_ACTION_INCREASE;
+	pcnt_channel_set_edge_action(chan, rising, falling);
+	pcnt_unit_add_watch_point(unit, PCNT_HIGH_LIMIT);
+	gpio_set_pull_mode(g_pins[pinIndex].pin, GPIO_PULLUP_ONLY);
+	pcnt_unit_enable(unit);
+	pcnt_unit_clear_count(unit);
+	pcnt_unit_start(unit);
+	g_pcntUnits[pinIndex] = unit;
+	g_pcntChannels[pinIndex] = chan;
+	return 1;
+}
+void HAL_PIN_Counter_Stop(int pinIndex) {
+	pcnt_unit_handle_t unit = g_pcntUnits[pinIndex];
+
+	if (unit == 0) {
+		return;
+	}
+	pcnt_unit_stop(unit);
+	pcnt_unit_disable(unit);
+	pcnt_del_channel(g_pcntChannels[pinIndex]);
+	pcnt_del_unit(unit);
+	g_pcntUnits[pinIndex] = 0;
+	g_pcntChannels[pinIndex] = 0;
+}
+unsigned int HAL_PIN_Counter_Read(int pinIndex) {
+	int value = 0;
+
+	if (g_pcntUnits[pinIndex]) {
+		pcnt_unit_get_count(g_pcntUnits[pinIndex], &value);
+	}
+	return (unsigned int)value;
+}
+#endif
+
 #endif // PLATFORM_ESPIDF
@@ -6,6 +6,7 @@
 #include "../../cmnds/cmd_public.h"
 #include "../../cmnds/cmd_local.h"
 #include "../../logging/logging.h"
+#include "../hal_generic.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
 
@@ -39,10 +40,7 @@ static void uart_event_task(void* pvParameters)
 			{
 			case UART_DATA:
 				uart_read_bytes(uartnum, data, event.size, portMAX_DELAY);
-				for (int i = 0; i < event.size; i++)
-				{
-					UART_AppendByteToReceiveRingBuffer(data[i]);
-				}
+				UART_AppendBytesToReceiveRingBuffer(data, event.size);
 				break;
 			case UART_BUFFER_FULL:
 			case UART_FIFO_OVF:
@@ -88,12 +86,9 @@ static void uart_event_task(void* pvParameters)
 	while (1)
 	{
 		int len = uart_read_bytes(uartnum, data, 512, 20 / portTICK_RATE_MS);
-		if (len)
+		if (len > 0)
 		{
-			for (int i = 0; i < len; i++)
-			{
-				UART_AppendByteToReceiveRingBuffer(data[i]);
-			}
+			UART_AppendBytesToReceiveRingBuffer(data, len);
 		}
 	}
 }
@@ -111,6 +106,27 @@ void HAL_SetBaud(uint32_t baud)
 {
 	uart_set_baudrate(uartnum, baud);
 }
+#if PLATFORM_ESPIDF
+bool HAL_UART_SendBreak(int breakUs, int mabUs)
+{
+	// inverted idle line is low
+	uart_set_line_inverse(uartnum, UART_SIGNAL_TXD_INV);
+	HAL_Delay_us(breakUs);
+	uart_set_line_inverse(uartnum, UART_SIGNAL_INV_DISABLE);
+	HAL_Delay_us(mabUs);
+	return true;
+}
+// driver is installed with 4096 bytes TX ring buffer, TX FIFO empty
+// interrupt feeds it to line
+bool HAL_UART_SendBytesAsync(const byte* data, int len)
+{
+	return uart_write_bytes(uartnum, data, len) == len;
+}
+bool HAL_UART_IsTxDone(void)
+{
+	return uart_wait_tx_done(uartnum, 0) == ESP_OK;
+}
+#endif
 int HAL_UART_Init(int baud, int parity, bool hwflowc, int txOverride, int rxOverride)
 {
 	if (CFG_HasFlag(OBK_FLAG_USE_SECONDARY_UART))
@@ -168,7 +184,7 @@ int HAL_UART_Init(int baud, int parity, bool hwflowc, int txOverride, int rxOver
 #else
 	//uart_isr_register(uartnum, uart_intr_handle, &uartnum);
 #endif
-	xTaskCreate(uart_event_task, "uart_event_task", 1024, NULL, 16, NULL);
+	rtos_create_thread(NULL, 16, "uart_event_task", uart_event_task, 1024, NULL);
 	return 1;
 }
 
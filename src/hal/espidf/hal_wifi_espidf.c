@@ -40,6 +40,8 @@ static tcpip_adapter_if_t ap_netif = TCPIP_ADAPTER_IF_AP;
 static void (*g_wifiStatusCallback)(int code);
 static int g_bOpenAccessPointMode = 0;
 static esp_netif_ip_info_t g_ip_info;
+static volatile bool g_scanRunning = false;
+static volatile bool g_scanDone = false;
 esp_event_handler_instance_t instance_any_id, instance_got_ip;
 bool handlers_registered = false;
 
@@ -164,6 +166,11 @@ void event_handler(void* arg, esp_event_base_t event_base,
 			g_wifiStatusCallback(WIFI_STA_CONNECTED);
 		}
 	}
+	else if(event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE)
+	{
+		g_scanRunning = false;
+		g_scanDone = true;
+	}
 	else if(event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STACONNECTED)
 	{
 		if(g_wifiStatusCallback != NULL)
@@ -216,6 +223,8 @@ void HAL_ConnectToWiFi(const char* oob_ssid, const char* connect_key, obkStaticI
 		strncpy((char*)wifi_config.sta.ssid, (char*)oob_ssid, 32);
 		strncpy((char*)wifi_config.sta.password, (char*)connect_key, 64);
 	}
+	// roaming may have left it locked to one AP
+	wifi_config.sta.bssid_set = false;
 #if CONFIG_ESP8266_WIFI_ENABLE_WPA3_SAE
 	wifi_config.pmf_cfg.capable = true;
 #endif
@@ -232,6 +241,75 @@ void HAL_DisconnectFromWifi()
 	esp_wifi_disconnect();
 }
 
+// background scan for drv_wifiRoam.c, short dwell so station
+// doesn't lose traffic while off its channel
+int HAL_WiFi_StartScan()
+{
+	wifi_scan_config_t cfg;
+
+	if(g_scanRunning || g_bOpenAccessPointMode)
+	{
+		return -1;
+	}
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+	cfg.scan_time.active.min = 30;
+	cfg.scan_time.active.max = 60;
+	g_scanRunning = true;
+	g_scanDone = false;
+	if(esp_wifi_scan_start(&cfg, false) != ESP_OK)
+	{
+		g_scanRunning = false;
+		return -1;
+	}
+	return 0;
+}
+
+int HAL_WiFi_GetScanResults(obkWiFiScanEntry_t* out, int max)
+{
+	wifi_ap_record_t* recs;
+	uint16_t i, n = max;
+
+	if(g_scanRunning || !g_scanDone)
+	{
+		return -1;
+	}
+	g_scanDone = false;
+	recs = (wifi_ap_record_t*)malloc(n * sizeof(wifi_ap_record_t));
+	if(recs == NULL)
+	{
+		return 0;
+	}
+	if(esp_wifi_scan_get_ap_records(&n, recs) != ESP_OK)
+	{
+		n = 0;
+	}
+	for(i = 0; i < n; i++)
+	{
+		memset(&out[i], 0, sizeof(obkWiFiScanEntry_t));
+		strncpy(out[i].ssid, (char*)recs[i].ssid, sizeof(out[i].ssid) - 1);
+		memcpy(out[i].bssid, recs[i].bssid, 6);
+		out[i].channel = recs[i].primary;
+		out[i].rssi = recs[i].rssi;
+		out[i].security = recs[i].authmode;
+	}
+	free(recs);
+	return n;
+}
+
+void HAL_WiFi_ConnectToBSSID(const char* ssid, const char* key, const obkWiFiScanEntry_t* ap, obkStaticIP_t* ip)
+{
+	wifi_config_t wifi_config;
+
+	esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+	memcpy(wifi_config.sta.bssid, ap->bssid, 6);
+	wifi_config.sta.bssid_set = true;
+	wifi_config.sta.channel = ap->channel;
+	esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+	esp_wifi_disconnect();
+	esp_wifi_connect();
+}
+
 int HAL_SetupWiFiOpenAccessPoint(const char* ssid)
 {
 	g_bOpenAccessPointMode = 1;
@@ -14,3 +14,17 @@ int __attribute__((weak)) HAL_ADC_Read(int pinNumber)
 {
 	return 0;
 }
+
+int __attribute__((weak)) HAL_ADC_ReadBurst(int pinNumber, unsigned short *out, int count)
+{
+	int i, v;
+
+	for (i = 0; i < count; i++) {
+		v = HAL_ADC_Read(pinNumber);
+		if (v < 0) {
+			break;
+		}
+		out[i] = v;
+	}
+	return i;
+}
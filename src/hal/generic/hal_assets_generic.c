@@ -0,0 +1,20 @@
+#include "../../obk_config.h"
+#include "../../new_common.h"
+#include "../hal_assets.h"
+
+int __attribute__((weak)) HAL_Assets_Open(const unsigned char** base) {
+	*base = 0;
+	return 0;
+}
+
+int __attribute__((weak)) HAL_Assets_Read(int offset, unsigned char* buffer, int len) {
+	return -1;
+}
+
+int __attribute__((weak)) HAL_Assets_Erase(int offset, int len) {
+	return -1;
+}
+
+int __attribute__((weak)) HAL_Assets_Write(int offset, const unsigned char* data, int len) {
+	return -1;
+}
@@ -9,3 +9,18 @@ int __attribute__((weak)) HAL_Configuration_SaveConfigMemory(void* src, int data
 {
 	return 0;
 }
+
+int __attribute__((weak)) HAL_Configuration_GetJournalSize(int dataLen)
+{
+	return 0;
+}
+
+int __attribute__((weak)) HAL_Configuration_ReadJournal(void* target, int offset, int len)
+{
+	return -1;
+}
+
+int __attribute__((weak)) HAL_Configuration_WriteJournal(const void* src, int offset, int len)
+{
+	return -1;
+}
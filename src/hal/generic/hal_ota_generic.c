@@ -11,6 +11,10 @@ int __attribute__((weak)) HAL_FlashRead(char*buffer, int readlen, int startaddr)
 	return res;
 }
 
+int __attribute__((weak)) HAL_OTA_GetRelayImage(unsigned int* addr, int* len, unsigned int* crc) {
+	return -1;
+}
+
 int __attribute__((weak)) http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 {
 	int total = 0;
@@ -36,3 +40,312 @@ int __attribute__((weak)) http_rest_post_flash(http_request_t* request, int star
 update_ota_exit:
 	return 0;
 }
+
+// Packed image header, all little endian:
+//   "OBKP", version, flags, 2 reserved bytes,
+//   output length, output CRC32, base length, base CRC32
+// then ops:
+//   0x00-0x7F  literal, tag + 1 bytes follow
+//   0x80-0xBF  (tag & 0x3F) + 3 bytes from output, 16 bit distance follows
+//   0xC0       bytes from base, varint length and zigzag varint of
+//              base offset minus output offset follow
+#define OTA_PACK_VERSION		1
+#define OTA_PACK_FLAG_DELTA		1
+#define OTA_PACK_HEADER_SIZE	24
+#define OTA_PACK_OP_BASE		0xC0
+#define OTA_UNPACK_WINDOW		4096
+// longest op is literal of 128 bytes
+#define OTA_UNPACK_PENDING		160
+
+#define OTA_UNPACK_DETECT		0
+#define OTA_UNPACK_PLAIN		1
+#define OTA_UNPACK_PACKED		2
+
+struct otaUnpack_s {
+	otaUnpackWrite_t write;
+	otaUnpackReadBase_t readBase;
+	void* ctx;
+	int mode;
+	bool bFailed;
+	unsigned char pending[OTA_UNPACK_PENDING];
+	int pendingLen;
+	// last output bytes, for copies from output
+	unsigned char* window;
+	unsigned int outPos;
+	unsigned int outLen;
+	unsigned int outCrc;
+	unsigned int baseLen;
+	unsigned int crc;
+};
+
+static const unsigned int g_crc32Nibbles[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+// same as zlib crc32, start with 0
+unsigned int OTA_CRC32(unsigned int crc, const unsigned char* data, int len) {
+	crc = ~crc;
+	while (len-- > 0) {
+		crc ^= *data++;
+		crc = (crc >> 4) ^ g_crc32Nibbles[crc & 15];
+		crc = (crc >> 4) ^ g_crc32Nibbles[crc & 15];
+	}
+	return ~crc;
+}
+static unsigned int OTA_Unpack_U32(const unsigned char* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+// returns bytes used, 0 when incomplete, -1 when too long
+static int OTA_Unpack_Varint(const unsigned char* p, int avail, unsigned int* out) {
+	unsigned int v = 0;
+	int i;
+
+	for (i = 0; i < avail; i++) {
+		if (i >= 5) {
+			return -1;
+		}
+		v |= (unsigned int)(p[i] & 0x7F) << (7 * i);
+		if ((p[i] & 0x80) == 0) {
+			*out = v;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+static int OTA_Unpack_Out(otaUnpack_t* u, const unsigned char* data, int len) {
+	int i;
+
+	if (u->outPos + len > u->outLen) {
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: output over %u bytes", u->outLen);
+		return -1;
+	}
+	for (i = 0; i < len; i++) {
+		u->window[(u->outPos + i) % OTA_UNPACK_WINDOW] = data[i];
+	}
+	u->crc = OTA_CRC32(u->crc, data, len);
+	u->outPos += len;
+	return u->write(u->ctx, data, len);
+}
+static int OTA_Unpack_CopyBase(otaUnpack_t* u, unsigned int offset, unsigned int len) {
+	unsigned char tmp[128];
+	int part;
+
+	if (u->readBase == 0 || offset + len > u->baseLen || offset + len < offset) {
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: base copy at %u out of base", offset);
+		return -1;
+	}
+	while (len > 0) {
+		part = len > sizeof(tmp) ? sizeof(tmp) : len;
+		if (u->readBase(u->ctx, tmp, part, offset) != 0 || OTA_Unpack_Out(u, tmp, part) != 0) {
+			return -1;
+		}
+		offset += part;
+		len -= part;
+	}
+	return 0;
+}
+// runs one op from p, returns bytes used, 0 when op is incomplete, -1 on error
+static int OTA_Unpack_Op(otaUnpack_t* u, const unsigned char* p, int avail) {
+	unsigned char tmp[66];
+	unsigned int len, dist, zz, start, i;
+	int tag, a, b;
+
+	if (avail < 1) {
+		return 0;
+	}
+	tag = p[0];
+	if (tag < 0x80) {
+		len = tag + 1;
+		if (avail < 1 + (int)len) {
+			return 0;
+		}
+		return OTA_Unpack_Out(u, p + 1, len) ? -1 : 1 + (int)len;
+	}
+	if (tag < OTA_PACK_OP_BASE) {
+		if (avail < 3) {
+			return 0;
+		}
+		len = (tag & 0x3F) + 3;
+		dist = p[1] | (p[2] << 8);
+		if (dist == 0 || dist > OTA_UNPACK_WINDOW || dist > u->outPos) {
+			ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: bad distance %u at %u", dist, u->outPos);
+			return -1;
+		}
+		start = u->outPos - dist;
+		// may overlap itself, then it repeats last dist bytes
+		for (i = 0; i < len; i++) {
+			tmp[i] = i < dist ? u->window[(start + i) % OTA_UNPACK_WINDOW] : tmp[i - dist];
+		}
+		return OTA_Unpack_Out(u, tmp, len) ? -1 : 3;
+	}
+	if (tag != OTA_PACK_OP_BASE) {
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: bad op 0x%02X at %u", tag, u->outPos);
+		return -1;
+	}
+	a = OTA_Unpack_Varint(p + 1, avail - 1, &len);
+	if (a <= 0) {
+		return a;
+	}
+	b = OTA_Unpack_Varint(p + 1 + a, avail - 1 - a, &zz);
+	if (b <= 0) {
+		return b;
+	}
+	// zigzag, small offset changes in both directions stay short
+	start = u->outPos + ((zz & 1) ? ~(zz >> 1) : (zz >> 1));
+	return OTA_Unpack_CopyBase(u, start, len) ? -1 : 1 + a + b;
+}
+static int OTA_Unpack_Header(otaUnpack_t* u) {
+	const unsigned char* h = u->pending;
+	unsigned int baseCrc, crc, off;
+	int part;
+
+	if (h[4] != OTA_PACK_VERSION) {
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: version %i not supported", h[4]);
+		return -1;
+	}
+	u->outLen = OTA_Unpack_U32(h + 8);
+	u->outCrc = OTA_Unpack_U32(h + 12);
+	u->baseLen = OTA_Unpack_U32(h + 16);
+	baseCrc = OTA_Unpack_U32(h + 20);
+	u->window = (unsigned char*)malloc(OTA_UNPACK_WINDOW);
+	if (u->window == 0) {
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: no memory");
+		return -1;
+	}
+	if ((h[5] & OTA_PACK_FLAG_DELTA) == 0) {
+		u->baseLen = 0;
+	}
+	else {
+		if (u->readBase == 0) {
+			ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: delta images are not supported here");
+			return -1;
+		}
+		// delta is only valid against base it was made from
+		crc = 0;
+		for (off = 0; off < u->baseLen; off += part) {
+			part = u->baseLen - off > OTA_UNPACK_WINDOW ? OTA_UNPACK_WINDOW : u->baseLen - off;
+			if (u->readBase(u->ctx, u->window, part, off) != 0) {
+				return -1;
+			}
+			crc = OTA_CRC32(crc, u->window, part);
+		}
+		if (crc != baseCrc) {
+			ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: delta is for other firmware (base CRC %08X, here %08X)", baseCrc, crc);
+			return -1;
+		}
+	}
+	ADDLOG_INFO(LOG_FEATURE_OTA, "Packed OTA: %u bytes%s", u->outLen, u->baseLen ? ", delta" : "");
+	return 0;
+}
+otaUnpack_t* OTA_Unpack_Create(otaUnpackWrite_t write, otaUnpackReadBase_t readBase, void* ctx) {
+	otaUnpack_t* u;
+
+	u = (otaUnpack_t*)malloc(sizeof(otaUnpack_t));
+	if (u == 0) {
+		return 0;
+	}
+	memset(u, 0, sizeof(*u));
+	u->write = write;
+	u->readBase = readBase;
+	u->ctx = ctx;
+	return u;
+}
+int OTA_Unpack_Feed(otaUnpack_t* u, const unsigned char* data, int len) {
+	int part, pos, r;
+
+	if (u->bFailed) {
+		return -1;
+	}
+	while (len > 0) {
+		if (u->mode == OTA_UNPACK_PLAIN) {
+			if (u->write(u->ctx, data, len) != 0) {
+				u->bFailed = true;
+				return -1;
+			}
+			return 0;
+		}
+		part = OTA_UNPACK_PENDING - u->pendingLen;
+		if (part > len) {
+			part = len;
+		}
+		memcpy(u->pending + u->pendingLen, data, part);
+		u->pendingLen += part;
+		data += part;
+		len -= part;
+		pos = 0;
+		if (u->mode == OTA_UNPACK_DETECT) {
+			if (u->pendingLen < 4) {
+				continue;
+			}
+			if (memcmp(u->pending, "OBKP", 4)) {
+				// plain image, what was held back goes first
+				u->mode = OTA_UNPACK_PLAIN;
+				r = u->pendingLen;
+				u->pendingLen = 0;
+				if (u->write(u->ctx, u->pending, r) != 0) {
+					u->bFailed = true;
+					return -1;
+				}
+				continue;
+			}
+			if (u->pendingLen < OTA_PACK_HEADER_SIZE) {
+				continue;
+			}
+			if (OTA_Unpack_Header(u) != 0) {
+				u->bFailed = true;
+				return -1;
+			}
+			u->mode = OTA_UNPACK_PACKED;
+			pos = OTA_PACK_HEADER_SIZE;
+		}
+		while ((r = OTA_Unpack_Op(u, u->pending + pos, u->pendingLen - pos)) > 0) {
+			pos += r;
+		}
+		if (r < 0) {
+			u->bFailed = true;
+			return -1;
+		}
+		u->pendingLen -= pos;
+		memmove(u->pending, u->pending + pos, u->pendingLen);
+	}
+	return 0;
+}
+int OTA_Unpack_Finish(otaUnpack_t* u) {
+	int r;
+
+	if (u->bFailed) {
+		return -1;
+	}
+	if (u->mode == OTA_UNPACK_DETECT) {
+		// image shorter than magic
+		r = u->pendingLen;
+		u->pendingLen = 0;
+		u->mode = OTA_UNPACK_PLAIN;
+		return r ? u->write(u->ctx, u->pending, r) : 0;
+	}
+	if (u->mode == OTA_UNPACK_PLAIN) {
+		return 0;
+	}
+	if (u->pendingLen || u->outPos != u->outLen) {
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: truncated, %u of %u bytes", u->outPos, u->outLen);
+		return -1;
+	}
+	if (u->crc != u->outCrc) {
+		ADDLOG_ERROR(LOG_FEATURE_OTA, "Packed OTA: CRC %08X, expected %08X", u->crc, u->outCrc);
+		return -1;
+	}
+	return 0;
+}
+int OTA_Unpack_IsPacked(otaUnpack_t* u) {
+	return u->mode == OTA_UNPACK_PACKED;
+}
+void OTA_Unpack_Free(otaUnpack_t* u) {
+	if (u == 0) {
+		return;
+	}
+	if (u->window) {
+		free(u->window);
+	}
+	free(u);
+}
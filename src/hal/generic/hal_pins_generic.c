@@ -49,6 +49,11 @@ void __attribute__((weak)) HAL_PIN_Setup_Output(int index)
 	return;
 }
 
+int __attribute__((weak)) HAL_PIN_Setup_OpenDrain(int index)
+{
+	return 0;
+}
+
 void __attribute__((weak)) HAL_PIN_PWM_Stop(int index)
 {
 	return;
@@ -64,6 +69,50 @@ void __attribute__((weak)) HAL_PIN_PWM_Update(int index, float value)
 	return;
 }
 
+// platforms that take float percent, they scale it to their own period
+void __attribute__((weak)) HAL_PIN_PWM_UpdateDuty(int index, unsigned short duty)
+{
+	HAL_PIN_PWM_Update(index, duty * (100.0f / 65535.0f));
+}
+
+void __attribute__((weak)) HAL_PIN_PWM_UpdateGroup(const int *pins, const unsigned short *duties, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		HAL_PIN_PWM_UpdateDuty(pins[i], duties[i]);
+	}
+}
+
+int __attribute__((weak)) HAL_PIN_PWM_FadeTo(int index, float value, int ms)
+{
+	return 0;
+}
+
+uint64_t __attribute__((weak)) HAL_PIN_ReadAll()
+{
+	uint64_t res = 0;
+	int i;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX && i < 64; i++) {
+		if (HAL_PIN_ReadDigitalInput(i)) {
+			res |= 1ULL << i;
+		}
+	}
+	return res;
+}
+
+void __attribute__((weak)) HAL_PIN_WriteMasked(uint64_t mask, uint64_t values)
+{
+	int i;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX && i < 64; i++) {
+		if (mask & (1ULL << i)) {
+			HAL_PIN_SetOutputValue(i, (values >> i) & 1);
+		}
+	}
+}
+
 unsigned int __attribute__((weak)) HAL_GetGPIOPin(int index)
 {
 	return index;
@@ -77,3 +126,18 @@ void __attribute__((weak)) HAL_DetachInterrupt(int pinIndex)
 {
 
 }
+
+int __attribute__((weak)) HAL_PIN_Counter_Start(int pinIndex, OBKInterruptType mode)
+{
+	return 0;
+}
+
+void __attribute__((weak)) HAL_PIN_Counter_Stop(int pinIndex)
+{
+
+}
+
+unsigned int __attribute__((weak)) HAL_PIN_Counter_Read(int pinIndex)
+{
+	return 0;
+}
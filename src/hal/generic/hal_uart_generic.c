@@ -14,5 +14,16 @@ void __attribute__((weak)) HAL_UART_Flush()
 void __attribute__((weak)) HAL_SetBaud(unsigned int baud)
 {
 }
-
+bool __attribute__((weak)) HAL_UART_SendBreak(int breakUs, int mabUs)
+{
+	return false;
+}
+bool __attribute__((weak)) HAL_UART_SendBytesAsync(const byte* data, int len)
+{
+	return false;
+}
+bool __attribute__((weak)) HAL_UART_IsTxDone(void)
+{
+	return false;
+}
 
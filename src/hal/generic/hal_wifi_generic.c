@@ -86,3 +86,18 @@ int __attribute__((weak)) HAL_SetupWiFiOpenAccessPoint(const char* ssid)
 	ADDLOG_ERROR(LOG_FEATURE_GENERAL, "Generic %s called", __func__);
 	return 0;
 }
+
+int __attribute__((weak)) HAL_WiFi_StartScan()
+{
+	return -1;
+}
+
+int __attribute__((weak)) HAL_WiFi_GetScanResults(obkWiFiScanEntry_t* out, int max)
+{
+	return -1;
+}
+
+void __attribute__((weak)) HAL_WiFi_ConnectToBSSID(const char* ssid, const char* key, const obkWiFiScanEntry_t* ap, obkStaticIP_t* ip)
+{
+	HAL_ConnectToWiFi(ssid, key, ip);
+}
@@ -1,5 +1,8 @@
 void HAL_ADC_Init(int pinNumber);
 int HAL_ADC_Read(int pinNumber);
+// Up to count raw samples taken back to back, in one conversion run where
+// hardware can do it. Returns how many, 0 on error.
+int HAL_ADC_ReadBurst(int pinNumber, unsigned short *out, int count);
 void HAL_ADC_Deinit(int pinNumber);
 #if defined(PLATFORM_W800)  || defined(PLATFORM_W600)
 float HAL_ADC_Temp(void);
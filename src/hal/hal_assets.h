@@ -0,0 +1,19 @@
+#ifndef __HAL_ASSETS_H__
+#define __HAL_ASSETS_H__
+
+// Read-only asset partition, its format is in src/assets/obk_assets.c.
+
+/// @brief Finds asset partition. When it is directly addressable (XIP,
+/// memory mapped) *base points at it, else *base is NULL and it is read
+/// by HAL_Assets_Read. Returns partition size, 0 when there is none.
+int HAL_Assets_Open(const unsigned char** base);
+/// @brief Reads from asset partition, returns 0 on success
+int HAL_Assets_Read(int offset, unsigned char* buffer, int len);
+/// @brief Erases sectors in given range, returns 0 on success
+int HAL_Assets_Erase(int offset, int len);
+/// @brief Writes to erased part of asset partition, returns 0 on success
+int HAL_Assets_Write(int offset, const unsigned char* data, int len);
+/// @brief Sector size, erase works on whole sectors
+#define HAL_ASSETS_SECTOR_SIZE 0x1000
+
+#endif /* __HAL_ASSETS_H__ */
@@ -10,3 +10,9 @@ int beken_hal_flash_read(const unsigned int addr, void *dst, const unsigned int
 
 int HAL_Configuration_ReadConfigMemory(void *target, int dataLen);
 int HAL_Configuration_SaveConfigMemory(void *src, int dataLen);
+// room for small changes after saved config, it is erased by next save.
+// Returns its size, 0 when platform can only save whole config.
+// Offsets are from start of journal, 0 is returned on success.
+int HAL_Configuration_GetJournalSize(int dataLen);
+int HAL_Configuration_ReadJournal(void *target, int offset, int len);
+int HAL_Configuration_WriteJournal(const void *src, int offset, int len);
@@ -4,3 +4,14 @@ void HAL_Delay_us(int delay);
 void HAL_Configure_WDT();
 void HAL_Run_WDT();
 void HAL_RegisterPlatformSpecificCommands();
+#if PLATFORM_ESPIDF
+// core for thread of given name, tskNO_AFFINITY when it may run on any
+int HAL_GetThreadCore(const char* name);
+#endif
+#ifdef WINDOWS
+// sockets that end wait of headless main loop, see hal_main_win32.c
+void HAL_NetLoop_Watch(int fd);
+void HAL_NetLoop_Unwatch(int fd);
+// sleeps up to ms, returns early when watched socket has data
+void HAL_NetLoop_Wait(int ms);
+#endif
@@ -42,5 +42,35 @@ void OTA_SetTotalBytes(int value);
 
 int HAL_FlashRead(char*buffer, int readlen, int startaddr);
 
+/***** Packed OTA images, made by scripts/ota_pack.py ******/
+
+// Packed image is compressed, and can be a delta against a base image
+// (normally the running one). Plain images pass through unchanged, so
+// OTA code can feed every upload through the unpacker.
+typedef struct otaUnpack_s otaUnpack_t;
+// both return 0 on success
+typedef int (*otaUnpackWrite_t)(void* ctx, const unsigned char* data, int len);
+typedef int (*otaUnpackReadBase_t)(void* ctx, unsigned char* out, int len, unsigned int offset);
+
+/// @brief Create unpacker. readBase can be NULL, delta images are refused then.
+otaUnpack_t* OTA_Unpack_Create(otaUnpackWrite_t write, otaUnpackReadBase_t readBase, void* ctx);
+/// @brief Feed next piece of uploaded image, returns -1 on error
+int OTA_Unpack_Feed(otaUnpack_t* u, const unsigned char* data, int len);
+/// @brief Checks length and CRC of unpacked image, 0 when image may be committed
+int OTA_Unpack_Finish(otaUnpack_t* u);
+/// @brief True when image turned out to be packed
+int OTA_Unpack_IsPacked(otaUnpack_t* u);
+void OTA_Unpack_Free(otaUnpack_t* u);
+unsigned int OTA_CRC32(unsigned int crc, const unsigned char* data, int len);
+
+/***** Serving firmware to peers ******/
+
+/// @brief Finds firmware image this device can serve to peers, in form its
+/// OTA takes. Returns 0 and flash address, length and CRC32 of image, or -1
+/// when there is no verified image.
+int HAL_OTA_GetRelayImage(unsigned int* addr, int* len, unsigned int* crc);
+void OTA_SetRelayEnabled(int bEnabled);
+int OTA_IsRelayEnabled();
+
 #endif /* __OTA_H__ */
 
@@ -2,17 +2,38 @@
 #ifndef __HAL_OBK_PINS_H__
 #define __HAL_OBK_PINS_H__
 
+#include <stdint.h>
+
 void HAL_PIN_SetOutputValue(int index, int iVal);
 int HAL_PIN_ReadDigitalInput(int index);
 void HAL_PIN_Setup_Input_Pulldown(int index);
 void HAL_PIN_Setup_Input_Pullup(int index);
 void HAL_PIN_Setup_Input(int index);
 void HAL_PIN_Setup_Output(int index);
+// Pin only pulls low, high is released to pullup and level can be read
+// back, as I2C needs. Returns 0 when pin can't do it.
+int HAL_PIN_Setup_OpenDrain(int index);
 void HAL_PIN_PWM_Stop(int index);
 void HAL_PIN_PWM_Start(int index, int freq);
 // Value range is 0 to 100, value is clamped
 void HAL_PIN_PWM_Update(int index, float value);
+// Duty 0 to 65535 for 0 to 100%, platform keeps as many bits as its PWM has
+void HAL_PIN_PWM_UpdateDuty(int index, unsigned short duty);
+// Duties of count pins, all registers are loaded first and then latched
+// together where hardware allows, so colors and complementary outputs
+// change on same PWM period
+void HAL_PIN_PWM_UpdateGroup(const int *pins, const unsigned short *duties, int count);
+// PWM hardware ramps duty to value (0 to 100) in ms, without CPU.
+// Returns 0 when pin can't fade so, caller updates duty itself then.
+// HAL_PIN_PWM_Update ends fade that is still running.
+int HAL_PIN_PWM_FadeTo(int index, float value, int ms);
 int HAL_PIN_CanThisPinBePWM(int index);
+// Whole bank access, bit N is pin index N. Returns levels of all pins,
+// bits of pins that can't be read are 0
+uint64_t HAL_PIN_ReadAll();
+// Sets pins in mask to their bits of values, at once where hardware allows,
+// so relays switch together
+void HAL_PIN_WriteMasked(uint64_t mask, uint64_t values);
 const char* HAL_PIN_GetPinNameAlias(int index);
 // Translate name like RB5 for OBK pin index
 int HAL_PIN_Find(const char *name);
@@ -27,6 +48,12 @@ typedef enum {
 } OBKInterruptType;
 void HAL_AttachInterrupt(int pinIndex, OBKInterruptType mode, OBKInterruptHandler function);
 void HAL_DetachInterrupt(int pinIndex);
+// Hardware pulse counter, counts given edges without interrupts.
+// Start returns 0 when pin can't be counted so, interrupt is used then.
+int HAL_PIN_Counter_Start(int pinIndex, OBKInterruptType mode);
+void HAL_PIN_Counter_Stop(int pinIndex);
+// pulses since start, wraps at 32 bits
+unsigned int HAL_PIN_Counter_Read(int pinIndex);
 
 /// @brief Get the actual GPIO pin for the pin index.
 /// @param index 
@@ -13,4 +13,14 @@ int HAL_UART_InitEx(int auartindex, int baud, int parity, bool hwflowc, int txOv
 void HAL_UART_SendByte(byte b);
 
 int HAL_UART_Init(int baud, int parity, bool hwflowc, int txOverride, int rxOverride);
-#endif
\ No newline at end of file
+#endif
+
+// For protocols that send frames from their own thread, like DMX512.
+// All return false where platform can't do it, then caller falls back
+// to HAL_UART_SendByte.
+// holds TX low for breakUs, then high for mabUs
+bool HAL_UART_SendBreak(int breakUs, int mabUs);
+// queues whole buffer for interrupt driven sending and returns at once
+bool HAL_UART_SendBytesAsync(const byte* data, int len);
+// true when previous bytes have left the line
+bool HAL_UART_IsTxDone(void);
@@ -41,6 +41,14 @@ typedef struct
 #endif
 } obkFastConnectData_t;
 
+typedef struct obkWiFiScanEntry_s {
+	char ssid[33];
+	unsigned char bssid[6];
+	unsigned char channel;
+	signed char rssi;
+	unsigned char security;
+} obkWiFiScanEntry_t;
+
 int HAL_SetupWiFiOpenAccessPoint(const char* ssid);
 void HAL_ConnectToWiFi(const char* oob_ssid, const char* connect_key, obkStaticIP_t *ip);
 void HAL_FastConnectToWiFi(const char* oob_ssid, const char* connect_key, obkStaticIP_t* ip);
@@ -67,5 +75,13 @@ void WiFI_GetMacAddress(char* mac);
 int WiFI_SetMacAddress(char* mac);
 void HAL_PrintNetworkInfo();
 int HAL_GetWifiStrength();
+// Scan that doesn't block and keeps station connected, see drv_wifiRoam.c.
+// Returns 0 when started, -1 when platform has none or scan already runs.
+int HAL_WiFi_StartScan();
+// -1 while scan runs or when none was done, otherwise fills up to max
+// entries of last scan and returns their count, only once per scan
+int HAL_WiFi_GetScanResults(obkWiFiScanEntry_t* out, int max);
+// joins given AP of SSID, for roaming between APs of one network
+void HAL_WiFi_ConnectToBSSID(const char* ssid, const char* key, const obkWiFiScanEntry_t* ap, obkStaticIP_t* ip);
 
 #endif
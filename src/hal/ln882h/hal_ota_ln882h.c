@@ -231,8 +231,8 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 {
 	int total = 0;
 	int towrite = request->bodylen;
-	char* writebuf = request->bodystart;
-	int writelen = request->bodylen;
+	char* writebuf = NULL;
+	int writelen;
 
 	ADDLOG_DEBUG(LOG_FEATURE_OTA, "OTA post len %d", request->contentLength);
 
@@ -248,6 +248,9 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		towrite = request->contentLength;
 	}
 
+	// first part came with headers
+	writelen = http_readBody(request, &writebuf);
+
 	do
 	{
 		//ADDLOG_DEBUG(LOG_FEATURE_OTA, "%d bytes to write", writelen);
@@ -265,14 +268,13 @@ int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr)
 		towrite -= writelen;
 		if (towrite > 0)
 		{
-			writebuf = request->received;
-			writelen = recv(request->fd, writebuf, request->receivedLenmax, 0);
+			writelen = http_readBody(request, &writebuf);
 			if (writelen < 0)
 			{
 				ADDLOG_DEBUG(LOG_FEATURE_OTA, "recv returned %d - end of data - remaining %d", writelen, towrite);
 			}
 		}
-	} while ((towrite > 0) && (writelen >= 0));
+	} while ((towrite > 0) && (writelen > 0));
 
 	ota_persistent_finish();
 	is_ready_to_verify = LN_TRUE;
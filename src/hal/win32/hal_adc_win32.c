@@ -8,6 +8,16 @@ void HAL_ADC_Deinit(int pinNumber)
 
 }
 
+int HAL_ADC_ReadBurst(int pinNumber, unsigned short *out, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		out[i] = HAL_ADC_Read(pinNumber);
+	}
+	return i;
+}
+
 
 #endif // WINDOWS
 
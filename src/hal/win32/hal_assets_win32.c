@@ -0,0 +1,55 @@
+#ifdef WINDOWS
+
+#include "../../obk_config.h"
+#include "../../new_common.h"
+#include "../hal_assets.h"
+#include "flash_pub.h"
+
+// free simulated flash between LFS and config
+#define SIM_ASSETS_START	0x1B3000
+#define SIM_ASSETS_LEN		0x2E000
+
+extern byte *g_flash;
+void allocFlashIfNeeded();
+
+// simulated flash is in RAM, so it is handed out as mapped
+int HAL_Assets_Open(const unsigned char** base) {
+	allocFlashIfNeeded();
+	*base = g_flash + SIM_ASSETS_START;
+	return SIM_ASSETS_LEN;
+}
+
+int HAL_Assets_Read(int offset, unsigned char* buffer, int len) {
+	if (offset < 0 || len < 0 || offset + len > SIM_ASSETS_LEN) {
+		return -1;
+	}
+	flash_read((char*)buffer, len, SIM_ASSETS_START + offset);
+	return 0;
+}
+
+int HAL_Assets_Erase(int offset, int len) {
+	byte erased[256];
+	int part;
+
+	if (offset < 0 || len < 0 || offset + len > SIM_ASSETS_LEN) {
+		return -1;
+	}
+	memset(erased, 0xFF, sizeof(erased));
+	while (len > 0) {
+		part = len > sizeof(erased) ? sizeof(erased) : len;
+		flash_write((char*)erased, part, SIM_ASSETS_START + offset);
+		offset += part;
+		len -= part;
+	}
+	return 0;
+}
+
+int HAL_Assets_Write(int offset, const unsigned char* data, int len) {
+	if (offset < 0 || len < 0 || offset + len > SIM_ASSETS_LEN) {
+		return -1;
+	}
+	flash_write((char*)data, len, SIM_ASSETS_START + offset);
+	return 0;
+}
+
+#endif
@@ -5,6 +5,8 @@
 
 // TODO
 #define MY_ADDR_OF_BK_PARTITION_NET_PARAM 0x1e1000
+// like on Beken, config is alone in one sector
+#define MY_LEN_OF_BK_PARTITION_NET_PARAM 0x1000
 
 int HAL_Configuration_ReadConfigMemory(void *target, int dataLen){
 	//FILE *f;
@@ -37,11 +39,39 @@ int HAL_Configuration_SaveConfigMemory(void *src, int dataLen){
 	//	fclose(f);
 	//}
 
+	byte erased[64];
+	int pos;
+
 	flash_write(src, dataLen, MY_ADDR_OF_BK_PARTITION_NET_PARAM);
+	// rest of sector is erased, as on real flash
+	memset(erased, 0xFF, sizeof(erased));
+	for (pos = dataLen; pos < MY_LEN_OF_BK_PARTITION_NET_PARAM; pos += sizeof(erased)) {
+		flash_write(erased, MIN(sizeof(erased), MY_LEN_OF_BK_PARTITION_NET_PARAM - pos), MY_ADDR_OF_BK_PARTITION_NET_PARAM + pos);
+	}
 
     return dataLen;
 }
 
+static int g_journalStart = 0;
+
+int HAL_Configuration_GetJournalSize(int dataLen) {
+	g_journalStart = dataLen;
+	if (dataLen >= MY_LEN_OF_BK_PARTITION_NET_PARAM) {
+		return 0;
+	}
+	return MY_LEN_OF_BK_PARTITION_NET_PARAM - dataLen;
+}
+
+int HAL_Configuration_ReadJournal(void *target, int offset, int len) {
+	flash_read(target, len, MY_ADDR_OF_BK_PARTITION_NET_PARAM + g_journalStart + offset);
+	return 0;
+}
+
+int HAL_Configuration_WriteJournal(const void *src, int offset, int len) {
+	flash_write((char*)src, len, MY_ADDR_OF_BK_PARTITION_NET_PARAM + g_journalStart + offset);
+	return 0;
+}
+
 
 
 
@@ -4,30 +4,108 @@
 #include "../hal_flashVars.h"
 #include "../../logging/logging.h"
 
+// Without file (selftests, UI simulator) nothing is kept, as before.
+// Headless build given -flashVars keeps the same structure as BK7231 in
+// that file, so boot counter, retained channels, LED state and energy
+// totals survive restart of native gateway.
+static FLASH_VARS_STRUCTURE g_flashVars;
+static const char *g_flashVarsPath = 0;
+
+static void HAL_FlashVars_Store() {
+	FILE *f;
+
+	f = fopen(g_flashVarsPath, "wb");
+	if (f == 0) {
+		printf("HAL_FlashVars_Store: can't write %s\n", g_flashVarsPath);
+		return;
+	}
+	fwrite(&g_flashVars, sizeof(g_flashVars), 1, f);
+	fclose(f);
+}
+void SIM_SetFlashVarsFile(const char *path) {
+	FILE *f;
+
+	memset(&g_flashVars, 0, sizeof(g_flashVars));
+	g_flashVarsPath = path;
+	// NULL goes back to keeping nothing
+	if (path == 0) {
+		return;
+	}
+	f = fopen(path, "rb");
+	if (f != 0) {
+		if (fread(&g_flashVars, 1, sizeof(g_flashVars), f) != sizeof(g_flashVars)) {
+			memset(&g_flashVars, 0, sizeof(g_flashVars));
+		}
+		fclose(f);
+	}
+	g_flashVars.len = sizeof(g_flashVars);
+}
+
 void HAL_FlashVars_SaveBootComplete(){
+	if (g_flashVarsPath == 0) {
+		return;
+	}
+	g_flashVars.boot_success_count = g_flashVars.boot_count;
+	HAL_FlashVars_Store();
 }
 
 int HAL_FlashVars_GetBootCount(){
-	return 0;
+	return g_flashVars.boot_count;
 }
 int HAL_FlashVars_GetBootFailures(){
     int diff = 0;
 	//diff = 10;
+	if (g_flashVarsPath) {
+		diff = g_flashVars.boot_count - g_flashVars.boot_success_count;
+	}
     return diff;
 }
 void HAL_FlashVars_IncreaseBootCount(){
+	if (g_flashVarsPath == 0) {
+		return;
+	}
+	g_flashVars.boot_count++;
+	HAL_FlashVars_Store();
 }
 void HAL_FlashVars_SaveChannel(int index, int value) {
-
+	if (g_flashVarsPath == 0 || index < 0 || index >= MAX_RETAIN_CHANNELS) {
+		return;
+	}
+	if (g_flashVars.savedValues[index] != value) {
+		g_flashVars.savedValues[index] = value;
+		HAL_FlashVars_Store();
+	}
 }
 int HAL_FlashVars_GetChannelValue(int ch) {
-	return 0;
+	if (ch < 0 || ch >= MAX_RETAIN_CHANNELS) {
+		return 0;
+	}
+	return g_flashVars.savedValues[ch];
 }
 void HAL_FlashVars_SaveLED(byte mode, short brightness, short temperature, byte r, byte g, byte b, byte bEnableAll) {
-
+	if (g_flashVarsPath == 0) {
+		return;
+	}
+	g_flashVars.savedValues[MAX_RETAIN_CHANNELS - 1] = brightness;
+	g_flashVars.savedValues[MAX_RETAIN_CHANNELS - 2] = temperature;
+	g_flashVars.savedValues[MAX_RETAIN_CHANNELS - 3] = mode;
+	g_flashVars.savedValues[MAX_RETAIN_CHANNELS - 4] = bEnableAll;
+	g_flashVars.rgb[0] = r;
+	g_flashVars.rgb[1] = g;
+	g_flashVars.rgb[2] = b;
+	HAL_FlashVars_Store();
 }
 void HAL_FlashVars_ReadLED(byte *mode, short *brightness, short *temperature, byte *rgb, byte *bEnableAll) {
-
+	if (g_flashVarsPath == 0) {
+		return;
+	}
+	*bEnableAll = g_flashVars.savedValues[MAX_RETAIN_CHANNELS - 4];
+	*mode = g_flashVars.savedValues[MAX_RETAIN_CHANNELS - 3];
+	*temperature = g_flashVars.savedValues[MAX_RETAIN_CHANNELS - 2];
+	*brightness = g_flashVars.savedValues[MAX_RETAIN_CHANNELS - 1];
+	rgb[0] = g_flashVars.rgb[0];
+	rgb[1] = g_flashVars.rgb[1];
+	rgb[2] = g_flashVars.rgb[2];
 }
 
 int HAL_GetEnergyMeterStatus(ENERGY_METERING_DATA *data)
@@ -37,19 +115,33 @@ int HAL_GetEnergyMeterStatus(ENERGY_METERING_DATA *data)
     {
         memset(data, 0, sizeof(ENERGY_METERING_DATA));
         data->actual_mday = -1;
+		if (g_flashVarsPath && g_flashVars.emetering.save_counter) {
+			memcpy(data, &g_flashVars.emetering, sizeof(ENERGY_METERING_DATA));
+		}
     }
     return 0;
 }
 
 int HAL_SetEnergyMeterStatus(ENERGY_METERING_DATA *data)
 {
+	if (g_flashVarsPath && data != NULL) {
+		memcpy(&g_flashVars.emetering, data, sizeof(ENERGY_METERING_DATA));
+		// nonzero marks saved data, see HAL_GetEnergyMeterStatus
+		if (g_flashVars.emetering.save_counter == 0) {
+			g_flashVars.emetering.save_counter = 1;
+		}
+		HAL_FlashVars_Store();
+	}
     return 0;
 }
 
 void HAL_FlashVars_SaveTotalConsumption(float total_consumption)
 {
+	if (g_flashVarsPath == 0) {
+		return;
+	}
+	g_flashVars.emetering.TotalConsumption = total_consumption;
+	HAL_FlashVars_Store();
 }
 
 #endif // WINDOWS
-
-
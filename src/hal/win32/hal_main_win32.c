@@ -1,4 +1,63 @@
 #ifdef WINDOWS
 
+#include "../../new_common.h"
+#include "../hal_generic.h"
 
-#endif // WINDOWS
\ No newline at end of file
+#ifdef LINUX
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+// Main loop of headless build sleeps here between frames. HTTP server
+// (its own epoll set), MQTT and other sockets are watched, so frame runs
+// as soon as one of them has data instead of after whole sleep.
+static int g_netLoopFd = -1;
+
+static void HAL_NetLoop_Open() {
+	if (g_netLoopFd < 0) {
+		g_netLoopFd = epoll_create1(EPOLL_CLOEXEC);
+	}
+}
+void HAL_NetLoop_Watch(int fd) {
+	struct epoll_event ev;
+
+	HAL_NetLoop_Open();
+	if (g_netLoopFd < 0 || fd < 0) {
+		return;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(g_netLoopFd, EPOLL_CTL_ADD, fd, &ev);
+}
+void HAL_NetLoop_Unwatch(int fd) {
+	if (g_netLoopFd < 0 || fd < 0) {
+		return;
+	}
+	epoll_ctl(g_netLoopFd, EPOLL_CTL_DEL, fd, NULL);
+}
+void HAL_NetLoop_Wait(int ms) {
+	struct epoll_event ev[8];
+
+	HAL_NetLoop_Open();
+	if (g_netLoopFd < 0) {
+		usleep(ms * 1000);
+		return;
+	}
+	// level triggered, sockets are read by their owners in next frame
+	epoll_wait(g_netLoopFd, ev, 8, ms);
+}
+
+#else
+
+void HAL_NetLoop_Watch(int fd) {
+}
+void HAL_NetLoop_Unwatch(int fd) {
+}
+void HAL_NetLoop_Wait(int ms) {
+	Sleep(ms);
+}
+
+#endif
+
+#endif // WINDOWS
@@ -5,6 +5,15 @@
 #include "../../logging/logging.h"
 #include "../hal_pins.h"
 
+#ifdef LINUX
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+// fcntl.h of win32 stubs hides system one, flags there match Linux
+#include <fcntl.h>
+int open(const char *path, int flags, ...);
+#include <unistd.h>
+#endif
+
 typedef enum simulatedPinMode_e {
 	SIM_PIN_NONE,
 	SIM_PIN_OUTPUT,
@@ -16,16 +25,103 @@ typedef enum simulatedPinMode_e {
 
 int g_simulatedPinStates[PLATFORM_GPIO_MAX];
 int g_simulatedPWMs[PLATFORM_GPIO_MAX];
+static int g_simulatedPWMFadeMS[PLATFORM_GPIO_MAX];
+static unsigned short g_simulatedPWMDuty[PLATFORM_GPIO_MAX];
 simulatedPinMode_t g_pinModes[PLATFORM_GPIO_MAX];
 int g_simulatedADCValues[PLATFORM_GPIO_MAX];
 
+static OBKInterruptHandler g_simInterruptHandlers[PLATFORM_GPIO_MAX];
+static OBKInterruptType g_simInterruptModes[PLATFORM_GPIO_MAX];
+static int g_simMaskedWrites = 0;
+static int g_simPWMGroupUpdates = 0;
+static int g_simPinSetups[PLATFORM_GPIO_MAX];
+static bool g_simOpenDrain = false;
+
 void SIM_Hack_ClearSimulatedPinRoles() {
+	memset(g_simInterruptHandlers, 0, sizeof(g_simInterruptHandlers));
 	memset(g_simulatedPinStates, 0, sizeof(g_simulatedPinStates));
 	memset(g_simulatedPWMs, 0, sizeof(g_simulatedPWMs));
+	memset(g_simulatedPWMFadeMS, 0, sizeof(g_simulatedPWMFadeMS));
+	memset(g_simulatedPWMDuty, 0, sizeof(g_simulatedPWMDuty));
 	memset(g_pinModes, 0, sizeof(g_pinModes));
 	memset(g_simulatedADCValues, 0, sizeof(g_simulatedADCValues));
 }
 
+#ifdef LINUX
+// Native Linux gateway drives real lines of GPIO chip given by -gpiochip
+// (for example /dev/gpiochip0), pin index is line offset. Only digital
+// in and out are real, PWM and ADC stay simulated.
+static const char *g_gpioChipPath = 0;
+static int g_gpioChipFd = -1;
+static int g_gpioLineFds[PLATFORM_GPIO_MAX];
+
+void SIM_SetGPIOChip(const char *path) {
+	int i;
+
+	g_gpioChipPath = path;
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		g_gpioLineFds[i] = -1;
+	}
+}
+static void HAL_GPIO_Release(int index) {
+	if (g_gpioChipPath && g_gpioLineFds[index] >= 0) {
+		close(g_gpioLineFds[index]);
+		g_gpioLineFds[index] = -1;
+	}
+}
+static void HAL_GPIO_Request(int index, int flags) {
+	struct gpiohandle_request req;
+
+	if (g_gpioChipPath == 0) {
+		return;
+	}
+	if (g_gpioChipFd < 0) {
+		g_gpioChipFd = open(g_gpioChipPath, O_RDWR | O_CLOEXEC);
+		if (g_gpioChipFd < 0) {
+			printf("HAL_GPIO_Request: can't open %s\n", g_gpioChipPath);
+			g_gpioChipPath = 0;
+			return;
+		}
+	}
+	HAL_GPIO_Release(index);
+	memset(&req, 0, sizeof(req));
+	req.lineoffsets[0] = index;
+	req.flags = flags;
+	req.default_values[0] = g_simulatedPinStates[index] ? 1 : 0;
+	req.lines = 1;
+	strcpy(req.consumer_label, "OpenBeken");
+	if (ioctl(g_gpioChipFd, GPIO_GET_LINEHANDLE_IOCTL, &req) < 0) {
+		printf("HAL_GPIO_Request: can't get line %i\n", index);
+		return;
+	}
+	g_gpioLineFds[index] = req.fd;
+}
+static int HAL_GPIO_Read(int index) {
+	struct gpiohandle_data data;
+
+	if (g_gpioChipPath && g_gpioLineFds[index] >= 0) {
+		memset(&data, 0, sizeof(data));
+		if (ioctl(g_gpioLineFds[index], GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) == 0) {
+			return data.values[0];
+		}
+	}
+	return g_simulatedPinStates[index];
+}
+static void HAL_GPIO_Write(int index, int iVal) {
+	struct gpiohandle_data data;
+
+	if (g_gpioChipPath && g_gpioLineFds[index] >= 0) {
+		memset(&data, 0, sizeof(data));
+		data.values[0] = iVal ? 1 : 0;
+		ioctl(g_gpioLineFds[index], GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+	}
+}
+#else
+#define HAL_GPIO_Request(index, flags)
+#define HAL_GPIO_Read(index) g_simulatedPinStates[index]
+#define HAL_GPIO_Write(index, iVal)
+#endif
+
 static int adcToGpio[] = {
 	-1,		// ADC0 - VBAT
 	4, //GPIO4,	// ADC1
@@ -57,7 +153,20 @@ int HAL_ADC_Read(int pinNumber) {
 	return g_simulatedADCValues[pinNumber];
 }
 void SIM_SetSimulatedPinValue(int pinIndex, bool bHigh) {
+	OBKInterruptType mode;
+	bool bChanged;
+
+	bChanged = g_simulatedPinStates[pinIndex] != bHigh;
 	g_simulatedPinStates[pinIndex] = bHigh;
+	// fire attached interrupt like real edge would
+	if (bChanged && g_simInterruptHandlers[pinIndex]) {
+		mode = g_simInterruptModes[pinIndex];
+		if (mode == INTERRUPT_CHANGE
+			|| (mode == INTERRUPT_RISING && bHigh)
+			|| (mode == INTERRUPT_FALLING && !bHigh)) {
+			g_simInterruptHandlers[pinIndex](pinIndex);
+		}
+	}
 }
 bool SIM_GetSimulatedPinValue(int pinIndex) {
 	return g_simulatedPinStates[pinIndex];
@@ -195,22 +304,73 @@ int HAL_PIN_CanThisPinBePWM(int index) {
 }
 void HAL_PIN_SetOutputValue(int index, int iVal) {
 	g_simulatedPinStates[index] = iVal;
+	HAL_GPIO_Write(index, iVal);
 }
 
 int HAL_PIN_ReadDigitalInput(int index) {
+	g_simulatedPinStates[index] = HAL_GPIO_Read(index);
 	return g_simulatedPinStates[index];
 }
+// real input lines with interrupt are polled once per frame, change
+// fires handler the same way as simulated edge
+void HAL_PIN_RunFrame() {
+#ifdef LINUX
+	int i;
+
+	if (g_gpioChipPath == 0) {
+		return;
+	}
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (g_gpioLineFds[i] >= 0 && g_simInterruptHandlers[i] && SIM_IsPinInput(i)) {
+			SIM_SetSimulatedPinValue(i, HAL_GPIO_Read(i));
+		}
+	}
+#endif
+}
+uint64_t HAL_PIN_ReadAll() {
+	uint64_t res = 0;
+	int i;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (g_simulatedPinStates[i]) {
+			res |= 1ULL << i;
+		}
+	}
+	return res;
+}
+void HAL_PIN_WriteMasked(uint64_t mask, uint64_t values) {
+	int i;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (mask & (1ULL << i)) {
+			g_simulatedPinStates[i] = (values >> i) & 1;
+			HAL_GPIO_Write(i, g_simulatedPinStates[i]);
+		}
+	}
+	g_simMaskedWrites++;
+}
+int SIM_GetMaskedWriteCount() {
+	return g_simMaskedWrites;
+}
 void HAL_PIN_Setup_Input_Pullup(int index) {
+	g_simPinSetups[index]++;
 	g_pinModes[index] = SIM_PIN_INPUT_PULLUP;
+	HAL_GPIO_Request(index, GPIOHANDLE_REQUEST_INPUT | GPIOHANDLE_REQUEST_BIAS_PULL_UP);
 }
 void HAL_PIN_Setup_Input_Pulldown(int index) {
+	g_simPinSetups[index]++;
+	HAL_GPIO_Request(index, GPIOHANDLE_REQUEST_INPUT | GPIOHANDLE_REQUEST_BIAS_PULL_DOWN);
 }
 void HAL_PIN_Setup_Input(int index) {
+	g_simPinSetups[index]++;
 	g_pinModes[index] = SIM_PIN_INPUT;
+	HAL_GPIO_Request(index, GPIOHANDLE_REQUEST_INPUT);
 }
 
 void HAL_PIN_Setup_Output(int index) {
+	g_simPinSetups[index]++;
 	g_pinModes[index] = SIM_PIN_OUTPUT;
+	HAL_GPIO_Request(index, GPIOHANDLE_REQUEST_OUTPUT);
 }
 
 
@@ -226,6 +386,52 @@ void HAL_PIN_PWM_Update(int index, float value) {
 	if (value > 100)
 		value = 100;
 	g_simulatedPWMs[index] = value;
+	g_simulatedPWMDuty[index] = value * 655.35f + 0.5f;
+}
+void HAL_PIN_PWM_UpdateDuty(int index, unsigned short duty) {
+	// small bias so duty made from whole percent does not truncate to one less
+	g_simulatedPWMs[index] = (duty * 100 + 50) / 65535;
+	g_simulatedPWMDuty[index] = duty;
+}
+void HAL_PIN_PWM_UpdateGroup(const int *pins, const unsigned short *duties, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		HAL_PIN_PWM_UpdateDuty(pins[i], duties[i]);
+	}
+	g_simPWMGroupUpdates++;
+}
+int SIM_GetPWMGroupUpdateCount() {
+	return g_simPWMGroupUpdates;
+}
+unsigned short SIM_GetPWMDuty(int index) {
+	return g_simulatedPWMDuty[index];
+}
+// simulated I2C switches direction, as on platforms without open drain,
+// unless selftest turns it on
+int HAL_PIN_Setup_OpenDrain(int index) {
+	if (!g_simOpenDrain)
+		return 0;
+	g_pinModes[index] = SIM_PIN_OUTPUT;
+	HAL_PIN_SetOutputValue(index, 1);
+	return 1;
+}
+void SIM_SetOpenDrainSupported(bool b) {
+	g_simOpenDrain = b;
+}
+int SIM_GetPinSetupCount(int index) {
+	return g_simPinSetups[index];
+}
+// simulated fade is done at once, time of last fade is kept for tests
+int HAL_PIN_PWM_FadeTo(int index, float value, int ms) {
+	if (g_pinModes[index] != SIM_PIN_PWM)
+		return 0;
+	HAL_PIN_PWM_Update(index, value);
+	g_simulatedPWMFadeMS[index] = ms;
+	return 1;
+}
+int SIM_GetPWMFadeMS(int index) {
+	return g_simulatedPWMFadeMS[index];
 }
 
 unsigned int HAL_GetGPIOPin(int index) {
@@ -233,10 +439,11 @@ unsigned int HAL_GetGPIOPin(int index) {
 }
 
 void HAL_AttachInterrupt(int pinIndex, OBKInterruptType mode, OBKInterruptHandler function) {
-
+	g_simInterruptModes[pinIndex] = mode;
+	g_simInterruptHandlers[pinIndex] = function;
 }
 void HAL_DetachInterrupt(int pinIndex) {
-
+	g_simInterruptHandlers[pinIndex] = 0;
 }
 
 
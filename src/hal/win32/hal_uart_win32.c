@@ -1,9 +1,64 @@
 #ifdef WINDOWS
 
 #include "../hal_uart.h"
+#include "../hal_generic.h"
+
+#ifdef LINUX
+#include <termios.h>
+// fcntl.h of win32 stubs hides system one, flags there match Linux
+#include <fcntl.h>
+int open(const char *path, int flags, ...);
+#include <unistd.h>
+
+// Native Linux gateway talks to real serial port given by -uart, without
+// it bytes go to simulated UART like in selftests.
+static const char *g_uartDevice = 0;
+static int g_uartFd = -1;
+
+void SIM_SetUARTDevice(const char *path) {
+	g_uartDevice = path;
+}
+static speed_t HAL_UART_GetSpeed(unsigned int baud) {
+	switch (baud) {
+	case 1200: return B1200;
+	case 2400: return B2400;
+	case 4800: return B4800;
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 921600: return B921600;
+	}
+	return B115200;
+}
+void HAL_UART_RunFrame() {
+	byte buf[256];
+	int n;
+
+	if (g_uartFd < 0) {
+		return;
+	}
+	while ((n = read(g_uartFd, buf, sizeof(buf))) > 0) {
+		UART_AppendBytesToReceiveRingBuffer(buf, n);
+	}
+}
+#else
+void HAL_UART_RunFrame() {
+}
+#endif
 
 void HAL_UART_SendByte(byte b)
 {
+#ifdef LINUX
+	if (g_uartFd >= 0) {
+		if (write(g_uartFd, &b, 1) != 1) {
+			printf("HAL_UART_SendByte: write to %s failed\n", g_uartDevice);
+		}
+		return;
+	}
+#endif
 	void SIM_AppendUARTByte(byte b);
 	// STUB - for testing
 	SIM_AppendUARTByte(b);
@@ -15,12 +70,61 @@ void HAL_UART_SendByte(byte b)
 
 int HAL_UART_Init(int baud, int parity, bool hwflowc, int txOverride, int rxOverride)
 {
+#ifdef LINUX
+	struct termios tio;
+
+	if (g_uartDevice == 0) {
+		return 1;
+	}
+	if (g_uartFd < 0) {
+		g_uartFd = open(g_uartDevice, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+		if (g_uartFd < 0) {
+			printf("HAL_UART_Init: can't open %s\n", g_uartDevice);
+			return 0;
+		}
+		HAL_NetLoop_Watch(g_uartFd);
+	}
+	if (tcgetattr(g_uartFd, &tio) != 0) {
+		return 0;
+	}
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, HAL_UART_GetSpeed(baud));
+	cfsetospeed(&tio, HAL_UART_GetSpeed(baud));
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(PARENB | PARODD | CRTSCTS);
+	// 1 is even and 2 is odd, as on other platforms
+	if (parity == 1) {
+		tio.c_cflag |= PARENB;
+	}
+	else if (parity == 2) {
+		tio.c_cflag |= PARENB | PARODD;
+	}
+	if (hwflowc) {
+		tio.c_cflag |= CRTSCTS;
+	}
+	tcsetattr(g_uartFd, TCSANOW, &tio);
+	tcflush(g_uartFd, TCIOFLUSH);
+#endif
 	return 1;
 }
 void HAL_UART_Flush(void)
 {
+#ifdef LINUX
+	if (g_uartFd >= 0) {
+		tcdrain(g_uartFd);
+	}
+#endif
 }
 void HAL_SetBaud(unsigned int baud)
 {
+#ifdef LINUX
+	struct termios tio;
+
+	if (g_uartFd >= 0 && tcgetattr(g_uartFd, &tio) == 0) {
+		cfsetispeed(&tio, HAL_UART_GetSpeed(baud));
+		cfsetospeed(&tio, HAL_UART_GetSpeed(baud));
+		tcsetattr(g_uartFd, TCSANOW, &tio);
+	}
+#endif
 }
-#endif
\ No newline at end of file
+#endif
@@ -15,10 +15,27 @@
 static void (*g_wifiStatusCallback)(int code);
 
 static char g_ipStr[32];
+static obkStaticIP_t g_simConnectIP;
+static int g_simConnectFailures = 0;
 
+// next connects fail, for tests of fallback
+void SIM_SetWiFiConnectFailures(int count) {
+	g_simConnectFailures = count;
+}
+// addresses given to last connect, zero for DHCP
+const obkStaticIP_t *SIM_GetLastWiFiConnectIP() {
+	return &g_simConnectIP;
+}
 void HAL_ConnectToWiFi(const char *ssid, const char *psk, obkStaticIP_t *ip)
 {
+	g_simConnectIP = *ip;
 	if (g_wifiStatusCallback) {
+		if (g_simConnectFailures > 0) {
+			g_simConnectFailures--;
+			g_wifiStatusCallback(WIFI_STA_CONNECTING);
+			g_wifiStatusCallback(WIFI_STA_DISCONNECTED);
+			return;
+		}
 		g_wifiStatusCallback(WIFI_STA_CONNECTED);
 	}
 	else {
@@ -60,27 +77,127 @@ int WiFI_SetMacAddress(char *mac) {
 	return 1;
 
 }
+static int g_simMacIndex = 0;
+
+// devices of fleet differ in MAC, and so in default names, see -device
+void SIM_SetMacIndex(int index) {
+	g_simMacIndex = index;
+}
 void WiFI_GetMacAddress(char *mac) {
 	mac[0] = 0xBA;
 	mac[1] = 0xDA;
 	mac[2] = 0x31;
 	mac[3] = 0x45;
-	mac[4] = 0xCA;
-	mac[5] = 0xFF;
+	mac[4] = 0xCA ^ ((g_simMacIndex >> 8) & 0xFF);
+	mac[5] = 0xFF ^ (g_simMacIndex & 0xFF);
 }
 
 void HAL_PrintNetworkInfo() {
 
 }
+
+// APs around simulated device, for tests of scan cache and roaming.
+// Scan is done at once, link signal is that of AP it's joined to.
+#define SIM_MAX_APS		16
+
+static obkWiFiScanEntry_t g_simAPs[SIM_MAX_APS];
+static int g_simAPCount = 0;
+static int g_simLinkAP = -1;
+static bool g_simScanDone = false;
+static int g_simScans = 0;
+
+static int SIM_FindWiFiAP(const unsigned char *bssid) {
+	int i;
+
+	for (i = 0; i < g_simAPCount; i++) {
+		if (!memcmp(g_simAPs[i].bssid, bssid, 6)) {
+			return i;
+		}
+	}
+	return -1;
+}
+void SIM_ClearWiFiAPs() {
+	g_simAPCount = 0;
+	g_simLinkAP = -1;
+	g_simScanDone = false;
+	g_simScans = 0;
+}
+// adds AP or changes its signal
+void SIM_SetWiFiAP(const char *ssid, const char *bssid, int channel, int rssi) {
+	obkWiFiScanEntry_t e;
+	unsigned int b[6];
+	int i;
+
+	memset(&e, 0, sizeof(e));
+	sscanf(bssid, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]);
+	for (i = 0; i < 6; i++) {
+		e.bssid[i] = b[i];
+	}
+	strncpy(e.ssid, ssid, sizeof(e.ssid) - 1);
+	e.channel = channel;
+	e.rssi = rssi;
+	i = SIM_FindWiFiAP(e.bssid);
+	if (i < 0) {
+		if (g_simAPCount >= SIM_MAX_APS) {
+			return;
+		}
+		i = g_simAPCount++;
+	}
+	g_simAPs[i] = e;
+}
+void SIM_SetWiFiLink(const char *bssid) {
+	unsigned int b[6];
+	unsigned char m[6];
+	int i;
+
+	sscanf(bssid, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]);
+	for (i = 0; i < 6; i++) {
+		m[i] = b[i];
+	}
+	g_simLinkAP = SIM_FindWiFiAP(m);
+}
+int SIM_GetWiFiScanCount() {
+	return g_simScans;
+}
+int HAL_WiFi_StartScan() {
+	g_simScans++;
+	g_simScanDone = true;
+	return 0;
+}
+int HAL_WiFi_GetScanResults(obkWiFiScanEntry_t *out, int max) {
+	int n;
+
+	if (g_simScanDone == false) {
+		return -1;
+	}
+	n = g_simAPCount < max ? g_simAPCount : max;
+	memcpy(out, g_simAPs, n * sizeof(obkWiFiScanEntry_t));
+	g_simScanDone = false;
+	return n;
+}
+void HAL_WiFi_ConnectToBSSID(const char *ssid, const char *key, const obkWiFiScanEntry_t *ap, obkStaticIP_t *ip) {
+	g_simLinkAP = SIM_FindWiFiAP(ap->bssid);
+	if (g_wifiStatusCallback) {
+		g_wifiStatusCallback(WIFI_STA_CONNECTING);
+		g_wifiStatusCallback(g_simLinkAP < 0 ? WIFI_STA_DISCONNECTED : WIFI_STA_CONNECTED);
+	}
+}
 int HAL_GetWifiStrength() {
+	if (g_simLinkAP >= 0) {
+		return g_simAPs[g_simLinkAP].rssi;
+	}
     return -1;
 }
 char* HAL_GetWiFiBSSID(char* bssid) {
+	if (g_simLinkAP >= 0) {
+		sprintf(bssid, MACSTR, MAC2STR(g_simAPs[g_simLinkAP].bssid));
+		return bssid;
+	}
 	strcpy(bssid, "30:B5:C2:5D:70:72");
 	return bssid;
 };
 uint8_t HAL_GetWiFiChannel(uint8_t *chan) {
-	*chan = 0;
+	*chan = g_simLinkAP >= 0 ? g_simAPs[g_simLinkAP].channel : 0;
 	return *chan;
 };
 const char *HAL_GetMyIPString() {
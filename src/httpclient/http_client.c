@@ -702,11 +702,13 @@ int httpclient_response_parse(httpclient_t *client, char *data, int len, uint32_
     int crlf_pos;
     iotx_time_t timer;
     char *crlf_ptr;
+    int major, minor;
 
     iotx_time_init(&timer);
     utils_time_countdown_ms(&timer, timeout_ms);
 
     client_data->response_content_len = -1;
+    client->keep_alive = false;
 
     crlf_ptr = strstr(data, "\r\n");
     if (crlf_ptr == NULL) {
@@ -718,7 +720,7 @@ int httpclient_response_parse(httpclient_t *client, char *data, int len, uint32_
     data[crlf_pos] = '\0';
 
     /* Parse HTTP response */
-    if (sscanf(data, "HTTP/%*d.%*d %d %*[^\r\n]", &(client->response_code)) != 1) {
+    if (sscanf(data, "HTTP/%d.%d %d %*[^\r\n]", &major, &minor, &(client->response_code)) != 3) {
         /* Cannot match string, error */
         ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "Not a correct HTTP answer : %s\r\n", data);
         return ERROR_HTTP_UNRESOLVED_DNS;
@@ -728,6 +730,8 @@ int httpclient_response_parse(httpclient_t *client, char *data, int len, uint32_
         /* Did not return a 2xx code; TODO fetch headers/(&data?) anyway and implement a mean of writing/reading headers */
         ADDLOG_WARN(LOG_FEATURE_HTTP_CLIENT, "Response code %d\r\n", client->response_code);
     }
+    // HTTP/1.1 keeps connection unless server says close
+    client->keep_alive = (major == 1 && minor >= 1);
 
     ADDLOG_DEBUG(LOG_FEATURE_HTTP_CLIENT, "Reading headers%s\r\n", data);
 
@@ -782,10 +786,14 @@ int httpclient_response_parse(httpclient_t *client, char *data, int len, uint32_
                 client_data->retrieve_len = client_data->response_content_len;
             } else if (!strcmp(key, "Transfer-Encoding")) {
                 if (!strcmp(value, "Chunked") || !strcmp(value, "chunked")) {
+                    // chunk framing is not parsed, so end of response is not known
+                    client->keep_alive = false;
                     client_data->is_chunked = true;
                     client_data->response_content_len = 0;
                     client_data->retrieve_len = 0;
                 }
+            } else if (!stricmp(key, "Connection")) {
+                client->keep_alive = !stricmp(value, "keep-alive");
             }
             memmove(data, &data[crlf_pos + 2], len - (crlf_pos + 2) + 1); /* Be sure to move NULL-terminating char as well */
             len -= (crlf_pos + 2);
@@ -1007,142 +1015,211 @@ iotx_err_t iotx_post(
     return httpclient_common(client, url, port, ca_crt, HTTPCLIENT_POST, timeout_ms, client_data);
 }
 
-//void mylog12(const char *s) {
-//
-//    	ADDLOG_INFO(LOG_FEATURE_HTTP_CLIENT, s);
-//}
-static void httprequest_thread( beken_thread_arg_t arg )
+// All async requests run one after another in one task, instead of a
+// thread each. Connection of response that was read to its end stays open
+// for HTTPCLIENT_KEEPALIVE_MS, and next request to same host and port is
+// sent over it, so repeated polling does not connect every time.
+#define HTTPCLIENT_KEEPALIVE_SLOTS	2
+#define HTTPCLIENT_KEEPALIVE_MS		15000
+#define HTTPCLIENT_QUEUE_IDLE_MS	50
+
+typedef struct httpKeepAlive_s {
+    char host[HTTPCLIENT_MAX_HOST_LEN];
+    int port;
+    // handle 0 when slot is free
+    utils_network_t net;
+    iotx_time_t expires;
+} httpKeepAlive_t;
+
+static httpKeepAlive_t g_keepAlive[HTTPCLIENT_KEEPALIVE_SLOTS];
+static httprequest_t *g_requestHead = 0;
+static httprequest_t *g_requestTail = 0;
+static SemaphoreHandle_t g_requestMutex = 0;
+static bool g_requestTaskStarted = false;
+
+// takes open connection to host, true if there was one
+static bool httpclient_takeKeepAlive(const char *host, int port, utils_network_t *net)
+{
+    httpKeepAlive_t *k;
+    int i;
+
+    for (i = 0; i < HTTPCLIENT_KEEPALIVE_SLOTS; i++) {
+        k = &g_keepAlive[i];
+        if (k->net.handle && k->port == port && !strcmp(k->host, host)) {
+            *net = k->net;
+            net->pHostAddress = host;
+            k->net.handle = 0;
+            return true;
+        }
+    }
+    return false;
+}
+// keeps connection of client, oldest kept one is closed when all slots are used
+static void httpclient_keepAlive(httpclient_t *client, const char *host, int port)
+{
+    httpKeepAlive_t *k, *use = 0;
+    int i;
+
+    for (i = 0; i < HTTPCLIENT_KEEPALIVE_SLOTS; i++) {
+        k = &g_keepAlive[i];
+        if (k->net.handle == 0) {
+            use = k;
+            break;
+        }
+        if (use == 0 || (int)(k->expires.time - use->expires.time) < 0) {
+            use = k;
+        }
+    }
+    if (use->net.handle) {
+        use->net.doDisconnect(&use->net);
+    }
+    strcpy_safe(use->host, host, sizeof(use->host));
+    use->port = port;
+    use->net = client->net;
+    use->net.pHostAddress = use->host;
+    utils_time_countdown_ms(&use->expires, HTTPCLIENT_KEEPALIVE_MS);
+    client->net.handle = 0;
+}
+static void httpclient_expireKeepAlive()
+{
+    httpKeepAlive_t *k;
+    int i;
+
+    for (i = 0; i < HTTPCLIENT_KEEPALIVE_SLOTS; i++) {
+        k = &g_keepAlive[i];
+        if (k->net.handle && utils_time_is_expired(&k->expires)) {
+            k->net.doDisconnect(&k->net);
+            k->net.handle = 0;
+        }
+    }
+}
+// connects, or takes kept connection, and sends request
+static int httpclient_open(httprequest_t *request, const char *host, int port, bool *reused)
+{
+    httpclient_t *client = &request->client;
+    int ret;
+
+    *reused = httpclient_takeKeepAlive(host, port, &client->net);
+    if (*reused == false) {
+        ADDLOG_INFO(LOG_FEATURE_HTTP_CLIENT, "host: '%s', port: %d", host, port);
+        iotx_net_init(&client->net, host, port, request->ca_crt);
+        ret = httpclient_connect(client);
+        if (0 != ret) {
+            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_connect is error,ret = %d", ret);
+            httpclient_close(client);
+            return ret;
+        }
+    }
+    ret = httpclient_send_request(client, request->url, request->method, &request->client_data);
+    if (0 != ret) {
+        ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_send_request is error,ret = %d", ret);
+        httpclient_close(client);
+    }
+    return ret;
+}
+static void httprequest_run(httprequest_t *request)
 {
-    httprequest_t *request = (httprequest_t *)arg;
     iotx_time_t timer;
     int ret = 0;
     char host[HTTPCLIENT_MAX_HOST_LEN] = { 0 };
+    // response of request without buffer is read here, so its end is known
+    char drain[HTTPCLIENT_CHUNK_SIZE];
     httpclient_t *client = &request->client;
-    const char *url = request->url;
     const char *header = request->header;
     int port = request->port;
-    const char *ca_crt = request->ca_crt;
-    //uint32_t timeout = request->timeout;
     httpclient_data_t *client_data = &request->client_data;
-    int method = request->method;
     int timeout_ms = request->timeout;
-
-    //addLog("start request thread\r\n");
-    //rtos_delay_milliseconds(500);
-
+    bool draining = false;
+    bool reused, retried = false;
+    bool aborted = false;
 
     if (header && header[0]){
         HTTPClient_SetCustomHeader(client, header);  //Sets the custom header if needed.
     }
 
-    //addLog("after HTTPClient_SetCustomHeader\r\n");
-    //rtos_delay_milliseconds(500);
-
-
     request->state = 0;
+    client->net.handle = 0;
 
-    if (0 == client->net.handle) {
-        //Establish connection if no.
-        //addLog("before httpclient_parse_host\r\n");
-        //rtos_delay_milliseconds(500);
-    	ret = httpclient_parse_host(url, host, &port, sizeof(host));
-
-        if (ret != SUCCESS_RETURN){
-            request->state = -1;
-            if (request->data_callback){
-                request->data_callback(request);
-            }
-            goto exit;
+    ret = httpclient_parse_host(request->url, host, &port, sizeof(host));
+    if (ret != SUCCESS_RETURN){
+        request->state = -1;
+        if (request->data_callback){
+            request->data_callback(request);
         }
-
-    	ADDLOG_INFO(LOG_FEATURE_HTTP_CLIENT, "host: '%s', port: %d", host, port);
-        //rtos_delay_milliseconds(500);
-
-    	iotx_net_init(&client->net, host, port, ca_crt);
-        //addLog("after iotx_net_init\r\n");
-        //rtos_delay_milliseconds(500);
-
-    	ret = httpclient_connect(client);
-        //addLog("after httpclient_connect %d\r\n", ret);
-        //rtos_delay_milliseconds(500);
-    	if (0 != ret) {
-            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_connect is error,ret = %d", ret);
-            httpclient_close(client);
-            request->state = -1;
-            if (request->data_callback){
-                request->data_callback(request);
-            }
-            goto exit;
-    	}
-
-        ret = httpclient_send_request(client, url, method, client_data);
-        if (0 != ret) {
-            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_send_request is error,ret = %d", ret);
-            httpclient_close(client);
+        goto exit;
+    }
+    if (httpclient_open(request, host, port, &reused) != 0) {
+        // kept connection may have been closed by server meanwhile
+        if (!reused || httpclient_open(request, host, port, &reused) != 0) {
             request->state = -1;
             if (request->data_callback){
                 request->data_callback(request);
             }
             goto exit;
         }
+        retried = true;
     }
-    //addLog("httpclient_connect ret = %d", ret);
-    //rtos_delay_milliseconds(500);
     request->state = 0;  // start
     request->client_data.response_buf_filled = 0;
     if (request->data_callback){
         request->data_callback(request);
     }
 
+    if (NULL == client_data->response_buf || 0 == client_data->response_buf_len) {
+        draining = true;
+        client_data->response_buf = drain;
+        client_data->response_buf_len = sizeof(drain);
+    }
+
     iotx_time_init(&timer);
     utils_time_countdown_ms(&timer, timeout_ms);
 
-    //addLog("rx buflen %d", client_data->response_buf_len);
-    //rtos_delay_milliseconds(500);
-
-    if ((NULL != client_data->response_buf)
-         || (0 != client_data->response_buf_len)) {
-        do {
-            // parse headers, fill client_data->response_buf up to max client_data->response_buf_len-1
-            ret = httpclient_recv_response(client, iotx_time_left(&timer), client_data);
-            //addLog("httpclient_recv_response is ret = %d is_more %d", ret, client_data->is_more);
-            //rtos_delay_milliseconds(500);
-            if (ret < 0) {
-                ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_recv_response is error,ret = %d", ret);
-                httpclient_close(client);
-                request->state = -2;
-                if (request->data_callback){
-                    request->data_callback(request);
-                }
-                // close & leave
-                break;
+    client_data->is_more = false;
+    while (1) {
+        // parse headers, fill client_data->response_buf up to max client_data->response_buf_len-1
+        ret = httpclient_recv_response(client, iotx_time_left(&timer), client_data);
+        if (ret == ERROR_HTTP_CONN && reused && !retried && client->response_code == 0) {
+            // kept connection was closed before anything came, send again on new one
+            retried = true;
+            httpclient_close(client);
+            client_data->is_more = false;
+            if (httpclient_open(request, host, port, &reused) == 0) {
+                continue;
             }
-            request->state = 1;
+        }
+        if (ret < 0) {
+            ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient_recv_response is error,ret = %d", ret);
+            httpclient_close(client);
+            request->state = -2;
             if (request->data_callback){
-                //addLog("calling callback");
-                //rtos_delay_milliseconds(500);
-                if (request->data_callback(request)){
-                    // abort on user request
-                    // close & leave
-                    break;
-                }
+                request->data_callback(request);
             }
-        } while (client_data->is_more);
-    } else {
-		// must read out somewhere data, otherwise lwip will fail at lwip_close and it wont free socket
-		// and then it will soon run out of the sockets and break networking
-		int c_read;
-		int ret;
-		c_read = 0;
-		do {
-			ret = client->net.doRead(&client->net, host, sizeof(host), iotx_time_left(&timer));
-			if(ret>0)
-				c_read += ret;
-		} while(ret > 0);
-        ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "httpclient - no response buff, skipped %i",c_read);
+            // close & leave
+            break;
+        }
+        request->state = 1;
+        if (request->data_callback && !draining){
+            if (request->data_callback(request)){
+                // abort on user request
+                // close & leave
+                aborted = true;
+                break;
+            }
+        }
+        if (!client_data->is_more) {
+            break;
+        }
+    }
+    if (draining) {
+        client_data->response_buf = 0;
+        client_data->response_buf_len = 0;
+    }
+    // only a response read to its known end leaves connection usable
+    if (ret >= 0 && !aborted && !client_data->is_more && client->keep_alive && !client_data->is_chunked
+        && client_data->response_content_len != (uint32_t)-1 && client_data->retrieve_len == 0) {
+        httpclient_keepAlive(client, host, port);
     }
 exit:
-    //addLog("close http channel");
     httpclient_close(client);
     request->state = 2;  // complete
     request->client_data.response_buf_filled = 0;
@@ -1151,9 +1228,32 @@ exit:
     }
 	// free if required
 	httpclient_freeMemory(request);
-    // remove this thread
-    rtos_delete_thread( NULL );
-    return;
+}
+
+static void httprequest_thread( beken_thread_arg_t arg )
+{
+    httprequest_t *request;
+
+    while (1) {
+        if (xSemaphoreTake(g_requestMutex, 1000) != pdTRUE) {
+            continue;
+        }
+        request = g_requestHead;
+        if (request) {
+            g_requestHead = request->next;
+            if (g_requestHead == 0) {
+                g_requestTail = 0;
+            }
+        }
+        xSemaphoreGive(g_requestMutex);
+        if (request == 0) {
+            httpclient_expireKeepAlive();
+            rtos_delay_milliseconds(HTTPCLIENT_QUEUE_IDLE_MS);
+            continue;
+        }
+        request->client.response_code = 0;
+        httprequest_run(request);
+    }
 }
 
 
@@ -1161,16 +1261,36 @@ exit:
 // our async stuff
 int HTTPClient_Async_SendGeneric(httprequest_t *request){
     OSStatus err = kNoErr;
-    err = rtos_create_thread( NULL, BEKEN_APPLICATION_PRIORITY,
+
+    if (g_requestMutex == 0) {
+        g_requestMutex = xSemaphoreCreateMutex();
+    }
+    if (g_requestTaskStarted == false) {
+        err = rtos_create_thread( NULL, BEKEN_APPLICATION_PRIORITY,
 									"httprequest",
 									(beken_thread_function_t)httprequest_thread,
-									0x800,
-									(beken_thread_arg_t)request );
-    if(err != kNoErr)
-    {
-       ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "create \"httprequest\" thread failed!\r\n");
-       return -1;
+									0x1000,
+									(beken_thread_arg_t)0 );
+        if(err != kNoErr)
+        {
+           ADDLOG_ERROR(LOG_FEATURE_HTTP_CLIENT, "create \"httprequest\" thread failed!\r\n");
+           return -1;
+        }
+        g_requestTaskStarted = true;
+    }
+    request->next = 0;
+    // request is owned by queue from now on, so it must get in
+    while (xSemaphoreTake(g_requestMutex, 1000) != pdTRUE) {
+        ADDLOG_WARN(LOG_FEATURE_HTTP_CLIENT, "Waiting for request queue");
+    }
+    if (g_requestTail) {
+        g_requestTail->next = request;
+    }
+    else {
+        g_requestHead = request;
     }
+    g_requestTail = request;
+    xSemaphoreGive(g_requestMutex);
 
     return 0;
 }
@@ -68,6 +68,7 @@ typedef struct {
     int remote_port; /**< HTTP or HTTPS port. */
     utils_network_t net;
     int response_code; /**< Response code. */
+    bool keep_alive; /**< Server leaves connection open after response. */
     char *header; /**< Custom header. */
     char *auth_user; /**< Username for basic authentication. */
     char *auth_password; /**< Password for basic authentication. */
@@ -116,11 +117,17 @@ typedef struct httprequest_t_tag{
     httpclient_data_t client_data;
 	char targetFile[32];
     void *usercontext; // anything you like
+    // used by request queue
+    struct httprequest_t_tag *next;
 } httprequest_t;
 
 
 /**
- * @brief            This function executes a request on a given URL. It returns immediately and calls back with state and data.
+ * @brief            This function queues a request on a given URL. It returns immediately and calls back with state and data.
+ *                   Requests run one after another in one HTTP client task. Connection of a response with known length
+ *                   that was read to its end is kept open for a while and used by next request to same host and port.
+ *                   Callback gets response in pieces of up to response_buf_len bytes (state 1), -1 or -2 on error
+ *                   and 2 when request is done.
  * @param[in]        request is a pointer to the #httprequest_t.
  * @return           .
  * @par              HTTPClient_Async_SendGeneric Post Example
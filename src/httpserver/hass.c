@@ -7,6 +7,9 @@
 #include "../new_pins.h"
 #include "../cmnds/cmd_enums.h"
 #include "../driver/drv_local.h"
+#if ENABLE_LITTLEFS
+#include "../littlefs/our_lfs.h"
+#endif
 
 #if ENABLE_HA_DISCOVERY
 
@@ -17,7 +20,7 @@ Switch - https://www.home-assistant.io/integrations/switch.mqtt/
 Sensor - https://www.home-assistant.io/integrations/sensor.mqtt/
 */
 
-//Buffer used to populate values in cJSON_Add* calls. The values are based on
+//Buffer used to populate values in JSONW_* calls. The values are based on
 //CFG_GetShortDeviceName and clientId so it needs to be bigger than them. +64 for light/switch/etc.
 static char g_hassBuffer[CGF_MQTT_CLIENT_ID_SIZE + 128];
 const char *g_template_lowMidHigh = "{% if value == '0' %}\n"
@@ -224,24 +227,42 @@ void hass_populate_device_config_channel(ENTITY_TYPE type, char* uniq_id, HassDe
 	STR_ReplaceWhiteSpacesWithUnderscore(uniq_id);
 }
 
-/// @brief Builds HomeAssistant device discovery info. The caller needs to free the returned pointer.
-/// @param ids 
-cJSON* hass_build_device_node(cJSON* ids) {
-	cJSON* dev = cJSON_CreateObject();
-	cJSON_AddItemToObject(dev, "ids", ids);     //identifiers
-	cJSON_AddStringToObject(dev, "name", CFG_GetShortDeviceName());
+/// @brief Writes HomeAssistant device discovery info.
+/// @param w
+static void hass_write_device_node(jsonWriter_t* w) {
+	JSONW_StartObject(w, "dev");
+	JSONW_StartArray(w, "ids");     //identifiers
+	JSONW_String(w, 0, CFG_GetDeviceName());
+	JSONW_EndArray(w);
+	JSONW_String(w, "name", CFG_GetShortDeviceName());
 
 #ifdef USER_SW_VER
-	cJSON_AddStringToObject(dev, "sw", USER_SW_VER);   //sw_version
+	JSONW_String(w, "sw", USER_SW_VER);   //sw_version
 #endif
 
-	cJSON_AddStringToObject(dev, "mf", MANUFACTURER);   //manufacturer
-	cJSON_AddStringToObject(dev, "mdl", PLATFORM_MCU_NAME);  //Using chipset for model
+	JSONW_String(w, "mf", MANUFACTURER);   //manufacturer
+	JSONW_String(w, "mdl", PLATFORM_MCU_NAME);  //Using chipset for model
 
 	sprintf(g_hassBuffer, "http://%s/index", HAL_GetMyIPString());
-	cJSON_AddStringToObject(dev, "cu", g_hassBuffer);  //configuration_url
+	JSONW_String(w, "cu", g_hassBuffer);  //configuration_url
+	JSONW_EndObject(w);
+}
+// field without value is left out, as it was with cJSON
+static void hass_add_string(HassDeviceInfo* info, const char* key, const char* value) {
+	if (value) {
+		JSONW_String(&info->w, key, value);
+	}
+}
+static void hass_write_string_array(jsonWriter_t* w, const char* key, int count, const char* items[]) {
+	int i;
 
-	return dev;
+	JSONW_StartArray(w, key);
+	for (i = 0; i < count; i++) {
+		if (items[i]) {
+			JSONW_String(w, 0, items[i]);
+		}
+	}
+	JSONW_EndArray(w);
 }
 
 // TODO, broken
@@ -262,10 +283,10 @@ cJSON* hass_build_device_node(cJSON* ids) {
 //	sprintf(info->channel, "fan/%s/config", uniq_id);
 //	STR_ReplaceWhiteSpacesWithUnderscore(info->channel);
 //
-//	cJSON_AddStringToObject(info->root, "pr_mode_stat_t", stateTopic);
+//	hass_add_string(info, "pr_mode_stat_t", stateTopic);
 //	sprintf(g_hassBuffer, "cmnd/%s/%s", CFG_GetMQTTClientId(), command);
-//	cJSON_AddStringToObject(info->root, "pr_mode_cmd_t", g_hassBuffer);
-//	cJSON_AddStringToObject(info->root, "dev_cla", "fan");
+//	hass_add_string(info, "pr_mode_cmd_t", g_hassBuffer);
+//	hass_add_string(info, "dev_cla", "fan");
 //	cJSON_AddItemToObject(info->root, "osc", cJSON_CreateBool(false));
 //	cJSON_AddItemToObject(info->root, "percentage", cJSON_CreateBool(false));
 //	cJSON_AddItemToObject(info->root, "pr_modes", cJSON_CreateStringArray(options, numOptions));
@@ -278,31 +299,22 @@ HassDeviceInfo* hass_createSelectEntity(const char* state_topic, const char* com
 	HassDeviceInfo* info = hass_init_device_info(HASS_SELECT, 0, NULL, NULL, 0, title);
 
 	// Set entity properties
-	cJSON_AddStringToObject(info->root, "name", title);
-	cJSON_AddStringToObject(info->root, "unique_id", title); // Using title as unique_id for simplicity; adjust if needed
-	cJSON_AddStringToObject(info->root, "state_topic", state_topic);
-	cJSON_AddStringToObject(info->root, "command_topic", command_topic);
+	hass_add_string(info, "name", title);
+	hass_add_string(info, "unique_id", title); // Using title as unique_id for simplicity; adjust if needed
+	hass_add_string(info, "state_topic", state_topic);
+	hass_add_string(info, "command_topic", command_topic);
 
 	// Create options array from provided options
-	cJSON* select_options = cJSON_CreateArray();
-	for (int i = 0; i < numoptions; i++) {
-		cJSON_AddItemToArray(select_options, cJSON_CreateString(options[i]));
-	}
-	cJSON_AddItemToObject(info->root, "options", select_options);
+	hass_write_string_array(&info->w, "options", numoptions, options);
 
 	// Set availability
-	cJSON_AddStringToObject(info->root, "availability_topic", "~/status");
-	cJSON_AddStringToObject(info->root, "payload_available", "online");
-	cJSON_AddStringToObject(info->root, "payload_not_available", "offline");
+	hass_add_string(info, "availability_topic", "~/status");
+	hass_add_string(info, "payload_available", "online");
+	hass_add_string(info, "payload_not_available", "offline");
 
 	// Set configuration channel for select entity
 	sprintf(info->channel, "select/%s/config", info->unique_id);
 
-	// Update device info
-	cJSON* dev = info->device;
-	cJSON_ReplaceItemInObject(dev, "manufacturer", cJSON_CreateString("Custom"));
-	cJSON_ReplaceItemInObject(dev, "model", cJSON_CreateString("C-Swing-Control"));
-
 	return info;
 }
 // Helper function to generate a dictionary string for value_template mapping integers to strings
@@ -343,21 +355,21 @@ HassDeviceInfo* hass_createGarageEntity(const char* state_topic, const char* com
 	const char *title) {
 	HassDeviceInfo* info = hass_init_device_info(HASS_GARAGE, 0, NULL, NULL, 0, title);
 
-	cJSON_AddStringToObject(info->root, "name", title);
-	cJSON_AddStringToObject(info->root, "unique_id", title);
-	cJSON_AddStringToObject(info->root, "device_class", "garage");
-	cJSON_AddStringToObject(info->root, "state_topic", state_topic);
-	cJSON_AddStringToObject(info->root, "command_topic", command_topic);
+	hass_add_string(info, "name", title);
+	hass_add_string(info, "unique_id", title);
+	hass_add_string(info, "device_class", "garage");
+	hass_add_string(info, "state_topic", state_topic);
+	hass_add_string(info, "command_topic", command_topic);
 	// publish [Topic] [Value]
 	// publish 1 open
 	// publish 1 closed
 	// publish 1 opening  
 	// obk0696FB33/[Topic]/get
-	cJSON_AddStringToObject(info->root, "payload_open", "OPEN");
-	cJSON_AddStringToObject(info->root, "payload_close", "CLOSE");
-	cJSON_AddStringToObject(info->root, "payload_stop", "STOP");
-	cJSON_AddStringToObject(info->root, "state_open", "open");
-	cJSON_AddStringToObject(info->root, "state_closed", "closed");
+	hass_add_string(info, "payload_open", "OPEN");
+	hass_add_string(info, "payload_close", "CLOSE");
+	hass_add_string(info, "payload_stop", "STOP");
+	hass_add_string(info, "state_open", "open");
+	hass_add_string(info, "state_closed", "closed");
 
 	sprintf(info->channel, "cover/%s/config", info->unique_id);
 	return info;
@@ -367,32 +379,24 @@ HassDeviceInfo* hass_createSelectEntityIndexedCustom(const char* state_topic, co
 	const char* options[], const char* title, char* value_template, char* command_template) {
 	HassDeviceInfo* info = hass_init_device_info(HASS_SELECT, 0, NULL, NULL, 0, title);
 
-	cJSON_AddStringToObject(info->root, "name", title);
-	cJSON_AddStringToObject(info->root, "unique_id", title);
-	cJSON_AddStringToObject(info->root, "state_topic", state_topic);
-	cJSON_AddStringToObject(info->root, "command_topic", command_topic);
+	hass_add_string(info, "name", title);
+	hass_add_string(info, "unique_id", title);
+	hass_add_string(info, "state_topic", state_topic);
+	hass_add_string(info, "command_topic", command_topic);
 
-	cJSON* select_options = cJSON_CreateArray();
-	for (int i = 0; i < numoptions; i++) {
-		cJSON_AddItemToArray(select_options, cJSON_CreateString(options[i]));
-	}
-	cJSON_AddItemToObject(info->root, "options", select_options);
+	hass_write_string_array(&info->w, "options", numoptions, options);
 
-	cJSON_AddStringToObject(info->root, "value_template", value_template);
-	cJSON_AddStringToObject(info->root, "command_template", command_template);
+	hass_add_string(info, "value_template", value_template);
+	hass_add_string(info, "command_template", command_template);
 
 	if (!CFG_HasFlag(OBK_FLAG_NOT_PUBLISH_AVAILABILITY)) {
-		cJSON_AddStringToObject(info->root, "availability_topic", "~/connected");
-		cJSON_AddStringToObject(info->root, "payload_available", "online");
-		cJSON_AddStringToObject(info->root, "payload_not_available", "offline");
+		hass_add_string(info, "availability_topic", "~/connected");
+		hass_add_string(info, "payload_available", "online");
+		hass_add_string(info, "payload_not_available", "offline");
 	}
 
 	sprintf(info->channel, "select/%s/config", info->unique_id);
 
-	//cJSON* dev = info->device;
-	//cJSON_ReplaceItemInObject(dev, "manufacturer", cJSON_CreateString("Custom"));
-	//cJSON_ReplaceItemInObject(dev, "model", cJSON_CreateString("C-Swing-Control"));
-
 	return info;
 }
 
@@ -401,90 +405,69 @@ HassDeviceInfo* hass_createHVAC(float min, float max, float step, const char **f
 	HassDeviceInfo* info = hass_init_device_info(HASS_HVAC, 0, NULL, NULL, 0, 0);
 
 	// Set the name for the HVAC device
-	cJSON_AddStringToObject(info->root, "name", "Smart Thermostat");
+	hass_add_string(info, "name", "Smart Thermostat");
 
 	// Set temperature unit
-	cJSON_AddStringToObject(info->root, "temperature_unit", "C");
+	hass_add_string(info, "temperature_unit", "C");
 
 	// Set temperature topics
-	cJSON_AddStringToObject(info->root, "current_temperature_topic", "~/CurrentTemperature/get");
+	hass_add_string(info, "current_temperature_topic", "~/CurrentTemperature/get");
 	sprintf(g_hassBuffer, "cmnd/%s/TargetTemperature", CFG_GetMQTTClientId());
-	cJSON_AddStringToObject(info->root, "temperature_command_topic", g_hassBuffer);
-	cJSON_AddStringToObject(info->root, "temperature_state_topic", "~/TargetTemperature/get");
+	hass_add_string(info, "temperature_command_topic", g_hassBuffer);
+	hass_add_string(info, "temperature_state_topic", "~/TargetTemperature/get");
 
 	// Set temperature range and step
-	cJSON_AddNumberToObject(info->root, "min_temp", min);
-	cJSON_AddNumberToObject(info->root, "max_temp", max);
-	cJSON_AddNumberToObject(info->root, "temp_step", step);
+	JSONW_Number(&info->w, "min_temp", min);
+	JSONW_Number(&info->w, "max_temp", max);
+	JSONW_Number(&info->w, "temp_step", step);
 
 	// Set mode topics
-	cJSON_AddStringToObject(info->root, "mode_state_topic", "~/ACMode/get");
+	hass_add_string(info, "mode_state_topic", "~/ACMode/get");
 	sprintf(g_hassBuffer, "cmnd/%s/ACMode", CFG_GetMQTTClientId());
-	cJSON_AddStringToObject(info->root, "mode_command_topic", g_hassBuffer);
+	hass_add_string(info, "mode_command_topic", g_hassBuffer);
 
 	// Add supported modes
-	cJSON* modes = cJSON_CreateArray();
-	cJSON_AddItemToArray(modes, cJSON_CreateString("off"));
-	cJSON_AddItemToArray(modes, cJSON_CreateString("heat"));
-	cJSON_AddItemToArray(modes, cJSON_CreateString("cool"));
+	JSONW_StartArray(&info->w, "modes");
+	hass_add_string(info, 0, "off");
+	hass_add_string(info, 0, "heat");
+	hass_add_string(info, 0, "cool");
 	// fan does not work, it has to be fan_only
-	cJSON_AddItemToArray(modes, cJSON_CreateString("fan_only"));
-	cJSON_AddItemToObject(info->root, "modes", modes);
+	hass_add_string(info, 0, "fan_only");
+	JSONW_EndArray(&info->w);
 
 	if (fanOptions && numFanOptions) {
 		// Add fan mode topics
-		cJSON_AddStringToObject(info->root, "fan_mode_state_topic", "~/FanMode/get");
+		hass_add_string(info, "fan_mode_state_topic", "~/FanMode/get");
 		sprintf(g_hassBuffer, "cmnd/%s/FanMode", CFG_GetMQTTClientId());
-		cJSON_AddStringToObject(info->root, "fan_mode_command_topic", g_hassBuffer);
+		hass_add_string(info, "fan_mode_command_topic", g_hassBuffer);
 
 		// Add supported fan modes
-		cJSON* fan_modes = cJSON_CreateArray();
-		for (int i = 0; i < numFanOptions; i++) {
-			const char *mode = fanOptions[i];
-			cJSON_AddItemToArray(fan_modes, cJSON_CreateString(mode));
-		}
-		cJSON_AddItemToObject(info->root, "fan_modes", fan_modes);
+		hass_write_string_array(&info->w, "fan_modes", numFanOptions, fanOptions);
 	}
 	if (numSwingHOptions) {
 		// Add Swing Horizontal
-		cJSON_AddStringToObject(info->root, "swing_horizontal_mode_state_topic", "~/SwingH/get");
+		hass_add_string(info, "swing_horizontal_mode_state_topic", "~/SwingH/get");
 		sprintf(g_hassBuffer, "cmnd/%s/SwingH", CFG_GetMQTTClientId());
-		cJSON_AddStringToObject(info->root, "swing_horizontal_mode_command_topic", g_hassBuffer);
+		hass_add_string(info, "swing_horizontal_mode_command_topic", g_hassBuffer);
 
-		cJSON* swingH_modes = cJSON_CreateArray();
-		for (int i = 0; i < numSwingHOptions; i++) {
-			const char *mode = swingHOptions[i];
-			cJSON_AddItemToArray(swingH_modes, cJSON_CreateString(mode));
-		}
-		cJSON_AddItemToObject(info->root, "swing_horizontal_modes", swingH_modes);
+		hass_write_string_array(&info->w, "swing_horizontal_modes", numSwingHOptions, swingHOptions);
 	}
 	if (numSwingOptions) {
 		// Add Swing Vertical
-		cJSON_AddStringToObject(info->root, "swing_mode_state_topic", "~/SwingV/get");
+		hass_add_string(info, "swing_mode_state_topic", "~/SwingV/get");
 		sprintf(g_hassBuffer, "cmnd/%s/SwingV", CFG_GetMQTTClientId());
-		cJSON_AddStringToObject(info->root, "swing_mode_command_topic", g_hassBuffer);
-
-		cJSON* swing_modes = cJSON_CreateArray();
-		for (int i = 0; i < numSwingOptions; i++) {
-			const char *mode = swingOptions[i];
-			cJSON_AddItemToArray(swing_modes, cJSON_CreateString(mode));
-		}
-		cJSON_AddItemToObject(info->root, "swing_modes", swing_modes);
+		hass_add_string(info, "swing_mode_command_topic", g_hassBuffer);
 
+		hass_write_string_array(&info->w, "swing_modes", numSwingOptions, swingOptions);
 	}
 	// Set availability topic
-	cJSON_AddStringToObject(info->root, "availability_topic", "~/status");
-	cJSON_AddStringToObject(info->root, "payload_available", "online");
-	cJSON_AddStringToObject(info->root, "payload_not_available", "offline");
+	hass_add_string(info, "availability_topic", "~/status");
+	hass_add_string(info, "payload_available", "online");
+	hass_add_string(info, "payload_not_available", "offline");
 
 	// Update device configuration channel for HVAC
 	sprintf(info->channel, "climate/%s/config", info->unique_id);
 
-	// Update device info
-	cJSON* dev = info->device;
-	cJSON_ReplaceItemInObject(dev, "manufacturer", cJSON_CreateString("Custom"));
-	cJSON_ReplaceItemInObject(dev, "model", cJSON_CreateString("C-Thermo"));
-
 	return info;
 }
 /// @brief Initializes HomeAssistant device discovery storage with common values.
@@ -495,21 +478,26 @@ HassDeviceInfo* hass_createHVAC(float min, float max, float step, const char **f
 /// @param payload_on The payload that represents enabled state. This is not added for POWER_SENSOR.
 /// @param payload_off The payload that represents disabled state. This is not added for POWER_SENSOR.
 /// @param asensdatasetix dataset index for ENERGY_METER_SENSOR, otherwise 0
+/// @param name `name` to publish instead of the one made from type and index, or NULL
+/// @param uniq_id `uniq_id` to publish instead of info->unique_id, or NULL
 /// @return 
-HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, const char* payload_on, const char* payload_off, int asensdatasetix, const char *title) {
+static HassDeviceInfo* hass_init_device_info_named(ENTITY_TYPE type, int index, const char* payload_on, const char* payload_off, int asensdatasetix, const char *title,
+	const char *name, const char *uniq_id) {
 	HassDeviceInfo* info = os_malloc(sizeof(HassDeviceInfo));
 	addLogAdv(LOG_DEBUG, LOG_FEATURE_HASS, "hass_init_device_info=%p", info);
 
 	hass_populate_unique_id(type, index, info->unique_id, asensdatasetix, title);
 	hass_populate_device_config_channel(type, info->unique_id, info);
 
-	info->ids = cJSON_CreateArray();
-	cJSON_AddItemToArray(info->ids, cJSON_CreateString(CFG_GetDeviceName()));
-
-	info->device = hass_build_device_node(info->ids);
-
-	info->root = cJSON_CreateObject();
-	cJSON_AddItemToObject(info->root, "dev", info->device);    //device
+	// discovery JSON is written straight into info->json, fields in the order they are added
+	memset(&info->out, 0, sizeof(info->out));
+	info->out.fd = -1;
+	info->out.reply = info->json;
+	info->out.replymaxlen = sizeof(info->json);
+	info->bFinished = false;
+	JSONW_Init(&info->w, &info->out);
+	JSONW_StartObject(&info->w, 0);
+	hass_write_device_node(&info->w);    //device
 
 	bool isSensor = false;	//This does not count binary_sensor
 
@@ -626,28 +614,28 @@ HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, const char* p
 			strcat(g_hassBuffer, "_");
 		strcat(g_hassBuffer, title);
 	}
-	cJSON_AddStringToObject(info->root, "name", g_hassBuffer);
-	cJSON_AddStringToObject(info->root, "~", CFG_GetMQTTClientId());      //base topic
+	hass_add_string(info, "name", name ? name : g_hassBuffer);
+	hass_add_string(info, "~", CFG_GetMQTTClientId());      //base topic
 	// remove availability information for sensor to keep last value visible on Home Assistant
 	bool flagavty = false;
 	flagavty = CFG_HasFlag(OBK_FLAG_NOT_PUBLISH_AVAILABILITY);
 	// if door sensor is running, then deep sleep will be invoked mostly, then we dont want availability
 #ifndef OBK_DISABLE_ALL_DRIVERS
-	if (DRV_IsRunning("DoorSensor") == false && DRV_IsRunning("tmSensor") == false)
+	if (DRV_IsRunning(DRV_ID_DoorSensor) == false && DRV_IsRunning(DRV_ID_tmSensor) == false)
 #endif
 	{
 		if (!isSensor && !flagavty) {
-			cJSON_AddStringToObject(info->root, "avty_t", "~/connected");   //availability_topic, `online` value is broadcasted
+			hass_add_string(info, "avty_t", "~/connected");   //availability_topic, `online` value is broadcasted
 		}
 	}
 
 	if (!isSensor && type != HASS_TEXTFIELD && type != HASS_GARAGE) {	//Sensors (except binary_sensor) don't use payload 
 		if(type == HASS_BUTTON) {
-			cJSON_AddStringToObject(info->root, "payload_press", payload_on);
+			hass_add_string(info, "payload_press", payload_on);
 		}
 		else if(type != HASS_TEXTFIELD){
-			cJSON_AddStringToObject(info->root, "pl_on", payload_on);    //payload_on
-			cJSON_AddStringToObject(info->root, "pl_off", payload_off);   //payload_off	
+			hass_add_string(info, "pl_on", payload_on);    //payload_on
+			hass_add_string(info, "pl_off", payload_off);   //payload_off	
 		}
 	}
 
@@ -655,56 +643,60 @@ HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, const char* p
 		// Sorry, you can't do that on stack
 		//char value_template[1024];
 		CMD_GenEnumValueTemplate(g_enums[index], g_hassBuffer, sizeof(g_hassBuffer));
-		cJSON_AddStringToObject(info->root, "value_template", g_hassBuffer);
+		hass_add_string(info, "value_template", g_hassBuffer);
 	}
 
-	cJSON_AddStringToObject(info->root, "uniq_id", info->unique_id);  //unique_id
-	cJSON_AddNumberToObject(info->root, "qos", 1);
+	hass_add_string(info, "uniq_id", uniq_id ? uniq_id : info->unique_id);  //unique_id
+	JSONW_Number(&info->w, "qos", 1);
 
-	addLogAdv(LOG_DEBUG, LOG_FEATURE_HASS, "root=%p", info->root);
 	return info;
 }
+/// @brief Initializes HomeAssistant device discovery storage with common values, see hass_init_device_info_named.
+HassDeviceInfo* hass_init_device_info(ENTITY_TYPE type, int index, const char* payload_on, const char* payload_off, int asensdatasetix, const char *title) {
+	return hass_init_device_info_named(type, index, payload_on, payload_off, asensdatasetix, title, NULL, NULL);
+}
 // backlog setchannelType 2 TextField; scheduleHADiscovery 1
 HassDeviceInfo* hass_init_textField_info(int index) {
 	HassDeviceInfo* info;
 	info = hass_init_device_info(HASS_TEXTFIELD, index, NULL, NULL, 0, NULL);
 
 	sprintf(g_hassBuffer, "~/%i/get", index);
-	cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);   //state_topic
+	hass_add_string(info, "stat_t", g_hassBuffer);   //state_topic
 
 	sprintf(g_hassBuffer, "~/%i/set", index);
-	cJSON_AddStringToObject(info->root, "cmd_t", g_hassBuffer);    //command_topic
+	hass_add_string(info, "cmd_t", g_hassBuffer);    //command_topic
 
-	cJSON_AddStringToObject(info->root, "platform", "mqtt");       // required by HA
-	cJSON_AddStringToObject(info->root, "mode", "text");           // optional, default is "text"
-	cJSON_AddBoolToObject(info->root, "ret", true);                // retain = true, optional
-	cJSON_AddStringToObject(info->root, "entity_category", "config"); // optional, makes it a config-type field
+	hass_add_string(info, "platform", "mqtt");       // required by HA
+	hass_add_string(info, "mode", "text");           // optional, default is "text"
+	JSONW_Bool(&info->w, "ret", true);                // retain = true, optional
+	hass_add_string(info, "entity_category", "config"); // optional, makes it a config-type field
 
 	return info;
 }
 
 
 HassDeviceInfo* hass_createToggle(const char *label, const char *stateTopic, const char *command) {
-	HassDeviceInfo* info = hass_init_device_info(RELAY, 0, "1", "0", 0, label);
+	char base_id[HASS_UNIQUE_ID_SIZE];
+	char uniq_id[HASS_UNIQUE_ID_SIZE];
+
+	// JSON is written as it goes, so label and own unique_id are given before
+	hass_populate_unique_id(RELAY, 0, base_id, 0, label);
+	snprintf(uniq_id, HASS_UNIQUE_ID_SIZE, "%s_%s", base_id, label);
+	STR_ReplaceWhiteSpacesWithUnderscore(uniq_id);
+
+	HassDeviceInfo* info = hass_init_device_info_named(RELAY, 0, "1", "0", 0, label, label, uniq_id);
 	if (info == NULL) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "Failed to initialize HassDeviceInfo for toggle");
 		return NULL;
 	}
 
-	cJSON_ReplaceItemInObject(info->root, "name", cJSON_CreateString(label));
-
-	char uniq_id[HASS_UNIQUE_ID_SIZE];
-	snprintf(uniq_id, HASS_UNIQUE_ID_SIZE, "%s_%s", info->unique_id, label);
-	STR_ReplaceWhiteSpacesWithUnderscore(uniq_id);
-	cJSON_ReplaceItemInObject(info->root, "uniq_id", cJSON_CreateString(uniq_id));
-
 	// update the discovery channel with the new unique_id
 	sprintf(info->channel, "switch/%s/config", uniq_id);
 	STR_ReplaceWhiteSpacesWithUnderscore(info->channel);
 
-	cJSON_AddStringToObject(info->root, "stat_t", stateTopic);
+	hass_add_string(info, "stat_t", stateTopic);
 	sprintf(g_hassBuffer, "cmnd/%s/%s", CFG_GetMQTTClientId(), command);
-	cJSON_AddStringToObject(info->root, "cmd_t", g_hassBuffer);
+	hass_add_string(info, "cmd_t", g_hassBuffer);
 
 	return info;
 }
@@ -723,9 +715,9 @@ HassDeviceInfo* hass_init_relay_device_info(int index, ENTITY_TYPE type, bool bT
 	}
 
 	sprintf(g_hassBuffer, "~/%i/get", index);
-	cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);   //state_topic
+	hass_add_string(info, "stat_t", g_hassBuffer);   //state_topic
 	sprintf(g_hassBuffer, "~/%i/set", index);
-	cJSON_AddStringToObject(info->root, "cmd_t", g_hassBuffer);    //command_topic
+	hass_add_string(info, "cmd_t", g_hassBuffer);    //command_topic
 
 	return info;
 }
@@ -746,12 +738,12 @@ HassDeviceInfo* hass_init_light_device_info(ENTITY_TYPE type) {
 	switch (type) {
 	case LIGHT_RGBCW:
 	case LIGHT_RGB:
-		cJSON_AddStringToObject(info->root, "rgb_cmd_tpl", "{{'#%02x%02x%02x0000'|format(red,green,blue)}}");  //rgb_command_template
-		cJSON_AddStringToObject(info->root, "rgb_val_tpl", "{{ value[0:2]|int(base=16) }},{{ value[2:4]|int(base=16) }},{{ value[4:6]|int(base=16) }}");  //rgb_value_template
+		hass_add_string(info, "rgb_cmd_tpl", "{{'#%02x%02x%02x0000'|format(red,green,blue)}}");  //rgb_command_template
+		hass_add_string(info, "rgb_val_tpl", "{{ value[0:2]|int(base=16) }},{{ value[2:4]|int(base=16) }},{{ value[4:6]|int(base=16) }}");  //rgb_value_template
 
-		cJSON_AddStringToObject(info->root, "rgb_stat_t", "~/led_basecolor_rgb/get"); //rgb_state_topic
+		hass_add_string(info, "rgb_stat_t", "~/led_basecolor_rgb/get"); //rgb_state_topic
 		sprintf(g_hassBuffer, "cmnd/%s/led_basecolor_rgb", clientId);
-		cJSON_AddStringToObject(info->root, "rgb_cmd_t", g_hassBuffer);  //rgb_command_topic
+		hass_add_string(info, "rgb_cmd_t", g_hassBuffer);  //rgb_command_topic
 		break;
 
 	case LIGHT_ON_OFF:
@@ -765,7 +757,7 @@ HassDeviceInfo* hass_init_light_device_info(ENTITY_TYPE type) {
 		//Using `last` (the default) will send any style (brightness, color, etc) topics first and then a payload_on to the command_topic. 
 		//Using `first` will send the payload_on and then any style topics. 
 		//Using `brightness` will only send brightness commands instead of the payload_on to turn the light on.
-		cJSON_AddStringToObject(info->root, "on_cmd_type", "first");	//on_command_type
+		hass_add_string(info, "on_cmd_type", "first");	//on_command_type
 		break;
 
 	default:
@@ -774,49 +766,49 @@ HassDeviceInfo* hass_init_light_device_info(ENTITY_TYPE type) {
 
 	if ((type == LIGHT_PWMCW) || (type == LIGHT_RGBCW)) {
 		sprintf(g_hassBuffer, "cmnd/%s/led_temperature", clientId);
-		cJSON_AddStringToObject(info->root, "clr_temp_cmd_t", g_hassBuffer);    //color_temp_command_topic
+		hass_add_string(info, "clr_temp_cmd_t", g_hassBuffer);    //color_temp_command_topic
 
-		cJSON_AddStringToObject(info->root, "clr_temp_stat_t", "~/led_temperature/get");    //color_temp_state_topic
+		hass_add_string(info, "clr_temp_stat_t", "~/led_temperature/get");    //color_temp_state_topic
 
 		sprintf(g_hassBuffer, "%.0f", led_temperature_min);
-		cJSON_AddStringToObject(info->root, "min_mirs", g_hassBuffer);    //min_mireds
+		hass_add_string(info, "min_mirs", g_hassBuffer);    //min_mireds
 
 		sprintf(g_hassBuffer, "%.0f", led_temperature_max);
-		cJSON_AddStringToObject(info->root, "max_mirs", g_hassBuffer);    //max_mireds
+		hass_add_string(info, "max_mirs", g_hassBuffer);    //max_mireds
 	}
 
-	cJSON_AddStringToObject(info->root, "stat_t", "~/led_enableAll/get");  //state_topic
+	hass_add_string(info, "stat_t", "~/led_enableAll/get");  //state_topic
 	sprintf(g_hassBuffer, "cmnd/%s/led_enableAll", clientId);
-	cJSON_AddStringToObject(info->root, "cmd_t", g_hassBuffer);  //command_topic
+	hass_add_string(info, "cmd_t", g_hassBuffer);  //command_topic
 
-	cJSON_AddStringToObject(info->root, "bri_stat_t", "~/led_dimmer/get");  //brightness_state_topic
+	hass_add_string(info, "bri_stat_t", "~/led_dimmer/get");  //brightness_state_topic
 	sprintf(g_hassBuffer, "cmnd/%s/led_dimmer", clientId);
-	cJSON_AddStringToObject(info->root, "bri_cmd_t", g_hassBuffer);  //brightness_command_topic
+	hass_add_string(info, "bri_cmd_t", g_hassBuffer);  //brightness_command_topic
 
-	cJSON_AddNumberToObject(info->root, "bri_scl", brightness_scale);	//brightness_scale
+	JSONW_Number(&info->w, "bri_scl", brightness_scale);	//brightness_scale
 
 #if ENABLE_DRIVER_PIXELANIM
-	if((DRV_IsRunning("SM16703P") || DRV_IsRunning("DMX")) && DRV_IsRunning("PixelAnim"))
+	if((DRV_IsRunning(DRV_ID_SM16703P) || DRV_IsRunning(DRV_ID_DMX)) && DRV_IsRunning(DRV_ID_PixelAnim))
 	{
-		cJSON_AddStringToObject(info->root, "fx_stat_t", "~/currentAnim/get");
+		hass_add_string(info, "fx_stat_t", "~/currentAnim/get");
 		sprintf(g_hassBuffer, "cmnd/%s/anim", CFG_GetMQTTClientId());
-		cJSON_AddStringToObject(info->root, "fx_cmd_t", g_hassBuffer);
+		hass_add_string(info, "fx_cmd_t", g_hassBuffer);
 
 		char entry[64];
-		cJSON* fxmodes = cJSON_CreateArray();
-		cJSON_AddItemToArray(fxmodes, cJSON_CreateString("None"));
+		JSONW_StartArray(&info->w, "fx_list");
+		hass_add_string(info, 0, "None");
 		strcpy(g_hassBuffer, "{{ {");
 		strcat(g_hassBuffer, "'None':-1");
 		for(int i = 0; i < g_numAnims; i++)
 		{
 			const char* mode = g_anims[i].name;
-			cJSON_AddItemToArray(fxmodes, cJSON_CreateString(mode));
+			hass_add_string(info, 0, mode);
 			snprintf(entry, sizeof(entry), ",'%s':%d", g_anims[i].name, i);
 			strcat(g_hassBuffer, entry);
 		}
 		strcat(g_hassBuffer, "}[value] }}");
-		cJSON_AddItemToObject(info->root, "fx_list", fxmodes);
-		cJSON_AddItemToObject(info->root, "fx_cmd_tpl", cJSON_CreateString(g_hassBuffer));
+		JSONW_EndArray(&info->w);
+		hass_add_string(info, "fx_cmd_tpl", g_hassBuffer);
 	}
 #endif
 
@@ -840,7 +832,7 @@ HassDeviceInfo* hass_init_binary_sensor_device_info(int index, bool bInverse) {
 	HassDeviceInfo* info = hass_init_device_info(BINARY_SENSOR, index, payload_on, payload_off, 0, NULL);
 
 	sprintf(g_hassBuffer, "~/%i/get", index);
-	cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);   //state_topic
+	hass_add_string(info, "stat_t", g_hassBuffer);   //state_topic
 
 	return info;
 }
@@ -856,7 +848,7 @@ HassDeviceInfo* hass_init_energy_sensor_device_info(int index, int asensdataseti
 	//https://developers.home-assistant.io/docs/core/entity/sensor/#available-device-classes
 	//device_class automatically assigns unit,icon
 	if (index > OBK__LAST) return info;
-	if (index >= OBK_CONSUMPTION__DAILY_FIRST && !DRV_IsRunning("NTP")) return info; //include daily stats only when time is valid
+	if (index >= OBK_CONSUMPTION__DAILY_FIRST && !DRV_IsRunning(DRV_ID_NTP)) return info; //include daily stats only when time is valid
 #ifdef ENABLE_BL_TWIN
 	//in twin mode, for ix1 is possible to skip OBK_VOLTAGE, dont skip for now
 	//if ((asensdatasetix>0) && (index==OBK_VOLTAGE)) return info;
@@ -865,33 +857,33 @@ HassDeviceInfo* hass_init_energy_sensor_device_info(int index, int asensdataseti
 #endif
 	info = hass_init_device_info(ENERGY_METER_SENSOR, index, NULL, NULL, asensdatasetix, NULL);
 
-	cJSON_AddStringToObject(info->root, "dev_cla", DRV_GetEnergySensorNamesEx(asensdatasetix,index)->hass_dev_class);   //device_class=voltage,current,power, energy, timestamp
+	hass_add_string(info, "dev_cla", DRV_GetEnergySensorNamesEx(asensdatasetix,index)->hass_dev_class);   //device_class=voltage,current,power, energy, timestamp
 	//20241024 XJIKKA unit_of_meas is set bellow (was set twice)
-	//cJSON_AddStringToObject(info->root, "unit_of_meas", DRV_GetEnergySensorNames(index)->units);   //unit_of_measurement. Sets as empty string if not present. HA doesn't seem to mind
+	//hass_add_string(info, "unit_of_meas", DRV_GetEnergySensorNames(index)->units);   //unit_of_measurement. Sets as empty string if not present. HA doesn't seem to mind
 	sprintf(g_hassBuffer, "~/%s/get", DRV_GetEnergySensorNamesEx(asensdatasetix, index)->name_mqtt);
-	cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+	hass_add_string(info, "stat_t", g_hassBuffer);
 
 	if (!strcmp(DRV_GetEnergySensorNamesEx(asensdatasetix, index)->hass_dev_class, "energy")) {
 		//state_class can be measurement, total or total_increasing. Energy values should be total_increasing.
-		cJSON_AddStringToObject(info->root, "stat_cla", "total_increasing");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", CFG_HasFlag(OBK_FLAG_MQTT_ENERGY_IN_KWH) ? "kWh" : "Wh");
+		hass_add_string(info, "stat_cla", "total_increasing");
+		hass_add_string(info, "unit_of_meas", CFG_HasFlag(OBK_FLAG_MQTT_ENERGY_IN_KWH) ? "kWh" : "Wh");
 	} else {
 		//20241024 XJIKKA skip measurement for timestamp - HASS log:
 		//HASS:	energy_clear_date (<class 'homeassistant.components.mqtt.sensor.MqttSensor'>) is using state class 'measurement' 
 		//		which is impossible considering device class ('timestamp') it is using; expected None; 
 		if (strcmp(DRV_GetEnergySensorNamesEx(asensdatasetix, index)->hass_dev_class,"timestamp")) {
-			cJSON_AddStringToObject(info->root, "stat_cla", "measurement");
+			hass_add_string(info, "stat_cla", "measurement");
 		}
 		//20241024 XJIKKA if unit is not set (drv_bl_shared.c @ "power_factor"), mqtt value unit_of_meas was empty - HASS log:
 		//HASS:	sensor...power_factor is using native unit of measurement '' which is not a valid unit 
 		//		for the device class ('power_factor') it is using; expected one of ['no unit of measurement', '%']; 
 		//solution is to skip empty 
 		if (strlen(DRV_GetEnergySensorNamesEx(asensdatasetix, index)->units)>0) {
-			cJSON_AddStringToObject(info->root, "unit_of_meas", DRV_GetEnergySensorNames(index)->units);
+			hass_add_string(info, "unit_of_meas", DRV_GetEnergySensorNames(index)->units);
 		}
 	}
 	// if (index == OBK_CONSUMPTION_STATS) { //hide this as its not working anyway at present
-	// 	cJSON_AddStringToObject(info->root, "enabled_by_default ", "false");
+	// 	hass_add_string(info, "enabled_by_default ", "false");
 	// }
 	return info;
 }
@@ -902,13 +894,13 @@ HassDeviceInfo* hass_init_button_device_info(char* title,char* cmd_id, char* pre
 	const char* clientId = CFG_GetMQTTClientId();
 	info = hass_init_device_info(HASS_BUTTON, 0, press_payload, NULL, 0, title);
 	if (type == HASS_CATEGORY_DIAGNOSTIC){
-		cJSON_AddStringToObject(info->root, "entity_category", "diagnostic");
+		hass_add_string(info, "entity_category", "diagnostic");
 	}
 	else {
-		cJSON_AddStringToObject(info->root, "entity_category", "config");
+		hass_add_string(info, "entity_category", "config");
 	}
 	sprintf(g_hassBuffer, "cmnd/%s/%s", clientId, cmd_id);
-	cJSON_AddStringToObject(info->root, "command_topic", g_hassBuffer);
+	hass_add_string(info, "command_topic", g_hassBuffer);
 	return info;
 }
 
@@ -945,16 +937,16 @@ HassDeviceInfo* hass_init_light_singleColor_onChannels(int toggle, int dimmer, i
 	dev_info = hass_init_device_info(LIGHT_PWM, toggle, "1", "0", 0, NULL);
 
 	sprintf(g_hassBuffer, "~/%i/get", toggle);
-	cJSON_AddStringToObject(dev_info->root, "stat_t", g_hassBuffer);  //state_topic
+	hass_add_string(dev_info, "stat_t", g_hassBuffer);  //state_topic
 	sprintf(g_hassBuffer, "~/%i/set", toggle);
-	cJSON_AddStringToObject(dev_info->root, "cmd_t", g_hassBuffer);  //command_topic
+	hass_add_string(dev_info, "cmd_t", g_hassBuffer);  //command_topic
 
 	sprintf(g_hassBuffer, "~/%i/get", dimmer);
-	cJSON_AddStringToObject(dev_info->root, "bri_stat_t", g_hassBuffer);  //brightness_state_topic
+	hass_add_string(dev_info, "bri_stat_t", g_hassBuffer);  //brightness_state_topic
 	sprintf(g_hassBuffer, "~/%i/set", dimmer);
-	cJSON_AddStringToObject(dev_info->root, "bri_cmd_t", g_hassBuffer);  //brightness_command_topic
+	hass_add_string(dev_info, "bri_cmd_t", g_hassBuffer);  //brightness_command_topic
 
-	cJSON_AddNumberToObject(dev_info->root, "bri_scl", brightness_scale);	//brightness_scale
+	JSONW_Number(&dev_info->w, "bri_scl", brightness_scale);	//brightness_scale
 
 	return dev_info;
 }
@@ -965,206 +957,210 @@ HassDeviceInfo* hass_init_light_singleColor_onChannels(int toggle, int dimmer, i
 HassDeviceInfo* hass_init_sensor_device_info(ENTITY_TYPE type, int channel, int decPlaces, int decOffset, int divider) {
 	//Assuming that there is only one DHT setup per device which keeps uniqueid/names simpler
 	HassDeviceInfo* info = hass_init_device_info(type, channel, NULL, NULL, 0, NULL);	//using channel as index to generate uniqueId
+	// JSON can't be asked what it has, so this remembers if stat_cla was added
+	bool bHasStateClass = false;
 
 	//https://developers.home-assistant.io/docs/core/entity/sensor/#available-device-classes
 	switch (type) {
 	case HASS_PERCENT:
 		// backlog setChannelType 5 Percent; scheduleHADiscovery
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "%");
-		cJSON_AddStringToObject(info->root, "stat_cla", "measurement");
+		hass_add_string(info, "unit_of_meas", "%");
+		hass_add_string(info, "stat_cla", "measurement");
+		bHasStateClass = true;
 
 		// State topic for reading the percentage value
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 
 		// Command topic for writing the percentage value
 		sprintf(g_hassBuffer, "~/%d/set", channel);
-		cJSON_AddStringToObject(info->root, "cmd_t", g_hassBuffer);
+		hass_add_string(info, "cmd_t", g_hassBuffer);
 
 		// Value template to ensure the value is between 0 and 100
-		//cJSON_AddStringToObject(info->root, "val_tpl", "{{ value | float | round(0) | max(0) | min(100) }}");
+		//hass_add_string(info, "val_tpl", "{{ value | float | round(0) | max(0) | min(100) }}");
 
 
 		// Add number-specific properties for the slider
-		cJSON_AddStringToObject(info->root, "mode", "slider"); // Use slider mode in HA
-		cJSON_AddNumberToObject(info->root, "min", 0);        // Minimum value
-		cJSON_AddNumberToObject(info->root, "max", 100);      // Maximum value
-		cJSON_AddNumberToObject(info->root, "step", 1);       // Step value for slider
+		hass_add_string(info, "mode", "slider"); // Use slider mode in HA
+		JSONW_Number(&info->w, "min", 0);        // Minimum value
+		JSONW_Number(&info->w, "max", 100);      // Maximum value
+		JSONW_Number(&info->w, "step", 1);       // Step value for slider
 		break;
 	case TEMPERATURE_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "temperature");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "°C");
+		hass_add_string(info, "dev_cla", "temperature");
+		hass_add_string(info, "unit_of_meas", "°C");
 
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case HUMIDITY_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "humidity");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "%");
+		hass_add_string(info, "dev_cla", "humidity");
+		hass_add_string(info, "unit_of_meas", "%");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case SMOKE_SENSOR:
 		// there is no "smoke" class!
-		//cJSON_AddStringToObject(info->root, "dev_cla", "smoke");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "%");
+		//hass_add_string(info, "dev_cla", "smoke");
+		hass_add_string(info, "unit_of_meas", "%");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case CO2_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "carbon_dioxide");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "ppm");
+		hass_add_string(info, "dev_cla", "carbon_dioxide");
+		hass_add_string(info, "unit_of_meas", "ppm");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break; 
 	case PRESSURE_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "pressure");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "hPa");
+		hass_add_string(info, "dev_cla", "pressure");
+		hass_add_string(info, "unit_of_meas", "hPa");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case TVOC_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "volatile_organic_compounds");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "ppb");
+		hass_add_string(info, "dev_cla", "volatile_organic_compounds");
+		hass_add_string(info, "unit_of_meas", "ppb");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case ILLUMINANCE_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "illuminance");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "lx");
+		hass_add_string(info, "dev_cla", "illuminance");
+		hass_add_string(info, "unit_of_meas", "lx");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case BATTERY_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "battery");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "%");
-		cJSON_AddStringToObject(info->root, "stat_t", "~/battery/get");
+		hass_add_string(info, "dev_cla", "battery");
+		hass_add_string(info, "unit_of_meas", "%");
+		hass_add_string(info, "stat_t", "~/battery/get");
 		break;
 	case BATTERY_CHANNEL_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "battery");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "%");
+		hass_add_string(info, "dev_cla", "battery");
+		hass_add_string(info, "unit_of_meas", "%");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case BATTERY_VOLTAGE_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "voltage");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "mV");
-		cJSON_AddStringToObject(info->root, "stat_t", "~/voltage/get");
+		hass_add_string(info, "dev_cla", "voltage");
+		hass_add_string(info, "unit_of_meas", "mV");
+		hass_add_string(info, "stat_t", "~/voltage/get");
 		break;
 	case VOLTAGE_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "voltage");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "V");
+		hass_add_string(info, "dev_cla", "voltage");
+		hass_add_string(info, "unit_of_meas", "V");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case CURRENT_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "current");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "A");
+		hass_add_string(info, "dev_cla", "current");
+		hass_add_string(info, "unit_of_meas", "A");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case POWER_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "power");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "W");
+		hass_add_string(info, "dev_cla", "power");
+		hass_add_string(info, "unit_of_meas", "W");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case ENERGY_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "energy");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "kWh");
+		hass_add_string(info, "dev_cla", "energy");
+		hass_add_string(info, "unit_of_meas", "kWh");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_cla", "total_increasing");
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_cla", "total_increasing");
+		bHasStateClass = true;
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case POWERFACTOR_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "power_factor");
-		//cJSON_AddStringToObject(info->root, "unit_of_meas", "W");
+		hass_add_string(info, "dev_cla", "power_factor");
+		//hass_add_string(info, "unit_of_meas", "W");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case FREQUENCY_SENSOR:
-		cJSON_AddStringToObject(info->root, "dev_cla", "frequency");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "Hz");
+		hass_add_string(info, "dev_cla", "frequency");
+		hass_add_string(info, "unit_of_meas", "Hz");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case HASS_READONLYENUM:
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		// str sensor can't have state_class, so return before it gets set
 		return info;
 	case CUSTOM_SENSOR:
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case READONLYLOWMIDHIGH_SENSOR:
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
-		cJSON_AddStringToObject(info->root, "val_tpl", g_template_lowMidHigh);
+		hass_add_string(info, "stat_t", g_hassBuffer);
+		hass_add_string(info, "val_tpl", g_template_lowMidHigh);
 		break;
 	case WATER_QUALITY_PH:
-		cJSON_AddStringToObject(info->root, "dev_cla", "ph");
-		//cJSON_AddStringToObject(info->root, "unit_of_meas", "Ph");
+		hass_add_string(info, "dev_cla", "ph");
+		//hass_add_string(info, "unit_of_meas", "Ph");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case WATER_QUALITY_ORP:
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "mV");
+		hass_add_string(info, "unit_of_meas", "mV");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case WATER_QUALITY_TDS:
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "ppm");
+		hass_add_string(info, "unit_of_meas", "ppm");
 		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_add_string(info, "stat_t", g_hassBuffer);
 		break;
 	case HASS_TEMP:
-		cJSON_AddStringToObject(info->root, "dev_cla", "temperature");
-		cJSON_AddStringToObject(info->root, "stat_t", "~/temp");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "°C");
-		cJSON_AddStringToObject(info->root, "entity_category", "diagnostic");
+		hass_add_string(info, "dev_cla", "temperature");
+		hass_add_string(info, "stat_t", "~/temp");
+		hass_add_string(info, "unit_of_meas", "°C");
+		hass_add_string(info, "entity_category", "diagnostic");
 		break;
 	case HASS_RSSI:
-		cJSON_AddStringToObject(info->root, "dev_cla", "signal_strength");
-		cJSON_AddStringToObject(info->root, "stat_t", "~/rssi");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "dBm");
-		cJSON_AddStringToObject(info->root, "entity_category", "diagnostic");
+		hass_add_string(info, "dev_cla", "signal_strength");
+		hass_add_string(info, "stat_t", "~/rssi");
+		hass_add_string(info, "unit_of_meas", "dBm");
+		hass_add_string(info, "entity_category", "diagnostic");
 		break;
 	case HASS_UPTIME:
-		cJSON_AddStringToObject(info->root, "dev_cla", "duration");
-		cJSON_AddStringToObject(info->root, "stat_t", "~/uptime");
-		cJSON_AddStringToObject(info->root, "unit_of_meas", "s");
-		cJSON_AddStringToObject(info->root, "entity_category", "diagnostic");
-		cJSON_AddStringToObject(info->root, "stat_cla", "total_increasing");
+		hass_add_string(info, "dev_cla", "duration");
+		hass_add_string(info, "stat_t", "~/uptime");
+		hass_add_string(info, "unit_of_meas", "s");
+		hass_add_string(info, "entity_category", "diagnostic");
+		hass_add_string(info, "stat_cla", "total_increasing");
+		bHasStateClass = true;
 		break;
 	case HASS_BUILD:
-		cJSON_AddStringToObject(info->root, "stat_t", "~/build");
-		cJSON_AddStringToObject(info->root, "entity_category", "diagnostic");
+		hass_add_string(info, "stat_t", "~/build");
+		hass_add_string(info, "entity_category", "diagnostic");
 		break;
 	case HASS_SSID:
-		cJSON_AddStringToObject(info->root, "stat_t", "~/ssid");
-		cJSON_AddStringToObject(info->root, "entity_category", "diagnostic");
-		cJSON_AddStringToObject(info->root, "icon", "mdi:access-point-network");
+		hass_add_string(info, "stat_t", "~/ssid");
+		hass_add_string(info, "entity_category", "diagnostic");
+		hass_add_string(info, "icon", "mdi:access-point-network");
 		break;
 	case HASS_IP:
-		cJSON_AddStringToObject(info->root, "stat_t", "~/ip");
-		cJSON_AddStringToObject(info->root, "entity_category", "diagnostic");
-		cJSON_AddStringToObject(info->root, "icon", "mdi:ip-network");
+		hass_add_string(info, "stat_t", "~/ip");
+		hass_add_string(info, "entity_category", "diagnostic");
+		hass_add_string(info, "icon", "mdi:ip-network");
 		break;
 	default:
-		sprintf(g_hassBuffer, "~/%d/get", channel);
-		cJSON_AddStringToObject(info->root, "stat_t", g_hassBuffer);
+		hass_free_device_info(info);
 		return NULL;
 	}
 
-	if (type != READONLYLOWMIDHIGH_SENSOR && type != HASS_BUILD && type != HASS_SSID && type != HASS_IP && !cJSON_HasObjectItem(info->root, "stat_cla")) {
-		cJSON_AddStringToObject(info->root, "stat_cla", "measurement");
+	if (type != READONLYLOWMIDHIGH_SENSOR && type != HASS_BUILD && type != HASS_SSID && type != HASS_IP && !bHasStateClass) {
+		hass_add_string(info, "stat_cla", "measurement");
 	}
 
 
 	if (decPlaces != -1 && decOffset != -1 && divider != -1 && type != HASS_PERCENT) {
 		//https://www.home-assistant.io/integrations/sensor.mqtt/ refers to value_template (val_tpl)
-		cJSON_AddStringToObject(info->root, "val_tpl", hass_generate_multiplyAndRound_template(decPlaces, decOffset, divider));
+		hass_add_string(info, "val_tpl", hass_generate_multiplyAndRound_template(decPlaces, decOffset, divider));
 	}
 
 	return info;
@@ -1178,8 +1174,13 @@ const char* hass_build_discovery_json(HassDeviceInfo* info) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "ERROR: someone passed NULL pointer to hass_build_discovery_json\r\n");
 		return "";
 	}
-	int bOk = cJSON_PrintPreallocated(info->root, info->json, HASS_JSON_SIZE, 0);
-	if (bOk == false) {
+	if (info->bFinished == false) {
+		JSONW_EndObject(&info->w);
+		info->json[info->out.replylen] = 0;
+		info->bFinished = true;
+	}
+	// writer cuts what does not fit, one byte of buffer is there to tell
+	if (info->out.replylen >= HASS_JSON_SIZE) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_HASS, "ERROR: too long JSON in hass_build_discovery_json\r\n");
 		return "";
 	}
@@ -1193,11 +1194,137 @@ void hass_free_device_info(HassDeviceInfo* info) {
 		return;
 	//addLogAdv(LOG_DEBUG, LOG_FEATURE_HASS, "hass_free_device_info \r\n");
 
-	if (info->root != NULL) {
-		cJSON_Delete(info->root);
+	os_free(info);
+}
+
+// Discovery is run on every boot, IP change and config change and most of the
+// time nothing is different, so hashes of queued payloads are remembered
+// and only entities with changed payload are published again. Hashes are kept
+// in LittleFS, so they survive reboot. Broker host is part of the key, so
+// new broker gets everything.
+#define HASS_CACHE_SIZE		64
+#define HASS_CACHE_FILE		"hass.cache"
+
+typedef struct hassCacheEntry_s {
+	// hash of broker, discovery prefix and entity config topic
+	unsigned int key;
+	unsigned int payload;
+} hassCacheEntry_t;
+
+static hassCacheEntry_t g_hassCache[HASS_CACHE_SIZE];
+static int g_hassCacheCount = 0;
+static bool g_hassCacheLoaded = false;
+static bool g_hassCacheDirty = false;
+static int g_hassSent = 0;
+static int g_hassSkipped = 0;
+
+static unsigned int hass_hash(unsigned int h, const char* s) {
+	while (*s) {
+		h = ((h << 5) + h) + (unsigned char)*s;
+		s++;
 	}
+	return h;
+}
+static void hass_cache_load() {
+#if ENABLE_LITTLEFS
+	lfs_file_t* file;
+	int len;
+#endif
 
-	os_free(info);
+	g_hassCacheLoaded = true;
+	g_hassCacheCount = 0;
+#if ENABLE_LITTLEFS
+	if (!lfs_present()) {
+		return;
+	}
+	file = (lfs_file_t*)os_malloc(sizeof(lfs_file_t));
+	if (file == 0) {
+		return;
+	}
+	memset(file, 0, sizeof(lfs_file_t));
+	if (lfs_file_open(&lfs, file, HASS_CACHE_FILE, LFS_O_RDONLY) >= 0) {
+		len = lfs_file_read(&lfs, file, g_hassCache, sizeof(g_hassCache));
+		if (len > 0) {
+			g_hassCacheCount = len / sizeof(hassCacheEntry_t);
+		}
+		lfs_file_close(&lfs, file);
+	}
+	os_free(file);
+#endif
+}
+static void hass_cache_save() {
+#if ENABLE_LITTLEFS
+	lfs_file_t* file;
+
+	if (!lfs_present()) {
+		return;
+	}
+	file = (lfs_file_t*)os_malloc(sizeof(lfs_file_t));
+	if (file == 0) {
+		return;
+	}
+	memset(file, 0, sizeof(lfs_file_t));
+	if (lfs_file_open(&lfs, file, HASS_CACHE_FILE, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) >= 0) {
+		lfs_file_write(&lfs, file, g_hassCache, g_hassCacheCount * sizeof(hassCacheEntry_t));
+		lfs_file_close(&lfs, file);
+		g_hassCacheDirty = false;
+	}
+	os_free(file);
+#endif
+}
+
+/// @brief Queue discovery JSON of given entity, unless the same payload was queued before.
+/// @param topic discovery prefix
+/// @param info
+/// @return true if it was queued
+bool hass_publish_discovery(const char* topic, HassDeviceInfo* info) {
+	unsigned int key, payload;
+	const char* json;
+	int i;
+
+	if (g_hassCacheLoaded == false) {
+		hass_cache_load();
+	}
+	json = hass_build_discovery_json(info);
+	key = hass_hash(hass_hash(hass_hash(5381, CFG_GetMQTTHost()), topic), info->channel);
+	payload = hass_hash(5381, json);
+	for (i = 0; i < g_hassCacheCount; i++) {
+		if (g_hassCache[i].key == key) {
+			break;
+		}
+	}
+	if (i < g_hassCacheCount && g_hassCache[i].payload == payload) {
+		g_hassSkipped++;
+		return false;
+	}
+	MQTT_QueuePublish(topic, info->channel, json, OBK_PUBLISH_FLAG_RETAIN);
+	g_hassSent++;
+	if (i == g_hassCacheCount) {
+		if (g_hassCacheCount >= HASS_CACHE_SIZE) {
+			// no room, this one will just be sent every time
+			return true;
+		}
+		g_hassCacheCount++;
+		g_hassCache[i].key = key;
+	}
+	g_hassCache[i].payload = payload;
+	g_hassCacheDirty = true;
+	return true;
+}
+/// @brief Forget queued payloads, so next discovery publishes all entities.
+void hass_clear_discovery_cache() {
+	g_hassCacheLoaded = true;
+	g_hassCacheDirty = g_hassCacheCount != 0;
+	g_hassCacheCount = 0;
+}
+/// @brief Called after discovery run, stores cache if it has changed.
+void hass_discovery_finished() {
+	addLogAdv(LOG_INFO, LOG_FEATURE_HASS, "HA discovery: %i entities queued, %i unchanged\r\n", g_hassSent, g_hassSkipped);
+	g_hassSent = 0;
+	g_hassSkipped = 0;
+	if (g_hassCacheDirty) {
+		hass_cache_save();
+	}
 }
 
 #endif // ENABLE_HA_DISCOVERY
@@ -4,7 +4,6 @@
 
 #if ENABLE_HA_DISCOVERY
 
-#include "../cJSON/cJSON.h"
 #include "../new_pins.h"
 #include "../mqtt/new_mqtt.h"
 #include "../cmnds/cmd_public.h"
@@ -126,11 +125,12 @@ typedef enum {
 typedef struct HassDeviceInfo_s {
 	char unique_id[HASS_UNIQUE_ID_SIZE];
 	char channel[HASS_CHANNEL_SIZE];
-	char json[HASS_JSON_SIZE];
-
-	cJSON* root;
-	cJSON* device;
-	cJSON* ids;
+	// discovery JSON, fields are written into it by w as they are added
+	char json[HASS_JSON_SIZE + 1];
+	http_request_t out;
+	jsonWriter_t w;
+	// set when object was closed by hass_build_discovery_json
+	bool bFinished;
 } HassDeviceInfo;
 
 void hass_print_unique_id(http_request_t* request, const char* fmt, ENTITY_TYPE type, int index, int asensdatasetix);
@@ -158,6 +158,9 @@ HassDeviceInfo* hass_createToggle(const char *label, const char *stateTopic, con
 HassDeviceInfo* hass_init_textField_info(int index);
 const char* hass_build_discovery_json(HassDeviceInfo* info);
 void hass_free_device_info(HassDeviceInfo* info); 
+bool hass_publish_discovery(const char* topic, HassDeviceInfo* info);
+void hass_clear_discovery_cache();
+void hass_discovery_finished();
 char *hass_generate_multiplyAndRound_template(int decimalPlacesForRounding, int decimalPointOffset, int divider);
 HassDeviceInfo* hass_init_textField_info(int index);
 HassDeviceInfo* hass_init_button_device_info(char* title,char* cmd_id, char* press_payload, HASS_CATEGORY_TYPE type);
@@ -262,10 +262,10 @@ int http_fn_index(http_request_t* request) {
 	// user override is always stronger, so if no override set
 	if (bForceShowRGB == false && bForceShowRGBCW == false) {
 #ifndef OBK_DISABLE_ALL_DRIVERS
-		if (DRV_IsRunning("SM16703P")) {
+		if (DRV_IsRunning(DRV_ID_SM16703P)) {
 			bForceShowRGB = true;
 		}
-		if (DRV_IsRunning("DMX")) {
+		if (DRV_IsRunning(DRV_ID_DMX)) {
 			bForceShowRGB = true;
 		}
 #endif
@@ -279,12 +279,12 @@ int http_fn_index(http_request_t* request) {
 
 		poststr(request, "<div id=\"changed\">");
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
-		if (DRV_IsRunning("PWMToggler")) {
+		if (DRV_IsRunning(DRV_ID_PWMToggler)) {
 			DRV_Toggler_ProcessChanges(request);
 		}
 #endif
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
-		if (DRV_IsRunning("httpButtons")) {
+		if (DRV_IsRunning(DRV_ID_HTTPButtons)) {
 			DRV_HTTPButtons_ProcessChanges(request);
 		}
 #endif
@@ -390,7 +390,8 @@ int http_fn_index(http_request_t* request) {
 		DRV_AppendInformationToHTTPIndexPage(request, true);
 #endif
 
-		poststr(request, "<div id=\"state\">"); // replaceable content follows
+		// version lets page script ask only for changes, see http_fn_state
+		hprintf255(request, "<div id=\"state\" data-ver=\"%i\">", CHANNEL_GetStateVersion()); // replaceable content follows
 	}
 
 #if ENABLE_OBK_BERRY
@@ -718,16 +719,13 @@ int http_fn_index(http_request_t* request) {
 			channelTitle = ChannelType_GetTitle(channelType);
 
 			if (*channelTitle) {
-				int div;
 				const char *channelUnit;
 				char formatStr[16];
 				strcpy(formatStr, " %.4f");
 
-				div = ChannelType_GetDivider(channelType);
 				channelUnit = ChannelType_GetUnit(channelType);
 
-				iValue = CHANNEL_Get(i);
-				fValue = (float)iValue / (float)div;
+				fValue = CHANNEL_GetFinalValue(i);
 
 				poststr(request, "<tr><td>");
 				poststr(request, channelTitle);
@@ -744,7 +742,7 @@ int http_fn_index(http_request_t* request) {
 
 	bool bForceShowSingleDimmer = 0;
 #if	ENABLE_DRIVER_GOSUNDSW2
-	if (DRV_IsRunning("GosundSW2")) {
+	if (DRV_IsRunning(DRV_ID_GosundSW2)) {
 		bForceShowSingleDimmer = 1;
 	}
 #endif
@@ -827,7 +825,7 @@ int http_fn_index(http_request_t* request) {
 		}
 		bool bShowCWForPixelAnim = false;
 #if ENABLE_DRIVER_PIXELANIM
-		if (DRV_IsRunning("PixelAnim")) {
+		if (DRV_IsRunning(DRV_ID_PixelAnim)) {
 			if (c_realPwms == 2)
 				bShowCWForPixelAnim = true;
 			PixelAnim_CreatePanel(request);
@@ -865,19 +863,22 @@ int http_fn_index(http_request_t* request) {
 	}
 #endif
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
-	if (DRV_IsRunning("PWMToggler")) {
+	if (DRV_IsRunning(DRV_ID_PWMToggler)) {
 		DRV_Toggler_AddToHtmlPage(request);
 	}
 #endif
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
-	if (DRV_IsRunning("httpButtons")) {
+	if (DRV_IsRunning(DRV_ID_HTTPButtons)) {
 		DRV_HTTPButtons_AddToHtmlPage(request);
 	}
 #endif
 
 	poststr(request, "</table>");
 #ifndef OBK_DISABLE_ALL_DRIVERS
+	// replaced alone by page script when only driver values changed
+	poststr(request, "<div id=\"drv\">");
 	DRV_AppendInformationToHTTPIndexPage(request, false);
+	poststr(request, "</div>");
 #endif
 
 	if (1) {
@@ -940,8 +941,9 @@ int http_fn_index(http_request_t* request) {
 			hprintf255(request, "will start in %i!</h5>", g_startPingWatchDogAfter);
 		}
 		else {
-			hprintf255(request, "%i lost, %i ok, last reply was %is ago!</h5>",
-				PingWatchDog_GetTotalLost(), PingWatchDog_GetTotalReceived(), g_timeSinceLastPingReply);
+			hprintf255(request, "%i lost, %i ok, last reply was %is ago, now every %us!</h5>",
+				PingWatchDog_GetTotalLost(), PingWatchDog_GetTotalReceived(), g_timeSinceLastPingReply,
+				PingWatchDog_GetStats()->intervalMs / 1000);
 		}
 	}
 #endif
@@ -1122,7 +1124,7 @@ typedef enum {
 	// or we might try and hide/unhide it ...
 */
 	// since we can't simply stop showing the graph in updated status, we need to "hide" it if driver was stopped
-	if (! DRV_IsRunning("Charts")) {
+	if (! DRV_IsRunning(DRV_ID_Charts)) {
 		poststr(request, "<style onload=\"document.getElementById('obkChart').style.display='none'\"></style>");		
 	};
 
@@ -1150,7 +1152,7 @@ typedef enum {
 	// drawback : We need to take care, if driver is loaded and canvas will be displayed only on a reload of the page
 	// or we might try and hide/unhide it ...
 */
-//	if (DRV_IsRunning("Charts")) {
+//	if (DRV_IsRunning(DRV_ID_Charts)) {
 		poststr(request, "<canvas style='display: none' id=\"obkChart\" width=\"400\" height=\"200\"></canvas>");
 		poststr(request, "<script src=\"https://cdn.jsdelivr.net/npm/chart.js\"></script>");
 //	};
@@ -1186,6 +1188,106 @@ typedef enum {
 	return 0;
 }
 
+unsigned int http_hashString(const char* s) {
+	unsigned int hash = 5381;
+	while (*s) {
+		hash = ((hash << 5) + hash) + (byte)*s;
+		s++;
+	}
+	return hash;
+}
+// drivers and LED state have no change notifications, so their state
+// version is bumped when their output differs from last poll
+static void http_checkStateChanged(const char* s, unsigned int* hash, int* version) {
+	unsigned int h = http_hashString(s);
+	if (*version == 0 || h != *hash) {
+		*hash = h;
+		*version = CHANNEL_BumpStateVersion();
+	}
+}
+#ifndef OBK_DISABLE_ALL_DRIVERS
+// renders driver part of index state into buffer, without sending
+void http_captureDriverInfo(char* buffer, int size) {
+	http_request_t capture;
+
+	memset(&capture, 0, sizeof(capture));
+	capture.fd = -1;
+	capture.reply = buffer;
+	capture.replymaxlen = size;
+	DRV_AppendInformationToHTTPIndexPage(&capture, false);
+	buffer[capture.replylen] = 0;
+}
+#endif
+// JSON state for polling by page script, with only channels and driver
+// info changed since given version: state?since=123
+// "full" is set when client should fetch whole index?state=1 again
+int http_fn_state(http_request_t* request) {
+	static unsigned int drvHash = 0;
+	static int drvVersion = 0;
+	char tmpA[64];
+	char* drv = 0;
+	int since, ver, i, bFirst;
+	bool bFull;
+#if ENABLE_LED_BASIC
+	static unsigned int ledHash = 0;
+	static int ledVersion = 0;
+	char color[16];
+#endif
+
+	since = 0;
+	if (http_getArg(request->url, "since", tmpA, sizeof(tmpA))) {
+		since = atoi(tmpA);
+	}
+	bFull = false;
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	drv = malloc(HTTP_STATE_DRV_BUFFER);
+	if (drv) {
+		http_captureDriverInfo(drv, HTTP_STATE_DRV_BUFFER);
+		http_checkStateChanged(drv, &drvHash, &drvVersion);
+	}
+	else {
+		bFull = true;
+	}
+#endif
+#if ENABLE_LED_BASIC
+	LED_GetBaseColorString(color);
+	snprintf(tmpA, sizeof(tmpA), "%i %.1f %i %.0f %s", LED_GetEnableAll(), LED_GetDimmer(),
+		LED_GetMode(), LED_GetTemperature(), color);
+	http_checkStateChanged(tmpA, &ledHash, &ledVersion);
+	// LED widgets depend on many values, so page will re-render them
+	if (ledVersion > since) {
+		bFull = true;
+	}
+#endif
+	ver = CHANNEL_GetStateVersion();
+	// version from before reboot, or from page without state
+	if (since <= 0 || since > ver) {
+		bFull = true;
+	}
+
+	http_setup(request, httpMimeTypeJson);
+	hprintf255(request, "{\"ver\":%i,\"full\":%i,\"ch\":{", ver, bFull);
+	bFirst = 1;
+	for (i = 0; i < CHANNEL_MAX && !bFull; i++) {
+		if (CHANNEL_GetChangeVersion(i) > since) {
+			hprintf255(request, "%s\"%i\":%i", bFirst ? "" : ",", i, CHANNEL_Get(i));
+			bFirst = 0;
+		}
+	}
+	poststr(request, "}");
+	if (drv && !bFull && drvVersion > since) {
+		poststr(request, ",\"drv\":\"");
+		poststr_escapedForJSON(request, drv);
+		poststr(request, "\"");
+	}
+	poststr(request, "}");
+	if (drv) {
+		free(drv);
+	}
+	poststr(request, NULL);
+	return 0;
+}
+
 int http_fn_about(http_request_t* request) {
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "About");
@@ -1965,6 +2067,9 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 #if PLATFORM_TXW81X
 	hooks.malloc_fn = _os_malloc;
 	hooks.free_fn = _os_free;
+#elif ENABLE_HEAP_TRACKER
+	hooks.malloc_fn = HeapTrack_HookMalloc;
+	hooks.free_fn = HeapTrack_HookFree;
 #else
 	hooks.malloc_fn = os_malloc;
 	hooks.free_fn = os_free;
@@ -2023,7 +2128,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 			BIT_SET(flagsChannelPublished, toggle);
 			BIT_SET(flagsChannelPublished, dimmer);
 			dev_info = hass_init_light_singleColor_onChannels(toggle, dimmer, brightness_scale);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+			hass_publish_discovery(topic, dev_info);
 			hass_free_device_info(dev_info);
 			discoveryQueued = true;
 		}
@@ -2040,7 +2145,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 			dev_info = hass_init_light_device_info(LIGHT_RGBCW);
 		}
 		// Enable + RGB control + CW control
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_publish_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 		dev_info = NULL;
 		discoveryQueued = true;
@@ -2062,7 +2167,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 		}
 
 		if (dev_info != NULL) {
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+			hass_publish_discovery(topic, dev_info);
 			hass_free_device_info(dev_info);
 			dev_info = NULL;
 			discoveryQueued = true;
@@ -2076,7 +2181,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 		{
 			dev_info = hass_init_energy_sensor_device_info(i, BL_SENSORS_IX_0);
 			if (dev_info) {
-				MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+				hass_publish_discovery(topic, dev_info);
 				hass_free_device_info(dev_info);
 				discoveryQueued = true;
 			}
@@ -2084,7 +2189,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 				//20250319 XJIKKA to simplify and save space in flash frequency together with voltage
 				dev_info = hass_init_sensor_device_info(FREQUENCY_SENSOR, SPECIAL_CHANNEL_OBK_FREQUENCY, -1, -1, -1);
 				if (dev_info) {
-					MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+					hass_publish_discovery(topic, dev_info);
 					hass_free_device_info(dev_info);
 					discoveryQueued = true;
 				}
@@ -2097,7 +2202,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 			{
 				dev_info = hass_init_energy_sensor_device_info(i, BL_SENSORS_IX_1);
 				if (dev_info) {
-					MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+					hass_publish_discovery(topic, dev_info);
 					hass_free_device_info(dev_info);
 					discoveryQueued = true;
 				}
@@ -2109,11 +2214,11 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 
 	if (measuringBattery == true) {
 		dev_info = hass_init_sensor_device_info(BATTERY_SENSOR, 0, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_publish_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 
 		dev_info = hass_init_sensor_device_info(BATTERY_VOLTAGE_SENSOR, 0, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_publish_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 
 		discoveryQueued = true;
@@ -2125,14 +2230,14 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 			// TODO: flags are 32 bit and there are 64 max channels
 			BIT_SET(flagsChannelPublished, ch);
 			dev_info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, ch, 2, 1, 1);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+			hass_publish_discovery(topic, dev_info);
 			hass_free_device_info(dev_info);
 
 			ch = PIN_GetPinChannel2ForPinIndex(i);
 			// TODO: flags are 32 bit and there are 64 max channels
 			BIT_SET(flagsChannelPublished, ch);
 			dev_info = hass_init_sensor_device_info(HUMIDITY_SENSOR, ch, -1, -1, 1);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+			hass_publish_discovery(topic, dev_info);
 			hass_free_device_info(dev_info);
 
 			discoveryQueued = true;
@@ -2142,14 +2247,14 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 			// TODO: flags are 32 bit and there are 64 max channels
 			BIT_SET(flagsChannelPublished, ch);
 			dev_info = hass_init_sensor_device_info(CO2_SENSOR, ch, -1, -1, 1);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+			hass_publish_discovery(topic, dev_info);
 			hass_free_device_info(dev_info);
 
 			ch = PIN_GetPinChannel2ForPinIndex(i);
 			// TODO: flags are 32 bit and there are 64 max channels
 			BIT_SET(flagsChannelPublished, ch);
 			dev_info = hass_init_sensor_device_info(TVOC_SENSOR, ch, -1, -1, 1);
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+			hass_publish_discovery(topic, dev_info);
 			hass_free_device_info(dev_info);
 
 			discoveryQueued = true;
@@ -2175,13 +2280,13 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 			case ChType_Motion:
 			{
 				dev_info = hass_init_binary_sensor_device_info(i, true);
-				cJSON_AddStringToObject(dev_info->root, "dev_cla", "motion");
+				JSONW_String(&dev_info->w, "dev_cla", "motion");
 			}
 			break;
 			case ChType_Motion_n:
 			{
 				dev_info = hass_init_binary_sensor_device_info(i, false);
-				cJSON_AddStringToObject(dev_info->root, "dev_cla", "motion");
+				JSONW_String(&dev_info->w, "dev_cla", "motion");
 			}
 			break;
 			case ChType_OpenClosed:
@@ -2415,7 +2520,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 			break;
 		}
 		if (dev_info) {
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+			hass_publish_discovery(topic, dev_info);
 			hass_free_device_info(dev_info);
 
 			BIT_SET(flagsChannelPublished, i);
@@ -2440,7 +2545,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 			else {
 				dev_info = hass_init_relay_device_info(i, RELAY, bToggleInv);
 			}
-			MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+			hass_publish_discovery(topic, dev_info);
 			hass_free_device_info(dev_info);
 			dev_info = NULL;
 			discoveryQueued = true;
@@ -2456,7 +2561,7 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 				// TODO: flags are 32 bit and there are 64 max channels
 				BIT_SET(flagsChannelPublished, i);
 				dev_info = hass_init_binary_sensor_device_info(i, false);
-				MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+				hass_publish_discovery(topic, dev_info);
 				hass_free_device_info(dev_info);
 				dev_info = NULL;
 				discoveryQueued = true;
@@ -2467,27 +2572,28 @@ void doHomeAssistantDiscovery(const char* topic, http_request_t* request) {
 		//use -1 for channel as these don't correspond to channels
 #ifndef NO_CHIP_TEMPERATURE
 		dev_info = hass_init_sensor_device_info(HASS_TEMP, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_publish_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 #endif
 		dev_info = hass_init_sensor_device_info(HASS_RSSI, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_publish_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 		dev_info = hass_init_sensor_device_info(HASS_UPTIME, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_publish_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 		dev_info = hass_init_sensor_device_info(HASS_BUILD, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_publish_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 		dev_info = hass_init_sensor_device_info(HASS_SSID, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_publish_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 		dev_info = hass_init_sensor_device_info(HASS_IP, -1, -1, -1, 1);
-		MQTT_QueuePublish(topic, dev_info->channel, hass_build_discovery_json(dev_info), OBK_PUBLISH_FLAG_RETAIN);
+		hass_publish_discovery(topic, dev_info);
 		hass_free_device_info(dev_info);
 		discoveryQueued = true;
 
 	}
+	hass_discovery_finished();
 	if (discoveryQueued) {
 		MQTT_InvokeCommandAtEnd(PublishChannels);
 	}
@@ -2520,6 +2626,8 @@ int http_fn_ha_discovery(http_request_t* request) {
 	// even if it returns the empty HA topic,
 	// the function call below will set default
 	http_getArg(request->url, "prefix", topic, sizeof(topic));
+	// asked by user, so send everything
+	hass_clear_discovery_cache();
 	doHomeAssistantDiscovery(topic, request);
 
 	poststr(request, "MQTT discovery queued.");
@@ -2735,7 +2843,7 @@ int http_fn_ha_cfg(http_request_t* request) {
 	poststr(request, "<br/><div><label for=\"ha_disc_topic\">Discovery topic:</label><input id=\"ha_disc_topic\" value=\"homeassistant\"><button onclick=\"send_ha_disc();\">Start Home Assistant Discovery</button>&nbsp;<form action=\"cfg_mqtt\" class='disp-inline'><button type=\"submit\">Configure MQTT</button></form></div><br/>");
 	poststr(request, htmlFooterReturnToCfgOrMainPage);
 	http_html_end(request);
-	poststr(request, ha_discovery_script);
+	postconst(request, ha_discovery_script);
 	poststr(request, NULL);
 	return 0;
 }
@@ -2750,8 +2858,12 @@ void runHTTPCommandInternal(http_request_t* request, const char *cmd) {
 		JSON_ProcessCommandReply(cmd, skipToNextWord(cmd), request, (jsonCb_t)hprintf255, COMMAND_FLAG_SOURCE_HTTP);
 	}
 	else {
-		const char *s = Tokenizer_GetArg(0);
-		poststr(request, s);
+		// echo ran in its own tokenizer context, so expand its argument again here
+		tokenizer_t *prev;
+		prev = Tokenizer_Enter();
+		Tokenizer_TokenizeString(skipToNextWord(cmd), TOKENIZER_ALTERNATE_EXPAND_AT_START | TOKENIZER_FORCE_SINGLE_ARGUMENT_MODE);
+		poststr(request, Tokenizer_GetArg(0));
+		Tokenizer_Leave(prev);
 	}
 #endif
 }
@@ -23,6 +23,11 @@ int http_fn_cfg(http_request_t* request);
 int http_fn_cfg_pins(http_request_t* request);
 int http_fn_cfg_ping(http_request_t* request);
 int http_fn_index(http_request_t* request);
+int http_fn_state(http_request_t* request);
+// driver part of index state, for change checks by state and event stream
+#define HTTP_STATE_DRV_BUFFER	2048
+void http_captureDriverInfo(char* buffer, int size);
+unsigned int http_hashString(const char* s);
 int http_fn_testmsg(http_request_t* request);
 int http_fn_ota_exec(http_request_t* request);
 int http_fn_ota(http_request_t* request);
@@ -0,0 +1,332 @@
+#include "../new_common.h"
+#include "../logging/logging.h"
+#include "../new_pins.h"
+#include "new_http.h"
+#include "http_fns.h"
+#include "http_sse.h"
+
+#if ENABLE_HTTP_SSE
+
+// Server-Sent Events: page opens long-lived "events" request and gets
+// channel changes, log lines and driver info pushed as they happen,
+// instead of polling. Each client has a bounded backlog. When it
+// overflows (client too slow) backlog is dropped and client gets
+// "reset" event, so it can fetch whole state again.
+// Nothing here may log, log lines are published from addLogAdv.
+#ifndef SSE_MAX_CLIENTS
+#define SSE_MAX_CLIENTS				2
+#endif
+#ifndef SSE_BACKLOG_SIZE
+#define SSE_BACKLOG_SIZE			1536
+#endif
+// comment line is sent on idle stream, so dead clients are noticed
+#define SSE_PING_INTERVAL_MS		15000
+#define SSE_DRIVERS_INTERVAL_MS		1000
+#define SSE_POLL_DELAY_MS			50
+
+typedef struct sseClient_s {
+	// subscribed kinds, 0 when slot is free
+	int mask;
+	char* backlog;
+	int head;
+	int count;
+	bool bLost;
+} sseClient_t;
+
+static sseClient_t g_sseClients[SSE_MAX_CLIENTS];
+static volatile int g_sseMask = 0;
+static SemaphoreHandle_t g_sseMutex = 0;
+
+static const char g_sseReset[] = "event: reset\ndata: 1\n\n";
+
+static bool SSE_Mutex_Take(int del) {
+	int taken;
+
+	if (g_sseMutex == 0)
+	{
+		g_sseMutex = xSemaphoreCreateMutex();
+	}
+	taken = xSemaphoreTake(g_sseMutex, del);
+	if (taken == pdTRUE) {
+		return true;
+	}
+	return false;
+}
+static void SSE_Mutex_Free() {
+	xSemaphoreGive(g_sseMutex);
+}
+static void SSE_UpdateMask() {
+	int i, mask = 0;
+
+	for (i = 0; i < SSE_MAX_CLIENTS; i++) {
+		mask |= g_sseClients[i].mask;
+	}
+	g_sseMask = mask;
+}
+bool SSE_IsWanted(int kind) {
+	return (g_sseMask & kind) != 0;
+}
+static void SSE_Append(sseClient_t* c, const char* s, int len) {
+	int tail, part;
+
+	tail = (c->head + c->count) % SSE_BACKLOG_SIZE;
+	while (len > 0) {
+		part = SSE_BACKLOG_SIZE - tail;
+		if (part > len) {
+			part = len;
+		}
+		memcpy(c->backlog + tail, s, part);
+		c->count += part;
+		s += part;
+		len -= part;
+		tail = 0;
+	}
+}
+// event is appended whole or not at all, every line of data
+// becomes "data:" line, \r and last empty line are skipped
+static void SSE_AppendEvent(sseClient_t* c, const char* event, const char* data) {
+	const char* line;
+	const char* end;
+	int len, total, pass;
+
+	if (c->bLost) {
+		return;
+	}
+	total = 0;
+	for (pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			if (c->count + total > SSE_BACKLOG_SIZE) {
+				c->head = 0;
+				c->count = 0;
+				c->bLost = true;
+				return;
+			}
+			SSE_Append(c, "event: ", 7);
+			SSE_Append(c, event, strlen(event));
+			SSE_Append(c, "\n", 1);
+		}
+		else {
+			total = 7 + strlen(event) + 1 + 1;
+		}
+		line = data;
+		while (*line) {
+			end = line;
+			while (*end && *end != '\n' && *end != '\r') {
+				end++;
+			}
+			len = end - line;
+			if (pass == 1) {
+				SSE_Append(c, "data: ", 6);
+				SSE_Append(c, line, len);
+				SSE_Append(c, "\n", 1);
+			}
+			else {
+				total += 6 + len + 1;
+			}
+			if (*end == '\r') {
+				end++;
+			}
+			if (*end == '\n') {
+				end++;
+			}
+			line = end;
+		}
+		if (pass == 1) {
+			SSE_Append(c, "\n", 1);
+		}
+	}
+}
+static void SSE_PublishTo(int mask, int id, const char* event, const char* data) {
+	int i;
+
+	// short wait, this is called from logging and channel changes
+	if (SSE_Mutex_Take(10) == false) {
+		return;
+	}
+	for (i = 0; i < SSE_MAX_CLIENTS; i++) {
+		if ((id < 0 || id == i) && (g_sseClients[i].mask & mask)) {
+			SSE_AppendEvent(&g_sseClients[i], event, data);
+		}
+	}
+	SSE_Mutex_Free();
+}
+void SSE_Publish(int kind, const char* event, const char* data) {
+	if ((g_sseMask & kind) == 0) {
+		return;
+	}
+	SSE_PublishTo(kind, -1, event, data);
+}
+void SSE_OnChannelChanged(int ch, int iVal) {
+	char tmp[64];
+
+	if ((g_sseMask & SSE_EVENT_CHANNELS) == 0) {
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "{\"ch\":%i,\"val\":%i,\"ver\":%i}", ch, iVal, CHANNEL_GetStateVersion());
+	SSE_PublishTo(SSE_EVENT_CHANNELS, -1, "ch", tmp);
+}
+int SSE_Open(int mask) {
+	int i, id = -1;
+
+	if (SSE_Mutex_Take(100) == false) {
+		return -1;
+	}
+	for (i = 0; i < SSE_MAX_CLIENTS; i++) {
+		if (g_sseClients[i].mask == 0) {
+			g_sseClients[i].backlog = (char*)malloc(SSE_BACKLOG_SIZE);
+			if (g_sseClients[i].backlog) {
+				g_sseClients[i].head = 0;
+				g_sseClients[i].count = 0;
+				g_sseClients[i].bLost = false;
+				g_sseClients[i].mask = mask;
+				id = i;
+			}
+			break;
+		}
+	}
+	SSE_UpdateMask();
+	SSE_Mutex_Free();
+	return id;
+}
+int SSE_Read(int id, char* out, int maxLen) {
+	sseClient_t* c;
+	int len, part;
+
+	if (id < 0 || id >= SSE_MAX_CLIENTS) {
+		return 0;
+	}
+	if (SSE_Mutex_Take(100) == false) {
+		return 0;
+	}
+	c = &g_sseClients[id];
+	len = 0;
+	if (c->bLost) {
+		if (maxLen >= (int)sizeof(g_sseReset) - 1) {
+			len = sizeof(g_sseReset) - 1;
+			memcpy(out, g_sseReset, len);
+			c->bLost = false;
+		}
+	}
+	else {
+		len = c->count;
+		if (len > maxLen) {
+			len = maxLen;
+		}
+		part = SSE_BACKLOG_SIZE - c->head;
+		if (part > len) {
+			part = len;
+		}
+		memcpy(out, c->backlog + c->head, part);
+		memcpy(out + part, c->backlog, len - part);
+		c->head = (c->head + len) % SSE_BACKLOG_SIZE;
+		c->count -= len;
+	}
+	SSE_Mutex_Free();
+	return len;
+}
+void SSE_Close(int id) {
+	if (id < 0 || id >= SSE_MAX_CLIENTS) {
+		return;
+	}
+	if (SSE_Mutex_Take(100) == false) {
+		// slot must be freed anyway
+		g_sseClients[id].mask = 0;
+		SSE_UpdateMask();
+		return;
+	}
+	free(g_sseClients[id].backlog);
+	g_sseClients[id].backlog = 0;
+	g_sseClients[id].mask = 0;
+	SSE_UpdateMask();
+	SSE_Mutex_Free();
+}
+
+// keeps sending queued events until client goes away
+static void SSE_Stream(int fd, int id, int mask) {
+	char buf[256];
+	char* drv = 0;
+	unsigned int drvHash = 0, h;
+	int len, idleMs, drvMs;
+
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	// drivers have no change notifications, so their output is compared
+	if (mask & SSE_EVENT_DRIVERS) {
+		drv = (char*)malloc(HTTP_STATE_DRV_BUFFER);
+	}
+#endif
+	idleMs = 0;
+	drvMs = SSE_DRIVERS_INTERVAL_MS;
+	while (1) {
+		len = SSE_Read(id, buf, sizeof(buf));
+		if (len > 0) {
+			if (send(fd, buf, len, 0) < 0) {
+				break;
+			}
+			idleMs = 0;
+			continue;
+		}
+		rtos_delay_milliseconds(SSE_POLL_DELAY_MS);
+		idleMs += SSE_POLL_DELAY_MS;
+		drvMs += SSE_POLL_DELAY_MS;
+#ifndef OBK_DISABLE_ALL_DRIVERS
+		if (drv && drvMs >= SSE_DRIVERS_INTERVAL_MS) {
+			drvMs = 0;
+			http_captureDriverInfo(drv, HTTP_STATE_DRV_BUFFER);
+			h = http_hashString(drv);
+			if (h != drvHash) {
+				drvHash = h;
+				SSE_PublishTo(SSE_EVENT_DRIVERS, id, "drv", drv);
+			}
+		}
+#endif
+		if (idleMs >= SSE_PING_INTERVAL_MS) {
+			if (send(fd, ":\n\n", 3, 0) < 0) {
+				break;
+			}
+			idleMs = 0;
+		}
+	}
+	if (drv) {
+		free(drv);
+	}
+}
+
+// events?log=1 adds log lines, events?state=0 drops channels and drivers
+int http_fn_events(http_request_t* request) {
+	char tmpA[8];
+	int mask, id;
+
+	mask = SSE_EVENT_CHANNELS | SSE_EVENT_DRIVERS;
+	if (http_getArg(request->url, "state", tmpA, sizeof(tmpA)) && atoi(tmpA) == 0) {
+		mask = 0;
+	}
+	if (http_getArg(request->url, "log", tmpA, sizeof(tmpA)) && atoi(tmpA)) {
+		mask |= SSE_EVENT_LOG;
+	}
+	id = -1;
+	// stream holds the thread serving it, so server must have one per client.
+	// fd 0 is unit test, reply is only the headers
+	if (mask && (request->fd == 0 || request->allowStream)) {
+		id = SSE_Open(mask);
+	}
+	if (id < 0) {
+		request->responseCode = 503;
+		http_setup(request, httpMimeTypeText);
+		poststr(request, "Event stream not available");
+		poststr(request, NULL);
+		return 0;
+	}
+	request->keepAlive = 0;
+	poststr(request, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n");
+	poststr(request, httpCorsHeaders);
+	poststr(request, "\r\nConnection: close\r\n\r\n");
+	hprintf255(request, "retry: 3000\nevent: hello\ndata: {\"ver\":%i}\n\n", CHANNEL_GetStateVersion());
+	poststr(request, NULL);
+	if (request->fd != 0) {
+		SSE_Stream(request->fd, id, mask);
+	}
+	SSE_Close(id);
+	return 0;
+}
+
+#endif // ENABLE_HTTP_SSE
@@ -0,0 +1,22 @@
+#pragma once
+#include "../new_common.h"
+#include "new_http.h"
+
+// kinds of events client can subscribe to
+#define SSE_EVENT_CHANNELS		1
+#define SSE_EVENT_LOG			2
+#define SSE_EVENT_DRIVERS		4
+
+// quick check for hooks, true when some client wants given kind
+bool SSE_IsWanted(int kind);
+// queues event for all clients that want given kind, data can have many lines
+void SSE_Publish(int kind, const char* event, const char* data);
+void SSE_OnChannelChanged(int ch, int iVal);
+
+// returns client id, or -1 when all slots are taken
+int SSE_Open(int mask);
+// takes queued bytes of client stream, returns their count
+int SSE_Read(int id, char* out, int maxLen);
+void SSE_Close(int id);
+
+int http_fn_events(http_request_t* request);
@@ -5,6 +5,8 @@
 #include "lwip/inet.h"
 #include "../logging/logging.h"
 #include "new_http.h"
+#include "../quicktick.h"
+#include "../driver/drv_freeze.h"
 
 #if !NEW_TCP_SERVER
 
@@ -24,8 +26,32 @@
 
 #endif
 
+// Connection is kept open after GET reply that fits whole in reply buffer,
+// so browser polls of index?state=1 don't pay for new connection each time.
+// Replies that have to be sent in parts go on chunked for HTTP/1.1 clients.
+// Headers are handled by HTTP_WantsKeepAlive and HTTP_SetKeepAliveHeaders.
+
+// Request is received whole only when it fits in this, bigger bodies
+// (uploads) stay in socket and handler reads them with http_readBody
+#define HTTP_MAX_BUFFERED_REQUEST	4096
+
+#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
+// Clients are served from server thread, by select() over a fixed pool of
+// connections with buffers allocated once. Requests are received in parts
+// as they come, so a slow client doesn't hold back the others.
+#ifndef HTTP_POOL_SIZE
+#define HTTP_POOL_SIZE				3
+#endif
+// connection that didn't send whole request in this time is dropped
+#define HTTP_REQUEST_TIMEOUT_MS		10000
+#endif
+
 static void tcp_server_thread(beken_thread_arg_t arg);
+#if !DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
 static void tcp_client_thread(beken_thread_arg_t arg);
+#endif
+
+static volatile int g_httpKeptAlive = 0;
 
 
 xTaskHandle g_http_thread = NULL;
@@ -49,6 +75,68 @@ int sendfn(int fd, char* data, int len) {
 	return -1;
 }
 
+static bool HTTP_CanKeepAlive()
+{
+	// leave most sockets for new connections and MQTT
+	int limit = LWIP_GetMaxSockets() / 4;
+#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
+	// and at least one pool slot
+	if (limit > HTTP_POOL_SIZE - 1) {
+		limit = HTTP_POOL_SIZE - 1;
+	}
+#endif
+	return g_httpKeptAlive < limit;
+}
+// Processes received request and sends reply. Returns true when
+// connection can stay open for the next request.
+static bool HTTP_HandleRequest(http_request_t* request, bool bKeptAlive)
+{
+	int lenret, len;
+	bool bKeep = false;
+
+	// must be checked before processing, it modifies received data
+	request->keepAlive = HTTP_WantsKeepAlive(request->received) && (bKeptAlive || HTTP_CanKeepAlive());
+	request->allowChunked = HTTP_IsVersion11(request->received);
+
+	//addLog( "TCP received string %s\n",buf );
+	// returns length to be sent if any
+	//ADDLOG_ERROR(LOG_FEATURE_HTTP,  "TCP will process packet of len %i\n", request->receivedLen );
+	lenret = HTTP_ProcessPacket(request);
+	if (request->chunked) {
+		// headers and most of it were sent already
+		http_endChunked(request);
+		return true;
+	}
+	if (request->keepAlive) {
+		// nothing was sent yet, whole reply is in buffer
+		lenret = request->replylen;
+		len = HTTP_SetKeepAliveHeaders(request->reply, lenret, request->replymaxlen);
+		if (len > 0) {
+			lenret = len;
+			bKeep = true;
+		}
+	}
+	if (lenret > 0) {
+		//ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP sending reply len %i\n", lenret);
+		send(request->fd, request->reply, lenret, 0);
+	}
+	return bKeep;
+}
+
+#if !DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
+// waits for next request on kept-alive connection
+static bool HTTP_WaitForRequest(int fd)
+{
+	fd_set readfds;
+	struct timeval tv;
+
+	FD_ZERO(&readfds);
+	FD_SET(fd, &readfds);
+	tv.tv_sec = HTTP_KEEPALIVE_TIMEOUT_MS / 1000;
+	tv.tv_usec = (HTTP_KEEPALIVE_TIMEOUT_MS % 1000) * 1000;
+	return select(fd + 1, &readfds, NULL, NULL, &tv) > 0;
+}
+
 static void tcp_client_thread(beken_thread_arg_t arg)
 {
 	OSStatus err = kNoErr;
@@ -57,6 +145,9 @@ static void tcp_client_thread(beken_thread_arg_t arg)
 	char* buf = NULL;
 	char* reply = NULL;
 	int replyBufferSize = REPLY_BUFFER_SIZE;
+	bool bKeptAlive = false;
+	char* grown;
+	char* headersEnd;
 	//int res;
 	//char reply[8192];
 
@@ -71,58 +162,83 @@ static void tcp_client_thread(beken_thread_arg_t arg)
 		ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP Client failed to malloc buffer");
 		goto exit;
 	}
-	http_request_t request;
-	memset(&request, 0, sizeof(request));
-
-	request.fd = fd;
-	request.received = buf;
-	request.receivedLenmax = INCOMING_BUFFER_SIZE - 2;
-	request.responseCode = HTTP_RESPONSE_OK;
-#if PLATFORM_BL602
-	request.receivedLen = recv(fd, request.received, request.receivedLenmax, 0);
-	request.received[request.receivedLen] = 0;
-#else
-	request.receivedLen = 0;
+	// buffers are reused for all requests on kept-alive connection
 	while (1) {
-		int remaining = request.receivedLenmax - request.receivedLen;
-		int received = recv(fd, request.received + request.receivedLen, remaining, 0);
-		if (received <= 0) {
-			break;
-		}
-		request.receivedLen += received;
-		if (received < remaining) {
+		http_request_t request;
+		memset(&request, 0, sizeof(request));
+
+		if (bKeptAlive && !HTTP_WaitForRequest(fd)) {
+			// idle timeout
 			break;
 		}
-		// grow by 1024
-		request.receivedLenmax += 1024;
-		request.received = (char*)realloc(request.received, request.receivedLenmax+2);
-		if (request.received == NULL) {
-			// no memory
-			return;
+
+		request.fd = fd;
+		request.received = buf;
+		request.receivedLenmax = INCOMING_BUFFER_SIZE - 2;
+		request.responseCode = HTTP_RESPONSE_OK;
+		// this thread serves only this client
+		request.allowStream = 1;
+#if PLATFORM_BL602
+		request.receivedLen = recv(fd, request.received, request.receivedLenmax, 0);
+		request.received[request.receivedLen] = 0;
+#else
+		request.receivedLen = 0;
+		while (1) {
+			int remaining = request.receivedLenmax - request.receivedLen;
+			int received = recv(fd, request.received + request.receivedLen, remaining, 0);
+			if (received <= 0) {
+				break;
+			}
+			request.receivedLen += received;
+			request.received[request.receivedLen] = 0;
+			if (HTTP_IsRequestComplete(request.received, request.receivedLen)) {
+				break;
+			}
+			// big body is left in socket, handler reads it in parts
+			headersEnd = strstr(request.received, "\r\n\r\n");
+			if (headersEnd && (headersEnd + 4 - request.received)
+				+ HTTP_GetContentLength(request.received, headersEnd) > HTTP_MAX_BUFFERED_REQUEST) {
+				break;
+			}
+			if (received < remaining) {
+				// rest is still on the way
+				continue;
+			}
+			if (request.receivedLenmax >= HTTP_MAX_BUFFERED_REQUEST) {
+				break;
+			}
+			// grow by 1024
+			request.receivedLenmax += 1024;
+			grown = (char*)realloc(request.received, request.receivedLenmax+2);
+			if (grown == NULL) {
+				// no memory
+				goto exit;
+			}
+			request.received = buf = grown;
 		}
-	}
-	request.received[request.receivedLen] = 0;
+		request.received[request.receivedLen] = 0;
 #endif
 
-	request.reply = reply;
-	request.replylen = 0;
-	reply[0] = '\0';
+		request.reply = reply;
+		request.replylen = 0;
+		reply[0] = '\0';
 
-	request.replymaxlen = replyBufferSize - 1;
+		request.replymaxlen = replyBufferSize - 1;
 
-	if (request.receivedLen <= 0)
-	{
-		ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP Client is disconnected, fd: %d", fd);
-		goto exit;
-	}
-
-	//addLog( "TCP received string %s\n",buf );
-	// returns length to be sent if any
-	//ADDLOG_ERROR(LOG_FEATURE_HTTP,  "TCP will process packet of len %i\n", request.receivedLen );
-	int lenret = HTTP_ProcessPacket(&request);
-	if (lenret > 0) {
-		//ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP sending reply len %i\n", lenret);
-		send(fd, reply, lenret, 0);
+		if (request.receivedLen <= 0)
+		{
+			if (!bKeptAlive) {
+				ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP Client is disconnected, fd: %d", fd);
+			}
+			break;
+		}
+		if (!HTTP_HandleRequest(&request, bKeptAlive)) {
+			break;
+		}
+		if (!bKeptAlive) {
+			bKeptAlive = true;
+			g_httpKeptAlive++;
+		}
 	}
 
 	//rtos_delay_milliseconds(10);
@@ -131,6 +247,8 @@ exit:
 	if (err != kNoErr)
 		ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP client thread exit with err: %d", err);
 
+	if (bKeptAlive)
+		g_httpKeptAlive--;
 	if (buf != NULL)
 		os_free(buf);
 	if (reply != NULL)
@@ -138,13 +256,203 @@ exit:
 
 	lwip_close(fd);
 
+	rtos_delete_thread(NULL);
+}
+#endif
+
 #if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
+typedef struct httpConnection_s {
+	int fd;
+	int receivedLen;
+	unsigned int lastActivity;
+	bool bKeptAlive;
+	char* received;
+	char* reply;
+} httpConnection_t;
+
+static httpConnection_t g_httpPool[HTTP_POOL_SIZE];
+
+static void HTTP_Pool_Close(httpConnection_t* c)
+{
+	lwip_close(c->fd);
+	c->fd = -1;
+	if (c->bKeptAlive) {
+		c->bKeptAlive = false;
+		g_httpKeptAlive--;
+	}
+}
+static void HTTP_Pool_Receive(httpConnection_t* c)
+{
+	http_request_t request;
+	int received;
 
-#else
-	rtos_delete_thread(NULL);
+	received = recv(c->fd, c->received + c->receivedLen, INCOMING_BUFFER_SIZE - 2 - c->receivedLen, 0);
+	if (received <= 0) {
+		HTTP_Pool_Close(c);
+		return;
+	}
+	c->receivedLen += received;
+	c->received[c->receivedLen] = 0;
+	c->lastActivity = g_timeMs;
+	// when buffer is full, handler reads rest of the body by itself
+	if (!HTTP_IsRequestComplete(c->received, c->receivedLen) && c->receivedLen < INCOMING_BUFFER_SIZE - 2) {
+		return;
+	}
+	memset(&request, 0, sizeof(request));
+	request.fd = c->fd;
+	request.received = c->received;
+	request.receivedLen = c->receivedLen;
+	request.receivedLenmax = INCOMING_BUFFER_SIZE - 2;
+	request.responseCode = HTTP_RESPONSE_OK;
+	request.reply = c->reply;
+	request.replylen = 0;
+	c->reply[0] = '\0';
+	request.replymaxlen = REPLY_BUFFER_SIZE - 1;
+	c->receivedLen = 0;
+
+	if (!HTTP_HandleRequest(&request, c->bKeptAlive)) {
+		HTTP_Pool_Close(c);
+		return;
+	}
+	if (!c->bKeptAlive) {
+		c->bKeptAlive = true;
+		g_httpKeptAlive++;
+	}
+	c->lastActivity = g_timeMs;
+}
+static void HTTP_Pool_Accept(int tcp_listen_fd, httpConnection_t* c)
+{
+	struct sockaddr_in client_addr;
+	socklen_t sockaddr_t_size = sizeof(client_addr);
+
+	c->fd = accept(tcp_listen_fd, (struct sockaddr*)&client_addr, &sockaddr_t_size);
+	if (c->fd < 0) {
+		c->fd = -1;
+		return;
+	}
+#if LWIP_SO_SNDTIMEO
+	{
+		// limits how long one stuck client can hold the others
+		struct timeval tv;
+		tv.tv_sec = 5;
+		tv.tv_usec = 0;
+		setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
+	}
 #endif
+	c->receivedLen = 0;
+	c->bKeptAlive = false;
+	c->lastActivity = g_timeMs;
 }
 
+/* TCP server listener thread, serves all clients */
+static void tcp_server_thread(beken_thread_arg_t arg)
+{
+	(void)(arg);
+	OSStatus err = kNoErr;
+	struct sockaddr_in server_addr;
+	struct timeval tv;
+	int tcp_listen_fd = -1;
+	fd_set readfds;
+	httpConnection_t* c;
+	httpConnection_t* freeSlot;
+	int i, maxfd, timeout;
+
+	for (i = 0; i < HTTP_POOL_SIZE; i++) {
+		g_httpPool[i].fd = -1;
+	}
+	for (i = 0; i < HTTP_POOL_SIZE; i++) {
+		c = &g_httpPool[i];
+		c->received = (char*)os_malloc(INCOMING_BUFFER_SIZE);
+		c->reply = (char*)os_malloc(REPLY_BUFFER_SIZE);
+		if (c->received == 0 || c->reply == 0) {
+			ADDLOG_ERROR(LOG_FEATURE_HTTP, "TCP server failed to malloc buffers");
+			goto exit;
+		}
+	}
+
+	tcp_listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = INADDR_ANY;/* Accept conenction request on all network interface */
+	server_addr.sin_port = htons(HTTP_SERVER_PORT);
+	err = bind(tcp_listen_fd, (struct sockaddr*)&server_addr, sizeof(server_addr));
+
+	err = listen(tcp_listen_fd, 0);
+
+	while (1)
+	{
+		FD_ZERO(&readfds);
+		maxfd = -1;
+		freeSlot = 0;
+		for (i = 0; i < HTTP_POOL_SIZE; i++) {
+			c = &g_httpPool[i];
+			if (c->fd < 0) {
+				freeSlot = c;
+				continue;
+			}
+			FD_SET(c->fd, &readfds);
+			if (c->fd > maxfd) {
+				maxfd = c->fd;
+			}
+		}
+		// with all slots busy, new clients wait in listen backlog
+		if (freeSlot) {
+			FD_SET(tcp_listen_fd, &readfds);
+			if (tcp_listen_fd > maxfd) {
+				maxfd = tcp_listen_fd;
+			}
+		}
+		WDT_Heartbeat(WDT_TASK_HTTP);
+		// wake up now and then to drop idle connections
+		tv.tv_sec = 0;
+		tv.tv_usec = 500 * 1000;
+		if (select(maxfd + 1, &readfds, NULL, NULL, &tv) < 0) {
+			rtos_delay_milliseconds(10);
+			continue;
+		}
+		for (i = 0; i < HTTP_POOL_SIZE; i++) {
+			c = &g_httpPool[i];
+			if (c->fd < 0) {
+				continue;
+			}
+			if (FD_ISSET(c->fd, &readfds)) {
+				HTTP_Pool_Receive(c);
+				continue;
+			}
+			timeout = c->bKeptAlive ? HTTP_KEEPALIVE_TIMEOUT_MS : HTTP_REQUEST_TIMEOUT_MS;
+			if ((int)(g_timeMs - c->lastActivity) > timeout) {
+				HTTP_Pool_Close(c);
+			}
+		}
+		if (freeSlot && FD_ISSET(tcp_listen_fd, &readfds)) {
+			HTTP_Pool_Accept(tcp_listen_fd, freeSlot);
+		}
+	}
+
+exit:
+	if (err != kNoErr)
+		ADDLOG_ERROR(LOG_FEATURE_HTTP, "Server listener thread exit with err: %d", err);
+
+	for (i = 0; i < HTTP_POOL_SIZE; i++) {
+		c = &g_httpPool[i];
+		if (c->fd >= 0) {
+			HTTP_Pool_Close(c);
+		}
+		if (c->received) {
+			os_free(c->received);
+			c->received = 0;
+		}
+		if (c->reply) {
+			os_free(c->reply);
+			c->reply = 0;
+		}
+	}
+	if (tcp_listen_fd >= 0)
+		lwip_close(tcp_listen_fd);
+
+	rtos_delete_thread(NULL);
+}
+#else
 /* TCP server listener thread */
 static void tcp_server_thread(beken_thread_arg_t arg)
 {
@@ -178,19 +486,9 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 			if (client_fd >= 0)
 			{
 #if PLATFORM_XR809
-#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
-
-#else
 				OS_Thread_t clientThreadUnused;
-#endif
 #endif
 				strcpy(client_ip_str, inet_ntoa(client_addr.sin_addr));
-#if DISABLE_SEPARATE_THREAD_FOR_EACH_TCP_CLIENT
-				//ADDLOG_ERROR(LOG_FEATURE_HTTP, "HTTP [single thread] Client %s:%d connected, fd: %d", client_ip_str, client_addr.sin_port, client_fd);
-				// Use main server thread (blocking all other clients)
-				// right now, I am getting OS_ThreadCreate everytime on XR809 platform
-				tcp_client_thread((beken_thread_arg_t)client_fd);
-#else
 				//ADDLOG_ERROR(LOG_FEATURE_HTTP, "HTTP [multi thread] Client %s:%d connected, fd: %d", client_ip_str, client_addr.sin_port, client_fd);
 				// delay each accept by 20ms
 				// this allows previous to finish if
@@ -222,7 +520,6 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 					lwip_close(client_fd);
 					client_fd = -1;
 				}
-#endif
 			}
 		}
 	}
@@ -235,8 +532,7 @@ static void tcp_server_thread(beken_thread_arg_t arg)
 	rtos_delete_thread(NULL);
 
 }
-
-
+#endif
 
 void HTTPServer_Start()
 {
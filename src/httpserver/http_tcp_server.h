@@ -1,3 +1,5 @@
 
 void HTTPServer_Start();
-void HTTPServer_Stop();
\ No newline at end of file
+void HTTPServer_Stop();
+// requests answered since start, simulator and native Linux build
+int HTTPServer_GetRequestCount();
@@ -7,13 +7,26 @@
 #include "lwip/inet.h"
 #include "../logging/logging.h"
 #include "new_http.h"
+#include "../driver/drv_freeze.h"
+#include "../hal/hal_generic.h"
 #ifndef LINUX
 #include <timeapi.h>
+#else
+#include <sys/epoll.h>
 #endif
 
 SOCKET ListenSocket = INVALID_SOCKET;
 
 int g_httpPort = 80;
+// requests answered since start, for -bench
+static int g_httpRequestsServed = 0;
+
+int HTTPServer_GetRequestCount() {
+	return g_httpRequestsServed;
+}
+#ifdef LINUX
+static int g_httpEpoll = -1;
+#endif
 
 int HTTPServer_Start() {
 
@@ -51,6 +64,11 @@ int HTTPServer_Start() {
         return 1;
     }
 
+#ifdef LINUX
+	// restarted gateway must get its port back at once
+	argp = 1;
+	setsockopt(ListenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&argp, sizeof(argp));
+#endif
     // Setup the TCP listening socket
     iResult = bind( ListenSocket, result->ai_addr, (int)result->ai_addrlen);
     if (iResult == SOCKET_ERROR) {
@@ -79,10 +97,200 @@ int HTTPServer_Start() {
         printf("ioctlsocket() error %d\n", WSAGetLastError());
         return 1;
     }
+#ifdef LINUX
+	if (g_httpEpoll < 0) {
+		g_httpEpoll = epoll_create1(EPOLL_CLOEXEC);
+		HAL_NetLoop_Watch(g_httpEpoll);
+	}
+	if (g_httpEpoll >= 0) {
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = ListenSocket;
+		epoll_ctl(g_httpEpoll, EPOLL_CTL_ADD, ListenSocket, &ev);
+	}
+#endif
+	return 0;
 }
 #define DEFAULT_BUFLEN 10000
 int g_prevHTTPResult;
 
+#ifdef LINUX
+
+// Native Linux gateway serves many clients at once: every connection
+// is kept in table until whole request (headers and Content-Length body)
+// has arrived, so slow client doesn't hold others and one frame answers
+// all requests that are ready.
+#define HTTP_MAX_CONNS			16
+// seconds before half sent request is dropped
+#define HTTP_CONN_TIMEOUT		5
+
+typedef struct httpConn_s {
+	int fd;
+	int len;
+	time_t opened;
+	char *buf;
+} httpConn_t;
+
+static httpConn_t g_httpConns[HTTP_MAX_CONNS];
+
+static void HTTPServer_CloseConn(httpConn_t *c) {
+	epoll_ctl(g_httpEpoll, EPOLL_CTL_DEL, c->fd, NULL);
+	shutdown(c->fd, SD_SEND);
+	closesocket(c->fd);
+	c->fd = INVALID_SOCKET;
+	c->len = 0;
+}
+static httpConn_t *HTTPServer_FindConn(int fd) {
+	int i;
+
+	for (i = 0; i < HTTP_MAX_CONNS; i++) {
+		if (g_httpConns[i].buf && g_httpConns[i].fd == fd) {
+			return &g_httpConns[i];
+		}
+	}
+	return 0;
+}
+static void HTTPServer_AcceptAll() {
+	struct epoll_event ev;
+	httpConn_t *c;
+	int fd, i, argp;
+
+	while (1) {
+		fd = accept(ListenSocket, NULL, NULL);
+		if (fd < 0) {
+			return;
+		}
+		argp = 1;
+		ioctlsocket(fd, FIONBIO, &argp);
+		c = 0;
+		for (i = 0; i < HTTP_MAX_CONNS; i++) {
+			if (g_httpConns[i].buf == 0) {
+				g_httpConns[i].buf = malloc(DEFAULT_BUFLEN);
+			}
+			if (g_httpConns[i].buf && g_httpConns[i].fd == INVALID_SOCKET) {
+				c = &g_httpConns[i];
+				break;
+			}
+		}
+		if (c == 0) {
+			// full, client will retry
+			closesocket(fd);
+			continue;
+		}
+		c->fd = fd;
+		c->len = 0;
+		c->opened = time(0);
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+		epoll_ctl(g_httpEpoll, EPOLL_CTL_ADD, fd, &ev);
+	}
+}
+// true when headers and whole body are in buffer
+static bool HTTPServer_IsRequestComplete(httpConn_t *c) {
+	const char *end, *p;
+	int bodyLen = 0;
+
+	c->buf[c->len] = 0;
+	end = strstr(c->buf, "\r\n\r\n");
+	if (end == 0) {
+		return false;
+	}
+	for (p = c->buf; p < end; p++) {
+		if (p[0] == '\n' && !wal_strnicmp(p + 1, "Content-Length:", 15)) {
+			bodyLen = atoi(p + 16);
+			break;
+		}
+	}
+	return (c->buf + c->len) >= (end + 4 + bodyLen);
+}
+static void HTTPServer_Serve(httpConn_t *c) {
+	http_request_t request;
+	char outbuf[DEFAULT_BUFLEN];
+	int len, argp;
+
+	// replies may be sent in parts from HTTP_ProcessPacket
+	argp = 0;
+	ioctlsocket(c->fd, FIONBIO, &argp);
+
+	memset(&request, 0, sizeof(request));
+	request.fd = c->fd;
+	request.received = c->buf;
+	request.receivedLen = c->len;
+	outbuf[0] = '\0';
+	request.reply = outbuf;
+	request.replylen = 0;
+	request.responseCode = HTTP_RESPONSE_OK;
+	request.replymaxlen = DEFAULT_BUFLEN;
+	request.receivedLenmax = DEFAULT_BUFLEN;
+
+	len = HTTP_ProcessPacket(&request);
+	if (len > 0) {
+		if (send(c->fd, outbuf, len, MSG_NOSIGNAL) == SOCKET_ERROR) {
+			printf("send failed with error: %d\n", WSAGetLastError());
+		}
+	}
+	g_httpRequestsServed++;
+	HTTPServer_CloseConn(c);
+}
+static void HTTPServer_ReadConn(httpConn_t *c) {
+	int n;
+
+	n = recv(c->fd, c->buf + c->len, DEFAULT_BUFLEN - 1 - c->len, 0);
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+		HTTPServer_CloseConn(c);
+		return;
+	}
+	if (n < 0) {
+		return;
+	}
+	c->len += n;
+	// too big request is served truncated, as on the devices
+	if (c->len >= DEFAULT_BUFLEN - 1 || HTTPServer_IsRequestComplete(c)) {
+		c->buf[c->len] = 0;
+		HTTPServer_Serve(c);
+	}
+}
+void HTTPServer_RunQuickTick() {
+	struct epoll_event ev[HTTP_MAX_CONNS + 1];
+	static bool bInit = false;
+	httpConn_t *c;
+	time_t now;
+	int i, n;
+
+	WDT_Heartbeat(WDT_TASK_HTTP);
+	if (bInit == false) {
+		for (i = 0; i < HTTP_MAX_CONNS; i++) {
+			g_httpConns[i].fd = INVALID_SOCKET;
+		}
+		bInit = true;
+	}
+	if (g_httpEpoll < 0 || ListenSocket == INVALID_SOCKET) {
+		return;
+	}
+	n = epoll_wait(g_httpEpoll, ev, HTTP_MAX_CONNS + 1, 0);
+	for (i = 0; i < n; i++) {
+		if (ev[i].data.fd == ListenSocket) {
+			HTTPServer_AcceptAll();
+			continue;
+		}
+		c = HTTPServer_FindConn(ev[i].data.fd);
+		if (c) {
+			HTTPServer_ReadConn(c);
+		}
+	}
+	now = time(0);
+	for (i = 0; i < HTTP_MAX_CONNS; i++) {
+		c = &g_httpConns[i];
+		if (c->fd != INVALID_SOCKET && now - c->opened > HTTP_CONN_TIMEOUT) {
+			HTTPServer_CloseConn(c);
+		}
+	}
+}
+
+#else
+
 void HTTPServer_RunQuickTick() {
 	int iResult;
 	int err;
@@ -92,6 +300,7 @@ void HTTPServer_RunQuickTick() {
     SOCKET ClientSocket = INVALID_SOCKET;
 	int len, iSendResult;
 
+	WDT_Heartbeat(WDT_TASK_HTTP);
 	// Accept a client socket
 	ClientSocket = accept(ListenSocket, NULL, NULL);
 	if (ClientSocket == INVALID_SOCKET) {
@@ -205,8 +414,11 @@ void HTTPServer_RunQuickTick() {
 			//WSACleanup();
 			//return 1;
 		//}
+		g_httpRequestsServed++;
 }
 
 #endif
 
+#endif
+
 
@@ -26,6 +26,7 @@
 
 
 #include "../libraries/obktime/obktime.h"	// for time functions
+#include "../quicktick.h"
 
 #if ENABLE_TASMOTA_JSON
 
@@ -272,7 +273,7 @@ static int http_tasmota_json_SENSOR(void* request, jsonCb_t printer) {
 //		printer(request, "\"%s\":{\"Temperature\": %.1f},", PLATFORM_MCU_NAME, g_wifi_temperature);
 		printer(request, "\"ESP32\":{\"Temperature\": %.1f},", g_wifi_temperature);
 #endif
-	if (DRV_IsRunning("SHT3X")) {
+	if (DRV_IsRunning(DRV_ID_SHT3X)) {
 		g_pin_1 = PIN_FindPinIndexForRole(IOR_SHT3X_DAT, g_pin_1);
 		channel_1 = g_cfg.pins.channels[g_pin_1];
 		channel_2 = g_cfg.pins.channels2[g_pin_1];
@@ -290,7 +291,7 @@ static int http_tasmota_json_SENSOR(void* request, jsonCb_t printer) {
 		printer(request, "},");
 	}
 #if (ENABLE_DRIVER_DS1820)
-	if (DRV_IsRunning("DS1820")) {		//DS1820_simple.c with one sensor
+	if (DRV_IsRunning(DRV_ID_DS1820)) {		//DS1820_simple.c with one sensor
 		g_pin_1 = PIN_FindPinIndexForRole(IOR_DS1820_IO, g_pin_1);
 		channel_1 = g_cfg.pins.channels[g_pin_1];
 		chan_val1 = CHANNEL_GetFloat(channel_1) / 100.0f;
@@ -305,7 +306,7 @@ static int http_tasmota_json_SENSOR(void* request, jsonCb_t printer) {
 	}
 #endif
 #if (ENABLE_DRIVER_DS1820_FULL)
-	if (DRV_IsRunning("DS1820_full")) {		//DS1820_full.c with possibly multiple sensors
+	if (DRV_IsRunning(DRV_ID_DS1820_FULL)) {		//DS1820_full.c with possibly multiple sensors
 		char *str = DS1820_full_jsonSensors();
 		int toprint = strlen(str);
 		while (*str && toprint > 250) {		// string can be long, longer than request, this would break output if not split
@@ -319,7 +320,7 @@ static int http_tasmota_json_SENSOR(void* request, jsonCb_t printer) {
 		printer(request, str);
 	}
 #endif
-	if (DRV_IsRunning("CHT83XX")) {
+	if (DRV_IsRunning(DRV_ID_CHT83XX)) {
 		g_pin_1 = PIN_FindPinIndexForRole(IOR_CHT83XX_DAT, g_pin_1);
 		channel_1 = g_cfg.pins.channels[g_pin_1];
 		channel_2 = g_cfg.pins.channels2[g_pin_1];
@@ -357,7 +358,7 @@ static int http_tasmota_json_SENSOR(void* request, jsonCb_t printer) {
 		// close ENERGY block
 		printer(request, "},");
 	}
-	if (DRV_IsRunning("SGP")) {
+	if (DRV_IsRunning(DRV_ID_SGP)) {
 		g_pin_1 = PIN_FindPinIndexForRole(IOR_SGP_DAT, g_pin_1);
 		channel_1 = g_cfg.pins.channels[g_pin_1];
 		channel_2 = g_cfg.pins.channels2[g_pin_1];
@@ -500,7 +501,7 @@ static int http_tasmota_json_status_STS(void* request, jsonCb_t printer, bool bA
 	JSON_PrintKeyValue_Int(request, printer, "LoadAvg", 99, true);
 	JSON_PrintKeyValue_Int(request, printer, "MqttCount", 23, true);
 #ifdef ENABLE_DRIVER_BATTERY
-	if (DRV_IsRunning("Battery")) {
+	if (DRV_IsRunning(DRV_ID_Battery)) {
 		printer(request, "\"Vcc\":%.4f,", Battery_lastreading(OBK_BATT_VOLTAGE) / 1000.00);
 	}
 #endif
@@ -844,6 +845,182 @@ static int http_tasmota_json_status_generic(void* request, jsonCb_t printer) {
 
 	return 0;
 }
+static int http_tasmota_json_status_all(void* request, jsonCb_t printer, bool bAppendHeader) {
+	return http_tasmota_json_status_generic(request, printer);
+}
+
+enum {
+	JSON_CACHE_GENERIC,
+	JSON_CACHE_SNS,
+	JSON_CACHE_STS,
+	JSON_CACHE_COUNT,
+};
+
+#if ENABLE_TASMOTA_JSON_CACHE
+
+// Several pollers (TasmoAdmin, HA, scripts) may ask for the same STATUS
+// within a second. Section is rendered once into buffer and replayed from
+// there while channels, energy readings, LED state and config are the same
+// as when it was rendered. Heap, RSSI and such are at most a second old,
+// time and uptime are seconds, so they are still right.
+#define JSON_CACHE_TTL_MS		1000
+// printers take up to 255 characters per call
+#define JSON_CACHE_CHUNK		240
+
+typedef struct jsonCacheKey_s {
+	int seconds;
+	int stateVersion;
+	int readingsVersion;
+	int cfgPendingChanges;
+	int cfgChangeCounter;
+	char led[48];
+} jsonCacheKey_t;
+
+typedef struct jsonCacheEntry_s {
+	jsonCacheKey_t key;
+	unsigned int timeMs;
+	char* data;
+	int len;
+	bool bValid;
+} jsonCacheEntry_t;
+
+typedef struct jsonCapture_s {
+	char* buf;
+	int len;
+	int size;
+} jsonCapture_t;
+
+static const unsigned short g_jsonCacheSizes[JSON_CACHE_COUNT] = { 4096, 1024, 1024 };
+static jsonCacheEntry_t g_jsonCache[JSON_CACHE_COUNT];
+static int g_jsonCacheHits = 0;
+static int g_jsonCacheMisses = 0;
+static SemaphoreHandle_t g_jsonCacheMutex = 0;
+
+static void JSON_GetCacheKey(jsonCacheKey_t* key) {
+	// whole key is compared, padding included
+	memset(key, 0, sizeof(*key));
+	key->seconds = g_secondsElapsed;
+	key->stateVersion = CHANNEL_GetStateVersion();
+#if ENABLE_BL_SHARED
+	key->readingsVersion = DRV_GetReadingsVersion();
+#endif
+	key->cfgPendingChanges = g_cfg_pendingChanges;
+	key->cfgChangeCounter = g_cfg.changeCounter;
+#if ENABLE_LED_BASIC
+	{
+		char color[16];
+
+		LED_GetBaseColorString(color);
+		snprintf(key->led, sizeof(key->led), "%i %.1f %i %.0f %s", LED_GetEnableAll(), LED_GetDimmer(),
+			LED_GetMode(), LED_GetTemperature(), color);
+	}
+#endif
+}
+static int JSON_CapturePrinter(void* userData, const char* fmt, ...) {
+	jsonCapture_t* c = (jsonCapture_t*)userData;
+	va_list argList;
+	int n;
+
+	// once full, len stays past size
+	if (c->len >= c->size) {
+		return 0;
+	}
+	va_start(argList, fmt);
+	n = vsnprintf(c->buf + c->len, c->size - c->len, fmt, argList);
+	va_end(argList);
+	if (n < 0) {
+		c->len = c->size;
+		return 0;
+	}
+	c->len += n;
+	return n;
+}
+static void JSON_ReplayCached(void* request, jsonCb_t printer, const char* s, int len) {
+	char chunk[JSON_CACHE_CHUNK + 1];
+	int n;
+
+	while (len > 0) {
+		n = len < JSON_CACHE_CHUNK ? len : JSON_CACHE_CHUNK;
+		memcpy(chunk, s, n);
+		chunk[n] = 0;
+		printer(request, "%s", chunk);
+		s += n;
+		len -= n;
+	}
+}
+void JSON_GetStatusCacheStats(int* hits, int* misses) {
+	*hits = g_jsonCacheHits;
+	*misses = g_jsonCacheMisses;
+}
+#endif
+
+typedef int (*jsonStatusSection_t)(void* request, jsonCb_t printer, bool bAppendHeader);
+
+// section is printed as it would be by its function, from cache if it is there
+static void http_tasmota_json_status_cached(int section, void* request, jsonCb_t printer, bool bAppendHeader) {
+	static const jsonStatusSection_t sections[] = {
+		http_tasmota_json_status_all,
+		http_tasmota_json_status_SNS,
+		http_tasmota_json_status_STS,
+	};
+	static const char* headers[] = { "", "\"StatusSNS\":", "\"StatusSTS\":" };
+#if ENABLE_TASMOTA_JSON_CACHE
+	jsonCacheEntry_t* e = &g_jsonCache[section];
+	jsonCacheKey_t key;
+	jsonCapture_t capture;
+
+	if (bAppendHeader) {
+		printer(request, "%s", headers[section]);
+	}
+	if (g_jsonCacheMutex == 0) {
+		g_jsonCacheMutex = xSemaphoreCreateMutex();
+	}
+	// replies are not held back when other thread is slow to send its own
+	if (xSemaphoreTake(g_jsonCacheMutex, 1000) != pdTRUE) {
+		sections[section](request, printer, false);
+		return;
+	}
+	JSON_GetCacheKey(&key);
+	if (e->bValid && g_timeMs - e->timeMs < JSON_CACHE_TTL_MS && !memcmp(&key, &e->key, sizeof(key))) {
+		g_jsonCacheHits++;
+		JSON_ReplayCached(request, printer, e->data, e->len);
+		xSemaphoreGive(g_jsonCacheMutex);
+		return;
+	}
+	g_jsonCacheMisses++;
+	e->bValid = false;
+	if (e->data == 0) {
+		e->data = (char*)malloc(g_jsonCacheSizes[section]);
+	}
+	if (e->data == 0) {
+		xSemaphoreGive(g_jsonCacheMutex);
+		sections[section](request, printer, false);
+		return;
+	}
+	capture.buf = e->data;
+	capture.len = 0;
+	capture.size = g_jsonCacheSizes[section];
+	sections[section](&capture, JSON_CapturePrinter, false);
+	if (capture.len < capture.size) {
+		e->key = key;
+		e->timeMs = g_timeMs;
+		e->len = capture.len;
+		e->bValid = true;
+		JSON_ReplayCached(request, printer, e->data, e->len);
+		xSemaphoreGive(g_jsonCacheMutex);
+		return;
+	}
+	// does not fit, so it is printed directly each time
+	xSemaphoreGive(g_jsonCacheMutex);
+	addLogAdv(LOG_DEBUG, LOG_FEATURE_HTTP, "JSON status section %i does not fit cache", section);
+	sections[section](request, printer, false);
+#else
+	if (bAppendHeader) {
+		printer(request, "%s", headers[section]);
+	}
+	sections[section](request, printer, false);
+#endif
+}
 // drv_tuyaMCU.c
 int http_obk_json_dps(int id, void* request, jsonCb_t printer);
 
@@ -996,7 +1173,7 @@ int JSON_ProcessCommandReply(const char* cmd, const char* arg, void* request, js
 	}
 #endif
 	else if (!wal_strnicmp(cmd, "STATE", 5)) {
-		http_tasmota_json_status_STS(request, printer, false);
+		http_tasmota_json_status_cached(JSON_CACHE_STS, request, printer, false);
 #if ENABLE_MQTT
 		if (flags == COMMAND_FLAG_SOURCE_MQTT) {
 			MQTT_PublishPrinterContentsToStat((struct obk_mqtt_publishReplyPrinter_s*)request, "RESULT");
@@ -1008,7 +1185,7 @@ int JSON_ProcessCommandReply(const char* cmd, const char* arg, void* request, js
 	}
 	else if (!wal_strnicmp(cmd, "SENSOR", 5)) {
 		// not a Tasmota command, but still required for us
-		http_tasmota_json_status_SNS(request, printer, false);
+		http_tasmota_json_status_cached(JSON_CACHE_SNS, request, printer, false);
 #if ENABLE_MQTT
 		if (flags == COMMAND_FLAG_SOURCE_TELESENDER) {
 			MQTT_PublishPrinterContentsToTele((struct obk_mqtt_publishReplyPrinter_s*)request, "SENSOR");
@@ -1018,7 +1195,7 @@ int JSON_ProcessCommandReply(const char* cmd, const char* arg, void* request, js
 	else if (!wal_strnicmp(cmd, "STATUS", 6)) {
 		if (!stricmp(arg, "8") || !stricmp(arg, "10")) {
 			printer(request, "{");
-			http_tasmota_json_status_SNS(request, printer, true);
+			http_tasmota_json_status_cached(JSON_CACHE_SNS, request, printer, true);
 			printer(request, "}");
 #if ENABLE_MQTT
 			if (flags == COMMAND_FLAG_SOURCE_MQTT) {
@@ -1073,7 +1250,7 @@ int JSON_ProcessCommandReply(const char* cmd, const char* arg, void* request, js
 		}
 		else if (!stricmp(arg, "11")) {
 			printer(request, "{");
-			http_tasmota_json_status_STS(request, printer, true);
+			http_tasmota_json_status_cached(JSON_CACHE_STS, request, printer, true);
 			printer(request, "}");
 #if ENABLE_MQTT
 			if (flags == COMMAND_FLAG_SOURCE_MQTT) {
@@ -1092,7 +1269,7 @@ int JSON_ProcessCommandReply(const char* cmd, const char* arg, void* request, js
 #endif
 		}
 		else {
-			http_tasmota_json_status_generic(request, printer);
+			http_tasmota_json_status_cached(JSON_CACHE_GENERIC, request, printer, false);
 #if ENABLE_MQTT
 			if (flags == COMMAND_FLAG_SOURCE_MQTT) {
 				MQTT_PublishPrinterContentsToStat((struct obk_mqtt_publishReplyPrinter_s*)request, "STATUS");
@@ -3,6 +3,7 @@
 #include "../new_common.h"
 #include "../logging/logging.h"
 #include "ctype.h"
+#include <math.h>
 #include "new_http.h"
 #include "http_fns.h"
 #include "../new_pins.h"
@@ -11,6 +12,10 @@
 #include "../hal/hal_wifi.h"
 #include "../base64/base64.h"
 #include "http_basic_auth.h"
+#include "new_http_gz.h"
+#include "http_sse.h"
+#include "../logging/ioTrace.h"
+#include "../driver/drv_powerGov.h"
 
 
 // define the feature ADDLOGF_XXX will use
@@ -61,6 +66,10 @@ const char htmlFooterInfo[] =
 "<a target=\"_blank\" "
 "href=\"https://paypal.me/openshwprojects\">Support Project</a><br>";
 
+// built-in files, served gzipped, URL has content hash
+#define HTTP_STYLE_URL		"style_" HTMLHEADSTYLE_HASH ".css"
+#define HTTP_SCRIPT_URL		"script_" PAGESCRIPT_HASH ".js"
+
 const char* g_build_str = "Built on " __DATE__ " " __TIME__ " version " USER_SW_VER; // Show GIT version at Build line;
 
 const char httpCorsHeaders[] = "Access-Control-Allow-Origin: *\r\nAccess-Control-Allow-Headers: Origin, X-Requested-With, Content-Type, Accept";           // TEXT MIME type
@@ -74,56 +83,165 @@ const char* methodNames[] = {
 	"OPTIONS"
 };
 
-#if WINDOWS
-#define os_free free
-#define os_malloc malloc
-#endif
-
 void misc_formatUpTimeString(int totalSeconds, char* o);
 
-typedef struct http_callback_tag {
-	char* url;
-	int method;
-	http_callback_fn callback;
-	int auth_required;
-} http_callback_t;
+// Routes with whole url go to hash table, so finding one takes the same
+// time however many there are. Urls registered with trailing '/' are
+// prefixes (like "api/"), there are few of them and they are just scanned.
+#define HTTP_ROUTE_HASH_SIZE	64
+static httpRoute_t* g_routeHash[HTTP_ROUTE_HASH_SIZE];
+static httpRoute_t* g_prefixRoutes = 0;
 
-#define MAX_HTTP_CALLBACKS 32
-static http_callback_t* callbacks[MAX_HTTP_CALLBACKS];
-static int numCallbacks = 0;
+bool http_startsWith(const char* base, const char* substr);
+bool http_checkUrlBase(const char* base, const char* fileName);
 
-int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback, int auth_required) {
+static void HTTP_InitPageRoutes();
+
+// url ends at query or space
+static unsigned int HTTP_HashUrl(const char* url) {
+	unsigned int h = 5381;
+
+	while (*url && *url != '?' && *url != ' ') {
+		h = ((h << 5) + h) + (unsigned char)*url;
+		url++;
+	}
+	return h & (HTTP_ROUTE_HASH_SIZE - 1);
+}
+static void HTTP_AddRoute(httpRoute_t* r) {
+	int len = strlen(r->url);
+	int h;
+
+	if (len > 0 && r->url[len - 1] == '/') {
+		httpRoute_t** pp = &g_prefixRoutes;
+		// kept in order of registration
+		while (*pp) {
+			pp = &(*pp)->next;
+		}
+		r->next = 0;
+		*pp = r;
+	}
+	else {
+		// put first, so driver can override builtin page
+		h = HTTP_HashUrl(r->url);
+		r->next = g_routeHash[h];
+		g_routeHash[h] = r;
+	}
+}
+static httpRoute_t* HTTP_FindRoute(const char* url, int method) {
+	httpRoute_t* r;
+
+	for (r = g_routeHash[HTTP_HashUrl(url)]; r; r = r->next) {
+		if ((r->method == HTTP_ANY || r->method == method) && http_checkUrlBase(url, r->url)) {
+			return r;
+		}
+	}
+	return 0;
+}
+static httpRoute_t* HTTP_FindPrefixRoute(const char* url, int method) {
+	httpRoute_t* r;
+
+	for (r = g_prefixRoutes; r; r = r->next) {
+		if ((r->method == HTTP_ANY || r->method == method) && http_startsWith(url, r->url)) {
+			return r;
+		}
+	}
+	return 0;
+}
+static int HTTP_RunRoute(httpRoute_t* r, http_request_t* request) {
+	int res;
+#if ENABLE_HTTP_ROUTE_STATS
+	unsigned int start;
+	unsigned int took;
+
+	start = xTaskGetTickCount();
+#endif
+	if ((r->flags & HTTP_ROUTE_AUTH) && http_basic_auth_run(request) == HTTP_BASIC_AUTH_FAIL) {
+		return 0;
+	}
+	res = r->callback(request);
+#if ENABLE_HTTP_ROUTE_STATS
+	took = (unsigned int)(xTaskGetTickCount() - start) * portTICK_PERIOD_MS * 1000;
+	r->stats.hits++;
+	r->stats.totalUs += took;
+	if (took > r->stats.maxUs) {
+		r->stats.maxUs = took;
+	}
+#endif
+	return res;
+}
+static bool HTTP_HasRoute(httpRoute_t* r, const char* url, int method, http_callback_fn callback) {
+	for (; r; r = r->next) {
+		if (r->callback == callback && r->method == method && !strcmp(r->url, url)) {
+			return true;
+		}
+	}
+	return false;
+}
+int HTTP_RegisterRoute(httpRoute_t* route) {
+	if (!route || !route->url || !route->callback) {
+		return -1;
+	}
+	// pages go in first, so they are last in chains and can be overridden
+	HTTP_InitPageRoutes();
+	// init is run again on simulator reset
+	if (HTTP_HasRoute(g_routeHash[HTTP_HashUrl(route->url)], route->url, route->method, route->callback)
+		|| HTTP_HasRoute(g_prefixRoutes, route->url, route->method, route->callback)) {
+		return 0;
+	}
+	HTTP_AddRoute(route);
+	return 0;
+}
+#if ENABLE_HTTP_ROUTE_STATS
+static void HTTP_ForEachRouteIn(httpRoute_t* r, void* userData, void (*callback)(const httpRoute_t* r, void* userData)) {
+	for (; r; r = r->next) {
+		if (r->stats.hits) {
+			callback(r, userData);
+		}
+	}
+}
+void HTTP_ForEachRouteStats(void* userData, void (*callback)(const httpRoute_t* r, void* userData)) {
 	int i;
 
+	for (i = 0; i < HTTP_ROUTE_HASH_SIZE; i++) {
+		HTTP_ForEachRouteIn(g_routeHash[i], userData, callback);
+	}
+	HTTP_ForEachRouteIn(g_prefixRoutes, userData, callback);
+}
+#endif
+
+int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback, int auth_required) {
+	httpRoute_t* r;
+	char* urlCopy;
+
 	if (!url || !callback) {
 		return -1;
 	}
-	if (numCallbacks >= MAX_HTTP_CALLBACKS) {
-		return -4;
+	// leading '/' is skipped, request url doesn't have it
+	if (*url == '/') {
+		url++;
 	}
-	for (i = 0; i < MAX_HTTP_CALLBACKS; i++) {
-		if (callbacks[i]) {
-			if (callbacks[i]->callback == callback && !strcmp(callbacks[i]->url, url)
-				&& callbacks[i]->method == method) {
-				return i;
-			}
-		}
+	// drivers register again when restarted
+	if (HTTP_HasRoute(g_routeHash[HTTP_HashUrl(url)], url, method, callback)
+		|| HTTP_HasRoute(g_prefixRoutes, url, method, callback)) {
+		return 0;
 	}
-	callbacks[numCallbacks] = (http_callback_t*)os_malloc(sizeof(http_callback_t));
-	if (!callbacks[numCallbacks]) {
+	r = (httpRoute_t*)os_malloc(sizeof(httpRoute_t));
+	if (!r) {
 		return -2;
 	}
-	callbacks[numCallbacks]->url = (char*)os_malloc(strlen(url) + 1);
-	if (!callbacks[numCallbacks]->url) {
-		os_free(callbacks[numCallbacks]);
+	urlCopy = (char*)os_malloc(strlen(url) + 1);
+	if (!urlCopy) {
+		os_free(r);
 		return -3;
 	}
-	strcpy(callbacks[numCallbacks]->url, url);
-	callbacks[numCallbacks]->callback = callback;
-	callbacks[numCallbacks]->method = method;
-	callbacks[numCallbacks]->auth_required = auth_required > 0 ? 1 : 0;
-
-	numCallbacks++;
+	strcpy(urlCopy, url);
+	HTTP_InitPageRoutes();
+	memset(r, 0, sizeof(httpRoute_t));
+	r->url = urlCopy;
+	r->callback = callback;
+	r->method = method;
+	r->flags = auth_required > 0 ? HTTP_ROUTE_AUTH : 0;
+	HTTP_AddRoute(r);
 
 	// success
 	return 0;
@@ -141,6 +259,129 @@ int my_strnicmp(const char* a, const char* b, int len) {
 	}
 	return 0;
 }
+// Content-Length of request with complete headers, 0 when not given
+int HTTP_GetContentLength(const char* data, const char* headersEnd)
+{
+	const char* line;
+	int contentLength = 0;
+
+	line = data;
+	while (line && line < headersEnd) {
+		if (!my_strnicmp(line, "Content-Length:", 15)) {
+			contentLength = atoi(line + 15);
+		}
+		line = strstr(line, "\r\n");
+		if (line) {
+			line += 2;
+		}
+	}
+	return contentLength;
+}
+// true when headers and body of given Content-Length have arrived
+int HTTP_IsRequestComplete(const char* data, int len)
+{
+	const char* headersEnd;
+
+	headersEnd = strstr(data, "\r\n\r\n");
+	if (headersEnd == 0) {
+		return false;
+	}
+	return len >= (headersEnd + 4 - data) + HTTP_GetContentLength(data, headersEnd);
+}
+// request line ends with HTTP/1.1
+int HTTP_IsVersion11(const char* req)
+{
+	const char* eol;
+
+	eol = strstr(req, "\r\n");
+	return eol && eol - req >= 8 && !strncmp(eol - 8, "HTTP/1.1", 8);
+}
+// Finds out if browser wants to keep connection open after this request.
+// HTTP/1.1 keeps it by default, HTTP/1.0 only when asked.
+int HTTP_WantsKeepAlive(const char* req)
+{
+	const char* line;
+	const char* eol;
+	const char* v;
+	bool keep;
+
+	// only GETs, like state polls, POSTs (OTA, config) may restart device after reply
+	if (strncmp(req, "GET ", 4)) {
+		return false;
+	}
+	eol = strstr(req, "\r\n");
+	if (eol == 0) {
+		return false;
+	}
+	keep = HTTP_IsVersion11(req);
+	line = eol + 2;
+	while (*line && *line != '\r') {
+		if (!my_strnicmp(line, "Connection:", 11)) {
+			v = line + 11;
+			while (*v == ' ') {
+				v++;
+			}
+			if (!my_strnicmp(v, "close", 5)) {
+				keep = false;
+			}
+			else if (!my_strnicmp(v, "keep-alive", 10)) {
+				keep = true;
+			}
+		}
+		eol = strstr(line, "\r\n");
+		if (eol == 0) {
+			break;
+		}
+		line = eol + 2;
+	}
+	return keep;
+}
+// Replaces "Connection: close" of reply that is still whole in buffer
+// with keep-alive headers and Content-Length. Returns new length,
+// or -1 if it can't be done and connection must be closed.
+int HTTP_SetKeepAliveHeaders(char* reply, int len, int maxLen)
+{
+	static const char closeHeader[] = "Connection: close\r\n";
+	char tmp[96];
+	char* headersEnd;
+	char* conn;
+	char* contentLength;
+	int bodyLen, newLen, oldLen;
+
+	reply[len] = 0;
+	if (strncmp(reply, "HTTP/1.", 7)) {
+		return -1;
+	}
+	headersEnd = strstr(reply, "\r\n\r\n");
+	if (headersEnd == 0) {
+		return -1;
+	}
+	headersEnd += 4;
+	conn = strstr(reply, closeHeader);
+	if (conn == 0 || conn >= headersEnd) {
+		return -1;
+	}
+	bodyLen = len - (headersEnd - reply);
+	contentLength = strstr(reply, "Content-Length:");
+	if (contentLength && contentLength < headersEnd) {
+		// set by http_setup_len
+		newLen = snprintf(tmp, sizeof(tmp), "Connection: keep-alive\r\nKeep-Alive: timeout=%i\r\n",
+			HTTP_KEEPALIVE_TIMEOUT_MS / 1000);
+	}
+	else {
+		newLen = snprintf(tmp, sizeof(tmp), "Connection: keep-alive\r\nKeep-Alive: timeout=%i\r\nContent-Length: %i\r\n",
+			HTTP_KEEPALIVE_TIMEOUT_MS / 1000, bodyLen);
+	}
+	oldLen = sizeof(closeHeader) - 1;
+	if (len + newLen - oldLen > maxLen) {
+		return -1;
+	}
+	memmove(conn + newLen, conn + oldLen, len - (conn + oldLen - reply));
+	memcpy(conn, tmp, newLen);
+	len += newLen - oldLen;
+	reply[len] = 0;
+	return len;
+}
 
 
 /// @brief Write escaped data to the response.
@@ -247,6 +488,142 @@ void poststr_escapedForJSON(http_request_t* request, char* str) {
 		postany(request, str, strlen(str));
 	}
 }
+
+void JSONW_Init(jsonWriter_t* w, http_request_t* request) {
+	w->request = request;
+	w->depth = 0;
+	w->hasItems = 0;
+}
+// runs of plain characters are posted at once
+static void JSONW_PostEscaped(http_request_t* request, const char* s) {
+	const char* start = s;
+	char tmp[8];
+
+	while (*s) {
+		unsigned char c = *s;
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			s++;
+			continue;
+		}
+		if (s > start) {
+			postany(request, start, s - start);
+		}
+		if (c == '"' || c == '\\') {
+			tmp[0] = '\\';
+			tmp[1] = c;
+			tmp[2] = 0;
+		}
+		else if (c == '\n') {
+			strcpy(tmp, "\\n");
+		}
+		else if (c == '\r') {
+			strcpy(tmp, "\\r");
+		}
+		else if (c == '\t') {
+			strcpy(tmp, "\\t");
+		}
+		else {
+			snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+		}
+		postany(request, tmp, strlen(tmp));
+		s++;
+		start = s;
+	}
+	if (s > start) {
+		postany(request, start, s - start);
+	}
+}
+// comma and key before next value
+static void JSONW_Key(jsonWriter_t* w, const char* key) {
+	unsigned int bit = 1u << w->depth;
+
+	if (w->hasItems & bit) {
+		postany(w->request, ",", 1);
+	}
+	w->hasItems |= bit;
+	if (key) {
+		postany(w->request, "\"", 1);
+		JSONW_PostEscaped(w->request, key);
+		postany(w->request, "\":", 2);
+	}
+}
+static void JSONW_Open(jsonWriter_t* w, const char* key, const char* bracket) {
+	JSONW_Key(w, key);
+	postany(w->request, bracket, 1);
+	if (w->depth < 31) {
+		w->depth++;
+	}
+	w->hasItems &= ~(1u << w->depth);
+}
+static void JSONW_Close(jsonWriter_t* w, const char* bracket) {
+	if (w->depth > 0) {
+		w->depth--;
+	}
+	postany(w->request, bracket, 1);
+}
+void JSONW_StartObject(jsonWriter_t* w, const char* key) {
+	JSONW_Open(w, key, "{");
+}
+void JSONW_EndObject(jsonWriter_t* w) {
+	JSONW_Close(w, "}");
+}
+void JSONW_StartArray(jsonWriter_t* w, const char* key) {
+	JSONW_Open(w, key, "[");
+}
+void JSONW_EndArray(jsonWriter_t* w) {
+	JSONW_Close(w, "]");
+}
+void JSONW_String(jsonWriter_t* w, const char* key, const char* value) {
+	JSONW_Key(w, key);
+	postany(w->request, "\"", 1);
+	if (value) {
+		JSONW_PostEscaped(w->request, value);
+	}
+	postany(w->request, "\"", 1);
+}
+void JSONW_Int(jsonWriter_t* w, const char* key, int value) {
+	char tmp[16];
+
+	JSONW_Key(w, key);
+	snprintf(tmp, sizeof(tmp), "%i", value);
+	postany(w->request, tmp, strlen(tmp));
+}
+void JSONW_Bool(jsonWriter_t* w, const char* key, int value) {
+	JSONW_Key(w, key);
+	if (value) {
+		postany(w->request, "true", 4);
+	}
+	else {
+		postany(w->request, "false", 5);
+	}
+}
+void JSONW_Float(jsonWriter_t* w, const char* key, float value, int decimals) {
+	char tmp[32];
+
+	JSONW_Key(w, key);
+	if (isnan(value) || isinf(value)) {
+		postany(w->request, "null", 4);
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "%.*f", decimals, value);
+	postany(w->request, tmp, strlen(tmp));
+}
+void JSONW_Number(jsonWriter_t* w, const char* key, double value) {
+	char tmp[32];
+
+	JSONW_Key(w, key);
+	if (isnan(value) || isinf(value)) {
+		postany(w->request, "null", 4);
+		return;
+	}
+	if (value >= INT_MIN && value <= INT_MAX && value == (double)(int)value) {
+		snprintf(tmp, sizeof(tmp), "%i", (int)value);
+	}
+	else {
+		snprintf(tmp, sizeof(tmp), "%.5f", value);
+	}
+	postany(w->request, tmp, strlen(tmp));
+}
 bool http_startsWith(const char* base, const char* substr) {
 	while (*substr != 0) {
 		if (*base != *substr)
@@ -295,17 +672,49 @@ void http_setup(http_request_t* request, const char* type) {
 	poststr(request, "\r\n"); // end headers with double CRLF
 	poststr(request, "\r\n");
 }
+// for bodies built beforehand, client knows where body ends without
+// waiting for close, and kept-alive reply never has to go in chunks
+void http_setup_len(http_request_t* request, const char* type, int len) {
+	hprintf255(request, httpHeader, request->responseCode, type);
+	hprintf255(request, "\r\nContent-Length: %i\r\n", len);
+	poststr(request, httpCorsHeaders);
+	poststr(request, "\r\n");
+	// too big to stay in buffer, goes out as it is and connection is closed
+	if (request->replylen + len + 128 >= request->replymaxlen) {
+		request->keepAlive = 0;
+	}
+	poststr(request, "Connection: close");
+	poststr(request, "\r\n"); // end headers with double CRLF
+	poststr(request, "\r\n");
+}
 void http_setup_gz(http_request_t* request, const char* type) {
+	http_setup_gz_cached(request, type, NULL);
+}
+// etag can be NULL, otherwise content must never change for given etag
+static void http_setup_etag(http_request_t* request, const char* type, int bGzip, const char* etag, const char* cacheControl) {
 	hprintf255(request, httpHeader, request->responseCode, type);
 	poststr(request, "\r\n"); // next header
 	poststr(request, httpCorsHeaders);
 	poststr(request, "\r\n");
-	poststr(request, "Content-Encoding: gzip");
-	poststr(request, "\r\n");
+	if (bGzip) {
+		poststr(request, "Content-Encoding: gzip");
+		poststr(request, "\r\n");
+	}
+	if (etag) {
+		hprintf255(request, "ETag: \"%s\"\r\n", etag);
+		poststr(request, cacheControl);
+	}
 	poststr(request, "Connection: close");
 	poststr(request, "\r\n"); // end headers with double CRLF
 	poststr(request, "\r\n");
 }
+void http_setup_gz_cached(http_request_t* request, const char* type, const char* etag) {
+	http_setup_etag(request, type, true, etag, "Cache-Control: public, max-age=31536000, immutable\r\n");
+}
+// content can change for same url, browser revalidates with etag every time
+void http_setup_cached(http_request_t* request, const char* type, int bGzip, const char* etag) {
+	http_setup_etag(request, type, bGzip, etag, "Cache-Control: no-cache\r\n");
+}
 
 void http_html_start(http_request_t* request, const char* pagename) {
 	poststr(request, htmlDoctype);
@@ -317,7 +726,7 @@ void http_html_start(http_request_t* request, const char* pagename) {
 	poststr(request, "</title>");
 	poststr(request, htmlShortcutIcon);
 	poststr(request, htmlHeadMeta);
-	poststr(request, htmlHeadStyle);
+	poststr(request, "<link rel='stylesheet' href='/" HTTP_STYLE_URL "'>");
 	poststr(request, "</head>");
 	poststr(request, htmlBodyStart);
 	poststr(request, CFG_GetDeviceName());
@@ -325,11 +734,6 @@ void http_html_start(http_request_t* request, const char* pagename) {
 }
 
 
-const char pageScriptPart1[] = "<script type='text/javascript'>var firstTime,lastTime,onlineFor,req=null,onlineForEl=null,getElement=e=>document.getElementById(e);function showState(){clearTimeout(firstTime),clearTimeout(lastTime),null!=req&&req.abort(),(e=getElement(\"state\"))&&((req=new XMLHttpRequest).onreadystatechange=()=>{4==req.readyState&&\"OK\"==req.statusText&&(\"SELECT\"!=document.activeElement.tagName&&(\"INPUT\"!=document.activeElement.tagName||\"number\"!=document.activeElement.type&&\"color\"!=document.activeElement.type)&&(e.innerHTML=req.responseText),clearTimeout(firstTime),clearTimeout(lastTime),lastTime=setTimeout(showState,";
-const char pageScriptPart2[] = "))},req.open(\"GET\",\"index?state=1\",!0),req.send()),firstTime=setTimeout(showState,";
-const char pageScriptPart3[] = ")}function fmtUpTime(e){var t,n,o=Math.floor(e/86400);return e%=86400,t=Math.floor(e/3600),e%=3600,n=Math.floor(e/60),e=e%60,0<o?o+` days, ${t} hours, ${n} minutes and ${e} seconds`:0<t?t+` hours, ${n} minutes and ${e} seconds`:0<n?n+` minutes and ${e} seconds`:`just ${e} seconds`}function updateOnlineFor(){onlineForEl.textContent=fmtUpTime(++onlineFor)}function onLoad(){(onlineForEl=getElement(\"onlineFor\"))&&(onlineFor=parseInt(onlineForEl.dataset.initial,10))&&setInterval(updateOnlineFor,1e3),showState()}function submitTemperature(e){var t=getElement(\"form132\");getElement(\"kelvin132\").value=Math.round(1e6/parseInt(e.value)),t.submit()}window.addEventListener(\"load\",onLoad),history.pushState(null,\"\",window.location.pathname.slice(1)),setTimeout(()=>{var e=getElement(\"changed\");e&&(e.innerHTML=\"\")},5e3);</script>";
-
-
 void http_html_end(http_request_t* request) {
 	char upTimeStr[128];
 	unsigned char mac[32];
@@ -353,11 +757,81 @@ void http_html_end(http_request_t* request) {
 #endif
 
 	poststr(request, htmlBodyEnd);
-	poststr(request, pageScriptPart1);
-	hprintf255(request, "%i", g_indexAutoRefreshInterval);
-	poststr(request, pageScriptPart2);
-	hprintf255(request, "%i", g_indexAutoRefreshInterval);
-	poststr(request, pageScriptPart3);
+	hprintf255(request, "<script>var refreshInterval=%i;</script>", g_indexAutoRefreshInterval);
+	poststr(request, "<script src='/" HTTP_SCRIPT_URL "'></script>");
+}
+
+int http_hasETag(http_request_t* request, const char* etag) {
+	int i;
+
+	for (i = 0; i < request->numheaders; i++) {
+		if (!my_strnicmp(request->headers[i], "If-None-Match:", 14)) {
+			return strstr(request->headers[i] + 14, etag) != 0;
+		}
+	}
+	return false;
+}
+int http_getRange(http_request_t* request, int size, int* first, int* last) {
+	const char* p;
+	char* end;
+	long a, b;
+	int i;
+
+	for (i = 0; i < request->numheaders; i++) {
+		if (my_strnicmp(request->headers[i], "Range:", 6)) {
+			continue;
+		}
+		p = request->headers[i] + 6;
+		while (*p == ' ') {
+			p++;
+		}
+		// other units and lists of ranges get whole body
+		if (strncmp(p, "bytes=", 6) || strchr(p, ',')) {
+			return 0;
+		}
+		p += 6;
+		if (*p == '-') {
+			// last b bytes
+			b = strtol(p + 1, &end, 10);
+			if (end == p + 1 || b <= 0 || size <= 0) {
+				return -1;
+			}
+			*first = b < size ? size - b : 0;
+			*last = size - 1;
+			return 1;
+		}
+		a = strtol(p, &end, 10);
+		if (end == p || *end != '-' || a >= size) {
+			return -1;
+		}
+		p = end + 1;
+		b = strtol(p, &end, 10);
+		if (end == p || b >= size) {
+			b = size - 1;
+		}
+		if (b < a) {
+			return -1;
+		}
+		*first = a;
+		*last = b;
+		return 1;
+	}
+	return 0;
+}
+// sends one of built-in gzipped files, or 304 when browser has it already
+static int http_fn_asset(http_request_t* request, const char* type, const byte* data, int len, const char* etag) {
+	if (http_hasETag(request, etag)) {
+		poststr(request, "HTTP/1.1 304 Not Modified\r\n");
+		hprintf255(request, "ETag: \"%s\"\r\n", etag);
+		poststr(request, "Cache-Control: public, max-age=31536000, immutable\r\n");
+		poststr(request, "Connection: close\r\n\r\n");
+		poststr(request, NULL);
+		return 0;
+	}
+	http_setup_gz_cached(request, type, etag);
+	postany(request, (const char*)data, len);
+	poststr(request, NULL);
+	return 0;
 }
 
 const char* http_checkArg(const char* p, const char* n) {
@@ -606,27 +1080,123 @@ void setupAllWB2SPinsAsButtons() {
 	PIN_SetPinChannelForPinIndex(27, 1);
 }
 
+static void http_send(http_request_t* request, const char* data, int len) {
+#if ENABLE_HTTP_REQUEST_STATS
+	int heap;
+
+	// socket buffers are taken from heap too, so it's sampled after send
+	request->sentBytes += len;
+	request->sendCalls++;
+	send(request->fd, data, len, 0);
+	heap = xPortGetFreeHeapSize();
+	if (heap < request->heapMin) {
+		request->heapMin = heap;
+	}
+#else
+	send(request->fd, data, len, 0);
+#endif
+}
 // add some more output safely, sending if necessary.
 // call with str == NULL to force send. - can be binary.
 // supply length
+// request with fd < 0 only captures output into reply buffer, what
+// doesn't fit is dropped
+static void http_sendChunk(http_request_t* request, const char* data, int len) {
+	char tmp[12];
+
+	// empty chunk would end the reply
+	if (len <= 0) {
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "%x\r\n", len);
+	http_send(request, tmp, strlen(tmp));
+	http_send(request, data, len);
+	http_send(request, "\r\n", 2);
+}
+// Sends headers that are still whole in buffer with "Connection: close"
+// replaced by keep-alive and chunked encoding, body part stays in buffer.
+// Returns false if headers are not there and connection must be closed.
+static bool http_startChunked(http_request_t* request) {
+	static const char closeHeader[] = "Connection: close\r\n";
+	static const char chunkedHeaders[] = "Connection: keep-alive\r\nTransfer-Encoding: chunked\r\n";
+	char* reply = request->reply;
+	char* headersEnd;
+	char* conn;
+	int len;
+
+	reply[request->replylen] = 0;
+	if (strncmp(reply, "HTTP/1.", 7)) {
+		return false;
+	}
+	headersEnd = strstr(reply, "\r\n\r\n");
+	if (headersEnd == 0) {
+		return false;
+	}
+	headersEnd += 2;
+	conn = strstr(reply, closeHeader);
+	if (conn == 0 || conn >= headersEnd) {
+		return false;
+	}
+	http_send(request, reply, conn - reply);
+	http_send(request, chunkedHeaders, sizeof(chunkedHeaders) - 1);
+	conn += sizeof(closeHeader) - 1;
+	http_send(request, conn, headersEnd + 2 - conn);
+	len = request->replylen - (headersEnd + 2 - reply);
+	memmove(reply, headersEnd + 2, len);
+	request->replylen = len;
+	request->chunked = 1;
+	return true;
+}
+// sends what is in buffer, kept-alive reply that got too big
+// goes on in chunks, or, if it can't, connection is closed after it
+static void http_flushReply(http_request_t* request) {
+	if (request->keepAlive && request->chunked == 0) {
+		if (request->allowChunked == 0 || http_startChunked(request) == false) {
+			request->keepAlive = 0;
+		}
+	}
+	if (request->chunked) {
+		http_sendChunk(request, request->reply, request->replylen);
+	}
+	else {
+		//ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", request->replylen);
+		http_send(request, request->reply, request->replylen);
+	}
+	request->reply[0] = 0;
+	request->replylen = 0;
+}
+void http_endChunked(http_request_t* request) {
+	http_sendChunk(request, request->reply, request->replylen);
+	http_send(request, "0\r\n\r\n", 5);
+	request->reply[0] = 0;
+	request->replylen = 0;
+}
+
 int postany(http_request_t* request, const char* str, int len) {
-#if PLATFORM_BL602 || PLATFORM_BEKEN_NEW || PLATFORM_RTL8720D
-	send(request->fd, str, len, 0);
-	return 0;
-#else
 	int currentlen;
 	int addlen = len;
 
+#if PLATFORM_BL602 || PLATFORM_BEKEN_NEW || PLATFORM_RTL8720D
+	if (request->fd >= 0) {
+		request->keepAlive = 0;
+		http_send(request, str, len);
+		return 0;
+	}
+#endif
 	//ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: got %i", len);
 
 	if (NULL == str) {
 		// fd will be NULL for unit tests where HTTP packet is faked locally
-		if (request->fd == 0) {
+		if (request->fd <= 0) {
 			return request->replylen;
 		}
+		if (request->keepAlive) {
+			// server sends it when request is done
+			return 0;
+		}
 		if (request->replylen > 0) {
 			//ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", request->replylen);
-			send(request->fd, request->reply, request->replylen, 0);
+			http_send(request, request->reply, request->replylen);
 		}
 		request->reply[0] = 0;
 		request->replylen = 0;
@@ -634,33 +1204,107 @@ int postany(http_request_t* request, const char* str, int len) {
 	}
 
 	currentlen = request->replylen;
+	if (request->fd < 0 && currentlen + addlen >= request->replymaxlen) {
+		addlen = request->replymaxlen - 1 - currentlen;
+		if (addlen <= 0) {
+			return currentlen;
+		}
+	}
 	if (currentlen + addlen >= request->replymaxlen) {
-		//ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", request->replylen);
-		send(request->fd, request->reply, request->replylen, 0);
-		request->reply[0] = 0;
-		request->replylen = 0;
+		http_flushReply(request);
 		currentlen = 0;
 	}
-	while (addlen >= request->replymaxlen) {
-		if (request->replylen > 0) {
-			//ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", request->replylen);
-			send(request->fd, request->reply, request->replylen, 0);
-			request->replylen = 0;
+	if (addlen >= request->replymaxlen) {
+		// doesn't fit in buffer, buffer was flushed above, so send it whole,
+		// send blocks until it is queued
+		//ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", addlen);
+		if (request->chunked) {
+			http_sendChunk(request, str, addlen);
 		}
-		//ADDLOG_ERROR(LOG_FEATURE_HTTP, "postany: send %i", (request->replymaxlen - 1));
-		send(request->fd, str, (request->replymaxlen - 1), 0);
-		addlen -= (request->replymaxlen - 1);
-		str += (request->replymaxlen - 1);
-
-		rtos_delay_milliseconds(1);
+		else {
+			http_send(request, str, addlen);
+		}
+		return 0;
 	}
 
 	memcpy(request->reply + request->replylen, str, addlen);
 	request->replylen += addlen;
 	return (currentlen + addlen);
+}
+
+// strings shorter than that are still copied, so they go out together
+#define POSTCONST_DIRECT_MIN	256
+
+int postconst(http_request_t* request, const char* str) {
+	return postconstany(request, str, strlen(str));
+}
+int postconstany(http_request_t* request, const char* str, int len) {
+#if PLATFORM_BL602 || PLATFORM_BEKEN_NEW || PLATFORM_RTL8720D
+	// postany sends directly there anyway
+	return postany(request, str, len);
+#else
+	// kept-alive reply stays in buffer until it gets too big to be sent
+	// with Content-Length, and unit tests read the buffer
+	if (len < POSTCONST_DIRECT_MIN || (request->keepAlive && request->chunked == 0) || request->fd <= 0) {
+		return postany(request, str, len);
+	}
+	if (request->replylen > 0) {
+		http_flushReply(request);
+	}
+	if (request->chunked) {
+		http_sendChunk(request, str, len);
+	}
+	else {
+		http_send(request, str, len);
+	}
+	return 0;
 #endif
 }
 
+#ifndef HTTP_BODY_CHUNK_SIZE
+#define HTTP_BODY_CHUNK_SIZE	1024
+#endif
+
+int http_readBody(http_request_t* request, char** out) {
+	int len, remaining;
+
+	remaining = -1;
+	if (request->contentLength >= 0) {
+		remaining = request->contentLength - request->bodyRead;
+		if (remaining <= 0) {
+			return 0;
+		}
+	}
+	if (request->bodylen > 0) {
+		len = request->bodylen;
+		if (remaining >= 0 && len > remaining) {
+			len = remaining;
+		}
+		*out = request->bodystart;
+		request->bodylen = 0;
+		request->bodyRead += len;
+		return len;
+	}
+	// fake requests of unit tests have whole body in buffer
+	if (request->fd <= 0) {
+		return remaining < 0 ? 0 : -1;
+	}
+	len = request->receivedLenmax;
+	if (len > HTTP_BODY_CHUNK_SIZE) {
+		len = HTTP_BODY_CHUNK_SIZE;
+	}
+	if (remaining >= 0 && len > remaining) {
+		len = remaining;
+	}
+	len = recv(request->fd, request->received, len, 0);
+	if (len <= 0) {
+		// without Content-Length body ends when client closes
+		return remaining < 0 ? 0 : -1;
+	}
+	*out = request->received;
+	request->bodyRead += len;
+	return len;
+}
 
 // add some more output safely, sending if necessary.
 // call with str == NULL to force send.
@@ -684,8 +1328,102 @@ int hprintf255(http_request_t* request, const char* fmt, ...) {
 
 int HUE_APICall(http_request_t* request);
 
-int HTTP_ProcessPacket(http_request_t* request) {
+#if (ENABLE_DRIVER_DS1820_FULL)
+// including "../driver/drv_ds1820_simple.h" will complain about typedefs not used here 
+// so lets declare it "extern"
+extern int http_fn_cfg_ds18b20(http_request_t* request);
+#endif
+static int http_fn_style(http_request_t* request) {
+	return http_fn_asset(request, httpMimeTypeCSS, htmlHeadStyleGz, sizeof(htmlHeadStyleGz), HTMLHEADSTYLE_HASH);
+}
+static int http_fn_script(http_request_t* request) {
+	return http_fn_asset(request, httpMimeTypeJavascript, pageScriptGz, sizeof(pageScriptGz), PAGESCRIPT_HASH);
+}
+
+#define HTTP_PAGE(u, fn)		{ .url = u, .callback = fn, .method = HTTP_ANY, .flags = HTTP_ROUTE_PAGE }
+
+// builtin pages, they go to route table on first request
+static httpRoute_t g_pageRoutes[] = {
+	HTTP_PAGE("", http_fn_empty_url),
+	HTTP_PAGE(HTTP_STYLE_URL, http_fn_style),
+	HTTP_PAGE(HTTP_SCRIPT_URL, http_fn_script),
+	HTTP_PAGE("testmsg", http_fn_testmsg),
+	HTTP_PAGE("index", http_fn_index),
+	HTTP_PAGE("state", http_fn_state),
+#if ENABLE_HTTP_SSE
+	HTTP_PAGE("events", http_fn_events),
+#endif
+	HTTP_PAGE("about", http_fn_about),
+#if ENABLE_HTTP_MQTT
+	HTTP_PAGE("cfg_mqtt", http_fn_cfg_mqtt),
+	HTTP_PAGE("cfg_mqtt_set", http_fn_cfg_mqtt_set),
+#endif
+#if ENABLE_HTTP_IP
+	HTTP_PAGE("cfg_ip", http_fn_cfg_ip),
+#endif
+#if (ENABLE_DRIVER_DS1820_FULL)
+	HTTP_PAGE("cfg_ds18b20", http_fn_cfg_ds18b20),
+#endif
+#if ENABLE_HTTP_WEBAPP
+	HTTP_PAGE("cfg_webapp", http_fn_cfg_webapp),
+	HTTP_PAGE("cfg_webapp_set", http_fn_cfg_webapp_set),
+#endif
+	HTTP_PAGE("cfg_wifi", http_fn_cfg_wifi),
+#if ENABLE_HTTP_NAMES
+	HTTP_PAGE("cfg_name", http_fn_cfg_name),
+#endif
+	HTTP_PAGE("cfg_wifi_set", http_fn_cfg_wifi_set),
+	HTTP_PAGE("cfg_loglevel_set", http_fn_cfg_loglevel_set),
+#if ENABLE_HTTP_MAC
+	HTTP_PAGE("cfg_mac", http_fn_cfg_mac),
+#endif
+	HTTP_PAGE("cmd_tool", http_fn_cmd_tool),
+#if ENABLE_HTTP_STARTUP
+	HTTP_PAGE("startup_command", http_fn_startup_command),
+#endif
+#if ENABLE_HTTP_FLAGS
+	HTTP_PAGE("cfg_generic", http_fn_cfg_generic),
+#endif
+#if ENABLE_HTTP_STARTUP
+	HTTP_PAGE("cfg_startup", http_fn_cfg_startup),
+#endif
+#if ENABLE_HTTP_DGR
+	HTTP_PAGE("cfg_dgr", http_fn_cfg_dgr),
+#endif
+#if ENABLE_HA_DISCOVERY
+	HTTP_PAGE("ha_cfg", http_fn_ha_cfg),
+	HTTP_PAGE("ha_discovery", http_fn_ha_discovery),
+#endif
+	HTTP_PAGE("cfg", http_fn_cfg),
+	HTTP_PAGE("cfg_pins", http_fn_cfg_pins),
+#if ENABLE_HTTP_PING
+	HTTP_PAGE("cfg_ping", http_fn_cfg_ping),
+#endif
+	HTTP_PAGE("ota", http_fn_ota),
+	HTTP_PAGE("ota_exec", http_fn_ota_exec),
+	HTTP_PAGE("cm", http_fn_cm),
+#if ENABLE_TIME_PMNTP
+	HTTP_PAGE("pmntp", http_fn_pmntp), // poor mans NTP
+#endif
+};
+static bool g_pageRoutesAdded = false;
+
+static void HTTP_InitPageRoutes() {
 	int i;
+
+	if (g_pageRoutesAdded) {
+		return;
+	}
+	g_pageRoutesAdded = true;
+	for (i = 0; i < sizeof(g_pageRoutes) / sizeof(g_pageRoutes[0]); i++) {
+		HTTP_AddRoute(&g_pageRoutes[i]);
+	}
+}
+
+static int HTTP_ProcessPacketInternal(http_request_t* request) {
+	int i;
+	httpRoute_t* route;
+	httpRoute_t* prefixRoute;
 	char* p;
 	char* headers;
 	char* protocol;
@@ -820,18 +1558,16 @@ int HTTP_ProcessPacket(http_request_t* request) {
 	}
 #endif
 
-	// look for a callback with this URL and method, or HTTP_ANY
-	for (i = 0; i < numCallbacks; i++) {
-		char* url = callbacks[i]->url;
-		if (http_startsWith(urlStr, &url[1])) {
-			int method = callbacks[i]->method;
-			if (method == HTTP_ANY || method == request->method) {
-				if (callbacks[i]->auth_required > 0 && http_basic_auth_run(request) == HTTP_BASIC_AUTH_FAIL) {
-					return 0;
-				}
-				return callbacks[i]->callback(request);
-			}
-		}
+	// pages are run after auth and LFS override, so those are checked
+	// first, other routes do their own auth
+	HTTP_InitPageRoutes();
+	route = HTTP_FindRoute(urlStr, request->method);
+	if (route && !(route->flags & HTTP_ROUTE_PAGE)) {
+		return HTTP_RunRoute(route, request);
+	}
+	prefixRoute = HTTP_FindPrefixRoute(urlStr, request->method);
+	if (prefixRoute) {
+		return HTTP_RunRoute(prefixRoute, request);
 	}
 
 	if (http_basic_auth_run(request) == HTTP_BASIC_AUTH_FAIL) {
@@ -849,77 +1585,107 @@ int HTTP_ProcessPacket(http_request_t* request) {
 	}
 #endif
 
-	if (http_checkUrlBase(urlStr, "")) return http_fn_empty_url(request);
-
-	if (http_checkUrlBase(urlStr, "testmsg")) return http_fn_testmsg(request);
-	if (http_checkUrlBase(urlStr, "index")) return http_fn_index(request);
-
-	if (http_checkUrlBase(urlStr, "about")) return http_fn_about(request);
-	
-#if ENABLE_HTTP_MQTT
-	if (http_checkUrlBase(urlStr, "cfg_mqtt")) return http_fn_cfg_mqtt(request);
-	if (http_checkUrlBase(urlStr, "cfg_mqtt_set")) return http_fn_cfg_mqtt_set(request);
-#endif
-#if ENABLE_HTTP_IP
-	if (http_checkUrlBase(urlStr, "cfg_ip")) return http_fn_cfg_ip(request);
-#endif
-#if (ENABLE_DRIVER_DS1820_FULL)
-	// including "../driver/drv_ds1820_simple.h" will complain about typedefs not used here 
-	// so lets declare it "extern"
-	extern int http_fn_cfg_ds18b20(http_request_t* request);
-	if (http_checkUrlBase(urlStr, "cfg_ds18b20")) return http_fn_cfg_ds18b20(request);
-#endif
-
-#if ENABLE_HTTP_WEBAPP
-	if (http_checkUrlBase(urlStr, "cfg_webapp")) return http_fn_cfg_webapp(request);
-	if (http_checkUrlBase(urlStr, "cfg_webapp_set")) return http_fn_cfg_webapp_set(request);
-#endif
+	if (route) {
+		return HTTP_RunRoute(route, request);
+	}
+	return http_fn_other(request);
+}
 
-	if (http_checkUrlBase(urlStr, "cfg_wifi")) return http_fn_cfg_wifi(request);
-#if ENABLE_HTTP_NAMES
-	if (http_checkUrlBase(urlStr, "cfg_name")) return http_fn_cfg_name(request);
-#endif
-	if (http_checkUrlBase(urlStr, "cfg_wifi_set")) return http_fn_cfg_wifi_set(request);
+#if ENABLE_HTTP_REQUEST_STATS
+static httpRequestStats_t g_requestStats[HTTP_REQUEST_STATS_COUNT];
+// total count of recorded requests, next one goes to g_requestStats[g_requestStatsCount % size]
+static int g_requestStatsCount = 0;
+static SemaphoreHandle_t g_requestStatsMutex = 0;
 
-	if (http_checkUrlBase(urlStr, "cfg_loglevel_set")) return http_fn_cfg_loglevel_set(request);
-#if ENABLE_HTTP_MAC
-	if (http_checkUrlBase(urlStr, "cfg_mac")) return http_fn_cfg_mac(request);
-#endif
-	if (http_checkUrlBase(urlStr, "cmd_tool")) return http_fn_cmd_tool(request);
+static bool HTTP_RequestStats_Take() {
+	if (g_requestStatsMutex == 0) {
+		g_requestStatsMutex = xSemaphoreCreateMutex();
+	}
+	return xSemaphoreTake(g_requestStatsMutex, 10) == pdTRUE;
+}
+static void HTTP_RecordRequest(http_request_t* request, unsigned int us, int heapStart) {
+	httpRequestStats_t* e;
+	const char* url;
+	int i;
 
-#if ENABLE_HTTP_STARTUP
-	if (http_checkUrlBase(urlStr, "startup_command")) return http_fn_startup_command(request); 
-#endif
-#if ENABLE_HTTP_FLAGS
-	if (http_checkUrlBase(urlStr, "cfg_generic")) return http_fn_cfg_generic(request);
-#endif
-#if ENABLE_HTTP_STARTUP
-	if (http_checkUrlBase(urlStr, "cfg_startup")) return http_fn_cfg_startup(request);
-#endif
-#if ENABLE_HTTP_DGR
-	if (http_checkUrlBase(urlStr, "cfg_dgr")) return http_fn_cfg_dgr(request);
-#endif
+	if (HTTP_RequestStats_Take() == false) {
+		return;
+	}
+	e = &g_requestStats[g_requestStatsCount % HTTP_REQUEST_STATS_COUNT];
+	g_requestStatsCount++;
+	url = request->url ? request->url : "";
+	for (i = 0; i < sizeof(e->url) - 1 && url[i] && url[i] != '?' && url[i] != ' '; i++) {
+		e->url[i] = url[i];
+	}
+	e->url[i] = 0;
+	e->method = request->method;
+	e->us = us;
+	e->bytes = request->sentBytes + request->replylen;
+	e->sends = request->sendCalls + (request->replylen > 0 ? 1 : 0);
+	e->heapMin = request->heapMin;
+	e->heapUsed = heapStart - request->heapMin;
+	xSemaphoreGive(g_requestStatsMutex);
+}
+int HTTP_GetRequestStats(httpRequestStats_t* out, int maxCount) {
+	int i, count;
 
-#if ENABLE_HA_DISCOVERY
-	if (http_checkUrlBase(urlStr, "ha_cfg")) return http_fn_ha_cfg(request);
-	if (http_checkUrlBase(urlStr, "ha_discovery")) return http_fn_ha_discovery(request);
+	if (HTTP_RequestStats_Take() == false) {
+		return 0;
+	}
+	count = g_requestStatsCount;
+	if (count > HTTP_REQUEST_STATS_COUNT) {
+		count = HTTP_REQUEST_STATS_COUNT;
+	}
+	if (count > maxCount) {
+		count = maxCount;
+	}
+	for (i = 0; i < count; i++) {
+		out[i] = g_requestStats[(g_requestStatsCount - 1 - i) % HTTP_REQUEST_STATS_COUNT];
+	}
+	xSemaphoreGive(g_requestStatsMutex);
+	return count;
+}
+void HTTP_LogRequestStats() {
+	httpRequestStats_t stats[HTTP_REQUEST_STATS_COUNT];
+	int i, count;
+
+	count = HTTP_GetRequestStats(stats, HTTP_REQUEST_STATS_COUNT);
+	for (i = 0; i < count; i++) {
+		ADDLOG_INFO(LOG_FEATURE_HTTP, "%s %i: %u us, %i bytes in %i sends, heap min %i, used %i",
+			stats[i].url, stats[i].method, stats[i].us, stats[i].bytes, stats[i].sends,
+			stats[i].heapMin, stats[i].heapUsed);
+	}
+}
 #endif
-	if (http_checkUrlBase(urlStr, "cfg")) return http_fn_cfg(request);
 
-	if (http_checkUrlBase(urlStr, "cfg_pins")) return http_fn_cfg_pins(request);
-#if ENABLE_HTTP_PING
-	if (http_checkUrlBase(urlStr, "cfg_ping")) return http_fn_cfg_ping(request);
+int HTTP_ProcessPacket(http_request_t* request) {
+	PowerGov_Kick();
+#if ENABLE_IO_TRACE
+	// before it is parsed in place
+	if (g_ioTraceMode) {
+		IOTrace_HttpRx(request->received, request->receivedLen);
+	}
 #endif
-
-
-	if (http_checkUrlBase(urlStr, "ota")) return http_fn_ota(request);
-	if (http_checkUrlBase(urlStr, "ota_exec")) return http_fn_ota_exec(request);
-	if (http_checkUrlBase(urlStr, "cm")) return http_fn_cm(request);
-	
-#if ENABLE_TIME_PMNTP
-	if (http_checkUrlBase(urlStr, "pmntp")) return http_fn_pmntp(request); // poor mans NTP
+#if ENABLE_HTTP_REQUEST_STATS
+	unsigned int start;
+	int heapStart, heap, res;
+
+	start = xTaskGetTickCount();
+	heapStart = xPortGetFreeHeapSize();
+	request->url = 0;
+	request->sentBytes = 0;
+	request->sendCalls = 0;
+	request->heapMin = heapStart;
+	res = HTTP_ProcessPacketInternal(request);
+	heap = xPortGetFreeHeapSize();
+	if (heap < request->heapMin) {
+		request->heapMin = heap;
+	}
+	HTTP_RecordRequest(request, (unsigned int)(xTaskGetTickCount() - start) * portTICK_PERIOD_MS * 1000, heapStart);
+	return res;
+#else
+	return HTTP_ProcessPacketInternal(request);
 #endif
-	return http_fn_other(request);
 }
 
 /*
@@ -931,10 +1697,6 @@ Gulp tasks should automatically appear in Visual Code or can be invoked from con
 See https://github.com/openshwprojects/OpenBK7231T_App/blob/main/BUILDING.md for gulp setup.
 */
 
-//region_start htmlHeadStyle
-const char htmlHeadStyle[] = "<style>div,fieldset,input,select{padding:5px;font-size:1em;margin:0 0 .2em}fieldset{background:#4f4f4f}p{margin:.5em 0}input{width:100%;box-sizing:border-box;-webkit-box-sizing:border-box;-moz-box-sizing:border-box;background:#ddd;color:#000}form{margin-bottom:.5em}input[type=checkbox],input[type=radio]{width:1em;margin-right:6px;vertical-align:-1px}input[type=range]{width:99%}select{width:100%;background:#ddd;color:#000}textarea{resize:vertical;width:98%;height:318px;padding:5px;overflow:auto;background:#1f1f1f;color:#65c115}body{text-align:center;font-family:verdana,sans-serif}body,h1 a{background:#21333e;color:#eaeaea}td{padding:0}button,input[type=submit]{border:0;border-radius:.3rem;background:#1fa3ec;color:#faffff;line-height:2.4rem;font-size:1.2rem;cursor:pointer}input[type=submit]{width:100%;transition-duration:.4s}input[type=submit]:hover{background:#0e70a4}.bred{background:#d43535!important}.bred:hover{background:#931f1f!important}.bgrn{background:#47c266!important}.bgrn:hover{background:#5aaf6f!important}a{color:#1fa3ec;text-decoration:none}.p{float:left;text-align:left}.q{float:right;text-align:right}.r{border-radius:.3em;padding:2px;margin:6px 2px;background:linear-gradient(90deg,#ffa000,#a6d1ff)}.hf{display:none}.hdiv{width:95%;white-space:nowrap}.hele{width:210px;display:inline-block;margin-left:2px}div#state{padding:0}div#changed{padding:0;height:23px}div#main{text-align:left;display:inline-block;color:#eaeaea;min-width:340px;max-width:800px}table{table-layout:fixed;width:100%}.disp-none{display:none}.disp-inline{display:inline-block}.safe{color:red}form.indent{padding-left:16px}li{margin:5px 0}.off,.on{text-align:center;font-size:54px}.on{font-weight:700}</style>";
-//region_end htmlHeadStyle
-
 //region_start ha_discovery_script
 const char ha_discovery_script[] = "<script type='text/javascript'>function send_ha_disc(){var e=new XMLHttpRequest;e.open(\"GET\",\"/ha_discovery?prefix=\"+document.getElementById(\"ha_disc_topic\").value,!1),e.onload=function(){200===e.status?alert(e.responseText):404===e.status&&alert(\"Error invoking ha_discovery\")},e.onerror=function(){alert(\"Error invoking ha_discovery\")},e.send()}</script>";
 //region_end ha_discovery_script
@@ -5,6 +5,7 @@ extern int g_indexAutoRefreshInterval;
 extern const char httpHeader[];  // HTTP header
 extern const char httpMimeTypeHTML[];              // HTML MIME type
 extern const char httpMimeTypeText[];           // TEXT MIME type
+extern const char httpCorsHeaders[];
 extern const char httpMimeTypeJson[];
 extern const char httpMimeTypeBinary[];
 extern const char httpMimeTypeXML[];
@@ -23,8 +24,6 @@ extern const char* htmlPinRoleNames[];
 
 extern const char* g_build_str;
 
-extern const char htmlHeadStyle[];
-extern const char pageScript[];
 extern const char ha_discovery_script[];
 
 #define HTTP_RESPONSE_OK 200
@@ -49,6 +48,8 @@ typedef struct http_request_tag {
 	char* bodystart; /// start start of the body (maybe all of it)
 	int bodylen;
 	int contentLength;
+	// body bytes already given out by http_readBody
+	int bodyRead;
 	int responseCode;
 
 	// used to respond
@@ -56,6 +57,24 @@ typedef struct http_request_tag {
 	int replylen;
 	int replymaxlen;
 	int fd;
+	// set by server when connection may be kept open, then the whole
+	// reply stays in buffer and server sends it with Content-Length.
+	// Cleared when reply doesn't fit and can't go on in chunks.
+	int keepAlive;
+	// set by server that gives each client its own thread, so request
+	// may keep the connection for long, like event stream
+	int allowStream;
+	// set by server for HTTP/1.1 clients, kept-alive reply that outgrows
+	// the buffer is then sent in chunks instead of closing connection
+	int allowChunked;
+	// set once headers went out with Transfer-Encoding: chunked,
+	// server ends the reply with http_endChunked
+	int chunked;
+	// counted by http_send for request statistics, heapMin is
+	// lowest free heap seen, only with ENABLE_HTTP_REQUEST_STATS
+	int sentBytes;
+	int sendCalls;
+	int heapMin;
 
 	// user variables used to build JSON data
 	int userCounter;
@@ -64,13 +83,37 @@ typedef struct http_request_tag {
 
 int HTTP_ProcessPacket(http_request_t* request);
 void http_setup(http_request_t* request, const char* type);
+// http_setup with Content-Length of body that follows
+void http_setup_len(http_request_t* request, const char* type, int len);
 void http_setup_gz(http_request_t* request, const char* type);
+void http_setup_gz_cached(http_request_t* request, const char* type, const char* etag);
+// etag makes browser keep reply, see http_hasETag
+void http_setup_cached(http_request_t* request, const char* type, int bGzip, const char* etag);
+// true when browser sent If-None-Match with this etag
+int http_hasETag(http_request_t* request, const char* etag);
+// single "Range: bytes=" of body with given size, returns 1 with first
+// and last byte set, 0 when whole body is to be sent or -1 when range is
+// outside of it and reply is 416
+int http_getRange(http_request_t* request, int size, int* first, int* last);
 void http_html_start(http_request_t* request, const char* pagename);
 void http_html_end(http_request_t* request);
 int poststr(http_request_t* request, const char* str);
 void poststr_escaped(http_request_t* request, char* str);
 void poststr_escapedForJSON(http_request_t* request, char* str);
 int postany(http_request_t* request, const char* str, int len);
+// poststr for constant strings that stay valid, long ones are sent
+// straight from their address instead of being copied to reply buffer
+int postconst(http_request_t* request, const char* str);
+// postconst for data that is not a string, like memory mapped flash
+int postconstany(http_request_t* request, const char* str, int len);
+// sends rest of chunked reply and the last, empty chunk
+void http_endChunked(http_request_t* request);
+// Big bodies (OTA, LFS uploads) don't fit in receive buffer, handler
+// takes them in parts of at most HTTP_BODY_CHUNK_SIZE. First part is what
+// came with headers, next ones are read into request->received, overwriting
+// url and headers. Returns length of part, 0 when whole body was read,
+// or -1 when client went away before Content-Length was reached.
+int http_readBody(http_request_t* request, char** out);
 void misc_formatUpTimeString(int totalSeconds, char* o);
 // void HTTP_AddBuildFooter(http_request_t *request);
 // void HTTP_AddHeader(http_request_t *request);
@@ -81,6 +124,29 @@ int http_getArgInteger(const char* base, const char* name);
 // poststr with format - for results LESS THAN 128
 int hprintf255(http_request_t* request, const char* fmt, ...);
 
+// JSON written straight into reply, only nesting is remembered,
+// so document can be of any size. key is NULL for array items
+// and for the top level value. Up to 32 levels of nesting
+typedef struct jsonWriter_s {
+	http_request_t* request;
+	int depth;
+	// bit per level, set after first item, so next ones get comma
+	unsigned int hasItems;
+} jsonWriter_t;
+
+void JSONW_Init(jsonWriter_t* w, http_request_t* request);
+void JSONW_StartObject(jsonWriter_t* w, const char* key);
+void JSONW_EndObject(jsonWriter_t* w);
+void JSONW_StartArray(jsonWriter_t* w, const char* key);
+void JSONW_EndArray(jsonWriter_t* w);
+void JSONW_String(jsonWriter_t* w, const char* key, const char* value);
+void JSONW_Int(jsonWriter_t* w, const char* key, int value);
+void JSONW_Bool(jsonWriter_t* w, const char* key, int value);
+// NaN and infinity are null, as cJSON does
+void JSONW_Float(jsonWriter_t* w, const char* key, float value, int decimals);
+// whole numbers without fraction, others with 5 decimals, as our cJSON prints them
+void JSONW_Number(jsonWriter_t* w, const char* key, double value);
+
 typedef enum {
 	HTTP_ANY = -1,
 	HTTP_GET = 0,
@@ -91,12 +157,77 @@ typedef enum {
 
 // callback function for http
 typedef int (*http_callback_fn)(http_request_t* request);
-// url MUST start with '/'
-// urls must be unique (i.e. you can't have /about and /aboutme or /about/me)
+
+// route runs basic auth first
+#define HTTP_ROUTE_AUTH			1
+// builtin page, found like others but run after global auth and LFS override
+#define HTTP_ROUTE_PAGE			2
+
+#if ENABLE_HTTP_ROUTE_STATS
+// per-route statistics, see /api/routestats
+typedef struct httpRouteStats_s {
+	unsigned int hits;
+	// resolution is the RTOS tick
+	unsigned int totalUs;
+	unsigned int maxUs;
+} httpRouteStats_t;
+#endif
+
+typedef struct httpRoute_s {
+	// without leading '/', trailing '/' makes it a prefix
+	const char* url;
+	http_callback_fn callback;
+	int method;
+	int flags;
+	struct httpRoute_s* next;
+#if ENABLE_HTTP_ROUTE_STATS
+	httpRouteStats_t stats;
+#endif
+} httpRoute_t;
+
+// route must stay valid, usually it's static
+int HTTP_RegisterRoute(httpRoute_t* route);
+// url MUST start with '/', it is matched whole (query aside),
+// unless it ends with '/', then it matches everything under it
 int HTTP_RegisterCallback(const char* url, int method, http_callback_fn callback, int auth_required);
+#if ENABLE_HTTP_ROUTE_STATS
+void HTTP_ForEachRouteStats(void* userData, void (*callback)(const httpRoute_t* r, void* userData));
+#endif
+
+#if ENABLE_HTTP_REQUEST_STATS
+#define HTTP_REQUEST_STATS_COUNT	8
+// last requests, see /api/httpstats
+typedef struct httpRequestStats_s {
+	char url[24];
+	int method;
+	// resolution is the RTOS tick
+	unsigned int us;
+	// reply bytes and send() calls, what is left in buffer for server
+	// to send counts as one call
+	int bytes;
+	int sends;
+	// free heap is sampled at start, on each send and at end
+	int heapMin;
+	int heapUsed;
+} httpRequestStats_t;
+// copies newest first, returns count
+int HTTP_GetRequestStats(httpRequestStats_t* out, int maxCount);
+void HTTP_LogRequestStats();
+#endif
 
 int my_strnicmp(const char* a, const char* b, int len);
 
+// kept-alive connection waits this long for the next request
+#define HTTP_KEEPALIVE_TIMEOUT_MS	5000
+// for servers that receive request in parts
+int HTTP_GetContentLength(const char* data, const char* headersEnd);
+int HTTP_IsRequestComplete(const char* data, int len);
+int HTTP_IsVersion11(const char* req);
+// GET that client wants to keep connection open after
+int HTTP_WantsKeepAlive(const char* req);
+// returns new reply length, or -1 if connection must be closed
+int HTTP_SetKeepAliveHeaders(char* reply, int len, int maxLen);
+
 int http_rest_error(http_request_t* request, int code, char* msg);
 
 #endif
@@ -0,0 +1,131 @@
+/*
+NOTE:
+
+This file is generated by gulp from style.css and script.js (see gulpfile.js),
+it should not be manually edited. It is included only by new_http.c.
+Hash changes with content, so browsers can cache files forever under URL with hash.
+*/
+#pragma once
+
+//region_start htmlHeadStyleGz
+#define HTMLHEADSTYLE_HASH "21a9d195"
+static const unsigned char htmlHeadStyleGz[] = {
+	0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0x75,0x55,0x61,0x8f,0xa3,0x2c,
+	0x10,0xfe,0x2b,0xbd,0x34,0x9b,0xdc,0x25,0x4a,0xb0,0xd6,0xee,0x2e,0xe6,0xfd,0x25,
+	0x97,0xfd,0x30,0xca,0xa0,0x64,0x15,0x78,0x11,0x5b,0x7a,0x86,0xff,0x7e,0xc1,0xea,
+	0x9e,0x6d,0xba,0x21,0x69,0xca,0xc0,0xcc,0xf3,0xcc,0x33,0x33,0xc8,0xe5,0x39,0x11,
+	0x12,0x3b,0x3e,0xa0,0x4b,0xa4,0x32,0xa3,0x4b,0x06,0xec,0xb0,0x76,0x93,0x01,0xce,
+	0xa5,0x6a,0x58,0x61,0x7c,0x29,0xb4,0x72,0xe9,0x20,0xff,0x20,0xcb,0xb0,0x2f,0x7b,
+	0xb0,0x8d,0x54,0x8c,0xee,0xe8,0x8e,0x1c,0xb0,0x0f,0xab,0xff,0x54,0x41,0xfd,0xd9,
+	0x58,0x3d,0x2a,0xce,0xf6,0x47,0x11,0x57,0x30,0xd3,0x72,0x9b,0x14,0xd8,0xef,0x68,
+	0x98,0x21,0xa6,0x8b,0xe4,0xae,0x65,0x19,0xa5,0x2f,0x65,0xa5,0x7d,0x8c,0x1c,0x91,
+	0x2a,0x6d,0x39,0xda,0xb4,0xd2,0xbe,0x4c,0x2f,0x58,0x7d,0x4a,0x97,0x7e,0x73,0xda,
+	0xeb,0x3f,0xdf,0x1c,0x6d,0x29,0x70,0xce,0xcb,0x5a,0x77,0xda,0xb2,0x3d,0xa5,0x34,
+	0x08,0x6d,0xfb,0x85,0x4d,0x5a,0x69,0xe7,0x74,0x3f,0x93,0xba,0x51,0xfa,0xed,0xae,
+	0x06,0xff,0xab,0x5b,0xac,0x3f,0x2b,0xed,0x3f,0x92,0x8d,0xd1,0x02,0x97,0xfa,0x63,
+	0xe5,0xfc,0x95,0x7f,0x6a,0x65,0xd3,0x3a,0x76,0x32,0xbe,0x3c,0xa3,0x75,0xb2,0x86,
+	0x2e,0x85,0x4e,0x36,0x8a,0xa5,0x99,0xf1,0xe1,0x2e,0x80,0x6a,0x70,0x0d,0xf0,0xfe,
+	0xfe,0x12,0x16,0x85,0xb7,0x2a,0x7c,0x4f,0xdb,0xa1,0x77,0x60,0x11,0x26,0x8b,0x73,
+	0x05,0x56,0xb0,0x72,0x89,0xf7,0xf6,0x52,0xb6,0x38,0x53,0xc9,0xb3,0x37,0xe3,0xcb,
+	0x6d,0xdd,0xf4,0x19,0xad,0xe8,0xf4,0x85,0xc1,0xe8,0xf4,0x1d,0x48,0x26,0xe2,0x5a,
+	0x71,0x4e,0x45,0x9d,0x65,0x45,0xa8,0x34,0xbf,0x4e,0x11,0x6f,0x49,0xa4,0x46,0xe5,
+	0xd0,0xde,0xaa,0x2f,0xa0,0x97,0xdd,0x35,0xa2,0x73,0x50,0x90,0x0c,0xa0,0x86,0x74,
+	0x40,0x2b,0xc5,0xec,0x95,0xb4,0xd9,0x0e,0xee,0xea,0x7f,0xc8,0xf2,0x3c,0xc7,0x15,
+	0x00,0x21,0xae,0xe0,0xf8,0x57,0x5b,0xd1,0x50,0x8d,0xce,0x69,0xb5,0x55,0x7a,0x18,
+	0xab,0x5e,0xba,0x8f,0xe9,0x56,0x4f,0x46,0xcb,0xa5,0xb0,0xb1,0x02,0xe3,0xc0,0x48,
+	0x6e,0xb1,0x7f,0xc8,0x02,0x72,0xac,0x57,0x10,0x01,0x42,0x08,0x51,0x76,0x52,0x61,
+	0xba,0x48,0x72,0x20,0xc7,0xe8,0xb3,0xe9,0x5f,0x72,0x88,0x86,0x7a,0xb4,0x83,0xb6,
+	0xcc,0x68,0x19,0x33,0x0c,0x4f,0x38,0x6c,0x8a,0xe3,0x2c,0xa8,0x41,0x3a,0xa9,0x55,
+	0xca,0x47,0x0b,0xf1,0x0f,0x23,0xc7,0xe1,0x89,0x17,0x6b,0xa3,0xe2,0x77,0x3a,0x50,
+	0x7c,0xa5,0x70,0x0c,0xa4,0xb2,0xc8,0xef,0x0e,0xf8,0x31,0x2f,0xf2,0xe2,0x87,0xec,
+	0x8d,0xb6,0x0e,0x94,0xbb,0x5d,0x79,0x12,0xe1,0x3d,0x8f,0xa5,0xba,0xbb,0xd8,0x58,
+	0x75,0x3f,0x6c,0xaf,0xf5,0xe1,0x74,0x7a,0xbc,0xf2,0x24,0x56,0x01,0x20,0x4e,0xdb,
+	0x58,0x30,0x2d,0xe2,0x2d,0x52,0xce,0xd5,0xe7,0x58,0xeb,0x25,0x4f,0xa5,0x15,0x06,
+	0x62,0x26,0xd1,0x69,0x70,0xac,0x43,0xe1,0xca,0x4d,0x83,0xc4,0x7d,0x20,0xff,0x2f,
+	0xa7,0xf3,0x40,0x6c,0x8f,0x67,0x43,0x20,0x76,0x7a,0xac,0x23,0xf6,0x5f,0x6d,0x7a,
+	0x30,0x7e,0x7d,0x50,0x4e,0xc6,0xef,0xe2,0x76,0x43,0x38,0xd6,0x12,0x6c,0xda,0x44,
+	0x4f,0x54,0xee,0xe7,0x3b,0xe5,0xd8,0x24,0x7b,0x21,0x80,0x52,0x9a,0xec,0xe1,0xc4,
+	0x33,0x21,0x7e,0x05,0xd2,0x8a,0x89,0xcb,0xc1,0x74,0x70,0x5d,0x18,0xb7,0x5c,0x9e,
+	0xd7,0x89,0x2b,0x5e,0xca,0x4b,0x2b,0x1d,0xa6,0x83,0x81,0x1a,0x99,0xd2,0x17,0x0b,
+	0x26,0x90,0x16,0x3b,0x5c,0xae,0x1c,0x32,0x6a,0x7c,0xb9,0x46,0x90,0x6a,0x6e,0xa1,
+	0xaa,0xd3,0xf5,0xe7,0x3a,0xec,0x31,0xd3,0xc8,0x35,0x70,0x79,0xde,0x0f,0x0e,0x1c,
+	0x6e,0x3a,0x39,0xda,0xea,0x36,0x4e,0xf9,0xa6,0xbf,0xd7,0xa9,0x3c,0xe4,0x8b,0x57,
+	0x0f,0x52,0x4d,0x0f,0xe2,0x3d,0xc7,0xbc,0x1b,0x9a,0xb2,0x97,0x2a,0xbd,0xd1,0xcc,
+	0x8f,0x74,0x56,0xcb,0x2f,0xfb,0x37,0x4a,0x8d,0x0f,0x0e,0xaa,0x0e,0xa7,0xf9,0x37,
+	0xed,0xe0,0xaa,0x47,0xc7,0x84,0xf4,0xc8,0xcb,0x7f,0x2d,0x1c,0x48,0xc4,0x49,0xa3,
+	0x34,0x0f,0x3a,0xcd,0xf6,0x1b,0xf8,0xf4,0x8c,0x4b,0x20,0x03,0x08,0x5c,0x9a,0xc4,
+	0x22,0x9f,0x5f,0x51,0x22,0x15,0x47,0xf5,0xf5,0x89,0xb8,0x89,0x93,0x9d,0x8c,0x0f,
+	0x9d,0x5c,0xdf,0xfb,0xc2,0xf8,0x1d,0x0d,0x44,0x0b,0x91,0x10,0xad,0xbe,0x7b,0x55,
+	0xe6,0x99,0x2c,0x8e,0xc6,0x87,0x78,0x69,0x36,0x5d,0x6e,0xb2,0xbd,0x52,0x1a,0xfe,
+	0x02,0xb0,0xd4,0x79,0x7e,0x9d,0x06,0x00,0x00,
+};
+//region_end htmlHeadStyleGz
+
+//region_start pageScriptGz
+#define PAGESCRIPT_HASH "fc79d093"
+static const unsigned char pageScriptGz[] = {
+	0x1f,0x8b,0x08,0x00,0x00,0x00,0x00,0x00,0x02,0x03,0xad,0x56,0xef,0x6f,0xdb,0x36,
+	0x10,0xfd,0x57,0x14,0xa2,0x35,0xc8,0x99,0x60,0xe5,0xa6,0x0b,0x86,0x38,0xac,0x81,
+	0x15,0x5e,0x9b,0x2d,0x3f,0x8a,0xc5,0x1d,0xf6,0x31,0x8c,0x74,0x8e,0xd5,0xd2,0xa4,
+	0x42,0x9e,0x94,0x18,0xb6,0xff,0xf7,0x81,0x92,0x2d,0xc9,0x89,0xdb,0x64,0xc3,0xbe,
+	0xd1,0xc7,0x27,0xf2,0xdd,0xdd,0x7b,0x3c,0x97,0xca,0x45,0xd3,0xcc,0x79,0x9c,0x64,
+	0x73,0xe0,0x5a,0x6d,0x16,0xd6,0xe8,0xcc,0xc0,0x6f,0xd6,0x71,0x07,0x77,0xd2,0x14,
+	0x5a,0xb7,0xa1,0xb1,0xae,0x03,0x1e,0x15,0xc2,0x5f,0xe0,0x64,0x5c,0x2f,0x3f,0x5b,
+	0xad,0xbd,0x8c,0x79,0x5e,0xf8,0x19,0xa4,0xf2,0x60,0xc0,0x6f,0x01,0xc7,0x1a,0xe6,
+	0x60,0x50,0x82,0x7c,0x9f,0xda,0xa4,0x08,0x6b,0xd1,0x86,0x7f,0x5d,0x9c,0xa6,0x14,
+	0xd8,0x70,0x5a,0x98,0x04,0x33,0x6b,0x22,0x3f,0xb3,0xf7,0x57,0xe1,0x30,0xca,0x96,
+	0x89,0x06,0xe5,0x02,0x1b,0x5b,0x20,0x6d,0x38,0x32,0xbe,0x13,0xdf,0x32,0x66,0x3c,
+	0x70,0x3a,0x90,0x0e,0xee,0x7a,0x3d,0x07,0x77,0x42,0xdd,0x58,0x87,0x94,0x71,0x0a,
+	0xb2,0xbd,0x8f,0x92,0x8a,0x29,0x61,0xac,0xd7,0xa3,0xb4,0x4a,0x0d,0xee,0xa3,0xbf,
+	0xcf,0xcf,0x3e,0x21,0xe6,0x7f,0xc2,0x5d,0x01,0x1e,0x99,0xb0,0xc6,0x81,0x4a,0x17,
+	0x15,0x34,0x99,0x29,0x73,0x0b,0x92,0x32,0xf9,0x7e,0xf9,0x4e,0x86,0xe3,0x45,0xb5,
+	0x59,0x91,0xec,0xf5,0xc8,0xe5,0x1f,0xa4,0x8e,0x06,0x74,0xe1,0x27,0xf0,0x80,0xbd,
+	0x1e,0x25,0x57,0xe3,0xb3,0xf1,0x87,0x09,0x39,0x90,0x4d,0xd2,0x2a,0xc1,0xac,0x84,
+	0x0d,0x0f,0x81,0xea,0xf6,0x42,0xcd,0x21,0x40,0x4f,0x2f,0x3e,0x7f,0x79,0x1e,0xb9,
+	0x5a,0x11,0x53,0xcc,0x6f,0xc0,0xfd,0x00,0xb9,0xc8,0x03,0xa3,0xc4,0x6a,0xfb,0x0c,
+	0x2a,0x64,0x0f,0x22,0x33,0x06,0xdc,0xa7,0xc9,0xf9,0xd9,0x26,0x2b,0x9f,0x5b,0xe3,
+	0x21,0x64,0xf0,0xa8,0xc6,0xcf,0xd7,0x7e,0xbb,0x92,0x75,0xef,0x47,0x1e,0x70,0x0b,
+	0x6a,0x3a,0xca,0x0f,0xe3,0x9f,0x1c,0x4c,0x1d,0xf8,0xd9,0xa9,0x41,0x70,0xa5,0xd2,
+	0xec,0xb8,0x03,0xcc,0xad,0xd6,0x35,0xf0,0x31,0x8a,0xad,0x83,0x0a,0x85,0xcd,0xc1,
+	0x50,0xf2,0x71,0x3c,0x21,0x9c,0x64,0x26,0x85,0x87,0x51,0xd5,0x21,0x39,0x20,0xfc,
+	0x20,0x66,0x15,0xc4,0x83,0x49,0x29,0x63,0xbc,0x61,0x2c,0xf7,0x32,0x79,0x7c,0xc1,
+	0xba,0xd1,0x5f,0x43,0xe2,0xff,0xd3,0xdf,0xbf,0x55,0x59,0xa9,0x5c,0x04,0x1c,0x87,
+	0x2f,0x57,0x1b,0xc8,0xdf,0xaf,0x2e,0x2f,0x44,0xae,0x9c,0x07,0xfa,0xb4,0x97,0x8d,
+	0x4f,0x41,0x94,0xe0,0x38,0x88,0x69,0xa1,0xf5,0x6a,0x15,0x9f,0x5c,0xde,0x7c,0x85,
+	0x04,0xc5,0x37,0x58,0x78,0x0a,0x22,0x99,0x31,0xa1,0xc1,0xdc,0xe2,0x6c,0xb5,0x3a,
+	0x8c,0x4f,0x64,0xbf,0xdf,0xba,0x7a,0x44,0x77,0x1c,0xde,0x71,0x29,0x3b,0xa6,0x14,
+	0x77,0x1c,0x96,0xba,0xb2,0xf2,0x57,0x69,0xb3,0x34,0x8a,0x0f,0xa4,0x04,0x91,0xba,
+	0xb2,0xd7,0xa3,0xd8,0x51,0x5c,0x15,0xfb,0xbe,0xcc,0x1a,0x3d,0xbd,0x4c,0x1f,0x7b,
+	0x04,0x52,0xf1,0x1d,0xf9,0xcc,0x24,0x20,0x49,0x7f,0x5b,0x82,0x47,0x42,0xf9,0xef,
+	0x3a,0xf1,0xa8,0x1c,0x8e,0x4b,0x30,0xe8,0x29,0xab,0x5b,0x56,0x35,0xb9,0x0a,0x5d,
+	0xd9,0xc2,0x25,0x40,0x09,0x54,0xfb,0x84,0x71,0x94,0x74,0xfb,0x28,0xc6,0xbc,0x6a,
+	0xf2,0x73,0x3e,0xda,0x4b,0x67,0x10,0xc7,0x6c,0xcd,0x86,0x20,0x54,0x9a,0x56,0x17,
+	0x9d,0x65,0x1e,0xc1,0x80,0xa3,0x24,0x99,0x11,0x8e,0x8c,0xef,0xdb,0x72,0xe0,0x01,
+	0xbf,0xbb,0x1b,0xba,0xc5,0x61,0x23,0xbb,0x3d,0x8d,0x1c,0xe2,0xd3,0xce,0x29,0x54,
+	0x6c,0x1d,0x8e,0xb3,0x06,0x9c,0xb3,0xae,0xd6,0xed,0xdb,0xd0,0xe9,0xae,0x5a,0x69,
+	0x3b,0x08,0x3a,0xb6,0x62,0xeb,0xb6,0x8a,0xd3,0x39,0x7e,0xc9,0x43,0x9e,0x14,0xea,
+	0x22,0x22,0x37,0xdc,0xca,0x73,0x85,0x33,0x31,0xd5,0xd6,0x3a,0x0a,0x6f,0x7e,0x39,
+	0x7a,0x17,0xc7,0x6c,0xe8,0x00,0x0b,0x67,0x22,0x78,0x2d,0xab,0x00,0xc7,0x5d,0xd4,
+	0xe1,0x51,0x1c,0x33,0x0e,0xaf,0x65,0x58,0x70,0xb3,0xbb,0x79,0x14,0xb6,0x24,0xbc,
+	0x3e,0x8a,0x79,0x7c,0x62,0x47,0xb6,0x7f,0x1d,0xa5,0x6a,0xe1,0x79,0xf4,0x6a,0x89,
+	0xeb,0x68,0x66,0x0b,0x57,0xad,0xcd,0x3a,0x9a,0x67,0xa6,0x40,0xf0,0x91,0x32,0x69,
+	0xf4,0x6a,0x09,0xeb,0xc8,0x43,0x62,0x4d,0xea,0xaf,0x8f,0xe3,0x13,0x1c,0x61,0xff,
+	0xfa,0xc5,0x68,0x33,0x32,0xfd,0xeb,0x1f,0x20,0xae,0xbf,0x16,0x1e,0x77,0x63,0x6d,
+	0x5d,0x8a,0x3c,0x55,0x08,0x97,0xdb,0x81,0x4b,0xd9,0xb2,0x33,0x7c,0x05,0xc2,0x03,
+	0x7e,0xb0,0x06,0xc3,0x58,0x6d,0x2b,0xd8,0xef,0x37,0x98,0x8e,0x4e,0xad,0x39,0xb3,
+	0x2a,0xa5,0x6c,0x49,0xbb,0xe3,0xbb,0xdb,0xe5,0x26,0x5e,0x0f,0xc5,0xe6,0xa7,0xac,
+	0x9e,0x93,0x53,0x83,0xdd,0x2f,0xab,0xde,0x7b,0x08,0x7a,0xc8,0x30,0x53,0x9a,0x0f,
+	0xe2,0xf0,0x95,0x07,0xdc,0x7a,0x84,0x3e,0xe2,0xce,0x07,0x70,0xc8,0x86,0xb5,0x41,
+	0xf6,0xcc,0xe1,0x61,0xd0,0x49,0xf3,0x40,0x35,0x57,0x42,0x73,0x51,0x78,0xb1,0x06,
+	0x31,0x5b,0xad,0x62,0x7e,0x9f,0x99,0xd4,0xde,0x8b,0x8e,0xc5,0x46,0x3b,0x36,0x3c,
+	0xde,0x51,0x59,0x6b,0xd5,0xe2,0x66,0x9e,0xe1,0x04,0xe6,0x39,0x38,0x85,0x85,0x6b,
+	0xc5,0xb6,0x43,0x68,0x6a,0xdd,0x7c,0x70,0xf8,0x96,0xb0,0x61,0x37,0xfa,0x0d,0x74,
+	0x99,0x99,0x2a,0x2e,0x4a,0xa5,0x0b,0xa8,0x95,0xe5,0x6c,0x61,0x52,0x3a,0x80,0xa3,
+	0x37,0x1d,0xca,0xd5,0x3e,0x63,0x1c,0x45,0x7d,0x25,0x65,0xeb,0x0d,0xe5,0xa7,0xb6,
+	0xd3,0x56,0xa5,0x84,0xd7,0xdd,0x61,0x7c,0x96,0x79,0xb4,0x6e,0x21,0x82,0x61,0xea,
+	0x04,0xaa,0x3f,0x58,0x84,0x6c,0x73,0xd6,0x36,0x51,0x21,0x19,0x91,0x2b,0x9c,0x19,
+	0x35,0x07,0xe1,0x75,0x96,0x00,0x1d,0x30,0xc6,0x3b,0x4f,0x45,0x3b,0x3f,0x76,0x52,
+	0xab,0xa7,0x4b,0xba,0xa9,0x76,0x77,0xf0,0x13,0xc2,0xd6,0xfc,0xe7,0xd0,0xa1,0x7f,
+	0x00,0x29,0x47,0x98,0xfa,0x08,0x0a,0x00,0x00,
+};
+//region_end pageScriptGz
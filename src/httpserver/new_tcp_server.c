@@ -32,6 +32,8 @@ void HTTPServer_Start();
 #ifndef HTTP_CLIENT_STACK_SIZE
 #define HTTP_CLIENT_STACK_SIZE		8192
 #endif
+// bigger requests are not grown in RAM, only first part is received
+#define HTTP_MAX_BUFFERED_REQUEST	4096
 typedef struct
 {
 	int fd;
@@ -69,6 +71,8 @@ static void tcp_client_thread(tcp_thread_t* arg)
 	request.received = buf;
 	request.receivedLenmax = INCOMING_BUFFER_SIZE - 2;
 	request.responseCode = HTTP_RESPONSE_OK;
+	// this thread serves only this client
+	request.allowStream = 1;
 	request.receivedLen = 0;
 	while(1)
 	{
@@ -83,6 +87,12 @@ static void tcp_client_thread(tcp_thread_t* arg)
 		{
 			break;
 		}
+		request.received[request.receivedLen] = 0;
+		// rest of big body (upload) is read by handler in parts
+		if(request.receivedLenmax >= HTTP_MAX_BUFFERED_REQUEST && strstr(request.received, "\r\n\r\n"))
+		{
+			break;
+		}
 		// grow by INCOMING_BUFFER_SIZE
 		request.receivedLenmax += INCOMING_BUFFER_SIZE;
 		request.received = (char*)realloc(request.received, request.receivedLenmax + 2);
@@ -9,6 +9,7 @@
 #include "../hal/hal_wifi.h"
 #include "../hal/hal_flashVars.h"
 #include "../littlefs/our_lfs.h"
+#include "../assets/obk_assets.h"
 #include "lwip/sockets.h"
 
 #define DEFAULT_FLASH_LEN 0x200000
@@ -29,6 +30,13 @@ extern uint8_t flash_size_8720;
 #ifndef OBK_DISABLE_ALL_DRIVERS
 #include "../driver/drv_local.h"
 #endif
+#include "../driver/drv_public.h"
+#include "../driver/drv_bl_shared.h"
+#include "../driver/drv_kws303wf.h"
+#include "../driver/drv_wifiRoam.h"
+#include "../quicktick.h"
+#include "../logging/cpuProfiler.h"
+#include "../base64/base64.h"
 
 #define MAX_JSON_VALUE_LENGTH   128
 
@@ -61,17 +69,134 @@ static int http_rest_post_reboot(http_request_t* request);
 int http_rest_post_flash(http_request_t* request, int startaddr, int maxaddr);
 static int http_rest_get_flash(http_request_t* request, int startaddr, int len);
 static int http_rest_get_flash_advanced(http_request_t* request);
+static int http_rest_get_flash_crc(http_request_t* request);
 static int http_rest_post_flash_advanced(http_request_t* request);
 
 static int http_rest_get_info(http_request_t* request);
+#if ENABLE_CMD_STATS
+static int http_rest_get_cmdstats(http_request_t* request);
+#endif
 
 static int http_rest_post_channels(http_request_t* request);
 static int http_rest_get_channels(http_request_t* request);
+#if ENABLE_CHANNEL_STATS
+static int http_rest_get_channelstats(http_request_t* request);
+#endif
+#if ENABLE_DRIVER_WIFIROAM
+static int http_rest_get_wifiscan(http_request_t* request);
+#endif
+static int http_rest_get_channelValues(http_request_t* request);
+static int http_rest_post_channelValues(http_request_t* request);
 
 static int http_rest_post_cmd(http_request_t* request);
 
 
+#if ENABLE_HTTP_ROUTE_STATS
+static int http_rest_get_routestats(http_request_t* request);
+#endif
+#if ENABLE_HTTP_REQUEST_STATS
+static int http_rest_get_httpstats(http_request_t* request);
+#endif
+#if ENABLE_CRASH_LOG
+static int http_rest_get_crashlog(http_request_t* request);
+#endif
+#if ENABLE_SYSPERF
+static int http_rest_get_sysperf(http_request_t* request);
+static int http_rest_get_top(http_request_t* request);
+#endif
+#if ENABLE_PING_WATCHDOG
+static int http_rest_get_ping(http_request_t* request);
+#endif
+#if ENABLE_HEAP_TRACKER
+static int http_rest_get_heapstats(http_request_t* request);
+#endif
+#if ENABLE_CPU_PROFILER
+static int http_rest_get_profile(http_request_t* request);
+#endif
+#if ENABLE_OTA_RELAY
+static int http_rest_get_otarelay(http_request_t* request);
+static int http_rest_get_otarelay_image(http_request_t* request);
+#endif
+#if ENABLE_ASSETS
+static int http_rest_get_assets(http_request_t* request);
+static int http_rest_get_asset_file(http_request_t* request);
+static int http_rest_post_assets(http_request_t* request);
+#endif
+
+#define REST_ROUTE(u, m, fn)		{ .url = u, .callback = fn, .method = m, .flags = HTTP_ROUTE_AUTH }
+
+// endpoints with fixed url, others are found by http_rest_get and http_rest_post
+static httpRoute_t g_restRoutes[] = {
+	REST_ROUTE("api/channels", HTTP_GET, http_rest_get_channels),
+	REST_ROUTE("api/channelValues", HTTP_GET, http_rest_get_channelValues),
+#if ENABLE_CHANNEL_STATS
+	REST_ROUTE("api/channelstats", HTTP_GET, http_rest_get_channelstats),
+#endif
+#if ENABLE_DRIVER_WIFIROAM
+	REST_ROUTE("api/wifiscan", HTTP_GET, http_rest_get_wifiscan),
+#endif
+	REST_ROUTE("api/pins", HTTP_GET, http_rest_get_pins),
+	REST_ROUTE("api/channelTypes", HTTP_GET, http_rest_get_channelTypes),
+	REST_ROUTE("api/logconfig", HTTP_GET, http_rest_get_logconfig),
+	REST_ROUTE("api/info", HTTP_GET, http_rest_get_info),
+#if ENABLE_CMD_STATS
+	REST_ROUTE("api/cmdstats", HTTP_GET, http_rest_get_cmdstats),
+#endif
+#if ENABLE_HTTP_ROUTE_STATS
+	REST_ROUTE("api/routestats", HTTP_GET, http_rest_get_routestats),
+#endif
+#if ENABLE_HTTP_REQUEST_STATS
+	REST_ROUTE("api/httpstats", HTTP_GET, http_rest_get_httpstats),
+#endif
+#if ENABLE_CRASH_LOG
+	REST_ROUTE("api/crashlog", HTTP_GET, http_rest_get_crashlog),
+#endif
+#if ENABLE_SYSPERF
+	REST_ROUTE("api/sysperf", HTTP_GET, http_rest_get_sysperf),
+	REST_ROUTE("api/top", HTTP_GET, http_rest_get_top),
+#endif
+#if ENABLE_PING_WATCHDOG
+	REST_ROUTE("api/ping", HTTP_GET, http_rest_get_ping),
+#endif
+#if ENABLE_HEAP_TRACKER
+	REST_ROUTE("api/heapstats", HTTP_GET, http_rest_get_heapstats),
+#endif
+#if ENABLE_CPU_PROFILER
+	REST_ROUTE("api/profile", HTTP_GET, http_rest_get_profile),
+#endif
+#if ENABLE_OTA_RELAY
+	REST_ROUTE("api/otarelay", HTTP_GET, http_rest_get_otarelay),
+	REST_ROUTE("api/otarelay/image", HTTP_GET, http_rest_get_otarelay_image),
+#endif
+#if ENABLE_BL_HISTORY
+	REST_ROUTE("api/energyhistory", HTTP_GET, EnergyHistory_HTTPQuery),
+#endif
+#if ENABLE_DRIVER_KWS303WF
+	REST_ROUTE("api/kws/history", HTTP_GET, KWS303WF_HistoryHTTPQuery),
+	REST_ROUTE("api/kws/faults", HTTP_GET, KWS303WF_FaultsHTTPQuery),
+#endif
+#if ENABLE_DRIVER_BKPARTITIONS
+	REST_ROUTE("api/partitions", HTTP_GET, BKPartitions_HTTPQuery),
+#endif
+#if ENABLE_ASSETS
+	REST_ROUTE("api/assets", HTTP_GET, http_rest_get_assets),
+	REST_ROUTE("api/assets", HTTP_POST, http_rest_post_assets),
+#endif
+	REST_ROUTE("api/channels", HTTP_POST, http_rest_post_channels),
+	REST_ROUTE("api/channelValues", HTTP_POST, http_rest_post_channelValues),
+	REST_ROUTE("api/pins", HTTP_POST, http_rest_post_pins),
+	REST_ROUTE("api/channelTypes", HTTP_POST, http_rest_post_channelTypes),
+	REST_ROUTE("api/logconfig", HTTP_POST, http_rest_post_logconfig),
+	REST_ROUTE("api/reboot", HTTP_POST, http_rest_post_reboot),
+	REST_ROUTE("api/cmnd", HTTP_POST, http_rest_post_cmd),
+};
+
 void init_rest() {
+	int i;
+
+	for (i = 0; i < sizeof(g_restRoutes) / sizeof(g_restRoutes[0]); i++) {
+		HTTP_RegisterRoute(&g_restRoutes[i]);
+	}
 	HTTP_RegisterCallback("/api/", HTTP_GET, http_rest_get, 1);
 	HTTP_RegisterCallback("/api/", HTTP_POST, http_rest_post, 1);
 	HTTP_RegisterCallback("/app", HTTP_GET, http_rest_app, 1);
@@ -99,20 +224,6 @@ bool tryGetTokenString(const char* json, jsmntok_t* tok, char* outBuffer) {
 static int http_rest_get(http_request_t* request) {
 	ADDLOG_DEBUG(LOG_FEATURE_API, "GET of %s", request->url);
 
-	if (!strcmp(request->url, "api/channels")) {
-		return http_rest_get_channels(request);
-	}
-
-	if (!strcmp(request->url, "api/pins")) {
-		return http_rest_get_pins(request);
-	}
-	if (!strcmp(request->url, "api/channelTypes")) {
-		return http_rest_get_channelTypes(request);
-	}
-	if (!strcmp(request->url, "api/logconfig")) {
-		return http_rest_get_logconfig(request);
-	}
-
 	if (!strncmp(request->url, "api/seriallog", 13)) {
 		return http_rest_get_seriallog(request);
 	}
@@ -150,13 +261,24 @@ static int http_rest_get(http_request_t* request) {
 	}
 #endif
 
-	if (!strcmp(request->url, "api/info")) {
-		return http_rest_get_info(request);
+#if ENABLE_ASSETS
+	if (!strncmp(request->url, "api/assets/", 11)) {
+		return http_rest_get_asset_file(request);
 	}
+#endif
+
+#if ENABLE_DRIVER_CHARTS
+	if (!strncmp(request->url, "api/chart/", 10)) {
+		return Chart_HTTPQuery(request);
+	}
+#endif
 
 	if (!strncmp(request->url, "api/flash/", 10)) {
 		return http_rest_get_flash_advanced(request);
 	}
+	if (!strncmp(request->url, "api/flashcrc/", 13)) {
+		return http_rest_get_flash_crc(request);
+	}
 
 	http_setup(request, httpMimeTypeHTML);
 	http_html_start(request, "GET REST API");
@@ -171,26 +293,11 @@ static int http_rest_post(http_request_t* request) {
 	char tmp[20];
 	ADDLOG_DEBUG(LOG_FEATURE_API, "POST to %s", request->url);
 
-	if (!strcmp(request->url, "api/channels")) {
-		return http_rest_post_channels(request);
-	}
-	
-	if (!strcmp(request->url, "api/pins")) {
-		return http_rest_post_pins(request);
-	}
-	if (!strcmp(request->url, "api/channelTypes")) {
-		return http_rest_post_channelTypes(request);
-	}
-	if (!strcmp(request->url, "api/logconfig")) {
-		return http_rest_post_logconfig(request);
-	}
-
-	if (!strcmp(request->url, "api/reboot")) {
-		return http_rest_post_reboot(request);
-	}
 	if (!strcmp(request->url, "api/ota")) {
 		OTA_IncrementProgress(1);
 		int r = 0;
+		// new firmware may not read config journal
+		CFG_Save_Compact();
 #if PLATFORM_BEKEN
 		r = http_rest_post_flash(request, START_ADR_OF_BK_PARTITION_OTA, LFS_BLOCKS_END);
 #elif PLATFORM_W600
@@ -224,10 +331,6 @@ static int http_rest_post(http_request_t* request) {
 		return http_rest_post_flash_advanced(request);
 	}
 
-	if (!strcmp(request->url, "api/cmnd")) {
-		return http_rest_post_cmd(request);
-	}
-
 
 #if ENABLE_LITTLEFS
 	if (!strcmp(request->url, "api/fsblock")) {
@@ -303,6 +406,44 @@ static int http_rest_app(http_request_t* request) {
 	return 0;
 }
 
+#if ENABLE_LITTLEFS || ENABLE_ASSETS
+static const struct {
+	const char* ext;
+	const char* type;
+} g_fileMimeTypes[] = {
+	{ "js", httpMimeTypeJavascript },
+	{ "vue", httpMimeTypeJavascript },
+	{ "html", httpMimeTypeHTML },
+	{ "css", httpMimeTypeCSS },
+	{ "json", httpMimeTypeJson },
+	{ "ico", "image/x-icon" },
+};
+// content type by extension, for name.js.gz it is the one of .js
+static const char* http_getFileMimeType(const char* fpath) {
+	const char* ext;
+	int len, i;
+
+	len = strlen(fpath);
+	if (len > 3 && !strcmp(fpath + len - 3, ".gz")) {
+		len -= 3;
+	}
+	ext = fpath + len;
+	while (ext > fpath && ext[-1] != '.' && ext[-1] != '/') {
+		ext--;
+	}
+	if (ext == fpath || ext[-1] != '.') {
+		return httpMimeTypeBinary;
+	}
+	len -= ext - fpath;
+	for (i = 0; i < sizeof(g_fileMimeTypes) / sizeof(g_fileMimeTypes[0]); i++) {
+		if (strlen(g_fileMimeTypes[i].ext) == len && !strncmp(ext, g_fileMimeTypes[i].ext, len)) {
+			return g_fileMimeTypes[i].type;
+		}
+	}
+	return httpMimeTypeBinary;
+}
+#endif
+
 #if ENABLE_LITTLEFS
 
 int EndsWith(const char* str, const char* suffix)
@@ -371,22 +512,18 @@ void BB_AddText(berryBuilder_t *b, const char *fname, const char *start, const c
 #endif
 	BB_AddCode(b, "\")", 0);
 }
-void eval_berry_snippet(const char *s);
+#if ENABLE_OBK_BERRY
 void Berry_SaveRequest(http_request_t *r);
-void BB_Run(berryBuilder_t *b)
-{
-	b->berry_buffer[b->berry_len] = 0;
-	eval_berry_snippet(b->berry_buffer);
-}
-int http_runBerryFile(http_request_t *request, const char *fname) {
-	Berry_SaveRequest(request);
+// turns page with <?b ?> tags into Berry program, called only when cached bytecode is stale
+static char *http_buildBerryPage(const char *fname) {
 	berryBuilder_t bb;
+	char *data, *p, *res;
+
 	BB_Start(&bb);
-	char *data = (char*)LFS_ReadFile(fname);
+	data = (char*)LFS_ReadFile(fname);
 	if (data == 0)
 		return 0;
-	http_setup(request, httpMimeTypeHTML);
-	char *p = data;
+	p = data;
 	while (*p) {
 		char *btag = strstr(p, "<?b");
 		if (!btag) {
@@ -404,9 +541,24 @@ int http_runBerryFile(http_request_t *request, const char *fname) {
 		p++;
 	BB_AddText(&bb, fname, s, p);
 	free(data);
-	BB_Run(&bb);
+	res = (char*)malloc(bb.berry_len + 1);
+	if (res == 0)
+		return 0;
+	memcpy(res, bb.berry_buffer, bb.berry_len);
+	res[bb.berry_len] = 0;
+	return res;
+}
+int http_runBerryFile(http_request_t *request, const char *fname) {
+	struct lfs_info info;
+
+	if (lfs_stat(&lfs, fname, &info) < 0 || info.type != LFS_TYPE_REG)
+		return 0;
+	Berry_SaveRequest(request);
+	http_setup(request, httpMimeTypeHTML);
+	Berry_RunFile(fname, http_buildBerryPage);
 	return 1;
 }
+#endif
 static int http_rest_run_lfs_file(http_request_t* request) {
 	char* fpath;
 	// don't start LFS just because we're trying to read a file -
@@ -437,13 +589,16 @@ static int http_rest_run_lfs_file(http_request_t* request) {
 	return 0;
 }
 
+// file is sent in chunks of this, so any size can be served
+#define LFS_FILE_CHUNK 1024
+
 static int http_rest_get_lfs_file(http_request_t* request) {
 	char* fpath;
 	char* buff;
 	int len;
 	int lfsres;
 	int total = 0;
-	lfs_file_t* file;
+	lfsStream_t* stream;
 	char *args;
 	bool isGzip;
 
@@ -458,9 +613,7 @@ static int http_rest_get_lfs_file(http_request_t* request) {
 
 	fpath = os_malloc(strlen(request->url) - strlen("api/lfs/") + 1);
 
-	buff = os_malloc(1024);
-	file = os_malloc(sizeof(lfs_file_t));
-	memset(file, 0, sizeof(lfs_file_t));
+	buff = 0;
 
 	strcpy(fpath, request->url + strlen("api/lfs/"));
 
@@ -473,9 +626,18 @@ static int http_rest_get_lfs_file(http_request_t* request) {
 	isGzip = EndsWith(fpath, "gz");
 
 	ADDLOG_DEBUG(LOG_FEATURE_API, "LFS read of %s", fpath);
-	lfsres = lfs_file_open(&lfs, file, fpath, LFS_O_RDONLY);
+	stream = LFS_OpenStream(fpath, &lfsres);
+	if (stream) {
+		lfsres = 0;
+		buff = os_malloc(LFS_FILE_CHUNK);
+		if (buff == 0) {
+			LFS_CloseStream(stream);
+			stream = 0;
+			lfsres = LFS_ERR_NOMEM;
+		}
+	}
 
-	if (lfsres == -21) {
+	if (lfsres == LFS_ERR_ISDIR) {
 		lfs_dir_t* dir;
 		ADDLOG_DEBUG(LOG_FEATURE_API, "%s is a folder", fpath);
 		dir = os_malloc(sizeof(lfs_dir_t));
@@ -529,49 +691,7 @@ static int http_rest_get_lfs_file(http_request_t* request) {
 	else {
 		ADDLOG_DEBUG(LOG_FEATURE_API, "LFS open [%s] gives %d", fpath, lfsres);
 		if (lfsres >= 0) {
-			char* ext = fpath;
-			const char *mimetype = httpMimeTypeBinary;
-
-			if (isGzip) {
-				// find original extension (e.g., .js from .js.gz)
-				char* dot = strrchr(fpath, '.');
-				if (dot) {
-					*dot = '\0'; // temporarily strip .gz
-					if (EndsWith(fpath, ".js")) {
-						mimetype = httpMimeTypeJavascript;
-					}
-					else if (EndsWith(fpath, ".html")) {
-						mimetype = httpMimeTypeHTML;
-					}
-					else if (EndsWith(fpath, ".css")) {
-						mimetype = httpMimeTypeCSS;
-					}
-					else if (EndsWith(fpath, ".json")) {
-						mimetype = httpMimeTypeJson;
-					}
-					else if (EndsWith(fpath, ".ico")) {
-						mimetype = "image/x-icon";
-					}
-					*dot = '.'; // restore .gz
-				}
-			}
-			else {
-				if (EndsWith(fpath, ".js") || EndsWith(fpath, ".vue")) {
-					mimetype = httpMimeTypeJavascript;
-				}
-				else if (EndsWith(fpath, ".json")) {
-					mimetype = httpMimeTypeJson;
-				}
-				else if (EndsWith(fpath, ".html")) {
-					mimetype = httpMimeTypeHTML;
-				}
-				else if (EndsWith(fpath, ".css")) {
-					mimetype = httpMimeTypeCSS;
-				}
-				else if (EndsWith(fpath, ".ico")) {
-					mimetype = "image/x-icon";
-				}
-			}
+			const char *mimetype = http_getFileMimeType(fpath);
 
 			if (isGzip) {
 				http_setup_gz(request, mimetype);
@@ -583,15 +703,15 @@ static int http_rest_get_lfs_file(http_request_t* request) {
 			//			http_runBerryFile(request, fpath);
 			//#else
 			do {
-				len = lfs_file_read(&lfs, file, buff, 1024);
-				total += len;
-				if (len) {
+				len = LFS_ReadChunk(stream, (byte*)buff, LFS_FILE_CHUNK);
+				if (len > 0) {
+					total += len;
 					//ADDLOG_DEBUG(LOG_FEATURE_API, "%d bytes read", len);
 					postany(request, buff, len);
 				}
 			} while (len > 0);
 			//#endif
-			lfs_file_close(&lfs, file);
+			LFS_CloseStream(stream);
 			ADDLOG_DEBUG(LOG_FEATURE_API, "%d total bytes read", total);
 		}
 		else {
@@ -603,7 +723,6 @@ static int http_rest_get_lfs_file(http_request_t* request) {
 	}
 	poststr(request, NULL);
 	if (fpath) os_free(fpath);
-	if (file) os_free(file);
 	if (buff) os_free(buff);
 	return 0;
 }
@@ -673,11 +792,38 @@ static int http_rest_get_lfs_delete(http_request_t* request) {
 	return 0;
 }
 
+#define HTTP_B64_STEP	256
+// decodes part of base64 body through small buffer into file, returns
+// bytes written, LFS_ERR_INVAL on bad input
+static int http_rest_write_b64(lfs_file_t* file, b64_stream_t* b64, const char* data, int len) {
+	byte decoded[B64_DECODE_MAX(HTTP_B64_STEP)];
+	int step, n, total = 0;
+
+	while (len > 0) {
+		step = len > HTTP_B64_STEP ? HTTP_B64_STEP : len;
+		n = b64_decode_update(b64, data, step, decoded);
+		if (n < 0) {
+			return LFS_ERR_INVAL;
+		}
+		n = lfs_file_write(&lfs, file, decoded, n);
+		if (n < 0) {
+			return n;
+		}
+		total += n;
+		data += step;
+		len -= step;
+	}
+	return total;
+}
 static int http_rest_post_lfs_file(http_request_t* request) {
 	int len;
 	int lfsres;
 	int total = 0;
 	int loops = 0;
+	char tmp[8];
+	char* args;
+	b64_stream_t b64;
+	bool bBase64;
 
 	// allocated variables
 	lfs_file_t* file;
@@ -700,6 +846,13 @@ static int http_rest_post_lfs_file(http_request_t* request) {
 	memset(file, 0, sizeof(lfs_file_t));
 
 	strcpy(fpath, request->url + strlen("api/lfs/"));
+	// ?b64=1 when body is base64 of file
+	bBase64 = http_getArg(request->url, "b64", tmp, sizeof(tmp)) && tmp[0] == '1';
+	b64_decode_begin(&b64);
+	args = strchr(fpath, '?');
+	if (args) {
+		*args = 0;
+	}
 	ADDLOG_DEBUG(LOG_FEATURE_API, "LFS write of %s len %d", fpath, request->contentLength);
 
 	folder = strchr(fpath, '/');
@@ -721,11 +874,13 @@ static int http_rest_post_lfs_file(http_request_t* request) {
 	if (lfsres >= 0) {
 		//ADDLOG_DEBUG(LOG_FEATURE_API, "opened %s");
 		int towrite = request->bodylen;
-		char* writebuf = request->bodystart;
-		int writelen = request->bodylen;
+		char* writebuf = NULL;
+		int writelen;
 		if (request->contentLength >= 0) {
 			towrite = request->contentLength;
 		}
+		// first part came with headers, rest is read in parts below
+		writelen = http_readBody(request, &writebuf);
 		//ADDLOG_DEBUG(LOG_FEATURE_API, "bodylen %d, contentlen %d", request->bodylen, request->contentLength);
 
 		if (writelen < 0) {
@@ -751,7 +906,12 @@ static int http_rest_post_lfs_file(http_request_t* request) {
 			}
 #endif
 			//ADDLOG_DEBUG(LOG_FEATURE_API, "%d bytes to write", writelen);
-			len = lfs_file_write(&lfs, file, writebuf, writelen);
+			if (bBase64) {
+				len = http_rest_write_b64(file, &b64, writebuf, writelen);
+			}
+			else {
+				len = lfs_file_write(&lfs, file, writebuf, writelen);
+			}
 			if (len < 0) {
 				ADDLOG_ERROR(LOG_FEATURE_API, "Failed to write to %s with error %i", fpath,len);
 				break;
@@ -760,16 +920,25 @@ static int http_rest_post_lfs_file(http_request_t* request) {
 			if (len > 0) {
 				//ADDLOG_DEBUG(LOG_FEATURE_API, "%d bytes written", len);
 			}
-			towrite -= len;
+			towrite -= writelen;
 			if (towrite > 0) {
-				writebuf = request->received;
-				writelen = recv(request->fd, writebuf, request->receivedLenmax, 0);
+				writelen = http_readBody(request, &writebuf);
 				if (writelen < 0) {
 					ADDLOG_DEBUG(LOG_FEATURE_API, "recv returned %d - end of data - remaining %d", writelen, towrite);
 				}
 			}
-		} while ((towrite > 0) && (writelen >= 0));
+		} while ((towrite > 0) && (writelen > 0));
 
+		if (bBase64 && len >= 0) {
+			// last group may come without padding
+			byte last[2];
+
+			len = b64_decode_finish(&b64, last);
+			if (len > 0) {
+				len = lfs_file_write(&lfs, file, last, len);
+				total += len > 0 ? len : 0;
+			}
+		}
 		// no more data
 		lfs_file_truncate(&lfs, file, total);
 
@@ -777,7 +946,13 @@ static int http_rest_post_lfs_file(http_request_t* request) {
 		lfs_file_close(&lfs, file);
 		ADDLOG_DEBUG(LOG_FEATURE_API, "%d total bytes written", total);
 		http_setup(request, httpMimeTypeJson);
-		hprintf255(request, "{\"fname\":\"%s\",\"size\":%d}", fpath, total);
+		if (bBase64 && len < 0) {
+			request->responseCode = 400;
+			hprintf255(request, "{\"fname\":\"%s\",\"error\":%d}", fpath, len);
+		}
+		else {
+			hprintf255(request, "{\"fname\":\"%s\",\"size\":%d}", fpath, total);
+		}
 	}
 	else {
 		request->responseCode = HTTP_RESPONSE_SERVER_ERROR;
@@ -827,40 +1002,28 @@ static int http_rest_get_seriallog(http_request_t* request) {
 static int http_rest_get_pins(http_request_t* request) {
 	int i;
 	int maxNonZero;
+	jsonWriter_t w;
+
 	http_setup(request, httpMimeTypeJson);
-	poststr(request, "{\"rolenames\":[");
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_StartArray(&w, "rolenames");
 	for (i = 0; i < IOR_Total_Options; i++) {
-		if (i) {
-			hprintf255(request, ",");
-		}
-		hprintf255(request, "\"%s\"", htmlPinRoleNames[i]);
+		JSONW_String(&w, NULL, htmlPinRoleNames[i]);
 	}
-	poststr(request, "],\"roles\":[");
-
+	JSONW_EndArray(&w);
+	JSONW_StartArray(&w, "roles");
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (i) {
-			hprintf255(request, ",");
-		}
-		hprintf255(request, "%d", g_cfg.pins.roles[i]);
+		JSONW_Int(&w, NULL, g_cfg.pins.roles[i]);
 	}
+	JSONW_EndArray(&w);
 	// TODO: maybe we should cull futher channels that are not used?
 	// I support many channels because I plan to use 16x relays module with I2C MCP23017 driver
-
-	// find max non-zero ch
-	//maxNonZero = -1;
-	//for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-	//	if (g_cfg.pins.channels[i] != 0) {
-	//		maxNonZero = i;
-	//	}
-	//}
-
-	poststr(request, "],\"channels\":[");
+	JSONW_StartArray(&w, "channels");
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (i) {
-			hprintf255(request, ",");
-		}
-		hprintf255(request, "%d", g_cfg.pins.channels[i]);
+		JSONW_Int(&w, NULL, g_cfg.pins.channels[i]);
 	}
+	JSONW_EndArray(&w);
 	// find max non-zero ch2
 	maxNonZero = -1;	
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
@@ -869,22 +1032,18 @@ static int http_rest_get_pins(http_request_t* request) {
 		}
 	}
 	if (maxNonZero != -1) {
-		poststr(request, "],\"channels2\":[");
+		JSONW_StartArray(&w, "channels2");
 		for (i = 0; i <= maxNonZero; i++) {
-			if (i) {
-				hprintf255(request, ",");
-			}
-			hprintf255(request, "%d", g_cfg.pins.channels2[i]);
+			JSONW_Int(&w, NULL, g_cfg.pins.channels2[i]);
 		}
+		JSONW_EndArray(&w);
 	}
-	poststr(request, "],\"states\":[");
+	JSONW_StartArray(&w, "states");
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (i) {
-			hprintf255(request, ",");
-		}
-		hprintf255(request, "%d", CHANNEL_Get(g_cfg.pins.channels[i]));
+		JSONW_Int(&w, NULL, CHANNEL_Get(g_cfg.pins.channels[i]));
 	}
-	poststr(request, "]}");
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
 	poststr(request, NULL);
 	return 0;
 }
@@ -923,7 +1082,9 @@ static int http_rest_get_channelTypes(http_request_t* request) {
 ////////////////////////////
 // log config
 static int http_rest_get_logconfig(http_request_t* request) {
-	int i;
+	const char* name;
+	unsigned int dropped, features;
+	int i, level;
 	http_setup(request, httpMimeTypeJson);
 	hprintf255(request, "{\"level\":%d,", g_loglevel);
 	hprintf255(request, "\"features\":%d,", logfeatures);
@@ -945,7 +1106,17 @@ static int http_rest_get_logconfig(http_request_t* request) {
 			hprintf255(request, "\"%s\"", logfeaturenames[i]);
 		}
 	}
-	poststr(request, "]}");
+	// bytes lost by sinks that could not keep up
+	poststr(request, "],\"dropped\":{");
+	for (i = 0; LOG_GetSinkDropped(i, &name, &dropped); i++) {
+		hprintf255(request, "%s\"%s\":%u", i ? "," : "", name, dropped);
+	}
+	// own level and features of outputs
+	poststr(request, "},\"sinks\":{");
+	for (i = 0; LOG_GetSinkFilter(i, &name, &level, &features); i++) {
+		hprintf255(request, "%s\"%s\":{\"level\":%i,\"features\":%u}", i ? "," : "", name, level, features);
+	}
+	poststr(request, "}}");
 	poststr(request, NULL);
 	return 0;
 }
@@ -1027,30 +1198,34 @@ static int http_rest_post_logconfig(http_request_t* request) {
 
 static int http_rest_get_info(http_request_t* request) {
 	char macstr[3 * 6 + 1];
+	char tmp[64];
 	long int* pAllGenericFlags = (long int*)&g_cfg.genericFlags;
+	jsonWriter_t w;
 
 	http_setup(request, httpMimeTypeJson);
-	hprintf255(request, "{\"uptime_s\":%d,", g_secondsElapsed);
-	hprintf255(request, "\"build\":\"%s\",", g_build_str);
-	hprintf255(request, "\"ip\":\"%s\",", HAL_GetMyIPString());
-	hprintf255(request, "\"mac\":\"%s\",", HAL_GetMACStr(macstr));
-	hprintf255(request, "\"flags\":\"%ld\",", *pAllGenericFlags);
-	hprintf255(request, "\"mqtthost\":\"%s:%d\",", CFG_GetMQTTHost(), CFG_GetMQTTPort());
-	hprintf255(request, "\"mqtttopic\":\"%s\",", CFG_GetMQTTClientId());
-	hprintf255(request, "\"chipset\":\"%s\",", PLATFORM_MCU_NAME);
-	hprintf255(request, "\"webapp\":\"%s\",", CFG_GetWebappRoot());
-	hprintf255(request, "\"shortName\":\"%s\",", CFG_GetShortDeviceName());
-	poststr(request, "\"startcmd\":\"");
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "uptime_s", g_secondsElapsed);
+	JSONW_String(&w, "build", g_build_str);
+	JSONW_String(&w, "ip", HAL_GetMyIPString());
+	JSONW_String(&w, "mac", HAL_GetMACStr(macstr));
+	snprintf(tmp, sizeof(tmp), "%ld", *pAllGenericFlags);
+	JSONW_String(&w, "flags", tmp);
+	snprintf(tmp, sizeof(tmp), "%s:%d", CFG_GetMQTTHost(), CFG_GetMQTTPort());
+	JSONW_String(&w, "mqtthost", tmp);
+	JSONW_String(&w, "mqtttopic", CFG_GetMQTTClientId());
+	JSONW_String(&w, "chipset", PLATFORM_MCU_NAME);
+	JSONW_String(&w, "webapp", CFG_GetWebappRoot());
+	JSONW_String(&w, "shortName", CFG_GetShortDeviceName());
 	// This can be longer than 255
-	poststr_escapedForJSON(request, CFG_GetShortStartupCommand());
-	poststr(request, "\",");
+	JSONW_String(&w, "startcmd", CFG_GetShortStartupCommand());
 #ifndef OBK_DISABLE_ALL_DRIVERS
-	hprintf255(request, "\"supportsSSDP\":%d,", DRV_IsRunning("SSDP") ? 1 : 0);
+	JSONW_Int(&w, "supportsSSDP", DRV_IsRunning(DRV_ID_SSDP) ? 1 : 0);
 #else
-	hprintf255(request, "\"supportsSSDP\":0,");
+	JSONW_Int(&w, "supportsSSDP", 0);
 #endif
-
-	hprintf255(request, "\"supportsClientDeviceDB\":true}");
+	JSONW_Bool(&w, "supportsClientDeviceDB", true);
+	JSONW_EndObject(&w);
 
 	poststr(request, NULL);
 	return 0;
@@ -1301,33 +1476,602 @@ static int http_rest_post_flash_advanced(http_request_t* request) {
 	return http_rest_error(request, -1, "invalid url");
 }
 
+#define FLASH_DUMP_BUFFER_SIZE	4096
+
+// Raw flash with Content-Length, so cut transfer is seen by client, and
+// Range for resuming it. Parts are sent straight from buffer, send only
+// waits for lwIP to queue it, so next read overlaps with transmission.
+// CRC32 of same range to check dump against comes from api/flashcrc.
 static int http_rest_get_flash(http_request_t* request, int startaddr, int len) {
 	char* buffer;
-	int res;
+	int bufferSize, first, last, range, readlen, total, res;
+	unsigned int crc, ms, startTick;
 
-	if (startaddr < 0 || (startaddr + len > DEFAULT_FLASH_LEN)) {
+	if (startaddr < 0 || len < 0 || (startaddr + len > DEFAULT_FLASH_LEN)) {
 		return http_rest_error(request, -1, "requested flash read out of range");
 	}
+	range = http_getRange(request, len, &first, &last);
+	if (range < 0) {
+		request->responseCode = 416;
+		hprintf255(request, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%i\r\n", len);
+		poststr(request, "Content-Length: 0\r\nConnection: close\r\n\r\n");
+		poststr(request, NULL);
+		return 0;
+	}
+	if (range == 0) {
+		first = 0;
+		last = len - 1;
+	}
 
-	int bufferSize = 1024;
+	bufferSize = FLASH_DUMP_BUFFER_SIZE;
 	buffer = os_malloc(bufferSize);
-	memset(buffer, 0, bufferSize);
+	if (buffer == 0) {
+		bufferSize = 1024;
+		buffer = os_malloc(bufferSize);
+		if (buffer == 0) {
+			return http_rest_error(request, 500, "no memory");
+		}
+	}
+
+	// Content-Length is given here, reply must not get second one
+	request->keepAlive = 0;
+	total = last + 1 - first;
+	if (range) {
+		request->responseCode = 206;
+		hprintf255(request, "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %i-%i/%i\r\n", first, last, len);
+	}
+	else {
+		poststr(request, "HTTP/1.1 200 OK\r\n");
+	}
+	hprintf255(request, "Content-Type: %s\r\nContent-Length: %i\r\nAccept-Ranges: bytes\r\n", httpMimeTypeBinary, total);
+	poststr(request, httpCorsHeaders);
+	poststr(request, "\r\nConnection: close\r\n\r\n");
 
-	http_setup(request, httpMimeTypeBinary);
+	startTick = xTaskGetTickCount();
+	startaddr += first;
+	len = total;
+	crc = 0;
 	while (len) {
-		int readlen = len;
-		if (readlen > 1024) {
-			readlen = 1024;
+		readlen = len;
+		if (readlen > bufferSize) {
+			readlen = bufferSize;
 		}
 		res = HAL_FlashRead(buffer, readlen, startaddr);
+		if (res < 0) {
+			// client sees less than Content-Length
+			ADDLOG_ERROR(LOG_FEATURE_API, "Flash dump: read error %i at 0x%X", res, startaddr);
+			break;
+		}
+		crc = OTA_CRC32(crc, (const unsigned char*)buffer, readlen);
 		startaddr += readlen;
 		len -= readlen;
-		postany(request, buffer, readlen);
+		postconstany(request, buffer, readlen);
 	}
 	poststr(request, NULL);
 	os_free(buffer);
+	ms = (unsigned int)(xTaskGetTickCount() - startTick) * portTICK_PERIOD_MS;
+	ADDLOG_INFO(LOG_FEATURE_API, "Flash dump: %i bytes from 0x%X in %u ms, %u KB/s, CRC32 %08X",
+		total - len, startaddr - (total - len), ms, ms ? (unsigned int)(total - len) / ms : 0, crc);
+	return 0;
+}
+// CRC32 (same as OTA_CRC32) of flash range, same url form as api/flash/
+static int http_rest_get_flash_crc(http_request_t* request) {
+	char* buffer;
+	int startaddr = 0;
+	int len = 0;
+	int readlen, pos;
+	unsigned int crc, ms, startTick;
+
+	if (sscanf(request->url + 13, "%x-%x", &startaddr, &len) != 2
+		|| startaddr < 0 || len < 0 || startaddr + len > DEFAULT_FLASH_LEN) {
+		return http_rest_error(request, -1, "invalid url");
+	}
+	buffer = os_malloc(FLASH_DUMP_BUFFER_SIZE);
+	if (buffer == 0) {
+		return http_rest_error(request, 500, "no memory");
+	}
+	startTick = xTaskGetTickCount();
+	crc = 0;
+	for (pos = 0; pos < len; pos += readlen) {
+		readlen = len - pos;
+		if (readlen > FLASH_DUMP_BUFFER_SIZE) {
+			readlen = FLASH_DUMP_BUFFER_SIZE;
+		}
+		if (HAL_FlashRead(buffer, readlen, startaddr + pos) < 0) {
+			os_free(buffer);
+			return http_rest_error(request, 500, "flash read error");
+		}
+		crc = OTA_CRC32(crc, (const unsigned char*)buffer, readlen);
+	}
+	os_free(buffer);
+	ms = (unsigned int)(xTaskGetTickCount() - startTick) * portTICK_PERIOD_MS;
+	http_setup(request, httpMimeTypeJson);
+	hprintf255(request, "{\"start\":%i,\"len\":%i,\"crc\":\"%08X\",\"ms\":%u}", startaddr, len, crc, ms);
+	poststr(request, NULL);
+	return 0;
+}
+
+#if ENABLE_OTA_RELAY
+// state of firmware serving, so controller knows which peers can feed others
+static int http_rest_get_otarelay(http_request_t* request) {
+	unsigned int addr, crc;
+	int len;
+
+	http_setup(request, httpMimeTypeJson);
+	if (OTA_IsRelayEnabled() && HAL_OTA_GetRelayImage(&addr, &len, &crc) == 0) {
+		hprintf255(request, "{\"enabled\":1,\"image\":1,\"len\":%i,\"crc\":\"%08X\",\"version\":\"%s\"}",
+			len, crc, USER_SW_VER);
+	}
+	else {
+		hprintf255(request, "{\"enabled\":%i,\"image\":0}", OTA_IsRelayEnabled());
+	}
+	poststr(request, NULL);
+	return 0;
+}
+// image in form that ota_http and flash upload take
+static int http_rest_get_otarelay_image(http_request_t* request) {
+	unsigned int addr, crc;
+	int len;
+
+	if (OTA_IsRelayEnabled() == 0) {
+		return http_rest_error(request, 403, "OTA relay is off, see otaRelay");
+	}
+	if (HAL_OTA_GetRelayImage(&addr, &len, &crc) != 0) {
+		return http_rest_error(request, 404, "no verified image");
+	}
+	ADDLOG_INFO(LOG_FEATURE_API, "Serving %i bytes of firmware to peer", len);
+	return http_rest_get_flash(request, addr, len);
+}
+#endif
+
+#if ENABLE_ASSETS
+static int http_rest_get_assets(http_request_t* request) {
+	char name[ASSETS_NAME_SIZE];
+	obkAsset_t a;
+	jsonWriter_t w;
+	int i, count;
+
+	count = Assets_GetCount();
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "files", count);
+	JSONW_Bool(&w, "mapped", Assets_IsMapped());
+	JSONW_StartArray(&w, "content");
+	for (i = 0; i < count; i++) {
+		if (Assets_GetEntry(i, name, &a)) {
+			JSONW_StartObject(&w, NULL);
+			JSONW_String(&w, "name", name);
+			JSONW_Int(&w, "size", a.size);
+			JSONW_EndObject(&w);
+		}
+	}
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+// file from asset image, name.gz is served for name when only it is there
+static int http_rest_get_asset_file(http_request_t* request) {
+	char name[ASSETS_NAME_SIZE + 3];
+	char etag[12];
+	byte buf[256];
+	obkAsset_t a;
+	const char* p;
+	int len, pos;
+	bool isGzip, found;
+
+	p = request->url + strlen("api/assets/");
+	len = 0;
+	while (p[len] && p[len] != '?') {
+		len++;
+	}
+	found = false;
+	if (len < ASSETS_NAME_SIZE) {
+		memcpy(name, p, len);
+		name[len] = 0;
+		found = Assets_Find(name, &a);
+		if (found == false) {
+			strcpy(name + len, ".gz");
+			found = Assets_Find(name, &a);
+		}
+	}
+	if (found == false) {
+		return http_rest_error(request, HTTP_RESPONSE_NOT_FOUND, "no such asset");
+	}
+	len = strlen(name);
+	isGzip = len > 3 && !strcmp(name + len - 3, ".gz");
+	snprintf(etag, sizeof(etag), "%08x", a.crc);
+	if (http_hasETag(request, etag)) {
+		poststr(request, "HTTP/1.1 304 Not Modified\r\n");
+		hprintf255(request, "ETag: \"%s\"\r\n", etag);
+		poststr(request, "Connection: close\r\n\r\n");
+		poststr(request, NULL);
+		return 0;
+	}
+	http_setup_cached(request, http_getFileMimeType(name), isGzip, etag);
+	if (a.data) {
+		// mapped flash is sent from where it is
+		postconstany(request, (const char*)a.data, a.size);
+	}
+	else {
+		pos = 0;
+		while ((len = Assets_Read(&a, pos, buf, sizeof(buf))) > 0) {
+			postany(request, (const char*)buf, len);
+			pos += len;
+		}
+	}
+	poststr(request, NULL);
+	return 0;
+}
+// whole image made by scripts/mkassets.py
+static int http_rest_post_assets(http_request_t* request) {
+	char* data;
+	int len, total, partSize, files;
+
+	partSize = Assets_WriteBegin();
+	if (partSize <= 0) {
+		Assets_WriteEnd(false);
+		return http_rest_error(request, HTTP_RESPONSE_NOT_FOUND, "no asset partition");
+	}
+	if (request->contentLength > partSize) {
+		Assets_WriteEnd(false);
+		return http_rest_error(request, 413, "image does not fit asset partition");
+	}
+	total = 0;
+	while ((len = http_readBody(request, &data)) > 0) {
+		if (Assets_WriteChunk(total, (const byte*)data, len)) {
+			Assets_WriteEnd(false);
+			return http_rest_error(request, HTTP_RESPONSE_SERVER_ERROR, "asset write failed");
+		}
+		total += len;
+	}
+	files = Assets_WriteEnd(len == 0 && total > 0);
+	ADDLOG_INFO(LOG_FEATURE_API, "Asset image of %i bytes written, %i files", total, files);
+	if (files == 0) {
+		return http_rest_error(request, 400, "asset image is not valid");
+	}
+	http_setup(request, httpMimeTypeJson);
+	hprintf255(request, "{\"size\":%i,\"files\":%i}", total, files);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
+#if ENABLE_CMD_STATS
+typedef struct cmdStatsPrinter_s {
+	http_request_t* request;
+	int addcomma;
+} cmdStatsPrinter_t;
+
+static void http_rest_print_cmdstat(const char *name, const cmdStats_t *st, void *userData) {
+	cmdStatsPrinter_t* p = (cmdStatsPrinter_t*)userData;
+
+	if (p->addcomma) {
+		poststr(p->request, ",");
+	}
+	hprintf255(p->request, "\"%s\":{\"calls\":%u,\"totalUs\":%u,\"maxUs\":%u,\"sources\":%i}",
+		name, st->calls, st->totalUs, st->maxUs, st->sources);
+	p->addcomma = 1;
+}
+static int http_rest_get_cmdstats(http_request_t* request) {
+	cmdStatsPrinter_t p;
+
+	p.request = request;
+	p.addcomma = 0;
+	http_setup(request, httpMimeTypeJson);
+	poststr(request, "{");
+	CMD_ForEachCommandStats(&p, http_rest_print_cmdstat);
+	poststr(request, "}");
+	poststr(request, NULL);
 	return 0;
 }
+#endif
+
+#if ENABLE_HTTP_ROUTE_STATS
+static void http_rest_print_routestat(const httpRoute_t* r, void* userData) {
+	jsonWriter_t* w = (jsonWriter_t*)userData;
+
+	JSONW_StartObject(w, NULL);
+	JSONW_String(w, "url", r->url);
+	JSONW_Int(w, "method", r->method);
+	JSONW_Int(w, "hits", r->stats.hits);
+	JSONW_Int(w, "totalUs", r->stats.totalUs);
+	JSONW_Int(w, "maxUs", r->stats.maxUs);
+	JSONW_EndObject(w);
+}
+static int http_rest_get_routestats(http_request_t* request) {
+	jsonWriter_t w;
+
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartArray(&w, NULL);
+	HTTP_ForEachRouteStats(&w, http_rest_print_routestat);
+	JSONW_EndArray(&w);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
+#if ENABLE_HTTP_REQUEST_STATS
+// last requests, newest first, this one is not there yet
+static int http_rest_get_httpstats(http_request_t* request) {
+	httpRequestStats_t stats[HTTP_REQUEST_STATS_COUNT];
+	jsonWriter_t w;
+	int i, count;
+
+	count = HTTP_GetRequestStats(stats, HTTP_REQUEST_STATS_COUNT);
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartArray(&w, NULL);
+	for (i = 0; i < count; i++) {
+		JSONW_StartObject(&w, NULL);
+		JSONW_String(&w, "url", stats[i].url);
+		JSONW_Int(&w, "method", stats[i].method);
+		JSONW_Int(&w, "us", stats[i].us);
+		JSONW_Int(&w, "bytes", stats[i].bytes);
+		JSONW_Int(&w, "sends", stats[i].sends);
+		JSONW_Int(&w, "heapMin", stats[i].heapMin);
+		JSONW_Int(&w, "heapUsed", stats[i].heapUsed);
+		JSONW_EndObject(&w);
+	}
+	JSONW_EndArray(&w);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
+#if ENABLE_CRASH_LOG
+// last log lines of previous boot, with time since boot and free heap
+static int http_rest_get_crashlog(http_request_t* request) {
+	jsonWriter_t w;
+	unsigned int tick, heap;
+	char text[96];
+	int i;
+
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "reason", g_rebootReason);
+	JSONW_StartArray(&w, "lines");
+	for (i = 0; LOG_GetCrashLogLine(i, &tick, &heap, text, sizeof(text)); i++) {
+		JSONW_StartObject(&w, NULL);
+		JSONW_Int(&w, "ms", tick);
+		JSONW_Int(&w, "heap", heap);
+		JSONW_String(&w, "text", text);
+		JSONW_EndObject(&w);
+	}
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
+#if ENABLE_SYSPERF
+static void http_rest_print_perfstat(const char* name, const perfStat_t* st, void* userData) {
+	jsonWriter_t* w = (jsonWriter_t*)userData;
+
+	JSONW_StartObject(w, name);
+	JSONW_Int(w, "calls", st->calls);
+	JSONW_Int(w, "avgUs", st->calls ? st->totalUs / st->calls : 0);
+	JSONW_Int(w, "maxUs", st->maxUs);
+	JSONW_EndObject(w);
+}
+#if ENABLE_DRIVER_INDEX_CACHE && !defined(OBK_DISABLE_ALL_DRIVERS)
+// calls are renders of both parts, kept are requests served without render
+static void http_rest_print_indexstat(const char* name, const perfStat_t* st, unsigned int hits, void* userData) {
+	jsonWriter_t* w = (jsonWriter_t*)userData;
+
+	JSONW_StartObject(w, name);
+	JSONW_Int(w, "calls", st->calls);
+	JSONW_Int(w, "kept", hits);
+	JSONW_Int(w, "avgUs", st->calls ? st->totalUs / st->calls : 0);
+	JSONW_Int(w, "maxUs", st->maxUs);
+	JSONW_EndObject(w);
+}
+#endif
+// tasks of last window, cpu is per mille of one core and -1 where
+// RTOS run time stats are not built, cores are their load, see top
+static int http_rest_get_top(http_request_t* request) {
+	perfTask_t tasks[SYSPERF_MAX_TASKS];
+	jsonWriter_t w;
+	int i, count;
+
+	count = SYSPERF_GetTasks(tasks, SYSPERF_MAX_TASKS);
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "windowSec", SYSPERF_GetWindow());
+	JSONW_StartArray(&w, "cores");
+	for (i = 0; i < SYSPERF_MAX_CORES; i++) {
+		JSONW_Int(&w, NULL, SYSPERF_GetCoreLoad(i));
+	}
+	JSONW_EndArray(&w);
+	JSONW_StartArray(&w, "tasks");
+	for (i = 0; i < count; i++) {
+		JSONW_StartObject(&w, NULL);
+		JSONW_String(&w, "name", tasks[i].name);
+		JSONW_Int(&w, "cpu", tasks[i].cpuPermille);
+		JSONW_Int(&w, "priority", tasks[i].priority);
+		JSONW_Int(&w, "minFree", tasks[i].minFreeBytes);
+		JSONW_Int(&w, "core", tasks[i].core);
+		JSONW_EndObject(&w);
+	}
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+// QuickTick parts, driver quick ticks and thread stacks, see sysperf
+static int http_rest_get_sysperf(http_request_t* request) {
+	perfThread_t threads[SYSPERF_MAX_THREADS];
+	jsonWriter_t w;
+	int i, count;
+
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "periodMs", QUICK_TMR_DURATION);
+	JSONW_Int(&w, "overruns", QuickTick_GetOverruns());
+	JSONW_StartObject(&w, "stages");
+	for (i = 0; i < QT_STAGE_COUNT; i++) {
+		http_rest_print_perfstat(QuickTick_GetStageName(i), QuickTick_GetStageStats(i), &w);
+	}
+	JSONW_EndObject(&w);
+	JSONW_StartObject(&w, "drivers");
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	DRV_ForEachQuickTickStats(&w, http_rest_print_perfstat);
+#endif
+	JSONW_EndObject(&w);
+#if ENABLE_DRIVER_INDEX_CACHE && !defined(OBK_DISABLE_ALL_DRIVERS)
+	JSONW_StartObject(&w, "index");
+	DRV_ForEachIndexStats(&w, http_rest_print_indexstat);
+	JSONW_EndObject(&w);
+#endif
+	JSONW_StartArray(&w, "threads");
+	count = SYSPERF_GetThreads(threads, SYSPERF_MAX_THREADS);
+	for (i = 0; i < count; i++) {
+		JSONW_StartObject(&w, NULL);
+		JSONW_String(&w, "name", threads[i].name);
+		JSONW_Int(&w, "stack", threads[i].stackBytes);
+		JSONW_Int(&w, "minFree", threads[i].minFreeBytes);
+		JSONW_Bool(&w, "alive", threads[i].bAlive);
+		JSONW_EndObject(&w);
+	}
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
+#if ENABLE_HEAP_TRACKER
+// allocation tracker totals and 16 sites holding most memory,
+// largestFree is -1 where platform does not tell it
+static int http_rest_get_heapstats(http_request_t* request) {
+	heapSiteStats_t sites[16];
+	heapStats_t st;
+	jsonWriter_t w;
+	int i, count;
+
+	HeapTrack_GetStats(&st);
+	count = HeapTrack_GetSites(sites, 16);
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "liveBytes", st.liveBytes);
+	JSONW_Int(&w, "liveCount", st.liveCount);
+	JSONW_Int(&w, "peakBytes", st.peakBytes);
+	JSONW_Int(&w, "allocs", st.allocs);
+	JSONW_Int(&w, "frees", st.frees);
+	JSONW_Int(&w, "failed", st.failed);
+	JSONW_Int(&w, "foreign", st.untracked);
+	JSONW_Int(&w, "freeHeap", st.freeHeap);
+	JSONW_Int(&w, "largestFree", st.largestFree);
+	JSONW_StartArray(&w, "sites");
+	for (i = 0; i < count; i++) {
+		JSONW_StartObject(&w, NULL);
+		JSONW_String(&w, "file", sites[i].file ? sites[i].file : "other");
+		JSONW_Int(&w, "line", sites[i].line);
+		JSONW_Int(&w, "liveBytes", sites[i].liveBytes);
+		JSONW_Int(&w, "liveCount", sites[i].liveCount);
+		JSONW_Int(&w, "peakBytes", sites[i].peakBytes);
+		JSONW_Int(&w, "allocs", sites[i].allocs);
+		JSONW_EndObject(&w);
+	}
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
+#if ENABLE_CPU_PROFILER
+// whole sample table, pc is hex and 0 where platform can't tell it,
+// task indexes tasks array; scripts/profile_report.py reads it
+static int http_rest_get_profile(http_request_t* request) {
+	profilerEntry_t e[32];
+	profilerStats_t st;
+	jsonWriter_t w;
+	char tmp[12];
+	int i, j, count;
+
+	Profiler_GetStats(&st);
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "hz", st.hz);
+	JSONW_Bool(&w, "running", st.bRunning);
+	JSONW_Int(&w, "samples", st.samples);
+	JSONW_Int(&w, "dropped", st.dropped);
+	JSONW_StartArray(&w, "tasks");
+	for (i = 0; i < st.numTasks; i++) {
+		JSONW_StartObject(&w, NULL);
+		JSONW_String(&w, "name", Profiler_GetTaskName(i));
+		JSONW_Int(&w, "samples", Profiler_GetTaskSamples(i));
+		JSONW_EndObject(&w);
+	}
+	JSONW_EndArray(&w);
+	JSONW_StartArray(&w, "pcs");
+	// table is copied in parts, so stack use stays small
+	for (i = 0; ; i += count) {
+		count = Profiler_GetEntries(i, e, 32);
+		if (count == 0) {
+			break;
+		}
+		for (j = 0; j < count; j++) {
+			JSONW_StartObject(&w, NULL);
+			snprintf(tmp, sizeof(tmp), "%08x", e[j].pc);
+			JSONW_String(&w, "pc", tmp);
+			JSONW_Int(&w, "task", e[j].task);
+			JSONW_Int(&w, "n", e[j].count);
+			JSONW_EndObject(&w);
+		}
+	}
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
+#if ENABLE_PING_WATCHDOG
+// ping watchdog counters and round trip histogram, counts[i] are replies
+// up to limitsMs[i], last count has no limit
+static int http_rest_get_ping(http_request_t* request) {
+	const pingStats_t* st = PingWatchDog_GetStats();
+	jsonWriter_t w;
+	int i;
+
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_String(&w, "host", CFG_GetPingHost());
+	JSONW_Int(&w, "intervalMs", st->intervalMs);
+	JSONW_Int(&w, "sent", st->sent);
+	JSONW_Int(&w, "received", st->received);
+	JSONW_Int(&w, "lost", st->lost);
+	JSONW_Int(&w, "lastMs", st->lastMs);
+	JSONW_Int(&w, "minMs", st->minMs);
+	JSONW_Int(&w, "maxMs", st->maxMs);
+	JSONW_Int(&w, "avgMs", st->received ? st->sumMs / st->received : 0);
+	JSONW_Int(&w, "sinceReply", g_timeSinceLastPingReply);
+	JSONW_StartArray(&w, "limitsMs");
+	for (i = 0; i < PING_HIST_BUCKETS - 1; i++) {
+		JSONW_Int(&w, NULL, PingWatchDog_GetBucketLimitMS(i));
+	}
+	JSONW_EndArray(&w);
+	JSONW_StartArray(&w, "counts");
+	for (i = 0; i < PING_HIST_BUCKETS; i++) {
+		JSONW_Int(&w, NULL, st->hist[i]);
+	}
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
 
 static int http_rest_get_channels(http_request_t* request) {
 	int i;
@@ -1356,6 +2100,73 @@ static int http_rest_get_channels(http_request_t* request) {
 	return 0;
 }
 
+#if ENABLE_CHANNEL_STATS
+static void http_rest_print_channelstat(int ch, int window, const float* stats, void* userData) {
+	jsonWriter_t* w = (jsonWriter_t*)userData;
+
+	JSONW_StartObject(w, NULL);
+	JSONW_Int(w, "ch", ch);
+	JSONW_Int(w, "window", window);
+	JSONW_Float(w, "avg", stats[CHSTAT_AVG], 3);
+	JSONW_Float(w, "min", stats[CHSTAT_MIN], 3);
+	JSONW_Float(w, "max", stats[CHSTAT_MAX], 3);
+	JSONW_Float(w, "sum", stats[CHSTAT_SUM], 3);
+	JSONW_Float(w, "rate", stats[CHSTAT_RATE], 5);
+	JSONW_Float(w, "ema", stats[CHSTAT_EMA], 3);
+	JSONW_EndObject(w);
+}
+static int http_rest_get_channelstats(http_request_t* request) {
+	jsonWriter_t w;
+
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartArray(&w, NULL);
+	ChannelStats_ForEach(&w, http_rest_print_channelstat);
+	JSONW_EndArray(&w);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
+#if ENABLE_DRIVER_WIFIROAM
+static void http_rest_print_wifiap(const obkWiFiScanEntry_t* ap, int age, void* userData) {
+	jsonWriter_t* w = (jsonWriter_t*)userData;
+	char bssid[32];
+
+	sprintf(bssid, MACSTR, MAC2STR(ap->bssid));
+	JSONW_StartObject(w, NULL);
+	JSONW_String(w, "ssid", ap->ssid);
+	JSONW_String(w, "bssid", bssid);
+	JSONW_Int(w, "ch", ap->channel);
+	JSONW_Int(w, "rssi", ap->rssi);
+	JSONW_Int(w, "age", age);
+	JSONW_EndObject(w);
+}
+// cache of WiFiRoam driver, empty when it's not running
+static int http_rest_get_wifiscan(http_request_t* request) {
+	jsonWriter_t w;
+	char bssid[32];
+	bool bRunning = DRV_IsRunningByName("WiFiRoam");
+
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_String(&w, "ssid", CFG_GetWiFiSSID());
+	JSONW_String(&w, "bssid", HAL_GetWiFiBSSID(bssid));
+	JSONW_Int(&w, "rssi", HAL_GetWifiStrength());
+	JSONW_Int(&w, "scans", bRunning ? WiFiRoam_GetScanCount() : 0);
+	JSONW_Int(&w, "roams", bRunning ? WiFiRoam_GetRoamCount() : 0);
+	JSONW_StartArray(&w, "aps");
+	if (bRunning) {
+		WiFiRoam_ForEachAP(&w, http_rest_print_wifiap);
+	}
+	JSONW_EndArray(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+#endif
+
 // currently crashes the MCU - maybe stack overflow?
 static int http_rest_post_channels(http_request_t* request) {
 	int i;
@@ -1410,6 +2221,160 @@ static int http_rest_post_channels(http_request_t* request) {
 }
 
 
+// parses list like "1,2,8-15", returns count or -1 when it's not valid
+static int http_rest_parseChannelList(const char* s, int* chs, int maxCount) {
+	int count, first, last;
+	char* end;
+
+	count = 0;
+	while (*s) {
+		first = strtol(s, &end, 10);
+		if (end == s) {
+			return -1;
+		}
+		s = end;
+		last = first;
+		if (*s == '-') {
+			s++;
+			last = strtol(s, &end, 10);
+			if (end == s) {
+				return -1;
+			}
+			s = end;
+		}
+		if (first < 0 || last >= CHANNEL_MAX || first > last) {
+			return -1;
+		}
+		for (; first <= last; first++) {
+			if (count >= maxCount) {
+				return -1;
+			}
+			chs[count++] = first;
+		}
+		if (*s == ',') {
+			s++;
+		}
+		else if (*s) {
+			return -1;
+		}
+	}
+	return count;
+}
+static void http_rest_putInt32(byte* p, int v) {
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+// Many channels in one request, for pollers that would otherwise ask one by one.
+// api/channelValues?ch=1,2,8-15 gives {"ver":..,"values":{"1":..}}, all channels without ch.
+// With &bin=1 it's little-endian int32 state version followed by one int32
+// per listed channel, in the listed order.
+static int http_rest_get_channelValues(http_request_t* request) {
+	int chs[CHANNEL_MAX];
+	byte bin[4 + CHANNEL_MAX * 4];
+	char tmp[256];
+	char key[8];
+	jsonWriter_t w;
+	int i, count;
+
+	if (http_getArg(request->url, "ch", tmp, sizeof(tmp))) {
+		count = http_rest_parseChannelList(tmp, chs, CHANNEL_MAX);
+		if (count < 0) {
+			return http_rest_error(request, 400, "Invalid channel list");
+		}
+	}
+	else {
+		for (i = 0; i < CHANNEL_MAX; i++) {
+			chs[i] = i;
+		}
+		count = CHANNEL_MAX;
+	}
+	if (http_getArg(request->url, "bin", tmp, sizeof(tmp)) && atoi(tmp)) {
+		http_rest_putInt32(bin, CHANNEL_GetStateVersion());
+		for (i = 0; i < count; i++) {
+			http_rest_putInt32(bin + 4 + i * 4, CHANNEL_Get(chs[i]));
+		}
+		http_setup(request, httpMimeTypeBinary);
+		postany(request, (const char*)bin, 4 + count * 4);
+		poststr(request, NULL);
+		return 0;
+	}
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "ver", CHANNEL_GetStateVersion());
+	JSONW_StartObject(&w, "values");
+	for (i = 0; i < count; i++) {
+		sprintf(key, "%i", chs[i]);
+		JSONW_Int(&w, key, CHANNEL_Get(chs[i]));
+	}
+	JSONW_EndObject(&w);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
+
+// body is object like {"1":100,"2":0}, all values are set as one batch
+static int http_rest_post_channelValues(http_request_t* request) {
+	int chs[CHANNEL_MAX];
+	int vals[CHANNEL_MAX];
+	jsonWriter_t w;
+	jsmn_parser* p;
+	jsmntok_t* t;
+	char* json_str;
+	int i, r, count, changed;
+
+	json_str = request->bodystart;
+	p = os_malloc(sizeof(jsmn_parser));
+	t = os_malloc(sizeof(jsmntok_t) * (1 + CHANNEL_MAX * 2));
+	if (p == 0 || t == 0 || json_str == 0) {
+		if (p) {
+			os_free(p);
+		}
+		if (t) {
+			os_free(t);
+		}
+		return http_rest_error(request, 400, "No data");
+	}
+	jsmn_init(p);
+	r = jsmn_parse(p, json_str, strlen(json_str), t, 1 + CHANNEL_MAX * 2);
+	if (r < 1 || t[0].type != JSMN_OBJECT) {
+		os_free(p);
+		os_free(t);
+		return http_rest_error(request, 400, "Object expected");
+	}
+	count = 0;
+	for (i = 1; i + 1 < r; i += 2) {
+		if (t[i].type != JSMN_STRING || t[i + 1].type != JSMN_PRIMITIVE) {
+			count = -1;
+			break;
+		}
+		chs[count] = atoi(json_str + t[i].start);
+		vals[count] = atoi(json_str + t[i + 1].start);
+		if (chs[count] < 0 || chs[count] >= CHANNEL_MAX) {
+			count = -1;
+			break;
+		}
+		count++;
+	}
+	os_free(p);
+	os_free(t);
+	if (count < 0) {
+		return http_rest_error(request, 400, "Invalid channel");
+	}
+	changed = CHANNEL_SetMany(chs, vals, count, 0);
+
+	http_setup(request, httpMimeTypeJson);
+	JSONW_Init(&w, request);
+	JSONW_StartObject(&w, NULL);
+	JSONW_Int(&w, "ver", CHANNEL_GetStateVersion());
+	JSONW_Int(&w, "changed", changed);
+	JSONW_EndObject(&w);
+	poststr(request, NULL);
+	return 0;
+}
 
 static int http_rest_post_cmd(http_request_t* request) {
 	commandResult_t res;
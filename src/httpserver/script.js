@@ -1,14 +1,20 @@
-//The content of this file get set into htmlHeadStyle (new_http.cs)
+//The content of this file get set into pageScriptGz (new_http.c)
+// refreshInterval is set by page in inline script before this one
 
 var firstTime,
 	lastTime,
 	req = null;
 var onlineFor;
 var onlineForEl = null;
+// state version shown on page, see http_fn_state
+var stateVer = 0;
+var statePolls = 0;
+// true while changes are pushed by event stream
+var pushed = false;
 
 var getElement = (id) => document.getElementById(id);
 
-// refresh status section every 3 seconds
+// fetch whole status section
 function showState() {
 	clearTimeout(firstTime);
 	clearTimeout(lastTime);
@@ -33,12 +39,76 @@ function showState() {
 			}
 			clearTimeout(firstTime);
 			clearTimeout(lastTime);
-			lastTime = setTimeout(showState, 3e3);
+			if (pushed) {
+				// for values that are not pushed (RSSI, MQTT stats...)
+				lastTime = setTimeout(showState, 30 * refreshInterval);
+			} else {
+				lastTime = setTimeout(pollState, refreshInterval);
+			}
 		}
 	};
 	req.open("GET", "index?state=1", true);
 	req.send();
-	firstTime = setTimeout(showState, 3e3);
+	firstTime = setTimeout(showState, refreshInterval);
+}
+
+// every refreshInterval ms ask only for changes since stateVer.
+// Status section is fetched again when channels changed, and every
+// 30 polls for the rest (RSSI, MQTT stats...), driver info is patched alone.
+function pollState() {
+	clearTimeout(firstTime);
+	clearTimeout(lastTime);
+	if (req != null) {
+		req.abort();
+	}
+	req = new XMLHttpRequest();
+	req.onreadystatechange = () => {
+		if (req.readyState == 4 && req.statusText == "OK") {
+			var st = JSON.parse(req.responseText);
+			stateVer = st.ver;
+			if (st.full || Object.keys(st.ch).length > 0 || ++statePolls >= 30) {
+				statePolls = 0;
+				showState();
+				return;
+			}
+			var drvEl = getElement("drv");
+			if (drvEl && st.drv !== undefined) {
+				drvEl.innerHTML = st.drv;
+			}
+			clearTimeout(firstTime);
+			lastTime = setTimeout(pollState, refreshInterval);
+		}
+	};
+	req.open("GET", "state?since=" + stateVer, true);
+	req.send();
+	// no reply, try whole section
+	firstTime = setTimeout(showState, refreshInterval);
+}
+
+// changes pushed by device, polling is used when stream can't be opened
+function startEvents() {
+	var es = new EventSource("events");
+	pushed = true;
+	var refresh = () => {
+		clearTimeout(lastTime);
+		lastTime = setTimeout(showState, 100);
+	};
+	es.addEventListener("ch", refresh);
+	// backlog on device overflowed, some changes were lost
+	es.addEventListener("reset", refresh);
+	es.addEventListener("drv", (e) => {
+		var drvEl = getElement("drv");
+		if (drvEl) {
+			drvEl.innerHTML = e.data;
+		}
+	});
+	es.onerror = () => {
+		// browser reconnects by itself unless stream was refused
+		if (es.readyState == 2) {
+			pushed = false;
+			pollState();
+		}
+	};
 }
 
 function fmtUpTime(totalSeconds) {
@@ -76,7 +146,15 @@ function onLoad() {
 		}
 	}
 
-	showState();
+	var stateEl = getElement("state");
+	if (stateEl) {
+		stateVer = parseInt(stateEl.dataset.ver, 10) || 0;
+		if (window.EventSource) {
+			startEvents();
+		} else {
+			pollState();
+		}
+	}
 }
 
 function submitTemperature(slider) {
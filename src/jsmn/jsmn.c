@@ -1,5 +1,6 @@
 
 #include "string.h"
+#include <stdlib.h>
 // this includes the source code.
 #include "jsmn.h"
 
@@ -10,3 +11,109 @@ int jsoneq(const char *json, jsmntok_t *tok, const char *s) {
   }
   return -1;
 }
+
+// Tokens are read in place, no tree is built: caller gives parsed token
+// array, path goes through object keys and array indexes, e.g.
+// "weather.0.main", and value is taken from json text.
+
+// index of first token after token i and everything inside it
+int jsmn_skip(const jsmntok_t *t, int count, int i) {
+  int pending = 1;
+
+  while (pending > 0 && i < count) {
+    pending += t[i].size - 1;
+    i++;
+  }
+  return i;
+}
+
+// token of value at path from root, -1 if there is none
+int jsmn_find(const char *json, const jsmntok_t *t, int count, const char *path) {
+  char part[32];
+  const char *dot;
+  int i = 0, n, k, found;
+
+  while (*path) {
+    dot = strchr(path, '.');
+    n = dot ? (int)(dot - path) : (int)strlen(path);
+    if (n >= (int)sizeof(part) || i >= count) {
+      return -1;
+    }
+    memcpy(part, path, n);
+    part[n] = 0;
+    path += dot ? n + 1 : n;
+    if (t[i].type == JSMN_OBJECT) {
+      found = 0;
+      k = t[i].size;
+      i++;
+      while (k-- > 0 && i < count) {
+        if (jsoneq(json, (jsmntok_t*)&t[i], part) == 0) {
+          found = 1;
+          i++;
+          break;
+        }
+        // key with its value
+        i = jsmn_skip(t, count, i);
+      }
+      if (!found) {
+        return -1;
+      }
+    }
+    else if (t[i].type == JSMN_ARRAY) {
+      k = atoi(part);
+      if (k < 0 || k >= t[i].size) {
+        return -1;
+      }
+      i++;
+      while (k-- > 0) {
+        i = jsmn_skip(t, count, i);
+      }
+    }
+    else {
+      return -1;
+    }
+  }
+  return i < count ? i : -1;
+}
+
+static int jsmn_findNumber(const char *json, const jsmntok_t *t, int count, const char *path) {
+  int i = jsmn_find(json, t, count, path);
+  char c;
+
+  if (i < 0 || t[i].type != JSMN_PRIMITIVE) {
+    return -1;
+  }
+  c = json[t[i].start];
+  // not true, false or null
+  if (c != '-' && (c < '0' || c > '9')) {
+    return -1;
+  }
+  return i;
+}
+double jsmn_getDouble(const char *json, const jsmntok_t *t, int count, const char *path, double def) {
+  int i = jsmn_findNumber(json, t, count, path);
+
+  return i < 0 ? def : atof(json + t[i].start);
+}
+int jsmn_getInt(const char *json, const jsmntok_t *t, int count, const char *path, int def) {
+  int i = jsmn_findNumber(json, t, count, path);
+
+  return i < 0 ? def : (int)strtol(json + t[i].start, 0, 10);
+}
+// string as it is in json, escapes are not decoded
+void jsmn_getString(const char *json, const jsmntok_t *t, int count, const char *path, char *dst, int dstSize, const char *def) {
+  int i = jsmn_find(json, t, count, path);
+  int len;
+
+  if (i < 0 || t[i].type != JSMN_STRING) {
+    strncpy(dst, def, dstSize - 1);
+    dst[dstSize - 1] = '\0';
+    return;
+  }
+  len = t[i].end - t[i].start;
+  if (len > dstSize - 1) {
+    len = dstSize - 1;
+  }
+  memcpy(dst, json + t[i].start, len);
+  dst[len] = '\0';
+}
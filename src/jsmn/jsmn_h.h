@@ -4,3 +4,9 @@
 #include "jsmn.h"
 
 int jsoneq(const char *json, jsmntok_t *tok, const char *s);
+// lookups in parsed tokens, path like "main.temp" or "weather.0.main"
+int jsmn_skip(const jsmntok_t *t, int count, int i);
+int jsmn_find(const char *json, const jsmntok_t *t, int count, const char *path);
+double jsmn_getDouble(const char *json, const jsmntok_t *t, int count, const char *path, double def);
+int jsmn_getInt(const char *json, const jsmntok_t *t, int count, const char *path, int def);
+void jsmn_getString(const char *json, const jsmntok_t *t, int count, const char *path, char *dst, int dstSize, const char *def);
@@ -32,6 +32,7 @@
 */
 
 #include "RCSwitch.h"
+#include "../../../driver/drv_rc_edges.h"
 
 #ifdef RaspberryPi
     // PROGMEM and _P functions are for AVR based microprocessors,
@@ -886,15 +887,25 @@ volatile int rc_triggers = 0;
 int prev = 0;
 int g_rcpin = 0;
 static const uint32_t ir_periodus = 50;
+// edges are queued in driver/drv_rc_edges.c and decoded by processEdges
 void RC_ISR(uint8_t t) {
 	g_micros += ir_periodus;
 	int n = HAL_PIN_ReadDigitalInput(g_rcpin);
 	if (n != prev) {
 		prev = n;
 		rc_triggers++;
-		RCSwitch::handleInterrupt(0);
+		RC_PushEdge(g_micros);
 	}
 }
+// runs queued edges until a code is decoded or queue is empty
+bool RCSwitch::processEdges() {
+	uint32_t time;
+
+	while (RCSwitch::nReceivedValue == 0 && RC_PopEdge(&time)) {
+		RCSwitch::handleEdge(time);
+	}
+	return RCSwitch::nReceivedValue != 0;
+}
 static uint32_t ir_chan
 #if PLATFORM_BEKEN
 = BKTIMER0
@@ -951,13 +962,12 @@ void RCSwitch::enableReceive() {
 int rc_checkedProtocols = 0; 
 int rc_singleRepeats = 0; 
 int rc_repeats = 0; 
-void RECEIVE_ATTR RCSwitch::handleInterrupt(int xyz) {
+void RCSwitch::handleEdge(unsigned long time) {
 
   static unsigned int changeCount = 0;
   static unsigned long lastTime = 0;
   static unsigned char repeatCount = 0;
 
-  const long time = g_micros; // micros();
   const unsigned int duration = time - lastTime;
 
   RCSwitch::buftimings[3]=RCSwitch::buftimings[2];
@@ -179,7 +179,8 @@ class RCSwitch {
 
     #if not defined( RCSwitchDisableReceiving )
 public:
-    static void handleInterrupt(int xyz);
+    static bool processEdges();
+    static void handleEdge(unsigned long time);
 private:
     static bool receiveProtocol(const int p, unsigned int changeCount);
     static bool updateSeparationLimit();
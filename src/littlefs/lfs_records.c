@@ -0,0 +1,254 @@
+#include "../obk_config.h"
+#include "../new_common.h"
+#include "../hal/hal_ota.h"
+#include "our_lfs.h"
+#include "lfs_records.h"
+
+#if ENABLE_LITTLEFS
+
+#define LFS_RECORD_HEADER	10
+#define LFS_RING_HEADER		12
+
+static void LFS_Rec_PutU16(byte *p, int v) {
+	p[0] = v;
+	p[1] = v >> 8;
+}
+static int LFS_Rec_GetU16(const byte *p) {
+	return p[0] | (p[1] << 8);
+}
+static lfs_file_t *LFS_Rec_AllocFile() {
+	lfs_file_t *file;
+
+	if (!lfs_present()) {
+		return 0;
+	}
+	file = (lfs_file_t*)os_malloc(sizeof(lfs_file_t));
+	if (file) {
+		memset(file, 0, sizeof(lfs_file_t));
+	}
+	return file;
+}
+// CRC of entry from version byte on, header CRC field is not included
+static uint32_t LFS_Record_CRC(const byte *hdr, const byte *data, int len) {
+	return OTA_CRC32(OTA_CRC32(0, hdr + 2, 4), data, len);
+}
+
+bool LFS_Record_Load(lfsRecord_t *r, void *data) {
+	lfs_file_t *file;
+	byte hdr[LFS_RECORD_HEADER];
+	byte *buf;
+	int pos, size, len, found;
+	uint32_t crc;
+
+	r->fileSize = -1;
+	file = LFS_Rec_AllocFile();
+	buf = (byte*)malloc(r->size);
+	if (file == 0 || buf == 0) {
+		os_free(file);
+		free(buf);
+		return false;
+	}
+	found = 0;
+	if (lfs_file_open(&lfs, file, r->fileName, LFS_O_RDONLY) < 0) {
+		// nothing saved yet, first save creates it
+		r->fileSize = 0;
+	}
+	else {
+		size = lfs_file_size(&lfs, file);
+		for (pos = 0; pos + LFS_RECORD_HEADER <= size; pos += LFS_RECORD_HEADER + len) {
+			if (lfs_file_read(&lfs, file, hdr, LFS_RECORD_HEADER) != LFS_RECORD_HEADER
+				|| hdr[0] != 'R' || hdr[1] != 'J') {
+				break;
+			}
+			len = LFS_Rec_GetU16(hdr + 4);
+			if (pos + LFS_RECORD_HEADER + len > size) {
+				break;
+			}
+			if (hdr[2] != r->version || len != r->size) {
+				lfs_file_seek(&lfs, file, pos + LFS_RECORD_HEADER + len, LFS_SEEK_SET);
+				continue;
+			}
+			if (lfs_file_read(&lfs, file, buf, len) != len) {
+				break;
+			}
+			crc = hdr[6] | (hdr[7] << 8) | (hdr[8] << 16) | ((uint32_t)hdr[9] << 24);
+			if (crc != LFS_Record_CRC(hdr, buf, len)) {
+				break;
+			}
+			memcpy(data, buf, len);
+			found = 1;
+		}
+		// entries appended after broken tail would not be found
+		if (pos == size) {
+			r->fileSize = size;
+		}
+		lfs_file_close(&lfs, file);
+	}
+	os_free(file);
+	free(buf);
+	return found;
+}
+bool LFS_Record_Save(lfsRecord_t *r, const void *data) {
+	lfs_file_t *file;
+	byte *buf;
+	int len, flags, ok;
+	uint32_t crc;
+
+	len = LFS_RECORD_HEADER + r->size;
+	file = LFS_Rec_AllocFile();
+	buf = (byte*)malloc(len);
+	if (file == 0 || buf == 0) {
+		os_free(file);
+		free(buf);
+		return false;
+	}
+	buf[0] = 'R';
+	buf[1] = 'J';
+	buf[2] = r->version;
+	buf[3] = 0;
+	LFS_Rec_PutU16(buf + 4, r->size);
+	memcpy(buf + LFS_RECORD_HEADER, data, r->size);
+	crc = LFS_Record_CRC(buf, buf + LFS_RECORD_HEADER, r->size);
+	buf[6] = crc;
+	buf[7] = crc >> 8;
+	buf[8] = crc >> 16;
+	buf[9] = crc >> 24;
+
+	flags = LFS_O_WRONLY | LFS_O_CREAT;
+	if (r->fileSize < 0 || r->fileSize + len > r->maxBytes) {
+		flags |= LFS_O_TRUNC;
+		r->fileSize = 0;
+	}
+	else {
+		flags |= LFS_O_APPEND;
+	}
+	ok = lfs_file_open(&lfs, file, r->fileName, flags) >= 0;
+	if (ok) {
+		ok = lfs_file_write(&lfs, file, buf, len) == len;
+		if (lfs_file_close(&lfs, file) < 0) {
+			ok = 0;
+		}
+	}
+	r->fileSize = ok ? r->fileSize + len : -1;
+	os_free(file);
+	free(buf);
+	return ok;
+}
+
+static void LFS_Ring_PutHeader(lfsRing_t *r, byte *out) {
+	out[0] = 'R';
+	out[1] = 'R';
+	out[2] = r->version;
+	out[3] = 0;
+	LFS_Rec_PutU16(out + 4, r->recSize);
+	LFS_Rec_PutU16(out + 6, r->maxRecords);
+	LFS_Rec_PutU16(out + 8, r->next);
+	LFS_Rec_PutU16(out + 10, r->count);
+}
+bool LFS_Ring_Open(lfsRing_t *r) {
+	lfs_file_t *file;
+	byte hdr[LFS_RING_HEADER];
+	int ok;
+
+	r->next = 0;
+	r->count = 0;
+	file = LFS_Rec_AllocFile();
+	if (file == 0) {
+		return false;
+	}
+	if (lfs_file_open(&lfs, file, r->fileName, LFS_O_RDONLY) >= 0) {
+		ok = lfs_file_read(&lfs, file, hdr, LFS_RING_HEADER) == LFS_RING_HEADER
+			&& hdr[0] == 'R' && hdr[1] == 'R' && hdr[2] == r->version
+			&& LFS_Rec_GetU16(hdr + 4) == r->recSize
+			&& LFS_Rec_GetU16(hdr + 6) == r->maxRecords
+			&& LFS_Rec_GetU16(hdr + 8) < r->maxRecords
+			&& LFS_Rec_GetU16(hdr + 10) <= r->maxRecords;
+		lfs_file_close(&lfs, file);
+		if (ok) {
+			r->next = LFS_Rec_GetU16(hdr + 8);
+			r->count = LFS_Rec_GetU16(hdr + 10);
+		}
+		else {
+			lfs_remove(&lfs, r->fileName);
+		}
+	}
+	os_free(file);
+	return true;
+}
+bool LFS_Ring_Append(lfsRing_t *r, const void *rec) {
+	lfs_file_t *file;
+	byte hdr[LFS_RING_HEADER];
+	unsigned short next, count;
+	int ok;
+
+	file = LFS_Rec_AllocFile();
+	if (file == 0) {
+		return false;
+	}
+	next = (r->next + 1) % r->maxRecords;
+	count = r->count < r->maxRecords ? r->count + 1 : r->count;
+	// slots past end of new file are zero filled by seek
+	ok = lfs_file_open(&lfs, file, r->fileName, LFS_O_RDWR | LFS_O_CREAT) >= 0;
+	if (ok) {
+		ok = lfs_file_seek(&lfs, file, LFS_RING_HEADER + r->next * r->recSize, LFS_SEEK_SET) >= 0
+			&& lfs_file_write(&lfs, file, rec, r->recSize) == r->recSize;
+		if (ok) {
+			r->next = next;
+			r->count = count;
+			LFS_Ring_PutHeader(r, hdr);
+			ok = lfs_file_seek(&lfs, file, 0, LFS_SEEK_SET) >= 0
+				&& lfs_file_write(&lfs, file, hdr, LFS_RING_HEADER) == LFS_RING_HEADER;
+		}
+		if (lfs_file_close(&lfs, file) < 0) {
+			ok = 0;
+		}
+	}
+	os_free(file);
+	return ok;
+}
+int LFS_Ring_Read(lfsRing_t *r, int first, void *recs, int maxCount) {
+	lfs_file_t *file;
+	byte *out = (byte*)recs;
+	int slot, n, done, len;
+
+	if (first < 0 || first >= r->count || maxCount <= 0) {
+		return 0;
+	}
+	if (maxCount > r->count - first) {
+		maxCount = r->count - first;
+	}
+	file = LFS_Rec_AllocFile();
+	if (file == 0) {
+		return -1;
+	}
+	if (lfs_file_open(&lfs, file, r->fileName, LFS_O_RDONLY) < 0) {
+		os_free(file);
+		return -1;
+	}
+	slot = (r->next + r->maxRecords - r->count + first) % r->maxRecords;
+	// at most two reads, second one after wrap
+	for (done = 0; done < maxCount; done += n) {
+		n = maxCount - done;
+		if (n > r->maxRecords - slot) {
+			n = r->maxRecords - slot;
+		}
+		len = n * r->recSize;
+		if (lfs_file_seek(&lfs, file, LFS_RING_HEADER + slot * r->recSize, LFS_SEEK_SET) < 0
+			|| lfs_file_read(&lfs, file, out + done * r->recSize, len) != len) {
+			break;
+		}
+		slot = 0;
+	}
+	lfs_file_close(&lfs, file);
+	os_free(file);
+	return done;
+}
+void LFS_Ring_Clear(lfsRing_t *r) {
+	r->next = 0;
+	r->count = 0;
+	if (lfs_present()) {
+		lfs_remove(&lfs, r->fileName);
+	}
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __LFS_RECORDS_H__
+#define __LFS_RECORDS_H__
+
+#include "../new_common.h"
+
+// Small binary stores on LittleFS for driver state and logs, so drivers
+// do not keep many text files and rewrite them on every change.
+
+// State record kept as append-only journal. Every save appends
+//   "RJ", version (u8), 0, size (u16), CRC32 (u32) of version to end of data
+// and load takes last entry with good CRC, so a cut write leaves the one
+// before. When file would grow over maxBytes, it is written again with
+// newest entry only. Entries of other version or size are skipped, load
+// returns false then and caller keeps its defaults. Load must be called
+// before first save, it finds where file can be appended.
+typedef struct lfsRecord_s {
+	const char *fileName;
+	byte version;
+	unsigned short size;
+	int maxBytes;
+	// file size after last load or save, -1 when file must be rewritten
+	int fileSize;
+} lfsRecord_t;
+
+bool LFS_Record_Load(lfsRecord_t *r, void *data);
+bool LFS_Record_Save(lfsRecord_t *r, const void *data);
+
+// Fixed size ring of records. Header
+//   "RR", version (u8), 0, record size (u16), max records (u16),
+//   next slot (u16), count (u16)
+// keeps row count, so appending writes one slot and the header and never
+// reads the file. When full, oldest record is overwritten.
+typedef struct lfsRing_s {
+	const char *fileName;
+	byte version;
+	unsigned short recSize;
+	unsigned short maxRecords;
+	unsigned short next;
+	unsigned short count;
+} lfsRing_t;
+
+// reads header, ring of other layout is started again empty
+bool LFS_Ring_Open(lfsRing_t *r);
+bool LFS_Ring_Append(lfsRing_t *r, const void *rec);
+// up to maxCount records from index first on, 0 is oldest,
+// returns count read or -1 on error
+int LFS_Ring_Read(lfsRing_t *r, int first, void *recs, int maxCount);
+void LFS_Ring_Clear(lfsRing_t *r);
+
+#endif
@@ -109,11 +109,33 @@ static int lfs_write(const struct lfs_config *c, lfs_block_t block,
 // May return LFS_ERR_CORRUPT if the block should be considered bad.
 static int lfs_erase(const struct lfs_config *c, lfs_block_t block);
 
+// counts every program call, so caches of file content can tell that
+// something was written without LittleFS having modification times
+static unsigned int g_lfsWriteGeneration;
+static int lfs_writeCounted(const struct lfs_config *c, lfs_block_t block,
+        lfs_off_t off, const void *buffer, lfs_size_t size) {
+	g_lfsWriteGeneration++;
+	return lfs_write(c, block, off, buffer, size);
+}
+unsigned int LFS_GetWriteGeneration() {
+	return g_lfsWriteGeneration;
+}
+
 // Sync the state of the underlying block device. Negative error codes
 // are propogated to the user.
 static int lfs_sync(const struct lfs_config *c);
 
 
+// used when config keeps 0, see lfs_tune
+#if ENABLE_LFS_SPI
+#define LFS_DEFAULT_CACHE_SIZE 128
+#define LFS_DEFAULT_LOOKAHEAD_SIZE 128
+#else
+#define LFS_DEFAULT_CACHE_SIZE 16
+#define LFS_DEFAULT_LOOKAHEAD_SIZE 16
+#endif
+#define LFS_DEFAULT_BLOCK_CYCLES 500
+
 uint32_t LFS_Start = LFS_BLOCKS_END - LFS_BLOCKS_DEFAULT_LEN;
 uint32_t LFS_Size = LFS_BLOCKS_DEFAULT_LEN;
 
@@ -121,7 +143,7 @@ uint32_t LFS_Size = LFS_BLOCKS_DEFAULT_LEN;
 struct lfs_config cfg = {
     // block device operations
     .read  = lfs_read,
-    .prog  = lfs_write,
+    .prog  = lfs_writeCounted,
     .erase = lfs_erase,
     .sync  = lfs_sync,
 
@@ -135,16 +157,71 @@ struct lfs_config cfg = {
     .prog_size = 1,
     .block_size = LFS_BLOCK_SIZE,
     .block_count = (LFS_BLOCKS_DEFAULT_LEN/LFS_BLOCK_SIZE),
-#if ENABLE_LFS_SPI
-	.cache_size = 128,
-	.lookahead_size = 128,
-#else
-	.cache_size = 16,
-	.lookahead_size = 16,
-#endif
-    .block_cycles = 500,
+	.cache_size = LFS_DEFAULT_CACHE_SIZE,
+	.lookahead_size = LFS_DEFAULT_LOOKAHEAD_SIZE,
+    .block_cycles = LFS_DEFAULT_BLOCK_CYCLES,
+};
+
+typedef struct lfsPreset_s {
+	const char *name;
+	short cacheSize;
+	short lookaheadSize;
+	short blockCycles;
+} lfsPreset_t;
+
+// Read/prog cache sets size of every flash access (and RAM, it is taken
+// twice plus once per open file), lookahead is one bit per block.
+static const lfsPreset_t g_lfsPresets[] = {
+	// platform default
+	{ "default", 0, 0, 0 },
+	// least RAM
+	{ "small", 16, 16, 500 },
+	// internal flash, each access is a locked driver call
+	{ "internal", 64, 16, 500 },
+	// memory mapped flash (ESP, BL602), reads are cheap
+	{ "mapped", 32, 32, 500 },
+	// external SPI NOR, one transaction per 256 byte page
+	{ "spinor", 256, 32, 500 },
+	// files appended all the time (charts), page sized writes
+	// and metadata moved half as often
+	{ "log", 256, 16, 1000 },
 };
 
+// takes tuning from config, it is used on next mount or format
+static void LFS_ApplyTuning() {
+	int cache, lookahead, cycles, maxLookahead;
+
+	CFG_GetLFS_Tuning(&cache, &lookahead, &cycles);
+	if (cache == 0) {
+		cache = LFS_DEFAULT_CACHE_SIZE;
+	}
+	if (lookahead == 0) {
+		lookahead = LFS_DEFAULT_LOOKAHEAD_SIZE;
+	}
+	if (cycles == 0) {
+		cycles = LFS_DEFAULT_BLOCK_CYCLES;
+	}
+	// sizes are powers of two, cache must divide block
+	// and lookahead must be multiple of 8
+	if (cache < 8) {
+		cache = 8;
+	}
+	if (cache > LFS_BLOCK_SIZE) {
+		cache = LFS_BLOCK_SIZE;
+	}
+	if (lookahead < 8) {
+		lookahead = 8;
+	}
+	// bits past block count are never used
+	maxLookahead = ((cfg.block_count + 63) / 64) * 8;
+	if (lookahead > maxLookahead) {
+		lookahead = maxLookahead;
+	}
+	cfg.cache_size = cache;
+	cfg.lookahead_size = lookahead;
+	cfg.block_cycles = cycles;
+}
+
 int lfs_present(){
     return lfs_initialised;
 }
@@ -317,6 +394,7 @@ static commandResult_t CMD_LFS_Format(const void *context, const char *cmd, cons
 #endif
 
     cfg.block_count = (newsize/LFS_BLOCK_SIZE);
+    LFS_ApplyTuning();
 
     int err  = lfs_format(&lfs, &cfg);
     ADDLOG_INFO(LOG_FEATURE_CMD, "LFS formatted size 0x%X (err %d)", LFS_Size, err);
@@ -424,6 +502,120 @@ static commandResult_t CMD_LFS_Remove(const void *context, const char *cmd, cons
 
 	return CMD_RES_OK;
 }
+static commandResult_t CMD_LFS_Tune(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	const char *name;
+	int i, cache, lookahead, cycles;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		name = Tokenizer_GetArg(0);
+		if (Tokenizer_IsArgInteger(0)) {
+			cache = Tokenizer_GetArgInteger(0);
+			lookahead = Tokenizer_GetArgIntegerDefault(1, 0);
+			cycles = Tokenizer_GetArgIntegerDefault(2, 0);
+		}
+		else {
+			for (i = 0; i < sizeof(g_lfsPresets) / sizeof(g_lfsPresets[0]); i++) {
+				if (!stricmp(g_lfsPresets[i].name, name)) {
+					break;
+				}
+			}
+			if (i == sizeof(g_lfsPresets) / sizeof(g_lfsPresets[0])) {
+				ADDLOG_ERROR(LOG_FEATURE_CMD, "lfs_tune: unknown preset %s", name);
+				return CMD_RES_BAD_ARGUMENT;
+			}
+			cache = g_lfsPresets[i].cacheSize;
+			lookahead = g_lfsPresets[i].lookaheadSize;
+			cycles = g_lfsPresets[i].blockCycles;
+		}
+		CFG_SetLFS_Tuning(cache, lookahead, cycles);
+	}
+	CFG_GetLFS_Tuning(&cache, &lookahead, &cycles);
+	ADDLOG_INFO(LOG_FEATURE_CMD, "LFS configured cache %i lookahead %i cycles %i (0 is default), in use cache %i lookahead %i cycles %i",
+		cache, lookahead, cycles, (int)cfg.cache_size, (int)cfg.lookahead_size, (int)cfg.block_cycles);
+	return CMD_RES_OK;
+}
+static int LFS_BenchMs() {
+	return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+static int LFS_BenchKBs(int bytes, int ms) {
+	if (ms <= 0) {
+		ms = 1;
+	}
+	return bytes / ms * 1000 / 1024;
+}
+static commandResult_t CMD_LFS_Bench(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	static const char *fname = "lfs_bench.tmp";
+	byte buf[256];
+	lfs_file_t f;
+	int total, appends, i, len, res;
+	int mountMs, writeMs, readMs, appendMs, start;
+
+	Tokenizer_TokenizeString(args, 0);
+	total = Tokenizer_GetArgIntegerDefault(0, 16) * 1024;
+	appends = Tokenizer_GetArgIntegerDefault(1, 60);
+	if (total <= 0 || appends <= 0) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	// remount first, it also takes new lfs_tune values
+	start = LFS_BenchMs();
+	release_lfs();
+	init_lfs(0);
+	mountMs = LFS_BenchMs() - start;
+	if (!lfs_initialised) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "lfs_bench: LFS not mounted");
+		return CMD_RES_ERROR;
+	}
+	for (i = 0; i < sizeof(buf); i++) {
+		buf[i] = 'a' + i % 26;
+	}
+
+	start = LFS_BenchMs();
+	res = lfs_file_open(&lfs, &f, fname, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+	if (res >= 0) {
+		for (i = 0; res >= 0 && i < total; i += len) {
+			len = total - i;
+			if (len > sizeof(buf)) {
+				len = sizeof(buf);
+			}
+			res = lfs_file_write(&lfs, &f, buf, len);
+		}
+		lfs_file_close(&lfs, &f);
+	}
+	writeMs = LFS_BenchMs() - start;
+	if (res < 0) {
+		ADDLOG_ERROR(LOG_FEATURE_CMD, "lfs_bench: write failed %i", res);
+		lfs_remove(&lfs, fname);
+		return CMD_RES_ERROR;
+	}
+
+	start = LFS_BenchMs();
+	lfs_file_open(&lfs, &f, fname, LFS_O_RDONLY);
+	while (lfs_file_read(&lfs, &f, buf, sizeof(buf)) > 0) {
+	}
+	lfs_file_close(&lfs, &f);
+	readMs = LFS_BenchMs() - start;
+	lfs_remove(&lfs, fname);
+
+	// like chart logging: open, add short line, close
+	memcpy(buf, "1700000000,23.5,45.1,1013.2\n", 28);
+	start = LFS_BenchMs();
+	for (i = 0; i < appends; i++) {
+		if (lfs_file_open(&lfs, &f, fname, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND) < 0) {
+			break;
+		}
+		lfs_file_write(&lfs, &f, buf, 28);
+		lfs_file_close(&lfs, &f);
+	}
+	appendMs = LFS_BenchMs() - start;
+	lfs_remove(&lfs, fname);
+
+	ADDLOG_INFO(LOG_FEATURE_CMD, "lfs_bench cache %i lookahead %i cycles %i: mount %i ms, write %i KB/s, read %i KB/s, %i appends %i ms (%i us each)",
+		(int)cfg.cache_size, (int)cfg.lookahead_size, (int)cfg.block_cycles,
+		mountMs, LFS_BenchKBs(total, writeMs), LFS_BenchKBs(total, readMs),
+		i, appendMs, i ? appendMs * 1000 / i : 0);
+	return CMD_RES_OK;
+}
 void LFSAddCmds(){
 	//cmddetail:{"name":"lfs_size","args":"[MaxSize]",
 	//cmddetail:"descr":"Log or Set LFS size - will apply and re-format next boot, usage setlfssize 0x10000",
@@ -486,6 +678,16 @@ void LFSAddCmds(){
 	//cmddetail:"fn":"CMD_LFS_MakeDirectory","file":"littlefs/our_lfs.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("lfs_mkdir", CMD_LFS_MakeDirectory, NULL);
+	//cmddetail:{"name":"lfs_tune","args":"[Preset or CacheSize] [LookaheadSize] [BlockCycles]",
+	//cmddetail:"descr":"Sets LFS cache, lookahead and block_cycles, used from next mount. Presets: default, small, internal, mapped, spinor, log. 0 is platform default, BlockCycles -1 disables wear leveling. No arguments prints current values",
+	//cmddetail:"fn":"CMD_LFS_Tune","file":"littlefs/our_lfs.c","requires":"",
+	//cmddetail:"examples":"lfs_tune log"}
+	CMD_RegisterCommand("lfs_tune", CMD_LFS_Tune, NULL);
+	//cmddetail:{"name":"lfs_bench","args":"[SizeKB] [Appends]",
+	//cmddetail:"descr":"Remounts LFS and measures mount time, file write and read speed and time of short appends (like chart logging). Uses a temporary file",
+	//cmddetail:"fn":"CMD_LFS_Bench","file":"littlefs/our_lfs.c","requires":"",
+	//cmddetail:"examples":"lfs_bench 32 100"}
+	CMD_RegisterCommand("lfs_bench", CMD_LFS_Bench, NULL);
 }
 
 
@@ -601,6 +803,7 @@ void init_lfs(int create){
         LFS_Start = newstart;
         LFS_Size = newsize;
         cfg.block_count = (newsize/LFS_BLOCK_SIZE);
+        LFS_ApplyTuning();
 
         int err = lfs_mount(&lfs, &cfg);
 
@@ -660,6 +863,7 @@ void LFS_SPI_Flash_Write(int adr, const byte *data, int cnt);
 void LFS_SPI_Flash_Read(int adr, int cnt, byte *data);
 
 void LFS_SPI_Flash_EraseSector(int addr);
+void LFS_SPI_Flash_Sync();
 
 // Read a region in a block. Negative error codes are propogated
 // to the user.
@@ -1191,7 +1395,10 @@ static int lfs_erase(const struct lfs_config* c, lfs_block_t block)
 // Sync the state of the underlying block device. Negative error codes
 // are propogated to the user.
 static int lfs_sync(const struct lfs_config *c){
-    // nothing to do
+#if ENABLE_LFS_SPI
+	// page programs may still be queued in SPI flash driver
+	LFS_SPI_Flash_Sync();
+#endif
     return 0;
 }
 
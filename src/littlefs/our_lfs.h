@@ -200,5 +200,7 @@ void LFSAddCmds();
 void init_lfs(int create);
 void release_lfs();
 int lfs_present();
+// changes on every write to flash, including format
+unsigned int LFS_GetWriteGeneration();
 #endif
 #endif
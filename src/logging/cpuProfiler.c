@@ -0,0 +1,303 @@
+#include "../new_common.h"
+#include "../cmnds/cmd_public.h"
+#include "logging.h"
+#include "cpuProfiler.h"
+
+#if ENABLE_CPU_PROFILER
+
+#if PLATFORM_BEKEN
+#include "include.h"
+#include "arm_arch.h"
+#include "bk_timer_pub.h"
+#include "drv_model_pub.h"
+#elif PLATFORM_BL602
+#include <hal_hwtimer.h>
+#endif
+
+// Table is hashed by address and task. Timer interrupt is its only writer:
+// it looks at few slots from hash and counts sample as dropped when all
+// of them are taken by others, so there is no lock and no allocation.
+// Readers stop timer first or accept counts being one behind.
+//
+// Interrupted address is known on RISC-V (BL602), where mepc holds it
+// while timer callback runs. Beken SDK IRQ handler does not pass it to
+// timer callback, so there samples are counted per task only.
+// Beken uses BKTIMER2, IR2 driver has BKTIMER0.
+
+#define PROFILER_PROBES			8
+#define PROFILER_TASK_NAME		16
+#define PROFILER_DEFAULT_HZ		1000
+
+static profilerEntry_t g_profEntries[PROFILER_MAX_ENTRIES];
+static const char *g_profTaskKeys[PROFILER_MAX_TASKS];
+static char g_profTaskNames[PROFILER_MAX_TASKS][PROFILER_TASK_NAME];
+static unsigned int g_profTaskSamples[PROFILER_MAX_TASKS];
+static int g_profNumTasks = 0;
+static int g_profLastTask = 0;
+static unsigned int g_profSamples = 0;
+static unsigned int g_profDropped = 0;
+static int g_profHz = 0;
+static int g_profRunning = 0;
+
+#if PLATFORM_BEKEN
+static uint32_t g_profChan = BKTIMER2;
+#elif PLATFORM_BL602
+static hw_timer_t *g_profTimer = 0;
+#endif
+
+static int Profiler_FindTask(const char *taskName) {
+	int i;
+
+	if (g_profLastTask < g_profNumTasks && g_profTaskKeys[g_profLastTask] == taskName) {
+		return g_profLastTask;
+	}
+	for (i = 0; i < g_profNumTasks; i++) {
+		if (g_profTaskKeys[i] == taskName) {
+			g_profLastTask = i;
+			return i;
+		}
+	}
+	if (g_profNumTasks >= PROFILER_MAX_TASKS) {
+		return -1;
+	}
+	i = g_profNumTasks;
+	g_profTaskKeys[i] = taskName;
+	strncpy(g_profTaskNames[i], taskName ? taskName : "?", PROFILER_TASK_NAME - 1);
+	g_profTaskNames[i][PROFILER_TASK_NAME - 1] = 0;
+	g_profTaskSamples[i] = 0;
+	g_profNumTasks++;
+	g_profLastTask = i;
+	return i;
+}
+void Profiler_Sample(unsigned int pc, const char *taskName) {
+	profilerEntry_t *e;
+	unsigned int h;
+	int task, i;
+
+	g_profSamples++;
+	task = Profiler_FindTask(taskName);
+	if (task < 0) {
+		g_profDropped++;
+		return;
+	}
+	g_profTaskSamples[task]++;
+	// instructions are at least 2 bytes apart
+	h = ((pc >> 1) ^ (task * 0x9E37)) * 2654435761u;
+	h >>= 16;
+	for (i = 0; i < PROFILER_PROBES; i++) {
+		e = &g_profEntries[(h + i) & (PROFILER_MAX_ENTRIES - 1)];
+		if (e->count == 0) {
+			e->pc = pc;
+			e->task = task;
+			e->count = 1;
+			return;
+		}
+		if (e->pc == pc && e->task == task) {
+			e->count++;
+			return;
+		}
+	}
+	g_profDropped++;
+}
+
+#if PLATFORM_BEKEN
+static void Profiler_ISR(UINT8 t) {
+	Profiler_Sample(0, pcTaskGetName(NULL));
+}
+#elif PLATFORM_BL602
+static void Profiler_ISR(void) {
+	unsigned int pc;
+
+	__asm__ volatile ("csrr %0, mepc" : "=r"(pc));
+	Profiler_Sample(pc, pcTaskGetName(NULL));
+}
+#endif
+
+void Profiler_Reset() {
+	memset(g_profEntries, 0, sizeof(g_profEntries));
+	g_profNumTasks = 0;
+	g_profLastTask = 0;
+	g_profSamples = 0;
+	g_profDropped = 0;
+}
+bool Profiler_Start(int hz) {
+	Profiler_Stop();
+	Profiler_Reset();
+#if PLATFORM_BEKEN
+	timer_param_t params = {
+		(unsigned char)g_profChan,
+		1, // div
+		1000000 / hz, // us
+		Profiler_ISR
+	};
+	if (sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_INIT_PARAM_US, &params) != 0) {
+		return false;
+	}
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_ENABLE, &g_profChan);
+#elif PLATFORM_BL602
+	// timer counts whole milliseconds
+	if (hz > 1000) {
+		hz = 1000;
+	}
+	hal_hwtimer_init();
+	g_profTimer = hal_hwtimer_create(1000 / hz, Profiler_ISR, 1);
+	if (g_profTimer == 0) {
+		return false;
+	}
+	hz = 1000 / (1000 / hz);
+#else
+	// no sampling timer here, Profiler_Sample may still be fed by hand
+	return false;
+#endif
+	g_profHz = hz;
+	g_profRunning = 1;
+	return true;
+}
+void Profiler_Stop() {
+	if (g_profRunning == 0) {
+		return;
+	}
+#if PLATFORM_BEKEN
+	sddev_control((char *)TIMER_DEV_NAME, CMD_TIMER_UNIT_DISABLE, &g_profChan);
+#elif PLATFORM_BL602
+	hal_hwtimer_delete(g_profTimer);
+	g_profTimer = 0;
+#endif
+	g_profRunning = 0;
+}
+void Profiler_GetStats(profilerStats_t *st) {
+	int i;
+
+	st->samples = g_profSamples;
+	st->dropped = g_profDropped;
+	st->hz = g_profHz;
+	st->bRunning = g_profRunning;
+	st->numTasks = g_profNumTasks;
+	st->numEntries = 0;
+	for (i = 0; i < PROFILER_MAX_ENTRIES; i++) {
+		if (g_profEntries[i].count) {
+			st->numEntries++;
+		}
+	}
+}
+const char *Profiler_GetTaskName(int task) {
+	if (task < 0 || task >= g_profNumTasks) {
+		return "?";
+	}
+	return g_profTaskNames[task];
+}
+unsigned int Profiler_GetTaskSamples(int task) {
+	if (task < 0 || task >= g_profNumTasks) {
+		return 0;
+	}
+	return g_profTaskSamples[task];
+}
+int Profiler_GetEntries(int first, profilerEntry_t *out, int maxCount) {
+	int i, count = 0;
+
+	for (i = 0; i < PROFILER_MAX_ENTRIES && count < maxCount; i++) {
+		if (g_profEntries[i].count == 0) {
+			continue;
+		}
+		if (first > 0) {
+			first--;
+			continue;
+		}
+		out[count++] = g_profEntries[i];
+	}
+	return count;
+}
+// few are asked for, so each is found by scan of table
+int Profiler_GetTop(profilerEntry_t *out, int maxCount) {
+	unsigned int limit = 0xFFFFFFFF;
+	int i, count, best, last = -1;
+
+	for (count = 0; count < maxCount; count++) {
+		best = -1;
+		for (i = 0; i < PROFILER_MAX_ENTRIES; i++) {
+			const profilerEntry_t *e = &g_profEntries[i];
+			// equal counts go in table order, after those already taken
+			if (e->count == 0 || e->count > limit || (e->count == limit && i <= last)) {
+				continue;
+			}
+			if (best < 0 || e->count > g_profEntries[best].count) {
+				best = i;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+		out[count] = g_profEntries[best];
+		limit = g_profEntries[best].count;
+		last = best;
+	}
+	return count;
+}
+
+// profile_start [Hz]
+static commandResult_t CMD_Profile_Start(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int hz;
+
+	Tokenizer_TokenizeString(args, 0);
+	hz = Tokenizer_GetArgIntegerDefault(0, PROFILER_DEFAULT_HZ);
+	if (hz < 10 || hz > 10000) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	if (!Profiler_Start(hz)) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_CMD, "profile: sampling timer not started");
+		return CMD_RES_ERROR;
+	}
+	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "profile: sampling at %i Hz", g_profHz);
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_Profile_Stop(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	Profiler_Stop();
+	return CMD_RES_OK;
+}
+// profile_print [Count]
+static commandResult_t CMD_Profile_Print(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	profilerEntry_t top[16];
+	profilerStats_t st;
+	int i, count, max;
+
+	Tokenizer_TokenizeString(args, 0);
+	max = Tokenizer_GetArgIntegerDefault(0, 10);
+	if (max > 16) {
+		max = 16;
+	}
+	Profiler_GetStats(&st);
+	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "profile: %u samples at %i Hz, %u dropped, %i addresses, %s",
+		st.samples, st.hz, st.dropped, st.numEntries, st.bRunning ? "running" : "stopped");
+	if (st.samples == 0) {
+		return CMD_RES_OK;
+	}
+	for (i = 0; i < st.numTasks; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "task %s: %u samples, %u%%", Profiler_GetTaskName(i),
+			Profiler_GetTaskSamples(i), Profiler_GetTaskSamples(i) * 100 / st.samples);
+	}
+	count = Profiler_GetTop(top, max);
+	for (i = 0; i < count; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "0x%08x %s: %u samples", top[i].pc,
+			Profiler_GetTaskName(top[i].task), top[i].count);
+	}
+	return CMD_RES_OK;
+}
+void Profiler_AddCmds() {
+	//cmddetail:{"name":"profile_start","args":"[Hz]",
+	//cmddetail:"descr":"Clears profile and starts hardware timer sampling interrupted address and running task [default 1000 Hz]. Address is known on BL602, Beken counts tasks only. See profile_print and /api/profile, scripts/profile_report.py names addresses from ELF",
+	//cmddetail:"fn":"CMD_Profile_Start","file":"logging/cpuProfiler.c","requires":"ENABLE_CPU_PROFILER",
+	//cmddetail:"examples":"profile_start 500"}
+	CMD_RegisterCommand("profile_start", CMD_Profile_Start, NULL);
+	//cmddetail:{"name":"profile_stop","args":"",
+	//cmddetail:"descr":"Stops sampling started by profile_start, collected profile is kept",
+	//cmddetail:"fn":"CMD_Profile_Stop","file":"logging/cpuProfiler.c","requires":"ENABLE_CPU_PROFILER",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("profile_stop", CMD_Profile_Stop, NULL);
+	//cmddetail:{"name":"profile_print","args":"[Count]",
+	//cmddetail:"descr":"Logs sample counts, share of each task and Count [default 10] most sampled addresses",
+	//cmddetail:"fn":"CMD_Profile_Print","file":"logging/cpuProfiler.c","requires":"ENABLE_CPU_PROFILER",
+	//cmddetail:"examples":"profile_print 5"}
+	CMD_RegisterCommand("profile_print", CMD_Profile_Print, NULL);
+}
+
+#endif
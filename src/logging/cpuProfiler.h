@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////
+// intent: To see where processor time goes on device under real load,
+// a hardware timer interrupts it about 1000 times a second and counts
+// interrupted address and running task in RAM table.
+//
+// "profile_start [Hz]" clears table and starts timer, "profile_stop"
+// stops it, "profile_print [Count]" logs tasks and hottest addresses.
+// /api/profile returns whole table, scripts/profile_report.py names
+// addresses from firmware ELF.
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef _OBK_CPUPROFILER_H
+#define _OBK_CPUPROFILER_H
+
+#include "../obk_config.h"
+
+#if ENABLE_CPU_PROFILER
+
+#ifndef PROFILER_MAX_ENTRIES
+// power of two, 12 bytes each
+#define PROFILER_MAX_ENTRIES		512
+#endif
+#define PROFILER_MAX_TASKS			16
+
+typedef struct profilerEntry_s {
+	// 0 where platform can't tell interrupted address
+	unsigned int pc;
+	unsigned short task;
+	unsigned short pad;
+	// 0 marks free slot
+	unsigned int count;
+} profilerEntry_t;
+
+typedef struct profilerStats_s {
+	unsigned int samples;
+	// table had no free slot near address
+	unsigned int dropped;
+	int hz;
+	int bRunning;
+	int numTasks;
+	int numEntries;
+} profilerStats_t;
+
+// from timer interrupt; taskName is pointer kept by RTOS for running
+// task, it tells tasks apart and is copied only when first seen
+void Profiler_Sample(unsigned int pc, const char *taskName);
+bool Profiler_Start(int hz);
+void Profiler_Stop();
+void Profiler_Reset();
+void Profiler_GetStats(profilerStats_t *st);
+const char *Profiler_GetTaskName(int task);
+unsigned int Profiler_GetTaskSamples(int task);
+// copies used slots in table order, skipping first ones, returns count
+int Profiler_GetEntries(int first, profilerEntry_t *out, int maxCount);
+// copies up to maxCount busiest entries, busiest first
+int Profiler_GetTop(profilerEntry_t *out, int maxCount);
+void Profiler_AddCmds();
+
+#endif
+
+#endif
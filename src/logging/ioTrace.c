@@ -0,0 +1,526 @@
+#include "../new_common.h"
+#include "../new_pins.h"
+#include "../cmnds/cmd_public.h"
+#include "../quicktick.h"
+#include "logging.h"
+#include "ioTrace.h"
+
+#if ENABLE_IO_TRACE
+
+#include "../littlefs/our_lfs.h"
+#include "../driver/drv_uart.h"
+#include "../mqtt/new_mqtt.h"
+#include "../httpserver/new_http.h"
+#include "../driver/drv_ntp.h"
+
+// Records go to RAM under mutex, since MQTT and HTTP come from their own
+// threads, and main loop writes them to file. UART is taken when bytes
+// are consumed, not in receive ISR. Sent UART bytes come one at a time,
+// so they are kept until something else comes or time moves on.
+
+#if WINDOWS
+#define IOTRACE_BUFFER_SIZE		16384
+#else
+#define IOTRACE_BUFFER_SIZE		4096
+#endif
+#define IOTRACE_TX_PENDING		64
+// record header: type and two LEB128 numbers
+#define IOTRACE_HEADER_MAX		11
+#define IOTRACE_DEFAULT_FILE	"iotrace.bin"
+
+unsigned char g_ioTraceMode = IOTRACE_OFF;
+
+static byte *g_traceBuf = 0;
+static int g_traceLen = 0;
+static unsigned int g_traceLastTime;
+static unsigned int g_traceFlushTime;
+static unsigned int g_traceLost = 0;
+static unsigned int g_traceWritten = 0;
+static byte g_traceTx[IOTRACE_TX_PENDING];
+static int g_traceTxLen = 0;
+static int g_traceTxPort;
+static unsigned int g_traceTxTime;
+// last recorded level of pins, 0xFF before first one
+static byte g_traceGpio[PLATFORM_GPIO_MAX];
+static lfs_file_t *g_traceFile = 0;
+static SemaphoreHandle_t g_traceMutex = 0;
+
+static bool IOTrace_Lock() {
+	if (g_traceMutex == 0) {
+		g_traceMutex = xSemaphoreCreateMutex();
+	}
+	return xSemaphoreTake(g_traceMutex, 100) == pdTRUE;
+}
+static void IOTrace_Unlock() {
+	xSemaphoreGive(g_traceMutex);
+}
+static int IOTrace_PutNumber(byte *out, unsigned int v) {
+	int n = 0;
+
+	while (v >= 0x80) {
+		out[n++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	out[n++] = v;
+	return n;
+}
+// caller holds lock, payload is up to three parts
+static void IOTrace_PutRecordAt(int type, unsigned int time, const byte *a, int aLen,
+	const byte *b, int bLen, const byte *c, int cLen) {
+	byte hdr[IOTRACE_HEADER_MAX];
+	int n;
+
+	hdr[0] = type;
+	n = 1 + IOTrace_PutNumber(hdr + 1, time - g_traceLastTime);
+	n += IOTrace_PutNumber(hdr + n, aLen + bLen + cLen);
+	if (g_traceLen + n + aLen + bLen + cLen > IOTRACE_BUFFER_SIZE) {
+		g_traceLost++;
+		return;
+	}
+	memcpy(g_traceBuf + g_traceLen, hdr, n);
+	g_traceLen += n;
+	memcpy(g_traceBuf + g_traceLen, a, aLen);
+	g_traceLen += aLen;
+	if (bLen) {
+		memcpy(g_traceBuf + g_traceLen, b, bLen);
+		g_traceLen += bLen;
+	}
+	if (cLen) {
+		memcpy(g_traceBuf + g_traceLen, c, cLen);
+		g_traceLen += cLen;
+	}
+	g_traceLastTime = time;
+}
+static void IOTrace_FlushTx() {
+	byte port;
+
+	if (g_traceTxLen == 0) {
+		return;
+	}
+	port = g_traceTxPort;
+	IOTrace_PutRecordAt(IOTRACE_UART_TX, g_traceTxTime, &port, 1, g_traceTx, g_traceTxLen, 0, 0);
+	g_traceTxLen = 0;
+}
+static void IOTrace_PutRecord(int type, const byte *a, int aLen, const byte *b, int bLen,
+	const byte *c, int cLen) {
+	if (!IOTrace_Lock()) {
+		g_traceLost++;
+		return;
+	}
+	// recording may have stopped while we waited
+	if (g_ioTraceMode == IOTRACE_RECORD) {
+		IOTrace_FlushTx();
+		IOTrace_PutRecordAt(type, g_timeMs, a, aLen, b, bLen, c, cLen);
+	}
+	IOTrace_Unlock();
+}
+
+#if WINDOWS
+// replay hashes outputs instead of recording them
+static unsigned int g_replayUartHash;
+static unsigned int g_replayMqttHash;
+static int g_replayOutputs;
+
+static unsigned int IOTrace_Hash(unsigned int h, const byte *p, int len) {
+	while (len-- > 0) {
+		h = (h ^ *p++) * 16777619u;
+	}
+	return h;
+}
+#endif
+
+void IOTrace_UartRx(int port, const unsigned char *data, int len) {
+	byte p = port;
+
+	if (g_ioTraceMode != IOTRACE_RECORD || len <= 0) {
+		return;
+	}
+	IOTrace_PutRecord(IOTRACE_UART_RX, &p, 1, data, len, 0, 0);
+}
+void IOTrace_UartTx(int port, unsigned char b) {
+#if WINDOWS
+	if (g_ioTraceMode == IOTRACE_REPLAY) {
+		g_replayUartHash = IOTrace_Hash(g_replayUartHash, &b, 1);
+		g_replayOutputs++;
+		return;
+	}
+#endif
+	if (g_ioTraceMode != IOTRACE_RECORD || !IOTrace_Lock()) {
+		return;
+	}
+	if (g_ioTraceMode == IOTRACE_RECORD) {
+		if (g_traceTxLen && (g_traceTxPort != port || g_traceTxTime != g_timeMs
+			|| g_traceTxLen == IOTRACE_TX_PENDING)) {
+			IOTrace_FlushTx();
+		}
+		if (g_traceTxLen == 0) {
+			g_traceTxPort = port;
+			g_traceTxTime = g_timeMs;
+		}
+		g_traceTx[g_traceTxLen++] = b;
+	}
+	IOTrace_Unlock();
+}
+void IOTrace_MqttRx(const char *topic, int topicLen, const unsigned char *data, int len) {
+	byte hdr[5];
+
+	if (g_ioTraceMode != IOTRACE_RECORD) {
+		return;
+	}
+	IOTrace_PutRecord(IOTRACE_MQTT_RX, hdr, IOTrace_PutNumber(hdr, topicLen),
+		(const byte*)topic, topicLen, data, len);
+}
+void IOTrace_MqttTx(const char *topic, const char *data, int len) {
+	byte hdr[5];
+	int topicLen = strlen(topic);
+
+#if WINDOWS
+	if (g_ioTraceMode == IOTRACE_REPLAY) {
+		g_replayMqttHash = IOTrace_Hash(g_replayMqttHash, (const byte*)topic, topicLen + 1);
+		g_replayMqttHash = IOTrace_Hash(g_replayMqttHash, (const byte*)data, len);
+		g_replayOutputs++;
+		return;
+	}
+#endif
+	if (g_ioTraceMode != IOTRACE_RECORD) {
+		return;
+	}
+	IOTrace_PutRecord(IOTRACE_MQTT_TX, hdr, IOTrace_PutNumber(hdr, topicLen),
+		(const byte*)topic, topicLen, (const byte*)data, len);
+}
+void IOTrace_HttpRx(const char *data, int len) {
+	if (g_ioTraceMode != IOTRACE_RECORD || len <= 0) {
+		return;
+	}
+	IOTrace_PutRecord(IOTRACE_HTTP_RX, (const byte*)data, len, 0, 0, 0, 0);
+}
+void IOTrace_Gpio(int pin, int level) {
+	byte rec[2];
+
+	if (g_ioTraceMode != IOTRACE_RECORD || pin < 0 || pin >= PLATFORM_GPIO_MAX) {
+		return;
+	}
+	if (g_traceGpio[pin] == level) {
+		return;
+	}
+	g_traceGpio[pin] = level;
+	rec[0] = pin;
+	rec[1] = level;
+	IOTrace_PutRecord(IOTRACE_GPIO, rec, 2, 0, 0, 0, 0);
+}
+void IOTrace_Ntp(unsigned int utc) {
+	byte rec[4];
+
+	if (g_ioTraceMode != IOTRACE_RECORD) {
+		return;
+	}
+	rec[0] = utc;
+	rec[1] = utc >> 8;
+	rec[2] = utc >> 16;
+	rec[3] = utc >> 24;
+	IOTrace_PutRecord(IOTRACE_NTP, rec, 4, 0, 0, 0, 0);
+}
+// main loop only, file system is not shared with other threads
+static void IOTrace_Flush() {
+	int written;
+
+	if (!IOTrace_Lock()) {
+		return;
+	}
+	IOTrace_FlushTx();
+	if (g_traceLen > 0 && g_traceFile) {
+		written = lfs_file_write(&lfs, g_traceFile, g_traceBuf, g_traceLen);
+		lfs_file_sync(&lfs, g_traceFile);
+		if (written != g_traceLen) {
+			// file system is full, rest of trace would have a gap
+			addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "iotrace: write failed, recording stopped");
+			g_ioTraceMode = IOTRACE_OFF;
+		}
+		else {
+			g_traceWritten += written;
+		}
+	}
+	g_traceLen = 0;
+	g_traceFlushTime = g_timeMs;
+	IOTrace_Unlock();
+}
+void IOTrace_RunQuickTick() {
+	if (g_ioTraceMode != IOTRACE_RECORD) {
+		return;
+	}
+	// half full buffer or a second old data
+	if (g_traceLen + g_traceTxLen > IOTRACE_BUFFER_SIZE / 2
+		|| (g_traceLen + g_traceTxLen > 0 && g_timeMs - g_traceFlushTime >= 1000)) {
+		IOTrace_Flush();
+	}
+}
+static void IOTrace_Close() {
+	if (g_traceFile) {
+		lfs_file_close(&lfs, g_traceFile);
+		os_free(g_traceFile);
+		g_traceFile = 0;
+	}
+	if (g_traceBuf) {
+		os_free(g_traceBuf);
+		g_traceBuf = 0;
+	}
+}
+static void IOTrace_Stop() {
+	if (g_ioTraceMode != IOTRACE_RECORD && g_traceFile == 0) {
+		return;
+	}
+	IOTrace_Flush();
+	g_ioTraceMode = IOTRACE_OFF;
+	// no recorder is inside lock after this
+	if (IOTrace_Lock()) {
+		IOTrace_Unlock();
+	}
+	IOTrace_Close();
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "iotrace: stopped, %u bytes, %u records lost",
+		g_traceWritten, g_traceLost);
+}
+// iotrace_start [FileName]
+static commandResult_t CMD_IOTrace_Start(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	const char *fname = IOTRACE_DEFAULT_FILE;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		fname = Tokenizer_GetArg(0);
+	}
+	IOTrace_Stop();
+	if (!lfs_present()) {
+		init_lfs(1);
+	}
+	if (!lfs_present()) {
+		return CMD_RES_ERROR;
+	}
+	g_traceBuf = (byte*)os_malloc(IOTRACE_BUFFER_SIZE);
+	g_traceFile = (lfs_file_t*)os_malloc(sizeof(lfs_file_t));
+	if (g_traceBuf == 0 || g_traceFile == 0) {
+		IOTrace_Close();
+		return CMD_RES_ERROR;
+	}
+	memset(g_traceFile, 0, sizeof(lfs_file_t));
+	if (lfs_file_open(&lfs, g_traceFile, fname, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC) < 0) {
+		os_free(g_traceFile);
+		g_traceFile = 0;
+		IOTrace_Close();
+		return CMD_RES_ERROR;
+	}
+	memcpy(g_traceBuf, IOTRACE_MAGIC, 4);
+	g_traceBuf[4] = IOTRACE_VERSION;
+	g_traceLen = 5;
+	g_traceTxLen = 0;
+	g_traceLost = 0;
+	g_traceWritten = 0;
+	g_traceLastTime = g_traceFlushTime = g_timeMs;
+	memset(g_traceGpio, 0xFF, sizeof(g_traceGpio));
+	g_ioTraceMode = IOTRACE_RECORD;
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "iotrace: recording to %s", fname);
+	return CMD_RES_OK;
+}
+static commandResult_t CMD_IOTrace_Stop(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	IOTrace_Stop();
+	return CMD_RES_OK;
+}
+void IOTrace_AddCmds() {
+	// file of previous init went away with its file system
+	g_ioTraceMode = IOTRACE_OFF;
+	if (g_traceFile) {
+		os_free(g_traceFile);
+		g_traceFile = 0;
+	}
+	IOTrace_Close();
+	//cmddetail:{"name":"iotrace_start","args":"[FileName]",
+	//cmddetail:"descr":"Records received UART bytes, MQTT messages, HTTP requests, input pin levels and NTP time, and sent UART bytes and MQTT messages, with their times, to LFS file [default iotrace.bin]. Simulator replays it with -replay to time new firmware on field traffic",
+	//cmddetail:"fn":"CMD_IOTrace_Start","file":"logging/ioTrace.c","requires":"ENABLE_IO_TRACE",
+	//cmddetail:"examples":"iotrace_start tuya.bin"}
+	CMD_RegisterCommand("iotrace_start", CMD_IOTrace_Start, NULL);
+	//cmddetail:{"name":"iotrace_stop","args":"",
+	//cmddetail:"descr":"Ends recording started by iotrace_start and tells how many records did not fit",
+	//cmddetail:"fn":"CMD_IOTrace_Stop","file":"logging/ioTrace.c","requires":"ENABLE_IO_TRACE",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("iotrace_stop", CMD_IOTrace_Stop, NULL);
+}
+
+#if WINDOWS
+#include <time.h>
+#include "../sim/sim_import.h"
+
+void Sim_RunFrame(int frameTime);
+
+#define IOTRACE_REPLAY_FRAME	10
+
+static int IOTrace_GetNumber(const byte *p, int len, int *at, unsigned int *out) {
+	unsigned int v = 0;
+	int shift = 0;
+
+	while (*at < len && shift < 32) {
+		byte b = p[(*at)++];
+		v |= (unsigned int)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0) {
+			*out = v;
+			return 1;
+		}
+		shift += 7;
+	}
+	return 0;
+}
+
+static void IOTrace_ReplayHTTP(const byte *p, int len) {
+	static char out[32768];
+	http_request_t request;
+	char *in;
+
+	// request is parsed in place
+	in = (char*)malloc(len + 1);
+	if (in == 0) {
+		return;
+	}
+	memcpy(in, p, len);
+	in[len] = 0;
+	memset(&request, 0, sizeof(request));
+	request.received = in;
+	request.receivedLen = len;
+	request.reply = out;
+	request.replymaxlen = sizeof(out);
+	HTTP_ProcessPacket(&request);
+	free(in);
+}
+static void IOTrace_ReplayInput(int type, const byte *p, int len) {
+	unsigned int topicLen;
+	int at = 0;
+	int i;
+
+	switch (type) {
+	case IOTRACE_UART_RX:
+		for (i = 1; i < len; i++) {
+			UART_AppendByteToReceiveRingBufferEx(p[0], p[i]);
+		}
+		break;
+	case IOTRACE_MQTT_RX:
+		if (IOTrace_GetNumber(p, len, &at, &topicLen) && at + (int)topicLen <= len) {
+			char *topic = (char*)malloc(topicLen + 1);
+			if (topic) {
+				memcpy(topic, p + at, topicLen);
+				topic[topicLen] = 0;
+				MQTT_Post_Received(topic, topicLen, p + at + topicLen, len - at - topicLen);
+				free(topic);
+			}
+		}
+		break;
+	case IOTRACE_HTTP_RX:
+		IOTrace_ReplayHTTP(p, len);
+		break;
+	case IOTRACE_GPIO:
+		if (len >= 2) {
+			SIM_SetSimulatedPinValue(p[0], p[1]);
+		}
+		break;
+	case IOTRACE_NTP:
+		if (len >= 4) {
+			NTP_SetSimulatedTime(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24));
+		}
+		break;
+	}
+}
+static void IOTrace_ExpectOutput(ioTraceReplay_t *res, int type, const byte *p, int len) {
+	unsigned int topicLen;
+	int at = 0;
+
+	if (type == IOTRACE_UART_TX && len >= 1) {
+		res->expectedUartHash = IOTrace_Hash(res->expectedUartHash, p + 1, len - 1);
+		res->expectedOutputs += len - 1;
+	}
+	else if (type == IOTRACE_MQTT_TX && IOTrace_GetNumber(p, len, &at, &topicLen) && at + (int)topicLen <= len) {
+		static const byte zero = 0;
+		res->expectedMqttHash = IOTrace_Hash(res->expectedMqttHash, p + at, topicLen);
+		res->expectedMqttHash = IOTrace_Hash(res->expectedMqttHash, &zero, 1);
+		res->expectedMqttHash = IOTrace_Hash(res->expectedMqttHash, p + at + topicLen, len - at - topicLen);
+		res->expectedOutputs++;
+	}
+}
+bool IOTrace_Replay(const unsigned char *data, int len, ioTraceReplay_t *res) {
+	unsigned int delta, size, due, now;
+	clock_t start;
+	int at, type;
+
+	memset(res, 0, sizeof(*res));
+	res->expectedUartHash = res->expectedMqttHash = 2166136261u;
+	g_replayUartHash = g_replayMqttHash = 2166136261u;
+	g_replayOutputs = 0;
+	if (len < 5 || memcmp(data, IOTRACE_MAGIC, 4) || data[4] != IOTRACE_VERSION) {
+		res->bBroken = 1;
+		return false;
+	}
+	g_ioTraceMode = IOTRACE_REPLAY;
+	start = clock();
+	now = due = 0;
+	at = 5;
+	while (at < len) {
+		type = data[at++];
+		if (!IOTrace_GetNumber(data, len, &at, &delta) || !IOTrace_GetNumber(data, len, &at, &size)
+			|| at + (int)size > len) {
+			res->bBroken = 1;
+			break;
+		}
+		due += delta;
+		// device ran its loop in between, so does simulator
+		while (now < due) {
+			int step = due - now < IOTRACE_REPLAY_FRAME ? due - now : IOTRACE_REPLAY_FRAME;
+			Sim_RunFrame(step);
+			now += step;
+		}
+		if (type & IOTRACE_OUTPUT) {
+			IOTrace_ExpectOutput(res, type, data + at, size);
+		}
+		else {
+			IOTrace_ReplayInput(type, data + at, size);
+			res->inputs++;
+		}
+		res->records++;
+		at += size;
+	}
+	// let last input be handled
+	for (delta = 0; delta < 1000; delta += IOTRACE_REPLAY_FRAME) {
+		Sim_RunFrame(IOTRACE_REPLAY_FRAME);
+	}
+	g_ioTraceMode = IOTRACE_OFF;
+	res->simMs = now;
+	res->cpuMs = (unsigned int)((clock() - start) * 1000 / CLOCKS_PER_SEC);
+	res->uartHash = g_replayUartHash;
+	res->mqttHash = g_replayMqttHash;
+	res->outputs = g_replayOutputs;
+	return res->bBroken == 0 && res->uartHash == res->expectedUartHash
+		&& res->mqttHash == res->expectedMqttHash;
+}
+bool IOTrace_ReplayFile(const char *fname, ioTraceReplay_t *res) {
+	FILE *f;
+	byte *data;
+	long len;
+	bool bSame;
+
+	memset(res, 0, sizeof(*res));
+	f = fopen(fname, "rb");
+	if (f == 0) {
+		res->bBroken = 1;
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = (byte*)malloc(len > 0 ? len : 1);
+	if (data == 0 || fread(data, 1, len, f) != (size_t)len) {
+		fclose(f);
+		free(data);
+		res->bBroken = 1;
+		return false;
+	}
+	fclose(f);
+	bSame = IOTrace_Replay(data, len, res);
+	free(data);
+	return bSame;
+}
+#endif
+
+#endif
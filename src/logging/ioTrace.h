@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////
+// intent: To record what device receives (UART, MQTT, HTTP, input pins,
+// NTP time) and what it sends (UART, MQTT), so field traffic can be
+// replayed against new firmware in simulator and timed there.
+//
+// "iotrace_start [file]" records to LittleFS, "iotrace_stop" ends it,
+// file is downloaded like any other from /api/lfs/.
+// Simulator replays it with "-replay file" (see win_main.c).
+///////////////////////////////////////////////////////////////////////////
+
+#ifndef _OBK_IOTRACE_H
+#define _OBK_IOTRACE_H
+
+#include "../obk_config.h"
+
+// File is "OBKT", version byte, then records: type byte, milliseconds
+// since previous record and payload length as LEB128, payload.
+#define IOTRACE_MAGIC			"OBKT"
+#define IOTRACE_VERSION			1
+
+// port byte, received bytes
+#define IOTRACE_UART_RX			1
+// topic length as LEB128, topic, data
+#define IOTRACE_MQTT_RX			2
+// whole request as it came
+#define IOTRACE_HTTP_RX			3
+// pin byte, raw level byte
+#define IOTRACE_GPIO			4
+// 32 bit unix time, little endian
+#define IOTRACE_NTP				5
+// outputs have top bit set, replay compares them instead of feeding
+#define IOTRACE_OUTPUT			0x80
+#define IOTRACE_UART_TX			(IOTRACE_OUTPUT | IOTRACE_UART_RX)
+#define IOTRACE_MQTT_TX			(IOTRACE_OUTPUT | IOTRACE_MQTT_RX)
+
+#define IOTRACE_OFF				0
+#define IOTRACE_RECORD			1
+#define IOTRACE_REPLAY			2
+
+#if ENABLE_IO_TRACE
+
+// callers test it first, so nothing is called while trace is off
+extern unsigned char g_ioTraceMode;
+
+void IOTrace_UartRx(int port, const unsigned char *data, int len);
+void IOTrace_UartTx(int port, unsigned char b);
+void IOTrace_MqttRx(const char *topic, int topicLen, const unsigned char *data, int len);
+void IOTrace_MqttTx(const char *topic, const char *data, int len);
+void IOTrace_HttpRx(const char *data, int len);
+// only level changes are stored, so it may be called on every poll
+void IOTrace_Gpio(int pin, int level);
+void IOTrace_Ntp(unsigned int utc);
+// writes recorded data to file, from QuickTick
+void IOTrace_RunQuickTick();
+void IOTrace_AddCmds();
+
+#if WINDOWS
+typedef struct ioTraceReplay_s {
+	int records;
+	int inputs;
+	// simulated time covered by trace
+	unsigned int simMs;
+	// processor time replay took
+	unsigned int cpuMs;
+	// outputs in trace and from replay, hashed per kind
+	int expectedOutputs;
+	int outputs;
+	unsigned int expectedUartHash;
+	unsigned int uartHash;
+	unsigned int expectedMqttHash;
+	unsigned int mqttHash;
+	// trace is cut or has unknown version
+	int bBroken;
+} ioTraceReplay_t;
+
+// runs simulator frames between records as fast as possible,
+// returns true when outputs are same as recorded
+bool IOTrace_Replay(const unsigned char *data, int len, ioTraceReplay_t *res);
+bool IOTrace_ReplayFile(const char *fname, ioTraceReplay_t *res);
+#endif
+
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 
 #include "../new_common.h"
 #include "../httpserver/new_http.h"
+#include "../httpserver/http_sse.h"
 #include "../logging/logging.h"
 // Commands register, execution API and cmd tokenizer
 #include "../cmnds/cmd_public.h"
@@ -96,38 +97,105 @@ char* logfeaturenames[] = {
 volatile int direct_serial_log = DEFAULT_DIRECT_SERIAL_LOG;
 
 static int g_extraSocketToSendLOG = 0;
+// gets lines of command that runs now, see LOG_SetOutputCapture
+static logCaptureCallback_t g_logCapture = 0;
+static void *g_logCaptureUserData = 0;
 static char g_loggingBuffer[LOGGING_BUFFER_SIZE];
 
 #define MAX_TCP_LOG_PORTS 2
-int tcp_log_ports[MAX_TCP_LOG_PORTS] = {-1};
-
+int tcp_log_ports[MAX_TCP_LOG_PORTS] = { -1, -1 };
+#define TCPLOGBUFSIZE 128
+// what socket did not take yet
+static char tcpPending[MAX_TCP_LOG_PORTS][TCPLOGBUFSIZE];
+static int tcpPendingLen[MAX_TCP_LOG_PORTS];
 
-void LOG_SetRawSocketCallback(int newFD)
-{
-	g_extraSocketToSendLOG = newFD;
-}
+#ifndef MSG_DONTWAIT
+#define MSG_DONTWAIT 0
+#endif
 
 static int http_getlog(http_request_t* request);
 static int http_getlograw(http_request_t* request);
 
 static void log_server_thread(beken_thread_arg_t arg);
-static void log_client_thread(beken_thread_arg_t arg);
 static void log_serial_thread(beken_thread_arg_t arg);
 
 static void startSerialLog();
 static void startLogServer();
 
+// must be power of two
 #define LOGSIZE 4096
+#define LOGMASK (LOGSIZE - 1)
 #define LOGPORT 9000
 
 int logTcpPort = LOGPORT;
 
+// Each sink reads the log with its own cursor, from the thread that
+// sends it out, so slow client never blocks the one that logs.
+typedef enum {
+	LOG_SINK_SERIAL,
+	// one per TCP log client slot
+	LOG_SINK_TCP,
+	LOG_SINK_TCP_LAST = LOG_SINK_TCP + MAX_TCP_LOG_PORTS - 1,
+	// TCP console, see LOG_SetRawSocketCallback
+	LOG_SINK_SOCKET,
+	// command output for HTTP reply, see LOG_SetCommandHTTPRedirectReply
+	LOG_SINK_REDIRECT,
+	LOG_SINK_HTTP,
+	LOG_SINK_COUNT
+} logSink_t;
+
+static const char* g_logSinkNames[LOG_SINK_COUNT] = {
+	"serial", "tcp0", "tcp1", "console", "cmd", "http"
+};
+
+// Sinks with own level and features, see "logsink" command. Line that
+// is not wanted by all of them starts with LOG_TAG_MARKER and mask of
+// those that want it, readers skip lines that are not for them.
+typedef enum {
+	LOG_FILTER_SERIAL,
+	LOG_FILTER_TCP,
+	LOG_FILTER_HTTP,
+	LOG_FILTER_CONSOLE,
+	LOG_FILTER_COUNT
+} logFilter_t;
+
+static const char* g_logFilterNames[LOG_FILTER_COUNT] = {
+	"serial", "tcp", "http", "console"
+};
+// -1 means global loglevel or logfeatures
+static int g_logFilterLevel[LOG_FILTER_COUNT] = { -1, -1, -1, -1 };
+static int g_logFilterFeatures[LOG_FILTER_COUNT] = { -1, -1, -1, -1 };
+
+#define LOG_TAG_MARKER		0x1F
+// binary record, see addLogBin
+#define LOG_BIN_MARKER		0x1E
+
+// per sink reader state, for skipping binary records and tagged lines
+typedef struct logSinkState_s {
+	// 0 in text, -1 when record length is next, else bytes left of record
+	short bin;
+	// mask byte is next
+	char tag;
+	// in line for other sinks
+	char skipLine;
+} logSinkState_t;
+
+static logSinkState_t g_logSinkState[LOG_SINK_COUNT];
+// set once ring has tags or records, readers only filter after that
+static int g_logFiltered = 0;
+
+// Writers are serialized by mutex, readers don't take it. Positions are
+// counts of bytes ever written, so they only grow and index in ring is
+// position & LOGMASK. Writer moves "reserved" before copying and "head"
+// after, so reader can tell if what it has just copied was overwritten.
+// Sink that is more than LOGSIZE behind has lost the oldest part.
 static struct tag_logMemory {
 	char log[LOGSIZE];
-	int head;
-	int tailserial;
-	int tailtcp;
-	int tailhttp;
+	volatile unsigned int head;
+	volatile unsigned int reserved;
+	unsigned int tails[LOG_SINK_COUNT];
+	// bytes sink lost because it was too far behind
+	unsigned int dropped[LOG_SINK_COUNT];
 	SemaphoreHandle_t mutex;
 } logMemory;
 
@@ -227,8 +295,12 @@ logPort 1
 static void initLog(void)
 {
 	bk_printf("Entering initLog()...\r\n");
-	logMemory.head = logMemory.tailserial = logMemory.tailtcp = logMemory.tailhttp = 0;
+	memset(logMemory.tails, 0, sizeof(logMemory.tails));
+	logMemory.head = logMemory.reserved = 0;
 	logMemory.mutex = xSemaphoreCreateMutex();
+#if ENABLE_CRASH_LOG
+	LOG_InitCrashLog();
+#endif
 	initialised = 1;
 	startSerialLog();
 	HTTP_RegisterCallback("/logs", HTTP_GET, http_getlog, 1);
@@ -254,6 +326,18 @@ static void initLog(void)
 	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("logdelay", log_command, NULL);
+	//cmddetail:{"name":"logsink","args":"[serial|tcp|http|console] [Level] [FeatureMask]",
+	//cmddetail:"descr":"Sets own log level and feature mask for one log output, -1 (default) follows loglevel and logfeature. Lines no output wants are not formatted at all. Without level, prints current setting",
+	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
+	//cmddetail:"examples":"logsink tcp 5 0x2"}
+	CMD_RegisterCommand("logsink", log_command, NULL);
+#if ENABLE_BINARY_LOG
+	//cmddetail:{"name":"logBinary","args":"[0or1]",
+	//cmddetail:"descr":"When 1, addLogBin calls store format address and raw arguments instead of text. Web log and serial skip such records, TCP log port gets them and scripts/decode_binlog.py formats them using firmware ELF",
+	//cmddetail:"fn":"log_command","file":"logging/logging.c","requires":"",
+	//cmddetail:"examples":""}
+	CMD_RegisterCommand("logBinary", log_command, NULL);
+#endif
 #if PLATFORM_BEKEN || PLATFORM_LN882H
 	//cmddetail:{"name":"logport","args":"[Index]",
 	//cmddetail:"descr":"Allows you to change log output port. On Beken, the UART1 is used for flashing and for TuyaMCU/BL0942, while UART2 is for log. Sometimes it might be easier for you to have log on UART1, so now you can just use this command like backlog uartInit 115200; logport 1 to enable logging on UART1..",
@@ -271,14 +355,69 @@ static void inittcplog(){
 	tcpLogStarted = 1;
 }
 http_request_t *g_log_alsoPrintToHTTP = 0;
-bool b_guard_recursivePrint = false;
+
+static int getText(char* buff, int buffsize, logSink_t sink);
 
 void LOG_DeInit() {
 	initialised = 0;
 }
-// all log printfs made by command will be sent also to request
+// all log printfs made by command will be sent also to request,
+// they are taken from log when redirect ends, in thread of the request
 void LOG_SetCommandHTTPRedirectReply(http_request_t* request) {
-	g_log_alsoPrintToHTTP = request;
+	char buf[128];
+	char* line;
+	char* end;
+	int len;
+
+	if (request) {
+		logMemory.tails[LOG_SINK_REDIRECT] = logMemory.head;
+		g_log_alsoPrintToHTTP = request;
+		return;
+	}
+	if (g_log_alsoPrintToHTTP == 0) {
+		return;
+	}
+	while ((len = getText(buf, sizeof(buf), LOG_SINK_REDIRECT)) > 0) {
+		line = buf;
+		while ((end = strchr(line, '\n')) != 0) {
+			*end = 0;
+			poststr(g_log_alsoPrintToHTTP, line);
+			poststr(g_log_alsoPrintToHTTP, "\n<br>");
+			line = end + 1;
+		}
+		poststr(g_log_alsoPrintToHTTP, line);
+	}
+	g_log_alsoPrintToHTTP = 0;
+}
+void LOG_SetRawSocketCallback(int newFD)
+{
+	// only lines logged from now on go to the socket
+	if (newFD && newFD != g_extraSocketToSendLOG) {
+		logMemory.tails[LOG_SINK_SOCKET] = logMemory.head;
+	}
+	g_extraSocketToSendLOG = newFD;
+}
+void LOG_SetOutputCapture(logCaptureCallback_t callback, void *userData)
+{
+	g_logCaptureUserData = userData;
+	g_logCapture = callback;
+}
+int LOG_GetSinkFilter(int index, const char** name, int* level, unsigned int* features) {
+	if (index < 0 || index >= LOG_FILTER_COUNT) {
+		return 0;
+	}
+	*name = g_logFilterNames[index];
+	*level = g_logFilterLevel[index] < 0 ? g_loglevel : g_logFilterLevel[index];
+	*features = g_logFilterFeatures[index] == -1 ? logfeatures : (unsigned int)g_logFilterFeatures[index];
+	return 1;
+}
+int LOG_GetSinkDropped(int index, const char** name, unsigned int* dropped) {
+	if (index < 0 || index >= LOG_SINK_COUNT) {
+		return 0;
+	}
+	*name = g_logSinkNames[index];
+	*dropped = logMemory.dropped[index];
+	return 1;
 }
 
 
@@ -319,25 +458,247 @@ void LOG_SetCommandHTTPRedirectReply(http_request_t* request) {
 	}
 #endif
 
-// adds a log to the log memory
-// if head collides with either tail, move the tails on.
-void addLogAdv(int level, int feature, const char* fmt, ...)
+static int LOG_SinkFilter(logSink_t sink) {
+	if (sink == LOG_SINK_SERIAL) {
+		return LOG_FILTER_SERIAL;
+	}
+	if (sink <= LOG_SINK_TCP_LAST) {
+		return LOG_FILTER_TCP;
+	}
+	if (sink == LOG_SINK_SOCKET) {
+		return LOG_FILTER_CONSOLE;
+	}
+	// web log and command output
+	return LOG_FILTER_HTTP;
+}
+// mask of sinks that can read the log now
+static int LOG_ActiveFilters() {
+	int i, mask;
+
+	mask = 1 << LOG_FILTER_HTTP;
+	if (direct_serial_log != LOGTYPE_NONE) {
+		mask |= 1 << LOG_FILTER_SERIAL;
+	}
+	for (i = 0; i < MAX_TCP_LOG_PORTS; i++) {
+		if (tcp_log_ports[i] >= 0) {
+			mask |= 1 << LOG_FILTER_TCP;
+		}
+	}
+	if (g_extraSocketToSendLOG || g_logCapture) {
+		mask |= 1 << LOG_FILTER_CONSOLE;
+	}
+	return mask;
+}
+// mask of active sinks that want the line
+static int LOG_WantedBy(int level, int feature, int active) {
+	int i, mask, lvl;
+	unsigned int features;
+
+	mask = 0;
+	for (i = 0; i < LOG_FILTER_COUNT; i++) {
+		if (!(active & (1 << i))) {
+			continue;
+		}
+		lvl = g_logFilterLevel[i] < 0 ? g_loglevel : g_logFilterLevel[i];
+		features = g_logFilterFeatures[i] == -1 ? logfeatures : (unsigned int)g_logFilterFeatures[i];
+		if (level <= lvl && ((1 << feature) & features)) {
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+}
+static void LOG_ResetSinkState(logSink_t sink) {
+	memset(&g_logSinkState[sink], 0, sizeof(g_logSinkState[sink]));
+}
+// returns true when sink shows the byte, binary records are kept for TCP
+static bool LOG_SinkTakesByte(logSink_t sink, int filter, byte c) {
+	logSinkState_t* st = &g_logSinkState[sink];
+
+	if (st->bin) {
+		if (st->bin < 0) {
+			st->bin = c;
+		}
+		else {
+			st->bin--;
+		}
+		return filter == LOG_FILTER_TCP;
+	}
+	if (st->tag) {
+		st->tag = 0;
+		st->skipLine = (c & (1 << filter)) == 0;
+		return false;
+	}
+	if (st->skipLine) {
+		if (c == '\n') {
+			st->skipLine = 0;
+		}
+		return false;
+	}
+	if (c == LOG_BIN_MARKER) {
+		st->bin = -1;
+		return filter == LOG_FILTER_TCP;
+	}
+	if (c == LOG_TAG_MARKER) {
+		st->tag = 1;
+		return false;
+	}
+	return true;
+}
+// removes what is not for given sink, returns new length
+static int LOG_FilterSink(char* buff, int count, logSink_t sink) {
+	int i, n, filter;
+
+	if (!g_logFiltered) {
+		return count;
+	}
+	filter = LOG_SinkFilter(sink);
+	n = 0;
+	for (i = 0; i < count; i++) {
+		if (LOG_SinkTakesByte(sink, filter, buff[i])) {
+			buff[n++] = buff[i];
+		}
+	}
+	buff[n] = 0;
+	return n;
+}
+
+// called with mutex taken
+static void LOG_RingWrite(const char* s, int len) {
+	unsigned int pos;
+	int part;
+
+	pos = logMemory.head & LOGMASK;
+	logMemory.reserved = logMemory.head + len;
+	part = LOGSIZE - pos;
+	if (part > len) {
+		part = len;
+	}
+	OBK_SMP_BARRIER();
+	memcpy(logMemory.log + pos, s, part);
+	memcpy(logMemory.log, s + part, len - part);
+	OBK_SMP_BARRIER();
+	logMemory.head = logMemory.reserved;
+}
+
+#if ENABLE_CRASH_LOG
+// Last lines are also copied to RAM that is not cleared on reset, so
+// after watchdog or crash they can be read from /api/crashlog. Only
+// memcpy on log path, nothing is written to flash.
+#if PLATFORM_ESPIDF
+#include "esp_attr.h"
+#define CRASHLOG_RETAINED	__NOINIT_ATTR
+#else
+// plain RAM, log is kept only by LOG_InitCrashLog without reset
+#define CRASHLOG_RETAINED
+#endif
+#define CRASHLOG_MAGIC		0x4F424B43
+#define CRASHLOG_LINES		16
+#define CRASHLOG_LINE_LEN	80
+
+typedef struct crashLogLine_s {
+	unsigned int tick;
+	unsigned int heap;
+	unsigned short len;
+	char text[CRASHLOG_LINE_LEN];
+} crashLogLine_t;
+
+typedef struct crashLog_s {
+	unsigned int magic;
+	// count of lines ever added, slot is next % CRASHLOG_LINES
+	unsigned int next;
+	crashLogLine_t lines[CRASHLOG_LINES];
+	// RAM after power on is random, so magic is at both ends
+	unsigned int magicEnd;
+} crashLog_t;
+
+static CRASHLOG_RETAINED crashLog_t g_crashLog;
+// log of previous boot, allocated only when there was one
+static crashLog_t* g_crashLogPrev;
+
+void LOG_InitCrashLog() {
+	if (g_crashLog.magic == CRASHLOG_MAGIC && g_crashLog.magicEnd == CRASHLOG_MAGIC) {
+		if (g_crashLogPrev == 0) {
+			g_crashLogPrev = (crashLog_t*)malloc(sizeof(crashLog_t));
+		}
+		if (g_crashLogPrev) {
+			memcpy(g_crashLogPrev, &g_crashLog, sizeof(crashLog_t));
+		}
+	}
+	memset(&g_crashLog, 0, sizeof(g_crashLog));
+	g_crashLog.magic = CRASHLOG_MAGIC;
+	g_crashLog.magicEnd = CRASHLOG_MAGIC;
+}
+int LOG_GetCrashLogLine(int index, unsigned int* tick, unsigned int* heap, char* text, int maxLen) {
+	crashLogLine_t* l;
+	unsigned int first;
+	int len;
+
+	if (g_crashLogPrev == 0 || index < 0) {
+		return 0;
+	}
+	first = 0;
+	if (g_crashLogPrev->next > CRASHLOG_LINES) {
+		first = g_crashLogPrev->next - CRASHLOG_LINES;
+	}
+	if (index >= CRASHLOG_LINES || first + index >= g_crashLogPrev->next) {
+		return 0;
+	}
+	l = &g_crashLogPrev->lines[(first + index) % CRASHLOG_LINES];
+	len = l->len;
+	if (len > CRASHLOG_LINE_LEN) {
+		len = CRASHLOG_LINE_LEN;
+	}
+	if (len > maxLen - 1) {
+		len = maxLen - 1;
+	}
+	memcpy(text, l->text, len);
+	text[len] = 0;
+	*tick = l->tick;
+	*heap = l->heap;
+	return 1;
+}
+// called with mutex taken
+static void LOG_CrashLogAdd(const char* s, int len) {
+	crashLogLine_t* l;
+
+	if (g_crashLog.magic != CRASHLOG_MAGIC) {
+		return;
+	}
+	while (len > 0 && (s[len - 1] == '\n' || s[len - 1] == '\r')) {
+		len--;
+	}
+	if (len > CRASHLOG_LINE_LEN) {
+		len = CRASHLOG_LINE_LEN;
+	}
+	l = &g_crashLog.lines[g_crashLog.next % CRASHLOG_LINES];
+	l->tick = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	l->heap = xPortGetFreeHeapSize();
+	l->len = len;
+	memcpy(l->text, s, len);
+	g_crashLog.next++;
+}
+void LOG_CrashLogNote(const char* s) {
+	LOG_CrashLogAdd(s, strlen(s));
+}
+#endif
+
+// adds a log to the log memory, sinks that are too far behind lose oldest part
+static void addLogAdvV(int level, int feature, const char* fmt, va_list argList)
 {
 	char* tmp;
 	char* t;
-	int len;
-	va_list argList;
+	char* line;
+	int len, active, wanted;
 	BaseType_t taken;
-	int i;
 
 	if (fmt == 0)
 	{
 		return;
 	}
-	if (!((1 << feature) & logfeatures)) {
-		return;
-	}
-	if (level > g_loglevel) {
+	// nothing is formatted when no sink wants the line
+	active = LOG_ActiveFilters();
+	wanted = LOG_WantedBy(level, feature, active);
+	if (wanted == 0) {
 		return;
 	}
 
@@ -352,55 +713,69 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 
 	taken = xSemaphoreTake(logMemory.mutex, 100);
 	tmp = g_loggingBuffer;
-	memset(tmp, 0, LOGGING_BUFFER_SIZE);
 	t = tmp;
+	if (wanted != active) {
+		// 0x80 keeps mask byte away from markers and line end
+		*t++ = LOG_TAG_MARKER;
+		*t++ = 0x80 | wanted;
+		g_logFiltered = 1;
+	}
+	line = t;
 
 	if (feature == LOG_FEATURE_RAW)
 	{
 		// raw means no prefixes
 	}
 	else {
-		strncpy(t, loglevelnames[level], (LOGGING_BUFFER_SIZE - (3 + t - tmp)));
-		t += strlen(t);
+		// names are short, they always fit
+		len = strlen(loglevelnames[level]);
+		memcpy(t, loglevelnames[level], len);
+		t += len;
 		if (feature < sizeof(logfeaturenames) / sizeof(*logfeaturenames))
 		{
-			strncpy(t, logfeaturenames[feature], (LOGGING_BUFFER_SIZE - (3 + t - tmp)));
-			t += strlen(t);
+			len = strlen(logfeaturenames[feature]);
+			memcpy(t, logfeaturenames[feature], len);
+			t += len;
 		}
 	}
 
-	va_start(argList, fmt);
 	//vsnprintf3(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
 	//vsnprintf2(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	vsnprintf(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
-	va_end(argList);
-	if (tmp[strlen(tmp) - 1] == '\n') tmp[strlen(tmp) - 1] = '\0';
-	if (tmp[strlen(tmp) - 1] == '\r') tmp[strlen(tmp) - 1] = '\0';
+	len = vsnprintf(t, (LOGGING_BUFFER_SIZE - (3 + t - tmp)), fmt, argList);
+	// returned length is what it would be without the limit
+	if (len < 0) {
+		len = 0;
+	}
+	else if (len > LOGGING_BUFFER_SIZE - (4 + t - tmp)) {
+		len = LOGGING_BUFFER_SIZE - (4 + t - tmp);
+	}
+	len += t - tmp;
+	if (len > 0 && tmp[len - 1] == '\n') len--;
+	if (len > 0 && tmp[len - 1] == '\r') len--;
 
-	len = strlen(tmp); // save 3 bytes at end for /r/n/0
+	// save 3 bytes at end for /r/n/0
 	tmp[len++] = '\r';
 	tmp[len++] = '\n';
 	tmp[len] = '\0';
 #if WINDOWS
-	printf(tmp);
+	printf(line);
 #endif
-	// This is used by HTTP console
-	if (g_log_alsoPrintToHTTP) {
-		// guard here is used for the rare case when poststr attempts to do an addLogAdv as well
-		if (b_guard_recursivePrint == false) {
-			b_guard_recursivePrint = true;
-			poststr(g_log_alsoPrintToHTTP, tmp);
-			poststr(g_log_alsoPrintToHTTP, "<br>");
-			b_guard_recursivePrint = false;
-		}
+	if (g_logCapture && (wanted & (1 << LOG_FILTER_CONSOLE))) {
+		g_logCapture(line, len - (line - tmp), g_logCaptureUserData);
 	}
-	if (g_extraSocketToSendLOG)
-	{
-		send(g_extraSocketToSendLOG, tmp, strlen(tmp), 0);
+#if ENABLE_HTTP_SSE
+	if (wanted & (1 << LOG_FILTER_HTTP)) {
+		SSE_Publish(SSE_EVENT_LOG, "log", line);
 	}
+#endif
+#if ENABLE_CRASH_LOG
+	LOG_CrashLogAdd(line, len - (line - tmp));
+#endif
 
 	if (direct_serial_log == LOGTYPE_DIRECT) {
-		bk_printf("%s", tmp);
+		if (wanted & (1 << LOG_FILTER_SERIAL)) {
+			bk_printf("%s", line);
+		}
 		if (taken == pdTRUE) {
 			xSemaphoreGive(logMemory.mutex);
 		}
@@ -416,23 +791,7 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 		return;
 	}
 
-	for ( i = 0; i < len; i++)
-	{
-		logMemory.log[logMemory.head] = tmp[i];
-		logMemory.head = (logMemory.head + 1) % LOGSIZE;
-		if (logMemory.tailserial == logMemory.head)
-		{
-			logMemory.tailserial = (logMemory.tailserial + 1) % LOGSIZE;
-		}
-		if (logMemory.tailtcp == logMemory.head)
-		{
-			logMemory.tailtcp = (logMemory.tailtcp + 1) % LOGSIZE;
-		}
-		if (logMemory.tailhttp == logMemory.head)
-		{
-			logMemory.tailhttp = (logMemory.tailhttp + 1) % LOGSIZE;
-		}
-	}
+	LOG_RingWrite(tmp, len);
 
 	if (taken == pdTRUE) {
 		xSemaphoreGive(logMemory.mutex);
@@ -456,37 +815,251 @@ void addLogAdv(int level, int feature, const char* fmt, ...)
 		rtos_delay_milliseconds(timems);
 	}
 }
+void addLogAdv(int level, int feature, const char* fmt, ...)
+{
+	va_list argList;
 
+	va_start(argList, fmt);
+	addLogAdvV(level, feature, fmt, argList);
+	va_end(argList);
+}
 
-static int getData(char* buff, int buffsize, int* tail) {
-	BaseType_t taken;
-	int count;
-	char* p;
-	if (!initialised)
-		return 0;
-	taken = xSemaphoreTake(logMemory.mutex, 100);
-	if (taken == 0)
-	{
-		return 0;
-	}
+#if ENABLE_BINARY_LOG
+// Binary record: marker, length of the rest, kind, level, feature,
+// 32 bit address of format or title, then arguments or raw bytes.
+// Marker is never in text lines. Numbers are little endian.
+#define LOG_BIN_KIND_FORMAT	'F'
+#define LOG_BIN_KIND_HEX	'H'
+#define LOG_BIN_HEADER		9
+// length byte counts what follows it
+#define LOG_BIN_MAX			(2 + 255)
+
+static int g_logBinary = 0;
 
-	count = 0;
-	p = buff;
-	while (buffsize > 1) {
-		if (*tail == logMemory.head) {
+static int LOG_PutInt(byte* out, int n, int space, unsigned long long v, int size) {
+	int i;
+
+	if (n + size > space) {
+		return -1;
+	}
+	for (i = 0; i < size; i++) {
+		out[n + i] = (byte)(v >> (i * 8));
+	}
+	return n + size;
+}
+// stores arguments as format says: integers in 4 or 8 bytes, doubles in 8,
+// strings with length byte. Stops when record is full.
+static int LOG_PackArgs(byte* out, int space, const char* fmt, va_list argList) {
+	const char* str;
+	double d;
+	unsigned long long v;
+	int n, len, longs;
+
+	n = 0;
+	while (*fmt && n >= 0) {
+		if (*fmt++ != '%') {
+			continue;
+		}
+		if (*fmt == '%') {
+			fmt++;
+			continue;
+		}
+		while (*fmt && strchr("-+ #0123456789.*", *fmt)) {
+			if (*fmt == '*') {
+				n = LOG_PutInt(out, n, space, (unsigned int)va_arg(argList, int), 4);
+			}
+			fmt++;
+		}
+		longs = 0;
+		while (*fmt && strchr("hlLqjzt", *fmt)) {
+			if (*fmt == 'l' || *fmt == 'q' || *fmt == 'j') {
+				longs++;
+			}
+			fmt++;
+		}
+		if (n < 0) {
+			break;
+		}
+		switch (*fmt) {
+		case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+			if (longs >= 2) {
+				v = va_arg(argList, unsigned long long);
+				n = LOG_PutInt(out, n, space, v, 8);
+			}
+			else if (longs == 1) {
+				n = LOG_PutInt(out, n, space, (unsigned int)va_arg(argList, unsigned long), 4);
+			}
+			else {
+				n = LOG_PutInt(out, n, space, (unsigned int)va_arg(argList, unsigned int), 4);
+			}
+			break;
+		case 'p':
+			n = LOG_PutInt(out, n, space, (unsigned int)(size_t)va_arg(argList, void*), 4);
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			d = va_arg(argList, double);
+			memcpy(&v, &d, 8);
+			n = LOG_PutInt(out, n, space, v, 8);
+			break;
+		case 's':
+			str = va_arg(argList, const char*);
+			if (str == 0) {
+				str = "(null)";
+			}
+			len = strlen(str);
+			if (len > 255) {
+				len = 255;
+			}
+			if (n + 1 + len > space) {
+				// what fits of the last string is kept
+				len = space - n - 1;
+				if (len < 0) {
+					n = -1;
+					break;
+				}
+			}
+			out[n++] = len;
+			memcpy(out + n, str, len);
+			n += len;
 			break;
 		}
-		*p = logMemory.log[*tail];
-		p++;
-		(*tail) = ((*tail) + 1) % LOGSIZE;
-		buffsize--;
-		count++;
+		if (*fmt) {
+			fmt++;
+		}
 	}
-	*p = 0;
+	return n;
+}
+// records are read only by TCP
+static bool LOG_IsWanted(int level, int feature) {
+	int active = LOG_ActiveFilters() & (1 << LOG_FILTER_TCP);
 
+	return LOG_WantedBy(level, feature, active) != 0;
+}
+static void LOG_AddBinary(byte* rec, int kind, int level, int feature, const void* addr, int dataLen) {
+	BaseType_t taken;
+	unsigned int a;
+	int i;
+
+	if (!initialised) {
+		initLog();
+	}
+	a = (unsigned int)(size_t)addr;
+	rec[0] = LOG_BIN_MARKER;
+	rec[1] = LOG_BIN_HEADER - 2 + dataLen;
+	rec[2] = kind;
+	rec[3] = level;
+	rec[4] = feature;
+	for (i = 0; i < 4; i++) {
+		rec[5 + i] = (byte)(a >> (i * 8));
+	}
+	taken = xSemaphoreTake(logMemory.mutex, 100);
+	g_logFiltered = 1;
+	LOG_RingWrite((const char*)rec, LOG_BIN_HEADER + dataLen);
 	if (taken == pdTRUE) {
 		xSemaphoreGive(logMemory.mutex);
 	}
+#ifdef PLATFORM_BEKEN
+	trigger_log_send();
+#endif
+}
+#endif
+
+void addLogBin(int level, int feature, const char* fmt, ...)
+{
+	va_list argList;
+#if ENABLE_BINARY_LOG
+	byte rec[LOG_BIN_MAX];
+	int len;
+
+	// direct log has no ring
+	if (g_logBinary && direct_serial_log != LOGTYPE_DIRECT && fmt) {
+		if (!LOG_IsWanted(level, feature)) {
+			return;
+		}
+		va_start(argList, fmt);
+		len = LOG_PackArgs(rec + LOG_BIN_HEADER, sizeof(rec) - LOG_BIN_HEADER, fmt, argList);
+		va_end(argList);
+		if (len < 0) {
+			len = 0;
+		}
+		LOG_AddBinary(rec, LOG_BIN_KIND_FORMAT, level, feature, fmt, len);
+		return;
+	}
+#endif
+	va_start(argList, fmt);
+	addLogAdvV(level, feature, fmt, argList);
+	va_end(argList);
+}
+void addLogHex(int level, int feature, const char* title, const unsigned char* data, int len)
+{
+	char tmp[256];
+	int i, n;
+#if ENABLE_BINARY_LOG
+	byte rec[LOG_BIN_MAX];
+
+	if (g_logBinary && direct_serial_log != LOGTYPE_DIRECT) {
+		if (!LOG_IsWanted(level, feature)) {
+			return;
+		}
+		if (len > (int)sizeof(rec) - LOG_BIN_HEADER) {
+			len = (int)sizeof(rec) - LOG_BIN_HEADER;
+		}
+		memcpy(rec + LOG_BIN_HEADER, data, len);
+		LOG_AddBinary(rec, LOG_BIN_KIND_HEX, level, feature, title, len);
+		return;
+	}
+#endif
+	n = 0;
+	for (i = 0; i < len && n + 4 <= (int)sizeof(tmp); i++) {
+		n += sprintf(tmp + n, "%02X ", data[i]);
+	}
+	tmp[n] = 0;
+	addLogAdv(level, feature, "%s: %s", title, tmp);
+}
+
+
+// copies up to buffsize - 1 bytes not yet read by sink, without mutex,
+// each sink is read from one place only
+static int getData(char* buff, int buffsize, logSink_t sink) {
+	unsigned int head, tail, lost;
+	int count, part;
+
+	if (!initialised || buffsize < 1)
+		return 0;
+	head = logMemory.head;
+	tail = logMemory.tails[sink];
+	if (head - tail > LOGSIZE) {
+		logMemory.dropped[sink] += head - LOGSIZE - tail;
+		tail = head - LOGSIZE;
+		LOG_ResetSinkState(sink);
+	}
+	count = head - tail;
+	if (count > buffsize - 1) {
+		count = buffsize - 1;
+	}
+	part = LOGSIZE - (tail & LOGMASK);
+	if (part > count) {
+		part = count;
+	}
+	OBK_SMP_BARRIER();
+	memcpy(buff, logMemory.log + (tail & LOGMASK), part);
+	memcpy(buff + part, logMemory.log, count - part);
+	OBK_SMP_BARRIER();
+	// start of copied data may have been overwritten meanwhile
+	lost = logMemory.reserved - tail;
+	if (lost > LOGSIZE) {
+		lost -= LOGSIZE;
+		if (lost >= count) {
+			lost = count;
+		}
+		memmove(buff, buff + lost, count - lost);
+		count -= lost;
+		tail += lost;
+		logMemory.dropped[sink] += lost;
+		LOG_ResetSinkState(sink);
+	}
+	logMemory.tails[sink] = tail + count;
+	buff[count] = 0;
 	return count;
 }
 
@@ -498,61 +1071,122 @@ static int getData(char* buff, int buffsize, int* tail) {
 // H/W TX fifo seems to be 256 bytes!!!
 static int getSerial2() {
 	if (!initialised) return 0;
-	int* tail = &logMemory.tailserial;
+	unsigned int tail = logMemory.tails[LOG_SINK_SERIAL];
+	unsigned int head;
 	char c;
-	BaseType_t taken = xSemaphoreTake(logMemory.mutex, 100);
 	char overflow = 0;
 
-	// if we hit overflow
-	if (logMemory.tailserial == (logMemory.head + 1) % LOGSIZE) {
-		overflow = 1;
-	}
-
-	while ((*tail != logMemory.head) && !uart_is_tx_fifo_full(UART_PORT)) {
-		c = logMemory.log[*tail];
+	while (!uart_is_tx_fifo_full(UART_PORT)) {
+		head = logMemory.head;
+		// if we hit overflow
+		if (head - tail > LOGSIZE) {
+			logMemory.dropped[LOG_SINK_SERIAL] += head - LOGSIZE - tail;
+			tail = head - LOGSIZE;
+			overflow = 1;
+			LOG_ResetSinkState(LOG_SINK_SERIAL);
+		}
+		if (tail == head) {
+			break;
+		}
+		OBK_SMP_BARRIER();
+		c = logMemory.log[tail & LOGMASK];
+		OBK_SMP_BARRIER();
+		// being overwritten, skip what writer is taking
+		if (logMemory.reserved - tail > LOGSIZE) {
+			logMemory.dropped[LOG_SINK_SERIAL] += logMemory.reserved - LOGSIZE - tail;
+			tail = logMemory.reserved - LOGSIZE;
+			overflow = 1;
+			LOG_ResetSinkState(LOG_SINK_SERIAL);
+			continue;
+		}
 		if (overflow) {
 			c = '^'; // replace the first char with ^ if we overflowed....
 			overflow = 0;
 		}
 
-		(*tail) = ((*tail) + 1) % LOGSIZE;
+		tail++;
+		if (g_logFiltered && !LOG_SinkTakesByte(LOG_SINK_SERIAL, LOG_FILTER_SERIAL, c)) {
+			continue;
+		}
 
 		if (direct_serial_log == LOGTYPE_THREAD) {
 			UART_WRITE_BYTE(UART_PORT_INDEX, c);
 		}
 	}
+	logMemory.tails[LOG_SINK_SERIAL] = tail;
 
-	int remains = (*tail != logMemory.head);
-
-	if (taken == pdTRUE) {
-		xSemaphoreGive(logMemory.mutex);
-	}
-	return remains;
+	return (tail != logMemory.head);
 }
 
 #else
 
 static int getSerial(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailserial);
+	int len = getText(buff, buffsize, LOG_SINK_SERIAL);
 	//bk_printf("got serial: %d:%s\r\n", len, buff);
 	return len;
 }
 
 #endif
 
+// like getData, but only what is for given sink
+static int getText(char* buff, int buffsize, logSink_t sink) {
+	int len = getData(buff, buffsize, sink);
+	// 0 means no more data, so don't return it for chunk that was all skipped
+	while (len > 0) {
+		len = LOG_FilterSink(buff, len, sink);
+		if (len > 0) {
+			break;
+		}
+		len = getData(buff, buffsize, sink);
+	}
+	return len;
+}
+// returns bytes sent, 0 when socket is full, -1 when it is broken
+static int LOG_SendNoWait(int fd, const char* s, int len) {
+	int r;
+
+	r = send(fd, s, len, MSG_DONTWAIT);
+	if (r < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		}
+		return -1;
+	}
+	return r;
+}
 
-static int getTcp(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailtcp);
+// TCP gets binary records too, for scripts/decode_binlog.py
+static int getTcp(int slot, char* buff, int buffsize) {
+	int len = getText(buff, buffsize, LOG_SINK_TCP + slot);
 	//bk_printf("got tcp: %d:%s\r\n", len,buff);
 	return len;
 }
 
 static int getHttp(char* buff, int buffsize) {
-	int len = getData(buff, buffsize, &logMemory.tailhttp);
+	int len = getText(buff, buffsize, LOG_SINK_HTTP);
 	//printf("got tcp: %d:%s\r\n", len,buff);
 	return len;
 }
 
+// called by TCP console thread, never waits for the client
+void LOG_SendToRawSocket() {
+	char buf[128];
+	int fd, len, sent;
+
+	fd = g_extraSocketToSendLOG;
+	if (fd == 0) {
+		return;
+	}
+	while ((len = getText(buf, sizeof(buf), LOG_SINK_SOCKET)) > 0) {
+		sent = LOG_SendNoWait(fd, buf, len);
+		// filtered text can't be given back, so what did not fit is lost
+		if (sent < len) {
+			logMemory.dropped[LOG_SINK_SOCKET] += len - (sent > 0 ? sent : 0);
+			break;
+		}
+	}
+}
+
 void startLogServer() {
 #if WINDOWS
 
@@ -628,11 +1262,14 @@ void log_server_thread(beken_thread_arg_t arg)
 			if (client_fd >= 0)
 			{
 				strcpy(client_ip_str, inet_ntoa(client_addr.sin_addr));
-#ifdef PLATFORM_BEKEN
 				// Just note the new client port, if we have an available slot out of the two we record.
+				// Log thread sends to it, client gets lines logged from now on.
 				int found_port_slot = 0;
 				for (int i = 0; i < MAX_TCP_LOG_PORTS; i++) {
 					if (tcp_log_ports[i] == -1){
+						logMemory.tails[LOG_SINK_TCP + i] = logMemory.head;
+						LOG_ResetSinkState(LOG_SINK_TCP + i);
+						tcpPendingLen[i] = 0;
 						tcp_log_ports[i] = client_fd;
 						found_port_slot = 1;
 						break;
@@ -642,19 +1279,6 @@ void log_server_thread(beken_thread_arg_t arg)
 					close(client_fd);
 					client_fd = -1;
 				}
-#else
-				//addLog( "TCP Log Client %s:%d connected, fd: %d", client_ip_str, client_addr.sin_port, client_fd );
-                if (kNoErr
-                    != rtos_create_thread(NULL, BEKEN_APPLICATION_PRIORITY,
-                        "Logging TCP Client",
-                        (beken_thread_function_t)log_client_thread,
-                        0x800,
-                        (beken_thread_arg_t)client_fd))
-                {
-					close(client_fd);
-					client_fd = -1;
-				}
-#endif
 			}
 		}
 	}
@@ -667,66 +1291,39 @@ void log_server_thread(beken_thread_arg_t arg)
 	rtos_delete_thread(NULL);
 }
 
-#define TCPLOGBUFSIZE 128
-static char tcplogbuf[TCPLOGBUFSIZE];
-
-#ifdef PLATFORM_BEKEN
+// Each client has own cursor and gets what its socket takes without
+// waiting, rest is kept for next call. Client that is too slow loses
+// oldest lines, they are counted in dropped.
 static void send_to_tcp(){
-	int i;
+	int i, len;
+
 	for (i = 0; i < MAX_TCP_LOG_PORTS; i++){
-		if (tcp_log_ports[i] >= 0){
-			break;
-		}
-	}
-	// no ports to send to
-	if (i == MAX_TCP_LOG_PORTS){
-		return;
-	}
-	int count;
-	do {
-		count = getTcp(tcplogbuf, TCPLOGBUFSIZE);
-		if (count) {
-			for (i = 0; i < MAX_TCP_LOG_PORTS; i++){
-				if (tcp_log_ports[i] >= 0){
-					int len = send(tcp_log_ports[i], tcplogbuf, count, 0);
-					// if some error, close socket
-					if (len != count) {
-						// this is the only place this port can be closed.
-						close(tcp_log_ports[i]);
-						tcp_log_ports[i] = -1;
-					}
+		while (tcp_log_ports[i] >= 0) {
+			if (tcpPendingLen[i] == 0) {
+				tcpPendingLen[i] = getTcp(i, tcpPending[i], TCPLOGBUFSIZE);
+				if (tcpPendingLen[i] == 0) {
+					break;
 				}
 			}
-		}
-	} while(count);
-}
-#endif
-
-// on beken, we trigger log send from timer thread
-#ifndef PLATFORM_BEKEN
-
-// non-beken
-static void log_client_thread(beken_thread_arg_t arg)
-{
-	int fd = (int)arg;
-	while (1) {
-		int count = getTcp(tcplogbuf, TCPLOGBUFSIZE);
-		if (count) {
-			int len = send(fd, tcplogbuf, count, 0);
+			len = LOG_SendNoWait(tcp_log_ports[i], tcpPending[i], tcpPendingLen[i]);
 			// if some error, close socket
-			if (len != count) {
+			if (len < 0) {
+				// this is the only place this port can be closed.
+				close(tcp_log_ports[i]);
+				tcp_log_ports[i] = -1;
+				break;
+			}
+			tcpPendingLen[i] -= len;
+			if (tcpPendingLen[i] > 0) {
+				memmove(tcpPending[i], tcpPending[i] + len, tcpPendingLen[i]);
 				break;
 			}
 		}
-		rtos_delay_milliseconds(10);
 	}
-
-	//addLog( "TCP client thread exit with err: %d", len );
-
-	close(fd);
-	rtos_delete_thread(NULL);
 }
 
+// on beken, we trigger log send from timer thread
+#ifndef PLATFORM_BEKEN
 
 
 #define SERIALLOGBUFSIZE 128
@@ -740,6 +1337,7 @@ static void log_serial_thread(beken_thread_arg_t arg)
 				bk_printf("%s", seriallogbuf);
 			}
 		}
+		send_to_tcp();
 		rtos_delay_milliseconds(10);
 	}
 }
@@ -794,6 +1392,9 @@ commandResult_t log_command(const void* context, const char* cmd, const char* ar
 					g_loglevel = level;
 					result = CMD_RES_OK;
 					ADDLOG_DEBUG(LOG_FEATURE_CMD, "loglevel set %d", level);
+					if (level > OBK_LOG_MIN_LEVEL && OBK_LOG_MIN_LEVEL < LOG_MAX) {
+						ADDLOG_INFO(LOG_FEATURE_CMD, "build has only levels up to %i, except for some features", OBK_LOG_MIN_LEVEL);
+					}
 				}
 				else {
 					ADDLOG_ERROR(LOG_FEATURE_CMD, "loglevel %d out of range", level);
@@ -856,6 +1457,41 @@ commandResult_t log_command(const void* context, const char* cmd, const char* ar
 			result = CMD_RES_OK;
 			break;
 		}
+		if (!stricmp(cmd, "logsink")) {
+			char name[16];
+			int i, res, level, features;
+
+			level = features = -1;
+			name[0] = 0;
+			res = sscanf(args, "%15s %i %i", name, &level, &features);
+			for (i = 0; i < LOG_FILTER_COUNT; i++) {
+				if (!stricmp(name, g_logFilterNames[i])) {
+					break;
+				}
+			}
+			if (res < 1 || i == LOG_FILTER_COUNT) {
+				ADDLOG_ERROR(LOG_FEATURE_CMD, "logsink '%s' unknown, use serial, tcp, http or console", name);
+				result = CMD_RES_BAD_ARGUMENT;
+				break;
+			}
+			if (res >= 2) {
+				g_logFilterLevel[i] = level;
+				g_logFilterFeatures[i] = features;
+			}
+			ADDLOG_INFO(LOG_FEATURE_CMD, "logsink %s level %i features 0x%08X", g_logFilterNames[i],
+				g_logFilterLevel[i] < 0 ? g_loglevel : g_logFilterLevel[i],
+				g_logFilterFeatures[i] == -1 ? logfeatures : (unsigned int)g_logFilterFeatures[i]);
+			result = CMD_RES_OK;
+			break;
+		}
+#if ENABLE_BINARY_LOG
+		if (!stricmp(cmd, "logBinary")) {
+			g_logBinary = atoi(args);
+			ADDLOG_INFO(LOG_FEATURE_CMD, "logBinary %i", g_logBinary);
+			result = CMD_RES_OK;
+			break;
+		}
+#endif
 
 	} while (0);
 
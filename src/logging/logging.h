@@ -14,20 +14,64 @@
 #ifndef _OBK_LOGGING_H
 #define _OBK_LOGGING_H
 
+// for OBK_LOG_MIN_LEVEL and OBK_LOG_DEBUG_FEATURES
+#include "../obk_config.h"
+
 void addLogAdv(int level, int feature, const char *fmt, ...);
+// Same as addLogAdv, but after "logBinary 1" line is not formatted on device.
+// Address of format and raw arguments go to log and scripts/decode_binlog.py
+// expands them on host from firmware ELF, so format must be a string literal.
+// Meant for high-rate debug lines, read them from TCP log.
+void addLogBin(int level, int feature, const char *fmt, ...);
+// logs "title: " and bytes as hex, in binary mode raw bytes are stored
+void addLogHex(int level, int feature, const char *title, const unsigned char *data, int len);
+// log lines go to newFD from now on, 0 stops it
 void LOG_SetRawSocketCallback(int newFD);
+// sends log to socket of LOG_SetRawSocketCallback without waiting,
+// called by the thread that owns it
+void LOG_SendToRawSocket();
+// Lines logged while it is set are also given to callback, with level
+// prefix and line end, from thread that logs them and under log mutex, so
+// it should only copy them. Console level and features apply (logsink
+// console). Command queue sets it around command that wants its output.
+typedef void (*logCaptureCallback_t)(const char *text, int len, void *userData);
+void LOG_SetOutputCapture(logCaptureCallback_t callback, void *userData);
+// bytes each log sink lost while it was too slow, index goes from 0
+// until 0 is returned
+int LOG_GetSinkDropped(int index, const char** name, unsigned int* dropped);
+// level and features used by each output (see logsink command),
+// index goes from 0 until 0 is returned
+int LOG_GetSinkFilter(int index, const char** name, int* level, unsigned int* features);
+// takes lines kept over reset as log of previous boot and starts new one
+void LOG_InitCrashLog();
+// line of previous boot, oldest first, returns 0 when there are no more
+int LOG_GetCrashLogLine(int index, unsigned int* tick, unsigned int* heap, char* text, int maxLen);
+// adds line without log mutex, for watchdog which may run in ISR
+// while stuck task holds the mutex
+void LOG_CrashLogNote(const char* s);
+
+// Levels above OBK_LOG_MIN_LEVEL are built only for features in
+// OBK_LOG_DEBUG_FEATURES (both from obk_config.h). Condition is constant
+// for constant feature, so compiler drops the call, its arguments and
+// format string. Macros stay expressions.
+#define LOG_IS_BUILT(level, x) ((level) <= OBK_LOG_MIN_LEVEL || (((OBK_LOG_DEBUG_FEATURES) >> (x)) & 1))
+#define ADDLOG_LEVEL(level, x, fmt, ...) (LOG_IS_BUILT(level, x) ? addLogAdv(level, x, fmt, ##__VA_ARGS__) : (void)0)
+
+#define ADDLOG_ERROR(x, fmt, ...) ADDLOG_LEVEL(LOG_ERROR, x, fmt, ##__VA_ARGS__)
+#define ADDLOG_WARN(x, fmt, ...)  ADDLOG_LEVEL(LOG_WARN, x, fmt, ##__VA_ARGS__)
+#define ADDLOG_INFO(x, fmt, ...)  ADDLOG_LEVEL(LOG_INFO, x, fmt, ##__VA_ARGS__)
+#define ADDLOG_DEBUG(x, fmt, ...) ADDLOG_LEVEL(LOG_DEBUG, x, fmt, ##__VA_ARGS__)
+#define ADDLOG_EXTRADEBUG(x, fmt, ...) ADDLOG_LEVEL(LOG_EXTRADEBUG, x, fmt, ##__VA_ARGS__)
+
+#define ADDLOGBIN_WARN(x, fmt, ...)  (LOG_IS_BUILT(LOG_WARN, x) ? addLogBin(LOG_WARN, x, fmt, ##__VA_ARGS__) : (void)0)
+#define ADDLOGBIN_INFO(x, fmt, ...)  (LOG_IS_BUILT(LOG_INFO, x) ? addLogBin(LOG_INFO, x, fmt, ##__VA_ARGS__) : (void)0)
+#define ADDLOGBIN_DEBUG(x, fmt, ...) (LOG_IS_BUILT(LOG_DEBUG, x) ? addLogBin(LOG_DEBUG, x, fmt, ##__VA_ARGS__) : (void)0)
 
-#define ADDLOG_ERROR(x, fmt, ...) addLogAdv(LOG_ERROR, x, fmt, ##__VA_ARGS__)
-#define ADDLOG_WARN(x, fmt, ...)  addLogAdv(LOG_WARN, x, fmt, ##__VA_ARGS__)
-#define ADDLOG_INFO(x, fmt, ...)  addLogAdv(LOG_INFO, x, fmt, ##__VA_ARGS__)
-#define ADDLOG_DEBUG(x, fmt, ...) addLogAdv(LOG_DEBUG, x, fmt, ##__VA_ARGS__)
-#define ADDLOG_EXTRADEBUG(x, fmt, ...) addLogAdv(LOG_EXTRADEBUG, x, fmt, ##__VA_ARGS__)
-
-#define ADDLOGF_ERROR(fmt, ...) addLogAdv(LOG_ERROR, LOG_FEATURE, fmt, ##__VA_ARGS__)
-#define ADDLOGF_WARN(fmt, ...)  addLogAdv(LOG_WARN, LOG_FEATURE, fmt, ##__VA_ARGS__)
-#define ADDLOGF_INFO(fmt, ...)  addLogAdv(LOG_INFO, LOG_FEATURE, fmt, ##__VA_ARGS__)
-#define ADDLOGF_DEBUG(fmt, ...) addLogAdv(LOG_DEBUG, LOG_FEATURE, fmt, ##__VA_ARGS__)
-#define ADDLOGF_EXTRADEBUG(fmt, ...) addLogAdv(LOG_EXTRADEBUG, LOG_FEATURE, fmt, ##__VA_ARGS__)
+#define ADDLOGF_ERROR(fmt, ...) ADDLOG_LEVEL(LOG_ERROR, LOG_FEATURE, fmt, ##__VA_ARGS__)
+#define ADDLOGF_WARN(fmt, ...)  ADDLOG_LEVEL(LOG_WARN, LOG_FEATURE, fmt, ##__VA_ARGS__)
+#define ADDLOGF_INFO(fmt, ...)  ADDLOG_LEVEL(LOG_INFO, LOG_FEATURE, fmt, ##__VA_ARGS__)
+#define ADDLOGF_DEBUG(fmt, ...) ADDLOG_LEVEL(LOG_DEBUG, LOG_FEATURE, fmt, ##__VA_ARGS__)
+#define ADDLOGF_EXTRADEBUG(fmt, ...) ADDLOG_LEVEL(LOG_EXTRADEBUG, LOG_FEATURE, fmt, ##__VA_ARGS__)
 
 
 extern int g_loglevel;
@@ -0,0 +1,289 @@
+// keep real allocator here, new_common.h sends everything else to us
+#define HEAP_TRACKER_INTERNAL
+#include "../new_common.h"
+#include "../logging/logging.h"
+
+#if ENABLE_HEAP_TRACKER
+
+#if PLATFORM_ESPIDF
+#include "esp_heap_caps.h"
+#endif
+
+// Every block gets a header with its size, call site and sequence number,
+// and live blocks are linked, so heapstats can tell which file and line
+// holds memory, and selftest can ask for blocks left since a mark. Magic
+// is the word right before data, so pointers from allocator of libraries
+// (strdup, SDK) are told apart by reading only allocator header of theirs,
+// and they are passed on untouched.
+
+#define HEAP_TRACK_MAGIC		0x48454150
+#define HEAP_TRACK_FREED		0x46524545
+#define HEAP_TRACK_MAX_SITES	128
+// site 0 collects what did not get own slot
+#define HEAP_TRACK_OTHER		0
+
+typedef struct heapBlock_s {
+	struct heapBlock_s *prev;
+	struct heapBlock_s *next;
+	unsigned int size;
+	unsigned int seq;
+	unsigned short site;
+	unsigned short pad;
+	unsigned int magic;
+} heapBlock_t;
+
+// data after header keeps 8 byte alignment
+typedef char heapBlockSizeCheck_t[(sizeof(heapBlock_t) % 8) == 0 ? 1 : -1];
+
+static heapSiteStats_t g_heapSites[HEAP_TRACK_MAX_SITES];
+static int g_heapNumSites = 1;
+static heapStats_t g_heapStats;
+static heapBlock_t *g_heapBlocks = 0;
+static unsigned int g_heapSeq = 0;
+static SemaphoreHandle_t g_heapMutex = 0;
+
+// nothing holds lock for long, it is taken unless something went wrong
+static bool HeapTrack_Lock() {
+	if (g_heapMutex == 0) {
+		g_heapMutex = xSemaphoreCreateMutex();
+	}
+	return xSemaphoreTake(g_heapMutex, 1000) == pdTRUE;
+}
+static void HeapTrack_Unlock(bool bTaken) {
+	if (bTaken) {
+		xSemaphoreGive(g_heapMutex);
+	}
+}
+static int HeapTrack_FindSite(const char *file, int line) {
+	heapSiteStats_t *s;
+	int i;
+
+	for (i = 1; i < g_heapNumSites; i++) {
+		s = &g_heapSites[i];
+		// same file may come as different literal from headers
+		if (s->line == line && (s->file == file || !strcmp(s->file, file))) {
+			return i;
+		}
+	}
+	if (g_heapNumSites >= HEAP_TRACK_MAX_SITES) {
+		return HEAP_TRACK_OTHER;
+	}
+	s = &g_heapSites[g_heapNumSites];
+	s->file = file;
+	s->line = line;
+	return g_heapNumSites++;
+}
+static heapBlock_t *HeapTrack_GetBlock(void *p) {
+	heapBlock_t *b = ((heapBlock_t*)p) - 1;
+
+	if (*(((unsigned int*)p) - 1) != HEAP_TRACK_MAGIC) {
+		return 0;
+	}
+	return b;
+}
+static void HeapTrack_Add(heapBlock_t *b, size_t size, const char *file, int line) {
+	heapSiteStats_t *s;
+	bool taken;
+
+	taken = HeapTrack_Lock();
+	b->size = size;
+	b->seq = ++g_heapSeq;
+	b->site = HeapTrack_FindSite(file, line);
+	b->magic = HEAP_TRACK_MAGIC;
+	b->prev = 0;
+	b->next = g_heapBlocks;
+	if (g_heapBlocks) {
+		g_heapBlocks->prev = b;
+	}
+	g_heapBlocks = b;
+	s = &g_heapSites[b->site];
+	s->allocs++;
+	s->liveCount++;
+	s->liveBytes += size;
+	if (s->liveBytes > s->peakBytes) {
+		s->peakBytes = s->liveBytes;
+	}
+	g_heapStats.allocs++;
+	g_heapStats.liveCount++;
+	g_heapStats.liveBytes += size;
+	if (g_heapStats.liveBytes > g_heapStats.peakBytes) {
+		g_heapStats.peakBytes = g_heapStats.liveBytes;
+	}
+	HeapTrack_Unlock(taken);
+}
+static void HeapTrack_Remove(heapBlock_t *b) {
+	heapSiteStats_t *s;
+	bool taken;
+
+	taken = HeapTrack_Lock();
+	if (b->prev) {
+		b->prev->next = b->next;
+	}
+	else {
+		g_heapBlocks = b->next;
+	}
+	if (b->next) {
+		b->next->prev = b->prev;
+	}
+	s = &g_heapSites[b->site];
+	s->liveCount--;
+	s->liveBytes -= b->size;
+	g_heapStats.frees++;
+	g_heapStats.liveCount--;
+	g_heapStats.liveBytes -= b->size;
+	b->magic = HEAP_TRACK_FREED;
+	HeapTrack_Unlock(taken);
+}
+
+void *HeapTrack_Malloc(size_t size, const char *file, int line) {
+	heapBlock_t *b = (heapBlock_t*)os_malloc(sizeof(heapBlock_t) + size);
+
+	if (b == 0) {
+		g_heapStats.failed++;
+		return 0;
+	}
+	HeapTrack_Add(b, size, file, line);
+	return b + 1;
+}
+void *HeapTrack_Calloc(size_t count, size_t size, const char *file, int line) {
+	void *p;
+
+	if (size && count > (size_t)-1 / size) {
+		g_heapStats.failed++;
+		return 0;
+	}
+	p = HeapTrack_Malloc(count * size, file, line);
+	if (p) {
+		memset(p, 0, count * size);
+	}
+	return p;
+}
+void HeapTrack_Free(void *p) {
+	heapBlock_t *b;
+
+	if (p == 0) {
+		return;
+	}
+	b = HeapTrack_GetBlock(p);
+	if (b == 0) {
+		if (*(((unsigned int*)p) - 1) == HEAP_TRACK_FREED) {
+			addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "HeapTrack: %p freed twice", p);
+			return;
+		}
+		g_heapStats.untracked++;
+		os_free(p);
+		return;
+	}
+	HeapTrack_Remove(b);
+	os_free(b);
+}
+// new block is counted to site that resized it
+void *HeapTrack_Realloc(void *p, size_t size, const char *file, int line) {
+	heapBlock_t *b;
+	void *n;
+
+	if (p == 0) {
+		return HeapTrack_Malloc(size, file, line);
+	}
+	b = HeapTrack_GetBlock(p);
+	if (b == 0) {
+		g_heapStats.untracked++;
+		return realloc(p, size);
+	}
+	n = HeapTrack_Malloc(size, file, line);
+	if (n == 0) {
+		return 0;
+	}
+	memcpy(n, p, b->size < size ? b->size : size);
+	HeapTrack_Free(p);
+	return n;
+}
+// for cJSON hooks, which take functions
+void *HeapTrack_HookMalloc(size_t size) {
+	return HeapTrack_Malloc(size, "cJSON", 0);
+}
+void HeapTrack_HookFree(void *p) {
+	HeapTrack_Free(p);
+}
+
+void HeapTrack_GetStats(heapStats_t *out) {
+	*out = g_heapStats;
+	out->freeHeap = xPortGetFreeHeapSize();
+#if PLATFORM_ESPIDF
+	out->largestFree = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+#else
+	// allocator of SDK does not tell
+	out->largestFree = -1;
+#endif
+}
+// sites with memory first, most live bytes first
+int HeapTrack_GetSites(heapSiteStats_t *out, int maxCount) {
+	byte picked[HEAP_TRACK_MAX_SITES];
+	int i, best, count = 0;
+	bool taken;
+
+	memset(picked, 0, sizeof(picked));
+	taken = HeapTrack_Lock();
+	for (count = 0; count < maxCount; count++) {
+		best = -1;
+		for (i = 0; i < g_heapNumSites; i++) {
+			if (g_heapSites[i].allocs == 0 || picked[i]) {
+				continue;
+			}
+			if (best == -1 || g_heapSites[i].liveBytes > g_heapSites[best].liveBytes) {
+				best = i;
+			}
+		}
+		if (best == -1) {
+			break;
+		}
+		picked[best] = 1;
+		out[count] = g_heapSites[best];
+	}
+	HeapTrack_Unlock(taken);
+	return count;
+}
+void HeapTrack_ResetPeak() {
+	int i;
+	bool taken;
+
+	taken = HeapTrack_Lock();
+	g_heapStats.peakBytes = g_heapStats.liveBytes;
+	for (i = 0; i < g_heapNumSites; i++) {
+		g_heapSites[i].peakBytes = g_heapSites[i].liveBytes;
+	}
+	HeapTrack_Unlock(taken);
+}
+// blocks allocated later than this are newer than mark
+unsigned int HeapTrack_GetMark() {
+	return g_heapSeq;
+}
+// counts blocks allocated after mark that are still there, logs first few
+int HeapTrack_CountLiveSince(unsigned int mark, bool bLog) {
+	heapBlock_t *b;
+	heapSiteStats_t *s;
+	// logging may allocate, so it is done after lock
+	unsigned int sizes[8];
+	unsigned short sites[8];
+	int i, count = 0;
+	bool taken;
+
+	taken = HeapTrack_Lock();
+	// list is newest first
+	for (b = g_heapBlocks; b && (int)(b->seq - mark) > 0; b = b->next) {
+		if (count < 8) {
+			sizes[count] = b->size;
+			sites[count] = b->site;
+		}
+		count++;
+	}
+	HeapTrack_Unlock(taken);
+	for (i = 0; bLog && i < count && i < 8; i++) {
+		s = &g_heapSites[sites[i]];
+		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "HeapTrack: %u bytes from %s:%i still allocated",
+			sizes[i], sites[i] == HEAP_TRACK_OTHER ? "other" : s->file, s->line);
+	}
+	return count;
+}
+
+#endif
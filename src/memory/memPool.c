@@ -0,0 +1,169 @@
+#include "../new_common.h"
+#include "../logging/logging.h"
+
+#if ENABLE_MEMPOOL
+
+// Structures that are allocated and freed often, like event handlers or
+// MQTT callbacks, are taken from slabs of blocks of a few fixed sizes,
+// so they do not cut heap that lwIP and TLS need into small holes, and
+// allocation is a pop from free list. Slab a block is in is found by its
+// address, so pointers that came from malloc are freed there as well.
+
+#define MEMPOOL_SLAB_SIZE		1024
+// blocks after header keep 8 byte alignment
+#define MEMPOOL_HEADER_SIZE		((sizeof(memSlab_t) + 7) & ~7)
+
+typedef struct memSlab_s {
+	// slabs of the same class
+	struct memSlab_s *next;
+	void *freeList;
+	unsigned short used;
+} memSlab_t;
+
+static const unsigned short g_poolSizes[MEMPOOL_NUM_CLASSES] = { 16, 32, 64, 128 };
+static memSlab_t *g_poolSlabs[MEMPOOL_NUM_CLASSES];
+static memPoolStats_t g_poolStats[MEMPOOL_NUM_CLASSES];
+// one empty slab per class is kept, so alloc and free in turn does not
+// get and release a slab each time
+static byte g_poolEmptySlabs[MEMPOOL_NUM_CLASSES];
+static unsigned int g_poolFallbacks = 0;
+static SemaphoreHandle_t g_poolMutex = 0;
+
+static bool MemPool_Lock() {
+	if (g_poolMutex == 0) {
+		g_poolMutex = xSemaphoreCreateMutex();
+	}
+	return xSemaphoreTake(g_poolMutex, 1000) == pdTRUE;
+}
+static void MemPool_Unlock(bool bTaken) {
+	if (bTaken) {
+		xSemaphoreGive(g_poolMutex);
+	}
+}
+static memSlab_t *MemPool_NewSlab(int cls) {
+	memSlab_t *slab;
+	byte *block;
+	int size = g_poolSizes[cls];
+	int i, count = (MEMPOOL_SLAB_SIZE - MEMPOOL_HEADER_SIZE) / size;
+
+	slab = (memSlab_t*)malloc(MEMPOOL_SLAB_SIZE);
+	if (slab == 0) {
+		return 0;
+	}
+	slab->used = 0;
+	slab->freeList = 0;
+	// free list goes in address order
+	block = ((byte*)slab) + MEMPOOL_HEADER_SIZE + (count - 1) * size;
+	for (i = 0; i < count; i++, block -= size) {
+		*(void**)block = slab->freeList;
+		slab->freeList = block;
+	}
+	slab->next = g_poolSlabs[cls];
+	g_poolSlabs[cls] = slab;
+	g_poolStats[cls].slabs++;
+	g_poolStats[cls].capacity += count;
+	return slab;
+}
+void *MemPool_Alloc(size_t size) {
+	memSlab_t *slab;
+	void *p;
+	int cls;
+	bool taken;
+
+	for (cls = 0; cls < MEMPOOL_NUM_CLASSES; cls++) {
+		if (size <= g_poolSizes[cls]) {
+			break;
+		}
+	}
+	if (cls == MEMPOOL_NUM_CLASSES) {
+		g_poolFallbacks++;
+		return malloc(size);
+	}
+	taken = MemPool_Lock();
+	if (taken == false) {
+		// free lists can't be touched without lock, heap is safe
+		g_poolFallbacks++;
+		return malloc(size);
+	}
+	for (slab = g_poolSlabs[cls]; slab; slab = slab->next) {
+		if (slab->freeList) {
+			break;
+		}
+	}
+	if (slab == 0) {
+		slab = MemPool_NewSlab(cls);
+	}
+	if (slab == 0) {
+		MemPool_Unlock(taken);
+		g_poolFallbacks++;
+		return malloc(size);
+	}
+	if (slab->used == 0 && g_poolEmptySlabs[cls]) {
+		g_poolEmptySlabs[cls]--;
+	}
+	p = slab->freeList;
+	slab->freeList = *(void**)p;
+	slab->used++;
+	g_poolStats[cls].allocs++;
+	g_poolStats[cls].used++;
+	if (g_poolStats[cls].used > g_poolStats[cls].peakUsed) {
+		g_poolStats[cls].peakUsed = g_poolStats[cls].used;
+	}
+	MemPool_Unlock(taken);
+	return p;
+}
+void MemPool_Free(void *p) {
+	memSlab_t *slab, **prev;
+	int cls;
+	bool taken;
+
+	if (p == 0) {
+		return;
+	}
+	// block may be in a slab, so it has to wait for lock
+	do {
+		taken = MemPool_Lock();
+	} while (taken == false);
+	for (cls = 0; cls < MEMPOOL_NUM_CLASSES; cls++) {
+		for (prev = &g_poolSlabs[cls]; *prev; prev = &(*prev)->next) {
+			slab = *prev;
+			if ((byte*)p < (byte*)slab + MEMPOOL_HEADER_SIZE || (byte*)p >= (byte*)slab + MEMPOOL_SLAB_SIZE) {
+				continue;
+			}
+			*(void**)p = slab->freeList;
+			slab->freeList = p;
+			slab->used--;
+			g_poolStats[cls].used--;
+			if (slab->used == 0) {
+				if (g_poolEmptySlabs[cls]) {
+					*prev = slab->next;
+					g_poolStats[cls].slabs--;
+					g_poolStats[cls].capacity -= (MEMPOOL_SLAB_SIZE - MEMPOOL_HEADER_SIZE) / g_poolSizes[cls];
+					free(slab);
+				}
+				else {
+					g_poolEmptySlabs[cls]++;
+				}
+			}
+			MemPool_Unlock(taken);
+			return;
+		}
+	}
+	MemPool_Unlock(taken);
+	free(p);
+}
+int MemPool_GetStats(memPoolStats_t *out, unsigned int *outFallbacks) {
+	int cls;
+	bool taken;
+
+	taken = MemPool_Lock();
+	for (cls = 0; cls < MEMPOOL_NUM_CLASSES; cls++) {
+		out[cls] = g_poolStats[cls];
+		out[cls].blockSize = g_poolSizes[cls];
+	}
+	*outFallbacks = g_poolFallbacks;
+	MemPool_Unlock(taken);
+	return MEMPOOL_NUM_CLASSES;
+}
+
+#endif
@@ -16,6 +16,10 @@
 #include "../driver/drv_deviceclock.h"
 #include "../driver/drv_tuyaMCU.h"
 #include "../hal/hal_ota.h"
+#include "../quicktick.h"
+#include "../logging/ioTrace.h"
+#include "../driver/drv_freeze.h"
+#include "../driver/drv_powerGov.h"
 #include <math.h>
 #ifndef WINDOWS
 #include <lwip/dns.h>
@@ -88,6 +92,28 @@ static int g_intervalBetweenMQTTBroadcasts = 60;
 // While doing self state broadcast, it limits the number of publishes 
 // per second in order not to overload LWIP
 static int g_maxBroadcastItemsPublishedPerSecond = 1;
+// When set, self state broadcast is sent as one JSON document
+// on <base>/state instead of one publish per item.
+// You can change it with command: mqtt_broadcastJSON 1
+static int g_mqttBroadcastJSON = 0;
+
+//
+// Token bucket in front of publishes, see mqtt_rateLimit.
+// Bucket is refilled every second. Telemetry may only use tokens above
+// tele reserve, state changes may use all of them and command replies
+// are always sent, so interactive traffic is not stuck behind telemetry.
+// Publishes that are refused are queued and sent when tokens are back.
+//
+#define MQTT_PRIO_REPLY		0
+#define MQTT_PRIO_STATE		1
+#define MQTT_PRIO_TELE		2
+#define MQTT_PRIO_COUNT		3
+// refill per second, 0 disables limiter
+static int g_mqttRatePerSecond = 0;
+static int g_mqttRateBurst = 0;
+static int g_mqttRateTeleReserve = 0;
+static int g_mqttRateTokens = 0;
+static int g_mqttRateDeferred[MQTT_PRIO_COUNT];
 // interval for automatic publish of tasmota tele/sensor and tele/state
 static short g_teleState_interval = 120;
 static short g_teleSensor_interval = 3;
@@ -97,57 +123,78 @@ static short g_teleSensor_interval = 3;
 // in tcp_thread
 //
 #define MQTT_RX_BUFFER_MAX 4096
-unsigned char mqtt_rx_buffer[MQTT_RX_BUFFER_MAX];
-int mqtt_rx_buffer_head;
-int mqtt_rx_buffer_tail;
-int mqtt_rx_buffer_count;
-unsigned char temp_topic[128];
-unsigned char temp_data[2048];
-
-int addLenData(int len, const unsigned char *data){
-	mqtt_rx_buffer[mqtt_rx_buffer_head] = (len >> 8) & 0xff;
-	mqtt_rx_buffer_head = (mqtt_rx_buffer_head + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count++;
-	mqtt_rx_buffer[mqtt_rx_buffer_head] = (len) & 0xff;
-	mqtt_rx_buffer_head = (mqtt_rx_buffer_head + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count++;
-	for (int i = 0; i < len; i++){
-		mqtt_rx_buffer[mqtt_rx_buffer_head] = data[i];
-		mqtt_rx_buffer_head = (mqtt_rx_buffer_head + 1) % MQTT_RX_BUFFER_MAX;
-		mqtt_rx_buffer_count++;
-	}
-	return len + 2;
-}
-
-int getLenData(int *len, unsigned char *data, int maxlen){
-	int l;
-	l = mqtt_rx_buffer[mqtt_rx_buffer_tail];
-	mqtt_rx_buffer_tail = (mqtt_rx_buffer_tail + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count--;
-	l = l<<8;
-	l |= mqtt_rx_buffer[mqtt_rx_buffer_tail];
-	mqtt_rx_buffer_tail = (mqtt_rx_buffer_tail + 1) % MQTT_RX_BUFFER_MAX;
-	mqtt_rx_buffer_count--;
-
-	for (int i = 0; i < l; i++){
-		if (i < maxlen){
-			data[i] = mqtt_rx_buffer[mqtt_rx_buffer_tail];
-		}
-		mqtt_rx_buffer_tail = (mqtt_rx_buffer_tail + 1) % MQTT_RX_BUFFER_MAX;
-		mqtt_rx_buffer_count--;
-	}
-	if (mqtt_rx_buffer_count < 0){
-		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_rx buffer underflow!!!");
-		mqtt_rx_buffer_count = 0;
-		mqtt_rx_buffer_tail = mqtt_rx_buffer_head = 0;
-	}
-
-	if (l > maxlen){
-		*len = maxlen;
-	} else {
-		*len = l;
+#define MQTT_RX_ALIGN(x)	(((x) + 3) & ~3)
+// topicLen of a marker that says next record is at the start of buffer
+#define MQTT_RX_WRAP		0xFFFF
+
+// Each message is one contiguous record, so it can be processed in place.
+// Topic and payload are NULL terminated. Record is released only after
+// callbacks are done, so tcp_thread can keep writing behind it.
+typedef struct mqttRxRecord_s {
+	unsigned short topicLen;
+	unsigned short dataLen;
+} mqttRxRecord_t;
+
+static unsigned int mqtt_rx_buffer_storage[MQTT_RX_BUFFER_MAX / sizeof(unsigned int)];
+#define mqtt_rx_buffer ((unsigned char*)mqtt_rx_buffer_storage)
+// write and read offsets, buffer is empty when they are equal
+static int mqtt_rx_buffer_head;
+static int mqtt_rx_buffer_tail;
+
+static int MQTT_RxRecordSize(int topiclen, int datalen) {
+	return MQTT_RX_ALIGN(sizeof(mqttRxRecord_t) + topiclen + 1 + datalen + 1);
+}
+// finds place for contiguous record, head never catches up with tail
+static mqttRxRecord_t* MQTT_RxReserve(int size) {
+	mqttRxRecord_t* r;
+
+	if (mqtt_rx_buffer_head == mqtt_rx_buffer_tail) {
+		// empty, so whole buffer is available for large payloads
+		mqtt_rx_buffer_head = 0;
+		mqtt_rx_buffer_tail = 0;
+	}
+	if (mqtt_rx_buffer_head >= mqtt_rx_buffer_tail) {
+		if (MQTT_RX_BUFFER_MAX - mqtt_rx_buffer_head >= size
+			&& !(mqtt_rx_buffer_head + size == MQTT_RX_BUFFER_MAX && mqtt_rx_buffer_tail == 0)) {
+			r = (mqttRxRecord_t*)(mqtt_rx_buffer + mqtt_rx_buffer_head);
+			mqtt_rx_buffer_head = (mqtt_rx_buffer_head + size) % MQTT_RX_BUFFER_MAX;
+			return r;
+		}
+		if (size >= mqtt_rx_buffer_tail) {
+			return 0;
+		}
+		// not enough space at the end, continue at the start
+		((mqttRxRecord_t*)(mqtt_rx_buffer + mqtt_rx_buffer_head))->topicLen = MQTT_RX_WRAP;
+		mqtt_rx_buffer_head = size;
+		return (mqttRxRecord_t*)mqtt_rx_buffer;
+	}
+	if (mqtt_rx_buffer_head + size >= mqtt_rx_buffer_tail) {
+		return 0;
 	}
-	return l + 2;
+	r = (mqttRxRecord_t*)(mqtt_rx_buffer + mqtt_rx_buffer_head);
+	mqtt_rx_buffer_head += size;
+	return r;
+}
+// oldest record or NULL, it stays in buffer until MQTT_RxRelease
+static mqttRxRecord_t* MQTT_RxPeek() {
+	mqttRxRecord_t* r;
+
+	if (mqtt_rx_buffer_tail == mqtt_rx_buffer_head) {
+		return 0;
+	}
+	r = (mqttRxRecord_t*)(mqtt_rx_buffer + mqtt_rx_buffer_tail);
+	if (r->topicLen == MQTT_RX_WRAP) {
+		mqtt_rx_buffer_tail = 0;
+		if (mqtt_rx_buffer_head == 0) {
+			return 0;
+		}
+		r = (mqttRxRecord_t*)mqtt_rx_buffer;
+	}
+	return r;
+}
+static void MQTT_RxRelease(mqttRxRecord_t* r) {
+	mqtt_rx_buffer_tail = ((unsigned char*)r - mqtt_rx_buffer) + MQTT_RxRecordSize(r->topicLen, r->dataLen);
+	mqtt_rx_buffer_tail %= MQTT_RX_BUFFER_MAX;
 }
 
 static SemaphoreHandle_t g_mutex = 0;
@@ -178,47 +225,87 @@ static void MQTT_Mutex_Free()
 // system can use it to spoof MQTT packets to check if MQTT commands
 // are working...
 int MQTT_Post_Received(const char *topic, int topiclen, const unsigned char *data, int datalen){
+	mqttRxRecord_t *r = 0;
+	char *p;
+
+#if ENABLE_IO_TRACE
+	if (g_ioTraceMode) {
+		IOTrace_MqttRx(topic, topiclen, data, datalen);
+	}
+#endif
 	MQTT_Mutex_Take(100);
-	if ((MQTT_RX_BUFFER_MAX - 1 - mqtt_rx_buffer_count) < topiclen + datalen + 2 + 2){
+	if (topiclen < MQTT_RX_WRAP && datalen < MQTT_RX_WRAP) {
+		r = MQTT_RxReserve(MQTT_RxRecordSize(topiclen, datalen));
+	}
+	if (r == 0){
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_rx buffer overflow for topic %s", topic);
 	} else {
-		addLenData(topiclen, (unsigned char *)topic);
-		addLenData(datalen, data);
+		r->topicLen = topiclen;
+		r->dataLen = datalen;
+		p = (char*)(r + 1);
+		memcpy(p, topic, topiclen);
+		p[topiclen] = 0;
+		p += topiclen + 1;
+		memcpy(p, data, datalen);
+		p[datalen] = 0;
 	}
 	MQTT_Mutex_Free();
-
+	// command will be run, don't make it wait in power save
+	PowerGov_Kick();
 
 #ifdef PLATFORM_BEKEN
 	MQTT_TriggerRead();
+#else
+	QuickTick_Wake();
 #endif
 	return 1;
 }
 int MQTT_Post_Received_Str(const char *topic, const char *data) {
 	return MQTT_Post_Received(topic, strlen(topic), (const unsigned char*)data, strlen(data));
 }
-int get_received(char **topic, int *topiclen, unsigned char **data, int *datalen){
-	int res = 0;
+// returns record with topic and data pointing into rx buffer,
+// caller must pass it to MQTT_RxRelease when done
+static mqttRxRecord_t* get_received(char **topic, int *topiclen, unsigned char **data, int *datalen){
+	mqttRxRecord_t *r;
+
 	MQTT_Mutex_Take(100);
-	if (mqtt_rx_buffer_tail != mqtt_rx_buffer_head){
-		getLenData(topiclen, temp_topic, sizeof(temp_topic)-1);
-		temp_topic[*topiclen] = 0;
-		getLenData(datalen, temp_data, sizeof(temp_data)-1);
-		temp_data[*datalen] = 0;
-		*topic = (char *)temp_topic;
-		*data = temp_data;
-		res = 1;
-	}
+	r = MQTT_RxPeek();
 	MQTT_Mutex_Free();
-	return res;
+	if (r) {
+		*topic = (char*)(r + 1);
+		*topiclen = r->topicLen;
+		*data = (unsigned char*)(*topic + r->topicLen + 1);
+		*datalen = r->dataLen;
+	}
+	return r;
 }
 //
 //////////////////////////////////////////////////////////////////////
 
-#define MQTT_QUEUE_ITEM_IS_REUSABLE(x)  (x->topic[0] == 0)
-#define MQTT_QUEUE_ITEM_SET_REUSABLE(x) (x->topic[0] = 0)
+#define MQTT_QUEUE_ALIGN(x)		(((x) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
 
-MqttPublishItem_t* g_MqttPublishQueueHead = NULL;
-int g_MqttPublishItemsQueued = 0;   //Items in the queue waiting to be published. This is not the queue length.
+/// @brief Chunk of publish queue, items are appended at writePos
+/// and taken from readPos, so both ends of the queue are O(1)
+typedef struct MqttPublishChunk
+{
+	struct MqttPublishChunk* next;
+	int capacity;
+	int readPos;
+	int writePos;
+} MqttPublishChunk_t;
+
+#define MQTT_CHUNK_DATA(c)		((byte*)((c) + 1))
+
+static MqttPublishChunk_t* g_MqttPublishQueueHead = NULL;
+static MqttPublishChunk_t* g_MqttPublishQueueTail = NULL;
+// most recently queued item, for MQTT_InvokeCommandAtEnd
+static MqttPublishItem_t* g_MqttPublishQueueLast = NULL;
+// memory taken by chunks
+static int g_MqttPublishQueueBytes = 0;
+int g_MqttPublishItemsQueued = 0;   //Items in the queue waiting to be published.
+// queued items by topic and channel, for coalescing
+static MqttPublishItem_t* g_MqttPublishQueueKeys[MQTT_QUEUE_KEY_BUCKETS];
+static int g_MqttQueueCoalesce = MQTT_QUEUE_COALESCE_RETAINED;
 
 // from mqtt.c
 extern void mqtt_disconnect(mqtt_client_t* client);
@@ -237,17 +324,71 @@ static int mqtt_received_events = 0;
 
 static int g_just_connected = 0;
 
+// Fast reconnect after a short outage.
+// Broker address of the last good connection is reused, so reconnect
+// doesn't wait for DNS, and first retry is done a second after
+// disconnect, then the delay doubles up to LOOPS_WITH_DISCONNECTED.
+static ip_addr_t mqtt_ip_cached;
+static unsigned int mqtt_ip_cached_hostHash = 0;
+static bool mqtt_ip_cached_valid = false;
+// connect in progress with cached address, cache is dropped if it fails
+static volatile bool mqtt_connecting = false;
+static int g_mqttReconnectBackoff = 1;
+// when connection was lost, -1 while connected or before first connect
+static volatile int g_mqttDisconnectedAt = -1;
+static bool g_mqttConnectedOnce = false;
+// publishes refused because MQTT was down, they need a republish
+static int g_mqttLostPublishes = 0;
+// after outage up to this long, retained values on broker are still
+// considered valid and whole state is not published again
+#define MQTT_RESUME_MAX_OUTAGE	60
+
+#if MQTT_USE_TLS
+// TLS session of the last good connection, offered to broker again on
+// reconnect, so it can be resumed (session ID or ticket) without the
+// full handshake. Kept only in RAM.
+static mbedtls_ssl_session mqtt_tls_session;
+static bool mqtt_tls_session_valid = false;
+static unsigned int mqtt_tls_session_hostHash = 0;
+static int g_mqttTlsResume = 1;
+// MBEDTLS_SSL_MAX_FRAG_LEN_xxx asked from broker, so it doesn't send
+// records larger than our input buffer
+static int g_mqttTlsMaxFragCode = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+#endif
+
 
 typedef struct mqtt_callback_tag {
-	char* topic;
-	char* subscriptionTopic;
+	// both from string pool, many callbacks share the same base topic
+	const char* topic;
+	const char* subscriptionTopic;
 	int ID;
+	// registration order, callbacks for one topic are tried in this order
+	int order;
 	mqtt_callback_fn callback;
+	// all callbacks
+	struct mqtt_callback_tag* next;
+	// trie node of subscription topic and next callback in it
+	struct mqtt_topicNode_tag* node;
+	struct mqtt_callback_tag* nextInNode;
 } mqtt_callback_t;
 
-#define MAX_MQTT_CALLBACKS 32
-static mqtt_callback_t* callbacks[MAX_MQTT_CALLBACKS];
-static int numCallbacks = 0;
+// Trie of subscription topics, one level per node, so incoming topic
+// is routed in time proportional to its depth, not to callback count
+typedef struct mqtt_topicNode_tag {
+	struct mqtt_topicNode_tag* sibling;
+	struct mqtt_topicNode_tag* children;
+	// wildcard children, '+' for single level and '#' for the rest
+	struct mqtt_topicNode_tag* plus;
+	struct mqtt_topicNode_tag* hash;
+	mqtt_callback_t* callbacks;
+	char level[1];
+} mqtt_topicNode_t;
+
+// most callbacks that can get a single message
+#define MAX_MQTT_MATCHED_CALLBACKS 16
+static mqtt_callback_t* callbacks = 0;
+static mqtt_topicNode_t* g_mqttTopicTrie = 0;
+static int g_mqttCallbackOrder = 0;
 // note: only one incomming can be processed at a time.
 static obk_mqtt_request_t g_mqtt_request;
 static obk_mqtt_request_t g_mqtt_request_cb;
@@ -255,6 +396,8 @@ static obk_mqtt_request_t g_mqtt_request_cb;
 #define LOOPS_WITH_DISCONNECTED 15
 int mqtt_loopsWithDisconnected = 0;
 int mqtt_reconnect = 0;
+// first connect since boot is logged as boot phase
+static bool mqtt_wasConnected = false;
 // set for the device to broadcast self state on start
 int g_bPublishAllStatesNow = 0;
 int g_publishItemIndex = PUBLISHITEM_ALL_INDEX_FIRST;
@@ -399,22 +542,161 @@ char* MQTT_GetStatusMessage(void)
 	return mqtt_status_message;
 }
 
-void MQTT_ClearCallbacks() {
+static mqtt_topicNode_t* MQTT_Trie_NewNode(const char* level, int len) {
+	mqtt_topicNode_t* n;
+
+	n = (mqtt_topicNode_t*)os_malloc(sizeof(mqtt_topicNode_t) + len);
+	if (n == 0) {
+		return 0;
+	}
+	memset(n, 0, sizeof(mqtt_topicNode_t));
+	memcpy(n->level, level, len);
+	n->level[len] = 0;
+	return n;
+}
+static void MQTT_Trie_Free(mqtt_topicNode_t* n) {
+	mqtt_topicNode_t* next;
+
+	while (n) {
+		next = n->sibling;
+		MQTT_Trie_Free(n->children);
+		MQTT_Trie_Free(n->plus);
+		MQTT_Trie_Free(n->hash);
+		os_free(n);
+		n = next;
+	}
+}
+// finds or adds node for subscription topic filter
+static mqtt_topicNode_t* MQTT_Trie_Get(const char* filter) {
+	mqtt_topicNode_t* n, ** slot;
+	const char* end;
+	int len;
+
+	if (g_mqttTopicTrie == 0) {
+		g_mqttTopicTrie = MQTT_Trie_NewNode("", 0);
+		if (g_mqttTopicTrie == 0) {
+			return 0;
+		}
+	}
+	n = g_mqttTopicTrie;
+	while (1) {
+		end = strchr(filter, '/');
+		len = end ? end - filter : strlen(filter);
+		if (len == 1 && *filter == '+') {
+			slot = &n->plus;
+		}
+		else if (len == 1 && *filter == '#') {
+			slot = &n->hash;
+		}
+		else {
+			for (slot = &n->children; *slot; slot = &(*slot)->sibling) {
+				if (!strncmp((*slot)->level, filter, len) && (*slot)->level[len] == 0) {
+					break;
+				}
+			}
+		}
+		if (*slot == 0) {
+			*slot = MQTT_Trie_NewNode(filter, len);
+			if (*slot == 0) {
+				return 0;
+			}
+		}
+		n = *slot;
+		if (end == 0) {
+			return n;
+		}
+		filter = end + 1;
+	}
+}
+static void MQTT_Trie_Unlink(mqtt_callback_t* cb) {
+	mqtt_callback_t** prev;
+
+	if (cb->node == 0) {
+		return;
+	}
+	for (prev = &cb->node->callbacks; *prev; prev = &(*prev)->nextInNode) {
+		if (*prev == cb) {
+			*prev = cb->nextInNode;
+			break;
+		}
+	}
+	cb->node = 0;
+	cb->nextInNode = 0;
+}
+static void MQTT_Trie_Collect(mqtt_topicNode_t* n, mqtt_callback_t** out, int* count) {
+	mqtt_callback_t* cb;
 	int i;
-	for (i = 0; i < MAX_MQTT_CALLBACKS; i++) {
-		if (callbacks[i]) {
-			free(callbacks[i]->topic);
-			free(callbacks[i]->subscriptionTopic);
-			free(callbacks[i]);
-			callbacks[i] = 0;
+
+	if (n == 0) {
+		return;
+	}
+	for (cb = n->callbacks; cb && *count < MAX_MQTT_MATCHED_CALLBACKS; cb = cb->nextInNode) {
+		// keep registration order
+		for (i = *count; i > 0 && out[i - 1]->order > cb->order; i--) {
+			out[i] = out[i - 1];
 		}
+		out[i] = cb;
+		(*count)++;
+	}
+}
+static void MQTT_Trie_Match(mqtt_topicNode_t* n, const char* topic, mqtt_callback_t** out, int* count) {
+	mqtt_topicNode_t* c;
+	const char* end;
+	int len;
+
+	if (n == 0) {
+		return;
+	}
+	// '#' matches this level and everything below
+	MQTT_Trie_Collect(n->hash, out, count);
+	end = strchr(topic, '/');
+	len = end ? end - topic : strlen(topic);
+	for (c = n->children; c; c = c->sibling) {
+		if (!strncmp(c->level, topic, len) && c->level[len] == 0) {
+			break;
+		}
+	}
+	if (end) {
+		MQTT_Trie_Match(c, end + 1, out, count);
+		MQTT_Trie_Match(n->plus, end + 1, out, count);
+		return;
+	}
+	if (c) {
+		MQTT_Trie_Collect(c, out, count);
+		// "a/#" also matches "a"
+		MQTT_Trie_Collect(c->hash, out, count);
 	}
+	if (n->plus) {
+		MQTT_Trie_Collect(n->plus, out, count);
+		MQTT_Trie_Collect(n->plus->hash, out, count);
+	}
+}
+// callbacks that subscribed to topic, in registration order
+static int MQTT_FindCallbacks(const char* topic, mqtt_callback_t** out) {
+	int count = 0;
+
+	MQTT_Trie_Match(g_mqttTopicTrie, topic, out, &count);
+	return count;
+}
+
+void MQTT_ClearCallbacks() {
+	mqtt_callback_t* cb;
+
+	while (callbacks) {
+		cb = callbacks;
+		callbacks = cb->next;
+		StringPool_Release(cb->topic);
+		StringPool_Release(cb->subscriptionTopic);
+		MemPool_Free(cb);
+	}
+	MQTT_Trie_Free(g_mqttTopicTrie);
+	g_mqttTopicTrie = 0;
 }
 // this can REPLACE callbacks, since we MAY wish to change the root topic....
 // in which case we would re-resigster all callbacks?
 int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic, int ID, mqtt_callback_fn callback) {
-	int index;
-	int i;
+	mqtt_callback_t* cb, * other, ** last;
+	mqtt_topicNode_t* node;
 	int subscribechange = 0;
 	if (!basetopic || !subscriptiontopic || !callback) {
 		return -1;
@@ -422,79 +704,64 @@ int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic,
 	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT_RegisterCallback called for bT %s subT %s", basetopic, subscriptiontopic);
 
 	// find existing to replace
-	for (index = 0; index < numCallbacks; index++) {
-		if (callbacks[index]) {
-			if (callbacks[index]->ID == ID) {
-				break;
-			}
-		}
-	}
-
-	// find empty if any (empty by MQTT_RemoveCallback)
-	if (index == numCallbacks) {
-		for (index = 0; index < numCallbacks; index++) {
-			if (!callbacks[index]) {
-				break;
-			}
+	for (last = &callbacks; *last; last = &(*last)->next) {
+		if ((*last)->ID == ID) {
+			break;
 		}
 	}
-
-	if (index >= MAX_MQTT_CALLBACKS) {
-		return -4;
-	}
-	if (!callbacks[index]) {
-		callbacks[index] = (mqtt_callback_t*)os_malloc(sizeof(mqtt_callback_t));
-		if (callbacks[index] != 0) {
-			memset(callbacks[index], 0, sizeof(mqtt_callback_t));
+	cb = *last;
+	if (!cb) {
+		cb = (mqtt_callback_t*)MemPool_Alloc(sizeof(mqtt_callback_t));
+		if (!cb) {
+			return -2;
 		}
+		memset(cb, 0, sizeof(mqtt_callback_t));
+		cb->ID = ID;
+		cb->order = g_mqttCallbackOrder++;
+		// append, so list stays in registration order
+		*last = cb;
 	}
-	if (!callbacks[index]) {
-		return -2;
-	}
-	if (!callbacks[index]->topic || strcmp(callbacks[index]->topic, basetopic)) {
-		if (callbacks[index]->topic) {
-			os_free(callbacks[index]->topic);
-		}
-		callbacks[index]->topic = (char*)os_malloc(strlen(basetopic) + 1);
-		if (!callbacks[index]->topic) {
-			os_free(callbacks[index]);
+	if (!cb->topic || strcmp(cb->topic, basetopic)) {
+		StringPool_Release(cb->topic);
+		cb->topic = StringPool_Intern(basetopic);
+		if (!cb->topic) {
+			MQTT_RemoveCallback(ID);
 			return -3;
 		}
-		strcpy(callbacks[index]->topic, basetopic);
 	}
 
-	if (!callbacks[index]->subscriptionTopic || strcmp(callbacks[index]->subscriptionTopic, subscriptiontopic)) {
-		if (callbacks[index]->subscriptionTopic) {
-			os_free(callbacks[index]->subscriptionTopic);
-		}
-		callbacks[index]->subscriptionTopic = (char*)os_malloc(strlen(subscriptiontopic) + 1);
-		callbacks[index]->subscriptionTopic[0] = '\0';
-		if (!callbacks[index]->subscriptionTopic) {
-			os_free(callbacks[index]->topic);
-			os_free(callbacks[index]);
+	if (!cb->subscriptionTopic || strcmp(cb->subscriptionTopic, subscriptiontopic)) {
+		const char *interned;
+
+		interned = StringPool_Intern(subscriptiontopic);
+		node = MQTT_Trie_Get(subscriptiontopic);
+		if (!interned || !node) {
+			StringPool_Release(interned);
+			MQTT_RemoveCallback(ID);
 			return -3;
 		}
+		StringPool_Release(cb->subscriptionTopic);
+		cb->subscriptionTopic = 0;
+		MQTT_Trie_Unlink(cb);
 
 		// find out if this subscription is new.
-		for (i = 0; i < numCallbacks; i++) {
-			if (callbacks[i]) {
-				if (callbacks[i]->subscriptionTopic &&
-					!strcmp(callbacks[i]->subscriptionTopic, subscriptiontopic)) {
-					break;
-				}
+		// Interned strings are equal only if pointers are equal
+		for (other = callbacks; other; other = other->next) {
+			if (other->subscriptionTopic == interned) {
+				break;
 			}
 		}
-		strcpy(callbacks[index]->subscriptionTopic, subscriptiontopic);
+		cb->subscriptionTopic = interned;
+		cb->node = node;
+		cb->nextInNode = node->callbacks;
+		node->callbacks = cb;
 		// if this subscription is new, must reconnect
-		if (i == numCallbacks) {
+		if (!other) {
 			subscribechange++;
 		}
 	}
 
-	callbacks[index]->callback = callback;
-	if (index == numCallbacks) {
-		numCallbacks++;
-	}
+	cb->callback = callback;
 
 	if (subscribechange) {
 		if (mqtt_client) {
@@ -506,26 +773,20 @@ int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic,
 }
 
 int MQTT_RemoveCallback(int ID) {
-	int index;
-
-	for (index = 0; index < numCallbacks; index++) {
-		if (callbacks[index]) {
-			if (callbacks[index]->ID == ID) {
-				if (callbacks[index]->topic) {
-					os_free(callbacks[index]->topic);
-					callbacks[index]->topic = NULL;
-				}
-				if (callbacks[index]->subscriptionTopic) {
-					os_free(callbacks[index]->subscriptionTopic);
-					callbacks[index]->subscriptionTopic = NULL;
-				}
-				os_free(callbacks[index]);
-				callbacks[index] = NULL;
-				if (mqtt_client) {
-					mqtt_reconnect = 8;
-				}
-				return 1;
+	mqtt_callback_t* cb, ** prev;
+
+	for (prev = &callbacks; *prev; prev = &(*prev)->next) {
+		cb = *prev;
+		if (cb->ID == ID) {
+			*prev = cb->next;
+			MQTT_Trie_Unlink(cb);
+			StringPool_Release(cb->topic);
+			StringPool_Release(cb->subscriptionTopic);
+			MemPool_Free(cb);
+			if (mqtt_client) {
+				mqtt_reconnect = 8;
 			}
+			return 1;
 		}
 	}
 	return 0;
@@ -788,8 +1049,8 @@ int tasCmnd(obk_mqtt_request_t* request) {
 
 #if 1
 	args = (const char *)request->received;
-	// I think that our function get_received always ensured that
-	// there is a NULL terminating character after payload of MQTT
+	// MQTT_Post_Received always puts a NULL terminating character
+	// after payload of MQTT, also when payload is processed in place
 	// So we can feed it directly as command
 	CMD_ExecuteCommandArgs(p, args, COMMAND_FLAG_SOURCE_MQTT);
 #if ENABLE_TASMOTA_JSON
@@ -854,7 +1115,48 @@ static void mqtt_pub_request_cb(void* arg, err_t result)
 }
 
 // This publishes value to the specified topic/channel.
-static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const char* sTopic, const char* sChannel, const char* sVal, int flags, bool appendGet)
+static int MQTT_RateLimit_Class(int flags)
+{
+	if (flags & OBK_PUBLISH_FLAG_REPLY)
+		return MQTT_PRIO_REPLY;
+	if (flags & OBK_PUBLISH_FLAG_TELE)
+		return MQTT_PRIO_TELE;
+	return MQTT_PRIO_STATE;
+}
+static bool MQTT_RateLimit_Allows(int prio)
+{
+	if (g_mqttRatePerSecond <= 0)
+		return true;
+	if (prio == MQTT_PRIO_TELE)
+		return g_mqttRateTokens > g_mqttRateTeleReserve;
+	if (prio == MQTT_PRIO_STATE)
+		return g_mqttRateTokens > 0;
+	return true;
+}
+// takes a token for publish with given flags, returns false if it has to wait
+static bool MQTT_RateLimit_Take(int flags)
+{
+	int prio = MQTT_RateLimit_Class(flags);
+
+	if (!MQTT_RateLimit_Allows(prio)) {
+		g_mqttRateDeferred[prio]++;
+		return false;
+	}
+	// replies may run into debt, which holds back the others for a while
+	if (g_mqttRatePerSecond > 0 && g_mqttRateTokens > -g_mqttRateBurst)
+		g_mqttRateTokens--;
+	return true;
+}
+static void MQTT_RateLimit_Refill()
+{
+	if (g_mqttRatePerSecond <= 0)
+		return;
+	g_mqttRateTokens += g_mqttRatePerSecond;
+	if (g_mqttRateTokens > g_mqttRateBurst)
+		g_mqttRateTokens = g_mqttRateBurst;
+}
+
+static OBK_Publish_Result MQTT_SendTopicToClient(mqtt_client_t* client, const char* sTopic, const char* sChannel, const char* sVal, int flags, bool appendGet)
 {
 	err_t err;
 	u8_t qos = 1; /* 0 1 or 2, see MQTT specification */
@@ -879,7 +1181,7 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 	else {
 		if (MQTT_Mutex_Take(500) == 0)
 		{
-			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_PublishTopicToClient: mutex failed for %s=%s\r\n", sChannel, sVal);
+			addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "MQTT_SendTopicToClient: mutex failed for %s=%s\r\n", sChannel, sVal);
 			return OBK_PUBLISH_MUTEX_FAIL;
 		}
 	}
@@ -909,6 +1211,7 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 	if (res == 0)
 	{
 		g_my_reconnect_mqtt_after_time = 5;
+		g_mqttLostPublishes++;
 		MQTT_Mutex_Free();
 		return OBK_PUBLISH_WAS_DISCONNECTED;
 	}
@@ -939,6 +1242,11 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 		LOCK_TCPIP_CORE();
 		err = mqtt_publish(client, pub_topic, sVal, strlen(sVal), qos, retain, mqtt_pub_request_cb, 0);
 		UNLOCK_TCPIP_CORE();
+#if ENABLE_IO_TRACE
+		if (g_ioTraceMode && err == ERR_OK) {
+			IOTrace_MqttTx(pub_topic, sVal, strlen(sVal));
+		}
+#endif
 		os_free(pub_topic);
 
 		if (err != ERR_OK)
@@ -968,24 +1276,61 @@ static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const
 	}
 }
 
+static OBK_Publish_Result MQTT_PublishTopicToClient(mqtt_client_t* client, const char* sTopic, const char* sChannel, const char* sVal, int flags, bool appendGet)
+{
+	char channelWithGet[MQTT_PUBLISH_ITEM_CHANNEL_LENGTH + 1];
+
+	if (client == 0)
+		return OBK_PUBLISH_WAS_DISCONNECTED;
+	if (!MQTT_RateLimit_Take(flags))
+	{
+		// send it later, from queue
+		if (appendGet && !(flags & OBK_PUBLISH_FLAG_FORCE_REMOVE_GET) && !CFG_HasFlag(OBK_FLAG_MQTT_NEVERAPPENDGET)
+			&& !(flags & OBK_PUBLISH_FLAG_RAW_TOPIC_NAME))
+		{
+			snprintf(channelWithGet, sizeof(channelWithGet), "%s/get", sChannel);
+			sChannel = channelWithGet;
+		}
+		MQTT_QueuePublish(sTopic, sChannel, sVal, flags);
+		return OBK_PUBLISH_OK;
+	}
+	return MQTT_SendTopicToClient(client, sTopic, sChannel, sVal, flags, appendGet);
+}
+
 // This is used to publish channel values in "obk0696FB33/1/get" format with numerical value,
 // This is also used to publish custom information with string name,
 // for example, "obk0696FB33/voltage/get" is used to publish voltage from the sensor
 static OBK_Publish_Result MQTT_PublishMain(mqtt_client_t* client, const char* sChannel, const char* sVal, int flags, bool appendGet)
 {
+	OBK_Publish_Result res;
+
+	if (flags & OBK_PUBLISH_FLAG_DEDUP)
+	{
+		// hashing is much cheaper than the send it can save
+		if (MQTT_Dedup_IsUnchanged(CFG_GetMQTTClientId(), sChannel, sVal, flags))
+		{
+			return OBK_PUBLISH_OK;
+		}
+		res = MQTT_PublishTopicToClient(mqtt_client, CFG_GetMQTTClientId(), sChannel, sVal, flags, appendGet);
+		if (res == OBK_PUBLISH_OK)
+		{
+			MQTT_Dedup_MarkSent(CFG_GetMQTTClientId(), sChannel, sVal, flags);
+		}
+		return res;
+	}
 	return MQTT_PublishTopicToClient(mqtt_client, CFG_GetMQTTClientId(), sChannel, sVal, flags, appendGet);
 }
 OBK_Publish_Result MQTT_PublishTele(const char* teleName, const char* teleValue)
 {
 	char topic[64];
 	snprintf(topic, sizeof(topic), "tele/%s", CFG_GetMQTTClientId());
-	return MQTT_PublishTopicToClient(mqtt_client, topic, teleName, teleValue, 0, false);
+	return MQTT_PublishTopicToClient(mqtt_client, topic, teleName, teleValue, OBK_PUBLISH_FLAG_TELE, false);
 }
 OBK_Publish_Result MQTT_PublishStat(const char* statName, const char* statValue)
 {
 	char topic[64];
 	snprintf(topic,sizeof(topic),"stat/%s", CFG_GetMQTTClientId());
-	return MQTT_PublishTopicToClient(mqtt_client, topic, statName, statValue, 0, false);
+	return MQTT_PublishTopicToClient(mqtt_client, topic, statName, statValue, OBK_PUBLISH_FLAG_REPLY, false);
 }
 /// @brief Publish a MQTT message immediately.
 /// @param sTopic 
@@ -1007,7 +1352,7 @@ void MQTT_OBK_Printf(char* s) {
 // we should do callbacks from one of our threads?
 static void mqtt_incoming_data_cb(void* arg, const u8_t* data, u16_t len, u8_t flags)
 {
-	int i;
+	mqtt_callback_t* matched[MAX_MQTT_MATCHED_CALLBACKS];
 	// unused - left here as example
 	//const struct mqtt_connect_client_info_t* client_info = (const struct mqtt_connect_client_info_t*)arg;
 
@@ -1021,23 +1366,11 @@ static void mqtt_incoming_data_cb(void* arg, const u8_t* data, u16_t len, u8_t f
 		//addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT in topic %s", g_mqtt_request.topic);
 		mqtt_received_events++;
 
-		for (i = 0; i < numCallbacks; i++)
+		// if ANYONE is interested, store it.
+		// Callbacks are run later from our thread, see MQTT_process_received
+		if (MQTT_FindCallbacks(g_mqtt_request.topic, matched))
 		{
-			if (callbacks[i] == 0)
-				continue;
-			char* cbtopic = callbacks[i]->topic;
-			if (!strncmp(g_mqtt_request.topic, cbtopic, strlen(cbtopic)))
-			{
-				MQTT_Post_Received(g_mqtt_request.topic, strlen(g_mqtt_request.topic), data, len);
-				// if ANYONE is interested, store it.
-				break;
-				// note - callback must return 1 to say it ate the mqtt, else further processing can be performed.
-				// i.e. multiple people can get each topic if required.
-				//if (callbacks[i]->callback(&g_mqtt_request))
-				//{
-				//	return;
-				//}
-			}
+			MQTT_Post_Received(g_mqtt_request.topic, strlen(g_mqtt_request.topic), data, len);
 		}
 		//addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT topic not handled: %s", g_mqtt_request.topic);
 	}
@@ -1050,7 +1383,9 @@ int MQTT_process_received(){
 	int topiclen;
 	unsigned char *data;
 	int datalen;
-	int found = 0;
+	mqttRxRecord_t *found;
+	mqtt_callback_t *matched[MAX_MQTT_MATCHED_CALLBACKS];
+	int matchedCount;
 	int count = 0;
 	do{
 		found = get_received(&topic, &topiclen, &data, &datalen);
@@ -1059,20 +1394,20 @@ int MQTT_process_received(){
 			strncpy(g_mqtt_request_cb.topic, topic, sizeof(g_mqtt_request_cb.topic));
 			g_mqtt_request_cb.received = data;
 			g_mqtt_request_cb.receivedLen = datalen;
-			for (int i = 0; i < numCallbacks; i++)
+			matchedCount = MQTT_FindCallbacks(topic, matched);
+			for (int i = 0; i < matchedCount; i++)
 			{
-				char* cbtopic = callbacks[i]->topic;
-				if (!strncmp(topic, cbtopic, strlen(cbtopic)))
+				// note - callback must return 1 to say it ate the mqtt, else further processing can be performed.
+				// i.e. multiple people can get each topic if required.
+				if (matched[i]->callback(&g_mqtt_request_cb))
 				{
-					// note - callback must return 1 to say it ate the mqtt, else further processing can be performed.
-					// i.e. multiple people can get each topic if required.
-					if (callbacks[i]->callback(&g_mqtt_request_cb))
-					{
-						// if no further processing, then break this loop.
-						break;
-					}
+					// if no further processing, then break this loop.
+					break;
 				}
 			}
+			MQTT_Mutex_Take(100);
+			MQTT_RxRelease(found);
+			MQTT_Mutex_Free();
 		}
 	} while (found);
 
@@ -1085,21 +1420,16 @@ int MQTT_process_received(){
 static void mqtt_incoming_publish_cb(void* arg, const char* topic, u32_t tot_len)
 {
 	//const char *p;
-	int i;
+	mqtt_callback_t* matched[MAX_MQTT_MATCHED_CALLBACKS];
 	// unused - left here as example
 	//const struct mqtt_connect_client_info_t* client_info = (const struct mqtt_connect_client_info_t*)arg;
 
 	// look for a callback with this URL and method, or HTTP_ANY
 	g_mqtt_request.topic[0] = '\0';
-	for (i = 0; i < numCallbacks; i++)
+	if (MQTT_FindCallbacks(topic, matched))
 	{
-		char* cbtopic = callbacks[i]->topic;
-		if (strncmp(topic, cbtopic, strlen(cbtopic)))
-		{
-			strncpy(g_mqtt_request.topic, topic, sizeof(g_mqtt_request.topic) - 1);
-			g_mqtt_request.topic[sizeof(g_mqtt_request.topic) - 1] = 0;
-			break;
-		}
+		strncpy(g_mqtt_request.topic, topic, sizeof(g_mqtt_request.topic) - 1);
+		g_mqtt_request.topic[sizeof(g_mqtt_request.topic) - 1] = 0;
 	}
 	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT client in mqtt_incoming_publish_cb topic %s\n", topic);
 }
@@ -1112,11 +1442,67 @@ static void mqtt_request_cb(void* arg, err_t err)
 	}
 }
 
+static unsigned int MQTT_HostHash(const char* s)
+{
+	unsigned int hash = 5381;
+
+	while (*s) {
+		hash = ((hash << 5) + hash) + (byte)*s;
+		s++;
+	}
+	return hash;
+}
+static void MQTT_NoteDisconnected()
+{
+	if (g_mqttConnectedOnce && g_mqttDisconnectedAt < 0) {
+		g_mqttDisconnectedAt = g_secondsElapsed;
+	}
+}
+#if MQTT_USE_TLS
+static void MQTT_TLS_DropSession()
+{
+	mbedtls_ssl_session_free(&mqtt_tls_session);
+	mqtt_tls_session_valid = false;
+}
+static void MQTT_TLS_SaveSession(mbedtls_ssl_context* ssl)
+{
+	MQTT_TLS_DropSession();
+	if (!g_mqttTlsResume) {
+		return;
+	}
+	if (mbedtls_ssl_get_session(ssl, &mqtt_tls_session) == 0) {
+		mqtt_tls_session_hostHash = MQTT_HostHash(CFG_GetMQTTHost());
+		mqtt_tls_session_valid = true;
+	}
+}
+// must be called after new connection is set up, but before handshake,
+// so with TCPIP core still locked after mqtt_client_connect
+static void MQTT_TLS_OfferSession(mqtt_client_t* client)
+{
+	altcp_mbedtls_state_t* state;
+
+	if (!mqtt_tls_session_valid) {
+		return;
+	}
+	if (!g_mqttTlsResume || mqtt_tls_session_hostHash != MQTT_HostHash(CFG_GetMQTTHost())) {
+		MQTT_TLS_DropSession();
+		return;
+	}
+	if (client->conn == 0 || client->conn->state == 0) {
+		return;
+	}
+	state = client->conn->state;
+	if (mbedtls_ssl_set_session(&state->ssl_context, &mqtt_tls_session) == 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Resuming TLS session");
+	}
+}
+#endif
+
 /////////////////////////////////////////////
 // should be called in tcp_thread context.
 static void mqtt_connection_cb(mqtt_client_t* client, void* arg, mqtt_connection_status_t status)
 {
-	int i;
+	mqtt_callback_t* cb;
 	char tmp[CGF_MQTT_CLIENT_ID_SIZE + 16];
 	const char* clientId;
 	err_t err = ERR_OK;
@@ -1129,6 +1515,15 @@ static void mqtt_connection_cb(mqtt_client_t* client, void* arg, mqtt_connection
 	if (status == MQTT_CONNECT_ACCEPTED)
 	{
 		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "mqtt_connection_cb: Successfully connected\n");
+		if (mqtt_wasConnected == false) {
+			mqtt_wasConnected = true;
+			Main_LogBootPhase("mqtt up");
+		}
+		MQTT_Dedup_ResetCache();
+		mqtt_connecting = false;
+		mqtt_ip_cached = mqtt_ip;
+		mqtt_ip_cached_hostHash = MQTT_HostHash(CFG_GetMQTTHost());
+		mqtt_ip_cached_valid = true;
 
 #if LWIP_ALTCP_TLS_MBEDTLS
 		if (CFG_GetMQTTUseTls() && client && client->conn && client->conn->state) {
@@ -1136,6 +1531,7 @@ static void mqtt_connection_cb(mqtt_client_t* client, void* arg, mqtt_connection
 			mbedtls_ssl_context* ssl = &state->ssl_context;
 			addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT TLS VERSION: %s\n", mbedtls_ssl_get_version(ssl));
 			addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT TLS CIPHER : %s\n", mbedtls_ssl_get_ciphersuite(ssl));
+			MQTT_TLS_SaveSession(ssl);
 		}
 #endif
 
@@ -1149,19 +1545,17 @@ static void mqtt_connection_cb(mqtt_client_t* client, void* arg, mqtt_connection
 		// subscribe to all callback subscription topics
 		// this makes a BIG assumption that we can subscribe multiple times to the same one?
 		// TODO - check that subscribing multiple times to the same topic is not BAD
-		for (i = 0; i < numCallbacks; i++) {
-			if (callbacks[i]) {
-				if (callbacks[i]->subscriptionTopic && callbacks[i]->subscriptionTopic[0]) {
-					err = mqtt_sub_unsub(client,
-						callbacks[i]->subscriptionTopic, 1,
-						mqtt_request_cb, LWIP_CONST_CAST(void*, client_info),
-						1);
-					if (err != ERR_OK) {
-						addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "mqtt_subscribe to %s return: %d\n", callbacks[i]->subscriptionTopic, err);
-					}
-					else {
-						addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "mqtt_subscribed to %s\n", callbacks[i]->subscriptionTopic);
-					}
+		for (cb = callbacks; cb; cb = cb->next) {
+			if (cb->subscriptionTopic && cb->subscriptionTopic[0]) {
+				err = mqtt_sub_unsub(client,
+					cb->subscriptionTopic, 1,
+					mqtt_request_cb, LWIP_CONST_CAST(void*, client_info),
+					1);
+				if (err != ERR_OK) {
+					addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "mqtt_subscribe to %s return: %d\n", cb->subscriptionTopic, err);
+				}
+				else {
+					addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "mqtt_subscribed to %s\n", cb->subscriptionTopic);
 				}
 			}
 		}
@@ -1192,6 +1586,20 @@ static void mqtt_connection_cb(mqtt_client_t* client, void* arg, mqtt_connection
 	}
 	else {
 		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "mqtt_connection_cb: Disconnected, reason: %d(%s)\n", status, get_callback_error(status));
+		if (mqtt_connecting) {
+			// broker may have moved, resolve it again next time
+			mqtt_connecting = false;
+			mqtt_ip_cached_valid = false;
+#if MQTT_USE_TLS
+			// broker may not like our old session, do full handshake next time
+			MQTT_TLS_DropSession();
+#endif
+		}
+		else {
+			// count reconnect delay from now, not from when our thread notices
+			MQTT_NoteDisconnected();
+			mqtt_loopsWithDisconnected = 0;
+		}
 	}
 }
 
@@ -1281,7 +1689,6 @@ static int MQTT_do_connect(mqtt_client_t* client)
 	// host name/ip
 	if (NULL != hostEntry)
 	{
-#ifndef LINUX
 		if (hostEntry->h_addr_list && hostEntry->h_addr_list[0]) {
 			int len = hostEntry->h_length;
 			if (len > 4) {
@@ -1290,14 +1697,20 @@ static int MQTT_do_connect(mqtt_client_t* client)
 			}
 			memcpy(&mqtt_ip, hostEntry->h_addr_list[0], len);
 		}
-		else 
-#endif
+		else
 		{
 			addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "mqtt_host resolves no addresses?\r\n");
 			snprintf(mqtt_status_message, sizeof(mqtt_status_message), "mqtt_host resolves no addresses?");
 			return 0;
 		}
 #else
+	if (dns_in_progress_time <= 0 && !dns_resolved && mqtt_ip_cached_valid
+		&& mqtt_ip_cached_hostHash == MQTT_HostHash(mqtt_host))
+	{
+		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "mqtt_host %s - using address from last connection\r\n", mqtt_host);
+		memcpy(&mqtt_ip_resolved, &mqtt_ip_cached, sizeof(mqtt_ip_resolved));
+		dns_resolved = true;
+	}
 	if (dns_in_progress_time <= 0 && !dns_resolved)
 	{
 #ifdef PLATFORM_XR809
@@ -1376,6 +1789,11 @@ static int MQTT_do_connect(mqtt_client_t* client)
 				else {
 					mbedtls_ssl_conf_authmode(&mqtt_client_info.tls_config->conf, MBEDTLS_SSL_VERIFY_OPTIONAL);
 				}
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+				if (g_mqttTlsMaxFragCode != MBEDTLS_SSL_MAX_FRAG_LEN_NONE) {
+					mbedtls_ssl_conf_max_frag_len(&mqtt_client_info.tls_config->conf, g_mqttTlsMaxFragCode);
+				}
+#endif
 			}
 			else {
 				addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Secure TLS config fail. Try connect anyway.");
@@ -1396,10 +1814,17 @@ static int MQTT_do_connect(mqtt_client_t* client)
 			&mqtt_ip, mqtt_port,
 			mqtt_connection_cb, LWIP_CONST_CAST(void*, &mqtt_client_info),
 			&mqtt_client_info);
+#if MQTT_USE_TLS
+		if (res == ERR_OK && mqtt_client_info.tls_config) {
+			MQTT_TLS_OfferSession(mqtt_client);
+		}
+#endif
 		UNLOCK_TCPIP_CORE();
 		mqtt_connect_result = res;
+		mqtt_connecting = (res == ERR_OK);
 		if (res != ERR_OK)
 		{
+			mqtt_ip_cached_valid = false;
 			addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Connect error in mqtt_client_connect - code: %d (%s)\n", res, get_error_name(res));
 			snprintf(mqtt_status_message, sizeof(mqtt_status_message), "mqtt_client_connect connect failed");
 			if (res == ERR_ISCONN)
@@ -1464,7 +1889,7 @@ OBK_Publish_Result MQTT_PublishMain_StringString(const char* sChannel, const cha
 
 }
 
-OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
+static OBK_Publish_Result MQTT_ChannelPublishValue(int channel, int flags)
 {
 	char channelNameStr[8];
 	char valueStr[16];
@@ -1487,9 +1912,6 @@ OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
 		sprintf(valueStr, "%i", iVal);
 	}
 
-	MQTT_BroadcastTasmotaTeleSTATE();
-	MQTT_BroadcastTasmotaTeleSENSOR();
-
 	// String from channel number
 	sprintf(channelNameStr, "%i", channel);
 
@@ -1502,6 +1924,33 @@ OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
 
 	return MQTT_PublishMain(mqtt_client, channelNameStr, valueStr, flags, true);
 }
+OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags)
+{
+	// allow users to force-hide some channels (those channels are NEVER published)
+	if (CHANNEL_HasNeverPublishFlag(channel)) {
+		return OBK_PUBLISH_OK;
+	}
+	MQTT_BroadcastTasmotaTeleSTATE();
+	MQTT_BroadcastTasmotaTeleSENSOR();
+	return MQTT_ChannelPublishValue(channel, flags);
+}
+// for channel batch, Tasmota STATE and SENSOR are sent once for all channels
+OBK_Publish_Result MQTT_ChannelsPublish(const int* channels, int count, int flags)
+{
+	OBK_Publish_Result res, ret;
+	int i;
+
+	ret = OBK_PUBLISH_OK;
+	MQTT_BroadcastTasmotaTeleSTATE();
+	MQTT_BroadcastTasmotaTeleSENSOR();
+	for (i = 0; i < count; i++) {
+		res = MQTT_ChannelPublishValue(channels[i], flags);
+		if (res != OBK_PUBLISH_OK) {
+			ret = res;
+		}
+	}
+	return ret;
+}
 // This console command will trigger a publish of all used variables (channels and extra stuff)
 commandResult_t MQTT_PublishAll(const void* context, const char* cmd, const char* args, int cmdFlags) {
 	MQTT_PublishWholeDeviceState_Internal(true);
@@ -1559,6 +2008,8 @@ commandResult_t MQTT_PublishFile(const void* context, const char* cmd, const cha
 	OBK_Publish_Result ret;
 	int flags = 0;
 	byte*data;
+	lfsStream_t* s;
+	int size;
 
 	Tokenizer_TokenizeString(args, TOKENIZER_ALLOW_QUOTES | TOKENIZER_ALLOW_ESCAPING_QUOTATIONS | TOKENIZER_EXPAND_EARLY);
 
@@ -1572,6 +2023,21 @@ commandResult_t MQTT_PublishFile(const void* context, const char* cmd, const cha
 	if (Tokenizer_GetArgIntegerDefault(2, 0) != 0) {
 		flags = OBK_PUBLISH_FLAG_RAW_TOPIC_NAME;
 	}
+	// payload is sent at once, so file that could never fit in
+	// MQTT output buffer is refused before it is loaded
+	s = LFS_OpenStream(fname, 0);
+	if (s == 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Publish file %s not found", fname);
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	size = LFS_GetStreamSize(s);
+	LFS_CloseStream(s);
+#ifdef MQTT_OUTPUT_RINGBUF_SIZE
+	if (size >= MQTT_OUTPUT_RINGBUF_SIZE) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Publish file %s has %i bytes, max is %i", fname, size, MQTT_OUTPUT_RINGBUF_SIZE - 1);
+		return CMD_RES_BAD_ARGUMENT;
+	}
+#endif
 	data = LFS_ReadFileExpanding(fname);
 	if (data) {
 		ret = MQTT_PublishMain_StringString(topic, (const char*)data, flags);
@@ -1641,7 +2107,7 @@ commandResult_t MQTT_PublishCommandDriver(const void* context, const char* cmd,
 	Tokenizer_TokenizeString(args, 0);
 
 	driver = Tokenizer_GetArg(0);
-	bool bOn = DRV_IsRunning(driver);
+	bool bOn = DRV_IsRunningByName(driver);
 
 	char full[32];
 	sprintf(full,"driver/%s", driver);
@@ -1652,92 +2118,141 @@ commandResult_t MQTT_PublishCommandDriver(const void* context, const char* cmd,
 /****************************************************************************************************
  *
  ****************************************************************************************************/
-#define MQTT_TMR_DURATION      50
-
-typedef struct BENCHMARK_TEST_INFO
-{
-	portTickType TestStartTick;
-	portTickType TestStopTick;
-	long msg_cnt;
-	long msg_num;
-	char topic[256];
-	char value[256];
-	float bench_time;
-	float bench_rate;
-	bool report_published;
-} BENCHMARK_TEST_INFO;
-
-#ifndef portTICK_RATE_MS
-#define portTICK_RATE_MS ( ( portTickType ) 1000 / configTICK_RATE_HZ )
-#endif
-
-void MQTT_Test_Tick(void* param)
+// Benchmark publishes Count messages of given size on [client]/benchmark
+// and measures round trip of each through own subscription to that topic.
+// It is driven from quick tick, so it runs the same on device and in the
+// Windows build. At most MQTT_BENCH_WINDOW messages wait for loopback at once.
+#define MQTT_BENCH_WINDOW			8
+#define MQTT_BENCH_SAMPLES			256
+#define MQTT_BENCH_MAX_SIZE			1024
+// give broker time to take our subscription before first publish
+#define MQTT_BENCH_SUBSCRIBE_DELAY	500
+// benchmark ends when nothing was sent or received for this long
+#define MQTT_BENCH_TIMEOUT			5000
+#define MQTT_BENCH_CALLBACK_ID		4
+
+typedef struct mqttBenchmark_s {
+	int count;
+	int size;
+	int qos;
+	int sent;
+	int received;
+	// every stride-th message latency is kept for percentiles
+	int stride;
+	int samples;
+	unsigned int startTime;
+	unsigned int lastActivity;
+	int queueMax;
+	int heapMin;
+	unsigned short latency[MQTT_BENCH_SAMPLES];
+	char payload[MQTT_BENCH_MAX_SIZE + 1];
+} mqttBenchmark_t;
+
+static mqttBenchmark_t* g_mqttBench = NULL;
+
+static void MQTT_Benchmark_Stop()
 {
-	BENCHMARK_TEST_INFO* info = (BENCHMARK_TEST_INFO*)param;
-	int block = 1;
-	err_t err;
-	int qos = 1;
-	int retain = 0;
-
-	if (info != NULL)
-	{
-		while (1)
-		{
+	if (g_mqttBench == NULL) {
+		return;
+	}
+	MQTT_RemoveCallback(MQTT_BENCH_CALLBACK_ID);
+	os_free(g_mqttBench);
+	g_mqttBench = NULL;
+}
+static int MQTT_Benchmark_Received(obk_mqtt_request_t* request)
+{
+	mqttBenchmark_t* b = g_mqttBench;
+	unsigned int sentAt, latency;
+	int seq;
 
-			LOCK_TCPIP_CORE();
-			int res = mqtt_client_is_connected(mqtt_client);
-			UNLOCK_TCPIP_CORE();
+	if (b == NULL) {
+		return 1;
+	}
+	// received data is always NULL terminated in rx buffer
+	if (sscanf((const char*)request->received, "%i %u", &seq, &sentAt) != 2) {
+		return 1;
+	}
+	if (b->received >= b->sent) {
+		// duplicate delivery
+		return 1;
+	}
+	latency = g_timeMs - sentAt;
+	b->received++;
+	b->lastActivity = g_timeMs;
+	if (seq % b->stride == 0 && b->samples < MQTT_BENCH_SAMPLES) {
+		b->latency[b->samples++] = latency > 0xFFFF ? 0xFFFF : latency;
+	}
+	return 1;
+}
+static int MQTT_Benchmark_CompareLatency(const void* a, const void* b)
+{
+	return *(const unsigned short*)a - *(const unsigned short*)b;
+}
+static void MQTT_Benchmark_Finish(mqttBenchmark_t* b)
+{
+	char report[256];
+	int elapsed;
+	int p50 = 0, p99 = 0;
+
+	elapsed = (int)(b->lastActivity - b->startTime);
+	if (elapsed <= 0) {
+		elapsed = 1;
+	}
+	if (b->samples > 0) {
+		qsort(b->latency, b->samples, sizeof(b->latency[0]), MQTT_Benchmark_CompareLatency);
+		p50 = b->latency[b->samples * 50 / 100];
+		p99 = b->latency[b->samples * 99 / 100];
+	}
+	snprintf(report, sizeof(report), "{\"sent\":%i,\"received\":%i,\"size\":%i,\"qos\":%i,\"timeMs\":%i,"
+		"\"sendRate\":%i,\"rate\":%i,\"p50\":%i,\"p99\":%i,\"queueMax\":%i,\"heapMin\":%i}",
+		b->sent, b->received, b->size, b->qos, elapsed,
+		(int)(b->sent * 1000LL / elapsed), (int)(b->received * 1000LL / elapsed),
+		p50, p99, b->queueMax, b->heapMin);
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Benchmark completed: %s", report);
+	MQTT_Benchmark_Stop();
+	MQTT_PublishTopicToClient(mqtt_client, CFG_GetMQTTClientId(), "benchmark/result", report,
+		OBK_PUBLISH_FLAG_FORCE_REMOVE_GET | OBK_PUBLISH_FLAG_REPLY, false);
+}
+static void MQTT_Benchmark_Tick()
+{
+	mqttBenchmark_t* b = g_mqttBench;
+	OBK_Publish_Result res;
+	int len, heap, flags;
 
-			if (res == 0)
-				break;
-			if (info->msg_cnt < info->msg_num)
-			{
-				sprintf(info->value, "TestMSG: %li/%li Time: %i s, Rate: %i msg/s", info->msg_cnt, info->msg_num,
-					(int)info->bench_time, (int)info->bench_rate);
-				LOCK_TCPIP_CORE();
-				err = mqtt_publish(mqtt_client, info->topic, info->value, strlen(info->value), qos, retain, mqtt_pub_request_cb, 0);
-				UNLOCK_TCPIP_CORE();
-				if (err == ERR_OK)
-				{
-					/* MSG published */
-					info->msg_cnt++;
-					info->TestStopTick = xTaskGetTickCount();
-					/* calculate stats */
-					info->bench_time = (float)(info->TestStopTick - info->TestStartTick);
-					info->bench_time /= (float)(1000 / portTICK_RATE_MS);
-					info->bench_rate = (float)info->msg_cnt;
-					if (info->bench_time != 0.0)
-						info->bench_rate /= info->bench_time;
-					block--;
-					if (block <= 0)
-						break;
-				}
-				else {
-					/* MSG not published, error occured */
-					break;
-				}
-			}
-			else {
-				/* All messages publiched */
-				if (info->report_published == false)
-				{
-					/* Publish report */
-					sprintf(info->value, "Benchmark completed. %li msg published. Total Time: %i s MsgRate: %i msg/s",
-						info->msg_cnt, (int)info->bench_time, (int)info->bench_rate);
-					LOCK_TCPIP_CORE();
-					err = mqtt_publish(mqtt_client, info->topic, info->value, strlen(info->value), qos, retain, mqtt_pub_request_cb, 0);
-					UNLOCK_TCPIP_CORE();
-					if (err == ERR_OK)
-					{
-						/* Report published */
-						addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, info->value);
-						info->report_published = true;
-						/* Stop timer */
-					}
-				}
-				break;
-			}
+	if (b == NULL) {
+		return;
+	}
+	if (g_MqttPublishItemsQueued > b->queueMax) {
+		b->queueMax = g_MqttPublishItemsQueued;
+	}
+	heap = xPortGetFreeHeapSize();
+	if (heap < b->heapMin) {
+		b->heapMin = heap;
+	}
+	if ((int)(g_timeMs - b->startTime) < 0) {
+		return;
+	}
+	flags = OBK_PUBLISH_FLAG_MUTEX_SILENT | OBK_PUBLISH_FLAG_FORCE_REMOVE_GET;
+	if (b->qos == 0) {
+		flags |= OBK_PUBLISH_FLAG_QOS_ZERO;
+	}
+	while (b->sent < b->count && b->sent - b->received < MQTT_BENCH_WINDOW) {
+		len = sprintf(b->payload, "%i %u ", b->sent, g_timeMs);
+		if (len < b->size) {
+			memset(b->payload + len, 'x', b->size - len);
+			len = b->size;
+		}
+		b->payload[len] = 0;
+		res = MQTT_PublishTopicToClient(mqtt_client, CFG_GetMQTTClientId(), "benchmark", b->payload, flags, false);
+		if (res != OBK_PUBLISH_OK) {
+			// busy, try again on next tick
+			break;
 		}
+		b->sent++;
+		b->lastActivity = g_timeMs;
+	}
+	if (b->received >= b->count || (int)(g_timeMs - b->lastActivity) > MQTT_BENCH_TIMEOUT) {
+		MQTT_Benchmark_Finish(b);
 	}
 }
 
@@ -1769,7 +2284,7 @@ commandResult_t MQTT_SetMaxBroadcastItemsPublishedPerSecond(const void* context,
 
 	return CMD_RES_OK;
 }
-commandResult_t MQTT_SetBroadcastInterval(const void* context, const char* cmd, const char* args, int cmdFlags)
+commandResult_t MQTT_SetDedupExpire(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
 	Tokenizer_TokenizeString(args, 0);
 	// following check must be done after 'Tokenizer_TokenizeString',
@@ -1778,78 +2293,142 @@ commandResult_t MQTT_SetBroadcastInterval(const void* context, const char* cmd,
 	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
 		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
-	g_intervalBetweenMQTTBroadcasts = Tokenizer_GetArgInteger(0);
+	MQTT_Dedup_SetCacheExpireTime(Tokenizer_GetArgInteger(0));
 
 	return CMD_RES_OK;
 }
-static BENCHMARK_TEST_INFO* info = NULL;
+commandResult_t MQTT_SetQueueCoalesce(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	g_MqttQueueCoalesce = Tokenizer_GetArgInteger(0);
 
-#if WINDOWS
+	return CMD_RES_OK;
+}
+commandResult_t MQTT_SetBroadcastJSON(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	g_mqttBroadcastJSON = Tokenizer_GetArgInteger(0);
 
-#elif PLATFORM_BL602 || PLATFORM_W600 || PLATFORM_W800 || PLATFORM_ESPIDF || PLATFORM_TR6260 \
-	|| PLATFORM_REALTEK || PLATFORM_ECR6600 || PLATFORM_ESP8266 || PLATFORM_TXW81X || PLATFORM_RDA5981 || PLATFORM_LN8825
-static void mqtt_timer_thread(void* param)
+	return CMD_RES_OK;
+}
+commandResult_t MQTT_SetRateLimit(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
-	while (1)
-	{
-		rtos_delay_milliseconds(MQTT_TMR_DURATION);
-		MQTT_Test_Tick(param);
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		g_mqttRatePerSecond = Tokenizer_GetArgInteger(0);
+		g_mqttRateBurst = Tokenizer_GetArgIntegerDefault(1, g_mqttRatePerSecond * 2);
+		if (g_mqttRateBurst < 1) {
+			g_mqttRateBurst = 1;
+		}
+		g_mqttRateTeleReserve = Tokenizer_GetArgIntegerDefault(2, g_mqttRateBurst / 2);
+		g_mqttRateTokens = g_mqttRateBurst;
+		memset(g_mqttRateDeferred, 0, sizeof(g_mqttRateDeferred));
 	}
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Rate %i/s, burst %i, tele reserve %i, tokens %i, deferred reply %i state %i tele %i",
+		g_mqttRatePerSecond, g_mqttRateBurst, g_mqttRateTeleReserve, g_mqttRateTokens,
+		g_mqttRateDeferred[MQTT_PRIO_REPLY], g_mqttRateDeferred[MQTT_PRIO_STATE], g_mqttRateDeferred[MQTT_PRIO_TELE]);
+
+	return CMD_RES_OK;
 }
-#elif PLATFORM_XRADIO || PLATFORM_LN882H
-static OS_Timer_t timer;
-#else
-static beken_timer_t g_mqtt_timer;
-#endif
+// max fragment length in bytes to MBEDTLS_SSL_MAX_FRAG_LEN_xxx code
+// (0 none, 1 512, 2 1024, 3 2048, 4 4096), largest one not above it,
+// but at least 512
+int MQTT_TLS_MaxFragmentCode(int bytes)
+{
+	int code;
 
-commandResult_t MQTT_StartMQTTTestThread(const void* context, const char* cmd, const char* args, int cmdFlags)
+	if (bytes <= 0)
+		return 0;
+	for (code = 1; code < 4 && (512 << code) <= bytes; code++) {
+	}
+	return code;
+}
+#if MQTT_USE_TLS
+commandResult_t MQTT_SetTlsOptions(const void* context, const char* cmd, const char* args, int cmdFlags)
 {
-	if (info != NULL)
-	{
-		/* Benchmark test already started */
-		/* try to restart */
-		info->TestStartTick = xTaskGetTickCount();
-		info->msg_cnt = 0;
-		info->report_published = false;
-		return CMD_RES_OK;
+	int frag;
+
+	Tokenizer_TokenizeString(args, 0);
+	if (Tokenizer_GetArgsCount() >= 1) {
+		frag = Tokenizer_GetArgInteger(0);
+		g_mqttTlsMaxFragCode = MQTT_TLS_MaxFragmentCode(frag);
+		g_mqttTlsResume = Tokenizer_GetArgIntegerDefault(1, g_mqttTlsResume);
+		if (!g_mqttTlsResume) {
+			MQTT_TLS_DropSession();
+		}
 	}
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "TLS max fragment %i, resume %i (session %s), buffers in %i out %i",
+		g_mqttTlsMaxFragCode == MBEDTLS_SSL_MAX_FRAG_LEN_NONE ? 0 : 256 << g_mqttTlsMaxFragCode,
+		g_mqttTlsResume, mqtt_tls_session_valid ? "cached" : "none",
+		MBEDTLS_SSL_IN_CONTENT_LEN, MBEDTLS_SSL_OUT_CONTENT_LEN);
 
-	info = (BENCHMARK_TEST_INFO*)os_malloc(sizeof(BENCHMARK_TEST_INFO));
-	if (info == NULL)
-	{
-		return CMD_RES_ERROR;
+	return CMD_RES_OK;
+}
+#endif
+commandResult_t MQTT_SetBroadcastInterval(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	Tokenizer_TokenizeString(args, 0);
+	// following check must be done after 'Tokenizer_TokenizeString',
+	// so we know arguments count in Tokenizer. 'cmd' argument is
+	// only for warning display
+	if (Tokenizer_CheckArgsCountAndPrintWarning(cmd, 1)) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
 	}
+	g_intervalBetweenMQTTBroadcasts = Tokenizer_GetArgInteger(0);
 
-	memset(info, 0, sizeof(BENCHMARK_TEST_INFO));
-	info->TestStartTick = xTaskGetTickCount();
-	info->msg_num = 1000;
-	sprintf(info->topic, "%s/benchmark", CFG_GetMQTTClientId());
+	return CMD_RES_OK;
+}
+commandResult_t MQTT_StartMQTTTestThread(const void* context, const char* cmd, const char* args, int cmdFlags)
+{
+	char cbtopicbase[CGF_MQTT_CLIENT_ID_SIZE + 16];
+	char cbtopicsub[CGF_MQTT_CLIENT_ID_SIZE + 16];
+	mqttBenchmark_t* b;
 
-#if WINDOWS
+	// starting again restarts benchmark
+	MQTT_Benchmark_Stop();
 
-#elif PLATFORM_BL602 || PLATFORM_W600 || PLATFORM_W800 || PLATFORM_ESPIDF || PLATFORM_TR6260 \
-	|| PLATFORM_REALTEK || PLATFORM_ECR6600 || PLATFORM_ESP8266 || PLATFORM_LN8825
-	xTaskCreate(mqtt_timer_thread, "mqtt", 1024, (void*)info, 15, NULL);
-#elif PLATFORM_TXW81X
-	os_task_create("mqtt", mqtt_timer_thread, (void*)info, 15, 0, NULL, 1024);
-#elif PLATFORM_RDA5981
-	rda_thread_new("mqtt", mqtt_timer_thread, NULL, 1024, osPriorityNormal);
-#elif PLATFORM_XRADIO || PLATFORM_LN882H
-	OS_TimerSetInvalid(&timer);
-	if (OS_TimerCreate(&timer, OS_TIMER_PERIODIC, MQTT_Test_Tick, (void*)info, MQTT_TMR_DURATION) != OS_OK)
+	b = (mqttBenchmark_t*)os_malloc(sizeof(mqttBenchmark_t));
+	if (b == NULL)
 	{
-		printf("PIN_AddCommands timer create failed\n");
 		return CMD_RES_ERROR;
 	}
-	OS_TimerStart(&timer); /* start OS timer to feed watchdog */
-#else
-	OSStatus result;
+	memset(b, 0, sizeof(mqttBenchmark_t));
 
-	result = rtos_init_timer(&g_mqtt_timer, MQTT_TMR_DURATION, MQTT_Test_Tick, (void*)info);
-	ASSERT(kNoErr == result);
-	result = rtos_start_timer(&g_mqtt_timer);
-	ASSERT(kNoErr == result);
-#endif
+	Tokenizer_TokenizeString(args, 0);
+	b->count = Tokenizer_GetArgIntegerDefault(0, 1000);
+	if (b->count < 1) {
+		b->count = 1;
+	}
+	b->size = Tokenizer_GetArgIntegerDefault(1, 64);
+	if (b->size > MQTT_BENCH_MAX_SIZE) {
+		b->size = MQTT_BENCH_MAX_SIZE;
+	}
+	b->qos = Tokenizer_GetArgIntegerDefault(2, 1) ? 1 : 0;
+	b->stride = (b->count + MQTT_BENCH_SAMPLES - 1) / MQTT_BENCH_SAMPLES;
+	b->startTime = g_timeMs + MQTT_BENCH_SUBSCRIBE_DELAY;
+	b->lastActivity = b->startTime;
+	b->heapMin = xPortGetFreeHeapSize();
+	g_mqttBench = b;
+	QuickTick_Wake();
+
+	snprintf(cbtopicbase, sizeof(cbtopicbase), "%s/", CFG_GetMQTTClientId());
+	snprintf(cbtopicsub, sizeof(cbtopicsub), "%s/benchmark", CFG_GetMQTTClientId());
+	// note: this may REPLACE an existing entry with the same ID.  ID 4 !!!
+	MQTT_RegisterCallback(cbtopicbase, cbtopicsub, MQTT_BENCH_CALLBACK_ID, MQTT_Benchmark_Received);
+
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Benchmark started: %i messages of %i bytes, QoS %i", b->count, b->size, b->qos);
 	return CMD_RES_OK;
 }
 
@@ -1970,8 +2549,8 @@ void MQTT_init()
 	//cmddetail:"fn":"MQTT_PublishChannels","file":"mqtt/new_mqtt.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("publishChannels", MQTT_PublishChannels, NULL);
-	//cmddetail:{"name":"publishBenchmark","args":"",
-	//cmddetail:"descr":"",
+	//cmddetail:{"name":"publishBenchmark","args":"[Count][Size][QoS]",
+	//cmddetail:"descr":"Publishes Count (default 1000) messages of Size bytes (default 64, max 1024) with QoS 0 or 1 (default) on [client]/benchmark, and measures round trip of each through own subscription to it. At most 8 messages are in flight. When all came back, or nothing happened for 5 seconds, report with sent and received counts, msg/s, p50/p99 round trip latency in ms, publish queue high-water mark and free heap low-water mark is logged and published on [client]/benchmark/result as JSON.",
 	//cmddetail:"fn":"MQTT_StartMQTTTestThread","file":"mqtt/new_mqtt.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("publishBenchmark", MQTT_StartMQTTTestThread, NULL);
@@ -1985,6 +2564,33 @@ void MQTT_init()
 	//cmddetail:"fn":"MQTT_SetMaxBroadcastItemsPublishedPerSecond","file":"mqtt/new_mqtt.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("mqtt_broadcastItemsPerSec", MQTT_SetMaxBroadcastItemsPublishedPerSecond, NULL);
+	//cmddetail:{"name":"mqtt_broadcastJSON","args":"[0or1]",
+	//cmddetail:"descr":"If set to 1, self state broadcast (and publishAll/publishChannels) sends whole state - device info, LED state, energy readings and all published channels - as a single JSON message on [base]/state, instead of separate message for each item. This value is not saved, you must use autoexec.bat or short startup command to execute it on every reboot.",
+	//cmddetail:"fn":"MQTT_SetBroadcastJSON","file":"mqtt/new_mqtt.c","requires":"",
+	//cmddetail:"examples":"mqtt_broadcastJSON 1"}
+	CMD_RegisterCommand("mqtt_broadcastJSON", MQTT_SetBroadcastJSON, NULL);
+	//cmddetail:{"name":"mqtt_rateLimit","args":"[TokensPerSecond][Burst][TeleReserve]",
+	//cmddetail:"descr":"Limits MQTT publishes with a token bucket that is refilled every second. Telemetry (tele topics, self state broadcast, energy readings) is sent only while more than TeleReserve tokens are left, state changes while any token is left, command replies are always sent. Publishes over the limit are queued and sent later. Burst defaults to twice the rate and TeleReserve to half of Burst. 0 disables the limiter (default). Without arguments prints current values and deferred counts. This value is not saved, you must use autoexec.bat or short startup command to execute it on every reboot.",
+	//cmddetail:"fn":"MQTT_SetRateLimit","file":"mqtt/new_mqtt.c","requires":"",
+	//cmddetail:"examples":"mqtt_rateLimit 5 10 5"}
+	CMD_RegisterCommand("mqtt_rateLimit", MQTT_SetRateLimit, NULL);
+#if MQTT_USE_TLS
+	//cmddetail:{"name":"mqtt_tlsOptions","args":"[MaxFragment][Resume]",
+	//cmddetail:"descr":"Tunes MQTT over TLS. MaxFragment (512, 1024, 2048 or 4096, 0 for none - default) is the largest record broker is asked to send, it should not be above TLS input buffer size set at build time (CFG_MQTT_TLS_IN_CONTENT_LEN). Resume 1 (default) keeps TLS session in RAM and resumes it on reconnect instead of doing full handshake. Takes effect on next connect. Without arguments prints current values. This value is not saved, you must use autoexec.bat or short startup command to execute it on every reboot.",
+	//cmddetail:"fn":"MQTT_SetTlsOptions","file":"mqtt/new_mqtt.c","requires":"",
+	//cmddetail:"examples":"mqtt_tlsOptions 2048 1"}
+	CMD_RegisterCommand("mqtt_tlsOptions", MQTT_SetTlsOptions, NULL);
+#endif
+	//cmddetail:{"name":"mqtt_queueCoalesce","args":"[Mode]",
+	//cmddetail:"descr":"Sets how publish queue handles a new value for topic that is still waiting in queue. 0 - queue every value, 1 - (default) retained topics keep only the newest value, 2 - all topics keep only the newest value. The newest value takes place of the old one in queue. This value is not saved, you must use autoexec.bat or short startup command to execute it on every reboot.",
+	//cmddetail:"fn":"MQTT_SetQueueCoalesce","file":"mqtt/new_mqtt.c","requires":"",
+	//cmddetail:"examples":"mqtt_queueCoalesce 2"}
+	CMD_RegisterCommand("mqtt_queueCoalesce", MQTT_SetQueueCoalesce, NULL);
+	//cmddetail:{"name":"mqtt_dedupExpire","args":"[ValueSeconds]",
+	//cmddetail:"descr":"Publishes that opt into deduplication (battery driver, etc) are not sent again with unchanged value until this many seconds have passed. Default is 60, 0 disables it. Cache is also cleared on every MQTT connect. This value is not saved, you must use autoexec.bat or short startup command to execute it on every reboot.",
+	//cmddetail:"fn":"MQTT_SetDedupExpire","file":"mqtt/new_mqtt.c","requires":"",
+	//cmddetail:"examples":"mqtt_dedupExpire 300"}
+	CMD_RegisterCommand("mqtt_dedupExpire", MQTT_SetDedupExpire, NULL);
 	//cmddetail:{"name":"TasTeleInterval","args":"[SensorInterval][StateInterval]",
 	//cmddetail:"descr":"This allows you to configure Tasmota TELE publish intervals, only if you have TELE flag enabled. First argument is interval for sensor publish (energy metering, etc), second is interval for State tele publish.",
 	//cmddetail:"fn":"MQTT_SetTasTeleIntervals","file":"mqtt/new_mqtt.c","requires":"",
@@ -2012,7 +2618,7 @@ static float getInternalTemperature() {
 
 OBK_Publish_Result MQTT_DoItemPublishString(const char* sChannel, const char* valueStr)
 {
-	return MQTT_PublishMain(mqtt_client, sChannel, valueStr, OBK_PUBLISH_FLAG_MUTEX_SILENT, false);
+	return MQTT_PublishMain(mqtt_client, sChannel, valueStr, OBK_PUBLISH_FLAG_MUTEX_SILENT | OBK_PUBLISH_FLAG_TELE, false);
 }
 
 OBK_Publish_Result MQTT_DoItemPublish(int idx)
@@ -2076,7 +2682,7 @@ OBK_Publish_Result MQTT_DoItemPublish(int idx)
 /*		//Drivers are only built on BK7231 chips
 #ifndef OBK_DISABLE_ALL_DRIVERS
 
-		if (DRV_IsRunning("NTP")) {
+		if (DRV_IsRunning(DRV_ID_NTP)) {
 */
 #ifdef PLATFORM_ESP8266
 		// while all other platforms will accept uint32_t as long unsigned, ESP8266 needs %u 
@@ -2138,20 +2744,142 @@ OBK_Publish_Result MQTT_DoItemPublish(int idx)
 	// TODO
 	//type = CHANNEL_GetType(idx);
 	if (bWantsToPublish) {
-		return MQTT_ChannelPublish(g_publishItemIndex, OBK_PUBLISH_FLAG_MUTEX_SILENT);
+		return MQTT_ChannelPublish(g_publishItemIndex, OBK_PUBLISH_FLAG_MUTEX_SILENT | OBK_PUBLISH_FLAG_TELE);
 	}
 
 	return OBK_PUBLISH_WAS_NOT_REQUIRED; // didnt publish
 }
 
+#if ENABLE_TASMOTA_JSON
+// Prints the same items as MQTT_DoItemPublish into one JSON object,
+// keys are the topic names used when items are published one by one
+static void MQTT_PrintStateJSON(obk_mqtt_publishReplyPrinter_t* request, bool bStatic)
+{
+	jsonCb_t printer = (jsonCb_t)mqtt_printf255;
+	char dataStr[3 * 6 + 1];
+	char key[8];
+	int i, cnt;
+
+	printer(request, "{");
+	if (bStatic) {
+		JSON_PrintKeyValue_String(request, printer, "host", CFG_GetShortDeviceName(), true);
+		JSON_PrintKeyValue_String(request, printer, "build", BUILD_AND_VERSION_FOR_MQTT, true);
+		JSON_PrintKeyValue_String(request, printer, "mac", HAL_GetMACStr(dataStr), true);
+	}
+#ifndef NO_CHIP_TEMPERATURE
+	JSON_PrintKeyValue_Float(request, printer, "temp", getInternalTemperature(), true);
+#endif
+	JSON_PrintKeyValue_String(request, printer, "ssid", CFG_GetWiFiSSID(), true);
+	printer(request, "\"datetime\":%u,", (unsigned int)TIME_GetCurrentTime());
+	JSON_PrintKeyValue_Int(request, printer, "sockets", LWIP_GetActiveSockets(), true);
+	JSON_PrintKeyValue_Int(request, printer, "rssi", HAL_GetWifiStrength(), true);
+	JSON_PrintKeyValue_Int(request, printer, "uptime", g_secondsElapsed, true);
+	JSON_PrintKeyValue_Int(request, printer, "freeheap", xPortGetFreeHeapSize(), true);
+	JSON_PrintKeyValue_String(request, printer, "ip", HAL_GetMyIPString(), true);
+#if ENABLE_PING_WATCHDOG
+	if (g_timeSinceLastPingReply != -1) {
+		const pingStats_t* ping = PingWatchDog_GetStats();
+
+		// histogram as in api/ping
+		printer(request, "\"ping\":{");
+		JSON_PrintKeyValue_Int(request, printer, "lost", ping->lost, true);
+		JSON_PrintKeyValue_Int(request, printer, "received", ping->received, true);
+		JSON_PrintKeyValue_Int(request, printer, "avgMs", ping->received ? ping->sumMs / ping->received : 0, true);
+		JSON_PrintKeyValue_Int(request, printer, "maxMs", ping->maxMs, true);
+		printer(request, "\"counts\":[");
+		for (i = 0; i < PING_HIST_BUCKETS; i++) {
+			printer(request, i ? ",%u" : "%u", ping->hist[i]);
+		}
+		printer(request, "]},");
+	}
+#endif
+#if ENABLE_LED_BASIC
+	if (LED_IsLEDRunning()) {
+		JSON_PrintKeyValue_Int(request, printer, "led_enableAll", LED_GetEnableAll(), true);
+		JSON_PrintKeyValue_Int(request, printer, "led_dimmer", (int)LED_GetDimmer(), true);
+		if (LED_GetMode() == Light_Temperature) {
+			JSON_PrintKeyValue_Int(request, printer, "led_temperature", (int)LED_GetTemperature(), true);
+		}
+		else if (LED_GetMode() == Light_RGB) {
+			LED_GetBaseColorString(dataStr);
+			JSON_PrintKeyValue_String(request, printer, "led_basecolor_rgb", dataStr, true);
+		}
+	}
+#endif
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	if (DRV_IsMeasuringPower()) {
+		printer(request, "\"energy\":{");
+		cnt = 0;
+		for (i = OBK__FIRST; i <= OBK_CONSUMPTION__DAILY_LAST; i++) {
+			float v = DRV_GetReading((energySensor_t)i);
+			if (isnan(v)) {
+				continue;
+			}
+			if (cnt) {
+				printer(request, ",");
+			}
+			cnt++;
+			JSON_PrintKeyValue_Float(request, printer, DRV_GetEnergySensorNames((energySensor_t)i)->name_mqtt, v, false);
+		}
+		printer(request, "},");
+	}
+#endif
+	printer(request, "\"channels\":{");
+	cnt = 0;
+	for (i = 0; i < CHANNEL_MAX; i++) {
+		if (!CHANNEL_ShouldBePublished(i) || CHANNEL_HasNeverPublishFlag(i)) {
+			continue;
+		}
+		if (cnt) {
+			printer(request, ",");
+		}
+		cnt++;
+		sprintf(key, "%i", i);
+		if (CFG_HasFlag(OBK_FLAG_PUBLISH_MULTIPLIED_VALUES)) {
+			JSON_PrintKeyValue_Float(request, printer, key, CHANNEL_GetFinalValue(i), false);
+		}
+		else {
+			JSON_PrintKeyValue_Int(request, printer, key, CHANNEL_Get(i), false);
+		}
+	}
+	printer(request, "}}");
+}
+static OBK_Publish_Result MQTT_PublishStateJSON(bool bStatic)
+{
+	obk_mqtt_publishReplyPrinter_t replyBuilder;
+	OBK_Publish_Result res;
+
+	memset(&replyBuilder, 0, sizeof(obk_mqtt_publishReplyPrinter_t));
+	MQTT_PrintStateJSON(&replyBuilder, bStatic);
+	res = MQTT_DoItemPublishString("state", replyBuilder.allocated ? replyBuilder.allocated : replyBuilder.stackBuffer);
+	if (replyBuilder.allocated != 0) {
+		free(replyBuilder.allocated);
+	}
+	return res;
+}
+#endif
+
 // from 5ms quicktick
 int MQTT_RunQuickTick(){
 #ifndef PLATFORM_BEKEN
 	// on Beken, we use a one-shot timer for this.
 	MQTT_process_received();
 #endif
+	MQTT_Benchmark_Tick();
 	return 0;
 }
+// 0 while received messages wait or benchmark runs, else -1
+int MQTT_GetTimeToNextWakeMS() {
+#ifndef PLATFORM_BEKEN
+	if (mqtt_rx_buffer_tail != mqtt_rx_buffer_head) {
+		return 0;
+	}
+#endif
+	if (g_mqttBench) {
+		return 0;
+	}
+	return -1;
+}
 
 int g_wantTasmotaTeleSend = 0;
 void MQTT_BroadcastTasmotaTeleSENSOR() {
@@ -2186,6 +2914,7 @@ int MQTT_RunEverySecondUpdate()
 
 	if (Main_HasWiFiConnected() == 0)
 	{
+		MQTT_NoteDisconnected();
 		mqtt_reconnect = 0;
 		if (Main_HasFastConnect()) {
 			mqtt_loopsWithDisconnected = LOOPS_WITH_DISCONNECTED + 1;
@@ -2201,6 +2930,8 @@ int MQTT_RunEverySecondUpdate()
 	{
 		return 0;
 	}
+	// publisher stuck with mutex taken shows as missing heartbeat
+	WDT_Heartbeat(WDT_TASK_MQTT);
 	if (g_mqtt_bBaseTopicDirty) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT base topic is dirty, will reinit callbacks and reconnect\n");
 		MQTT_InitCallbacks();
@@ -2243,8 +2974,10 @@ int MQTT_RunEverySecondUpdate()
 		//addLogAdv(LOG_INFO,LOG_FEATURE_MAIN, "Timer discovers disconnected mqtt %i\n",mqtt_loopsWithDisconnected);
 		if (OTA_GetProgress() == -1)
 		{
+			MQTT_NoteDisconnected();
 			mqtt_loopsWithDisconnected++;
-			if (mqtt_loopsWithDisconnected > LOOPS_WITH_DISCONNECTED)
+			if (mqtt_loopsWithDisconnected > LOOPS_WITH_DISCONNECTED
+				|| mqtt_loopsWithDisconnected >= g_mqttReconnectBackoff)
 			{
 				if (mqtt_client == 0)
 				{
@@ -2266,6 +2999,11 @@ int MQTT_RunEverySecondUpdate()
 				}
 				else {
 					mqtt_loopsWithDisconnected = 0;
+					// wait longer after each attempt until one succeeds
+					g_mqttReconnectBackoff *= 2;
+					if (g_mqttReconnectBackoff > LOOPS_WITH_DISCONNECTED) {
+						g_mqttReconnectBackoff = LOOPS_WITH_DISCONNECTED;
+					}
 				}
 				mqtt_connect_events++;
 			}
@@ -2277,18 +3015,34 @@ int MQTT_RunEverySecondUpdate()
 		// things to do in our threads on connection accepted.
 		if (g_just_connected){
 			g_just_connected = 0;
+			g_mqttReconnectBackoff = 1;
 			// publish all values on state
 			if (CFG_HasFlag(OBK_FLAG_MQTT_BROADCASTSELFSTATEONCONNECT)) {
-				g_wantTasmotaTeleSend = 1;
-				MQTT_PublishWholeDeviceState();
+				if (g_mqttDisconnectedAt >= 0 && g_secondsElapsed - g_mqttDisconnectedAt <= MQTT_RESUME_MAX_OUTAGE) {
+					// short outage, broker still has our retained values,
+					// only republish channels if something was lost meanwhile
+					addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "MQTT resumed after %i s, %i publishes lost\n",
+						g_secondsElapsed - g_mqttDisconnectedAt, g_mqttLostPublishes);
+					if (g_mqttLostPublishes > 0) {
+						MQTT_PublishOnlyDeviceChannelsIfPossible();
+					}
+				}
+				else {
+					g_wantTasmotaTeleSend = 1;
+					MQTT_PublishWholeDeviceState();
+				}
 			}
 			else {
 				//MQTT_PublishOnlyDeviceChannelsIfPossible();
 			}
+			g_mqttConnectedOnce = true;
+			g_mqttDisconnectedAt = -1;
+			g_mqttLostPublishes = 0;
 		}
 
 		MQTT_Mutex_Free();
 		// below mutex is not required any more
+		MQTT_RateLimit_Refill();
 
 		// it is connected publish TELE
 		if (g_wantTasmotaTeleSend) {
@@ -2333,6 +3087,24 @@ int MQTT_RunEverySecondUpdate()
 		}
 		else if (g_bPublishAllStatesNow)
 		{
+#if ENABLE_TASMOTA_JSON
+			// whole state at once, as one message
+			if (g_mqttBroadcastJSON) {
+				OBK_Publish_Result publishRes;
+
+				if (g_MqttPublishItemsQueued > 0) {
+					PublishQueuedItems();
+				}
+				publishRes = MQTT_PublishStateJSON(g_publishItemIndex < PUBLISHITEM_DYNAMIC_INDEX_FIRST);
+				// on MQTT busy or disconnected, retry the same later
+				if (publishRes != OBK_PUBLISH_MUTEX_FAIL
+					&& publishRes != OBK_PUBLISH_WAS_DISCONNECTED
+					&& publishRes != OBK_PUBLISH_RATE_LIMITED) {
+					g_bPublishAllStatesNow = 0;
+				}
+				return 1;
+			}
+#endif
 			// Doing step by a step a full publish state
 			//if (g_timeSinceLastMQTTPublish > 2)
 			{
@@ -2341,6 +3113,9 @@ int MQTT_RunEverySecondUpdate()
 
 				while (g_publishItemIndex < CHANNEL_MAX)
 				{
+					// out of tokens for telemetry, continue next second
+					if (!MQTT_RateLimit_Allows(MQTT_PRIO_TELE))
+						break;
 					publishRes = MQTT_DoItemPublish(g_publishItemIndex);
 					if (publishRes != OBK_PUBLISH_WAS_NOT_REQUIRED)
 					{
@@ -2361,7 +3136,8 @@ int MQTT_RunEverySecondUpdate()
 					}
 					// OBK_PUBLISH_MUTEX_FAIL - MQTT is busy
 					if (publishRes == OBK_PUBLISH_MUTEX_FAIL
-						|| publishRes == OBK_PUBLISH_WAS_DISCONNECTED)
+						|| publishRes == OBK_PUBLISH_WAS_DISCONNECTED
+						|| publishRes == OBK_PUBLISH_RATE_LIMITED)
 					{
 						// retry the same later
 						break;
@@ -2395,23 +3171,121 @@ int MQTT_RunEverySecondUpdate()
 	return 1;
 }
 
-MqttPublishItem_t* get_queue_tail(MqttPublishItem_t* head) {
-	if (head == NULL) { return NULL; }
+// reserves space for item at the end of queue, adding a chunk when needed
+static MqttPublishItem_t* MQTT_Queue_Alloc(int size) {
+	MqttPublishChunk_t* c = g_MqttPublishQueueTail;
+	MqttPublishItem_t* item;
+	int capacity;
+
+	if (c == NULL || c->capacity - c->writePos < size) {
+		capacity = size > MQTT_QUEUE_CHUNK_SIZE ? size : MQTT_QUEUE_CHUNK_SIZE;
+		if (g_MqttPublishQueueBytes + capacity > MQTT_MAX_QUEUE_BYTES) {
+			return NULL;
+		}
+		c = os_malloc(sizeof(MqttPublishChunk_t) + capacity);
+		if (c == NULL) {
+			return NULL;
+		}
+		c->next = NULL;
+		c->capacity = capacity;
+		c->readPos = 0;
+		c->writePos = 0;
+		if (g_MqttPublishQueueTail) {
+			g_MqttPublishQueueTail->next = c;
+		}
+		else {
+			g_MqttPublishQueueHead = c;
+		}
+		g_MqttPublishQueueTail = c;
+		g_MqttPublishQueueBytes += capacity;
+	}
+	item = (MqttPublishItem_t*)(MQTT_CHUNK_DATA(c) + c->writePos);
+	c->writePos += size;
+	return item;
+}
+
+static unsigned short MQTT_Queue_KeyHash(const char* topic, const char* channel) {
+	unsigned short hash = 5381;
 
-	while (head->next != NULL) {
-		head = head->next;
+	while (*topic) {
+		hash = ((hash << 5) + hash) + (byte)*topic++;
+	}
+	hash = ((hash << 5) + hash) + '/';
+	while (*channel) {
+		hash = ((hash << 5) + hash) + (byte)*channel++;
 	}
-	return head;
+	return hash;
 }
 
-MqttPublishItem_t* find_queue_reusable_item(MqttPublishItem_t* head) {
-	while (head != NULL) {
-		if (MQTT_QUEUE_ITEM_IS_REUSABLE(head)) {
-			return head;
+static MqttPublishItem_t* MQTT_Queue_FindKey(unsigned short hash, const char* topic, const char* channel, int flags) {
+	MqttPublishItem_t* item;
+
+	for (item = g_MqttPublishQueueKeys[hash % MQTT_QUEUE_KEY_BUCKETS]; item; item = item->nextSameKey) {
+		if (item->keyHash == hash && item->flags == flags
+			&& !strcmp(MQTT_ITEM_TOPIC(item), topic) && !strcmp(MQTT_ITEM_CHANNEL(item), channel)) {
+			return item;
+		}
+	}
+	return NULL;
+}
+
+static void MQTT_Queue_LinkKey(MqttPublishItem_t* item, unsigned short hash) {
+	item->keyHash = hash;
+	item->bIndexed = 1;
+	item->nextSameKey = g_MqttPublishQueueKeys[hash % MQTT_QUEUE_KEY_BUCKETS];
+	g_MqttPublishQueueKeys[hash % MQTT_QUEUE_KEY_BUCKETS] = item;
+}
+
+static void MQTT_Queue_UnlinkKey(MqttPublishItem_t* item) {
+	MqttPublishItem_t** prev = &g_MqttPublishQueueKeys[item->keyHash % MQTT_QUEUE_KEY_BUCKETS];
+
+	while (*prev) {
+		if (*prev == item) {
+			*prev = item->nextSameKey;
+			break;
 		}
-		head = head->next;
+		prev = &(*prev)->nextSameKey;
+	}
+	item->bIndexed = 0;
+}
+
+static MqttPublishItem_t* MQTT_Queue_Front() {
+	MqttPublishChunk_t* c = g_MqttPublishQueueHead;
+
+	if (g_MqttPublishItemsQueued == 0) {
+		return NULL;
+	}
+	return (MqttPublishItem_t*)(MQTT_CHUNK_DATA(c) + c->readPos);
+}
+
+// drops the first item, chunks are freed once all their items are gone,
+// except for the last regular sized one that is kept for the next items
+static void MQTT_Queue_PopFront() {
+	MqttPublishChunk_t* c = g_MqttPublishQueueHead;
+	MqttPublishItem_t* item = MQTT_Queue_Front();
+
+	if (item->bIndexed) {
+		MQTT_Queue_UnlinkKey(item);
+	}
+	c->readPos += item->size;
+	g_MqttPublishItemsQueued--;
+	if (g_MqttPublishItemsQueued == 0) {
+		g_MqttPublishQueueLast = NULL;
+	}
+	if (c->readPos < c->writePos) {
+		return;
+	}
+	if (c->next == NULL && c->capacity == MQTT_QUEUE_CHUNK_SIZE) {
+		c->readPos = 0;
+		c->writePos = 0;
+		return;
+	}
+	g_MqttPublishQueueHead = c->next;
+	if (g_MqttPublishQueueHead == NULL) {
+		g_MqttPublishQueueTail = NULL;
 	}
-	return head;
+	g_MqttPublishQueueBytes -= c->capacity;
+	os_free(c);
 }
 
 /// @brief Queue an entry for publish and execute a command after the publish.
@@ -2422,61 +3296,91 @@ MqttPublishItem_t* find_queue_reusable_item(MqttPublishItem_t* head) {
 /// @param command Command to execute after the publish
 void MQTT_QueuePublishWithCommand(const char* topic, const char* channel, const char* value, int flags, PostPublishCommands command) {
 	MqttPublishItem_t* newItem;
+	MqttPublishItem_t* oldItem = NULL;
+	int topicLen, channelLen, valueLen, valueSpace, size;
+	unsigned short hash = 0;
+	bool bCoalesce;
+
+	bCoalesce = g_MqttQueueCoalesce == MQTT_QUEUE_COALESCE_ALL || (g_MqttQueueCoalesce == MQTT_QUEUE_COALESCE_RETAINED && (flags & OBK_PUBLISH_FLAG_RETAIN));
+	if (bCoalesce) {
+		//Newer value of already queued topic replaces the old one and keeps its position
+		hash = MQTT_Queue_KeyHash(topic, channel);
+		oldItem = MQTT_Queue_FindKey(hash, topic, channel, flags);
+		valueLen = strlen(value);
+		if (oldItem != NULL && oldItem->size - sizeof(MqttPublishItem_t) - oldItem->valueOffset > valueLen) {
+			memcpy(MQTT_ITEM_VALUE(oldItem), value, valueLen + 1);
+			if (command != None) {
+				oldItem->command = command;
+			}
+			addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Queued topic=%s/%s updated in place, %i items in queue", topic, channel, g_MqttPublishItemsQueued);
+			return;
+		}
+	}
+
 	if (g_MqttPublishItemsQueued >= MQTT_MAX_QUEUE_SIZE) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! %i items already present\r\n", g_MqttPublishItemsQueued);
 		return;
 	}
 
-	if ((strlen(topic) > MQTT_PUBLISH_ITEM_TOPIC_LENGTH) ||
-		(strlen(channel) > MQTT_PUBLISH_ITEM_CHANNEL_LENGTH) ||
-		(strlen(value) > MQTT_PUBLISH_ITEM_VALUE_LENGTH)) {
+	topicLen = strlen(topic);
+	channelLen = strlen(channel);
+	valueLen = strlen(value);
+	if ((topicLen > MQTT_PUBLISH_ITEM_TOPIC_LENGTH) ||
+		(channelLen > MQTT_PUBLISH_ITEM_CHANNEL_LENGTH) ||
+		(valueLen > MQTT_PUBLISH_ITEM_VALUE_LENGTH)) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! Topic (%i), channel (%i) or value (%i) exceeds size limit\r\n",
-			strlen(topic), strlen(channel), strlen(value));
+			topicLen, channelLen, valueLen);
 		return;
 	}
 
-	//Queue data for publish. This might be a new item in the queue or an existing item. This is done to prevent
-	//memory fragmentation. The total queue length is limited to MQTT_MAX_QUEUE_SIZE.
-
-	if (g_MqttPublishQueueHead == NULL) {
-		g_MqttPublishQueueHead = newItem = os_malloc(sizeof(MqttPublishItem_t));
-		newItem->next = NULL;
+	//Queue data for publish. Strings are stored right after the item header at their real length,
+	//so short publishes take little memory. The total queue size is limited to MQTT_MAX_QUEUE_BYTES.
+	valueSpace = valueLen + 1;
+	if (bCoalesce && valueSpace < MQTT_QUEUE_COALESCE_MIN_VALUE) {
+		valueSpace = MQTT_QUEUE_COALESCE_MIN_VALUE;
 	}
-	else {
-		newItem = find_queue_reusable_item(g_MqttPublishQueueHead);
-
-		if (newItem == NULL) {
-			newItem = os_malloc(sizeof(MqttPublishItem_t));
-			if(newItem == NULL)
-			{
-				//addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "os_malloc failed for MqttPublishItem_t");
-				return;
-			}
-			newItem->next = NULL;
-			get_queue_tail(g_MqttPublishQueueHead)->next = newItem; //Append new item
-		}
+	size = MQTT_QUEUE_ALIGN(sizeof(MqttPublishItem_t) + topicLen + 1 + channelLen + 1 + valueSpace);
+	newItem = MQTT_Queue_Alloc(size);
+	if (newItem == NULL) {
+		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "Unable to queue! Queue is full with %i items\r\n", g_MqttPublishItemsQueued);
+		return;
 	}
-
-	//strcpy does copy ending null character.
-	strcpy(newItem->topic, topic);
-	strcpy(newItem->channel, channel);
-	strcpy(newItem->value, value);
+	newItem->size = size;
+	newItem->channelOffset = topicLen + 1;
+	newItem->valueOffset = topicLen + 1 + channelLen + 1;
 	newItem->command = command;
 	newItem->flags = flags;
+	newItem->bIndexed = 0;
+	newItem->bReplaced = 0;
+	//copy with ending null characters
+	memcpy(MQTT_ITEM_TOPIC(newItem), topic, topicLen + 1);
+	memcpy(MQTT_ITEM_CHANNEL(newItem), channel, channelLen + 1);
+	memcpy(MQTT_ITEM_VALUE(newItem), value, valueLen + 1);
+	if (oldItem != NULL) {
+		//new value doesn't fit in old item, so old one is skipped and new one goes to the end
+		MQTT_Queue_UnlinkKey(oldItem);
+		oldItem->bReplaced = 1;
+		if (command == None) {
+			newItem->command = oldItem->command;
+		}
+	}
+	if (bCoalesce) {
+		MQTT_Queue_LinkKey(newItem, hash);
+	}
 
+	g_MqttPublishQueueLast = newItem;
 	g_MqttPublishItemsQueued++;
-	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Queued topic=%s/%s, %i items in queue", newItem->topic, newItem->channel, g_MqttPublishItemsQueued);
+	addLogAdv(LOG_INFO, LOG_FEATURE_MQTT, "Queued topic=%s/%s, %i items in queue", topic, channel, g_MqttPublishItemsQueued);
 }
 
 /// @brief Add the specified command to the last entry in the queue.
 /// @param command 
 void MQTT_InvokeCommandAtEnd(PostPublishCommands command) {
-	MqttPublishItem_t* tail = get_queue_tail(g_MqttPublishQueueHead);
-	if (tail == NULL){
+	if (g_MqttPublishQueueLast == NULL){
 		addLogAdv(LOG_ERROR, LOG_FEATURE_MQTT, "InvokeCommandAtEnd invoked but queue is empty");
 	}
 	else {
-		tail->command = command;
+		g_MqttPublishQueueLast->command = command;
 	}
 }
 
@@ -2496,37 +3400,39 @@ OBK_Publish_Result PublishQueuedItems() {
 	OBK_Publish_Result result = OBK_PUBLISH_WAS_NOT_REQUIRED;
 
 	int count = 0;
-	MqttPublishItem_t* head = g_MqttPublishQueueHead;
+	MqttPublishItem_t* head;
+	PostPublishCommands command;
 
-	//The next actionable item might not be at the front. The queue size is limited to MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE
-	//so this traversal is fast.
 	//addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"PublishQueuedItems g_MqttPublishItemsQueued=%i",g_MqttPublishItemsQueued );
-	while ((head != NULL) && (count < MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE) && (g_MqttPublishItemsQueued > 0)) {
-		if (!MQTT_QUEUE_ITEM_IS_REUSABLE(head)) {  //Skip reusable entries
-			count++;
-			result = MQTT_PublishTopicToClient(mqtt_client, head->topic, head->channel, head->value, head->flags, false);
-			MQTT_QUEUE_ITEM_SET_REUSABLE(head); //Flag item as reusable
-			g_MqttPublishItemsQueued--;   //decrement queued count
+	while ((count < MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE) && ((head = MQTT_Queue_Front()) != NULL)) {
+		if (head->bReplaced) {
+			MQTT_Queue_PopFront();
+			continue;
+		}
+		//keep item at front until there are tokens for it
+		if (!MQTT_RateLimit_Take(head->flags)) {
+			result = OBK_PUBLISH_RATE_LIMITED;
+			break;
+		}
+		count++;
+		result = MQTT_SendTopicToClient(mqtt_client, MQTT_ITEM_TOPIC(head), MQTT_ITEM_CHANNEL(head), MQTT_ITEM_VALUE(head), head->flags, false);
+		//item is dropped also when publish failed, commands below may queue new items
+		command = (PostPublishCommands)head->command;
+		MQTT_Queue_PopFront();
 
-			//Stop if last publish failed
-			if (result != OBK_PUBLISH_OK) break;
+		//Stop if last publish failed
+		if (result != OBK_PUBLISH_OK) break;
 
-			switch (head->command) {
-			case None:
-				break;
-			case PublishAll:
-				MQTT_PublishWholeDeviceState_Internal(true);
-				break;
-			case PublishChannels:
-				MQTT_PublishOnlyDeviceChannelsIfPossible();
-				break;
-			}
-		}
-		else {
-			//addLogAdv(LOG_INFO,LOG_FEATURE_MQTT,"PublishQueuedItems item skipped reusable");
+		switch (command) {
+		case None:
+			break;
+		case PublishAll:
+			MQTT_PublishWholeDeviceState_Internal(true);
+			break;
+		case PublishChannels:
+			MQTT_PublishOnlyDeviceChannelsIfPossible();
+			break;
 		}
-
-		head = head->next;
 	}
 
 	return result;
@@ -25,6 +25,7 @@ extern mqtt_client_t* mqtt_client;
 
 void MQTT_init();
 int MQTT_RunQuickTick();
+int MQTT_GetTimeToNextWakeMS();
 int MQTT_RunEverySecondUpdate();
 void MQTT_BroadcastTasmotaTeleSTATE();
 void MQTT_BroadcastTasmotaTeleSENSOR();
@@ -64,6 +65,8 @@ enum OBK_Publish_Result_e {
 	OBK_PUBLISH_WAS_DISCONNECTED,
 	OBK_PUBLISH_WAS_NOT_REQUIRED,
 	OBK_PUBLISH_MEM_FAIL,
+	// no tokens left for this priority class, see mqtt_rateLimit
+	OBK_PUBLISH_RATE_LIMITED,
 };
 
 #define OBK_PUBLISH_FLAG_MUTEX_SILENT			1
@@ -72,6 +75,13 @@ enum OBK_Publish_Result_e {
 // do not add anything to given topic
 #define OBK_PUBLISH_FLAG_RAW_TOPIC_NAME			8
 #define OBK_PUBLISH_FLAG_QOS_ZERO				16
+// skip publish if the same value was sent to this topic recently, see new_mqtt_deduper.c
+#define OBK_PUBLISH_FLAG_DEDUP					32
+// priority class for mqtt_rateLimit, without these flags publish is a state change
+// periodic telemetry, deferred first when rate limited
+#define OBK_PUBLISH_FLAG_TELE					64
+// reply to a command, never deferred
+#define OBK_PUBLISH_FLAG_REPLY					128
 
 
 #include "new_mqtt_deduper.h"
@@ -95,17 +105,30 @@ typedef enum PostPublishCommands_e {
 } PostPublishCommands;
 
 
-/// @brief Publish queue item
+/// @brief Publish queue item, topic, channel and value strings follow it
+/// back-to-back at their real lengths
 typedef struct MqttPublishItem
 {
-	char topic[MQTT_PUBLISH_ITEM_TOPIC_LENGTH];
-	char channel[MQTT_PUBLISH_ITEM_CHANNEL_LENGTH];
-	char value[MQTT_PUBLISH_ITEM_VALUE_LENGTH];
+	// next queued item with the same key hash, see mqtt_queueCoalesce
+	struct MqttPublishItem* nextSameKey;
 	int flags;
-	struct MqttPublishItem* next;
-	PostPublishCommands command;
+	// whole record with strings, rounded up for alignment
+	unsigned short size;
+	// offsets of channel and value strings from the end of this header
+	unsigned short channelOffset;
+	unsigned short valueOffset;
+	// hash of topic and channel, only valid when bIndexed is set
+	unsigned short keyHash;
+	byte command;
+	byte bIndexed;
+	// newer value was queued as a separate item, this one is skipped
+	byte bReplaced;
 } MqttPublishItem_t;
 
+#define MQTT_ITEM_TOPIC(x)		((char*)((x) + 1))
+#define MQTT_ITEM_CHANNEL(x)	(MQTT_ITEM_TOPIC(x) + (x)->channelOffset)
+#define MQTT_ITEM_VALUE(x)		(MQTT_ITEM_TOPIC(x) + (x)->valueOffset)
+
 
 // Maximum length to log data parameters
 #define MQTT_MAX_DATA_LOG_LENGTH					12
@@ -113,9 +136,26 @@ typedef struct MqttPublishItem
 // Count of queued items published at once.
 #define MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE	3
 // When using Hass discovery, when we have, for example,
-// 16 relays, every relay will be a separate publish,
-// so I bumped MAX to 32
-#define MQTT_MAX_QUEUE_SIZE	                32
+// 16 relays, every relay will be a separate publish.
+// Items are small now, so many short publishes can wait
+// for broker reconnect, total size is limited separately
+#define MQTT_MAX_QUEUE_SIZE	                256
+// Queued items are packed into chunks of this size,
+// larger items get a chunk of their own
+#define MQTT_QUEUE_CHUNK_SIZE				2048
+// Limit of memory taken by all chunks
+#define MQTT_MAX_QUEUE_BYTES				(32 * 1024)
+// Hash buckets used to find queued items by topic and channel
+#define MQTT_QUEUE_KEY_BUCKETS				32
+// Space reserved for value of items that can be coalesced,
+// so a longer new value usually still fits in place
+#define MQTT_QUEUE_COALESCE_MIN_VALUE		16
+
+// mqtt_queueCoalesce modes
+#define MQTT_QUEUE_COALESCE_NONE			0
+// only retained items keep just the newest value
+#define MQTT_QUEUE_COALESCE_RETAINED		1
+#define MQTT_QUEUE_COALESCE_ALL				2
 
 // callback function for mqtt.
 // return 0 to allow the incoming topic/data to be processed by others/channel set.
@@ -135,6 +175,7 @@ int MQTT_GetReceivedEventCounter(void);
 
 OBK_Publish_Result PublishQueuedItems();
 OBK_Publish_Result MQTT_ChannelPublish(int channel, int flags);
+OBK_Publish_Result MQTT_ChannelsPublish(const int* channels, int count, int flags);
 void MQTT_ClearCallbacks();
 int MQTT_RegisterCallback(const char* basetopic, const char* subscriptiontopic, int ID, mqtt_callback_fn callback);
 int MQTT_RemoveCallback(int ID);
@@ -148,8 +189,12 @@ const char* MQTT_RemoveClientFromTopic(const char* topic, const char *prefix);
 // are working...
 int MQTT_Post_Received(const char *topic, int topiclen, const unsigned char *data, int datalen);
 int MQTT_Post_Received_Str(const char *topic, const char *data);
+// runs messages queued by MQTT_Post_Received, from quicktick or MQTT thread
+int MQTT_process_received();
 
 void MQTT_GetStats(int* outUsed, int* outMax, int* outFreeMem);
+// mqtt_tlsOptions max fragment length to mbedTLS code
+int MQTT_TLS_MaxFragmentCode(int bytes);
 
 OBK_Publish_Result MQTT_DoItemPublish(int idx);
 OBK_Publish_Result MQTT_PublishMain_StringFloat(const char* sChannel, float f, 
@@ -35,6 +35,23 @@ typedef struct mqtt_dedup_slot_s {
 
 static mqtt_dedup_slot_t *mqtt_dedups[DEDUP_MAX];
 
+// Cache for any topic, open addressing with linear probing.
+// Only hashes are kept, a hash collision at worst skips one publish
+// until the entry expires.
+#define DEDUP_CACHE_SIZE 32
+#define DEDUP_CACHE_PROBES 4
+
+typedef struct mqtt_dedup_entry_s {
+	// 0 means empty
+	unsigned int topicHash;
+	unsigned int valueHash;
+	// g_secondsElapsed of last send
+	int lastSendTime;
+} mqtt_dedup_entry_t;
+
+static mqtt_dedup_entry_t g_dedupCache[DEDUP_CACHE_SIZE];
+static int g_dedupCacheExpireTime = DEDUP_CACHE_EXPIRE_TIME;
+
 static int stat_deduper_send = 0;
 static int stat_deduper_culled_duplicates = 0;
 static int stat_deduper_culled_tooFast = 0;
@@ -88,6 +105,83 @@ void MQTT_Dedup_Tick() {
 	}
 
 }
+static unsigned int DD_Hash(unsigned int hash, const char* s) {
+	while (*s) {
+		hash ^= (byte)*s++;
+		hash *= 16777619;
+	}
+	return hash;
+}
+static unsigned int DD_TopicHash(const char* sTopic, const char* sChannel, int flags) {
+	unsigned int hash;
+
+	hash = DD_Hash(2166136261u, sTopic);
+	hash = DD_Hash(hash ^ '/', sChannel);
+	// raw topic flag changes the final topic, retain changes what broker keeps
+	hash ^= (flags & (OBK_PUBLISH_FLAG_RAW_TOPIC_NAME | OBK_PUBLISH_FLAG_RETAIN | OBK_PUBLISH_FLAG_FORCE_REMOVE_GET));
+	if (hash == 0) {
+		hash = 1;
+	}
+	return hash;
+}
+// finds entry for topic, or an empty or the oldest one in probed range to take over
+static mqtt_dedup_entry_t* DD_FindEntry(unsigned int topicHash, bool *bFound) {
+	mqtt_dedup_entry_t* e, * victim;
+	int i;
+
+	victim = 0;
+	for (i = 0; i < DEDUP_CACHE_PROBES; i++) {
+		e = &g_dedupCache[(topicHash + i) % DEDUP_CACHE_SIZE];
+		if (e->topicHash == topicHash) {
+			*bFound = true;
+			return e;
+		}
+		if (e->topicHash == 0) {
+			// entries are never removed, so topic is not further on
+			break;
+		}
+		if (victim == 0 || e->lastSendTime < victim->lastSendTime) {
+			victim = e;
+		}
+	}
+	*bFound = false;
+	if (i < DEDUP_CACHE_PROBES) {
+		return e;
+	}
+	return victim;
+}
+bool MQTT_Dedup_IsUnchanged(const char* sTopic, const char* sChannel, const char* valueStr, int flags) {
+	mqtt_dedup_entry_t* e;
+	bool bFound;
+
+	e = DD_FindEntry(DD_TopicHash(sTopic, sChannel, flags), &bFound);
+	if (bFound && e->valueHash == DD_Hash(2166136261u, valueStr)
+		&& g_secondsElapsed - e->lastSendTime < g_dedupCacheExpireTime) {
+		stat_deduper_culled_duplicates++;
+		return true;
+	}
+	return false;
+}
+void MQTT_Dedup_MarkSent(const char* sTopic, const char* sChannel, const char* valueStr, int flags) {
+	mqtt_dedup_entry_t* e;
+	unsigned int topicHash;
+	bool bFound;
+
+	topicHash = DD_TopicHash(sTopic, sChannel, flags);
+	e = DD_FindEntry(topicHash, &bFound);
+	e->topicHash = topicHash;
+	e->valueHash = DD_Hash(2166136261u, valueStr);
+	e->lastSendTime = g_secondsElapsed;
+	stat_deduper_send++;
+}
+void MQTT_Dedup_ResetCache() {
+	memset(g_dedupCache, 0, sizeof(g_dedupCache));
+}
+void MQTT_Dedup_SetCacheExpireTime(int seconds) {
+	g_dedupCacheExpireTime = seconds;
+	// forget everything, so new time is used right away
+	MQTT_Dedup_ResetCache();
+}
 OBK_Publish_Result MQTT_PublishMain_StringInt_DeDuped(int slotCode, int expireTime, const char* sChannel, int val, int flags) {
 	char buffer[16];
 	sprintf(buffer,"%i",val);
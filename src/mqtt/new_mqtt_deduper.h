@@ -21,11 +21,20 @@ typedef enum MQTT_Dedup_Slot_e {
 } MQTT_Dedup_Slot_t;
 
 #define DEDUP_EXPIRE_TIME 5
+// Publishes with OBK_PUBLISH_FLAG_DEDUP go through a small cache keyed by topic hash,
+// unchanged value is not sent again until this many seconds have passed (see mqtt_dedupExpire)
+#define DEDUP_CACHE_EXPIRE_TIME 60
 
 // This will not republish given value if value is the same as in previous publish and if the time passed since last publish is lower than expireTime
 OBK_Publish_Result MQTT_PublishMain_StringString_DeDuped(int slotCode, int expireTime, const char* sChannel, const char* valueStr, int flags);
 OBK_Publish_Result MQTT_PublishMain_StringInt_DeDuped(int slotCode, int expireTime, const char* sChannel, int val, int flags);
 void MQTT_Dedup_Tick();
+// true if the same value was sent to this topic recently, so publish can be skipped
+bool MQTT_Dedup_IsUnchanged(const char* sTopic, const char* sChannel, const char* valueStr, int flags);
+void MQTT_Dedup_MarkSent(const char* sTopic, const char* sChannel, const char* valueStr, int flags);
+void MQTT_Dedup_SetCacheExpireTime(int seconds);
+// broker may have lost state, so everything is sent again
+void MQTT_Dedup_ResetCache();
 
 #endif
 
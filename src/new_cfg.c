@@ -96,6 +96,7 @@ void CFG_MarkAsDirty() {
 }
 void CFG_ClearIO() {
 	memset(&g_cfg.pins, 0, sizeof(g_cfg.pins));
+	PIN_InvalidateChannelIndex();
 	g_cfg_pendingChanges++;
 }
 void CFG_SetDefaultConfig() {
@@ -112,6 +113,7 @@ void CFG_SetDefaultConfig() {
 	g_configInitialized = 1;
 
 	memset(&g_cfg,0,sizeof(mainConfig_t));
+	PIN_InvalidateChannelIndex();
 	g_cfg.version = MAIN_CFG_VERSION;
 	g_cfg.mqtt_port = 1883;
 	g_cfg.ident0 = CFG_IDENT_0;
@@ -535,6 +537,7 @@ void CFG_SetMQTTPass(const char *s) {
 }
 void CFG_ClearPins() {
 	memset(&g_cfg.pins,0,sizeof(g_cfg.pins));
+	PIN_InvalidateChannelIndex();
 	g_cfg_pendingChanges++;
 }
 void CFG_IncrementOTACount() {
@@ -547,15 +550,208 @@ void CFG_SetMac(char *mac) {
 		g_cfg_pendingChanges++;
 	}
 }
+
+// Journal: where platform has room after saved config, small saves append
+// records of changed byte runs there instead of rewriting (and erasing) it.
+// Record is marker, CRC8, offset (top bit set on last record of a save),
+// length and data. Loading applies records up to last complete save, and
+// full config is saved again when journal is full.
+#define CFG_JOURNAL_MARKER		0xA5
+#define CFG_JOURNAL_HEADER		5
+#define CFG_JOURNAL_COMMIT		0x8000
+#define CFG_JOURNAL_MAX_RECORD	255
+// runs closer than this are joined, record header costs more than the gap
+#define CFG_JOURNAL_GAP			CFG_JOURNAL_HEADER
+
+// config as it is on flash with journal applied, so changes can be found
+static byte *g_cfgSaved = 0;
+// next free byte of journal, -1 when only full save can be done
+static int g_cfgJournalPos = -1;
+static int g_cfgJournalSize = 0;
+static int g_cfgFullSaves = 0;
+static int g_cfgJournalSaves = 0;
+
+// after full save or load, journal continues from pos (-1 to not use it)
+static void CFG_Journal_Reset(int pos) {
+	g_cfgJournalPos = -1;
+	g_cfgJournalSize = HAL_Configuration_GetJournalSize(sizeof(g_cfg));
+	if (g_cfgJournalSize <= 0 || pos < 0) {
+		return;
+	}
+	if (g_cfgSaved == 0) {
+		g_cfgSaved = (byte*)malloc(sizeof(g_cfg));
+		if (g_cfgSaved == 0) {
+			return;
+		}
+	}
+	memcpy(g_cfgSaved, &g_cfg, sizeof(g_cfg));
+	g_cfgJournalPos = pos;
+}
+// finds next changed run starting at *i
+static bool CFG_Journal_NextRun(int *i, int *start, int *len) {
+	const byte *cur = (const byte*)&g_cfg;
+	int n = sizeof(g_cfg);
+	int j, end, gap;
+
+	while (*i < n && cur[*i] == g_cfgSaved[*i]) {
+		(*i)++;
+	}
+	if (*i >= n) {
+		return false;
+	}
+	*start = *i;
+	end = *i + 1;
+	gap = 0;
+	for (j = end; j < n && j < *start + CFG_JOURNAL_MAX_RECORD; j++) {
+		if (cur[j] != g_cfgSaved[j]) {
+			end = j + 1;
+			gap = 0;
+		}
+		else if (++gap >= CFG_JOURNAL_GAP) {
+			break;
+		}
+	}
+	*len = end - *start;
+	*i = end;
+	return true;
+}
+// returns 0 when changes went to journal
+static int CFG_Journal_Save() {
+	byte rec[CFG_JOURNAL_HEADER + CFG_JOURNAL_MAX_RECORD];
+	int i, start, len, runs, need, run, off;
+
+	if (g_cfgSaved == 0 || g_cfgJournalPos < 0) {
+		return -1;
+	}
+	// nothing is written unless whole save fits
+	i = 0;
+	runs = 0;
+	need = 0;
+	while (CFG_Journal_NextRun(&i, &start, &len)) {
+		need += CFG_JOURNAL_HEADER + len;
+		runs++;
+	}
+	if (runs == 0) {
+		return 0;
+	}
+	if (g_cfgJournalPos + need > g_cfgJournalSize) {
+		return -1;
+	}
+	i = 0;
+	for (run = 0; run < runs; run++) {
+		CFG_Journal_NextRun(&i, &start, &len);
+		off = start;
+		if (run == runs - 1) {
+			off |= CFG_JOURNAL_COMMIT;
+		}
+		rec[0] = CFG_JOURNAL_MARKER;
+		rec[2] = off & 0xFF;
+		rec[3] = off >> 8;
+		rec[4] = len;
+		memcpy(rec + CFG_JOURNAL_HEADER, ((const byte*)&g_cfg) + start, len);
+		rec[1] = Tiny_CRC8((const char*)rec + 2, 3 + len);
+		if (HAL_Configuration_WriteJournal(rec, g_cfgJournalPos, CFG_JOURNAL_HEADER + len) != 0) {
+			// unknown state, full save rewrites it
+			g_cfgJournalPos = -1;
+			return -1;
+		}
+		g_cfgJournalPos += CFG_JOURNAL_HEADER + len;
+		memcpy(g_cfgSaved + start, rec + CFG_JOURNAL_HEADER, len);
+	}
+	g_cfgJournalSaves++;
+	ADDLOG_DEBUG(LOG_FEATURE_CFG, "CFG journal save, %i runs, %i bytes, %i of %i used",
+		runs, need, g_cfgJournalPos, g_cfgJournalSize);
+	return 0;
+}
+// reads journal record at pos into rec, returns its length or 0 at end
+static int CFG_Journal_ReadRecord(byte *rec, int pos, int *off) {
+	int len;
+
+	if (pos + CFG_JOURNAL_HEADER > g_cfgJournalSize
+		|| HAL_Configuration_ReadJournal(rec, pos, CFG_JOURNAL_HEADER) != 0
+		|| rec[0] != CFG_JOURNAL_MARKER) {
+		return 0;
+	}
+	*off = rec[2] | (rec[3] << 8);
+	len = rec[4];
+	if (len == 0 || (*off & ~CFG_JOURNAL_COMMIT) + len > sizeof(g_cfg)
+		|| pos + CFG_JOURNAL_HEADER + len > g_cfgJournalSize
+		|| HAL_Configuration_ReadJournal(rec + CFG_JOURNAL_HEADER, pos + CFG_JOURNAL_HEADER, len) != 0
+		|| (byte)Tiny_CRC8((const char*)rec + 2, 3 + len) != rec[1]) {
+		return 0;
+	}
+	return CFG_JOURNAL_HEADER + len;
+}
+// called once saved config passed its check
+static void CFG_Journal_Load() {
+	byte rec[CFG_JOURNAL_HEADER + CFG_JOURNAL_MAX_RECORD];
+	int pos, committed, len, off, records;
+	byte next;
+
+	g_cfgJournalSize = HAL_Configuration_GetJournalSize(sizeof(g_cfg));
+	if (g_cfgJournalSize <= 0) {
+		return;
+	}
+	// find end of last complete save
+	pos = 0;
+	committed = 0;
+	while ((len = CFG_Journal_ReadRecord(rec, pos, &off)) > 0) {
+		pos += len;
+		if (off & CFG_JOURNAL_COMMIT) {
+			committed = pos;
+		}
+	}
+	records = 0;
+	for (pos = 0; pos < committed; pos += len) {
+		len = CFG_Journal_ReadRecord(rec, pos, &off);
+		off &= ~CFG_JOURNAL_COMMIT;
+		memcpy(((byte*)&g_cfg) + off, rec + CFG_JOURNAL_HEADER, len - CFG_JOURNAL_HEADER);
+		records++;
+	}
+	// appending is safe only after last save, on erased flash
+	next = 0;
+	if (committed < g_cfgJournalSize) {
+		HAL_Configuration_ReadJournal(&next, committed, 1);
+	}
+	if (records) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_CFG, "CFG_InitAndLoad: applied %i journal records, %i bytes.", records, committed);
+	}
+	CFG_Journal_Reset(next == 0xFF ? committed : -1);
+}
+void CFG_GetSaveStats(int *fullSaves, int *journalSaves, int *journalUsed) {
+	*fullSaves = g_cfgFullSaves;
+	*journalSaves = g_cfgJournalSaves;
+	*journalUsed = g_cfgJournalPos;
+}
 void CFG_Save_IfThereArePendingChanges() {
 	if(g_cfg_pendingChanges > 0) {
 		g_cfg.version = MAIN_CFG_VERSION;
 		g_cfg.changeCounter++;
 		g_cfg.crc = CFG_CalcChecksum(&g_cfg);
-		HAL_Configuration_SaveConfigMemory(&g_cfg,sizeof(g_cfg));
+		if (CFG_Journal_Save() != 0) {
+			HAL_Configuration_SaveConfigMemory(&g_cfg,sizeof(g_cfg));
+			g_cfgFullSaves++;
+			CFG_Journal_Reset(0);
+		}
 		g_cfg_pendingChanges = 0;
 	}
 }
+// Before reboot and OTA, journal is folded into full config, so firmware
+// that boots next finds whole config even if it can't read the journal.
+void CFG_Save_Compact() {
+	if (g_cfg_pendingChanges == 0 && g_cfgJournalPos <= 0) {
+		return;
+	}
+	g_cfg.version = MAIN_CFG_VERSION;
+	if (g_cfg_pendingChanges > 0) {
+		g_cfg.changeCounter++;
+	}
+	g_cfg.crc = CFG_CalcChecksum(&g_cfg);
+	HAL_Configuration_SaveConfigMemory(&g_cfg, sizeof(g_cfg));
+	g_cfgFullSaves++;
+	CFG_Journal_Reset(0);
+	g_cfg_pendingChanges = 0;
+}
 void CFG_DeviceGroups_SetName(const char *s) {
 	// this will return non-zero if there were any changes
 	if(strcpy_safe_checkForChanges(g_cfg.dgr_name, s,sizeof(g_cfg.dgr_name))) {
@@ -687,6 +883,7 @@ void PIN_SetPinChannelForPinIndex(int index, int ch) {
 	if(g_cfg.pins.channels[index] != ch) {
 		g_cfg_pendingChanges++;
 		g_cfg.pins.channels[index] = ch;
+		PIN_InvalidateChannelIndex();
 	}
 }
 void PIN_SetPinChannel2ForPinIndex(int index, int ch) {
@@ -697,6 +894,7 @@ void PIN_SetPinChannel2ForPinIndex(int index, int ch) {
 	if(g_cfg.pins.channels2[index] != ch) {
 		g_cfg_pendingChanges++;
 		g_cfg.pins.channels2[index] = ch;
+		PIN_InvalidateChannelIndex();
 	}
 }
 //void CFG_ApplyStartChannelValues() {
@@ -793,6 +991,53 @@ uint32_t CFG_GetLFS_Size() {
 	}
 	return size;
 }
+static byte CFG_Log2OrZero(int value) {
+	byte res = 0;
+
+	if (value <= 0) {
+		return 0;
+	}
+	while ((1 << (res + 1)) <= value) {
+		res++;
+	}
+	return res;
+}
+// sizes are stored as powers of two, others are rounded down
+void CFG_SetLFS_Tuning(int cacheSize, int lookaheadSize, int blockCycles) {
+	byte cache, lookahead, cycles;
+
+	cache = CFG_Log2OrZero(cacheSize);
+	lookahead = CFG_Log2OrZero(lookaheadSize);
+	if (blockCycles < 0) {
+		cycles = 255;
+	}
+	else if (blockCycles == 0) {
+		cycles = 0;
+	}
+	else if (blockCycles >= 2540) {
+		cycles = 254;
+	}
+	else {
+		cycles = (blockCycles + 9) / 10;
+	}
+	if (g_cfg.LFS_cacheLog2 != cache || g_cfg.LFS_lookaheadLog2 != lookahead
+		|| g_cfg.LFS_blockCycles10 != cycles) {
+		g_cfg.LFS_cacheLog2 = cache;
+		g_cfg.LFS_lookaheadLog2 = lookahead;
+		g_cfg.LFS_blockCycles10 = cycles;
+		g_cfg_pendingChanges++;
+	}
+}
+void CFG_GetLFS_Tuning(int *cacheSize, int *lookaheadSize, int *blockCycles) {
+	*cacheSize = g_cfg.LFS_cacheLog2 ? (1 << g_cfg.LFS_cacheLog2) : 0;
+	*lookaheadSize = g_cfg.LFS_lookaheadLog2 ? (1 << g_cfg.LFS_lookaheadLog2) : 0;
+	if (g_cfg.LFS_blockCycles10 == 255) {
+		*blockCycles = -1;
+	}
+	else {
+		*blockCycles = g_cfg.LFS_blockCycles10 * 10;
+	}
+}
 #endif
 
 #if MQTT_USE_TLS
@@ -845,7 +1090,10 @@ void CFG_InitAndLoad() {
 	byte chkSum;
 
 	HAL_Configuration_ReadConfigMemory(&g_cfg,sizeof(g_cfg));
+	PIN_InvalidateChannelIndex();
 	chkSum = CFG_CalcChecksum(&g_cfg);
+	// until full save, nothing is known about flash
+	CFG_Journal_Reset(-1);
 	if(g_cfg.ident0 != CFG_IDENT_0 || g_cfg.ident1 != CFG_IDENT_1 || g_cfg.ident2 != CFG_IDENT_2
 		|| chkSum != g_cfg.crc) {
 			addLogAdv(LOG_WARN, LOG_FEATURE_CFG, "CFG_InitAndLoad: Config crc or ident mismatch. Default config will be loaded.");
@@ -853,6 +1101,13 @@ void CFG_InitAndLoad() {
 		// mark as changed
 		g_cfg_pendingChanges ++;
 	} else {
+		CFG_Journal_Load();
+		if (CFG_CalcChecksum(&g_cfg) != g_cfg.crc) {
+			// records passed their checks, so this should not happen
+			addLogAdv(LOG_WARN, LOG_FEATURE_CFG, "CFG_InitAndLoad: journal does not match config, using saved config.");
+			HAL_Configuration_ReadConfigMemory(&g_cfg,sizeof(g_cfg));
+			CFG_Journal_Reset(-1);
+		}
 #if defined(PLATFORM_XRADIO) || defined(PLATFORM_BL602)
 		if (g_cfg.mac[0] == 0 && g_cfg.mac[1] == 0 && g_cfg.mac[2] == 0 && g_cfg.mac[3] == 0 && g_cfg.mac[4] == 0 && g_cfg.mac[5] == 0) {
 			WiFI_GetMacAddress((char*)g_cfg.mac);
@@ -44,6 +44,10 @@ int CFG_SetWebappRoot(const char *s);
 void CFG_InitAndLoad();
 //void CFG_ApplyStartChannelValues();
 void CFG_Save_IfThereArePendingChanges();
+// saves whole config, also when only journal holds changes
+void CFG_Save_Compact();
+// journalUsed is -1 when next save will be full one
+void CFG_GetSaveStats(int *fullSaves, int *journalSaves, int *journalUsed);
 void CFG_Save_SetupTimer();
 void CFG_IncrementOTACount();
 // This is a short startup command stored along with config.
@@ -96,6 +100,9 @@ void CFG_SetWebPassword(const char *s);
 #if ENABLE_LITTLEFS
 void CFG_SetLFS_Size(uint32_t value);
 uint32_t CFG_GetLFS_Size();
+// 0 means platform default, blockCycles -1 disables wear leveling
+void CFG_SetLFS_Tuning(int cacheSize, int lookaheadSize, int blockCycles);
+void CFG_GetLFS_Tuning(int *cacheSize, int *lookaheadSize, int *blockCycles);
 #endif 
 
 #if MQTT_USE_TLS
@@ -361,6 +361,12 @@ typedef int SemaphoreHandle_t;
 #define pdTRUE 1
 #define pdFALSE 0
 typedef int OSStatus;
+// win_rtos_stub.c
+int xSemaphoreTake(int semaphore, int blockTime);
+int xSemaphoreCreateMutex();
+int xSemaphoreGive(int semaphore);
+int xTaskGetTickCount();
+int xPortGetFreeHeapSize();
 
 int rtos_delay_milliseconds(int sec);
 int delay_ms(int sec);
@@ -535,6 +541,7 @@ OSStatus rtos_suspend_thread(beken_thread_t* thread);
 
 #include <FreeRTOS.h>
 #include <task.h>
+#include <semphr.h>
 
 #define ASSERT
 //#define os_free free
@@ -626,6 +633,9 @@ OSStatus rtos_suspend_thread(beken_thread_t* thread);
 
 #if PLATFORM_ESP8266
 #define xPortGetFreeHeapSize() esp_get_free_heap_size()
+#else
+// dual core, queue filled by ISR may be read on other core
+#define OBK_SMP_BARRIER()	__sync_synchronize()
 #endif
 
 #elif PLATFORM_TR6260
@@ -999,6 +1009,13 @@ typedef unsigned char byte;
 #endif
 
 
+// Orders stores of queue entry before store of index that publishes it,
+// and reads of index before reads of entry, where ISR or other core fills
+// the queue. Single core chips only need volatile index for that.
+#ifndef OBK_SMP_BARRIER
+#define OBK_SMP_BARRIER()
+#endif
+
 // stricmp fix
 #if WINDOWS
 
@@ -1036,6 +1053,9 @@ const char* strcasestr(const char* str1, const char* str2);
 
 // user_main.c
 char Tiny_CRC8(const char *data,int length);
+// continues checksum of Tiny_CRC8 over more data, start with 0;
+// Tiny_CRC8 of whole is same as CRC8_Update over its parts in order
+unsigned char CRC8_Update(unsigned char crc, const void *data, int length);
 void RESET_ScheduleModuleReset(int delSeconds);
 void MAIN_ScheduleUnsafeInit(int delSeconds);
 #if ENABLE_HA_DISCOVERY
@@ -1045,16 +1065,44 @@ int Main_IsConnectedToWiFi();
 int Main_IsOpenAccessPointMode();
 void Main_Init();
 bool Main_HasFastConnect();
+void Main_ConnectToWiFiNow();
+void Main_HoldWiFi(bool bHold);
+bool Main_IsWiFiHeld();
+void Main_LogBootPhase(const char* phase);
 void Main_OnEverySecond();
 int Main_HasMQTTConnected();
 int Main_HasWiFiConnected();
 void Main_OnPingCheckerReply(int ms);
+void Main_OnWiFiStatusChange(int code);
+
+// new_ping.c, new_pingStats.c
+#if ENABLE_PING_WATCHDOG || WINDOWS
+#define PING_HIST_BUCKETS		8
+typedef struct pingStats_s {
+	unsigned int sent;
+	unsigned int received;
+	unsigned int lost;
+	// current, adapted interval
+	unsigned int intervalMs;
+	unsigned int lastMs;
+	unsigned int minMs;
+	unsigned int maxMs;
+	unsigned int sumMs;
+	// round trips, bucket limits are given by PingWatchDog_GetBucketLimitMS
+	unsigned int hist[PING_HIST_BUCKETS];
+} pingStats_t;
 
-// new_ping.c
-#if ENABLE_PING_WATCHDOG
 void Main_SetupPingWatchDog(const char *target/*, int delayBetweenPings_Seconds*/);
 int PingWatchDog_GetTotalLost();
 int PingWatchDog_GetTotalReceived();
+const pingStats_t *PingWatchDog_GetStats();
+// upper limit of bucket in ms, -1 for last one that has no limit
+int PingWatchDog_GetBucketLimitMS(int bucket);
+// called by new_ping.c for each ping, adapt interval and histogram
+void PingWatchDog_ResetStats();
+void PingWatchDog_OnSent();
+void PingWatchDog_OnReply(unsigned int ms);
+void PingWatchDog_OnLoss();
 #endif
 
 // my addon to LWIP library
@@ -1113,6 +1161,12 @@ extern uint8_t g_wifi_channel;
 typedef int(*jsonCb_t)(void *userData, const char *fmt, ...);
 #if ENABLE_TASMOTA_JSON
 int JSON_ProcessCommandReply(const char *cmd, const char *args, void *request, jsonCb_t printer, int flags);
+void JSON_PrintKeyValue_String(void* request, jsonCb_t printer, const char* key, const char* value, bool bComma);
+void JSON_PrintKeyValue_Int(void* request, jsonCb_t printer, const char* key, int value, bool bComma);
+void JSON_PrintKeyValue_Float(void* request, jsonCb_t printer, const char* key, float value, bool bComma);
+#if ENABLE_TASMOTA_JSON_CACHE
+void JSON_GetStatusCacheStats(int *hits, int *misses);
+#endif
 #endif
 void ScheduleDriverStart(const char *name, int delay);
 bool isWhiteSpace(char ch);
@@ -1120,5 +1174,86 @@ void convert_IP_to_string(char *o, unsigned char *ip);
 int str_to_ip(const char *s, byte *ip);
 int STR_ReplaceWhiteSpacesWithUnderscore(char *p);
 
+#if ENABLE_HEAP_TRACKER
+typedef struct heapSiteStats_s {
+	const char *file;
+	int line;
+	unsigned int liveBytes;
+	unsigned int liveCount;
+	unsigned int peakBytes;
+	unsigned int allocs;
+} heapSiteStats_t;
+
+typedef struct heapStats_s {
+	unsigned int liveBytes;
+	unsigned int liveCount;
+	unsigned int peakBytes;
+	unsigned int allocs;
+	unsigned int frees;
+	unsigned int failed;
+	// frees and reallocs of blocks that did not come from tracker
+	unsigned int untracked;
+	int freeHeap;
+	// -1 when platform can't tell
+	int largestFree;
+} heapStats_t;
+
+void *HeapTrack_Malloc(size_t size, const char *file, int line);
+void *HeapTrack_Calloc(size_t count, size_t size, const char *file, int line);
+void *HeapTrack_Realloc(void *p, size_t size, const char *file, int line);
+void HeapTrack_Free(void *p);
+void *HeapTrack_HookMalloc(size_t size);
+void HeapTrack_HookFree(void *p);
+void HeapTrack_GetStats(heapStats_t *out);
+int HeapTrack_GetSites(heapSiteStats_t *out, int maxCount);
+void HeapTrack_ResetPeak();
+unsigned int HeapTrack_GetMark();
+int HeapTrack_CountLiveSince(unsigned int mark, bool bLog);
+
+// every allocation of our code records file and line, see heapstats
+#ifndef HEAP_TRACKER_INTERNAL
+#undef os_malloc
+#undef os_free
+#undef os_realloc
+#undef os_calloc
+#undef malloc
+#undef free
+#undef realloc
+#undef calloc
+#define os_malloc(size)			HeapTrack_Malloc(size, __FILE__, __LINE__)
+#define os_free(p)				HeapTrack_Free(p)
+#define os_realloc(p, size)		HeapTrack_Realloc(p, size, __FILE__, __LINE__)
+#define os_calloc(count, size)	HeapTrack_Calloc(count, size, __FILE__, __LINE__)
+#define malloc(size)			HeapTrack_Malloc(size, __FILE__, __LINE__)
+#define free(p)					HeapTrack_Free(p)
+#define realloc(p, size)		HeapTrack_Realloc(p, size, __FILE__, __LINE__)
+#define calloc(count, size)		HeapTrack_Calloc(count, size, __FILE__, __LINE__)
+#endif
+#endif
+
+#if ENABLE_MEMPOOL
+#define MEMPOOL_NUM_CLASSES		4
+
+typedef struct memPoolStats_s {
+	unsigned short blockSize;
+	unsigned short slabs;
+	unsigned int used;
+	unsigned int capacity;
+	unsigned int peakUsed;
+	unsigned int allocs;
+} memPoolStats_t;
+
+// small blocks of similar size, see poolstats. Blocks bigger than largest
+// class, or when no slab can be had, come from malloc, MemPool_Free
+// tells them apart, so every MemPool_Alloc just needs MemPool_Free.
+void *MemPool_Alloc(size_t size);
+void MemPool_Free(void *p);
+// one entry per size class, returns count of them
+int MemPool_GetStats(memPoolStats_t *out, unsigned int *outFallbacks);
+#else
+#define MemPool_Alloc(size)		malloc(size)
+#define MemPool_Free(p)			free(p)
+#endif
+
 #endif /* __NEW_COMMON_H__ */
 
@@ -54,12 +54,14 @@
 #define PING_RESULT(ping_ok)
 #endif
 
+// Pings run from lwIP timeouts, the timer lwIP already runs, and replies
+// come to raw PCB callback, so watchdog has no thread or socket of its own.
+// Interval and round trip histogram are kept in new_pingStats.c.
+
 static unsigned int ping_time;
 static ip_addr_t ping_target;
 static unsigned short ping_seq_num;
 static struct raw_pcb *ping_pcb;
-static unsigned int ping_lost = 0;
-static unsigned int ping_received = 0;
 static int bReceivedLastOneSend = -1;
 static bool ping_handler_active = false;
 //static bool ping_handler_silent = false;
@@ -105,12 +107,8 @@ static void ping_send(struct raw_pcb *raw, const ip_addr_t *addr)
 
     ping_prepare_echo(iecho, (u16_t)ping_size);
 
-	if(bReceivedLastOneSend == 0) {
-		//addLogAdv(LOG_INFO,LOG_FEATURE_MAIN,"Ping lost: (total lost %i, recv %i)\r\n",ping_lost,ping_received);
-		ping_lost++;
-
-	}
 	bReceivedLastOneSend = 0;
+	PingWatchDog_OnSent();
 
     raw_sendto(raw, p, addr);
 
@@ -119,20 +117,14 @@ static void ping_send(struct raw_pcb *raw, const ip_addr_t *addr)
   }
   pbuf_free(p);
 }
-int PING_getPingIntervalMS() {
-	int ret;
-
-	ret = CFG_GetPingIntervalSeconds();
-
-	if (ret < 1) {
-		ret = 1;
-	}
-	return ret * 1000;
-}
 static void ping_timeout(void *arg)
 {
   struct raw_pcb *pcb = (struct raw_pcb*)arg;
 
+  // reply to previous one did not come until now
+  if (bReceivedLastOneSend == 0) {
+    PingWatchDog_OnLoss();
+  }
  // if (ping_handler_silent == false)
   {
     LWIP_ASSERT("ping_timeout: no pcb given!", pcb != NULL);
@@ -140,7 +132,7 @@ static void ping_timeout(void *arg)
     ping_send(pcb, &ping_target);
   }
   // void 	sys_timeout (u32_t msecs, sys_timeout_handler handler, void *arg)
-  sys_timeout(PING_getPingIntervalMS(), ping_timeout, pcb);
+  sys_timeout(PingWatchDog_GetStats()->intervalMs, ping_timeout, pcb);
 }
 
 static u8_t ping_recv(void *arg, struct raw_pcb *pcb, struct pbuf *p, const ip_addr_t *addr)
@@ -161,8 +153,8 @@ static u8_t ping_recv(void *arg, struct raw_pcb *pcb, struct pbuf *p, const ip_a
     // ip_addr_debug_print(PING_DEBUG, addr);
 	  ms = (sys_now()-ping_time);
     //  LWIP_DEBUGF( PING_DEBUG, (" %"U32_F" ms\n", ms));
-	  ping_received++;
 	bReceivedLastOneSend = 1;
+	PingWatchDog_OnReply(ms);
 
 	//addLogAdv(LOG_INFO,LOG_FEATURE_MAIN,"Ping recv: %ims (total lost %i, recv %i)\r\n", ms,ping_lost,ping_received);
 
@@ -179,13 +171,6 @@ static u8_t ping_recv(void *arg, struct raw_pcb *pcb, struct pbuf *p, const ip_a
   return 0; /* don't eat the packet */
 }
 
-int PingWatchDog_GetTotalLost() {
-	return ping_lost;
-}
-int PingWatchDog_GetTotalReceived() {
-	return ping_received;
-}
-
 void Main_SetupPingWatchDog(const char *target/*, int delayBetweenPings_Seconds*/) 
 {
 	// none sent yet.
@@ -202,8 +187,9 @@ void Main_SetupPingWatchDog(const char *target/*, int delayBetweenPings_Seconds*
 
         raw_recv(ping_pcb, ping_recv, NULL);
         raw_bind(ping_pcb, IP_ADDR_ANY);
+		PingWatchDog_ResetStats();
 	    // void 	sys_timeout (u32_t msecs, sys_timeout_handler handler, void *arg)
-        sys_timeout(PING_getPingIntervalMS(), ping_timeout, ping_pcb);
+        sys_timeout(PingWatchDog_GetStats()->intervalMs, ping_timeout, ping_pcb);
 		ping_handler_active = true;
     }
 
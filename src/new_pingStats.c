@@ -0,0 +1,113 @@
+// Ping watchdog interval and round trip statistics, apart from lwIP code
+// of new_ping.c so they are built in simulator too.
+
+#include "obk_config.h"
+
+#if ENABLE_PING_WATCHDOG || WINDOWS
+
+#include "new_common.h"
+#include "new_cfg.h"
+
+// Interval adapts to link: after PING_HEALTHY_STREAK replies in a row it
+// doubles, up to PING_MAX_BACKOFF times PingInterval, and a lost reply
+// brings it back to PingInterval and then halves it down to
+// PING_MIN_INTERVAL_MS, so loss is confirmed soon. It never gets so long
+// that watchdog restart time could pass between pings.
+// Round trip of each reply goes to histogram, see ping_bucketLimits.
+#define PING_MIN_INTERVAL_MS	1000
+#define PING_MAX_BACKOFF		8
+#define PING_HEALTHY_STREAK		4
+
+static unsigned int ping_streak = 0;
+static pingStats_t ping_stats;
+// upper limits of histogram buckets in ms, last bucket takes the rest
+static const unsigned short ping_bucketLimits[PING_HIST_BUCKETS - 1] = { 5, 10, 20, 50, 100, 200, 500 };
+
+int PING_getPingIntervalMS() {
+	int ret;
+
+	ret = CFG_GetPingIntervalSeconds();
+
+	if (ret < 1) {
+		ret = 1;
+	}
+	return ret * 1000;
+}
+static unsigned int ping_getMaxIntervalMS() {
+	unsigned int base = PING_getPingIntervalMS();
+	unsigned int max = base * PING_MAX_BACKOFF;
+	int restart = CFG_GetPingDisconnectedSecondsToRestart();
+
+	// at least few pings before watchdog restarts device
+	if (restart > 0 && max > (unsigned int)restart * 1000 / 4) {
+		max = (unsigned int)restart * 1000 / 4;
+	}
+	return max > base ? max : base;
+}
+void PingWatchDog_ResetStats() {
+	memset(&ping_stats, 0, sizeof(ping_stats));
+	ping_stats.intervalMs = PING_getPingIntervalMS();
+	ping_streak = 0;
+}
+void PingWatchDog_OnSent() {
+	ping_stats.sent++;
+}
+void PingWatchDog_OnReply(unsigned int ms) {
+	int i;
+
+	for (i = 0; i < PING_HIST_BUCKETS - 1; i++) {
+		if (ms <= ping_bucketLimits[i]) {
+			break;
+		}
+	}
+	ping_stats.hist[i]++;
+	if (ping_stats.received == 0 || ms < ping_stats.minMs) {
+		ping_stats.minMs = ms;
+	}
+	if (ms > ping_stats.maxMs) {
+		ping_stats.maxMs = ms;
+	}
+	ping_stats.lastMs = ms;
+	ping_stats.sumMs += ms;
+	ping_stats.received++;
+	if (++ping_streak >= PING_HEALTHY_STREAK) {
+		ping_streak = 0;
+		ping_stats.intervalMs *= 2;
+		if (ping_stats.intervalMs > ping_getMaxIntervalMS()) {
+			ping_stats.intervalMs = ping_getMaxIntervalMS();
+		}
+	}
+}
+void PingWatchDog_OnLoss() {
+	unsigned int base = PING_getPingIntervalMS();
+
+	ping_stats.lost++;
+	ping_streak = 0;
+	if (ping_stats.intervalMs > base) {
+		ping_stats.intervalMs = base;
+	}
+	else if (ping_stats.intervalMs / 2 >= PING_MIN_INTERVAL_MS) {
+		ping_stats.intervalMs /= 2;
+	}
+	else {
+		ping_stats.intervalMs = PING_MIN_INTERVAL_MS;
+	}
+}
+
+int PingWatchDog_GetTotalLost() {
+	return ping_stats.lost;
+}
+int PingWatchDog_GetTotalReceived() {
+	return ping_stats.received;
+}
+const pingStats_t *PingWatchDog_GetStats() {
+	return &ping_stats;
+}
+int PingWatchDog_GetBucketLimitMS(int bucket) {
+	if (bucket < 0 || bucket >= PING_HIST_BUCKETS - 1) {
+		return -1;
+	}
+	return ping_bucketLimits[bucket];
+}
+
+#endif // ENABLE_PING_WATCHDOG || WINDOWS
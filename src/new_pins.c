@@ -6,7 +6,9 @@
 #include "quicktick.h"
 #include "new_cfg.h"
 #include "httpserver/new_http.h"
+#include "httpserver/http_sse.h"
 #include "logging/logging.h"
+#include "logging/ioTrace.h"
 #include "mqtt/new_mqtt.h"
 // Commands register, execution API and cmd tokenizer
 #include "cmnds/cmd_public.h"
@@ -137,8 +139,97 @@ char g_enable_pins = 0;
 
 // it was nice to have it as bits but now that we support PWM...
 //int g_channelStates;
-int g_channelValues[CHANNEL_MAX] = { 0 };
-float g_channelValuesFloats[CHANNEL_MAX] = { 0 };
+// Value is kept in the form it was set, see CHANNEL_REPR_*. Raw value is
+// integer or float, final value is raw divided by divider of channel type.
+typedef struct channelValue_s {
+	union {
+		int i;
+		float f;
+	} v;
+	byte repr;
+	// type divider was taken from, integers follow type changes on read
+	byte type;
+	// 0 until integer is synced with its type
+	unsigned short divider;
+} channelValue_t;
+
+static channelValue_t g_channelStore[CHANNEL_MAX];
+
+static channelValue_t* Channel_Sync(int ch) {
+	channelValue_t* c = &g_channelStore[ch];
+
+	// float keeps divider it was set with
+	if (c->repr != CHANNEL_REPR_FLOAT && (c->divider == 0 || c->type != g_cfg.pins.channelTypes[ch])) {
+		c->type = g_cfg.pins.channelTypes[ch];
+		c->divider = ChannelType_GetDivider(c->type);
+		c->repr = c->divider > 1 ? CHANNEL_REPR_FIXED : CHANNEL_REPR_INT;
+	}
+	return c;
+}
+static int Channel_GetInt(int ch) {
+	if (g_channelStore[ch].repr == CHANNEL_REPR_FLOAT) {
+		return (int)g_channelStore[ch].v.f;
+	}
+	return g_channelStore[ch].v.i;
+}
+// true when channel already has exactly this integer
+static bool Channel_HoldsInt(int ch, int iVal) {
+	if (g_channelStore[ch].repr == CHANNEL_REPR_FLOAT) {
+		return g_channelStore[ch].v.f == (float)iVal;
+	}
+	return g_channelStore[ch].v.i == iVal;
+}
+static void Channel_StoreInt(int ch, int iVal) {
+	g_channelStore[ch].v.i = iVal;
+	g_channelStore[ch].repr = CHANNEL_REPR_INT;
+	g_channelStore[ch].divider = 0;
+	CHANNEL_STATS_UPDATE(ch, iVal);
+}
+static void Channel_StoreFloat(int ch, float raw, int divider) {
+	g_channelStore[ch].v.f = raw;
+	g_channelStore[ch].repr = CHANNEL_REPR_FLOAT;
+	g_channelStore[ch].type = g_cfg.pins.channelTypes[ch];
+	g_channelStore[ch].divider = divider;
+	CHANNEL_STATS_UPDATE(ch, raw);
+}
+// PWM of channel is full at 100, dimmer types with own range are full at its end
+static int Channel_GetPWMRange(int ch) {
+	switch (g_cfg.pins.channelTypes[ch]) {
+	case ChType_Dimmer256:
+		return 255;
+	case ChType_Dimmer1000:
+		return 1000;
+	}
+	return 100;
+}
+// value of channel, int or float, is in channel units, full PWM is at its range
+static unsigned short Channel_GetPWMDuty(int ch) {
+	int range = Channel_GetPWMRange(ch);
+	float f;
+	int v;
+
+	if (g_channelStore[ch].repr == CHANNEL_REPR_FLOAT) {
+		f = g_channelStore[ch].v.f;
+		if (f <= 0) {
+			return 0;
+		}
+		if (f >= range) {
+			return 65535;
+		}
+		return f * 65535 / range + 0.5f;
+	}
+	v = g_channelStore[ch].v.i;
+	if (v <= 0) {
+		return 0;
+	}
+	if (v >= range) {
+		return 65535;
+	}
+	return (v * 65535 + range / 2) / range;
+}
+// bumped on every channel change, so web page can ask only for changes
+static int g_stateVersion = 1;
+static int g_channelVersions[CHANNEL_MAX] = { 0 };
 
 pinButton_s g_buttons[PLATFORM_GPIO_MAX];
 
@@ -214,6 +305,8 @@ void PINS_BeginDeepSleepWithPinWakeUp(unsigned int wakeUpTime) {
 	int value;
 	int falling;
 
+	CHANNEL_FlushSaves();
+
 	// door input always uses opposite level for wakeup
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
 		if (g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep
@@ -346,66 +439,12 @@ void PINS_BeginDeepSleepWithPinWakeUp(unsigned int wakeUpTime) {
 }
 
 
-#ifdef PLATFORM_BEKEN
-#ifdef BEKEN_PIN_GPI_INTERRUPTS
-// TODO: EXAMPLE of edge based interrupt handling
-// NOT YET ENABLED
-
-// this will be from hal_bk....
-// causes button read.
-extern void BUTTON_TriggerRead();
-
-
-// NOTE: ISR!!!!
-// triggers one-shot timer to fire in 1ms
-// from hal_main_bk7231.c
-// THIS IS AN ISR.
-void PIN_IntHandler(unsigned char index) {
-	BUTTON_TriggerRead();
-}
-
-// this will be from hal_bk....
-// ensures that we will get called in 50ms or less.
-extern void BUTTON_TriggerRead_quick();
-
-// called in PIN_ticks to carry on polling for 20 polls after last button is active
-void PIN_TriggerPoll() {
-	BUTTON_TriggerRead_quick();
-}
-#endif
-#endif
-
-
 void PIN_SetupPins() {
 	int i;
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
 		PIN_SetPinRoleForPinIndex(i, g_cfg.pins.roles[i]);
 	}
 
-#ifdef PLATFORM_BEKEN
-#ifdef BEKEN_PIN_GPI_INTERRUPTS
-	// TODO: EXAMPLE of edge based interrupt handling
-	// NOT YET ENABLED
-	for (int i = 0; i < 32; i++) {
-		if (g_gpio_index_map[0] & (1 << i)) {
-			uint32_t mode = GPIO_INT_LEVEL_RISING;
-			if (g_gpio_edge_map[0] & (1 << i)) {
-				mode = GPIO_INT_LEVEL_FALLING;
-			}
-			if (g_cfg.pins.roles[i] == IOR_IRRecv) {
-				// not yet implemented
-				//gpio_int_enable(i, mode, IR_GPI_IntHandler);
-			}
-			else {
-				gpio_int_enable(i, mode, PIN_IntHandler);
-			}
-		}
-		else {
-			gpio_int_disable(i);
-		}
-	}
-#endif
-#endif
 #ifdef ENABLE_DRIVER_DHT
 	// TODO: better place to call?
 	DHT_OnPinsConfigChanged();
@@ -415,6 +454,36 @@ void PIN_SetupPins() {
 #endif
 	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "PIN_SetupPins pins have been set up.\r\n");
 }
+// Drives relay and LED outputs from channel values right after config
+// is loaded, long before commands, drivers and LittleFS are set up, so
+// relays come back to their state without flicker after power blip.
+// PIN_SetupPins sets up all roles later as before.
+void PIN_SetupOutputsEarly() {
+	int i, role, channelValue;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		role = g_cfg.pins.roles[i];
+		switch (role) {
+		case IOR_LED:
+		case IOR_LED_n:
+		case IOR_BAT_Relay:
+		case IOR_BAT_Relay_n:
+		case IOR_Relay:
+		case IOR_Relay_n:
+			channelValue = Channel_GetInt(g_cfg.pins.channels[i]);
+			HAL_PIN_Setup_Output(i);
+			if (role == IOR_LED_n || role == IOR_Relay_n || role == IOR_BAT_Relay_n) {
+				HAL_PIN_SetOutputValue(i, !channelValue);
+			}
+			else {
+				HAL_PIN_SetOutputValue(i, channelValue);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
 
 int PIN_GetPinRoleForPinIndex(int index) {
 	if (index < 0 || index >= PLATFORM_GPIO_MAX) {
@@ -498,6 +567,70 @@ void RAW_SetPinValue(int index, int iVal) {
 		HAL_PIN_SetOutputValue(index, iVal);
 	}
 }
+// digital outputs of channel changes are gathered here and written
+// in one HAL_PIN_WriteMasked, so relays of a batch switch together
+#if PLATFORM_GPIO_MAX > 64
+#error "pin masks of HAL_PIN_ReadAll/HAL_PIN_WriteMasked are 64 bit"
+#endif
+static uint64_t g_pinOutMask = 0;
+static uint64_t g_pinOutValues = 0;
+
+static void PIN_QueueOutput(int index, int iVal) {
+	g_pinOutMask |= 1ULL << index;
+	if (iVal) {
+		g_pinOutValues |= 1ULL << index;
+	}
+	else {
+		g_pinOutValues &= ~(1ULL << index);
+	}
+}
+// PWM duties are gathered too and set by one HAL_PIN_PWM_UpdateGroup,
+// so colors of light change on same PWM period
+static int g_pwmQueuePins[PLATFORM_GPIO_MAX];
+static unsigned short g_pwmQueueDuties[PLATFORM_GPIO_MAX];
+static int g_pwmQueueCount = 0;
+static int g_pwmGroupDepth = 0;
+
+static void PIN_QueuePWM(int index, unsigned short duty) {
+	int i;
+
+	for (i = 0; i < g_pwmQueueCount; i++) {
+		if (g_pwmQueuePins[i] == index) {
+			g_pwmQueueDuties[i] = duty;
+			return;
+		}
+	}
+	g_pwmQueuePins[g_pwmQueueCount] = index;
+	g_pwmQueueDuties[g_pwmQueueCount] = duty;
+	g_pwmQueueCount++;
+}
+static void PIN_FlushPWMs() {
+	if (g_pwmQueueCount == 0 || g_pwmGroupDepth > 0) {
+		return;
+	}
+	HAL_PIN_PWM_UpdateGroup(g_pwmQueuePins, g_pwmQueueDuties, g_pwmQueueCount);
+	g_pwmQueueCount = 0;
+}
+void PIN_BeginPWMGroup() {
+	g_pwmGroupDepth++;
+}
+void PIN_CommitPWMGroup() {
+	if (g_pwmGroupDepth > 0) {
+		g_pwmGroupDepth--;
+	}
+	PIN_FlushPWMs();
+}
+static void PIN_FlushOutputs() {
+	PIN_FlushPWMs();
+	if (g_pinOutMask == 0) {
+		return;
+	}
+	if (g_enable_pins) {
+		HAL_PIN_WriteMasked(g_pinOutMask, g_pinOutValues);
+	}
+	g_pinOutMask = 0;
+	g_pinOutValues = 0;
+}
 void Button_OnPressRelease(int index) {
 	if (CFG_HasFlag(OBK_FLAG_BUTTON_DISABLE_ALL)) {
 		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Child lock!");
@@ -730,15 +863,23 @@ bool BTN_ShouldInvert(int index) {
 	}
 	return false;
 }
-static uint8_t PIN_ReadDigitalInputValue_WithInversionIncluded(int index) {
-	uint8_t iVal = HAL_PIN_ReadDigitalInput(index);
-
+static uint8_t PIN_InvertInputIfNeeded(int index, uint8_t iVal) {
 	// support inverted button
 	if (BTN_ShouldInvert(index)) {
 		return (iVal == 0) ? 1 : 0;
 	}
 	return iVal;
 }
+static uint8_t PIN_ReadDigitalInputValue_WithInversionIncluded(int index) {
+#if ENABLE_IO_TRACE
+	if (g_ioTraceMode) {
+		uint8_t raw = HAL_PIN_ReadDigitalInput(index);
+		IOTrace_Gpio(index, raw);
+		return PIN_InvertInputIfNeeded(index, raw);
+	}
+#endif
+	return PIN_InvertInputIfNeeded(index, HAL_PIN_ReadDigitalInput(index));
+}
 static uint8_t button_generic_get_gpio_value(void* param)
 {
 	int index;
@@ -807,7 +948,7 @@ void CHANNEL_SetFirstChannelByType(int requiredType, int newVal) {
 void CHANNEL_SetAll(int iVal, int iFlags) {
 	int i;
 
-
+	CHANNEL_BeginBatch();
 	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
 		switch (g_cfg.pins.roles[i])
 		{
@@ -852,6 +993,7 @@ void CHANNEL_SetAll(int iVal, int iFlags) {
 			break;
 		}
 	}
+	CHANNEL_CommitBatch();
 }
 void CHANNEL_SetStateOnly(int iVal) {
 	int i;
@@ -881,7 +1023,7 @@ void CHANNEL_DoSpecialToggleAll() {
 	for (i = 0; i < CHANNEL_MAX; i++) {
 		if (CHANNEL_IsPowerRelayChannel(i) == false)
 			continue;
-		if (g_channelValues[i] > 0) {
+		if (Channel_GetInt(i) > 0) {
 			anyEnabled = true;
 		}
 	}
@@ -903,21 +1045,206 @@ void PIN_InterruptHandler(int gpio) {
 
 #endif
 
-unsigned short g_counterDeltas[PLATFORM_GPIO_MAX];
+// Pulse counters. Hardware unit (see HAL_PIN_Counter_Start) counts on
+// its own, else interrupt only bumps running total. Tick adds difference
+// since last tick to channel, so nothing is lost between read and clear.
+// Optional rate output is pulses per second over gating window.
+typedef struct pinCounter_s {
+	unsigned int seen;
+	bool bHardware;
+	int rateChannel;
+	// 0 when there is no rate output
+	int gateMS;
+	// of current gating window
+	unsigned int gatePulses;
+	int gateElapsed;
+} pinCounter_t;
+
+static volatile unsigned int g_counterPulses[PLATFORM_GPIO_MAX];
+static pinCounter_t g_counters[PLATFORM_GPIO_MAX];
+
 void PIN_InterruptHandler(int gpio) {
-	g_counterDeltas[gpio]++;
+	g_counterPulses[gpio]++;
 }
-void PIN_ApplyCounterDeltas() {
-	for (int i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_counterDeltas[i]) {
-			// TODO: disable interrupts now so it won't get called in meantime?
-			int delta = g_counterDeltas[i];
-			g_counterDeltas[i] = 0;
-			int ch = g_cfg.pins.channels[i];
-			CHANNEL_Add(ch, delta);
+static unsigned int PIN_Counter_ReadTotal(int index) {
+	if (g_counters[index].bHardware) {
+		return HAL_PIN_Counter_Read(index);
+	}
+	return g_counterPulses[index];
+}
+static void PIN_Counter_Start(int index, OBKInterruptType mode) {
+	pinCounter_t* c = &g_counters[index];
+
+	c->bHardware = HAL_PIN_Counter_Start(index, mode);
+	if (c->bHardware == false) {
+		HAL_PIN_Setup_Input_Pullup(index);
+		HAL_AttachInterrupt(index, mode, PIN_InterruptHandler);
+	}
+	c->seen = PIN_Counter_ReadTotal(index);
+	c->gatePulses = 0;
+	c->gateElapsed = 0;
+}
+static void PIN_Counter_Stop(int index) {
+	if (g_counters[index].bHardware) {
+		HAL_PIN_Counter_Stop(index);
+		g_counters[index].bHardware = false;
+	}
+	else {
+		HAL_DetachInterrupt(index);
+	}
+}
+void PIN_ApplyCounterDeltas(int elapsedMS) {
+	pinCounter_t* c;
+	unsigned int total, delta;
+	int i, role;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		role = g_cfg.pins.roles[i];
+		if (role != IOR_Counter_f && role != IOR_Counter_r) {
+			continue;
+		}
+		c = &g_counters[i];
+		total = PIN_Counter_ReadTotal(i);
+		// unsigned difference copes with wrap
+		delta = total - c->seen;
+		c->seen = total;
+		if (delta) {
+			CHANNEL_Add(g_cfg.pins.channels[i], delta);
+		}
+		if (c->gateMS <= 0) {
+			continue;
+		}
+		c->gatePulses += delta;
+		c->gateElapsed += elapsedMS;
+		if (c->gateElapsed >= c->gateMS) {
+			CHANNEL_SetSmart(c->rateChannel, c->gatePulses * 1000.0f / c->gateElapsed, 0);
+			c->gatePulses = 0;
+			c->gateElapsed = 0;
 		}
 	}
 }
+// ms until first gating window ends, -1 when no rate is measured
+static int PIN_Counter_GetTimeToNextRateMS() {
+	int i, left, best = -1;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (g_counters[i].gateMS <= 0) {
+			continue;
+		}
+		if (g_cfg.pins.roles[i] != IOR_Counter_f && g_cfg.pins.roles[i] != IOR_Counter_r) {
+			continue;
+		}
+		left = g_counters[i].gateMS - g_counters[i].gateElapsed;
+		if (left < 0) {
+			left = 0;
+		}
+		if (best < 0 || left < best) {
+			best = left;
+		}
+	}
+	return best;
+}
+bool PIN_Counter_IsHardware(int index) {
+	return g_counters[index].bHardware;
+}
+
+// what PIN_ticks does with pin of given role
+#define PIN_INPUT_NONE			0
+#define PIN_INPUT_BUTTON		1
+#define PIN_INPUT_DIGITAL		2
+#define PIN_INPUT_TOGGLE		3
+
+static int PIN_GetInputKind(int role) {
+	switch (role) {
+	case IOR_Button:
+	case IOR_Button_n:
+	case IOR_Button_ToggleAll:
+	case IOR_Button_ToggleAll_n:
+	case IOR_Button_NextColor:
+	case IOR_Button_NextColor_n:
+	case IOR_Button_NextDimmer:
+	case IOR_Button_NextDimmer_n:
+	case IOR_Button_NextTemperature:
+	case IOR_Button_NextTemperature_n:
+	case IOR_Button_ScriptOnly:
+	case IOR_Button_ScriptOnly_n:
+	case IOR_SmartButtonForLEDs:
+	case IOR_SmartButtonForLEDs_n:
+		return PIN_INPUT_BUTTON;
+	case IOR_DigitalInput:
+	case IOR_DigitalInput_n:
+	case IOR_DigitalInput_NoPup:
+	case IOR_DigitalInput_NoPup_n:
+	case IOR_DoorSensorWithDeepSleep:
+	case IOR_DoorSensorWithDeepSleep_NoPup:
+	case IOR_DoorSensorWithDeepSleep_pd:
+		return PIN_INPUT_DIGITAL;
+	case IOR_ToggleChannelOnToggle:
+	case IOR_ToggleChannelOnToggle_pd:
+		return PIN_INPUT_TOGGLE;
+	}
+	return PIN_INPUT_NONE;
+}
+
+#if ENABLE_PIN_EDGE_INPUT
+// Input pins are not polled. Their ISR only stamps the edge into queue,
+// PIN_ticks replays edges with their times through the same debounce and
+// click logic, and keeps stepping a pin only while it is in the middle
+// of a gesture or still debouncing. Idle inputs cost nothing.
+#define PIN_EDGE_QUEUE_SIZE		64
+
+typedef struct pinEdge_s {
+	uint32_t time;
+	byte pin;
+	byte level;
+} pinEdge_t;
+
+static pinEdge_t g_pinEdges[PIN_EDGE_QUEUE_SIZE];
+// head is moved only by ISR, tail only by PIN_ticks
+static volatile unsigned int g_pinEdgeHead = 0;
+static volatile unsigned int g_pinEdgeTail = 0;
+static volatile unsigned int g_pinEdgesLost = 0;
+static unsigned int g_pinEdgesLostSeen = 0;
+static byte g_pinEdgeAttached[PLATFORM_GPIO_MAX];
+// raw level after last replayed edge and time pin was stepped to
+static byte g_pinEdgeLevel[PLATFORM_GPIO_MAX];
+static uint32_t g_pinEdgeTime[PLATFORM_GPIO_MAX];
+// some pin must be stepped on next tick
+static bool g_pinEdgeBusy = false;
+
+// NOTE: ISR
+static void PIN_EdgeInterruptHandler(int gpio) {
+	unsigned int head = g_pinEdgeHead;
+	pinEdge_t* e;
+
+	if (head - g_pinEdgeTail >= PIN_EDGE_QUEUE_SIZE) {
+		g_pinEdgesLost++;
+		return;
+	}
+	e = &g_pinEdges[head % PIN_EDGE_QUEUE_SIZE];
+	e->time = SYSPERF_GetTimeMs();
+	e->pin = gpio;
+	e->level = HAL_PIN_ReadDigitalInput(gpio);
+	OBK_SMP_BARRIER();
+	g_pinEdgeHead = head + 1;
+	QuickTick_WakeFromISR();
+}
+static void PIN_AttachEdgeInput(int index) {
+	g_pinEdgeLevel[index] = HAL_PIN_ReadDigitalInput(index);
+	g_pinEdgeTime[index] = SYSPERF_GetTimeMs();
+	g_pinEdgeAttached[index] = 1;
+	// let next tick look at initial state
+	g_pinEdgeBusy = true;
+	HAL_AttachInterrupt(index, INTERRUPT_CHANGE, PIN_EdgeInterruptHandler);
+}
+static void PIN_DetachEdgeInput(int index) {
+	if (g_pinEdgeAttached[index] == 0) {
+		return;
+	}
+	HAL_DetachInterrupt(index);
+	g_pinEdgeAttached[index] = 0;
+}
+#endif
 
 
 
@@ -951,6 +1278,9 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 
 		// remove from active inputs
 		setGPIActive(index, 0, 0);
+#if ENABLE_PIN_EDGE_INPUT
+		PIN_DetachEdgeInput(index);
+#endif
 
 		switch (g_cfg.pins.roles[index])
 		{
@@ -997,7 +1327,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 			break;
 		case IOR_Counter_f:
 		case IOR_Counter_r:
-			HAL_DetachInterrupt(index);
+			PIN_Counter_Stop(index);
 			break;
 		case IOR_BridgeForward:
 		case IOR_BridgeReverse:
@@ -1021,6 +1351,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 		}
 		g_cfg.pins.roles[index] = role;
 		g_cfg_pendingChanges++;
+		PIN_InvalidateChannelIndex();
 	}
 
 	if (g_enable_pins) {
@@ -1149,7 +1480,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 			int channelValue;
 
 			channelIndex = PIN_GetPinChannelForPinIndex(index);
-			channelValue = g_channelValues[channelIndex];
+			channelValue = Channel_GetInt(channelIndex);
 
 			HAL_PIN_Setup_Output(index);
 			if (role == IOR_LED_n || role == IOR_Relay_n || role == IOR_BAT_Relay_n) {
@@ -1181,7 +1512,7 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 			int channelValue;
 
 			channelIndex = PIN_GetPinChannelForPinIndex(index);
-			channelValue = g_channelValues[channelIndex];
+			channelValue = Channel_GetInt(channelIndex);
 
 			HAL_PIN_Setup_Output(index);
 			HAL_PIN_SetOutputValue(index, 0);
@@ -1217,12 +1548,10 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 #endif
 			break; 
 		case IOR_Counter_f:
-			HAL_PIN_Setup_Input_Pullup(index);
-			HAL_AttachInterrupt(index, INTERRUPT_FALLING, PIN_InterruptHandler);
+			PIN_Counter_Start(index, INTERRUPT_FALLING);
 			break;
 		case IOR_Counter_r:
-			HAL_PIN_Setup_Input_Pullup(index);
-			HAL_AttachInterrupt(index, INTERRUPT_RISING, PIN_InterruptHandler);
+			PIN_Counter_Start(index, INTERRUPT_RISING);
 			break;
 		case IOR_PWM_n:
 		case IOR_PWM_ScriptOnly:
@@ -1230,10 +1559,8 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 		case IOR_PWM:
 		{
 			int channelIndex;
-			float channelValue;
 
 			channelIndex = PIN_GetPinChannelForPinIndex(index);
-			channelValue = g_channelValuesFloats[channelIndex];
 
 			//100hz to 20000hz according to tuya code
 #define PWM_FREQUENCY_SLOW 600 //Slow frequency for LED Drivers requiring slower PWM Freq
@@ -1249,10 +1576,10 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 			if (role == IOR_PWM_n
 				|| role == IOR_PWM_ScriptOnly_n) {
 				// inversed PWM
-				HAL_PIN_PWM_Update(index, 100.0f - channelValue);
+				HAL_PIN_PWM_UpdateDuty(index, 65535 - Channel_GetPWMDuty(channelIndex));
 			}
 			else {
-				HAL_PIN_PWM_Update(index, channelValue);
+				HAL_PIN_PWM_UpdateDuty(index, Channel_GetPWMDuty(channelIndex));
 			}
 		}
 		break;
@@ -1260,6 +1587,11 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 		default:
 			break;
 		}
+#if ENABLE_PIN_EDGE_INPUT
+		if (PIN_GetInputKind(role) != PIN_INPUT_NONE) {
+			PIN_AttachEdgeInput(index);
+		}
+#endif
 	}
 	if (bSampleInitialState) {
 		if (PIN_ReadDigitalInputValue_WithInversionIncluded(index)) {
@@ -1281,24 +1613,235 @@ void PIN_SetPinRoleForPinIndex(int index, int role) {
 void PIN_SetGenericDoubleClickCallback(void (*cb)(int pinIndex)) {
 	g_doubleClickCallback = cb;
 }
+// Remembered channels are written behind. Change only marks channel,
+// all marked channels are written together once they were quiet for
+// g_channelSaveDelay seconds, or g_channelSaveInterval seconds after
+// first change if they keep changing. Writes are never closer than
+// g_channelSaveInterval. Delay 0 writes at once.
+static unsigned int g_channelSaveDirty[(CHANNEL_MAX + 31) / 32];
+static int g_channelSaveDirtyCount = 0;
+static int g_channelSaveDelay = 3;
+static int g_channelSaveInterval = 10;
+// seconds since last change, since first unsaved change and since last write
+static int g_channelSaveQuiet = 0;
+static int g_channelSaveAge = 0;
+static int g_channelSaveSinceWrite = 0x7FFF;
+static channelSaveStats_t g_channelSaveStats;
+
 void Channel_SaveInFlashIfNeeded(int ch) {
 	// save, if marked as save value in flash (-1)
-	if (g_cfg.startChannelValues[ch] == -1) {
-		//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Channel_SaveInFlashIfNeeded: Channel %i is being saved to flash, state %i", ch, g_channelValues[ch]);
-		HAL_FlashVars_SaveChannel(ch, g_channelValues[ch]);
+	if (g_cfg.startChannelValues[ch] != -1) {
+		return;
 	}
-	else {
-		//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Channel_SaveInFlashIfNeeded: Channel %i is not saved to flash, state %i", ch, g_channelValues[ch]);
+	g_channelSaveStats.requests++;
+	if ((g_channelSaveDirty[ch / 32] & (1u << (ch % 32))) == 0) {
+		g_channelSaveDirty[ch / 32] |= 1u << (ch % 32);
+		if (g_channelSaveDirtyCount == 0) {
+			g_channelSaveAge = 0;
+		}
+		g_channelSaveDirtyCount++;
+	}
+	g_channelSaveQuiet = 0;
+	if (g_channelSaveDelay == 0) {
+		CHANNEL_FlushSaves();
 	}
 }
-static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
-	int i;
+int CHANNEL_FlushSaves() {
+	int indices[CHANNEL_MAX];
+	int values[CHANNEL_MAX];
+	int ch, count, iVal;
+
+	if (g_channelSaveDirtyCount == 0) {
+		return 0;
+	}
+	count = 0;
+	for (ch = 0; ch < CHANNEL_MAX; ch++) {
+		if ((g_channelSaveDirty[ch / 32] & (1u << (ch % 32))) == 0) {
+			continue;
+		}
+		if (g_cfg.startChannelValues[ch] != -1) {
+			continue;
+		}
+		iVal = Channel_GetInt(ch);
+		// set there and back while waiting
+		if (HAL_FlashVars_GetChannelValue(ch) == iVal) {
+			g_channelSaveStats.unchanged++;
+			continue;
+		}
+		indices[count] = ch;
+		values[count] = iVal;
+		count++;
+	}
+	memset(g_channelSaveDirty, 0, sizeof(g_channelSaveDirty));
+	g_channelSaveDirtyCount = 0;
+	if (count) {
+		HAL_FlashVars_SaveChannels(indices, values, count);
+		g_channelSaveStats.writes++;
+		g_channelSaveStats.values += count;
+		g_channelSaveSinceWrite = 0;
+	}
+	return count;
+}
+void CHANNEL_RunSavesEverySecond() {
+	if (g_channelSaveSinceWrite < 0x7FFF) {
+		g_channelSaveSinceWrite++;
+	}
+	if (g_channelSaveDirtyCount == 0) {
+		return;
+	}
+	g_channelSaveQuiet++;
+	g_channelSaveAge++;
+	if (g_channelSaveSinceWrite < g_channelSaveInterval) {
+		return;
+	}
+	if (g_channelSaveQuiet >= g_channelSaveDelay || g_channelSaveAge >= g_channelSaveInterval) {
+		CHANNEL_FlushSaves();
+	}
+}
+void CHANNEL_SetSaveDelay(int delaySeconds, int intervalSeconds) {
+	g_channelSaveDelay = delaySeconds < 0 ? 0 : delaySeconds;
+	g_channelSaveInterval = intervalSeconds < 0 ? 0 : intervalSeconds;
+	if (g_channelSaveDelay == 0) {
+		CHANNEL_FlushSaves();
+	}
+}
+void CHANNEL_GetSaveStats(channelSaveStats_t* out, int* delaySeconds, int* intervalSeconds, int* pending) {
+	*out = g_channelSaveStats;
+	*delaySeconds = g_channelSaveDelay;
+	*intervalSeconds = g_channelSaveInterval;
+	*pending = g_channelSaveDirtyCount;
+}
+
+// Channel to pins index, derived from pin roles and channels, so channel
+// change and channel queries do not scan all pins. Rebuilt on first use
+// after PIN_InvalidateChannelIndex.
+typedef enum {
+	PIN_OUT_None,
+	PIN_OUT_Digital,
+	PIN_OUT_Digital_n,
+	PIN_OUT_PWM,
+	PIN_OUT_PWM_n,
+} pinOutAction_t;
+
+#define CH_INDEX_RELAY			1
+#define CH_INDEX_POWERRELAY		2
+#define CH_INDEX_INUSE			4
+
+// pins of channel ch are g_chPins[g_chPinsStart[ch]] until g_chPinsStart[ch + 1]
+static byte g_chPinsStart[CHANNEL_MAX + 1];
+static byte g_chPins[PLATFORM_GPIO_MAX + 1];
+static byte g_pinOutAction[PLATFORM_GPIO_MAX + 1];
+static byte g_chIndexFlags[CHANNEL_MAX];
+static volatile bool g_chIndexDirty = true;
+
+void PIN_InvalidateChannelIndex() {
+	g_chIndexDirty = true;
+}
+static int PIN_GetOutAction(int role) {
+	switch (role) {
+	case IOR_Relay:
+	case IOR_BAT_Relay:
+	case IOR_LED:
+		return PIN_OUT_Digital;
+	case IOR_Relay_n:
+	case IOR_BAT_Relay_n:
+	case IOR_LED_n:
+		return PIN_OUT_Digital_n;
+	case IOR_PWM:
+	case IOR_PWM_ScriptOnly:
+		return PIN_OUT_PWM;
+	case IOR_PWM_n:
+	case IOR_PWM_ScriptOnly_n:
+		return PIN_OUT_PWM_n;
+	}
+	return PIN_OUT_None;
+}
+static void PIN_RebuildChannelIndex() {
+	int i, ch, role, nofC, pos;
+	byte counts[CHANNEL_MAX];
+
+	// cleared first, so change made while rebuilding marks it again
+	g_chIndexDirty = false;
+	memset(counts, 0, sizeof(counts));
+	memset(g_chIndexFlags, 0, sizeof(g_chIndexFlags));
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		role = g_cfg.pins.roles[i];
+		ch = g_cfg.pins.channels[i];
+		g_pinOutAction[i] = PIN_GetOutAction(role);
+		if (ch < CHANNEL_MAX) {
+			counts[ch]++;
+			if (role == IOR_Relay || role == IOR_Relay_n || role == IOR_LED || role == IOR_LED_n
+				|| role == IOR_BridgeForward || role == IOR_BridgeReverse) {
+				g_chIndexFlags[ch] |= CH_INDEX_RELAY;
+			}
+			// NOTE: do not include Battery relay
+			// Also allow toggling Bridge channel
+			// https://www.elektroda.com/rtvforum/viewtopic.php?p=20906463#20906463
+			if (role == IOR_Relay || role == IOR_Relay_n
+				|| role == IOR_BridgeForward || role == IOR_BridgeReverse) {
+				g_chIndexFlags[ch] |= CH_INDEX_POWERRELAY;
+			}
+		}
+		if (role != IOR_None) {
+			nofC = PIN_IOR_NofChan(role);
+			if (nofC >= 1 && ch < CHANNEL_MAX) {
+				g_chIndexFlags[ch] |= CH_INDEX_INUSE;
+			}
+			ch = g_cfg.pins.channels2[i];
+			if (nofC >= 2 && ch < CHANNEL_MAX) {
+				g_chIndexFlags[ch] |= CH_INDEX_INUSE;
+			}
+		}
+	}
+	pos = 0;
+	for (ch = 0; ch < CHANNEL_MAX; ch++) {
+		g_chPinsStart[ch] = pos;
+		pos += counts[ch];
+	}
+	g_chPinsStart[CHANNEL_MAX] = pos;
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		ch = g_cfg.pins.channels[i];
+		if (ch < CHANNEL_MAX) {
+			g_chPins[g_chPinsStart[ch] + counts[ch]] = i;
+			counts[ch]++;
+		}
+	}
+}
+static void PIN_CheckChannelIndex() {
+	if (g_chIndexDirty) {
+		PIN_RebuildChannelIndex();
+	}
+}
+// Channel change batch, see CHANNEL_BeginBatch. Values are stored
+// right away, change handlers run once for whole batch on commit.
+static int g_channelBatchDepth = 0;
+static unsigned int g_channelBatchChanged[(CHANNEL_MAX + 31) / 32];
+static int g_channelBatchPrevValues[CHANNEL_MAX];
+static byte g_channelBatchFlags[CHANNEL_MAX];
+
+static void Channel_AddToBatch(int ch, int prevValue, int iFlags) {
+	if (g_channelBatchChanged[ch / 32] & (1u << (ch % 32))) {
+		// skip MQTT only if all sets wanted so, same for force
+		g_channelBatchFlags[ch] &= iFlags;
+		return;
+	}
+	g_channelBatchChanged[ch / 32] |= 1u << (ch % 32);
+	g_channelBatchPrevValues[ch] = prevValue;
+	g_channelBatchFlags[ch] = iFlags;
+}
+// everything but MQTT, events and flash save, and drivers when bDrivers is false
+static void Channel_ApplyChange(int ch, bool bDrivers) {
+	int i, pin;
 	int iVal;
 	int bOn;
 
 	//bOn = BIT_CHECK(g_channelStates,ch);
-	iVal = g_channelValues[ch];
-	g_channelValuesFloats[ch] = (float)iVal;
+	iVal = Channel_GetInt(ch);
+	g_channelVersions[ch] = ++g_stateVersion;
+#if ENABLE_HTTP_SSE
+	SSE_OnChannelChanged(ch, iVal);
+#endif
 	bOn = iVal > 0;
 
 #if ENABLE_I2C
@@ -1306,7 +1849,9 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 #endif
 
 #ifndef OBK_DISABLE_ALL_DRIVERS
-	DRV_OnChannelChanged(ch, iVal);
+	if (bDrivers) {
+		DRV_OnChannelChanged(ch, iVal);
+	}
 #endif
 
 #if ENABLE_DRIVER_TUYAMCU
@@ -1315,22 +1860,38 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 #if ENABLE_DRIVER_GIRIERMCU
 	GirierMCU_OnChannelChanged(ch, iVal);
 #endif
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			if (g_cfg.pins.roles[i] == IOR_Relay || g_cfg.pins.roles[i] == IOR_BAT_Relay || g_cfg.pins.roles[i] == IOR_LED) {
-				RAW_SetPinValue(i, bOn);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_Relay_n || g_cfg.pins.roles[i] == IOR_LED_n || g_cfg.pins.roles[i] == IOR_BAT_Relay_n) {
-				RAW_SetPinValue(i, !bOn);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
-				HAL_PIN_PWM_Update(i, iVal);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
-				HAL_PIN_PWM_Update(i, 100 - iVal);
-			}
+	PIN_CheckChannelIndex();
+	for (i = g_chPinsStart[ch]; i < g_chPinsStart[ch + 1]; i++) {
+		pin = g_chPins[i];
+		switch (g_pinOutAction[pin]) {
+		case PIN_OUT_Digital:
+			PIN_QueueOutput(pin, bOn);
+			break;
+		case PIN_OUT_Digital_n:
+			PIN_QueueOutput(pin, !bOn);
+			break;
+		case PIN_OUT_PWM:
+			PIN_QueuePWM(pin, Channel_GetPWMDuty(ch));
+			break;
+		case PIN_OUT_PWM_n:
+			PIN_QueuePWM(pin, 65535 - Channel_GetPWMDuty(ch));
+			break;
 		}
 	}
+}
+static void Channel_FireEvents(int ch, int prevValue) {
+	// Simple event - it just says that there was a change
+	EventHandlers_FireEvent(CMD_EVENT_CHANNEL_ONCHANGE, ch);
+	// more advanced events - change FROM value TO value
+	EventHandlers_ProcessVariableChange_Integer(CMD_EVENT_CHANGE_CHANNEL0 + ch, prevValue, Channel_GetInt(ch));
+}
+static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
+	if (g_channelBatchDepth > 0) {
+		Channel_AddToBatch(ch, prevValue, iFlags);
+		return;
+	}
+	Channel_ApplyChange(ch, true);
+	PIN_FlushOutputs();
 #if ENABLE_MQTT
 	if ((iFlags & CHANNEL_SET_FLAG_SKIP_MQTT) == 0) {
 		if (CHANNEL_ShouldBePublished(ch)) {
@@ -1338,14 +1899,77 @@ static void Channel_OnChanged(int ch, int prevValue, int iFlags) {
 		}
 	}
 #endif
-	// Simple event - it just says that there was a change
-	EventHandlers_FireEvent(CMD_EVENT_CHANNEL_ONCHANGE, ch);
-	// more advanced events - change FROM value TO value
-	EventHandlers_ProcessVariableChange_Integer(CMD_EVENT_CHANGE_CHANNEL0 + ch, prevValue, iVal);
+	Channel_FireEvents(ch, prevValue);
 	//addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL,"CHANNEL_OnChanged: Channel index %i startChannelValues %i\n\r",ch,g_cfg.startChannelValues[ch]);
 
 	Channel_SaveInFlashIfNeeded(ch);
 }
+void CHANNEL_BeginBatch() {
+	g_channelBatchDepth++;
+}
+int CHANNEL_CommitBatch() {
+	int chs[CHANNEL_MAX];
+	int prevValues[CHANNEL_MAX];
+	int vals[CHANNEL_MAX];
+	byte flags[CHANNEL_MAX];
+	int i, ch, count, toPublish;
+
+	if (g_channelBatchDepth <= 0) {
+		return 0;
+	}
+	g_channelBatchDepth--;
+	if (g_channelBatchDepth > 0) {
+		return 0;
+	}
+	// taken out first, handlers below may set channels again
+	count = 0;
+	for (ch = 0; ch < CHANNEL_MAX; ch++) {
+		if ((g_channelBatchChanged[ch / 32] & (1u << (ch % 32))) == 0) {
+			continue;
+		}
+		// was set there and back
+		if (Channel_GetInt(ch) == g_channelBatchPrevValues[ch]
+			&& (g_channelBatchFlags[ch] & CHANNEL_SET_FLAG_FORCE) == 0) {
+			continue;
+		}
+		chs[count] = ch;
+		prevValues[count] = g_channelBatchPrevValues[ch];
+		vals[count] = Channel_GetInt(ch);
+		flags[count] = g_channelBatchFlags[ch];
+		count++;
+	}
+	memset(g_channelBatchChanged, 0, sizeof(g_channelBatchChanged));
+	if (count == 0) {
+		return 0;
+	}
+	for (i = 0; i < count; i++) {
+		Channel_ApplyChange(chs[i], false);
+	}
+	PIN_FlushOutputs();
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	DRV_OnChannelsChanged(chs, vals, count);
+#endif
+#if ENABLE_MQTT
+	toPublish = 0;
+	for (i = 0; i < count; i++) {
+		if ((flags[i] & CHANNEL_SET_FLAG_SKIP_MQTT) == 0 && CHANNEL_ShouldBePublished(chs[i])) {
+			// values were for drivers, array is reused for list
+			vals[toPublish++] = chs[i];
+		}
+	}
+	if (toPublish) {
+		MQTT_ChannelsPublish(vals, toPublish, 0);
+	}
+#endif
+	for (i = 0; i < count; i++) {
+		Channel_FireEvents(chs[i], prevValues[i]);
+	}
+	// remembered channels are written later together
+	for (i = 0; i < count; i++) {
+		Channel_SaveInFlashIfNeeded(chs[i]);
+	}
+	return count;
+}
 void CFG_ApplyChannelStartValues() {
 	int i;
 	for (i = 0; i < CHANNEL_MAX; i++) {
@@ -1353,12 +1977,12 @@ void CFG_ApplyChannelStartValues() {
 
 		iValue = g_cfg.startChannelValues[i];
 		if (iValue == -1) {
-			g_channelValuesFloats[i] = g_channelValues[i] = HAL_FlashVars_GetChannelValue(i);
-			//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CFG_ApplyChannelStartValues: Channel %i is being set to REMEMBERED state %i", i, g_channelValues[i]);
+			Channel_StoreInt(i, HAL_FlashVars_GetChannelValue(i));
+			//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CFG_ApplyChannelStartValues: Channel %i is being set to REMEMBERED state %i", i, Channel_GetInt(i));
 		}
 		else {
-			g_channelValuesFloats[i] = g_channelValues[i] = iValue;
-			//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CFG_ApplyChannelStartValues: Channel %i is being set to constant state %i", i, g_channelValues[i]);
+			Channel_StoreInt(i, iValue);
+			//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CFG_ApplyChannelStartValues: Channel %i is being set to constant state %i", i, Channel_GetInt(i));
 		}
 	}
 }
@@ -1532,18 +2156,55 @@ const char *ChannelType_GetTitle(int type) {
 }
 float CHANNEL_GetFinalValue(int channel) {
 	float dVal;
+	channelValue_t* c;
 
-	dVal = CHANNEL_Get(channel);
-	dVal /= ChannelType_GetDivider(CHANNEL_GetType(channel));
-
-	return dVal;
+	if (channel < 0 || channel >= CHANNEL_MAX) {
+		dVal = CHANNEL_Get(channel);
+		dVal /= ChannelType_GetDivider(CHANNEL_GetType(channel));
+		return dVal;
+	}
+	c = Channel_Sync(channel);
+	switch (c->repr) {
+	case CHANNEL_REPR_INT:
+		return c->v.i;
+	case CHANNEL_REPR_FIXED:
+		return c->v.i / (float)c->divider;
+	}
+	return c->v.f / c->divider;
 }
 float CHANNEL_GetFloat(int ch) {
 	if (ch < 0 || ch >= CHANNEL_MAX) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "CHANNEL_Get: Channel index %i is out of range <0,%i)\n\r", ch, CHANNEL_MAX);
 		return 0;
 	}
-	return g_channelValuesFloats[ch];
+	if (g_channelStore[ch].repr == CHANNEL_REPR_FLOAT) {
+		return g_channelStore[ch].v.f;
+	}
+	return g_channelStore[ch].v.i;
+}
+int CHANNEL_GetRepr(int ch) {
+	if (ch < 0 || ch >= CHANNEL_MAX) {
+		return CHANNEL_REPR_INT;
+	}
+	return Channel_Sync(ch)->repr;
+}
+int CHANNEL_GetDivider(int ch) {
+	if (ch < 0 || ch >= CHANNEL_MAX) {
+		return ChannelType_GetDivider(CHANNEL_GetType(ch));
+	}
+	return Channel_Sync(ch)->divider;
+}
+int CHANNEL_GetStateVersion() {
+	return g_stateVersion;
+}
+int CHANNEL_BumpStateVersion() {
+	return ++g_stateVersion;
+}
+int CHANNEL_GetChangeVersion(int ch) {
+	if (ch < 0 || ch >= CHANNEL_MAX) {
+		return 0;
+	}
+	return g_channelVersions[ch];
 }
 int CHANNEL_Get(int ch) {
 #if ENABLE_LED_BASIC
@@ -1568,7 +2229,7 @@ int CHANNEL_Get(int ch) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "CHANNEL_Get: Channel index %i is out of range <0,%i)\n\r", ch, CHANNEL_MAX);
 		return 0;
 	}
-	return g_channelValues[ch];
+	return Channel_GetInt(ch);
 }
 void CHANNEL_ClearAllChannels() {
 	int i;
@@ -1578,33 +2239,86 @@ void CHANNEL_ClearAllChannels() {
 	}
 }
 
+// fVal is in channel units like CHANNEL_Set, so divider of channel type applies
+// to it. Whole values are stored as integers, so int and float readers agree.
 void CHANNEL_Set_FloatPWM(int ch, float fVal, int iFlags) {
-	int i;
-	float prevValue = g_channelValuesFloats[ch];
+	int i, pin;
+	float prevValue = CHANNEL_GetFloat(ch);
+	unsigned short duty;
 
-	g_channelValues[ch] = (int)fVal;
-	g_channelValuesFloats[ch] = fVal;
+	if (fVal == (int)fVal) {
+		Channel_StoreInt(ch, (int)fVal);
+	}
+	else {
+		Channel_StoreFloat(ch, fVal, ChannelType_GetDivider(g_cfg.pins.channelTypes[ch]));
+	}
+	duty = Channel_GetPWMDuty(ch);
 
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
-				HAL_PIN_PWM_Update(i, fVal);
+	if ((iFlags & CHANNEL_SET_FLAG_SKIP_PWM) == 0) {
+		PIN_CheckChannelIndex();
+		for (i = g_chPinsStart[ch]; i < g_chPinsStart[ch + 1]; i++) {
+			pin = g_chPins[i];
+			if (g_pinOutAction[pin] == PIN_OUT_PWM) {
+				PIN_QueuePWM(pin, duty);
 			}
-			else if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
-				HAL_PIN_PWM_Update(i, 100.0f - fVal);
+			else if (g_pinOutAction[pin] == PIN_OUT_PWM_n) {
+				PIN_QueuePWM(pin, 65535 - duty);
 			}
 		}
+		PIN_FlushPWMs();
 	}
 	// TODO: support float
 	EventHandlers_FireEvent(CMD_EVENT_CHANNEL_ONCHANGE, ch);
 	EventHandlers_ProcessVariableChange_Integer(CMD_EVENT_CHANGE_CHANNEL0 + ch, prevValue, fVal);
 }
+bool CHANNEL_FadePWM(int ch, float fVal, int ms) {
+	bool bAny = false;
+	int i;
+
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (g_cfg.pins.channels[i] != ch) {
+			continue;
+		}
+		if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
+			if (HAL_PIN_PWM_FadeTo(i, fVal, ms) == 0) {
+				return false;
+			}
+			bAny = true;
+		}
+		else if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
+			if (HAL_PIN_PWM_FadeTo(i, 100.0f - fVal, ms) == 0) {
+				return false;
+			}
+			bAny = true;
+		}
+	}
+	return bAny;
+}
+// fVal is final value, it is stored as float if divider of channel
+// type can't hold it, integer readers get it truncated
 void CHANNEL_SetSmart(int ch, float fVal, int iFlags) {
+	int divider, divided, prevValue;
+	float raw;
+
 	if (ch < 0 || ch >= CHANNEL_MAX)
 		return;
-	int divider = ChannelType_GetDivider(g_cfg.pins.channelTypes[ch]);
-	int divided = fVal * divider;
-	CHANNEL_Set(ch, divided, iFlags);
+	divider = ChannelType_GetDivider(g_cfg.pins.channelTypes[ch]);
+	raw = fVal * divider;
+	divided = raw;
+	if (raw == divided) {
+		CHANNEL_Set(ch, divided, iFlags);
+		return;
+	}
+	if ((iFlags & CHANNEL_SET_FLAG_FORCE) == 0 && g_channelStore[ch].repr == CHANNEL_REPR_FLOAT
+		&& g_channelStore[ch].v.f == raw && g_channelStore[ch].divider == divider) {
+		return;
+	}
+	prevValue = Channel_GetInt(ch);
+	Channel_StoreFloat(ch, raw, divider);
+	if ((iFlags & CHANNEL_SET_FLAG_SILENT) == 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Set channel %i has changed to %f (flags %i)\n\r", ch, fVal, iFlags);
+	}
+	Channel_OnChanged(ch, prevValue, iFlags);
 }
 
 void CHANNEL_Set_Ex(int ch, int iVal, int iFlags, int ausemovingaverage) {
@@ -1643,9 +2357,9 @@ void CHANNEL_Set_Ex(int ch, int iVal, int iFlags, int ausemovingaverage) {
 		//}
 		return;
 	}
-	prevValue = g_channelValues[ch];
+	prevValue = Channel_GetInt(ch);
 	if (bForce == 0) {
-		if (prevValue == iVal) {
+		if (Channel_HoldsInt(ch, iVal)) {
 			if (bSilent == 0) {
 				addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "No change in channel %i (still set to %i) - ignoring\n\r", ch, prevValue);
 			}
@@ -1661,13 +2375,56 @@ void CHANNEL_Set_Ex(int ch, int iVal, int iFlags, int ausemovingaverage) {
 		iVal=XJ_MovingAverage_int(prevValue, iVal);
 	}
 	#endif
-	g_channelValues[ch] = iVal;
+	Channel_StoreInt(ch, iVal);
 
 	Channel_OnChanged(ch, prevValue, iFlags);
 }
 void CHANNEL_Set(int ch, int iVal, int iFlags) {
 	CHANNEL_Set_Ex(ch, iVal, iFlags, 0);
 }
+// All values are stored before change handlers run, so drivers and scripts
+// woken by one channel already see the whole batch. Special channels are
+// passed to CHANNEL_Set right away. If channel is listed twice, last value wins.
+int CHANNEL_SetMany(const int* chs, const int* vals, int count, int iFlags) {
+	int prevValues[CHANNEL_MAX];
+	unsigned int changed[(CHANNEL_MAX + 31) / 32];
+	int i, ch, res;
+
+	memset(changed, 0, sizeof(changed));
+	for (i = 0; i < count; i++) {
+		ch = chs[i];
+		if (ch < 0 || ch >= CHANNEL_MAX) {
+			CHANNEL_Set(ch, vals[i], iFlags);
+			continue;
+		}
+		if ((changed[ch / 32] & (1u << (ch % 32))) == 0) {
+			if (Channel_HoldsInt(ch, vals[i]) && (iFlags & CHANNEL_SET_FLAG_FORCE) == 0) {
+				continue;
+			}
+			prevValues[ch] = Channel_GetInt(ch);
+			changed[ch / 32] |= 1u << (ch % 32);
+		}
+		Channel_StoreInt(ch, vals[i]);
+	}
+	res = 0;
+	CHANNEL_BeginBatch();
+	for (ch = 0; ch < CHANNEL_MAX; ch++) {
+		if ((changed[ch / 32] & (1u << (ch % 32))) == 0) {
+			continue;
+		}
+		// was set there and back
+		if (Channel_GetInt(ch) == prevValues[ch] && (iFlags & CHANNEL_SET_FLAG_FORCE) == 0) {
+			continue;
+		}
+		Channel_OnChanged(ch, prevValues[ch], iFlags);
+		res++;
+	}
+	CHANNEL_CommitBatch();
+	if ((iFlags & CHANNEL_SET_FLAG_SILENT) == 0) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_SetMany: %i of %i channels changed (flags %i)\n\r", res, count, iFlags);
+	}
+	return res;
+}
 char *g_channelPingPongs = 0;
 
 void CHANNEL_AddClamped(int ch, int iDelta, int min, int max, int bWrapInsteadOfClamp) {
@@ -1728,10 +2485,10 @@ void CHANNEL_Add(int ch, int iVal) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "CHANNEL_Add: Channel index %i is out of range <0,%i)\n\r", ch, CHANNEL_MAX);
 		return;
 	}
-	prevValue = g_channelValues[ch];
-	g_channelValues[ch] = g_channelValues[ch] + iVal;
+	prevValue = Channel_GetInt(ch);
+	Channel_StoreInt(ch, prevValue + iVal);
 
-	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Add channel %i has changed to %i\n\r", ch, g_channelValues[ch]);
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "CHANNEL_Add channel %i has changed to %i\n\r", ch, Channel_GetInt(ch));
 
 	Channel_OnChanged(ch, prevValue, 0);
 #else
@@ -1750,10 +2507,10 @@ int CHANNEL_FindMaxValueForChannel(int ch) {
 		if (g_cfg.pins.channels[i] == ch) {
 			// is it PWM?
 			if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
-				return 100;
+				return Channel_GetPWMRange(ch);
 			}
 			if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
-				return 100;
+				return Channel_GetPWMRange(ch);
 			}
 		}
 	}
@@ -1781,11 +2538,11 @@ void CHANNEL_Toggle(int ch) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "CHANNEL_Toggle: Channel index %i is out of range <0,%i)\n\r", ch, CHANNEL_MAX);
 		return;
 	}
-	prev = g_channelValues[ch];
-	if (g_channelValues[ch] == 0)
-		g_channelValues[ch] = CHANNEL_FindMaxValueForChannel(ch);
+	prev = Channel_GetInt(ch);
+	if (prev == 0)
+		Channel_StoreInt(ch, CHANNEL_FindMaxValueForChannel(ch));
 	else
-		g_channelValues[ch] = 0;
+		Channel_StoreInt(ch, 0);
 
 	Channel_OnChanged(ch, prev, 0);
 }
@@ -1796,13 +2553,12 @@ int CHANNEL_HasChannelPinWithRoleOrRole(int ch, int iorType, int iorType2) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "CHANNEL_HasChannelPinWithRole: Channel index %i is out of range <0,%i)\n\r", ch, CHANNEL_MAX);
 		return 0;
 	}
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			if (g_cfg.pins.roles[i] == iorType)
-				return 1;
-			else if (g_cfg.pins.roles[i] == iorType2)
-				return 1;
-		}
+	PIN_CheckChannelIndex();
+	for (i = g_chPinsStart[ch]; i < g_chPinsStart[ch + 1]; i++) {
+		if (g_cfg.pins.roles[g_chPins[i]] == iorType)
+			return 1;
+		else if (g_cfg.pins.roles[g_chPins[i]] == iorType2)
+			return 1;
 	}
 	return 0;
 }
@@ -1813,11 +2569,10 @@ int CHANNEL_HasChannelPinWithRole(int ch, int iorType) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "CHANNEL_HasChannelPinWithRole: Channel index %i is out of range <0,%i)\n\r", ch, CHANNEL_MAX);
 		return 0;
 	}
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			if (g_cfg.pins.roles[i] == iorType)
-				return 1;
-		}
+	PIN_CheckChannelIndex();
+	for (i = g_chPinsStart[ch]; i < g_chPinsStart[ch + 1]; i++) {
+		if (g_cfg.pins.roles[g_chPins[i]] == iorType)
+			return 1;
 	}
 	return 0;
 }
@@ -1831,28 +2586,19 @@ bool CHANNEL_Check(int ch) {
 		addLogAdv(LOG_ERROR, LOG_FEATURE_GENERAL, "CHANNEL_Check: Channel index %i is out of range <0,%i)\n\r", ch, CHANNEL_MAX);
 		return 0;
 	}
-	if (g_channelValues[ch] > 0)
+	if (Channel_GetInt(ch) > 0)
 		return 1;
 	return 0;
 }
 
 bool CHANNEL_IsInUse(int ch) {
-	int i;
-
 	if (g_cfg.pins.channelTypes[ch] != ChType_Default) {
 		return true;
 	}
 
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.roles[i] != IOR_None) {
-			int NofC=PIN_IOR_NofChan(g_cfg.pins.roles[i]);
-			if (NofC>=1 && g_cfg.pins.channels[i] == ch) {
-				return true;
-			}
-			if (NofC>=2 && g_cfg.pins.channels2[i] == ch) {
-				return true;
-			}
-		}
+	PIN_CheckChannelIndex();
+	if (g_chIndexFlags[ch] & CH_INDEX_INUSE) {
+		return true;
 	}
 #if (ENABLE_DRIVER_DS1820_FULL)
 #include "driver/drv_ds1820_full.h"
@@ -1863,22 +2609,11 @@ bool CHANNEL_IsInUse(int ch) {
 
 
 bool CHANNEL_IsPowerRelayChannel(int ch) {
-	int i;
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		if (g_cfg.pins.channels[i] == ch) {
-			int role = g_cfg.pins.roles[i];
-			// NOTE: do not include Battery relay
-			if (role == IOR_Relay || role == IOR_Relay_n) {
-				return true;
-			}
-			// Also allow toggling Bridge channel
-			// https://www.elektroda.com/rtvforum/viewtopic.php?p=20906463#20906463
-			if (role == IOR_BridgeForward || role == IOR_BridgeReverse) {
-				return true;
-			}
-		}
+	if (ch < 0 || ch >= CHANNEL_MAX) {
+		return false;
 	}
-	return false;
+	PIN_CheckChannelIndex();
+	return (g_chIndexFlags[ch] & CH_INDEX_POWERRELAY) != 0;
 }
 bool CHANNEL_ShouldBePublished(int ch) {
 	int i;
@@ -1966,18 +2701,12 @@ int CHANNEL_GetRoleForOutputChannel(int ch) {
 #define ADC_SAMPLING_TICK_COUNT PIN_TMR_LOOPS_PER_SECOND
 
 
-void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
+// read_gpio_level is level button had during last ms_since_last
+void PIN_Input_Handler(int pinIndex, uint8_t read_gpio_level, uint32_t ms_since_last)
 {
 	pinButton_s* handle;
-	uint8_t read_gpio_level;
 
 	handle = &g_buttons[pinIndex];
-	if (handle->hal_button_Level != 0) {
-		read_gpio_level = handle->hal_button_Level(handle);
-	}
-	else {
-		read_gpio_level = handle->button_level;
-	}
 
 	//ticks counter working..
 	if ((handle->state) > 0)
@@ -1986,12 +2715,14 @@ void PIN_Input_Handler(int pinIndex, uint32_t ms_since_last)
 	/*------------button debounce handle---------------*/
 	if (read_gpio_level != handle->button_level) { //not equal to prev one
 		//continue read 3 times same new level change
-		handle->debounce_cnt += ms_since_last;
-
-		if (handle->debounce_cnt >= BTN_DEBOUNCE_MS) {
+		// (checked before adding, long steps would overflow the byte)
+		if (handle->debounce_cnt + ms_since_last >= BTN_DEBOUNCE_MS) {
 			handle->button_level = read_gpio_level;
 			handle->debounce_cnt = 0;
 		}
+		else {
+			handle->debounce_cnt += ms_since_last;
+		}
 	}
 	else { //leved not change ,counter reset.
 		handle->debounce_cnt = 0;
@@ -2120,234 +2851,223 @@ void PIN_set_wifi_led(int value) {
 
 static uint32_t g_time = 0;
 static uint32_t g_last_time = 0;
-static int activepoll_time = 0; // time to keep polling active until
-
-//  background ticks, timer repeat invoking interval defined by PIN_TMR_DURATION.
-void PIN_ticks(void* param)
-{
-	int i;
-	int value;
 
-
-	PIN_ApplyCounterDeltas();
-
-#if defined(PLATFORM_BEKEN) || defined(WINDOWS)
-	g_time = rtos_get_time();
-#else
-	g_time += PIN_TMR_DURATION;
-#endif
-	uint32_t t_diff = g_time - g_last_time;
-	// cope with wrap
-	if (t_diff > 0x4000) {
-		t_diff = ((g_time + 0x4000) - (g_last_time + 0x4000));
+// returns true when debounced value of input has just changed
+static bool PIN_DebounceInput(int i, uint8_t value, uint32_t ms, int debounceMS) {
+	if (value) {
+		if (g_times[i] > debounceMS) {
+			if (g_lastValidState[i] != value) {
+				// became up
+				g_lastValidState[i] = value;
+				return true;
+			}
+		}
+		else {
+			g_times[i] += ms;
+		}
+		g_times2[i] = 0;
 	}
-	g_last_time = g_time;
-
+	else {
+		if (g_times2[i] > debounceMS) {
+			if (g_lastValidState[i] != value) {
+				// became down
+				g_lastValidState[i] = value;
+				return true;
+			}
+		}
+		else {
+			g_times2[i] += ms;
+		}
+		g_times[i] = 0;
+	}
+	return false;
+}
+// advances input pin by ms, value (inversion included) is what pin had during that time
+static void PIN_StepInput(int i, int kind, uint8_t value, uint32_t ms, int debounceMS) {
+	if (kind == PIN_INPUT_BUTTON) {
+		PIN_Input_Handler(i, value, ms);
+	}
+	else if (kind == PIN_INPUT_DIGITAL) {
+		if (PIN_DebounceInput(i, value, ms, debounceMS)) {
+			CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
+		}
+	}
+	else if (kind == PIN_INPUT_TOGGLE) {
+		if (PIN_DebounceInput(i, value, ms, debounceMS)) {
+			if (!CFG_HasFlag(OBK_FLAG_BUTTON_DISABLE_ALL)) {
+				CHANNEL_Toggle(g_cfg.pins.channels[i]);
+				EventHandlers_FireEvent(CMD_EVENT_PIN_ONTOGGLE, i);
+			}
+			else {
+				addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Child lock!");
+			}
+		}
+	}
+}
+static int PIN_GetDebounceMS() {
 	BTN_SHORT_MS = (g_cfg.buttonShortPress * 100);
 	BTN_LONG_MS = (g_cfg.buttonLongPress * 100);
 	BTN_HOLD_REPEAT_MS = (g_cfg.buttonHoldRepeat * 100);
 
-	int debounceMS;
 	if (CFG_HasFlag(OBK_FLAG_BTN_INSTANTTOUCH)) {
-		debounceMS = 100;
-	}
-	else {
-		debounceMS = 250;
+		return 100;
 	}
+	return 250;
+}
 
-	int activepins = 0;
-	uint32_t pinvalues[2] = { 0, 0 };
+#if ENABLE_PIN_EDGE_INPUT
+// true when pin has nothing to do until its next edge
+static bool PIN_IsInputSettled(int i, int kind, uint8_t value) {
+	if (kind == PIN_INPUT_BUTTON) {
+		return g_buttons[i].state == 0 && g_buttons[i].button_level == value;
+	}
+	return g_lastValidState[i] == value;
+}
+static uint32_t PIN_EdgeTimeSince(uint32_t now, uint32_t then) {
+	int d = (int)(now - then);
 
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++)
-	{
-		// note pins which are active - i.e. would not trigger an edge interrupt on change.
-		// if we have any, then we must poll until none
-		// TODO: this will only be used when GPI interrupt triggeringis used.
-		// but it's useful info anyway...
+	// edge may be stamped after tick has taken its time
+	if (d < 0) {
+		return 0;
+	}
+	// idle pins are not stepped, so gap can be long
+	if (d > 0x4000) {
+		return 0x4000;
+	}
+	return d;
+}
+static void PIN_ProcessEdges() {
+	pinEdge_t* e;
+	unsigned int tail, lost;
+	int i, kind, debounceMS;
+	uint8_t value;
+	uint64_t levels;
+	bool busy;
 
-		if (i >= 32)
-		{
-			if (g_gpio_index_map[1] & (1 << (i - 32)))
-			{
-				uint32_t level = 1;
-				if (g_gpio_edge_map[1] & (1 << (i - 32))) {
-					level = 0;
-				}
-				int rawval = HAL_PIN_ReadDigitalInput(i);
-				if (rawval && level == 1) {
-					activepins++;
-					pinvalues[1] |= (1 << (i - 32));
-				}
-				if (!rawval && level == 0) {
-					activepins++;
-					pinvalues[1] |= (1 << (i - 32));
-				}
+	tail = g_pinEdgeTail;
+	lost = g_pinEdgesLost;
+	if (tail == g_pinEdgeHead && g_pinEdgeBusy == false && lost == g_pinEdgesLostSeen) {
+		return;
+	}
+	debounceMS = PIN_GetDebounceMS();
+
+	// replay queued edges, each one ends time of previous level
+	while (tail != g_pinEdgeHead) {
+		OBK_SMP_BARRIER();
+		e = &g_pinEdges[tail % PIN_EDGE_QUEUE_SIZE];
+		i = e->pin;
+		kind = PIN_GetInputKind(g_cfg.pins.roles[i]);
+		if (g_pinEdgeAttached[i] && kind != PIN_INPUT_NONE) {
+			value = PIN_InvertInputIfNeeded(i, g_pinEdgeLevel[i]);
+			PIN_StepInput(i, kind, value, PIN_EdgeTimeSince(e->time, g_pinEdgeTime[i]), debounceMS);
+			g_pinEdgeLevel[i] = e->level;
+			g_pinEdgeTime[i] = e->time;
+#if ENABLE_IO_TRACE
+			if (g_ioTraceMode) {
+				IOTrace_Gpio(i, e->level);
 			}
+#endif
 		}
-		else {
-			if (g_gpio_index_map[0] & (1 << i))
-			{
-				uint32_t level = 1;
-				if (g_gpio_edge_map[0] & (1 << i)) {
-					level = 0;
-				}
-				int rawval = HAL_PIN_ReadDigitalInput(i);
-				if (rawval && level == 1) {
-					activepins++;
-					pinvalues[0] |= (1 << i);
-				}
-				if (!rawval && level == 0) {
-					activepins++;
-					pinvalues[0] |= (1 << i);
-				}
+		tail++;
+		// slot may be filled again after this
+		OBK_SMP_BARRIER();
+		g_pinEdgeTail = tail;
+	}
+	if (lost != g_pinEdgesLostSeen) {
+		// queue was full, edges are gone, so levels are read again
+		addLogAdv(LOG_WARN, LOG_FEATURE_GENERAL, "PIN_ticks: %u input edges lost", lost - g_pinEdgesLostSeen);
+		g_pinEdgesLostSeen = lost;
+		levels = HAL_PIN_ReadAll();
+		for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+			if (g_pinEdgeAttached[i]) {
+				g_pinEdgeLevel[i] = (levels >> i) & 1;
 			}
 		}
-
-		// activepins is count of pins which are 'active', i.e. match thier expected active level
-		if (activepins) {
-			activepoll_time = 1000; //20 x 50ms = 1s of polls after button release
+	}
+	// step pins which still have work, up to now
+	busy = false;
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (g_pinEdgeAttached[i] == 0) {
+			continue;
 		}
-
-#if 0
-		if (g_cfg.pins.roles[i] == IOR_PWM || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly) {
-			HAL_PIN_PWM_Update(i, g_channelValuesFloats[g_cfg.pins.channels[i]]);
+		kind = PIN_GetInputKind(g_cfg.pins.roles[i]);
+		if (kind == PIN_INPUT_NONE) {
+			continue;
 		}
-		else if (g_cfg.pins.roles[i] == IOR_PWM_n || g_cfg.pins.roles[i] == IOR_PWM_ScriptOnly_n) {
-			// invert PWM value
-			HAL_PIN_PWM_Update(i, 100 - g_channelValuesFloats[g_cfg.pins.channels[i]]);
+		value = PIN_InvertInputIfNeeded(i, g_pinEdgeLevel[i]);
+		if (PIN_IsInputSettled(i, kind, value)) {
+			continue;
 		}
-		else
+		PIN_StepInput(i, kind, value, PIN_EdgeTimeSince(g_time, g_pinEdgeTime[i]), debounceMS);
+		g_pinEdgeTime[i] = g_time;
+		if (PIN_IsInputSettled(i, kind, value) == false) {
+			busy = true;
+		}
+	}
+	g_pinEdgeBusy = busy;
+}
 #endif
-			if (g_cfg.pins.roles[i] == IOR_Button || g_cfg.pins.roles[i] == IOR_Button_n
-				|| g_cfg.pins.roles[i] == IOR_Button_ToggleAll || g_cfg.pins.roles[i] == IOR_Button_ToggleAll_n
-				|| g_cfg.pins.roles[i] == IOR_Button_NextColor || g_cfg.pins.roles[i] == IOR_Button_NextColor_n
-				|| g_cfg.pins.roles[i] == IOR_Button_NextDimmer || g_cfg.pins.roles[i] == IOR_Button_NextDimmer_n
-				|| g_cfg.pins.roles[i] == IOR_Button_NextTemperature || g_cfg.pins.roles[i] == IOR_Button_NextTemperature_n
-				|| g_cfg.pins.roles[i] == IOR_Button_ScriptOnly || g_cfg.pins.roles[i] == IOR_Button_ScriptOnly_n
-				|| g_cfg.pins.roles[i] == IOR_SmartButtonForLEDs || g_cfg.pins.roles[i] == IOR_SmartButtonForLEDs_n) {
-				//addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL,"Test hold %i\r\n",i);
-				PIN_Input_Handler(i, t_diff);
-			}
-			else if (g_cfg.pins.roles[i] == IOR_DigitalInput || g_cfg.pins.roles[i] == IOR_DigitalInput_n
-				||
-				g_cfg.pins.roles[i] == IOR_DigitalInput_NoPup || g_cfg.pins.roles[i] == IOR_DigitalInput_NoPup_n
-				|| g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep || g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep_NoPup
-				|| g_cfg.pins.roles[i] == IOR_DoorSensorWithDeepSleep_pd) {
-				// read pin digital value (and already invert it if needed)
-				value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
 
-#if 0
-				CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
-#else
-				// debouncing
-				if (value) {
-					if (g_times[i] > debounceMS) {
-						if (g_lastValidState[i] != value) {
-							// became up
-							g_lastValidState[i] = value;
-							CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
-						}
-					}
-					else {
-						g_times[i] += t_diff;
-					}
-					g_times2[i] = 0;
-				}
-				else {
-					if (g_times2[i] > debounceMS) {
-						if (g_lastValidState[i] != value) {
-							// became down
-							g_lastValidState[i] = value;
-							CHANNEL_Set(g_cfg.pins.channels[i], value, 0);
-						}
-					}
-					else {
-						g_times2[i] += t_diff;
-					}
-					g_times[i] = 0;
-				}
-
-#endif
-			}
-			else if (g_cfg.pins.roles[i] == IOR_ToggleChannelOnToggle
-				|| g_cfg.pins.roles[i] == IOR_ToggleChannelOnToggle_pd) {
-				value = PIN_ReadDigitalInputValue_WithInversionIncluded(i);
-			
-				if (value) {
-					if (g_times[i] > debounceMS) {
-						if (g_lastValidState[i] != value) {
-							g_lastValidState[i] = value;
-			
-							if (!CFG_HasFlag(OBK_FLAG_BUTTON_DISABLE_ALL)) {
-								CHANNEL_Toggle(g_cfg.pins.channels[i]);
-								EventHandlers_FireEvent(CMD_EVENT_PIN_ONTOGGLE, i);
-							} else {
-								addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Child lock!");
-							}
-						}
-					} else {
-						g_times[i] += t_diff;
-					}
-					g_times2[i] = 0;
-				} else {
-					if (g_times2[i] > debounceMS) {
-						if (g_lastValidState[i] != value) {
-							g_lastValidState[i] = value;
-			
-							if (!CFG_HasFlag(OBK_FLAG_BUTTON_DISABLE_ALL)) {
-								CHANNEL_Toggle(g_cfg.pins.channels[i]);
-								EventHandlers_FireEvent(CMD_EVENT_PIN_ONTOGGLE, i);
-							} else {
-								addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Child lock!");
-							}
-						}
-					} else {
-						g_times2[i] += t_diff;
-					}
-					g_times[i] = 0;
-				}
-			}
+// 0 when inputs need next tick, else time until counter rate is due or -1.
+// Counter pulses are not waited for, they are added to channels on next
+// tick anyway
+int PIN_GetTimeToNextWakeMS() {
+#if ENABLE_PIN_EDGE_INPUT
+	if (g_pinEdgeBusy || g_pinEdgeHead != g_pinEdgeTail || g_pinEdgesLost != g_pinEdgesLostSeen) {
+		return 0;
 	}
+#else
+	int i;
 
-#ifdef PLATFORM_BEKEN
-#ifdef BEKEN_PIN_GPI_INTERRUPTS
-	// TODO: not implemented yet - this bit continues polling
-	// for a while after a GPI is fired, so that we can see long press, etc.
-	if (param) {
-		addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL, "Pin intr at %d (+%d) (%08lX)", g_time, t_diff, pinvalues[0]);
+	// polled inputs
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		if (PIN_GetInputKind(g_cfg.pins.roles[i]) != PIN_INPUT_NONE) {
+			return 0;
+		}
 	}
 #endif
+	return PIN_Counter_GetTimeToNextRateMS();
+}
+
+//  background ticks, timer repeat invoking interval defined by PIN_TMR_DURATION.
+void PIN_ticks(void* param)
+{
+#if defined(PLATFORM_BEKEN) || defined(WINDOWS) || PLATFORM_ESPIDF
+	g_time = SYSPERF_GetTimeMs();
+#else
+	g_time += PIN_TMR_DURATION;
 #endif
+	uint32_t t_diff = g_time - g_last_time;
+	// cope with wrap
+	if (t_diff > 0x4000) {
+		t_diff = ((g_time + 0x4000) - (g_last_time + 0x4000));
+	}
+	g_last_time = g_time;
+
+	PIN_ApplyCounterDeltas(t_diff);
+
+#if ENABLE_PIN_EDGE_INPUT
+	PIN_ProcessEdges();
+#else
+	int i;
+	int kind;
+	int debounceMS = PIN_GetDebounceMS();
+	uint64_t levels;
+	bool bRead = false;
 
-	if (activepoll_time) {
-		activepoll_time -= t_diff;
-		if (activepoll_time <= 0) {
-			activepoll_time = 0;
+	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
+		kind = PIN_GetInputKind(g_cfg.pins.roles[i]);
+		if (kind != PIN_INPUT_NONE) {
+			// whole bank is read once, on first input
+			if (bRead == false) {
+				levels = HAL_PIN_ReadAll();
+				bRead = true;
+			}
+			// pin digital value, inverted if needed
+			PIN_StepInput(i, kind, PIN_InvertInputIfNeeded(i, (levels >> i) & 1), t_diff, debounceMS);
 		}
 	}
-	if (activepoll_time) {
-		// setup to poll in 50ms
-#ifdef PLATFORM_BEKEN
-#ifdef BEKEN_PIN_GPI_INTERRUPTS
-		PIN_TriggerPoll();
-		if (activepins) {
-			addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL, "Pins active at %d (%x)", g_time, pinvalues[0]);
-		}
-		else {
-			addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL, "Pins ->inactive at %d (%x)", g_time, pinvalues[0]);
-		}
 #endif
-#endif
-
-	}
-	else {
-#ifdef PLATFORM_BEKEN
-#ifdef BEKEN_PIN_GPI_INTERRUPTS
-		addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL, "Pins inactive at %d", g_time);
-#endif      
-#endif      
-	}
-
 }
 const char* g_channelTypeNames[] = {
 	"Default",
@@ -2444,6 +3164,41 @@ int CHANNEL_ParseChannelType(const char* s) {
 	}
 	return ChType_Error;
 }
+// CounterRate [Pin] [RateChannel] [GateMS] - writes pulses per second of
+// counter pin to RateChannel every GateMS, RateChannel -1 stops it
+static commandResult_t CMD_CounterRate(const void* context, const char* cmd, const char* args, int cmdFlags) {
+	pinCounter_t* c;
+	int pin;
+
+	Tokenizer_TokenizeString(args, 0);
+
+	if (Tokenizer_GetArgsCount() < 2) {
+		return CMD_RES_NOT_ENOUGH_ARGUMENTS;
+	}
+	pin = Tokenizer_GetPin(0, -1);
+	if (pin < 0 || pin >= PLATFORM_GPIO_MAX) {
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	c = &g_counters[pin];
+	c->gatePulses = 0;
+	c->gateElapsed = 0;
+	c->rateChannel = Tokenizer_GetArgInteger(1);
+	if (c->rateChannel < 0) {
+		c->gateMS = 0;
+		return CMD_RES_OK;
+	}
+	if (c->rateChannel >= CHANNEL_MAX) {
+		c->gateMS = 0;
+		return CMD_RES_BAD_ARGUMENT;
+	}
+	c->gateMS = Tokenizer_GetArgIntegerDefault(2, 1000);
+	if (c->gateMS < PIN_TMR_DURATION) {
+		c->gateMS = PIN_TMR_DURATION;
+	}
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Counter on pin %i: rate to channel %i every %i ms, counted by %s",
+		pin, c->rateChannel, c->gateMS, c->bHardware ? "hardware" : "interrupt");
+	return CMD_RES_OK;
+}
 static commandResult_t CMD_setButtonHoldRepeat(const void* context, const char* cmd, const char* args, int cmdFlags) {
 
 
@@ -2499,8 +3254,8 @@ static commandResult_t CMD_ShowChannelValues(const void* context, const char* cm
 	int i;
 
 	for (i = 0; i < CHANNEL_MAX; i++) {
-		if (g_channelValues[i] > 0) {
-			addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Channel %i value is %i", i, g_channelValues[i]);
+		if (Channel_GetInt(i) > 0) {
+			addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "Channel %i value is %i", i, Channel_GetInt(i));
 		}
 	}
 
@@ -2673,23 +3428,11 @@ int h_isChannelPWM(int tg_ch) {
 	return false;
 }
 int h_isChannelRelay(int tg_ch) {
-	int i;
-	int role;
-
-	for (i = 0; i < PLATFORM_GPIO_MAX; i++) {
-		int ch = PIN_GetPinChannelForPinIndex(i);
-		if (tg_ch != ch)
-			continue;
-		role = PIN_GetPinRoleForPinIndex(i);
-		if (role == IOR_Relay || role == IOR_Relay_n || role == IOR_LED || role == IOR_LED_n) {
-			return true;
-		}
-		if ((role == IOR_BridgeForward) || (role == IOR_BridgeReverse))
-		{
-			return true;
-		}
+	if (tg_ch < 0 || tg_ch >= CHANNEL_MAX) {
+		return false;
 	}
-	return false;
+	PIN_CheckChannelIndex();
+	return (g_chIndexFlags[tg_ch] & CH_INDEX_RELAY) != 0;
 }
 int h_isChannelDigitalInput(int tg_ch) {
 	int i;
@@ -2869,6 +3612,11 @@ void PIN_AddCommands(void)
 	//cmddetail:"fn":"CMD_setButtonHoldRepeat","file":"new_pins.c","requires":"",
 	//cmddetail:"examples":""}
 	CMD_RegisterCommand("setButtonHoldRepeat", CMD_setButtonHoldRepeat, NULL);
+	//cmddetail:{"name":"CounterRate","args":"[Pin][RateChannel][OptionalGateMS]",
+	//cmddetail:"descr":"For Counter_f/Counter_r pin, sets RateChannel to pulses per second counted over gating window of GateMS (default 1000). Use channel type with divider (like Frequency_div10) for fractions. RateChannel -1 stops it. Counting is done by hardware pulse counter where platform has one.",
+	//cmddetail:"fn":"CMD_CounterRate","file":"new_pins.c","requires":"",
+	//cmddetail:"examples":"CounterRate 7 5 2000"}
+	CMD_RegisterCommand("CounterRate", CMD_CounterRate, NULL);
 #ifdef ENABLE_BL_MOVINGAVG
 	//cmddetail:{"name":"setMovingAvg","args":"MovingAvg",
 	//cmddetail:"descr":"Moving average value for power and current. <=1 disable, >=2 count of avg values. The setting is temporary and need to be set at startup.",
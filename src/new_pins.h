@@ -576,14 +576,14 @@ typedef enum ioRole_e {
 	IOR_PWM_ScriptOnly_n,
 	//iodetail:{"name":"Counter_f",
 	//iodetail:"title":"TODO",
-	//iodetail:"descr":"Counts pulses on falling edge (transition from high to low). Each transitions adds 1 to linked channel.",
+	//iodetail:"descr":"Counts pulses on falling edge (transition from high to low). Each transitions adds 1 to linked channel. See CounterRate command for pulses per second.",
 	//iodetail:"enum":"IOR_Counter_f",
 	//iodetail:"file":"new_pins.h",
 	//iodetail:"driver":""}
 	IOR_Counter_f,
 	//iodetail:{"name":"Counter_r",
 	//iodetail:"title":"TODO",
-	//iodetail:"descr":"Counts pulses on rising edge (transition from low to high). Each transitions adds 1 to linked channel.",
+	//iodetail:"descr":"Counts pulses on rising edge (transition from low to high). Each transitions adds 1 to linked channel. See CounterRate command for pulses per second.",
 	//iodetail:"enum":"IOR_Counter_r",
 	//iodetail:"file":"new_pins.h",
 	//iodetail:"driver":""}
@@ -1543,7 +1543,13 @@ typedef struct mainConfig_s {
 	// offset 0x00000554
 	char mqtt_group[64];
 	// offs 0x00000594
-	byte unused_bytefill[3];
+	// LFS tuning, 0 is platform default, see lfs_tune
+	// read/prog cache is 1 << LFS_cacheLog2 bytes
+	byte LFS_cacheLog2;
+	// lookahead is 1 << LFS_lookaheadLog2 bytes
+	byte LFS_lookaheadLog2;
+	// block_cycles / 10, 255 disables wear leveling
+	byte LFS_blockCycles10;
 	// offs 0x00000597
 	byte timeRequiredToMarkBootSuccessfull;
 	//offs 0x00000598
@@ -1579,9 +1585,14 @@ typedef struct mainConfig_s {
 #if PLATFORM_BEKEN
 	obkFastConnectData_t fcdata;
 	// offset 0x00000D0C (3340 decimal)
-	char unused[244];
+	// last DHCP lease, fast connect reuses it, see Main_GetWiFiConnectIP
+	obkStaticIP_t dhcpLease;
+	// offset 0x00000D1C (3356 decimal)
+	char unused[228];
 #else
-	char unused[324];
+	obkStaticIP_t dhcpLease;
+	// offset 0x00000CCC (3276 decimal)
+	char unused[308];
 #endif
 #endif
 } mainConfig_t;
@@ -1598,8 +1609,13 @@ extern int g_initialPinStates;
 #define CHANNEL_SET_FLAG_FORCE		1
 #define CHANNEL_SET_FLAG_SKIP_MQTT	2
 #define CHANNEL_SET_FLAG_SILENT		4
+// CHANNEL_Set_FloatPWM stores value only, PWM hardware fades pins itself
+#define CHANNEL_SET_FLAG_SKIP_PWM	8
 
 void PIN_ticks(void* param);
+int PIN_GetTimeToNextWakeMS();
+// true when counter pin is counted by hardware unit, not interrupt
+bool PIN_Counter_IsHardware(int index);
 
 void PIN_DeepSleep_SetWakeUpEdge(int pin, byte edgeCode);
 void PIN_DeepSleep_SetAllWakeUpEdges(byte edgeCode);
@@ -1608,6 +1624,7 @@ void PIN_set_wifi_led(int value);
 void PIN_AddCommands(void);
 void PINS_BeginDeepSleepWithPinWakeUp(unsigned int wakeUpTime);
 void PIN_SetupPins();
+void PIN_SetupOutputsEarly();
 void PIN_OnReboot();
 void CFG_ClearPins();
 int PIN_CountPinsWithRole(int role);
@@ -1620,6 +1637,8 @@ const char* PIN_GetPinNameAlias(int index);
 void PIN_SetPinRoleForPinIndex(int index, int role);
 void PIN_SetPinChannelForPinIndex(int index, int ch);
 void PIN_SetPinChannel2ForPinIndex(int index, int ch);
+// must be called after g_cfg.pins is changed other way than by setters above
+void PIN_InvalidateChannelIndex();
 void CHANNEL_Toggle(int ch);
 void CHANNEL_DoSpecialToggleAll();
 bool CHANNEL_Check(int ch);
@@ -1628,13 +1647,46 @@ void CHANNEL_ClearAllChannels();
 // CHANNEL_SET_FLAG_*
 void CHANNEL_Set_Ex(int ch, int iVal, int iFlags, int ausemovingaverage);
 void CHANNEL_Set(int ch, int iVal, int iFlags);
+// sets many channels as one batch, returns number of changed channels
+int CHANNEL_SetMany(const int* chs, const int* vals, int count, int iFlags);
+// Changes made between these two only store values, then commit runs
+// change handlers once for whole batch: pins, drivers with single
+// multi-channel call, one MQTT publish pass, events and one flash save.
+// Batches can be nested, only the outer commit runs handlers.
+// Commit returns count of channels that changed.
+void CHANNEL_BeginBatch();
+int CHANNEL_CommitBatch();
 void CHANNEL_SetSmart(int ch, float fVal, int iFlags);
+// PWM duties set between these two, by channel changes and by
+// CHANNEL_Set_FloatPWM, go out in one HAL_PIN_PWM_UpdateGroup on commit.
+// Can be nested, only the outer commit writes them.
+void PIN_BeginPWMGroup();
+void PIN_CommitPWMGroup();
 void CHANNEL_Set_FloatPWM(int ch, float fVal, int iFlags);
+// hardware fade of PWM pins of channel to fVal, false if there is no pin
+// or some can't fade, see HAL_PIN_PWM_FadeTo
+bool CHANNEL_FadePWM(int ch, float fVal, int ms);
 void CHANNEL_Add(int ch, int iVal);
 void CHANNEL_AddClamped(int ch, int iVal, int min, int max, int bWrapInsteadOfClamp);
 int CHANNEL_Get(int ch);
+// version grows with each channel change, see http_fn_state
+int CHANNEL_GetStateVersion();
+int CHANNEL_BumpStateVersion();
+// state version of last change of channel, 0 if never changed
+int CHANNEL_GetChangeVersion(int ch);
+// Native form of channel value. Integer channels with divider in their
+// type are fixed point. Float is set by CHANNEL_Set_FloatPWM, and by
+// CHANNEL_SetSmart when value has more digits than the divider keeps.
+#define CHANNEL_REPR_INT		0
+#define CHANNEL_REPR_FIXED		1
+#define CHANNEL_REPR_FLOAT		2
+// value divided by divider, float is not rounded through int
 float CHANNEL_GetFinalValue(int channel);
+// raw value, with fraction for float channels
 float CHANNEL_GetFloat(int ch);
+int CHANNEL_GetRepr(int ch);
+// divider that raw value of channel is scaled by
+int CHANNEL_GetDivider(int ch);
 int CHANNEL_GetRoleForOutputChannel(int ch);
 bool CHANNEL_ShouldBePublished(int ch);
 bool CHANNEL_IsPowerRelayChannel(int ch);
@@ -1656,7 +1708,24 @@ void CHANNEL_SetStateOnly(int iVal);
 int CHANNEL_HasChannelPinWithRole(int ch, int iorType);
 int CHANNEL_HasChannelPinWithRoleOrRole(int ch, int iorType, int iorType2);
 bool CHANNEL_IsInUse(int ch);
+// marks remembered channel for write-behind save, see CHANNEL_SetSaveDelay
 void Channel_SaveInFlashIfNeeded(int ch);
+typedef struct channelSaveStats_s {
+	// changes of remembered channels
+	unsigned int requests;
+	// flash writes made for them and channel values written
+	unsigned int writes;
+	unsigned int values;
+	// dirty channels that were back at saved value
+	unsigned int unchanged;
+} channelSaveStats_t;
+// writes all marked channels now, returns count written
+int CHANNEL_FlushSaves();
+void CHANNEL_RunSavesEverySecond();
+// save after delaySeconds without change, at most once per intervalSeconds,
+// delay 0 saves every change at once
+void CHANNEL_SetSaveDelay(int delaySeconds, int intervalSeconds);
+void CHANNEL_GetSaveStats(channelSaveStats_t* out, int* delaySeconds, int* intervalSeconds, int* pending);
 int CHANNEL_FindMaxValueForChannel(int ch);
 int CHANNEL_FindIndexForType(int requiredType); 
 int CHANNEL_FindIndexForPinType(int requiredType);
@@ -1667,6 +1736,30 @@ const char* CHANNEL_GetLabel(int ch);
 void CHANNEL_SetLabel(int ch, const char *s, int bHideTogglePrefix);
 bool CHANNEL_ShouldAddTogglePrefixToUI(int ch);
 bool CHANNEL_HasNeverPublishFlag(int ch);
+// cmd_channelStats.c
+#if ENABLE_CHANNEL_STATS
+typedef enum {
+	CHSTAT_AVG,
+	CHSTAT_MIN,
+	CHSTAT_MAX,
+	// value * seconds over window
+	CHSTAT_SUM,
+	// change per second over window
+	CHSTAT_RATE,
+	CHSTAT_EMA,
+	CHSTAT_COUNT,
+} channelStat_t;
+extern unsigned int g_channelStatsMask[(CHANNEL_MAX + 31) / 32];
+void ChannelStats_Update(int ch, float value);
+// false when channel has no tracker with this window
+bool ChannelStats_Get(int ch, int window, int stat, float* out);
+void ChannelStats_ForEach(void* userData, void (*callback)(int ch, int window, const float* stats, void* userData));
+void ChannelStats_Init();
+#define CHANNEL_STATS_UPDATE(ch, v) \
+	if (g_channelStatsMask[(ch) / 32] & (1u << ((ch) % 32))) ChannelStats_Update(ch, v)
+#else
+#define CHANNEL_STATS_UPDATE(ch, v)
+#endif
 //ledRemap_t *CFG_GetLEDRemap();
 
 void PIN_get_Relay_PWM_Count(int* relayCount, int* pwmCount, int* dInputCount);
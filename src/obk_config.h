@@ -54,6 +54,8 @@
 #define ENABLE_HTTP_STARTUP						1
 #define ENABLE_HTTP_PING						1
 #define ENABLE_LED_BASIC						1
+// integer smooth transitions and gamma table, most chips have no FPU
+#define ENABLE_LED_FIXED_POINT					1
 
 #if PLATFORM_XRADIO
 
@@ -109,6 +111,8 @@
 //#define ENABLE_DRIVER_SM16703P					1
 //#define ENABLE_DRIVER_PIXELANIM					1
 #undef ENABLE_HTTP_MAC
+// flash is tight, debug lines are not built
+#define OBK_LOG_MIN_LEVEL						LOG_INFO
 
 #elif PLATFORM_W800
 
@@ -154,6 +158,8 @@
 #define ENABLE_DRIVER_TCA9554					1
 #define ENABLE_DRIVER_PINMUTEX					1
 #define ENABLE_DRIVER_TESTSPIFLASH				1
+// software watchdog with task heartbeats, see startDriver Freeze
+#define ENABLE_DRIVER_FREEZE					1
 
 #define ENABLE_DRIVER_GIRIERMCU					1
 
@@ -164,6 +170,10 @@
 #define ENABLE_SEND_POSTANDGET					1
 #define ENABLE_MQTT								1
 #define ENABLE_TASMOTADEVICEGROUPS				1
+// channels mirrored between OBK devices over UDP, see ChSync_Publish
+#define ENABLE_DRIVER_CHSYNC					1
+// answers <name>.local and DNS-SD queries for _http._tcp and _obk._tcp
+#define ENABLE_DRIVER_MDNS						1
 #define ENABLE_LITTLEFS							1
 #define ENABLE_NTP								1
 #define ENABLE_TIME_DST							1
@@ -171,6 +181,7 @@
 #define ENABLE_DRIVER_BL0937					1
 #define ENABLE_DRIVER_BL0942					1
 #define ENABLE_DRIVER_BL0942SPI					1
+#define ENABLE_DRIVER_ST7735					1
 #define ENABLE_DRIVER_CSE7766					1
 #define ENABLE_DRIVER_CSE7761					1
 #define ENABLE_DRIVER_TESTPOWER					1
@@ -190,23 +201,60 @@
 #define ENABLE_DRIVER_BKPARTITIONS				1
 #define ENABLE_DRIVER_PT6523					1
 #define ENABLE_DRIVER_MAX6675					1
+#define ENABLE_DRIVER_NEO6M						1
+#define ENABLE_DRIVER_DEBOUNCER					1
 #define ENABLE_DRIVER_TEXTSCROLLER				1
 #define ENABLE_TIME_SUNRISE_SUNSET				1
 // parse things like $CH1 or $hour etc
 #define ENABLE_EXPAND_CONSTANT					1
 #define ENABLE_DRIVER_DHT						1
 #define ENABLE_DRIVER_SM16703P					0
-#define ENABLE_DRIVER_PIXELANIM					0
+#define ENABLE_DRIVER_PIXELANIM					1
 #define ENABLE_DRIVER_TMGN						1
+// per-command call counts and timings, see cmdStats
+#define ENABLE_CMD_STATS						1
+// per-route hit counts and timings, see /api/routestats
+#define ENABLE_HTTP_ROUTE_STATS					1
+// timing, bytes sent and heap of last requests, see /api/httpstats
+#define ENABLE_HTTP_REQUEST_STATS				1
+// addLogBin records, see scripts/decode_binlog.py
+#define ENABLE_BINARY_LOG						1
+// last log lines of previous boot, see /api/crashlog
+#define ENABLE_CRASH_LOG						1
+// buttons and digital inputs driven by edge interrupts, see PIN_ticks
+#define ENABLE_PIN_EDGE_INPUT					1
+// QuickTick runs only when something has work due
+#define ENABLE_QUICKTICK_SLEEP					1
+// QuickTick part timings and thread stack use, see sysperf
+#define ENABLE_SYSPERF							1
+// file and line of every allocation, see heapstats
+#define ENABLE_HEAP_TRACKER						1
+// size class pools for small structures, see poolstats
+#define ENABLE_MEMPOOL							1
+// record and replay of device inputs and outputs, see iotrace_start
+#define ENABLE_IO_TRACE							1
+// timer sampled CPU profile, see profile_start; simulator has no
+// sampling timer, devices opt in
+#define ENABLE_CPU_PROFILER						1
+// config checksum four bytes per step, 768 more bytes of tables
+#define ENABLE_CRC8_SLICE4						1
+// repeated Tasmota STATUS polls are served from last rendered sections
+#define ENABLE_TASMOTA_JSON_CACHE				1
+// updated device can serve its firmware to peers, see otaRelay
+#define ENABLE_OTA_RELAY						1
+// read-only asset image for web UI and scripts, see /api/assets
+#define ENABLE_ASSETS							1
 #define ENABLE_DRIVER_DRAWERS					1
 #define ENABLE_TASMOTA_JSON						1
 #define ENABLE_DRIVER_DDP						1
 #define ENABLE_DRIVER_DDPSEND					1
+// E1.31 (sACN) and Art-Net receiver for LED strips
+#define ENABLE_DRIVER_E131						1
 #define ENABLE_DRIVER_SSDP						1
 #define ENABLE_DRIVER_ADCBUTTON					1
 #define ENABLE_DRIVER_SM15155E					1
 // #define ENABLE_DRIVER_IR						1
-// #define ENABLE_DRIVER_IR2					1
+#define ENABLE_DRIVER_IR2						1
 #define ENABLE_DRIVER_CHARTS					1
 #define ENABLE_DRIVER_WIDGET					1
 #define ENABLE_DRIVER_OPENWEATHERMAP			1
@@ -268,6 +316,8 @@
 #elif PLATFORM_BEKEN
 
 //#define ENABLE_LFS_SPI						1
+// flash on hardware SPI pins P14/P16/P17, chip select on P15
+//#define ENABLE_LFS_SPI_HW						1
 //#define ENABLE_DRIVER_TESTSPIFLASH			1
 
 //#define	ENABLE_DRIVER_UART_TCP					1
@@ -283,6 +333,8 @@
 #define ENABLE_SEND_POSTANDGET					1
 #define ENABLE_MQTT								1
 #define ENABLE_TASMOTADEVICEGROUPS				1
+#define ENABLE_DRIVER_CHSYNC					1
+#define ENABLE_DRIVER_MDNS						1
 #define ENABLE_LITTLEFS							1
 #define ENABLE_NTP								1
 // #define ENABLE_TIME_DST						1
@@ -311,6 +363,7 @@
 #define ENABLE_DRIVER_HUE						1
 // #define ENABLE_DRIVER_CHARGINGLIMIT			1
 #define ENABLE_DRIVER_BATTERY					1
+#define ENABLE_BINARY_LOG						1
 #if PLATFORM_BK7231N || PLATFORM_BEKEN_NEW
 // #define ENABLE_DRIVER_PWM_GROUP				1
 #define ENABLE_DRIVER_SM16703P					0
@@ -319,6 +372,12 @@
 #define ENABLE_DRIVER_SM15155E					1  
 
 
+#endif
+#if PLATFORM_BK7231T
+// flash is tight, debug lines are not built,
+// add features here like (1 << LOG_FEATURE_TUYAMCU) to keep theirs
+#define OBK_LOG_MIN_LEVEL						LOG_INFO
+#define OBK_LOG_DEBUG_FEATURES					0
 #endif
 // parse things like $CH1 or $hour etc
 #define ENABLE_EXPAND_CONSTANT					1
@@ -343,6 +402,10 @@
 #define NEW_TCP_SERVER							1
 #endif
 #define ENABLE_DRIVER_NEO6M						1
+#define ENABLE_DRIVER_DEBOUNCER					1
+#define ENABLE_DRIVER_FREEZE					1
+// updated device can serve its firmware to peers, see otaRelay
+#define ENABLE_OTA_RELAY						1
 
 // ENABLE_I2C_ is a syntax for
 // our I2C system defines for drv_i2c_main.c
@@ -447,6 +510,17 @@
 
 #elif PLATFORM_ESPIDF
 
+// on dual core chips threads of network servers run on OBK_NET_CORE with
+// WiFi and lwIP, QuickTick and sensor reads on OBK_TIMING_CORE, -1 lets
+// them run on any core, see HAL_GetThreadCore
+#ifndef OBK_NET_CORE
+#define OBK_NET_CORE							0
+#endif
+#ifndef OBK_TIMING_CORE
+#define OBK_TIMING_CORE							1
+#endif
+// .noinit RAM keeps last log lines over watchdog and panic reset
+#define ENABLE_CRASH_LOG						1
 #define ENABLE_SEND_POSTANDGET					1
 #define	ENABLE_HA_DISCOVERY						1
 #define ENABLE_MQTT								1
@@ -470,6 +544,7 @@
 #define ENABLE_TASMOTA_JSON						1
 #define ENABLE_CALENDAR_EVENTS					1
 #define ENABLE_DRIVER_DDP						1
+#define ENABLE_DRIVER_E131						1
 #define ENABLE_DRIVER_SSDP						1
 #define ENABLE_DRIVER_CHT83XX					1
 //#define ENABLE_DRIVER_CSE7761					1
@@ -477,6 +552,22 @@
 #define ENABLE_ADVANCED_CHANNELTYPES_DISCOVERY	1
 #define ENABLE_DRIVER_SM16703P					1
 #define ENABLE_DRIVER_PIXELANIM					1
+// buttons and digital inputs driven by edge interrupts, see PIN_ticks
+#define ENABLE_PIN_EDGE_INPUT					1
+// QuickTick runs only when something has work due
+#define ENABLE_QUICKTICK_SLEEP					1
+// QuickTick part timings and thread stack use, see sysperf
+#define ENABLE_SYSPERF							1
+// size class pools for small structures, see poolstats
+#define ENABLE_MEMPOOL							1
+// config checksum four bytes per step, 768 more bytes of tables
+#define ENABLE_CRC8_SLICE4						1
+// repeated Tasmota STATUS polls are served from last rendered sections
+#define ENABLE_TASMOTA_JSON_CACHE				1
+// updated device can serve its firmware to peers, see otaRelay
+#define ENABLE_OTA_RELAY						1
+// read-only asset image for web UI and scripts, see /api/assets
+#define ENABLE_ASSETS							1
 
 #if (OBK_VARIANT == OBK_VARIANT_ESP4M || OBK_VARIANT == OBK_VARIANT_ESP2M_BERRY)
 #define ENABLE_OBK_BERRY						1
@@ -671,6 +762,12 @@
 #define ENABLE_HTTP_DGR							1
 #endif
 
+// OpenWeatherMap queries go through async HTTP client
+#if ENABLE_DRIVER_OPENWEATHERMAP
+#undef ENABLE_SEND_POSTANDGET
+#define ENABLE_SEND_POSTANDGET					1
+#endif
+
 // if power metering chip is enabled, also enable backend for that
 #if ENABLE_DRIVER_BL0937 || ENABLE_DRIVER_BL0942 || ENABLE_DRIVER_BL0942SPI || ENABLE_DRIVER_CSE7766 || ENABLE_DRIVER_HT7017 || ENABLE_DRIVER_ST7735
 #define ENABLE_BL_SHARED						1
@@ -680,5 +777,62 @@
 // #define ENABLE_BL_MOVINGAVG					1
 #endif
 
+// energy per interval in LittleFS files, see drv_bl_history.c
+#if ENABLE_BL_SHARED && ENABLE_LITTLEFS
+#define ENABLE_BL_HISTORY						1
+#endif
+
+// text/event-stream of channel changes, logs and driver info for web
+// page, each open stream holds one HTTP client thread
+#if WINDOWS || PLATFORM_BEKEN || PLATFORM_BL602 || PLATFORM_ESPIDF || PLATFORM_LN882H
+#define ENABLE_HTTP_SSE							1
+#endif
+
+// PowerSave level follows load, see startDriver PowerGov
+#if WINDOWS || PLATFORM_BEKEN || PLATFORM_BL602 || PLATFORM_ESPIDF || PLATFORM_REALTEK
+#define ENABLE_DRIVER_POWERGOV					1
+#endif
+
+// rolling avg/min/max/rate of channels for rules, see ChannelStats
+#if WINDOWS || PLATFORM_BEKEN || PLATFORM_BL602 || PLATFORM_ESPIDF || PLATFORM_REALTEK
+#define ENABLE_CHANNEL_STATS					1
+#endif
+
+// index page parts of drivers kept until they change, see DRV_MarkIndexDirty
+#if WINDOWS || PLATFORM_BEKEN || PLATFORM_BL602 || PLATFORM_ESPIDF || PLATFORM_REALTEK
+#define ENABLE_DRIVER_INDEX_CACHE				1
+#endif
+
+// Modbus RTU master and slave on UART, see startDriver Modbus
+#if WINDOWS || PLATFORM_BEKEN || PLATFORM_BL602 || PLATFORM_ESPIDF || PLATFORM_REALTEK
+#define ENABLE_DRIVER_MODBUS					1
+#endif
+
+// background scan cache and roaming between APs of SSID, see startDriver WiFiRoam
+#if WINDOWS || (PLATFORM_BEKEN && !defined(PLATFORM_BEKEN_NEW)) || PLATFORM_BL602 || PLATFORM_ESPIDF
+#define ENABLE_DRIVER_WIFIROAM					1
+#endif
+
+// ADDLOG_xxx calls above this level are compiled out, see logging.h.
+// Bits of OBK_LOG_DEBUG_FEATURES are LOG_FEATURE_xxx that keep all levels.
+#ifndef OBK_LOG_MIN_LEVEL
+#define OBK_LOG_MIN_LEVEL						LOG_MAX
+#endif
+#ifndef OBK_LOG_DEBUG_FEATURES
+#define OBK_LOG_DEBUG_FEATURES					0
+#endif
+
+// Berry VM allocates from its own arena, so scripts can't starve
+// lwIP and MQTT of heap. Size is set with berryArena command.
+#if ENABLE_OBK_BERRY
+#define ENABLE_BERRY_ARENA						1
+#endif
+
+// tcp, http and mqtt for Berry that resume a closure from main loop
+// instead of blocking the script, see be_async.c
+#if ENABLE_OBK_BERRY
+#define ENABLE_BERRY_ASYNC						1
+#endif
+
 // closing OBK_CONFIG_H
 #endif
@@ -1,9 +1,101 @@
+#ifndef __QUICKTICK_H__
+#define __QUICKTICK_H__
+#include "new_common.h"
 
 
-#define QUICK_TMR_DURATION      25 // Delay (in ms) between button scan iterations
 
-// define this to use edge based GPI interrupts to drive Pin_ticks()
-//#define BEKEN_PIN_GPI_INTERRUPTS
+#define QUICK_TMR_DURATION      25 // Delay (in ms) between button scan iterations
 
 extern unsigned int g_deltaTimeMS;
 extern unsigned int g_timeMs;
+
+// pins, drivers, scripts and queued commands, every QUICK_TMR_DURATION
+// or when woken, simulator calls it once per frame
+void QuickTick(void* param);
+
+// With ENABLE_QUICKTICK_SLEEP, QuickTick runs only when some part has
+// work due. Code that gives QuickTick work from other thread (or ISR)
+// must wake it, work found inside QuickTick is seen by itself.
+void QuickTick_Wake();
+void QuickTick_WakeFromISR();
+// time not yet passed to QuickTick parts, timers armed from outside of
+// QuickTick add it to their delay, so they don't fire early after sleep
+int QuickTick_GetTimeSinceRunMS();
+// how long quick thread may sleep before next QuickTick
+int QuickTick_GetSleepMS();
+
+// microseconds on ESP-IDF, elsewhere resolution is the RTOS tick
+unsigned int SYSPERF_GetTimeUs();
+// milliseconds for timestamps of drivers, from hardware clock on Beken,
+// ESP-IDF and simulator, elsewhere resolution is the RTOS tick
+uint32_t SYSPERF_GetTimeMs();
+
+#if ENABLE_SYSPERF
+// time spent in parts of QuickTick and stack use of threads, see sysperf
+typedef struct perfStat_s {
+	unsigned int calls;
+	unsigned int totalUs;
+	unsigned int maxUs;
+} perfStat_t;
+
+enum {
+	QT_STAGE_TOTAL,
+	QT_STAGE_PINS,
+	QT_STAGE_SCRIPTS,
+	QT_STAGE_REPEATING_EVENTS,
+	QT_STAGE_DRIVERS,
+	QT_STAGE_COMMANDS,
+	QT_STAGE_MQTT,
+	QT_STAGE_LED,
+	QT_STAGE_COUNT
+};
+
+void PerfStat_Add(perfStat_t* st, unsigned int us);
+const char* QuickTick_GetStageName(int stage);
+const perfStat_t* QuickTick_GetStageStats(int stage);
+// runs longer than QUICK_TMR_DURATION
+unsigned int QuickTick_GetOverruns();
+void QuickTick_ResetStats();
+
+#define SYSPERF_MAX_THREADS		16
+typedef struct perfThread_s {
+	char name[16];
+	int stackBytes;
+	// least free stack seen, -1 when platform can't tell
+	int minFreeBytes;
+	bool bAlive;
+} perfThread_t;
+
+// threads created by rtos_create_thread are registered by it
+void SYSPERF_RegisterThread(void* handle, const char* name, int stackBytes);
+void SYSPERF_UnregisterThread(void* handle);
+// copies registered threads with fresh high-water marks, returns count
+int SYSPERF_GetThreads(perfThread_t* out, int maxCount);
+
+#define SYSPERF_MAX_TASKS		24
+#define SYSPERF_DEFAULT_WINDOW	10
+typedef struct perfTask_s {
+	char name[16];
+	// -1 when platform can't tell
+	int priority;
+	int minFreeBytes;
+	// of one core in last whole window, -1 without RTOS run time stats
+	int cpuPermille;
+	// -1 when task may run on any core or platform can't tell
+	int core;
+} perfTask_t;
+
+// tasks and their CPU use are taken once a window of seconds
+void SYSPERF_SetWindow(int seconds);
+int SYSPERF_GetWindow();
+void SYSPERF_OnEverySecond();
+// tasks of last window, all RTOS tasks where run time stats are built,
+// else registered threads; returns count
+int SYSPERF_GetTasks(perfTask_t* out, int maxCount);
+#define SYSPERF_MAX_CORES		2
+// busy time of core in last window in per mille, from its idle task,
+// -1 without run time stats or when chip has no such core
+int SYSPERF_GetCoreLoad(int core);
+#endif
+
+#endif
@@ -28,6 +28,7 @@
 /* Author: Jan Winkler */
 
 #include <math.h>
+#include "rgb2hsv.h"
 
 
 static float my_min(float a, float b){
@@ -163,3 +164,125 @@ void HSVtoRGB(float *ofR, float *ofG, float *ofB, float fH, float fS, float fV)
 	*ofB = fB;
 }
 
+// one sector of hue is 60 degrees
+#define HSV_SECTOR	(60 * HSV_HUE_PER_DEGREE)
+
+// 2^24 / d rounded up, so a * g_hsvRecip[d] >> 8 is a / d in 16.16 without
+// divide, which ARM968 of BK7231 doesn't have
+static const uint32_t g_hsvRecip[256] = {
+	0, 16777216, 8388608, 5592406, 4194304, 3355444, 2796203, 2396746,
+	2097152, 1864136, 1677722, 1525202, 1398102, 1290556, 1198373, 1118482,
+	1048576, 986896, 932068, 883012, 838861, 798916, 762601, 729445,
+	699051, 671089, 645278, 621379, 599187, 578525, 559241, 541201,
+	524288, 508401, 493448, 479350, 466034, 453439, 441506, 430186,
+	419431, 409201, 399458, 390168, 381301, 372828, 364723, 356963,
+	349526, 342393, 335545, 328966, 322639, 316552, 310690, 305041,
+	299594, 294338, 289263, 284360, 279621, 275037, 270601, 266306,
+	262144, 258112, 254201, 250407, 246724, 243149, 239675, 236299,
+	233017, 229825, 226720, 223697, 220753, 217886, 215093, 212370,
+	209716, 207127, 204601, 202136, 199729, 197380, 195084, 192842,
+	190651, 188509, 186414, 184366, 182362, 180401, 178482, 176603,
+	174763, 172961, 171197, 169467, 167773, 166112, 164483, 162886,
+	161320, 159784, 158276, 156797, 155345, 153920, 152521, 151147,
+	149797, 148471, 147169, 145889, 144632, 143396, 142180, 140986,
+	139811, 138655, 137519, 136401, 135301, 134218, 133153, 132105,
+	131072, 130056, 129056, 128071, 127101, 126145, 125204, 124276,
+	123362, 122462, 121575, 120700, 119838, 118988, 118150, 117324,
+	116509, 115705, 114913, 114131, 113360, 112599, 111849, 111108,
+	110377, 109656, 108943, 108241, 107547, 106862, 106185, 105518,
+	104858, 104207, 103564, 102928, 102301, 101681, 101068, 100463,
+	99865, 99274, 98690, 98113, 97542, 96979, 96421, 95870,
+	95326, 94787, 94255, 93728, 93207, 92692, 92183, 91679,
+	91181, 90688, 90201, 89718, 89241, 88769, 88302, 87839,
+	87382, 86929, 86481, 86038, 85599, 85164, 84734, 84308,
+	83887, 83469, 83056, 82647, 82242, 81841, 81443, 81050,
+	80660, 80274, 79892, 79513, 79138, 78767, 78399, 78034,
+	77673, 77315, 76960, 76609, 76261, 75916, 75574, 75235,
+	74899, 74566, 74236, 73909, 73585, 73263, 72945, 72629,
+	72316, 72006, 71698, 71393, 71090, 70790, 70493, 70198,
+	69906, 69616, 69328, 69043, 68760, 68479, 68201, 67924,
+	67651, 67379, 67109, 66842, 66577, 66314, 66053, 65794,
+};
+
+void RGB_to_HSV_u16(uint8_t r, uint8_t g, uint8_t b, uint16_t *h, uint16_t *s, uint16_t *v) {
+	uint32_t max, min, delta, sat, ratio, hue;
+
+	max = r > g ? r : g;
+	if (b > max)
+		max = b;
+	min = r < g ? r : g;
+	if (b < min)
+		min = b;
+	delta = max - min;
+
+	*v = max * 257;
+	if (delta == 0) {
+		*h = 0;
+		*s = 0;
+		return;
+	}
+	// delta / max in 8.24, scaled by 65535 / 65536
+	sat = delta * g_hsvRecip[max];
+	sat = (sat - (sat >> 16)) >> 8;
+	*s = sat > 65535 ? 65535 : sat;
+
+	// same order of channels as in RGBtoHSV, ratio is 0 to 1 in 16.16
+	if (max == r) {
+		if (g >= b) {
+			ratio = ((g - b) * g_hsvRecip[delta]) >> 8;
+			hue = (ratio * HSV_SECTOR + 32768) >> 16;
+		} else {
+			ratio = ((b - g) * g_hsvRecip[delta]) >> 8;
+			hue = HSV_HUE_MAX - ((ratio * HSV_SECTOR + 32768) >> 16);
+		}
+	} else if (max == g) {
+		if (b >= r) {
+			ratio = ((b - r) * g_hsvRecip[delta]) >> 8;
+			hue = 2 * HSV_SECTOR + ((ratio * HSV_SECTOR + 32768) >> 16);
+		} else {
+			ratio = ((r - b) * g_hsvRecip[delta]) >> 8;
+			hue = 2 * HSV_SECTOR - ((ratio * HSV_SECTOR + 32768) >> 16);
+		}
+	} else {
+		if (r >= g) {
+			ratio = ((r - g) * g_hsvRecip[delta]) >> 8;
+			hue = 4 * HSV_SECTOR + ((ratio * HSV_SECTOR + 32768) >> 16);
+		} else {
+			ratio = ((g - r) * g_hsvRecip[delta]) >> 8;
+			hue = 4 * HSV_SECTOR - ((ratio * HSV_SECTOR + 32768) >> 16);
+		}
+	}
+	if (hue >= HSV_HUE_MAX)
+		hue -= HSV_HUE_MAX;
+	*h = hue;
+}
+
+void HSV_to_RGB_u8(uint16_t h, uint16_t s, uint16_t v, uint8_t *r, uint8_t *g, uint8_t *b) {
+	uint32_t sector, f, c, x, m, rr, gg, bb;
+
+	if (h >= HSV_HUE_MAX)
+		h %= HSV_HUE_MAX;
+	sector = h / HSV_SECTOR;
+	// position in sector, 0 to 1 in 16.16; 139811 / 2^14 is 65536 / 7680
+	f = ((h - sector * HSV_SECTOR) * 139811u) >> 14;
+
+	// chroma, rising and falling channel and the rest, all 0 to 65535
+	c = (v * (s + 1u)) >> 16;
+	if (sector & 1)
+		x = (c * (65536 - f)) >> 16;
+	else
+		x = (c * f) >> 16;
+	m = v - c;
+
+	switch (sector) {
+	case 0: rr = c; gg = x; bb = 0; break;
+	case 1: rr = x; gg = c; bb = 0; break;
+	case 2: rr = 0; gg = c; bb = x; break;
+	case 3: rr = 0; gg = x; bb = c; break;
+	case 4: rr = x; gg = 0; bb = c; break;
+	default: rr = c; gg = 0; bb = x; break;
+	}
+	*r = ((rr + m) * 255 + 32768) >> 16;
+	*g = ((gg + m) * 255 + 32768) >> 16;
+	*b = ((bb + m) * 255 + 32768) >> 16;
+}
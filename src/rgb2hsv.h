@@ -1,3 +1,13 @@
 
 void RGBtoHSV(float fR, float fG, float fB, float *ofH, float *ofS, float *ofV);
 void HSVtoRGB(float *ofR, float *ofG, float *ofB, float fH, float fS, float fV);
+
+#include <stdint.h>
+
+// Fixed point variants for devices without FPU. Hue is in 1/128 of degree,
+// so 0 to HSV_HUE_MAX - 1, saturation and value are 0 to 65535.
+#define HSV_HUE_PER_DEGREE	128
+#define HSV_HUE_MAX			(360 * HSV_HUE_PER_DEGREE)
+
+void RGB_to_HSV_u16(uint8_t r, uint8_t g, uint8_t b, uint16_t *h, uint16_t *s, uint16_t *v);
+void HSV_to_RGB_u8(uint16_t h, uint16_t s, uint16_t v, uint8_t *r, uint8_t *g, uint8_t *b);
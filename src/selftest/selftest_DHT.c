@@ -1,8 +1,43 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_dht_internal.h"
+
+// falling edge times of frame with response pulse, as capture ISR has them
+static int Test_DHT_MakeEdges(uint32_t *edges, const byte *frame) {
+	uint32_t t = 1000;
+	int i, n = 0;
+
+	edges[n++] = t;
+	t += 160;
+	for (i = 0; i < 40; i++) {
+		edges[n++] = t;
+		t += (frame[i / 8] & (0x80 >> (i % 8))) ? 120 : 77;
+	}
+	edges[n++] = t;
+	return n;
+}
+static void Test_DHT_Decode() {
+	const byte frame[5] = { 0x02, 0x8C, 0x01, 0x5F, 0xEE };
+	uint32_t edges[DHT_MAX_EDGES];
+	byte data[5];
+	int n;
+
+	n = Test_DHT_MakeEdges(edges, frame);
+	SELFTEST_ASSERT(DHT_DecodeEdges(edges, n, data));
+	SELFTEST_ASSERT(memcmp(data, frame, 5) == 0);
+	// response edge may come before interrupt is armed
+	SELFTEST_ASSERT(DHT_DecodeEdges(edges + 1, n - 1, data));
+	SELFTEST_ASSERT(memcmp(data, frame, 5) == 0);
+	SELFTEST_ASSERT(DHT_DecodeEdges(edges, n - 2, data) == false);
+	// missed edge makes a too long bit
+	edges[20] = edges[21];
+	SELFTEST_ASSERT(DHT_DecodeEdges(edges, n, data) == false);
+}
 
 void Test_DHT() {
+	Test_DHT_Decode();
+
 	// reset whole device
 	SIM_ClearOBK(0);
 
@@ -0,0 +1,136 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../assets/obk_assets.h"
+#include "../hal/hal_ota.h"
+
+#if ENABLE_ASSETS
+
+static byte g_testImage[1024];
+
+static void Test_Assets_PutU32(byte *p, unsigned int v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+// same layout as scripts/mkassets.py makes, names must be sorted
+static int Test_Assets_Build(const char **names, const char **bodies, const int *sizes, int count) {
+	byte *entry;
+	int i, at;
+
+	memset(g_testImage, 0, sizeof(g_testImage));
+	at = 16 + count * (ASSETS_NAME_SIZE + 12);
+	for (i = 0; i < count; i++) {
+		at = (at + 3) & ~3;
+		entry = g_testImage + 16 + i * (ASSETS_NAME_SIZE + 12);
+		strcpy((char*)entry, names[i]);
+		Test_Assets_PutU32(entry + ASSETS_NAME_SIZE, at);
+		Test_Assets_PutU32(entry + ASSETS_NAME_SIZE + 4, sizes[i]);
+		Test_Assets_PutU32(entry + ASSETS_NAME_SIZE + 8, OTA_CRC32(0, (const byte*)bodies[i], sizes[i]));
+		memcpy(g_testImage + at, bodies[i], sizes[i]);
+		at += sizes[i];
+	}
+	memcpy(g_testImage, "OBKA", 4);
+	g_testImage[4] = 1;
+	g_testImage[6] = count;
+	Test_Assets_PutU32(g_testImage + 8, at);
+	Test_Assets_PutU32(g_testImage + 12, OTA_CRC32(0, g_testImage + 16, count * (ASSETS_NAME_SIZE + 12)));
+	return at;
+}
+// as POST handler does it, fake HTTP client can not send binary body
+static int Test_Assets_Upload(int len, int step) {
+	int pos, part;
+
+	SELFTEST_ASSERT(Assets_WriteBegin() >= len);
+	for (pos = 0; pos < len; pos += part) {
+		part = len - pos;
+		if (part > step) {
+			part = step;
+		}
+		SELFTEST_ASSERT(Assets_WriteChunk(pos, g_testImage + pos, part) == 0);
+		// nothing is served while image is written
+		SELFTEST_ASSERT(Assets_GetCount() == 0);
+	}
+	return Assets_WriteEnd(true);
+}
+
+void Test_Assets() {
+	const char *names[] = { "app.js", "index.html.gz", "util.be" };
+	const char *bodies[] = {
+		"function hello(){return 42;}",
+		"\x1f\x8b\x08\x08gzipdata",
+		"util = module('util')\nutil.twice = def(n) return n * 2 end\nreturn util\n"
+	};
+	int sizes[3];
+	obkAsset_t a;
+	byte tmp[8];
+	const char *etag;
+	char hdr[128];
+	int i, len;
+
+	SIM_ClearOBK(0);
+	for (i = 0; i < 3; i++) {
+		sizes[i] = strlen(bodies[i]);
+	}
+	len = Test_Assets_Build(names, bodies, sizes, 3);
+	SELFTEST_ASSERT(Test_Assets_Upload(len, 7) == 3);
+	SELFTEST_ASSERT(Assets_IsMapped());
+	SELFTEST_ASSERT(Assets_Find("/util.be", &a));
+	SELFTEST_ASSERT(a.size == sizes[2]);
+	SELFTEST_ASSERT((a.offset & 3) == 0);
+	SELFTEST_ASSERT(Assets_Read(&a, a.size - 4, tmp, sizeof(tmp)) == 4);
+	SELFTEST_ASSERT(!memcmp(tmp, "til\n", 4));
+	SELFTEST_ASSERT(Assets_Find("util", &a) == false);
+	SELFTEST_ASSERT(Assets_Find("zzz", &a) == false);
+
+	Test_FakeHTTPClientPacket_JSON("api/assets");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "files", 3);
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("{\"name\":\"index.html.gz\",\"size\":12}");
+
+	Test_FakeHTTPClientPacket_GET("api/assets/app.js");
+	SELFTEST_ASSERT_HTML_REPLY(bodies[0]);
+	// gzipped file is served for name without .gz
+	Test_FakeHTTPClientPacket_GET("api/assets/index.html?x=1");
+	SELFTEST_ASSERT_HTML_REPLY(bodies[1]);
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReplyHeaders(), "Content-Encoding: gzip") != 0);
+	SELFTEST_ASSERT(strstr(Test_GetLastHTMLReplyHeaders(), "text/html") != 0);
+
+	// browser asks again with cached ETag
+	Test_FakeHTTPClientPacket_GET("api/assets/app.js");
+	etag = strstr(Test_GetLastHTMLReplyHeaders(), "ETag: ");
+	SELFTEST_ASSERT(etag != 0);
+	strcpy(hdr, "If-None-Match: ");
+	strncat(hdr, etag + 6, strcspn(etag + 6, "\r"));
+	Test_FakeHTTPClientPacket_GET_WithHeader("api/assets/app.js", hdr);
+	SELFTEST_ASSERT(!strncmp(Test_GetLastHTMLReplyHeaders(), "HTTP/1.1 304", 12));
+
+	Test_FakeHTTPClientPacket_GET("api/assets/missing.txt");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("404");
+
+#if ENABLE_OBK_BERRY
+	// Berry imports module from assets when it is not in LittleFS
+	CMD_ExecuteCommand("berry import util; setChannel(4, util.twice(21))", 0);
+	SELFTEST_ASSERT_CHANNEL(4, 42);
+#endif
+
+	// broken upload leaves no image
+	SELFTEST_ASSERT(Assets_WriteBegin() > 0);
+	SELFTEST_ASSERT(Assets_WriteChunk(0, g_testImage, 20) == 0);
+	SELFTEST_ASSERT(Assets_WriteEnd(false) == 0);
+	SELFTEST_ASSERT(Assets_Find("app.js", &a) == false);
+
+	// text is not an image
+	Test_FakeHTTPClientPacket_POST("api/assets", "not an asset image");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("not valid");
+	SELFTEST_ASSERT(Assets_GetCount() == 0);
+
+	// image with one bad index byte is refused
+	len = Test_Assets_Build(names, bodies, sizes, 3);
+	g_testImage[16 + 2]++;
+	SELFTEST_ASSERT(Test_Assets_Upload(len, 512) == 0);
+}
+
+#endif
+
+#endif
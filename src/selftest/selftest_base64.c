@@ -0,0 +1,73 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../base64/base64.h"
+
+static void Test_Base64_Text(const char *text, const char *encoded) {
+	unsigned char out[64];
+	char *enc;
+
+	enc = b64_encode((const unsigned char*)text, strlen(text));
+	SELFTEST_ASSERT(enc && !strcmp(enc, encoded));
+	free(enc);
+	memset(out, 0, sizeof(out));
+	SELFTEST_ASSERT(b64_decode(encoded, out, sizeof(out)));
+	SELFTEST_ASSERT(!strcmp((const char*)out, text));
+}
+void Test_Base64() {
+	static unsigned char data[300];
+	static unsigned char out[300 + 8];
+	b64_stream_t s;
+	char *enc;
+	int i, len, step, at, n, total;
+
+	Test_Base64_Text("f", "Zg==");
+	Test_Base64_Text("fo", "Zm8=");
+	Test_Base64_Text("foo", "Zm9v");
+	Test_Base64_Text("foob", "Zm9vYg==");
+	Test_Base64_Text("admin:pass", "YWRtaW46cGFzcw==");
+	SELFTEST_ASSERT(b64_encode(data, 0) == 0);
+	SELFTEST_ASSERT(!b64_decode("Zm9", out, sizeof(out)));
+	SELFTEST_ASSERT(!b64_decode("Zm=v", out, sizeof(out)));
+	SELFTEST_ASSERT(!b64_decode("Zg==Zm9v", out, sizeof(out)));
+	SELFTEST_ASSERT(!b64_decode("Zm9v*A==", out, sizeof(out)));
+	SELFTEST_ASSERT(!b64_decode("Zm9vYg==", out, 3));
+	SELFTEST_ASSERT(b64_isvalidchar('+') && b64_isvalidchar('=') && !b64_isvalidchar('-'));
+
+	for (i = 0; i < (int)sizeof(data); i++) {
+		data[i] = (unsigned char)rand();
+	}
+	// every length of tail, decoded whole and in parts of every size
+	for (len = 1; len < 40; len++) {
+		enc = b64_encode(data, len);
+		SELFTEST_ASSERT(b64_decoded_size(enc) == (size_t)len);
+		SELFTEST_ASSERT(b64_decode(enc, out, len));
+		SELFTEST_ASSERT(!memcmp(out, data, len));
+		for (step = 1; step < 9; step++) {
+			b64_decode_begin(&s);
+			total = 0;
+			for (at = 0; enc[at]; at += n) {
+				n = strlen(enc + at) < (size_t)step ? (int)strlen(enc + at) : step;
+				total += b64_decode_update(&s, enc + at, n, out + total);
+			}
+			total += b64_decode_finish(&s, out + total);
+			SELFTEST_ASSERT(total == len);
+			SELFTEST_ASSERT(!memcmp(out, data, len));
+		}
+		free(enc);
+	}
+	// body with line breaks and without padding
+	b64_decode_begin(&s);
+	total = b64_decode_update(&s, "Zm9v\r\nYmFy\r\nYg", 14, out);
+	total += b64_decode_finish(&s, out + total);
+	SELFTEST_ASSERT(total == 7 && !memcmp(out, "foobarb", 7));
+	// nothing but padding after padding
+	b64_decode_begin(&s);
+	SELFTEST_ASSERT(b64_decode_update(&s, "Zg==Zg==", 8, out) < 0);
+	SELFTEST_ASSERT(b64_decode_finish(&s, out) < 0);
+	b64_decode_begin(&s);
+	SELFTEST_ASSERT(b64_decode_update(&s, "Zm9vY", 5, out) == 3);
+	SELFTEST_ASSERT(b64_decode_finish(&s, out) < 0);
+}
+
+#endif
@@ -2,6 +2,7 @@
 
 #include "selftest_local.h"
 #include "../driver/drv_battery.h"
+#include "../driver/drv_public.h"
 
 // P23 is ADC, it is connected to two resistors, both 1k,
 // one is connected to P26, second to VDD
@@ -42,8 +43,23 @@ void Test_Battery_SmokeSensor() {
 	// assert: current ,expected, max difference
 	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(Battery_lastreading(OBK_BATT_LEVEL), 0, 5.0f);
 }
+// burst filter used for ADC reads drops lone spikes
+void Test_Battery_ADCSampler() {
+	const unsigned short spike[8] = { 1000, 1002, 4095, 998, 1001, 0, 1000, 999 };
+	const unsigned short ramp[5] = { 100, 200, 300, 400, 500 };
+	const unsigned short two[2] = { 10, 13 };
+
+	SELFTEST_ASSERT(ADCSampler_Filter(spike, 8) == 1000);
+	SELFTEST_ASSERT(ADCSampler_Filter(ramp, 5) == 300);
+	SELFTEST_ASSERT(ADCSampler_Filter(two, 2) == 12);
+	SELFTEST_ASSERT(ADCSampler_Filter(two, 0) == 0);
+
+	SIM_SetIntegerValueADCPin(23, 1714);
+	SELFTEST_ASSERT(ADCSampler_Read(23) == 1714);
+}
 void Test_Battery() {
 	Test_Battery_SmokeSensor();
+	Test_Battery_ADCSampler();
 
 }
 
@@ -0,0 +1,246 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../httpserver/new_http.h"
+#include "../logging/logging.h"
+#include "../mqtt/new_mqtt.h"
+#if !LINUX && defined(_DEBUG)
+#include <crtdbg.h>
+#endif
+
+// Micro-benchmarks of hot paths, see SELFBENCH. There are no limits here,
+// times depend on machine; results go to selfbench.json, so they can be
+// compared between releases. Allocations are counted on Linux without
+// ASAN and in MSVC debug build, elsewhere they are reported as null.
+
+#define SELFBENCH_WARMUP		16
+#define SELFBENCH_MIN_NS		2000000
+#define SELFBENCH_MAX_REPS		1000000
+#define SELFBENCH_ROUNDS		3
+#define SELFBENCH_MAX_RESULTS	32
+
+enum {
+	SELFBENCH_PHASE_WARMUP,
+	SELFBENCH_PHASE_CALIBRATE,
+	SELFBENCH_PHASE_MEASURE,
+};
+
+typedef struct selfBenchResult_s {
+	const char *name;
+	double nsPerOp;
+	// -1 when allocations are not counted
+	double allocsPerOp;
+	long long ops;
+} selfBenchResult_t;
+
+static selfBenchResult_t g_benchResults[SELFBENCH_MAX_RESULTS];
+static int g_numBenchResults = 0;
+static unsigned int g_benchAllocs = 0;
+
+#if LINUX && !defined(__SANITIZE_ADDRESS__)
+#define SELFBENCH_COUNT_ALLOCS 1
+// glibc lets program replace its allocator, these count and pass on
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void __libc_free(void *p);
+
+void *malloc(size_t size) {
+	g_benchAllocs++;
+	return __libc_malloc(size);
+}
+void *calloc(size_t count, size_t size) {
+	g_benchAllocs++;
+	return __libc_calloc(count, size);
+}
+void *realloc(void *p, size_t size) {
+	g_benchAllocs++;
+	return __libc_realloc(p, size);
+}
+void free(void *p) {
+	__libc_free(p);
+}
+#elif !LINUX && defined(_DEBUG)
+#define SELFBENCH_COUNT_ALLOCS 1
+static int SelfBench_AllocHook(int type, void *p, size_t size, int blockType, long request, const unsigned char *file, int line) {
+	if (type == _HOOK_ALLOC || type == _HOOK_REALLOC) {
+		g_benchAllocs++;
+	}
+	return 1;
+}
+#else
+#define SELFBENCH_COUNT_ALLOCS 0
+#endif
+
+static long long SelfBench_NowNS() {
+#if LINUX
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (long long)((double)now.QuadPart * 1e9 / freq.QuadPart);
+#endif
+}
+
+void SelfBench_Begin(selfBench_t *b, const char *name) {
+#if SELFBENCH_COUNT_ALLOCS && !LINUX
+	static bool bHooked = false;
+
+	if (!bHooked) {
+		_CrtSetAllocHook(SelfBench_AllocHook);
+		bHooked = true;
+	}
+#endif
+	memset(b, 0, sizeof(*b));
+	b->name = name;
+	b->phase = SELFBENCH_PHASE_WARMUP;
+	b->left = SELFBENCH_WARMUP;
+	b->start = SelfBench_NowNS();
+}
+static void SelfBench_Report(selfBench_t *b) {
+	selfBenchResult_t *r;
+	long long ops = (long long)b->reps * SELFBENCH_ROUNDS;
+
+	if (g_numBenchResults >= SELFBENCH_MAX_RESULTS) {
+		return;
+	}
+	r = &g_benchResults[g_numBenchResults++];
+	r->name = b->name;
+	r->nsPerOp = (double)b->best / b->reps;
+	r->allocsPerOp = SELFBENCH_COUNT_ALLOCS ? (double)b->allocs / ops : -1;
+	r->ops = ops;
+	printf("SelfBench: %-36s %12.1f ns/op %8.2f allocs/op\n", r->name, r->nsPerOp, r->allocsPerOp);
+}
+// called when a batch is done, returns false when measurement is over
+bool SelfBench_Batch(selfBench_t *b) {
+	long long took = SelfBench_NowNS() - b->start;
+
+	switch (b->phase) {
+	case SELFBENCH_PHASE_WARMUP:
+		b->phase = SELFBENCH_PHASE_CALIBRATE;
+		b->reps = 1;
+		break;
+	case SELFBENCH_PHASE_CALIBRATE:
+		// how many ops fill SELFBENCH_MIN_NS
+		if (took < SELFBENCH_MIN_NS && b->reps < SELFBENCH_MAX_REPS) {
+			b->reps *= 2;
+			break;
+		}
+		b->phase = SELFBENCH_PHASE_MEASURE;
+		b->round = 0;
+		break;
+	default:
+		if (b->round == 0 || took < b->best) {
+			b->best = took;
+		}
+		b->allocs += g_benchAllocs - b->allocStart;
+		b->round++;
+		if (b->round >= SELFBENCH_ROUNDS) {
+			SelfBench_Report(b);
+			return false;
+		}
+		break;
+	}
+	// this call runs first op of next batch
+	b->left = b->reps - 1;
+	b->allocStart = g_benchAllocs;
+	b->start = SelfBench_NowNS();
+	return true;
+}
+void SelfBench_WriteJSON(const char *fileName) {
+	selfBenchResult_t *r;
+	FILE *f;
+	int i;
+
+	f = fopen(fileName, "w");
+	if (f == 0) {
+		printf("SelfBench: can't write %s\n", fileName);
+		return;
+	}
+	fprintf(f, "{\"version\":\"%s\",\"platform\":\"%s\",\"benchmarks\":[", USER_SW_VER, PLATFORM_MCU_NAME);
+	for (i = 0; i < g_numBenchResults; i++) {
+		r = &g_benchResults[i];
+		fprintf(f, "%s\n{\"name\":\"%s\",\"ns_per_op\":%.1f,\"ops\":%lld,\"allocs_per_op\":", i ? "," : "", r->name, r->nsPerOp, r->ops);
+		if (r->allocsPerOp < 0) {
+			fprintf(f, "null}");
+		}
+		else {
+			fprintf(f, "%.2f}", r->allocsPerOp);
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+}
+
+void SIM_ClearAndPrepareForMQTTTesting(const char *clientName, const char *groupName);
+
+static char g_benchHTTPIn[1024];
+static char g_benchHTTPOut[32768];
+
+void Test_SelfBench() {
+	selfBench_t b;
+	http_request_t request;
+	int saveLogLevel;
+	int len, first;
+	float f = 0;
+
+	SIM_ClearAndPrepareForMQTTTesting("benchDev", "benchGroup");
+	CMD_ExecuteCommand("setChannel 2 7", 0);
+	// ops log, but printing is not what is measured
+	saveLogLevel = g_loglevel;
+	g_loglevel = LOG_ERROR;
+	first = g_numBenchResults;
+
+	// channel keeps value, so no change handlers and publishes run
+	SELFBENCH(b, "CMD_ExecuteCommand setChannel") {
+		CMD_ExecuteCommand("setChannel 1 5", 0);
+	}
+	SELFBENCH(b, "CMD_EvaluateExpression") {
+		f += CMD_EvaluateExpression("$CH2*2+(10-$CH1)/4", 0);
+	}
+	SELFBENCH(b, "Tokenizer_TokenizeString") {
+		Tokenizer_TokenizeString("addRepeatingEvent 5 -1 setChannel 1 $CH2+1", 0);
+	}
+	SELFBENCH(b, "MQTT_Post_Received+process_received") {
+		MQTT_Post_Received_Str("cmnd/benchDev/setChannel", "1 5");
+		MQTT_process_received();
+	}
+	// request is parsed in place, so copying it is part of op
+	snprintf(g_benchHTTPIn, sizeof(g_benchHTTPIn), "GET /index HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: */*\r\n\r\n");
+	len = strlen(g_benchHTTPIn);
+	SELFBENCH(b, "HTTP_ProcessPacket index") {
+		char in[sizeof(g_benchHTTPIn)];
+
+		memcpy(in, g_benchHTTPIn, len + 1);
+		memset(&request, 0, sizeof(request));
+		request.received = in;
+		request.receivedLen = len;
+		request.reply = g_benchHTTPOut;
+		request.replymaxlen = sizeof(g_benchHTTPOut);
+		HTTP_ProcessPacket(&request);
+	}
+	// whole config is checksummed on every save
+	SELFBENCH(b, "Tiny_CRC8 mainConfig_t") {
+		f += Tiny_CRC8((const char*)&g_cfg, sizeof(g_cfg));
+	}
+	// DEBUG is above level set, so line is only filtered
+	SELFBENCH(b, "addLogAdv filtered") {
+		addLogAdv(LOG_DEBUG, LOG_FEATURE_GENERAL, "bench %i %s", 5, "text");
+	}
+
+	g_loglevel = saveLogLevel;
+	SELFTEST_ASSERT(f != 0);
+	SELFTEST_ASSERT(g_numBenchResults == first + 7);
+	SELFTEST_ASSERT_CHANNEL(1, 5);
+}
+
+#endif
@@ -1,6 +1,9 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../berry/be_arena.h"
+#include "../berry/be_async.h"
+#include "../berry/be_run.h"
 
 
 void Test_Berry_VarLifeSpan() {
@@ -537,9 +540,20 @@ void Test_Berry_StartScriptShortcut2() {
 		"addChannel(5,1);\n");
 	CMD_ExecuteCommand("startScript test.be", 0);
 	SELFTEST_ASSERT_CHANNEL(5, 1);
-	// wont work
-	//CMD_ExecuteCommand("startScript test.be", 0);
-	//SELFTEST_ASSERT_CHANNEL(5, 2);
+	// compiled bytecode is kept next to the source
+	byte *cached = LFS_ReadFile("test.bec");
+	SELFTEST_ASSERT(cached != 0);
+	free(cached);
+	// second start runs from cached bytecode
+	CMD_ExecuteCommand("startScript test.be", 0);
+	SELFTEST_ASSERT_CHANNEL(5, 2);
+	// editing the source invalidates the cache
+	Test_FakeHTTPClientPacket_POST("api/lfs/test.be",
+		"addChannel(5,10);\n");
+	CMD_ExecuteCommand("startScript test.be", 0);
+	SELFTEST_ASSERT_CHANNEL(5, 12);
+	CMD_ExecuteCommand("startScript test.be", 0);
+	SELFTEST_ASSERT_CHANNEL(5, 22);
 
 }
 
@@ -1220,8 +1234,29 @@ void Test_Berry_HTTP2() {
 			"<h1>Hello hey</h1>"
 			"</body>"
 			"</html>";
+		berryCacheStats_t st, st2;
 		Test_FakeHTTPClientPacket_GET("api/run/indexb.html?arg=hey");
 		SELFTEST_ASSERT_HTML_REPLY(test1_res);
+		// second request calls closure kept in VM, page is not compiled again
+		berryGetCacheStats(&st);
+		Test_FakeHTTPClientPacket_GET("api/run/indexb.html?arg=hey");
+		SELFTEST_ASSERT_HTML_REPLY(test1_res);
+		berryGetCacheStats(&st2);
+		SELFTEST_ASSERT(st2.hits == st.hits + 1);
+		SELFTEST_ASSERT(st2.compiles == st.compiles);
+		// write of other file only makes it check the hash
+		CMD_ExecuteCommand("lfs_write other.txt x", 0);
+		Test_FakeHTTPClientPacket_GET("api/run/indexb.html?arg=hey");
+		SELFTEST_ASSERT_HTML_REPLY(test1_res);
+		berryGetCacheStats(&st);
+		SELFTEST_ASSERT(st.rechecked == st2.rechecked + 1);
+		SELFTEST_ASSERT(st.compiles == st2.compiles);
+		// after stopBerry, bytecode file is used
+		CMD_ExecuteCommand("stopBerry", 0);
+		Test_FakeHTTPClientPacket_GET("api/run/indexb.html?arg=hey");
+		SELFTEST_ASSERT_HTML_REPLY(test1_res);
+		berryGetCacheStats(&st2);
+		SELFTEST_ASSERT(st2.bytecodeLoads == st.bytecodeLoads + 1);
 	}
 	{
 		const char *test1 =
@@ -1425,6 +1460,13 @@ void Test_Berry_CmdHandler() {
 	CMD_ExecuteCommand("MyCmd 555.168.0.123",0);
 	SELFTEST_ASSERT_STRING("555.168.0.123", CFG_GetMQTTHost());
 
+	// named handler is a regular command now
+	SELFTEST_ASSERT(CMD_Find("MyCmd") != 0);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("MyCmd 666.168.0.123", 0) == CMD_RES_OK);
+	SELFTEST_ASSERT_STRING("666.168.0.123", CFG_GetMQTTHost());
+	// other unknown commands are still unknown
+	SELFTEST_ASSERT(CMD_ExecuteCommand("MyOtherCmd 1", 0) == CMD_RES_UNKNOWN_COMMAND);
+	SELFTEST_ASSERT_STRING("666.168.0.123", CFG_GetMQTTHost());
 
 }
 void Test_Berry_NTP() {
@@ -1523,7 +1565,107 @@ void Test_Berry_OpenWeatherMap() {
 	SELFTEST_ASSERT_CHANNEL(11, 180);
 }
 
+#if ENABLE_BERRY_ARENA
+static void Test_Berry_Arena() {
+	berryArenaStats_t st;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	CMD_ExecuteCommand("stopBerry", 0);
+	CMD_ExecuteCommand("berryArena 262144 50", 0);
+	CMD_ExecuteCommand("berry l = [] for i:0..2000 l.push(str(i)) end setChannel(1, l.size())", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 2001);
+	Berry_GetArenaStats(&st);
+	SELFTEST_ASSERT(st.size == 262144);
+	SELFTEST_ASSERT(st.allocs > 2000);
+	SELFTEST_ASSERT(st.used > 0);
+	SELFTEST_ASSERT(st.peak >= st.used);
+	SELFTEST_ASSERT(st.failed == 0);
+	// garbage is collected between ticks once arena passes the threshold
+	CMD_ExecuteCommand("berry l = nil", 0);
+	CMD_ExecuteCommand("berry for i:0..3000 l = [str(i), str(i + 1)] end setChannel(2, 1)", 0);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	Berry_RunThreads(10);
+	Berry_GetArenaStats(&st);
+	SELFTEST_ASSERT(st.used < st.peak);
+	// everything is returned when VM is deleted
+	CMD_ExecuteCommand("stopBerry", 0);
+	Berry_GetArenaStats(&st);
+	SELFTEST_ASSERT(st.used == 0);
+	SELFTEST_ASSERT(st.frees == st.allocs);
+
+	CMD_ExecuteCommand("berryArena 1048576 75", 0);
+}
+#endif
+#if ENABLE_BERRY_ASYNC
+static void Test_Berry_Async() {
+	berryAsyncStats_t st;
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("asyncTester", "bekens");
+	CMD_ExecuteCommand("lfs_format", 0);
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	CMD_ExecuteCommand("setChannel 3 0", 0);
+
+	CMD_ExecuteCommand("berry sleep_ms(100, def() setChannel(1, 5) end)", 0);
+	Berry_RunThreads(50);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	Berry_RunThreads(51);
+	SELFTEST_ASSERT_CHANNEL(1, 5);
+
+	// closure is resumed with payload, others keep waiting
+	CMD_ExecuteCommand("berry mqtt.await(\"async/reply\", 1000, def(p) setChannel(2, int(p)) end)", 0);
+	CMD_ExecuteCommand("berry mqtt.await(\"async/other\", 1000, def(p) setChannel(3, p == nil ? 7 : 8) end)", 0);
+	Berry_Async_GetStats(&st);
+	SELFTEST_ASSERT(st.waiting == 2);
+	SIM_SendFakeMQTT("async/reply", "42");
+	Berry_RunThreads(10);
+	SELFTEST_ASSERT_CHANNEL(2, 42);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+	// timeout gives nil
+	for (i = 0; i < 110; i++) {
+		Berry_RunThreads(10);
+	}
+	SELFTEST_ASSERT_CHANNEL(3, 7);
+	Berry_Async_GetStats(&st);
+	SELFTEST_ASSERT(st.waiting == 0);
+	SELFTEST_ASSERT(st.completed == 1);
+	SELFTEST_ASSERT(st.timeouts == 1);
+
+	// same topic is awaited again, chained from the closure
+	CMD_ExecuteCommand("berry def next(p) addChannel(2, int(p)) mqtt.await(\"async/reply\", 1000, next) end "
+		"mqtt.await(\"async/reply\", 1000, next)", 0);
+	SIM_SendFakeMQTT("async/reply", "1");
+	Berry_RunThreads(10);
+	SIM_SendFakeMQTT("async/reply", "2");
+	Berry_RunThreads(10);
+	SELFTEST_ASSERT_CHANNEL(2, 45);
+
+	// cancelled wait never runs
+	CMD_ExecuteCommand("berry t = mqtt.await(\"async/cancel\", 1000, def(p) setChannel(3, 99) end) cancel(t)", 0);
+	SIM_SendFakeMQTT("async/cancel", "1");
+	Berry_RunThreads(10);
+	SELFTEST_ASSERT_CHANNEL(3, 7);
+
+	// names are not resolved, that would block
+	CMD_ExecuteCommand("berry setChannel(1, tcp.connect(\"example.com\", 80, 1000, def(s) end) == nil ? 1 : 0)", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	CMD_ExecuteCommand("berry setChannel(1, tcp.send(12345, \"x\"))", 0);
+	SELFTEST_ASSERT_CHANNEL(1, -1);
+
+	CMD_ExecuteCommand("stopBerry", 0);
+	Berry_Async_GetStats(&st);
+	SELFTEST_ASSERT(st.waiting == 0);
+	SELFTEST_ASSERT(st.sockets == 0);
+}
+#endif
 void Test_Berry() {
+#if ENABLE_BERRY_ARENA
+	Test_Berry_Arena();
+#endif
 
 	Test_Berry_Click_And_Timeout();
 	Test_Berry_Click();
@@ -1560,6 +1702,9 @@ void Test_Berry() {
 	Test_Berry_NTP();
 	Test_Berry_JSON();
 	Test_Berry_OpenWeatherMap();
+#if ENABLE_BERRY_ASYNC
+	Test_Berry_Async();
+#endif
 }
 
 #endif
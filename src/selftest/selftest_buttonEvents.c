@@ -2,7 +2,97 @@
 
 #include "selftest_local.h"
 
+static void Test_ButtonEvents_ManyHandlers() {
+	char buffer[64];
+	int i;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+
+	// more handlers than dispatch buckets, so some of them share a bucket
+	for (i = 0; i < 40; i++) {
+		snprintf(buffer, sizeof(buffer), "addEventHandler OnClick %i addChannel 20 %i", i, i + 1);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	CMD_ExecuteCommand("addEventHandler OnPress 32 addChannel 21 1", 0);
+	CMD_ExecuteCommand("addEventHandler OnClick 5 addChannel 22 1", 0);
+	SELFTEST_ASSERT(EventHandlers_GetActiveCount() == 42);
+
+	// 32 shares a bucket with 0, only the exact match may run
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 32);
+	SELFTEST_ASSERT_CHANNEL(20, 33);
+	SELFTEST_ASSERT_CHANNEL(21, 0);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 0);
+	SELFTEST_ASSERT_CHANNEL(20, 34);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONPRESS, 32);
+	SELFTEST_ASSERT_CHANNEL(20, 34);
+	SELFTEST_ASSERT_CHANNEL(21, 1);
+	// both handlers for the same pin run
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 5);
+	SELFTEST_ASSERT_CHANNEL(20, 40);
+	SELFTEST_ASSERT_CHANNEL(22, 1);
+	// no handler for that one
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 41);
+	SELFTEST_ASSERT_CHANNEL(20, 40);
+
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+	SELFTEST_ASSERT(EventHandlers_GetActiveCount() == 0);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 32);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONPRESS, 32);
+	SELFTEST_ASSERT_CHANNEL(20, 40);
+	SELFTEST_ASSERT_CHANNEL(21, 1);
+
+	// handlers added after clearing are found again
+	CMD_ExecuteCommand("addEventHandler OnClick 32 addChannel 21 10", 0);
+	EventHandlers_FireEvent(CMD_EVENT_PIN_ONCLICK, 32);
+	SELFTEST_ASSERT_CHANNEL(21, 11);
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+}
+
+// input edges are queued by interrupt and replayed in PIN_ticks
+static void Test_ButtonEvents_EdgeQueue() {
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_SetSimulatedPinValue(8, false);
+	PIN_SetPinRoleForPinIndex(8, IOR_DigitalInput);
+	PIN_SetPinChannelForPinIndex(8, 5);
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(5, 0);
+	// bounce shorter than debounce time is ignored
+	SIM_SetSimulatedPinValue(8, true);
+	Sim_RunFrames(5, false);
+	SIM_SetSimulatedPinValue(8, false);
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(5, 0);
+	// more edges than queue can hold, level gets read again
+	for (i = 0; i < 201; i++) {
+		SIM_SetSimulatedPinValue(8, (i % 2) == 0);
+	}
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(5, 1);
+	SIM_SetSimulatedPinValue(8, false);
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(5, 0);
+
+	// toggle input follows edges too
+	SIM_SetSimulatedPinValue(7, true);
+	PIN_SetPinRoleForPinIndex(7, IOR_ToggleChannelOnToggle);
+	PIN_SetPinChannelForPinIndex(7, 6);
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(6, 0);
+	SIM_SetSimulatedPinValue(7, false);
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(6, 1);
+	SIM_SetSimulatedPinValue(7, true);
+	Sim_RunFrames(50, false);
+	SELFTEST_ASSERT_CHANNEL(6, 0);
+}
+
 void Test_ButtonEvents() {
+	Test_ButtonEvents_ManyHandlers();
+	Test_ButtonEvents_EdgeQueue();
+
 	// reset whole device
 	SIM_ClearOBK(0);
 
@@ -0,0 +1,73 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_txw81x_frames.h"
+
+// encoder frames are just numbers here
+static int g_camTestFrames[8];
+static int g_camTestReleased[8];
+
+static void Test_CamFrames_Release(void* data) {
+	g_camTestReleased[(int*)data - g_camTestFrames]++;
+}
+
+void Test_CamFrames() {
+	camFrame_t *a, *b, *c, *s;
+	int i;
+
+	memset(g_camTestReleased, 0, sizeof(g_camTestReleased));
+	TXW_CamFrames_Init(Test_CamFrames_Release);
+	SELFTEST_ASSERT(TXW_CamFrames_Get(0) == 0);
+
+	// client gets newest frame once
+	SELFTEST_ASSERT(TXW_CamFrames_Publish(&g_camTestFrames[0], 100));
+	a = TXW_CamFrames_Get(0);
+	SELFTEST_ASSERT(a && a->data == &g_camTestFrames[0]);
+	SELFTEST_ASSERT(a->len == 100 && a->seq == 1);
+	SELFTEST_ASSERT(TXW_CamFrames_Get(a->seq) == 0);
+
+	// frame being sent stays until it is put back, newer ones that nobody
+	// took are released as soon as something newer comes
+	SELFTEST_ASSERT(TXW_CamFrames_Publish(&g_camTestFrames[1], 200));
+	SELFTEST_ASSERT(TXW_CamFrames_Publish(&g_camTestFrames[2], 300));
+	SELFTEST_ASSERT(g_camTestReleased[0] == 0);
+	SELFTEST_ASSERT(g_camTestReleased[1] == 1);
+	b = TXW_CamFrames_Get(a->seq);
+	SELFTEST_ASSERT(b && b->data == &g_camTestFrames[2] && b->seq == 3);
+	// slow client skipped one
+	SELFTEST_ASSERT(TXW_CamFrames_Skipped(a->seq, b->seq) == 1);
+	SELFTEST_ASSERT(TXW_CamFrames_Skipped(0, b->seq) == 0);
+	SELFTEST_ASSERT(TXW_CamFrames_Skipped(2, b->seq) == 0);
+	TXW_CamFrames_Put(a);
+	SELFTEST_ASSERT(g_camTestReleased[0] == 1);
+	// newest one is kept for snapshot even when nobody sends it
+	TXW_CamFrames_Put(b);
+	SELFTEST_ASSERT(g_camTestReleased[2] == 0);
+	s = TXW_CamFrames_Get(0);
+	SELFTEST_ASSERT(s == b && s->refs == 1);
+
+	// two streams and a snapshot hold frames, one more slot is newest, then
+	// encoder frame is not taken
+	SELFTEST_ASSERT(TXW_CamFrames_Publish(&g_camTestFrames[3], 400));
+	a = TXW_CamFrames_Get(s->seq);
+	SELFTEST_ASSERT(TXW_CamFrames_Publish(&g_camTestFrames[4], 500));
+	c = TXW_CamFrames_Get(a->seq);
+	SELFTEST_ASSERT(c && c->data == &g_camTestFrames[4]);
+	SELFTEST_ASSERT(TXW_CamFrames_Publish(&g_camTestFrames[5], 600));
+	SELFTEST_ASSERT(!TXW_CamFrames_Publish(&g_camTestFrames[6], 700));
+	SELFTEST_ASSERT(g_camTestReleased[6] == 0);
+	// and it is newest one, not a held one, that is given next
+	b = TXW_CamFrames_Get(c->seq);
+	SELFTEST_ASSERT(b && b->data == &g_camTestFrames[5]);
+	TXW_CamFrames_Put(b);
+	TXW_CamFrames_Put(s);
+	TXW_CamFrames_Put(a);
+	TXW_CamFrames_Put(c);
+	SELFTEST_ASSERT(TXW_CamFrames_Publish(&g_camTestFrames[7], 800));
+	for (i = 0; i < 6; i++) {
+		SELFTEST_ASSERT(g_camTestReleased[i] == 1);
+	}
+	SELFTEST_ASSERT(g_camTestReleased[7] == 0);
+}
+
+#endif
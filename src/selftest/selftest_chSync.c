@@ -0,0 +1,77 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_local.h"
+
+#if ENABLE_DRIVER_CHSYNC
+
+static void Test_ChSync_Send(const char *name, int flags, int seq, int ch, int value) {
+	byte buffer[64];
+	int len;
+
+	len = ChSync_Format(buffer, sizeof(buffer), name, flags, seq, &ch, &value, 1);
+	ChSync_ProcessPacket(buffer, len);
+}
+
+void Test_ChSync() {
+	byte buffer[64];
+	int chs[3] = { 5, 6, 7 };
+	int vals[3] = { 300, -2, 9 };
+	int len;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver ChSync dev1", 0);
+	CMD_ExecuteCommand("ChSync_Subscribe kitchen 5 10", 0);
+	CMD_ExecuteCommand("ChSync_Subscribe kitchen 6 11", 0);
+	CMD_ExecuteCommand("setChannel 1 3", 0);
+	CMD_ExecuteCommand("ChSync_Publish 1 2", 0);
+
+	// all published go out together at first
+	DRV_ChSync_RunQuickTick();
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("ChSync dev1: sent 1 packets (2 values)");
+	// then only ones that changed
+	CMD_ExecuteCommand("setChannel 1 7", 0);
+	CMD_ExecuteCommand("setChannel 3 7", 0);
+	DRV_ChSync_RunQuickTick();
+	DRV_ChSync_RunQuickTick();
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("sent 2 packets (3 values)");
+
+	len = ChSync_Format(buffer, sizeof(buffer), "kitchen", 0, 1, chs, vals, 3);
+	ChSync_ProcessPacket(buffer, len);
+	SELFTEST_ASSERT_CHANNEL(10, 300);
+	SELFTEST_ASSERT_CHANNEL(11, -2);
+	SELFTEST_ASSERT_CHANNEL(7, 0);
+	// same sequence again is ignored
+	Test_ChSync_Send("kitchen", 0, 1, 5, 1);
+	SELFTEST_ASSERT_CHANNEL(10, 300);
+	Test_ChSync_Send("kitchen", 0, 2, 5, 70000);
+	SELFTEST_ASSERT_CHANNEL(10, 70000);
+	Test_ChSync_Send("kitchen", 0, 3, 5, -100000000);
+	SELFTEST_ASSERT_CHANNEL(10, -100000000);
+	// other senders do not count
+	Test_ChSync_Send("hall", 0, 9, 5, 4);
+	SELFTEST_ASSERT_CHANNEL(10, -100000000);
+	// sender that started again sends full refresh
+	Test_ChSync_Send("kitchen", 1, 1, 5, 12);
+	SELFTEST_ASSERT_CHANNEL(10, 12);
+	// our own packet back from multicast
+	CMD_ExecuteCommand("ChSync_Subscribe dev1 1 12", 0);
+	Test_ChSync_Send("dev1", 0, 77, 1, 5);
+	SELFTEST_ASSERT_CHANNEL(12, 0);
+
+	// value that came is not sent on again
+	CMD_ExecuteCommand("ChSync_Publish 10", 0);
+	DRV_ChSync_RunQuickTick();
+	Test_ChSync_Send("kitchen", 0, 2, 5, 13);
+	Test_ChSync_Send("kitchen", 0, 3, 5, 14);
+	SELFTEST_ASSERT_CHANNEL(10, 14);
+	DRV_ChSync_RunQuickTick();
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("sent 3 packets (6 values), received 8 (7 values applied, 1 old)");
+}
+
+#endif
+
+#endif
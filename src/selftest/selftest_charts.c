@@ -0,0 +1,168 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../littlefs/our_lfs.h"
+
+#if ENABLE_DRIVER_CHARTS
+
+static int Test_Charts_U16(int at) {
+	const byte *p = (const byte*)Test_GetLastHTMLReply() + at;
+	return p[0] | (p[1] << 8);
+}
+static unsigned int Test_Charts_U32(int at) {
+	return Test_Charts_U16(at) | ((unsigned int)Test_Charts_U16(at + 2) << 16);
+}
+static float Test_Charts_F32(int at) {
+	unsigned int bits = Test_Charts_U32(at);
+	float f;
+
+	memcpy(&f, &bits, 4);
+	return f;
+}
+// value of sample of var from api/chart reply
+static float Test_Charts_Value(int var, int sample) {
+	int vars = ((const byte*)Test_GetLastHTMLReply())[5];
+	int count = Test_Charts_U16(6);
+	short q = (short)Test_Charts_U16(8 + vars * 4 + count * 4 + (var * count + sample) * 2);
+
+	return q * Test_Charts_F32(8 + var * 4);
+}
+
+void Test_Charts() {
+	char tmp[64];
+	int i;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver Charts", 0);
+	CMD_ExecuteCommand("chart_create 200 2 2", 0);
+	CMD_ExecuteCommand("chart_setVar 0 \"Temperature\" \"axtemp\"", 0);
+	CMD_ExecuteCommand("chart_setVar 1 \"Power\" \"axpower\"", 0);
+	CMD_ExecuteCommand("chart_setAxis 0 \"axtemp\" 0 \"Temperature (C)\"", 0);
+	CMD_ExecuteCommand("chart_setAxis 1 \"axpower\" 1 \"Power (W)\"", 0);
+	CMD_ExecuteCommand("chart_add 1725606094 21.37 5", 0);
+	// do not fit into 0.01 steps, power column goes to 0.1 W, then to 1 W
+	CMD_ExecuteCommand("chart_add 1725606104 -3.5 1200", 0);
+	CMD_ExecuteCommand("chart_add 1725606114 22 30000.4", 0);
+
+	// page has setup only, samples come separately
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("fetch('/api/chart/0?points='");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("label: 'Power'");
+	SELFTEST_ASSERT_HTML_REPLY_NOT_CONTAINS("chartdata0");
+
+	Test_FakeHTTPClientPacket_GET("api/chart/0");
+	SELFTEST_ASSERT(!strncmp(Test_GetLastHTMLReply(), "OBKC", 4));
+	SELFTEST_ASSERT(Test_GetLastHTMLReply()[4] == 1);
+	SELFTEST_ASSERT(Test_GetLastHTMLReply()[5] == 2);
+	SELFTEST_ASSERT(Test_Charts_U16(6) == 3);
+	SELFTEST_ASSERT(Test_Charts_U32(16) == 1725606094);
+	SELFTEST_ASSERT(Test_Charts_U32(24) == 1725606114);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(0, 0), 21.37f);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(0, 1), -3.5f);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(1, 0), 5);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(1, 1), 1200);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(1, 2), 30000);
+
+	// flat line with one spike, spike must stay when downsampled
+	CMD_ExecuteCommand("chart_create 200 1 1", 0);
+	CMD_ExecuteCommand("chart_setVar 0 \"T\" \"ax\"", 0);
+	CMD_ExecuteCommand("chart_setAxis 0 \"ax\" 0 \"T\"", 0);
+	for (i = 0; i < 150; i++) {
+		snprintf(tmp, sizeof(tmp), "chart_add %i %i", 1000 + i * 10, i == 77 ? 90 : 20);
+		CMD_ExecuteCommand(tmp, 0);
+	}
+	Test_FakeHTTPClientPacket_GET("api/chart/0?points=20");
+	SELFTEST_ASSERT(Test_Charts_U16(6) == 20);
+	SELFTEST_ASSERT(Test_Charts_U32(12) == 1000);
+	SELFTEST_ASSERT(Test_Charts_U32(12 + 19 * 4) == 1000 + 149 * 10);
+	for (i = 0; i < 20; i++) {
+		if (Test_Charts_U32(12 + i * 4) == 1770) {
+			break;
+		}
+	}
+	SELFTEST_ASSERT(i < 20);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(0, i), 90);
+	// more points than samples gives all of them
+	Test_FakeHTTPClientPacket_GET("api/chart/0?points=400");
+	SELFTEST_ASSERT(Test_Charts_U16(6) == 150);
+
+	Test_FakeHTTPClientPacket_GET("api/chart/1");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("no chart");
+}
+
+#if ENABLE_LITTLEFS
+static void Test_Charts_Create() {
+	CMD_ExecuteCommand("chart_create 8 2 1", 0);
+	CMD_ExecuteCommand("chart_setVar 0 \"T\" \"ax\"", 0);
+	CMD_ExecuteCommand("chart_setVar 1 \"P\" \"ax\"", 0);
+	CMD_ExecuteCommand("chart_setAxis 0 \"ax\" 0 \"T\"", 0);
+}
+static void Test_Charts_Add(int from, int to) {
+	char tmp[64];
+
+	for (; from < to; from++) {
+		snprintf(tmp, sizeof(tmp), "chart_add %i %i.5 %i", 1000 + from, from, from * 100);
+		CMD_ExecuteCommand(tmp, 0);
+	}
+}
+// as after reboot, chart is made again and gets samples from file
+static void Test_Charts_Reboot() {
+	Test_Charts_Create();
+	CMD_ExecuteCommand("chart_persist chart.bin 10", 0);
+}
+
+void Test_Charts_Persist() {
+	struct lfs_info info;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+	CMD_ExecuteCommand("startDriver Charts", 0);
+	Test_Charts_Create();
+	// samples from before persist go to file too
+	Test_Charts_Add(0, 2);
+	CMD_ExecuteCommand("chart_persist chart.bin 10", 0);
+	Test_Charts_Add(2, 5);
+	// lost, not flushed yet
+	Sim_RunSeconds(5, false);
+	Test_Charts_Reboot();
+	SELFTEST_ASSERT(lfs_stat(&lfs, "chart.bin", &info) < 0);
+	Test_Charts_Add(0, 5);
+	Sim_RunSeconds(11, false);
+	SELFTEST_ASSERT(lfs_stat(&lfs, "chart.bin", &info) >= 0);
+	SELFTEST_ASSERT(info.size == 12 + 2 + 8 * 8);
+	Test_Charts_Reboot();
+	Test_FakeHTTPClientPacket_GET("api/chart/0");
+	SELFTEST_ASSERT(Test_Charts_U16(6) == 5);
+	SELFTEST_ASSERT(Test_Charts_U32(16) == 1000);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(0, 4), 4.5f);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(1, 3), 300);
+
+	// ring wraps, only new records are written
+	Test_Charts_Add(5, 11);
+	CMD_ExecuteCommand("chart_flush", 0);
+	Test_Charts_Reboot();
+	Test_FakeHTTPClientPacket_GET("api/chart/0");
+	SELFTEST_ASSERT(Test_Charts_U16(6) == 7);
+	SELFTEST_ASSERT(Test_Charts_U32(16) == 1004);
+	SELFTEST_ASSERT(Test_Charts_U32(16 + 6 * 4) == 1010);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(0, 6), 10.5f);
+	// scale of P changes, file is written again as whole
+	CMD_ExecuteCommand("chart_add 2000 1 40000", 0);
+	CMD_ExecuteCommand("chart_flush", 0);
+	Test_Charts_Reboot();
+	Test_FakeHTTPClientPacket_GET("api/chart/0");
+	SELFTEST_ASSERT(Test_Charts_U16(6) == 7);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(1, 6), 40000);
+	SELFTEST_ASSERT_FLOATCOMPARE(Test_Charts_Value(1, 5), 1000);
+
+	// chart of other size does not take file
+	CMD_ExecuteCommand("chart_create 16 2 1", 0);
+	CMD_ExecuteCommand("chart_persist chart.bin", 0);
+	Test_FakeHTTPClientPacket_GET("api/chart/0");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("no chart");
+}
+#endif
+
+#endif
+
+#endif
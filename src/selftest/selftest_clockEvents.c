@@ -141,6 +141,40 @@ void Test_ClockEvents() {
 	SELFTEST_ASSERT_CHANNEL(2, 20);
 	SELFTEST_ASSERT_CHANNEL(3, 30);
 	SELFTEST_ASSERT_CHANNEL(4, 53);
+
+	// week days, self removal and time jumps
+	ResetEventsAndChannels(4);
+	// Sunday only
+	CMD_ExecuteCommand("addClockEvent 13:55 0x01 10 addChannel 1 1", 0);
+	CMD_ExecuteCommand("addClockEvent 13:55 0x7f 11 addChannel 2 1", 0);
+	CMD_ExecuteCommand("addClockEvent 14:00 0xff 12 backlog addChannel 3 1; removeClockEvent 12", 0);
+
+	// Thursday 13:54:30, then four days in steps
+	simTime = 1681998870;
+	TIME_RunEvents(simTime, true);
+	for (int i = 0; i <= 4 * 86400; i += 37) {
+		TIME_RunEvents(simTime + i, true);
+	}
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_CHANNEL(2, 4);
+	SELFTEST_ASSERT_CHANNEL(3, 1);
+	SELFTEST_ASSERT(TIME_Print_EventList() == 2);
+
+	// Monday 13:54:30, a jump over one day only replays its first 100 seconds
+	simTime += 4 * 86400;
+	TIME_RunEvents(simTime, true);
+	TIME_RunEvents(simTime + 86400 + 10, true);
+	SELFTEST_ASSERT_CHANNEL(2, 5);
+	TIME_RunEvents(simTime + 86400 + 40, true);
+	SELFTEST_ASSERT_CHANNEL(2, 6);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+
+	// going back in time runs them again
+	TIME_RunEvents(simTime, true);
+	TIME_RunEvents(simTime + 50, true);
+	SELFTEST_ASSERT_CHANNEL(2, 7);
+	SELFTEST_ASSERT_CHANNEL(3, 1);
+	ResetEventsAndChannels(2);
 }
 
 #endif
@@ -241,8 +241,82 @@ void Test_Commands_Alias_Chain2() {
 	SELFTEST_ASSERT_CHANNEL(6, 666);
 	SELFTEST_ASSERT_CHANNEL(10, 4*111);
 }
+void Test_Commands_Alias_Registry() {
+	command_t *c;
+	int used, freeBytes, used2, freeBytes2;
+	int i;
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	// builtin command lookup is case insensitive
+	c = CMD_Find("addChannel");
+	SELFTEST_ASSERT(c != 0);
+	SELFTEST_ASSERT(CMD_Find("ADDCHANNEL") == c);
+	SELFTEST_ASSERT((c->commandFlags & CMD_FLAG_FREE_STRUCT) == 0);
+	// alias can't replace builtin command
+	SELFTEST_ASSERT(CMD_CreateAliasHelper("addchannel", "setChannel 1 1") == CMD_RES_BAD_ARGUMENT);
+	SELFTEST_ASSERT(CMD_Find("addChannel") == c);
+
+	CMD_ExecuteCommand("alias myAliasX addChannel 1 5", 0);
+	c = CMD_Find("MYALIASX");
+	SELFTEST_ASSERT(c != 0);
+	SELFTEST_ASSERT((c->commandFlags & CMD_FLAG_ALIAS_RECORD) != 0);
+	CMD_ExecuteCommand("myaliasx", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 5);
+	SELFTEST_ASSERT(CMD_Find("myAliasY") == 0);
+
+	// redefinition replaces the command, short one fits in place
+	CMD_ExecuteCommand("alias myAliasX addChannel 1 7", 0);
+	SELFTEST_ASSERT(CMD_Find("myAliasX") == c);
+	CMD_ExecuteCommand("myAliasX", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 12);
+	// longer one needs a new spot
+	CMD_ExecuteCommand("alias myAliasX backlog addChannel 1 100; addChannel 1 100; addChannel 1 100", 0);
+	SELFTEST_ASSERT(CMD_Find("myAliasX") == c);
+	CMD_ExecuteCommand("myAliasX", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 312);
+	// alias that redefines itself while running
+	CMD_ExecuteCommand("alias myAliasX alias myAliasX addChannel 1 1", 0);
+	CMD_ExecuteCommand("myAliasX", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 312);
+	CMD_ExecuteCommand("myAliasX", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 313);
+	// many redefinitions in a loop must not use up the arena
+	for (i = 0; i < 500; i++) {
+		CMD_ExecuteCommand("alias myAliasX addChannel 1 2", 0);
+	}
+	CMD_ExecuteCommand("myAliasX", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 315);
+	// space left by growing alias is taken by next one that grows
+	CMD_ExecuteCommand("alias myAliasP addChannel 3 1000000", 0);
+	CMD_ExecuteCommand("alias myAliasQ addChannel 3 1", 0);
+	CMD_ExecuteCommand("alias myAliasP backlog addChannel 3 1; addChannel 3 2; addChannel 3 3", 0);
+	CMD_GetAliasArenaStats(&used, &freeBytes);
+	SELFTEST_ASSERT(freeBytes > 0);
+	CMD_ExecuteCommand("alias myAliasQ addChannel 3 2000000", 0);
+	CMD_GetAliasArenaStats(&used2, &freeBytes2);
+	SELFTEST_ASSERT(used2 == used);
+	SELFTEST_ASSERT(freeBytes2 < freeBytes);
+	CMD_ExecuteCommand("myAliasQ", 0);
+	CMD_ExecuteCommand("myAliasP", 0);
+	SELFTEST_ASSERT_CHANNEL(3, 2000006);
+	// when arena is full, aliases still work from heap
+	for (i = 0; i < 200; i++) {
+		char tmp[64];
+		sprintf(tmp, "alias myArenaAlias%i addChannel 2 %i", i, i);
+		CMD_ExecuteCommand(tmp, 0);
+	}
+	CMD_ExecuteCommand("myArenaAlias0", 0);
+	CMD_ExecuteCommand("myArenaAlias199", 0);
+	SELFTEST_ASSERT_CHANNEL(2, 199);
+	c = CMD_Find("myArenaAlias199");
+	SELFTEST_ASSERT(c != 0);
+	SELFTEST_ASSERT((c->commandFlags & CMD_FLAG_FREE_STRUCT) != 0);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("aliasStats", 0) == CMD_RES_OK);
+}
 
 void Test_Commands_Alias() {
+	Test_Commands_Alias_Registry();
 	Test_Commands_Alias_Generic();
 	Test_Commands_Alias_Chain();
 	Test_Commands_Alias_Chain2();
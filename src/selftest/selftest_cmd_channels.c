@@ -2,7 +2,160 @@
 
 #include "selftest_local.h"
 
+static void Test_Channels_Batch() {
+	int writes;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	PIN_SetPinRoleForPinIndex(1, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(1, 1);
+	PIN_SetPinRoleForPinIndex(2, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(2, 2);
+	PIN_SetPinRoleForPinIndex(3, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(3, 3);
+	CMD_ExecuteCommand("addEventHandler OnChannelChange 1 addChannel 10 1", 0);
+	CMD_ExecuteCommand("addEventHandler OnChannelChange 3 addChannel 11 1", 0);
+
+	CHANNEL_BeginBatch();
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+	CMD_ExecuteCommand("setChannel 2 1", 0);
+	// set there and back is no change
+	CMD_ExecuteCommand("setChannel 3 1", 0);
+	CMD_ExecuteCommand("setChannel 3 0", 0);
+	// values are there already, but nothing runs yet
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_PIN_BOOLEAN(1, false);
+	SELFTEST_ASSERT_CHANNEL(10, 0);
+	// nested commit does nothing
+	CHANNEL_BeginBatch();
+	SELFTEST_ASSERT(CHANNEL_CommitBatch() == 0);
+	SELFTEST_ASSERT_PIN_BOOLEAN(1, false);
+	writes = SIM_GetMaskedWriteCount();
+	SELFTEST_ASSERT(CHANNEL_CommitBatch() == 2);
+	// both relays are switched by one bank write
+	SELFTEST_ASSERT(SIM_GetMaskedWriteCount() == writes + 1);
+	SELFTEST_ASSERT_PIN_BOOLEAN(1, true);
+	SELFTEST_ASSERT_PIN_BOOLEAN(2, true);
+	SELFTEST_ASSERT_PIN_BOOLEAN(3, false);
+	SELFTEST_ASSERT_CHANNEL(10, 1);
+	SELFTEST_ASSERT_CHANNEL(11, 0);
+	// unmatched commit is ignored
+	SELFTEST_ASSERT(CHANNEL_CommitBatch() == 0);
+
+	// SetAll goes through batch as well
+	CHANNEL_SetAll(0, 0);
+	SELFTEST_ASSERT_PIN_BOOLEAN(1, false);
+	SELFTEST_ASSERT_PIN_BOOLEAN(2, false);
+	SELFTEST_ASSERT_CHANNEL(10, 2);
+	// outside of batch change runs at once
+	CMD_ExecuteCommand("setChannel 3 1", 0);
+	SELFTEST_ASSERT_PIN_BOOLEAN(3, true);
+	SELFTEST_ASSERT_CHANNEL(11, 1);
+}
+static void Test_Channels_Repr() {
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	CMD_ExecuteCommand("setChannelType 6 Temperature_div10", 0);
+	CMD_ExecuteCommand("setChannel 6 215", 0);
+	SELFTEST_ASSERT(CHANNEL_GetRepr(6) == CHANNEL_REPR_FIXED);
+	SELFTEST_ASSERT(CHANNEL_GetDivider(6) == 10);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFinalValue(6), 21.5f);
+
+	// divider keeps it, so it stays fixed point
+	CHANNEL_SetSmart(6, 22.5f, 0);
+	SELFTEST_ASSERT(CHANNEL_GetRepr(6) == CHANNEL_REPR_FIXED);
+	SELFTEST_ASSERT_CHANNEL(6, 225);
+	// more digits than divider keeps, float is stored
+	CHANNEL_SetSmart(6, 22.25f, 0);
+	SELFTEST_ASSERT(CHANNEL_GetRepr(6) == CHANNEL_REPR_FLOAT);
+	SELFTEST_ASSERT_CHANNEL(6, 222);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFloat(6), 222.5f);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFinalValue(6), 22.25f);
+	// integer set turns it back
+	CMD_ExecuteCommand("setChannel 6 222", 0);
+	SELFTEST_ASSERT(CHANNEL_GetRepr(6) == CHANNEL_REPR_FIXED);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFinalValue(6), 22.2f);
+
+	// float PWM keeps its fraction after other channels change
+	CHANNEL_Set_FloatPWM(7, 33.5f, 0);
+	CMD_ExecuteCommand("setChannel 8 1", 0);
+	SELFTEST_ASSERT(CHANNEL_GetRepr(7) == CHANNEL_REPR_FLOAT);
+	SELFTEST_ASSERT_CHANNEL(7, 33);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFloat(7), 33.5f);
+	// same integer as truncated float is still a change
+	CMD_ExecuteCommand("setChannel 7 33", 0);
+	SELFTEST_ASSERT(CHANNEL_GetRepr(7) == CHANNEL_REPR_INT);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFloat(7), 33.0f);
+
+	// float set is in channel units, divider of type applies
+	CMD_ExecuteCommand("setChannelType 14 Temperature_div10", 0);
+	CMD_ExecuteCommand("setChannelFloat 14 21.37", 0);
+	SELFTEST_ASSERT(CHANNEL_GetRepr(14) == CHANNEL_REPR_FLOAT);
+	SELFTEST_ASSERT_CHANNEL(14, 21);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFinalValue(14), 2.137f);
+	// whole float is stored as integer
+	CMD_ExecuteCommand("setChannelFloat 14 0", 0);
+	SELFTEST_ASSERT(CHANNEL_GetRepr(14) == CHANNEL_REPR_FIXED);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFloat(14), 0.0f);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFinalValue(14), 0.0f);
+}
+static void Test_Channels_SaveDelay() {
+	channelSaveStats_t before, after;
+	int delay, interval, pending, i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("ChannelSaveDelay 3 10", 0);
+	// nothing written recently
+	Sim_RunSeconds(11, false);
+
+	CMD_ExecuteCommand("SetStartValue 4 -1", 0);
+	CMD_ExecuteCommand("SetStartValue 5 -1", 0);
+	CHANNEL_GetSaveStats(&before, &delay, &interval, &pending);
+	for (i = 1; i <= 20; i++) {
+		CHANNEL_Set(4, i, 0);
+		CHANNEL_Set(5, i * 2, 0);
+	}
+	// channel that is not remembered is not queued
+	CHANNEL_Set(6, 7, 0);
+	CHANNEL_GetSaveStats(&after, &delay, &interval, &pending);
+	SELFTEST_ASSERT(pending == 2);
+	SELFTEST_ASSERT(after.writes == before.writes);
+	// written once after quiet period
+	Sim_RunSeconds(4, false);
+	CHANNEL_GetSaveStats(&after, &delay, &interval, &pending);
+	SELFTEST_ASSERT(pending == 0);
+	SELFTEST_ASSERT(after.requests - before.requests == 40);
+	SELFTEST_ASSERT(after.writes - before.writes == 1);
+	SELFTEST_ASSERT(after.values - before.values == 2);
+
+	// set there and back before write is not written
+	CHANNEL_GetSaveStats(&before, &delay, &interval, &pending);
+	CHANNEL_Set(4, 0, 0);
+	CHANNEL_Set(4, 5, 0);
+	CHANNEL_Set(4, 0, 0);
+	CHANNEL_FlushSaves();
+	CHANNEL_GetSaveStats(&after, &delay, &interval, &pending);
+	SELFTEST_ASSERT(after.writes == before.writes);
+	SELFTEST_ASSERT(after.unchanged - before.unchanged == 1);
+
+	// delay 0 writes every change
+	CMD_ExecuteCommand("ChannelSaveDelay 0", 0);
+	CHANNEL_GetSaveStats(&before, &delay, &interval, &pending);
+	CHANNEL_Set(5, 1, 0);
+	CHANNEL_Set(5, 2, 0);
+	CHANNEL_GetSaveStats(&after, &delay, &interval, &pending);
+	SELFTEST_ASSERT(pending == 0);
+	SELFTEST_ASSERT(after.writes - before.writes == 2);
+	CMD_ExecuteCommand("ChannelSaveDelay 3 10", 0);
+}
 void Test_Commands_Channels() {
+	Test_Channels_Batch();
+	Test_Channels_Repr();
+	Test_Channels_SaveDelay();
+
 	// reset whole device
 	SIM_ClearOBK(0);
 
@@ -384,4 +537,54 @@ void Test_Commands_Channels() {
 }
 
 
+#if ENABLE_CHANNEL_STATS
+void Test_ChannelStats() {
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("setChannel 1 10", 0);
+	// 16 s window has one second slots
+	CMD_ExecuteCommand("ChannelStats 1 16", 0);
+	Sim_RunSeconds(4, false);
+	CMD_ExecuteCommand("setChannel 1 30", 0);
+	Sim_RunSeconds(4, false);
+	// weighted by time, not by number of sets
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHavg1_16", 0), 20.0f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHavg1_16*2", 0), 40.0f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHmin1_16", 0), 10.0f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHmax1_16", 0), 30.0f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHsum1_16", 0), 160.0f, 0.1f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHrate1_16", 0), 2.5f, 0.01f);
+	SELFTEST_ASSERT(CMD_EvaluateExpression("$CHema1_16", 0) > 10.0f);
+	SELFTEST_ASSERT(CMD_EvaluateExpression("$CHema1_16", 0) < 20.0f);
+	// no tracker for this window
+	SELFTEST_ASSERT_EXPRESSION("$CHavg1_5", 0);
+	SELFTEST_ASSERT_EXPRESSION("$CH1", 30);
+
+	// short dip is kept until its slot leaves window
+	CMD_ExecuteCommand("setChannel 1 2", 0);
+	Sim_RunSeconds(0.5f, false);
+	CMD_ExecuteCommand("setChannel 1 30", 0);
+	Sim_RunSeconds(10, false);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHmin1_16", 0), 2.0f, 0.01f);
+	Sim_RunSeconds(10, false);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHmin1_16", 0), 30.0f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHavg1_16", 0), 30.0f, 0.01f);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHrate1_16", 0), 0.0f, 0.01f);
+
+	CMD_ExecuteCommand("setChannel 12 -5", 0);
+	CMD_ExecuteCommand("ChannelStats 12 100", 0);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHmax12_100", 0), -5.0f, 0.01f);
+
+	Test_FakeHTTPClientPacket_GET("api/channelstats");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"ch\":1,\"window\":16,\"avg\":30.000,\"min\":30.000");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"ch\":12,\"window\":100,");
+
+	CMD_ExecuteCommand("ChannelStats_Clear 1", 0);
+	SELFTEST_ASSERT_EXPRESSION("$CHavg1_16", 0);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CMD_EvaluateExpression("$CHmax12_100", 0), -5.0f, 0.01f);
+	CMD_ExecuteCommand("ChannelStats_Clear", 0);
+	SELFTEST_ASSERT_EXPRESSION("$CHmax12_100", 0);
+}
+#endif
+
 #endif
@@ -1,6 +1,10 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_public.h"
+#include "../hal/hal_ota.h"
+#include "../logging/cpuProfiler.h"
+#include "../driver/drv_uart.h"
 
 void Test_Events() {
 	// reset whole device
@@ -130,6 +134,12 @@ void Test_Events() {
 	SELFTEST_ASSERT_CHANNEL(10, 4);
 }
 
+static int g_uartNotifies;
+
+static void Test_UART_OnReceive() {
+	g_uartNotifies++;
+}
+
 void Test_UART() {
 	int USED_BUFFER_SIZE = 123;
 	UART_InitReceiveRingBuffer(USED_BUFFER_SIZE);
@@ -176,6 +186,62 @@ void Test_UART() {
 		SELFTEST_ASSERT(realSize == reportedSize);
 		next++;
 	}
+
+	// block path, ring is 128 bytes inside for 123 asked
+	byte burst[200];
+	byte back[200];
+	const byte *span;
+	int got, i;
+	for (i = 0; i < sizeof(burst); i++) {
+		burst[i] = i;
+	}
+	UART_InitReceiveRingBuffer(USED_BUFFER_SIZE);
+	SELFTEST_ASSERT(UART_GetReceiveRingBufferSize() == USED_BUFFER_SIZE);
+	UART_AppendBytesToReceiveRingBuffer(burst, 100);
+	SELFTEST_ASSERT(UART_ReadInto(back, 90) == 90);
+	SELFTEST_ASSERT(back[89] == 89);
+	// wraps around end of ring memory
+	UART_AppendBytesToReceiveRingBuffer(burst + 100, 60);
+	SELFTEST_ASSERT(UART_GetDataSize() == 70);
+	got = UART_PeekContiguous(&span);
+	SELFTEST_ASSERT(got == 128 - 90);
+	SELFTEST_ASSERT(span[0] == 90);
+	SELFTEST_ASSERT(UART_PeekInto(back, sizeof(back)) == 70);
+	SELFTEST_ASSERT(back[0] == 90 && back[69] == 159);
+	SELFTEST_ASSERT(UART_GetByte(69) == 159);
+	UART_ConsumeBytes(got);
+	SELFTEST_ASSERT(UART_PeekContiguous(&span) == 70 - got);
+	SELFTEST_ASSERT(span[0] == 90 + got);
+	// too much, first bytes are lost and counted
+	SELFTEST_ASSERT(UART_GetOverrunsEx(UART_GetSelectedPortIndex()) == 0);
+	UART_AppendBytesToReceiveRingBuffer(burst, 150);
+	SELFTEST_ASSERT(UART_GetDataSize() == USED_BUFFER_SIZE - 1);
+	SELFTEST_ASSERT(UART_GetOverrunsEx(UART_GetSelectedPortIndex()) == 32 + 150 - (USED_BUFFER_SIZE - 1));
+	SELFTEST_ASSERT(UART_GetByte(0) == 150 - (USED_BUFFER_SIZE - 1));
+	SELFTEST_ASSERT(UART_ReadInto(back, sizeof(back)) == USED_BUFFER_SIZE - 1);
+	SELFTEST_ASSERT(back[USED_BUFFER_SIZE - 2] == 149);
+	SELFTEST_ASSERT(UART_GetDataSize() == 0);
+	// consuming more than there is leaves ring empty
+	UART_AppendByteToReceiveRingBuffer(7);
+	UART_ConsumeBytes(5);
+	SELFTEST_ASSERT(UART_GetDataSize() == 0);
+
+	// reader waiting for data is told once per append, not per byte
+	g_uartNotifies = 0;
+	UART_SetReceiveNotify(Test_UART_OnReceive);
+	UART_AppendByteToReceiveRingBuffer(1);
+	SELFTEST_ASSERT(g_uartNotifies == 1);
+	UART_AppendBytesToReceiveRingBuffer(burst, 20);
+	SELFTEST_ASSERT(g_uartNotifies == 2);
+	UART_AppendBytesToReceiveRingBuffer(burst, 0);
+	SELFTEST_ASSERT(g_uartNotifies == 2);
+	// also when ring is full and bytes are lost
+	UART_AppendBytesToReceiveRingBuffer(burst, 150);
+	SELFTEST_ASSERT(g_uartNotifies == 3);
+	UART_SetReceiveNotify(0);
+	UART_AppendByteToReceiveRingBuffer(1);
+	SELFTEST_ASSERT(g_uartNotifies == 3);
+	UART_ConsumeBytes(UART_GetDataSize());
 }
 
 void Test_PinMutex() {
@@ -228,13 +294,678 @@ void Test_PinMutex() {
 	Sim_RunMiliseconds(25, false);
 	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(10) == 1);
 	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(11) == 0);
-	
 
+	// off is applied at once, without waiting for a frame
+	CMD_ExecuteCommand("setChannel 0 0", 0);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(10) == 0);
+	Sim_RunMiliseconds(30, false);
+	// dead time is counted from when pin 10 went off, not from last change
+	CMD_ExecuteCommand("setChannel 0 2", 0);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(11) == 0);
+	Sim_RunMiliseconds(60, false);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(11) == 0);
+	Sim_RunMiliseconds(20, false);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(10) == 0);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(11) == 1);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "PinMutex 0: ch 0, dead time 100 ms, last 110 ms, min 110 ms, switches 3");
+	// same pin again needs no dead time
+	CMD_ExecuteCommand("setChannel 0 0", 0);
+	CMD_ExecuteCommand("setChannel 0 2", 0);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(11) == 1);
+
+	// table grows for higher index
+	SELFTEST_ASSERT(CMD_ExecuteCommand("setMutex 5 1 0 12 13", 0) == CMD_RES_OK);
+	CMD_ExecuteCommand("setChannel 1 2", 0);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(13) == 1);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(11) == 1);
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+	Sim_RunMiliseconds(10, false);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(12) == 1);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(13) == 0);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("setMutex 32 1 0 12 13", 0) == CMD_RES_BAD_ARGUMENT);
+
+	CMD_ExecuteCommand("stopDriver PinMutex", 0);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(11) == 0);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(12) == 0);
+}
+#if ENABLE_CMD_STATS
+void Test_CmdStats() {
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	CMD_ExecuteCommand("cmdStats reset", 0);
+	CMD_ExecuteCommand("setChannel 1 5", 0);
+	CMD_ExecuteCommand("setChannel 1 6", COMMAND_FLAG_SOURCE_MQTT);
+	CMD_ExecuteCommand("backlog addChannel 1 1; addChannel 1 1; addChannel 1 1", COMMAND_FLAG_SOURCE_HTTP);
+	SELFTEST_ASSERT_CHANNEL(1, 9);
+
+	Test_FakeHTTPClientPacket_JSON("api/cmdstats");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("SetChannel", "calls", 2);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("SetChannel", "sources", COMMAND_FLAG_SOURCE_MQTT);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("AddChannel", "calls", 3);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("AddChannel", "sources", COMMAND_FLAG_SOURCE_HTTP);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("backlog", "calls", 1);
+	// reset clears everything, only the cmdStats call itself is counted after it
+	CMD_ExecuteCommand("cmdStats reset", 0);
+	Test_FakeHTTPClientPacket_JSON("api/cmdstats");
+	SELFTEST_ASSERT_JSON_VALUE_STRING_NOT_PRESENT("SetChannel", "calls");
+}
+#endif
+#if ENABLE_SYSPERF
+void Test_SysPerf() {
+	perfThread_t threads[SYSPERF_MAX_THREADS];
+	perfTask_t tasks[SYSPERF_MAX_TASKS];
+	int i, count, found;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	CMD_ExecuteCommand("startDriver PWMToggler", 0);
+	CMD_ExecuteCommand("sysperf reset", 0);
+	Sim_RunFrames(10, false);
+	Test_FakeHTTPClientPacket_JSON("api/sysperf");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "periodMs", QUICK_TMR_DURATION);
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer_Nested2("stages", "total", "calls") >= 10);
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer_Nested2("stages", "drivers", "calls") >= 10);
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer_Nested2("drivers", "PWMToggler", "calls") >= 10);
+	CMD_ExecuteCommand("sysperf reset", 0);
+	SELFTEST_ASSERT(QuickTick_GetStageStats(QT_STAGE_TOTAL)->calls == 0);
+	CMD_ExecuteCommand("sysperf", 0);
+	CMD_ExecuteCommand("stopDriver PWMToggler", 0);
+
+	// thread that ended keeps its record for next one of same name
+	SYSPERF_RegisterThread((void*)0x100, "selftest", 4096);
+	SYSPERF_UnregisterThread((void*)0x100);
+	SYSPERF_RegisterThread((void*)0x104, "selftest", 4096);
+	count = SYSPERF_GetThreads(threads, SYSPERF_MAX_THREADS);
+	found = 0;
+	for (i = 0; i < count; i++) {
+		if (!strcmp(threads[i].name, "selftest")) {
+			found++;
+			SELFTEST_ASSERT(threads[i].bAlive);
+			SELFTEST_ASSERT(threads[i].stackBytes == 4096);
+			// simulator has no stack marks
+			SELFTEST_ASSERT(threads[i].minFreeBytes == -1);
+		}
+	}
+	SELFTEST_ASSERT(found == 1);
+
+	// task list is taken at end of window, simulator has no run time stats
+	SELFTEST_ASSERT(CMD_ExecuteCommand("top 2", 0) == CMD_RES_OK);
+	SELFTEST_ASSERT(SYSPERF_GetWindow() == 2);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("top 0", 0) == CMD_RES_BAD_ARGUMENT);
+	Sim_RunSeconds(3, false);
+	count = SYSPERF_GetTasks(tasks, SYSPERF_MAX_TASKS);
+	found = 0;
+	for (i = 0; i < count; i++) {
+		if (!strcmp(tasks[i].name, "selftest")) {
+			found++;
+			SELFTEST_ASSERT(tasks[i].cpuPermille == -1);
+			SELFTEST_ASSERT(tasks[i].priority == -1);
+			SELFTEST_ASSERT(tasks[i].core == -1);
+		}
+	}
+	SELFTEST_ASSERT(found == 1);
+	// no idle task to take core load from
+	SELFTEST_ASSERT(SYSPERF_GetCoreLoad(0) == -1);
+	SELFTEST_ASSERT(SYSPERF_GetCoreLoad(SYSPERF_MAX_CORES) == -1);
+	Test_FakeHTTPClientPacket_JSON("api/top");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "windowSec", 2);
+	SELFTEST_ASSERT_JSON_VALUE_EXISTS(0, "cores");
+	SYSPERF_UnregisterThread((void*)0x104);
+	// ended thread leaves list with next window
+	Sim_RunSeconds(3, false);
+	count = SYSPERF_GetTasks(tasks, SYSPERF_MAX_TASKS);
+	for (i = 0; i < count; i++) {
+		SELFTEST_ASSERT(strcmp(tasks[i].name, "selftest"));
+	}
+	SYSPERF_SetWindow(SYSPERF_DEFAULT_WINDOW);
+
+#if ENABLE_DRIVER_INDEX_CACHE && ENABLE_DRIVER_WIFIROAM
+	// index part of driver that marks its changes is rendered once
+	SIM_ClearWiFiAPs();
+	SIM_SetWiFiAP("HomeNet", "11:22:33:44:55:01", 1, -60);
+	CMD_ExecuteCommand("startDriver WiFiRoam 5", 0);
+	CMD_ExecuteCommand("sysperf reset", 0);
+	for (i = 0; i < 3; i++) {
+		Test_FakeHTTPClientPacket_GET("index");
+		SELFTEST_ASSERT_HTML_REPLY_CONTAINS("<h5>WiFiRoam: 0 APs cached, 0 scans, 0 roams</h5>");
+	}
+	Test_FakeHTTPClientPacket_JSON("api/sysperf");
+	// calls also count part before state, it is never kept
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("index", "WiFiRoam", "calls", 3 + 1);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("index", "WiFiRoam", "kept", 2);
+	// own change
+	Sim_RunSeconds(6.5f, false);
+	CMD_ExecuteCommand("sysperf reset", 0);
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("<h5>WiFiRoam: 1 APs cached, 1 scans, 0 roams</h5>");
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("<h5>WiFiRoam: 1 APs cached, 1 scans, 0 roams</h5>");
+	// channel change drops it too
+	CHANNEL_Set(10, 5, 0);
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("<h5>WiFiRoam: 1 APs cached, 1 scans, 0 roams</h5>");
+	Test_FakeHTTPClientPacket_JSON("api/sysperf");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("index", "WiFiRoam", "calls", 3 + 2);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("index", "WiFiRoam", "kept", 1);
+	// and so does any command
+	CMD_ExecuteCommand("sysperf reset", 0);
+	Test_FakeHTTPClientPacket_GET("index");
+	Test_FakeHTTPClientPacket_JSON("api/sysperf");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("index", "WiFiRoam", "calls", 1 + 1);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER_NESTED2("index", "WiFiRoam", "kept", 0);
+	// restarted driver starts from its new state
+	CMD_ExecuteCommand("stopDriver WiFiRoam", 0);
+	CMD_ExecuteCommand("startDriver WiFiRoam 5", 0);
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("<h5>WiFiRoam: 0 APs cached, 0 scans, 0 roams</h5>");
+	CMD_ExecuteCommand("stopDriver WiFiRoam", 0);
+	SIM_ClearWiFiAPs();
+#endif
+}
+#endif
+void Test_StringPool() {
+	const char *a, *b, *c;
+	int strings, refs, bytes;
+	int strings2, refs2, bytes2;
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	StringPool_GetStats(&strings, &refs, &bytes);
+	a = StringPool_Intern("setChannel 1 0");
+	b = StringPool_Intern("setChannel 1 0");
+	c = StringPool_Intern("setChannel 2 0");
+	SELFTEST_ASSERT(a == b);
+	SELFTEST_ASSERT(a != c);
+	SELFTEST_ASSERT(!strcmp(c, "setChannel 2 0"));
+	StringPool_GetStats(&strings2, &refs2, &bytes2);
+	SELFTEST_ASSERT(strings2 == strings + 2);
+	SELFTEST_ASSERT(refs2 == refs + 3);
+	StringPool_Release(a);
+	// still kept by b
+	SELFTEST_ASSERT(!strcmp(b, "setChannel 1 0"));
+	StringPool_Release(b);
+	StringPool_Release(c);
+	StringPool_GetStats(&strings2, &refs2, &bytes2);
+	SELFTEST_ASSERT(strings2 == strings);
+	SELFTEST_ASSERT(refs2 == refs);
+	SELFTEST_ASSERT(bytes2 == bytes);
+
+	// string with saturated count stays shared and is never freed
+	for (i = 0; i < 0x10000; i++) {
+		a = StringPool_Intern("Test_StringPool pinned");
+	}
+	b = StringPool_Intern("Test_StringPool pinned");
+	SELFTEST_ASSERT(a == b);
+	StringPool_Release(b);
+	StringPool_GetStats(&strings, &refs, &bytes);
+	for (i = 0; i < 0x10000; i++) {
+		StringPool_Release(a);
+	}
+	StringPool_GetStats(&strings2, &refs2, &bytes2);
+	SELFTEST_ASSERT(strings2 == strings);
+	SELFTEST_ASSERT(refs2 == refs);
+	SELFTEST_ASSERT(!strcmp(a, "Test_StringPool pinned"));
+
+	// identical handler commands are stored once
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+	StringPool_GetStats(&strings, &refs, &bytes);
+	for (i = 0; i < 10; i++) {
+		CMD_ExecuteCommand("addEventHandler OnClick 5 addChannel 3 1", 0);
+	}
+	StringPool_GetStats(&strings2, &refs2, &bytes2);
+	SELFTEST_ASSERT(strings2 == strings + 1);
+	SELFTEST_ASSERT(refs2 == refs + 10);
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+	StringPool_GetStats(&strings2, &refs2, &bytes2);
+	SELFTEST_ASSERT(strings2 == strings);
+}
+static int g_queuedDone;
+static commandResult_t g_queuedLastRes;
+
+static void Test_CommandQueue_OnDone(commandResult_t res, void *userData) {
+	g_queuedDone += *(int*)userData;
+	g_queuedLastRes = res;
+}
+static char g_queuedOutA[256];
+static char g_queuedOutB[256];
+
+static void Test_CommandQueue_OnOutput(const char *text, int len, void *userData) {
+	char *out = (char*)userData;
+	int have = strlen(out);
+
+	if (have + len < 256) {
+		memcpy(out + have, text, len);
+		out[have + len] = 0;
+	}
+}
+void Test_CommandQueue() {
+	int weight = 1;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	g_queuedDone = 0;
+	SELFTEST_ASSERT(CMD_QueueCommand("setChannel 1 5", COMMAND_FLAG_SOURCE_TCP, Test_CommandQueue_OnDone, &weight));
+	SELFTEST_ASSERT(CMD_QueueCommand("addChannel 1 2", COMMAND_FLAG_SOURCE_TCP, Test_CommandQueue_OnDone, &weight));
+	// nothing happens until the main loop runs
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT(g_queuedDone == 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(1, 7);
+	SELFTEST_ASSERT(g_queuedDone == 2);
+	SELFTEST_ASSERT(g_queuedLastRes == CMD_RES_OK);
+
+	SELFTEST_ASSERT(CMD_QueueCommand("thisCommandDoesNotExist 1", 0, Test_CommandQueue_OnDone, &weight));
+	// no callback is fine too
+	SELFTEST_ASSERT(CMD_QueueCommand("setChannel 2 3", 0, 0, 0));
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(g_queuedDone == 3);
+	SELFTEST_ASSERT(g_queuedLastRes == CMD_RES_UNKNOWN_COMMAND);
+	SELFTEST_ASSERT_CHANNEL(2, 3);
+
+	// each command gets only lines it logged itself
+	g_queuedOutA[0] = g_queuedOutB[0] = 0;
+	SELFTEST_ASSERT(CMD_QueueCommandWithOutput("echo first session", COMMAND_FLAG_SOURCE_TCP, Test_CommandQueue_OnOutput, 0, g_queuedOutA));
+	SELFTEST_ASSERT(CMD_QueueCommandWithOutput("echo second session", COMMAND_FLAG_SOURCE_TCP, Test_CommandQueue_OnOutput, 0, g_queuedOutB));
+	SELFTEST_ASSERT(CMD_QueueCommand("echo nobody", 0, 0, 0));
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(strstr(g_queuedOutA, "first session\r\n") != 0);
+	SELFTEST_ASSERT(strstr(g_queuedOutA, "second") == 0);
+	SELFTEST_ASSERT(strstr(g_queuedOutB, "second session\r\n") != 0);
+	SELFTEST_ASSERT(strstr(g_queuedOutB, "first") == 0);
+	SELFTEST_ASSERT(strstr(g_queuedOutA, "nobody") == 0 && strstr(g_queuedOutB, "nobody") == 0);
+	// nothing is captured once queue is done
+	CMD_ExecuteCommand("echo after queue", 0);
+	SELFTEST_ASSERT(strstr(g_queuedOutB, "after queue") == 0);
 }
+static void Test_DriverIds() {
+	// reset whole device
+	SIM_ClearOBK(0);
+	SELFTEST_ASSERT(DRV_IsRunning(DRV_ID_PinMutex) == false);
+	CMD_ExecuteCommand("startDriver pinmutex", 0);
+	SELFTEST_ASSERT(DRV_IsRunning(DRV_ID_PinMutex));
+	SELFTEST_ASSERT(DRV_IsRunningByName("PINMUTEX"));
+	SELFTEST_ASSERT(DRV_IsRunning(DRV_ID_NTP) == false);
+	CMD_ExecuteCommand("startDriver NTP", 0);
+	SELFTEST_ASSERT(DRV_IsRunning(DRV_ID_NTP));
+	CMD_ExecuteCommand("stopDriver PinMutex", 0);
+	SELFTEST_ASSERT(DRV_IsRunning(DRV_ID_PinMutex) == false);
+	SELFTEST_ASSERT(DRV_IsRunningByName("PinMutex") == false);
+	SELFTEST_ASSERT(DRV_IsRunning(DRV_ID_NTP));
+	SELFTEST_ASSERT(DRV_IsRunning(DRV_ID_COUNT) == false);
+	SELFTEST_ASSERT(DRV_IsRunning(-1) == false);
+	CMD_ExecuteCommand("stopDriver NTP", 0);
+	SELFTEST_ASSERT(DRV_IsRunning(DRV_ID_NTP) == false);
+}
+// made by scripts/ota_pack.py, with base string below for delta
+static const char g_otaTestBase[] = "OpenBeken firmware v1: relay, button, led, mqtt, http server;";
+static const char g_otaTestImage[] = "OpenBeken firmware v2: relay, button, led, mqtt, http server; "
+	"abababababababababababababababababababab";
+static const unsigned char g_otaTestPacked[] = {
+	0x4F, 0x42, 0x4B, 0x50, 0x01, 0x00, 0x00, 0x00, 0x66, 0x00, 0x00, 0x00, 0x3F, 0x91, 0xA0, 0x6E,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3F, 0x4F, 0x70, 0x65, 0x6E, 0x42, 0x65, 0x6B,
+	0x65, 0x6E, 0x20, 0x66, 0x69, 0x72, 0x6D, 0x77, 0x61, 0x72, 0x65, 0x20, 0x76, 0x32, 0x3A, 0x20,
+	0x72, 0x65, 0x6C, 0x61, 0x79, 0x2C, 0x20, 0x62, 0x75, 0x74, 0x74, 0x6F, 0x6E, 0x2C, 0x20, 0x6C,
+	0x65, 0x64, 0x2C, 0x20, 0x6D, 0x71, 0x74, 0x74, 0x2C, 0x20, 0x68, 0x74, 0x74, 0x70, 0x20, 0x73,
+	0x65, 0x72, 0x76, 0x65, 0x72, 0x3B, 0x20, 0x61, 0x62, 0xA3, 0x02, 0x00
+};
+static const unsigned char g_otaTestDelta[] = {
+	0x4F, 0x42, 0x4B, 0x50, 0x01, 0x01, 0x00, 0x00, 0x66, 0x00, 0x00, 0x00, 0x3F, 0x91, 0xA0, 0x6E,
+	0x3D, 0x00, 0x00, 0x00, 0xAD, 0x1C, 0xDF, 0x3A, 0xC0, 0x14, 0x00, 0x0B, 0x32, 0x3A, 0x20, 0x72,
+	0x65, 0x6C, 0x61, 0x79, 0x2C, 0x20, 0x62, 0x75, 0xC0, 0x1D, 0x00, 0x02, 0x20, 0x61, 0x62, 0xA3,
+	0x02, 0x00
+};
+static char g_otaTestOut[256];
+static int g_otaTestOutLen;
+static const char* g_otaTestBaseData;
+
+static int Test_OTA_Write(void* ctx, const unsigned char* data, int len) {
+	if (g_otaTestOutLen + len > sizeof(g_otaTestOut) - 1) {
+		return -1;
+	}
+	memcpy(g_otaTestOut + g_otaTestOutLen, data, len);
+	g_otaTestOutLen += len;
+	g_otaTestOut[g_otaTestOutLen] = 0;
+	return 0;
+}
+static int Test_OTA_ReadBase(void* ctx, unsigned char* out, int len, unsigned int offset) {
+	memcpy(out, g_otaTestBaseData + offset, len);
+	return 0;
+}
+// feeds image in pieces of given size, returns Finish result
+static int Test_OTA_Run(const unsigned char* data, int len, int chunk, bool bBase) {
+	otaUnpack_t* u;
+	int i, part, res;
+
+	g_otaTestOutLen = 0;
+	g_otaTestOut[0] = 0;
+	u = OTA_Unpack_Create(Test_OTA_Write, bBase ? Test_OTA_ReadBase : 0, 0);
+	res = 0;
+	for (i = 0; i < len && res == 0; i += chunk) {
+		part = len - i < chunk ? len - i : chunk;
+		res = OTA_Unpack_Feed(u, data + i, part);
+	}
+	if (res == 0) {
+		res = OTA_Unpack_Finish(u);
+	}
+	OTA_Unpack_Free(u);
+	return res;
+}
+static void Test_OTA_Unpack() {
+	unsigned char bad[sizeof(g_otaTestPacked)];
+	int chunk;
+
+	SELFTEST_ASSERT(OTA_CRC32(0, (const unsigned char*)"123456789", 9) == 0xCBF43926);
+	g_otaTestBaseData = g_otaTestBase;
+	for (chunk = 1; chunk <= 64; chunk *= 4) {
+		// plain image passes through
+		SELFTEST_ASSERT(Test_OTA_Run((const unsigned char*)g_otaTestImage, strlen(g_otaTestImage), chunk, false) == 0);
+		SELFTEST_ASSERT_STRING(g_otaTestOut, g_otaTestImage);
+		SELFTEST_ASSERT(Test_OTA_Run(g_otaTestPacked, sizeof(g_otaTestPacked), chunk, false) == 0);
+		SELFTEST_ASSERT_STRING(g_otaTestOut, g_otaTestImage);
+		SELFTEST_ASSERT(Test_OTA_Run(g_otaTestDelta, sizeof(g_otaTestDelta), chunk, true) == 0);
+		SELFTEST_ASSERT_STRING(g_otaTestOut, g_otaTestImage);
+	}
+	// delta needs a base
+	SELFTEST_ASSERT(Test_OTA_Run(g_otaTestDelta, sizeof(g_otaTestDelta), 16, false) != 0);
+	// and exactly the base it was made from
+	g_otaTestBaseData = "OpenBeken firmware v0: relay, button, led, mqtt, http server;";
+	SELFTEST_ASSERT(Test_OTA_Run(g_otaTestDelta, sizeof(g_otaTestDelta), 16, true) != 0);
+	SELFTEST_ASSERT(g_otaTestOutLen == 0);
+	// damaged and truncated images are refused
+	memcpy(bad, g_otaTestPacked, sizeof(bad));
+	bad[40] ^= 1;
+	SELFTEST_ASSERT(Test_OTA_Run(bad, sizeof(bad), 16, false) != 0);
+	SELFTEST_ASSERT(Test_OTA_Run(g_otaTestPacked, sizeof(g_otaTestPacked) - 3, 16, false) != 0);
+}
+// Beken OTA writer, hal/bk7231/hal_ota_bk7231.c on RAM area
+int init_ota(unsigned int startaddr);
+void add_otadata(unsigned char *data, int len);
+int close_ota();
+void SIM_OTA_ClearArea();
+const byte *SIM_OTA_GetArea();
+int SIM_OTA_GetErases();
+int SIM_OTA_GetYields();
+
+static void Test_OTA_BekenWriter() {
+	static byte image[5 * 0x1000 + 100];
+	const byte *area;
+	int i, part, len = sizeof(image);
+
+	for (i = 0; i < len; i++) {
+		image[i] = (byte)(i * 7 + (i >> 12));
+	}
+	SIM_OTA_ClearArea();
+	OTA_ResetProgress();
+	area = SIM_OTA_GetArea();
+	// would overwrite running firmware
+	SELFTEST_ASSERT(init_ota(0x1000) == 0);
+	SELFTEST_ASSERT(init_ota(START_ADR_OF_BK_PARTITION_OTA) == 1);
+	// pieces as they come from socket
+	for (i = 0; i < len; i += part) {
+		part = len - i < 1460 ? len - i : 1460;
+		add_otadata(image + i, part);
+	}
+	// full sectors are written, without sleeping per piece
+	SELFTEST_ASSERT(SIM_OTA_GetErases() == 5);
+	SELFTEST_ASSERT(SIM_OTA_GetYields() == 1);
+	SELFTEST_ASSERT(close_ota() == 0);
+	SELFTEST_ASSERT(SIM_OTA_GetErases() == 6);
+	SELFTEST_ASSERT(memcmp(area, image, len) == 0);
+	// last sector is padded
+	for (i = len; i < 6 * 0x1000; i++) {
+		SELFTEST_ASSERT(area[i] == 0xFF);
+	}
+	// progress counts flashed sectors
+	SELFTEST_ASSERT(OTA_GetProgress() == -1 + 6 * 0x1000);
+	// nothing more after close
+	SELFTEST_ASSERT(close_ota() == -1);
+	// device would reboot now, here MQTT and others must not see OTA going
+	OTA_ResetProgress();
+}
+#if ENABLE_OTA_RELAY
+static void Test_OTA_Relay() {
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	// off by default
+	SELFTEST_ASSERT(OTA_IsRelayEnabled() == 0);
+	Test_FakeHTTPClientPacket_JSON("api/otarelay");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "enabled", 0);
+	Test_FakeHTTPClientPacket_JSON("api/otarelay/image");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "error", 403);
+
+	CMD_ExecuteCommand("otaRelay 1", 0);
+	SELFTEST_ASSERT(OTA_IsRelayEnabled());
+	// simulator has no verified image to serve
+	Test_FakeHTTPClientPacket_JSON("api/otarelay");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "enabled", 1);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "image", 0);
+	Test_FakeHTTPClientPacket_JSON("api/otarelay/image");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "error", 404);
+
+	CMD_ExecuteCommand("otaRelay 0", 0);
+	SELFTEST_ASSERT(OTA_IsRelayEnabled() == 0);
+}
+#endif
+#if ENABLE_HEAP_TRACKER
+void Test_HeapTracker() {
+	heapSiteStats_t sites[16];
+	heapStats_t before, st;
+	unsigned int mark;
+	char *p, *foreign;
+	int line, i, count;
+
+	SIM_ClearOBK(0);
+	// first page builds what it keeps
+	Test_FakeHTTPClientPacket_GET("index");
+
+	HeapTrack_GetStats(&before);
+	mark = HeapTrack_GetMark();
+	line = __LINE__ + 1;
+	p = malloc(4000000);
+	HeapTrack_GetStats(&st);
+	SELFTEST_ASSERT(st.liveBytes == before.liveBytes + 4000000);
+	SELFTEST_ASSERT(st.liveCount == before.liveCount + 1);
+	SELFTEST_ASSERT(st.peakBytes >= st.liveBytes);
+	// biggest holder is listed first, with its file and line, flash of
+	// simulator has 2 MB
+	count = HeapTrack_GetSites(sites, 16);
+	SELFTEST_ASSERT(count >= 1);
+	SELFTEST_ASSERT(strstr(sites[0].file, "selftest_cmd_generic.c") != 0);
+	SELFTEST_ASSERT(sites[0].line == line);
+	SELFTEST_ASSERT(sites[0].liveBytes == 4000000);
+	// moved block keeps data and goes to site that resized it
+	p[0] = 'x';
+	p[3999999] = 'y';
+	p = realloc(p, 5000000);
+	SELFTEST_ASSERT(p[0] == 'x' && p[3999999] == 'y');
+	HeapTrack_GetStats(&st);
+	SELFTEST_ASSERT(st.liveBytes == before.liveBytes + 5000000);
+	SELFTEST_ASSERT(HeapTrack_CountLiveSince(mark, false) == 1);
+	free(p);
+	SELFTEST_ASSERT_NO_LEAKS_SINCE(mark);
+
+	// pointer from C library is passed on
+	foreign = strdup("not ours");
+	free(foreign);
+	HeapTrack_GetStats(&st);
+	SELFTEST_ASSERT(st.untracked == before.untracked + 1);
+
+	// these give back everything they take, after first run fills caches
+	for (i = 0; i < 4; i++) {
+		if (i == 1) {
+			mark = HeapTrack_GetMark();
+		}
+		Test_FakeHTTPClientPacket_GET("index");
+		CMD_ExecuteCommand("setChannel 1 $CH1+1", 0);
+		CMD_ExecuteCommand("backlog setChannel 2 5; addChannel 2 1", 0);
+	}
+	SELFTEST_ASSERT_CHANNEL(1, 4);
+	SELFTEST_ASSERT_NO_LEAKS_SINCE(mark);
+
+	Test_FakeHTTPClientPacket_JSON("api/heapstats");
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer("liveCount", 0) > 0);
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer("largestFree", 0) == -1);
+	CMD_ExecuteCommand("heapstats 3", 0);
+	CMD_ExecuteCommand("heapstats reset", 0);
+	HeapTrack_GetStats(&st);
+	SELFTEST_ASSERT(st.peakBytes == st.liveBytes);
+}
+#endif
+#if ENABLE_MEMPOOL
+void Test_MemPool() {
+	memPoolStats_t before[MEMPOOL_NUM_CLASSES], st[MEMPOOL_NUM_CLASSES];
+	unsigned int fallbacksBefore, fallbacks;
+	byte *p[40];
+	byte *big;
+	int i, j;
+
+	SIM_ClearOBK(0);
+	MemPool_GetStats(before, &fallbacksBefore);
+	// sizes go to smallest class they fit
+	p[0] = MemPool_Alloc(10);
+	p[1] = MemPool_Alloc(33);
+	p[2] = MemPool_Alloc(128);
+	MemPool_GetStats(st, &fallbacks);
+	SELFTEST_ASSERT(st[0].blockSize == 16 && st[3].blockSize == 128);
+	SELFTEST_ASSERT(st[0].used == before[0].used + 1);
+	SELFTEST_ASSERT(st[1].used == before[1].used);
+	SELFTEST_ASSERT(st[2].used == before[2].used + 1);
+	SELFTEST_ASSERT(st[3].used == before[3].used + 1);
+	SELFTEST_ASSERT(fallbacks == fallbacksBefore);
+	for (i = 0; i < 3; i++) {
+		MemPool_Free(p[i]);
+	}
+	// too big for any class comes from heap and is freed there
+	big = MemPool_Alloc(200);
+	MemPool_GetStats(st, &fallbacks);
+	SELFTEST_ASSERT(fallbacks == fallbacksBefore + 1);
+	memset(big, 1, 200);
+	MemPool_Free(big);
+
+	// more than one slab of blocks, none of them overlap
+	for (i = 0; i < 40; i++) {
+		p[i] = MemPool_Alloc(100);
+		memset(p[i], i, 100);
+	}
+	MemPool_GetStats(st, &fallbacks);
+	SELFTEST_ASSERT(st[3].used == before[3].used + 40);
+	SELFTEST_ASSERT(st[3].slabs > 1);
+	SELFTEST_ASSERT(st[3].capacity >= st[3].used);
+	SELFTEST_ASSERT(st[3].peakUsed >= st[3].used);
+	for (i = 0; i < 40; i++) {
+		for (j = 0; j < 100; j++) {
+			SELFTEST_ASSERT(p[i][j] == i);
+		}
+		MemPool_Free(p[i]);
+	}
+	// empty slabs go back to heap, one is kept
+	MemPool_GetStats(st, &fallbacks);
+	SELFTEST_ASSERT(st[3].used == before[3].used);
+	SELFTEST_ASSERT(st[3].slabs <= before[3].slabs + 1);
+
+	// event handlers come from pool
+	for (i = 0; i < 10; i++) {
+		CMD_ExecuteCommand("addEventHandler OnClick 5 addChannel 3 1", 0);
+	}
+	MemPool_GetStats(st, &fallbacks);
+	SELFTEST_ASSERT(st[0].allocs + st[1].allocs + st[2].allocs + st[3].allocs >= before[0].allocs + before[1].allocs + before[2].allocs + before[3].allocs + 10);
+	CMD_ExecuteCommand("clearAllHandlers", 0);
+	CMD_ExecuteCommand("poolstats", 0);
+	MemPool_GetStats(st, &fallbacks);
+	for (i = 0; i < MEMPOOL_NUM_CLASSES; i++) {
+		SELFTEST_ASSERT(st[i].used <= before[i].used);
+	}
+}
+#endif
+#if ENABLE_CPU_PROFILER
+static void Test_CPUProfiler() {
+	static const char taskA[] = "tcp_ip", taskB[] = "quick";
+	profilerEntry_t top[4], all[PROFILER_MAX_ENTRIES];
+	profilerStats_t st;
+	int i, count;
+
+	// simulator has no sampling timer, samples are fed like ISR does
+	SELFTEST_ASSERT(CMD_ExecuteCommand("profile_start", 0) == CMD_RES_ERROR);
+	Profiler_Reset();
+	for (i = 0; i < 30; i++) {
+		Profiler_Sample(0x23001000, taskA);
+	}
+	for (i = 0; i < 20; i++) {
+		Profiler_Sample(0x23002000, taskB);
+	}
+	for (i = 0; i < 10; i++) {
+		Profiler_Sample(0x23001000, taskB);
+	}
+	Profiler_GetStats(&st);
+	SELFTEST_ASSERT(st.samples == 60);
+	SELFTEST_ASSERT(st.dropped == 0);
+	SELFTEST_ASSERT(st.numTasks == 2);
+	// same address in two tasks is counted apart
+	SELFTEST_ASSERT(st.numEntries == 3);
+	SELFTEST_ASSERT(!strcmp(Profiler_GetTaskName(0), "tcp_ip"));
+	SELFTEST_ASSERT(Profiler_GetTaskSamples(1) == 30);
+	count = Profiler_GetTop(top, 4);
+	SELFTEST_ASSERT(count == 3);
+	SELFTEST_ASSERT(top[0].pc == 0x23001000 && top[0].task == 0 && top[0].count == 30);
+	SELFTEST_ASSERT(top[1].pc == 0x23002000 && top[1].count == 20);
+	SELFTEST_ASSERT(top[2].pc == 0x23001000 && top[2].task == 1 && top[2].count == 10);
+
+	// full table drops instead of replacing
+	for (i = 0; i < PROFILER_MAX_ENTRIES * 2; i++) {
+		Profiler_Sample(0x30000000 + i * 4, taskA);
+	}
+	Profiler_GetStats(&st);
+	SELFTEST_ASSERT(st.dropped > 0);
+	SELFTEST_ASSERT(st.numEntries <= PROFILER_MAX_ENTRIES);
+	SELFTEST_ASSERT(st.samples == 60 + PROFILER_MAX_ENTRIES * 2);
+	count = Profiler_GetEntries(0, all, PROFILER_MAX_ENTRIES);
+	SELFTEST_ASSERT(count == st.numEntries);
+	SELFTEST_ASSERT(Profiler_GetEntries(count - 1, all, 4) == 1);
+	count = Profiler_GetTop(top, 1);
+	SELFTEST_ASSERT(count == 1 && top[0].count == 30);
+
+	Test_FakeHTTPClientPacket_JSON("api/profile");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "samples", st.samples);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "dropped", st.dropped);
+	CMD_ExecuteCommand("profile_print 3", 0);
+	Profiler_Reset();
+	Profiler_GetStats(&st);
+	SELFTEST_ASSERT(st.samples == 0 && st.numEntries == 0);
+}
+#endif
 void Test_Commands_Generic() {
+	Test_OTA_Unpack();
+	Test_OTA_BekenWriter();
+#if ENABLE_OTA_RELAY
+	Test_OTA_Relay();
+#endif
+	Test_StringPool();
+	Test_CommandQueue();
+#if ENABLE_CMD_STATS
+	Test_CmdStats();
+#endif
+#if ENABLE_SYSPERF
+	Test_SysPerf();
+#endif
+#if ENABLE_HEAP_TRACKER
+	Test_HeapTracker();
+#endif
+#if ENABLE_CPU_PROFILER
+	Test_CPUProfiler();
+#endif
+#if ENABLE_MEMPOOL
+	Test_MemPool();
+#endif
 	Test_UART();
 	Test_Events();
 	Test_PinMutex();
+	Test_DriverIds();
 
 	// reset whole device
 	SIM_ClearOBK(0);
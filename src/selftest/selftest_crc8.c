@@ -0,0 +1,81 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+
+// bitwise loop Tiny_CRC8 was before tables, kept to compare against
+static char Test_CRC8_Bitwise(const char *data, int length)
+{
+	char crc = 0x00;
+	char extract;
+	char sum;
+	int i;
+	char tempI;
+
+	for (i = 0; i < length; i++)
+	{
+		extract = *data;
+		for (tempI = 8; tempI; tempI--)
+		{
+			sum = (crc ^ extract) & 0x01;
+			crc >>= 1;
+			if (sum)
+				crc ^= 0x8C;
+			extract >>= 1;
+		}
+		data++;
+	}
+	return crc;
+}
+
+void Test_CRC8() {
+	static char buf[4096 + 8];
+	unsigned char crc;
+	int i, len, ofs, split;
+
+	for (i = 0; i < (int)sizeof(buf); i++) {
+		buf[i] = (char)rand();
+	}
+	// every byte value, both halves of sign bit
+	for (i = 0; i < 256; i++) {
+		buf[i] = (char)i;
+	}
+	SELFTEST_ASSERT(Tiny_CRC8(buf, 256) == Test_CRC8_Bitwise(buf, 256));
+	SELFTEST_ASSERT(Tiny_CRC8(buf, 0) == 0);
+	// lengths around slice by 4 step, unaligned starts
+	for (len = 0; len < 80; len++) {
+		for (ofs = 0; ofs < 8; ofs++) {
+			SELFTEST_ASSERT(Tiny_CRC8(buf + ofs, len) == Test_CRC8_Bitwise(buf + ofs, len));
+		}
+	}
+	SELFTEST_ASSERT(Tiny_CRC8(buf, 4096) == Test_CRC8_Bitwise(buf, 4096));
+	SELFTEST_ASSERT(Tiny_CRC8((const char*)&g_cfg, sizeof(g_cfg)) == Test_CRC8_Bitwise((const char*)&g_cfg, sizeof(g_cfg)));
+	// in parts, same as whole
+	for (split = 0; split <= 300; split += 7) {
+		crc = CRC8_Update(0, buf, split);
+		crc = CRC8_Update(crc, buf + split, 1000 - split);
+		SELFTEST_ASSERT((char)crc == Test_CRC8_Bitwise(buf, 1000));
+	}
+	crc = 0;
+	for (i = 0; i < 1000; i++) {
+		crc = CRC8_Update(crc, buf + i, 1);
+	}
+	SELFTEST_ASSERT((char)crc == Tiny_CRC8(buf, 1000));
+}
+
+// keeps benchmark results used
+static volatile char g_crc8BenchSink;
+
+void Test_CRC8_Bench() {
+	selfBench_t b;
+	char r = 0;
+
+	SELFBENCH(b, "Tiny_CRC8 bitwise mainConfig_t") {
+		r ^= Test_CRC8_Bitwise((const char*)&g_cfg, sizeof(g_cfg));
+	}
+	SELFBENCH(b, "Tiny_CRC8 mainConfig_t") {
+		r ^= Tiny_CRC8((const char*)&g_cfg, sizeof(g_cfg));
+	}
+	g_crc8BenchSink = r;
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../sim/sim_import.h"
+
+static void Test_Debouncer_Set(int pin, int level, int ms) {
+	SIM_SetSimulatedPinValue(pin, level);
+	Sim_RunFrame(ms);
+}
+
+void Test_Debouncer() {
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver Debouncer", 0);
+	// 20 ms window, 3 ms glitch, adaptive up to 80 ms, rising changes counted on channel 2
+	SELFTEST_ASSERT(CMD_ExecuteCommand("Debouncer_Add 7 1 20 3 80 2", 0) == CMD_RES_OK);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+
+	// 1 ms pulse is dropped, level that stays is taken after glitch window
+	Test_Debouncer_Set(7, 1, 1);
+	Test_Debouncer_Set(7, 0, 1);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	Test_Debouncer_Set(7, 1, 1);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	Sim_RunFrame(5);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+
+	// bounces inside window change nothing
+	Test_Debouncer_Set(7, 0, 1);
+	Test_Debouncer_Set(7, 1, 1);
+	Test_Debouncer_Set(7, 0, 1);
+	Test_Debouncer_Set(7, 1, 1);
+	Sim_RunFrame(30);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+
+	// change after chatter doubles window
+	Test_Debouncer_Set(7, 0, 5);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Debouncer P7: 0, window 40 ms, changes 2, bounces 4, glitches 1");
+	// real change inside window waits for its end
+	Test_Debouncer_Set(7, 1, 25);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	Sim_RunFrame(15);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_CHANNEL(2, 2);
+
+	// same pin again only changes settings
+	SELFTEST_ASSERT(CMD_ExecuteCommand("Debouncer_Add 7 3 0", 0) == CMD_RES_OK);
+	SELFTEST_ASSERT_CHANNEL(3, 1);
+	Test_Debouncer_Set(7, 0, 1);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+
+	CMD_ExecuteCommand("Debouncer_Clear", 0);
+	Test_Debouncer_Set(7, 1, 10);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+}
+
+#endif
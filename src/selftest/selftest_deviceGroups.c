@@ -3,6 +3,7 @@
 #include "selftest_local.h"
 #include "../driver/drv_local.h"
 #include "../devicegroups/deviceGroups_public.h"
+#include "../quicktick.h"
 
 static int sim_fakeSeq = 1;
 
@@ -168,10 +169,114 @@ void Test_DeviceGroups_RGB() {
 	SELFTEST_ASSERT_CHANNEL(3, 0);
 
 }
+// newer update of same thing for same group replaces queued one
+void Test_DeviceGroups_SendQueue() {
+	char tmp[64];
+	int i;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver DGR", 0);
+	SELFTEST_ASSERT(DGR_GetSendQueueCount() == 0);
+
+	CMD_ExecuteCommand("DGR_SendBrightness roomA 10", 0);
+	CMD_ExecuteCommand("DGR_SendBrightness roomA 20", 0);
+	CMD_ExecuteCommand("DGR_SendBrightness roomA 30", 0);
+	SELFTEST_ASSERT(DGR_GetSendQueueCount() == 1);
+	CMD_ExecuteCommand("DGR_SendBrightness roomB 30", 0);
+	SELFTEST_ASSERT(DGR_GetSendQueueCount() == 2);
+	CMD_ExecuteCommand("DGR_SendPower roomA 1 1", 0);
+	CMD_ExecuteCommand("DGR_SendRGBCW roomA FF0000", 0);
+	CMD_ExecuteCommand("DGR_SendRGBCW roomA 00FF00", 0);
+	CMD_ExecuteCommand("DGR_SendPower roomA 0 1", 0);
+	SELFTEST_ASSERT(DGR_GetSendQueueCount() == 4);
+
+	for (i = 0; i < 4; i++) {
+		snprintf(tmp, sizeof(tmp), "DGR_SendBrightness room%i 50", i);
+		CMD_ExecuteCommand(tmp, 0);
+	}
+	SELFTEST_ASSERT(DGR_GetSendQueueCount() == 8);
+	// ring is full, packet that replaces nothing is dropped
+	CMD_ExecuteCommand("DGR_SendBrightness roomC 40", 0);
+	SELFTEST_ASSERT(DGR_GetSendQueueCount() == 8);
+	// but update of queued one still gets in
+	CMD_ExecuteCommand("DGR_SendBrightness roomA 40", 0);
+	SELFTEST_ASSERT(DGR_GetSendQueueCount() == 8);
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("(5 replaced in queue, 1 dropped)");
+}
+static void Test_DeviceGroups_PowerFrom(const char *ip, const char *groupName, int seq, int powerBits) {
+	byte buffer[64];
+	int len;
+
+	len = DGR_Quick_FormatPowerState(buffer, sizeof(buffer), groupName, seq, 0, powerBits, 1);
+	DGR_SpoofNextDGRPacketSource(ip);
+	DGR_ProcessIncomingPacket((char*)buffer, len);
+}
+static void Test_DeviceGroups_AckFrom(const char *ip, const char *groupName, int seq) {
+	byte buffer[64];
+	int len;
+
+	len = DGR_Quick_FormatAck(buffer, sizeof(buffer), groupName, seq);
+	DGR_SpoofNextDGRPacketSource(ip);
+	DGR_ProcessIncomingPacket((char*)buffer, len);
+}
+// sequence is kept per member, every message is acked and ours wait for acks
+void Test_DeviceGroups_Acks() {
+	const char *testName = "win_ackTst";
+	int i;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CFG_DeviceGroups_SetName(testName);
+	CFG_DeviceGroups_SetRecvFlags(DGR_SHARE_POWER);
+	CFG_DeviceGroups_SetSendFlags(0);
+	CMD_ExecuteCommand("startDriver DGR", 0);
+
+	Test_DeviceGroups_PowerFrom("192.168.0.50", testName, 5, 1);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	// same sequence again from same member is duplicate
+	Test_DeviceGroups_PowerFrom("192.168.0.50", testName, 5, 0);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	// but not from another one
+	Test_DeviceGroups_PowerFrom("192.168.0.51", testName, 5, 0);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+
+	// sequence starts from 0 after driver restart
+	CMD_ExecuteCommand("DGR_SendPower win_ackTst 1 1", 0);
+	DGR_FlushSendQueue();
+	SELFTEST_ASSERT(DGR_GetPendingAckCount() == 1);
+	Test_DeviceGroups_AckFrom("192.168.0.50", testName, 0);
+	SELFTEST_ASSERT(DGR_GetPendingAckCount() == 1);
+	// ack of other sequence does not count
+	Test_DeviceGroups_AckFrom("192.168.0.51", testName, 7);
+	SELFTEST_ASSERT(DGR_GetPendingAckCount() == 1);
+	Test_DeviceGroups_AckFrom("192.168.0.51", testName, 0);
+	SELFTEST_ASSERT(DGR_GetPendingAckCount() == 0);
+
+	// no ack, sent again with growing delay and given up after a few
+	CMD_ExecuteCommand("DGR_SendPower win_ackTst 0 1", 0);
+	DGR_FlushSendQueue();
+	DGR_RunRetransmits();
+	SELFTEST_ASSERT(DGR_GetPendingAckCount() == 1);
+	g_timeMs += 250;
+	DGR_RunRetransmits();
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("DGR acks sent: 3, received: 3, retransmits: 1, unacked: 0, members: 2");
+	for (i = 0; i < 6; i++) {
+		g_timeMs += 10000;
+		DGR_RunRetransmits();
+	}
+	SELFTEST_ASSERT(DGR_GetPendingAckCount() == 0);
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("retransmits: 5, unacked: 1");
+}
 void Test_DeviceGroups() {
 
 	Test_DeviceGroups_TwoRelays();
 	Test_DeviceGroups_RGB();
+	Test_DeviceGroups_SendQueue();
+	Test_DeviceGroups_Acks();
 
 }
 
@@ -0,0 +1,43 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../hal/hal_uart.h"
+
+byte DMX_GetByte(uint32_t idx);
+
+void Test_DMX() {
+	SIM_ClearOBK(0);
+	SIM_UART_InitReceiveRingBuffer(2048);
+	CMD_ExecuteCommand("startDriver DMX", 0);
+	CMD_ExecuteCommand("SM16703P_Init 2 RGB", 0);
+	// simulated UART can't send break, so frame is sent from apply
+	SELFTEST_ASSERT(HAL_UART_SendBreak(120, 12) == false);
+	SIM_ClearUART();
+
+	// nothing goes to line until apply
+	CMD_ExecuteCommand("SM16703P_SetPixel 0 255 0 0", 0);
+	CMD_ExecuteCommand("SM16703P_SetPixel 1 0 0 7", 0);
+	SELFTEST_ASSERT_HAS_UART_EMPTY();
+
+	// start code and all 512 channels
+	CMD_ExecuteCommand("SM16703P_Start", 0);
+	SELFTEST_ASSERT(SIM_UART_GetDataSize() == 513);
+	SELFTEST_ASSERT(SIM_UART_GetByte(0) == 0);
+	SELFTEST_ASSERT(SIM_UART_GetByte(1) == 255);
+	SELFTEST_ASSERT(SIM_UART_GetByte(6) == 7);
+	SELFTEST_ASSERT(SIM_UART_GetByte(512) == 0);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 255);
+	SIM_ClearUART();
+
+	// next frame has what was written since
+	CMD_ExecuteCommand("SM16703P_SetPixel 0 1 2 3", 0);
+	SELFTEST_ASSERT_HAS_UART_EMPTY();
+	CMD_ExecuteCommand("SM16703P_Start", 0);
+	SELFTEST_ASSERT(SIM_UART_GetDataSize() == 513);
+	SELFTEST_ASSERT(SIM_UART_GetByte(1) == 1);
+	SELFTEST_ASSERT(SIM_UART_GetByte(3) == 3);
+	SELFTEST_ASSERT(SIM_UART_GetByte(6) == 7);
+	SIM_ClearUART();
+}
+
+#endif
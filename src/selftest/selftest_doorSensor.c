@@ -5,6 +5,7 @@
 
 int Simulator_GetNoChangeTimePassed();
 int Simulator_GetDoorSennsorAutomaticWakeUpAfterSleepTime();
+int Simulator_GetDoorSensorBatchCount();
 
 const char *demo_noSleeper =
 "again:\n"
@@ -12,7 +13,98 @@ const char *demo_noSleeper =
 "if $CH1==1 then DSTime clear\n"
 "goto again\n";
 
+// sensor wakes often, so it reuses last DHCP lease instead of asking again
+static void Test_DoorSensor_FastConnect() {
+	SIM_ClearOBK(0);
+	CFG_SetFlag(OBK_FLAG_WIFI_FAST_CONNECT, true);
+	SELFTEST_ASSERT(g_cfg.dhcpLease.localIPAddr[0] == 0);
+	Main_ConnectToWiFiNow();
+	SELFTEST_ASSERT(SIM_GetLastWiFiConnectIP()->localIPAddr[0] == 0);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(g_cfg.dhcpLease.localIPAddr[0] == 127);
+	SELFTEST_ASSERT(g_cfg.dhcpLease.gatewayIPAddr[0] == 192);
+	SELFTEST_ASSERT(g_cfg.dhcpLease.netMask[0] == 255);
+
+	Main_ConnectToWiFiNow();
+	SELFTEST_ASSERT(SIM_GetLastWiFiConnectIP()->localIPAddr[0] == 127);
+	// one failure may be bad luck, after two DHCP is asked again
+	SIM_SetWiFiConnectFailures(2);
+	Main_ConnectToWiFiNow();
+	SELFTEST_ASSERT(SIM_GetLastWiFiConnectIP()->localIPAddr[0] == 127);
+	Main_ConnectToWiFiNow();
+	SELFTEST_ASSERT(SIM_GetLastWiFiConnectIP()->localIPAddr[0] == 127);
+	Main_ConnectToWiFiNow();
+	SELFTEST_ASSERT(SIM_GetLastWiFiConnectIP()->localIPAddr[0] == 0);
+
+	// configured static IP wins
+	str_to_ip("10.0.0.5", g_cfg.staticIP.localIPAddr);
+	Main_ConnectToWiFiNow();
+	SELFTEST_ASSERT(SIM_GetLastWiFiConnectIP()->localIPAddr[0] == 10);
+
+	// without fast connect lease is not used
+	SIM_ClearOBK(0);
+	memset(&g_cfg.staticIP, 0, sizeof(g_cfg.staticIP));
+	str_to_ip("127.0.0.1", g_cfg.dhcpLease.localIPAddr);
+	Main_ConnectToWiFiNow();
+	SELFTEST_ASSERT(SIM_GetLastWiFiConnectIP()->localIPAddr[0] == 0);
+	memset(&g_cfg.dhcpLease, 0, sizeof(g_cfg.dhcpLease));
+}
+// driver restart stands for reboot after deep sleep, batch state is in LFS
+static void Test_DoorSensor_Wake() {
+	CMD_ExecuteCommand("stopDriver DoorSensor", 0);
+	CMD_ExecuteCommand("startDriver DoorSensor", 0);
+}
+static void Test_DoorSensor_Batch() {
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("miscDevice", "bekens");
+	CMD_ExecuteCommand("lfs_format", 0);
+	CHANNEL_Set(1, 0, 0);
+	PIN_SetPinRoleForPinIndex(9, IOR_DoorSensorWithDeepSleep);
+	PIN_SetPinChannelForPinIndex(9, 1);
+
+	CMD_ExecuteCommand("startDriver DoorSensor", 0);
+	CMD_ExecuteCommand("DSTime 10 60", 0);
+	CMD_ExecuteCommand("DSBatch 3", 0);
+	SELFTEST_ASSERT(Main_IsWiFiHeld() == false);
+	// awake for 10s, then sleeps for 60s
+	Sim_RunSeconds(11, false);
+
+	// two timer wakes only take a sample, with WiFi off
+	Test_DoorSensor_Wake();
+	SELFTEST_ASSERT(Main_IsWiFiHeld());
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(Simulator_GetDoorSensorBatchCount() == 1);
+	Test_DoorSensor_Wake();
+	SELFTEST_ASSERT(Main_IsWiFiHeld());
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(Simulator_GetDoorSensorBatchCount() == 2);
+
+	// third one connects and sends both, at 202s of batch clock
+	SIM_ClearMQTTHistory();
+	Test_DoorSensor_Wake();
+	SELFTEST_ASSERT(Main_IsWiFiHeld() == false);
+	Sim_RunSeconds(11, false);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("miscDevice/batch/get",
+		"{\"samples\":[{\"age\":131,\"door\":0,\"mV\":0},{\"age\":70,\"door\":0,\"mV\":0}]}", false);
+	SELFTEST_ASSERT(Simulator_GetDoorSensorBatchCount() == 0);
+
+	// door change on wake that was meant to be sensor-only connects
+	Test_DoorSensor_Wake();
+	SELFTEST_ASSERT(Main_IsWiFiHeld());
+	CHANNEL_Set(1, 1, 0);
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(Main_IsWiFiHeld() == false);
+	SELFTEST_ASSERT(Simulator_GetDoorSensorBatchCount() == 0);
+
+	CMD_ExecuteCommand("DSBatch 0", 0);
+	CMD_ExecuteCommand("DSTime 60 0", 0);
+	CMD_ExecuteCommand("stopDriver DoorSensor", 0);
+	SIM_ClearMQTTHistory();
+}
 void Test_DoorSensor() {
+	Test_DoorSensor_FastConnect();
+	Test_DoorSensor_Batch();
+
 	// reset whole device
 	SIM_ClearOBK(0);
 
@@ -0,0 +1,68 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../httpserver/new_http.h"
+#include "../driver/drv_ds1820_full.h"
+
+#if ENABLE_DRIVER_DS1820_FULL
+
+// fake sensors of driver/drv_ds1820_full.c
+void SIM_DS18B20_SetBadReads(int index, int count);
+void SIM_DS18B20_GetReadCounts(int index, int *reads, int *crcErrors);
+
+#define TEST_DS18B20_SENSORS 6
+
+static int Test_DS18B20_TotalReads() {
+	int i, reads, crcErrors, total = 0;
+
+	for (i = 0; i < TEST_DS18B20_SENSORS; i++) {
+		SIM_DS18B20_GetReadCounts(i, &reads, &crcErrors);
+		total += reads;
+	}
+	return total;
+}
+
+void Test_DS18B20() {
+	int i, reads, crcErrors, total, prev;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_DS1820_IO);
+	CMD_ExecuteCommand("startDriver DS1820_FULL 60", 0);
+	CMD_ExecuteCommand("DS1820_FULL_setsensor \"0x28 0xFF 0xAA 0xBB 0xCC 0xDD 0xEE 0x02\" 9 \"second\" 3", 0);
+	// second sensor gives bad CRC twice
+	SIM_DS18B20_SetBadReads(1, 2);
+
+	// conversion, then reads spread over seconds, at most 4 each
+	prev = 0;
+	for (i = 0; i < 5; i++) {
+		Sim_RunSeconds(1, false);
+		total = Test_DS18B20_TotalReads();
+		SELFTEST_ASSERT(total - prev <= DS18B20_READS_PER_SECOND);
+		prev = total;
+	}
+	// bad reads are tried again on later seconds, counted as CRC errors
+	SIM_DS18B20_GetReadCounts(1, &reads, &crcErrors);
+	SELFTEST_ASSERT(reads == 3 && crcErrors == 2);
+	SELFTEST_ASSERT(CHANNEL_Get(3) >= 2000 && CHANNEL_Get(3) <= 2120);
+	for (i = 0; i < TEST_DS18B20_SENSORS; i++) {
+		if (i != 1) {
+			SIM_DS18B20_GetReadCounts(i, &reads, &crcErrors);
+			SELFTEST_ASSERT(reads == 1 && crcErrors == 0);
+		}
+	}
+
+	// sensor that keeps failing is given up after 5 reads
+	CMD_ExecuteCommand("stopDriver DS1820_FULL", 0);
+	CMD_ExecuteCommand("startDriver DS1820_FULL 60", 0);
+	SIM_DS18B20_SetBadReads(2, 100);
+	Sim_RunSeconds(10, false);
+	SIM_DS18B20_GetReadCounts(2, &reads, &crcErrors);
+	SELFTEST_ASSERT(reads == 5 && crcErrors == 5);
+
+	SIM_DS18B20_SetBadReads(2, 0);
+	CMD_ExecuteCommand("stopDriver DS1820_FULL", 0);
+}
+
+#endif
+
+#endif
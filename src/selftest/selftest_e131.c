@@ -0,0 +1,144 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_local.h"
+
+#if ENABLE_DRIVER_E131
+
+bool Strip_VerifyPixel(uint32_t pixel, byte r, byte g, byte b);
+byte DMX_GetByte(uint32_t idx);
+
+static byte g_e131Packet[640];
+
+static int Test_E131_BuildSACN(int universe, int seq, int syncUniverse, const byte *dmx, int channels) {
+	byte *p = g_e131Packet;
+
+	memset(p, 0, sizeof(g_e131Packet));
+	// root layer
+	p[1] = 0x10;
+	memcpy(p + 4, "ASC-E1.17", 9);
+	p[21] = 0x04;
+	// framing layer
+	p[43] = 0x02;
+	strcpy((char*)p + 44, "selftest");
+	p[108] = 100;
+	p[109] = syncUniverse >> 8;
+	p[110] = syncUniverse;
+	p[111] = seq;
+	p[113] = universe >> 8;
+	p[114] = universe;
+	// DMP layer, count has start code too
+	p[117] = 0x02;
+	p[118] = 0xA1;
+	p[122] = 1;
+	p[123] = (channels + 1) >> 8;
+	p[124] = channels + 1;
+	memcpy(p + 126, dmx, channels);
+	return 126 + channels;
+}
+static void Test_E131_SendSACN(int universe, int seq, int syncUniverse, const byte *dmx, int channels) {
+	E131_ProcessPacket(g_e131Packet, Test_E131_BuildSACN(universe, seq, syncUniverse, dmx, channels));
+}
+static void Test_E131_SendSACNSync(int syncUniverse) {
+	byte *p = g_e131Packet;
+
+	memset(p, 0, 49);
+	p[1] = 0x10;
+	memcpy(p + 4, "ASC-E1.17", 9);
+	p[21] = 0x08;
+	p[43] = 0x01;
+	p[45] = syncUniverse >> 8;
+	p[46] = syncUniverse;
+	E131_ProcessPacket(p, 49);
+}
+static void Test_E131_SendArtNet(int opcode, int universe, int seq, const byte *dmx, int channels) {
+	byte *p = g_e131Packet;
+
+	memset(p, 0, 18);
+	memcpy(p, "Art-Net", 8);
+	p[8] = opcode;
+	p[9] = opcode >> 8;
+	p[11] = 14;
+	p[12] = seq;
+	p[14] = universe;
+	p[15] = universe >> 8;
+	p[16] = channels >> 8;
+	p[17] = channels;
+	memcpy(p + 18, dmx, channels);
+	E131_ProcessPacket(p, opcode == 0x5000 ? 18 + channels : 14);
+}
+
+void Test_E131() {
+	const byte red[] = { 1, 2, 3, 4, 5, 6 };
+	const byte blue[] = { 9, 8, 7 };
+	const byte rgbw[] = { 0, 10, 20, 30, 40 };
+	unsigned int packets, lost, latency;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver DMX", 0);
+	CMD_ExecuteCommand("SM16703P_Init 200 RGB", 0);
+	CMD_ExecuteCommand("startDriver E131 5", 0);
+
+	// 200 pixels are universes 5 and 6, frame is sent when both came
+	Test_E131_SendSACN(5, 1, 0, red, 6);
+	SELFTEST_ASSERT(Strip_VerifyPixel(1, 4, 5, 6));
+	SELFTEST_ASSERT(DMX_GetByte(0) == 0);
+	SELFTEST_ASSERT(E131_GetFramesShown() == 0);
+	Test_E131_SendSACN(6, 1, 0, blue, 3);
+	SELFTEST_ASSERT(Strip_VerifyPixel(170, 9, 8, 7));
+	SELFTEST_ASSERT(E131_GetFramesShown() == 1);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 1);
+	SELFTEST_ASSERT(DMX_GetByte(5) == 6);
+
+	// two lost packets, and universe 5 again before 6 shows what came
+	Test_E131_SendSACN(5, 4, 0, blue, 3);
+	Test_E131_SendSACN(5, 5, 0, red, 3);
+	SELFTEST_ASSERT(E131_GetFramesShown() == 2);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 9);
+	SELFTEST_ASSERT(E131_GetUniverseStats(5, &packets, &lost, &latency));
+	SELFTEST_ASSERT(packets == 3);
+	SELFTEST_ASSERT(lost == 2);
+	SELFTEST_ASSERT(E131_GetUniverseStats(7, &packets, &lost, &latency) == false);
+	// not mapped
+	Test_E131_SendSACN(7, 1, 0, red, 3);
+	SELFTEST_ASSERT(E131_GetFramesShown() == 2);
+
+	// sender uses sync, nothing is shown until sync packet
+	Test_E131_SendSACN(6, 2, 100, red, 3);
+	Test_E131_SendSACN(5, 6, 100, blue, 3);
+	Test_E131_SendSACN(6, 3, 100, blue, 3);
+	SELFTEST_ASSERT(E131_GetFramesShown() == 2);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 9 && DMX_GetByte(1) == 8);
+	Test_E131_SendSACN(5, 7, 100, red, 3);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 9);
+	Test_E131_SendSACNSync(100);
+	SELFTEST_ASSERT(E131_GetFramesShown() == 3);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 1);
+
+	// Art-Net, own map with RGBW pixels from channel 4
+	CMD_ExecuteCommand("SM16703P_Init 4 RGBW", 0);
+	CMD_ExecuteCommand("E131_Map 0 2 2 2 4", 0);
+	Test_E131_SendArtNet(0x5000, 0, 0, red, 6);
+	SELFTEST_ASSERT(E131_GetFramesShown() == 4);
+	SELFTEST_ASSERT(DMX_GetByte(8) == 2);
+	SELFTEST_ASSERT(DMX_GetByte(11) == 5);
+	SELFTEST_ASSERT(DMX_GetByte(12) == 0);
+	SELFTEST_ASSERT(E131_GetUniverseStats(5, &packets, &lost, &latency) == false);
+	Test_E131_SendArtNet(0x5200, 0, 0, 0, 0);
+	Test_E131_SendArtNet(0x5000, 0, 1, rgbw, 5);
+	SELFTEST_ASSERT(DMX_GetByte(8) == 2);
+	Test_E131_SendArtNet(0x5200, 0, 0, 0, 0);
+	SELFTEST_ASSERT(E131_GetFramesShown() == 5);
+	SELFTEST_ASSERT(DMX_GetByte(8) == 10);
+	SELFTEST_ASSERT(DMX_GetByte(11) == 40);
+	SELFTEST_ASSERT(E131_GetUniverseStats(0, &packets, &lost, &latency));
+	SELFTEST_ASSERT(packets == 2);
+	SELFTEST_ASSERT(lost == 0);
+
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("Universe 0 (pixels 2-3): 2 packets, 0 lost");
+}
+
+#endif
+
+#endif
@@ -1,6 +1,8 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_uart.h"
+#include "../driver/drv_spi.h"
 
 #if ENABLE_BL_SHARED
 
@@ -126,6 +128,197 @@ void Test_EnergyMeter_BL0942() {
 
 	SIM_ClearMQTTHistory();
 }
+// BL0942 reply for given chip address, raw values for default calibration
+static void Test_BL0942_FakeReply(int addr, float v, float c, float p, int cfCnt) {
+	byte data[23];
+	byte checksum = 0x58 | addr;
+	int i;
+	int raw;
+
+	memset(data, 0, sizeof(data));
+	data[0] = 0x55;
+	raw = (int)(251210 * c);
+	data[1] = raw; data[2] = raw >> 8; data[3] = raw >> 16;
+	raw = (int)(15188 * v);
+	data[4] = raw; data[5] = raw >> 8; data[6] = raw >> 16;
+	raw = (int)(598 * p);
+	data[10] = raw; data[11] = raw >> 8; data[12] = raw >> 16;
+	data[13] = cfCnt; data[14] = cfCnt >> 8; data[15] = cfCnt >> 16;
+	// 50Hz
+	raw = 20000;
+	data[16] = raw; data[17] = raw >> 8;
+	for (i = 0; i < sizeof(data) - 1; i++) {
+		checksum += data[i];
+	}
+	data[22] = checksum ^ 0xFF;
+	for (i = 0; i < sizeof(data); i++) {
+		UART_AppendByteToReceiveRingBuffer(data[i]);
+	}
+}
+
+// chips on fake bus answer read requests sent by driver,
+// returns count of requests seen for each address
+static void Test_BL0942_RunBus(int ms, int answerMask, int *requests) {
+	int addr;
+
+	for (; ms > 0; ms -= 10) {
+		Sim_RunFrames(1, false);
+		while (SIM_UART_GetDataSize() >= 2) {
+			addr = SIM_UART_GetByte(0) & 3;
+			SELFTEST_ASSERT((SIM_UART_GetByte(0) & 0xFC) == 0x58);
+			SELFTEST_ASSERT(SIM_UART_GetByte(1) == 0xAA);
+			SIM_UART_ConsumeBytes(2);
+			requests[addr]++;
+			if (answerMask & (1 << addr)) {
+				if (addr == 1) {
+					Test_BL0942_FakeReply(1, 230, 0.26f, 60, 0);
+				}
+				else {
+					Test_BL0942_FakeReply(addr, 232, 0.17f, 40, 0);
+				}
+			}
+		}
+	}
+}
+
+void Test_EnergyMeter_BL0942_Bus() {
+	int initCounter;
+	int requests[4];
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("miscDevice", "bekens");
+	SIM_UART_InitReceiveRingBuffer(512);
+	SIM_ClearUART();
+
+	// chips at addresses 1 and 2, polled every 250ms
+	CMD_ExecuteCommand("startDriver BL0942 4800 6 250", 0);
+	// both chips were set up once, each with own address
+	SELFTEST_ASSERT_HAS_SENT_UART_STRING("A91D550000E4");
+	SELFTEST_ASSERT_HAS_SENT_UART_STRING("A9198F0000AE");
+	SELFTEST_ASSERT_HAS_SENT_UART_STRING("AA1D550000E3");
+	SELFTEST_ASSERT_HAS_SENT_UART_STRING("AA198F0000AD");
+	SELFTEST_ASSERT_HAS_UART_EMPTY();
+	initCounter = get_g_uart_init_counter();
+
+	// first chip is asked, second only after first replied
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_HAS_SENT_UART_STRING("59AA");
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT_HAS_UART_EMPTY();
+	Test_BL0942_FakeReply(1, 230, 0.26f, 60, 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_HAS_SENT_UART_STRING("5AAA");
+	Test_BL0942_FakeReply(2, 232, 0.17f, 40, 0);
+	// round done, next one waits for poll time
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_HAS_UART_EMPTY();
+
+	// four rounds a second, single dataset, so chips add up
+	memset(requests, 0, sizeof(requests));
+	Test_BL0942_RunBus(2000, 6, requests);
+	SELFTEST_ASSERT(requests[1] == 8 && requests[2] == 8);
+	SELFTEST_ASSERT(requests[0] == 0 && requests[3] == 0);
+	SELFTEST_ASSERT_EXPRESSION("$power", 100);
+	SELFTEST_ASSERT_EXPRESSION("$current", 0.43f);
+	SELFTEST_ASSERT_EXPRESSION("$voltage", 231);
+
+	// silent chip times out, the other is still polled, and after
+	// a few misses only the other one counts
+	memset(requests, 0, sizeof(requests));
+	Test_BL0942_RunBus(2000, 4, requests);
+	SELFTEST_ASSERT(requests[1] == 8 && requests[2] == 8);
+	SELFTEST_ASSERT_EXPRESSION("$power", 40);
+	SELFTEST_ASSERT_EXPRESSION("$voltage", 232);
+
+	// port is set up only once
+	SELFTEST_ASSERT(initCounter == get_g_uart_init_counter());
+
+	CMD_ExecuteCommand("stopDriver BL0942", 0);
+	// 14 frames above, later tests expect to start on whole second
+	Sim_RunFrames(86, false);
+	SIM_ClearUART();
+	SIM_ClearMQTTHistory();
+}
+// fake BL0942 on SPI, register reads answer with checksum, one register
+// can be given bad checksum
+static uint32_t g_testBL0942Regs[256];
+static int g_testBL0942BadReg = -1;
+static int g_testBL0942Reads;
+
+static void Test_BL0942_SPIDevice(const void *tx, uint32_t txSize, void *rx, uint32_t rxSize) {
+	const byte *t = (const byte*)tx;
+	byte *r = (byte*)rx;
+	uint32_t val;
+
+	if (txSize == 6 && t[0] == 0xA8) {
+		g_testBL0942Regs[t[1]] = (t[2] << 16) | (t[3] << 8) | t[4];
+		return;
+	}
+	if (txSize != 2 || t[0] != 0x58 || rxSize != 4) {
+		return;
+	}
+	g_testBL0942Reads++;
+	val = g_testBL0942Regs[t[1]];
+	r[0] = val >> 16;
+	r[1] = val >> 8;
+	r[2] = val;
+	r[3] = (t[0] + t[1] + r[0] + r[1] + r[2]) ^ 0xFF;
+	if (t[1] == g_testBL0942BadReg) {
+		r[3] ^= 0x01;
+	}
+}
+
+// raw values for default calibration
+static void Test_BL0942_SetSPIRegs(float v, float c, float p) {
+	g_testBL0942Regs[0x03] = (int)(251210 * c);
+	g_testBL0942Regs[0x04] = (int)(15188 * v);
+	g_testBL0942Regs[0x06] = (int)(598 * p);
+	// 50Hz
+	g_testBL0942Regs[0x08] = 20000;
+}
+
+void Test_EnergyMeter_BL0942_SPI() {
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("miscDevice", "bekens");
+	memset(g_testBL0942Regs, 0, sizeof(g_testBL0942Regs));
+	g_testBL0942BadReg = -1;
+	SIM_SPI_SetDevice(Test_BL0942_SPIDevice);
+
+	CMD_ExecuteCommand("startDriver BL0942SPI", 0);
+	// mode register was written
+	SELFTEST_ASSERT(g_testBL0942Regs[0x19] != 0);
+
+	// one read per register of scan list each second
+	Test_BL0942_SetSPIRegs(230, 0.26f, 60);
+	g_testBL0942Reads = 0;
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(g_testBL0942Reads == 5);
+	SELFTEST_ASSERT_EXPRESSION("$power", 60);
+	SELFTEST_ASSERT_EXPRESSION("$voltage", 230);
+
+	// bad checksum on last register drops whole update
+	Test_BL0942_SetSPIRegs(232, 0.52f, 120);
+	g_testBL0942BadReg = 0x08;
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_EXPRESSION("$power", 60);
+	SELFTEST_ASSERT_EXPRESSION("$voltage", 230);
+	// and on first one, nothing more is read that second
+	g_testBL0942BadReg = 0x03;
+	g_testBL0942Reads = 0;
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(g_testBL0942Reads == 1);
+	SELFTEST_ASSERT_EXPRESSION("$power", 60);
+
+	// good again
+	g_testBL0942BadReg = -1;
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_EXPRESSION("$power", 120);
+	SELFTEST_ASSERT_EXPRESSION("$voltage", 232);
+
+	CMD_ExecuteCommand("stopDriver BL0942SPI", 0);
+	SIM_SPI_SetDevice(0);
+	SIM_ClearMQTTHistory();
+}
 void Test_EnergyMeter_CSE7766() {
 	SIM_ClearOBK(0);
 	SIM_ClearAndPrepareForMQTTTesting("miscDevice", "bekens");
@@ -532,6 +725,107 @@ void Test_EnergyMeter_ResetBug() {
 
 	SIM_ClearMQTTHistory();
 }
+void Test_EnergyMeter_Stats() {
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("miscDevice", "bekens");
+
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+	CMD_ExecuteCommand("SetupEnergyStats 1 10 10 1", 0);
+	CMD_ExecuteCommand("SetupTestPower 230 1 360 50 0", 0);
+	Sim_RunSeconds(5, false);
+	SELFTEST_ASSERT(SIM_BeginParsingMQTTJSON("miscDevice/consumption_stats/get", false));
+	// period ends once a second apart from readings
+	Sim_RunSeconds(7, false);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("miscDevice/consumption_stats/get", false);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "consumption_sample_count", 10);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "consumption_sampling_period", 10);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "consumption_stat_index", 0);
+	SELFTEST_ASSERT(strstr(SIM_GetMQTTHistoryString("miscDevice/consumption_stats/get", false), "\"consumption_samples\":[") != 0);
+	// next period
+	SIM_ClearMQTTHistory();
+	Sim_RunSeconds(10, false);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("miscDevice/consumption_stats/get", false);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "consumption_stat_index", 1);
+
+	SIM_ClearMQTTHistory();
+}
+void Test_EnergyMeter_Windows() {
+	const char *dump;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("miscDevice", "bekens");
+
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+	CMD_ExecuteCommand("SetupTestPower 230 1 360 50 0", 0);
+	// ring of 8, 2 s and 5 s windows
+	CMD_ExecuteCommand("SetupEnergyWindows 1 8 2 5 0", 0);
+	Sim_RunSeconds(3, false);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("miscDevice/energy_window_2/get", false);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "window", 2);
+	SELFTEST_ASSERT(SIM_BeginParsingMQTTJSON("miscDevice/energy_window_5/get", false));
+	Sim_RunSeconds(3, false);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("miscDevice/energy_window_5/get", false);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "count", 5);
+	dump = SIM_GetMQTTHistoryString("miscDevice/energy_window_5/get", false);
+	SELFTEST_ASSERT(strstr(dump, "\"power_min\":360.00,\"power_max\":360.00,\"power_mean\":360.00,\"power_rms\":360.00") != 0);
+	SELFTEST_ASSERT(strstr(dump, "\"voltage_rms\":230.0") != 0);
+	SIM_ClearMQTTHistory();
+
+	// ring keeps newest 8, delta coded, steady power gives zero deltas
+	Sim_RunSeconds(10, false);
+	CMD_ExecuteCommand("EnergyTraceDump", 0);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("miscDevice/energy_trace/get", false);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "count", 8);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "parts", 1);
+	dump = SIM_GetMQTTHistoryString("miscDevice/energy_trace/get", false);
+	SELFTEST_ASSERT(strstr(dump, "\"power\":[3600,0,0,0,0,0,0,0]") != 0);
+	SELFTEST_ASSERT(strstr(dump, "\"voltage\":[2300,0,") != 0);
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("EnergyTraceDump 3", 0);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("miscDevice/energy_trace/get", false);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "count", 3);
+
+	CMD_ExecuteCommand("SetupEnergyWindows 0", 0);
+	SIM_ClearMQTTHistory();
+}
+#if ENABLE_BL_HISTORY
+void Test_EnergyMeter_History() {
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+	// 2025-01-31 23:55 UTC
+	NTP_SetSimulatedTime(1738367700);
+
+	CMD_ExecuteCommand("startDriver TESTPOWER", 0);
+	CMD_ExecuteCommand("SetupTestPower 230 1 360 50 0", 0);
+	CMD_ExecuteCommand("EnergyCntReset 0", 0);
+	CMD_ExecuteCommand("EnergyHistory 60 3", 0);
+	// first minute is recorded at 23:56
+	Sim_RunSeconds(65, false);
+	CMD_ExecuteCommand("EnergyCntReset 500", 0);
+	Sim_RunSeconds(60, false);
+	Test_FakeHTTPClientPacket_JSON("api/energyhistory");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "count", 2);
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("[1738367820,500000]");
+
+	// as after reboot, new block is started in same file
+	CMD_ExecuteCommand("EnergyHistory 60 3", 0);
+	Sim_RunSeconds(60, false);
+	CMD_ExecuteCommand("EnergyCntReset 1700", 0);
+	Sim_RunSeconds(60 * 4, false);
+	Test_FakeHTTPClientPacket_JSON("api/energyhistory");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "count", 7);
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("[1738367940,11999");
+	// 00:00 closes January, next ones are in February file
+	Test_FakeHTTPClientPacket_JSON("api/energyhistory?from=1738367999");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "count", 3);
+	Test_FakeHTTPClientPacket_JSON("api/energyhistory?from=1738368000");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "count", 2);
+	Test_FakeHTTPClientPacket_JSON("api/energyhistory?from=1738367820&to=1738367940");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "count", 2);
+
+	CMD_ExecuteCommand("EnergyHistory 0", 0);
+}
+#endif
 void Test_EnergyMeter() {
 	Test_EnergyMeter_ResetBug();
 	Test_EnergyMeter_CSE7766();
@@ -539,11 +833,18 @@ void Test_EnergyMeter() {
 	// TODO: fix on Linux
 	Test_EnergyMeter_BL0942();
 #endif
+	Test_EnergyMeter_BL0942_Bus();
+	Test_EnergyMeter_BL0942_SPI();
 	Test_EnergyMeter_Basic();
 	Test_EnergyMeter_Tasmota();
 	Test_EnergyMeter_Events();
 	Test_EnergyMeter_TurnOffScript();
 	Test_EnergyMeter_Limits();
+	Test_EnergyMeter_Stats();
+	Test_EnergyMeter_Windows();
+#if ENABLE_BL_HISTORY
+	Test_EnergyMeter_History();
+#endif
 }
 
 #endif
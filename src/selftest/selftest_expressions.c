@@ -268,6 +268,14 @@ void Test_Expressions_RunTests_Basic() {
 	//SELFTEST_ASSERT_EXPRESSION("15.0/$CH18+1000\n\r", 1.0f + 1000);
 	//SELFTEST_ASSERT_EXPRESSION("1.50/$CH18+1000\n\r", 0.1f + 1000);
 
+	// constant names are case insensitive and may share their first letters
+	CHANNEL_Set(5, 7, 0);
+	CHANNEL_Set(45, 3, 0);
+	SELFTEST_ASSERT_EXPRESSION("$ch5", 7);
+	SELFTEST_ASSERT_EXPRESSION("$Ch45", 3);
+	SELFTEST_ASSERT_EXPRESSION("$CH5+$CH45", 10);
+	SELFTEST_ASSERT_EXPRESSION("$activeRepeatingEvents", 0);
+	SELFTEST_ASSERT_EXPRESSION("$ACTIVEREPEATINGEVENTS+1", 1);
 }
 
 
@@ -312,4 +320,41 @@ void Test_Expressions_RunTests_Braces() {
 
 }
 
+// expressions with constants are compiled and cached, so make sure
+// that the cached code still sees the current values
+void Test_Expressions_RunTests_Compiled() {
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	for (i = 0; i < 20; i++) {
+		CHANNEL_Set(1, i, 0);
+		CHANNEL_Set(2, 2 * i, 0);
+		SELFTEST_ASSERT_EXPRESSION("$CH1*10", i * 10);
+		SELFTEST_ASSERT_EXPRESSION("$CH1+$CH2", i * 3);
+		SELFTEST_ASSERT_EXPRESSION("($CH1+1)*($CH2-1)", (i + 1) * (2 * i - 1));
+		SELFTEST_ASSERT_EXPRESSION("$CH1>5", i > 5);
+		SELFTEST_ASSERT_EXPRESSION("!$CH1", !i);
+		SELFTEST_ASSERT_EXPRESSION("$CH1>5 && $CH2<30", (i > 5 && 2 * i < 30));
+		SELFTEST_ASSERT_EXPRESSION(" $CH1 % 3 ", i % 3);
+		SELFTEST_ASSERT_EXPRESSION("-$CH2+100", 100 - 2 * i);
+	}
+	// more distinct expressions than cache slots
+	for (i = 0; i < 20; i++) {
+		char tmp[32];
+		sprintf(tmp, "$CH1*%i", i);
+		SELFTEST_ASSERT_EXPRESSION(tmp, 19 * i);
+		SELFTEST_ASSERT_EXPRESSION("$CH1*10", 190);
+	}
+	// if command uses the same path
+	CMD_ExecuteCommand("setChannel 3 0", 0);
+	for (i = 0; i < 5; i++) {
+		CMD_ExecuteCommand("if $CH3<3 then addChannel 3 1", 0);
+	}
+	SELFTEST_ASSERT_CHANNEL(3, 3);
+	// longer chain of operators
+	SELFTEST_ASSERT_EXPRESSION("$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1+$CH1", 380);
+}
+
 #endif
@@ -2,7 +2,72 @@
 
 #include "selftest_local.h"
 
+static void Test_Flags_Journal() {
+	int full, journal, used, full0, journal0, used0, i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("flags 0", 0);
+	CFG_Save_IfThereArePendingChanges();
+	CFG_GetSaveStats(&full0, &journal0, &used0);
+	CMD_ExecuteCommand("SetFlag 5 1", 0);
+	CFG_Save_IfThereArePendingChanges();
+	CFG_GetSaveStats(&full, &journal, &used);
+	// flag bit and change counter, not whole config
+	SELFTEST_ASSERT(full == full0);
+	SELFTEST_ASSERT(journal == journal0 + 1);
+	SELFTEST_ASSERT(used > used0);
+	SELFTEST_ASSERT(used - used0 < 32);
+	CMD_ExecuteCommand("SetFlag 5 0", 0);
+	CMD_ExecuteCommand("SetFlag 7 1", 0);
+	CFG_Save_IfThereArePendingChanges();
+	CFG_GetSaveStats(&full, &journal, &used);
+
+	// journal is applied on load, and continued after it
+	g_cfg.genericFlags = 0;
+	CFG_InitAndLoad();
+	SELFTEST_ASSERT_FLAG(5, false);
+	SELFTEST_ASSERT_FLAG(7, true);
+	CFG_GetSaveStats(&full, &journal, &used0);
+	SELFTEST_ASSERT(used0 == used);
+
+	// full journal is folded into new full save
+	CFG_GetSaveStats(&full0, &journal0, &used);
+	for (i = 0; i < 100; i++) {
+		CMD_ExecuteCommand(i % 2 ? "SetFlag 9 1" : "SetFlag 9 0", 0);
+		CFG_Save_IfThereArePendingChanges();
+	}
+	CFG_GetSaveStats(&full, &journal, &used);
+	SELFTEST_ASSERT(full > full0);
+	SELFTEST_ASSERT(journal - journal0 > full - full0);
+	g_cfg.genericFlags = 0;
+	CFG_InitAndLoad();
+	SELFTEST_ASSERT_FLAG(7, true);
+	SELFTEST_ASSERT_FLAG(9, true);
+
+	// before reboot and OTA, journal and pending changes go to full save
+	CMD_ExecuteCommand("SetFlag 11 1", 0);
+	CFG_Save_IfThereArePendingChanges();
+	CMD_ExecuteCommand("SetFlag 12 1", 0);
+	CFG_GetSaveStats(&full0, &journal0, &used0);
+	SELFTEST_ASSERT(used0 > 0);
+	CFG_Save_Compact();
+	CFG_GetSaveStats(&full, &journal, &used);
+	SELFTEST_ASSERT(full == full0 + 1);
+	SELFTEST_ASSERT(used == 0);
+	// nothing left to fold
+	CFG_Save_Compact();
+	CFG_GetSaveStats(&full, &journal, &used);
+	SELFTEST_ASSERT(full == full0 + 1);
+	g_cfg.genericFlags = 0;
+	CFG_InitAndLoad();
+	SELFTEST_ASSERT_FLAG(11, true);
+	SELFTEST_ASSERT_FLAG(12, true);
+	CMD_ExecuteCommand("flags 0", 0);
+	CFG_Save_IfThereArePendingChanges();
+}
 void Test_Flags() {
+	Test_Flags_Journal();
 	// reset whole device
 	SIM_ClearOBK(0);
 	// test flags
@@ -1,37 +1,167 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../win32/stubs/flash_pub.h"
+#include "../driver/drv_local.h"
+
+void SIM_ClearAndPrepareForMQTTTesting(const char *clientName, const char *groupName);
+uint16_t crc16(const uint8_t *b, int from, int to, uint16_t initial_value);
 
 void Test_Flash_Search() {
-	/*int tr;
-	int check;
+	int tr, j;
+	int at;
 	int testAdr = 26293;
 	byte testData[] = { 0xFF, 0xFE, 0x01, 0x02, 0x03, 0x04, 0x05, 0xFC, 0xFB, 0xFA, 0xBA, 0xAD, 0xF0, 0x0D, 0xAB, 0xCD };
 	int testDataLen = sizeof(testData);
+	// first bytes repeat, so naive restart after mismatch would miss it
+	byte overlap[] = { 0xA5, 0xA5, 0xA5, 0x5A };
+	byte overlapFlash[] = { 0xA5, 0xA5, 0xA5, 0xA5, 0xA5, 0x5A };
+	char *saved;
+
 	SIM_ClearOBK(0);
 	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+	// writes below go all over flash, it is put back at end
+	saved = (char*)malloc(0x200000);
+	flash_read(saved, 0x200000, 0);
 
-	flash_write(testData, testDataLen, testAdr);
-
+	flash_write((char*)testData, testDataLen, testAdr);
 
 	SELFTEST_ASSERT(Flash_FindPattern(testData, testDataLen, 0x0, 0x200000) == testAdr);
+	// whole flash when it is not there
+	testData[0] = 0x11;
+	SELFTEST_ASSERT(Flash_FindPattern(testData, testDataLen, 0x0, 0x200000) == -1);
+	testData[0] = 0xFF;
+	// range ending inside of it
+	SELFTEST_ASSERT(Flash_FindPattern(testData, testDataLen, 0x0, testAdr + testDataLen - 1) == -1);
+	SELFTEST_ASSERT(Flash_FindPattern(testData, testDataLen, testAdr, testAdr + testDataLen) == testAdr);
+
+	flash_write((char*)overlapFlash, sizeof(overlapFlash), 0x10000);
+	SELFTEST_ASSERT(Flash_FindPattern(overlap, sizeof(overlap), 0x0, 0x200000) == 0x10002);
+
+	// pattern across every place of chunk boundary
+	for (j = 1; j < testDataLen; j++) {
+		testData[2] = 0x40 + j;
+		testAdr = 0x20000 + j * 0x1000 - j;
+		flash_write((char*)testData, testDataLen, testAdr);
+		SELFTEST_ASSERT(Flash_FindPattern(testData, testDataLen, 0x0, 0x200000) == testAdr);
+		// and from unaligned start
+		SELFTEST_ASSERT(Flash_FindPattern(testData, testDataLen, testAdr - 3, 0x200000) == testAdr);
+	}
+	// same for pattern with repeating start
+	for (j = 1; j < (int)sizeof(overlapFlash); j++) {
+		testAdr = 0x40000 + j * 0x1000 - j;
+		flash_write((char*)overlapFlash, sizeof(overlapFlash), testAdr);
+		SELFTEST_ASSERT(Flash_FindPattern(overlap, sizeof(overlap), 0x30000, 0x200000) == testAdr + 2);
+		memset(overlapFlash, 0, sizeof(overlapFlash));
+		flash_write((char*)overlapFlash, sizeof(overlapFlash), testAdr);
+		overlapFlash[0] = overlapFlash[1] = overlapFlash[2] = overlapFlash[3] = overlapFlash[4] = 0xA5;
+		overlapFlash[5] = 0x5A;
+	}
 
-	for (tr = 0; tr < 200; tr++) {
+	for (tr = 0; tr < 50; tr++) {
 		// random ofs
-		testAdr = 0x1 + rand() % 0x200000 - testDataLen;
-		printf("Loop %i, adr %i\n", tr, testAdr);
+		testAdr = rand() % (0x200000 - testDataLen);
 		// random content with attempt index encoded inside so it's unique
 		// (so we won't get it by pure chance somewhere else in the test flash)
-		for (int j = 0; j < 4; j++) {
-			testData[2 + j] = tr;
+		for (j = 0; j < 4; j++) {
+			testData[2 + j] = 0x80 + tr;
 		}
-		// write
-		flash_write(testData, testDataLen, testAdr);
-		// checksearch
-		int at = Flash_FindPattern(testData, testDataLen, 0x0, 0x200000);
-		printf("Found at %i\n", at);
+		flash_write((char*)testData, testDataLen, testAdr);
+		at = Flash_FindPattern(testData, testDataLen, 0x0, 0x200000);
 		SELFTEST_ASSERT(at == testAdr);
-	}*/
+	}
+	SELFTEST_ASSERT(CMD_ExecuteCommand("FindPattern 0x0 0x200000 A5A5A55A", 0) == CMD_RES_OK);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("FindPattern 0x0 0x200000 A5A", 0) == CMD_RES_BAD_ARGUMENT);
+	flash_write(saved, 0x200000, 0);
+	free(saved);
+	SIM_ClearOBK(0);
+}
+
+#if ENABLE_DRIVER_BKPARTITIONS
+// writes data as BKPartitions reads it, 32 bytes and CRC16 per 34 byte record
+static void Test_BKPartitions_Write(const byte *data, int len, int stream) {
+	byte rec[34];
+	uint16_t crc;
+	int q;
+
+	for (q = 0; q < len; q += 32) {
+		memcpy(rec, data + q, 32);
+		crc = crc16(rec, 0, 32, 0xffff);
+		rec[32] = crc >> 8;
+		rec[33] = crc & 0xFF;
+		flash_write((char*)rec, 34, (stream + q) / 32 * 34);
+	}
+}
+static void Test_BKPartitions_Put32(byte *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
 }
+void Test_BKPartitions() {
+	static byte data[1536];
+	const PartitionRecord *found;
+	char *saved;
+	int i, count, bApp, bNet;
+
+	SIM_ClearOBK(0);
+	saved = (char*)malloc(0x200000);
+	flash_read(saved, 0x200000, 0);
+
+	memset(data, 0xFF, sizeof(data));
+	// fal64 across border of driver sections (512 data bytes)
+	memcpy(data + 500, "01PE", 4);
+	memset(data + 504, 0, 24);
+	strcpy((char*)data + 504, "app");
+	memcpy(data + 528, "beken_onchip_crc", 16);
+	Test_BKPartitions_Put32(data + 552, 0x11000);
+	Test_BKPartitions_Put32(data + 556, 0x121000);
+	Test_BKPartitions_Put32(data + 560, 0);
+	// fal48 with magic split between sections
+	memcpy(data + 1022, "01PE", 4);
+	memset(data + 1026, 0, 16);
+	strcpy((char*)data + 1026, "net_param");
+	memcpy(data + 1042, "beken_onchip_crc", 16);
+	Test_BKPartitions_Put32(data + 1058, 0x1D0000);
+	Test_BKPartitions_Put32(data + 1062, 0x1000);
+	Test_BKPartitions_Put32(data + 1066, 7);
+	Test_BKPartitions_Write(data, sizeof(data), 512 * 200);
+
+	CMD_ExecuteCommand("startDriver BKPartitions", 0);
+	// few sections a frame, whole flash takes about thousand of them
+	for (i = 0; i < 2000 && !BKPartitions_IsDone(); i++) {
+		Sim_RunFrames(1, false);
+	}
+	SELFTEST_ASSERT(BKPartitions_IsDone());
+	count = BKPartitions_GetFound(&found);
+	bApp = bNet = 0;
+	for (i = 0; i < count; i++) {
+		if (!strcmp(found[i].name, "app")) {
+			bApp = 1;
+			SELFTEST_ASSERT(found[i].at == 3215 * 34 + 20);
+			SELFTEST_ASSERT(found[i].offset == 0x11000);
+			SELFTEST_ASSERT(found[i].length == 0x121000);
+			SELFTEST_ASSERT(!strcmp(found[i].layout, "fal64"));
+		}
+		if (!strcmp(found[i].name, "net_param")) {
+			bNet = 1;
+			SELFTEST_ASSERT(found[i].at == 3231 * 34 + 30);
+			SELFTEST_ASSERT(found[i].offset == 0x1D0000);
+			SELFTEST_ASSERT(found[i].extra == 7);
+			SELFTEST_ASSERT(!strcmp(found[i].layout, "fal48"));
+		}
+	}
+	SELFTEST_ASSERT(bApp && bNet);
+	// served from cache
+	Test_FakeHTTPClientPacket_GET("api/partitions");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"name\":\"net_param\"");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"done\":true");
+
+	CMD_ExecuteCommand("stopDriver BKPartitions", 0);
+	flash_write(saved, 0x200000, 0);
+	free(saved);
+	SIM_ClearOBK(0);
+}
+#endif
 
 #endif
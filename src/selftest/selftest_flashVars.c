@@ -0,0 +1,155 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include <stddef.h>
+#include "../hal/hal_flashVars.h"
+
+// record log of hal/bk7231/hal_flashVars_bk7231.c, on its RAM area
+void SIM_FlashVarsLog_SetArea(const void *image, int len);
+const byte *SIM_FlashVarsLog_GetArea();
+void SIM_FlashVarsLog_PowerLossAfter(int ops);
+const FLASH_VARS_STRUCTURE *SIM_FlashVarsLog_Boot();
+int SIM_FlashVarsLog_SaveBootCount(int bootCount);
+// file of headless Linux build, hal/win32/hal_flashVars_win32.c
+void SIM_SetFlashVarsFile(const char *path);
+
+#define TEST_FLASH_VARS_SECTOR 0x1000
+
+// size of structure in old format, len is its last byte like on device
+// (structure has padding after it here)
+#define TEST_FLASH_VARS_LEGACY_LEN ((int)offsetof(FLASH_VARS_STRUCTURE, len) + 1)
+
+// area in old format: magic, then structures with boot counts 1..count
+static int Test_FlashVars_MakeLegacy(byte *img, int count) {
+	FLASH_VARS_STRUCTURE v;
+	unsigned int magic = 0xfefefefe;
+	int i, pos;
+
+	memcpy(img, &magic, sizeof(magic));
+	pos = sizeof(magic);
+	for (i = 1; i <= count; i++) {
+		memset(&v, 0, sizeof(v));
+		v.boot_count = i;
+		v.savedValues[0] = i * 10;
+		v.len = TEST_FLASH_VARS_LEGACY_LEN;
+		memcpy(img + pos, &v, TEST_FLASH_VARS_LEGACY_LEN);
+		pos += TEST_FLASH_VARS_LEGACY_LEN;
+	}
+	return pos;
+}
+
+void Test_FlashVars() {
+	static byte img[2 * TEST_FLASH_VARS_SECTOR];
+	const FLASH_VARS_STRUCTURE *v;
+	const byte *area;
+	int len, count, i;
+
+	area = SIM_FlashVarsLog_GetArea();
+
+	// power lost during conversion before new header is written
+	// (marker, erase of sector 1, record), old area is still complete
+	len = Test_FlashVars_MakeLegacy(img, 20);
+	SIM_FlashVarsLog_SetArea(img, len);
+	SIM_FlashVarsLog_PowerLossAfter(3);
+	SIM_FlashVarsLog_Boot();
+	SELFTEST_ASSERT(area[3] == 0x00);
+	SELFTEST_ASSERT(memcmp(area + 4, img + 4, len - 4) == 0);
+	SELFTEST_ASSERT(area[TEST_FLASH_VARS_SECTOR + 8] == 0);
+	// converted again, record left in sector 1 is not read as old data
+	SIM_FlashVarsLog_PowerLossAfter(-1);
+	v = SIM_FlashVarsLog_Boot();
+	SELFTEST_ASSERT(v->boot_count == 20);
+	SELFTEST_ASSERT(v->savedValues[0] == 200);
+	// old area is erased once log header is there
+	SELFTEST_ASSERT(area[0] == 0xFF && area[4] == 0xFF);
+	SELFTEST_ASSERT(SIM_FlashVarsLog_SaveBootCount(21) >= 0);
+	v = SIM_FlashVarsLog_Boot();
+	SELFTEST_ASSERT(v->boot_count == 21);
+	SELFTEST_ASSERT(v->savedValues[0] == 200);
+
+	// compaction of full sector loses power before its header, so last
+	// saved value stays in old sector
+	for (i = 100; i < 1000; i++) {
+		SIM_FlashVarsLog_PowerLossAfter(1);
+		if (SIM_FlashVarsLog_SaveBootCount(i) < 0) {
+			break;
+		}
+	}
+	SELFTEST_ASSERT(i < 1000);
+	SIM_FlashVarsLog_PowerLossAfter(-1);
+	v = SIM_FlashVarsLog_Boot();
+	SELFTEST_ASSERT(v->boot_count == i - 1);
+	SELFTEST_ASSERT(v->savedValues[0] == 200);
+	SELFTEST_ASSERT(SIM_FlashVarsLog_SaveBootCount(i) >= 0);
+	v = SIM_FlashVarsLog_Boot();
+	SELFTEST_ASSERT(v->boot_count == i);
+
+	// latest old structure crosses into sector 1
+	count = (TEST_FLASH_VARS_SECTOR - 4) / TEST_FLASH_VARS_LEGACY_LEN + 1;
+	len = Test_FlashVars_MakeLegacy(img, count);
+	SELFTEST_ASSERT(len > TEST_FLASH_VARS_SECTOR);
+	SIM_FlashVarsLog_SetArea(img, len);
+	v = SIM_FlashVarsLog_Boot();
+	SELFTEST_ASSERT(v->boot_count == count);
+	SELFTEST_ASSERT(v->savedValues[0] == count * 10);
+	SELFTEST_ASSERT(area[0] == 0xFF);
+	v = SIM_FlashVarsLog_Boot();
+	SELFTEST_ASSERT(v->boot_count == count);
+	// interrupted after sector 1 is erased, old area is dropped instead
+	// of reading part of that structure
+	SIM_FlashVarsLog_SetArea(img, len);
+	SIM_FlashVarsLog_PowerLossAfter(2);
+	SIM_FlashVarsLog_Boot();
+	SIM_FlashVarsLog_PowerLossAfter(-1);
+	v = SIM_FlashVarsLog_Boot();
+	SELFTEST_ASSERT(v->boot_count == 0);
+	SELFTEST_ASSERT(v->savedValues[0] == 0);
+}
+
+void Test_FlashVarsFile() {
+	const char *path = "selftest_flashVars.bin";
+	ENERGY_METERING_DATA em;
+	byte mode, rgb[3], all;
+	short brightness, temperature;
+
+	remove(path);
+	SIM_SetFlashVarsFile(path);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 0);
+	HAL_FlashVars_IncreaseBootCount();
+	HAL_FlashVars_IncreaseBootCount();
+	HAL_FlashVars_SaveBootComplete();
+	HAL_FlashVars_IncreaseBootCount();
+	HAL_FlashVars_SaveChannel(3, 77);
+	HAL_FlashVars_SaveLED(1, 80, 300, 10, 20, 30, 1);
+	memset(&em, 0, sizeof(em));
+	em.TotalConsumption = 12.5f;
+	HAL_SetEnergyMeterStatus(&em);
+
+	// restarted gateway reads all of it back from file
+	SIM_SetFlashVarsFile(path);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 3);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootFailures() == 1);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(3) == 77);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(4) == 0);
+	HAL_FlashVars_ReadLED(&mode, &brightness, &temperature, rgb, &all);
+	SELFTEST_ASSERT(mode == 1 && brightness == 80 && temperature == 300);
+	SELFTEST_ASSERT(rgb[0] == 10 && rgb[1] == 20 && rgb[2] == 30 && all == 1);
+	HAL_GetEnergyMeterStatus(&em);
+	SELFTEST_ASSERT(em.TotalConsumption == 12.5f);
+	HAL_FlashVars_SaveTotalConsumption(20.0f);
+	SIM_SetFlashVarsFile(path);
+	HAL_GetEnergyMeterStatus(&em);
+	SELFTEST_ASSERT(em.TotalConsumption == 20.0f);
+
+	// without file, as in other selftests, nothing is kept
+	SIM_SetFlashVarsFile(0);
+	HAL_FlashVars_IncreaseBootCount();
+	HAL_FlashVars_SaveChannel(3, 5);
+	SELFTEST_ASSERT(HAL_FlashVars_GetBootCount() == 0);
+	SELFTEST_ASSERT(HAL_FlashVars_GetChannelValue(3) == 0);
+	HAL_GetEnergyMeterStatus(&em);
+	SELFTEST_ASSERT(em.TotalConsumption == 0);
+	remove(path);
+}
+
+#endif
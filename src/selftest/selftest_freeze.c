@@ -0,0 +1,83 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_freeze.h"
+#include "../logging/logging.h"
+
+extern int g_simulatedTimeNow;
+void SIM_ClearAndPrepareForMQTTTesting(const char *clientName, const char *groupName);
+
+static bool Test_Freeze_CrashLogHas(const char *a, const char *b) {
+	unsigned int tick, heap;
+	char text[96];
+	int i;
+
+	for (i = 0; LOG_GetCrashLogLine(i, &tick, &heap, text, sizeof(text)); i++) {
+		if (strstr(text, a) && strstr(text, b)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Test_Freeze() {
+	wdtStats_t st;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("wdtTester", "bekens");
+	CMD_ExecuteCommand("startDriver Freeze", 0);
+	Sim_RunSeconds(3, false);
+	SELFTEST_ASSERT(WDT_IsHealthy());
+	WDT_GetStats(WDT_TASK_MAIN, &st);
+	SELFTEST_ASSERT(st.maxGapMs >= 1000 && st.maxGapMs <= 1100);
+	WDT_GetStats(WDT_TASK_QUICKTICK, &st);
+	SELFTEST_ASSERT(st.maxGapMs > 0 && st.maxGapMs <= 1100);
+	SELFTEST_ASSERT(st.stuckCount == 0);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "WDT max gap: Main ");
+
+	// whole device stalls for 4 s, in which tasks with 3 s deadline are stuck
+	CMD_ExecuteCommand("echo before hang", 0);
+	g_simulatedTimeNow += 4000;
+	WDT_Check();
+	SELFTEST_ASSERT(WDT_IsHealthy() == false);
+	WDT_GetStats(WDT_TASK_QUICKTICK, &st);
+	SELFTEST_ASSERT(st.stuckCount == 1);
+	WDT_GetStats(WDT_TASK_MAIN, &st);
+	SELFTEST_ASSERT(st.stuckCount == 0);
+	// reported once per hang
+	WDT_Check();
+	WDT_GetStats(WDT_TASK_QUICKTICK, &st);
+	SELFTEST_ASSERT(st.stuckCount == 1);
+	// next heartbeat ends it, gap is kept
+	Sim_RunFrame(10);
+	SELFTEST_ASSERT(WDT_IsHealthy());
+	WDT_GetStats(WDT_TASK_QUICKTICK, &st);
+	SELFTEST_ASSERT(st.maxGapMs >= 4000);
+	// as after reboot
+	LOG_InitCrashLog();
+	SELFTEST_ASSERT(Test_Freeze_CrashLogHas("WDT QuickTick stuck ", "cmd echo before hang"));
+	SELFTEST_ASSERT(Test_Freeze_CrashLogHas("WDT Script stuck ", "cmd echo before hang"));
+	SELFTEST_ASSERT(Test_Freeze_CrashLogHas("WDT Main stuck ", "") == false);
+
+	// MQTT can be restarted alone
+	CMD_ExecuteCommand("WDT_Restart 1", 0);
+	CMD_ExecuteCommand("WDT_Deadline MQTT 100", 0);
+	g_simulatedTimeNow += 200;
+	WDT_Check();
+	SELFTEST_ASSERT(WDT_IsHealthy());
+	Sim_RunSeconds(1.1f, false);
+	WDT_GetStats(WDT_TASK_MQTT, &st);
+	SELFTEST_ASSERT(st.stuckCount == 1);
+	SELFTEST_ASSERT(st.restarts == 1);
+	// without restart, stuck MQTT lets hardware watchdog reset device
+	CMD_ExecuteCommand("WDT_Restart 0", 0);
+	g_simulatedTimeNow += 200;
+	WDT_Check();
+	SELFTEST_ASSERT(WDT_IsHealthy() == false);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("WDT_Deadline Nobody 100", 0) == CMD_RES_BAD_ARGUMENT);
+
+	CMD_ExecuteCommand("stopDriver Freeze", 0);
+	SELFTEST_ASSERT(WDT_IsHealthy());
+}
+
+#endif
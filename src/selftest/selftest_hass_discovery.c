@@ -1,6 +1,7 @@
 ﻿#ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../httpserver/hass.h"
 
 void CheckForCommonVars() {
 
@@ -522,7 +523,87 @@ void Test_HassDiscovery_SpecialChar() {
 	SELFTEST_ASSERT(0xC6 == ((byte*)fullName)[3]);
 }
 
+void Test_HassDiscovery_Cache() {
+	const char *shortName = "WinCacheTest";
+
+	SIM_ClearOBK(shortName);
+	SIM_ClearAndPrepareForMQTTTesting("testDeviceCache", "bekens");
+
+	CFG_SetShortDeviceName(shortName);
+	CFG_SetDeviceName(shortName);
+
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+
+	// command always sends all
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("scheduleHADiscovery 1", 0);
+	Sim_RunSeconds(5, false);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("homeassistant", true);
+
+	// automatic discovery skips unchanged entities
+	SIM_ClearMQTTHistory();
+	Main_ScheduleHomeAssistantDiscovery(1);
+	Sim_RunSeconds(5, false);
+	SELFTEST_ASSERT(SIM_BeginParsingMQTTJSON("homeassistant", true));
+
+	// changed one is sent again
+	PIN_SetPinChannelForPinIndex(9, 2);
+	SIM_ClearMQTTHistory();
+	Main_ScheduleHomeAssistantDiscovery(1);
+	Sim_RunSeconds(5, false);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("homeassistant", true);
+	SELFTEST_ASSERT_JSON_VALUE_STRING(NULL, "stat_t", "~/2/get");
+}
+// discovery JSON is written as fields are added
+void Test_HassDiscovery_Writer() {
+	const char *modes[] = { "low", "say \"hi\"", NULL, "high" };
+	const char *many[40];
+	char longOption[64];
+	HassDeviceInfo *info;
+	const char *json;
+	int i;
+
+	SIM_ClearOBK("WinWriterTest");
+	CFG_SetShortDeviceName("WinWriterTest");
+	CFG_SetDeviceName("WinWriterTest");
+
+	// label and own unique_id are written in place of default ones
+	info = hass_createToggle("My Toggle", "~/t/get", "toggleCmd");
+	json = hass_build_discovery_json(info);
+	SELFTEST_ASSERT(json == info->json);
+	SELFTEST_ASSERT(strstr(json, "{\"dev\":{\"ids\":[\"WinWriterTest\"],\"name\":\"WinWriterTest\"") == json);
+	SELFTEST_ASSERT(strstr(json, "\"name\":\"My Toggle\",\"~\":") != 0);
+	SELFTEST_ASSERT(strstr(json, "_My_Toggle_My_Toggle\",\"qos\":1,\"stat_t\":\"~/t/get\"") != 0);
+	SELFTEST_ASSERT(json[strlen(json) - 1] == '}' && json[strlen(json) - 2] != '}');
+	// object is closed once
+	SELFTEST_ASSERT(!strcmp(hass_build_discovery_json(info), json));
+	hass_free_device_info(info);
+
+	// numbers are printed as cJSON did, missing strings are left out
+	info = hass_createHVAC(16, 30, 0.5f, modes, 4, 0, 0, 0, 0);
+	json = hass_build_discovery_json(info);
+	SELFTEST_ASSERT(strstr(json, "\"min_temp\":16,\"max_temp\":30,\"temp_step\":0.50000,") != 0);
+	SELFTEST_ASSERT(strstr(json, "\"fan_modes\":[\"low\",\"say \\\"hi\\\"\",\"high\"]") != 0);
+	hass_free_device_info(info);
+	info = hass_init_sensor_device_info(TEMPERATURE_SENSOR, 2, -1, -1, -1);
+	json = hass_build_discovery_json(info);
+	SELFTEST_ASSERT(strstr(json, "pl_on") == 0);
+	SELFTEST_ASSERT(strstr(json, "\"stat_t\":\"~/2/get\",\"stat_cla\":\"measurement\"}") != 0);
+	hass_free_device_info(info);
+
+	// too long for one MQTT publish is not sent cut
+	memset(longOption, 'x', sizeof(longOption) - 1);
+	longOption[sizeof(longOption) - 1] = 0;
+	for (i = 0; i < 40; i++) {
+		many[i] = longOption;
+	}
+	info = hass_createSelectEntity("~/s/get", "~/s/set", 40, many, "Many");
+	SELFTEST_ASSERT_STRING(hass_build_discovery_json(info), "");
+	hass_free_device_info(info);
+}
 void Test_HassDiscovery() {
+	Test_HassDiscovery_Writer();
     Test_HassDiscovery_SpecialChar();
 	Test_HassDiscovery_SHTSensor();
 #if ENABLE_DRIVER_BL0942
@@ -544,6 +625,7 @@ void Test_HassDiscovery() {
 	Test_HassDiscovery_DHT11();
 	Test_HassDiscovery_digitalInput();
 	Test_HassDiscovery_digitalInputNoAVTY();
+	Test_HassDiscovery_Cache();
 }
 
 
@@ -2,9 +2,16 @@
 
 #include "selftest_local.h"
 #include "../httpserver/new_http.h"
+#include "../httpserver/http_sse.h"
+#include "../logging/logging.h"
+#include "../hal/hal_ota.h"
+#include "../hal/hal_wifi.h"
 //#define JSMN_HEADER
 ///#include "../jsmn/jsmn.h"
 #include "../cJSON/cJSON.h"
+#if LINUX
+#include <unistd.h>
+#endif
 
 // "GET /index?tgl=1 HTTP/1.1\r\n"
 const char *http_get_template1 = "GET /%s HTTP/1.1\r\n"
@@ -101,6 +108,11 @@ void Test_FakeHTTPClientPacket_GET(const char *tg) {
 	sprintf(buffer, http_get_template1, tg);
 	Test_FakeHTTPClientPacket_Generic();
 }
+// one extra header line, like "If-None-Match: ..."
+void Test_FakeHTTPClientPacket_GET_WithHeader(const char *tg, const char *header) {
+	sprintf(buffer, "GET /%s HTTP/1.1\r\nHost: 127.0.0.1\r\n%s\r\n\r\n", tg, header);
+	Test_FakeHTTPClientPacket_Generic();
+}
 void Test_FakeHTTPClientPacket_POST(const char *tg, const char *data) {
 	int dataLen = strlen(data);
 
@@ -280,6 +292,10 @@ const char *Test_GetJSONValue_String(const char *keyword, const char *obj) {
 const char *Test_GetLastHTMLReply() {
 	return replyAt;
 }
+// status line and headers, followed by body
+const char *Test_GetLastHTMLReplyHeaders() {
+	return outbuf;
+}
 const char *Test_QueryHTMLReply(const char *url) {
 	Test_FakeHTTPClientPacket_GET(url);
 	return Test_GetLastHTMLReply();
@@ -914,12 +930,682 @@ void Test_Http_Commands() {
 	SELFTEST_ASSERT_CHANNEL(1, 567);
 	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "success", 200);
 }
+// finds URL of built-in file referenced by page, like "style_1234abcd.css"
+static void Test_Http_FindAssetURL(const char *page, const char *prefix, char *out, int outSize) {
+	const char *p;
+	int len;
+
+	p = strstr(page, prefix);
+	SELFTEST_ASSERT(p != 0);
+	p++; // skip slash
+	len = strcspn(p, "'");
+	SELFTEST_ASSERT(len < outSize);
+	memcpy(out, p, len);
+	out[len] = 0;
+}
+void Test_Http_Assets() {
+	char styleURL[64];
+	char scriptURL[64];
+	const char *etag;
+	char tmp[128];
+
+	SIM_ClearOBK(0);
+	Test_FakeHTTPClientPacket_GET("index");
+	Test_Http_FindAssetURL(replyAt, "/style_", styleURL, sizeof(styleURL));
+	Test_Http_FindAssetURL(replyAt, "/script_", scriptURL, sizeof(scriptURL));
+	SELFTEST_ASSERT(strstr(replyAt, "var refreshInterval=") != 0);
+
+	Test_FakeHTTPClientPacket_GET(styleURL);
+	SELFTEST_ASSERT(strstr(outbuf, "Content-Encoding: gzip") != 0);
+	SELFTEST_ASSERT(strstr(outbuf, "immutable") != 0);
+	etag = strstr(outbuf, "ETag: ");
+	SELFTEST_ASSERT(etag != 0);
+	// gzip magic
+	SELFTEST_ASSERT((byte)replyAt[0] == 0x1f && (byte)replyAt[1] == 0x8b);
+
+	// browser asks again with cached ETag
+	strcpy(tmp, "If-None-Match: ");
+	strncat(tmp, etag + 6, strcspn(etag + 6, "\r"));
+	sprintf(buffer, "GET /%s HTTP/1.1\r\nHost: 127.0.0.1\r\n%s\r\n\r\n", styleURL, tmp);
+	Test_FakeHTTPClientPacket_Generic();
+	SELFTEST_ASSERT(!strncmp(outbuf, "HTTP/1.1 304", 12));
+	SELFTEST_ASSERT(replyAt != 0 && *replyAt == 0);
+
+	Test_FakeHTTPClientPacket_GET(scriptURL);
+	SELFTEST_ASSERT(strstr(outbuf, "Content-type: application/javascript") != 0);
+	SELFTEST_ASSERT((byte)replyAt[0] == 0x1f && (byte)replyAt[1] == 0x8b);
+
+	// stale hash is not served as immutable file
+	Test_FakeHTTPClientPacket_GET("style_00000000.css");
+	SELFTEST_ASSERT(strstr(outbuf, "immutable") == 0);
+}
+void Test_Http_State() {
+	const char *p;
+	int ver;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	// first poll takes snapshot of driver and LED state
+	Test_FakeHTTPClientPacket_JSON("state?since=0");
+
+	Test_FakeHTTPClientPacket_GET("index");
+	p = strstr(replyAt, "data-ver=\"");
+	SELFTEST_ASSERT(p != 0);
+	ver = atoi(p + 10);
+	SELFTEST_ASSERT(ver > 0);
+
+	// nothing changed since page was loaded
+	Test_FakeHTTPClientPacket_JSON_VA("state?since=%i", ver);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "full", 0);
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer("1", "ch") == -999999);
+	ver = Test_GetJSONValue_Integer("ver", 0);
+
+	// only changed channel is sent
+	CHANNEL_Set(1, 1, 0);
+	Test_FakeHTTPClientPacket_JSON_VA("state?since=%i", ver);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "full", 0);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("ch", "1", 1);
+	ver = Test_GetJSONValue_Integer("ver", 0);
+	Test_FakeHTTPClientPacket_JSON_VA("state?since=%i", ver);
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer("1", "ch") == -999999);
+
+	// unknown version (like from before reboot) wants full refresh
+	Test_FakeHTTPClientPacket_JSON("state?since=0");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "full", 1);
+	Test_FakeHTTPClientPacket_JSON_VA("state?since=%i", ver + 1000);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "full", 1);
+}
+void Test_Http_RequestParts() {
+	const char *req = "POST /cfg HTTP/1.1\r\nHost: 127.0.0.1\r\ncontent-length: 5\r\n\r\nhello";
+	const char *get = "GET /index HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+	int headersLen;
+
+	headersLen = strstr(req, "\r\n\r\n") + 4 - req;
+	SELFTEST_ASSERT(HTTP_GetContentLength(req, req + headersLen) == 5);
+	SELFTEST_ASSERT(HTTP_GetContentLength(get, strstr(get, "\r\n\r\n")) == 0);
+	// headers not all there yet
+	SELFTEST_ASSERT(!HTTP_IsRequestComplete("GET /index HTTP/1.1\r\nHost: 12", 31));
+	SELFTEST_ASSERT(HTTP_IsRequestComplete(get, strlen(get)));
+	// body comes in parts
+	SELFTEST_ASSERT(!HTTP_IsRequestComplete(req, headersLen));
+	SELFTEST_ASSERT(!HTTP_IsRequestComplete(req, headersLen + 4));
+	SELFTEST_ASSERT(HTTP_IsRequestComplete(req, headersLen + 5));
+}
+void Test_Http_KeepAlive() {
+	static char reply[256];
+	const char *p;
+	int len;
+
+	SELFTEST_ASSERT(HTTP_WantsKeepAlive("GET /index HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"));
+	SELFTEST_ASSERT(!HTTP_WantsKeepAlive("GET /index HTTP/1.0\r\nHost: 127.0.0.1\r\n\r\n"));
+	SELFTEST_ASSERT(HTTP_WantsKeepAlive("GET /index HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n"));
+	SELFTEST_ASSERT(!HTTP_WantsKeepAlive("GET /index HTTP/1.1\r\nconnection: close\r\n\r\n"));
+	// POST may restart device after reply
+	SELFTEST_ASSERT(!HTTP_WantsKeepAlive("POST /cfg HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"));
+
+	// Content-Length is added for body
+	strcpy(reply, "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\nhello");
+	len = HTTP_SetKeepAliveHeaders(reply, strlen(reply), sizeof(reply) - 1);
+	SELFTEST_ASSERT(len == (int)strlen(reply));
+	SELFTEST_ASSERT(strstr(reply, "Connection: close") == 0);
+	SELFTEST_ASSERT(strstr(reply, "Connection: keep-alive\r\n") != 0);
+	SELFTEST_ASSERT(strstr(reply, "Content-Length: 5\r\n") != 0);
+	SELFTEST_ASSERT(!strcmp(Helper_GetPastHTTPHeader(reply), "hello"));
+	// but not twice
+	strcpy(reply, "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nhi");
+	len = HTTP_SetKeepAliveHeaders(reply, strlen(reply), sizeof(reply) - 1);
+	SELFTEST_ASSERT(len > 0);
+	p = strstr(reply, "Content-Length:");
+	SELFTEST_ASSERT(p != 0 && strstr(p + 1, "Content-Length:") == 0);
+	// no room for new headers, or headers already sent
+	strcpy(reply, "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\nhello");
+	SELFTEST_ASSERT(HTTP_SetKeepAliveHeaders(reply, strlen(reply), strlen(reply) + 10) == -1);
+	strcpy(reply, "hello");
+	SELFTEST_ASSERT(HTTP_SetKeepAliveHeaders(reply, strlen(reply), sizeof(reply) - 1) == -1);
+
+	// real page
+	SIM_ClearOBK(0);
+	Test_FakeHTTPClientPacket_GET("index");
+	len = HTTP_SetKeepAliveHeaders(outbuf, strlen(outbuf), sizeof(outbuf) - 1);
+	SELFTEST_ASSERT(len > 0);
+	replyAt = Helper_GetPastHTTPHeader(outbuf);
+	p = strstr(outbuf, "Content-Length: ");
+	SELFTEST_ASSERT(p != 0 && p < replyAt);
+	SELFTEST_ASSERT(atoi(p + 16) == (int)strlen(replyAt));
+}
+static int g_testRouteCalls;
+static int Test_Http_RouteCallback(http_request_t *request) {
+	g_testRouteCalls++;
+	http_setup(request, httpMimeTypeText);
+	poststr(request, "route ok");
+	poststr(request, NULL);
+	return 0;
+}
+void Test_Http_Routes() {
+#if ENABLE_HTTP_ROUTE_STATS
+	cJSON *item;
+	int i, hits;
+#endif
+
+	SIM_ClearOBK(0);
+	g_testRouteCalls = 0;
+	HTTP_RegisterCallback("/test_route", HTTP_GET, Test_Http_RouteCallback, 0);
+	// registering again does nothing
+	HTTP_RegisterCallback("/test_route", HTTP_GET, Test_Http_RouteCallback, 0);
+	HTTP_RegisterCallback("/test_tree/", HTTP_GET, Test_Http_RouteCallback, 0);
+
+	// whole url must match, query aside
+	Test_FakeHTTPClientPacket_GET("test_route?a=1");
+	SELFTEST_ASSERT(g_testRouteCalls == 1);
+	SELFTEST_ASSERT(strstr(replyAt, "route ok") != 0);
+	Test_FakeHTTPClientPacket_GET("test_routes");
+	SELFTEST_ASSERT(g_testRouteCalls == 1);
+	// and prefix matches all below it
+	Test_FakeHTTPClientPacket_GET("test_tree/x/y");
+	SELFTEST_ASSERT(g_testRouteCalls == 2);
+	// builtin pages are still served
+	Test_FakeHTTPClientPacket_GET("about");
+	SELFTEST_ASSERT(g_testRouteCalls == 2);
+	SELFTEST_ASSERT(strstr(replyAt, "route ok") == 0);
+
+#if ENABLE_HTTP_ROUTE_STATS
+	Test_FakeHTTPClientPacket_JSON("api/routestats");
+	SELFTEST_ASSERT(cJSON_IsArray(g_json));
+	hits = 0;
+	for (i = 0; i < cJSON_GetArraySize(g_json); i++) {
+		item = cJSON_GetArrayItem(g_json, i);
+		if (!strcmp(cJSON_GetObjectItemCaseSensitive(item, "url")->valuestring, "test_route")) {
+			hits = cJSON_GetObjectItemCaseSensitive(item, "hits")->valueint;
+		}
+	}
+	SELFTEST_ASSERT(hits >= 1);
+#endif
+}
+static int Test_Http_BinInt32(int index) {
+	const byte *p = (const byte*)replyAt + index * 4;
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+void Test_Http_ChannelValues() {
+	SIM_ClearOBK(0);
+
+	Test_FakeHTTPClientPacket_POST_withJSONReply("api/channelValues", "{\"1\":10,\"2\":20,\"5\":50}");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "changed", 3);
+	SELFTEST_ASSERT_CHANNEL(1, 10);
+	SELFTEST_ASSERT_CHANNEL(2, 20);
+	SELFTEST_ASSERT_CHANNEL(5, 50);
+	// nothing new
+	Test_FakeHTTPClientPacket_POST_withJSONReply("api/channelValues", "{\"1\":10,\"2\":20}");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "changed", 0);
+
+	Test_FakeHTTPClientPacket_JSON("api/channelValues?ch=1-2,5");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "ver", CHANNEL_GetStateVersion());
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("values", "1", 10);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("values", "2", 20);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("values", "5", 50);
+
+	// version, then values in asked order
+	Test_FakeHTTPClientPacket_GET("api/channelValues?ch=5,2&bin=1");
+	SELFTEST_ASSERT(strstr(outbuf, httpMimeTypeBinary) != 0);
+	SELFTEST_ASSERT(Test_Http_BinInt32(0) == CHANNEL_GetStateVersion());
+	SELFTEST_ASSERT(Test_Http_BinInt32(1) == 50);
+	SELFTEST_ASSERT(Test_Http_BinInt32(2) == 20);
+
+	Test_FakeHTTPClientPacket_GET("api/channelValues?ch=1-99");
+	SELFTEST_ASSERT(strstr(outbuf, " 400 ") != 0);
+	Test_FakeHTTPClientPacket_POST("api/channelValues", "{\"99\":1}");
+	SELFTEST_ASSERT(strstr(outbuf, " 400 ") != 0);
+}
+void Test_Http_RequestStats() {
+#if ENABLE_HTTP_REQUEST_STATS
+	cJSON *item;
+
+	SIM_ClearOBK(0);
+	Test_FakeHTTPClientPacket_GET("about?x=1");
+	Test_FakeHTTPClientPacket_JSON("api/httpstats");
+	SELFTEST_ASSERT(cJSON_IsArray(g_json));
+	// newest first, query is cut off
+	item = cJSON_GetArrayItem(g_json, 0);
+	SELFTEST_ASSERT(!strcmp(cJSON_GetObjectItemCaseSensitive(item, "url")->valuestring, "about"));
+	SELFTEST_ASSERT(cJSON_GetObjectItemCaseSensitive(item, "bytes")->valueint > 100);
+	// fake client gets whole reply from buffer
+	SELFTEST_ASSERT(cJSON_GetObjectItemCaseSensitive(item, "sends")->valueint == 1);
+#endif
+}
+void Test_Http_FlashDump() {
+	char expected[256];
+	char crc[16];
+
+	SIM_ClearOBK(0);
+	HAL_FlashRead(expected, sizeof(expected), 0x1000);
+	Test_FakeHTTPClientPacket_GET("api/flash/1000-100");
+	SELFTEST_ASSERT(!strncmp(outbuf, "HTTP/1.1 200", 12));
+	SELFTEST_ASSERT(strstr(outbuf, "Content-Length: 256\r\n") != 0);
+	SELFTEST_ASSERT(strstr(outbuf, "Accept-Ranges: bytes\r\n") != 0);
+	SELFTEST_ASSERT(!memcmp(replyAt, expected, 256));
+
+	// resuming after byte 199
+	Test_FakeHTTPClientPacket_GET_WithHeader("api/flash/1000-100", "Range: bytes=200-");
+	SELFTEST_ASSERT(!strncmp(outbuf, "HTTP/1.1 206", 12));
+	SELFTEST_ASSERT(strstr(outbuf, "Content-Range: bytes 200-255/256\r\n") != 0);
+	SELFTEST_ASSERT(strstr(outbuf, "Content-Length: 56\r\n") != 0);
+	SELFTEST_ASSERT(!memcmp(replyAt, expected + 200, 56));
+	Test_FakeHTTPClientPacket_GET_WithHeader("api/flash/1000-100", "Range: bytes=16-31");
+	SELFTEST_ASSERT(strstr(outbuf, "Content-Range: bytes 16-31/256\r\n") != 0);
+	SELFTEST_ASSERT(!memcmp(replyAt, expected + 16, 16));
+	// last 16 bytes
+	Test_FakeHTTPClientPacket_GET_WithHeader("api/flash/1000-100", "Range: bytes=-16");
+	SELFTEST_ASSERT(strstr(outbuf, "Content-Range: bytes 240-255/256\r\n") != 0);
+	SELFTEST_ASSERT(!memcmp(replyAt, expected + 240, 16));
+	Test_FakeHTTPClientPacket_GET_WithHeader("api/flash/1000-100", "Range: bytes=256-");
+	SELFTEST_ASSERT(!strncmp(outbuf, "HTTP/1.1 416", 12));
+	SELFTEST_ASSERT(strstr(outbuf, "Content-Range: bytes */256\r\n") != 0);
+
+	Test_FakeHTTPClientPacket_JSON("api/flashcrc/1000-100");
+	snprintf(crc, sizeof(crc), "%08X", OTA_CRC32(0, (const unsigned char*)expected, 256));
+	SELFTEST_ASSERT_STRING(Test_GetJSONValue_String("crc", 0), crc);
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer("len", 0) == 256);
+}
+void Test_Http_HueWemo() {
+	unsigned char mac[8];
+	char tmp[64];
+	char user[16];
+	const char *p;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CMD_ExecuteCommand("startDriver WEMO", 0);
+	CMD_ExecuteCommand("startDriver HUE", 0);
+	WiFI_GetMacAddress((char*)mac);
+
+	Test_FakeHTTPClientPacket_GET("setup.xml");
+	snprintf(tmp, sizeof(tmp), "Content-Length: %i\r\n", (int)strlen(replyAt));
+	SELFTEST_ASSERT(strstr(outbuf, tmp) != 0);
+	snprintf(tmp, sizeof(tmp), "<presentationURL>http://%s:80/</presentationURL>", HAL_GetMyIPString());
+	SELFTEST_ASSERT(strstr(replyAt, tmp) != 0);
+	SELFTEST_ASSERT(strstr(replyAt, "<binaryState>0</binaryState>") != 0);
+	CMD_ExecuteCommand("POWER ON", 0);
+	Test_FakeHTTPClientPacket_GET("setup.xml");
+	SELFTEST_ASSERT(strstr(replyAt, "<binaryState>1</binaryState>") != 0);
+	Test_FakeHTTPClientPacket_POST("upnp/control/basicevent1",
+		"<s:Body><u:SetBinaryState xmlns:u=\"urn:Belkin:service:basicevent:1\"><BinaryState>0</BinaryState></u:SetBinaryState></s:Body>");
+	SELFTEST_ASSERT(CHANNEL_Get(1) == 0);
+	SELFTEST_ASSERT(strstr(replyAt, "<u:SetBinaryStateResponse") != 0);
+	SELFTEST_ASSERT(strstr(replyAt, "<BinaryState>0</BinaryState></u:SetBinaryStateResponse>") != 0);
+
+	Test_FakeHTTPClientPacket_GET("description.xml");
+	snprintf(tmp, sizeof(tmp), "Content-Length: %i\r\n", (int)strlen(replyAt));
+	SELFTEST_ASSERT(strstr(outbuf, tmp) != 0);
+	snprintf(tmp, sizeof(tmp), "<URLBase>http://%s:80/</URLBase>", HAL_GetMyIPString());
+	SELFTEST_ASSERT(strstr(replyAt, tmp) != 0);
+
+	snprintf(user, sizeof(user), "%02X%02X%02X", mac[3], mac[4], mac[5]);
+	snprintf(tmp, sizeof(tmp), "api/%s/config", user);
+	Test_FakeHTTPClientPacket_GET(tmp);
+	snprintf(tmp, sizeof(tmp), "\"mac\":\"%02x:%02x:%02x:%02x:%02x:%02x\"", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	SELFTEST_ASSERT(strstr(replyAt, tmp) != 0);
+	snprintf(tmp, sizeof(tmp), "\"bridgeid\":\"%02X%02X%02XFFFE%02X%02X%02X\"", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	SELFTEST_ASSERT(strstr(replyAt, tmp) != 0);
+	snprintf(tmp, sizeof(tmp), "\"whitelist\":{\"%s\"", user);
+	SELFTEST_ASSERT(strstr(replyAt, tmp) != 0);
+	snprintf(tmp, sizeof(tmp), "\"gateway\":\"%s\"", HAL_GetMyGatewayString());
+	SELFTEST_ASSERT(strstr(replyAt, tmp) != 0);
+	p = strstr(replyAt, "\"UTC\":\"");
+	SELFTEST_ASSERT(p != 0 && p[26] == '"');
+	snprintf(tmp, sizeof(tmp), "api/%s", user);
+	Test_FakeHTTPClientPacket_GET(tmp);
+	SELFTEST_ASSERT(!strncmp(replyAt, "{\"lights\":{\"1\":{\"state\":{\"on\":false,", 36));
+	SELFTEST_ASSERT(strstr(replyAt, "\"linkbutton\":false,\"portalservices\":false}}") != 0);
+	snprintf(tmp, sizeof(tmp), "Content-Length: %i\r\n", (int)strlen(replyAt));
+	SELFTEST_ASSERT(strstr(outbuf, tmp) != 0);
+
+	// light 1 is the relay
+	snprintf(tmp, sizeof(tmp), "api/%s/lights/1/state", user);
+	Test_FakeHTTPClientPacket_POST(tmp, "{\"on\": true}");
+	SELFTEST_ASSERT(CHANNEL_Get(1) == 1);
+	SELFTEST_ASSERT(!strcmp(replyAt, "[{\"success\":{\"/lights/1/state/on\":true}}]"));
+	snprintf(tmp, sizeof(tmp), "api/%s/lights", user);
+	Test_FakeHTTPClientPacket_GET(tmp);
+	SELFTEST_ASSERT(!strncmp(replyAt, "{\"1\":{\"state\":{\"on\":true,\"bri\":254,", 35));
+	snprintf(tmp, sizeof(tmp), "Content-Length: %i\r\n", (int)strlen(replyAt));
+	SELFTEST_ASSERT(strstr(outbuf, tmp) != 0);
+	snprintf(tmp, sizeof(tmp), "api/%s/lights/2", user);
+	Test_FakeHTTPClientPacket_GET(tmp);
+	SELFTEST_ASSERT(strstr(replyAt, "\"error\":{\"type\":3,\"address\":\"/lights/2\"") != 0);
+
+	// with LED, bri is dimmer
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(24, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(24, 1);
+	CMD_ExecuteCommand("startDriver HUE", 0);
+	CMD_ExecuteCommand("led_enableAll 0", 0);
+	snprintf(tmp, sizeof(tmp), "api/%s/lights/1/state", user);
+	Test_FakeHTTPClientPacket_POST(tmp, "{\"on\":true,\"bri\":128}");
+	SELFTEST_ASSERT(LED_GetEnableAll() == 1);
+	SELFTEST_ASSERT_EXPRESSION("$led_dimmer", 50);
+	SELFTEST_ASSERT(strstr(replyAt, "{\"success\":{\"/lights/1/state/bri\":128}}]") != 0);
+	snprintf(tmp, sizeof(tmp), "api/%s/lights/1", user);
+	Test_FakeHTTPClientPacket_GET(tmp);
+	SELFTEST_ASSERT(!strncmp(replyAt, "{\"state\":{\"on\":true,\"bri\":128,", 30));
+}
+void Test_Http_LogRing() {
+	int i;
+
+	SIM_ClearOBK(0);
+	// take what is there already
+	Test_FakeHTTPClientPacket_GET("lograw");
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "ringtest single");
+	Test_FakeHTTPClientPacket_GET("lograw");
+	SELFTEST_ASSERT(strstr(replyAt, "ringtest single\r\n") != 0);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	SELFTEST_ASSERT(strstr(replyAt, "ringtest single") == 0);
+
+	// more than ring holds, oldest lines are lost
+	for (i = 0; i < 300; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "ringtest %i", i);
+	}
+	Test_FakeHTTPClientPacket_GET("lograw");
+	SELFTEST_ASSERT(strlen(replyAt) <= 4096);
+	SELFTEST_ASSERT(strstr(replyAt, "ringtest 299\r\n") != 0);
+	SELFTEST_ASSERT(strstr(replyAt, "ringtest 298\r\n") != 0);
+	SELFTEST_ASSERT(strstr(replyAt, "ringtest 10\r\n") == 0);
+}
+void Test_Http_LogBinary() {
+	const unsigned char bytes[] = { 0x55, 0xAA };
+
+	SIM_ClearOBK(0);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	// off by default, line is formatted as usual
+	addLogBin(LOG_INFO, LOG_FEATURE_GENERAL, "bintest %i %s", 12, "abc");
+	addLogHex(LOG_INFO, LOG_FEATURE_GENERAL, "hextest", bytes, 2);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	SELFTEST_ASSERT(strstr(replyAt, "bintest 12 abc\r\n") != 0);
+	SELFTEST_ASSERT(strstr(replyAt, "hextest: 55 AA \r\n") != 0);
+#if ENABLE_BINARY_LOG
+	CMD_ExecuteCommand("logBinary 1", 0);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "before");
+	addLogBin(LOG_INFO, LOG_FEATURE_GENERAL, "bintest %i %s", 34, "def");
+	addLogHex(LOG_INFO, LOG_FEATURE_GENERAL, "hextest", bytes, 2);
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "after");
+	Test_FakeHTTPClientPacket_GET("lograw");
+	// web log skips records, text around them stays
+	SELFTEST_ASSERT(strstr(replyAt, "bintest") == 0);
+	SELFTEST_ASSERT(strstr(replyAt, "hextest") == 0);
+	SELFTEST_ASSERT(strchr(replyAt, 0x1E) == 0);
+	SELFTEST_ASSERT(strstr(replyAt, "before\r\n") != 0);
+	SELFTEST_ASSERT(strstr(replyAt, "after\r\n") != 0);
+	// only records in ring, lograw must not stop early
+	addLogBin(LOG_INFO, LOG_FEATURE_GENERAL, "bintest %i", 1);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	SELFTEST_ASSERT(strstr(replyAt, "bintest") == 0);
+	CMD_ExecuteCommand("logBinary 0", 0);
+#endif
+}
+static int Test_Http_LogDropped(const char* sink) {
+	cJSON* dropped;
+
+	Test_FakeHTTPClientPacket_JSON("api/logconfig");
+	dropped = cJSON_GetObjectItemCaseSensitive(g_json, "dropped");
+	SELFTEST_ASSERT(dropped != 0);
+	return cJSON_GetObjectItemCaseSensitive(dropped, sink)->valueint;
+}
+void Test_Http_LogSinks() {
+	int i, before;
+
+	SIM_ClearOBK(0);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	before = Test_Http_LogDropped("http");
+	Test_FakeHTTPClientPacket_GET("lograw");
+	// web log that kept up lost nothing
+	SELFTEST_ASSERT(Test_Http_LogDropped("http") == before);
+	for (i = 0; i < 300; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "sinktest %i", i);
+	}
+	Test_FakeHTTPClientPacket_GET("lograw");
+	SELFTEST_ASSERT(Test_Http_LogDropped("http") > before);
+
+	// command output is taken from log into reply
+	Test_FakeHTTPClientPacket_GET("cmd_tool?cmd=echo%20sinkecho");
+	SELFTEST_ASSERT(strstr(replyAt, "sinkecho\r\n<br>") != 0);
+}
+void Test_Http_LogFilters() {
+	cJSON* sink;
+
+	SIM_ClearOBK(0);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	// web log only up to warnings, serial still gets info
+	CMD_ExecuteCommand("logsink http 2", 0);
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "filtertest info");
+	addLogAdv(LOG_WARN, LOG_FEATURE_GENERAL, "filtertest warn");
+	Test_FakeHTTPClientPacket_GET("lograw");
+	SELFTEST_ASSERT(strstr(replyAt, "filtertest info") == 0);
+	SELFTEST_ASSERT(strstr(replyAt, "filtertest warn\r\n") != 0);
+	SELFTEST_ASSERT(strchr(replyAt, 0x1F) == 0);
+
+	Test_FakeHTTPClientPacket_JSON("api/logconfig");
+	sink = cJSON_GetObjectItemCaseSensitive(cJSON_GetObjectItemCaseSensitive(g_json, "sinks"), "http");
+	SELFTEST_ASSERT(cJSON_GetObjectItemCaseSensitive(sink, "level")->valueint == 2);
+
+	// only GENERAL feature
+	CMD_ExecuteCommand("logsink http -1 0x80", 0);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "filtertest cmd");
+	addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "filtertest general");
+	Test_FakeHTTPClientPacket_GET("lograw");
+	SELFTEST_ASSERT(strstr(replyAt, "filtertest cmd") == 0);
+	SELFTEST_ASSERT(strstr(replyAt, "filtertest general\r\n") != 0);
+
+	CMD_ExecuteCommand("logsink http -1", 0);
+	Test_FakeHTTPClientPacket_GET("lograw");
+	addLogAdv(LOG_INFO, LOG_FEATURE_CMD, "filtertest back");
+	Test_FakeHTTPClientPacket_GET("lograw");
+	SELFTEST_ASSERT(strstr(replyAt, "filtertest back\r\n") != 0);
+}
+void Test_Http_CrashLog() {
+#if ENABLE_CRASH_LOG
+	cJSON* lines;
+	int i;
+
+	SIM_ClearOBK(0);
+	for (i = 0; i < 20; i++) {
+		addLogAdv(LOG_INFO, LOG_FEATURE_GENERAL, "crashtest %i", i);
+	}
+	// as if device was reset
+	LOG_InitCrashLog();
+	Test_FakeHTTPClientPacket_JSON("api/crashlog");
+	lines = cJSON_GetObjectItemCaseSensitive(g_json, "lines");
+	SELFTEST_ASSERT(cJSON_GetArraySize(lines) == 16);
+	// oldest first, without line end
+	SELFTEST_ASSERT(strstr(cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(lines, 0), "text")->valuestring, "crashtest 4") != 0);
+	SELFTEST_ASSERT(strstr(cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(lines, 15), "text")->valuestring, "crashtest 19") != 0);
+	SELFTEST_ASSERT(strchr(cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(lines, 15), "text")->valuestring, '\n') == 0);
+	SELFTEST_ASSERT(cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(lines, 15), "heap")->valueint > 0);
+#endif
+}
+#if LINUX
+// long constant strings are sent on their own, after what is already
+// in buffer, so output order stays the same
+void Test_Http_PostConst() {
+	static char longStr[1000];
+	static char expected[1100];
+	char small[64];
+	char got[1100];
+	http_request_t request;
+	int sv[2], n, total;
+
+	memset(longStr, 'x', sizeof(longStr) - 1);
+	SELFTEST_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+	memset(&request, 0, sizeof(request));
+	request.fd = sv[0];
+	request.reply = small;
+	request.replymaxlen = sizeof(small);
+
+	poststr(&request, "head");
+	postconst(&request, longStr);
+	SELFTEST_ASSERT(request.replylen == 0);
+#if ENABLE_HTTP_REQUEST_STATS
+	// buffer flushed, then string sent whole
+	SELFTEST_ASSERT(request.sendCalls == 2);
+#endif
+	// short ones are still copied
+	postconst(&request, "short");
+	SELFTEST_ASSERT(request.replylen == 5);
+	poststr(&request, NULL);
+	close(sv[0]);
+
+	total = 0;
+	while ((n = recv(sv[1], got + total, sizeof(got) - 1 - total, 0)) > 0) {
+		total += n;
+	}
+	got[total] = 0;
+	close(sv[1]);
+	snprintf(expected, sizeof(expected), "head%sshort", longStr);
+	SELFTEST_ASSERT(!strcmp(got, expected));
+}
+#endif
+void Test_Http_ReadBody() {
+	http_request_t request;
+	char body[] = "0123456789";
+	char *part;
+
+	memset(&request, 0, sizeof(request));
+	request.bodystart = body;
+	request.bodylen = 10;
+	// extra bytes after Content-Length are not part of body
+	request.contentLength = 6;
+	SELFTEST_ASSERT(http_readBody(&request, &part) == 6);
+	SELFTEST_ASSERT(part == body);
+	SELFTEST_ASSERT(http_readBody(&request, &part) == 0);
+
+	// rest of body never came
+	memset(&request, 0, sizeof(request));
+	request.bodystart = body;
+	request.bodylen = 4;
+	request.contentLength = 10;
+	SELFTEST_ASSERT(http_readBody(&request, &part) == 4);
+	SELFTEST_ASSERT(http_readBody(&request, &part) == -1);
+
+	// without Content-Length all that came is the body
+	memset(&request, 0, sizeof(request));
+	request.bodystart = body;
+	request.bodylen = 10;
+	request.contentLength = -1;
+	SELFTEST_ASSERT(http_readBody(&request, &part) == 10);
+	SELFTEST_ASSERT(http_readBody(&request, &part) == 0);
+}
+void Test_Http_Info() {
+	cJSON *arr;
+
+	SIM_ClearOBK(0);
+	CFG_SetShortDeviceName("my \"dev\"\\1");
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 2);
+	CHANNEL_Set(2, 1, 0);
+
+	// names are escaped by JSON writer
+	Test_FakeHTTPClientPacket_JSON("api/info");
+	SELFTEST_ASSERT(g_json != 0);
+	SELFTEST_ASSERT_JSON_VALUE_STRING(0, "shortName", "my \"dev\"\\1");
+	SELFTEST_ASSERT(cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(g_json, "supportsClientDeviceDB")));
+
+	Test_FakeHTTPClientPacket_JSON("api/pins");
+	SELFTEST_ASSERT(g_json != 0);
+	arr = cJSON_GetObjectItemCaseSensitive(g_json, "roles");
+	SELFTEST_ASSERT(cJSON_GetArraySize(arr) == PLATFORM_GPIO_MAX);
+	SELFTEST_ASSERT(cJSON_GetArrayItem(arr, 9)->valueint == IOR_Relay);
+	arr = cJSON_GetObjectItemCaseSensitive(g_json, "states");
+	SELFTEST_ASSERT(cJSON_GetArrayItem(arr, 9)->valueint == 1);
+	arr = cJSON_GetObjectItemCaseSensitive(g_json, "rolenames");
+	SELFTEST_ASSERT(cJSON_GetArraySize(arr) == IOR_Total_Options);
+	SELFTEST_ASSERT(cJSON_GetObjectItemCaseSensitive(g_json, "channels2") == 0);
+}
+#if ENABLE_HTTP_SSE
+void Test_Http_Events() {
+	char tmp[2048];
+	int id, id2, id3, len, i;
+
+	SIM_ClearOBK(0);
+
+	Test_FakeHTTPClientPacket_GET("events");
+	SELFTEST_ASSERT(strstr(outbuf, "Content-Type: text/event-stream") != 0);
+	SELFTEST_ASSERT(strstr(replyAt, "event: hello\n") != 0);
+	// nothing to subscribe to
+	Test_FakeHTTPClientPacket_GET("events?state=0");
+	SELFTEST_ASSERT(strstr(outbuf, "text/event-stream") == 0);
+
+	id = SSE_Open(SSE_EVENT_CHANNELS);
+	SELFTEST_ASSERT(id >= 0);
+	SELFTEST_ASSERT(SSE_IsWanted(SSE_EVENT_CHANNELS));
+	SELFTEST_ASSERT(!SSE_IsWanted(SSE_EVENT_LOG));
+	CHANNEL_Set(3, 77, 0);
+	len = SSE_Read(id, tmp, sizeof(tmp) - 1);
+	tmp[len] = 0;
+	SELFTEST_ASSERT(strstr(tmp, "event: ch\ndata: {\"ch\":3,\"val\":77,") == tmp);
+	SELFTEST_ASSERT(SSE_Read(id, tmp, sizeof(tmp)) == 0);
+
+	// multi-line data goes in many data lines
+	SSE_Publish(SSE_EVENT_CHANNELS, "x", "a\r\nb\r\n");
+	len = SSE_Read(id, tmp, sizeof(tmp) - 1);
+	tmp[len] = 0;
+	SELFTEST_ASSERT_STRING(tmp, "event: x\ndata: a\ndata: b\n\n");
+
+	// no more free slots
+	id2 = SSE_Open(SSE_EVENT_LOG);
+	SELFTEST_ASSERT(id2 >= 0);
+	id3 = SSE_Open(SSE_EVENT_LOG);
+	SELFTEST_ASSERT(id3 < 0);
+	ADDLOG_INFO(LOG_FEATURE_HTTP, "Pushed log line");
+	len = SSE_Read(id2, tmp, sizeof(tmp) - 1);
+	tmp[len] = 0;
+	SELFTEST_ASSERT(strstr(tmp, "event: log\ndata: ") == tmp);
+	SELFTEST_ASSERT(strstr(tmp, "Pushed log line\n\n") != 0);
+	SSE_Close(id2);
+
+	// slow client loses backlog and is told to fetch whole state
+	for (i = 0; i < 100; i++) {
+		CHANNEL_Set(3, i, 0);
+	}
+	len = SSE_Read(id, tmp, sizeof(tmp) - 1);
+	tmp[len] = 0;
+	SELFTEST_ASSERT_STRING(tmp, "event: reset\ndata: 1\n\n");
+	CHANNEL_Set(3, 1, 0);
+	len = SSE_Read(id, tmp, sizeof(tmp) - 1);
+	tmp[len] = 0;
+	SELFTEST_ASSERT(strstr(tmp, "\"val\":1,") != 0);
+	SSE_Close(id);
+	SELFTEST_ASSERT(!SSE_IsWanted(SSE_EVENT_CHANNELS));
+}
+#endif
 void Test_Http() {
 	Test_Http_SingleRelayOnChannel1();
 	Test_Http_TwoRelays();
 	Test_Http_FourRelays();
 	Test_Http_WiFi();
 	Test_Http_Commands();
+	Test_Http_Assets();
+	Test_Http_State();
+	Test_Http_KeepAlive();
+	Test_Http_RequestParts();
+	Test_Http_Info();
+	Test_Http_ReadBody();
+#if LINUX
+	Test_Http_PostConst();
+#endif
+	Test_Http_Routes();
+	Test_Http_ChannelValues();
+	Test_Http_RequestStats();
+	Test_Http_FlashDump();
+	Test_Http_HueWemo();
+	Test_Http_LogRing();
+	Test_Http_LogBinary();
+	Test_Http_LogSinks();
+	Test_Http_LogFilters();
+	Test_Http_CrashLog();
+#if ENABLE_HTTP_SSE
+	Test_Http_Events();
+#endif
 }
 
 
@@ -0,0 +1,105 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_local.h"
+
+#if ENABLE_DRIVER_SGP
+
+static softI2C_t g_testBusA = { 1, 2 };
+static softI2C_t g_testBusB = { 3, 4 };
+static char g_stepOrder[8];
+
+static void Test_I2CSched_StepA(softI2C_t *bus) {
+	strcat(g_stepOrder, "A");
+}
+static void Test_I2CSched_StepB(softI2C_t *bus) {
+	strcat(g_stepOrder, "B");
+	// sensor still busy, poll again
+	if (strlen(g_stepOrder) < 3) {
+		I2CSched_Add(bus, 10, Test_I2CSched_StepB);
+	}
+}
+
+void Test_I2CSched() {
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(24, IOR_SGP_CLK);
+	PIN_SetPinRoleForPinIndex(26, IOR_SGP_DAT);
+	PIN_SetPinChannelForPinIndex(26, 2);
+	PIN_SetPinChannel2ForPinIndex(26, 3);
+	CMD_ExecuteCommand("startDriver SGP", 0);
+
+	// result is read after conversion time, second tick does not wait for it
+	SGP_Readmeasure();
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+	SELFTEST_ASSERT(I2CSched_GetPendingCount() == 1);
+	SELFTEST_ASSERT(I2CSched_GetTimeToNextWakeMS() > 0);
+	Sim_RunFrames(5, false);
+	SELFTEST_ASSERT_CHANNEL(2, 120);
+	SELFTEST_ASSERT_CHANNEL(3, 130);
+	SELFTEST_ASSERT(I2CSched_GetPendingCount() == 0);
+	SELFTEST_ASSERT(I2CSched_GetTimeToNextWakeMS() == -1);
+
+	// steps of two buses run in due order, not in order they came
+	g_stepOrder[0] = 0;
+	I2CSched_Add(&g_testBusA, 35, Test_I2CSched_StepA);
+	I2CSched_Add(&g_testBusB, 5, Test_I2CSched_StepB);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_STRING(g_stepOrder, "BBBA");
+
+	// stopped driver leaves nothing behind
+	g_stepOrder[0] = 0;
+	I2CSched_Add(&g_testBusA, 10, Test_I2CSched_StepA);
+	I2CSched_Add(&g_testBusB, 10, Test_I2CSched_StepA);
+	I2CSched_Cancel(&g_testBusA);
+	Sim_RunFrames(5, false);
+	SELFTEST_ASSERT_STRING(g_stepOrder, "A");
+
+	SELFTEST_ASSERT(CMD_ExecuteCommand("SoftI2C_Stats", 0) == CMD_RES_OK);
+	SGP_Readmeasure();
+	CMD_ExecuteCommand("stopDriver SGP", 0);
+	SELFTEST_ASSERT(I2CSched_GetPendingCount() == 0);
+}
+
+#endif
+
+// Start, one byte and Stop, returns how many times data and clock pins
+// were set up
+static void Test_SoftI2C_Transfer(softI2C_t *bus, uint8_t value, int *dataSetups, int *clkSetups) {
+	int data = SIM_GetPinSetupCount(bus->pin_data);
+	int clk = SIM_GetPinSetupCount(bus->pin_clk);
+
+	Soft_I2C_Start(bus, 0x40);
+	Soft_I2C_WriteByte(bus, value);
+	Soft_I2C_Stop(bus);
+	*dataSetups = SIM_GetPinSetupCount(bus->pin_data) - data;
+	*clkSetups = SIM_GetPinSetupCount(bus->pin_clk) - clk;
+}
+
+void Test_SoftI2C() {
+	softI2C_t bus = { 5, 6 };
+	int data, clk;
+
+	SIM_ClearOBK(0);
+	Soft_I2C_PreInit(&bus);
+
+	// data pin held low over several bits is set up once, not every bit:
+	// 0x40 and 0x00 set it up 8 times, where every edge would be 23
+	Test_SoftI2C_Transfer(&bus, 0x00, &data, &clk);
+	SELFTEST_ASSERT(data == 8);
+	// clock changes every time
+	SELFTEST_ASSERT(clk == 38);
+	// other driver may use pins between, so next transfer sets them again
+	Test_SoftI2C_Transfer(&bus, 0x00, &data, &clk);
+	SELFTEST_ASSERT(data == 8);
+
+	// with open drain pins only change level, both end released
+	SIM_SetOpenDrainSupported(true);
+	Test_SoftI2C_Transfer(&bus, 0x5A, &data, &clk);
+	SELFTEST_ASSERT(data == 0 && clk == 0);
+	SELFTEST_ASSERT(SIM_GetSimulatedPinValue(5) && SIM_GetSimulatedPinValue(6));
+	SIM_SetOpenDrainSupported(false);
+
+	SELFTEST_ASSERT(CMD_ExecuteCommand("SoftI2C_SetSpeed 0", 0) == CMD_RES_BAD_ARGUMENT);
+}
+
+#endif
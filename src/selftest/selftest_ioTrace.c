@@ -0,0 +1,96 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../logging/ioTrace.h"
+#include "../littlefs/our_lfs.h"
+#include "../mqtt/new_mqtt.h"
+#include "../driver/drv_uart.h"
+
+#if ENABLE_IO_TRACE
+
+void SIM_ClearAndPrepareForMQTTTesting(const char *clientName, const char *groupName);
+
+// uartSendHex A1 from broker, recorded answer is EE on UART
+static const byte g_wrongAnswer[] = {
+	'O', 'B', 'K', 'T', IOTRACE_VERSION,
+	IOTRACE_MQTT_RX, 0, 28, 25,
+	'c', 'm', 'n', 'd', '/', 't', 'r', 'a', 'c', 'e', 'D', 'e', 'v', '/',
+	'u', 'a', 'r', 't', 'S', 'e', 'n', 'd', 'H', 'e', 'x',
+	'A', '1',
+	IOTRACE_UART_TX, 10, 2, 0, 0xEE,
+};
+
+static int Test_IOTrace_ReadFile(const char *fname, byte *out, int maxLen) {
+	lfs_file_t file;
+	int len;
+
+	memset(&file, 0, sizeof(file));
+	if (lfs_file_open(&lfs, &file, fname, LFS_O_RDONLY) < 0) {
+		return -1;
+	}
+	len = lfs_file_read(&lfs, &file, out, maxLen);
+	lfs_file_close(&lfs, &file);
+	return len;
+}
+void Test_IOTrace() {
+	static byte trace[4096];
+	ioTraceReplay_t res;
+	int len;
+
+	SIM_ClearAndPrepareForMQTTTesting("traceDev", "traceGroup");
+	CMD_ExecuteCommand("lfs_format", 0);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("iotrace_start unitTrace.bin", 0) == CMD_RES_OK);
+	// commands from broker, they answer on UART and MQTT
+	MQTT_Post_Received_Str("cmnd/traceDev/uartSendHex", "A1B2C3");
+	Sim_RunFrames(5, false);
+	MQTT_Post_Received_Str("cmnd/traceDev/publish", "traceTopic 123");
+	Sim_RunFrames(5, false);
+	// what driver consumed is recorded
+	UART_AppendByteToReceiveRingBuffer(0x55);
+	UART_AppendByteToReceiveRingBuffer(0xAA);
+	UART_ConsumeBytes(2);
+	Test_FakeHTTPClientPacket_GET("index");
+	// main loop writes it to file within a second
+	Sim_RunFrames(150, false);
+	len = Test_IOTrace_ReadFile("unitTrace.bin", trace, sizeof(trace));
+	SELFTEST_ASSERT(len > 5);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("iotrace_stop", 0) == CMD_RES_OK);
+
+	len = Test_IOTrace_ReadFile("unitTrace.bin", trace, sizeof(trace));
+	SELFTEST_ASSERT(len > 5);
+	SELFTEST_ASSERT(!memcmp(trace, IOTRACE_MAGIC, 4));
+	SELFTEST_ASSERT(trace[4] == IOTRACE_VERSION);
+
+	// same device from scratch answers the same
+	SIM_ClearAndPrepareForMQTTTesting("traceDev", "traceGroup");
+	IOTrace_Replay(trace, len, &res);
+	// two MQTT messages, UART bytes and HTTP request
+	SELFTEST_ASSERT(res.inputs == 4);
+	SELFTEST_ASSERT(res.bBroken == 0);
+	// three UART bytes and at least the publish
+	SELFTEST_ASSERT(res.expectedOutputs >= 4);
+	SELFTEST_ASSERT(res.outputs >= 4);
+	// periodic state broadcast follows uptime of device, which is
+	// not same here, so only UART answer is compared exactly
+	SELFTEST_ASSERT(res.uartHash == res.expectedUartHash);
+	SELFTEST_ASSERT(res.simMs > 0);
+
+	// recorded answer differs from what device sends now
+	SIM_ClearAndPrepareForMQTTTesting("traceDev", "traceGroup");
+	SELFTEST_ASSERT(!IOTrace_Replay(g_wrongAnswer, sizeof(g_wrongAnswer), &res));
+	SELFTEST_ASSERT(res.inputs == 1);
+	SELFTEST_ASSERT(res.expectedOutputs == 1);
+	SELFTEST_ASSERT(res.uartHash != res.expectedUartHash);
+
+	// unknown version is not replayed
+	trace[4] = IOTRACE_VERSION + 1;
+	SELFTEST_ASSERT(!IOTrace_Replay(trace, len, &res));
+	SELFTEST_ASSERT(res.bBroken);
+	SELFTEST_ASSERT(res.records == 0);
+
+	SIM_ClearOBK(0);
+}
+
+#endif
+
+#endif
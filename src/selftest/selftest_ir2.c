@@ -0,0 +1,61 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+
+#if ENABLE_DRIVER_IR2 && ENABLE_LITTLEFS
+
+int IR2_GetQueue(const int **out);
+int IR2_EncodeCode(const int *t, int n, byte *out, int outSize);
+int IR2_DecodeCode(const byte *in, int len, int *t, int max);
+
+void Test_IR2() {
+	const int *q;
+	int t[32];
+	byte code[64];
+	int distinct[16];
+	int n, i;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+	CMD_ExecuteCommand("startDriver IR2", 0);
+	CMD_ExecuteCommand("SetupIR2 50 0.5 0 26", 0);
+
+	// raw send, queue starts with 500 us space
+	CMD_ExecuteCommand("SendIR2 3200 1300 950", 0);
+	n = IR2_GetQueue(&q);
+	SELFTEST_ASSERT(n == 4);
+	SELFTEST_ASSERT(q[0] == 500 && q[1] == 3200 && q[3] == 950);
+
+	// 900 and 950 within tolerance become one level, nibble per edge
+	t[0] = 9000; t[1] = 4500; t[2] = 900; t[3] = 950; t[4] = 900; t[5] = 1700; t[6] = 950;
+	n = IR2_EncodeCode(t, 7, code, sizeof(code));
+	SELFTEST_ASSERT(n == 5 + 4 * 2 + 4);
+	SELFTEST_ASSERT(code[2] == 4);
+	n = IR2_DecodeCode(code, n, t, 32);
+	SELFTEST_ASSERT(n == 7);
+	SELFTEST_ASSERT(t[0] == 9000 && t[1] == 4500 && t[2] == 925 && t[3] == 925 && t[5] == 1700);
+	// 16 levels do not fit nibble table
+	distinct[0] = 100;
+	for (i = 1; i < 16; i++) {
+		distinct[i] = distinct[i - 1] * 3 / 2;
+	}
+	SELFTEST_ASSERT(IR2_EncodeCode(distinct, 16, code, sizeof(code)) == 0);
+
+	// stored codes and gaps go out as one queue
+	CMD_ExecuteCommand("IR2_Store pw 9000 4500 560 560 560 1690 560", 0);
+	CMD_ExecuteCommand("IR2_Send pw 100 pw pw", 0);
+	n = IR2_GetQueue(&q);
+	SELFTEST_ASSERT(n == 1 + 7 * 3 + 2);
+	SELFTEST_ASSERT(q[1] == 9000 && q[7] == 560);
+	SELFTEST_ASSERT(q[8] == 100000);
+	SELFTEST_ASSERT(q[9] == 9000);
+	SELFTEST_ASSERT(q[16] == 50000);
+	SELFTEST_ASSERT(q[23] == 560);
+
+	CMD_ExecuteCommand("IR2_Delete pw", 0);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("IR2_Send pw", 0) == CMD_RES_BAD_ARGUMENT);
+}
+
+#endif
+
+#endif
@@ -65,6 +65,23 @@ void Test_LEDDriver_SingleColor() {
 	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Dimmer");
 	SELFTEST_ASSERT_PAGE_NOT_CONTAINS("index", "LED RGB Color");
 	SELFTEST_ASSERT_HTML_REPLY_NOT_CONTAINS("LED Temperature Slider");
+
+	// divider of channel type applies to value set by LED driver
+	CMD_ExecuteCommand("setChannelType 1 Temperature_div10", 0);
+	CMD_ExecuteCommand("POWER1 toggle", 0);
+	CMD_ExecuteCommand("POWER1 toggle", 0);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFinalValue(1), 10.0f);
+	// fraction is kept, int readers get it truncated
+	CMD_ExecuteCommand("Dimmer 1", 0);
+	SELFTEST_ASSERT(CHANNEL_GetRepr(1) == CHANNEL_REPR_FLOAT);
+	SELFTEST_ASSERT_CHANNEL(1, (int)CHANNEL_GetFloat(1));
+	// whole value clears fraction, int and float agree
+	CMD_ExecuteCommand("Dimmer 0", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFloat(1), 0.0f);
+	SELFTEST_ASSERT_FLOATCOMPARE(CHANNEL_GetFinalValue(1), 0.0f);
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("Temperature 0.0");
 }
 
 void Test_LEDDriver_CW() {
@@ -1018,6 +1035,54 @@ void Test_LEDDriver_RGB(int firstChannel) {
 	//SELFTEST_ASSERT_CHANNEL(firstChannel+2, 666);
 
 }
+void Test_LEDDriver_SmoothTransitions() {
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	PIN_SetPinRoleForPinIndex(24, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(24, 1);
+
+	PIN_SetPinRoleForPinIndex(26, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(26, 2);
+
+	PIN_SetPinRoleForPinIndex(9, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(9, 3);
+
+	CFG_SetFlag(OBK_FLAG_LED_SMOOTH_TRANSITIONS, true);
+	CMD_ExecuteCommand("led_lerpSpeed 255", 0);
+	CMD_ExecuteCommand("led_enableAll 1", 0);
+	CMD_ExecuteCommand("led_dimmer 100", 0);
+	CMD_ExecuteCommand("led_basecolor_rgb FF0000", 0);
+	Sim_RunMiliseconds(2000, false);
+	SELFTEST_ASSERT_CHANNEL(1, 100);
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+
+	// both are on the way, at same distance from targets
+	CMD_ExecuteCommand("led_basecolor_rgb 00FF00", 0);
+	Sim_RunMiliseconds(200, false);
+	SELFTEST_ASSERT(CHANNEL_GetFloat(1) > 10 && CHANNEL_GetFloat(1) < 90);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CHANNEL_GetFloat(1) + CHANNEL_GetFloat(2), 100.0f, 0.01f);
+	// PWM hardware was given the whole fade, lerp did not write it since
+	SELFTEST_ASSERT(SIM_GetPWMValue(24) == 0);
+	SELFTEST_ASSERT(SIM_GetPWMValue(26) == 100);
+	SELFTEST_ASSERT(SIM_GetPWMFadeMS(26) > 500 && SIM_GetPWMFadeMS(26) <= 1000);
+	SELFTEST_ASSERT(SIM_GetPWMFadeMS(9) == 0);
+	Sim_RunMiliseconds(1000, false);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT_CHANNEL(2, 100);
+
+	// ends at gamma corrected value, 255 * 0.5 ^ 2.2 scaled to 0-100
+	CMD_ExecuteCommand("led_dimmer 50", 0);
+	Sim_RunMiliseconds(1000, false);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CHANNEL_GetFloat(2), 21.764f, 0.01f);
+	SELFTEST_ASSERT(LED_GetTimeToNextWakeMS() == -1);
+
+	CMD_ExecuteCommand("led_gammaCtrl gamma 1.0", 0);
+	CMD_ExecuteCommand("led_dimmer 40", 0);
+	Sim_RunMiliseconds(1000, false);
+	SELFTEST_ASSERT_FLOATCOMPAREEPSILON(CHANNEL_GetFloat(2), 40.0f, 0.01f);
+	CFG_SetFlag(OBK_FLAG_LED_SMOOTH_TRANSITIONS, false);
+}
 void Test_LEDDriver() {
 
 	Test_LEDDriver_SingleColor();
@@ -1031,6 +1096,7 @@ void Test_LEDDriver() {
 	Test_LEDDriver_Palette();
 	Test_LEDDriver_BP5758_RGBCW();
 	Test_LEDDriver_SM2235_RGBCW();
+	Test_LEDDriver_SmoothTransitions();
 }
 
 #endif
@@ -0,0 +1,201 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_local.h"
+#include "../driver/drv_spiLED.h"
+
+#if ENABLE_DRIVER_PIXELANIM && ENABLE_DRIVER_DDP && ENABLE_LED_BASIC
+
+// Times LED and strip hot paths and prints ns per pixel, so LED changes
+// can come with numbers. Every case is repeated for a few ms and best of
+// rounds is taken, so host scheduling does not count. Limits are about
+// 10x of unoptimized simulator build on ordinary PC, case above its limit
+// got a lot slower and fails. Slow builds (sanitizers) can scale them.
+#ifndef LEDBENCH_LIMIT_SCALE
+#define LEDBENCH_LIMIT_SCALE 1
+#endif
+
+#define LEDBENCH_MAX_PIXELS 1000
+#define LEDBENCH_MIN_NS 2000000
+#define LEDBENCH_ROUNDS 3
+// DDP packets are split like WLED does, 480 RGB pixels each
+#define LEDBENCH_DDP_PIXELS 480
+
+void DDP_Parse(byte *data, int len);
+
+typedef struct ledBench_s {
+	const char *name;
+	void (*run)(int pixels, int arg);
+	int arg;
+	// ns per pixel for 30, 300 and 1000 pixels
+	int limit[3];
+} ledBench_t;
+
+static const int g_benchSizes[3] = { 30, 300, LEDBENCH_MAX_PIXELS };
+static byte g_benchData[LEDBENCH_MAX_PIXELS * 3];
+static byte g_benchOut[LEDBENCH_MAX_PIXELS * 3 * 4];
+static byte g_benchPacket[10 + LEDBENCH_DDP_PIXELS * 3];
+
+static long long LEDBench_NowNS() {
+#if LINUX
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (long long)((double)now.QuadPart * 1e9 / freq.QuadPart);
+#endif
+}
+
+static void LEDBench_SetPixel(int pixels, int arg) {
+	int i;
+
+	for (i = 0; i < pixels; i++) {
+		Strip_setPixel(i, i, i >> 1, 255 - (i & 0xFF), 0, 0);
+	}
+}
+static void LEDBench_SetMultiplePixel(int pixels, int arg) {
+	Strip_setMultiplePixel(pixels, g_benchData, false);
+}
+#if ENABLE_DRIVER_SM16703P || ENABLE_DRIVER_SM15155E
+static void LEDBench_TranslateByte(int pixels, int arg) {
+	int i;
+
+	for (i = 0; i < pixels * 3; i++) {
+		translate_byte(g_benchData[i], g_benchOut + i * 4);
+	}
+}
+static void LEDBench_EncodeBytes(int pixels, int arg) {
+	SPILED_EncodeBytes(g_benchOut, g_benchData, pixels * 3);
+}
+#endif
+static void LEDBench_DDP(int pixels, int arg) {
+	int first, count;
+
+	for (first = 0; first < pixels; first += count) {
+		count = pixels - first;
+		if (count > LEDBENCH_DDP_PIXELS) {
+			count = LEDBENCH_DDP_PIXELS;
+		}
+		// version 1, PUSH on last packet, offset and length in bytes
+		g_benchPacket[0] = first + count >= pixels ? 0x41 : 0x40;
+		g_benchPacket[2] = 0x0B;
+		g_benchPacket[4] = (first * 3) >> 24;
+		g_benchPacket[5] = (first * 3) >> 16;
+		g_benchPacket[6] = (first * 3) >> 8;
+		g_benchPacket[7] = first * 3;
+		g_benchPacket[8] = (count * 3) >> 8;
+		g_benchPacket[9] = count * 3;
+		memcpy(g_benchPacket + 10, g_benchData + first * 3, count * 3);
+		DDP_Parse(g_benchPacket, 10 + count * 3);
+	}
+}
+static void LEDBench_Anim(int pixels, int arg) {
+	g_anims[arg].runFunc();
+}
+static void LEDBench_Lerp(int pixels, int arg) {
+	LED_RunQuickColorLerp(1);
+}
+
+static ledBench_t g_benches[] = {
+	{ "Strip_setPixel", LEDBench_SetPixel, 0, { 100, 100, 100 } },
+	{ "Strip_setMultiplePixel", LEDBench_SetMultiplePixel, 0, { 20, 10, 10 } },
+#if ENABLE_DRIVER_SM16703P || ENABLE_DRIVER_SM15155E
+	{ "translate_byte", LEDBench_TranslateByte, 0, { 100, 100, 100 } },
+	{ "SPILED_EncodeBytes", LEDBench_EncodeBytes, 0, { 100, 60, 60 } },
+#endif
+	{ "DDP_Parse", LEDBench_DDP, 0, { 40, 10, 10 } },
+	// cost is per call, so it is spread over more pixels on long strips
+	{ "LED_RunQuickColorLerp", LEDBench_Lerp, 0, { 400, 40, 20 } },
+};
+static int g_numBenches = sizeof(g_benches) / sizeof(g_benches[0]);
+
+// best ns per pixel of a few rounds
+static float LEDBench_Measure(ledBench_t *b, int pixels) {
+	long long start, took, best;
+	int round, reps, i;
+
+	// how many calls fill LEDBENCH_MIN_NS
+	reps = 1;
+	while (1) {
+		start = LEDBench_NowNS();
+		for (i = 0; i < reps; i++) {
+			b->run(pixels, b->arg);
+		}
+		took = LEDBench_NowNS() - start;
+		if (took >= LEDBENCH_MIN_NS || reps >= 1000000) {
+			break;
+		}
+		reps *= 2;
+	}
+	best = took;
+	for (round = 1; round < LEDBENCH_ROUNDS; round++) {
+		start = LEDBench_NowNS();
+		for (i = 0; i < reps; i++) {
+			b->run(pixels, b->arg);
+		}
+		took = LEDBench_NowNS() - start;
+		if (took < best) {
+			best = took;
+		}
+	}
+	return (float)best / ((float)reps * pixels);
+}
+static void LEDBench_Report(ledBench_t *b, int size) {
+	int pixels = g_benchSizes[size];
+	int limit = b->limit[size] * LEDBENCH_LIMIT_SCALE;
+	float ns = LEDBench_Measure(b, pixels);
+
+	printf("LEDBench: %-24s %4i px %8.2f ns/px (limit %i)\n", b->name, pixels, ns, limit);
+	SELFTEST_ASSERT(ns <= limit);
+}
+static void LEDBench_InitStrip(int pixels) {
+	char tmp[64];
+
+	snprintf(tmp, sizeof(tmp), "SM16703P_Init %i RGB", pixels);
+	CMD_ExecuteCommand(tmp, 0);
+}
+
+void Test_LEDBench() {
+	ledBench_t anim;
+	int i, j, size;
+
+	SIM_ClearOBK(0);
+	for (i = 0; i < sizeof(g_benchData); i++) {
+		g_benchData[i] = i * 7;
+	}
+	CMD_ExecuteCommand("startDriver DMX", 0);
+	CMD_ExecuteCommand("startDriver PixelAnim", 0);
+	// simulated time stands still, so frames wait in strip buffer and
+	// only rendering is timed, not DMX UART
+	CMD_ExecuteCommand("Strip_FPS 1", 0);
+	CMD_ExecuteCommand("led_enableAll 1", 0);
+	CMD_ExecuteCommand("led_dimmer 100", 0);
+	// very slow transition that never ends while measured
+	CMD_ExecuteCommand("SetFlag 18 1", 0);
+	CMD_ExecuteCommand("led_lerpSpeed 1", 0);
+	CMD_ExecuteCommand("led_basecolor_rgb FF4020", 0);
+
+	for (size = 0; size < 3; size++) {
+		LEDBench_InitStrip(g_benchSizes[size]);
+		for (i = 0; i < g_numBenches; i++) {
+			LEDBench_Report(&g_benches[i], size);
+		}
+		for (j = 0; j < g_numAnims; j++) {
+			anim.name = g_anims[j].name;
+			anim.run = LEDBench_Anim;
+			anim.arg = j;
+			anim.limit[size] = 600;
+			LEDBench_Report(&anim, size);
+		}
+	}
+	CMD_ExecuteCommand("SetFlag 18 0", 0);
+}
+
+#endif
+
+#endif
@@ -1,13 +1,171 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../littlefs/lfs_records.h"
+#include "../driver/drv_local.h"
 
+// file is read in chunks, check that longer file comes out whole
+static void Test_LFS_Stream() {
+	char big[3001];
+	int i;
+
+	for (i = 0; i < 3000; i++) {
+		big[i] = 'a' + (i * 7) % 26;
+	}
+	big[3000] = 0;
+	LFS_WriteFile("bigFile.txt", (const byte*)big, 3000, false);
+	Test_FakeHTTPClientPacket_GET("api/lfs/bigFile.txt");
+	SELFTEST_ASSERT_HTML_REPLY(big);
+
+	// script is loaded without comments and indentation
+	strcpy(big, "// comment\r\n\r\n  \t setChannel 3 10  \r\n/\n//again\naddChannel 3 5");
+	LFS_WriteFile("streamScript.txt", (const byte*)big, strlen(big), false);
+	CMD_ExecuteCommand("startScript streamScript.txt", 0);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_CHANNEL(3, 15);
+}
+// $readfile is served from cache until something is written
+static void Test_LFS_FileCache() {
+	char *ptr;
+	int len;
+
+	CMD_ExecuteCommand("lfs_write cachedA.txt 12", 0);
+	CMD_ExecuteCommand("lfs_write cachedB.txt 34", 0);
+	ptr = CMD_ExpandingStrdup("$readfile(cachedA.txt)+$readfile(cachedB.txt)");
+	SELFTEST_ASSERT_STRING(ptr, "12+34");
+	free(ptr);
+	ptr = CMD_ExpandingStrdup("$readfile(cachedA.txt)");
+	SELFTEST_ASSERT_STRING(ptr, "12");
+	free(ptr);
+	SELFTEST_ASSERT(LFS_GetFileCacheHits("cachedA.txt") == 1);
+	SELFTEST_ASSERT(LFS_GetFileCacheHits("cachedB.txt") == 0);
+	SELFTEST_ASSERT(!strcmp((const char*)LFS_BorrowFile("cachedB.txt", &len), "34") && len == 2);
+	SELFTEST_ASSERT(LFS_GetFileCacheHits("cachedB.txt") == 1);
+
+	CMD_ExecuteCommand("lfs_write cachedA.txt 56", 0);
+	ptr = CMD_ExpandingStrdup("$readfile(cachedA.txt)");
+	SELFTEST_ASSERT_STRING(ptr, "56");
+	free(ptr);
+	SELFTEST_ASSERT(LFS_GetFileCacheHits("cachedB.txt") == -1);
+	SELFTEST_ASSERT(LFS_BorrowFile("noSuchFile.txt", 0) == 0);
+}
+#if ENABLE_DRIVER_WIDGET
+// widgets are rendered from RAM until file is written again,
+// runs after Test_LFS_Stream, simulated flash has no room for another big file
+static void Test_LFS_Widgets() {
+	char big[3001];
+	int i;
+
+	CMD_ExecuteCommand("startDriver Widget", 0);
+	CMD_ExecuteCommand("lfs_write wStatic.html <b>staticW</b>", 0);
+	CMD_ExecuteCommand("lfs_write wState.html <i>stateW1</i>", 0);
+	CMD_ExecuteCommand("widget_create 1 0 wStatic.html 0", 0);
+	CMD_ExecuteCommand("widget_create 1 1 wState.html", 0);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "<b>staticW</b>");
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "<i>stateW1</i>");
+	SELFTEST_ASSERT_PAGE_CONTAINS("index?state=1", "<i>stateW1</i>");
+	SELFTEST_ASSERT_PAGE_NOT_CONTAINS("index?state=1", "staticW");
+	SELFTEST_ASSERT(Widget_GetCacheHits("wState.html") >= 2);
+	// static one without bAllowCache is read again on each page
+	SELFTEST_ASSERT(Widget_GetCacheHits("wStatic.html") == -1);
+
+	CMD_ExecuteCommand("lfs_write wState.html <i>stateW2</i>", 0);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index?state=1", "<i>stateW2</i>");
+	SELFTEST_ASSERT(Widget_GetCacheHits("wState.html") == 0);
+
+	// file from Test_LFS_Stream is too big for RAM, comes out whole in chunks
+	for (i = 0; i < 3000; i++) {
+		big[i] = 'a' + (i * 7) % 26;
+	}
+	big[3000] = 0;
+	CMD_ExecuteCommand("widget_create 1 1 bigFile.txt", 0);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index?state=1", big);
+	SELFTEST_ASSERT(Widget_GetCacheHits("bigFile.txt") == -1);
+
+	CMD_ExecuteCommand("widget_clearAll", 0);
+	SELFTEST_ASSERT_PAGE_NOT_CONTAINS("index", "stateW2");
+	CMD_ExecuteCommand("stopDriver Widget", 0);
+	CMD_ExecuteCommand("lfs_remove wStatic.html", 0);
+	CMD_ExecuteCommand("lfs_remove wState.html", 0);
+}
+#endif
+static void Test_LFS_Tune() {
+	int cache, lookahead, cycles;
+
+	SELFTEST_ASSERT(CMD_ExecuteCommand("lfs_tune log", 0) == CMD_RES_OK);
+	CFG_GetLFS_Tuning(&cache, &lookahead, &cycles);
+	SELFTEST_ASSERT(cache == 256 && lookahead == 16 && cycles == 1000);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("lfs_tune nosuchflash", 0) == CMD_RES_BAD_ARGUMENT);
+	// bench remounts with new values, files must stay readable
+	SELFTEST_ASSERT(CMD_ExecuteCommand("lfs_bench 4 20", 0) == CMD_RES_OK);
+	Test_FakeHTTPClientPacket_GET("api/lfs/numbers.txt");
+	SELFTEST_ASSERT_HTML_REPLY("value is 2023, and 31");
+	CMD_ExecuteCommand("lfs_appendInt numbers.txt 5", 0);
+	Test_FakeHTTPClientPacket_GET("api/lfs/numbers.txt");
+	SELFTEST_ASSERT_HTML_REPLY("value is 2023, and 315");
+
+	SELFTEST_ASSERT(CMD_ExecuteCommand("lfs_tune 64 8 -1", 0) == CMD_RES_OK);
+	CFG_GetLFS_Tuning(&cache, &lookahead, &cycles);
+	SELFTEST_ASSERT(cache == 64 && lookahead == 8 && cycles == -1);
+
+	CMD_ExecuteCommand("lfs_tune default", 0);
+	CFG_GetLFS_Tuning(&cache, &lookahead, &cycles);
+	SELFTEST_ASSERT(cache == 0 && lookahead == 0 && cycles == 0);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("lfs_bench 4 5", 0) == CMD_RES_OK);
+	Test_FakeHTTPClientPacket_GET("api/lfs/numbers.txt");
+	SELFTEST_ASSERT_HTML_REPLY("value is 2023, and 315");
+}
+// journal keeps last good entry, ring keeps newest rows in order
+static void Test_LFS_Records() {
+	lfsRecord_t rec = { "testRec.bin", 1, sizeof(int), 64, -1 };
+	lfsRing_t ring = { "testRing.bin", 1, sizeof(int), 3, 0, 0 };
+	int v, i, rows[4];
+
+	SELFTEST_ASSERT(LFS_Record_Load(&rec, &v) == false);
+	SELFTEST_ASSERT(rec.fileSize == 0);
+	for (i = 1; i <= 10; i++) {
+		SELFTEST_ASSERT(LFS_Record_Save(&rec, &i));
+	}
+	// 14 byte entries, file is started again when over 64 bytes
+	SELFTEST_ASSERT(rec.fileSize == 28);
+	v = 0;
+	SELFTEST_ASSERT(LFS_Record_Load(&rec, &v) && v == 10);
+	// cut write leaves entry before, next save rewrites file
+	LFS_WriteFile("testRec.bin", (const byte*)"RJ\x01", 3, true);
+	v = 0;
+	SELFTEST_ASSERT(LFS_Record_Load(&rec, &v) && v == 10);
+	SELFTEST_ASSERT(rec.fileSize == -1);
+	i = 11;
+	LFS_Record_Save(&rec, &i);
+	SELFTEST_ASSERT(LFS_Record_Load(&rec, &v) && v == 11 && rec.fileSize == 14);
+	// other version is not loaded
+	rec.version = 2;
+	SELFTEST_ASSERT(LFS_Record_Load(&rec, &v) == false);
+
+	LFS_Ring_Clear(&ring);
+	SELFTEST_ASSERT(LFS_Ring_Read(&ring, 0, rows, 4) == 0);
+	for (i = 1; i <= 5; i++) {
+		SELFTEST_ASSERT(LFS_Ring_Append(&ring, &i));
+	}
+	ring.next = ring.count = 0;
+	SELFTEST_ASSERT(LFS_Ring_Open(&ring) && ring.count == 3);
+	SELFTEST_ASSERT(LFS_Ring_Read(&ring, 0, rows, 4) == 3);
+	SELFTEST_ASSERT(rows[0] == 3 && rows[1] == 4 && rows[2] == 5);
+	SELFTEST_ASSERT(LFS_Ring_Read(&ring, 2, rows, 4) == 1 && rows[0] == 5);
+	// ring of other layout is started again
+	ring.maxRecords = 4;
+	LFS_Ring_Open(&ring);
+	SELFTEST_ASSERT(ring.count == 0);
+	CMD_ExecuteCommand("lfs_remove testRec.bin", 0);
+}
 void Test_LFS() {
 	char buffer[64];
 	
 	// reset whole device
 	SIM_ClearOBK(0);
 	CMD_ExecuteCommand("lfs_format", 0);
+	// simulated flash is small, run this one on empty one
+	Test_LFS_Records();
 
 	// send file content as POST to REST interface
 	Test_FakeHTTPClientPacket_POST("api/lfs/unitTestFile.txt", "This is a sample file made by unit test.");
@@ -23,6 +181,13 @@ void Test_LFS() {
 	Test_FakeHTTPClientPacket_GET("api/lfs/unitTestFile.txt");
 	SELFTEST_ASSERT_HTML_REPLY(buffer);
 
+	// base64 body is decoded as it is written
+	Test_FakeHTTPClientPacket_POST("api/lfs/unitTestB64.txt?b64=1", "SGVsbG8s\r\nIGJhc2U2NCE=");
+	Test_FakeHTTPClientPacket_GET("api/lfs/unitTestB64.txt");
+	SELFTEST_ASSERT_HTML_REPLY("Hello, base64!");
+	Test_FakeHTTPClientPacket_POST("api/lfs/unitTestB64.txt?b64=1", "SGVsbG8*");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"error\"");
+
 	// check to see if we can execute a file from within LFS
 	Test_FakeHTTPClientPacket_POST("api/lfs/script1.txt", "setChannel 0 123");
 	// exec will execute a script file in-place, all commands at once
@@ -130,6 +295,13 @@ void Test_LFS() {
 	CMD_ExecuteCommand("lfs_appendInt numbers.txt 15+16", 0);
 	Test_FakeHTTPClientPacket_GET("api/lfs/numbers.txt");
 	SELFTEST_ASSERT_HTML_REPLY("value is 2023, and 31");
+
+	Test_LFS_Tune();
+	Test_LFS_Stream();
+	Test_LFS_FileCache();
+#if ENABLE_DRIVER_WIDGET
+	Test_LFS_Widgets();
+#endif
 }
 
 #endif
@@ -9,6 +9,7 @@
 #include "../obk_config.h"
 #include "../cmnds/cmd_public.h"
 #include "../cmnds/cmd_local.h"
+#include "../logging/logging.h"
 #include "../sim/sim_import.h"
 
 void SelfTest_Failed(const char *file, const char *function, int line, const char *exp);
@@ -73,6 +74,37 @@ void SelfTest_Failed(const char *file, const char *function, int line, const cha
 #define SELFTEST_ASSERT_HAS_UART_EMPTY() SELFTEST_ASSERT(SIM_UART_GetDataSize()==0);
 #define SELFTEST_ASSERT_HAS_SOME_DATA_IN_UART() SELFTEST_ASSERT(SIM_UART_GetDataSize()!=0);
 
+#if ENABLE_HEAP_TRACKER
+// fails when blocks allocated after mark (HeapTrack_GetMark) are still there
+#define SELFTEST_ASSERT_NO_LEAKS_SINCE(mark) SELFTEST_ASSERT(HeapTrack_CountLiveSince(mark, true) == 0);
+#endif
+
+// Micro-benchmark, body of the loop is one op:
+//	selfBench_t b;
+//	SELFBENCH(b, "CMD_ExecuteCommand") {
+//		CMD_ExecuteCommand("setChannel 1 5", 0);
+//	}
+// After warm-up, ops are run in batches that take SELFBENCH_MIN_NS each,
+// best batch gives ns/op. Result is printed and kept for SelfBench_WriteJSON.
+typedef struct selfBench_s {
+	const char *name;
+	int phase;
+	int reps;
+	int left;
+	int round;
+	long long start;
+	long long best;
+	long long allocs;
+	unsigned int allocStart;
+} selfBench_t;
+
+// timer is read only between batches
+#define SELFBENCH(b, name) for (SelfBench_Begin(&b, name); b.left-- > 0 || SelfBench_Batch(&b); )
+
+void SelfBench_Begin(selfBench_t *b, const char *name);
+bool SelfBench_Batch(selfBench_t *b);
+void SelfBench_WriteJSON(const char *fileName);
+
 //#define FLOAT_EQUALS (a,b) (fabs(a-b)<0.001f)
 float myFabs(float f);
 bool Float_Equals(float a, float b);
@@ -83,21 +115,32 @@ const char *va(const char *fmt, ...);
 
 void Test_Battery();
 void Test_Flash_Search();
+void Test_BKPartitions();
 void Test_JSON_Lib();
 void Test_Commands_Startup();
 void Test_TwoPWMsOneChannel();
 void Test_ClockEvents();
 void Test_Commands_Channels();
+void Test_ChannelStats();
 void Test_LEDDriver();
 void Test_TuyaMCU_Basic(); 
 void Test_TuyaMCU_Calib();
 void Test_TuyaMCU_Boolean();
 void Test_TuyaMCU_DP22();
+void Test_TuyaMCU_Queue();
+void Test_TuyaMCU_Mappings();
+void Test_TuyaMCU_Parser();
 void Test_TuyaMCU_Mult();
 void Test_TuyaMCU_RawAccess();
 void Test_Command_If();
 void Test_Command_If_Else();
 void Test_LFS();
+void Test_Assets();
+void Test_Charts();
+void Test_I2CSched();
+void Test_SoftI2C();
+void Test_SensorAcq();
+void Test_Charts_Persist();
 void Test_Tokenizer();
 void Test_Commands_Alias();
 void Test_ExpandConstant();
@@ -106,6 +149,7 @@ void Test_RepeatingEvents();
 void Test_HTTP_Client();
 void Test_DeviceGroups();
 void Test_NTP();
+void Test_NTP_Actions();
 void Test_TIME_DST();
 void Test_TIME_SunsetSunrise();
 void Test_MQTT();
@@ -113,6 +157,11 @@ void Test_Tasmota();
 void Test_Backlog();
 void Test_EnergyMeter();
 void Test_DHT();
+void Test_DS18B20();
+void Test_ST7735();
+void Test_RC();
+void Test_PingWatchDog();
+void Test_CamFrames();
 void Test_Flags();
 void Test_MultiplePinsOnChannel();
 void Test_HassDiscovery();
@@ -143,11 +192,37 @@ void Test_TuyaMCU_BatteryPowered();
 void Test_ChargeLimitDriver();
 void Test_WS2812B();
 void Test_LEDstrips();
+void Test_E131();
+void Test_DMX();
+void Test_ChSync();
+void Test_MDNS();
+void Test_SSDP();
+void Test_IR2();
+void Test_LEDBench();
+void Test_CRC8();
+void Test_CRC8_Bench();
+void Test_FlashVars();
+void Test_FlashVarsFile();
+void Test_LogLevels();
+void Test_Base64();
+void Test_RGB2HSV();
+void Test_RGB2HSV_Bench();
+void Test_ShiftRegister();
+void Test_NEO6M();
+void Test_Debouncer();
+void Test_Freeze();
+void Test_PowerGov();
+void Test_WiFiRoam();
+void Test_Modbus();
+void Test_SPIFlash();
+void Test_SelfBench();
+void Test_IOTrace();
 void Test_DMX();
 void Test_DoorSensor();
 void Test_Enums();
 void Test_Expressions_RunTests_Basic();
 void Test_Expressions_RunTests_Braces();
+void Test_Expressions_RunTests_Compiled();
 void Test_ButtonEvents();
 void Test_Http();
 void Test_Demo_ConditionalRelay();
@@ -159,10 +234,18 @@ void Test_Pins();
 
 void Test_GetJSONValue_Setup(const char *text);
 void Test_FakeHTTPClientPacket_GET(const char *tg);
+void Test_FakeHTTPClientPacket_GET_WithHeader(const char *tg, const char *header);
 void Test_FakeHTTPClientPacket_POST(const char *tg, const char *data);
 void Test_FakeHTTPClientPacket_POST_withJSONReply(const char *tg, const char *data);
 void Test_FakeHTTPClientPacket_JSON(const char *tg);
 const char *Test_GetLastHTMLReply();
+const char *Test_GetLastHTMLReplyHeaders();
+void SIM_SetWiFiConnectFailures(int count);
+const obkStaticIP_t *SIM_GetLastWiFiConnectIP();
+void SIM_ClearWiFiAPs();
+void SIM_SetWiFiAP(const char *ssid, const char *bssid, int channel, int rssi);
+void SIM_SetWiFiLink(const char *bssid);
+int SIM_GetWiFiScanCount();
 const char *Test_QueryHTMLReply(const char *url);
 
 bool SIM_HasHTTPTemperature();
@@ -172,6 +255,7 @@ bool SIM_HasHTTP_Active_RGB();
 bool SIM_HasHTTPDimmer();
 
 // TODO: move elsewhere?
+void Sim_RunFrame(int frameTime);
 void Sim_RunMiliseconds(int ms, bool bApplyRealtimeWait);
 void Sim_RunSeconds(float f, bool bApplyRealtimeWait);
 void Sim_RunFrames(int n, bool bApplyRealtimeWait);
@@ -192,7 +276,10 @@ void SIM_SendFakeMQTTAndRunSimFrame_CMND_ViaGroupTopic(const char *command, cons
 void SIM_SendFakeMQTTRawChannelSet(int channelIndex, const char *arguments);
 void SIM_SendFakeMQTTRawChannelSet_ViaGroupTopic(int channelIndex, const char *arguments);
 void SIM_ClearMQTTHistory();
+void SIM_SetMQTTOffline(bool bOffline);
+int SIM_GetMQTTConnectAttempts();
 void SIM_DumpMQTTHistory();
+int SIM_RepostMQTTPublishes(const char *topic);
 bool SIM_CheckMQTTHistoryForString(const char *topic, const char *value, bool bRetain);
 bool SIM_HasMQTTHistoryStringWithJSONPayload(const char *topic, bool bPrefixMode, 
 	const char *object1, const char *object2,
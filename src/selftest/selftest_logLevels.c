@@ -0,0 +1,33 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+
+// build settings of BK7231T, with TuyaMCU kept at all levels,
+// macros of logging.h take them when they are expanded
+#undef OBK_LOG_MIN_LEVEL
+#define OBK_LOG_MIN_LEVEL			LOG_INFO
+#undef OBK_LOG_DEBUG_FEATURES
+#define OBK_LOG_DEBUG_FEATURES		(1 << LOG_FEATURE_TUYAMCU)
+
+void Test_LogLevels() {
+	int calls = 0;
+
+	// arguments of calls that are compiled out are not evaluated
+	ADDLOG_ERROR(LOG_FEATURE_HTTP, "loglevels %i", calls++);
+	ADDLOG_INFO(LOG_FEATURE_HTTP, "loglevels %i", calls++);
+	SELFTEST_ASSERT(calls == 2);
+	ADDLOG_DEBUG(LOG_FEATURE_HTTP, "loglevels %i", calls++);
+	ADDLOG_EXTRADEBUG(LOG_FEATURE_HTTP, "loglevels %i", calls++);
+	ADDLOGBIN_DEBUG(LOG_FEATURE_HTTP, "loglevels %i", calls++);
+	SELFTEST_ASSERT(calls == 2);
+	// feature that keeps debug
+	ADDLOG_DEBUG(LOG_FEATURE_TUYAMCU, "loglevels %i", calls++);
+	ADDLOG_EXTRADEBUG(LOG_FEATURE_TUYAMCU, "loglevels %i", calls++);
+	SELFTEST_ASSERT(calls == 4);
+
+	SELFTEST_ASSERT(LOG_IS_BUILT(LOG_WARN, LOG_FEATURE_CMD));
+	SELFTEST_ASSERT(!LOG_IS_BUILT(LOG_DEBUG, LOG_FEATURE_CMD));
+	SELFTEST_ASSERT(LOG_IS_BUILT(LOG_DEBUG, LOG_FEATURE_TUYAMCU));
+}
+
+#endif
@@ -1,8 +1,11 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_local.h"
 
 void Test_MAX72XX() {
+	int i;
+
 	// reset whole device
 	SIM_ClearOBK(0);
 
@@ -120,6 +123,44 @@ void Test_MAX72XX() {
 	CMD_ExecuteCommand("MAX72XX_SetPixel 1 1 1", 0);
 	SELFTEST_ASSERT(MAX72XXSingle_CountPixels(true) == 2);
 	CMD_ExecuteCommand("stopDriver MAX72XX", 0);
+
+	// refresh sends only rows that changed, each to all devices at once
+	CMD_ExecuteCommand("startDriver MAX72XX", 0);
+	CMD_ExecuteCommand("MAX72XX_Setup 10 8 9 16", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_GetRowsSent() == 8);
+	CMD_ExecuteCommand("MAX72XX_refresh", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_GetRowsSent() == 8);
+	// pixel that is already on changes nothing, so nothing is sent
+	CMD_ExecuteCommand("MAX72XX_SetPixel 3 2 1", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_GetRowsSent() == 8);
+	CMD_ExecuteCommand("MAX72XX_SetPixel 4 2 1", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_GetRowsSent() == 9);
+	CMD_ExecuteCommand("MAX72XX_refresh", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_GetRowsSent() == 9);
+	CMD_ExecuteCommand("MAX72XX_Clear", 0);
+	CMD_ExecuteCommand("MAX72XX_Print 1", 0);
+	CMD_ExecuteCommand("MAX72XX_refresh", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_CountPixels(true) == 10);
+	SELFTEST_ASSERT(MAX72XXSingle_GetRowsSent() > 9 && MAX72XXSingle_GetRowsSent() <= 17);
+	MAX72XXSingle_PrintText("1", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_GetRowsSent() <= 17);
+	MAX72XXSingle_PrintText("11", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_CountPixels(true) == 2 * 10);
+	CMD_ExecuteCommand("stopDriver MAX72XX", 0);
+
+	// simulator has no hardware SPI, setup falls back to GPIO
+	CMD_ExecuteCommand("startDriver MAX72XX", 0);
+	CMD_ExecuteCommand("MAX72XX_Setup 10 8 9 16 1", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_GetRowsSent() == 8);
+	CMD_ExecuteCommand("MAX72XX_Clear", 0);
+	CMD_ExecuteCommand("MAX72XX_Print 11", 0);
+	CMD_ExecuteCommand("MAX72XX_refresh", 0);
+	i = MAX72XXSingle_GetRowsSent();
+	// scroll of 16 devices is at most 8 frames, one per row
+	CMD_ExecuteCommand("MAX72XX_Scroll 1", 0);
+	SELFTEST_ASSERT(MAX72XXSingle_GetRowsSent() > i && MAX72XXSingle_GetRowsSent() <= i + 8);
+	SELFTEST_ASSERT(MAX72XXSingle_CountPixels(true) == 2 * 10);
+	CMD_ExecuteCommand("stopDriver MAX72XX", 0);
 	
 }
 
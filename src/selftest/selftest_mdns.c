@@ -0,0 +1,107 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_local.h"
+
+#if ENABLE_DRIVER_MDNS
+
+// query with single question, returns its length
+static int Test_MDNS_Query(byte *q, int id, const char *name, int type, bool bUnicast) {
+	int n = 12, l;
+
+	memset(q, 0, 12);
+	q[0] = id >> 8;
+	q[1] = id;
+	q[5] = 1;
+	while (*name) {
+		l = strchr(name, '.') ? strchr(name, '.') - name : strlen(name);
+		q[n++] = l;
+		memcpy(q + n, name, l);
+		n += l;
+		name += l;
+		if (*name) {
+			name++;
+		}
+	}
+	q[n++] = 0;
+	q[n++] = 0;
+	q[n++] = type;
+	q[n++] = bUnicast ? 0x80 : 0;
+	q[n++] = 1;
+	return n;
+}
+static bool Test_MDNS_Contains(const byte *data, int len, const char *s) {
+	int l = strlen(s), i;
+
+	for (i = 0; i + l <= len; i++) {
+		if (!memcmp(data + i, s, l)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Test_MDNS() {
+	byte q[128];
+	byte reply[768];
+	int qlen, len;
+	bool bUnicast;
+
+	SIM_ClearOBK(0);
+	CFG_SetShortDeviceName("my_plug");
+	CMD_ExecuteCommand("startDriver MDNS", 0);
+
+	// browsing for OBK devices gets PTR, with SRV, TXT and A as additional
+	qlen = Test_MDNS_Query(q, 0, "_obk._tcp.local", 12, false);
+	len = MDNS_AnswerQuery(q, qlen, 5353, reply, sizeof(reply), &bUnicast);
+	SELFTEST_ASSERT(len > 12);
+	SELFTEST_ASSERT(bUnicast == false);
+	SELFTEST_ASSERT(reply[2] == 0x84);
+	// no question, one answer, three additional
+	SELFTEST_ASSERT(reply[5] == 0);
+	SELFTEST_ASSERT(reply[7] == 1);
+	SELFTEST_ASSERT(reply[11] == 3);
+	SELFTEST_ASSERT(Test_MDNS_Contains(reply, len, "chip=WIN32"));
+	SELFTEST_ASSERT(Test_MDNS_Contains(reply, len, "ver="));
+	SELFTEST_ASSERT(Test_MDNS_Contains(reply, len, "mac="));
+	// host label has no underscore
+	SELFTEST_ASSERT(Test_MDNS_Contains(reply, len, "\x07my-plug\x05local"));
+
+	// name is matched without case, A of host alone
+	qlen = Test_MDNS_Query(q, 0, "MY-PLUG.local", 1, true);
+	len = MDNS_AnswerQuery(q, qlen, 5353, reply, sizeof(reply), &bUnicast);
+	SELFTEST_ASSERT(bUnicast);
+	SELFTEST_ASSERT(reply[7] == 1);
+	SELFTEST_ASSERT(reply[11] == 0);
+	SELFTEST_ASSERT(!memcmp(reply + len - 4, "\x7f\x00\x00\x01", 4));
+
+	// service enumeration lists both services
+	qlen = Test_MDNS_Query(q, 0, "_services._dns-sd._udp.local", 12, false);
+	len = MDNS_AnswerQuery(q, qlen, 5353, reply, sizeof(reply), &bUnicast);
+	SELFTEST_ASSERT(reply[7] == 2);
+
+	// legacy query from other port keeps its ID and question, TTL is 10
+	qlen = Test_MDNS_Query(q, 0x1234, "_http._tcp.local", 12, false);
+	len = MDNS_AnswerQuery(q, qlen, 40000, reply, sizeof(reply), &bUnicast);
+	SELFTEST_ASSERT(bUnicast);
+	SELFTEST_ASSERT(reply[0] == 0x12 && reply[1] == 0x34);
+	SELFTEST_ASSERT(reply[5] == 1);
+	SELFTEST_ASSERT(!memcmp(reply + 12, q + 12, qlen - 12));
+	// TTL of PTR that follows the question
+	SELFTEST_ASSERT(reply[qlen + 18 + 4] == 0 && reply[qlen + 18 + 7] == 10);
+
+	// not ours, and responses of others, get nothing
+	qlen = Test_MDNS_Query(q, 0, "other.local", 1, false);
+	SELFTEST_ASSERT(MDNS_AnswerQuery(q, qlen, 5353, reply, sizeof(reply), &bUnicast) == 0);
+	qlen = Test_MDNS_Query(q, 0, "my-plug.local", 1, false);
+	q[2] = 0x84;
+	SELFTEST_ASSERT(MDNS_AnswerQuery(q, qlen, 5353, reply, sizeof(reply), &bUnicast) == 0);
+	// cut packet
+	SELFTEST_ASSERT(MDNS_AnswerQuery(q, 16, 5353, reply, sizeof(reply), &bUnicast) == 0);
+
+	CMD_ExecuteCommand("stopDriver MDNS", 0);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,254 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_modbus.h"
+#include "../driver/drv_uart.h"
+
+// appends CRC and puts frame into UART as if slave or master sent it
+static void Test_Modbus_Receive(const byte *data, int len) {
+	unsigned short crc = Modbus_CRC16(data, len);
+	int i;
+
+	for (i = 0; i < len; i++) {
+		UART_AppendByteToReceiveRingBuffer(data[i]);
+	}
+	UART_AppendByteToReceiveRingBuffer(crc & 0xFF);
+	UART_AppendByteToReceiveRingBuffer(crc >> 8);
+}
+// consumes frame sent by driver if it matches, with its CRC
+static bool Test_Modbus_Sent(const byte *data, int len) {
+	unsigned short crc = Modbus_CRC16(data, len);
+	int i;
+
+	if (SIM_UART_GetDataSize() != len + 2) {
+		return false;
+	}
+	for (i = 0; i < len; i++) {
+		if (SIM_UART_GetByte(i) != data[i]) {
+			return false;
+		}
+	}
+	if (SIM_UART_GetByte(len) != (crc & 0xFF) || SIM_UART_GetByte(len + 1) != (crc >> 8)) {
+		return false;
+	}
+	SIM_UART_ConsumeBytes(len + 2);
+	return true;
+}
+
+static const byte g_slave1Read[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x08 };
+static const byte g_slave1Reply[] = { 0x01, 0x03, 0x10,
+	0x00, 0xE6, 0x00, 0x05, 0xFF, 0x9C, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x86, 0xA0 };
+static const byte g_slave2Read[] = { 0x02, 0x04, 0x00, 0x64, 0x00, 0x01 };
+static const byte g_slave2Reply[] = { 0x02, 0x04, 0x02, 0x00, 0x2A };
+
+// slaves on fake bus answer requests of driver, returns count of
+// requests seen for each slave
+static void Test_Modbus_RunBus(int ms, bool bAnswer2, int *requests) {
+	for (; ms > 0; ms -= 10) {
+		Sim_RunFrames(1, false);
+		if (Test_Modbus_Sent(g_slave1Read, sizeof(g_slave1Read))) {
+			requests[1]++;
+			Test_Modbus_Receive(g_slave1Reply, sizeof(g_slave1Reply));
+		}
+		else if (Test_Modbus_Sent(g_slave2Read, sizeof(g_slave2Read))) {
+			requests[2]++;
+			if (bAnswer2) {
+				Test_Modbus_Receive(g_slave2Reply, sizeof(g_slave2Reply));
+			}
+		}
+		else {
+			SELFTEST_ASSERT_HAS_UART_EMPTY();
+		}
+	}
+}
+
+void Test_Modbus() {
+	const modbusSlaveStats_t *st;
+	int requests[3];
+	int i;
+	byte bad[sizeof(g_slave1Reply) + 2];
+	unsigned short crc;
+
+	SIM_ClearOBK(0);
+	SIM_UART_InitReceiveRingBuffer(512);
+	SIM_ClearUART();
+
+	// example from spec
+	{
+		byte frame[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+		SELFTEST_ASSERT(Modbus_CRC16(frame, sizeof(frame)) == 0xCDC5);
+	}
+
+	CMD_ExecuteCommand("startDriver Modbus 9600", 0);
+	// registers 0-1, 2 and 6-7 of slave 1 are read at once, gap 3-5 is small
+	CMD_ExecuteCommand("Modbus_Map 1 3 0 2 1 500", 0);
+	CMD_ExecuteCommand("Modbus_Map 1 3 2 1 3 500 0.1 s16", 0);
+	CMD_ExecuteCommand("Modbus_Map 1 3 6 1 4 500 1 u32", 0);
+	CMD_ExecuteCommand("Modbus_Map 2 4 100 1 5 1000", 0);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("Modbus_Map 1 7 0 1 1", 0) == CMD_RES_BAD_ARGUMENT);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("Modbus_Map 1 3 0 1 1 100 1 f32", 0) == CMD_RES_BAD_ARGUMENT);
+
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(Test_Modbus_Sent(g_slave1Read, sizeof(g_slave1Read)));
+	// one request at a time
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_HAS_UART_EMPTY();
+	Test_Modbus_Receive(g_slave1Reply, sizeof(g_slave1Reply));
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(1, 230);
+	SELFTEST_ASSERT_CHANNEL(2, 5);
+	SELFTEST_ASSERT_CHANNEL(3, -10);
+	SELFTEST_ASSERT_CHANNEL(4, 100000);
+	// next slave right after 3.5 characters
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(Test_Modbus_Sent(g_slave2Read, sizeof(g_slave2Read)));
+	Test_Modbus_Receive(g_slave2Reply, sizeof(g_slave2Reply));
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_CHANNEL(5, 42);
+
+	// each entry on its own interval
+	memset(requests, 0, sizeof(requests));
+	Test_Modbus_RunBus(3000, true, requests);
+	SELFTEST_ASSERT(requests[1] == 6);
+	SELFTEST_ASSERT(requests[2] == 3);
+	st = Modbus_GetSlaveStats(1);
+	SELFTEST_ASSERT(st && st->requests == 7 && st->replies == 7 && st->timeouts == 0);
+	SELFTEST_ASSERT(st->maxLatencyMs > 0 && st->maxLatencyMs <= 20);
+	SELFTEST_ASSERT(Modbus_GetBusLoad() > 0);
+	CMD_ExecuteCommand("Modbus_Stats", 0);
+	SELFTEST_ASSERT(Modbus_GetSlaveStats(1) == 0);
+
+	// silent slave times out, other one is still polled
+	memset(requests, 0, sizeof(requests));
+	Test_Modbus_RunBus(3000, false, requests);
+	SELFTEST_ASSERT(requests[1] == 6);
+	SELFTEST_ASSERT(requests[2] == 3);
+	// last one is still waited for
+	st = Modbus_GetSlaveStats(2);
+	SELFTEST_ASSERT(st && st->requests == 3 && st->timeouts == 2 && st->replies == 0);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Slave 2: 0/3 replies, 2 timeouts");
+
+	// write goes out after that one, ahead of polls due by then
+	CMD_ExecuteCommand("Modbus_Write 1 10 1234", 0);
+	Sim_RunFrames(20, false);
+	{
+		byte req[] = { 0x01, 0x06, 0x00, 0x0A, 0x04, 0xD2 };
+		SELFTEST_ASSERT(Test_Modbus_Sent(req, sizeof(req)));
+		Test_Modbus_Receive(req, sizeof(req));
+		Sim_RunFrames(1, false);
+		SELFTEST_ASSERT(Modbus_GetSlaveStats(1)->replies == 7);
+	}
+	CMD_ExecuteCommand("Modbus_Stats", 0);
+
+	// bad CRC and exception leave channels as they are
+	CHANNEL_Set(1, 0, 0);
+	memset(requests, 0, sizeof(requests));
+	for (i = 0; i < 100 && requests[1] == 0; i++) {
+		Sim_RunFrames(1, false);
+		if (Test_Modbus_Sent(g_slave1Read, sizeof(g_slave1Read))) {
+			requests[1]++;
+		}
+		SIM_ClearUART();
+	}
+	SELFTEST_ASSERT(requests[1] == 1);
+	memcpy(bad, g_slave1Reply, sizeof(g_slave1Reply));
+	crc = Modbus_CRC16(bad, sizeof(g_slave1Reply)) ^ 1;
+	bad[sizeof(g_slave1Reply)] = crc & 0xFF;
+	bad[sizeof(g_slave1Reply) + 1] = crc >> 8;
+	UART_AppendBytesToReceiveRingBuffer(bad, sizeof(bad));
+	Sim_RunFrames(1, false);
+	st = Modbus_GetSlaveStats(1);
+	SELFTEST_ASSERT(st && st->crcErrors == 1 && st->replies == 0);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	for (i = 0; i < 100 && requests[1] == 1; i++) {
+		Sim_RunFrames(1, false);
+		if (Test_Modbus_Sent(g_slave1Read, sizeof(g_slave1Read))) {
+			requests[1]++;
+		}
+		SIM_ClearUART();
+	}
+	SELFTEST_ASSERT(requests[1] == 2);
+	{
+		byte exc[] = { 0x01, 0x83, 0x02 };
+		Test_Modbus_Receive(exc, sizeof(exc));
+	}
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(st->exceptions == 1 && st->timeouts == 0);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+
+	// slave mode, channels are holding registers
+	CMD_ExecuteCommand("Modbus_Slave 5", 0);
+	Sim_RunFrames(2, false);
+	SIM_ClearUART();
+	CHANNEL_Set(1, 230, 0);
+	CHANNEL_Set(2, -5, 0);
+	{
+		byte req[] = { 0x05, 0x03, 0x00, 0x01, 0x00, 0x02 };
+		byte reply[] = { 0x05, 0x03, 0x04, 0x00, 0xE6, 0xFF, 0xFB };
+		Test_Modbus_Receive(req, sizeof(req));
+		Sim_RunFrames(1, false);
+		SELFTEST_ASSERT(Test_Modbus_Sent(reply, sizeof(reply)));
+	}
+	{
+		byte req[] = { 0x05, 0x06, 0x00, 0x03, 0x00, 0x64 };
+		Test_Modbus_Receive(req, sizeof(req));
+		Sim_RunFrames(1, false);
+		SELFTEST_ASSERT(Test_Modbus_Sent(req, sizeof(req)));
+		SELFTEST_ASSERT_CHANNEL(3, 100);
+	}
+	{
+		byte req[] = { 0x05, 0x10, 0x00, 0x04, 0x00, 0x02, 0x04, 0x00, 0x01, 0xFF, 0xFE };
+		byte reply[] = { 0x05, 0x10, 0x00, 0x04, 0x00, 0x02 };
+		Test_Modbus_Receive(req, sizeof(req));
+		Sim_RunFrames(1, false);
+		SELFTEST_ASSERT(Test_Modbus_Sent(reply, sizeof(reply)));
+		SELFTEST_ASSERT_CHANNEL(4, 1);
+		SELFTEST_ASSERT_CHANNEL(5, -2);
+	}
+	// register past channels and unknown function
+	{
+		byte req[] = { 0x05, 0x03, 0x00, 0x3F, 0x00, 0x02 };
+		byte reply[] = { 0x05, 0x83, 0x02 };
+		Test_Modbus_Receive(req, sizeof(req));
+		Sim_RunFrames(1, false);
+		SELFTEST_ASSERT(Test_Modbus_Sent(reply, sizeof(reply)));
+	}
+	{
+		byte req[] = { 0x05, 0x07, 0x00, 0x00, 0x00, 0x00 };
+		byte reply[] = { 0x05, 0x87, 0x01 };
+		Test_Modbus_Receive(req, sizeof(req));
+		Sim_RunFrames(1, false);
+		SELFTEST_ASSERT(Test_Modbus_Sent(reply, sizeof(reply)));
+	}
+	// other slave and broadcast are not answered, broadcast is applied
+	{
+		byte req[] = { 0x06, 0x03, 0x00, 0x01, 0x00, 0x02 };
+		byte bcast[] = { 0x00, 0x06, 0x00, 0x03, 0x00, 0x07 };
+		Test_Modbus_Receive(req, sizeof(req));
+		Test_Modbus_Receive(bcast, sizeof(bcast));
+		Sim_RunFrames(1, false);
+		SELFTEST_ASSERT_HAS_UART_EMPTY();
+		SELFTEST_ASSERT_CHANNEL(3, 7);
+	}
+	// noise before request and rest of a frame that never ends
+	{
+		byte req[] = { 0x05, 0x03, 0x00, 0x03, 0x00, 0x01 };
+		byte reply[] = { 0x05, 0x03, 0x02, 0x00, 0x07 };
+		UART_AppendByteToReceiveRingBuffer(0x55);
+		Test_Modbus_Receive(req, sizeof(req));
+		UART_AppendByteToReceiveRingBuffer(0x05);
+		UART_AppendByteToReceiveRingBuffer(0x03);
+		Sim_RunFrames(1, false);
+		SELFTEST_ASSERT(Test_Modbus_Sent(reply, sizeof(reply)));
+		Sim_RunFrames(2, false);
+		SELFTEST_ASSERT(UART_GetDataSize() == 0);
+	}
+	st = Modbus_GetSlaveStats(5);
+	SELFTEST_ASSERT(st && st->requests == 7 && st->replies == 4 && st->exceptions == 2);
+
+	CMD_ExecuteCommand("stopDriver Modbus", 0);
+	SIM_ClearUART();
+}
+
+#endif
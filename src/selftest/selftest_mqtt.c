@@ -2,6 +2,7 @@
 
 #include "selftest_local.h"
 #include "../hal/hal_wifi.h"
+#include "../mqtt/new_mqtt.h"
 
 void SIM_ClearAndPrepareForMQTTTesting(const char *clientName, const char *groupName) {
 	SIM_ClearOBK(0);
@@ -828,6 +829,500 @@ void Test_MQTT_Average() {
 	SIM_ClearMQTTHistory();
 }
 
+void Test_MQTT_Queue() {
+	extern int g_MqttPublishItemsQueued;
+	char channel[16];
+	char value[16];
+	char *big;
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+	SIM_ClearMQTTHistory();
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+
+	// many short items fit in a few chunks
+	for (i = 0; i < 198; i++) {
+		sprintf(channel, "q/%i", i);
+		sprintf(value, "%i", i * 3);
+		MQTT_QueuePublish("myTestDevice", channel, value, 0);
+	}
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 198);
+	// item larger than a chunk
+	big = malloc(MQTT_PUBLISH_ITEM_VALUE_LENGTH + 1);
+	memset(big, 'x', MQTT_PUBLISH_ITEM_VALUE_LENGTH);
+	big[MQTT_PUBLISH_ITEM_VALUE_LENGTH] = 0;
+	MQTT_QueuePublish("myTestDevice", "big", big, 0);
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 199);
+
+	// published in order, a few per second
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 199 - MQTT_QUEUED_ITEMS_PUBLISHED_AT_ONCE);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/q/0", "0", false);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/q/2", "6", false);
+	for (i = 0; i < 100 && g_MqttPublishItemsQueued > 1; i++) {
+		SIM_ClearMQTTHistory();
+		MQTT_RunEverySecondUpdate();
+	}
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 1);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/q/197", "591", false);
+	SIM_ClearMQTTHistory();
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/big", big, false);
+	free(big);
+
+	// queue is reused after being drained
+	SIM_ClearMQTTHistory();
+	MQTT_QueuePublish("myTestDevice", "again", "1", 0);
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/again", "1", false);
+	SIM_ClearMQTTHistory();
+}
+void Test_MQTT_QueueCoalesce() {
+	extern int g_MqttPublishItemsQueued;
+	char value[64];
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+	SIM_ClearMQTTHistory();
+
+	// by default only retained topics are coalesced
+	for (i = 0; i < 5; i++) {
+		sprintf(value, "%i", i);
+		MQTT_QueuePublish("myTestDevice", "plain", value, 0);
+		MQTT_QueuePublish("myTestDevice", "kept", value, OBK_PUBLISH_FLAG_RETAIN);
+	}
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 6);
+	MQTT_RunEverySecondUpdate();
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/kept", "4", true);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/kept", "0", true));
+	SIM_ClearMQTTHistory();
+
+	// all topics, new value keeps the position of the first one
+	CMD_ExecuteCommand("mqtt_queueCoalesce 2", 0);
+	MQTT_QueuePublish("myTestDevice", "a", "1", 0);
+	MQTT_QueuePublish("myTestDevice", "b", "1", 0);
+	MQTT_QueuePublish("myTestDevice", "c", "1", 0);
+	MQTT_QueuePublish("myTestDevice", "d", "1", 0);
+	MQTT_QueuePublish("myTestDevice", "a", "2", 0);
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 4);
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 1);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/a", "2", false);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/a", "1", false));
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/d", "1", false));
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+	SIM_ClearMQTTHistory();
+
+	// longer value that doesn't fit goes to the end, old one is skipped
+	MQTT_QueuePublish("myTestDevice", "a", "1", 0);
+	MQTT_QueuePublish("myTestDevice", "b", "1", 0);
+	memset(value, 'y', 40);
+	value[40] = 0;
+	MQTT_QueuePublish("myTestDevice", "a", value, 0);
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 3);
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/a", value, false);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/a", "1", false));
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/b", "1", false);
+	SIM_ClearMQTTHistory();
+
+	// off
+	CMD_ExecuteCommand("mqtt_queueCoalesce 0", 0);
+	MQTT_QueuePublish("myTestDevice", "kept", "1", OBK_PUBLISH_FLAG_RETAIN);
+	MQTT_QueuePublish("myTestDevice", "kept", "2", OBK_PUBLISH_FLAG_RETAIN);
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 2);
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+	SIM_ClearMQTTHistory();
+
+	// back to default
+	CMD_ExecuteCommand("mqtt_queueCoalesce 1", 0);
+}
+
+void Test_MQTT_Dedup() {
+	char name[16];
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+	CMD_ExecuteCommand("mqtt_dedupExpire 60", 0);
+	SIM_ClearMQTTHistory();
+
+	MQTT_PublishMain_StringInt("voltage", 3300, OBK_PUBLISH_FLAG_DEDUP);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/voltage/get", "3300", false);
+	SIM_ClearMQTTHistory();
+	// same value is skipped
+	MQTT_PublishMain_StringInt("voltage", 3300, OBK_PUBLISH_FLAG_DEDUP);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/voltage/get", "3300", false));
+	// unless caller didn't opt in
+	MQTT_PublishMain_StringInt("voltage", 3300, 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/voltage/get", "3300", false);
+	SIM_ClearMQTTHistory();
+	// new value is sent
+	MQTT_PublishMain_StringFloat("voltage", 3.25f, 2, OBK_PUBLISH_FLAG_DEDUP);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/voltage/get", "3.25", false);
+	SIM_ClearMQTTHistory();
+	MQTT_PublishMain_StringFloat("voltage", 3.25f, 2, OBK_PUBLISH_FLAG_DEDUP);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/voltage/get", "3.25", false));
+	// other topics don't affect it, even if there are more than cache entries
+	for (i = 0; i < 64; i++) {
+		sprintf(name, "sensor%i", i);
+		MQTT_PublishMain_StringInt(name, 1, OBK_PUBLISH_FLAG_DEDUP);
+	}
+	SIM_ClearMQTTHistory();
+	MQTT_PublishMain_StringInt("sensor63", 1, OBK_PUBLISH_FLAG_DEDUP);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/sensor63/get", "1", false));
+	// value is sent again after expire time
+	g_secondsElapsed += 61;
+	MQTT_PublishMain_StringInt("sensor63", 1, OBK_PUBLISH_FLAG_DEDUP);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/sensor63/get", "1", false);
+	SIM_ClearMQTTHistory();
+
+	// channel publish can opt in too
+	CMD_ExecuteCommand("setChannel 5 12", 0);
+	SIM_ClearMQTTHistory();
+	MQTT_ChannelPublish(5, OBK_PUBLISH_FLAG_DEDUP);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/5/get", "12", false);
+	SIM_ClearMQTTHistory();
+	MQTT_ChannelPublish(5, OBK_PUBLISH_FLAG_DEDUP);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/5/get", "12", false));
+	SIM_ClearMQTTHistory();
+}
+
+void Test_MQTT_RxBuffer() {
+	char *args;
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+
+	// several messages wait in buffer and are processed in order
+	MQTT_Post_Received_Str("cmnd/myTestDevice/setChannel", "1 5");
+	MQTT_Post_Received_Str("cmnd/myTestDevice/addChannel", "1 10");
+	MQTT_Post_Received_Str("cmnd/myTestDevice/setChannel", "2 1");
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	MQTT_process_received();
+	SELFTEST_ASSERT_CHANNEL(1, 15);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+
+	// records of odd sizes wrap around the buffer many times
+	args = malloc(3200);
+	for (i = 0; i < 40; i++) {
+		sprintf(args, "3 1");
+		memset(args + 3, ' ', 100 + i * 37);
+		args[103 + i * 37] = 0;
+		SIM_SendFakeMQTTAndRunSimFrame_CMND("addChannel", args);
+	}
+	SELFTEST_ASSERT_CHANNEL(3, 40);
+
+	// payload larger than 2 KB is not truncated
+	memset(args, ' ', 3000);
+	strcpy(args + 3000, "4 9");
+	SIM_SendFakeMQTTAndRunSimFrame_CMND("setChannel", args);
+	SELFTEST_ASSERT_CHANNEL(4, 9);
+	free(args);
+}
+
+static int g_routeHits[48];
+static int Test_MQTT_Route_Cb(obk_mqtt_request_t* request) {
+	int id;
+
+	// ID is encoded in payload, so one function serves all callbacks
+	id = atoi((const char*)request->received);
+	g_routeHits[id]++;
+	return 0;
+}
+static int Test_MQTT_Route_Dev(obk_mqtt_request_t* request) {
+	int id;
+
+	// topic is test/dev<N>/x
+	id = atoi(request->topic + 8);
+	g_routeHits[id]++;
+	return 0;
+}
+
+void Test_MQTT_Routing() {
+	char filter[32];
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+
+	// more callbacks than the old fixed table had
+	for (i = 0; i < 40; i++) {
+		sprintf(filter, "test/dev%i/+", i);
+		SELFTEST_ASSERT(MQTT_RegisterCallback("test/", filter, 100 + i, Test_MQTT_Route_Dev) == 0);
+	}
+	memset(g_routeHits, 0, sizeof(g_routeHits));
+	MQTT_Post_Received_Str("test/dev33/x", "");
+	MQTT_Post_Received_Str("test/dev7/x", "");
+	MQTT_Post_Received_Str("test/dev7/x/y", "");
+	MQTT_Post_Received_Str("test/dev50/x", "");
+	MQTT_process_received();
+	SELFTEST_ASSERT(g_routeHits[33] == 1);
+	SELFTEST_ASSERT(g_routeHits[7] == 1);
+	SELFTEST_ASSERT(g_routeHits[8] == 0);
+	// built-in callbacks still work
+	SIM_SendFakeMQTTAndRunSimFrame_CMND("setChannel", "1 23");
+	SELFTEST_ASSERT_CHANNEL(1, 23);
+	for (i = 0; i < 40; i++) {
+		SELFTEST_ASSERT(MQTT_RemoveCallback(100 + i) == 1);
+	}
+	SELFTEST_ASSERT(MQTT_RemoveCallback(100) == 0);
+
+	// wildcards, all matching callbacks get message in registration order
+	MQTT_RegisterCallback("wild/", "wild/#", 140, Test_MQTT_Route_Cb);
+	MQTT_RegisterCallback("wild/", "wild/+/b", 141, Test_MQTT_Route_Cb);
+	MQTT_RegisterCallback("wild/", "wild/a/b", 142, Test_MQTT_Route_Cb);
+	MQTT_RegisterCallback("wild/", "wild/+/#", 143, Test_MQTT_Route_Cb);
+	memset(g_routeHits, 0, sizeof(g_routeHits));
+	MQTT_Post_Received_Str("wild/a/b", "0");
+	MQTT_process_received();
+	SELFTEST_ASSERT(g_routeHits[0] == 4);
+	memset(g_routeHits, 0, sizeof(g_routeHits));
+	MQTT_Post_Received_Str("wild/a/c", "0");
+	MQTT_Post_Received_Str("wild", "0");
+	MQTT_Post_Received_Str("other/a/b", "0");
+	MQTT_process_received();
+	// wild/# twice, wild/+/# once
+	SELFTEST_ASSERT(g_routeHits[0] == 3);
+
+	// re-registering with same ID moves callback to new topic
+	MQTT_RegisterCallback("wild/", "moved/+", 142, Test_MQTT_Route_Cb);
+	memset(g_routeHits, 0, sizeof(g_routeHits));
+	MQTT_Post_Received_Str("moved/x", "5");
+	MQTT_Post_Received_Str("wild/q/b", "6");
+	MQTT_process_received();
+	SELFTEST_ASSERT(g_routeHits[5] == 1);
+	// wild/#, wild/+/b and wild/+/# match, but not old wild/a/b filter
+	SELFTEST_ASSERT(g_routeHits[6] == 3);
+	for (i = 140; i < 144; i++) {
+		MQTT_RemoveCallback(i);
+	}
+	memset(g_routeHits, 0, sizeof(g_routeHits));
+	MQTT_Post_Received_Str("wild/a/b", "0");
+	MQTT_process_received();
+	SELFTEST_ASSERT(g_routeHits[0] == 0);
+}
+
+void Test_MQTT_BroadcastJSON() {
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+
+	CMD_ExecuteCommand("setChannelType 1 Toggle", 0);
+	CMD_ExecuteCommand("setChannelType 2 Dimmer", 0);
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+	CMD_ExecuteCommand("setChannel 2 42", 0);
+	CMD_ExecuteCommand("mqtt_broadcastJSON 1", 0);
+	SIM_ClearMQTTHistory();
+
+	// whole state goes out in one message, no per item publishes
+	CMD_ExecuteCommand("publishAll", 0);
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("myTestDevice/state", false);
+	SELFTEST_ASSERT_JSON_VALUE_STRING(0, "host", CFG_GetShortDeviceName());
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("channels", "1", 1);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("channels", "2", 42);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/host", CFG_GetShortDeviceName(), false));
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/2/get", "42", false));
+	for (i = 0; i < 5; i++) {
+		MQTT_RunEverySecondUpdate();
+	}
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/2/get", "42", false));
+
+	// dynamic broadcast skips static items
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("setChannel 2 43", 0);
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("publishChannels", 0);
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("myTestDevice/state", false);
+	SELFTEST_ASSERT_JSON_VALUE_STRING_NOT_PRESENT(0, "host");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("channels", "2", 43);
+
+	// default is one publish per item
+	CMD_ExecuteCommand("mqtt_broadcastJSON 0", 0);
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("publishAll", 0);
+	for (i = 0; i < 20; i++) {
+		MQTT_RunEverySecondUpdate();
+	}
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/2/get", "43", false);
+	SELFTEST_ASSERT(!SIM_GetMQTTHistoryString("myTestDevice/state", false));
+}
+
+void Test_MQTT_RateLimit() {
+	extern int g_MqttPublishItemsQueued;
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+
+	// 2 tokens per second, bucket of 4, telemetry uses only the top 2
+	CMD_ExecuteCommand("mqtt_rateLimit 2 4 2", 0);
+	SIM_ClearMQTTHistory();
+	MQTT_PublishTele("t1", "a");
+	MQTT_PublishTele("t2", "b");
+	MQTT_PublishTele("t3", "c");
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("tele/myTestDevice/t1", "a", false);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("tele/myTestDevice/t2", "b", false);
+	// deferred, waits in queue
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("tele/myTestDevice/t3", "c", false));
+
+	// state changes and replies still go out at once
+	MQTT_PublishMain_StringString("st1", "1", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/st1/get", "1", false);
+	MQTT_PublishMain_StringString("st2", "2", 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/st2/get", "2", false);
+	// bucket is empty, next state change waits, reply does not
+	MQTT_PublishMain_StringString("st3", "3", 0);
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/st3/get", "3", false));
+	MQTT_PublishStat("RESULT", "ok");
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("stat/myTestDevice/RESULT", "ok", false);
+
+	// tokens come back over time and queue is sent in order,
+	// reply took the last token, so one second is not enough for telemetry
+	MQTT_RunEverySecondUpdate();
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("tele/myTestDevice/t3", "c", false));
+	SELFTEST_ASSERT(!SIM_CheckMQTTHistoryForString("myTestDevice/st3/get", "3", false));
+	for (i = 0; i < 5; i++) {
+		MQTT_RunEverySecondUpdate();
+	}
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("tele/myTestDevice/t3", "c", false);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/st3/get", "3", false);
+	SELFTEST_ASSERT(g_MqttPublishItemsQueued == 0);
+
+	CMD_ExecuteCommand("mqtt_rateLimit 0", 0);
+	SIM_ClearMQTTHistory();
+	MQTT_PublishTele("t4", "d");
+	MQTT_PublishTele("t5", "e");
+	MQTT_PublishTele("t6", "f");
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("tele/myTestDevice/t6", "f", false);
+}
+
+void Test_MQTT_Reconnect() {
+	int i, attempts;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+	// connect is only attempted with a host set
+	CFG_SetMQTTHost("127.0.0.1");
+	CFG_SetFlag(OBK_FLAG_MQTT_BROADCASTSELFSTATEONCONNECT, true);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+
+	// connection accepted by broker after long outage (or the first one),
+	// whole state is published, an item per second
+	SIM_SetMQTTOffline(true);
+	Sim_RunSeconds(70, false);
+	SIM_SetMQTTOffline(false);
+	SIM_ClearMQTTHistory();
+	Sim_RunSeconds(30, false);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("myTestDevice/host", false) != 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/1/get", "1", false);
+
+	// first retry a second after disconnect, then delay doubles
+	attempts = SIM_GetMQTTConnectAttempts();
+	SIM_SetMQTTOffline(true);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(SIM_GetMQTTConnectAttempts() == attempts + 1);
+	Sim_RunSeconds(28, false);
+	i = SIM_GetMQTTConnectAttempts() - attempts;
+	SELFTEST_ASSERT(i >= 3 && i <= 5);
+
+	// short outage with nothing lost, nothing is published again
+	SIM_ClearMQTTHistory();
+	SIM_SetMQTTOffline(false);
+	Sim_RunSeconds(30, false);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("myTestDevice/host", false) == 0);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("myTestDevice/1/get", false) == 0);
+	// and backoff is back to a second
+	attempts = SIM_GetMQTTConnectAttempts();
+	SIM_SetMQTTOffline(true);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(SIM_GetMQTTConnectAttempts() == attempts + 1);
+
+	// short outage with publish lost, only channels are published again
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	Sim_RunSeconds(10, false);
+	SIM_ClearMQTTHistory();
+	SIM_SetMQTTOffline(false);
+	Sim_RunSeconds(30, false);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("myTestDevice/host", false) == 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/1/get", "0", false);
+
+	// long outage, whole state again even if nothing was lost
+	SIM_SetMQTTOffline(true);
+	Sim_RunSeconds(70, false);
+	SIM_ClearMQTTHistory();
+	SIM_SetMQTTOffline(false);
+	Sim_RunSeconds(30, false);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("myTestDevice/host", false) != 0);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("myTestDevice/1/get", "0", false);
+}
+
+void Test_MQTT_TlsOptions() {
+	// same numbering as MBEDTLS_SSL_MAX_FRAG_LEN_xxx
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(0) == 0);
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(-5) == 0);
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(100) == 1);
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(512) == 1);
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(1023) == 1);
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(1024) == 2);
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(2048) == 3);
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(4000) == 3);
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(4096) == 4);
+	SELFTEST_ASSERT(MQTT_TLS_MaxFragmentCode(16384) == 4);
+}
+
+void Test_MQTT_Benchmark() {
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("myTestDevice", "bekens");
+
+	CMD_ExecuteCommand("publishBenchmark 20 40 0", 0);
+	// waits for subscription first
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT(SIM_RepostMQTTPublishes("myTestDevice/benchmark") == 0);
+	// only the first 8 are sent before they come back
+	Sim_RunMiliseconds(600, false);
+	SELFTEST_ASSERT(SIM_RepostMQTTPublishes("myTestDevice/benchmark") == 8);
+	for (i = 0; i < 20; i++) {
+		Sim_RunFrames(2, false);
+		SIM_RepostMQTTPublishes("myTestDevice/benchmark");
+	}
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("myTestDevice/benchmark/result", false);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "sent", 20);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "received", 20);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "size", 40);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "qos", 0);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "queueMax", 0);
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer("p99", 0) >= Test_GetJSONValue_Integer("p50", 0));
+	SELFTEST_ASSERT(Test_GetJSONValue_Integer("rate", 0) > 0);
+
+	// loopback never comes, benchmark gives up after timeout
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("publishBenchmark 4", 0);
+	Sim_RunSeconds(7, false);
+	SELFTEST_ASSERT_HAS_MQTT_JSON_SENT("myTestDevice/benchmark/result", false);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "sent", 4);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "received", 0);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "qos", 1);
+}
+
 void Test_MQTT(){
 	Test_MQTT_Misc();
 	Test_MQTT_Get_And_Reply();
@@ -840,6 +1335,16 @@ void Test_MQTT(){
 	Test_MQTT_Topic_With_Slash();
 	Test_MQTT_Topic_With_Slashes();
 	Test_MQTT_Average();
+	Test_MQTT_Queue();
+	Test_MQTT_QueueCoalesce();
+	Test_MQTT_Dedup();
+	Test_MQTT_RxBuffer();
+	Test_MQTT_Routing();
+	Test_MQTT_BroadcastJSON();
+	Test_MQTT_RateLimit();
+	Test_MQTT_Reconnect();
+	Test_MQTT_TlsOptions();
+	Test_MQTT_Benchmark();
 }
 
 #endif
@@ -84,6 +84,32 @@ void Test_MultiplePinsOnChannel() {
 	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_LED_n, false);
 	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_RELAY, true);
 	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_RELAY_n, false);
+
+	SELFTEST_ASSERT(h_isChannelRelay(1));
+	SELFTEST_ASSERT(CHANNEL_IsPowerRelayChannel(1));
+	SELFTEST_ASSERT(CHANNEL_IsInUse(1));
+	SELFTEST_ASSERT(CHANNEL_IsInUse(2) == false);
+
+	// move relay to other channel, it must follow that channel only
+	PIN_SetPinChannelForPinIndex(PIN_RELAY, 2);
+	SELFTEST_ASSERT(CHANNEL_HasChannelPinWithRole(2, IOR_Relay));
+	SELFTEST_ASSERT(CHANNEL_HasChannelPinWithRole(1, IOR_Relay) == false);
+	SELFTEST_ASSERT(CHANNEL_IsInUse(2));
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_LED_n, true);
+	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_RELAY, true);
+	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_RELAY_n, true);
+	CMD_ExecuteCommand("setChannel 2 1", 0);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_RELAY, false);
+
+	// role change is seen too, relay_n is not relay anymore
+	PIN_SetPinRoleForPinIndex(PIN_RELAY_n, IOR_None);
+	SELFTEST_ASSERT(CHANNEL_IsPowerRelayChannel(1) == false);
+	SELFTEST_ASSERT(h_isChannelRelay(1));
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_LED_n, false);
+	SELFTEST_ASSERT_PIN_BOOLEAN(PIN_RELAY, false);
 }
 
 
@@ -0,0 +1,139 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_uart.h"
+#include "../httpserver/new_http.h"
+#include "../driver/drv_neo6m.h"
+
+#if ENABLE_DRIVER_NEO6M
+
+static void Test_NEO6M_Feed(const char *s) {
+	UART_AppendBytesToReceiveRingBuffer((const byte*)s, strlen(s));
+}
+// UBX frame with sync chars and checksum
+static void Test_NEO6M_FeedUBX(byte cls, byte id, const byte *payload, int len) {
+	byte frame[128];
+	byte a = 0, b = 0;
+	int i;
+
+	frame[0] = 0xB5;
+	frame[1] = 0x62;
+	frame[2] = cls;
+	frame[3] = id;
+	frame[4] = len;
+	frame[5] = len >> 8;
+	memcpy(frame + 6, payload, len);
+	for (i = 2; i < 6 + len; i++) {
+		a += frame[i];
+		b += a;
+	}
+	frame[6 + len] = a;
+	frame[7 + len] = b;
+	UART_AppendBytesToReceiveRingBuffer(frame, len + 8);
+}
+static void Test_NEO6M_PutI32(byte *p, int v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+void Test_NEO6M() {
+	neo6mFix_t fix;
+	neo6mStats_t st;
+	byte pvt[92];
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("gpsTester", "bekens");
+	CMD_ExecuteCommand("startDriver NEO6M", 0);
+
+	Test_NEO6M_Feed("$GPRMC,142953.00,A,5213.00212,N,02101.98018,E,0.105,,200724,,,A*71\r\n");
+	Sim_RunFrames(1, false);
+	NEO6M_GetFix(&fix);
+	SELFTEST_ASSERT(fix.valid);
+	SELFTEST_ASSERT(fix.lat == 522167020);
+	SELFTEST_ASSERT(fix.lon == 210330030);
+	SELFTEST_ASSERT(fix.hour == 14 && fix.minute == 29 && fix.second == 53);
+	SELFTEST_ASSERT(fix.year == 2024 && fix.month == 7 && fix.day == 20);
+	// 0.105 knots
+	SELFTEST_ASSERT(fix.speed == 54);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "GPS: 2024-07-20T14:29:53 Lat: 52.2167020N Long: 21.0330030E");
+
+	// sentence split between ticks, with other sentences around
+	Test_NEO6M_Feed("$GPGSV,1,1,00*79\r\n$GNGGA,142953.00,5213.00212,N,02101.98");
+	Sim_RunFrames(1, false);
+	Test_NEO6M_Feed("018,E,1,08,1.01,123.4,M,34.5,M,,*4A\r\n$GPVTG,77.52,T,,M,5.400,N,10.001,K,A*3B\r\n");
+	Test_NEO6M_Feed("$GPGSA,A,3,04,05,09,12,,,,,,,,,2.5,1.3,2.1*3F\r\n");
+	Sim_RunFrames(1, false);
+	NEO6M_GetFix(&fix);
+	SELFTEST_ASSERT(fix.alt == 123400);
+	SELFTEST_ASSERT(fix.sats == 8);
+	SELFTEST_ASSERT(fix.course == 7752);
+	// 10.001 km/h
+	SELFTEST_ASSERT(fix.speed == 2778);
+	SELFTEST_ASSERT(fix.fixType == 3);
+	SELFTEST_ASSERT(fix.pdop == 250 && fix.hdop == 130 && fix.vdop == 210);
+	NEO6M_GetStats(&st);
+	SELFTEST_ASSERT(st.bad == 0);
+	// RMC and GGA of same second
+	SELFTEST_ASSERT(st.epochs == 1);
+
+	// bad checksum changes nothing
+	Test_NEO6M_Feed("$GPRMC,142955.00,A,5213.10000,S,02101.98018,W,0.105,,200724,,,A*79\r\n");
+	Sim_RunFrames(1, false);
+	NEO6M_GetFix(&fix);
+	SELFTEST_ASSERT(fix.lat == 522167020);
+	NEO6M_GetStats(&st);
+	SELFTEST_ASSERT(st.bad == 1);
+	Test_NEO6M_Feed("$GPRMC,142955.00,A,5213.10000,S,02101.98018,W,0.105,,200724,,,A*78\r\n");
+	Sim_RunFrames(1, false);
+	NEO6M_GetFix(&fix);
+	SELFTEST_ASSERT(fix.lat == -522183333);
+	SELFTEST_ASSERT(fix.lon == -210330030);
+
+	// UBX NAV-PVT
+	memset(pvt, 0, sizeof(pvt));
+	pvt[4] = 2025 & 0xFF;
+	pvt[5] = 2025 >> 8;
+	pvt[6] = 3;
+	pvt[7] = 4;
+	pvt[8] = 5;
+	pvt[9] = 6;
+	pvt[10] = 7;
+	pvt[11] = 3;
+	pvt[20] = 3;
+	pvt[21] = 1;
+	pvt[23] = 11;
+	Test_NEO6M_PutI32(pvt + 24, 210000000);
+	Test_NEO6M_PutI32(pvt + 28, 520000000);
+	Test_NEO6M_PutI32(pvt + 36, 99000);
+	Test_NEO6M_PutI32(pvt + 60, 1500);
+	Test_NEO6M_FeedUBX(0x01, 0x07, pvt, sizeof(pvt));
+	Sim_RunFrames(1, false);
+	NEO6M_GetFix(&fix);
+	SELFTEST_ASSERT(fix.lat == 520000000 && fix.lon == 210000000);
+	SELFTEST_ASSERT(fix.alt == 99000 && fix.speed == 1500 && fix.sats == 11);
+	SELFTEST_ASSERT(fix.year == 2025 && fix.hour == 5);
+	NEO6M_GetStats(&st);
+	SELFTEST_ASSERT(st.ubx == 1);
+
+	// position is published only after it moved far enough
+	CMD_ExecuteCommand("NEO6M_MinDistance 20", 0);
+	Test_NEO6M_Feed("$GPRMC,142953.00,A,5213.00212,N,02101.98018,E,0.105,,200724,,,A*71\r\n");
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_HAD_MQTT_PUBLISH_STR("gpsTester/gps/get",
+		"{\"lat\":52.2167020,\"lon\":21.0330030,\"alt\":99,\"speed\":54,\"course\":0,\"sats\":11}", false);
+	SIM_ClearMQTTHistory();
+	// about 2 m north
+	Test_NEO6M_Feed("$GPRMC,142954.00,A,5213.00312,N,02101.98018,E,0.105,,200724,,,A*77\r\n");
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("gpsTester/gps/get", false) == 0);
+	// about 34 km south
+	Test_NEO6M_Feed("$GPRMC,142955.00,A,5154.50000,N,02101.98018,E,0.105,,200724,,,A*73\r\n");
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(SIM_GetMQTTHistoryString("gpsTester/gps/get", false) != 0);
+}
+
+#endif
+
+#endif
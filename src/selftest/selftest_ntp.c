@@ -1,6 +1,9 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_ntp.h"
+#include "../driver/drv_local.h"
+#include "../devicegroups/deviceGroups_public.h"
 
 void Test_NTP() {
 	// reset whole device
@@ -38,8 +41,131 @@ void Test_NTP() {
 	CMD_ExecuteCommand("ntp_timeZoneOfs -12:05", 0);
 	SELFTEST_ASSERT_INTCOMPARE(NTP_GetTimesZoneOfsSeconds(), -(12 * 60 * 60 + 5 * 60));
 
+	// reply 40 ms after request, server held it 2 ms,
+	// so half of 38 ms is added to its time
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver NTP 64 256", 0);
+	SELFTEST_ASSERT(NTP_IsTimeSynced() == false);
+	NTP_SimulateReply(1700000000, 250, 40, 2);
+	SELFTEST_ASSERT(NTP_IsTimeSynced());
+	SELFTEST_ASSERT(NTP_GetCurrentTimeMs() == 1700000000269ULL);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_GetCurrentTimeWithoutOffset(), 1700000000);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_GetPollInterval(), 64);
+	// clock counts on from tick counter
+	Sim_RunMiliseconds(500, false);
+	SELFTEST_ASSERT(NTP_GetCurrentTimeMs() >= 1700000000769ULL && NTP_GetCurrentTimeMs() < 1700000000869ULL);
+	// replies that agree with clock double poll up to maximum
+	NTP_SimulateReply(1700000000, (int)(NTP_GetCurrentTimeMs() % 1000), 0, 0);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_GetPollInterval(), 128);
+	NTP_SimulateReply(1700000000, (int)(NTP_GetCurrentTimeMs() % 1000), 0, 0);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_GetPollInterval(), 256);
+	NTP_SimulateReply(1700000000, (int)(NTP_GetCurrentTimeMs() % 1000), 0, 0);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_GetPollInterval(), 256);
+	// clock that was off by second is checked again soon
+	NTP_SimulateReply(1700000002, 0, 0, 0);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_GetPollInterval(), 64);
+	SELFTEST_ASSERT(NTP_GetCurrentTimeMs() == 1700000002000ULL);
+
 
 
+}
+void Test_NTP_Actions() {
+	char buf[128];
+	byte packet[128];
+	const char *payload;
+	uint64_t now;
+	int len;
+
+	SIM_ClearAndPrepareForMQTTTesting("ntpActDev", "ntpActGrp");
+	// long poll, so nothing is sent to real server meanwhile
+	CMD_ExecuteCommand("startDriver NTP 1024 1024", 0);
+	NTP_SimulateReply(1700000000, 0, 0, 0);
+	SELFTEST_ASSERT(NTP_IsTimeSynced());
+	SELFTEST_ASSERT_INTCOMPARE(NTP_GetDriftPpm(), 0);
+
+	// server is 16 ms ahead after 64 s, tick counter runs 250 ppm slow,
+	// half of it is taken at once
+	Sim_RunMiliseconds(64000, false);
+	now = NTP_GetCurrentTimeMs();
+	NTP_SimulateReply((uint32_t)((now + 16) / 1000), (int)((now + 16) % 1000), 0, 0);
+	SELFTEST_ASSERT(NTP_GetDriftPpm() >= 120 && NTP_GetDriftPpm() <= 130);
+	now = NTP_GetCurrentTimeMs();
+	Sim_RunMiliseconds(64000, false);
+	SELFTEST_ASSERT(NTP_GetCurrentTimeMs() - now >= 64006 && NTP_GetCurrentTimeMs() - now <= 64010);
+
+	// relative time, runs on first tick at or after it
+	CMD_ExecuteCommand("ntp_at +1005 setChannel 1 5", 0);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_Actions_GetPendingCount(), 1);
+	SELFTEST_ASSERT(NTP_GetTimeToNextWakeMS() > 990 && NTP_GetTimeToNextWakeMS() <= 1005);
+	Sim_RunMiliseconds(900, false);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	Sim_RunMiliseconds(200, false);
+	SELFTEST_ASSERT_CHANNEL(1, 5);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_Actions_GetPendingCount(), 0);
+	SELFTEST_ASSERT(NTP_Actions_GetLastSkew() >= 0 && NTP_Actions_GetLastSkew() < 10);
+
+	// same action given twice (DGR and MQTT) is queued once
+	snprintf(buf, sizeof(buf), "ntp_at %llu addChannel 1 1", (unsigned long long)(NTP_GetCurrentTimeMs() + 2003));
+	CMD_ExecuteCommand(buf, 0);
+	CMD_ExecuteCommand(buf, 0);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_Actions_GetPendingCount(), 1);
+	Sim_RunMiliseconds(2100, false);
+	SELFTEST_ASSERT_CHANNEL(1, 6);
+
+	// deliberate stagger of this device
+	CMD_ExecuteCommand("ntp_atOffset 300", 0);
+	CMD_ExecuteCommand("ntp_at +1000 setChannel 2 7", 0);
+	Sim_RunMiliseconds(1150, false);
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+	Sim_RunMiliseconds(200, false);
+	SELFTEST_ASSERT_CHANNEL(2, 7);
+	CMD_ExecuteCommand("ntp_atOffset 0", 0);
+
+	// too late, dropped
+	snprintf(buf, sizeof(buf), "ntp_at %llu setChannel 3 9", (unsigned long long)(NTP_GetCurrentTimeMs() - 5000));
+	CMD_ExecuteCommand(buf, 0);
+	Sim_RunMiliseconds(100, false);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_Actions_GetPendingCount(), 0);
+
+	// from MQTT command topic
+	SIM_SendFakeMQTTAndRunSimFrame_CMND("ntp_at", "+500 setChannel 5 3");
+	SELFTEST_ASSERT_INTCOMPARE(NTP_Actions_GetPendingCount(), 1);
+	Sim_RunMiliseconds(600, false);
+	SELFTEST_ASSERT_CHANNEL(5, 3);
+
+	// from DGR command item, only with events shared in
+	CFG_DeviceGroups_SetName("ntpActGrp");
+	CFG_DeviceGroups_SetRecvFlags(0);
+	CMD_ExecuteCommand("startDriver DGR", 0);
+	snprintf(buf, sizeof(buf), "ntp_at %llu setChannel 4 4", (unsigned long long)(NTP_GetCurrentTimeMs() + 700));
+	len = DGR_Quick_FormatCommand(packet, sizeof(packet), "ntpActGrp", 1000, 0, buf);
+	DGR_SpoofNextDGRPacketSource("192.168.0.124");
+	DGR_ProcessIncomingPacket((char*)packet, len);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_Actions_GetPendingCount(), 0);
+	CFG_DeviceGroups_SetRecvFlags(DGR_SHARE_EVENT);
+	len = DGR_Quick_FormatCommand(packet, sizeof(packet), "ntpActGrp", 1001, 0, buf);
+	DGR_SpoofNextDGRPacketSource("192.168.0.124");
+	DGR_ProcessIncomingPacket((char*)packet, len);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_Actions_GetPendingCount(), 1);
+	Sim_RunMiliseconds(800, false);
+	SELFTEST_ASSERT_CHANNEL(4, 4);
+
+	// group send goes to MQTT group topic and is queued here once,
+	// even when broker gives it back
+	SIM_ClearMQTTHistory();
+	CMD_ExecuteCommand("ntp_atGroup 1500 setChannel 6 1", 0);
+	payload = SIM_GetMQTTHistoryString("cmnd/ntpActGrp/ntp_at", false);
+	SELFTEST_ASSERT(payload && strstr(payload, " setChannel 6 1"));
+	SIM_RepostMQTTPublishes("cmnd/ntpActGrp/ntp_at");
+	Sim_RunMiliseconds(100, false);
+	SELFTEST_ASSERT_INTCOMPARE(NTP_Actions_GetPendingCount(), 1);
+	Sim_RunMiliseconds(1500, false);
+	SELFTEST_ASSERT_CHANNEL(6, 1);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("ntp_atStats", 0) == CMD_RES_OK);
+
+	CMD_ExecuteCommand("stopDriver DGR", 0);
+	CMD_ExecuteCommand("stopDriver NTP", 0);
 }
 
 
@@ -50,7 +50,16 @@ void Test_OpenWeatherMap() {
 	SELFTEST_ASSERT_STRING(w->description, "clear sky");
 	SELFTEST_ASSERT_FLOATCOMPARE(w->lat, 50);
 	SELFTEST_ASSERT_FLOATCOMPARE(w->lon, 10);
+	SELFTEST_ASSERT(w->sunrise == 1604965200);
+	SELFTEST_ASSERT(w->sunset == 1605001200);
+	SELFTEST_ASSERT(w->timezone == -18000);
 
+	// values that are there change, weather stays
+	Weather_SetReply(reply_no_weather);
+	SELFTEST_ASSERT_FLOATCOMPARE(w->temp, 20);
+	SELFTEST_ASSERT_FLOATCOMPARE(w->pressure, 900);
+	SELFTEST_ASSERT_FLOATCOMPARE(w->humidity, 60);
+	SELFTEST_ASSERT_STRING(w->main_weather, "Clear");
 
 }
 
@@ -0,0 +1,87 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+
+void Test_PingWatchDog() {
+	const pingStats_t *st = PingWatchDog_GetStats();
+	int i;
+
+	CFG_SetPingIntervalSeconds(2);
+	CFG_SetPingDisconnectedSecondsToRestart(0);
+	PingWatchDog_ResetStats();
+	SELFTEST_ASSERT(st->intervalMs == 2000);
+
+	// round trips go to buckets by upper limit, limit itself included
+	SELFTEST_ASSERT(PingWatchDog_GetBucketLimitMS(0) == 5);
+	SELFTEST_ASSERT(PingWatchDog_GetBucketLimitMS(PING_HIST_BUCKETS - 2) == 500);
+	SELFTEST_ASSERT(PingWatchDog_GetBucketLimitMS(PING_HIST_BUCKETS - 1) == -1);
+	PingWatchDog_OnSent();
+	PingWatchDog_OnReply(5);
+	PingWatchDog_OnReply(7);
+	PingWatchDog_OnReply(15);
+	SELFTEST_ASSERT(st->intervalMs == 2000);
+	PingWatchDog_OnReply(600);
+	SELFTEST_ASSERT(st->sent == 1);
+	SELFTEST_ASSERT(st->hist[0] == 1);
+	SELFTEST_ASSERT(st->hist[1] == 1);
+	SELFTEST_ASSERT(st->hist[2] == 1);
+	SELFTEST_ASSERT(st->hist[PING_HIST_BUCKETS - 1] == 1);
+	SELFTEST_ASSERT(st->minMs == 5);
+	SELFTEST_ASSERT(st->maxMs == 600);
+	SELFTEST_ASSERT(st->lastMs == 600);
+	SELFTEST_ASSERT(st->sumMs == 627);
+	SELFTEST_ASSERT(PingWatchDog_GetTotalReceived() == 4);
+
+	// healthy link, interval doubles after each 4 replies up to 8 times
+	SELFTEST_ASSERT(st->intervalMs == 4000);
+	for (i = 0; i < 4; i++) {
+		PingWatchDog_OnReply(100);
+	}
+	SELFTEST_ASSERT(st->intervalMs == 8000);
+	for (i = 0; i < 8; i++) {
+		PingWatchDog_OnReply(100);
+	}
+	SELFTEST_ASSERT(st->intervalMs == 16000);
+	SELFTEST_ASSERT(st->hist[4] == 12);
+
+	// loss goes back to base interval, then halves down to a second
+	PingWatchDog_OnLoss();
+	SELFTEST_ASSERT(st->intervalMs == 2000);
+	PingWatchDog_OnLoss();
+	SELFTEST_ASSERT(st->intervalMs == 1000);
+	PingWatchDog_OnLoss();
+	SELFTEST_ASSERT(st->intervalMs == 1000);
+	SELFTEST_ASSERT(PingWatchDog_GetTotalLost() == 3);
+	// loss breaks streak of replies
+	for (i = 0; i < 3; i++) {
+		PingWatchDog_OnReply(100);
+	}
+	PingWatchDog_OnLoss();
+	PingWatchDog_OnReply(100);
+	SELFTEST_ASSERT(st->intervalMs == 1000);
+
+	// there are few pings before watchdog restart time passes
+	CFG_SetPingDisconnectedSecondsToRestart(20);
+	PingWatchDog_ResetStats();
+	SELFTEST_ASSERT(st->received == 0 && st->hist[4] == 0);
+	for (i = 0; i < 4; i++) {
+		PingWatchDog_OnReply(100);
+	}
+	SELFTEST_ASSERT(st->intervalMs == 4000);
+	for (i = 0; i < 8; i++) {
+		PingWatchDog_OnReply(100);
+	}
+	SELFTEST_ASSERT(st->intervalMs == 5000);
+	// but never below base interval
+	CFG_SetPingDisconnectedSecondsToRestart(4);
+	for (i = 0; i < 4; i++) {
+		PingWatchDog_OnReply(100);
+	}
+	SELFTEST_ASSERT(st->intervalMs == 2000);
+
+	CFG_SetPingDisconnectedSecondsToRestart(0);
+	CFG_SetPingIntervalSeconds(0);
+	PingWatchDog_ResetStats();
+}
+
+#endif
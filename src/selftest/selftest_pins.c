@@ -2,7 +2,71 @@
 
 #include "selftest_local.h"
 
+static void Test_Pins_Counter() {
+	int i, rate;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	SIM_SetSimulatedPinValue(7, false);
+	PIN_SetPinRoleForPinIndex(7, IOR_Counter_r);
+	PIN_SetPinChannelForPinIndex(7, 3);
+	CMD_ExecuteCommand("CounterRate 7 4 1000", 0);
+	// simulator has no hardware counter
+	SELFTEST_ASSERT(PIN_Counter_IsHardware(7) == false);
+	for (i = 0; i < 50; i++) {
+		SIM_SetSimulatedPinValue(7, true);
+		SIM_SetSimulatedPinValue(7, false);
+	}
+	Sim_RunSeconds(1.2f, false);
+	SELFTEST_ASSERT_CHANNEL(3, 50);
+	rate = CHANNEL_Get(4);
+	SELFTEST_ASSERT(rate >= 45 && rate <= 50);
+	// no pulses in next window
+	Sim_RunSeconds(1.2f, false);
+	SELFTEST_ASSERT_CHANNEL(3, 50);
+	SELFTEST_ASSERT_CHANNEL(4, 0);
+
+	// rate off, count goes on
+	CMD_ExecuteCommand("setChannel 4 7", 0);
+	CMD_ExecuteCommand("CounterRate 7 -1", 0);
+	SIM_SetSimulatedPinValue(7, true);
+	SIM_SetSimulatedPinValue(7, false);
+	Sim_RunSeconds(1.2f, false);
+	SELFTEST_ASSERT_CHANNEL(3, 51);
+	SELFTEST_ASSERT_CHANNEL(4, 7);
+	PIN_SetPinRoleForPinIndex(7, IOR_None);
+}
+// outputs at boot come from start values before pins are set up
+static void Test_Pins_EarlyOutputs() {
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	PIN_SetPinRoleForPinIndex(8, IOR_Relay_n);
+	PIN_SetPinChannelForPinIndex(8, 1);
+	PIN_SetPinRoleForPinIndex(7, IOR_LED);
+	PIN_SetPinChannelForPinIndex(7, 2);
+	CMD_ExecuteCommand("SetStartValue 1 1", 0);
+	CMD_ExecuteCommand("SetStartValue 2 0", 0);
+	SIM_SetSimulatedPinValue(9, false);
+	SIM_SetSimulatedPinValue(8, true);
+	SIM_SetSimulatedPinValue(7, true);
+
+	CFG_ApplyChannelStartValues();
+	PIN_SetupOutputsEarly();
+	SELFTEST_ASSERT_PIN_BOOLEAN(9, true);
+	SELFTEST_ASSERT_PIN_BOOLEAN(8, false);
+	SELFTEST_ASSERT_PIN_BOOLEAN(7, false);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	PIN_SetPinRoleForPinIndex(9, IOR_None);
+	PIN_SetPinRoleForPinIndex(8, IOR_None);
+	PIN_SetPinRoleForPinIndex(7, IOR_None);
+}
 void Test_Pins() {
+	Test_Pins_Counter();
+	Test_Pins_EarlyOutputs();
+
+
 	// reset whole device
 	SIM_ClearOBK(0);
 
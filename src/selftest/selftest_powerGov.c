@@ -0,0 +1,74 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_powerGov.h"
+
+void Test_PowerGov() {
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("govTester", "bekens");
+	CMD_ExecuteCommand("PowerSave 1", 0);
+	CMD_ExecuteCommand("startDriver PowerGov", 0);
+	// starts at full performance
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 0);
+	SELFTEST_ASSERT(CMD_GetPowerSaveLevel() == 0);
+	CMD_ExecuteCommand("PowerGov 2 3 6", 0);
+
+	Sim_RunSeconds(1.5f, false);
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 0);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 1);
+	SELFTEST_ASSERT(CMD_GetPowerSaveLevel() == 1);
+	Sim_RunSeconds(4, false);
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 2);
+	SELFTEST_ASSERT(CMD_GetPowerSaveLevel() == 2);
+
+	// command wakes it on next tick, not on next second
+	SIM_SendFakeMQTTAndRunSimFrame_CMND("echo", "hello");
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 0);
+	SELFTEST_ASSERT(CMD_GetPowerSaveLevel() == 0);
+	// idle time starts again from command
+	Sim_RunSeconds(1.5f, false);
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 0);
+	Sim_RunSeconds(3, false);
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 1);
+
+	SELFTEST_ASSERT(PowerGov_GetResidency(0) > 0);
+	SELFTEST_ASSERT(PowerGov_GetResidency(1) > 0);
+	SELFTEST_ASSERT(PowerGov_GetResidency(2) > 0);
+	SELFTEST_ASSERT(PowerGov_GetSwitches() == 4);
+
+	// page request is also a wake
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "PowerGov level ");
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 0);
+
+	// script that runs often keeps it up, long delays don't
+	CMD_ExecuteCommand("lfs_format", 0);
+	Test_FakeHTTPClientPacket_POST("api/lfs/govBusy.txt",
+		"again:\r\n"
+		"    delay_ms 50\r\n"
+		"    goto again\r\n");
+	Test_FakeHTTPClientPacket_POST("api/lfs/govIdle.txt",
+		"again:\r\n"
+		"    delay_s 30\r\n"
+		"    goto again\r\n");
+	CMD_ExecuteCommand("startScript govBusy.txt", 0);
+	Sim_RunSeconds(8, false);
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 0);
+	CMD_ExecuteCommand("stopAllScripts", 0);
+	CMD_ExecuteCommand("startScript govIdle.txt", 0);
+	Sim_RunSeconds(8, false);
+	SELFTEST_ASSERT(PowerGov_GetLevel() == 2);
+	CMD_ExecuteCommand("stopAllScripts", 0);
+
+	CMD_ExecuteCommand("PowerGov_Stats reset", 0);
+	SELFTEST_ASSERT(PowerGov_GetSwitches() == 0);
+	SELFTEST_ASSERT(PowerGov_GetResidency(0) == 0);
+
+	// level from before start is set again
+	CMD_ExecuteCommand("stopDriver PowerGov", 0);
+	SELFTEST_ASSERT(CMD_GetPowerSaveLevel() == 1);
+	CMD_ExecuteCommand("PowerSave 0", 0);
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_rc_edges.h"
+
+void Test_RC_Edges() {
+	uint32_t time;
+	unsigned int overflows;
+	int i;
+
+	// start empty
+	while (RC_PopEdge(&time)) {
+	}
+
+	// task gets edges in order ISR queued them
+	for (i = 0; i < 10; i++) {
+		RC_PushEdge(1000 + i * 50);
+	}
+	for (i = 0; i < 10; i++) {
+		SELFTEST_ASSERT(RC_PopEdge(&time));
+		SELFTEST_ASSERT(time == (uint32_t)(1000 + i * 50));
+	}
+	SELFTEST_ASSERT(!RC_PopEdge(&time));
+
+	// when task does not keep up, newest edges are lost and counted
+	overflows = RC_GetEdgeOverflows();
+	for (i = 0; i < RC_EDGE_RING + 5; i++) {
+		RC_PushEdge(i);
+	}
+	SELFTEST_ASSERT(RC_GetEdgeOverflows() == overflows + 5);
+	for (i = 0; i < RC_EDGE_RING; i++) {
+		SELFTEST_ASSERT(RC_PopEdge(&time));
+		SELFTEST_ASSERT(time == (uint32_t)i);
+	}
+	SELFTEST_ASSERT(!RC_PopEdge(&time));
+	// and queue works again after that
+	RC_PushEdge(777);
+	SELFTEST_ASSERT(RC_PopEdge(&time) && time == 777);
+}
+
+void Test_RC_Repeats() {
+	// new code always fires, hold repeat only once per RC_DUPLICATE_MS
+	SELFTEST_ASSERT(!RC_IsEarlyRepeat(0, 100000));
+	SELFTEST_ASSERT(RC_IsEarlyRepeat(1, 100000 + 50));
+	SELFTEST_ASSERT(RC_IsEarlyRepeat(1, 100000 + RC_DUPLICATE_MS - 1));
+	SELFTEST_ASSERT(!RC_IsEarlyRepeat(1, 100000 + RC_DUPLICATE_MS));
+	SELFTEST_ASSERT(RC_IsEarlyRepeat(1, 100000 + RC_DUPLICATE_MS + 10));
+	SELFTEST_ASSERT(!RC_IsEarlyRepeat(0, 100000 + RC_DUPLICATE_MS + 20));
+	// time wraps around
+	SELFTEST_ASSERT(!RC_IsEarlyRepeat(0, 0xFFFFFFF0));
+	SELFTEST_ASSERT(RC_IsEarlyRepeat(1, 0x10));
+}
+
+void Test_RC() {
+	Test_RC_Edges();
+	Test_RC_Repeats();
+}
+
+#endif
@@ -1,6 +1,104 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../quicktick.h"
+
+static void Test_RepeatingEvents_Wheel() {
+	char buffer[64];
+	int i, fired, missed, avgLate, maxLate;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("clearRepeatingEvents", 0);
+	SELFTEST_ASSERT_INTEGER(RepeatingEvents_GetActiveCount(), 0);
+
+	// many short timers, they must not drift
+	for (i = 0; i < 20; i++) {
+		snprintf(buffer, sizeof(buffer), "addRepeatingEventID %f -1 %i addChannel %i 1",
+			(100 + i * 20) * 0.001f, i, 20 + i);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	SELFTEST_ASSERT_INTEGER(RepeatingEvents_GetActiveCount(), 20);
+	Sim_RunSeconds(10.0f, false);
+	for (i = 0; i < 20; i++) {
+		SELFTEST_ASSERT_CHANNEL(20 + i, 10000 / (100 + i * 20));
+	}
+	RepeatingEvents_GetStats(&fired, &missed, &avgLate, &maxLate);
+	SELFTEST_ASSERT(fired > 0);
+	SELFTEST_ASSERT_INTEGER(missed, 0);
+	// intervals match simulator frame time
+	SELFTEST_ASSERT_INTEGER(maxLate, 0);
+
+	// cancel every second one, freed events are reused
+	for (i = 0; i < 20; i += 2) {
+		snprintf(buffer, sizeof(buffer), "cancelRepeatingEvent %i", i);
+		CMD_ExecuteCommand(buffer, 0);
+	}
+	SELFTEST_ASSERT_INTEGER(RepeatingEvents_GetActiveCount(), 10);
+	for (i = 0; i < 20; i++) {
+		CHANNEL_Set(20 + i, 0, 0);
+	}
+	Sim_RunSeconds(1.0f, false);
+	for (i = 0; i < 20; i++) {
+		if (i % 2) {
+			SELFTEST_ASSERT_CHANNEL(20 + i, 11000 / (100 + i * 20) - 10000 / (100 + i * 20));
+		}
+		else {
+			SELFTEST_ASSERT_CHANNEL(20 + i, 0);
+		}
+	}
+	CMD_ExecuteCommand("clearRepeatingEvents", 0);
+	SELFTEST_ASSERT_INTEGER(RepeatingEvents_GetActiveCount(), 0);
+
+	// event canceling itself runs only once
+	CMD_ExecuteCommand("setChannel 40 0", 0);
+	CMD_ExecuteCommand("addRepeatingEventID 0.1 -1 77 backlog addChannel 40 1; cancelRepeatingEvent 77", 0);
+	Sim_RunSeconds(1.0f, false);
+	SELFTEST_ASSERT_CHANNEL(40, 1);
+	SELFTEST_ASSERT_INTEGER(RepeatingEvents_GetActiveCount(), 0);
+	// and the one clearing all of them
+	CMD_ExecuteCommand("addRepeatingEvent 0.1 -1 addChannel 41 1", 0);
+	CMD_ExecuteCommand("addRepeatingEvent 0.25 -1 backlog addChannel 40 1; clearRepeatingEvents", 0);
+	Sim_RunSeconds(1.0f, false);
+	SELFTEST_ASSERT_CHANNEL(40, 2);
+	SELFTEST_ASSERT_CHANNEL(41, 2);
+	SELFTEST_ASSERT_INTEGER(RepeatingEvents_GetActiveCount(), 0);
+
+	// long intervals are moved between wheel levels
+	// (QuickTick sleeps without events, let it catch up so intervals start now)
+	QuickTick_Wake();
+	Sim_RunFrames(1, false);
+	CMD_ExecuteCommand("setChannel 42 0", 0);
+	CMD_ExecuteCommand("setChannel 43 0", 0);
+	CMD_ExecuteCommand("addRepeatingEvent 5400 2 addChannel 42 1", 0);
+	// longer than the whole wheel
+	CMD_ExecuteCommand("addRepeatingEvent 72000 1 addChannel 43 1", 0);
+	for (i = 0; i < 89; i++) {
+		RepeatingEvents_RunUpdate(60000);
+	}
+	SELFTEST_ASSERT_CHANNEL(42, 0);
+	RepeatingEvents_RunUpdate(60000);
+	SELFTEST_ASSERT_CHANNEL(42, 1);
+	for (i = 0; i < 90; i++) {
+		RepeatingEvents_RunUpdate(60000);
+	}
+	SELFTEST_ASSERT_CHANNEL(42, 2);
+	SELFTEST_ASSERT_CHANNEL(43, 0);
+	for (i = 0; i < 20; i++) {
+		RepeatingEvents_RunUpdate(3600000);
+	}
+	SELFTEST_ASSERT_CHANNEL(42, 2);
+	SELFTEST_ASSERT_CHANNEL(43, 1);
+	SELFTEST_ASSERT_INTEGER(RepeatingEvents_GetActiveCount(), 0);
+
+	// one frame is late for an interval between frames
+	QuickTick_Wake();
+	Sim_RunFrames(1, false);
+	CMD_ExecuteCommand("addRepeatingEvent 0.015 1 addChannel 44 1", 0);
+	Sim_RunSeconds(0.1f, false);
+	SELFTEST_ASSERT_CHANNEL(44, 1);
+	RepeatingEvents_GetStats(&fired, &missed, &avgLate, &maxLate);
+	SELFTEST_ASSERT_INTEGER(maxLate, 5);
+}
 
 void Test_RepeatingEvents() {
 	// reset whole device
@@ -20,6 +118,19 @@ void Test_RepeatingEvents() {
 	SELFTEST_ASSERT_CHANNEL(11, 2);
 	Sim_RunSeconds(6.0f, false);
 	SELFTEST_ASSERT_CHANNEL(11, 2);
+
+	// alias is created after event, so command is resolved on first fire
+	CMD_ExecuteCommand("addRepeatingEvent 1 3 myLateAlias", 0);
+	CMD_ExecuteCommand("alias myLateAlias addChannel 12 5", 0);
+	Sim_RunSeconds(4.0f, false);
+	SELFTEST_ASSERT_CHANNEL(12, 15);
+	// extra whitespace before command name
+	CMD_ExecuteCommand("setChannel 13 0", 0);
+	CMD_ExecuteCommand("addRepeatingEvent 1 1   addChannel 13 7", 0);
+	Sim_RunSeconds(2.0f, false);
+	SELFTEST_ASSERT_CHANNEL(13, 7);
+
+	Test_RepeatingEvents_Wheel();
 }
 
 
@@ -0,0 +1,97 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../rgb2hsv.h"
+
+static int Test_RGB2HSV_Diff(int a, int b) {
+	return a > b ? a - b : b - a;
+}
+static int Test_RGB2HSV_Worst(int worst, int a, int b) {
+	int d = Test_RGB2HSV_Diff(a, b);
+	return d > worst ? d : worst;
+}
+void Test_RGB2HSV() {
+	uint16_t h, s, v;
+	uint8_t r, g, bl;
+	float fh, fs, fv, fr, fg, fb;
+	int ir, ig, ib, worst, hueDiff;
+
+	// every color back to itself, hue and saturation within 1 LSB of float
+	worst = 0;
+	for (ir = 0; ir < 256; ir++) {
+		for (ig = 0; ig < 256; ig++) {
+			for (ib = 0; ib < 256; ib++) {
+				RGB_to_HSV_u16(ir, ig, ib, &h, &s, &v);
+				HSV_to_RGB_u8(h, s, v, &r, &g, &bl);
+				worst = Test_RGB2HSV_Worst(worst, r, ir);
+				worst = Test_RGB2HSV_Worst(worst, g, ig);
+				worst = Test_RGB2HSV_Worst(worst, bl, ib);
+				if ((ir ^ ig ^ ib) & 7) {
+					continue;
+				}
+				RGBtoHSV(ir / 255.0f, ig / 255.0f, ib / 255.0f, &fh, &fs, &fv);
+				hueDiff = Test_RGB2HSV_Diff(fh * HSV_HUE_PER_DEGREE + 0.5f, h);
+				// 360 is the same as 0
+				hueDiff = MIN(hueDiff, HSV_HUE_MAX - hueDiff);
+				SELFTEST_ASSERT(hueDiff <= 1);
+				SELFTEST_ASSERT(Test_RGB2HSV_Diff(fs * 65535 + 0.5f, s) <= 1);
+				SELFTEST_ASSERT(v == MAX(MAX(ir, ig), ib) * 257);
+			}
+		}
+	}
+	SELFTEST_ASSERT(worst <= 1);
+
+	// and other way, against float version
+	worst = 0;
+	for (h = 0; h < HSV_HUE_MAX; h += 37) {
+		for (ir = 0; ir < 65536; ir += 4369) {
+			HSV_to_RGB_u8(h, ir, 65535 - ir / 3, &r, &g, &bl);
+			HSVtoRGB(&fr, &fg, &fb, h / (float)HSV_HUE_PER_DEGREE, ir / 65535.0f, (65535 - ir / 3) / 65535.0f);
+			worst = Test_RGB2HSV_Worst(worst, r, fr * 255 + 0.5f);
+			worst = Test_RGB2HSV_Worst(worst, g, fg * 255 + 0.5f);
+			worst = Test_RGB2HSV_Worst(worst, bl, fb * 255 + 0.5f);
+		}
+	}
+	SELFTEST_ASSERT(worst <= 1);
+	HSV_to_RGB_u8(0, 65535, 65535, &r, &g, &bl);
+	SELFTEST_ASSERT(r == 255 && g == 0 && bl == 0);
+	HSV_to_RGB_u8(180 * HSV_HUE_PER_DEGREE, 65535, 65535, &r, &g, &bl);
+	SELFTEST_ASSERT(r == 0 && g == 255 && bl == 255);
+	RGB_to_HSV_u16(0, 0, 255, &h, &s, &v);
+	SELFTEST_ASSERT(h == 240 * HSV_HUE_PER_DEGREE && s == 65535 && v == 65535);
+
+	// driver keeps hsv in sync through fixed point
+	CMD_ExecuteCommand("led_basecolor_rgb 00FF00", 0);
+	SELFTEST_ASSERT_FLOATCOMPARE(LED_GetHue(), 120);
+	SELFTEST_ASSERT_FLOATCOMPARE(LED_GetSaturation(), 100);
+}
+
+// keeps benchmark results used
+static volatile unsigned int g_rgb2hsvBenchSink;
+
+void Test_RGB2HSV_Bench() {
+	selfBench_t b;
+	uint16_t h, s, v;
+	uint8_t r, g, bl;
+	float fh, fs, fv, fr, fg, fb;
+	int ir;
+	unsigned int acc = 0;
+
+	ir = 0;
+	SELFBENCH(b, "RGBtoHSV and back, float") {
+		RGBtoHSV((ir & 255) / 255.0f, 0.25f, 0.5f, &fh, &fs, &fv);
+		HSVtoRGB(&fr, &fg, &fb, fh, fs, fv);
+		acc += (unsigned int)(fr * 255);
+		ir++;
+	}
+	ir = 0;
+	SELFBENCH(b, "RGB_to_HSV_u16 and back") {
+		RGB_to_HSV_u16(ir & 255, 64, 128, &h, &s, &v);
+		HSV_to_RGB_u8(h, s, v, &r, &g, &bl);
+		acc += r;
+		ir++;
+	}
+	g_rgb2hsvBenchSink = acc;
+}
+
+#endif
@@ -66,6 +66,143 @@ const char *demo_waiting_for_smth =
 "    if $CH20==0 then goto again\r\n"
 "    setChannel 21 789\r\n";
 
+const char *demo_labels =
+"// comments and empty lines are not executed\r\n"
+"\r\n"
+"   \t\r\n"
+"setChannel 10 0   \r\n"
+"goto l17\r\n"
+"l1:\r\n"
+"l2:\r\n"
+"l3:\r\n"
+"l4:\r\n"
+"l5:\r\n"
+"l6:\r\n"
+"l7:\r\n"
+"l8:\r\n"
+"l9:\r\n"
+"l10:\r\n"
+"l11:\r\n"
+"l12:\r\n"
+"l13:\r\n"
+"l14:\r\n"
+"l15:\r\n"
+"l16:\r\n"
+"    setChannel 11 1\r\n"
+"    // first of duplicated labels is used\r\n"
+"    dup:\r\n"
+"    addChannel 10 1\r\n"
+"    if $CH10<5 then goto dup\r\n"
+"    goto end\r\n"
+"dup:\r\n"
+"    setChannel 12 666\r\n"
+"l17:\r\n"
+"    setChannel 13 17\r\n"
+"    goto l16\r\n"
+"end:\r\n"
+"    setChannel 14 1\r\n"
+"    goto missingLabel\r\n"
+"    setChannel 15 1\r\n";
+
+void Test_Scripting_Labels() {
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/labels.txt", demo_labels);
+	CMD_ExecuteCommand("startScript labels.txt", 0);
+	Sim_RunFrames(15, false);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_CHANNEL(10, 5);
+	SELFTEST_ASSERT_CHANNEL(11, 1);
+	SELFTEST_ASSERT_CHANNEL(12, 0);
+	SELFTEST_ASSERT_CHANNEL(13, 17);
+	SELFTEST_ASSERT_CHANNEL(14, 1);
+	// missing label ends the script
+	SELFTEST_ASSERT_CHANNEL(15, 0);
+
+	// start at label
+	CMD_ExecuteCommand("startScript labels.txt end", 0);
+	Sim_RunFrames(5, false);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_CHANNEL(10, 5);
+	SELFTEST_ASSERT_CHANNEL(15, 0);
+
+	// start in the middle, then jump back
+	CMD_ExecuteCommand("startScript labels.txt l17", 0);
+	Sim_RunFrames(15, false);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_CHANNEL(10, 6);
+
+	// backlog with delay is run as a script
+	CMD_ExecuteCommand("backlog setChannel 16 1; delay_ms 100;  ; addChannel 16 2", 0);
+	SELFTEST_ASSERT_CHANNEL(16, 0);
+	Sim_RunFrames(30, false);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_CHANNEL(16, 3);
+
+	CMD_ExecuteCommand("resetSVM", 0);
+}
+void Test_Scripting_Scheduler() {
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+	SELFTEST_ASSERT_INTEGER(SVM_GetTimeToNextWakeMS(), -1);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/sleeper.txt",
+		"setChannel 1 1\n"
+		"delay_s 60\n"
+		"setChannel 1 2\n");
+	Test_FakeHTTPClientPacket_POST("api/lfs/waiter.txt",
+		"setChannel 2 1\n"
+		"waitFor MQTTState 1\n"
+		"delay_ms 50\n"
+		"setChannel 2 2\n");
+	for (i = 0; i < 10; i++) {
+		CMD_ExecuteCommand("startScript sleeper.txt", 0);
+	}
+	CMD_ExecuteCommand("startScript waiter.txt", 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 11);
+	// new threads run on next tick
+	SELFTEST_ASSERT_INTEGER(SVM_GetTimeToNextWakeMS(), 1);
+	SVM_RunThreads(5);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	// sleepers are due in 60 seconds, waiter is not scheduled at all
+	SELFTEST_ASSERT_INTEGER(SVM_GetTimeToNextWakeMS(), 60000);
+	SVM_RunThreads(59000);
+	SELFTEST_ASSERT_INTEGER(SVM_GetTimeToNextWakeMS(), 1000);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+
+	// event wakes the waiter on next tick
+	CMD_Script_ProcessWaitersForEvent(CMD_EVENT_MQTT_STATE, 1);
+	SELFTEST_ASSERT_INTEGER(SVM_GetTimeToNextWakeMS(), 1);
+	SVM_RunThreads(5);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	SELFTEST_ASSERT_INTEGER(SVM_GetTimeToNextWakeMS(), 50);
+	SVM_RunThreads(50);
+	SELFTEST_ASSERT_CHANNEL(2, 2);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 10);
+
+	// stopped threads are removed from schedule
+	CMD_ExecuteCommand("stopAllScripts", 0);
+	SELFTEST_ASSERT_INTEGER(SVM_GetTimeToNextWakeMS(), -1);
+	SVM_RunThreads(5000);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+
+	// long freeze wakes all of them at once
+	for (i = 0; i < 3; i++) {
+		CMD_ExecuteCommand("startScript sleeper.txt", 0);
+	}
+	SVM_RunThreads(5);
+	SVM_RunThreads(100000);
+	SELFTEST_ASSERT_CHANNEL(1, 2);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	SELFTEST_ASSERT_INTEGER(SVM_GetTimeToNextWakeMS(), -1);
+}
 void Test_Scripting_Loop1() {
 	// reset whole device
 	SIM_ClearOBK(0);
@@ -272,6 +409,47 @@ void Test_Scripting_ClickEventAndBacklog() {
 	}
 
 }
+void Test_Scripting_Budget() {
+	scriptInstance_t *t;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/busy.txt",
+		"addChannel 1 1\n"
+		"addChannel 1 1\n"
+		"addChannel 1 1\n"
+		"addChannel 1 1\n"
+		"addChannel 1 1\n"
+		"addChannel 1 1\n"
+		"addChannel 1 1\n"
+		"addChannel 1 1\n");
+	CMD_ExecuteCommand("scriptBudget 5000 15000 3", 0);
+	CMD_ExecuteCommand("startScript busy.txt * 77", 0);
+	for (t = g_scriptThreads; t; t = t->next) {
+		if (t->uniqueID == 77) {
+			break;
+		}
+	}
+	SELFTEST_ASSERT(t != 0);
+	SELFTEST_ASSERT(t->stats.runs == 0);
+	// thread yields after 3 lines and continues next tick
+	SVM_RunThreads(5);
+	SELFTEST_ASSERT_CHANNEL(1, 3);
+	SELFTEST_ASSERT(t->stats.runs == 1);
+	SVM_RunThreads(5);
+	SELFTEST_ASSERT_CHANNEL(1, 6);
+	SVM_RunThreads(5);
+	SELFTEST_ASSERT_CHANNEL(1, 8);
+	SELFTEST_ASSERT(t->stats.runs == 3);
+	SELFTEST_ASSERT(t->stats.overruns == 0);
+	SELFTEST_ASSERT_INTEGER(CMD_GetCountActiveScriptThreads(), 0);
+	CMD_ExecuteCommand("listScripts", 0);
+
+	// back to defaults
+	CMD_ExecuteCommand("scriptBudget 5000 15000 20", 0);
+}
 void Test_Scripting() {
 	Test_Scripting_Loop1();
 	Test_Scripting_Loop2();
@@ -280,6 +458,9 @@ void Test_Scripting() {
 	Test_Scripting_StartScript();
 	Test_Scripting_WaitingForSmth();
 	Test_Scripting_ClickEventAndBacklog();
+	Test_Scripting_Labels();
+	Test_Scripting_Scheduler();
+	Test_Scripting_Budget();
 }
 
 #endif
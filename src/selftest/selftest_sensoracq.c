@@ -0,0 +1,71 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_local.h"
+
+#if ENABLE_DRIVER_SGP
+
+void Test_SensorAcq() {
+	sensorSample_t a, b;
+	unsigned int seq = 0;
+	unsigned int polls;
+	int id, count;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(24, IOR_SGP_CLK);
+	PIN_SetPinRoleForPinIndex(26, IOR_SGP_DAT);
+	PIN_SetPinChannelForPinIndex(26, 2);
+	PIN_SetPinChannel2ForPinIndex(26, 3);
+	CMD_ExecuteCommand("startDriver SGP", 0);
+	id = SensorAcq_Find("SGP");
+	SELFTEST_ASSERT(id >= 0);
+	SELFTEST_ASSERT_STRING(SensorAcq_GetName(id), "SGP");
+	// skip samples of earlier tests
+	while (SensorAcq_Next(&seq, &a)) {
+	}
+	polls = seq;
+
+	// first poll comes right away, then every 10 s of SGP_cycle
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT_CHANNEL(2, 120);
+	SELFTEST_ASSERT_CHANNEL(3, 130);
+	SELFTEST_ASSERT(SensorAcq_GetPollCount(id) == 1);
+	Sim_RunSeconds(25, false);
+	SELFTEST_ASSERT(SensorAcq_GetPollCount(id) == 3);
+
+	// both values of one poll carry its time
+	while (SensorAcq_Next(&seq, &a)) {
+		SELFTEST_ASSERT(SensorAcq_Next(&seq, &b));
+		SELFTEST_ASSERT(a.timeMs == b.timeMs);
+		SELFTEST_ASSERT(a.channel == 2 && a.value == 120);
+		SELFTEST_ASSERT(b.channel == 3 && b.value == 130);
+	}
+	SELFTEST_ASSERT(seq - polls == 6);
+
+	// faster cadence, applied right away
+	polls = SensorAcq_GetPollCount(id);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("SensorInterval SGP 2000", 0) == CMD_RES_OK);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("SensorInterval Nope 2000", 0) == CMD_RES_BAD_ARGUMENT);
+	Sim_RunSeconds(10.5f, false);
+	count = SensorAcq_GetPollCount(id) - polls;
+	SELFTEST_ASSERT(count >= 5 && count <= 6);
+
+	// reader that fell behind the ring gets only samples still in it
+	Sim_RunSeconds(60, false);
+	seq = 0;
+	count = 0;
+	while (SensorAcq_Next(&seq, &a)) {
+		count++;
+	}
+	SELFTEST_ASSERT(count == 32);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("SensorSamples 4", 0) == CMD_RES_OK);
+
+	CMD_ExecuteCommand("stopDriver SGP", 0);
+	polls = SensorAcq_GetPollCount(id);
+	Sim_RunSeconds(5, false);
+	SELFTEST_ASSERT(SensorAcq_GetPollCount(id) == polls);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+
+void Test_ShiftRegister() {
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	// data 24, latch 6, clock 7, channels 10 to 25, MSB first
+	CMD_ExecuteCommand("startDriver ShiftRegister 24 6 7 10 1 2 0", 0);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Shift register (GPIO): 0 updates");
+
+	// whole line is shifted and latched once, from next tick
+	CMD_ExecuteCommand("backlog setChannel 10 1; setChannel 11 1; setChannel 25 1", 0);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Shift register (GPIO): 0 updates");
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Shift register (GPIO): 1 updates");
+	// channel 10 is last bit out
+	SELFTEST_ASSERT_PIN_BOOLEAN(24, true);
+	SELFTEST_ASSERT_PIN_BOOLEAN(6, true);
+	// nothing changed, nothing sent
+	Sim_RunFrames(5, false);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Shift register (GPIO): 1 updates");
+
+	// batch is sent at once when committed
+	CHANNEL_BeginBatch();
+	CMD_ExecuteCommand("setChannel 10 0", 0);
+	CMD_ExecuteCommand("setChannel 12 1", 0);
+	CHANNEL_CommitBatch();
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Shift register (GPIO): 2 updates");
+	SELFTEST_ASSERT_PIN_BOOLEAN(24, false);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Shift register (GPIO): 2 updates");
+
+	// channels outside of registers are ignored
+	CMD_ExecuteCommand("setChannel 26 1", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "Shift register (GPIO): 2 updates");
+}
+
+#endif
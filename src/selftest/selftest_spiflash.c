@@ -0,0 +1,62 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_local.h"
+
+void Test_SPIFlash() {
+	byte buf[300];
+	byte big[1100];
+	int i;
+
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("startDriver TESTSPIFLASH", 0);
+
+	LFS_SPI_Flash_EraseSector(0);
+	LFS_SPI_Flash_Read(0, 16, buf);
+	for (i = 0; i < 16; i++) {
+		SELFTEST_ASSERT(buf[i] == 0xFF);
+	}
+	// cache line with 0xFF is now held, write must drop it
+	CMD_ExecuteCommand("SPITestFlash_WriteStr 250 ABCDEFGHIJKL", 0);
+	LFS_SPI_Flash_Read(250, 12, buf);
+	SELFTEST_ASSERT(memcmp(buf, "ABCDEFGHIJKL", 12) == 0);
+	// small read inside one line, other reads cross page boundary
+	LFS_SPI_Flash_Read(255, 2, buf);
+	SELFTEST_ASSERT(buf[0] == 'F' && buf[1] == 'G');
+	LFS_SPI_Flash_Read(240, 30, buf);
+	SELFTEST_ASSERT(buf[9] == 0xFF && buf[10] == 'A' && buf[21] == 'L' && buf[22] == 0xFF);
+
+	// more pages than the queue holds, read back before sync
+	for (i = 0; i < sizeof(big); i++) {
+		big[i] = i * 7;
+	}
+	LFS_SPI_Flash_EraseSector(4096);
+	LFS_SPI_Flash_Write(4096 + 100, big, sizeof(big));
+	memset(big, 0, sizeof(big));
+	LFS_SPI_Flash_Read(4096 + 100, sizeof(big), big);
+	for (i = 0; i < sizeof(big); i++) {
+		SELFTEST_ASSERT(big[i] == (byte)(i * 7));
+	}
+	LFS_SPI_Flash_Read(4096 + 99, 1, buf);
+	SELFTEST_ASSERT(buf[0] == 0xFF);
+
+	// write queued right before erase must not land after it
+	LFS_SPI_Flash_Write(4096 + 2000, (const byte*)"xyz", 3);
+	LFS_SPI_Flash_EraseSector(4096 + 1234);
+	LFS_SPI_Flash_Sync();
+	LFS_SPI_Flash_Read(4096 + 2000, 3, buf);
+	SELFTEST_ASSERT(buf[0] == 0xFF && buf[1] == 0xFF && buf[2] == 0xFF);
+	LFS_SPI_Flash_Read(0, 1, buf);
+	SELFTEST_ASSERT(buf[0] == 0xFF);
+	LFS_SPI_Flash_Read(250, 1, buf);
+	SELFTEST_ASSERT(buf[0] == 'A');
+
+	SELFTEST_ASSERT(CMD_ExecuteCommand("SPITestFlash_Test 8192 2000 90", 0) == CMD_RES_OK);
+	LFS_SPI_Flash_Read(8192 + 1999, 2, buf);
+	SELFTEST_ASSERT(buf[0] == 90 && buf[1] == 0xFF);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("SPITestFlash_ReadID", 0) == CMD_RES_OK);
+
+	CMD_ExecuteCommand("stopDriver TESTSPIFLASH", 0);
+}
+
+#endif
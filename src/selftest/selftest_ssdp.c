@@ -0,0 +1,70 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_local.h"
+#include "../hal/hal_wifi.h"
+#include "lwip/inet.h"
+
+#if ENABLE_DRIVER_SSDP
+
+static void Test_SSDP_Notify(const char *ip, const char *name, const char *version) {
+	char msg[256];
+
+	snprintf(msg, sizeof(msg), "NOTIFY * HTTP/1.1\r\nSERVER: OpenBk\r\nHOST: 239.255.255.250:1900\r\n"
+		"X-OBK-NAME: %s\r\nX-OBK-VERSION: %s\r\nNTS: ssdp:alive\r\n\r\n", name, version);
+	SSDP_ProcessPacketFrom(msg, ip);
+}
+
+void Test_SSDP() {
+	char msg[256];
+	const obkPeer_t *p;
+
+	SIM_ClearOBK(0);
+	// driver waits for WiFi before it starts
+	Main_OnWiFiStatusChange(WIFI_STA_CONNECTED);
+	CMD_ExecuteCommand("startDriver SSDP", 0);
+	SELFTEST_ASSERT(SSDP_GetPeerCount() == 0);
+
+	Test_SSDP_Notify("192.168.0.31", "kitchen", "1.17.1");
+	Test_SSDP_Notify("192.168.0.32", "hall", "1.17.2");
+	// other UPnP devices are not ours
+	strcpy(msg, "NOTIFY * HTTP/1.1\r\nSERVER: Linux UPnP/1.0\r\nX-OBK-NAME: tv\r\n\r\n");
+	SSDP_ProcessPacketFrom(msg, "192.168.0.40");
+	// reply to our search, SERVER is not second line there
+	strcpy(msg, "HTTP/1.1 200 OK\r\nCACHE-CONTROL: max-age=1800\r\nEXT:\r\nSERVER: OpenBk\r\nx-obk-name: garage\r\n\r\n");
+	SSDP_ProcessPacketFrom(msg, "192.168.0.33");
+	SELFTEST_ASSERT(SSDP_GetPeerCount() == 3);
+
+	p = SSDP_FindPeerByName("hall");
+	SELFTEST_ASSERT(p && p->ip == inet_addr("192.168.0.32"));
+	SELFTEST_ASSERT(!strcmp(p->version, "1.17.2"));
+	p = SSDP_FindPeerByIP(inet_addr("192.168.0.33"));
+	SELFTEST_ASSERT(p && !strcmp(p->name, "garage") && p->version[0] == 0);
+	SELFTEST_ASSERT(SSDP_FindPeerByIP(inet_addr("192.168.0.40")) == 0);
+	// notify of known device updates it
+	Test_SSDP_Notify("192.168.0.31", "kitchen2", "1.18.0");
+	SELFTEST_ASSERT(SSDP_GetPeerCount() == 3);
+	SELFTEST_ASSERT(!strcmp(SSDP_FindPeerByIP(inet_addr("192.168.0.31"))->name, "kitchen2"));
+
+	Test_FakeHTTPClientPacket_JSON("obkdevicelist?page=1&size=2");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "count", 3);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER(0, "pages", 2);
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"name\":\"garage\"");
+	SELFTEST_ASSERT_HTML_REPLY_NOT_CONTAINS("hall");
+
+	// devices that went quiet are dropped, others stay
+	Sim_RunSeconds(60, false);
+	Test_SSDP_Notify("192.168.0.32", "hall", "1.17.2");
+	Sim_RunSeconds(40, false);
+	SELFTEST_ASSERT(SSDP_GetPeerCount() == 1);
+	SELFTEST_ASSERT(SSDP_FindPeerByName("hall") != 0);
+	SELFTEST_ASSERT(SSDP_FindPeerByName("garage") == 0);
+	// slot that was freed is used again
+	Test_SSDP_Notify("192.168.0.34", "porch", "1.17.2");
+	SELFTEST_ASSERT(SSDP_GetPeerCount() == 2);
+	SELFTEST_ASSERT(SSDP_FindPeerByIP(inet_addr("192.168.0.34")) != 0);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_spi.h"
+#include "../driver/drv_st7735.h"
+
+#if ENABLE_DRIVER_ST7735
+
+#define TEST_ST7735_DC 17
+
+// fake panel on simulated SPI, counts how often each pixel was written
+static struct {
+	byte cmd;
+	byte args[4];
+	int argCount;
+	int x0, x1, y0, y1;
+	int x, y;
+	int pixelByte;
+	int windows;
+	int bursts;
+	int pixels;
+	byte writes[ST7735_HEIGHT][ST7735_WIDTH];
+} g_testPanel;
+
+static void Test_ST7735_Reset() {
+	memset(&g_testPanel, 0, sizeof(g_testPanel));
+}
+
+static void Test_ST7735_Device(const void *tx, uint32_t txSize, void *rx, uint32_t rxSize) {
+	const byte *b = (const byte*)tx;
+	uint32_t i;
+
+	if (!SIM_GetSimulatedPinValue(TEST_ST7735_DC)) {
+		g_testPanel.cmd = b[0];
+		g_testPanel.argCount = 0;
+		if (g_testPanel.cmd == ST77_RAMWR) {
+			g_testPanel.windows++;
+			g_testPanel.x = g_testPanel.x0;
+			g_testPanel.y = g_testPanel.y0;
+			g_testPanel.pixelByte = 0;
+		}
+		return;
+	}
+	if (g_testPanel.cmd == ST77_RAMWR) {
+		g_testPanel.bursts++;
+	}
+	for (i = 0; i < txSize; i++) {
+		if (g_testPanel.cmd == ST77_CASET || g_testPanel.cmd == ST77_RASET) {
+			if (g_testPanel.argCount < 4) {
+				g_testPanel.args[g_testPanel.argCount++] = b[i];
+			}
+			if (g_testPanel.argCount == 4 && g_testPanel.cmd == ST77_CASET) {
+				g_testPanel.x0 = g_testPanel.args[1] - ST7735_COL_OFFSET;
+				g_testPanel.x1 = g_testPanel.args[3] - ST7735_COL_OFFSET;
+			}
+			else if (g_testPanel.argCount == 4) {
+				g_testPanel.y0 = g_testPanel.args[1] - ST7735_ROW_OFFSET;
+				g_testPanel.y1 = g_testPanel.args[3] - ST7735_ROW_OFFSET;
+			}
+		}
+		else if (g_testPanel.cmd == ST77_RAMWR) {
+			if (++g_testPanel.pixelByte < 2) {
+				continue;
+			}
+			g_testPanel.pixelByte = 0;
+			g_testPanel.pixels++;
+			if (g_testPanel.y <= g_testPanel.y1) {
+				g_testPanel.writes[g_testPanel.y][g_testPanel.x]++;
+			}
+			if (++g_testPanel.x > g_testPanel.x1) {
+				g_testPanel.x = g_testPanel.x0;
+				g_testPanel.y++;
+			}
+		}
+	}
+}
+
+static int Test_ST7735_MaxWrites() {
+	int x, y, max = 0;
+
+	for (y = 0; y < ST7735_HEIGHT; y++) {
+		for (x = 0; x < ST7735_WIDTH; x++) {
+			if (g_testPanel.writes[y][x] > max) {
+				max = g_testPanel.writes[y][x];
+			}
+		}
+	}
+	return max;
+}
+
+void Test_ST7735() {
+	SIM_ClearOBK(0);
+	SIM_SPI_SetDevice(Test_ST7735_Device);
+	CMD_ExecuteCommand("startDriver ST7735 14 16 9 17 15 24 1", 0);
+
+	// whole screen is one window, sent in bursts of line buffer
+	Test_ST7735_Reset();
+	CMD_ExecuteCommand("st7735_clear 0x001F", 0);
+	SELFTEST_ASSERT(g_testPanel.windows == 1);
+	SELFTEST_ASSERT(g_testPanel.pixels == ST7735_WIDTH * ST7735_HEIGHT);
+	SELFTEST_ASSERT(g_testPanel.bursts == ST7735_HEIGHT / 8);
+	SELFTEST_ASSERT(Test_ST7735_MaxWrites() == 1);
+
+	// text is drawn in one window with its background, no pixel twice
+	Test_ST7735_Reset();
+	CMD_ExecuteCommand("st7735_goto 0 0", 0);
+	CMD_ExecuteCommand("st7735_print 12.5", 0);
+	SELFTEST_ASSERT(g_testPanel.windows == 1);
+	SELFTEST_ASSERT(g_testPanel.pixels > 0);
+	SELFTEST_ASSERT(Test_ST7735_MaxWrites() == 1);
+
+	// after splash, changed value redraws only its zone, each pixel once
+	Sim_RunSeconds(3, false);
+	CHANNEL_Set(1, 23012, 0);
+	Test_ST7735_Reset();
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(g_testPanel.pixels > 0);
+	SELFTEST_ASSERT(g_testPanel.pixels < ST7735_WIDTH * ST7735_HEIGHT / 2);
+	SELFTEST_ASSERT(Test_ST7735_MaxWrites() == 1);
+	// same value again sends nothing
+	Test_ST7735_Reset();
+	Sim_RunSeconds(1, false);
+	SELFTEST_ASSERT(g_testPanel.windows == 0);
+
+	CMD_ExecuteCommand("stopDriver ST7735", 0);
+	SIM_SPI_SetDevice(0);
+}
+
+#endif
+
+#endif
@@ -616,6 +616,7 @@ void Test_Tasmota_MQTT_RGBCW() {
 	SIM_ClearMQTTHistory();
 }
 void Test_Backlog() {
+	char tmp[256];
 
 	SELFTEST_ASSERT(CMD_ExecuteCommand("backlog setChannel 1 2; ", 0) == CMD_RES_OK);
 	SELFTEST_ASSERT_CHANNEL(1, 2);
@@ -634,6 +635,25 @@ void Test_Backlog() {
 	SELFTEST_ASSERT_CHANNEL(1, 5);
 	SELFTEST_ASSERT(CMD_ExecuteCommand("backlog setChannel 1 22; setChannel 1 33", 0) == CMD_RES_OK);
 	SELFTEST_ASSERT_CHANNEL(1, 33);
+	// single command longer than 128 characters is not truncated
+	strcpy(tmp, "backlog setChannel 1 1;");
+	memset(tmp + strlen(tmp), ' ', 150);
+	strcpy(tmp + strlen("backlog setChannel 1 1;") + 150, "setChannel 2 70");
+	SELFTEST_ASSERT(CMD_ExecuteCommand(tmp, 0) == CMD_RES_OK);
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_CHANNEL(2, 70);
+	// alias created by an earlier command of the same backlog
+	SELFTEST_ASSERT(CMD_ExecuteCommand("backlog alias myBacklogAlias setChannel 1 44; myBacklogAlias; addChannel 1 1", 0) == CMD_RES_OK);
+	SELFTEST_ASSERT_CHANNEL(1, 45);
+	// first command has no args, its name ends at ';' and "on" is not its arg
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	PIN_SetPinRoleForPinIndex(10, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(10, 2);
+	CMD_ExecuteCommand("backlog power1;power2 on", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
 }
 void Test_Tasmota_Backlog() {
 	CMD_ExecuteCommand("backlog setChannel 1 123; delay_ms 500; setChannel 1 234; delay_ms 500; setChannel 1 345; delay_ms 500; setChannel 1 456; delay_s 0.5; setChannel 1 567",0);
@@ -648,6 +668,57 @@ void Test_Tasmota_Backlog() {
 	Sim_RunMiliseconds(500, false);
 	SELFTEST_ASSERT_CHANNEL(1, 567);
 }
+#if ENABLE_TASMOTA_JSON_CACHE
+static char g_statusCacheReply[8192];
+
+void Test_Tasmota_StatusCache() {
+	int hits, misses, hits2, misses2;
+
+	SIM_ClearOBK(0);
+	PIN_SetPinRoleForPinIndex(9, IOR_Relay);
+	PIN_SetPinChannelForPinIndex(9, 1);
+	Sim_RunSeconds(1, false);
+
+	Test_FakeHTTPClientPacket_JSON("cm?cmnd=STATUS");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("Status", "Power", 0);
+	strcpy_safe(g_statusCacheReply, Test_GetLastHTMLReply(), sizeof(g_statusCacheReply));
+	JSON_GetStatusCacheStats(&hits, &misses);
+
+	// second poll in same second is replayed, byte for byte
+	Test_FakeHTTPClientPacket_JSON("cm?cmnd=STATUS");
+	JSON_GetStatusCacheStats(&hits2, &misses2);
+	SELFTEST_ASSERT(hits2 == hits + 1 && misses2 == misses);
+	SELFTEST_ASSERT(!strcmp(g_statusCacheReply, Test_GetLastHTMLReply()));
+
+	// channel change is seen at once
+	CMD_ExecuteCommand("setChannel 1 1", 0);
+	Test_FakeHTTPClientPacket_JSON("cm?cmnd=STATUS");
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("Status", "Power", 1);
+	JSON_GetStatusCacheStats(&hits, &misses);
+	SELFTEST_ASSERT(misses == misses2 + 1);
+
+	// and so is config
+	CFG_SetShortDeviceName("cachedDevice");
+	Test_FakeHTTPClientPacket_JSON("cm?cmnd=STATUS");
+	SELFTEST_ASSERT_JSON_VALUE_STRING("Status", "DeviceName", "cachedDevice");
+
+	// STATE and STATUS 11 share section, header is not part of it
+	Test_FakeHTTPClientPacket_JSON("cm?cmnd=STATE");
+	SELFTEST_ASSERT_JSON_VALUE_STRING(0, "POWER", "ON");
+	JSON_GetStatusCacheStats(&hits, &misses);
+	Test_FakeHTTPClientPacket_JSON("cm?cmnd=STATUS%2011");
+	SELFTEST_ASSERT_JSON_VALUE_STRING("StatusSTS", "POWER", "ON");
+	JSON_GetStatusCacheStats(&hits2, &misses2);
+	SELFTEST_ASSERT(hits2 == hits + 1);
+
+	// uptime moves on, so does section
+	Sim_RunSeconds(2, false);
+	Test_FakeHTTPClientPacket_JSON("cm?cmnd=STATUS%2011");
+	JSON_GetStatusCacheStats(&hits, &misses);
+	SELFTEST_ASSERT(hits == hits2 && misses == misses2 + 1);
+	SELFTEST_ASSERT_JSON_VALUE_INTEGER("StatusSTS", "UptimeSec", g_secondsElapsed);
+}
+#endif
 void Test_Tasmota() {
 	Test_Tasmota_MQTT_Switch();
 	Test_Tasmota_MQTT_Switch_Double();
@@ -655,5 +726,8 @@ void Test_Tasmota() {
 	Test_Tasmota_MQTT_RGBCW();
 #endif
 	Test_Tasmota_Backlog();
+#if ENABLE_TASMOTA_JSON_CACHE
+	Test_Tasmota_StatusCache();
+#endif
 }
 #endif
@@ -2,10 +2,73 @@
 
 #include "selftest_local.h"
 
+static void Test_Tokenizer_Context() {
+	tokenizer_t *t;
+	tokenizer_t *prev;
+
+	t = Tokenizer_Alloc();
+	SELFTEST_ASSERT(t != 0);
+
+	// separate context is not affected by global tokenizer
+	TokenizerCtx_TokenizeString(t, "first 12 \"quoted arg\"", TOKENIZER_ALLOW_QUOTES);
+	Tokenizer_TokenizeString("other 1 2 3 4", 0);
+	SELFTEST_ASSERT(TokenizerCtx_GetArgsCount(t) == 3);
+	SELFTEST_ASSERT_STRING(TokenizerCtx_GetArg(t, 0), "first");
+	SELFTEST_ASSERT(TokenizerCtx_GetArgInteger(t, 1) == 12);
+	SELFTEST_ASSERT_STRING(TokenizerCtx_GetArg(t, 2), "quoted arg");
+	SELFTEST_ASSERT_ARGUMENTS_COUNT(5);
+	SELFTEST_ASSERT_ARGUMENT(0, "other");
+
+	// classic API can be redirected
+	prev = Tokenizer_SetCurrent(t);
+	SELFTEST_ASSERT_ARGUMENTS_COUNT(3);
+	SELFTEST_ASSERT_ARGUMENT(0, "first");
+	Tokenizer_SetCurrent(prev);
+	SELFTEST_ASSERT_ARGUMENTS_COUNT(5);
+
+	Tokenizer_Free(t);
+}
+static char g_nestedArgs[3][64];
+static int g_nestedArgsCount;
+// runs its first arg as a command, then reads the rest of own args
+static commandResult_t CMD_SelfTest_Nested(const void *context, const char *cmd, const char *args, int cmdFlags) {
+	int i;
+
+	Tokenizer_TokenizeString(args, TOKENIZER_ALLOW_QUOTES | TOKENIZER_ALLOW_ESCAPING_QUOTATIONS);
+	CMD_ExecuteCommand(Tokenizer_GetArg(0), 0);
+	g_nestedArgsCount = Tokenizer_GetArgsCount();
+	for (i = 0; i < 3 && i < g_nestedArgsCount; i++) {
+		strcpy_safe(g_nestedArgs[i], Tokenizer_GetArg(i), sizeof(g_nestedArgs[i]));
+	}
+	return CMD_RES_OK;
+}
+static void Test_Tokenizer_Nested() {
+	CMD_RegisterCommand("SimNested", CMD_SelfTest_Nested, 0);
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+
+	// args of outer command survive backlog and if run inside it
+	CMD_ExecuteCommand("SimNested \"backlog setChannel 1 5; if 1 then \\\"setChannel 2 7\\\"\" outerA $CH1", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 5);
+	SELFTEST_ASSERT_CHANNEL(2, 7);
+	SELFTEST_ASSERT(g_nestedArgsCount == 3);
+	SELFTEST_ASSERT_STRING(g_nestedArgs[1], "outerA");
+	// expanded after nested command has run
+	SELFTEST_ASSERT_STRING(g_nestedArgs[2], "5");
+
+	// nested twice
+	CMD_ExecuteCommand("SimNested \"SimNested \\\"setChannel 1 9\\\" innerB\" outerC", 0);
+	SELFTEST_ASSERT_CHANNEL(1, 9);
+	SELFTEST_ASSERT(g_nestedArgsCount == 2);
+	SELFTEST_ASSERT_STRING(g_nestedArgs[1], "outerC");
+}
 void Test_Tokenizer() {
 	// reset whole device
 	SIM_ClearOBK(0);
 
+	Test_Tokenizer_Context();
+	Test_Tokenizer_Nested();
+
 	Tokenizer_TokenizeString("Hello", 0);
 	SELFTEST_ASSERT_ARGUMENTS_COUNT(1);
 	SELFTEST_ASSERT_ARGUMENT(0, "Hello");
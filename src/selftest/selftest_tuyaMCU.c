@@ -2,6 +2,8 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_tuyaMCU.h"
+#include "../driver/drv_uart.h"
 
 void Test_TuyaMCU_RawAccess() {
 	// reset whole device
@@ -206,6 +208,123 @@ void Test_TuyaMCU_Boolean() {
 	//SELFTEST_ASSERT_HAS_UART_EMPTY();
 
 }
+// values of dpID 3 SetDP packets sent to MCU, other packets are skipped
+static int Test_TuyaMCU_CollectSetDP(int *values, int max) {
+	int count = 0;
+	int len, i;
+	byte chk;
+
+	while (SIM_UART_GetDataSize() >= 7) {
+		SELFTEST_ASSERT(SIM_UART_GetByte(0) == 0x55 && SIM_UART_GetByte(1) == 0xAA);
+		len = 7 + (SIM_UART_GetByte(4) << 8 | SIM_UART_GetByte(5));
+		SELFTEST_ASSERT(SIM_UART_GetDataSize() >= len);
+		chk = 0;
+		for (i = 0; i < len - 1; i++) {
+			chk += SIM_UART_GetByte(i);
+		}
+		SELFTEST_ASSERT(chk == SIM_UART_GetByte(len - 1));
+		if (SIM_UART_GetByte(3) == 0x06 && SIM_UART_GetByte(6) == 3 && count < max) {
+			values[count++] = SIM_UART_GetByte(13);
+		}
+		SIM_UART_ConsumeBytes(len);
+	}
+	return count;
+}
+void Test_TuyaMCU_Queue() {
+	int values[100];
+	char tmp[64];
+	int i, count;
+
+	SIM_ClearOBK(0);
+	SIM_UART_InitReceiveRingBuffer(4096);
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	CFG_SetFlag(OBK_FLAG_TUYAMCU_USE_QUEUE, 1);
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 3 val 3", 0);
+
+	// queued, sent from frame
+	CMD_ExecuteCommand("setChannel 3 200", 0);
+	SELFTEST_ASSERT_HAS_UART_EMPTY();
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_HAS_SENT_UART_STRING("55 AA 00 06 00 08 03 02 00 04 000000C8 DE");
+
+	// slider drag, more than queue holds, oldest are dropped
+	for (i = 0; i < 80; i++) {
+		snprintf(tmp, sizeof(tmp), "setChannel 3 %i", i);
+		CMD_ExecuteCommand(tmp, 0);
+	}
+	Sim_RunSeconds(15, false);
+	count = Test_TuyaMCU_CollectSetDP(values, 100);
+	SELFTEST_ASSERT(count > 40 && count < 80);
+	for (i = 0; i < count; i++) {
+		SELFTEST_ASSERT(values[i] == 80 - count + i);
+	}
+	// ring is reused after wrap
+	CMD_ExecuteCommand("setChannel 3 5", 0);
+	CMD_ExecuteCommand("setChannel 3 6", 0);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(Test_TuyaMCU_CollectSetDP(values, 100) == 2);
+	SELFTEST_ASSERT(values[0] == 5 && values[1] == 6);
+	CFG_SetFlag(OBK_FLAG_TUYAMCU_USE_QUEUE, 0);
+}
+void Test_TuyaMCU_Mappings() {
+	char tmp[64];
+	int i;
+
+	SIM_ClearOBK(0);
+	SIM_UART_InitReceiveRingBuffer(2048);
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	// big device, dpIds 101..140 on channels 10..49
+	for (i = 0; i < 40; i++) {
+		snprintf(tmp, sizeof(tmp), "linkTuyaMCUOutputToChannel %i val %i", 101 + i, 10 + i);
+		CMD_ExecuteCommand(tmp, 0);
+	}
+	SELFTEST_ASSERT(TuyaMCU_IsChannelUsedByTuyaMCU(10));
+	SELFTEST_ASSERT(TuyaMCU_IsChannelUsedByTuyaMCU(49));
+	SELFTEST_ASSERT(!TuyaMCU_IsChannelUsedByTuyaMCU(50));
+	SELFTEST_ASSERT(!TuyaMCU_IsChannelUsedByTuyaMCU(1));
+	// dpId 140 sets 7
+	CMD_ExecuteCommand("uartFakeHex 55AA03070008 8C 02 0004 00000007 AA", 0);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_CHANNEL(49, 7);
+	// dpId 140 is moved to channel 5
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 140 val 5", 0);
+	SELFTEST_ASSERT(!TuyaMCU_IsChannelUsedByTuyaMCU(49));
+	SELFTEST_ASSERT(TuyaMCU_IsChannelUsedByTuyaMCU(5));
+	CMD_ExecuteCommand("setChannel 49 3", 0);
+	SELFTEST_ASSERT_HAS_UART_EMPTY();
+	CMD_ExecuteCommand("setChannel 5 3", 0);
+	SELFTEST_ASSERT_HAS_SENT_UART_STRING("55 AA 00 06 00 08 8C 02 00 04 00000003 A2");
+	CMD_ExecuteCommand("uartFakeHex 55AA03070008 8C 02 0004 00000009 AC", 0);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_CHANNEL(5, 9);
+	SELFTEST_ASSERT_CHANNEL(49, 3);
+}
+void Test_TuyaMCU_Parser() {
+	SIM_ClearOBK(0);
+	SIM_UART_InitReceiveRingBuffer(2048);
+	CMD_ExecuteCommand("startDriver TuyaMCU", 0);
+	CMD_ExecuteCommand("linkTuyaMCUOutputToChannel 140 val 49", 0);
+	// garbage, lone 0x55 and frame that comes in pieces
+	CMD_ExecuteCommand("uartFakeHex 00 55 12 55 55AA0307", 0);
+	Sim_RunFrames(10, false);
+	CMD_ExecuteCommand("uartFakeHex 0008 8C 02 0004", 0);
+	Sim_RunFrames(10, false);
+	CMD_ExecuteCommand("uartFakeHex 00000007", 0);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_CHANNEL(49, 0);
+	// all is taken from UART ring, even unfinished frame
+	SELFTEST_ASSERT(UART_GetDataSize() == 0);
+	CMD_ExecuteCommand("uartFakeHex AA", 0);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_CHANNEL(49, 7);
+	// bad checksum is dropped, frame right after it is not
+	CMD_ExecuteCommand("uartFakeHex 55AA03070008 8C 02 0004 00000008 AC", 0);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_CHANNEL(49, 7);
+	CMD_ExecuteCommand("uartFakeHex 55AA03070008 8C 02 0004 00000008 AD 55AA03070008 8C 02 0004 00000009 AC", 0);
+	Sim_RunFrames(10, false);
+	SELFTEST_ASSERT_CHANNEL(49, 9);
+}
 void Test_TuyaMCU_DP22() {
 	SIM_ClearOBK(0);
 	SIM_UART_InitReceiveRingBuffer(2048);
@@ -34,8 +34,101 @@ void Test_TwoPWMsOneChannel_Test1() {
 	PIN_get_Relay_PWM_Count(0, &pwmCount, 0);
 	SELFTEST_ASSERT(pwmCount == 2);
 }
+// Dimmer1000 and float values go to PWM with finer steps than 1%
+void Test_TwoPWMsOneChannel_Resolution() {
+	SIM_ClearOBK(0);
+
+	PIN_SetPinChannelForPinIndex(9, 0);
+	PIN_SetPinRoleForPinIndex(9, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(11, 0);
+	PIN_SetPinRoleForPinIndex(11, IOR_PWM_n);
+	CMD_ExecuteCommand("setChannelType 0 Dimmer1000", 0);
+
+	CMD_ExecuteCommand("setChannel 0 500", 0);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(9) == 32768);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(11) == 65535 - 32768);
+	SELFTEST_ASSERT(SIM_GetPWMValue(9) == 50);
+	// 0.7% would be 0 with whole percents
+	CMD_ExecuteCommand("setChannel 0 7", 0);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(9) == 459);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(11) == 65535 - 459);
+	// toggle goes to full range of type
+	CMD_ExecuteCommand("setChannel 0 0", 0);
+	CMD_ExecuteCommand("toggleChannel 0", 0);
+	SELFTEST_ASSERT_CHANNEL(0, 1000);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(9) == 65535);
+
+	// LED driver sets fractions of percent
+	CMD_ExecuteCommand("setChannelType 0 Default", 0);
+	CHANNEL_Set_FloatPWM(0, 12.34f, 0);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(9) == 8087);
+	SELFTEST_ASSERT(SIM_GetPWMValue(9) == 12);
+	CMD_ExecuteCommand("setChannel 0 100", 0);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(9) == 65535);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(11) == 0);
+
+	// Dimmer256 is full at 255, int and float values are both in its units
+	CMD_ExecuteCommand("setChannelType 0 Dimmer256", 0);
+	CMD_ExecuteCommand("setChannel 0 255", 0);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(9) == 65535);
+	CMD_ExecuteCommand("setChannel 0 128", 0);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(9) == 32896);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(11) == 65535 - 32896);
+	CHANNEL_Set_FloatPWM(0, 127.5f, 0);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(9) == 32768);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(11) == 65535 - 32768);
+	// pin set up later gets same duty
+	PIN_SetPinChannelForPinIndex(12, 0);
+	PIN_SetPinRoleForPinIndex(12, IOR_PWM);
+	SELFTEST_ASSERT(SIM_GetPWMDuty(12) == 32768);
+}
+// PWMs of one change go to HAL together, so they latch on same period
+void Test_TwoPWMsOneChannel_Group() {
+	int groups;
+
+	SIM_ClearOBK(0);
+
+	PIN_SetPinChannelForPinIndex(9, 0);
+	PIN_SetPinRoleForPinIndex(9, IOR_PWM);
+	PIN_SetPinChannelForPinIndex(11, 0);
+	PIN_SetPinRoleForPinIndex(11, IOR_PWM_n);
+	PIN_SetPinChannelForPinIndex(12, 1);
+	PIN_SetPinRoleForPinIndex(12, IOR_PWM);
+
+	groups = SIM_GetPWMGroupUpdateCount();
+	CMD_ExecuteCommand("setChannel 0 25", 0);
+	SELFTEST_ASSERT(SIM_GetPWMGroupUpdateCount() == groups + 1);
+	SELFTEST_ASSERT(SIM_GetPWMValue(9) == 25);
+	SELFTEST_ASSERT(SIM_GetPWMValue(11) == 75);
+
+	// both channels in one batch
+	groups = SIM_GetPWMGroupUpdateCount();
+	CHANNEL_BeginBatch();
+	CHANNEL_Set(0, 60, 0);
+	CHANNEL_Set(1, 70, 0);
+	CHANNEL_CommitBatch();
+	SELFTEST_ASSERT(SIM_GetPWMGroupUpdateCount() == groups + 1);
+	SELFTEST_ASSERT(SIM_GetPWMValue(9) == 60);
+	SELFTEST_ASSERT(SIM_GetPWMValue(12) == 70);
+
+	// float setter of LED driver waits for commit of group
+	groups = SIM_GetPWMGroupUpdateCount();
+	PIN_BeginPWMGroup();
+	CHANNEL_Set_FloatPWM(0, 10.0f, 0);
+	CHANNEL_Set_FloatPWM(1, 20.0f, 0);
+	CHANNEL_Set_FloatPWM(0, 30.0f, 0);
+	SELFTEST_ASSERT(SIM_GetPWMGroupUpdateCount() == groups);
+	SELFTEST_ASSERT(SIM_GetPWMValue(9) == 60);
+	PIN_CommitPWMGroup();
+	SELFTEST_ASSERT(SIM_GetPWMGroupUpdateCount() == groups + 1);
+	SELFTEST_ASSERT(SIM_GetPWMValue(9) == 30);
+	SELFTEST_ASSERT(SIM_GetPWMValue(11) == 70);
+	SELFTEST_ASSERT(SIM_GetPWMValue(12) == 20);
+}
 void Test_TwoPWMsOneChannel() {
 	Test_TwoPWMsOneChannel_Test1();
+	Test_TwoPWMsOneChannel_Resolution();
+	Test_TwoPWMsOneChannel_Group();
 
 
 }
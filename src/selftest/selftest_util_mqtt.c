@@ -109,6 +109,25 @@ bool CheckForKeyVal(cJSON *tmp, const char *key, const char *value) {
 	}
 	return false;
 }
+// acts as broker loopback, each publish on topic is received once
+int SIM_RepostMQTTPublishes(const char *topic) {
+	mqttHistoryEntry_t *ne;
+	int cur = history_tail;
+	int count = 0;
+
+	while (cur != history_head) {
+		ne = &mqtt_history[cur];
+		if (!strcmp(ne->topic, topic)) {
+			MQTT_Post_Received_Str(ne->topic, ne->value);
+			// mark as done
+			ne->topic[0] = 0;
+			count++;
+		}
+		cur++;
+		cur %= MAX_MQTT_HISTORY;
+	}
+	return count;
+}
 void SIM_DumpMQTTHistory() {
 	int cur = history_tail;
 	int index = 0;
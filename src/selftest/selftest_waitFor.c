@@ -417,6 +417,76 @@ void Test_WaitFor_ChannelValue() {
 	SELFTEST_ASSERT_CHANNEL(1, 123);
 	SELFTEST_ASSERT_CHANNEL(2, 234);
 }
+void Test_WaitFor_ManyWaiters() {
+	int i;
+
+	// reset whole device
+	SIM_ClearOBK(0);
+	CMD_ExecuteCommand("lfs_format", 0);
+
+	Test_FakeHTTPClientPacket_POST("api/lfs/waitA.txt",
+		"waitFor MQTTState 1\n"
+		"setChannel 1 1\n");
+	Test_FakeHTTPClientPacket_POST("api/lfs/waitB.txt",
+		"waitFor NoPingTime > 5\n"
+		"setChannel 2 1\n");
+	Test_FakeHTTPClientPacket_POST("api/lfs/waitC.txt",
+		"waitFor MQTTState 1\n"
+		"setChannel 3 1\n");
+	Test_FakeHTTPClientPacket_POST("api/lfs/waitD.txt",
+		"waitFor MQTTState 1\n"
+		"setChannel 4 1\n");
+
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_ExecuteCommand("setChannel 2 0", 0);
+	CMD_ExecuteCommand("setChannel 3 0", 0);
+	CMD_ExecuteCommand("setChannel 4 0", 0);
+	CMD_ExecuteCommand("startScript waitA.txt * 11", 0);
+	CMD_ExecuteCommand("startScript waitB.txt * 12", 0);
+	CMD_ExecuteCommand("startScript waitC.txt * 13", 0);
+	CMD_ExecuteCommand("startScript waitD.txt * 14", 0);
+	for (i = 0; i < 10; i++) {
+		SVM_RunThreads(5);
+	}
+	// stopped waiter must not wake up
+	CMD_ExecuteCommand("stopScript 14", 0);
+
+	// other events and not matching arguments don't wake anyone
+	CMD_Script_ProcessWaitersForEvent(CMD_EVENT_CHANGE_NOPINGTIME, 3);
+	CMD_Script_ProcessWaitersForEvent(CMD_EVENT_MQTT_STATE, 0);
+	for (i = 0; i < 10; i++) {
+		SVM_RunThreads(5);
+	}
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT_CHANNEL(2, 0);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+
+	CMD_Script_ProcessWaitersForEvent(CMD_EVENT_CHANGE_NOPINGTIME, 10);
+	for (i = 0; i < 10; i++) {
+		SVM_RunThreads(5);
+	}
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	SELFTEST_ASSERT_CHANNEL(3, 0);
+
+	CMD_Script_ProcessWaitersForEvent(CMD_EVENT_MQTT_STATE, 1);
+	for (i = 0; i < 10; i++) {
+		SVM_RunThreads(5);
+	}
+	SELFTEST_ASSERT_CHANNEL(1, 1);
+	SELFTEST_ASSERT_CHANNEL(2, 1);
+	SELFTEST_ASSERT_CHANNEL(3, 1);
+	SELFTEST_ASSERT_CHANNEL(4, 0);
+
+	// woken threads are gone from the wait lists
+	CMD_ExecuteCommand("setChannel 1 0", 0);
+	CMD_Script_ProcessWaitersForEvent(CMD_EVENT_MQTT_STATE, 1);
+	for (i = 0; i < 10; i++) {
+		SVM_RunThreads(5);
+	}
+	SELFTEST_ASSERT_CHANNEL(1, 0);
+	SELFTEST_ASSERT_CHANNEL(4, 0);
+}
 void Test_WaitFor() {
 	Test_WaitFor_MQTTState();
 	Test_WaitFor_NoPingTime();
@@ -427,6 +497,7 @@ void Test_WaitFor() {
 	Test_WaitFor_OperatorLess2();
 	Test_WaitFor_OperatorNotEqual();
 	Test_WaitFor_ChannelValue();
+	Test_WaitFor_ManyWaiters();
 }
 
 #endif
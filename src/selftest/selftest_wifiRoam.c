@@ -0,0 +1,83 @@
+#ifdef WINDOWS
+
+#include "selftest_local.h"
+#include "../driver/drv_wifiRoam.h"
+
+void Test_WiFiRoam() {
+	char bssid[32];
+	int scans;
+
+	SIM_ClearOBK(0);
+	SIM_ClearAndPrepareForMQTTTesting("roamTester", "bekens");
+	CFG_SetWiFiSSID("HomeNet");
+	SIM_ClearWiFiAPs();
+	SIM_SetWiFiAP("HomeNet", "11:22:33:44:55:01", 1, -80);
+	SIM_SetWiFiAP("HomeNet", "11:22:33:44:55:02", 6, -60);
+	SIM_SetWiFiAP("OtherNet", "11:22:33:44:55:03", 11, -40);
+	SIM_SetWiFiAP("HomeNet", "11:22:33:44:55:04", 11, -76);
+	SIM_SetWiFiLink("11:22:33:44:55:01");
+	SELFTEST_ASSERT(HAL_GetWifiStrength() == -80);
+
+	CMD_ExecuteCommand("startDriver WiFiRoam 5", 0);
+	CMD_ExecuteCommand("WiFiRoam_Policy -85 5 8", 0);
+	Sim_RunSeconds(6.5f, false);
+	SELFTEST_ASSERT(WiFiRoam_GetScanCount() == 1);
+	Test_FakeHTTPClientPacket_GET("api/wifiscan");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"bssid\":\"11:22:33:44:55:01\",\"rssi\":-80,");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("{\"ssid\":\"HomeNet\",\"bssid\":\"11:22:33:44:55:02\",\"ch\":6,\"rssi\":-60,");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("{\"ssid\":\"OtherNet\",\"bssid\":\"11:22:33:44:55:03\",\"ch\":11,\"rssi\":-40,");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"bssid\":\"11:22:33:44:55:04\"");
+	// link above MinRssi stays where it is
+	SELFTEST_ASSERT(WiFiRoam_GetRoamCount() == 0);
+	SELFTEST_ASSERT_STRING(HAL_GetWiFiBSSID(bssid), "11:22:33:44:55:01");
+
+	// no scans while device publishes a lot
+	scans = SIM_GetWiFiScanCount();
+	for (int i = 0; i < 8; i++) {
+		for (int j = 0; j < 6; j++) {
+			CMD_ExecuteCommand("publish roamBusy 1", 0);
+		}
+		Sim_RunSeconds(1, false);
+	}
+	SELFTEST_ASSERT(SIM_GetWiFiScanCount() == scans);
+	// missed scan is done on first idle second
+	Sim_RunSeconds(1.5f, false);
+	SELFTEST_ASSERT(SIM_GetWiFiScanCount() == scans + 1);
+
+	// weak link roams only after hold time, to strongest AP of same SSID
+	CMD_ExecuteCommand("WiFiRoam_Policy -75 5 8", 0);
+	Sim_RunSeconds(3, false);
+	SELFTEST_ASSERT(WiFiRoam_GetRoamCount() == 0);
+	Sim_RunSeconds(3, false);
+	SELFTEST_ASSERT(WiFiRoam_GetRoamCount() == 1);
+	SELFTEST_ASSERT_STRING(HAL_GetWiFiBSSID(bssid), "11:22:33:44:55:02");
+	SELFTEST_ASSERT(HAL_GetWifiStrength() == -60);
+	Sim_RunSeconds(2, false);
+	SELFTEST_ASSERT(Main_HasWiFiConnected());
+	SELFTEST_ASSERT(WiFiRoam_IsRoaming() == false);
+
+	// cooldown keeps it from jumping right back
+	SIM_SetWiFiAP("HomeNet", "11:22:33:44:55:01", 1, -50);
+	SIM_SetWiFiAP("HomeNet", "11:22:33:44:55:02", 6, -82);
+	Sim_RunSeconds(20, false);
+	SELFTEST_ASSERT(WiFiRoam_GetRoamCount() == 1);
+	SELFTEST_ASSERT_STRING(HAL_GetWiFiBSSID(bssid), "11:22:33:44:55:02");
+
+	// AP that isn't GainDb better is not worth it
+	SIM_SetWiFiAP("HomeNet", "11:22:33:44:55:01", 1, -78);
+	Sim_RunSeconds(120, false);
+	SELFTEST_ASSERT(WiFiRoam_GetRoamCount() == 1);
+	SIM_SetWiFiAP("HomeNet", "11:22:33:44:55:01", 1, -70);
+	Sim_RunSeconds(12, false);
+	SELFTEST_ASSERT(WiFiRoam_GetRoamCount() == 2);
+	SELFTEST_ASSERT_STRING(HAL_GetWiFiBSSID(bssid), "11:22:33:44:55:01");
+
+	Test_FakeHTTPClientPacket_GET("api/wifiscan");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("\"roams\":2,");
+	SELFTEST_ASSERT_PAGE_CONTAINS("index", "WiFiRoam: 4 APs cached");
+
+	CMD_ExecuteCommand("stopDriver WiFiRoam", 0);
+	SIM_ClearWiFiAPs();
+}
+
+#endif
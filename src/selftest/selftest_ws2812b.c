@@ -1,6 +1,8 @@
 #ifdef WINDOWS
 
 #include "selftest_local.h"
+#include "../driver/drv_local.h"
+#include "../driver/drv_spiLED.h"
 
 
 bool Strip_VerifyPixel(uint32_t pixel, byte r, byte g, byte b);
@@ -13,6 +15,8 @@ bool Strip_VerifyPixel5(uint32_t pixel, byte r, byte g, byte b, byte c, byte w);
 
 
 void Strip_setMultiplePixel(uint32_t pixel, uint8_t *data, bool push);
+byte DMX_GetByte(uint32_t idx);
+void DDP_SimulatePacket(const char *s);
 
 void Test_DMX_RGB() {
 	// reset whole device
@@ -70,6 +74,10 @@ void Test_DMX_RGB() {
 	{
 		byte ddpPacket[128];
 
+		// version 1 with PUSH, 9 bytes at offset 0
+		memset(ddpPacket, 0, sizeof(ddpPacket));
+		ddpPacket[0] = 0x41;
+		ddpPacket[9] = 9;
 		// data starts at offset 10
 		// pixel 0
 		ddpPacket[10] = 0xFF;
@@ -428,6 +436,10 @@ void Test_WS2812B() {
 	{
 		byte ddpPacket[128];
 
+		// version 1 with PUSH, 9 bytes at offset 0
+		memset(ddpPacket, 0, sizeof(ddpPacket));
+		ddpPacket[0] = 0x41;
+		ddpPacket[9] = 9;
 		// data starts at offset 10
 		// pixel 0
 		ddpPacket[10] = 0xFF;
@@ -473,7 +485,11 @@ void Test_WS2812B() {
 	{
 		byte ddpPacket[128];
 
+		// version 1 with PUSH, 12 bytes at offset 0
+		memset(ddpPacket, 0, sizeof(ddpPacket));
+		ddpPacket[0] = 0x41;
 		ddpPacket[2] = 0x1A;
+		ddpPacket[9] = 12;
 
 		// data starts at offset 10
 		// pixel 0
@@ -600,8 +616,171 @@ void Test_WS2812B_misc() {
 
 }
 
+#if ENABLE_DRIVER_PIXELANIM
+void Test_PixelAnim_Segments() {
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	CMD_ExecuteCommand("startDriver DMX", 0);
+	CMD_ExecuteCommand("SM16703P_Init 8 RGB", 0);
+	CMD_ExecuteCommand("startDriver PixelAnim", 0);
+	CMD_ExecuteCommand("led_enableAll 1", 0);
+	CMD_ExecuteCommand("led_dimmer 100", 0);
+	// plain colour on first half, standing rainbow on second
+	CMD_ExecuteCommand("PixelSeg 0 0 4 Solid", 0);
+	CMD_ExecuteCommand("PixelSegSet 0 color 102030", 0);
+	CMD_ExecuteCommand("PixelSeg 1 4 4 Rainbow Rainbow 0", 0);
+	Sim_RunFrames(3, false);
+	SELFTEST_ASSERT_PIXEL(0, 0x10, 0x20, 0x30);
+	SELFTEST_ASSERT_PIXEL(3, 0x10, 0x20, 0x30);
+	SELFTEST_ASSERT_PIXEL(4, 255, 0, 0);
+	SELFTEST_ASSERT_PIXEL(5, 171, 171, 0);
+	SELFTEST_ASSERT_PIXEL(6, 0, 171, 85);
+	SELFTEST_ASSERT_PIXEL(7, 85, 0, 171);
+
+	CMD_ExecuteCommand("PixelSegSet 1 brightness 127", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_PIXEL(4, 127, 0, 0);
+
+	// added over part of first segment
+	CMD_ExecuteCommand("PixelSeg 2 2 2 Solid", 0);
+	CMD_ExecuteCommand("PixelSegSet 2 color 010101", 0);
+	CMD_ExecuteCommand("PixelSegSet 2 blend Add", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_PIXEL(1, 0x10, 0x20, 0x30);
+	SELFTEST_ASSERT_PIXEL(2, 0x11, 0x21, 0x31);
+	SELFTEST_ASSERT_PIXEL(3, 0x11, 0x21, 0x31);
+
+	// rainbow moves
+	CMD_ExecuteCommand("PixelSegSet 1 speed 4096", 0);
+	Sim_RunFrames(2, false);
+	SELFTEST_ASSERT(Strip_VerifyPixel(4, 127, 0, 0) == false);
+
+	Test_FakeHTTPClientPacket_GET("index");
+	SELFTEST_ASSERT_HTML_REPLY_CONTAINS("Segment 1 [ACTIVE]: pixels 4-7, Rainbow, palette Rainbow");
+
+	// shorter strip cuts segments
+	CMD_ExecuteCommand("PixelSegSet 2 count 0", 0);
+	CMD_ExecuteCommand("SM16703P_Init 3 RGB", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT_PIXEL(2, 0x10, 0x20, 0x30);
+
+	SELFTEST_ASSERT(CMD_ExecuteCommand("PixelSeg 0 0 4 Sparkles", 0) == CMD_RES_BAD_ARGUMENT);
+	SELFTEST_ASSERT(CMD_ExecuteCommand("PixelSegSet 9 speed 1", 0) == CMD_RES_BAD_ARGUMENT);
+
+	// single animation again
+	CMD_ExecuteCommand("Anim 0", 0);
+	Sim_RunFrames(1, false);
+	SELFTEST_ASSERT(Strip_VerifyPixel(2, 0x10, 0x20, 0x30) == false);
+}
+#endif
+void Test_Strip_Framebuffer() {
+	// reset whole device
+	SIM_ClearOBK(0);
+
+	CMD_ExecuteCommand("startDriver DMX", 0);
+	// pixels are kept in strip order and reach backend buffer on Start
+	CMD_ExecuteCommand("SM16703P_Init 4 GRB", 0);
+	CMD_ExecuteCommand("SM16703P_SetPixel 1 10 20 30", 0);
+	SELFTEST_ASSERT_PIXEL(1, 20, 10, 30);
+	SELFTEST_ASSERT(DMX_GetByte(3) == 0);
+	CMD_ExecuteCommand("SM16703P_Start", 0);
+	SELFTEST_ASSERT(DMX_GetByte(3) == 20);
+	SELFTEST_ASSERT(DMX_GetByte(4) == 10);
+	SELFTEST_ASSERT(DMX_GetByte(5) == 30);
+	Strip_scaleAllPixels(128);
+	CMD_ExecuteCommand("SM16703P_Start", 0);
+	SELFTEST_ASSERT(DMX_GetByte(3) == 10);
+	SELFTEST_ASSERT(DMX_GetByte(5) == 15);
+
+	CMD_ExecuteCommand("SM16703P_Init 2 BWRG", 0);
+	CMD_ExecuteCommand("SM16703P_SetPixel 0 1 2 3 4", 0);
+	SELFTEST_ASSERT_PIXEL4(0, 3, 4, 1, 2);
+	CMD_ExecuteCommand("SM16703P_Init 2 WRGBC", 0);
+	CMD_ExecuteCommand("SM16703P_SetPixel 1 1 2 3 4 5", 0);
+	SELFTEST_ASSERT_PIXEL5(1, 5, 1, 2, 3, 4);
+	CMD_ExecuteCommand("SM16703P_Start", 0);
+	SELFTEST_ASSERT(DMX_GetByte(5) == 5);
+	SELFTEST_ASSERT(DMX_GetByte(9) == 4);
+
+	// paced output, second frame waits for its time, third replaces it
+	CMD_ExecuteCommand("SM16703P_Init 3 RGB", 0);
+	CMD_ExecuteCommand("Strip_FPS 20", 0);
+	CMD_ExecuteCommand("SM16703P_SetPixel 0 1 2 3", 0);
+	CMD_ExecuteCommand("SM16703P_Start", 0);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 1);
+	CMD_ExecuteCommand("SM16703P_SetPixel 0 5 2 3", 0);
+	CMD_ExecuteCommand("SM16703P_Start", 0);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 1);
+	SELFTEST_ASSERT(Strip_WantsFrame() == false);
+	CMD_ExecuteCommand("SM16703P_SetPixel 0 6 2 3", 0);
+	CMD_ExecuteCommand("SM16703P_Start", 0);
+	SELFTEST_ASSERT(Strip_GetDroppedFrames() == 1);
+	SELFTEST_ASSERT(Strip_GetTimeToNextWakeMS() > 0);
+	Sim_RunFrames(100, false);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 6);
+	SELFTEST_ASSERT(Strip_GetTimeToNextWakeMS() == -1);
+	SELFTEST_ASSERT(Strip_WantsFrame());
+	CMD_ExecuteCommand("Strip_FPS 0", 0);
+	CMD_ExecuteCommand("SM16703P_SetPixel 0 7 2 3", 0);
+	CMD_ExecuteCommand("SM16703P_Start", 0);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 7);
+
+	// DDP frame in two packets, shown on PUSH from second one
+	CMD_ExecuteCommand("SM16703P_Init 4 GRB", 0);
+	DDP_SimulatePacket("41010001000000000003FF0000");
+	SELFTEST_ASSERT(DMX_GetByte(1) == 0xFF);
+	DDP_SimulatePacket("40010001000000000006010203040506");
+	SELFTEST_ASSERT_PIXEL(0, 2, 1, 3);
+	SELFTEST_ASSERT_PIXEL(1, 5, 4, 6);
+	SELFTEST_ASSERT(DMX_GetByte(1) == 0xFF);
+	DDP_SimulatePacket("410200010000000600060708090A0B0C");
+	SELFTEST_ASSERT_PIXEL(2, 8, 7, 9);
+	SELFTEST_ASSERT_PIXEL(3, 0x0B, 0x0A, 0x0C);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 2);
+	SELFTEST_ASSERT(DMX_GetByte(11) == 0x0C);
+	// RGBW data type, with timecode, beyond strip end is cut
+	CMD_ExecuteCommand("SM16703P_Init 2 RGBW", 0);
+	DDP_SimulatePacket("51031B0100000004000C1234567811121314212223246666");
+	SELFTEST_ASSERT_PIXEL4(1, 0x11, 0x12, 0x13, 0x14);
+	SELFTEST_ASSERT(DMX_GetByte(4) == 0x11);
+	SELFTEST_ASSERT(DMX_GetByte(7) == 0x14);
+	SELFTEST_ASSERT(DMX_GetByte(0) == 0);
+}
+
+#if ENABLE_DRIVER_SM16703P || ENABLE_DRIVER_SM15155E
+void Test_SPILED_Encoding() {
+	byte src[256];
+	byte enc[256 * 4];
+	byte one[4];
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		src[i] = i;
+	}
+	SPILED_EncodeBytes(enc, src, 256);
+	for (i = 0; i < 256; i++) {
+		// same as 2 bits at a time
+		SELFTEST_ASSERT(enc[i * 4 + 0] == translate_2bit(i >> 6));
+		SELFTEST_ASSERT(enc[i * 4 + 1] == translate_2bit(i >> 4));
+		SELFTEST_ASSERT(enc[i * 4 + 2] == translate_2bit(i >> 2));
+		SELFTEST_ASSERT(enc[i * 4 + 3] == translate_2bit(i));
+		translate_byte(i, one);
+		SELFTEST_ASSERT(!memcmp(one, enc + i * 4, 4));
+		SELFTEST_ASSERT(reverse_translate_byte(enc + i * 4) == i);
+	}
+}
+#endif
+
 void Test_LEDstrips() {
+#if ENABLE_DRIVER_SM16703P || ENABLE_DRIVER_SM15155E
+	Test_SPILED_Encoding();
+#endif
 	Test_WS2812B_misc();
+	Test_Strip_Framebuffer();
+#if ENABLE_DRIVER_PIXELANIM
+	Test_PixelAnim_Segments();
+#endif
 	Test_DMX_RGB();
 	Test_DMX_RGBC();
 	Test_DMX_RGBW();
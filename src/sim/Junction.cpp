@@ -1,6 +1,8 @@
 #ifdef WINDOWS
 #include "Junction.h"
 
+int CJunction::topologyRevision = 0;
+
 CJunction::~CJunction() {
 	for (int i = 0; i < linked.size(); i++) {
 		CJunction *oj = linked[i];
@@ -29,6 +31,7 @@ bool CJunction::isWireJunction() const {
 }
 void CJunction::unlink(class CJunction *o) {
 	linked.erase(std::remove(linked.begin(), linked.end(), o), linked.end());
+	markTopologyChanged();
 }
 bool CJunction::hasLinkedOnlyWires() const {
 	for (int i = 0; i < linked.size(); i++) {
@@ -36,9 +36,14 @@ class CJunction : public CShape {
 	int visitCount;
 	bool bCurrentSource;
 	int depth;
+	// index in simulation junctions list, set by solver
+	int solverIndex;
+	// bumped on every change of links and edges, see CSolver
+	static int topologyRevision;
 public:
 	CJunction() {
 		depth = 0;
+		solverIndex = -1;
 	}
 	CJunction(float _x, float _y, const char *s, int gpio = -1) {
 		this->setPosition(_x, _y);
@@ -49,8 +54,21 @@ public:
 		this->visitCount = 0;
 		this->bCurrentSource = false;
 		this->depth = 0;
+		this->solverIndex = -1;
 	}
 	virtual ~CJunction();
+	static int getTopologyRevision() {
+		return topologyRevision;
+	}
+	static void markTopologyChanged() {
+		topologyRevision++;
+	}
+	int getSolverIndex() const {
+		return solverIndex;
+	}
+	void setSolverIndex(int i) {
+		solverIndex = i;
+	}
 	virtual CShape *cloneShape();
 	void setCurrentSource(bool b) {
 		bCurrentSource = b;
@@ -114,6 +132,7 @@ public:
 	virtual bool isWireJunction() const;
 	void clearLinks() {
 		linked.clear();
+		markTopologyChanged();
 	}
 	int getLinksCount() const {
 		return linked.size();
@@ -126,6 +145,7 @@ public:
 	}
 	void addEdge(CEdge *ed) {
 		myEdges.push_back(ed);
+		markTopologyChanged();
 	}
 	class CEdge *getEdge(int i) {
 		return myEdges[i];
@@ -137,6 +157,7 @@ public:
 	virtual void translate(const Coord &o);
 	void addLink(CJunction *j) {
 		linked.add_unique(j);
+		markTopologyChanged();
 	}
 	virtual void drawShape();
 };
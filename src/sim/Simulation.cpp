@@ -26,6 +26,7 @@ void CSimulation::removeJunctions(class CShape *s) {
 }
 void CSimulation::removeJunction(class CJunction *ju) {
 	junctions.remove(ju);
+	CJunction::markTopologyChanged();
 }
 float CSimulation::drawTextStats(float h) {
 	h = drawText(NULL, 10, h, "Objects %i, wires %i", objects.size(), wires.size());
@@ -95,6 +96,7 @@ bool CSimulation::isJunctionOnList(class CJunction *ju) {
 }
 void CSimulation::registerJunction(class CJunction *ju) {
 	junctions.push_back(ju);
+	CJunction::markTopologyChanged();
 }
 void CSimulation::registerJunctions(class CWire *w) {
 	for (int i = 0; i < w->getJunctionsCount(); i++) {
@@ -4,7 +4,84 @@
 #include "Simulation.h"
 #include "Controller_Base.h"
 
+static int Solver_IndexOf(CSimulation *sim, CJunction *ju) {
+	if (ju == 0)
+		return -1;
+	int i = ju->getSolverIndex();
+	if (i < 0 || i >= sim->getJunctionsCount())
+		return -1;
+	// index may be stale for junction removed from simulation
+	if (sim->getJunction(i) != ju)
+		return -1;
+	return i;
+}
+int CSolver::findRoot(int i) {
+	while (parents[i] != i) {
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+void CSolver::unite(int a, int b) {
+	if (a < 0 || b < 0)
+		return;
+	a = findRoot(a);
+	b = findRoot(b);
+	if (a == b)
+		return;
+	// keep lower index as root, so groups are ordered like junctions
+	if (a < b)
+		parents[b] = a;
+	else
+		parents[a] = b;
+}
+void CSolver::rebuildGroups() {
+	int cnt = sim->getJunctionsCount();
+
+	parents.resize(cnt);
+	for (int i = 0; i < cnt; i++) {
+		sim->getJunction(i)->setSolverIndex(i);
+		parents[i] = i;
+	}
+	for (int i = 0; i < cnt; i++) {
+		CJunction *ju = sim->getJunction(i);
+		for (int j = 0; j < ju->getLinksCount(); j++) {
+			unite(i, Solver_IndexOf(sim, ju->getLink(j)));
+		}
+		for (int j = 0; j < ju->getEdgesCount(); j++) {
+			unite(i, Solver_IndexOf(sim, ju->getEdge(j)->getOther(ju)));
+		}
+	}
+	groups.clear();
+	junctionGroups.resize(cnt);
+	for (int i = 0; i < cnt; i++) {
+		int root = findRoot(i);
+		if (root == i) {
+			junctionGroups[i] = groups.size();
+			groups.push_back(solverGroup_t());
+		}
+		else {
+			// root has lower index, so its group is already there
+			junctionGroups[i] = junctionGroups[root];
+		}
+		CJunction *ju = sim->getJunction(i);
+		solverGroup_t &g = groups[junctionGroups[i]];
+		g.members.push_back(ju);
+		CControllerBase *cntr = ju->findOwnerController_r();
+		if (cntr != 0) {
+			g.ports.push_back(ju);
+			g.portControllers.push_back(cntr);
+		}
+	}
+	builtRevision = CJunction::getTopologyRevision();
+}
 void CSolver::solveVoltages() {
+	if (builtRevision != CJunction::getTopologyRevision()) {
+		rebuildGroups();
+	}
+	for (int i = 0; i < groups.size(); i++) {
+		groups[i].bVisited = false;
+	}
 	for (int i = 0; i < sim->getJunctionsCount(); i++) {
 		CJunction *ju = sim->getJunction(i);
 		if (ju->isCurrentSource() == false) {
@@ -16,13 +93,25 @@ void CSolver::solveVoltages() {
 	for (int i = 0; i < sim->getJunctionsCount(); i++) {
 		CJunction *ju = sim->getJunction(i);
 		if (ju->hasName("VDD")) {
-			floodJunctions(ju, 3.3f, 100.0f);
+			floodGroup(junctionGroups[i], 3.3f, 100.0f, 0);
 		}
 		else if (ju->hasName("GND")) {
-			floodJunctions(ju, 0, 100.0f);
+			floodGroup(junctionGroups[i], 0, 100.0f, 0);
 		}
 		else if (ju->isCurrentSource()) {
-			floodJunctions(ju, ju->getVoltage(), ju->getDuty());
+			floodGroup(junctionGroups[i], ju->getVoltage(), ju->getDuty(), 0);
+		}
+	}
+	for (int i = 0; i < groups.size(); i++) {
+		solverGroup_t &g = groups[i];
+		if (g.bVisited == false)
+			continue;
+		for (int j = 0; j < g.members.size(); j++) {
+			CJunction *ju = g.members[j];
+			ju->setVisitCount(1);
+			ju->setVoltage(g.voltage);
+			ju->setDuty(g.duty);
+			ju->setDepth(g.depth);
 		}
 	}
 	for (int i = 0; i < sim->getObjectsCount(); i++) {
@@ -34,59 +123,29 @@ void CSolver::solveVoltages() {
 	}
 }
 bool CSolver::hasPath(class CJunction *a, class CJunction *b) {
-	TArray<CJunction*> toVisit;
-	TArray<CJunction*> checked;
-	toVisit.push_back(a);
-	while (toVisit.size()) {
-		CJunction *j = toVisit.pop();
-		checked.push_back(j);
-		for (int i = 0; i < j->getEdgesCount(); i++) {
-			CJunction *other = j->getEdge(i)->getOther(j);
-			if (other == 0)
-				continue;
-			if (checked.contains(other))
-				continue;
-			if (other == b)
-				return true;
-			toVisit.push_back(other);
-		}
-		for (int i = 0; i < j->getLinksCount(); i++) {
-			CJunction *other = j->getLink(i);
-			if (other == 0)
-				continue;
-			if (checked.contains(other))
-				continue;
-			if (other == b)
-				return true;
-			toVisit.push_back(other);
-		}
+	if (builtRevision != CJunction::getTopologyRevision()) {
+		rebuildGroups();
 	}
-	return false;
+	int ia = Solver_IndexOf(sim, a);
+	int ib = Solver_IndexOf(sim, b);
+	if (ia < 0 || ib < 0)
+		return false;
+	return junctionGroups[ia] == junctionGroups[ib];
 }
 // Idea: count steps to VDD/GND and use it to support multiple objects on line?
-void CSolver::floodJunctions(CJunction *ju, float voltage, float duty, int depth) {
-	if (ju == 0)
+void CSolver::floodGroup(int gi, float voltage, float duty, int depth) {
+	solverGroup_t &g = groups[gi];
+	if (g.bVisited)
 		return;
-	if (ju->getVisitCount() != 0)
-		return;
-	ju->setVisitCount(1);
-	ju->setVoltage(voltage);
-	ju->setDuty(duty);
-	ju->setDepth(depth);
-	for (int i = 0; i < ju->getLinksCount(); i++) {
-		CJunction *other = ju->getLink(i);
-		floodJunctions(other, voltage, duty, depth);
-	}
-	for (int i = 0; i < ju->getEdgesCount(); i++) {
-		CEdge *e = ju->getEdge(i);
-		CJunction *o = e->getOther(ju);
-		floodJunctions(o, voltage, duty, depth);
-	}
-	CControllerBase *cntr = ju->findOwnerController_r();
-	if (cntr != 0) {
-		CJunction *other = cntr->findOtherJunctionIfPassable(ju);
-		if (other) {
-			floodJunctions(other, voltage, duty, depth+1);
+	g.bVisited = true;
+	g.voltage = voltage;
+	g.duty = duty;
+	g.depth = depth;
+	for (int i = 0; i < g.ports.size(); i++) {
+		CJunction *other = g.portControllers[i]->findOtherJunctionIfPassable(g.ports[i]);
+		int oi = Solver_IndexOf(sim, other);
+		if (oi >= 0) {
+			floodGroup(junctionGroups[oi], voltage, duty, depth + 1);
 		}
 	}
 }
@@ -3,16 +3,46 @@
 
 #include "sim_local.h"
 
+// Junctions joined by wires and links form a group with same voltage.
+// Groups are kept in union-find and rebuilt only when wiring changes,
+// so each frame only floods groups through passable controllers.
+struct solverGroup_t {
+	// junctions of group, first in order of simulation list
+	TArray<class CJunction*> members;
+	// members owned by controller, which may pass voltage further
+	TArray<class CJunction*> ports;
+	TArray<class CControllerBase*> portControllers;
+	float voltage;
+	float duty;
+	int depth;
+	bool bVisited;
+};
+
 class CSolver {
 	class CSimulation *sim;
+	// union-find parent per junction index
+	TArray<int> parents;
+	TArray<int> junctionGroups;
+	TArray<solverGroup_t> groups;
+	int builtRevision;
 
-	void floodJunctions(class CJunction *ju, float voltage, float duty, int depth = 0);
+	int findRoot(int i);
+	void unite(int a, int b);
+	void rebuildGroups();
+	void floodGroup(int g, float voltage, float duty, int depth);
 public:
+	CSolver() {
+		sim = 0;
+		builtRevision = -1;
+	}
 	void setSimulation(class CSimulation *p) {
+		if (sim != p) {
+			builtRevision = -1;
+		}
 		sim = p;
 	}
 	void solveVoltages();
 	bool hasPath(class CJunction *a, class CJunction *b);
 };
 
-#endif
\ No newline at end of file
+#endif
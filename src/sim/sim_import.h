@@ -13,6 +13,18 @@ extern "C" {
 	void SIM_SetVoltageOnADCPin(int index, float v);
 	void SIM_SetIntegerValueADCPin(int index, int v);
 	int SIM_GetPWMValue(int index);
+	// time of last HAL_PIN_PWM_FadeTo of pin, simulated fade ends at once
+	int SIM_GetPWMFadeMS(int index);
+	// last duty of pin in 0-65535, see HAL_PIN_PWM_UpdateDuty
+	unsigned short SIM_GetPWMDuty(int index);
+	// count of HAL_PIN_WriteMasked calls
+	int SIM_GetMaskedWriteCount();
+	// count of HAL_PIN_PWM_UpdateGroup calls
+	int SIM_GetPWMGroupUpdateCount();
+	// count of HAL_PIN_Setup_Input*/Output calls of pin
+	int SIM_GetPinSetupCount(int index);
+	// HAL_PIN_Setup_OpenDrain succeeds, off by default
+	void SIM_SetOpenDrainSupported(bool b);
 	// flash control simulation
 	void SIM_SetupFlashFileReading(const char *flashPath);
 	void SIM_SaveFlashData(const char *flashPath);
@@ -15,6 +15,7 @@
 //#include "ir/ir_local.h"
 
 #include "driver/drv_deviceclock.h"
+#include "driver/drv_wifiRoam.h"
 
 // Commands register, execution API and cmd tokenizer
 #include "cmnds/cmd_public.h"
@@ -28,6 +29,8 @@
 #include "quicktick.h"
 #include "new_cfg.h"
 #include "logging/logging.h"
+#include "logging/ioTrace.h"
+#include "logging/cpuProfiler.h"
 #include "httpserver/http_tcp_server.h"
 #include "httpserver/rest_interface.h"
 #include "mqtt/new_mqtt.h"
@@ -41,6 +44,7 @@
 #include "driver/drv_ntp.h"
 #include "driver/drv_ssdp.h"
 #include "driver/drv_uart.h"
+#include "driver/drv_freeze.h"
 
 #if PLATFORM_BEKEN
 #include <mcu_ps.h>
@@ -71,6 +75,8 @@ int g_secondsElapsed = 0;
 int g_openAP = 0;
 // connect to wifi after this number of seconds
 static int g_connectToWiFi = 0;
+// battery device woke only to take a reading, see Main_HoldWiFi
+static bool g_bWiFiHeld = false;
 // reset after this number of seconds
 static int g_reset = 0;
 // is connected to WiFi?
@@ -98,6 +104,16 @@ static char g_currentIPString[32] = { 0 };
 static HALWifiStatus_t g_newWiFiStatus = WIFI_UNDEFINED;
 static HALWifiStatus_t g_prevWiFiStatus = WIFI_UNDEFINED;
 static int g_noMQTTTime = 0;
+// fast connect reuses last DHCP lease until connecting with it fails
+static bool g_bWiFiLeaseInUse = false;
+static bool g_bWiFiLeaseFailed = false;
+// set from WiFi callback, lease is stored from main loop
+static bool g_bWiFiLeaseCheck = false;
+static int g_wifiConnectStartMs = 0;
+static bool g_bWiFiConnectPending = false;
+static int g_wifiFailedConnects = 0;
+#define WIFI_FAILS_BEFORE_SCAN		2
+static bool g_bWiFiWasUp = false;
 
 uint8_t g_StartupDelayOver = 0;
 
@@ -153,6 +169,19 @@ void OTA_SetTotalBytes(int value)
 	total_bytes = value;
 }
 
+// off by default, serving firmware is opt-in
+static int g_otaRelay = 0;
+
+void OTA_SetRelayEnabled(int bEnabled)
+{
+	g_otaRelay = bEnabled;
+}
+
+int OTA_IsRelayEnabled()
+{
+	return g_otaRelay;
+}
+
 
 
 
@@ -261,14 +290,53 @@ int LWIP_GetActiveSockets() {
 	|| PLATFORM_ESPIDF || PLATFORM_TR6260 || PLATFORM_REALTEK || PLATFORM_ECR6600 \
 	|| PLATFORM_XRADIO || PLATFORM_ESP8266
 
+#if PLATFORM_ESPIDF
+#define OBK_TASK_CREATE(fn, name, depth, arg, prio, handle) \
+	xTaskCreatePinnedToCore(fn, name, depth, arg, prio, handle, HAL_GetThreadCore(name))
+#else
+#define OBK_TASK_CREATE		xTaskCreate
+#endif
+
+#if ENABLE_SYSPERF
+#if PLATFORM_ESPIDF && !CONFIG_FREERTOS_UNICORE
+// New thread may start on other core at once, which suspending scheduler
+// of this core doesn't stop, so thread that exits waits for this instead.
+static SemaphoreHandle_t g_threadRegMutex = 0;
+
+static void THREAD_REG_LOCK() {
+	if (g_threadRegMutex == 0) {
+		g_threadRegMutex = xSemaphoreCreateMutex();
+	}
+	xSemaphoreTake(g_threadRegMutex, portMAX_DELAY);
+}
+#define THREAD_REG_UNLOCK()		xSemaphoreGive(g_threadRegMutex)
+#else
+#define THREAD_REG_LOCK()		vTaskSuspendAll()
+#define THREAD_REG_UNLOCK()		xTaskResumeAll()
+#endif
+#endif
+
 OSStatus rtos_create_thread(beken_thread_t* thread,
 	uint8_t priority, const char* name,
 	beken_thread_function_t function,
 	uint32_t stack_size, beken_thread_arg_t arg) {
 	OSStatus err = kNoErr;
+#if ENABLE_SYSPERF
+	TaskHandle_t handle = 0;
 
-
-	err = xTaskCreate(function, name, stack_size / sizeof(StackType_t), arg, priority, thread);
+	// new thread must not run (and exit) before it is registered
+	THREAD_REG_LOCK();
+	err = OBK_TASK_CREATE(function, name, stack_size / sizeof(StackType_t), arg, priority, &handle);
+	if (err == pdPASS) {
+		SYSPERF_RegisterThread(handle, name, stack_size);
+	}
+	THREAD_REG_UNLOCK();
+	if (thread) {
+		*thread = handle;
+	}
+#else
+	err = OBK_TASK_CREATE(function, name, stack_size / sizeof(StackType_t), arg, priority, thread);
+#endif
 	/*
 	 BaseType_t xTaskCreate(
 								  TaskFunction_t pvTaskCode,
@@ -293,6 +361,13 @@ OSStatus rtos_create_thread(beken_thread_t* thread,
 }
 
 OSStatus rtos_delete_thread(beken_thread_t* thread) {
+#if ENABLE_SYSPERF && PLATFORM_ESPIDF && !CONFIG_FREERTOS_UNICORE
+	THREAD_REG_LOCK();
+	SYSPERF_UnregisterThread(thread == NULL ? xTaskGetCurrentTaskHandle() : *thread);
+	THREAD_REG_UNLOCK();
+#elif ENABLE_SYSPERF
+	SYSPERF_UnregisterThread(thread == NULL ? xTaskGetCurrentTaskHandle() : *thread);
+#endif
 	if(thread == NULL) vTaskDelete(NULL);
 	else vTaskDelete(*thread);
 	return kNoErr;
@@ -491,6 +566,60 @@ const char* CFG_GetWiFiPassX() {
 #endif
 }
 
+// Connects that used cached AP or lease did not get through, so next one
+// scans and asks DHCP. First connect often fails anyway, so it takes
+// two in a row. Enhanced fast connect data is saved again by HAL after
+// the next good connect.
+static void Main_OnWiFiConnectFailed() {
+	if (g_bHasWiFiConnected) {
+		return;
+	}
+	g_wifiFailedConnects++;
+	if (g_wifiFailedConnects < WIFI_FAILS_BEFORE_SCAN) {
+		return;
+	}
+	if (g_bWiFiLeaseInUse) {
+		g_bWiFiLeaseFailed = true;
+		g_bWiFiLeaseInUse = false;
+	}
+	if (CFG_HasFlag(OBK_FLAG_WIFI_ENHANCED_FAST_CONNECT)) {
+		HAL_DisableEnhancedFastConnect();
+	}
+}
+// lease from DHCP is kept in config, so fast connect after reboot can skip DHCP
+static void Main_SaveWiFiLease() {
+	obkStaticIP_t lease;
+
+	g_bWiFiLeaseCheck = false;
+	if (g_cfg.staticIP.localIPAddr[0] != 0 || g_bWiFiLeaseInUse || !Main_HasFastConnect()) {
+		return;
+	}
+	memset(&lease, 0, sizeof(lease));
+	if (str_to_ip(HAL_GetMyIPString(), lease.localIPAddr) != 4 || lease.localIPAddr[0] == 0
+		|| str_to_ip(HAL_GetMyMaskString(), lease.netMask) != 4
+		|| str_to_ip(HAL_GetMyGatewayString(), lease.gatewayIPAddr) != 4) {
+		return;
+	}
+	if (str_to_ip(HAL_GetMyDNSString(), lease.dnsServerIpAddr) != 4) {
+		// not every platform tells DNS, gateway usually is one
+		memcpy(lease.dnsServerIpAddr, lease.gatewayIPAddr, 4);
+	}
+	if (memcmp(&lease, &g_cfg.dhcpLease, sizeof(lease))) {
+		ADDLOGF_INFO("Saving DHCP lease %s for fast connect", HAL_GetMyIPString());
+		g_cfg.dhcpLease = lease;
+		g_cfg_pendingChanges++;
+	}
+}
+static obkStaticIP_t* Main_GetWiFiConnectIP() {
+	g_bWiFiLeaseInUse = false;
+	if (g_cfg.staticIP.localIPAddr[0] == 0 && g_cfg.dhcpLease.localIPAddr[0] != 0
+		&& !g_bWiFiLeaseFailed && Main_HasFastConnect()) {
+		g_bWiFiLeaseInUse = true;
+		return &g_cfg.dhcpLease;
+	}
+	return &g_cfg.staticIP;
+}
+
 void Main_OnWiFiStatusChange(int code)
 {
 	// careful what you do in here.
@@ -503,10 +632,12 @@ void Main_OnWiFiStatusChange(int code)
 		ADDLOGF_INFO("%s - WIFI_STA_CONNECTING - %i\r\n", __func__, code);
 		break;
 	case WIFI_STA_DISCONNECTED:
+		Main_OnWiFiConnectFailed();
 		// try to connect again in few seconds
 		// if we are already disconnected, why must we call disconnect again?
 #if PLATFORM_BEKEN
-		if (g_bHasWiFiConnected != 0)
+		// stopping station would also abort join of new AP
+		if (g_bHasWiFiConnected != 0 && !WiFiRoam_IsRoaming())
 		{
 			HAL_DisconnectFromWifi();
 		}
@@ -524,6 +655,7 @@ void Main_OnWiFiStatusChange(int code)
 		ADDLOGF_INFO("%s - WIFI_STA_DISCONNECTED - %i\r\n", __func__, code);
 		break;
 	case WIFI_STA_AUTH_FAILED:
+		Main_OnWiFiConnectFailed();
 		// try to connect again in few seconds
 		// for me first auth will often fail, so retry more aggressively during startup
 		// the maximum of 6 tries during first 30 seconds should be acceptable
@@ -541,6 +673,17 @@ void Main_OnWiFiStatusChange(int code)
 		if (!g_bHasWiFiConnected) FV_UpdateStartupSSIDIfChanged_StoredValue(g_SSIDactual);	//update ony on first connect
 #endif		
 
+		if (g_bWiFiConnectPending) {
+			g_bWiFiConnectPending = false;
+			ADDLOGF_INFO("WiFi up %i ms after connect started%s", (int)(xTaskGetTickCount() * portTICK_PERIOD_MS) - g_wifiConnectStartMs,
+				g_bWiFiLeaseInUse ? ", with cached lease" : "");
+		}
+		if (!g_bWiFiWasUp) {
+			g_bWiFiWasUp = true;
+			Main_LogBootPhase("wifi up");
+		}
+		g_bWiFiLeaseCheck = true;
+		g_wifiFailedConnects = 0;
 		g_bHasWiFiConnected = 1;
 		ADDLOGF_INFO("%s - WIFI_STA_CONNECTED - %i\r\n", __func__, code);
 
@@ -674,6 +817,7 @@ void Main_ScheduleHomeAssistantDiscovery(int seconds) {
 
 void Main_ConnectToWiFiNow() {
 	const char* wifi_ssid, * wifi_pass;
+	obkStaticIP_t* ip;
 
 	g_bOpenAccessPointMode = 0;
 	CheckForSSID12_Switch();
@@ -685,18 +829,37 @@ void Main_ConnectToWiFiNow() {
 	HAL_WiFi_SetupStatusCallback(Main_OnWiFiStatusChange);
 	ADDLOGF_INFO("Registered for wifi changes\r\n");
 	ADDLOGF_INFO("Connecting to SSID [%s]\r\n", wifi_ssid);
+	ip = Main_GetWiFiConnectIP();
+	if (g_bWiFiLeaseInUse) {
+		ADDLOGF_INFO("Using cached DHCP lease %i.%i.%i.%i", ip->localIPAddr[0], ip->localIPAddr[1], ip->localIPAddr[2], ip->localIPAddr[3]);
+	}
+	g_wifiConnectStartMs = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	g_bWiFiConnectPending = true;
 	if(CFG_HasFlag(OBK_FLAG_WIFI_ENHANCED_FAST_CONNECT))
 	{
-		HAL_FastConnectToWiFi(wifi_ssid, wifi_pass, &g_cfg.staticIP);
+		HAL_FastConnectToWiFi(wifi_ssid, wifi_pass, ip);
 	}
 	else
 	{
-		HAL_ConnectToWiFi(wifi_ssid, wifi_pass, &g_cfg.staticIP);
+		HAL_ConnectToWiFi(wifi_ssid, wifi_pass, ip);
 	}
 	// don't set g_connectToWiFi = 0; here!
 	// this would overwrite any changes, e.g. from Main_OnWiFiStatusChange !
 	// so don't do this here, but e.g. set in Main_OnWiFiStatusChange if connected!!!
 }
+
+// Drivers started before WiFi (e.g. DoorSensor) can keep radio off for
+// a wake that only records a reading. Releasing it connects right away.
+void Main_HoldWiFi(bool bHold) {
+	if (g_bWiFiHeld && !bHold && g_bHasWiFiConnected == 0) {
+		g_connectToWiFi = 1;
+	}
+	g_bWiFiHeld = bHold;
+}
+
+bool Main_IsWiFiHeld() {
+	return g_bWiFiHeld;
+}
 bool Main_HasFastConnect() {
 	if(g_bootFailures > 2)
 	{
@@ -734,6 +897,7 @@ void Main_OnEverySecond()
 	const char* safe;
 	int i;
 
+	WDT_Heartbeat(WDT_TASK_MAIN);
 #ifdef WINDOWS
 	g_bHasWiFiConnected = 1;
 #endif
@@ -782,6 +946,9 @@ void Main_OnEverySecond()
 		}
 	}
 #endif
+	if (g_bWiFiLeaseCheck) {
+		Main_SaveWiFiLease();
+	}
 	if (g_newWiFiStatus != g_prevWiFiStatus) {
 		g_prevWiFiStatus = g_newWiFiStatus;
 		// Argument type here is HALWifiStatus_t enumeration
@@ -816,6 +983,7 @@ void Main_OnEverySecond()
 	if (OTA_GetProgress() == -1)
 	{
 		CFG_Save_IfThereArePendingChanges();
+		CHANNEL_RunSavesEverySecond();
 	}
 
 	// On Beken, do reboot if we ran into heap size problem
@@ -883,7 +1051,7 @@ void Main_OnEverySecond()
 			{
 				int value;
 
-				value = HAL_ADC_Read(i);
+				value = ADCSampler_Read(i);
 
 				//	ADDLOGF_INFO("ADC %i=%i\r\n", i,value);
 				CHANNEL_Set(g_cfg.pins.channels[i], value, CHANNEL_SET_FLAG_SILENT);
@@ -906,6 +1074,9 @@ void Main_OnEverySecond()
 			}
 		}
 	}
+#if ENABLE_SYSPERF
+	SYSPERF_OnEverySecond();
+#endif
 #if (WINDOWS || PLATFORM_TXW81X || PLATFORM_RDA5981)
 	g_secondsElapsed++;
 #elif defined(PLATFORM_ESPIDF)
@@ -1032,7 +1203,7 @@ void Main_OnEverySecond()
 		}
 
 	}
-	if (g_connectToWiFi)
+	if (g_connectToWiFi && !g_bWiFiHeld)
 	{
 		g_connectToWiFi--;
 		if (0 == g_connectToWiFi && g_bHasWiFiConnected == 0)
@@ -1059,7 +1230,7 @@ void Main_OnEverySecond()
 		g_reset--;
 		if (!g_reset) {
 			// ensure any config changes are saved before reboot.
-			CFG_Save_IfThereArePendingChanges();
+			CFG_Save_Compact();
 #if ENABLE_BL_SHARED
 			if (DRV_IsMeasuringPower())
 			{
@@ -1069,6 +1240,7 @@ void Main_OnEverySecond()
 #if ENABLE_DRIVER_HLW8112SPI
 			HLW8112_Save_Statistics();
 #endif 
+			CHANNEL_FlushSaves();
 			ADDLOGF_INFO("Going to call HAL_RebootModule\r\n");
 			HAL_RebootModule();
 		}
@@ -1085,7 +1257,10 @@ void Main_OnEverySecond()
 		}
 	}
 #endif
-	HAL_Run_WDT();
+	// with a stuck task hardware watchdog resets device
+	if (WDT_IsHealthy()) {
+		HAL_Run_WDT();
+	}
 	// force it to sleep...  we MUST have some idle task processing
 	// else task memory doesn't get freed
 	rtos_delay_milliseconds(1);
@@ -1109,23 +1284,414 @@ int g_bWantPinDeepSleep;
 int g_pinDeepSleepWakeUp = 0;
 unsigned int g_deltaTimeMS;
 
+#if ENABLE_QUICKTICK_SLEEP
+// Each part reports time to its next work (-1 for none), QuickTick
+// body is skipped until the earliest one, or until someone wakes it.
+// Parts that can't tell it (drivers, polled pins) ask for every tick.
+#define QUICK_TMR_IDLE_MAX		1000
+
+static volatile int g_quickTickWake = 1;
+static int g_quickTickSleepMS = 0;
+#if PLATFORM_ESPIDF
+static TaskHandle_t g_quickTickThread = 0;
+#else
+static bool g_quickTickRunning = false;
+#endif
+
+static bool QuickTick_IsRunningNow() {
+#if PLATFORM_ESPIDF
+	return xTaskGetCurrentTaskHandle() == g_quickTickThread;
+#else
+	return g_quickTickRunning;
+#endif
+}
+void QuickTick_Wake() {
+	// sleep is computed at the end of QuickTick, it sees own work
+	if (QuickTick_IsRunningNow()) {
+		return;
+	}
+	g_quickTickWake = 1;
+#if PLATFORM_ESPIDF
+	if (g_quickTickThread) {
+		xTaskNotifyGive(g_quickTickThread);
+	}
+#endif
+}
+int QuickTick_GetTimeSinceRunMS() {
+	unsigned int now;
+
+	if (QuickTick_IsRunningNow()) {
+		return 0;
+	}
+#if PLATFORM_ESPIDF
+	now = esp_timer_get_time() / 1000;
+#else
+	now = rtos_get_time();
+#endif
+	return (int)(now - g_last_time);
+}
+void QuickTick_WakeFromISR() {
+	g_quickTickWake = 1;
+#if PLATFORM_ESPIDF
+	if (g_quickTickThread) {
+		vTaskNotifyGiveFromISR(g_quickTickThread, NULL);
+	}
+#endif
+}
+static void QuickTick_Earliest(int* next, int ms) {
+	if (ms >= 0 && ms < *next) {
+		*next = ms;
+	}
+}
+static int QuickTick_ComputeSleepMS() {
+	int next = QUICK_TMR_IDLE_MAX;
+
+	QuickTick_Earliest(&next, PIN_GetTimeToNextWakeMS());
+#if ENABLE_OBK_SCRIPTING
+	// covers Berry threads too
+	QuickTick_Earliest(&next, SVM_GetTimeToNextWakeMS());
+#elif ENABLE_OBK_BERRY
+	extern int Berry_GetTimeToNextWakeMS();
+	QuickTick_Earliest(&next, Berry_GetTimeToNextWakeMS());
+#endif
+	QuickTick_Earliest(&next, RepeatingEvents_GetTimeToNextWakeMS());
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	QuickTick_Earliest(&next, DRV_GetTimeToNextWakeMS());
+#endif
+	QuickTick_Earliest(&next, CMD_GetTimeToNextWakeMS());
+#if ENABLE_MQTT
+	QuickTick_Earliest(&next, MQTT_GetTimeToNextWakeMS());
+#endif
+#if ENABLE_LED_BASIC
+	QuickTick_Earliest(&next, LED_GetTimeToNextWakeMS());
+#endif
+	// WiFi LED blinks until connected
+	if (Main_IsOpenAccessPointMode()) {
+		QuickTick_Earliest(&next, WIFI_LED_FAST_BLINK_DURATION + 1 - g_wifiLedToggleTime);
+	}
+	else if (Main_IsConnectedToWiFi() == false) {
+		QuickTick_Earliest(&next, WIFI_LED_SLOW_BLINK_DURATION + 1 - g_wifiLedToggleTime);
+	}
+#ifdef WINDOWS
+	extern int g_bDoingUnitTestsNow;
+	// simulated TuyaMCU feeds bytes on every tick
+	if (g_bDoingUnitTestsNow == 0) {
+		next = 0;
+	}
+#endif
+	return next;
+}
+int QuickTick_GetSleepMS() {
+	if (g_quickTickWake || g_quickTickSleepMS < QUICK_TMR_DURATION) {
+		return QUICK_TMR_DURATION;
+	}
+	return g_quickTickSleepMS;
+}
+#else
+void QuickTick_Wake() {
+}
+void QuickTick_WakeFromISR() {
+}
+int QuickTick_GetTimeSinceRunMS() {
+	return 0;
+}
+int QuickTick_GetSleepMS() {
+	return QUICK_TMR_DURATION;
+}
+#endif
+
+unsigned int SYSPERF_GetTimeUs() {
+#if PLATFORM_ESPIDF
+	return (unsigned int)esp_timer_get_time();
+#else
+	return (unsigned int)xTaskGetTickCount() * portTICK_PERIOD_MS * 1000;
+#endif
+}
+uint32_t SYSPERF_GetTimeMs() {
+#if defined(PLATFORM_BEKEN) || defined(WINDOWS)
+	return (uint32_t)rtos_get_time();
+#elif PLATFORM_ESPIDF
+	return (uint32_t)(esp_timer_get_time() / 1000);
+#else
+	return (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+#endif
+}
+
+#if ENABLE_SYSPERF
+static const char* g_quickTickStageNames[QT_STAGE_COUNT] = {
+	"total", "pins", "scripts", "repeatingEvents", "drivers", "commands", "mqtt", "led"
+};
+static perfStat_t g_quickTickStages[QT_STAGE_COUNT];
+static unsigned int g_quickTickOverruns = 0;
+static perfThread_t g_perfThreads[SYSPERF_MAX_THREADS];
+static void* g_perfThreadHandles[SYSPERF_MAX_THREADS];
+
+void PerfStat_Add(perfStat_t* st, unsigned int us) {
+	st->calls++;
+	st->totalUs += us;
+	if (us > st->maxUs) {
+		st->maxUs = us;
+	}
+}
+const char* QuickTick_GetStageName(int stage) {
+	return g_quickTickStageNames[stage];
+}
+const perfStat_t* QuickTick_GetStageStats(int stage) {
+	return &g_quickTickStages[stage];
+}
+unsigned int QuickTick_GetOverruns() {
+	return g_quickTickOverruns;
+}
+void QuickTick_ResetStats() {
+	memset(g_quickTickStages, 0, sizeof(g_quickTickStages));
+	g_quickTickOverruns = 0;
+#ifndef OBK_DISABLE_ALL_DRIVERS
+	DRV_ResetQuickTickStats();
+#endif
+}
+// returns end time, so next stage starts there
+static unsigned int QuickTick_EndStage(int stage, unsigned int start) {
+	unsigned int now = SYSPERF_GetTimeUs();
+
+	PerfStat_Add(&g_quickTickStages[stage], now - start);
+	return now;
+}
+#define QT_PERF_STAGE(stage) perfAt = QuickTick_EndStage(stage, perfAt)
+
+static int SYSPERF_GetFreeStack(void* handle) {
+	// Beken threads come from SDK, so only platforms that register have it
+#if WINDOWS || PLATFORM_BEKEN || PLATFORM_TXW81X || PLATFORM_RDA5981
+	return -1;
+#else
+	return uxTaskGetStackHighWaterMark((TaskHandle_t)handle) * sizeof(StackType_t);
+#endif
+}
+static void SYSPERF_Measure(int i) {
+	int freeBytes = SYSPERF_GetFreeStack(g_perfThreadHandles[i]);
+
+	if (freeBytes >= 0 && (g_perfThreads[i].minFreeBytes < 0 || freeBytes < g_perfThreads[i].minFreeBytes)) {
+		g_perfThreads[i].minFreeBytes = freeBytes;
+	}
+}
+// finished thread keeps its slot, next one of that name continues its record
+void SYSPERF_RegisterThread(void* handle, const char* name, int stackBytes) {
+	int i, slot = -1;
+
+	if (handle == 0) {
+		return;
+	}
+	for (i = 0; i < SYSPERF_MAX_THREADS; i++) {
+		if (g_perfThreads[i].bAlive == false && !strncmp(g_perfThreads[i].name, name, sizeof(g_perfThreads[i].name) - 1)) {
+			slot = i;
+			break;
+		}
+		if (slot < 0 && g_perfThreads[i].name[0] == 0) {
+			slot = i;
+		}
+	}
+	if (slot < 0) {
+		return;
+	}
+	if (g_perfThreads[slot].name[0] == 0) {
+		strcpy_safe(g_perfThreads[slot].name, name, sizeof(g_perfThreads[slot].name));
+		g_perfThreads[slot].minFreeBytes = -1;
+	}
+	g_perfThreads[slot].stackBytes = stackBytes;
+	g_perfThreads[slot].bAlive = true;
+	g_perfThreadHandles[slot] = handle;
+}
+// called before thread is deleted, handle is not valid after that
+void SYSPERF_UnregisterThread(void* handle) {
+	int i;
+
+	for (i = 0; i < SYSPERF_MAX_THREADS; i++) {
+		if (g_perfThreads[i].bAlive && g_perfThreadHandles[i] == handle) {
+			SYSPERF_Measure(i);
+			g_perfThreads[i].bAlive = false;
+			g_perfThreadHandles[i] = 0;
+			return;
+		}
+	}
+}
+int SYSPERF_GetThreads(perfThread_t* out, int maxCount) {
+	int i, count = 0;
+
+	for (i = 0; i < SYSPERF_MAX_THREADS && count < maxCount; i++) {
+		if (g_perfThreads[i].name[0] == 0) {
+			continue;
+		}
+		if (g_perfThreads[i].bAlive) {
+			SYSPERF_Measure(i);
+		}
+		out[count++] = g_perfThreads[i];
+	}
+	return count;
+}
+
+// CPU share of tasks needs FreeRTOS run time counters, which SDK has only
+// with configGENERATE_RUN_TIME_STATS and configUSE_TRACE_FACILITY. They are
+// read at end of every window and share is of the time between two reads.
+#if !WINDOWS && defined(configGENERATE_RUN_TIME_STATS) && configGENERATE_RUN_TIME_STATS \
+	&& defined(configUSE_TRACE_FACILITY) && configUSE_TRACE_FACILITY
+#define SYSPERF_RUN_TIME_STATS 1
+#endif
+// ESP-IDF tells core task is pinned to
+#if PLATFORM_ESPIDF && defined(configTASKLIST_INCLUDE_COREID) && configTASKLIST_INCLUDE_COREID
+#define SYSPERF_TASK_CORE 1
+#endif
+static perfTask_t g_perfTasks[SYSPERF_MAX_TASKS];
+static int g_perfNumTasks = 0;
+static int g_perfCoreLoad[SYSPERF_MAX_CORES] = { -1, -1 };
+static int g_perfWindow = SYSPERF_DEFAULT_WINDOW;
+static int g_perfWindowAge = 0;
+#if SYSPERF_RUN_TIME_STATS
+static unsigned int g_perfTaskNumbers[SYSPERF_MAX_TASKS];
+static unsigned int g_perfTaskRunTimes[SYSPERF_MAX_TASKS];
+static unsigned int g_perfTotalRunTime = 0;
+
+// each core has own idle task, named IDLE0, IDLE1 on ESP-IDF
+static int SYSPERF_GetIdleCore(const TaskStatus_t* st) {
+	if (strncmp(st->pcTaskName, "IDLE", 4)) {
+		return -1;
+	}
+#if SYSPERF_TASK_CORE
+	if (st->xCoreID >= 0 && st->xCoreID < SYSPERF_MAX_CORES) {
+		return st->xCoreID;
+	}
+#endif
+	if (st->pcTaskName[4] >= '0' && st->pcTaskName[4] < '0' + SYSPERF_MAX_CORES) {
+		return st->pcTaskName[4] - '0';
+	}
+	return 0;
+}
+static void SYSPERF_SampleTasks() {
+	unsigned int numbers[SYSPERF_MAX_TASKS];
+	unsigned int runTimes[SYSPERF_MAX_TASKS];
+	unsigned int run, total, prev;
+#ifdef configRUN_TIME_COUNTER_TYPE
+	configRUN_TIME_COUNTER_TYPE rtosTotal;
+#else
+	uint32_t rtosTotal;
+#endif
+	TaskStatus_t* st;
+	UBaseType_t count;
+	int i, j, core, n = 0;
+
+	count = uxTaskGetNumberOfTasks();
+	st = (TaskStatus_t*)os_malloc(count * sizeof(TaskStatus_t));
+	if (st == 0) {
+		return;
+	}
+	count = uxTaskGetSystemState(st, count, &rtosTotal);
+	total = (unsigned int)rtosTotal - g_perfTotalRunTime;
+	for (i = 0; i < SYSPERF_MAX_CORES; i++) {
+		g_perfCoreLoad[i] = -1;
+	}
+	for (i = 0; i < (int)count && n < SYSPERF_MAX_TASKS; i++) {
+		run = (unsigned int)st[i].ulRunTimeCounter;
+		// task started in window is counted from its start
+		prev = 0;
+		for (j = 0; j < g_perfNumTasks; j++) {
+			if (g_perfTaskNumbers[j] == st[i].xTaskNumber) {
+				prev = g_perfTaskRunTimes[j];
+				break;
+			}
+		}
+		strcpy_safe(g_perfTasks[n].name, st[i].pcTaskName, sizeof(g_perfTasks[n].name));
+		g_perfTasks[n].priority = st[i].uxCurrentPriority;
+		g_perfTasks[n].minFreeBytes = st[i].usStackHighWaterMark * sizeof(StackType_t);
+		// first read gives share since boot
+		g_perfTasks[n].cpuPermille = total ? (int)((unsigned long long)(run - prev) * 1000 / total) : -1;
+#if SYSPERF_TASK_CORE
+		g_perfTasks[n].core = (st[i].xCoreID >= 0 && st[i].xCoreID < SYSPERF_MAX_CORES) ? (int)st[i].xCoreID : -1;
+#else
+		g_perfTasks[n].core = -1;
+#endif
+		core = SYSPERF_GetIdleCore(&st[i]);
+		if (core >= 0 && g_perfTasks[n].cpuPermille >= 0) {
+			g_perfCoreLoad[core] = 1000 - g_perfTasks[n].cpuPermille;
+			if (g_perfCoreLoad[core] < 0) {
+				g_perfCoreLoad[core] = 0;
+			}
+		}
+		numbers[n] = st[i].xTaskNumber;
+		runTimes[n] = run;
+		n++;
+	}
+	os_free(st);
+	memcpy(g_perfTaskNumbers, numbers, sizeof(numbers));
+	memcpy(g_perfTaskRunTimes, runTimes, sizeof(runTimes));
+	g_perfTotalRunTime = (unsigned int)rtosTotal;
+	g_perfNumTasks = n;
+}
+#else
+static void SYSPERF_SampleTasks() {
+	int i, n = 0;
+
+	for (i = 0; i < SYSPERF_MAX_THREADS && n < SYSPERF_MAX_TASKS; i++) {
+		if (g_perfThreads[i].bAlive == false) {
+			continue;
+		}
+		SYSPERF_Measure(i);
+		strcpy_safe(g_perfTasks[n].name, g_perfThreads[i].name, sizeof(g_perfTasks[n].name));
+#if WINDOWS
+		g_perfTasks[n].priority = -1;
+#else
+		g_perfTasks[n].priority = uxTaskPriorityGet((TaskHandle_t)g_perfThreadHandles[i]);
+#endif
+		g_perfTasks[n].minFreeBytes = g_perfThreads[i].minFreeBytes;
+		g_perfTasks[n].cpuPermille = -1;
+		g_perfTasks[n].core = -1;
+		n++;
+	}
+	g_perfNumTasks = n;
+}
+#endif
+void SYSPERF_SetWindow(int seconds) {
+	g_perfWindow = seconds;
+	g_perfWindowAge = 0;
+}
+int SYSPERF_GetWindow() {
+	return g_perfWindow;
+}
+void SYSPERF_OnEverySecond() {
+	g_perfWindowAge++;
+	// list is there from first second, share from second window on
+	if (g_perfWindowAge >= g_perfWindow || g_perfNumTasks == 0) {
+		g_perfWindowAge = 0;
+		SYSPERF_SampleTasks();
+	}
+}
+int SYSPERF_GetCoreLoad(int core) {
+	if (core < 0 || core >= SYSPERF_MAX_CORES) {
+		return -1;
+	}
+	return g_perfCoreLoad[core];
+}
+int SYSPERF_GetTasks(perfTask_t* out, int maxCount) {
+	int count = g_perfNumTasks < maxCount ? g_perfNumTasks : maxCount;
+
+	memcpy(out, g_perfTasks, count * sizeof(perfTask_t));
+	return count;
+}
+#else
+#define QT_PERF_STAGE(stage)
+#endif
 
 /////////////////////////////////////////////////////
 // this is what we do in a qucik tick
 void QuickTick(void* param)
 {
+#if ENABLE_SYSPERF
+	unsigned int perfStart, perfAt;
+#endif
+
 	if (g_bWantPinDeepSleep) {
 		g_bWantPinDeepSleep = 0;
 		PINS_BeginDeepSleepWithPinWakeUp(g_pinDeepSleepWakeUp);
 		return;
 	}
 
-#if defined(PLATFORM_BEKEN) && defined(BEKEN_PIN_GPI_INTERRUPTS)
-	// if using interrupt driven GPI for pins, don't call PIN_ticks() in QuickTick
-#else
-	PIN_ticks(param);
-#endif
-
 #if defined(PLATFORM_BEKEN) || defined(WINDOWS)
 	g_timeMs = rtos_get_time();
 #elif defined(PLATFORM_ESPIDF) //|| defined(PLATFORM_ESP8266)
@@ -1133,6 +1699,23 @@ void QuickTick(void* param)
 #else
 	g_timeMs += QUICK_TMR_DURATION;
 #endif
+#if ENABLE_QUICKTICK_SLEEP
+	if (g_quickTickWake == 0 && (int)(g_timeMs - g_last_time) < g_quickTickSleepMS) {
+		return;
+	}
+	g_quickTickWake = 0;
+#if !PLATFORM_ESPIDF
+	g_quickTickRunning = true;
+#endif
+#endif
+#if ENABLE_SYSPERF
+	perfStart = perfAt = SYSPERF_GetTimeUs();
+#endif
+	WDT_Heartbeat(WDT_TASK_QUICKTICK);
+
+	PIN_ticks(param);
+	QT_PERF_STAGE(QT_STAGE_PINS);
+
 	g_deltaTimeMS = g_timeMs - g_last_time;
 	// cope with wrap
 	if (g_deltaTimeMS > 0x4000) {
@@ -1147,25 +1730,37 @@ void QuickTick(void* param)
 	extern void Berry_RunThreads(int deltaMS);
 	Berry_RunThreads(g_deltaTimeMS);
 #endif
-	RepeatingEvents_RunUpdate(g_deltaTimeMS * 0.001f);
+	QT_PERF_STAGE(QT_STAGE_SCRIPTS);
+	RepeatingEvents_RunUpdate(g_deltaTimeMS);
+	QT_PERF_STAGE(QT_STAGE_REPEATING_EVENTS);
 #ifndef OBK_DISABLE_ALL_DRIVERS
 	DRV_RunQuickTick();
 #endif
 #ifdef WINDOWS
 	NewTuyaMCUSimulator_RunQuickTick(g_deltaTimeMS);
 #endif
+	QT_PERF_STAGE(QT_STAGE_DRIVERS);
 	CMD_RunUartCmndIfRequired();
+	CMD_RunQueuedCommands();
+	QT_PERF_STAGE(QT_STAGE_COMMANDS);
 
 	// process received messages here..
 #if ENABLE_MQTT
 	MQTT_RunQuickTick();
 #endif
+	QT_PERF_STAGE(QT_STAGE_MQTT);
+#if ENABLE_IO_TRACE
+	if (g_ioTraceMode) {
+		IOTrace_RunQuickTick();
+	}
+#endif
 
 #if ENABLE_LED_BASIC
 	if (CFG_HasFlag(OBK_FLAG_LED_SMOOTH_TRANSITIONS) == true) {
 		LED_RunQuickColorLerp(g_deltaTimeMS);
 	}
 #endif
+	QT_PERF_STAGE(QT_STAGE_LED);
 
 	// WiFi LED
 	// In Open Access point mode, fast blink
@@ -1191,6 +1786,19 @@ void QuickTick(void* param)
 		}
 	}
 
+#if ENABLE_SYSPERF
+	perfAt = SYSPERF_GetTimeUs() - perfStart;
+	PerfStat_Add(&g_quickTickStages[QT_STAGE_TOTAL], perfAt);
+	if (perfAt > QUICK_TMR_DURATION * 1000) {
+		g_quickTickOverruns++;
+	}
+#endif
+#if ENABLE_QUICKTICK_SLEEP
+	g_quickTickSleepMS = QuickTick_ComputeSleepMS();
+#if !PLATFORM_ESPIDF
+	g_quickTickRunning = false;
+#endif
+#endif
 }
 
 #define QT_STACK_SIZE 2048
@@ -1204,7 +1812,12 @@ void QuickTick(void* param)
 void quick_timer_thread(void* param)
 {
 	while (1) {
+#if ENABLE_QUICKTICK_SLEEP && PLATFORM_ESPIDF
+		// QuickTick_Wake ends the wait early
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(QuickTick_GetSleepMS()));
+#else
 		rtos_delay_milliseconds(QUICK_TMR_DURATION);
+#endif
 		QuickTick(0);
 	}
 }
@@ -1217,7 +1830,22 @@ void QuickTick_StartThread(void)
 
 #elif PLATFORM_BL602 || PLATFORM_W600 || PLATFORM_W800 || PLATFORM_TR6260 || defined(PLATFORM_REALTEK) || PLATFORM_ECR6600 \
 	|| PLATFORM_ESP8266 || PLATFORM_ESPIDF || PLATFORM_XRADIO || PLATFORM_LN882H || PLATFORM_LN8825
-	xTaskCreate(quick_timer_thread, "quick", QT_STACK_SIZE, NULL, 15, NULL);
+	TaskHandle_t handle = 0;
+
+#if ENABLE_QUICKTICK_SLEEP && PLATFORM_ESPIDF
+	xTaskCreatePinnedToCore(quick_timer_thread, "quick", QT_STACK_SIZE, NULL, 15, &g_quickTickThread,
+		HAL_GetThreadCore("quick"));
+	handle = g_quickTickThread;
+#elif PLATFORM_ESPIDF
+	xTaskCreatePinnedToCore(quick_timer_thread, "quick", QT_STACK_SIZE, NULL, 15, &handle,
+		HAL_GetThreadCore("quick"));
+#else
+	xTaskCreate(quick_timer_thread, "quick", QT_STACK_SIZE, NULL, 15, &handle);
+#endif
+#if ENABLE_SYSPERF
+	// depth is counted in StackType_t, which is a byte on ESP-IDF
+	SYSPERF_RegisterThread(handle, "quick", QT_STACK_SIZE * sizeof(StackType_t));
+#endif
 #elif PLATFORM_TXW81X
 	os_task_create("quick", quick_timer_thread, NULL, 15, 0, NULL, QT_STACK_SIZE);
 #elif PLATFORM_RDA5981
@@ -1273,6 +1901,51 @@ void isidle() {
 
 bool g_unsafeInitDone = false;
 
+// "Boot phase" lines tell where boot time goes
+void Main_LogBootPhase(const char* phase) {
+	ADDLOGF_INFO("Boot phase %s at %i ms", phase, (int)(xTaskGetTickCount() * portTICK_PERIOD_MS));
+}
+#ifndef OBK_DISABLE_ALL_DRIVERS
+// sensors and displays are not needed to get outputs and WiFi going,
+// so they start after the delay
+static void Main_StartDeferredDrivers() {
+	if (PIN_FindPinIndexForRole(IOR_BL0937_CF, -1) != -1 && PIN_FindPinIndexForRole(IOR_BL0937_CF1, -1) != -1
+		&& (PIN_FindPinIndexForRole(IOR_BL0937_SEL, -1) != -1 || PIN_FindPinIndexForRole(IOR_BL0937_SEL_n, -1) != -1)) {
+		DRV_StartDriver("BL0937");
+	}
+	if (PIN_FindPinIndexForRole(IOR_CHT83XX_CLK, -1) != -1 && PIN_FindPinIndexForRole(IOR_CHT83XX_DAT, -1) != -1) {
+		DRV_StartDriver("CHT83XX");
+	}
+	if (PIN_FindPinIndexForRole(IOR_SHT3X_CLK, -1) != -1 && PIN_FindPinIndexForRole(IOR_SHT3X_DAT, -1) != -1) {
+		DRV_StartDriver("SHT3X");
+	}
+	if (PIN_FindPinIndexForRole(IOR_SGP_CLK, -1) != -1 && PIN_FindPinIndexForRole(IOR_SGP_DAT, -1) != -1) {
+		DRV_StartDriver("SGP");
+	}
+	if (PIN_FindPinIndexForRole(IOR_BAT_ADC, -1) != -1) {
+		DRV_StartDriver("Battery");
+	}
+	if (PIN_FindPinIndexForRole(IOR_TM1637_CLK, -1) != -1 && PIN_FindPinIndexForRole(IOR_TM1637_DIO, -1) != -1) {
+		DRV_StartDriver("TM1637");
+	}
+	if ((PIN_FindPinIndexForRole(IOR_GN6932_CLK, -1) != -1) &&
+		(PIN_FindPinIndexForRole(IOR_GN6932_DAT, -1) != -1) &&
+		(PIN_FindPinIndexForRole(IOR_GN6932_STB, -1) != -1))
+	{
+		DRV_StartDriver("GN6932");
+	}
+	if (PIN_FindPinIndexForRole(IOR_HLW8112_SCSN, -1) != -1) {
+		DRV_StartDriver("HLW8112SPI");
+	}
+//	if ((PIN_FindPinIndexForRole(IOR_TM1638_CLK, -1) != -1) &&
+//		(PIN_FindPinIndexForRole(IOR_TM1638_DAT, -1) != -1) &&
+//		(PIN_FindPinIndexForRole(IOR_TM1638_STB, -1) != -1))
+//	{
+//		DRV_StartDriver("TM1638");
+//	}
+}
+#endif
+
 void Main_Init_AfterDelay_Unsafe(bool bStartAutoRunScripts) {
 
 	// initialise MQTT - just sets up variables.
@@ -1284,6 +1957,11 @@ void Main_Init_AfterDelay_Unsafe(bool bStartAutoRunScripts) {
 	CMD_Init_Delayed();
 
 	if (bStartAutoRunScripts) {
+#ifndef OBK_DISABLE_ALL_DRIVERS
+		if (!CFG_HasFlag(OBK_FLAG_DRV_DISABLE_AUTOSTART)) {
+			Main_StartDeferredDrivers();
+		}
+#endif
 		if (PIN_FindPinIndexForRole(IOR_IRRecv, -1) != -1 || PIN_FindPinIndexForRole(IOR_IRSend, -1) != -1
 			|| PIN_FindPinIndexForRole(IOR_IRRecv_nPup, -1) != -1) {
 			// start IR driver 5 seconds after boot.  It may affect wifi connect?
@@ -1305,6 +1983,7 @@ void Main_Init_AfterDelay_Unsafe(bool bStartAutoRunScripts) {
 #if ENABLE_OBK_BERRY
 		CMD_ExecuteCommand("berry import autoexec", COMMAND_FLAG_SOURCE_SCRIPT);
 #endif
+		Main_LogBootPhase("scripts started");
 	}
 }
 void Main_Init_BeforeDelay_Unsafe(bool bAutoRunScripts) {
@@ -1320,8 +1999,10 @@ void Main_Init_BeforeDelay_Unsafe(bool bAutoRunScripts) {
 	RepeatingEvents_Init();
 
 	// set initial values for channels.
-	// this is done early so lights come on at the flick of a switch.
-	CFG_ApplyChannelStartValues();
+	// normal boot did it already, together with outputs, see Main_Init_Before_Delay
+	if (bSafeMode) {
+		CFG_ApplyChannelStartValues();
+	}
 	PIN_AddCommands();
 	ADDLOGF_DEBUG("Initialised pins\r\n");
 
@@ -1391,10 +2072,6 @@ void Main_Init_BeforeDelay_Unsafe(bool bAutoRunScripts) {
 			if (PIN_FindPinIndexForRole(IOR_KP18058_CLK, -1) != -1 && PIN_FindPinIndexForRole(IOR_KP18058_DAT, -1) != -1) {
 				DRV_StartDriver("KP18058");
 			}
-			if (PIN_FindPinIndexForRole(IOR_BL0937_CF, -1) != -1 && PIN_FindPinIndexForRole(IOR_BL0937_CF1, -1) != -1
-				&& (PIN_FindPinIndexForRole(IOR_BL0937_SEL, -1) != -1 || PIN_FindPinIndexForRole(IOR_BL0937_SEL_n, -1) != -1)) {
-				DRV_StartDriver("BL0937");
-			}
 			if ((PIN_FindPinIndexForRole(IOR_BridgeForward, -1) != -1) && (PIN_FindPinIndexForRole(IOR_BridgeReverse, -1) != -1))
 			{
 				DRV_StartDriver("Bridge");
@@ -1405,36 +2082,6 @@ void Main_Init_BeforeDelay_Unsafe(bool bAutoRunScripts) {
 			{
 				DRV_StartDriver("DoorSensor");
 			}
-			if (PIN_FindPinIndexForRole(IOR_CHT83XX_CLK, -1) != -1 && PIN_FindPinIndexForRole(IOR_CHT83XX_DAT, -1) != -1) {
-				DRV_StartDriver("CHT83XX");
-			}
-			if (PIN_FindPinIndexForRole(IOR_SHT3X_CLK, -1) != -1 && PIN_FindPinIndexForRole(IOR_SHT3X_DAT, -1) != -1) {
-				DRV_StartDriver("SHT3X");
-			}
-			if (PIN_FindPinIndexForRole(IOR_SGP_CLK, -1) != -1 && PIN_FindPinIndexForRole(IOR_SGP_DAT, -1) != -1) {
-				DRV_StartDriver("SGP");
-			}
-			if (PIN_FindPinIndexForRole(IOR_BAT_ADC, -1) != -1) {
-				DRV_StartDriver("Battery");
-			}
-			if (PIN_FindPinIndexForRole(IOR_TM1637_CLK, -1) != -1 && PIN_FindPinIndexForRole(IOR_TM1637_DIO, -1) != -1) {
-				DRV_StartDriver("TM1637");
-			}
-			if ((PIN_FindPinIndexForRole(IOR_GN6932_CLK, -1) != -1) &&
-				(PIN_FindPinIndexForRole(IOR_GN6932_DAT, -1) != -1) &&
-				(PIN_FindPinIndexForRole(IOR_GN6932_STB, -1) != -1))
-			{
-				DRV_StartDriver("GN6932");
-			}
-			if (PIN_FindPinIndexForRole(IOR_HLW8112_SCSN, -1) != -1) {
-				DRV_StartDriver("HLW8112SPI");
-			}
-//			if ((PIN_FindPinIndexForRole(IOR_TM1638_CLK, -1) != -1) &&
-//				(PIN_FindPinIndexForRole(IOR_TM1638_DAT, -1) != -1) &&
-//				(PIN_FindPinIndexForRole(IOR_TM1638_STB, -1) != -1))
-//			{
-//				DRV_StartDriver("TM1638");
-//			}
 		}
 #endif
 	}
@@ -1447,6 +2094,7 @@ void Main_Init_BeforeDelay_Unsafe(bool bAutoRunScripts) {
 #if ENABLE_LED_BASIC
 	NewLED_RestoreSavedStateIfNeeded();
 #endif
+	Main_LogBootPhase("pins set up");
 }
 void Main_ForceUnsafeInit() {
 	if (g_unsafeInitDone) {
@@ -1483,10 +2131,23 @@ void Main_Init_Before_Delay()
 		ADDLOGF_INFO("###### safe mode activated - boot failures %d", g_bootFailures);
 	}
 	CFG_InitAndLoad();
+	if (!bSafeMode)
+	{
+		// this is done early so relays and lights come back at the flick of a switch
+		CFG_ApplyChannelStartValues();
+		PIN_SetupOutputsEarly();
+		Main_LogBootPhase("outputs restored");
+	}
 
 #if ENABLE_LITTLEFS
 	LFSAddCmds();
 #endif
+#if ENABLE_IO_TRACE
+	IOTrace_AddCmds();
+#endif
+#if ENABLE_CPU_PROFILER
+	Profiler_AddCmds();
+#endif
 
 	// only initialise certain things if we are not in AP mode
 	if (!bSafeMode)
@@ -1517,6 +2178,7 @@ void Main_Init_Delay()
 	// use this variable wherever to determine if we have TCP/IP features.
 	// e.g. in logging to determine if we can start TCP thread
 	g_StartupDelayOver = 1;
+	Main_LogBootPhase("delay over");
 }
 
 
@@ -1560,6 +2222,10 @@ void Main_Init_After_Delay()
 		{
 			g_openAP = 5;
 		}
+		else if (g_bWiFiHeld) {
+			ADDLOGF_INFO("WiFi held, wake is only for sensor reading\r\n");
+			g_connectToWiFi = 5;
+		}
 		else {
 			if (Main_HasFastConnect()) {
 #if ENABLE_MQTT
@@ -1584,6 +2250,7 @@ void Main_Init_After_Delay()
 #endif		
 		HTTPServer_Start();
 		ADDLOGF_DEBUG("Started http tcp server\r\n");
+		Main_LogBootPhase("http server started");
 #if MQTT_USE_TLS
 	} 
 #endif		
@@ -1627,6 +2294,9 @@ void Main_Init()
 #endif
 	// on windows, we don't want to remember commands from previous session
 	CMD_FreeAllCommands();
+	g_bWiFiLeaseFailed = false;
+	g_wifiFailedConnects = 0;
+	g_bWiFiHeld = false;
 #endif
 
 	// do things we want to happen immediately on boot
@@ -57,6 +57,23 @@
 #define MBEDTLS_ECP_WINDOW_SIZE            2
 #define MBEDTLS_SSL_MAX_CONTENT_LEN     4096
 
+// Record buffers, each is allocated per connection. Can be set from build
+// (CFG_MQTT_TLS_IN_CONTENT_LEN/CFG_MQTT_TLS_OUT_CONTENT_LEN) to trade heap
+// against throughput. With input smaller than broker's records, ask broker
+// for smaller fragments with mqtt_tlsOptions.
+#ifndef OBK_TLS_IN_CONTENT_LEN
+#define OBK_TLS_IN_CONTENT_LEN          MBEDTLS_SSL_MAX_CONTENT_LEN
+#endif
+#ifndef OBK_TLS_OUT_CONTENT_LEN
+#define OBK_TLS_OUT_CONTENT_LEN         MBEDTLS_SSL_MAX_CONTENT_LEN
+#endif
+#define MBEDTLS_SSL_IN_CONTENT_LEN      OBK_TLS_IN_CONTENT_LEN
+#define MBEDTLS_SSL_OUT_CONTENT_LEN     OBK_TLS_OUT_CONTENT_LEN
+
+// Session resumption on reconnect and max fragment length extension
+#define MBEDTLS_SSL_SESSION_TICKETS
+#define MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+
 // Modes
 #define MBEDTLS_SSL_CLI_C  // Only client enabled
 #undef  MBEDTLS_SSL_SRV_C 
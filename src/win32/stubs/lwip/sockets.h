@@ -1,2 +1,10 @@
 
 #include <fcntl.h>
+
+// win_rtos_stub.c
+int lwip_fcntl(int s, int cmd, int val);
+#ifdef LINUX
+// from unistd.h, which can't be included here, since some drivers
+// declare their own usleep
+int close(int fd);
+#endif
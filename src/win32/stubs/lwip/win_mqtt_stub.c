@@ -4,6 +4,7 @@
 #include "apps/mqtt.h"
 #include "ip_addr.h"
 #include "mqtt_opts.h"
+#include "../../../hal/hal_generic.h"
 
 #define LWIP_MAX(x, y)   (((x) > (y)) ? (x) : (y))
 #define LWIP_MIN(x, y)   (((x) < (y)) ? (x) : (y))
@@ -60,6 +61,11 @@ extern int g_bDoingUnitTestsNow;
 bool MQTT_IsFakingOnlineMQTT() {
 	return g_bDoingUnitTestsNow;
 }
+// selftests can take faked broker down, connect attempts made meanwhile
+// are accepted once it's back
+static bool g_simMQTTOffline = false;
+static mqtt_client_t *g_simMQTTPendingClient = 0;
+static int g_simMQTTConnectAttempts = 0;
 /**
  * MQTT connect flags, only used in CONNECT message
  */
@@ -378,8 +384,15 @@ err_t mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ip_addr, u16_t
 	u16_t client_user_len = 0, client_pass_len = 0;
 
 
-	if (MQTT_IsFakingOnlineMQTT())
+	if (MQTT_IsFakingOnlineMQTT()) {
+		g_simMQTTConnectAttempts++;
+		if (g_simMQTTOffline) {
+			client->connect_arg = arg;
+			client->connect_cb = cb;
+			g_simMQTTPendingClient = client;
+		}
 		return 0;
+	}
 
 	LWIP_ASSERT_CORE_LOCKED();
 	LWIP_ASSERT("mqtt_client_connect: client != NULL", client != NULL);
@@ -493,6 +506,8 @@ err_t mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ip_addr, u16_t
 	}
 	client->conn = (altcp_pcb*)malloc(sizeof(altcp_pcb));
 	client->conn->sock = s;
+	// incoming publish ends wait of main loop, socket leaves the set on close
+	HAL_NetLoop_Watch(s);
 
 	client->conn_state = TCP_CONNECTING;
 
@@ -742,10 +757,26 @@ mqtt_client_t *mqtt_client_new(void) {
 /** Check connection status */
 u8_t mqtt_client_is_connected(mqtt_client_t *client) {
 	if (MQTT_IsFakingOnlineMQTT())
-		return 1;
+		return !g_simMQTTOffline;
 	return client->conn_state == MQTT_CONNECTED;
 }
 
+void SIM_SetMQTTOffline(bool bOffline) {
+	mqtt_client_t *client;
+
+	g_simMQTTOffline = bOffline;
+	if (bOffline == false && g_simMQTTPendingClient) {
+		client = g_simMQTTPendingClient;
+		g_simMQTTPendingClient = 0;
+		if (client->connect_cb != NULL) {
+			client->connect_cb(client, client->connect_arg, MQTT_CONNECT_ACCEPTED);
+		}
+	}
+}
+int SIM_GetMQTTConnectAttempts() {
+	return g_simMQTTConnectAttempts;
+}
+
 /** Set callback to call for incoming publish */
 void mqtt_set_inpub_callback(mqtt_client_t *client, mqtt_incoming_publish_cb_t pub_cb,
                              mqtt_incoming_data_cb_t data_cb, void *arg) {
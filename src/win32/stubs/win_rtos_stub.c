@@ -11,12 +11,16 @@
 #else
 
 #include <time.h>
+#include <unistd.h>
 
 #define timeGetTime() time(NULL)
 #define DWORD uint
 
+#ifndef SOCKET_ERROR
 #define SOCKET_ERROR SO_ERROR
-#define Sleep sleep
+#endif
+// Sleep of Windows takes milliseconds
+#define Sleep(ms) usleep((ms) * 1000)
 #define ioctlsocket ioctl
 #define closesocket close
 #define GETSOCKETERRNO() (errno)
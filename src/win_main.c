@@ -21,10 +21,11 @@
 #else
 
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 
-#define Sleep sleep
+#define Sleep(ms) usleep((ms) * 1000)
 
 #endif
 
@@ -39,6 +40,11 @@
 #include "hal/hal_flashVars.h"
 #include "selftest/selftest_local.h"
 #include "new_pins.h"
+#include "hal/hal_generic.h"
+#include "httpserver/http_tcp_server.h"
+#if ENABLE_MQTT
+#include "mqtt/new_mqtt.h"
+#endif
 
 #define OFFSETOF(TYPE, ELEMENT) ((size_t)&(((TYPE *)0)->ELEMENT))
 
@@ -54,6 +60,10 @@ int g_simulatedTimeNow = 0;
 extern int g_httpPort;
 #define DEFAULT_FRAME_TIME 10
 
+// real serial port and GPIO lines of native Linux build, no-op otherwise
+void HAL_UART_RunFrame();
+void HAL_PIN_RunFrame();
+
 #if LINUX
 
 #include <stdint.h>
@@ -103,6 +113,8 @@ void Sim_RunFrame(int frameTime)
 	// this time counter is simulated, I need this for unit tests to work
 	g_simulatedTimeNow += frameTime;
 	accum_time += frameTime;
+	HAL_UART_RunFrame();
+	HAL_PIN_RunFrame();
 	QuickTick(0);
 	WIN_RunMQTTFrame();
 	HTTPServer_RunQuickTick();
@@ -213,10 +225,57 @@ void Win_DoUnitTests()
 	Test_HTTP_Client();
 	// Test_PartitionSearch();
 	Test_OpenWeatherMap();
+	Test_Flash_Search();
+#if ENABLE_DRIVER_BKPARTITIONS
+	Test_BKPartitions();
+#endif
 	Test_MAX72XX();
 
 	Test_LEDstrips();
+#if ENABLE_DRIVER_E131
+	Test_E131();
+#endif
+	Test_DMX();
+#if ENABLE_DRIVER_IR2 && ENABLE_LITTLEFS
+	Test_IR2();
+#endif
+	Test_CRC8();
+	Test_FlashVars();
+	Test_FlashVarsFile();
+	Test_LogLevels();
+	Test_Base64();
+	Test_RGB2HSV();
+#if ENABLE_DRIVER_SHIFTREGISTER
+	Test_ShiftRegister();
+#endif
+#if ENABLE_DRIVER_NEO6M
+	Test_NEO6M();
+#endif
+#if ENABLE_DRIVER_DEBOUNCER
+	Test_Debouncer();
+#endif
+#if ENABLE_DRIVER_FREEZE
+	Test_Freeze();
+#endif
+#if ENABLE_DRIVER_POWERGOV
+	Test_PowerGov();
+#endif
+#if ENABLE_DRIVER_WIFIROAM
+	Test_WiFiRoam();
+#endif
+#if ENABLE_DRIVER_MODBUS
+	Test_Modbus();
+#endif
+#if ENABLE_DRIVER_TESTSPIFLASH
+	Test_SPIFlash();
+#endif
+#if ENABLE_IO_TRACE && ENABLE_LITTLEFS
+	Test_IOTrace();
+#endif
 	Test_Commands_Channels();
+#if ENABLE_CHANNEL_STATS
+	Test_ChannelStats();
+#endif
 
 	Test_Driver_TCL_AC();
 
@@ -227,9 +286,13 @@ void Win_DoUnitTests()
 
 	Test_TuyaMCU_Boolean();
 	Test_TuyaMCU_DP22();
+	Test_TuyaMCU_Queue();
+	Test_TuyaMCU_Mappings();
+	Test_TuyaMCU_Parser();
 
 	Test_Demo_ConditionalRelay();
 	Test_Expressions_RunTests_Braces();
+	Test_Expressions_RunTests_Compiled();
 	Test_Expressions_RunTests_Basic();
 	Test_Enums();
 	Test_Backlog();
@@ -279,8 +342,18 @@ void Win_DoUnitTests()
 	// TODO: fix on Linux
 	Test_DHT();
 #endif
+#if ENABLE_DRIVER_DS1820_FULL
+	Test_DS18B20();
+#endif
+#if ENABLE_DRIVER_ST7735
+	Test_ST7735();
+#endif
+	Test_RC();
+	Test_PingWatchDog();
+	Test_CamFrames();
 	Test_Tasmota();
 	Test_NTP();
+	Test_NTP_Actions();
 	Test_TIME_DST();
 	Test_TIME_SunsetSunrise();
 	Test_ExpandConstant();
@@ -293,18 +366,55 @@ void Win_DoUnitTests()
 	Test_Demo_SignAndValue();
 	Test_LEDDriver();
 	Test_LFS();
+#if ENABLE_ASSETS
+	Test_Assets();
+#endif
+#if ENABLE_DRIVER_CHARTS
+	Test_Charts();
+#if ENABLE_LITTLEFS
+	Test_Charts_Persist();
+#endif
+#endif
+#if ENABLE_DRIVER_SGP
+	Test_I2CSched();
+	Test_SoftI2C();
+	Test_SensorAcq();
+#endif
 	Test_Scripting();
 	Test_Tokenizer();
 	Test_Pins();
 	Test_Http();
 	Test_Http_LED();
 	Test_DeviceGroups();
+#if ENABLE_DRIVER_CHSYNC
+	Test_ChSync();
+#endif
+#if ENABLE_DRIVER_MDNS
+	Test_MDNS();
+#endif
+#if ENABLE_DRIVER_SSDP
+	Test_SSDP();
+#endif
 
 	// Just to be sure
 	// Must be last step
 	// reset whole device
 	SIM_ClearOBK(0);
 }
+// Benchmarks print their timing, so they are not part of unit tests,
+// run them with -runBenchmarks
+void Win_DoBenchmarks()
+{
+#if ENABLE_DRIVER_PIXELANIM && ENABLE_DRIVER_DDP && ENABLE_LED_BASIC
+	Test_LEDBench();
+#endif
+	Test_CRC8_Bench();
+	Test_RGB2HSV_Bench();
+	Test_SelfBench();
+	SelfBench_WriteJSON("selfbench.json");
+
+	SIM_ClearOBK(0);
+}
 long g_delta;
 float SIM_GetDeltaTimeSeconds()
 {
@@ -330,6 +440,8 @@ int rtos_get_time()
 int g_bDoingUnitTestsNow = 0;
 
 #include "sim/sim_public.h"
+#include "sim/sim_import.h"
+#include "logging/ioTrace.h"
 
 int SelfTest_GetNumErrors();
 extern int g_selfTestsMode;
@@ -372,6 +484,183 @@ const char *va(const char *fmt, ...)
 // fixes - temp
 #endif
 
+// headless simulator options, see scripts/run_fleet_50_port9000.bat
+#define SIM_MAX_STARTUP_CMDS 16
+#define SIM_MAX_FLEET_ARGS 64
+static bool g_simHeadless = false;
+// simulated milliseconds per real one
+static float g_simTimeScale = 1.0f;
+static const char *g_simFlashPath = 0;
+static const char *g_simStartupCmds[SIM_MAX_STARTUP_CMDS];
+static int g_simNumStartupCmds = 0;
+// trace of iotrace_start to run through, see Win_RunReplay
+static const char *g_simReplayPath = 0;
+// -runBenchmarks runs Win_DoBenchmarks instead of unit tests
+static bool g_simRunBenchmarks = false;
+// seconds between -bench reports, 0 is off
+static int g_simBenchSeconds = 0;
+
+void SIM_SetMacIndex(int index);
+void SIM_SetFlashVarsFile(const char *path);
+#ifdef LINUX
+void SIM_SetUARTDevice(const char *path);
+void SIM_SetGPIOChip(const char *path);
+#endif
+
+// Throughput of shared code over last period, for profiling it natively
+// under load from HTTP and MQTT benchmark clients.
+static void Win_PrintBench(long periodMS)
+{
+	static int prevRequests = 0;
+	static int prevPublishes = 0;
+	static int prevReceived = 0;
+	static int prevFrames = 0;
+	int requests, publishes = 0, received = 0;
+	float secs = periodMS * 0.001f;
+
+	requests = HTTPServer_GetRequestCount();
+#if ENABLE_MQTT
+	publishes = MQTT_GetPublishEventCounter();
+	received = MQTT_GetReceivedEventCounter();
+#endif
+	printf("bench: %.1f HTTP req/s, %.1f MQTT pub/s, %.1f MQTT rx/s, %.1f frames/s\n",
+		(requests - prevRequests) / secs, (publishes - prevPublishes) / secs,
+		(received - prevReceived) / secs, (win_frameNum - prevFrames) / secs);
+	fflush(stdout);
+	prevRequests = requests;
+	prevPublishes = publishes;
+	prevReceived = received;
+	prevFrames = win_frameNum;
+}
+
+// Starts count headless simulators and waits for them. Firmware state is
+// global, so each device is own process, with own HTTP port, MAC and flash
+// file. They share host network, so device groups, SSDP and mDNS
+// multicast and MQTT broker see them as devices on one LAN.
+static int Win_RunFleet(const char *exe, int count, int basePort)
+{
+	char device[16], port[16], flash[64];
+	const char *args[SIM_MAX_FLEET_ARGS + 1];
+	int i, j, n, failed = 0;
+#ifndef LINUX
+	char cmdLine[4096];
+	PROCESS_INFORMATION *procs;
+	STARTUPINFOA si;
+#else
+	pid_t *procs;
+	int status;
+#endif
+
+#ifndef LINUX
+	procs = (PROCESS_INFORMATION *)calloc(count, sizeof(PROCESS_INFORMATION));
+#else
+	procs = (pid_t *)calloc(count, sizeof(pid_t));
+#endif
+	if (procs == 0)
+	{
+		return 1;
+	}
+	for (i = 0; i < count; i++)
+	{
+		snprintf(device, sizeof(device), "%i", i + 1);
+		snprintf(port, sizeof(port), "%i", basePort + i + 1);
+		snprintf(flash, sizeof(flash), "fleet_%i.bin", i + 1);
+		n = 0;
+		args[n++] = exe;
+		args[n++] = "-runUnitTests";
+		args[n++] = "0";
+		args[n++] = "-headless";
+		args[n++] = "-device";
+		args[n++] = device;
+		args[n++] = "-port";
+		args[n++] = port;
+		args[n++] = "-flash";
+		args[n++] = flash;
+		args[n++] = "-timeScale";
+		args[n++] = va("%g", g_simTimeScale);
+		for (j = 0; j < g_simNumStartupCmds && n + 2 <= SIM_MAX_FLEET_ARGS; j++)
+		{
+			args[n++] = "-cmd";
+			args[n++] = g_simStartupCmds[j];
+		}
+		args[n] = 0;
+#ifndef LINUX
+		cmdLine[0] = 0;
+		for (j = 0; j < n; j++)
+		{
+			strcat_safe(cmdLine, j ? " \"" : "\"", sizeof(cmdLine));
+			strcat_safe(cmdLine, args[j], sizeof(cmdLine));
+			strcat_safe(cmdLine, "\"", sizeof(cmdLine));
+		}
+		memset(&si, 0, sizeof(si));
+		si.cb = sizeof(si);
+		if (!CreateProcessA(NULL, cmdLine, NULL, NULL, FALSE, 0, NULL, NULL, &si, &procs[i]))
+		{
+			printf("Fleet: failed to start device %i\n", i + 1);
+			failed++;
+		}
+#else
+		procs[i] = fork();
+		if (procs[i] == 0)
+		{
+			execv(exe, (char *const *)args);
+			_exit(127);
+		}
+		if (procs[i] < 0)
+		{
+			printf("Fleet: failed to start device %i\n", i + 1);
+			failed++;
+		}
+#endif
+	}
+	printf("Fleet: %i devices on ports %i-%i\n", count - failed, basePort + 1, basePort + count);
+	for (i = 0; i < count; i++)
+	{
+#ifndef LINUX
+		if (procs[i].hProcess)
+		{
+			WaitForSingleObject(procs[i].hProcess, INFINITE);
+			CloseHandle(procs[i].hProcess);
+			CloseHandle(procs[i].hThread);
+		}
+#else
+		if (procs[i] > 0)
+		{
+			waitpid(procs[i], &status, 0);
+		}
+#endif
+	}
+	free(procs);
+	return failed;
+}
+
+#if ENABLE_IO_TRACE
+// Device is set up from -flash and -cmd like the one trace was taken on,
+// then trace is fed as fast as simulator runs. Exit code is 0 when outputs
+// match the recorded ones, so it can be used in scripts.
+static int Win_RunReplay(const char *path)
+{
+	ioTraceReplay_t res;
+	bool bSame;
+	int i;
+
+	SIM_ClearOBK(g_simFlashPath);
+	for (i = 0; i < g_simNumStartupCmds; i++)
+	{
+		CMD_ExecuteCommand(g_simStartupCmds[i], 0);
+	}
+	Sim_RunFrames(50, false);
+	bSame = IOTrace_ReplayFile(path, &res);
+	printf("Replay: %s, %i records, %i inputs, %u ms simulated in %u ms CPU\n",
+		path, res.records, res.inputs, res.simMs, res.cpuMs);
+	printf("Replay: outputs %i of %i, UART %s, MQTT %s%s\n", res.outputs, res.expectedOutputs,
+		res.uartHash == res.expectedUartHash ? "same" : "differ",
+		res.mqttHash == res.expectedMqttHash ? "same" : "differ",
+		res.bBroken ? ", trace is broken" : "");
+	return bSame ? 0 : 1;
+}
+#endif
+
 #if !ENABLE_SDL_WINDOW
 bool SIM_ReadDHT11(int pin, byte *data)
 {
@@ -389,6 +678,7 @@ void SIM_GeneratePowerStateDesc(char *o, int outLen)
 int __cdecl main(int argc, char **argv)
 {
 	bool bWantsUnitTests = 1;
+	int fleetSize = 0;
 
 #ifndef LINUX
 	WSADATA wsaData;
@@ -421,6 +711,106 @@ int __cdecl main(int argc, char **argv)
 						g_httpPort = value;
 					}
 				}
+				// before -h, which would match it
+				else if (wal_strnicmp(argv[i] + 1, "headless", 8) == 0)
+				{
+					g_simHeadless = true;
+				}
+				else if (wal_strnicmp(argv[i] + 1, "timeScale", 9) == 0)
+				{
+					float scale;
+
+					i++;
+
+					if (i < argc && sscanf(argv[i], "%f", &scale) == 1 && scale > 0)
+					{
+						g_simTimeScale = scale;
+					}
+				}
+				else if (wal_strnicmp(argv[i] + 1, "device", 6) == 0)
+				{
+					i++;
+
+					if (i < argc && sscanf(argv[i], "%d", &value) == 1)
+					{
+						SIM_SetMacIndex(value);
+					}
+				}
+				// before -flash, which would match it
+				else if (wal_strnicmp(argv[i] + 1, "flashVars", 9) == 0)
+				{
+					i++;
+
+					if (i < argc)
+					{
+						SIM_SetFlashVarsFile(argv[i]);
+					}
+				}
+				else if (wal_strnicmp(argv[i] + 1, "flash", 5) == 0)
+				{
+					i++;
+
+					if (i < argc)
+					{
+						g_simFlashPath = argv[i];
+					}
+				}
+				else if (wal_strnicmp(argv[i] + 1, "cmd", 3) == 0)
+				{
+					i++;
+
+					if (i < argc && g_simNumStartupCmds < SIM_MAX_STARTUP_CMDS)
+					{
+						g_simStartupCmds[g_simNumStartupCmds++] = argv[i];
+					}
+				}
+				else if (wal_strnicmp(argv[i] + 1, "replay", 6) == 0)
+				{
+					i++;
+
+					if (i < argc)
+					{
+						g_simReplayPath = argv[i];
+					}
+				}
+				else if (wal_strnicmp(argv[i] + 1, "bench", 5) == 0)
+				{
+					i++;
+
+					if (i < argc && sscanf(argv[i], "%d", &value) == 1)
+					{
+						g_simBenchSeconds = value;
+					}
+				}
+#ifdef LINUX
+				else if (wal_strnicmp(argv[i] + 1, "uart", 4) == 0)
+				{
+					i++;
+
+					if (i < argc)
+					{
+						SIM_SetUARTDevice(argv[i]);
+					}
+				}
+				else if (wal_strnicmp(argv[i] + 1, "gpiochip", 8) == 0)
+				{
+					i++;
+
+					if (i < argc)
+					{
+						SIM_SetGPIOChip(argv[i]);
+					}
+				}
+#endif
+				else if (wal_strnicmp(argv[i] + 1, "fleet", 5) == 0)
+				{
+					i++;
+
+					if (i < argc && sscanf(argv[i], "%d", &value) == 1)
+					{
+						fleetSize = value;
+					}
+				}
 				else if (wal_strnicmp(argv[i] + 1, "w", 1) == 0)
 				{
 					i++;
@@ -443,6 +833,10 @@ int __cdecl main(int argc, char **argv)
 #endif
 					}
 				}
+				else if (wal_strnicmp(argv[i] + 1, "runBenchmarks", 13) == 0)
+				{
+					g_simRunBenchmarks = true;
+				}
 				else if (wal_strnicmp(argv[i] + 1, "runUnitTests", 12) == 0)
 				{
 					i++;
@@ -621,6 +1015,14 @@ int __cdecl main(int argc, char **argv)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF | _CRTDBG_CHECK_ALWAYS_DF);
 #endif
 
+	if (g_simRunBenchmarks)
+	{
+		g_bDoingUnitTestsNow = 1;
+		SIM_ClearOBK(0);
+		Win_DoBenchmarks();
+		g_bDoingUnitTestsNow = 0;
+		return SelfTest_GetNumErrors();
+	}
 	if (g_selfTestsMode)
 	{
 		g_bDoingUnitTestsNow = 1;
@@ -637,22 +1039,48 @@ int __cdecl main(int argc, char **argv)
 		}
 	}
 
+	if (fleetSize > 0)
+	{
+		return Win_RunFleet(argv[0], fleetSize, g_httpPort);
+	}
+#if ENABLE_IO_TRACE
+	if (g_simReplayPath)
+	{
+		return Win_RunReplay(g_simReplayPath);
+	}
+#endif
+
+	if (g_simHeadless)
+	{
+		SIM_ClearOBK(g_simFlashPath);
+	}
 #if ENABLE_SDL_WINDOW
-	SIM_CreateWindow(argc, argv);
+	else
+	{
+		SIM_CreateWindow(argc, argv);
+	}
 #endif
 
+	// headless devices keep their config from flash and -cmd
+	if (!g_simHeadless)
+	{
 #if 1
-	CMD_ExecuteCommand("MQTTHost 192.168.0.113", 0);
-	CMD_ExecuteCommand("MqttPassword ma1oovoo0pooTie7koa8Eiwae9vohth1vool8ekaej8Voohi7beif5uMuph9Diex", 0);
-	CMD_ExecuteCommand("MqttClient WindowsOBK", 0);
-	CMD_ExecuteCommand("MqttUser homeassistant", 0);
+		CMD_ExecuteCommand("MQTTHost 192.168.0.113", 0);
+		CMD_ExecuteCommand("MqttPassword ma1oovoo0pooTie7koa8Eiwae9vohth1vool8ekaej8Voohi7beif5uMuph9Diex", 0);
+		CMD_ExecuteCommand("MqttClient WindowsOBK", 0);
+		CMD_ExecuteCommand("MqttUser homeassistant", 0);
 #else
-	CMD_ExecuteCommand("MQTTHost 192.168.0.118", 0);
-	CMD_ExecuteCommand("MqttPassword Test1", 0);
-	CMD_ExecuteCommand("MqttClient WindowsOBK", 0);
-	CMD_ExecuteCommand("MqttUser homeassistant", 0);
+		CMD_ExecuteCommand("MQTTHost 192.168.0.118", 0);
+		CMD_ExecuteCommand("MqttPassword Test1", 0);
+		CMD_ExecuteCommand("MqttClient WindowsOBK", 0);
+		CMD_ExecuteCommand("MqttUser homeassistant", 0);
 #endif
+	}
 	CMD_ExecuteCommand("reboot", 0);
+	for (int i = 0; i < g_simNumStartupCmds; i++)
+	{
+		CMD_ExecuteCommand(g_simStartupCmds[i], 0);
+	}
 	// CMD_ExecuteCommand("addRepeatingEvent 1 -1 backlog addChannel 1 1; publishInt myTestTopic $CH1", 0);
 
 	if (false)
@@ -669,17 +1097,50 @@ int __cdecl main(int argc, char **argv)
 	else
 	{
 		long prev_time = SIM_GetTime();
+		long save_time = prev_time;
+		long bench_time = prev_time;
+		float scaledTime = 0;
 		while (1)
 		{
 			long cur_time = SIM_GetTime();
 			g_delta = cur_time - prev_time;
 			if (g_delta <= 0)
 				continue;
-			// give CPU some time to rest
-			Sleep(DEFAULT_FRAME_TIME);
-			Sim_RunFrame(g_delta);
+			// give CPU some time to rest, network traffic ends it early
+			HAL_NetLoop_Wait(DEFAULT_FRAME_TIME);
+			if (g_simTimeScale == 1.0f)
+			{
+				Sim_RunFrame(g_delta);
+			}
+			else
+			{
+				// frames are as long as in tests, so faster time is more of them
+				scaledTime += g_delta * g_simTimeScale;
+				while (scaledTime >= DEFAULT_FRAME_TIME)
+				{
+					Sim_RunFrame(DEFAULT_FRAME_TIME);
+					scaledTime -= DEFAULT_FRAME_TIME;
+				}
+			}
+			if (g_simBenchSeconds > 0 && cur_time - bench_time >= g_simBenchSeconds * 1000)
+			{
+				Win_PrintBench(cur_time - bench_time);
+				bench_time = cur_time;
+			}
+			if (g_simHeadless)
+			{
+				// there is no UI to save it
+				if (g_simFlashPath && cur_time - save_time > 5000 && SIM_IsFlashModified())
+				{
+					SIM_SaveFlashData(g_simFlashPath);
+					save_time = cur_time;
+				}
+			}
 #if ENABLE_SDL_WINDOW
-			SIM_RunWindow();
+			else
+			{
+				SIM_RunWindow();
+			}
 #endif
 			prev_time = cur_time;
 		}
@@ -687,23 +1148,8 @@ int __cdecl main(int argc, char **argv)
 	return 0;
 }
 
-// initialise OTA flash starting at startaddr
-int init_ota(unsigned int startaddr)
-{
-	return 0;
-}
-
-// add any length of data to OTA
-void add_otadata(unsigned char *data, int len)
-{
-	return;
-}
-
-// finalise OTA flash (write last sector if incomplete)
-void close_ota()
-{
-	return;
-}
+// init_ota, add_otadata and close_ota are in hal/bk7231/hal_ota_bk7231.c,
+// on RAM area
 
 void otarequest(const char *urlin)
 {
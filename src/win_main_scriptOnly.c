@@ -40,6 +40,44 @@ byte *LFS_ReadFile(const char *fname) {
 
 	return ret;
 }
+const byte *LFS_BorrowFile(const char *fname, int *outLen) {
+	static byte *last = 0;
+
+	free(last);
+	last = LFS_ReadFile(fname);
+	if (last && outLen) {
+		*outLen = strlen((const char*)last);
+	}
+	return last;
+}
+struct lfsStream_s {
+	FILE *f;
+	int size;
+};
+lfsStream_t *LFS_OpenStream(const char *fname, int *outError) {
+	lfsStream_t *s;
+	FILE *f;
+
+	f = fopen(fname, "rb");
+	if (f == 0)
+		return 0;
+	s = malloc(sizeof(lfsStream_t));
+	s->f = f;
+	fseek(f, 0, SEEK_END);
+	s->size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	return s;
+}
+int LFS_GetStreamSize(lfsStream_t *s) {
+	return s->size;
+}
+int LFS_ReadChunk(lfsStream_t *s, byte *buffer, int maxLen) {
+	return fread(buffer, 1, maxLen, s->f);
+}
+void LFS_CloseStream(lfsStream_t *s) {
+	fclose(s->f);
+	free(s);
+}
 void CMD_StartTCPCommandLine() {
 
 }
@@ -10,12 +10,6 @@ void CMD_StartTCPCommandLine() {
 void Main_SetupPingWatchDog(const char *target/*, int delayBetweenPings_Seconds*/) {
 
 }
-int PingWatchDog_GetTotalLost() {
-	return 0;
-}
-int PingWatchDog_GetTotalReceived() {
-	return 0;
-}
 
 
 // placeholder - TODO